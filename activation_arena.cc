@@ -0,0 +1,135 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "activation_arena.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif  // defined(__linux__)
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+#if defined(__linux__)
+// The size of the huge pages of every architecture the codec ships on.
+constexpr int64_t kHugePageBytes = int64_t{2} << 20;
+#endif  // defined(__linux__)
+
+}  // namespace
+
+std::unique_ptr<ActivationArena> ActivationArena::Create(int64_t num_bytes,
+                                                         bool use_huge_pages) {
+  if (num_bytes < 0) {
+    LOG(ERROR) << "The size of an activation arena has to be non-negative, "
+               << "but was " << num_bytes << ".";
+    return nullptr;
+  }
+  // Keeps |data_| valid for an empty arena.
+  const int64_t capacity = std::max(num_bytes, kAlignment);
+#if defined(__linux__)
+  if (use_huge_pages) {
+    const int64_t mapped_bytes =
+        (capacity + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+    void* data = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    bool uses_huge_pages = data != MAP_FAILED;
+    if (!uses_huge_pages) {
+      // No huge pages are reserved, so transparent ones are the next best.
+      data = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (data == MAP_FAILED) {
+        LOG(ERROR) << "Could not map " << mapped_bytes << " bytes.";
+        return nullptr;
+      }
+#if defined(MADV_HUGEPAGE)
+      uses_huge_pages = madvise(data, mapped_bytes, MADV_HUGEPAGE) == 0;
+#endif  // defined(MADV_HUGEPAGE)
+    }
+    LOG_IF(WARNING, !uses_huge_pages)
+        << "Huge pages are not available for the activation arena.";
+    return std::unique_ptr<ActivationArena>(
+        new ActivationArena(static_cast<char*>(data), capacity, mapped_bytes,
+                            uses_huge_pages));
+  }
+#else
+  LOG_IF(WARNING, use_huge_pages)
+      << "Huge pages are not supported on this platform.";
+#endif  // defined(__linux__)
+  char* data = static_cast<char*>(::operator new(
+      capacity, std::align_val_t(kAlignment), std::nothrow));
+  if (data == nullptr) {
+    LOG(ERROR) << "Could not allocate " << capacity << " bytes.";
+    return nullptr;
+  }
+  return std::unique_ptr<ActivationArena>(
+      new ActivationArena(data, capacity, /*mapped_bytes=*/0,
+                          /*uses_huge_pages=*/false));
+}
+
+ActivationArena::ActivationArena(char* data, int64_t capacity,
+                                 int64_t mapped_bytes, bool uses_huge_pages)
+    : data_(data),
+      capacity_(capacity),
+      mapped_bytes_(mapped_bytes),
+      uses_huge_pages_(uses_huge_pages) {}
+
+int64_t ActivationArena::Release() {
+#if defined(__linux__)
+  // Only whole pages can be given back. Those of a heap arena that sit
+  // entirely inside it hold nothing of the allocator, so they can be too. The
+  // mapping of huge pages starts and ends on huge page boundaries.
+  const int64_t page_bytes = sysconf(_SC_PAGESIZE);
+  const int64_t begin = reinterpret_cast<intptr_t>(data_);
+  const int64_t end = begin + (mapped_bytes_ > 0 ? mapped_bytes_ : capacity_);
+  const int64_t pages_begin =
+      (begin + page_bytes - 1) / page_bytes * page_bytes;
+  const int64_t pages_end = end / page_bytes * page_bytes;
+  if (pages_end > pages_begin &&
+      madvise(reinterpret_cast<void*>(pages_begin), pages_end - pages_begin,
+              MADV_DONTNEED) == 0) {
+    std::memset(data_, 0, pages_begin - begin);
+    std::memset(reinterpret_cast<void*>(pages_end), 0,
+                std::max<int64_t>(begin + capacity_ - pages_end, 0));
+    return pages_end - pages_begin;
+  }
+#endif  // defined(__linux__)
+  std::memset(data_, 0, capacity_);
+  return 0;
+}
+
+ActivationArena::~ActivationArena() {
+#if defined(__linux__)
+  if (mapped_bytes_ > 0) {
+    munmap(data_, mapped_bytes_);
+    return;
+  }
+#endif  // defined(__linux__)
+  ::operator delete(data_, std::align_val_t(kAlignment));
+}
+
+}  // namespace codec
+}  // namespace chromemedia
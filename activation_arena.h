@@ -0,0 +1,104 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_ACTIVATION_ARENA_H_
+#define LYRA_CODEC_ACTIVATION_ARENA_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+
+// One contiguous, cache-aligned block of memory that the activation buffers
+// of a model instance are carved from, so that they sit next to each other in
+// memory and the memory of an instance is known when it is created. Buffers
+// are only released with the whole arena.
+class ActivationArena {
+ public:
+  // Every buffer starts at a multiple of this.
+  static constexpr int64_t kAlignment = 64;
+
+  // Returns the bytes |Allocate<T>(size)| takes from an arena.
+  template <typename T>
+  static constexpr int64_t BytesFor(int64_t size) {
+    return (size * static_cast<int64_t>(sizeof(T)) + kAlignment - 1) /
+           kAlignment * kAlignment;
+  }
+
+  // Returns the number of elements of a |T| that fill |BytesFor<T>(size)|,
+  // which is the stride that keeps consecutive buffers aligned.
+  template <typename T>
+  static constexpr int64_t AlignedSize(int64_t size) {
+    return BytesFor<T>(size) / static_cast<int64_t>(sizeof(T));
+  }
+
+  // Returns an arena of at least |num_bytes|. If |use_huge_pages| is true,
+  // the arena is backed by huge pages when the kernel has some reserved, and
+  // otherwise asks for transparent huge pages, where both are supported.
+  // Returns a nullptr on failure.
+  static std::unique_ptr<ActivationArena> Create(int64_t num_bytes,
+                                                 bool use_huge_pages = false);
+
+  ~ActivationArena();
+
+  // Returns |size| zeroed elements of a |T| that have to fit into the rest of
+  // the arena. Crash ok, as the arena is sized for its buffers up front.
+  template <typename T>
+  T* Allocate(int64_t size) {
+    const int64_t num_bytes = BytesFor<T>(size);
+    CHECK_LE(bytes_used_ + num_bytes, capacity_)
+        << "The activation arena of " << capacity_ << " bytes is full.";
+    char* buffer = data_ + bytes_used_;
+    std::memset(buffer, 0, num_bytes);
+    bytes_used_ += num_bytes;
+    return reinterpret_cast<T*>(buffer);
+  }
+
+  // Zeroes the arena and gives the pages it spans back to the system, which
+  // maps zeroed pages in again on the next touch, e.g. while the buffers are
+  // not used for a long time. The buffers stay allocated and valid. Returns
+  // the number of bytes given back, which is 0 where that is not supported;
+  // the arena is zeroed either way.
+  int64_t Release();
+
+  int64_t capacity() const { return capacity_; }
+  int64_t bytes_used() const { return bytes_used_; }
+
+  // Whether the arena is backed by huge pages, or the kernel was asked for
+  // transparent huge pages for it.
+  bool uses_huge_pages() const { return uses_huge_pages_; }
+
+ private:
+  ActivationArena(char* data, int64_t capacity, int64_t mapped_bytes,
+                  bool uses_huge_pages);
+
+  char* const data_;
+  const int64_t capacity_;
+  // Bytes that were mapped for the arena, or 0 if it came from the heap.
+  const int64_t mapped_bytes_;
+  const bool uses_huge_pages_;
+  int64_t bytes_used_ = 0;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_ACTIVATION_ARENA_H_
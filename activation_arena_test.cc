@@ -0,0 +1,98 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "activation_arena.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(ActivationArenaTest, RoundsBuffersUpToCacheLines) {
+  EXPECT_EQ(ActivationArena::BytesFor<float>(0), 0);
+  EXPECT_EQ(ActivationArena::BytesFor<float>(1), 64);
+  EXPECT_EQ(ActivationArena::BytesFor<float>(16), 64);
+  EXPECT_EQ(ActivationArena::BytesFor<int16_t>(33), 128);
+  EXPECT_EQ(ActivationArena::AlignedSize<int16_t>(33), 64);
+}
+
+TEST(ActivationArenaTest, CarvesAlignedZeroedBuffers) {
+  const int64_t num_bytes = ActivationArena::BytesFor<float>(10) +
+                            ActivationArena::BytesFor<int16_t>(100);
+  auto arena = ActivationArena::Create(num_bytes);
+  ASSERT_NE(arena, nullptr);
+  EXPECT_GE(arena->capacity(), num_bytes);
+
+  float* floats = arena->Allocate<float>(10);
+  int16_t* ints = arena->Allocate<int16_t>(100);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(floats) % ActivationArena::kAlignment,
+            0);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ints) % ActivationArena::kAlignment,
+            0);
+  // The buffers are contiguous.
+  EXPECT_EQ(reinterpret_cast<char*>(ints) - reinterpret_cast<char*>(floats),
+            64);
+  for (int i = 0; i < 10; ++i) EXPECT_EQ(floats[i], 0.f);
+  for (int i = 0; i < 100; ++i) EXPECT_EQ(ints[i], 0);
+  EXPECT_EQ(arena->bytes_used(), num_bytes);
+}
+
+TEST(ActivationArenaTest, HugePagesFallBackToRegularPages) {
+  auto arena = ActivationArena::Create(4096, /*use_huge_pages=*/true);
+  ASSERT_NE(arena, nullptr);
+  int32_t* buffer = arena->Allocate<int32_t>(1024);
+  buffer[1023] = 7;
+  EXPECT_EQ(buffer[1023], 7);
+}
+
+TEST(ActivationArenaTest, ReleasedBuffersStayValidAndZeroed) {
+  for (const bool use_huge_pages : {false, true}) {
+    const int64_t num_floats = 1 << 20;
+    auto arena = ActivationArena::Create(
+        ActivationArena::BytesFor<float>(num_floats), use_huge_pages);
+    ASSERT_NE(arena, nullptr);
+    float* buffer = arena->Allocate<float>(num_floats);
+    for (int64_t i = 0; i < num_floats; ++i) buffer[i] = 1.f;
+
+    const int64_t num_released = arena->Release();
+#if defined(__linux__)
+    // All but the partial pages at both ends of the 4 MiB are given back.
+    EXPECT_GT(num_released, arena->capacity() / 2) << use_huge_pages;
+#endif  // defined(__linux__)
+    EXPECT_LE(num_released, arena->capacity());
+    for (int64_t i = 0; i < num_floats; ++i) {
+      ASSERT_EQ(buffer[i], 0.f) << i;
+    }
+    buffer[num_floats - 1] = 2.f;
+    EXPECT_EQ(buffer[num_floats - 1], 2.f);
+  }
+}
+
+TEST(ActivationArenaTest, FullArenaDies) {
+  auto arena = ActivationArena::Create(64);
+  ASSERT_NE(arena, nullptr);
+  arena->Allocate<float>(16);
+  EXPECT_DEATH(arena->Allocate<float>(1), "full");
+}
+
+TEST(ActivationArenaTest, NegativeSizeReturnsNullptr) {
+  EXPECT_EQ(ActivationArena::Create(-1), nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,180 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "active_speaker_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "log_mel_spectrogram_extractor_impl.h"
+#include "lyra_config.h"
+#include "lyra_feature_decoder.h"
+#include "lyra_model.h"
+#include "noise_estimator.h"
+#include "packet_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<ActiveSpeakerDetector> ActiveSpeakerDetector::Create(
+    const ghc::filesystem::path& model_path) {
+  return Create(LyraFeatureDecoder::Create(model_path));
+}
+
+std::unique_ptr<ActiveSpeakerDetector> ActiveSpeakerDetector::Create(
+    const std::shared_ptr<LyraModel>& model) {
+  return Create(LyraFeatureDecoder::Create(model));
+}
+
+std::unique_ptr<ActiveSpeakerDetector> ActiveSpeakerDetector::Create(
+    std::unique_ptr<LyraFeatureDecoder> feature_decoder) {
+  if (feature_decoder == nullptr) {
+    LOG(ERROR) << "Could not create Feature Decoder.";
+    return nullptr;
+  }
+  return absl::WrapUnique(
+      new ActiveSpeakerDetector(std::move(feature_decoder)));
+}
+
+ActiveSpeakerDetector::ActiveSpeakerDetector(
+    std::unique_ptr<LyraFeatureDecoder> feature_decoder)
+    : feature_decoder_(std::move(feature_decoder)),
+      smoothing_weight_(
+          std::min(1.0f, 1.0f / (kSmoothingSeconds * kFrameRate))) {}
+
+ActiveSpeakerDetector::StreamId ActiveSpeakerDetector::AddStream() {
+  Stream stream;
+  stream.noise_estimator = NoiseEstimator::Create(
+      feature_decoder_->num_features(), 1.0f / kFrameRate);
+  // Only fails for a frame duration that is not positive.
+  CHECK(stream.noise_estimator != nullptr);
+  const StreamId id = next_stream_id_++;
+  streams_.emplace(id, std::move(stream));
+  return id;
+}
+
+bool ActiveSpeakerDetector::RemoveStream(StreamId stream) {
+  return streams_.erase(stream) > 0;
+}
+
+int ActiveSpeakerDetector::Estimate(absl::Span<const StreamPacket> packets,
+                                    absl::Span<Activity> activities) {
+  CHECK_EQ(activities.size(), packets.size());
+  packets_.clear();
+  for (const StreamPacket& packet : packets) {
+    packets_.push_back(packet.packet);
+  }
+  statuses_.resize(packets.size());
+  features_.clear();
+  feature_decoder_->DecodeFeaturesBatch(packets_, absl::MakeSpan(statuses_),
+                                        &features_);
+
+  const int num_features = feature_decoder_->num_features();
+  const int num_frames_per_packet = feature_decoder_->num_frames_per_packet();
+  std::vector<float> frame(num_features);
+  int num_valid = 0;
+  int features_offset = 0;
+  for (int i = 0; i < packets.size(); ++i) {
+    Activity& activity = activities[i];
+    activity = Activity();
+    const PacketInterface::UnpackStatus status = statuses_[i];
+    const int packet_offset = features_offset;
+    if (status == PacketInterface::UnpackStatus::kUnpacked) {
+      features_offset += num_frames_per_packet * num_features;
+    }
+    const auto it = streams_.find(packets[i].stream);
+    if (it == streams_.end()) {
+      LOG(ERROR) << "There is no stream " << packets[i].stream << ".";
+      continue;
+    }
+    Stream& stream = it->second;
+    if (status == PacketInterface::UnpackStatus::kInvalid) {
+      continue;
+    }
+    if (status == PacketInterface::UnpackStatus::kEmpty) {
+      // DTX only sends empty packets for noise.
+      for (int f = 0; f < num_frames_per_packet; ++f) {
+        stream.smoothed_level_db *= 1.0f - smoothing_weight_;
+      }
+      activity.smoothed_level_db = stream.smoothed_level_db;
+      activity.valid = true;
+      ++num_valid;
+      continue;
+    }
+    bool success = true;
+    for (int f = 0; f < num_frames_per_packet && success; ++f) {
+      const auto frame_begin =
+          features_.begin() + packet_offset + f * num_features;
+      std::copy(frame_begin, frame_begin + num_features, frame.begin());
+      success = EstimateFrame(frame, &stream, &activity);
+    }
+    if (!success) {
+      activity = Activity();
+      continue;
+    }
+    activity.valid = true;
+    ++num_valid;
+  }
+  return num_valid;
+}
+
+bool ActiveSpeakerDetector::EstimateFrame(const std::vector<float>& features,
+                                          Stream* stream, Activity* activity) {
+  const auto is_similar_noise_or =
+      stream->noise_estimator->IsSimilarNoise(features);
+  if (!is_similar_noise_or.has_value()) {
+    LOG(ERROR) << "Unable to check noise estimation.";
+    return false;
+  }
+  // Like the encoder, only frames that are not similar to the noise update
+  // the estimate.
+  const bool is_speech = !is_similar_noise_or.value();
+  if (is_speech && !stream->noise_estimator->Update(features)) {
+    LOG(ERROR) << "Unable to update noise estimator.";
+    return false;
+  }
+  const float level_db = LevelDb(features);
+  const float speech_level_db = is_speech ? level_db : 0.0f;
+  stream->smoothed_level_db +=
+      smoothing_weight_ * (speech_level_db - stream->smoothed_level_db);
+
+  activity->is_speech = activity->is_speech || is_speech;
+  activity->level_db = std::max(activity->level_db, level_db);
+  activity->smoothed_level_db = stream->smoothed_level_db;
+  return true;
+}
+
+float ActiveSpeakerDetector::LevelDb(absl::Span<const float> features) {
+  // The features are the log of the mel band powers, floored and divided by
+  // the normalization factor.
+  const float norm = LogMelSpectrogramExtractorImpl::GetNormalizationFactor();
+  const float silence = LogMelSpectrogramExtractorImpl::GetSilenceValue();
+  double power = 0.0;
+  for (const float feature : features) {
+    power += std::exp(norm * (std::max(feature, silence) - silence));
+  }
+  return 10.0f * std::log10(static_cast<float>(power / features.size()));
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_ACTIVE_SPEAKER_DETECTOR_H_
+#define LYRA_CODEC_ACTIVE_SPEAKER_DETECTOR_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_feature_decoder.h"
+#include "lyra_model.h"
+#include "noise_estimator_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Estimates from the packets of many streams, e.g. the participants of a
+// conference, which of them are speaking and how loudly, so that a forwarding
+// server can pick the active speakers without decoding any audio. Only the
+// features of the packets are decoded, with a |LyraFeatureDecoder|, and every
+// stream keeps a |NoiseEstimator| of its own that the features are compared
+// against, like the encoder does for DTX.
+//
+// Not thread-safe.
+class ActiveSpeakerDetector {
+ public:
+  using StreamId = int64_t;
+
+  // The packet of one stream to |Estimate|.
+  struct StreamPacket {
+    StreamId stream;
+    // Empty for a packet DTX found to be noise.
+    absl::Span<const uint8_t> packet;
+  };
+
+  // What |Estimate| found in a packet.
+  struct Activity {
+    // False if the stream does not exist or the packet could not be decoded,
+    // in which case the other fields are unset.
+    bool valid = false;
+    // Whether any frame of the packet differs from the noise of the stream.
+    bool is_speech = false;
+    // The power of the loudest frame, in dB above the floor of the features.
+    float level_db = 0.0f;
+    // The level of speech in the stream, averaged over about
+    // |kSmoothingSeconds|, where frames of noise count as 0 dB. Ranks the
+    // streams by how actively they speak.
+    float smoothed_level_db = 0.0f;
+  };
+
+  static constexpr float kSmoothingSeconds = 1.0f;
+
+  // Returns a nullptr if |model_path| does not hold the quantizer tables.
+  static std::unique_ptr<ActiveSpeakerDetector> Create(
+      const ghc::filesystem::path& model_path);
+
+  // Same as above, but shares the quantizer tables through |model|. Returns a
+  // nullptr if |model| is null.
+  static std::unique_ptr<ActiveSpeakerDetector> Create(
+      const std::shared_ptr<LyraModel>& model);
+
+  // Same as above, but with the features of |feature_decoder|. Returns a
+  // nullptr if it is null.
+  static std::unique_ptr<ActiveSpeakerDetector> Create(
+      std::unique_ptr<LyraFeatureDecoder> feature_decoder);
+
+  // Adds a stream whose noise estimate starts at silence.
+  StreamId AddStream();
+
+  // Returns false if there is no such stream.
+  bool RemoveStream(StreamId stream);
+
+  // Estimates the activity of every packet of |packets| into the same entry
+  // of |activities|, which has to be as long as |packets|. The packets of one
+  // stream have to be in order. Returns the number of valid entries.
+  int Estimate(absl::Span<const StreamPacket> packets,
+               absl::Span<Activity> activities);
+
+  int num_streams() const { return static_cast<int>(streams_.size()); }
+
+ private:
+  struct Stream {
+    std::unique_ptr<NoiseEstimatorInterface> noise_estimator;
+    float smoothed_level_db = 0.0f;
+  };
+
+  explicit ActiveSpeakerDetector(
+      std::unique_ptr<LyraFeatureDecoder> feature_decoder);
+
+  // Returns the power of |features| in dB above the floor of the features.
+  static float LevelDb(absl::Span<const float> features);
+
+  // Compares with and updates the noise estimate of |stream|, and smooths
+  // its level. Returns false if the noise estimator fails.
+  bool EstimateFrame(const std::vector<float>& features, Stream* stream,
+                     Activity* activity);
+
+  const std::unique_ptr<LyraFeatureDecoder> feature_decoder_;
+  // The weight of a new frame in |Stream::smoothed_level_db|.
+  const float smoothing_weight_;
+  std::map<StreamId, Stream> streams_;
+  StreamId next_stream_id_ = 0;
+  // Reused across calls to |Estimate|.
+  std::vector<absl::Span<const uint8_t>> packets_;
+  std::vector<PacketInterface::UnpackStatus> statuses_;
+  std::vector<float> features_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_ACTIVE_SPEAKER_DETECTOR_H_
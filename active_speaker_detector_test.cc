@@ -0,0 +1,170 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "active_speaker_detector.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "log_mel_spectrogram_extractor_impl.h"
+#include "lyra_config.h"
+#include "lyra_feature_decoder.h"
+#include "packet.h"
+#include "quantized_bits.h"
+#include "testing/mock_vector_quantizer.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Gives access to the private constructor to inject a MockVectorQuantizer.
+class LyraFeatureDecoderPeer {
+ public:
+  static std::unique_ptr<LyraFeatureDecoder> Create(
+      std::unique_ptr<MockVectorQuantizer> vector_quantizer, int num_features,
+      int num_frames_per_packet) {
+    return absl::WrapUnique(new LyraFeatureDecoder(
+        std::move(vector_quantizer),
+        absl::make_unique<Packet<kNumQuantizationBits, 0>>(), num_features,
+        num_frames_per_packet));
+  }
+};
+
+namespace {
+
+using testing::_;
+using testing::Return;
+
+constexpr int kTestNumFeatures = 8;
+constexpr int kTestNumFramesPerPacket = 2;
+
+// Returns the features of a packet whose bands all are |db| above the floor.
+std::vector<float> FeaturesAboveFloor(float db) {
+  const float feature =
+      LogMelSpectrogramExtractorImpl::GetSilenceValue() +
+      db / 10.0f * std::log(10.0f) /
+          LogMelSpectrogramExtractorImpl::GetNormalizationFactor();
+  return std::vector<float>(kTestNumFeatures * kTestNumFramesPerPacket,
+                            feature);
+}
+
+class ActiveSpeakerDetectorTest : public testing::Test {
+ protected:
+  ActiveSpeakerDetectorTest()
+      : encoded_(Packet<kNumQuantizationBits, 0>().PackQuantized(
+            QuantizedBits(kNumQuantizationBits))) {
+    auto vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+    vector_quantizer_ = vector_quantizer.get();
+    detector_ = ActiveSpeakerDetector::Create(LyraFeatureDecoderPeer::Create(
+        std::move(vector_quantizer), kTestNumFeatures,
+        kTestNumFramesPerPacket));
+  }
+
+  const std::vector<uint8_t> encoded_;
+  MockVectorQuantizer* vector_quantizer_;
+  std::unique_ptr<ActiveSpeakerDetector> detector_;
+};
+
+TEST_F(ActiveSpeakerDetectorTest, LoudFramesAreSpeech) {
+  ASSERT_NE(detector_, nullptr);
+  EXPECT_CALL(*vector_quantizer_, DecodeToLossyFeatures(_))
+      .WillOnce(Return(FeaturesAboveFloor(0.0f)))
+      .WillOnce(Return(FeaturesAboveFloor(40.0f)));
+  const ActiveSpeakerDetector::StreamId stream = detector_->AddStream();
+
+  std::vector<ActiveSpeakerDetector::Activity> activities(1);
+  ASSERT_EQ(detector_->Estimate({{stream, encoded_}},
+                                absl::MakeSpan(activities)),
+            1);
+  EXPECT_TRUE(activities[0].valid);
+  EXPECT_FALSE(activities[0].is_speech);
+  EXPECT_NEAR(activities[0].level_db, 0.0f, 1e-3f);
+  EXPECT_EQ(activities[0].smoothed_level_db, 0.0f);
+
+  ASSERT_EQ(detector_->Estimate({{stream, encoded_}},
+                                absl::MakeSpan(activities)),
+            1);
+  EXPECT_TRUE(activities[0].is_speech);
+  EXPECT_NEAR(activities[0].level_db, 40.0f, 1e-2f);
+  EXPECT_GT(activities[0].smoothed_level_db, 0.0f);
+  EXPECT_LT(activities[0].smoothed_level_db, 40.0f);
+}
+
+TEST_F(ActiveSpeakerDetectorTest, LouderStreamRanksHigher) {
+  ASSERT_NE(detector_, nullptr);
+  EXPECT_CALL(*vector_quantizer_, DecodeToLossyFeatures(_))
+      .WillOnce(Return(FeaturesAboveFloor(20.0f)))
+      .WillOnce(Return(FeaturesAboveFloor(50.0f)));
+  const ActiveSpeakerDetector::StreamId quiet = detector_->AddStream();
+  const ActiveSpeakerDetector::StreamId loud = detector_->AddStream();
+  EXPECT_EQ(detector_->num_streams(), 2);
+
+  std::vector<ActiveSpeakerDetector::Activity> activities(2);
+  ASSERT_EQ(detector_->Estimate({{quiet, encoded_}, {loud, encoded_}},
+                                absl::MakeSpan(activities)),
+            2);
+  EXPECT_TRUE(activities[0].is_speech);
+  EXPECT_TRUE(activities[1].is_speech);
+  EXPECT_GT(activities[1].smoothed_level_db, activities[0].smoothed_level_db);
+}
+
+TEST_F(ActiveSpeakerDetectorTest, EmptyPacketsAreNoiseAndInvalidOnesFail) {
+  ASSERT_NE(detector_, nullptr);
+  // The packet of the missing stream is decoded too.
+  EXPECT_CALL(*vector_quantizer_, DecodeToLossyFeatures(_))
+      .Times(2)
+      .WillRepeatedly(Return(FeaturesAboveFloor(40.0f)));
+  const ActiveSpeakerDetector::StreamId stream = detector_->AddStream();
+  std::vector<ActiveSpeakerDetector::Activity> activities(1);
+  ASSERT_EQ(detector_->Estimate({{stream, encoded_}},
+                                absl::MakeSpan(activities)),
+            1);
+  const float speech_level_db = activities[0].smoothed_level_db;
+
+  const std::vector<uint8_t> truncated(encoded_.begin(), encoded_.end() - 1);
+  activities.resize(3);
+  EXPECT_EQ(detector_->Estimate({{stream, {}},
+                                 {stream, truncated},
+                                 {stream + 1, encoded_}},
+                                absl::MakeSpan(activities)),
+            1);
+  EXPECT_TRUE(activities[0].valid);
+  EXPECT_FALSE(activities[0].is_speech);
+  // The level of the stream decays during noise.
+  EXPECT_LT(activities[0].smoothed_level_db, speech_level_db);
+  EXPECT_FALSE(activities[1].valid);
+  EXPECT_FALSE(activities[2].valid);
+
+  EXPECT_TRUE(detector_->RemoveStream(stream));
+  EXPECT_FALSE(detector_->RemoveStream(stream));
+}
+
+TEST(ActiveSpeakerDetectorCreate, NullFeatureDecoderReturnsNullptr) {
+  EXPECT_EQ(ActiveSpeakerDetector::Create(
+                std::unique_ptr<LyraFeatureDecoder>(nullptr)),
+            nullptr);
+  EXPECT_EQ(ActiveSpeakerDetector::Create(std::shared_ptr<LyraModel>()),
+            nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
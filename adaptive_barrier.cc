@@ -0,0 +1,108 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "adaptive_barrier.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cpu_pause.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+struct GenerationWaiter {
+  const std::atomic<uint32_t>* generation;
+  uint32_t generation_seen;
+};
+
+bool HasNewGeneration(GenerationWaiter* waiter) {
+  return waiter->generation->load() != waiter->generation_seen;
+}
+
+}  // namespace
+
+AdaptiveBarrier::AdaptiveBarrier(int num_threads)
+    : num_threads_(num_threads),
+      num_arrived_(0),
+      generation_(0),
+      num_blocked_(0),
+      wait_times_(num_threads) {
+  CHECK_GE(num_threads, 1);
+}
+
+void AdaptiveBarrier::Wait(int tid) {
+  const int64_t start_nanos = absl::GetCurrentTimeNanos();
+  const uint32_t generation = generation_.load();
+  if (num_arrived_.fetch_add(1) + 1 == num_threads_) {
+    // |num_arrived_| is reset before the others are released, which may
+    // arrive at the next barrier right away.
+    num_arrived_.store(0);
+    generation_.fetch_add(1);
+    if (num_blocked_.load() > 0) {
+      // Blocked threads re-evaluate their condition on unlock.
+      absl::MutexLock lock(&mutex_);
+    }
+  } else {
+    WaitForGeneration(generation);
+  }
+  wait_times_[tid].nanos.fetch_add(absl::GetCurrentTimeNanos() - start_nanos,
+                                   std::memory_order_relaxed);
+}
+
+absl::Duration AdaptiveBarrier::wait_time(int tid) const {
+  return absl::Nanoseconds(
+      wait_times_[tid].nanos.load(std::memory_order_relaxed));
+}
+
+void AdaptiveBarrier::ResetWaitTimes() {
+  for (WaitTime& wait_time : wait_times_) {
+    wait_time.nanos.store(0, std::memory_order_relaxed);
+  }
+}
+
+void AdaptiveBarrier::WaitForGeneration(uint32_t generation) {
+  GenerationWaiter waiter{&generation_, generation};
+  for (int i = 0; i < kNumPauses; ++i) {
+    if (HasNewGeneration(&waiter)) {
+      return;
+    }
+    CpuPause();
+  }
+  const absl::Time yield_end = absl::Now() + kYieldBeforeBlocking;
+  while (!HasNewGeneration(&waiter)) {
+    if (absl::Now() > yield_end) {
+      // The last thread to arrive either sees |num_blocked_| incremented and
+      // wakes this thread, or has incremented |generation_| already, which
+      // the condition then sees.
+      num_blocked_.fetch_add(1);
+      {
+        absl::MutexLock lock(&mutex_);
+        mutex_.Await(absl::Condition(&HasNewGeneration, &waiter));
+      }
+      num_blocked_.fetch_sub(1);
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
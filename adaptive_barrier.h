@@ -0,0 +1,83 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_ADAPTIVE_BARRIER_H_
+#define LYRA_CODEC_ADAPTIVE_BARRIER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A barrier for a fixed number of threads like |csrblocksparse::SpinBarrier|,
+// which spins until the last thread arrives. When a thread that the others
+// wait for is descheduled, e.g. on a host with more threads than cores, pure
+// spinning keeps the cores busy for a whole scheduler quantum. A waiting
+// thread here spins with a CPU pause for |kNumPauses| iterations, then yields
+// its core for up to |kYieldBeforeBlocking|, and then blocks until the last
+// thread arrives. Also accumulates the time each thread waited, which shows
+// how evenly the work between two barriers is split.
+class AdaptiveBarrier {
+ public:
+  explicit AdaptiveBarrier(int num_threads);
+
+  // Returns once all |num_threads| threads called it. |tid| is in
+  // [0, |num_threads|) and distinct for every thread.
+  void Wait(int tid);
+
+  // The total time thread |tid| spent in |Wait| since the construction or the
+  // last |ResetWaitTimes|.
+  absl::Duration wait_time(int tid) const;
+
+  // Must not be called concurrently with |Wait|.
+  void ResetWaitTimes();
+
+  int num_threads() const { return num_threads_; }
+
+ private:
+  static constexpr int kNumPauses = 1000;
+  static constexpr absl::Duration kYieldBeforeBlocking = absl::Microseconds(50);
+
+  // Returns once |generation_| differs from |generation|.
+  void WaitForGeneration(uint32_t generation);
+
+  const int num_threads_;
+  // The number of threads in the current generation that arrived.
+  std::atomic<int> num_arrived_;
+  // Incremented by the last thread to arrive, which releases the others.
+  std::atomic<uint32_t> generation_;
+  // The number of threads blocked on |mutex_|, which the last thread to
+  // arrive then has to wake.
+  std::atomic<int> num_blocked_;
+  absl::Mutex mutex_;
+
+  // One per thread, each on its own cache line so that the threads do not
+  // invalidate each other's when they update theirs.
+  struct alignas(64) WaitTime {
+    std::atomic<int64_t> nanos{0};
+  };
+  std::vector<WaitTime> wait_times_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_ADAPTIVE_BARRIER_H_
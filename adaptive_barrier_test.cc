@@ -0,0 +1,98 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "adaptive_barrier.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Calls |func| with every tid in [0, |num_threads|), each on its own thread.
+void RunOnThreads(int num_threads, const std::function<void(int)>& func) {
+  std::vector<std::thread> threads;
+  for (int tid = 1; tid < num_threads; ++tid) {
+    threads.emplace_back(func, tid);
+  }
+  func(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+class AdaptiveBarrierTest : public testing::TestWithParam<int> {
+ protected:
+  AdaptiveBarrierTest() : barrier_(GetParam()) {}
+
+  AdaptiveBarrier barrier_;
+};
+
+TEST_P(AdaptiveBarrierTest, NoThreadPassesBeforeAllArrived) {
+  constexpr int kNumRounds = 1000;
+  std::vector<std::atomic<int>> rounds(GetParam());
+  for (auto& round : rounds) round.store(0);
+  std::atomic<bool> passed_early(false);
+  RunOnThreads(GetParam(), [&](int tid) {
+    for (int round = 0; round < kNumRounds; ++round) {
+      rounds[tid].store(round + 1);
+      barrier_.Wait(tid);
+      for (const auto& other_round : rounds) {
+        if (other_round.load() < round + 1) passed_early.store(true);
+      }
+      // Nobody starts the next round before everyone checked this one.
+      barrier_.Wait(tid);
+    }
+  });
+  EXPECT_FALSE(passed_early.load());
+}
+
+TEST_P(AdaptiveBarrierTest, WaitsForADescheduledThread) {
+  // A thread that arrives a lot later makes the others block, which they
+  // return from once it arrives.
+  const absl::Duration kDelay = absl::Milliseconds(20);
+  RunOnThreads(GetParam(), [&](int tid) {
+    if (tid == 0) absl::SleepFor(kDelay);
+    barrier_.Wait(tid);
+  });
+  for (int tid = 1; tid < GetParam(); ++tid) {
+    EXPECT_GE(barrier_.wait_time(tid), kDelay / 2) << tid;
+  }
+  EXPECT_LT(barrier_.wait_time(0), kDelay / 2);
+}
+
+TEST_P(AdaptiveBarrierTest, ResetWaitTimes) {
+  RunOnThreads(GetParam(), [&](int tid) {
+    if (tid == 0) absl::SleepFor(absl::Milliseconds(1));
+    barrier_.Wait(tid);
+  });
+  barrier_.ResetWaitTimes();
+  for (int tid = 0; tid < GetParam(); ++tid) {
+    EXPECT_EQ(barrier_.wait_time(tid), absl::ZeroDuration()) << tid;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(NumThreads, AdaptiveBarrierTest,
+                         testing::Values(1, 2, 4));
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
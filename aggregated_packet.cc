@@ -0,0 +1,152 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "aggregated_packet.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kVersion = 0;
+constexpr int kVersionShift = 6;
+constexpr uint8_t kRedundantPacketFlag = 1 << 5;
+constexpr uint8_t kNumPacketsMask = kMaxNumPacketsPerPayload - 1;
+
+}  // namespace
+
+absl::optional<AggregatedPayload> ParseAggregatedPayload(
+    absl::Span<const uint8_t> payload, int packet_size) {
+  if (payload.size() < kAggregatedPayloadHeaderSize) {
+    LOG(ERROR) << "Payload of " << payload.size()
+               << " bytes is too short for the header.";
+    return absl::nullopt;
+  }
+  const uint8_t flags = payload[0];
+  if ((flags >> kVersionShift) != kVersion) {
+    LOG(ERROR) << "Unsupported payload version " << (flags >> kVersionShift)
+               << ".";
+    return absl::nullopt;
+  }
+  const bool has_redundant_packet = (flags & kRedundantPacketFlag) != 0;
+  const int num_packets = (flags & kNumPacketsMask) + 1;
+  const int expected_size =
+      kAggregatedPayloadHeaderSize +
+      (num_packets + (has_redundant_packet ? 1 : 0)) * packet_size;
+  if (payload.size() != expected_size) {
+    LOG(ERROR) << "Payload of " << payload.size() << " bytes but expected "
+               << expected_size << ".";
+    return absl::nullopt;
+  }
+
+  AggregatedPayload parsed;
+  parsed.sequence_number = payload[1];
+  int offset = kAggregatedPayloadHeaderSize;
+  if (has_redundant_packet) {
+    parsed.redundant_packet = payload.subspan(offset, packet_size);
+    offset += packet_size;
+  }
+  parsed.packets.reserve(num_packets);
+  for (int i = 0; i < num_packets; ++i) {
+    parsed.packets.push_back(payload.subspan(offset, packet_size));
+    offset += packet_size;
+  }
+  return parsed;
+}
+
+std::unique_ptr<PacketAggregator> PacketAggregator::Create(
+    int packet_size, int num_packets_per_payload, bool redundancy) {
+  if (packet_size <= 0) {
+    LOG(ERROR) << "Packet size has to be positive but was " << packet_size
+               << ".";
+    return nullptr;
+  }
+  if (num_packets_per_payload < 1 ||
+      num_packets_per_payload > kMaxNumPacketsPerPayload) {
+    LOG(ERROR) << "Number of packets per payload has to be in [1, "
+               << kMaxNumPacketsPerPayload << "] but was "
+               << num_packets_per_payload << ".";
+    return nullptr;
+  }
+  return absl::WrapUnique(
+      new PacketAggregator(packet_size, num_packets_per_payload, redundancy));
+}
+
+PacketAggregator::PacketAggregator(int packet_size,
+                                   int num_packets_per_payload,
+                                   bool redundancy)
+    : packet_size_(packet_size),
+      num_packets_per_payload_(num_packets_per_payload),
+      redundancy_(redundancy),
+      next_sequence_number_(0) {
+  packets_.reserve(packet_size_ * num_packets_per_payload_);
+}
+
+absl::optional<std::vector<uint8_t>> PacketAggregator::AddPacket(
+    absl::Span<const uint8_t> packet) {
+  if (packet.size() != packet_size_) {
+    LOG(ERROR) << "Packet of " << packet.size() << " bytes but expected "
+               << packet_size_ << ".";
+    return absl::nullopt;
+  }
+  packets_.insert(packets_.end(), packet.begin(), packet.end());
+  ++next_sequence_number_;
+  if (packets_.size() < packet_size_ * num_packets_per_payload_) {
+    return absl::nullopt;
+  }
+  return Flush();
+}
+
+absl::optional<std::vector<uint8_t>> PacketAggregator::Flush() {
+  if (packets_.empty()) {
+    return absl::nullopt;
+  }
+  const int num_packets = packets_.size() / packet_size_;
+  const bool has_redundant_packet = redundancy_ && !previous_packet_.empty();
+  std::vector<uint8_t> payload;
+  payload.reserve(kAggregatedPayloadHeaderSize +
+                  (num_packets + (has_redundant_packet ? 1 : 0)) *
+                      packet_size_);
+  payload.push_back((kVersion << kVersionShift) |
+                    (has_redundant_packet ? kRedundantPacketFlag : 0) |
+                    (num_packets - 1));
+  payload.push_back(static_cast<uint8_t>(next_sequence_number_ - num_packets));
+  if (has_redundant_packet) {
+    payload.insert(payload.end(), previous_packet_.begin(),
+                   previous_packet_.end());
+  }
+  payload.insert(payload.end(), packets_.begin(), packets_.end());
+
+  if (redundancy_) {
+    previous_packet_.assign(packets_.end() - packet_size_, packets_.end());
+  }
+  packets_.clear();
+  return payload;
+}
+
+int PacketAggregator::payload_size() const {
+  return kAggregatedPayloadHeaderSize +
+         (num_packets_per_payload_ + (redundancy_ ? 1 : 0)) * packet_size_;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_AGGREGATED_PACKET_H_
+#define LYRA_CODEC_AGGREGATED_PACKET_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A payload carries several consecutive Lyra packets, so that they share the
+// per packet transport overhead, and optionally a redundant copy of the last
+// packet of the previous payload, so that losing a payload loses one packet
+// less. It is laid out as:
+//  +--------+--------+-----------------+----------+-----+----------+
+//  | flags  |  seq   | [redundant]     | packet 0 | ... | packet n |
+//  +--------+--------+-----------------+----------+-----+----------+
+// The flags byte holds the format version in its 2 most significant bits,
+// whether the redundant packet is present in the next bit and the number of
+// packets minus 1 in the 5 least significant bits. |seq| is the sequence
+// number modulo 256 of packet 0, counted in packets.
+inline constexpr int kAggregatedPayloadHeaderSize = 2;
+inline constexpr int kMaxNumPacketsPerPayload = 32;
+
+struct AggregatedPayload {
+  // The sequence number of the first of |packets|.
+  uint8_t sequence_number;
+  // The packet before the first of |packets|, if the payload carries it.
+  absl::optional<absl::Span<const uint8_t>> redundant_packet;
+  std::vector<absl::Span<const uint8_t>> packets;
+};
+
+// Returns the packets of |payload|, which point into it, or a nullopt if it is
+// not a valid payload of packets of |packet_size| bytes.
+absl::optional<AggregatedPayload> ParseAggregatedPayload(
+    absl::Span<const uint8_t> payload, int packet_size);
+
+// Collects consecutive packets into payloads of the format above.
+class PacketAggregator {
+ public:
+  // Returns a nullptr if |packet_size| is not positive or
+  // |num_packets_per_payload| is not in [1, |kMaxNumPacketsPerPayload|].
+  // With |redundancy| every payload but the first carries the last packet of
+  // the previous one.
+  static std::unique_ptr<PacketAggregator> Create(int packet_size,
+                                                  int num_packets_per_payload,
+                                                  bool redundancy);
+
+  // Adds the next packet. Returns the payload once it holds
+  // |num_packets_per_payload| packets, otherwise a nullopt. Also returns a
+  // nullopt and drops |packet| if it does not have |packet_size| bytes.
+  absl::optional<std::vector<uint8_t>> AddPacket(
+      absl::Span<const uint8_t> packet);
+
+  // Returns the payload of the packets added since the last one was returned,
+  // if there are any, e.g. at the end of a stream.
+  absl::optional<std::vector<uint8_t>> Flush();
+
+  // The size of a full payload in bytes.
+  int payload_size() const;
+
+ private:
+  PacketAggregator(int packet_size, int num_packets_per_payload,
+                   bool redundancy);
+
+  const int packet_size_;
+  const int num_packets_per_payload_;
+  const bool redundancy_;
+  // The sequence number of the next added packet.
+  uint8_t next_sequence_number_;
+  // The packets of the payload under construction, concatenated.
+  std::vector<uint8_t> packets_;
+  // The last packet of the previous payload, empty before the first one.
+  std::vector<uint8_t> previous_packet_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_AGGREGATED_PACKET_H_
@@ -0,0 +1,138 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "aggregated_packet.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::ElementsAreArray;
+
+constexpr int kPacketSize = 3;
+
+std::vector<uint8_t> MakePacket(uint8_t value) {
+  return std::vector<uint8_t>(kPacketSize, value);
+}
+
+TEST(AggregatedPacketTest, CreateFailsWithInvalidParams) {
+  EXPECT_EQ(PacketAggregator::Create(0, 2, false), nullptr);
+  EXPECT_EQ(PacketAggregator::Create(kPacketSize, 0, false), nullptr);
+  EXPECT_EQ(PacketAggregator::Create(kPacketSize, kMaxNumPacketsPerPayload + 1,
+                                     false),
+            nullptr);
+}
+
+TEST(AggregatedPacketTest, AggregatesPackets) {
+  auto aggregator = PacketAggregator::Create(kPacketSize, 3, false);
+  ASSERT_NE(aggregator, nullptr);
+  EXPECT_FALSE(aggregator->AddPacket(MakePacket(1)).has_value());
+  EXPECT_FALSE(aggregator->AddPacket(MakePacket(2)).has_value());
+  const auto payload_or = aggregator->AddPacket(MakePacket(3));
+  ASSERT_TRUE(payload_or.has_value());
+  EXPECT_EQ(payload_or->size(), aggregator->payload_size());
+
+  const auto parsed_or = ParseAggregatedPayload(*payload_or, kPacketSize);
+  ASSERT_TRUE(parsed_or.has_value());
+  EXPECT_EQ(parsed_or->sequence_number, 0);
+  EXPECT_FALSE(parsed_or->redundant_packet.has_value());
+  ASSERT_EQ(parsed_or->packets.size(), 3);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_THAT(parsed_or->packets[i], ElementsAreArray(MakePacket(i + 1)));
+  }
+}
+
+TEST(AggregatedPacketTest, CarriesLastPacketOfPreviousPayload) {
+  auto aggregator = PacketAggregator::Create(kPacketSize, 2, true);
+  ASSERT_NE(aggregator, nullptr);
+  aggregator->AddPacket(MakePacket(1));
+  const auto first_or = aggregator->AddPacket(MakePacket(2));
+  ASSERT_TRUE(first_or.has_value());
+  aggregator->AddPacket(MakePacket(3));
+  const auto second_or = aggregator->AddPacket(MakePacket(4));
+  ASSERT_TRUE(second_or.has_value());
+  EXPECT_EQ(second_or->size(), aggregator->payload_size());
+
+  // The first payload has nothing to repeat.
+  const auto first_parsed_or = ParseAggregatedPayload(*first_or, kPacketSize);
+  ASSERT_TRUE(first_parsed_or.has_value());
+  EXPECT_FALSE(first_parsed_or->redundant_packet.has_value());
+
+  const auto parsed_or = ParseAggregatedPayload(*second_or, kPacketSize);
+  ASSERT_TRUE(parsed_or.has_value());
+  EXPECT_EQ(parsed_or->sequence_number, 2);
+  ASSERT_TRUE(parsed_or->redundant_packet.has_value());
+  EXPECT_THAT(*parsed_or->redundant_packet, ElementsAreArray(MakePacket(2)));
+  ASSERT_EQ(parsed_or->packets.size(), 2);
+  EXPECT_THAT(parsed_or->packets[0], ElementsAreArray(MakePacket(3)));
+  EXPECT_THAT(parsed_or->packets[1], ElementsAreArray(MakePacket(4)));
+}
+
+TEST(AggregatedPacketTest, FlushReturnsPartialPayload) {
+  auto aggregator = PacketAggregator::Create(kPacketSize, 4, false);
+  ASSERT_NE(aggregator, nullptr);
+  EXPECT_FALSE(aggregator->Flush().has_value());
+  aggregator->AddPacket(MakePacket(7));
+  const auto payload_or = aggregator->Flush();
+  ASSERT_TRUE(payload_or.has_value());
+  const auto parsed_or = ParseAggregatedPayload(*payload_or, kPacketSize);
+  ASSERT_TRUE(parsed_or.has_value());
+  ASSERT_EQ(parsed_or->packets.size(), 1);
+  EXPECT_THAT(parsed_or->packets[0], ElementsAreArray(MakePacket(7)));
+  EXPECT_FALSE(aggregator->Flush().has_value());
+}
+
+TEST(AggregatedPacketTest, AddPacketFailsWithWrongSize) {
+  auto aggregator = PacketAggregator::Create(kPacketSize, 1, false);
+  ASSERT_NE(aggregator, nullptr);
+  EXPECT_FALSE(
+      aggregator->AddPacket(std::vector<uint8_t>(kPacketSize + 1)).has_value());
+  EXPECT_FALSE(aggregator->Flush().has_value());
+}
+
+TEST(AggregatedPacketTest, ParseFailsOnInvalidPayloads) {
+  EXPECT_FALSE(ParseAggregatedPayload({}, kPacketSize).has_value());
+  // One packet announced, none present.
+  const std::vector<uint8_t> truncated = {0, 0};
+  EXPECT_FALSE(ParseAggregatedPayload(truncated, kPacketSize).has_value());
+  // Unknown version.
+  std::vector<uint8_t> other_version = {1 << 6, 0};
+  other_version.resize(other_version.size() + kPacketSize);
+  EXPECT_FALSE(ParseAggregatedPayload(other_version, kPacketSize).has_value());
+}
+
+TEST(AggregatedPacketTest, SequenceNumbersWrapAround) {
+  auto aggregator = PacketAggregator::Create(kPacketSize, 3, false);
+  ASSERT_NE(aggregator, nullptr);
+  absl::optional<std::vector<uint8_t>> payload_or;
+  for (int i = 0; i < 258; ++i) {
+    payload_or = aggregator->AddPacket(MakePacket(0));
+  }
+  ASSERT_TRUE(payload_or.has_value());
+  // Packets 255, 256 and 257.
+  EXPECT_EQ(ParseAggregatedPayload(*payload_or, kPacketSize)->sequence_number,
+            255);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,278 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "android_example/aaudio_player.h"
+
+#include <aaudio/AAudio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "lyra_config.h"
+#include "realtime_renderer.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr absl::Duration kLatencyInterval = absl::Milliseconds(100);
+constexpr int64_t kStopTimeoutNanos = 100000000;
+
+// The rate the stream is reopened at if the native one is not supported.
+constexpr int kFallbackSampleRateHz = 48000;
+
+void ErrorCallback(AAudioStream* stream, void* user_data,
+                   aaudio_result_t error) {
+  // The stream cannot be restarted from this callback, and the player is
+  // expected to be recreated by the app when its device goes away.
+  LOG(ERROR) << "The AAudio stream stopped: "
+             << AAudio_convertResultToText(error);
+}
+
+int64_t MonotonicNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Opens a stream calling |data_callback| with |user_data|, at |sample_rate_hz|
+// unless it is 0, in which case the device picks its native rate.
+AAudioStream* OpenStream(int sample_rate_hz, void* user_data,
+                         AAudioStream_dataCallback data_callback) {
+  AAudioStreamBuilder* builder;
+  aaudio_result_t result = AAudio_createStreamBuilder(&builder);
+  if (result != AAUDIO_OK) {
+    LOG(ERROR) << "Could not create an AAudio stream builder: "
+               << AAudio_convertResultToText(result);
+    return nullptr;
+  }
+  AAudioStreamBuilder_setDirection(builder, AAUDIO_DIRECTION_OUTPUT);
+  AAudioStreamBuilder_setPerformanceMode(builder,
+                                         AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+  AAudioStreamBuilder_setSharingMode(builder, AAUDIO_SHARING_MODE_EXCLUSIVE);
+  AAudioStreamBuilder_setFormat(builder, AAUDIO_FORMAT_PCM_I16);
+  AAudioStreamBuilder_setChannelCount(builder, kNumChannels);
+  if (sample_rate_hz > 0) {
+    AAudioStreamBuilder_setSampleRate(builder, sample_rate_hz);
+  }
+  AAudioStreamBuilder_setDataCallback(builder, data_callback, user_data);
+  AAudioStreamBuilder_setErrorCallback(builder, ErrorCallback, user_data);
+  AAudioStream* stream = nullptr;
+  result = AAudioStreamBuilder_openStream(builder, &stream);
+  AAudioStreamBuilder_delete(builder);
+  if (result != AAUDIO_OK) {
+    LOG(ERROR) << "Could not open an AAudio stream: "
+               << AAudio_convertResultToText(result);
+    return nullptr;
+  }
+  return stream;
+}
+
+}  // namespace
+
+std::unique_ptr<AAudioPlayer> AAudioPlayer::Create(
+    const std::function<RealtimeRenderer::SampleSource(int sample_rate_hz)>&
+        make_source,
+    int num_bursts_ahead) {
+  // The data callback finds the player through this holder, since the stream
+  // has to be open to know the rate of the renderer the player is made of.
+  auto player_holder = absl::make_unique<std::atomic<AAudioPlayer*>>(nullptr);
+  AAudioStream* stream =
+      OpenStream(/*sample_rate_hz=*/0, player_holder.get(), DataCallback);
+  if (stream != nullptr &&
+      !IsSampleRateSupported(AAudioStream_getSampleRate(stream))) {
+    LOG(INFO) << "The native sample rate of "
+              << AAudioStream_getSampleRate(stream)
+              << " Hz is not supported, playing at " << kFallbackSampleRateHz
+              << " Hz.";
+    AAudioStream_close(stream);
+    stream =
+        OpenStream(kFallbackSampleRateHz, player_holder.get(), DataCallback);
+  }
+  if (stream == nullptr) {
+    return nullptr;
+  }
+  const int sample_rate_hz = AAudioStream_getSampleRate(stream);
+  const int frames_per_burst = AAudioStream_getFramesPerBurst(stream);
+  if (AAudioStream_getSharingMode(stream) != AAUDIO_SHARING_MODE_EXCLUSIVE) {
+    LOG(INFO) << "The AAudio stream is shared, which adds the latency of the "
+                 "mixer.";
+  }
+  // Two bursts are the smallest buffer that does not underrun whenever a
+  // callback is a little late.
+  AAudioStream_setBufferSizeInFrames(stream, 2 * frames_per_burst);
+
+  auto renderer = RealtimeRenderer::Create(sample_rate_hz, frames_per_burst,
+                                           num_bursts_ahead,
+                                           make_source(sample_rate_hz));
+  if (renderer == nullptr) {
+    AAudioStream_close(stream);
+    return nullptr;
+  }
+  auto player =
+      absl::WrapUnique(new AAudioPlayer(stream, std::move(renderer)));
+  player->player_holder_ = std::move(player_holder);
+  player->player_holder_->store(player.get(), std::memory_order_release);
+  const aaudio_result_t result = AAudioStream_requestStart(stream);
+  if (result != AAUDIO_OK) {
+    LOG(ERROR) << "Could not start the AAudio stream: "
+               << AAudio_convertResultToText(result);
+    return nullptr;
+  }
+  return player;
+}
+
+AAudioPlayer::AAudioPlayer(AAudioStream* stream,
+                           std::unique_ptr<RealtimeRenderer> renderer)
+    : stream_(stream),
+      sample_rate_hz_(AAudioStream_getSampleRate(stream)),
+      frames_per_burst_(AAudioStream_getFramesPerBurst(stream)),
+      renderer_(std::move(renderer)),
+      num_callbacks_(0),
+      num_callback_overruns_(0),
+      max_callback_nanos_(0),
+      terminate_(false) {
+  monitor_ =
+      absl::make_unique<csrblocksparse::Thread>([this]() { RunMonitor(); });
+}
+
+AAudioPlayer::~AAudioPlayer() {
+  terminate_.store(true, std::memory_order_relaxed);
+  monitor_->join();
+  // The data callback uses the renderer until the stream has stopped.
+  if (AAudioStream_requestStop(stream_) == AAUDIO_OK) {
+    aaudio_stream_state_t state = AAUDIO_STREAM_STATE_STOPPING;
+    while (state == AAUDIO_STREAM_STATE_STOPPING) {
+      if (AAudioStream_waitForStateChange(stream_, state, &state,
+                                          kStopTimeoutNanos) != AAUDIO_OK) {
+        break;
+      }
+    }
+  }
+  AAudioStream_close(stream_);
+}
+
+aaudio_data_callback_result_t AAudioPlayer::DataCallback(AAudioStream* stream,
+                                                         void* user_data,
+                                                         void* audio_data,
+                                                         int32_t num_frames) {
+  int16_t* const output = static_cast<int16_t*>(audio_data);
+  AAudioPlayer* const player =
+      static_cast<std::atomic<AAudioPlayer*>*>(user_data)->load(
+          std::memory_order_acquire);
+  if (player == nullptr) {
+    std::fill(output, output + num_frames, 0);
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+  }
+  const int64_t begin_nanos = MonotonicNanos();
+  player->renderer_->Render(absl::MakeSpan(output, num_frames));
+  const int64_t duration_nanos = MonotonicNanos() - begin_nanos;
+
+  player->num_callbacks_.fetch_add(1, std::memory_order_relaxed);
+  if (duration_nanos * player->sample_rate_hz_ >
+      static_cast<int64_t>(num_frames) * 1000000000) {
+    player->num_callback_overruns_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (duration_nanos >
+      player->max_callback_nanos_.load(std::memory_order_relaxed)) {
+    player->max_callback_nanos_.store(duration_nanos,
+                                      std::memory_order_relaxed);
+  }
+  return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+void AAudioPlayer::RunMonitor() {
+  while (!terminate_.load(std::memory_order_relaxed)) {
+    absl::SleepFor(kLatencyInterval);
+    const double latency_ms = LatencyMs();
+    if (latency_ms < 0.0) {
+      continue;
+    }
+    absl::MutexLock lock(&latency_mutex_);
+    latency_sum_ms_ += latency_ms;
+    ++num_latencies_;
+    max_latency_ms_ = std::max(max_latency_ms_, latency_ms);
+  }
+}
+
+double AAudioPlayer::LatencyMs() const {
+  // The timestamp tells when a past frame was presented, from which the time
+  // the last frame written will be is extrapolated.
+  int64_t presented_frame;
+  int64_t presented_nanos;
+  if (AAudioStream_getTimestamp(stream_, CLOCK_MONOTONIC, &presented_frame,
+                                &presented_nanos) != AAUDIO_OK) {
+    return -1.0;
+  }
+  const int64_t frames_written = AAudioStream_getFramesWritten(stream_);
+  const int64_t written_presented_nanos =
+      presented_nanos +
+      (frames_written - presented_frame) * 1000000000 / sample_rate_hz_;
+  const double stream_latency_ms =
+      (written_presented_nanos - MonotonicNanos()) / 1e6;
+  const double renderer_latency_ms =
+      1000.0 * renderer_->num_samples_buffered() / sample_rate_hz_;
+  return std::max(stream_latency_ms, 0.0) + renderer_latency_ms;
+}
+
+AAudioPlayer::Statistics AAudioPlayer::statistics() const {
+  Statistics statistics;
+  statistics.sample_rate_hz = sample_rate_hz_;
+  statistics.frames_per_burst = frames_per_burst_;
+  statistics.num_callbacks = num_callbacks_.load(std::memory_order_relaxed);
+  statistics.num_callback_overruns =
+      num_callback_overruns_.load(std::memory_order_relaxed);
+  statistics.max_callback_ms =
+      max_callback_nanos_.load(std::memory_order_relaxed) / 1e6;
+  statistics.num_xruns = AAudioStream_getXRunCount(stream_);
+  statistics.renderer = renderer_->statistics();
+  absl::MutexLock lock(&latency_mutex_);
+  if (num_latencies_ > 0) {
+    statistics.mean_latency_ms = latency_sum_ms_ / num_latencies_;
+  }
+  statistics.max_latency_ms = max_latency_ms_;
+  return statistics;
+}
+
+std::string AAudioPlayerStatisticsString(
+    const AAudioPlayer::Statistics& statistics) {
+  return absl::StrFormat(
+      "%d Hz, %d frames per burst, %d callbacks of which %d overran (longest "
+      "%.2f ms), %d xruns, %d renderer underruns, %d decode failures, "
+      "latency %.1f ms mean and %.1f ms max",
+      statistics.sample_rate_hz, statistics.frames_per_burst,
+      statistics.num_callbacks, statistics.num_callback_overruns,
+      statistics.max_callback_ms, statistics.num_xruns,
+      statistics.renderer.num_underruns,
+      statistics.renderer.num_source_failures,
+      statistics.mean_latency_ms, statistics.max_latency_ms);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
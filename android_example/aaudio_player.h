@@ -0,0 +1,126 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_ANDROID_EXAMPLE_AAUDIO_PLAYER_H_
+#define LYRA_CODEC_ANDROID_EXAMPLE_AAUDIO_PLAYER_H_
+
+#include <aaudio/AAudio.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "absl/synchronization/mutex.h"
+#include "realtime_renderer.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Plays the audio of a |RealtimeRenderer| on an AAudio output stream in low
+// latency mode, as calls on a device would. The data callback of the stream
+// only calls |RealtimeRenderer::Render|, while the renderer decodes ahead on
+// its worker thread.
+//
+// The player counts the callbacks that took longer than the audio they
+// rendered, the underruns of the renderer and those AAudio reports, and
+// samples the latency from the renderer generating a sample to it leaving the
+// speaker on a monitoring thread of its own.
+class AAudioPlayer {
+ public:
+  struct Statistics {
+    int sample_rate_hz = 0;
+    int frames_per_burst = 0;
+    int64_t num_callbacks = 0;
+    // Callbacks that took longer than the duration of the frames they were
+    // asked for, and the longest one.
+    int64_t num_callback_overruns = 0;
+    double max_callback_ms = 0.0;
+    // Underruns of the stream reported by AAudio.
+    int32_t num_xruns = 0;
+    RealtimeRenderer::Statistics renderer;
+    // From the renderer generating a sample to the sample being played: the
+    // samples buffered in the renderer and in the stream, and the latency of
+    // the device.
+    double mean_latency_ms = 0.0;
+    double max_latency_ms = 0.0;
+  };
+
+  // Opens a mono 16 bit output stream in exclusive low latency mode at the
+  // native sample rate of the device if Lyra supports it and at 48 kHz
+  // otherwise, which AAudio then resamples. |make_source| is called with the
+  // sample rate of the stream once it is open. The renderer keeps
+  // |num_bursts_ahead| bursts of the device decoded ahead. Returns a nullptr
+  // if the stream cannot be opened or started.
+  static std::unique_ptr<AAudioPlayer> Create(
+      const std::function<RealtimeRenderer::SampleSource(int sample_rate_hz)>&
+          make_source,
+      int num_bursts_ahead = 4);
+
+  // Stops and closes the stream.
+  ~AAudioPlayer();
+
+  Statistics statistics() const;
+
+ private:
+  AAudioPlayer(AAudioStream* stream,
+               std::unique_ptr<RealtimeRenderer> renderer);
+
+  static aaudio_data_callback_result_t DataCallback(AAudioStream* stream,
+                                                    void* user_data,
+                                                    void* audio_data,
+                                                    int32_t num_frames);
+
+  // Samples the latency every |kLatencyInterval| until the player is
+  // destroyed.
+  void RunMonitor();
+
+  // The latency of the next sample the renderer generates, or a negative
+  // value if the stream has no timestamp yet.
+  double LatencyMs() const;
+
+  AAudioStream* const stream_;
+  const int sample_rate_hz_;
+  const int frames_per_burst_;
+  // The user data of the callbacks of |stream_|, which is opened before the
+  // player exists. Null until the player is made.
+  std::unique_ptr<std::atomic<AAudioPlayer*>> player_holder_;
+  std::unique_ptr<RealtimeRenderer> renderer_;
+
+  // Only written by the data callback.
+  std::atomic<int64_t> num_callbacks_;
+  std::atomic<int64_t> num_callback_overruns_;
+  std::atomic<int64_t> max_callback_nanos_;
+
+  mutable absl::Mutex latency_mutex_;
+  double latency_sum_ms_ ABSL_GUARDED_BY(latency_mutex_) = 0.0;
+  int64_t num_latencies_ ABSL_GUARDED_BY(latency_mutex_) = 0;
+  double max_latency_ms_ ABSL_GUARDED_BY(latency_mutex_) = 0.0;
+
+  std::atomic<bool> terminate_;
+  std::unique_ptr<csrblocksparse::Thread> monitor_;
+};
+
+// Returns |statistics| on one line, for logging.
+std::string AAudioPlayerStatisticsString(
+    const AAudioPlayer::Statistics& statistics);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_ANDROID_EXAMPLE_AAUDIO_PLAYER_H_
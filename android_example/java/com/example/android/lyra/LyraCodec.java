@@ -0,0 +1,201 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.example.android.lyra;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Long-lived Lyra encoders and decoders that work one packet at a time.
+ *
+ * <p>A {@link Model} loads the weights once and every {@link Encoder} and {@link Decoder} created
+ * from it shares them, so that creating a codec for a new call is cheap. Packets and samples are
+ * passed either through direct {@link ByteBuffer}s in native byte order, which are not copied at
+ * all, or through arrays, which are pinned while the packet is processed. None of these classes are
+ * thread-safe.
+ */
+public final class LyraCodec {
+  static {
+    System.loadLibrary("lyra_android_example");
+  }
+
+  /** Size in bytes of an encoded packet. */
+  public static final int PACKET_SIZE = nativePacketSize();
+
+  private LyraCodec() {}
+
+  /** The weights shared by encoders and decoders. */
+  public static final class Model implements AutoCloseable {
+    private long handle;
+
+    /**
+     * Creates a model from the weights in {@code modelPath}, which are loaded on the first use.
+     *
+     * @throws IllegalArgumentException if there is no model at {@code modelPath}.
+     */
+    public Model(String modelPath) {
+      handle = nativeCreateModel(modelPath);
+      if (handle == 0) {
+        throw new IllegalArgumentException("No Lyra model at " + modelPath);
+      }
+    }
+
+    /** Releases the reference of this object to the weights, which outlive it in open codecs. */
+    @Override
+    public void close() {
+      if (handle != 0) {
+        nativeDestroyModel(handle);
+        handle = 0;
+      }
+    }
+
+    private long handle() {
+      if (handle == 0) {
+        throw new IllegalStateException("Model was closed.");
+      }
+      return handle;
+    }
+  }
+
+  /** Encodes one stream, a packet of 40ms at a time. */
+  public static final class Encoder implements AutoCloseable {
+    private long handle;
+
+    /**
+     * @throws IllegalArgumentException if the sample rate is not supported.
+     */
+    public Encoder(Model model, int sampleRateHz, boolean enableDtx) {
+      handle = nativeCreateEncoder(model.handle(), sampleRateHz, enableDtx);
+      if (handle == 0) {
+        throw new IllegalArgumentException("Could not create a Lyra encoder.");
+      }
+    }
+
+    /** The number of samples of a packet. */
+    public int samplesPerPacket() {
+      return nativeSamplesPerPacket(handle);
+    }
+
+    /**
+     * Encodes {@link #samplesPerPacket} samples from the direct buffer {@code samples} into the
+     * direct buffer {@code packet}, which holds at least {@link LyraCodec#PACKET_SIZE} bytes.
+     *
+     * @return the size of the packet, which is 0 if DTX found the samples silent, or -1 on failure.
+     */
+    public int encode(ByteBuffer samples, ByteBuffer packet) {
+      return nativeEncodeBuffer(handle, samples, packet);
+    }
+
+    /** Same as {@link #encode(ByteBuffer, ByteBuffer)} for the samples from {@code offset}. */
+    public int encode(short[] samples, int offset, byte[] packet) {
+      return nativeEncodeArray(handle, samples, offset, packet);
+    }
+
+    @Override
+    public void close() {
+      if (handle != 0) {
+        nativeDestroyEncoder(handle);
+        handle = 0;
+      }
+    }
+  }
+
+  /** Decodes one stream, a packet at a time. */
+  public static final class Decoder implements AutoCloseable {
+    private long handle;
+
+    /**
+     * @throws IllegalArgumentException if the sample rate is not supported.
+     */
+    public Decoder(Model model, int sampleRateHz) {
+      handle = nativeCreateDecoder(model.handle(), sampleRateHz);
+      if (handle == 0) {
+        throw new IllegalArgumentException("Could not create a Lyra decoder.");
+      }
+    }
+
+    /**
+     * Creates a decoder with the number of threads and the arithmetic that decode fastest on this
+     * device while leaving half of each packet's time to the rest of the app. The first decoder
+     * created on a device times them for a few hundred milliseconds and caches the result in the
+     * file at {@code tuningCachePath}; later ones, also in later runs of the app, read it from
+     * there.
+     *
+     * @throws IllegalArgumentException if the sample rate is not supported.
+     */
+    public Decoder(Model model, int sampleRateHz, String tuningCachePath) {
+      handle = nativeCreateTunedDecoder(model.handle(), sampleRateHz, tuningCachePath);
+      if (handle == 0) {
+        throw new IllegalArgumentException("Could not create a Lyra decoder.");
+      }
+    }
+
+    /**
+     * Decodes the {@code packetSize} bytes of the direct buffer {@code packet} into {@code
+     * numSamples} samples of the direct buffer {@code samples}, at most 40ms of them. A {@code
+     * packetSize} of 0 conceals a lost packet instead.
+     *
+     * @return whether decoding succeeded.
+     */
+    public boolean decode(ByteBuffer packet, int packetSize, ByteBuffer samples, int numSamples) {
+      return nativeDecodeBuffer(handle, packet, packetSize, samples, numSamples);
+    }
+
+    /**
+     * Same as {@link #decode(ByteBuffer, int, ByteBuffer, int)} into the samples from {@code
+     * offset}. A null {@code packet} conceals a lost packet.
+     */
+    public boolean decode(byte[] packet, short[] samples, int offset, int numSamples) {
+      return nativeDecodeArray(handle, packet, samples, offset, numSamples);
+    }
+
+    @Override
+    public void close() {
+      if (handle != 0) {
+        nativeDestroyDecoder(handle);
+        handle = 0;
+      }
+    }
+  }
+
+  private static native long nativeCreateModel(String modelPath);
+
+  private static native void nativeDestroyModel(long model);
+
+  private static native int nativePacketSize();
+
+  private static native long nativeCreateEncoder(long model, int sampleRateHz, boolean enableDtx);
+
+  private static native void nativeDestroyEncoder(long encoder);
+
+  private static native int nativeSamplesPerPacket(long encoder);
+
+  private static native int nativeEncodeBuffer(long encoder, ByteBuffer samples, ByteBuffer packet);
+
+  private static native int nativeEncodeArray(
+      long encoder, short[] samples, int offset, byte[] packet);
+
+  private static native long nativeCreateDecoder(long model, int sampleRateHz);
+
+  private static native long nativeCreateTunedDecoder(
+      long model, int sampleRateHz, String tuningCachePath);
+
+  private static native void nativeDestroyDecoder(long decoder);
+
+  private static native boolean nativeDecodeBuffer(
+      long decoder, ByteBuffer packet, int packetSize, ByteBuffer samples, int numSamples);
+
+  private static native boolean nativeDecodeArray(
+      long decoder, byte[] packet, short[] samples, int offset, int numSamples);
+}
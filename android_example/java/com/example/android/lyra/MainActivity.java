@@ -22,6 +22,7 @@ import android.media.AudioFormat;
 import android.media.AudioRecord;
 import android.media.AudioTrack;
 import android.media.MediaRecorder;
+import android.os.BatteryManager;
 import android.os.Bundle;
 import android.support.annotation.NonNull;
 import android.support.v7.app.AppCompatActivity;
@@ -49,7 +50,9 @@ public class MainActivity extends AppCompatActivity {
 
   private boolean hasStartedDecode = false;
   private boolean isRecording = false;
+  private boolean isStreaming = false;
   private String weightsDirectory;
+  private LyraCodec.Model model;
   private AudioRecord record;
   private AudioTrack player;
   private short[] micData;
@@ -87,6 +90,9 @@ public class MainActivity extends AppCompatActivity {
     // instead, in which case they would only exist as files.
     weightsDirectory = getExternalFilesDir(null).getAbsolutePath();
     copyWeightsAssetsToDirectory(weightsDirectory);
+    // The weights are loaded once, on first use, and shared by every encoder
+    // and decoder of the app.
+    model = new LyraCodec.Model(weightsDirectory);
 
     // This demo uses the microphone, which we need permission for.
     ActivityCompat.requestPermissions(this, permissions, REQUEST_RECORD_AUDIO_PERMISSION);
@@ -122,11 +128,13 @@ public class MainActivity extends AppCompatActivity {
     if (micDataShortsWritten < PLAYBACK_SKIP_SAMPLES) {
       return;
     }
-    // Whatever micData holds, encode and decode with Lyra.
-    short[] decodedAudio = encodeAndDecodeSamples(micData, micDataShortsWritten, weightsDirectory);
+    // Whatever micData holds, encode and decode with Lyra, one packet at a
+    // time as a call would.
+    short[] decodedAudio = encodeAndDecodeSamples(micData, micDataShortsWritten);
 
     if (decodedAudio == null) {
       Log.e(TAG, "Failed to encode and decode microphone data.");
+      return;
     }
 
     // Create a new AudioTrack in static mode so we can write once and
@@ -162,6 +170,26 @@ public class MainActivity extends AppCompatActivity {
     player.play();
   }
 
+  private short[] encodeAndDecodeSamples(short[] samples, int sampleLength) {
+    try (LyraCodec.Encoder encoder = new LyraCodec.Encoder(model, SAMPLE_RATE, false);
+        LyraCodec.Decoder decoder =
+            new LyraCodec.Decoder(
+                model, SAMPLE_RATE, new File(getCacheDir(), "lyra_tuning.tsv").getPath())) {
+      final int samplesPerPacket = encoder.samplesPerPacket();
+      final int numPackets = sampleLength / samplesPerPacket;
+      short[] decodedAudio = new short[numPackets * samplesPerPacket];
+      byte[] packet = new byte[LyraCodec.PACKET_SIZE];
+      for (int i = 0; i < numPackets; ++i) {
+        final int offset = i * samplesPerPacket;
+        if (encoder.encode(samples, offset, packet) != LyraCodec.PACKET_SIZE
+            || !decoder.decode(packet, decodedAudio, offset, samplesPerPacket)) {
+          return null;
+        }
+      }
+      return decodedAudio;
+    }
+  }
+
   private void stopRecording() {
     record.stop();
     isRecording = false;
@@ -195,6 +223,36 @@ public class MainActivity extends AppCompatActivity {
     }
   }
 
+  /**
+   * Called when user taps the stream button. Plays the recording in a loop, decoded ahead of an
+   * AAudio low latency stream, until tapped again, and then shows the callback overruns and the
+   * latency of the stream.
+   */
+  public synchronized void onStreamButtonClicked(View view) {
+    Button button = (Button) view;
+    TextView tv = (TextView) findViewById(R.id.sample_text);
+    if (!isStreaming) {
+      if (micDataShortsWritten < PLAYBACK_SKIP_SAMPLES) {
+        tv.setText("Record from the microphone first.");
+        return;
+      }
+      if (!startStreamingPlayback(micData, micDataShortsWritten, weightsDirectory)) {
+        Log.e(TAG, "Failed to start the streaming playback.");
+        return;
+      }
+      isStreaming = true;
+      button.setText("Stop streaming");
+    } else {
+      String statistics = stopStreamingPlayback();
+      isStreaming = false;
+      button.setText(R.string.button_stream);
+      if (statistics != null) {
+        Log.i(TAG, "Streaming playback: " + statistics);
+        tv.setText(statistics);
+      }
+    }
+  }
+
   /** Called when user taps the benchmark button. */
   public void runBenchmark(View view) {
     if (!hasStartedDecode) {
@@ -211,6 +269,27 @@ public class MainActivity extends AppCompatActivity {
                 // thread.
                 benchmarkDecode(2000, weightsDirectory);
                 Log.i(TAG, "Finished benchmarkDecode()");
+                Log.i(TAG, "Starting benchmarkDecodePerCluster()");
+                // Compares the big and LITTLE cores with two threads each.
+                benchmarkDecodePerCluster(2000, 2, weightsDirectory);
+                Log.i(TAG, "Finished benchmarkDecodePerCluster()");
+                Log.i(TAG, "Starting benchmarkEncode()");
+                benchmarkEncode(500, weightsDirectory);
+                Log.i(TAG, "Finished benchmarkEncode()");
+                // The energy is only meaningful while the phone runs on its
+                // battery.
+                BatteryManager batteryManager =
+                    (BatteryManager) getSystemService(BATTERY_SERVICE);
+                if (batteryManager.isCharging()) {
+                  Log.w(TAG, "Unplug the phone to measure the energy of the codec.");
+                }
+                Log.i(TAG, "Starting benchmarkDecodeEnergy()");
+                // Compares every compute type with one to two threads.
+                benchmarkDecodeEnergy(2000, 2, weightsDirectory);
+                Log.i(TAG, "Finished benchmarkDecodeEnergy()");
+                Log.i(TAG, "Starting benchmarkEncodeEnergy()");
+                benchmarkEncodeEnergy(500, weightsDirectory);
+                Log.i(TAG, "Finished benchmarkEncodeEnergy()");
                 tv.post(() -> tv.setText("Finished benchmarking. See logcat for results."));
                 button.post(() -> button.setEnabled(true));
                 hasStartedDecode = false;
@@ -253,6 +332,38 @@ public class MainActivity extends AppCompatActivity {
    */
   public native String benchmarkDecode(int numCondVectors, String modelBasePath);
 
-  public native short[] encodeAndDecodeSamples(
-      short[] samples, int sampleLength, String modelBasePath);
+  /**
+   * Benchmarks the decoder model once on every cluster of identical cores with {@code numThreads}
+   * threads pinned to it. The results are logged.
+   */
+  public native int benchmarkDecodePerCluster(
+      int numCondVectors, int numThreads, String modelBasePath);
+
+  public native int benchmarkEncode(int numPackets, String modelBasePath);
+
+  /**
+   * Measures the joules per second of decoded audio with every compute type and from one to {@code
+   * maxThreads} threads. The results are logged, most efficient first.
+   */
+  public native int benchmarkDecodeEnergy(int numCondVectors, int maxThreads, String modelBasePath);
+
+  /**
+   * Measures the joules per second of encoded audio at every sample rate, with DTX off and on. The
+   * results are logged.
+   */
+  public native int benchmarkEncodeEnergy(int numPackets, String modelBasePath);
+
+  /**
+   * Encodes the first {@code numSamples} of {@code samples} at {@link #SAMPLE_RATE} and starts
+   * playing them in a loop on an AAudio low latency stream. Returns false if the stream or the
+   * codec could not be created.
+   */
+  public native boolean startStreamingPlayback(
+      short[] samples, int numSamples, String modelBasePath);
+
+  /**
+   * Stops the playback started by {@link #startStreamingPlayback} and returns its callback
+   * overruns, underruns and latency, or null if none was started.
+   */
+  public native String stopStreamingPlayback();
 }
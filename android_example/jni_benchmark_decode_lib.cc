@@ -14,53 +14,51 @@
 
 #include <jni.h>
 
-#include <string>
+#include <numeric>
 #include <vector>
 
 #include "benchmark_decode_lib.h"
-#include "decoder_main_lib.h"
-#include "encoder_main_lib.h"
-#include "lyra_config.h"
+#include "compute_precision.h"
 
-extern "C" JNIEXPORT jshortArray JNICALL
-Java_com_example_android_lyra_MainActivity_encodeAndDecodeSamples(
-    JNIEnv* env, jobject this_obj, jshortArray samples, jint sample_length,
+extern "C" JNIEXPORT int JNICALL
+Java_com_example_android_lyra_MainActivity_benchmarkDecode(
+    JNIEnv* env, jobject this_obj, jint num_cond_vectors,
     jstring model_base_path) {
-  std::vector<int16_t> samples_vector(sample_length);
-  std::vector<uint8_t> features;
-  std::vector<int16_t> decoded_audio;
-  jshortArray java_decoded_audio = nullptr;
-  env->GetShortArrayRegion(samples, jsize{0}, sample_length,
-                           &samples_vector[0]);
-
   const char* cpp_model_base_path = env->GetStringUTFChars(model_base_path, 0);
-  std::unique_ptr<chromemedia::codec::LyraDecoder> decoder =
-      chromemedia::codec::LyraDecoder::Create(
-          16000, chromemedia::codec::kNumChannels, chromemedia::codec::kBitrate,
-          cpp_model_base_path);
-
-  if (chromemedia::codec::EncodeWav(
-          samples_vector, chromemedia::codec::kNumChannels, 16000, false, false,
-          cpp_model_base_path, &features) &&
-      chromemedia::codec::DecodeFeatures(features, 0.0, 1.0, decoder.get(),
-                                         &decoded_audio)) {
-    java_decoded_audio = env->NewShortArray(decoded_audio.size());
-    env->SetShortArrayRegion(java_decoded_audio, 0, decoded_audio.size(),
-                             &decoded_audio[0]);
-  }
-
+  int ret = chromemedia::codec::benchmark_decode(num_cond_vectors,
+                                                 cpp_model_base_path);
   env->ReleaseStringUTFChars(model_base_path, cpp_model_base_path);
+  return ret;
+}
 
-  return java_decoded_audio;
+extern "C" JNIEXPORT int JNICALL
+Java_com_example_android_lyra_MainActivity_benchmarkDecodePerCluster(
+    JNIEnv* env, jobject this_obj, jint num_cond_vectors, jint num_threads,
+    jstring model_base_path) {
+  const char* cpp_model_base_path = env->GetStringUTFChars(model_base_path, 0);
+  chromemedia::codec::BenchmarkDecodeOptions options;
+  options.num_cond_vectors = num_cond_vectors;
+  options.num_threads = num_threads;
+  options.model_base_path = cpp_model_base_path;
+  env->ReleaseStringUTFChars(model_base_path, cpp_model_base_path);
+  return chromemedia::codec::benchmark_decode_per_cluster(options);
 }
 
 extern "C" JNIEXPORT int JNICALL
-Java_com_example_android_lyra_MainActivity_benchmarkDecode(
-    JNIEnv* env, jobject this_obj, jint num_cond_vectors,
+Java_com_example_android_lyra_MainActivity_benchmarkDecodeEnergy(
+    JNIEnv* env, jobject this_obj, jint num_cond_vectors, jint max_threads,
     jstring model_base_path) {
   const char* cpp_model_base_path = env->GetStringUTFChars(model_base_path, 0);
-  int ret = chromemedia::codec::benchmark_decode(num_cond_vectors,
-                                                 cpp_model_base_path);
+  chromemedia::codec::BenchmarkDecodeOptions options;
+  options.num_cond_vectors = num_cond_vectors;
+  options.model_base_path = cpp_model_base_path;
   env->ReleaseStringUTFChars(model_base_path, cpp_model_base_path);
-  return ret;
+  std::vector<int> thread_counts(max_threads);
+  std::iota(thread_counts.begin(), thread_counts.end(), 1);
+  return chromemedia::codec::benchmark_decode_energy_sweep(
+      options,
+      {chromemedia::codec::ComputePrecision::kFloat,
+       chromemedia::codec::ComputePrecision::kFixed16,
+       chromemedia::codec::ComputePrecision::kBfloat16},
+      thread_counts);
 }
@@ -0,0 +1,39 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <jni.h>
+
+#include "benchmark_encode_lib.h"
+
+extern "C" JNIEXPORT int JNICALL
+Java_com_example_android_lyra_MainActivity_benchmarkEncode(
+    JNIEnv* env, jobject this_obj, jint num_packets, jstring model_base_path) {
+  const char* cpp_model_base_path = env->GetStringUTFChars(model_base_path, 0);
+  int ret =
+      chromemedia::codec::benchmark_encode(num_packets, cpp_model_base_path);
+  env->ReleaseStringUTFChars(model_base_path, cpp_model_base_path);
+  return ret;
+}
+
+extern "C" JNIEXPORT int JNICALL
+Java_com_example_android_lyra_MainActivity_benchmarkEncodeEnergy(
+    JNIEnv* env, jobject this_obj, jint num_packets, jstring model_base_path) {
+  const char* cpp_model_base_path = env->GetStringUTFChars(model_base_path, 0);
+  chromemedia::codec::BenchmarkEncodeOptions options;
+  options.num_packets = num_packets;
+  options.model_base_path = cpp_model_base_path;
+  options.measure_energy = true;
+  env->ReleaseStringUTFChars(model_base_path, cpp_model_base_path);
+  return chromemedia::codec::benchmark_encode(options);
+}
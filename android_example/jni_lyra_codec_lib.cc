@@ -0,0 +1,283 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Long-lived encoder and decoder handles for LyraCodec.java. The model is
+// loaded once per |LyraCodec.Model| and shared by every encoder and decoder
+// created from it, and packets are passed through direct ByteBuffers or
+// pinned arrays, so that the per-packet cost is that of the codec alone.
+
+#include <jni.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "decoder_autotuner.h"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_encoder.h"
+#include "lyra_model.h"
+
+namespace {
+
+using chromemedia::codec::AutotuneDecoder;
+using chromemedia::codec::AutotuneOptions;
+using chromemedia::codec::kBitrate;
+using chromemedia::codec::kNumChannels;
+using chromemedia::codec::kNumFramesPerPacket;
+using chromemedia::codec::kPacketSize;
+using chromemedia::codec::LyraDecoder;
+using chromemedia::codec::LyraEncoder;
+using chromemedia::codec::LyraModel;
+using chromemedia::codec::TunedDecoderConfig;
+
+// The handle of a model owns one reference to it, so that the Java side can
+// release the model while encoders and decoders still use it.
+using ModelHandle = std::shared_ptr<LyraModel>;
+
+template <typename T>
+T* FromHandle(jlong handle) {
+  return reinterpret_cast<T*>(static_cast<intptr_t>(handle));
+}
+
+template <typename T>
+jlong ToHandle(T* pointer) {
+  return static_cast<jlong>(reinterpret_cast<intptr_t>(pointer));
+}
+
+int NumSamplesPerPacket(const LyraEncoder& encoder) {
+  return kNumFramesPerPacket * encoder.sample_rate_hz() / encoder.frame_rate();
+}
+
+// Encodes the packet of |samples| into |packet|, which holds at least
+// |kPacketSize| bytes. Returns the size of the packet, which is 0 if DTX
+// found it silent, or -1 on failure.
+jint EncodePacket(LyraEncoder* encoder, absl::Span<const int16_t> samples,
+                  uint8_t* packet) {
+  const auto encoded_or = encoder->EncodeBatch(samples);
+  if (!encoded_or.has_value() || encoded_or->size() != 1) {
+    return -1;
+  }
+  const std::vector<uint8_t>& encoded = encoded_or->front();
+  std::copy(encoded.begin(), encoded.end(), packet);
+  return encoded.size();
+}
+
+// Decodes |packet| into |samples|, or conceals a lost packet if |packet| is
+// empty.
+bool DecodePacket(LyraDecoder* decoder, absl::Span<const uint8_t> packet,
+                  absl::Span<int16_t> samples) {
+  if (packet.empty()) {
+    return decoder->DecodePacketLoss(samples);
+  }
+  return decoder->SetEncodedPacket(packet) && decoder->DecodeSamples(samples);
+}
+
+// Returns the address of the direct |buffer| if it holds at least
+// |num_bytes|, or a nullptr.
+template <typename T>
+T* DirectBuffer(JNIEnv* env, jobject buffer, int64_t num_bytes) {
+  if (buffer == nullptr || env->GetDirectBufferCapacity(buffer) < num_bytes) {
+    return nullptr;
+  }
+  return static_cast<T*>(env->GetDirectBufferAddress(buffer));
+}
+
+}  // namespace
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeCreateModel(
+    JNIEnv* env, jclass clazz, jstring model_path) {
+  const char* cpp_model_path = env->GetStringUTFChars(model_path, 0);
+  std::shared_ptr<LyraModel> model = LyraModel::Create(cpp_model_path);
+  env->ReleaseStringUTFChars(model_path, cpp_model_path);
+  if (model == nullptr) {
+    return 0;
+  }
+  return ToHandle(new ModelHandle(std::move(model)));
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeDestroyModel(JNIEnv* env,
+                                                           jclass clazz,
+                                                           jlong model) {
+  delete FromHandle<ModelHandle>(model);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_example_android_lyra_LyraCodec_nativePacketSize(JNIEnv* env,
+                                                         jclass clazz) {
+  return kPacketSize;
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeCreateEncoder(
+    JNIEnv* env, jclass clazz, jlong model, jint sample_rate_hz,
+    jboolean enable_dtx) {
+  return ToHandle(LyraEncoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                                      enable_dtx,
+                                      *FromHandle<ModelHandle>(model))
+                      .release());
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeDestroyEncoder(JNIEnv* env,
+                                                             jclass clazz,
+                                                             jlong encoder) {
+  delete FromHandle<LyraEncoder>(encoder);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeSamplesPerPacket(
+    JNIEnv* env, jclass clazz, jlong encoder) {
+  return NumSamplesPerPacket(*FromHandle<LyraEncoder>(encoder));
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeEncodeBuffer(
+    JNIEnv* env, jclass clazz, jlong encoder_handle, jobject samples,
+    jobject packet) {
+  LyraEncoder* encoder = FromHandle<LyraEncoder>(encoder_handle);
+  const int num_samples = NumSamplesPerPacket(*encoder);
+  const int16_t* samples_data =
+      DirectBuffer<const int16_t>(env, samples, num_samples * sizeof(int16_t));
+  uint8_t* packet_data = DirectBuffer<uint8_t>(env, packet, kPacketSize);
+  if (samples_data == nullptr || packet_data == nullptr) {
+    return -1;
+  }
+  return EncodePacket(encoder, absl::MakeConstSpan(samples_data, num_samples),
+                      packet_data);
+}
+
+// The arrays stay pinned while the packet is encoded, which blocks the garbage
+// collector for that long, but a packet only takes a few milliseconds and
+// nothing is copied.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeEncodeArray(
+    JNIEnv* env, jclass clazz, jlong encoder_handle, jshortArray samples,
+    jint offset, jbyteArray packet) {
+  LyraEncoder* encoder = FromHandle<LyraEncoder>(encoder_handle);
+  const int num_samples = NumSamplesPerPacket(*encoder);
+  if (offset < 0 || env->GetArrayLength(samples) - offset < num_samples ||
+      env->GetArrayLength(packet) < kPacketSize) {
+    return -1;
+  }
+  auto* samples_data = static_cast<int16_t*>(
+      env->GetPrimitiveArrayCritical(samples, nullptr));
+  auto* packet_data =
+      static_cast<uint8_t*>(env->GetPrimitiveArrayCritical(packet, nullptr));
+  jint packet_size = -1;
+  if (samples_data != nullptr && packet_data != nullptr) {
+    packet_size = EncodePacket(
+        encoder, absl::MakeConstSpan(samples_data + offset, num_samples),
+        packet_data);
+  }
+  if (packet_data != nullptr) {
+    env->ReleasePrimitiveArrayCritical(packet, packet_data, 0);
+  }
+  if (samples_data != nullptr) {
+    env->ReleasePrimitiveArrayCritical(samples, samples_data, JNI_ABORT);
+  }
+  return packet_size;
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeCreateDecoder(
+    JNIEnv* env, jclass clazz, jlong model, jint sample_rate_hz) {
+  return ToHandle(LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                                      *FromHandle<ModelHandle>(model))
+                      .release());
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeCreateTunedDecoder(
+    JNIEnv* env, jclass clazz, jlong model, jint sample_rate_hz,
+    jstring tuning_cache_path) {
+  AutotuneOptions options;
+  const char* cpp_cache_path = env->GetStringUTFChars(tuning_cache_path, 0);
+  options.cache_path = cpp_cache_path;
+  env->ReleaseStringUTFChars(tuning_cache_path, cpp_cache_path);
+  // Falls back to the defaults of |LyraDecoder::Create| if nothing could be
+  // timed.
+  const TunedDecoderConfig tuned =
+      AutotuneDecoder(options).value_or(TunedDecoderConfig());
+  return ToHandle(LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                                      *FromHandle<ModelHandle>(model),
+                                      tuned.num_threads, tuned.precision)
+                      .release());
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeDestroyDecoder(JNIEnv* env,
+                                                             jclass clazz,
+                                                             jlong decoder) {
+  delete FromHandle<LyraDecoder>(decoder);
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeDecodeBuffer(
+    JNIEnv* env, jclass clazz, jlong decoder_handle, jobject packet,
+    jint packet_size, jobject samples, jint num_samples) {
+  const uint8_t* packet_data = nullptr;
+  if (packet_size > 0) {
+    packet_data = DirectBuffer<const uint8_t>(env, packet, packet_size);
+    if (packet_data == nullptr) {
+      return false;
+    }
+  }
+  int16_t* samples_data =
+      DirectBuffer<int16_t>(env, samples, num_samples * sizeof(int16_t));
+  if (num_samples <= 0 || samples_data == nullptr) {
+    return false;
+  }
+  return DecodePacket(FromHandle<LyraDecoder>(decoder_handle),
+                      absl::MakeConstSpan(packet_data, packet_size),
+                      absl::MakeSpan(samples_data, num_samples));
+}
+
+// Pins the arrays like |nativeEncodeArray|.
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_example_android_lyra_LyraCodec_nativeDecodeArray(
+    JNIEnv* env, jclass clazz, jlong decoder_handle, jbyteArray packet,
+    jshortArray samples, jint offset, jint num_samples) {
+  if (num_samples <= 0 || offset < 0 ||
+      env->GetArrayLength(samples) - offset < num_samples) {
+    return false;
+  }
+  const int packet_size = packet == nullptr ? 0 : env->GetArrayLength(packet);
+  auto* packet_data =
+      packet == nullptr
+          ? nullptr
+          : static_cast<uint8_t*>(env->GetPrimitiveArrayCritical(packet,
+                                                                 nullptr));
+  auto* samples_data = static_cast<int16_t*>(
+      env->GetPrimitiveArrayCritical(samples, nullptr));
+  bool decoded = false;
+  if ((packet == nullptr || packet_data != nullptr) &&
+      samples_data != nullptr) {
+    decoded = DecodePacket(FromHandle<LyraDecoder>(decoder_handle),
+                           absl::MakeConstSpan(packet_data, packet_size),
+                           absl::MakeSpan(samples_data + offset, num_samples));
+  }
+  if (samples_data != nullptr) {
+    env->ReleasePrimitiveArrayCritical(samples, samples_data, 0);
+  }
+  if (packet_data != nullptr) {
+    env->ReleasePrimitiveArrayCritical(packet, packet_data, JNI_ABORT);
+  }
+  return decoded;
+}
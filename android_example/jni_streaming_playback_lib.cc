@@ -0,0 +1,169 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Streams the decoded recording of MainActivity.java to the speaker through an
+// AAudio low latency stream. The decoder runs ahead of the stream on the
+// worker thread of a |RealtimeRenderer| instead of in the audio callback, as
+// it would in a call.
+
+#include <jni.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "android_example/aaudio_player.h"
+#include "glog/logging.h"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_encoder.h"
+#include "realtime_renderer.h"
+
+namespace {
+
+using chromemedia::codec::AAudioPlayer;
+using chromemedia::codec::AAudioPlayerStatisticsString;
+using chromemedia::codec::kBitrate;
+using chromemedia::codec::kNumChannels;
+using chromemedia::codec::kNumFramesPerPacket;
+using chromemedia::codec::LyraDecoder;
+using chromemedia::codec::LyraEncoder;
+using chromemedia::codec::RealtimeRenderer;
+
+// The rate MainActivity.java records at.
+constexpr int kRecordingSampleRateHz = 16000;
+
+// Decodes |packets| in a loop, in buffers of whatever size the renderer asks
+// for, which is that of a burst of the device rather than that of a packet.
+class PacketLoop {
+ public:
+  PacketLoop(std::unique_ptr<LyraDecoder> decoder,
+             std::vector<std::vector<uint8_t>> packets)
+      : decoder_(std::move(decoder)),
+        packets_(std::move(packets)),
+        num_samples_per_packet_(kNumFramesPerPacket *
+                                decoder_->sample_rate_hz() /
+                                decoder_->frame_rate()) {}
+
+  bool operator()(absl::Span<int16_t> samples) {
+    while (!samples.empty()) {
+      if (num_samples_remaining_ == 0) {
+        if (!decoder_->SetEncodedPacket(packets_[next_packet_])) {
+          return false;
+        }
+        next_packet_ = (next_packet_ + 1) % packets_.size();
+        num_samples_remaining_ = num_samples_per_packet_;
+      }
+      const int num_samples =
+          std::min<int>(num_samples_remaining_, samples.size());
+      if (!decoder_->DecodeSamples(samples.subspan(0, num_samples))) {
+        return false;
+      }
+      num_samples_remaining_ -= num_samples;
+      samples.remove_prefix(num_samples);
+    }
+    return true;
+  }
+
+ private:
+  const std::unique_ptr<LyraDecoder> decoder_;
+  const std::vector<std::vector<uint8_t>> packets_;
+  const int num_samples_per_packet_;
+  int next_packet_ = 0;
+  int num_samples_remaining_ = 0;
+};
+
+absl::Mutex player_mutex(absl::kConstInit);
+AAudioPlayer* player ABSL_GUARDED_BY(player_mutex) = nullptr;
+
+}  // namespace
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_example_android_lyra_MainActivity_startStreamingPlayback(
+    JNIEnv* env, jobject this_obj, jshortArray samples, jint num_samples,
+    jstring model_base_path) {
+  const char* cpp_model_base_path = env->GetStringUTFChars(model_base_path, 0);
+  const std::string model_path = cpp_model_base_path;
+  env->ReleaseStringUTFChars(model_base_path, cpp_model_base_path);
+
+  auto encoder = LyraEncoder::Create(kRecordingSampleRateHz, kNumChannels,
+                                     kBitrate, /*enable_dtx=*/false,
+                                     model_path);
+  if (encoder == nullptr) {
+    return false;
+  }
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * kRecordingSampleRateHz / encoder->frame_rate();
+  const int num_packets = num_samples / num_samples_per_packet;
+  if (num_packets == 0 || env->GetArrayLength(samples) < num_samples) {
+    return false;
+  }
+  std::vector<int16_t> recording(num_samples);
+  env->GetShortArrayRegion(samples, 0, num_samples, recording.data());
+  std::vector<std::vector<uint8_t>> packets;
+  for (int i = 0; i < num_packets; ++i) {
+    auto packet = encoder->Encode(absl::MakeConstSpan(
+        recording.data() + i * num_samples_per_packet,
+        num_samples_per_packet));
+    if (!packet.has_value()) {
+      return false;
+    }
+    packets.push_back(std::move(*packet));
+  }
+
+  // The decoder has to be at the rate of the stream, which is only known
+  // once it is open.
+  auto new_player = AAudioPlayer::Create([&](int sample_rate_hz) {
+    auto decoder = LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                                       model_path);
+    if (decoder == nullptr) {
+      // Makes |RealtimeRenderer::Create| and so the player fail.
+      return RealtimeRenderer::SampleSource();
+    }
+    // |SampleSource| has to be copyable, which the decoder is not.
+    auto loop =
+        std::make_shared<PacketLoop>(std::move(decoder), std::move(packets));
+    return RealtimeRenderer::SampleSource(
+        [loop](absl::Span<int16_t> samples) { return (*loop)(samples); });
+  });
+  if (new_player == nullptr) {
+    return false;
+  }
+  absl::MutexLock lock(&player_mutex);
+  delete player;
+  player = new_player.release();
+  return true;
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_android_lyra_MainActivity_stopStreamingPlayback(
+    JNIEnv* env, jobject this_obj) {
+  absl::MutexLock lock(&player_mutex);
+  if (player == nullptr) {
+    return nullptr;
+  }
+  const std::string statistics =
+      AAudioPlayerStatisticsString(player->statistics());
+  delete player;
+  player = nullptr;
+  LOG(INFO) << "Streaming playback: " << statistics;
+  return env->NewStringUTF(statistics.c_str());
+}
@@ -23,7 +23,7 @@
 namespace chromemedia {
 namespace codec {
 
-ghc::filesystem::path GetCompleteArchitecturePath(
+inline ghc::filesystem::path GetCompleteArchitecturePath(
     const ghc::filesystem::path& model_path) {
   return model_path;
 }
@@ -0,0 +1,570 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_BATCHED_CAUSAL_CONVOLUTIONAL_CONDITIONING_H_
+#define LYRA_CODEC_BATCHED_CAUSAL_CONVOLUTIONAL_CONDITIONING_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "causal_convolutional_conditioning.h"
+#include "dsp_util.h"
+#include "glog/logging.h"
+#include "layer_wrappers_lib.h"
+#include "lyra_model.h"
+#include "model_unpacker.h"
+#include "parallel_load.h"
+#include "projection_folder.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Runs the conditioning stack of |CausalConvolutionalConditioning| for
+// |num_streams| independent streams at once. The frames of all streams that
+// are due together are stored as the columns of one input per layer, so each
+// layer runs one sparse matrix-matrix product per frame, and its weights are
+// only streamed from memory once for all those streams instead of once per
+// stream.
+// The conv1d and dilated layers look back at earlier frames. Their histories
+// are kept per stream and gathered into the columns before every product, so
+// each stream produces the same conditioning it would produce in its own
+// |CausalConvolutionalConditioning|. The transpose and projection layers only
+// see the current frame, so the columns of all streams just sit side by side.
+// Unlike |CausalConvolutionalConditioning| this class does not skip frames
+// that repeat a saturated input and cannot stretch its output.
+// This class is not thread-safe and runs on the calling thread only.
+template <typename Types>
+class BatchedCausalConvolutionalConditioning {
+ public:
+  using ConditioningType = CausalConvolutionalConditioning<Types>;
+  using DiskWeightType = typename ConditioningType::DiskWeightType;
+  using Conv1DWeightType = typename ConditioningType::Conv1DWeightType;
+  using Conv1DRhsType = typename ConditioningType::Conv1DRhsType;
+  using CondStack0WeightType = typename ConditioningType::CondStack0WeightType;
+  using CondStack0RhsType = typename ConditioningType::CondStack0RhsType;
+  using CondStack1WeightType = typename ConditioningType::CondStack1WeightType;
+  using CondStack1RhsType = typename ConditioningType::CondStack1RhsType;
+  using CondStack2WeightType = typename ConditioningType::CondStack2WeightType;
+  using CondStack2RhsType = typename ConditioningType::CondStack2RhsType;
+  using Transpose0WeightType = typename ConditioningType::Transpose0WeightType;
+  using Transpose0RhsType = typename ConditioningType::Transpose0RhsType;
+  using Transpose1WeightType = typename ConditioningType::Transpose1WeightType;
+  using Transpose1RhsType = typename ConditioningType::Transpose1RhsType;
+  using Transpose2WeightType = typename ConditioningType::Transpose2WeightType;
+  using Transpose2RhsType = typename ConditioningType::Transpose2RhsType;
+  using ConvCondWeightType = typename ConditioningType::ConvCondWeightType;
+  using ConvCondRhsType = typename ConditioningType::ConvCondRhsType;
+  using ConvCondOutputType = typename ConditioningType::ConvCondOutputType;
+  using ConvToGatesWeightType =
+      typename ConditioningType::ConvToGatesWeightType;
+  using ConvToGatesRhsType = typename ConditioningType::ConvToGatesRhsType;
+  using ConvToGatesOutType = typename ConditioningType::ConvToGatesOutType;
+  using FoldedProjectionOutType =
+      typename ConditioningType::FoldedProjectionOutType;
+  using OutputType = typename ConditioningType::OutputType;
+
+  // Loads the layers that a |CausalConvolutionalConditioning| of the same
+  // arguments would load. If |model| is not null, the weights are shared with
+  // every stack created through it, including the ones of single sessions
+  // running on one thread. Returns a nullptr on failure.
+  static std::unique_ptr<BatchedCausalConvolutionalConditioning<Types>> Create(
+      int num_streams, int feature_depth, int num_cond_hiddens,
+      int num_hiddens, int num_samples_per_hop, int num_frames_per_packet,
+      const std::string& path, const std::string& prefix,
+      LyraModel* model = nullptr) {
+    if (num_streams < 1) {
+      LOG(ERROR) << "Number of streams has to be positive, but was "
+                 << num_streams << ".";
+      return nullptr;
+    }
+    if (num_samples_per_hop <= 0 || num_frames_per_packet <= 0) {
+      LOG(ERROR) << "Number of samples per hop and of frames per packet have "
+                    "to be positive, but were "
+                 << num_samples_per_hop << " and " << num_frames_per_packet
+                 << ".";
+      return nullptr;
+    }
+    auto conditioning =
+        absl::WrapUnique(new BatchedCausalConvolutionalConditioning<Types>(
+            num_streams, feature_depth, num_cond_hiddens, num_hiddens,
+            num_samples_per_hop, num_frames_per_packet,
+            HasFoldedProjection(path, prefix)));
+    if (!conditioning->LoadLayers(path, prefix, IsZippedModel(path, prefix),
+                                  model)) {
+      LOG(ERROR) << "Could not create the conditioning layers of " << prefix
+                 << " in " << path << ".";
+      return nullptr;
+    }
+    return conditioning;
+  }
+
+  // Runs the frames in the columns of |inputs[i]| through the stack of stream
+  // |streams[i]| and appends the results to its conditioning. The |j|-th
+  // frames of all streams that have one go through the layers together, so
+  // streams may bring different numbers of frames and streams that are not
+  // due are left out. Every stream may appear at most once.
+  void Precompute(absl::Span<const int> streams,
+                  absl::Span<const csrblocksparse::VectorView<float>> inputs) {
+    CHECK_EQ(streams.size(), inputs.size());
+    std::vector<bool> seen(num_streams_, false);
+    int num_frames = 0;
+    for (int i = 0; i < streams.size(); ++i) {
+      CHECK_GE(streams[i], 0);
+      CHECK_LT(streams[i], num_streams_);
+      CHECK(!seen[streams[i]]) << "Stream " << streams[i] << " is repeated.";
+      seen[streams[i]] = true;
+      CHECK_EQ(inputs[i].rows(), feature_depth_);
+      num_frames = std::max(num_frames, inputs[i].cols());
+    }
+
+    for (int frame = 0; frame < num_frames; ++frame) {
+      batch_streams_.clear();
+      batch_frames_.clear();
+      for (int i = 0; i < streams.size(); ++i) {
+        if (frame < inputs[i].cols()) {
+          batch_streams_.push_back(streams[i]);
+          batch_frames_.push_back(inputs[i].data() +
+                                  frame * inputs[i].col_stride());
+        }
+      }
+      RunFrame();
+    }
+  }
+
+  // Return the conditioning vector of |stream| corresponding to |step| in
+  // sample domain, as |CausalConvolutionalConditioning::AtStep| does.
+  absl::Span<const OutputType> AtStep(int stream, int step) const {
+    const int conditioning_column =
+        (step % (num_frames_per_packet_ * num_samples_per_hop_)) /
+        (num_samples_per_hop_ / kCondUpsamplingRatio);
+    const int num_output_elements = 3 * num_hiddens_;
+    return absl::Span<const OutputType>(
+        streams_[stream].conditioning.data() +
+            conditioning_column * num_output_elements,
+        num_output_elements);
+  }
+
+  int num_samples(int stream) const {
+    return streams_[stream].num_precomputed_frames * num_samples_per_hop_;
+  }
+
+  // Forgets all frames run through the stack of |stream|, so the slot can be
+  // reused for a new session without affecting the other streams.
+  void ResetStream(int stream) {
+    CHECK_GE(stream, 0);
+    CHECK_LT(stream, num_streams_);
+    Stream& state = streams_[stream];
+    std::fill(state.conv1d_history.begin(), state.conv1d_history.end(),
+              static_cast<Conv1DRhsType>(0.f));
+    std::fill(state.dilated_history_0.begin(), state.dilated_history_0.end(),
+              static_cast<CondStack0RhsType>(0.f));
+    std::fill(state.dilated_history_1.begin(), state.dilated_history_1.end(),
+              static_cast<CondStack1RhsType>(0.f));
+    std::fill(state.dilated_history_2.begin(), state.dilated_history_2.end(),
+              static_cast<CondStack2RhsType>(0.f));
+    state.num_frames_run = 0;
+    state.conditioning.FillZero();
+    state.num_precomputed_frames = 0;
+  }
+
+  int num_streams() const { return num_streams_; }
+
+ private:
+  static constexpr int kNumThreads = 1;
+  static constexpr int kConv1DKernel = ConditioningType::kConv1DKernel;
+  static constexpr int kDilatedKernel = ConditioningType::kDilatedKernel;
+  static constexpr int kTransposeStride = ConditioningType::kTransposeStride;
+  static constexpr int kCondUpsamplingRatio =
+      ConditioningType::kCondUpsamplingRatio;
+  // All dilations divide it, so the position of every dilated history can be
+  // taken from the number of frames run modulo it.
+  static constexpr int kMaxDilation = ConditioningType::kDilation[2];
+
+  template <typename WeightType, typename RhsType>
+  using SparseLayer =
+      std::shared_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>;
+
+  // The state of one stream of the stack.
+  struct Stream {
+    // The inputs of the conv1d layer of the last |kConv1DKernel| - 1 frames,
+    // oldest first.
+    std::vector<Conv1DRhsType> conv1d_history;
+    // The Relu'd inputs of each dilated layer of the last |dilation| frames,
+    // where frame |t| is at position |t| % |dilation|.
+    std::vector<CondStack0RhsType> dilated_history_0;
+    std::vector<CondStack1RhsType> dilated_history_1;
+    std::vector<CondStack2RhsType> dilated_history_2;
+    // The number of frames run, modulo |kMaxDilation|.
+    int num_frames_run = 0;
+    // |num_frames_per_packet_| frames worth of conditioning output.
+    csrblocksparse::FatCacheAlignedVector<OutputType> conditioning;
+    int num_precomputed_frames = 0;
+  };
+
+  BatchedCausalConvolutionalConditioning() = delete;
+
+  BatchedCausalConvolutionalConditioning(
+      int num_streams, int feature_depth, int num_cond_hiddens,
+      int num_hiddens, int num_samples_per_hop, int num_frames_per_packet,
+      bool folded_projection)
+      : num_streams_(num_streams),
+        feature_depth_(feature_depth),
+        num_cond_hiddens_(num_cond_hiddens),
+        num_hiddens_(num_hiddens),
+        num_samples_per_hop_(num_samples_per_hop),
+        num_frames_per_packet_(num_frames_per_packet),
+        folded_projection_(folded_projection),
+        streams_(num_streams),
+        conv1d_input_(kConv1DKernel * feature_depth, num_streams),
+        dilated_input_0_(num_cond_hiddens, num_streams),
+        dilated_input_1_(num_cond_hiddens, num_streams),
+        dilated_input_2_(num_cond_hiddens, num_streams),
+        dilated_window_0_(kDilatedKernel * num_cond_hiddens, num_streams),
+        dilated_window_1_(kDilatedKernel * num_cond_hiddens, num_streams),
+        dilated_window_2_(kDilatedKernel * num_cond_hiddens, num_streams),
+        transpose_input_0_(num_cond_hiddens, num_streams),
+        transpose_input_1_(num_cond_hiddens, kTransposeStride * num_streams),
+        transpose_input_2_(num_cond_hiddens,
+                           kTransposeStride * kTransposeStride * num_streams),
+        projection_input_(num_cond_hiddens,
+                          kCondUpsamplingRatio * num_streams) {
+    for (Stream& stream : streams_) {
+      stream.conv1d_history.resize((kConv1DKernel - 1) * feature_depth_);
+      stream.dilated_history_0.resize(ConditioningType::kDilation[0] *
+                                      num_cond_hiddens_);
+      stream.dilated_history_1.resize(ConditioningType::kDilation[1] *
+                                      num_cond_hiddens_);
+      stream.dilated_history_2.resize(ConditioningType::kDilation[2] *
+                                      num_cond_hiddens_);
+      stream.conditioning = csrblocksparse::FatCacheAlignedVector<OutputType>(
+          3 * num_hiddens_, num_frames_per_packet_ * kCondUpsamplingRatio);
+    }
+    for (int stream = 0; stream < num_streams_; ++stream) {
+      ResetStream(stream);
+    }
+    const int num_projection_columns = kCondUpsamplingRatio * num_streams;
+    if (folded_projection_) {
+      folded_projection_out_ =
+          csrblocksparse::FatCacheAlignedVector<FoldedProjectionOutType>(
+              3 * num_hiddens_, num_projection_columns);
+    } else {
+      conv_cond_out_ =
+          csrblocksparse::FatCacheAlignedVector<ConvCondOutputType>(
+              num_hiddens_, num_projection_columns);
+      conv_to_gates_input_ =
+          csrblocksparse::FatCacheAlignedVector<ConvToGatesRhsType>(
+              num_hiddens_, num_projection_columns);
+      conv_to_gates_out_ =
+          csrblocksparse::FatCacheAlignedVector<ConvToGatesOutType>(
+              3 * num_hiddens_, num_projection_columns);
+    }
+    batch_streams_.reserve(num_streams_);
+    batch_frames_.reserve(num_streams_);
+  }
+
+  // Returns a function that loads the weights of the layer of |params|, of
+  // |rows| x |cols|, into |*layer| and returns whether that succeeded.
+  template <typename WeightType, typename RhsType>
+  static std::function<bool()> LayerLoader(
+      LayerParams params, int rows, int cols, bool zipped, LyraModel* model,
+      SparseLayer<WeightType, RhsType>* layer) {
+    std::get<LayerParams::FromDisk>(params.from).zipped = zipped;
+    return [params, rows, cols, model, layer]() {
+      *layer = LayerWrapper<WeightType, RhsType, RhsType, DiskWeightType>::
+          LoadAndCheckLayer(params.from, params.prefix,
+                            "|" + params.prefix + "| layer: ", rows, cols,
+                            kNumThreads, model);
+      return *layer != nullptr;
+    };
+  }
+
+  bool LoadLayers(const std::string& path, const std::string& prefix,
+                  bool zipped, LyraModel* model) {
+    const int nc = num_cond_hiddens_;
+    std::vector<std::function<bool()>> loaders = {
+        LayerLoader(ConditioningType::Conv1DParams(feature_depth_, nc,
+                                                   kNumThreads, path, prefix),
+                    nc, kConv1DKernel * feature_depth_, zipped, model,
+                    &conv1d_layer_),
+        LayerLoader(ConditioningType::DilatedParams(nc, 0, kNumThreads, path,
+                                                    prefix),
+                    nc, kDilatedKernel * nc, zipped, model,
+                    &dilated_conv_layer_0_),
+        LayerLoader(ConditioningType::DilatedParams(nc, 1, kNumThreads, path,
+                                                    prefix),
+                    nc, kDilatedKernel * nc, zipped, model,
+                    &dilated_conv_layer_1_),
+        LayerLoader(ConditioningType::DilatedParams(nc, 2, kNumThreads, path,
+                                                    prefix),
+                    nc, kDilatedKernel * nc, zipped, model,
+                    &dilated_conv_layer_2_),
+        LayerLoader(ConditioningType::TransposeParams(nc, 0, kNumThreads, path,
+                                                      prefix),
+                    kTransposeStride * nc, nc, zipped, model,
+                    &transpose_conv_layer_0_),
+        LayerLoader(ConditioningType::TransposeParams(nc, 1, kNumThreads, path,
+                                                      prefix),
+                    kTransposeStride * nc, nc, zipped, model,
+                    &transpose_conv_layer_1_),
+        LayerLoader(ConditioningType::TransposeParams(nc, 2, kNumThreads, path,
+                                                      prefix),
+                    kTransposeStride * nc, nc, zipped, model,
+                    &transpose_conv_layer_2_),
+    };
+    if (folded_projection_) {
+      loaders.push_back(LayerLoader(
+          ConditioningType::FoldedProjectionParams(nc, num_hiddens_,
+                                                   kNumThreads, path, prefix),
+          3 * num_hiddens_, nc, zipped, model, &folded_projection_layer_));
+    } else {
+      loaders.push_back(LayerLoader(
+          ConditioningType::ConvCondParams(nc, num_hiddens_, kNumThreads, path,
+                                           prefix),
+          num_hiddens_, nc, zipped, model, &conv_cond_layer_));
+      loaders.push_back(LayerLoader(
+          ConditioningType::ConvToGatesParams(num_hiddens_, kNumThreads, path,
+                                              prefix),
+          3 * num_hiddens_, num_hiddens_, zipped, model,
+          &conv_to_gates_layer_));
+    }
+    // The layers are read and decompressed concurrently.
+    return LoadInParallel(loaders);
+  }
+
+  // The first |cols| columns of |rows| rows of |buffer|. The buffers are
+  // contiguous, so the |rows| may differ from the ones |buffer| was created
+  // with, which reads the two output columns of a transpose layer per input
+  // column as one column of twice the rows, as the layer writes them.
+  template <typename T>
+  static csrblocksparse::VectorView<T> Columns(
+      const csrblocksparse::FatCacheAlignedVector<T>& buffer, int rows,
+      int cols) {
+    return csrblocksparse::VectorView<T>(buffer.data(), rows, cols, rows);
+  }
+
+  template <typename T>
+  static csrblocksparse::MutableVectorView<T> MutableColumns(
+      csrblocksparse::FatCacheAlignedVector<T>* buffer, int rows, int cols) {
+    return csrblocksparse::MutableVectorView<T>(buffer->data(), rows, cols,
+                                                rows);
+  }
+
+  // Runs the frames in |batch_frames_| through the stacks of
+  // |batch_streams_|, one column each.
+  void RunFrame() {
+    const int num_columns = batch_streams_.size();
+    const int nc = num_cond_hiddens_;
+
+    // The conv1d layer reads the frame below the ones before it.
+    for (int j = 0; j < num_columns; ++j) {
+      Stream& stream = streams_[batch_streams_[j]];
+      Conv1DRhsType* column = conv1d_input_.data() + j * conv1d_input_.rows();
+      std::copy(stream.conv1d_history.begin(), stream.conv1d_history.end(),
+                column);
+      CastVector(0, feature_depth_, batch_frames_[j],
+                 column + stream.conv1d_history.size());
+      std::copy(column + feature_depth_, column + conv1d_input_.rows(),
+                stream.conv1d_history.begin());
+    }
+    auto conv1d_out = MutableColumns(&dilated_input_0_, nc, num_columns);
+    conv1d_layer_->SpMM_bias(
+        Columns(conv1d_input_, conv1d_input_.rows(), num_columns), &conv1d_out,
+        /*relu=*/false);
+
+    RunDilatedLayer(0, dilated_conv_layer_0_, &Stream::dilated_history_0,
+                    dilated_input_0_, &dilated_window_0_, &dilated_input_1_);
+    RunDilatedLayer(1, dilated_conv_layer_1_, &Stream::dilated_history_1,
+                    dilated_input_1_, &dilated_window_1_, &dilated_input_2_);
+    RunDilatedLayer(2, dilated_conv_layer_2_, &Stream::dilated_history_2,
+                    dilated_input_2_, &dilated_window_2_, &transpose_input_0_);
+    for (const int stream : batch_streams_) {
+      streams_[stream].num_frames_run =
+          (streams_[stream].num_frames_run + 1) % kMaxDilation;
+    }
+
+    // Every transpose layer doubles the columns of each stream, which stay
+    // next to each other.
+    RunTransposeLayer(transpose_conv_layer_0_, transpose_input_0_, num_columns,
+                      &transpose_input_1_);
+    RunTransposeLayer(transpose_conv_layer_1_, transpose_input_1_,
+                      kTransposeStride * num_columns, &transpose_input_2_);
+    RunTransposeLayer(transpose_conv_layer_2_, transpose_input_2_,
+                      kTransposeStride * kTransposeStride * num_columns,
+                      &projection_input_);
+
+    const int num_projection_columns = kCondUpsamplingRatio * num_columns;
+    if (folded_projection_) {
+      auto folded_out = MutableColumns(&folded_projection_out_,
+                                       3 * num_hiddens_,
+                                       num_projection_columns);
+      folded_projection_layer_->SpMM_bias(
+          Columns(projection_input_, nc, num_projection_columns), &folded_out,
+          /*relu=*/false);
+      AppendFrames(folded_projection_out_);
+      return;
+    }
+    auto conv_cond_out =
+        MutableColumns(&conv_cond_out_, num_hiddens_, num_projection_columns);
+    conv_cond_layer_->SpMM_bias(
+        Columns(projection_input_, nc, num_projection_columns), &conv_cond_out,
+        /*relu=*/false);
+    CastVector(0, num_hiddens_ * num_projection_columns, conv_cond_out_.data(),
+               conv_to_gates_input_.data());
+    auto conv_to_gates_out = MutableColumns(
+        &conv_to_gates_out_, 3 * num_hiddens_, num_projection_columns);
+    conv_to_gates_layer_->SpMM_bias(
+        Columns(conv_to_gates_input_, num_hiddens_, num_projection_columns),
+        &conv_to_gates_out, /*relu=*/false);
+    AppendFrames(conv_to_gates_out_);
+  }
+
+  // Runs dilated layer |level| on |input|, whose columns are stacked below
+  // the input of |dilation| frames before into |window|, and adds |input| as
+  // the skip connection to |output|.
+  template <typename WeightType, typename RhsType, typename OutType>
+  void RunDilatedLayer(
+      int level, const SparseLayer<WeightType, RhsType>& layer,
+      std::vector<RhsType> Stream::*history,
+      const csrblocksparse::FatCacheAlignedVector<RhsType>& input,
+      csrblocksparse::FatCacheAlignedVector<RhsType>* window,
+      csrblocksparse::FatCacheAlignedVector<OutType>* output) {
+    const int num_columns = batch_streams_.size();
+    const int nc = num_cond_hiddens_;
+    const int dilation = ConditioningType::kDilation[level];
+    for (int j = 0; j < num_columns; ++j) {
+      Stream& stream = streams_[batch_streams_[j]];
+      RhsType* past =
+          (stream.*history).data() + (stream.num_frames_run % dilation) * nc;
+      const RhsType* current = input.data() + j * nc;
+      RhsType* column = window->data() + j * kDilatedKernel * nc;
+      std::copy(past, past + nc, column);
+      for (int i = 0; i < nc; ++i) {
+        column[nc + i] = static_cast<RhsType>(
+            std::max(static_cast<float>(current[i]), 0.0f));
+      }
+      // The Relu'd input is read again |dilation| frames later.
+      std::copy(column + nc, column + kDilatedKernel * nc, past);
+    }
+    auto output_view = MutableColumns(output, nc, num_columns);
+    layer->SpMM_bias(Columns(*window, kDilatedKernel * nc, num_columns),
+                     &output_view, /*relu=*/false);
+    for (int i = 0; i < nc * num_columns; ++i) {
+      const float sum = static_cast<float>(output_view.data()[i]) +
+                        static_cast<float>(input.data()[i]);
+      output_view.data()[i] = static_cast<OutType>(sum);
+    }
+  }
+
+  // Runs a transpose layer with Relu on |num_columns| columns of |input|,
+  // which writes twice as many columns into |output|.
+  template <typename WeightType, typename RhsType, typename OutType>
+  void RunTransposeLayer(
+      const SparseLayer<WeightType, RhsType>& layer,
+      const csrblocksparse::FatCacheAlignedVector<RhsType>& input,
+      int num_columns, csrblocksparse::FatCacheAlignedVector<OutType>* output) {
+    auto output_view =
+        MutableColumns(output, kTransposeStride * num_cond_hiddens_,
+                       num_columns);
+    layer->SpMM_bias(Columns(input, num_cond_hiddens_, num_columns),
+                     &output_view, /*relu=*/true);
+  }
+
+  // Converts the |kCondUpsamplingRatio| columns of each stream of |frames| to
+  // the input type of the GRU gate and appends them to its conditioning.
+  template <typename FrameType>
+  void AppendFrames(
+      const csrblocksparse::FatCacheAlignedVector<FrameType>& frames) {
+    const int frame_size = kCondUpsamplingRatio * frames.rows();
+    for (int j = 0; j < batch_streams_.size(); ++j) {
+      Stream& stream = streams_[batch_streams_[j]];
+      auto& conditioning = stream.conditioning;
+      // Shift the content of |conditioning| if necessary.
+      if (stream.num_precomputed_frames == num_frames_per_packet_) {
+        std::copy(conditioning.data() + frame_size,
+                  conditioning.data() + conditioning.size(),
+                  conditioning.data());
+      }
+      stream.num_precomputed_frames =
+          std::min(stream.num_precomputed_frames + 1, num_frames_per_packet_);
+      CastVector(0, frame_size, frames.data() + j * frame_size,
+                 conditioning.data() +
+                     (stream.num_precomputed_frames - 1) * frame_size);
+    }
+  }
+
+  const int num_streams_;
+  const int feature_depth_;
+  const int num_cond_hiddens_;
+  const int num_hiddens_;
+  const int num_samples_per_hop_;
+  const int num_frames_per_packet_;
+  // Whether the model holds a folded projection layer.
+  const bool folded_projection_;
+
+  std::vector<Stream> streams_;
+
+  SparseLayer<Conv1DWeightType, Conv1DRhsType> conv1d_layer_;
+  SparseLayer<CondStack0WeightType, CondStack0RhsType> dilated_conv_layer_0_;
+  SparseLayer<CondStack1WeightType, CondStack1RhsType> dilated_conv_layer_1_;
+  SparseLayer<CondStack2WeightType, CondStack2RhsType> dilated_conv_layer_2_;
+  SparseLayer<Transpose0WeightType, Transpose0RhsType>
+      transpose_conv_layer_0_;
+  SparseLayer<Transpose1WeightType, Transpose1RhsType>
+      transpose_conv_layer_1_;
+  SparseLayer<Transpose2WeightType, Transpose2RhsType>
+      transpose_conv_layer_2_;
+  // Either |folded_projection_layer_| or the other two are set.
+  SparseLayer<ConvCondWeightType, ConvCondRhsType> conv_cond_layer_;
+  SparseLayer<ConvToGatesWeightType, ConvToGatesRhsType> conv_to_gates_layer_;
+  SparseLayer<ConvToGatesWeightType, ConvCondRhsType> folded_projection_layer_;
+
+  // Buffers between the layers, with the columns of all streams of a frame.
+  csrblocksparse::FatCacheAlignedVector<Conv1DRhsType> conv1d_input_;
+  // The inputs of the dilated layers, before Relu, and the windows of Relu'd
+  // inputs that the products read.
+  csrblocksparse::FatCacheAlignedVector<CondStack0RhsType> dilated_input_0_;
+  csrblocksparse::FatCacheAlignedVector<CondStack1RhsType> dilated_input_1_;
+  csrblocksparse::FatCacheAlignedVector<CondStack2RhsType> dilated_input_2_;
+  csrblocksparse::FatCacheAlignedVector<CondStack0RhsType> dilated_window_0_;
+  csrblocksparse::FatCacheAlignedVector<CondStack1RhsType> dilated_window_1_;
+  csrblocksparse::FatCacheAlignedVector<CondStack2RhsType> dilated_window_2_;
+  csrblocksparse::FatCacheAlignedVector<Transpose0RhsType> transpose_input_0_;
+  csrblocksparse::FatCacheAlignedVector<Transpose1RhsType> transpose_input_1_;
+  csrblocksparse::FatCacheAlignedVector<Transpose2RhsType> transpose_input_2_;
+  csrblocksparse::FatCacheAlignedVector<ConvCondRhsType> projection_input_;
+  csrblocksparse::FatCacheAlignedVector<ConvCondOutputType> conv_cond_out_;
+  csrblocksparse::FatCacheAlignedVector<ConvToGatesRhsType>
+      conv_to_gates_input_;
+  csrblocksparse::FatCacheAlignedVector<ConvToGatesOutType> conv_to_gates_out_;
+  csrblocksparse::FatCacheAlignedVector<FoldedProjectionOutType>
+      folded_projection_out_;
+
+  // The streams of the frame being run and their input frames.
+  std::vector<int> batch_streams_;
+  std::vector<const float*> batch_frames_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_BATCHED_CAUSAL_CONVOLUTIONAL_CONDITIONING_H_
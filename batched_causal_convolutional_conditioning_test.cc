@@ -0,0 +1,201 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "batched_causal_convolutional_conditioning.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// placeholder for get runfiles header.
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_types.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static const char kPrefix[] = "lyra";
+static constexpr int kFeatureDepth = 3;
+static constexpr int kNumCondHiddens = 8;
+static constexpr int kNumHiddens = 4;
+static constexpr int kNumStreams = 3;
+static constexpr int kNumFramesPerBatchPacket = 2;
+static constexpr int kCondUpsamplingRatio = 8;
+static const int kNumSamplesPerHop = GetNumSamplesPerHop(16000);
+
+template <typename ComputeType>
+class BatchedCausalConvolutionalConditioningTest : public ::testing::Test {
+ protected:
+  using Types = ConditioningTypes<ComputeType, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+                                  6, 6, 6, 6, 6, 6, 6, 6>;
+  using BatchedType = BatchedCausalConvolutionalConditioning<Types>;
+  using SingleType = CausalConvolutionalConditioning<Types>;
+
+  BatchedCausalConvolutionalConditioningTest()
+      : testdata_dir_(ghc::filesystem::current_path() / "testdata"),
+        batched_(BatchedType::Create(
+            kNumStreams, kFeatureDepth, kNumCondHiddens, kNumHiddens,
+            kNumSamplesPerHop, kNumFramesPerBatchPacket,
+            testdata_dir_.string(), kPrefix)) {
+    for (int i = 0; i < kNumStreams; ++i) {
+      singles_.push_back(CreateSingle());
+    }
+  }
+
+  std::unique_ptr<SingleType> CreateSingle() const {
+    return absl::make_unique<SingleType>(
+        kFeatureDepth, kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+        kNumFramesPerBatchPacket, /*num_threads=*/1, testdata_dir_.string(),
+        kPrefix);
+  }
+
+  // Features that differ between streams and frames.
+  static csrblocksparse::FatCacheAlignedVector<float> Features(int stream,
+                                                               int tick,
+                                                               int num_frames) {
+    csrblocksparse::FatCacheAlignedVector<float> features(kFeatureDepth,
+                                                          num_frames);
+    for (int i = 0; i < features.size(); ++i) {
+      features.data()[i] = 0.1f * ((stream + 2 * tick + i) % 7) - 0.3f;
+    }
+    return features;
+  }
+
+  // Expects the current conditioning of stream |stream| of |batched_| to
+  // match the one of |single|.
+  void ExpectSameConditioning(int stream, SingleType* single) {
+    ASSERT_EQ(batched_->num_samples(stream), single->num_samples());
+    for (int step = 0; step < single->num_samples();
+         step += kNumSamplesPerHop / kCondUpsamplingRatio) {
+      const auto batched_output = batched_->AtStep(stream, step);
+      const auto single_output = single->AtStep(step);
+      ASSERT_EQ(batched_output.size(), single_output.size());
+      for (int k = 0; k < single_output.size(); ++k) {
+        EXPECT_NEAR(static_cast<float>(batched_output[k]),
+                    static_cast<float>(single_output[k]), 1e-5f)
+            << "Stream " << stream << ", step " << step << ", element " << k;
+      }
+    }
+  }
+
+  const ghc::filesystem::path testdata_dir_;
+  std::unique_ptr<BatchedType> batched_;
+  std::vector<std::unique_ptr<SingleType>> singles_;
+};
+
+using ComputeTypes = ::testing::Types<float, csrblocksparse::fixed16_type>;
+TYPED_TEST_SUITE(BatchedCausalConvolutionalConditioningTest, ComputeTypes);
+
+TYPED_TEST(BatchedCausalConvolutionalConditioningTest, MatchesStreamsRunAlone) {
+  ASSERT_NE(this->batched_, nullptr);
+  // Past the 10 frames the output of a frame depends on, with streams that
+  // are not due in some ticks and streams that bring fewer frames.
+  for (int tick = 0; tick < 8; ++tick) {
+    std::vector<int> streams;
+    std::vector<csrblocksparse::FatCacheAlignedVector<float>> features;
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      if (tick % 3 == 2 && stream == 1) {
+        continue;
+      }
+      const int num_frames =
+          stream == 2 && tick % 2 == 1 ? 1 : kNumFramesPerBatchPacket;
+      streams.push_back(stream);
+      features.push_back(this->Features(stream, tick, num_frames));
+      this->singles_[stream]->Precompute(features.back(), /*num_threads=*/1);
+    }
+    std::vector<csrblocksparse::VectorView<float>> inputs;
+    for (const auto& input : features) {
+      inputs.push_back(csrblocksparse::VectorView<float>(input));
+    }
+    this->batched_->Precompute(absl::MakeConstSpan(streams),
+                               absl::MakeConstSpan(inputs));
+
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      this->ExpectSameConditioning(stream, this->singles_[stream].get());
+    }
+  }
+}
+
+TYPED_TEST(BatchedCausalConvolutionalConditioningTest,
+           ResetStreamForgetsOnlyItsHistory) {
+  ASSERT_NE(this->batched_, nullptr);
+  const std::vector<int> all_streams = {0, 1, 2};
+  for (int tick = 0; tick < 4; ++tick) {
+    std::vector<csrblocksparse::FatCacheAlignedVector<float>> features;
+    std::vector<csrblocksparse::VectorView<float>> inputs;
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      features.push_back(
+          this->Features(stream, tick, kNumFramesPerBatchPacket));
+    }
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      inputs.push_back(csrblocksparse::VectorView<float>(features[stream]));
+      this->singles_[stream]->Precompute(features[stream],
+                                         /*num_threads=*/1);
+    }
+    this->batched_->Precompute(absl::MakeConstSpan(all_streams),
+                               absl::MakeConstSpan(inputs));
+  }
+
+  this->batched_->ResetStream(1);
+  EXPECT_EQ(this->batched_->num_samples(1), 0);
+  this->singles_[1] = this->CreateSingle();
+  for (int tick = 0; tick < 2; ++tick) {
+    std::vector<csrblocksparse::FatCacheAlignedVector<float>> features;
+    std::vector<csrblocksparse::VectorView<float>> inputs;
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      features.push_back(
+          this->Features(stream, tick, kNumFramesPerBatchPacket));
+    }
+    for (int stream = 0; stream < kNumStreams; ++stream) {
+      inputs.push_back(csrblocksparse::VectorView<float>(features[stream]));
+      this->singles_[stream]->Precompute(features[stream],
+                                         /*num_threads=*/1);
+    }
+    this->batched_->Precompute(absl::MakeConstSpan(all_streams),
+                               absl::MakeConstSpan(inputs));
+  }
+  for (int stream = 0; stream < kNumStreams; ++stream) {
+    this->ExpectSameConditioning(stream, this->singles_[stream].get());
+  }
+}
+
+TEST(BatchedCausalConvolutionalConditioningCreate, InvalidArgumentsReturnNull) {
+  using BatchedType = BatchedCausalConvolutionalConditioning<
+      ConditioningTypes<float, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+                        6, 6>>;
+  const std::string testdata_dir =
+      (ghc::filesystem::current_path() / "testdata").string();
+  for (const int invalid_num_streams : {-1, 0}) {
+    EXPECT_EQ(BatchedType::Create(invalid_num_streams, kFeatureDepth,
+                                  kNumCondHiddens, kNumHiddens,
+                                  kNumSamplesPerHop, kNumFramesPerBatchPacket,
+                                  testdata_dir, kPrefix),
+              nullptr);
+  }
+  EXPECT_EQ(BatchedType::Create(kNumStreams, kFeatureDepth, kNumCondHiddens,
+                                kNumHiddens, kNumSamplesPerHop,
+                                kNumFramesPerBatchPacket, testdata_dir,
+                                "does_not_exist"),
+            nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,375 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_BATCHED_LYRA_WAVEGRU_H_
+#define LYRA_CODEC_BATCHED_LYRA_WAVEGRU_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "batched_causal_convolutional_conditioning.h"
+#include "causal_convolutional_conditioning.h"
+#include "dsp_util.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "layer_wrappers_lib.h"
+#include "lyra_types.h"
+#include "model_unpacker.h"
+#include "project_and_sample.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Runs the WaveGRU sampling loop for |num_streams| independent streams at
+// once. The GRU states and autoregressive inputs of all streams are stored as
+// the columns of a single input buffer, so the ar_to_gates and GRU layers
+// are each evaluated with one sparse matrix-matrix product per step, and their
+// weights are only streamed from memory once for the whole batch instead of
+// once per stream.
+// Per-stream state (GRU state, autoregressive input, random generator and the
+// position in the conditioning) is kept separate, so each stream produces the
+// same samples it would produce in its own LyraWavegru.
+// This class is not thread-safe and runs on the calling thread only.
+template <typename WeightTypeKind>
+class BatchedLyraWavegru {
+ public:
+  using Types = WavegruTypes<WeightTypeKind>;
+  using ArWeightType = typename Types::ArWeightType;
+  using ArRhsType = typename Types::ArRhsType;
+  using ArOutputType = typename Types::ArOutputType;
+  using GruWeightType = typename Types::GruWeightType;
+  using GruStateType = typename Types::GruStateType;
+  using GruRhsType = typename Types::GruRhsType;
+  using DiskWeightType = typename Types::DiskWeightType;
+  using ScratchType = typename Types::ScratchType;
+
+  // The layers are held by their final types, so that the calls made for
+  // every sample are resolved statically and can be inlined.
+  using ArLayerType = Conv1DLayerWrapper<ArWeightType, ArRhsType, ArOutputType,
+                                         DiskWeightType>;
+  using GruLayerType = Conv1DLayerWrapper<GruWeightType, GruStateType,
+                                          GruRhsType, DiskWeightType>;
+
+  using ConditioningType =
+      CausalConvolutionalConditioning<ConditioningTypes<WeightTypeKind>>;
+  using BatchedConditioningType = BatchedCausalConvolutionalConditioning<
+      ConditioningTypes<WeightTypeKind>>;
+
+  using ProjectAndSampleType =
+      ProjectAndSample<ProjectAndSampleTypes<WeightTypeKind>>;
+
+  // Returns a nullptr on failure.
+  static std::unique_ptr<BatchedLyraWavegru<WeightTypeKind>> Create(
+      int num_streams, const ghc::filesystem::path& path,
+      const std::string& prefix) {
+    if (num_streams < 1) {
+      LOG(ERROR) << "Number of streams has to be positive, but was "
+                 << num_streams << ".";
+      return nullptr;
+    }
+    const int kNumThreads = 1;
+
+    // The streams are stacked as the |length| columns of a 1x1 convolution.
+    const bool zipped = IsZippedModel(path, prefix);
+    LayerParams ar_to_gates_params{.num_input_channels = kNumSplitBands,
+                                   .num_filters = 3 * kNumGruHiddens,
+                                   .length = num_streams,
+                                   .kernel_size = 1,
+                                   .dilation = 1,
+                                   .stride = 1,
+                                   .relu = false,
+                                   .skip_connection = false,
+                                   .type = LayerType::kConv1D,
+                                   .num_threads = kNumThreads,
+                                   .per_column_barrier = false,
+                                   .from =
+                                       LayerParams::FromDisk{
+                                           .path = path.string(),
+                                           .zipped = zipped,
+                                       },
+                                   .prefix = prefix + "_ar_to_gates_"};
+    auto ar_to_gates_layer = ArLayerType::Create(ar_to_gates_params);
+    if (ar_to_gates_layer == nullptr) {
+      return nullptr;
+    }
+
+    LayerParams gru_params{.num_input_channels = kNumGruHiddens,
+                           .num_filters = 3 * kNumGruHiddens,
+                           .length = num_streams,
+                           .kernel_size = 1,
+                           .dilation = 1,
+                           .stride = 1,
+                           .relu = false,
+                           .skip_connection = false,
+                           .type = LayerType::kConv1D,
+                           .num_threads = kNumThreads,
+                           .per_column_barrier = false,
+                           .from =
+                               LayerParams::FromDisk{
+                                   .path = path.string(),
+                                   .zipped = zipped,
+                               },
+                           .prefix = prefix + "_gru_layer_"};
+    auto gru_layer = GruLayerType::Create(gru_params);
+    if (gru_layer == nullptr) {
+      return nullptr;
+    }
+
+    // The projection and sampling layers only keep scratch space between
+    // calls, so a single instance is shared by all streams.
+    auto project_and_sample_layer = absl::make_unique<ProjectAndSampleType>();
+    project_and_sample_layer->LoadRaw(path, prefix + "_", zipped);
+    if (project_and_sample_layer->PrepareForThreads(kNumThreads) !=
+        kNumThreads) {
+      LOG(ERROR) << "Could not prepare project_and_sample.";
+      return nullptr;
+    }
+    return absl::WrapUnique(new BatchedLyraWavegru<WeightTypeKind>(
+        num_streams, std::move(ar_to_gates_layer), std::move(gru_layer),
+        std::move(project_and_sample_layer)));
+  }
+
+  // Generates |num_samples| samples for every stream in the batch. Stream |i|
+  // reads its conditioning from |conditionings[i]| starting at
+  // |conditioning_starts[i]| and writes |num_samples| / |num_split_bands()|
+  // samples into each band of |split_band_samples->at(i)|.
+  // |num_samples| has to be a multiple of |num_split_bands()| and every
+  // conditioning needs to have at least that many samples left.
+  // Returns the number of samples generated per stream.
+  int SampleBatch(
+      absl::Span<ConditioningType* const> conditionings,
+      absl::Span<const int> conditioning_starts, int num_samples,
+      std::vector<std::vector<std::vector<int16_t>>>* split_band_samples) {
+    CHECK_EQ(conditionings.size(), num_streams_);
+    return SampleStreams(
+        [conditionings](int stream) {
+          return conditionings[stream]->num_samples();
+        },
+        [conditionings](int stream, int step) {
+          return conditionings[stream]->AtStep(step);
+        },
+        conditioning_starts, num_samples, split_band_samples);
+  }
+
+  // Same as above, but stream |i| reads the conditioning of stream |i| of
+  // |conditioning|, which must have |num_streams()| streams.
+  int SampleBatch(
+      const BatchedConditioningType& conditioning,
+      absl::Span<const int> conditioning_starts, int num_samples,
+      std::vector<std::vector<std::vector<int16_t>>>* split_band_samples) {
+    CHECK_EQ(conditioning.num_streams(), num_streams_);
+    return SampleStreams(
+        [&conditioning](int stream) {
+          return conditioning.num_samples(stream);
+        },
+        [&conditioning](int stream, int step) {
+          return conditioning.AtStep(stream, step);
+        },
+        conditioning_starts, num_samples, split_band_samples);
+  }
+
+  // Clears the GRU state, the autoregressive input and the random generator
+  // of |stream|, so the slot can be reused for a new session without
+  // affecting the other streams.
+  void ResetStream(int stream) {
+    CHECK_GE(stream, 0);
+    CHECK_LT(stream, num_streams_);
+    auto gru_states = gru_layer_->InputViewToUpdate();
+    std::fill_n(gru_states.data() + stream * gru_states.col_stride(),
+                kNumGruHiddens, static_cast<GruStateType>(0.f));
+    auto ar_inputs = ar_to_gates_layer_->InputViewToUpdate();
+    std::fill_n(ar_inputs.data() + stream * ar_inputs.col_stride(),
+                kNumSplitBands, static_cast<ArRhsType>(0.f));
+    stream_gens_[stream] = InitialGenerator();
+  }
+
+  int num_streams() const { return num_streams_; }
+
+  int num_gru_hiddens() const { return kNumGruHiddens; }
+
+  int num_split_bands() const { return kNumSplitBands; }
+
+ private:
+  static constexpr int kNumGruHiddens = 1024;
+  static constexpr int kNumSplitBands = 4;
+
+  BatchedLyraWavegru() = delete;
+
+  BatchedLyraWavegru(
+      int num_streams, std::unique_ptr<ArLayerType> ar_to_gates_layer,
+      std::unique_ptr<GruLayerType> gru_layer,
+      std::unique_ptr<ProjectAndSampleType> project_and_sample_layer)
+      : num_streams_(num_streams),
+        ar_to_gates_layer_(std::move(ar_to_gates_layer)),
+        gru_layer_(std::move(gru_layer)),
+        project_and_sample_layer_(std::move(project_and_sample_layer)),
+        ar_output_buffer_(3 * kNumGruHiddens, num_streams),
+        ar_and_cond_to_gates_buffer_(3 * kNumGruHiddens, num_streams),
+        gru_gates_buffer_(3 * kNumGruHiddens, num_streams),
+        conditioning_buffer_(3 * kNumGruHiddens),
+        sample_tmp_(project_and_sample_layer_->expanded_mixes_size()),
+        sample_at_s_(kNumSplitBands),
+        stream_gens_(num_streams, InitialGenerator()),
+        spin_barrier_(absl::make_unique<csrblocksparse::SpinBarrier>(1)) {
+    ar_output_buffer_.FillZero();
+    ar_and_cond_to_gates_buffer_.FillZero();
+    gru_gates_buffer_.FillZero();
+    sample_tmp_.FillZero();
+  }
+
+  // Runs |SampleBatch| on streams that read |num_conditioning_samples(i)|
+  // samples of conditioning of stream |i| through |at_step(i, step)|.
+  template <typename NumConditioningSamples, typename AtStep>
+  int SampleStreams(
+      NumConditioningSamples num_conditioning_samples, AtStep at_step,
+      absl::Span<const int> conditioning_starts, int num_samples,
+      std::vector<std::vector<std::vector<int16_t>>>* split_band_samples) {
+    CHECK_EQ(conditioning_starts.size(), num_streams_);
+    CHECK_EQ(split_band_samples->size(), num_streams_);
+    // We can only generate samples in multiples of |kNumSplitBands|.
+    CHECK_EQ(num_samples % kNumSplitBands, 0);
+    CHECK_GE(num_samples, 0);
+    for (int i = 0; i < num_streams_; ++i) {
+      CHECK_LE(conditioning_starts[i] + num_samples,
+               num_conditioning_samples(i))
+          << "Stream " << i << " does not have enough conditioning.";
+      CHECK_EQ(split_band_samples->at(i).size(), kNumSplitBands);
+      for (auto& band : split_band_samples->at(i)) {
+        band.resize(num_samples / kNumSplitBands);
+      }
+    }
+
+    constexpr int kTid = 0;
+    for (int s = 0; s < num_samples; s += kNumSplitBands) {
+      // Bring the AR samples of all streams up to 3 * kNumGruHiddens in one
+      // pass over the weights.
+      ar_to_gates_layer_->Run(
+          kTid, spin_barrier_.get(),
+          csrblocksparse::MutableVectorView<ArOutputType>(&ar_output_buffer_));
+
+      // Sum the conditioning and autoregressive output per stream.
+      for (int i = 0; i < num_streams_; ++i) {
+        const GruRhsType* conditioning =
+            GateInputConditioning(at_step(i, conditioning_starts[i] + s));
+        GruRhsType* ar_and_cond = ar_and_cond_to_gates_buffer_.slice(i).data();
+        CastVector(0, 3 * kNumGruHiddens, ar_output_buffer_.slice(i).data(),
+                   ar_and_cond);
+        csrblocksparse::detail::SumVectors(0, 3 * kNumGruHiddens, conditioning,
+                                           ar_and_cond, ar_and_cond);
+      }
+
+      // Pass the GRU states of all streams through the GRU layer at once.
+      gru_layer_->Run(
+          kTid, spin_barrier_.get(),
+          csrblocksparse::MutableVectorView<GruRhsType>(&gru_gates_buffer_));
+
+      auto gru_states = gru_layer_->InputViewToUpdate();
+      auto ar_inputs = ar_to_gates_layer_->InputViewToUpdate();
+      for (int i = 0; i < num_streams_; ++i) {
+        GruStateType* gru_state =
+            gru_states.data() + i * gru_states.col_stride();
+        gru_gates_
+            .template GruWithARInput<csrblocksparse::ARInputsMode::k0ARInputs>(
+                0, kNumGruHiddens, /*state_size=*/kNumGruHiddens,
+                /*gru_recurrent_ptr=*/gru_gates_buffer_.slice(i).data(),
+                /*input_ptr=*/ar_and_cond_to_gates_buffer_.slice(i).data(),
+                /*gru_state_ptr=*/gru_state);
+
+        // Project and sample.
+        project_and_sample_layer_->GetSamples(
+            csrblocksparse::MutableVectorView<GruStateType>(
+                gru_state, kNumGruHiddens, 1, kNumGruHiddens),
+            kTid, &stream_gens_[i], &sample_tmp_, kNumSplitBands,
+            sample_at_s_.data());
+
+        // Loop back the samples as the input of |ar_to_gates_layer_| for the
+        // next step.
+        ArRhsType* sample_at_sminus1 =
+            ar_inputs.data() + i * ar_inputs.col_stride();
+        for (int band = 0; band < kNumSplitBands; ++band) {
+          sample_at_sminus1[band] =
+              static_cast<ArRhsType>(SampleToFloat(sample_at_s_[band]));
+          split_band_samples->at(i)[band][s / kNumSplitBands] =
+              sample_at_s_[band];
+        }
+      }
+    }
+    return num_samples;
+  }
+
+  // Returns |conditioning| as gate inputs, widened into
+  // |conditioning_buffer_| if it is stored in another type.
+  const GruRhsType* GateInputConditioning(
+      absl::Span<const typename ConditioningType::OutputType> conditioning) {
+    if constexpr (std::is_same<typename ConditioningType::OutputType,
+                               GruRhsType>::value) {
+      return conditioning.data();
+    } else {
+      CastVector(0, conditioning.size(), conditioning.data(),
+                 conditioning_buffer_.data());
+      return conditioning_buffer_.data();
+    }
+  }
+
+  // Matches the state of the generators in LyraWavegru after construction.
+  static std::minstd_rand InitialGenerator() {
+    std::minstd_rand gen;
+    gen.discard(10);
+    return gen;
+  }
+
+  // The range [-32768, 32767] is mapped to floating point by x / 32768.0f
+  // resulting in a range of [-1.f, 1.f).
+  static float SampleToFloat(int sample) {
+    return static_cast<float>(sample) / 32768.0f;
+  }
+
+  const int num_streams_;
+
+  std::unique_ptr<ArLayerType> ar_to_gates_layer_;
+  std::unique_ptr<GruLayerType> gru_layer_;
+  std::unique_ptr<ProjectAndSampleType> project_and_sample_layer_;
+  csrblocksparse::GruGates<GruStateType, GruRhsType, ArRhsType> gru_gates_;
+
+  // Buffers, one column per stream.
+  csrblocksparse::FatCacheAlignedVector<ArOutputType> ar_output_buffer_;
+  csrblocksparse::FatCacheAlignedVector<GruRhsType>
+      ar_and_cond_to_gates_buffer_;
+  csrblocksparse::FatCacheAlignedVector<GruRhsType> gru_gates_buffer_;
+  // The conditioning of one stream and step as gate inputs, only used if it is
+  // stored in another type.
+  csrblocksparse::CacheAlignedVector<GruRhsType> conditioning_buffer_;
+  csrblocksparse::CacheAlignedVector<ScratchType> sample_tmp_;
+  std::vector<int> sample_at_s_;
+
+  // Random generators for each stream.
+  std::vector<std::minstd_rand> stream_gens_;
+
+  std::unique_ptr<csrblocksparse::SpinBarrier> spin_barrier_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_BATCHED_LYRA_WAVEGRU_H_
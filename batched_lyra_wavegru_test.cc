@@ -0,0 +1,198 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "batched_lyra_wavegru.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// placeholder for get runfiles header.
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static const char kPrefix[] = "lyra_16khz";
+static constexpr int kNumCondHiddens = 512;
+
+#ifdef USE_FIXED16
+using ComputeType = csrblocksparse::fixed16_type;
+#elif USE_BFLOAT16
+using ComputeType = csrblocksparse::bfloat16;
+#else
+using ComputeType = float;
+#endif  // USE_FIXED16
+
+using BatchedWavegruType = BatchedLyraWavegru<ComputeType>;
+using ConditioningType = BatchedWavegruType::ConditioningType;
+
+class BatchedLyraWavegruTest : public testing::TestWithParam<int> {
+ protected:
+  BatchedLyraWavegruTest()
+      : num_streams_(GetParam()),
+        model_path_(ghc::filesystem::current_path() / "wavegru"),
+        num_samples_per_hop_(GetNumSamplesPerHop(kInternalSampleRateHz)),
+        batched_wavegru_(
+            BatchedWavegruType::Create(num_streams_, model_path_, kPrefix)) {}
+
+  std::unique_ptr<ConditioningType> CreateConditioning() {
+    auto conditioning = absl::make_unique<ConditioningType>(
+        kNumFeatures, kNumCondHiddens, batched_wavegru_->num_gru_hiddens(),
+        num_samples_per_hop_, kNumFramesPerPacket, /*num_threads=*/1,
+        model_path_.string(), kPrefix);
+    csrblocksparse::FatCacheAlignedVector<float> features(kNumFeatures, 1);
+    features.FillZero();
+    conditioning->Precompute(features, /*num_threads=*/1);
+    return conditioning;
+  }
+
+  const int num_streams_;
+  const ghc::filesystem::path model_path_;
+  const int num_samples_per_hop_;
+  std::unique_ptr<BatchedWavegruType> batched_wavegru_;
+};
+
+TEST_P(BatchedLyraWavegruTest, ModelExists) {
+  ASSERT_NE(batched_wavegru_, nullptr);
+  EXPECT_EQ(batched_wavegru_->num_streams(), num_streams_);
+}
+
+TEST_P(BatchedLyraWavegruTest, StreamsWithSameInputProduceSameSamples) {
+  ASSERT_NE(batched_wavegru_, nullptr);
+  std::vector<std::unique_ptr<ConditioningType>> conditioning_owners;
+  std::vector<ConditioningType*> conditionings;
+  for (int i = 0; i < num_streams_; ++i) {
+    conditioning_owners.push_back(CreateConditioning());
+    conditionings.push_back(conditioning_owners.back().get());
+  }
+  const std::vector<int> conditioning_starts(num_streams_, 0);
+  std::vector<std::vector<std::vector<int16_t>>> split_band_samples(
+      num_streams_, std::vector<std::vector<int16_t>>(
+                        batched_wavegru_->num_split_bands()));
+
+  EXPECT_EQ(batched_wavegru_->SampleBatch(
+                absl::MakeConstSpan(conditionings),
+                absl::MakeConstSpan(conditioning_starts), num_samples_per_hop_,
+                &split_band_samples),
+            num_samples_per_hop_);
+
+  for (int i = 0; i < num_streams_; ++i) {
+    for (const auto& band : split_band_samples[i]) {
+      EXPECT_EQ(band.size(),
+                num_samples_per_hop_ / batched_wavegru_->num_split_bands());
+    }
+    EXPECT_EQ(split_band_samples[i], split_band_samples[0]);
+  }
+}
+
+TEST_P(BatchedLyraWavegruTest, ResetStreamRestartsItsSequence) {
+  ASSERT_NE(batched_wavegru_, nullptr);
+  std::vector<std::unique_ptr<ConditioningType>> conditioning_owners;
+  std::vector<ConditioningType*> conditionings;
+  for (int i = 0; i < num_streams_; ++i) {
+    conditioning_owners.push_back(CreateConditioning());
+    conditionings.push_back(conditioning_owners.back().get());
+  }
+  const std::vector<int> conditioning_starts(num_streams_, 0);
+  const int num_samples = 4 * batched_wavegru_->num_split_bands();
+  std::vector<std::vector<std::vector<int16_t>>> first_samples(
+      num_streams_, std::vector<std::vector<int16_t>>(
+                        batched_wavegru_->num_split_bands()));
+  batched_wavegru_->SampleBatch(absl::MakeConstSpan(conditionings),
+                                absl::MakeConstSpan(conditioning_starts),
+                                num_samples, &first_samples);
+
+  for (int i = 0; i < num_streams_; ++i) {
+    batched_wavegru_->ResetStream(i);
+  }
+  std::vector<std::vector<std::vector<int16_t>>> second_samples(
+      num_streams_, std::vector<std::vector<int16_t>>(
+                        batched_wavegru_->num_split_bands()));
+  batched_wavegru_->SampleBatch(absl::MakeConstSpan(conditionings),
+                                absl::MakeConstSpan(conditioning_starts),
+                                num_samples, &second_samples);
+
+  EXPECT_EQ(first_samples, second_samples);
+}
+
+TEST_P(BatchedLyraWavegruTest, BatchedConditioningProducesSameSamples) {
+  ASSERT_NE(batched_wavegru_, nullptr);
+  std::vector<std::unique_ptr<ConditioningType>> conditioning_owners;
+  std::vector<ConditioningType*> conditionings;
+  for (int i = 0; i < num_streams_; ++i) {
+    conditioning_owners.push_back(CreateConditioning());
+    conditionings.push_back(conditioning_owners.back().get());
+  }
+  auto batched_conditioning = BatchedWavegruType::BatchedConditioningType::
+      Create(num_streams_, kNumFeatures, kNumCondHiddens,
+             batched_wavegru_->num_gru_hiddens(), num_samples_per_hop_,
+             kNumFramesPerPacket, model_path_.string(), kPrefix);
+  ASSERT_NE(batched_conditioning, nullptr);
+  csrblocksparse::FatCacheAlignedVector<float> features(kNumFeatures, 1);
+  features.FillZero();
+  std::vector<int> streams;
+  std::vector<csrblocksparse::VectorView<float>> inputs;
+  for (int i = 0; i < num_streams_; ++i) {
+    streams.push_back(i);
+    inputs.push_back(csrblocksparse::VectorView<float>(features));
+  }
+  batched_conditioning->Precompute(absl::MakeConstSpan(streams),
+                                   absl::MakeConstSpan(inputs));
+
+  const std::vector<int> conditioning_starts(num_streams_, 0);
+  const int num_samples = 4 * batched_wavegru_->num_split_bands();
+  std::vector<std::vector<std::vector<int16_t>>> samples(
+      num_streams_, std::vector<std::vector<int16_t>>(
+                        batched_wavegru_->num_split_bands()));
+  batched_wavegru_->SampleBatch(absl::MakeConstSpan(conditionings),
+                                absl::MakeConstSpan(conditioning_starts),
+                                num_samples, &samples);
+  for (int i = 0; i < num_streams_; ++i) {
+    batched_wavegru_->ResetStream(i);
+  }
+  std::vector<std::vector<std::vector<int16_t>>> batched_samples(
+      num_streams_, std::vector<std::vector<int16_t>>(
+                        batched_wavegru_->num_split_bands()));
+  EXPECT_EQ(batched_wavegru_->SampleBatch(
+                *batched_conditioning,
+                absl::MakeConstSpan(conditioning_starts), num_samples,
+                &batched_samples),
+            num_samples);
+
+  EXPECT_EQ(batched_samples, samples);
+}
+
+INSTANTIATE_TEST_SUITE_P(NumStreams, BatchedLyraWavegruTest,
+                         testing::Values(1, 2, 8));
+
+TEST(BatchedLyraWavegruCreate, InvalidNumStreamsReturnsNullptr) {
+  for (const int invalid_num_streams : {-1, 0}) {
+    EXPECT_EQ(BatchedWavegruType::Create(
+                  invalid_num_streams,
+                  ghc::filesystem::current_path() / "wavegru", kPrefix),
+              nullptr);
+  }
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -12,17 +12,89 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <numeric>
 #include <string>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/flags/usage.h"
+#include "absl/time/time.h"
 #include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "tracing.h"
 
 ABSL_FLAG(int, num_cond_vectors, 2000,
           "The number of conditioning vectors to feed to the conditioning "
           "stack / network. "
-          "Equivalent to the number of calls to Precompute and Run.");
+          "Equivalent to the number of calls to Precompute and Run, "
+          "including the warm-up calls.");
+
+ABSL_FLAG(int, num_threads, 1,
+          "The number of threads used to run the model, including the main "
+          "thread.");
+
+ABSL_FLAG(bool, profile_stages, false,
+          "Logs latency histograms of every stage of the sampling loop and of "
+          "the time each thread waits at barriers.");
+
+ABSL_FLAG(bool, perf_counters, false,
+          "Also counts cycles, instructions, branch misses and last level "
+          "cache misses while conditioning and sampling, and in every stage "
+          "with --profile_stages, where perf_event_open is permitted.");
+
+ABSL_FLAG(bool, measure_energy, false,
+          "Also measures how much energy the device draws per second of "
+          "decoded audio, from the power rail monitors where they can be read "
+          "or else the battery. Run it on battery.");
+
+ABSL_FLAG(bool, energy_sweep, false,
+          "Measures the energy of decoding with every precision and every "
+          "number of threads up to --num_threads, and compares them.");
+
+ABSL_FLAG(bool, warm_up, false,
+          "Warms the model up before the first conditioning vector, to "
+          "compare the latency of the first call with the steady state.");
+
+ABSL_FLAG(std::string, precision, "",
+          "Arithmetic of the model, one of 'float', 'fixed16' or 'bfloat16'. "
+          "Defaults to the precision the binary was built for.");
+
+ABSL_FLAG(int, num_warm_up_calls, 0,
+          "The number of calls at the start that are run but left out of the "
+          "stats, e.g. to exclude cold caches.");
+
+ABSL_FLAG(int, prefetch_distance, 0,
+          "Steps of the sampling loop ahead of which every thread prefetches "
+          "the conditioning while it waits for the samples, or 0 to leave it "
+          "to the hardware prefetcher. Compare the conditioning sum stage of "
+          "--profile_stages, or cache misses under a counter profiler, with "
+          "and without it.");
+
+ABSL_FLAG(bool, gru_row_pipelining, false,
+          "Makes every thread wait after the GRU matrix multiplication only "
+          "for the threads whose rows it reads. Compare the barrier waits of "
+          "--profile_stages with and without it.");
+
+ABSL_FLAG(std::string, output_dir,
+          chromemedia::codec::kDefaultBenchmarkOutputDir,
+          "Directory the timings of every call are written to as CSV, and "
+          "their stats with the host metadata as benchmark_decode.json. "
+          "Nothing is written if empty.");
+
+ABSL_FLAG(std::string, trace_path, "",
+          "If set, traces the codec internals and writes the most recent "
+          "events of every thread to this path as Chrome trace JSON.");
+
+ABSL_FLAG(bool, per_cluster, false,
+          "Runs the benchmark once on every cluster of identical cores, such "
+          "as the big and LITTLE cores of a phone, with all threads pinned "
+          "to it, and compares them.");
+
+ABSL_FLAG(double, performance_hint_target_ms, 0.0,
+          "If positive, asks Android 13 and later to clock the cores so that "
+          "every call of the sampling loop takes at most this long.");
 
 ABSL_FLAG(
     std::string, model_path, "wavegru",
@@ -34,6 +106,58 @@ int main(int argc, char** argv) {
   absl::SetProgramUsageMessage(argv[0]);
   absl::ParseCommandLine(argc, argv);
 
-  return chromemedia::codec::benchmark_decode(
-      absl::GetFlag(FLAGS_num_cond_vectors), absl::GetFlag(FLAGS_model_path));
+  chromemedia::codec::ComputePrecision precision =
+      chromemedia::codec::kDefaultComputePrecision;
+  const std::string precision_name = absl::GetFlag(FLAGS_precision);
+  if (!precision_name.empty()) {
+    const auto precision_or =
+        chromemedia::codec::ComputePrecisionFromName(precision_name);
+    if (!precision_or.has_value()) {
+      LOG(ERROR) << "Unknown precision '" << precision_name << "'.";
+      return -1;
+    }
+    precision = precision_or.value();
+  }
+
+  const std::string trace_path = absl::GetFlag(FLAGS_trace_path);
+  if (!trace_path.empty()) {
+    chromemedia::codec::Tracing::Enable();
+  }
+  chromemedia::codec::BenchmarkDecodeOptions options;
+  options.num_cond_vectors = absl::GetFlag(FLAGS_num_cond_vectors);
+  options.model_base_path = absl::GetFlag(FLAGS_model_path);
+  options.num_threads = absl::GetFlag(FLAGS_num_threads);
+  options.profile_stages = absl::GetFlag(FLAGS_profile_stages);
+  options.count_perf_events = absl::GetFlag(FLAGS_perf_counters);
+  options.measure_energy = absl::GetFlag(FLAGS_measure_energy);
+  options.precision = precision;
+  options.warm_up = absl::GetFlag(FLAGS_warm_up);
+  options.num_warm_up_calls = absl::GetFlag(FLAGS_num_warm_up_calls);
+  options.prefetch_distance = absl::GetFlag(FLAGS_prefetch_distance);
+  options.gru_row_pipelining = absl::GetFlag(FLAGS_gru_row_pipelining);
+  options.output_dir = absl::GetFlag(FLAGS_output_dir);
+  options.affinity.performance_hint_target =
+      absl::Milliseconds(absl::GetFlag(FLAGS_performance_hint_target_ms));
+  int result;
+  if (absl::GetFlag(FLAGS_energy_sweep)) {
+    std::vector<int> thread_counts(options.num_threads);
+    std::iota(thread_counts.begin(), thread_counts.end(), 1);
+    result = chromemedia::codec::benchmark_decode_energy_sweep(
+        options,
+        {chromemedia::codec::ComputePrecision::kFloat,
+         chromemedia::codec::ComputePrecision::kFixed16,
+         chromemedia::codec::ComputePrecision::kBfloat16},
+        thread_counts);
+  } else if (absl::GetFlag(FLAGS_per_cluster)) {
+    result = chromemedia::codec::benchmark_decode_per_cluster(options);
+  } else {
+    result = chromemedia::codec::benchmark_decode(options);
+  }
+  if (!trace_path.empty()) {
+    chromemedia::codec::Tracing::Disable();
+    if (!chromemedia::codec::Tracing::WriteChromeTrace(trace_path)) {
+      return -1;
+    }
+  }
+  return result;
 }
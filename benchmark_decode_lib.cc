@@ -14,8 +14,11 @@
 
 #include "benchmark_decode_lib.h"
 
+#include <unistd.h>
+
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <fstream>  // IWYU pragma: keep // b/24696850
 #include <iterator>
 #include <limits>
@@ -24,96 +27,375 @@
 #include <random>
 #include <string>
 #include <system_error>  // NOLINT(build/c++11)
-#include <type_traits>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
 #include <vector>
 
-#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "absl/strings/substitute.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "architecture_utils.h"
-#include "audio/dsp/signal_vector_util.h"
+#include "compute_precision.h"
+#include "cpu_features.h"
+#include "energy_meter.h"
 #include "generative_model_interface.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
 #include "log_mel_spectrogram_extractor_impl.h"
 #include "lyra_config.h"
+#include "perf_counters.h"
+#include "stage_profiler.h"
+#include "thread_affinity.h"
+#include "thread_pool.h"
 #include "wavegru_model_impl.h"
 
-#ifdef BENCHMARK
-#include "absl/base/thread_annotations.h"
-#include "absl/time/time.h"
-#endif  // BENCHMARK
-
 namespace chromemedia {
 namespace codec {
+namespace {
+
+// Returns the smallest element of |sorted| that at least |fraction| of the
+// elements are less than or equal to.
+int64_t NearestRankPercentile(const std::vector<int64_t>& sorted,
+                              double fraction) {
+  const int64_t rank =
+      static_cast<int64_t>(std::ceil(fraction * sorted.size()));
+  return sorted[std::max<int64_t>(rank, 1) - 1];
+}
+
+// Returns the value of the first line of /proc/cpuinfo starting with one of
+// |keys|, in their order of preference.
+absl::optional<std::string> ReadCpuInfo(
+    const std::vector<absl::string_view>& keys) {
+  for (const absl::string_view key : keys) {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+      absl::string_view rest = line;
+      if (!absl::ConsumePrefix(&rest, key)) {
+        continue;
+      }
+      rest = absl::StripLeadingAsciiWhitespace(rest);
+      if (!absl::ConsumePrefix(&rest, ":")) {
+        continue;
+      }
+      return std::string(absl::StripAsciiWhitespace(rest));
+    }
+  }
+  return absl::nullopt;
+}
+
+bool MakeOutputDir(const std::string& output_dir) {
+  std::error_code error_code;
+  if (ghc::filesystem::is_directory(output_dir, error_code) ||
+      ghc::filesystem::create_directories(output_dir, error_code)) {
+    return true;
+  }
+  LOG(ERROR) << "Could not create " << output_dir << ": "
+             << error_code.message();
+  return false;
+}
+
+}  // namespace
 
-TimingStats GetTimingStats(const std::vector<int64_t>& timings_microsecs) {
+TimingStats GetTimingStats(const std::vector<int64_t>& timings_microsecs,
+                           int64_t audio_microsecs_per_call) {
   TimingStats timing_stats;
   timing_stats.num_calls = static_cast<int64_t>(timings_microsecs.size());
-  timing_stats.mean_microsecs =
-      std::accumulate(timings_microsecs.begin(), timings_microsecs.end(), 0l) /
+  const double mean =
+      std::accumulate(timings_microsecs.begin(), timings_microsecs.end(),
+                      0.0) /
       timing_stats.num_calls;
+  timing_stats.mean_microsecs = static_cast<int64_t>(mean);
   timing_stats.max_microsecs =
       *std::max_element(timings_microsecs.begin(), timings_microsecs.end());
   timing_stats.min_microsecs =
       *std::min_element(timings_microsecs.begin(), timings_microsecs.end());
-  std::vector<float> variances(timings_microsecs.size());
-  std::transform(timings_microsecs.begin() + 1, timings_microsecs.end(),
-                 variances.begin(), [&](int64_t timings_microsecs) {
-                   return audio_dsp::Square(timings_microsecs -
-                                            timing_stats.mean_microsecs) /
-                          timing_stats.num_calls;
-                 });
+  double sum_of_squares = 0.0;
+  for (const int64_t timing : timings_microsecs) {
+    sum_of_squares += (timing - mean) * (timing - mean);
+  }
   timing_stats.standard_deviation =
-      std::sqrt(std::accumulate(variances.begin(), variances.end(), 0.f));
+      std::sqrt(sum_of_squares / timing_stats.num_calls);
 
+  std::vector<int64_t> sorted = timings_microsecs;
+  std::sort(sorted.begin(), sorted.end());
+  timing_stats.p50_microsecs = NearestRankPercentile(sorted, 0.5);
+  timing_stats.p90_microsecs = NearestRankPercentile(sorted, 0.9);
+  timing_stats.p99_microsecs = NearestRankPercentile(sorted, 0.99);
+  timing_stats.p999_microsecs = NearestRankPercentile(sorted, 0.999);
+  timing_stats.real_time_factor =
+      audio_microsecs_per_call > 0 ? mean / audio_microsecs_per_call : 0.0;
   return timing_stats;
 }
 
-void PrintStatsAndWriteCSV(const std::vector<int64_t>& timings,
-                           const absl::string_view title) {
+bool PrintStatsAndWriteCSV(const std::vector<int64_t>& timings,
+                           const absl::string_view title,
+                           const std::string& output_dir) {
   const std::string stats_template =
-      "$0 stats for generating $1 frames of audio, max: $2 us, "
-      "min: $3 us, mean: $4 us, stdev: $5.";
+      "$0 stats for generating $1 frames of audio, max: $2 us, min: $3 us, "
+      "mean: $4 us, stdev: $5, p50: $6 us, p90: $7 us, p99: $8 us, "
+      "p99.9: $9 us.";
   auto stats = GetTimingStats(timings);
 
   const std::string stats_string = absl::Substitute(
       stats_template, title, stats.num_calls, stats.max_microsecs,
-      stats.min_microsecs, stats.mean_microsecs, stats.standard_deviation);
+      stats.min_microsecs, stats.mean_microsecs, stats.standard_deviation,
+      stats.p50_microsecs, stats.p90_microsecs, stats.p99_microsecs,
+      stats.p999_microsecs);
   LOG(INFO) << stats_string;
 
-#if !defined __arm__ && !defined __aarch64__
-  const ghc::filesystem::path output_dir("/tmp/benchmarks/");
-  std::error_code error_code;
-  if (!ghc::filesystem::is_directory(output_dir, error_code)) {
-    CHECK(ghc::filesystem::create_directories(output_dir, error_code));
+  if (output_dir.empty()) {
+    return true;
   }
-  const std::string filename = absl::Substitute("$0.csv", title);
-  std::ofstream csv((output_dir / filename).string());
+  if (!MakeOutputDir(output_dir)) {
+    return false;
+  }
+  const ghc::filesystem::path path =
+      ghc::filesystem::path(output_dir) / absl::Substitute("$0.csv", title);
+  std::ofstream csv(path.string());
   csv << "Time(us)" << std::endl;
   for (const auto element : timings) {
     csv << element << std::endl;
   }
-#endif  // !defined __arm__ && !defined __aarch64__
+  if (!csv) {
+    LOG(ERROR) << "Could not write " << path.string() << ".";
+    return false;
+  }
+  return true;
 }
 
-int benchmark_decode(const int num_cond_vectors,
-                     const std::string& model_base_path) {
+HostInfo GetHostInfo() {
+  HostInfo host;
+  // x86 kernels report a model name, ARM ones only the SoC or the part.
+  host.cpu_model = ReadCpuInfo({"model name", "Hardware", "Processor",
+                                "CPU part"})
+                       .value_or("unknown");
+  host.cpu_isa = CpuIsaName(DetectCpuIsa());
+  host.num_cpus = static_cast<int>(std::thread::hardware_concurrency());
+  return host;
+}
+
+int64_t ResidentMemoryBytes() {
+  std::ifstream statm("/proc/self/statm");
+  int64_t size_pages;
+  int64_t resident_pages;
+  if (!(statm >> size_pages >> resident_pages)) {
+    return 0;
+  }
+  return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+int64_t PeakResidentMemoryBytes() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    absl::string_view rest = line;
+    int64_t kilobytes;
+    if (absl::ConsumePrefix(&rest, "VmHWM:") &&
+        absl::SimpleAtoi(absl::StripSuffix(
+                             absl::StripAsciiWhitespace(rest), "kB"),
+                         &kilobytes)) {
+      return kilobytes * 1024;
+    }
+  }
+  return 0;
+}
+
+bool ResetPeakResidentMemory() {
+  // Writing 5 to clear_refs resets the peak, see proc(5).
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.flush();
+  return static_cast<bool>(clear_refs);
+}
+
+std::string EscapeJson(absl::string_view text) {
+  std::string escaped;
+  for (const char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      absl::StrAppendFormat(&escaped, "\\u%04x", c);
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string FormatHostInfoJson(const HostInfo& host) {
+  return absl::StrFormat(
+      "{\"cpu_model\": \"%s\", \"cpu_isa\": \"%s\", \"num_cpus\": %d}",
+      EscapeJson(host.cpu_model), EscapeJson(host.cpu_isa), host.num_cpus);
+}
+
+std::string FormatTimingStatsJson(const TimingStats& stats) {
+  return absl::StrFormat(
+      "{\"num_calls\": %d, \"mean_us\": %d, \"stdev_us\": %.3f, "
+      "\"min_us\": %d, \"p50_us\": %d, \"p90_us\": %d, \"p99_us\": %d, "
+      "\"p99.9_us\": %d, \"max_us\": %d, \"real_time_factor\": %.6f}",
+      stats.num_calls, stats.mean_microsecs, stats.standard_deviation,
+      stats.min_microsecs, stats.p50_microsecs, stats.p90_microsecs,
+      stats.p99_microsecs, stats.p999_microsecs, stats.max_microsecs,
+      stats.real_time_factor);
+}
+
+double EnergyStats::joules_per_audio_second() const {
+  return audio_seconds > 0.0 ? joules / audio_seconds : 0.0;
+}
+
+double EnergyStats::net_joules_per_audio_second() const {
+  if (audio_seconds <= 0.0) {
+    return 0.0;
+  }
+  return std::max(joules - idle_watts * seconds, 0.0) / audio_seconds;
+}
+
+double MeasureIdleWatts(EnergyMeter* meter, absl::Duration duration) {
+  meter->Start();
+  absl::SleepFor(duration);
+  return meter->Stop().watts();
+}
+
+std::string FormatEnergyStatsJson(const EnergyStats& stats) {
+  return absl::StrFormat(
+      "{\"source\": \"%s\", \"joules\": %.6f, \"seconds\": %.6f, "
+      "\"audio_seconds\": %.6f, \"idle_watts\": %.6f, \"charging\": %s, "
+      "\"joules_per_audio_second\": %.6f, "
+      "\"net_joules_per_audio_second\": %.6f}",
+      EscapeJson(stats.source), stats.joules, stats.seconds,
+      stats.audio_seconds, stats.idle_watts,
+      stats.charging ? "true" : "false", stats.joules_per_audio_second(),
+      stats.net_joules_per_audio_second());
+}
+
+std::string FormatPerfCountsSeriesJson(
+    const std::vector<std::pair<std::string, PerfCounts>>& perf_counts) {
+  std::string json = "{";
+  for (int i = 0; i < static_cast<int>(perf_counts.size()); ++i) {
+    absl::StrAppendFormat(&json, "%s\"%s\": %s", i == 0 ? "" : ", ",
+                          EscapeJson(perf_counts[i].first),
+                          FormatPerfCountsJson(perf_counts[i].second));
+  }
+  json += "}";
+  return json;
+}
+
+std::string FormatBenchmarkJson(
+    const BenchmarkDecodeOptions& options, const HostInfo& host,
+    const std::vector<std::pair<std::string, TimingStats>>& stats,
+    const std::vector<std::pair<std::string, PerfCounts>>& perf_counts,
+    const EnergyStats* energy) {
+  std::string json = absl::StrFormat(
+      "{\n"
+      "  \"host\": %s,\n"
+      "  \"config\": {\"compute_type\": \"%s\", \"num_threads\": %d, "
+      "\"num_cond_vectors\": %d, \"num_warm_up_calls\": %d, "
+      "\"warm_up\": %s, \"prefetch_distance\": %d, "
+      "\"gru_row_pipelining\": %s},\n"
+      "  \"results\": {",
+      FormatHostInfoJson(host), ComputePrecisionName(options.precision),
+      options.num_threads, options.num_cond_vectors,
+      options.num_warm_up_calls, options.warm_up ? "true" : "false",
+      options.prefetch_distance,
+      options.gru_row_pipelining ? "true" : "false");
+  for (int i = 0; i < static_cast<int>(stats.size()); ++i) {
+    absl::StrAppendFormat(&json, "%s\n    \"%s\": %s", i == 0 ? "" : ",",
+                          EscapeJson(stats[i].first),
+                          FormatTimingStatsJson(stats[i].second));
+  }
+  json += "\n  }";
+  if (!perf_counts.empty()) {
+    absl::StrAppend(&json, ",\n  \"perf_counters\": ",
+                    FormatPerfCountsSeriesJson(perf_counts));
+  }
+  if (energy != nullptr) {
+    absl::StrAppend(&json, ",\n  \"energy\": ", FormatEnergyStatsJson(*energy));
+  }
+  json += "\n}\n";
+  return json;
+}
+
+int benchmark_decode(const BenchmarkDecodeOptions& options,
+                     TimingStats* call_stats, EnergyStats* energy_stats) {
   const std::string model_path =
-      chromemedia::codec::GetCompleteArchitecturePath(model_base_path);
-  if (num_cond_vectors <= 0) {
+      chromemedia::codec::GetCompleteArchitecturePath(options.model_base_path);
+  if (options.num_cond_vectors <= 0) {
     LOG(ERROR) << "The number of conditioning vectors has to be positive.";
     return -1;
   }
+  if (options.num_warm_up_calls < 0 ||
+      options.num_warm_up_calls >= options.num_cond_vectors) {
+    LOG(ERROR) << "The number of warm-up calls has to be non-negative and "
+               << "less than the number of conditioning vectors.";
+    return -1;
+  }
+  const bool warm_up = options.warm_up;
+  const int num_cond_vectors = options.num_cond_vectors;
 
   std::unique_ptr<chromemedia::codec::GenerativeModelInterface> model =
       chromemedia::codec::WavegruModelImpl::Create(
           chromemedia::codec::GetNumSamplesPerHop(
               chromemedia::codec::kInternalSampleRateHz),
           chromemedia::codec::kNumFeatures,
-          chromemedia::codec::kNumFramesPerPacket, model_path);
+          chromemedia::codec::kNumFramesPerPacket, model_path,
+          options.num_threads, /*model=*/nullptr, options.precision,
+          chromemedia::codec::kInternalSampleRateHz,
+          ThreadPool::Create(options.num_threads, options.affinity));
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not create the model.";
+    return -1;
+  }
+  if (options.prefetch_distance > 0 &&
+      !model->SetPrefetchDistance(options.prefetch_distance)) {
+    LOG(ERROR) << "Could not prefetch " << options.prefetch_distance
+               << " steps ahead.";
+    return -1;
+  }
+  if (options.gru_row_pipelining &&
+      !model->SetGruRowPipeliningEnabled(true)) {
+    LOG(ERROR) << "Could not pipeline the rows of the GRU.";
+    return -1;
+  }
+  if (warm_up) {
+    const absl::Time warm_up_start = absl::Now();
+    model->WarmUp();
+    LOG(INFO) << "Warming up took "
+              << absl::ToInt64Microseconds(absl::Now() - warm_up_start)
+              << " us.";
+  }
+  chromemedia::codec::StageProfiler* const profiler =
+      options.profile_stages ? model->EnableStageProfiling() : nullptr;
+  std::unique_ptr<PerfCounters> counters;
+  if (options.count_perf_events) {
+    counters = PerfCounters::Create();
+    if (counters == nullptr) {
+      LOG(WARNING) << "Running without counting hardware events.";
+    } else if (profiler != nullptr && !profiler->EnablePerfCounters()) {
+      LOG(WARNING) << "Profiling the stages without hardware events.";
+    }
+  }
+  std::unique_ptr<EnergyMeter> energy_meter;
+  EnergyStats energy;
+  if (options.measure_energy) {
+    energy_meter = EnergyMeter::Create();
+    if (energy_meter == nullptr) {
+      LOG(WARNING) << "Running without measuring the energy.";
+    } else {
+      energy.source = EnergySourceName(energy_meter->source());
+      energy.idle_watts = MeasureIdleWatts(energy_meter.get());
+    }
+  }
 
   const int num_samples_per_hop = chromemedia::codec::GetNumSamplesPerHop(
       chromemedia::codec::kInternalSampleRateHz);
@@ -124,12 +406,27 @@ int benchmark_decode(const int num_cond_vectors,
       chromemedia::codec::LogMelSpectrogramExtractorImpl::Create(
           chromemedia::codec::kInternalSampleRateHz, kNumFeatures,
           num_samples_per_hop, num_samples_per_frame);
-  std::uniform_real_distribution<int16_t> distribution(
+  std::uniform_int_distribution<int16_t> distribution(
       std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max());
   std::default_random_engine generator;
   std::vector<int16_t> random_audio(num_samples_per_hop);
 
+  // Wall time of running the model on each conditioning vector, to compare
+  // the first call with the steady state, and the parts of it the model spent
+  // conditioning and sampling.
+  std::vector<int64_t> call_timings_microsecs;
+  std::vector<int64_t> cond_stack_timings;
+  std::vector<int64_t> model_timings;
+  call_timings_microsecs.reserve(num_cond_vectors);
+  cond_stack_timings.reserve(num_cond_vectors);
+  model_timings.reserve(num_cond_vectors);
+  // Hardware events of the calling thread in the measured calls.
+  PerfCounts conditioning_events;
+  PerfCounts sampling_events;
   for (int i = 0; i < num_cond_vectors; ++i) {
+    if (energy_meter != nullptr && i == options.num_warm_up_calls) {
+      energy_meter->Start();
+    }
     std::generate(random_audio.begin(), random_audio.end(),
                   [&]() { return distribution(generator); });
     auto features_or =
@@ -138,8 +435,24 @@ int benchmark_decode(const int num_cond_vectors,
       LOG(ERROR) << "Could not create random features to give model.";
       return -1;
     }
+    const int64_t conditioning_nanos = model->conditioning_nanos();
+    const int64_t sampling_nanos = model->sampling_nanos();
+    const PerfCounts start_events =
+        counters != nullptr ? counters->Read() : PerfCounts();
+    const absl::Time call_start = absl::Now();
     model->AddFeatures(features_or.value());
+    const PerfCounts conditioned_events =
+        counters != nullptr ? counters->Read() : PerfCounts();
     auto decoded_or = model->GenerateSamples(num_samples_per_hop);
+    call_timings_microsecs.push_back(
+        absl::ToInt64Microseconds(absl::Now() - call_start));
+    if (counters != nullptr && i >= options.num_warm_up_calls) {
+      conditioning_events += conditioned_events - start_events;
+      sampling_events += counters->Read() - conditioned_events;
+    }
+    cond_stack_timings.push_back(
+        (model->conditioning_nanos() - conditioning_nanos) / 1000);
+    model_timings.push_back((model->sampling_nanos() - sampling_nanos) / 1000);
     if (!decoded_or.has_value()) {
       LOG(ERROR) << "Could not generate samples.";
       return -1;
@@ -150,32 +463,209 @@ int benchmark_decode(const int num_cond_vectors,
       return -1;
     }
   }
+  if (energy_meter != nullptr) {
+    // Includes making up the random features, which is little next to
+    // running the model.
+    const bool charging = energy_meter->charging();
+    const EnergyReading reading = energy_meter->Stop();
+    energy.joules = reading.joules;
+    energy.seconds = reading.seconds;
+    energy.audio_seconds =
+        static_cast<double>(num_cond_vectors - options.num_warm_up_calls) *
+        num_samples_per_hop / chromemedia::codec::kInternalSampleRateHz;
+    energy.charging = charging;
+    LOG(INFO) << absl::StrFormat(
+        "Decoding took %.4f J per second of audio, %.4f J above the %.3f W "
+        "drawn while idle, measured on the %s.",
+        energy.joules_per_audio_second(), energy.net_joules_per_audio_second(),
+        energy.idle_watts, energy.source);
+    if (energy_stats != nullptr) {
+      *energy_stats = energy;
+    }
+  }
+  LOG(INFO) << "The first call took " << call_timings_microsecs.front()
+            << " us" << (warm_up ? " after warming up" : "") << ".";
+  if (call_timings_microsecs.size() > 1) {
+    const TimingStats steady_state_stats = GetTimingStats(
+        std::vector<int64_t>(call_timings_microsecs.begin() + 1,
+                             call_timings_microsecs.end()));
+    LOG(INFO) << "The following calls took "
+              << steady_state_stats.mean_microsecs << " us on average.";
+  }
+  if (profiler != nullptr) {
+    LOG(INFO) << "Sampling loop stages:\n" << profiler->Report();
+  }
+  std::vector<std::pair<std::string, PerfCounts>> perf_counts;
+  if (counters != nullptr) {
+    perf_counts = {{"call_conditioning", conditioning_events},
+                   {"call_sampling", sampling_events}};
+    if (profiler != nullptr && profiler->perf_counters_enabled()) {
+      for (int s = 0; s < static_cast<int>(SamplingStage::kNumStages); ++s) {
+        const SamplingStage stage = static_cast<SamplingStage>(s);
+        perf_counts.emplace_back(SamplingStageName(stage),
+                                 profiler->SummarizeEvents(stage));
+      }
+    }
+    LOG(INFO) << "Calling thread while conditioning: "
+              << FormatPerfCounts(conditioning_events);
+    LOG(INFO) << "Calling thread while sampling: "
+              << FormatPerfCounts(sampling_events);
+  }
 
-#ifdef BENCHMARK
-  auto cond_stack_timings = model->conditioning_timings_microsecs();
-  auto model_timings = model->model_timings_microsecs();
-
-#ifdef USE_FIXED16
-  LOG(INFO) << "Using fixed point arithmetic.";
-#elif USE_BFLOAT16
-  LOG(INFO) << "Using bfloat arithmetic.";
-#else
-  LOG(INFO) << "Using float arithmetic.";
-#endif  // USE_FIXED16
+  LOG(INFO) << "Using " << ComputePrecisionName(options.precision)
+            << " arithmetic.";
+  LOG(INFO) << "Using " << options.num_threads << " thread(s).";
 
+  // Neither the stats nor the CSVs include the warm-up calls.
+  const int64_t audio_microsecs_per_call =
+      int64_t{num_samples_per_hop} * 1000000 /
+      chromemedia::codec::kInternalSampleRateHz;
   std::vector<int64_t> combined_timings;
   std::transform(model_timings.begin(), model_timings.end(),
                  cond_stack_timings.begin(),
                  std::back_inserter(combined_timings), std::plus<int64_t>());
+  const std::vector<std::pair<std::string, const std::vector<int64_t>*>>
+      series = {{"call", &call_timings_microsecs},
+                {"conditioning_only", &cond_stack_timings},
+                {"model_only", &model_timings},
+                {"combined_model_and_conditioning", &combined_timings}};
+  std::vector<std::pair<std::string, TimingStats>> stats;
+  for (const auto& [title, timings] : series) {
+    const std::vector<int64_t> measured(
+        timings->begin() + options.num_warm_up_calls, timings->end());
+    if (!chromemedia::codec::PrintStatsAndWriteCSV(measured, title,
+                                                   options.output_dir)) {
+      return -1;
+    }
+    stats.emplace_back(title,
+                       GetTimingStats(measured, audio_microsecs_per_call));
+  }
+  if (call_stats != nullptr) {
+    *call_stats = stats.front().second;
+  }
+  if (options.output_dir.empty()) {
+    return 0;
+  }
 
-  chromemedia::codec::PrintStatsAndWriteCSV(cond_stack_timings,
-                                            "conditioning_only");
-  chromemedia::codec::PrintStatsAndWriteCSV(model_timings, "model_only");
-  chromemedia::codec::PrintStatsAndWriteCSV(combined_timings,
-                                            "combined_model_and_conditioning");
-#endif  // BENCHMARK
+  const std::string json_path =
+      (ghc::filesystem::path(options.output_dir) / "benchmark_decode.json")
+          .string();
+  std::ofstream json(json_path);
+  json << FormatBenchmarkJson(options, GetHostInfo(), stats, perf_counts,
+                              energy_meter != nullptr ? &energy : nullptr);
+  if (!json) {
+    LOG(ERROR) << "Could not write " << json_path << ".";
+    return -1;
+  }
+  LOG(INFO) << "Wrote results to " << json_path << ".";
   return 0;
 }
 
+int benchmark_decode_per_cluster(const BenchmarkDecodeOptions& options) {
+  const std::vector<CpuCluster> clusters = DetectCpuClusters();
+  std::vector<std::string> summaries;
+  for (int i = 0; i < clusters.size(); ++i) {
+    const std::string name = CpuClusterName(clusters[i]);
+    LOG(INFO) << "Benchmarking on " << name << ".";
+    BenchmarkDecodeOptions cluster_options = options;
+    cluster_options.affinity = AffinityForCluster(clusters[i]);
+    cluster_options.affinity.performance_hint_target =
+        options.affinity.performance_hint_target;
+    if (!options.output_dir.empty()) {
+      cluster_options.output_dir =
+          (ghc::filesystem::path(options.output_dir) /
+           absl::StrCat("cluster_", i))
+              .string();
+      std::error_code error_code;
+      ghc::filesystem::create_directories(cluster_options.output_dir,
+                                          error_code);
+      if (error_code) {
+        LOG(ERROR) << "Could not create " << cluster_options.output_dir
+                   << ".";
+        return -1;
+      }
+    }
+    TimingStats stats;
+    if (benchmark_decode(cluster_options, &stats) != 0) {
+      LOG(ERROR) << "Benchmarking on " << name << " failed.";
+      return -1;
+    }
+    summaries.push_back(absl::StrFormat("%s: %d us per call, RTF %.3f", name,
+                                        stats.mean_microsecs,
+                                        stats.real_time_factor));
+  }
+  LOG(INFO) << "Calls on each cluster:\n" << absl::StrJoin(summaries, "\n");
+  return 0;
+}
+
+int benchmark_decode_energy_sweep(
+    const BenchmarkDecodeOptions& options,
+    const std::vector<ComputePrecision>& precisions,
+    const std::vector<int>& thread_counts) {
+  std::vector<std::pair<double, std::string>> summaries;
+  for (const ComputePrecision precision : precisions) {
+    for (const int num_threads : thread_counts) {
+      const std::string name = absl::StrFormat(
+          "%s_%d_threads", ComputePrecisionName(precision), num_threads);
+      LOG(INFO) << "Measuring the energy of " << name << ".";
+      BenchmarkDecodeOptions sweep_options = options;
+      sweep_options.precision = precision;
+      sweep_options.num_threads = num_threads;
+      sweep_options.measure_energy = true;
+      if (!options.output_dir.empty()) {
+        sweep_options.output_dir =
+            (ghc::filesystem::path(options.output_dir) / name).string();
+        std::error_code error_code;
+        ghc::filesystem::create_directories(sweep_options.output_dir,
+                                            error_code);
+        if (error_code) {
+          LOG(ERROR) << "Could not create " << sweep_options.output_dir
+                     << ".";
+          return -1;
+        }
+      }
+      TimingStats stats;
+      EnergyStats energy;
+      if (benchmark_decode(sweep_options, &stats, &energy) != 0) {
+        LOG(ERROR) << "Benchmarking " << name << " failed.";
+        return -1;
+      }
+      if (energy.audio_seconds <= 0.0) {
+        LOG(ERROR) << "The energy cannot be measured on this device.";
+        return -1;
+      }
+      summaries.emplace_back(
+          energy.net_joules_per_audio_second(),
+          absl::StrFormat("%s: %.4f J/s, %.4f J/s above idle, RTF %.3f%s",
+                          name, energy.joules_per_audio_second(),
+                          energy.net_joules_per_audio_second(),
+                          stats.real_time_factor,
+                          energy.charging ? " (charging)" : ""));
+    }
+  }
+  std::sort(summaries.begin(), summaries.end());
+  std::vector<std::string> lines;
+  for (const auto& summary : summaries) {
+    lines.push_back(summary.second);
+  }
+  LOG(INFO) << "Energy per second of decoded audio:\n"
+            << absl::StrJoin(lines, "\n");
+  return 0;
+}
+
+int benchmark_decode(const int num_cond_vectors,
+                     const std::string& model_base_path,
+                     const int num_threads, const bool profile_stages,
+                     const ComputePrecision precision, const bool warm_up) {
+  BenchmarkDecodeOptions options;
+  options.num_cond_vectors = num_cond_vectors;
+  options.model_base_path = model_base_path;
+  options.num_threads = num_threads;
+  options.profile_stages = profile_stages;
+  options.precision = precision;
+  options.warm_up = warm_up;
+  return benchmark_decode(options);
+}
+
 }  // namespace codec
 }  // namespace chromemedia
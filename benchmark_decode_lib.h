@@ -17,10 +17,18 @@
 #ifndef LYRA_CODEC_BENCHMARK_DECODE_LIB_H_
 #define LYRA_CODEC_BENCHMARK_DECODE_LIB_H_
 
+#include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "compute_precision.h"
+#include "energy_meter.h"
+#include "perf_counters.h"
+#include "thread_affinity.h"
 
 namespace chromemedia {
 namespace codec {
@@ -31,20 +39,190 @@ struct TimingStats {
   int64_t min_microsecs;
   int64_t num_calls;
   float standard_deviation;
+  // Nearest-rank percentiles.
+  int64_t p50_microsecs;
+  int64_t p90_microsecs;
+  int64_t p99_microsecs;
+  int64_t p999_microsecs;
+  // Mean time of a call over the duration of the audio it produced, or 0 if
+  // the duration is unknown.
+  double real_time_factor;
 };
 
-// Given an array of ints, computes the max, min, mean, and standard deviation.
-// Returns the results as a string.
+// Given an array of ints, computes the max, min, mean, standard deviation and
+// percentiles. If |audio_microsecs_per_call| is positive, also computes the
+// real-time factor of calls producing that much audio each.
 ABSL_ATTRIBUTE_UNUSED TimingStats
-GetTimingStats(const std::vector<int64_t>& timings_microsecs);
+GetTimingStats(const std::vector<int64_t>& timings_microsecs,
+               int64_t audio_microsecs_per_call = 0);
 
-// Prints stats and writes CSV for the runtime information in |timings| to file
-// under /{sdcard,tmp}/benchmark/lyra/.
-ABSL_ATTRIBUTE_UNUSED void PrintStatsAndWriteCSV(
-    const std::vector<int64_t>& timings, const absl::string_view title);
+// Where benchmark results are written by default.
+#if defined(__ANDROID__)
+constexpr char kDefaultBenchmarkOutputDir[] = "/sdcard/benchmarks/lyra/";
+#else
+constexpr char kDefaultBenchmarkOutputDir[] = "/tmp/benchmarks/";
+#endif
 
-int benchmark_decode(const int num_cond_vectors,
-                     const std::string& model_base_path);
+// Prints stats and writes CSV for the runtime information in |timings| to
+// |output_dir|/|title|.csv. Returns false if the file could not be written.
+ABSL_ATTRIBUTE_UNUSED bool PrintStatsAndWriteCSV(
+    const std::vector<int64_t>& timings, const absl::string_view title,
+    const std::string& output_dir = kDefaultBenchmarkOutputDir);
+
+// Describes the machine a benchmark ran on, so that results from different
+// hosts can be told apart.
+struct HostInfo {
+  // As reported by the kernel, or "unknown".
+  std::string cpu_model;
+  // Instruction set the codec's own kernels were dispatched to.
+  std::string cpu_isa;
+  int num_cpus;
+};
+
+HostInfo GetHostInfo();
+
+// Returns the resident memory of this process in bytes, or 0 where it cannot
+// be read.
+int64_t ResidentMemoryBytes();
+
+// Returns the largest resident memory of this process in bytes since it
+// started or since the last successful |ResetPeakResidentMemory|, or 0 where
+// it cannot be read.
+int64_t PeakResidentMemoryBytes();
+
+// Lowers the peak resident memory to the current resident memory, so that
+// |PeakResidentMemoryBytes| measures the peak of what runs next. Returns
+// false where the kernel does not support it.
+bool ResetPeakResidentMemory();
+
+// Energy the device drew while a benchmark produced audio.
+struct EnergyStats {
+  // As named by |EnergySourceName|.
+  std::string source;
+  double joules = 0.0;
+  // Wall time of the measurement.
+  double seconds = 0.0;
+  // Duration of the audio produced meanwhile.
+  double audio_seconds = 0.0;
+  // What the device drew while idle just before, e.g. for the screen.
+  double idle_watts = 0.0;
+  // Whether the battery was charging, which makes battery readings useless.
+  bool charging = false;
+
+  // Joules per second of audio, i.e. the average power of running in real
+  // time, with and without what the device draws while idle.
+  double joules_per_audio_second() const;
+  double net_joules_per_audio_second() const;
+};
+
+// How long the device is measured idle before the calls.
+inline constexpr absl::Duration kIdleEnergyDuration = absl::Seconds(1);
+
+// Returns the average power |meter| reads while this thread sleeps for
+// |duration|.
+double MeasureIdleWatts(EnergyMeter* meter,
+                        absl::Duration duration = kIdleEnergyDuration);
+
+// Returns |stats| as a JSON object.
+std::string FormatEnergyStatsJson(const EnergyStats& stats);
+
+struct BenchmarkDecodeOptions {
+  // Number of conditioning vectors, i.e. calls to the model, to run.
+  int num_cond_vectors = 2000;
+  std::string model_base_path;
+  int num_threads = 1;
+  // Also logs latency histograms of each stage of the sampling loop.
+  bool profile_stages = false;
+  ComputePrecision precision = kDefaultComputePrecision;
+  // Warms the model up with |GenerativeModelInterface::WarmUp| first.
+  bool warm_up = false;
+  // Number of calls at the start that are run but left out of the stats.
+  int num_warm_up_calls = 0;
+  // Steps of the sampling loop ahead of which the threads prefetch, as with
+  // |GenerativeModelInterface::SetPrefetchDistance|.
+  int prefetch_distance = 0;
+  // Whether the threads wait after the GRU only for the threads whose rows
+  // they read, as with |GenerativeModelInterface::SetGruRowPipeliningEnabled|.
+  bool gru_row_pipelining = false;
+  // Also counts the hardware events of the calling thread while it conditions
+  // and samples, and of every stage of the sampling loop on every thread with
+  // |profile_stages|. Where they cannot be counted, the benchmark runs
+  // without them.
+  bool count_perf_events = false;
+  // Also measures the energy the device draws during the measured calls with
+  // |EnergyMeter|, after measuring it idle for |kIdleEnergyDuration|. Where it
+  // cannot be measured, the benchmark runs without it.
+  bool measure_energy = false;
+  // Directory the CSV and JSON results are written to. Nothing is written if
+  // it is empty.
+  std::string output_dir = kDefaultBenchmarkOutputDir;
+  // Where the threads of the model run.
+  ThreadAffinity affinity;
+};
+
+// Returns |text| quoted for a JSON string, without the quotes.
+std::string EscapeJson(absl::string_view text);
+
+// Returns |host| as a JSON object.
+std::string FormatHostInfoJson(const HostInfo& host);
+
+// Returns |stats| as a JSON object with times in microseconds.
+std::string FormatTimingStatsJson(const TimingStats& stats);
+
+// Returns the hardware events of each series in |perf_counts| as a JSON object
+// under their names.
+std::string FormatPerfCountsSeriesJson(
+    const std::vector<std::pair<std::string, PerfCounts>>& perf_counts);
+
+// Returns the results of a benchmark run with |options| on |host| as a JSON
+// object. |stats| holds the stats of each measured series under its name,
+// |perf_counts| the hardware events of each counted one, if any, and |energy|
+// the energy of the measured calls, if it is not null.
+std::string FormatBenchmarkJson(
+    const BenchmarkDecodeOptions& options, const HostInfo& host,
+    const std::vector<std::pair<std::string, TimingStats>>& stats,
+    const std::vector<std::pair<std::string, PerfCounts>>& perf_counts = {},
+    const EnergyStats* energy = nullptr);
+
+// Runs the model on |options.num_cond_vectors| random feature vectors and
+// logs the stats of the wall time of each call and of the parts of it spent
+// conditioning and sampling. Unless |options.output_dir| is empty, writes the
+// timings of every call as CSV and the stats with the host metadata as
+// benchmark_decode.json into it. Always logs how long the first conditioning
+// vector took compared to the mean of the following ones. If |call_stats| is
+// not null, the stats of the measured calls are also stored in it. With
+// |options.count_perf_events|, logs the hardware events of the measured calls
+// as well and adds them to the JSON, and likewise the energy they took with
+// |options.measure_energy|, which is also stored in |energy_stats| if it was
+// measured and |energy_stats| is not null.
+int benchmark_decode(const BenchmarkDecodeOptions& options,
+                     TimingStats* call_stats = nullptr,
+                     EnergyStats* energy_stats = nullptr);
+
+// Runs |benchmark_decode| once on each cluster of |DetectCpuClusters| with
+// every thread pinned to it, writing the results of each into a subdirectory
+// of |options.output_dir| named after the position of the cluster, fastest
+// first. |options.affinity| is replaced except for its performance hint
+// target. Logs the mean time and real time factor of the calls on each cluster
+// at the end.
+int benchmark_decode_per_cluster(const BenchmarkDecodeOptions& options);
+
+// Runs |benchmark_decode| with the energy measured once for every combination
+// of |precisions| and |thread_counts|, writing the results of each into a
+// subdirectory of |options.output_dir| named after it. Logs the joules per
+// second of audio of each at the end, most efficient first, so that the
+// configuration to ship on a class of devices can be picked.
+int benchmark_decode_energy_sweep(
+    const BenchmarkDecodeOptions& options,
+    const std::vector<ComputePrecision>& precisions,
+    const std::vector<int>& thread_counts);
+
+// Runs |benchmark_decode| with the default options but for the given ones.
+int benchmark_decode(
+    const int num_cond_vectors, const std::string& model_base_path,
+    const int num_threads = 1, const bool profile_stages = false,
+    const ComputePrecision precision = kDefaultComputePrecision,
+    const bool warm_up = false);
 
 }  // namespace codec
 }  // namespace chromemedia
@@ -0,0 +1,179 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark_decode_lib.h"
+
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "compute_precision.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "perf_counters.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+TEST(GetTimingStatsTest, ComputesPercentilesByNearestRank) {
+  std::vector<int64_t> timings(1000);
+  std::iota(timings.begin(), timings.end(), 1);
+
+  const TimingStats stats = GetTimingStats(timings);
+
+  EXPECT_EQ(stats.num_calls, 1000);
+  EXPECT_EQ(stats.min_microsecs, 1);
+  EXPECT_EQ(stats.max_microsecs, 1000);
+  EXPECT_EQ(stats.mean_microsecs, 500);
+  EXPECT_EQ(stats.p50_microsecs, 500);
+  EXPECT_EQ(stats.p90_microsecs, 900);
+  EXPECT_EQ(stats.p99_microsecs, 990);
+  EXPECT_EQ(stats.p999_microsecs, 999);
+}
+
+TEST(GetTimingStatsTest, StandardDeviationIncludesEveryCall) {
+  // The first call deviates the most, so leaving it out would show.
+  const TimingStats stats = GetTimingStats({10, 2, 4, 4, 4, 5, 5, 7});
+
+  // Mean 5.125, population variance 5.109375.
+  EXPECT_NEAR(stats.standard_deviation, 2.2604, 1e-3);
+}
+
+TEST(GetTimingStatsTest, RealTimeFactorIsMeanOverAudioDuration) {
+  EXPECT_DOUBLE_EQ(GetTimingStats({1000, 3000}).real_time_factor, 0.0);
+  EXPECT_DOUBLE_EQ(GetTimingStats({1000, 3000}, 10000).real_time_factor, 0.2);
+}
+
+TEST(GetTimingStatsTest, SingleCall) {
+  const TimingStats stats = GetTimingStats({42});
+
+  EXPECT_EQ(stats.p50_microsecs, 42);
+  EXPECT_EQ(stats.p999_microsecs, 42);
+  EXPECT_EQ(stats.standard_deviation, 0.0f);
+}
+
+TEST(FormatBenchmarkJsonTest, ContainsHostConfigAndResults) {
+  BenchmarkDecodeOptions options;
+  options.num_threads = 2;
+  options.num_cond_vectors = 100;
+  options.num_warm_up_calls = 5;
+  options.prefetch_distance = 2;
+  options.gru_row_pipelining = true;
+  options.precision = ComputePrecision::kFloat;
+  HostInfo host;
+  host.cpu_model = "Some \"Quoted\" CPU";
+  host.cpu_isa = "avx2";
+  host.num_cpus = 8;
+  const std::vector<std::pair<std::string, TimingStats>> stats = {
+      {"call", GetTimingStats({100, 200, 300}, 10000)}};
+
+  const std::string json = FormatBenchmarkJson(options, host, stats);
+
+  EXPECT_THAT(json, HasSubstr("\"cpu_model\": \"Some \\\"Quoted\\\" CPU\""));
+  EXPECT_THAT(json, HasSubstr("\"cpu_isa\": \"avx2\""));
+  EXPECT_THAT(json, HasSubstr("\"num_cpus\": 8"));
+  EXPECT_THAT(json, HasSubstr(absl::StrCat("\"compute_type\": \"",
+                                           ComputePrecisionName(
+                                               ComputePrecision::kFloat),
+                                           "\"")));
+  EXPECT_THAT(json, HasSubstr("\"num_threads\": 2"));
+  EXPECT_THAT(json, HasSubstr("\"num_warm_up_calls\": 5"));
+  EXPECT_THAT(json, HasSubstr("\"prefetch_distance\": 2"));
+  EXPECT_THAT(json, HasSubstr("\"gru_row_pipelining\": true"));
+  EXPECT_THAT(json, HasSubstr("\"call\": {\"num_calls\": 3, \"mean_us\": 200"));
+  EXPECT_THAT(json, HasSubstr("\"real_time_factor\": 0.020000"));
+  EXPECT_THAT(json, testing::Not(HasSubstr("perf_counters")));
+}
+
+TEST(FormatBenchmarkJsonTest, ContainsPerfCountersOfEverySeries) {
+  const std::vector<std::pair<std::string, TimingStats>> stats = {
+      {"call", GetTimingStats({100})}};
+  const std::vector<std::pair<std::string, PerfCounts>> perf_counts = {
+      {"call_sampling", PerfCounts{1000, 3000, 10, 20}},
+      {"gru_matvec", PerfCounts{500, 1000, -1, 5}}};
+  HostInfo host;
+  host.cpu_model = "cpu";
+  host.cpu_isa = "generic";
+  host.num_cpus = 1;
+
+  const std::string json =
+      FormatBenchmarkJson(BenchmarkDecodeOptions(), host, stats, perf_counts);
+
+  EXPECT_THAT(json, HasSubstr("\"perf_counters\": {\"call_sampling\": "
+                              "{\"cycles\": 1000, \"instructions\": 3000, "
+                              "\"ipc\": 3.000"));
+  EXPECT_THAT(json, HasSubstr("\"gru_matvec\": {\"cycles\": 500"));
+  EXPECT_THAT(json, HasSubstr("\"branch_misses\": null"));
+}
+
+TEST(FormatBenchmarkJsonTest, ContainsEnergyIfMeasured) {
+  EnergyStats energy;
+  energy.source = "battery";
+  energy.joules = 12.0;
+  energy.seconds = 10.0;
+  energy.audio_seconds = 20.0;
+  energy.idle_watts = 0.5;
+  HostInfo host;
+  host.cpu_model = "cpu";
+  host.cpu_isa = "generic";
+  host.num_cpus = 1;
+
+  const std::string json = FormatBenchmarkJson(
+      BenchmarkDecodeOptions(), host, {{"call", GetTimingStats({100})}},
+      /*perf_counts=*/{}, &energy);
+
+  EXPECT_THAT(json, HasSubstr("\"energy\": {\"source\": \"battery\""));
+  EXPECT_THAT(json, HasSubstr("\"joules_per_audio_second\": 0.600000"));
+  // 5 J of the 12 were drawn while idle.
+  EXPECT_THAT(json, HasSubstr("\"net_joules_per_audio_second\": 0.350000"));
+  EXPECT_THAT(json, HasSubstr("\"charging\": false"));
+}
+
+TEST(EnergyStatsTest, NothingPerSecondWithoutAudio) {
+  EnergyStats energy;
+  energy.joules = 1.0;
+
+  EXPECT_EQ(energy.joules_per_audio_second(), 0.0);
+  EXPECT_EQ(energy.net_joules_per_audio_second(), 0.0);
+}
+
+TEST(GetHostInfoTest, DescribesThisHost) {
+  const HostInfo host = GetHostInfo();
+
+  EXPECT_FALSE(host.cpu_model.empty());
+  EXPECT_FALSE(host.cpu_isa.empty());
+  EXPECT_GE(host.num_cpus, 0);
+}
+
+#if defined(__linux__)
+TEST(ResidentMemoryBytesTest, IsPositiveOnLinux) {
+  EXPECT_GT(ResidentMemoryBytes(), 0);
+}
+
+TEST(PeakResidentMemoryBytesTest, IsAtLeastResidentMemoryOnLinux) {
+  const int64_t resident = ResidentMemoryBytes();
+
+  EXPECT_GE(PeakResidentMemoryBytes(), resident);
+}
+#endif  // defined(__linux__)
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
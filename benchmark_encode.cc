@@ -0,0 +1,96 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "benchmark_decode_lib.h"
+#include "benchmark_encode_lib.h"
+#include "glog/logging.h"
+
+ABSL_FLAG(int, num_packets, 500,
+          "The number of packets encoded with every sample rate and DTX "
+          "setting, including the warm-up packets.");
+
+ABSL_FLAG(int, num_warm_up_packets, 0,
+          "The number of packets at the start that are encoded but left out "
+          "of the stats.");
+
+ABSL_FLAG(bool, perf_counters, false,
+          "Also counts cycles, instructions, branch misses and last level "
+          "cache misses of the measured calls, where perf_event_open is "
+          "permitted.");
+
+ABSL_FLAG(bool, measure_energy, false,
+          "Also measures how much energy the device draws per second of "
+          "encoded audio, from the power rail monitors where they can be read "
+          "or else the battery. Run it on battery.");
+
+ABSL_FLAG(std::string, sample_rates_hz, "8000,16000,32000,48000",
+          "Comma separated input sample rates to benchmark.");
+
+ABSL_FLAG(std::string, dtx, "off,on",
+          "Comma separated DTX settings to benchmark, 'off' and/or 'on'.");
+
+ABSL_FLAG(std::string, output_dir,
+          chromemedia::codec::kDefaultBenchmarkOutputDir,
+          "Directory the per-call timings of every stage are written to as "
+          "CSV, and their stats with the host metadata as "
+          "benchmark_encode.json. Nothing is written if empty.");
+
+ABSL_FLAG(
+    std::string, model_path, "wavegru",
+    "Path to directory containing model weights and quant files. For mobile "
+    "this is the absolute path, like '/sdcard/wavegru/'. For desktop this is "
+    "the path relative to the binary.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  chromemedia::codec::BenchmarkEncodeOptions options;
+  options.num_packets = absl::GetFlag(FLAGS_num_packets);
+  options.num_warm_up_packets = absl::GetFlag(FLAGS_num_warm_up_packets);
+  options.count_perf_events = absl::GetFlag(FLAGS_perf_counters);
+  options.measure_energy = absl::GetFlag(FLAGS_measure_energy);
+  options.model_base_path = absl::GetFlag(FLAGS_model_path);
+  options.output_dir = absl::GetFlag(FLAGS_output_dir);
+
+  options.sample_rates_hz.clear();
+  for (const absl::string_view rate :
+       absl::StrSplit(absl::GetFlag(FLAGS_sample_rates_hz), ',')) {
+    int sample_rate_hz;
+    if (!absl::SimpleAtoi(rate, &sample_rate_hz)) {
+      LOG(ERROR) << "Invalid sample rate '" << rate << "'.";
+      return -1;
+    }
+    options.sample_rates_hz.push_back(sample_rate_hz);
+  }
+  options.dtx_settings.clear();
+  for (const absl::string_view setting :
+       absl::StrSplit(absl::GetFlag(FLAGS_dtx), ',')) {
+    if (setting != "off" && setting != "on") {
+      LOG(ERROR) << "Invalid DTX setting '" << setting << "'.";
+      return -1;
+    }
+    options.dtx_settings.push_back(setting == "on");
+  }
+
+  return chromemedia::codec::benchmark_encode(options);
+}
@@ -0,0 +1,304 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark_encode_lib.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/substitute.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "architecture_utils.h"
+#include "benchmark_decode_lib.h"
+#include "codec_metrics.h"
+#include "energy_meter.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_encoder.h"
+#include "lyra_model.h"
+#include "perf_counters.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// The stages of |LyraEncoder::Encode| that |EncoderMetrics| times, after the
+// call as a whole.
+constexpr int kNumSeries = 7;
+constexpr std::array<const char*, kNumSeries> kSeriesNames = {
+    "call",  "resample", "filter", "extract", "noise_estimation", "quantize",
+    "pack"};
+
+// Returns the time each stage took between |before| and |after| in
+// microseconds, in the order of |kSeriesNames| after "call".
+std::array<int64_t, kNumSeries - 1> StageMicroseconds(
+    const EncoderMetrics& before, const EncoderMetrics& after) {
+  return {(after.resampling_nanos - before.resampling_nanos) / 1000,
+          (after.filtering_nanos - before.filtering_nanos) / 1000,
+          (after.extraction_nanos - before.extraction_nanos) / 1000,
+          (after.noise_estimation_nanos - before.noise_estimation_nanos) /
+              1000,
+          (after.quantization_nanos - before.quantization_nanos) / 1000,
+          (after.packing_nanos - before.packing_nanos) / 1000};
+}
+
+// Encodes with one configuration and appends its result to |results|. Also
+// measures the energy of the measured calls if |energy_meter| is not null,
+// against |idle_watts|.
+bool BenchmarkConfiguration(const BenchmarkEncodeOptions& options,
+                            const std::shared_ptr<LyraModel>& model,
+                            int sample_rate_hz, bool enable_dtx,
+                            EnergyMeter* energy_meter, double idle_watts,
+                            std::vector<EncodeBenchmarkResult>* results) {
+  std::unique_ptr<LyraEncoder> encoder = LyraEncoder::Create(
+      sample_rate_hz, kNumChannels, kBitrate, enable_dtx, model);
+  if (encoder == nullptr) {
+    LOG(ERROR) << "Could not create an encoder at " << sample_rate_hz
+               << " Hz.";
+    return false;
+  }
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(sample_rate_hz);
+  const std::vector<int16_t> audio =
+      GenerateSyntheticSpeech(sample_rate_hz,
+                              options.num_packets * num_samples_per_packet);
+
+  std::unique_ptr<PerfCounters> counters;
+  if (options.count_perf_events) {
+    counters = PerfCounters::Create();
+  }
+  PerfCounts call_events;
+
+  std::array<std::vector<int64_t>, kNumSeries> timings;
+  for (auto& series : timings) {
+    series.reserve(options.num_packets - options.num_warm_up_packets);
+  }
+  for (int p = 0; p < options.num_packets; ++p) {
+    if (energy_meter != nullptr && p == options.num_warm_up_packets) {
+      energy_meter->Start();
+    }
+    const EncoderMetrics before = encoder->metrics();
+    const PerfCounts before_events =
+        counters != nullptr ? counters->Read() : PerfCounts();
+    const absl::Time call_start = absl::Now();
+    const auto encoded_or = encoder->Encode(absl::MakeConstSpan(audio).subspan(
+        p * num_samples_per_packet, num_samples_per_packet));
+    const int64_t call_microsecs =
+        absl::ToInt64Microseconds(absl::Now() - call_start);
+    if (counters != nullptr && p >= options.num_warm_up_packets) {
+      call_events += counters->Read() - before_events;
+    }
+    if (!encoded_or.has_value()) {
+      LOG(ERROR) << "Could not encode packet " << p << ".";
+      return false;
+    }
+    if (p < options.num_warm_up_packets) {
+      continue;
+    }
+    timings[0].push_back(call_microsecs);
+    const auto stages = StageMicroseconds(before, encoder->metrics());
+    for (int s = 0; s < static_cast<int>(stages.size()); ++s) {
+      timings[s + 1].push_back(stages[s]);
+    }
+  }
+
+  EncodeBenchmarkResult result;
+  if (energy_meter != nullptr) {
+    EnergyStats energy;
+    energy.source = EnergySourceName(energy_meter->source());
+    energy.charging = energy_meter->charging();
+    const EnergyReading reading = energy_meter->Stop();
+    energy.joules = reading.joules;
+    energy.seconds = reading.seconds;
+    energy.audio_seconds =
+        static_cast<double>(options.num_packets - options.num_warm_up_packets) *
+        num_samples_per_packet / sample_rate_hz;
+    energy.idle_watts = idle_watts;
+    LOG(INFO) << absl::StrFormat(
+        "Encoding at %d Hz with DTX %s took %.4f J per second of audio, "
+        "%.4f J above idle.",
+        sample_rate_hz, enable_dtx ? "on" : "off",
+        energy.joules_per_audio_second(),
+        energy.net_joules_per_audio_second());
+    result.energy = energy;
+  }
+  const int64_t audio_microsecs_per_call =
+      int64_t{num_samples_per_packet} * 1000000 / sample_rate_hz;
+  result.sample_rate_hz = sample_rate_hz;
+  result.enable_dtx = enable_dtx;
+  for (int s = 0; s < kNumSeries; ++s) {
+    const std::string title =
+        absl::Substitute("encode_$0hz_dtx_$1_$2", sample_rate_hz,
+                         enable_dtx ? "on" : "off", kSeriesNames[s]);
+    if (!PrintStatsAndWriteCSV(timings[s], title, options.output_dir)) {
+      return false;
+    }
+    result.stats.emplace_back(
+        kSeriesNames[s], GetTimingStats(timings[s], audio_microsecs_per_call));
+  }
+  if (counters != nullptr) {
+    LOG(INFO) << "Encoding at " << sample_rate_hz << " Hz with DTX "
+              << (enable_dtx ? "on" : "off") << ": "
+              << FormatPerfCounts(call_events);
+    result.perf_counts = {{"call", call_events}};
+  }
+  results->push_back(std::move(result));
+  return true;
+}
+
+}  // namespace
+
+std::vector<int16_t> GenerateSyntheticSpeech(int sample_rate_hz,
+                                             int num_samples) {
+  constexpr double kPi = 3.14159265358979323846;
+  constexpr int kNumHarmonics = 5;
+  std::default_random_engine generator;
+  std::normal_distribution<float> noise(0.0f, 30.0f);
+  std::vector<int16_t> audio(num_samples);
+  double phase = 0.0;
+  for (int i = 0; i < num_samples; ++i) {
+    const double t = static_cast<double>(i) / sample_rate_hz;
+    double sample = noise(generator);
+    if (static_cast<int>(t) % 2 == 0) {
+      const double pitch_hz = 120.0 + 20.0 * std::sin(2.0 * kPi * 0.5 * t);
+      phase += 2.0 * kPi * pitch_hz / sample_rate_hz;
+      const double envelope = 0.5 * (1.0 - std::cos(2.0 * kPi * 4.0 * t));
+      double voiced = 0.0;
+      for (int k = 1; k <= kNumHarmonics; ++k) {
+        voiced += std::sin(k * phase) / k;
+      }
+      sample += 8000.0 * envelope * voiced;
+    }
+    audio[i] = static_cast<int16_t>(
+        std::clamp<double>(sample, std::numeric_limits<int16_t>::min(),
+                           std::numeric_limits<int16_t>::max()));
+  }
+  return audio;
+}
+
+std::string FormatEncodeBenchmarkJson(
+    const BenchmarkEncodeOptions& options, const HostInfo& host,
+    const std::vector<EncodeBenchmarkResult>& results) {
+  std::string json = absl::StrFormat(
+      "{\n"
+      "  \"host\": %s,\n"
+      "  \"config\": {\"num_packets\": %d, \"num_warm_up_packets\": %d},\n"
+      "  \"results\": [",
+      FormatHostInfoJson(host), options.num_packets,
+      options.num_warm_up_packets);
+  for (int r = 0; r < static_cast<int>(results.size()); ++r) {
+    const EncodeBenchmarkResult& result = results[r];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"sample_rate_hz\": %d, \"enable_dtx\": %s, \"stages\": {",
+        r == 0 ? "" : ",", result.sample_rate_hz,
+        result.enable_dtx ? "true" : "false");
+    for (int s = 0; s < static_cast<int>(result.stats.size()); ++s) {
+      absl::StrAppendFormat(&json, "%s\n      \"%s\": %s", s == 0 ? "" : ",",
+                            EscapeJson(result.stats[s].first),
+                            FormatTimingStatsJson(result.stats[s].second));
+    }
+    json += "\n    }";
+    if (!result.perf_counts.empty()) {
+      absl::StrAppend(&json, ",\n    \"perf_counters\": ",
+                      FormatPerfCountsSeriesJson(result.perf_counts));
+    }
+    if (result.energy.has_value()) {
+      absl::StrAppend(&json, ",\n    \"energy\": ",
+                      FormatEnergyStatsJson(*result.energy));
+    }
+    json += "}";
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+int benchmark_encode(const BenchmarkEncodeOptions& options) {
+  if (options.num_packets <= 0) {
+    LOG(ERROR) << "The number of packets has to be positive.";
+    return -1;
+  }
+  if (options.num_warm_up_packets < 0 ||
+      options.num_warm_up_packets >= options.num_packets) {
+    LOG(ERROR) << "The number of warm-up packets has to be non-negative and "
+               << "less than the number of packets.";
+    return -1;
+  }
+  const std::shared_ptr<LyraModel> model =
+      LyraModel::Create(GetCompleteArchitecturePath(options.model_base_path));
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not load the model.";
+    return -1;
+  }
+
+  std::unique_ptr<EnergyMeter> energy_meter;
+  double idle_watts = 0.0;
+  if (options.measure_energy) {
+    energy_meter = EnergyMeter::Create();
+    if (energy_meter == nullptr) {
+      LOG(WARNING) << "Running without measuring the energy.";
+    } else {
+      idle_watts = MeasureIdleWatts(energy_meter.get());
+    }
+  }
+
+  std::vector<EncodeBenchmarkResult> results;
+  for (const int sample_rate_hz : options.sample_rates_hz) {
+    for (const bool enable_dtx : options.dtx_settings) {
+      if (!BenchmarkConfiguration(options, model, sample_rate_hz, enable_dtx,
+                                  energy_meter.get(), idle_watts, &results)) {
+        return -1;
+      }
+    }
+  }
+
+  if (options.output_dir.empty()) {
+    return 0;
+  }
+  const std::string json_path =
+      (ghc::filesystem::path(options.output_dir) / "benchmark_encode.json")
+          .string();
+  std::ofstream json(json_path);
+  json << FormatEncodeBenchmarkJson(options, GetHostInfo(), results);
+  if (!json) {
+    LOG(ERROR) << "Could not write " << json_path << ".";
+    return -1;
+  }
+  LOG(INFO) << "Wrote results to " << json_path << ".";
+  return 0;
+}
+
+int benchmark_encode(int num_packets, const std::string& model_base_path) {
+  BenchmarkEncodeOptions options;
+  options.num_packets = num_packets;
+  options.model_base_path = model_base_path;
+  return benchmark_encode(options);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_BENCHMARK_ENCODE_LIB_H_
+#define LYRA_CODEC_BENCHMARK_ENCODE_LIB_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "benchmark_decode_lib.h"
+#include "perf_counters.h"
+
+namespace chromemedia {
+namespace codec {
+
+struct BenchmarkEncodeOptions {
+  // Number of packets encoded per configuration, one |LyraEncoder::Encode|
+  // call each.
+  int num_packets = 500;
+  std::string model_base_path;
+  // Every combination of these sample rates and DTX settings is run.
+  std::vector<int> sample_rates_hz = {8000, 16000, 32000, 48000};
+  std::vector<bool> dtx_settings = {false, true};
+  // Number of packets at the start that are encoded but left out of the
+  // stats.
+  int num_warm_up_packets = 0;
+  // Also counts the hardware events of the measured calls. Where they cannot
+  // be counted, the benchmark runs without them.
+  bool count_perf_events = false;
+  // Also measures the energy the device draws during the measured calls, as
+  // with |BenchmarkDecodeOptions::measure_energy|.
+  bool measure_energy = false;
+  // Directory the CSV and JSON results are written to. Nothing is written if
+  // it is empty.
+  std::string output_dir = kDefaultBenchmarkOutputDir;
+};
+
+// Stats of every stage of encoding with one configuration.
+struct EncodeBenchmarkResult {
+  int sample_rate_hz;
+  bool enable_dtx;
+  // Under the name of each stage, and "call" for the whole call.
+  std::vector<std::pair<std::string, TimingStats>> stats;
+  // Hardware events of the measured calls under "call", if they were
+  // counted. The stages are too short to read the counters around each.
+  std::vector<std::pair<std::string, PerfCounts>> perf_counts;
+  // Energy of the measured calls, if it was measured.
+  absl::optional<EnergyStats> energy;
+};
+
+// Returns |num_samples| of audio that alternates every second between a
+// voiced section, harmonics of a gliding pitch with a syllable-rate envelope,
+// and quiet background noise, so that DTX sees both speech and noise.
+std::vector<int16_t> GenerateSyntheticSpeech(int sample_rate_hz,
+                                             int num_samples);
+
+// Returns the results of a benchmark run with |options| on |host| as a JSON
+// object.
+std::string FormatEncodeBenchmarkJson(
+    const BenchmarkEncodeOptions& options, const HostInfo& host,
+    const std::vector<EncodeBenchmarkResult>& results);
+
+// Encodes |options.num_packets| packets of synthetic audio, alternating
+// between voiced sections and background noise, with every configuration in
+// |options| and logs the stats of each stage: resampling, filtering, feature
+// extraction, noise estimation, quantization and packing. Unless
+// |options.output_dir| is empty, writes the per-call timings of each stage as
+// CSV and the stats with the host metadata as benchmark_encode.json into it.
+// Returns 0 on success.
+int benchmark_encode(const BenchmarkEncodeOptions& options);
+
+// Runs |benchmark_encode| with the default options but for the given ones.
+int benchmark_encode(int num_packets, const std::string& model_base_path);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_BENCHMARK_ENCODE_LIB_H_
@@ -0,0 +1,105 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark_encode_lib.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "benchmark_decode_lib.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "perf_counters.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+TEST(FormatEncodeBenchmarkJsonTest, ContainsEveryConfigurationAndStage) {
+  BenchmarkEncodeOptions options;
+  options.num_packets = 10;
+  options.num_warm_up_packets = 2;
+  HostInfo host;
+  host.cpu_model = "cpu";
+  host.cpu_isa = "generic";
+  host.num_cpus = 1;
+  EncodeBenchmarkResult without_dtx;
+  without_dtx.sample_rate_hz = 8000;
+  without_dtx.enable_dtx = false;
+  without_dtx.stats = {{"call", GetTimingStats({100, 200})},
+                       {"quantize", GetTimingStats({50, 60})}};
+  EncodeBenchmarkResult with_dtx = without_dtx;
+  with_dtx.sample_rate_hz = 48000;
+  with_dtx.enable_dtx = true;
+
+  const std::string json =
+      FormatEncodeBenchmarkJson(options, host, {without_dtx, with_dtx});
+
+  EXPECT_THAT(json, HasSubstr("\"cpu_isa\": \"generic\""));
+  EXPECT_THAT(json, HasSubstr("\"num_packets\": 10"));
+  EXPECT_THAT(json, HasSubstr("\"num_warm_up_packets\": 2"));
+  EXPECT_THAT(json,
+              HasSubstr("{\"sample_rate_hz\": 8000, \"enable_dtx\": false"));
+  EXPECT_THAT(json,
+              HasSubstr("{\"sample_rate_hz\": 48000, \"enable_dtx\": true"));
+  EXPECT_THAT(json, HasSubstr("\"quantize\": {\"num_calls\": 2"));
+  EXPECT_THAT(json, testing::Not(HasSubstr("perf_counters")));
+
+  with_dtx.perf_counts = {{"call", PerfCounts{100, 200, 3, 4}}};
+  EXPECT_THAT(FormatEncodeBenchmarkJson(options, host, {with_dtx}),
+              HasSubstr("\"perf_counters\": {\"call\": {\"cycles\": 100"));
+}
+
+TEST(BenchmarkEncodeTest, RejectsMoreWarmUpPacketsThanPackets) {
+  BenchmarkEncodeOptions options;
+  options.num_packets = 4;
+  options.num_warm_up_packets = 4;
+  options.model_base_path = "wavegru";
+  options.output_dir = "";
+
+  EXPECT_NE(benchmark_encode(options), 0);
+}
+
+TEST(BenchmarkEncodeTest, WritesJsonWithEveryConfiguration) {
+  const ghc::filesystem::path output_dir =
+      ghc::filesystem::path(testing::TempDir()) / "benchmark_encode";
+  BenchmarkEncodeOptions options;
+  options.num_packets = 10;
+  options.num_warm_up_packets = 1;
+  options.model_base_path = "wavegru";
+  options.sample_rates_hz = {16000, 48000};
+  options.output_dir = output_dir.string();
+
+  ASSERT_EQ(benchmark_encode(options), 0);
+
+  std::ifstream json_file((output_dir / "benchmark_encode.json").string());
+  std::stringstream json;
+  json << json_file.rdbuf();
+  EXPECT_THAT(json.str(),
+              HasSubstr("{\"sample_rate_hz\": 16000, \"enable_dtx\": false"));
+  EXPECT_THAT(json.str(),
+              HasSubstr("{\"sample_rate_hz\": 48000, \"enable_dtx\": true"));
+  EXPECT_THAT(json.str(), HasSubstr("\"noise_estimation\": {\"num_calls\": 9"));
+  EXPECT_TRUE(ghc::filesystem::exists(output_dir /
+                                      "encode_16000hz_dtx_on_extract.csv"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,155 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "biquad_cascade.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Runs one section over |num_samples| samples, which may be in place.
+template <typename InputType>
+void FilterSection(const BiquadCascade::Section& section,
+                   const InputType* input, int num_samples, float* output,
+                   double* state_1, double* state_2) {
+  double z1 = *state_1;
+  double z2 = *state_2;
+  for (int n = 0; n < num_samples; ++n) {
+    const double x = input[n];
+    const double y = section.b0 * x + z1;
+    z1 = section.b1 * x - section.a1 * y + z2;
+    z2 = section.b2 * x - section.a2 * y;
+    output[n] = static_cast<float>(y);
+  }
+  *state_1 = z1;
+  *state_2 = z2;
+}
+
+// Fractional bits of the fixed point coefficients and of the signal between
+// fixed point sections.
+constexpr int kCoefficientBits = 29;
+constexpr int kSignalBits = 12;
+
+// Runs one fixed point section over |num_samples| samples in place.
+template <typename Section>
+void FilterFixedPointSection(const Section& section, int num_samples,
+                             int32_t* signal, int64_t* state_1,
+                             int64_t* state_2) {
+  static constexpr int64_t kRounding = int64_t{1} << (kCoefficientBits - 1);
+  int64_t z1 = *state_1;
+  int64_t z2 = *state_2;
+  for (int n = 0; n < num_samples; ++n) {
+    const int64_t x = signal[n];
+    const int64_t y =
+        (int64_t{section.b0} * x + z1 + kRounding) >> kCoefficientBits;
+    z1 = int64_t{section.b1} * x - int64_t{section.a1} * y + z2;
+    z2 = int64_t{section.b2} * x - int64_t{section.a2} * y;
+    signal[n] = static_cast<int32_t>(y);
+  }
+  *state_1 = z1;
+  *state_2 = z2;
+}
+
+int32_t ToFixedPoint(double coefficient) {
+  return static_cast<int32_t>(
+      std::lround(std::ldexp(coefficient, kCoefficientBits)));
+}
+
+}  // namespace
+
+BiquadCascade::BiquadCascade(std::vector<Section> sections)
+    : sections_(std::move(sections)),
+      state_1_(sections_.size(), 0.0),
+      state_2_(sections_.size(), 0.0) {}
+
+void BiquadCascade::ProcessBlock(absl::Span<const int16_t> input,
+                                 absl::Span<float> output) {
+  CHECK_EQ(input.size(), output.size());
+  if (sections_.empty()) {
+    std::copy(input.begin(), input.end(), output.begin());
+    return;
+  }
+  const int num_samples = input.size();
+  // The first section reads the int16 input, the others filter the output of
+  // the previous one in place.
+  FilterSection(sections_[0], input.data(), num_samples, output.data(),
+                &state_1_[0], &state_2_[0]);
+  for (int s = 1; s < sections_.size(); ++s) {
+    FilterSection(sections_[s], output.data(), num_samples, output.data(),
+                  &state_1_[s], &state_2_[s]);
+  }
+}
+
+void BiquadCascade::Reset() {
+  std::fill(state_1_.begin(), state_1_.end(), 0.0);
+  std::fill(state_2_.begin(), state_2_.end(), 0.0);
+}
+
+FixedPointBiquadCascade::FixedPointBiquadCascade(
+    const std::vector<BiquadCascade::Section>& sections)
+    : sections_([&sections]() {
+        std::vector<Section> fixed_point_sections;
+        for (const BiquadCascade::Section& section : sections) {
+          CHECK(std::abs(section.b0) < 4.0 && std::abs(section.b1) < 4.0 &&
+                std::abs(section.b2) < 4.0 && std::abs(section.a1) < 4.0 &&
+                std::abs(section.a2) < 4.0)
+              << "Coefficients have to be in (-4, 4).";
+          fixed_point_sections.push_back(
+              {ToFixedPoint(section.b0), ToFixedPoint(section.b1),
+               ToFixedPoint(section.b2), ToFixedPoint(section.a1),
+               ToFixedPoint(section.a2)});
+        }
+        return fixed_point_sections;
+      }()),
+      state_1_(sections_.size(), 0),
+      state_2_(sections_.size(), 0) {}
+
+void FixedPointBiquadCascade::ProcessBlock(absl::Span<const int16_t> input,
+                                           absl::Span<int16_t> output) {
+  CHECK_EQ(input.size(), output.size());
+  const int num_samples = input.size();
+  buffer_.resize(num_samples);
+  for (int n = 0; n < num_samples; ++n) {
+    buffer_[n] = int32_t{input[n]} * (1 << kSignalBits);
+  }
+  for (int s = 0; s < sections_.size(); ++s) {
+    FilterFixedPointSection(sections_[s], num_samples, buffer_.data(),
+                            &state_1_[s], &state_2_[s]);
+  }
+  static constexpr int32_t kMin = std::numeric_limits<int16_t>::min();
+  static constexpr int32_t kMax = std::numeric_limits<int16_t>::max();
+  static constexpr int32_t kRounding = 1 << (kSignalBits - 1);
+  for (int n = 0; n < num_samples; ++n) {
+    output[n] = static_cast<int16_t>(std::min(
+        std::max((buffer_[n] + kRounding) >> kSignalBits, kMin), kMax));
+  }
+}
+
+void FixedPointBiquadCascade::Reset() {
+  std::fill(state_1_.begin(), state_1_.end(), 0);
+  std::fill(state_2_.begin(), state_2_.end(), 0);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_BIQUAD_CASCADE_H_
+#define LYRA_CODEC_BIQUAD_CASCADE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A cascade of second order IIR sections that filters a stream of int16
+// samples into floats, one block at a time. Each section runs over the whole
+// block before the next one, in transposed direct form II, so that its
+// coefficients and state stay in registers. The state is kept in double
+// precision since the poles of narrow high-pass sections lie close to the
+// unit circle.
+class BiquadCascade {
+ public:
+  // The coefficients of H(z) = (b0 + b1 z^-1 + b2 z^-2) /
+  // (1 + a1 z^-1 + a2 z^-2).
+  struct Section {
+    double b0;
+    double b1;
+    double b2;
+    double a1;
+    double a2;
+  };
+
+  explicit BiquadCascade(std::vector<Section> sections);
+
+  // Filters |input| into |output|, which has to be as long, continuing from
+  // the state the previous call left.
+  void ProcessBlock(absl::Span<const int16_t> input, absl::Span<float> output);
+
+  // Clears the state, as if no samples were filtered yet.
+  void Reset();
+
+ private:
+  const std::vector<Section> sections_;
+  // The two delayed values of each section.
+  std::vector<double> state_1_;
+  std::vector<double> state_2_;
+};
+
+// The same cascade in integer arithmetic, for devices without fast floating
+// point, which filters int16 samples into int16 samples. The coefficients are
+// kept with 29 fractional bits rather than in Q15, since Q15 would move the
+// poles of the high-pass sections by much more than their distance to the unit
+// circle. The signal between sections carries 12 fractional bits, so that the
+// rounding noise fed back through those poles stays below one int16 step.
+class FixedPointBiquadCascade {
+ public:
+  explicit FixedPointBiquadCascade(
+      const std::vector<BiquadCascade::Section>& sections);
+
+  // Filters |input| into |output|, which has to be as long, continuing from
+  // the state the previous call left. The output is rounded and clipped to
+  // int16.
+  void ProcessBlock(absl::Span<const int16_t> input,
+                    absl::Span<int16_t> output);
+
+  // Clears the state, as if no samples were filtered yet.
+  void Reset();
+
+ private:
+  // The coefficients of a section, with 29 fractional bits.
+  struct Section {
+    int32_t b0;
+    int32_t b1;
+    int32_t b2;
+    int32_t a1;
+    int32_t a2;
+  };
+
+  const std::vector<Section> sections_;
+  // The two delayed values of each section, with the fractional bits of the
+  // signal and of the coefficients.
+  std::vector<int64_t> state_1_;
+  std::vector<int64_t> state_2_;
+  // The signal between sections.
+  std::vector<int32_t> buffer_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_BIQUAD_CASCADE_H_
@@ -0,0 +1,190 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "biquad_cascade.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Two of the high-pass sections of the encoder.
+const std::vector<BiquadCascade::Section> kSections = {
+    {0.99860809, -1.99666786, 0.99860809, -1.99658432, 0.99729972},
+    {0.99357343, -0.99357343, 0.0, -0.98714687, 0.0}};
+
+std::vector<int16_t> RandomSamples(int num_samples, int max_value = 32767) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> distribution(-max_value - 1, max_value);
+  std::vector<int16_t> samples(num_samples);
+  for (int16_t& sample : samples) {
+    sample = distribution(gen);
+  }
+  return samples;
+}
+
+// Filters |input| with the direct form I difference equation of each section.
+std::vector<double> DirectFormFilter(
+    const std::vector<BiquadCascade::Section>& sections,
+    const std::vector<int16_t>& input) {
+  std::vector<double> signal(input.begin(), input.end());
+  for (const auto& section : sections) {
+    std::vector<double> filtered(signal.size());
+    for (int n = 0; n < signal.size(); ++n) {
+      const auto x = [&signal](int i) { return i >= 0 ? signal[i] : 0.0; };
+      const auto y = [&filtered](int i) { return i >= 0 ? filtered[i] : 0.0; };
+      filtered[n] = section.b0 * x(n) + section.b1 * x(n - 1) +
+                    section.b2 * x(n - 2) - section.a1 * y(n - 1) -
+                    section.a2 * y(n - 2);
+    }
+    signal = filtered;
+  }
+  return signal;
+}
+
+TEST(BiquadCascadeTest, MatchesDirectForm) {
+  const std::vector<int16_t> input = RandomSamples(1000);
+  BiquadCascade filter(kSections);
+  std::vector<float> output(input.size());
+
+  filter.ProcessBlock(input, absl::MakeSpan(output));
+
+  const std::vector<double> expected = DirectFormFilter(kSections, input);
+  for (int n = 0; n < input.size(); ++n) {
+    EXPECT_NEAR(output[n], expected[n], 1e-2) << "at sample " << n;
+  }
+}
+
+TEST(BiquadCascadeTest, OutputDoesNotDependOnBlockSize) {
+  const std::vector<int16_t> input = RandomSamples(700);
+  BiquadCascade whole_filter(kSections);
+  std::vector<float> whole(input.size());
+  whole_filter.ProcessBlock(input, absl::MakeSpan(whole));
+
+  BiquadCascade block_filter(kSections);
+  std::vector<float> blocks(input.size());
+  const absl::Span<const int16_t> input_span(input);
+  int start = 0;
+  for (int block_size : {1, 7, 100, 592}) {
+    block_filter.ProcessBlock(
+        input_span.subspan(start, block_size),
+        absl::MakeSpan(blocks).subspan(start, block_size));
+    start += block_size;
+  }
+
+  EXPECT_EQ(blocks, whole);
+}
+
+TEST(BiquadCascadeTest, ResetClearsState) {
+  const std::vector<int16_t> input = RandomSamples(100);
+  BiquadCascade filter(kSections);
+  std::vector<float> first(input.size());
+  filter.ProcessBlock(input, absl::MakeSpan(first));
+
+  filter.Reset();
+  std::vector<float> second(input.size());
+  filter.ProcessBlock(input, absl::MakeSpan(second));
+
+  EXPECT_EQ(first, second);
+}
+
+TEST(BiquadCascadeTest, EmptyCascadeConvertsToFloat) {
+  const std::vector<int16_t> input = {-32768, -1, 0, 1, 32767};
+  BiquadCascade filter({});
+  std::vector<float> output(input.size());
+
+  filter.ProcessBlock(input, absl::MakeSpan(output));
+
+  EXPECT_THAT(output, testing::ElementsAre(-32768.0f, -1.0f, 0.0f, 1.0f,
+                                           32767.0f));
+}
+
+TEST(FixedPointBiquadCascadeTest, MatchesDirectForm) {
+  // Half of full scale, so that the output is not clipped.
+  const std::vector<int16_t> input = RandomSamples(1000, 16383);
+  FixedPointBiquadCascade filter(kSections);
+  std::vector<int16_t> output(input.size());
+
+  filter.ProcessBlock(input, absl::MakeSpan(output));
+
+  const std::vector<double> expected = DirectFormFilter(kSections, input);
+  for (int n = 0; n < input.size(); ++n) {
+    EXPECT_NEAR(output[n], expected[n], 1.0) << "at sample " << n;
+  }
+}
+
+TEST(FixedPointBiquadCascadeTest, OutputDoesNotDependOnBlockSize) {
+  const std::vector<int16_t> input = RandomSamples(700);
+  FixedPointBiquadCascade whole_filter(kSections);
+  std::vector<int16_t> whole(input.size());
+  whole_filter.ProcessBlock(input, absl::MakeSpan(whole));
+
+  FixedPointBiquadCascade block_filter(kSections);
+  std::vector<int16_t> blocks(input.size());
+  const absl::Span<const int16_t> input_span(input);
+  int start = 0;
+  for (int block_size : {1, 7, 100, 592}) {
+    block_filter.ProcessBlock(
+        input_span.subspan(start, block_size),
+        absl::MakeSpan(blocks).subspan(start, block_size));
+    start += block_size;
+  }
+
+  EXPECT_EQ(blocks, whole);
+}
+
+TEST(FixedPointBiquadCascadeTest, ResetClearsState) {
+  const std::vector<int16_t> input = RandomSamples(100);
+  FixedPointBiquadCascade filter(kSections);
+  std::vector<int16_t> first(input.size());
+  filter.ProcessBlock(input, absl::MakeSpan(first));
+
+  filter.Reset();
+  std::vector<int16_t> second(input.size());
+  filter.ProcessBlock(input, absl::MakeSpan(second));
+
+  EXPECT_EQ(first, second);
+}
+
+TEST(FixedPointBiquadCascadeTest, OutputIsClipped) {
+  const std::vector<int16_t> input = {-32768, 32767, -32768, 32767};
+  // Almost a gain of four.
+  FixedPointBiquadCascade filter({{3.99, 0.0, 0.0, 0.0, 0.0}});
+  std::vector<int16_t> output(input.size());
+
+  filter.ProcessBlock(input, absl::MakeSpan(output));
+
+  EXPECT_THAT(output, testing::ElementsAre(-32768, 32767, -32768, 32767));
+}
+
+TEST(FixedPointBiquadCascadeTest, EmptyCascadeCopies) {
+  const std::vector<int16_t> input = {-32768, -1, 0, 1, 32767};
+  FixedPointBiquadCascade filter({});
+  std::vector<int16_t> output(input.size());
+
+  filter.ProcessBlock(input, absl::MakeSpan(output));
+
+  EXPECT_EQ(output, input);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
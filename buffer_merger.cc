@@ -17,106 +17,197 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
-#include <functional>
-#include <iterator>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/types/span.h"
 #include "filter_banks.h"
 #include "filter_banks_interface.h"
 #include "glog/logging.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
 
 std::unique_ptr<BufferMerger> BufferMerger::Create(int num_bands) {
-  auto merge_filter = MergeFilter::Create(num_bands);
+  return Create(num_bands, num_bands);
+}
+
+std::unique_ptr<BufferMerger> BufferMerger::Create(int num_bands,
+                                                   int num_output_bands) {
+  return Create(num_bands, num_output_bands, /*upsampling_factor=*/1);
+}
+
+std::unique_ptr<BufferMerger> BufferMerger::Create(int num_bands,
+                                                   int num_output_bands,
+                                                   int upsampling_factor) {
+  if (num_output_bands < 1 || num_output_bands > num_bands ||
+      num_bands % num_output_bands != 0) {
+    LOG(ERROR) << "Cannot merge " << num_output_bands << " out of "
+               << num_bands << " bands.";
+    return nullptr;
+  }
+  if (upsampling_factor < 1) {
+    LOG(ERROR) << "Upsampling factor has to be positive, but was "
+               << upsampling_factor << ".";
+    return nullptr;
+  }
+  std::unique_ptr<MergeFilterInterface> merge_filter;
+  if (upsampling_factor == 1) {
+    merge_filter = MergeFilter::Create(num_output_bands);
+  } else {
+    merge_filter =
+        UpsamplingMergeFilter::Create(num_output_bands, upsampling_factor);
+  }
   if (merge_filter == nullptr) {
-    LOG(ERROR) << "Cannot create a MergeFilter with " << num_bands << " bands.";
+    LOG(ERROR) << "Cannot create a MergeFilter with " << num_output_bands
+               << " bands.";
     return nullptr;
   }
 
-  return absl::WrapUnique(new BufferMerger(std::move(merge_filter)));
+  return absl::WrapUnique(new BufferMerger(num_bands, std::move(merge_filter)));
 }
 
-BufferMerger::BufferMerger(std::unique_ptr<MergeFilterInterface> merge_filter)
+BufferMerger::BufferMerger(int num_bands,
+                           std::unique_ptr<MergeFilterInterface> merge_filter)
     : merge_filter_(std::move(merge_filter)),
-      num_bands_(merge_filter_->num_bands()) {
-  leftover_samples_.reserve(num_bands_ - 1);
+      num_bands_(num_bands),
+      num_output_bands_(merge_filter_->num_bands()),
+      num_samples_per_band_sample_(
+          merge_filter_->num_samples_per_band_sample()),
+      leftover_samples_(num_samples_per_band_sample_ - 1),
+      leftover_start_(0),
+      num_leftover_samples_(0) {
+  split_bands_.reserve(num_bands_);
+  output_bands_.reserve(num_output_bands_);
 }
 
-int BufferMerger::GetNumSamplesToGenerate(int num_samples) const {
-  if (num_samples < leftover_samples_.size()) {
+int BufferMerger::GetNumSamplesToGeneratePerBand(int num_samples) const {
+  if (num_samples < num_leftover_samples_) {
     return 0;
   }
 
-  const int num_samples_to_generate_per_band = static_cast<int>(
-      std::ceil(static_cast<float>(num_samples - leftover_samples_.size()) /
-                static_cast<float>(num_bands_)));
-  return num_samples_to_generate_per_band * num_bands_;
+  return static_cast<int>(
+      std::ceil(static_cast<float>(num_samples - num_leftover_samples_) /
+                static_cast<float>(num_samples_per_band_sample_)));
+}
+
+int BufferMerger::GetNumSamplesToGenerate(int num_samples) const {
+  return GetNumSamplesToGeneratePerBand(num_samples) * num_bands_;
 }
 
 std::vector<int16_t> BufferMerger::BufferAndMerge(
-    const std::function<const std::vector<std::vector<int16_t>>&(int)>&
-        sample_generator,
-    int num_samples) {
-  int num_samples_to_generate = GetNumSamplesToGenerate(num_samples);
+    SampleGenerator sample_generator, int num_samples) {
+  std::vector<int16_t> samples(num_samples);
+  BufferAndMerge(sample_generator, absl::MakeSpan(samples));
+  return samples;
+}
+
+void BufferMerger::BufferAndMerge(SampleGenerator sample_generator,
+                                  absl::Span<int16_t> samples) {
+  const int num_samples = samples.size();
+  const int num_samples_to_generate_per_band =
+      GetNumSamplesToGeneratePerBand(num_samples);
 
   // 1. If we have any leftover samples from last time we must use them.
-  std::vector<int16_t> samples(num_samples);
-  const int num_leftover_used = UseLeftoverSamples(num_samples, &samples);
+  const int num_leftover_used = UseLeftoverSamples(samples);
 
-  // 2. Generate samples using |sample_generator|.
-  const std::vector<std::vector<int16_t>>& new_split_samples =
-      sample_generator(num_samples_to_generate);
+  // 2. Generate samples into |split_bands_| using |sample_generator|.
+  PrepareSplitBands(num_samples_to_generate_per_band);
+  sample_generator(split_bands_);
 
   // 3. Merge the buffer of split samples if needed to produce new samples.
-  const std::vector<int16_t> new_samples = MergeSamples(new_split_samples);
-  CHECK_EQ(new_samples.size(), num_samples_to_generate);
+  const absl::Span<const int16_t> new_samples = MergeSamples();
+  CHECK_EQ(new_samples.size(),
+           num_samples_to_generate_per_band * num_samples_per_band_sample_);
 
   // 4. Copy the new samples to output and the leftover buffers.
-  CopyNewSamples(new_samples, num_samples, num_leftover_used, &samples);
-  return samples;
+  CopyNewSamples(new_samples, num_leftover_used, samples);
+}
+
+bool BufferMerger::SaveState(StateWriter* writer) const {
+  // Only the leftovers that were not used yet are saved.
+  writer->Write(num_leftover_samples_);
+  writer->WriteBytes(leftover_samples_.data() + leftover_start_,
+                     num_leftover_samples_ * sizeof(int16_t));
+  return merge_filter_->SaveState(writer);
 }
 
-int BufferMerger::UseLeftoverSamples(int num_samples,
-                                     std::vector<int16_t>* samples) {
+bool BufferMerger::RestoreState(StateReader* reader) {
+  int num_leftover_samples;
+  if (!reader->Read(&num_leftover_samples) || num_leftover_samples < 0 ||
+      num_leftover_samples > static_cast<int>(leftover_samples_.size()) ||
+      !reader->ReadBytes(leftover_samples_.data(),
+                         num_leftover_samples * sizeof(int16_t))) {
+    return false;
+  }
+  leftover_start_ = 0;
+  num_leftover_samples_ = num_leftover_samples;
+  return merge_filter_->RestoreState(reader);
+}
+
+int BufferMerger::UseLeftoverSamples(absl::Span<int16_t> samples) {
   const int num_leftover_used =
-      std::min(static_cast<int>(leftover_samples_.size()), num_samples);
-  std::move(leftover_samples_.begin(),
-            leftover_samples_.begin() + num_leftover_used, samples->begin());
-  std::move(leftover_samples_.begin() + num_leftover_used,
-            leftover_samples_.end(), leftover_samples_.begin());
-  leftover_samples_.resize(leftover_samples_.size() - num_leftover_used);
+      std::min(num_leftover_samples_, static_cast<int>(samples.size()));
+  const auto leftover_begin = leftover_samples_.begin() + leftover_start_;
+  std::copy(leftover_begin, leftover_begin + num_leftover_used,
+            samples.begin());
+  leftover_start_ += num_leftover_used;
+  num_leftover_samples_ -= num_leftover_used;
   return num_leftover_used;
 }
 
-std::vector<int16_t> BufferMerger::MergeSamples(
-    const std::vector<std::vector<int16_t>>& new_split_samples) {
-  // If there is only one band, no need to merge.
-  if (num_bands_ == 1) {
-    return new_split_samples.at(0);
+void BufferMerger::PrepareSplitBands(int num_samples_per_band) {
+  split_samples_.resize(num_bands_ * num_samples_per_band);
+  split_bands_.clear();
+  for (int band = 0; band < num_bands_; ++band) {
+    split_bands_.emplace_back(
+        split_samples_.data() + band * num_samples_per_band,
+        num_samples_per_band);
   }
-  // Otherwise merge the split samples.
-  return merge_filter_->Merge(new_split_samples);
 }
 
-void BufferMerger::CopyNewSamples(const std::vector<int16_t>& new_samples,
-                                  int num_samples, int num_leftover_used,
-                                  std::vector<int16_t>* samples) {
+absl::Span<const int16_t> BufferMerger::MergeSamples() {
+  // If there is only one output band and no upsampling, no need to merge.
+  if (num_samples_per_band_sample_ == 1) {
+    return split_bands_.at(0);
+  }
+  // Only the lowest |num_output_bands_| bands are merged. The low bands of the
+  // split filter tree come first, so they are the ones a filter tree with
+  // |num_output_bands_| bands expects, and the views skip the upper ones
+  // without copying.
+  output_bands_.assign(split_bands_.begin(),
+                       split_bands_.begin() + num_output_bands_);
+  merged_samples_.resize(split_bands_.at(0).size() *
+                         num_samples_per_band_sample_);
+  merge_filter_->MergeInto(output_bands_, absl::MakeSpan(merged_samples_));
+  return merged_samples_;
+}
+
+void BufferMerger::CopyNewSamples(absl::Span<const int16_t> new_samples,
+                                  int num_leftover_used,
+                                  absl::Span<int16_t> samples) {
   // Copy the needed samples to the destination, which already has some
   // leftover samples from the last run.
-  const int num_samples_to_copy = num_samples - num_leftover_used;
+  const int num_samples_to_copy = samples.size() - num_leftover_used;
   CHECK_GE(new_samples.size(), num_samples_to_copy);
   std::copy(new_samples.begin(), new_samples.begin() + num_samples_to_copy,
-            samples->begin() + num_leftover_used);
+            samples.begin() + num_leftover_used);
 
-  // Store the rest in the |leftover_samples_|.
-  leftover_samples_.insert(leftover_samples_.end(),
-                           new_samples.begin() + num_samples_to_copy,
-                           new_samples.end());
+  // Store the rest in |leftover_samples_|, which is only refilled once all of
+  // its samples were used, so they start at its beginning.
+  const int num_new_leftover = new_samples.size() - num_samples_to_copy;
+  if (num_new_leftover == 0) {
+    return;
+  }
+  CHECK_EQ(num_leftover_samples_, 0);
+  CHECK_LE(num_new_leftover, leftover_samples_.size());
+  std::copy(new_samples.begin() + num_samples_to_copy, new_samples.end(),
+            leftover_samples_.begin());
+  leftover_start_ = 0;
+  num_leftover_samples_ = num_new_leftover;
 }
 
 }  // namespace codec
@@ -18,11 +18,13 @@
 #define LYRA_CODEC_BUFFER_MERGER_H_
 
 #include <cstdint>
-#include <functional>
 #include <memory>
 #include <vector>
 
+#include "absl/functional/function_ref.h"
+#include "absl/types/span.h"
 #include "filter_banks_interface.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -34,38 +36,111 @@ class BufferMerger {
  public:
   static std::unique_ptr<BufferMerger> Create(int num_bands);
 
+  // Same as above, but only the lowest |num_output_bands| of the |num_bands|
+  // generated bands are merged and the others are dropped, which divides the
+  // output sample rate by |num_bands| / |num_output_bands|. For example, the
+  // lowest 2 of 4 bands of a 16 kHz model give 8 kHz. |num_output_bands| has
+  // to be a power of 2 no larger than |num_bands|.
+  static std::unique_ptr<BufferMerger> Create(int num_bands,
+                                              int num_output_bands);
+
+  // Same as above, but the merged samples are also upsampled by
+  // |upsampling_factor| in the merge filter, which multiplies the output
+  // sample rate by it. For example, 4 bands of a 16 kHz model upsampled by 3
+  // give 48 kHz without a separate resampling pass.
+  static std::unique_ptr<BufferMerger> Create(int num_bands,
+                                              int num_output_bands,
+                                              int upsampling_factor);
+
+  // Fills every span of its argument, which holds one span per generated
+  // band, all of the same size, with newly generated samples of that band.
+  // Called once per |BufferAndMerge|, with views into buffers owned by the
+  // merger that are only valid during the call.
+  using SampleGenerator =
+      absl::FunctionRef<void(absl::Span<const absl::Span<int16_t>>)>;
+
   // Buffer the newly generated split samples and merge them to produce
-  // |num_samples| samples.
-  std::vector<int16_t> BufferAndMerge(
-      const std::function<const std::vector<std::vector<int16_t>>&(int)>&
-          sample_generator,
-      int num_samples);
+  // |num_samples| samples at the output sample rate.
+  std::vector<int16_t> BufferAndMerge(SampleGenerator sample_generator,
+                                      int num_samples);
+
+  // Same as above, but writes |samples.size()| merged samples into |samples|.
+  // The split and merged buffers only grow to the largest request, so this
+  // does not allocate in the steady state.
+  void BufferAndMerge(SampleGenerator sample_generator,
+                      absl::Span<int16_t> samples);
+
+  void Reset() {
+    leftover_start_ = 0;
+    num_leftover_samples_ = 0;
+  }
 
-  void Reset() { leftover_samples_.clear(); }
+  // Like |Reset|, but also forgets the history of the merge filter, as if the
+  // merger was just created.
+  void ClearState() {
+    Reset();
+    merge_filter_->Reset();
+  }
+
+  // Appends the leftover samples and the history of the merge filter to
+  // |writer|. Returns false if the merge filter does not support this.
+  bool SaveState(StateWriter* writer) const;
+
+  // Restores what |SaveState| of a merger of the same bands wrote. Returns
+  // false if |reader| does not hold it, in which case the state must be
+  // cleared before the merger is used again.
+  bool RestoreState(StateReader* reader);
 
  private:
-  explicit BufferMerger(std::unique_ptr<MergeFilterInterface> merge_filter);
+  BufferMerger(int num_bands,
+               std::unique_ptr<MergeFilterInterface> merge_filter);
+
+  // Number of samples per band that need to be generated if a total of
+  // |num_samples| output samples is requested upstream. Computed based on the
+  // number of leftover samples from previous calls and number of output bands.
+  int GetNumSamplesToGeneratePerBand(int num_samples) const;
 
   // Helper function to inform the generative model how many samples need to
-  // be generated if a total of |num_samples| is requested upstream. Computed
-  // based on the number of leftover samples from previous calls and number of
-  // bands.
+  // be generated, summed over all bands, if a total of |num_samples| is
+  // requested upstream.
   int GetNumSamplesToGenerate(int num_samples) const;
 
-  // Use at most |num_samples| from |leftover_samples_| to fill the beginning
-  // of |samples|.
-  int UseLeftoverSamples(int num_samples, std::vector<int16_t>* samples);
+  // Use at most |samples.size()| from |leftover_samples_| to fill the
+  // beginning of |samples|.
+  int UseLeftoverSamples(absl::Span<int16_t> samples);
+
+  // Points |split_bands_| to |num_samples_per_band| samples per band of
+  // |split_samples_|.
+  void PrepareSplitBands(int num_samples_per_band);
 
-  std::vector<int16_t> MergeSamples(
-      const std::vector<std::vector<int16_t>>& new_split_samples);
+  // Returns a view of either the single band in |split_bands_| or
+  // |merged_samples_|, which is only valid until the next call.
+  absl::Span<const int16_t> MergeSamples();
 
-  void CopyNewSamples(const std::vector<int16_t>& new_samples, int num_samples,
-                      int num_leftover_used, std::vector<int16_t>* samples);
+  void CopyNewSamples(absl::Span<const int16_t> new_samples,
+                      int num_leftover_used, absl::Span<int16_t> samples);
 
   std::unique_ptr<MergeFilterInterface> merge_filter_;
+  // Number of bands generated by the model.
   const int num_bands_;
-  // Buffer of (at most |num_bands_ - 1|) leftover samples from the last run.
+  // Number of the lowest bands that are merged into the output.
+  const int num_output_bands_;
+  // Number of output samples each sample per band merges into.
+  const int num_samples_per_band_sample_;
+  // Buffer of the (at most |num_samples_per_band_sample_ - 1|) leftover
+  // samples from the last run, which are used from |leftover_start_| on. New
+  // leftovers are only stored once all the old ones were used, so the buffer
+  // has a fixed capacity and neither using nor storing them moves samples.
   std::vector<int16_t> leftover_samples_;
+  int leftover_start_;
+  int num_leftover_samples_;
+  // Reused samples of all the generated bands one after the other, and views
+  // of each band and of the lowest |num_output_bands_| bands.
+  std::vector<int16_t> split_samples_;
+  std::vector<absl::Span<int16_t>> split_bands_;
+  std::vector<absl::Span<const int16_t>> output_bands_;
+  // Reused output of |merge_filter_|, which grows to the largest request.
+  std::vector<int16_t> merged_samples_;
   friend class BufferMergerPeer;
 };
 
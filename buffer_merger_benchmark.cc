@@ -0,0 +1,61 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "buffer_merger.h"
+
+static constexpr int kNumBands = 4;
+
+// Merges |state.range(0)| samples per call from 4 bands of random samples.
+// Requests that are not a multiple of the number of bands also exercise the
+// leftover samples.
+void BM_BufferAndMerge(benchmark::State& state) {
+  const int num_samples = state.range(0);
+  auto buffer_merger = chromemedia::codec::BufferMerger::Create(kNumBands);
+  // We create random split samples to avoid any caching in the benchmark.
+  absl::BitGen gen;
+  std::vector<int16_t> random_samples(16 * num_samples);
+  for (auto& sample : random_samples) {
+    sample = absl::Uniform<uint16_t>(gen);
+  }
+  int offset = 0;
+  const auto sample_generator =
+      [&](absl::Span<const absl::Span<int16_t>> split_samples) {
+        for (const absl::Span<int16_t> band : split_samples) {
+          if (offset + band.size() > random_samples.size()) {
+            offset = 0;
+          }
+          std::copy(random_samples.begin() + offset,
+                    random_samples.begin() + offset + band.size(),
+                    band.begin());
+          offset += band.size();
+        }
+      };
+  std::vector<int16_t> samples(num_samples);
+
+  for (auto _ : state) {
+    buffer_merger->BufferAndMerge(sample_generator, absl::MakeSpan(samples));
+    benchmark::DoNotOptimize(samples.data());
+  }
+}
+
+BENCHMARK(BM_BufferAndMerge)->Arg(1)->Arg(30)->Arg(160)->Arg(321)->Arg(640);
+BENCHMARK_MAIN();
@@ -14,16 +14,19 @@
 
 #include "buffer_merger.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
-#include <functional>
 #include <memory>
 #include <numeric>
+#include <random>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "filter_banks.h"
 #include "filter_banks_interface.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -35,18 +38,38 @@ namespace codec {
 
 class BufferMergerPeer {
  public:
-  explicit BufferMergerPeer(std::unique_ptr<MockMergeFilter> mock_merge_filter)
-      : buffer_merger_(new BufferMerger(std::move(mock_merge_filter))) {}
+  explicit BufferMergerPeer(
+      std::unique_ptr<MockMergeFilter> mock_merge_filter) {
+    const int num_bands = mock_merge_filter->num_bands();
+    buffer_merger_ = absl::WrapUnique(
+        new BufferMerger(num_bands, std::move(mock_merge_filter)));
+  }
+
+  // |num_bands| bands are generated and the lowest
+  // |mock_merge_filter->num_bands()| are merged.
+  BufferMergerPeer(int num_bands,
+                   std::unique_ptr<MockMergeFilter> mock_merge_filter)
+      : buffer_merger_(
+            new BufferMerger(num_bands, std::move(mock_merge_filter))) {}
 
   std::vector<int16_t> BufferAndMerge(
       const std::vector<std::vector<int16_t>>& new_split_samples,
       int num_samples) {
-    std::function<const std::vector<std::vector<int16_t>>&(int)>
-        sample_generator = [&new_split_samples](int num_samples_to_generate)
-        -> const std::vector<std::vector<int16_t>>& {
-      return new_split_samples;
-    };
-    return buffer_merger_->BufferAndMerge(sample_generator, num_samples);
+    return buffer_merger_->BufferAndMerge(
+        [&new_split_samples](absl::Span<const absl::Span<int16_t>> bands) {
+          CopySplitSamples(new_split_samples, bands);
+        },
+        num_samples);
+  }
+
+  void BufferAndMerge(
+      const std::vector<std::vector<int16_t>>& new_split_samples,
+      absl::Span<int16_t> samples) {
+    buffer_merger_->BufferAndMerge(
+        [&new_split_samples](absl::Span<const absl::Span<int16_t>> bands) {
+          CopySplitSamples(new_split_samples, bands);
+        },
+        samples);
   }
 
   int GetNumSamplesToGenerate(int num_samples) {
@@ -55,6 +78,20 @@ class BufferMergerPeer {
   void Reset() { return buffer_merger_->Reset(); }
 
   std::unique_ptr<BufferMerger> buffer_merger_;
+
+ private:
+  // Fills each of |bands| with the first samples of the same band of
+  // |new_split_samples|.
+  static void CopySplitSamples(
+      const std::vector<std::vector<int16_t>>& new_split_samples,
+      absl::Span<const absl::Span<int16_t>> bands) {
+    ASSERT_EQ(new_split_samples.size(), bands.size());
+    for (int band = 0; band < bands.size(); ++band) {
+      ASSERT_GE(new_split_samples[band].size(), bands[band].size());
+      std::copy_n(new_split_samples[band].begin(), bands[band].size(),
+                  bands[band].begin());
+    }
+  }
 };
 
 namespace {
@@ -303,6 +340,162 @@ TEST_F(BufferMergerTest, SubsequentBufferAndMergeUseLeftovers) {
   EXPECT_THAT(result_2, ElementsAre(3, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4));
 }
 
+TEST_F(BufferMergerTest, SpanOutputUsesLeftovers) {
+  // Same as above, but writing into caller-provided buffers.
+  auto mock_merge_filter = absl::make_unique<MockMergeFilter>(2);
+  EXPECT_CALL(*mock_merge_filter, Merge(_))
+      .WillRepeatedly(Invoke(InterleaveMerge));
+  BufferMergerPeer buffer_merger_peer(std::move(mock_merge_filter));
+
+  std::vector<int16_t> result_1(7);
+  const auto split_samples_1 =
+      SetUpSplitSamples(2, buffer_merger_peer.GetNumSamplesToGenerate(7));
+  buffer_merger_peer.BufferAndMerge(split_samples_1, absl::MakeSpan(result_1));
+  EXPECT_THAT(result_1, ElementsAre(0, 0, 1, 1, 2, 2, 3));
+
+  std::vector<int16_t> result_2(11);
+  const auto split_samples_2 =
+      SetUpSplitSamples(2, buffer_merger_peer.GetNumSamplesToGenerate(11));
+  buffer_merger_peer.BufferAndMerge(split_samples_2, absl::MakeSpan(result_2));
+  EXPECT_THAT(result_2, ElementsAre(3, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4));
+}
+
+TEST_F(BufferMergerTest, OnlyLowestBandsAreMerged) {
+  const int kNumBands = 4;
+  const int kNumOutputBands = 2;
+  auto mock_merge_filter = absl::make_unique<MockMergeFilter>(kNumOutputBands);
+  auto split_samples = SetUpSplitSamples(kNumBands, 4 * 10);
+  // Mark the upper bands so that they would show up if they were merged.
+  std::fill(split_samples[2].begin(), split_samples[2].end(), -1);
+  std::fill(split_samples[3].begin(), split_samples[3].end(), -1);
+  EXPECT_CALL(*mock_merge_filter,
+              Merge(ElementsAre(split_samples[0], split_samples[1])))
+      .WillOnce(Invoke(InterleaveMerge));
+
+  BufferMergerPeer buffer_merger_peer(kNumBands, std::move(mock_merge_filter));
+  // Producing 20 output samples needs 10 samples per band, which is 40 over
+  // all generated bands.
+  EXPECT_EQ(40, buffer_merger_peer.GetNumSamplesToGenerate(20));
+  const std::vector<int16_t> samples =
+      buffer_merger_peer.BufferAndMerge(split_samples, 20);
+  EXPECT_THAT(samples, SizeIs(20));
+  EXPECT_EQ(std::count(samples.begin(), samples.end(), -1), 0);
+}
+
+TEST_F(BufferMergerTest, LeftoversAreCountedAtTheOutputRate) {
+  const int kNumBands = 4;
+  const int kNumOutputBands = 2;
+  auto mock_merge_filter = absl::make_unique<MockMergeFilter>(kNumOutputBands);
+  EXPECT_CALL(*mock_merge_filter, Merge(_))
+      .WillRepeatedly(Invoke(InterleaveMerge));
+  BufferMergerPeer buffer_merger_peer(kNumBands, std::move(mock_merge_filter));
+
+  // 7 output samples need 4 samples per band and leave 1 leftover sample.
+  EXPECT_EQ(16, buffer_merger_peer.GetNumSamplesToGenerate(7));
+  const auto split_samples = SetUpSplitSamples(kNumBands, 16);
+  EXPECT_THAT(buffer_merger_peer.BufferAndMerge(split_samples, 7), SizeIs(7));
+  EXPECT_EQ(0, buffer_merger_peer.GetNumSamplesToGenerate(1));
+  EXPECT_EQ(kNumBands, buffer_merger_peer.GetNumSamplesToGenerate(2));
+}
+
+TEST(BufferMergerUpsamplingTest, LeftoversAreCountedAtTheUpsampledRate) {
+  constexpr int kNumBands = 4;
+  constexpr int kUpsamplingFactor = 3;
+  auto buffer_merger =
+      BufferMerger::Create(kNumBands, kNumBands, kUpsamplingFactor);
+  ASSERT_NE(nullptr, buffer_merger);
+  int num_samples_generated = 0;
+  const auto sample_generator =
+      [&](absl::Span<const absl::Span<int16_t>> bands) {
+        ASSERT_THAT(bands, SizeIs(kNumBands));
+        num_samples_generated = 0;
+        for (absl::Span<int16_t> band : bands) {
+          std::fill(band.begin(), band.end(), 100);
+          num_samples_generated += band.size();
+        }
+      };
+
+  // 100 output samples need 9 samples per band, which merge and upsample
+  // into 108 samples and leave 8 leftover samples.
+  EXPECT_THAT(buffer_merger->BufferAndMerge(sample_generator, 100),
+              SizeIs(100));
+  EXPECT_EQ(9 * kNumBands, num_samples_generated);
+  EXPECT_THAT(buffer_merger->BufferAndMerge(sample_generator, 8), SizeIs(8));
+  EXPECT_EQ(0, num_samples_generated);
+  EXPECT_THAT(buffer_merger->BufferAndMerge(sample_generator, 12),
+              SizeIs(12));
+  EXPECT_EQ(kNumBands, num_samples_generated);
+}
+
+TEST(BufferMergerCreate, InvalidNumOutputBandsFails) {
+  EXPECT_NE(nullptr, BufferMerger::Create(4, 2));
+  EXPECT_NE(nullptr, BufferMerger::Create(4, 1));
+  EXPECT_EQ(nullptr, BufferMerger::Create(4, 0));
+  EXPECT_EQ(nullptr, BufferMerger::Create(4, 3));
+  EXPECT_EQ(nullptr, BufferMerger::Create(4, 8));
+}
+
+TEST(BufferMergerCreate, InvalidUpsamplingFactorFails) {
+  EXPECT_NE(nullptr, BufferMerger::Create(4, 4, 1));
+  EXPECT_NE(nullptr, BufferMerger::Create(4, 4, 3));
+  EXPECT_EQ(nullptr, BufferMerger::Create(4, 4, 0));
+}
+
+// Splits a random signal of |num_bands| * |num_samples_per_band| samples.
+std::vector<std::vector<int16_t>> SplitRandomSignal(int num_bands,
+                                                    int num_samples_per_band) {
+  std::vector<int16_t> signal(num_bands * num_samples_per_band);
+  std::mt19937 generator;
+  std::uniform_int_distribution<> distribution(-8192, 8192);
+  for (int16_t& sample : signal) {
+    sample = distribution(generator);
+  }
+  return SplitFilter::Create(num_bands)->Split(signal);
+}
+
+TEST(BufferMergerEightBandsTest, MatchesTheMergeFilter) {
+  constexpr int kNumBands = 8;
+  constexpr int kNumSamplesPerBand = 40;
+  const auto split_samples = SplitRandomSignal(kNumBands, kNumSamplesPerBand);
+  auto buffer_merger = BufferMerger::Create(kNumBands);
+  ASSERT_NE(buffer_merger, nullptr);
+
+  const std::vector<int16_t> samples = buffer_merger->BufferAndMerge(
+      [&](absl::Span<const absl::Span<int16_t>> bands) {
+        ASSERT_EQ(bands.size(), kNumBands);
+        for (int band = 0; band < kNumBands; ++band) {
+          ASSERT_EQ(bands[band].size(), kNumSamplesPerBand);
+          std::copy(split_samples[band].begin(), split_samples[band].end(),
+                    bands[band].begin());
+        }
+      },
+      kNumBands * kNumSamplesPerBand);
+
+  EXPECT_EQ(samples, MergeFilter::Create(kNumBands)->Merge(split_samples));
+}
+
+TEST(BufferMergerEightBandsTest, LowestFourBandsMergeAtHalfTheRate) {
+  constexpr int kNumBands = 8;
+  constexpr int kNumOutputBands = 4;
+  constexpr int kNumSamplesPerBand = 40;
+  const auto split_samples = SplitRandomSignal(kNumBands, kNumSamplesPerBand);
+  auto buffer_merger = BufferMerger::Create(kNumBands, kNumOutputBands);
+  ASSERT_NE(buffer_merger, nullptr);
+
+  const std::vector<int16_t> samples = buffer_merger->BufferAndMerge(
+      [&split_samples](absl::Span<const absl::Span<int16_t>> bands) {
+        for (int band = 0; band < kNumBands; ++band) {
+          std::copy(split_samples[band].begin(), split_samples[band].end(),
+                    bands[band].begin());
+        }
+      },
+      kNumOutputBands * kNumSamplesPerBand);
+
+  const std::vector<std::vector<int16_t>> lowest_bands(
+      split_samples.begin(), split_samples.begin() + kNumOutputBands);
+  EXPECT_EQ(samples, MergeFilter::Create(kNumOutputBands)->Merge(lowest_bands));
+}
+
 class BufferMergerNumBandTest : public testing::TestWithParam<int> {
  protected:
   BufferMergerNumBandTest() : num_bands_(GetParam()) {}
@@ -0,0 +1,84 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes a model directory into a single bundle file, which encoders and
+// decoders open in place of the directory. Pass --verify to check the
+// checksums of an existing bundle instead.
+
+#include <memory>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "architecture_utils.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "model_bundle.h"
+#include "model_unpacker.h"
+
+ABSL_FLAG(std::string, model_path, "wavegru",
+          "Path to directory containing the model files, gzipped or "
+          "unpacked. For desktop this is the path relative to the binary.");
+ABSL_FLAG(std::string, output_path, "",
+          "The path of the bundle to be written. Will overwrite an existing "
+          "file.");
+ABSL_FLAG(bool, verify, false,
+          "If true, checks the bundle at --output_path against its "
+          "checksums instead of writing it.");
+ABSL_FLAG(std::string, role, "decoder",
+          "The user of the model, 'encoder' to keep only the quantizer "
+          "assets or 'decoder' to keep all of them.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  const ghc::filesystem::path output_path(absl::GetFlag(FLAGS_output_path));
+  if (output_path.empty()) {
+    LOG(ERROR) << "Flag --output_path not set.";
+    return -1;
+  }
+
+  if (absl::GetFlag(FLAGS_verify)) {
+    const std::unique_ptr<chromemedia::codec::ModelBundle> bundle =
+        chromemedia::codec::ModelBundle::Open(output_path);
+    if (bundle == nullptr || !bundle->VerifyChecksums()) {
+      LOG(ERROR) << "Failed to verify " << output_path;
+      return -1;
+    }
+    LOG(INFO) << output_path << " holds " << bundle->SectionNames().size()
+              << " valid sections with identifier " << bundle->identifier()
+              << ".";
+    return 0;
+  }
+
+  const ghc::filesystem::path model_path =
+      chromemedia::codec::GetCompleteArchitecturePath(
+          absl::GetFlag(FLAGS_model_path));
+  const std::string role_name = absl::GetFlag(FLAGS_role);
+  const auto role = chromemedia::codec::ModelRoleFromName(role_name);
+  if (!role.has_value()) {
+    LOG(ERROR) << "Unknown role '" << role_name << "'.";
+    return -1;
+  }
+
+  if (!chromemedia::codec::WriteModelBundle(model_path, output_path,
+                                            role.value())) {
+    LOG(ERROR) << "Failed to bundle " << model_path;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,107 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "capacity_benchmark_lib.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+
+ABSL_FLAG(std::string, mode, "shared_model",
+          "How sessions are run, one of 'thread_per_session' (every session "
+          "loads its own model and runs on its own thread), 'shared_model' "
+          "(decoders share one model and run on a pinned worker per core) or "
+          "'batched' (one batched model per core runs all its sessions).");
+
+ABSL_FLAG(int, num_cores, 0,
+          "Cores the sessions run on. Defaults to all cores if not positive.");
+
+ABSL_FLAG(std::string, precision, "",
+          "Arithmetic of the model, one of 'float', 'fixed16' or 'bfloat16'. "
+          "Defaults to the precision the binary was built for.");
+
+ABSL_FLAG(int, sample_rate_hz, 16000, "Output sample rate of every session.");
+
+ABSL_FLAG(bool, encode, false,
+          "Whether every session also encodes a packet per decoded packet, as "
+          "in a two-way call.");
+
+ABSL_FLAG(double, packet_loss_rate, 0.05,
+          "Packet loss rate of every session.");
+
+ABSL_FLAG(double, average_burst_length, 2.0,
+          "Average length of the bursts of lost packets.");
+
+ABSL_FLAG(int, num_packets_per_trial, 250,
+          "The number of packets every session decodes in one trial.");
+
+ABSL_FLAG(double, max_deadline_miss_rate, 0.01,
+          "The largest fraction of packets finishing after the arrival of the "
+          "next packet for which a number of sessions counts as real time.");
+
+ABSL_FLAG(int, min_sessions, 1, "The number of sessions of the first trial.");
+
+ABSL_FLAG(int, max_sessions, 1024, "The most sessions the ramp tries.");
+
+ABSL_FLAG(std::string, json_path, "",
+          "If set, the result and every trial are written to this path as "
+          "JSON.");
+
+ABSL_FLAG(
+    std::string, model_path, "wavegru",
+    "Path to directory containing model weights and quant files. For mobile "
+    "this is the absolute path, like '/sdcard/wavegru/'. For desktop this is "
+    "the path relative to the binary.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  chromemedia::codec::CapacityBenchmarkOptions options;
+  const std::string mode_name = absl::GetFlag(FLAGS_mode);
+  const auto mode_or = chromemedia::codec::SessionModeFromName(mode_name);
+  if (!mode_or.has_value()) {
+    LOG(ERROR) << "Unknown mode '" << mode_name << "'.";
+    return -1;
+  }
+  options.mode = mode_or.value();
+
+  const std::string precision_name = absl::GetFlag(FLAGS_precision);
+  if (!precision_name.empty()) {
+    const auto precision_or =
+        chromemedia::codec::ComputePrecisionFromName(precision_name);
+    if (!precision_or.has_value()) {
+      LOG(ERROR) << "Unknown precision '" << precision_name << "'.";
+      return -1;
+    }
+    options.precision = precision_or.value();
+  }
+
+  options.model_base_path = absl::GetFlag(FLAGS_model_path);
+  options.num_cores = absl::GetFlag(FLAGS_num_cores);
+  options.sample_rate_hz = absl::GetFlag(FLAGS_sample_rate_hz);
+  options.encode = absl::GetFlag(FLAGS_encode);
+  options.packet_loss_rate = absl::GetFlag(FLAGS_packet_loss_rate);
+  options.average_burst_length = absl::GetFlag(FLAGS_average_burst_length);
+  options.num_packets_per_trial = absl::GetFlag(FLAGS_num_packets_per_trial);
+  options.max_deadline_miss_rate = absl::GetFlag(FLAGS_max_deadline_miss_rate);
+  options.min_sessions = absl::GetFlag(FLAGS_min_sessions);
+  options.max_sessions = absl::GetFlag(FLAGS_max_sessions);
+
+  return chromemedia::codec::benchmark_capacity(options,
+                                                absl::GetFlag(FLAGS_json_path));
+}
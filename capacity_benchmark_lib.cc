@@ -0,0 +1,611 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "capacity_benchmark_lib.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "architecture_utils.h"
+#include "batched_causal_convolutional_conditioning.h"
+#include "batched_lyra_wavegru.h"
+#include "benchmark_decode_lib.h"
+#include "benchmark_encode_lib.h"
+#include "codec_executor.h"
+#include "compute_precision.h"
+#include "gilbert_model.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_encoder.h"
+#include "lyra_model.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kNumCondHiddens = 512;
+constexpr char kModelPrefix[] = "lyra_16khz";
+// Sessions start at different packets of the shared input, so that their DTX
+// sections do not line up.
+constexpr int kNumInputPackets = 250;
+// Time to start all session threads before the first packet arrives.
+constexpr absl::Duration kStartDelay = absl::Milliseconds(200);
+
+absl::Duration PacketDuration() {
+  return absl::Seconds(1) * kNumFramesPerPacket / kFrameRate;
+}
+
+// Returns the packets of |kNumInputPackets| of synthetic speech encoded with
+// DTX, so that the background noise sections are sent as empty packets.
+absl::optional<std::vector<std::vector<uint8_t>>> EncodeInputPackets(
+    const std::shared_ptr<LyraModel>& model) {
+  auto encoder = LyraEncoder::Create(kInternalSampleRateHz, kNumChannels,
+                                     kBitrate, /*enable_dtx=*/true, model);
+  if (encoder == nullptr) {
+    LOG(ERROR) << "Could not create the encoder of the input packets.";
+    return absl::nullopt;
+  }
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(kInternalSampleRateHz);
+  const std::vector<int16_t> audio = GenerateSyntheticSpeech(
+      kInternalSampleRateHz, kNumInputPackets * num_samples_per_packet);
+  auto packets_or = encoder->EncodeBatch(audio);
+  if (!packets_or.has_value()) {
+    LOG(ERROR) << "Could not encode the input packets.";
+  }
+  return packets_or;
+}
+
+// Calls |process_packet| for |num_packets| packets arriving every packet
+// duration from |start| and appends the latency of each, from its arrival
+// until |process_packet| returned, to |latencies_microsecs|. Packets after a
+// late one arrive on schedule, so a session that falls behind stays behind.
+// Returns false as soon as |process_packet| does.
+bool RunInRealTime(absl::Time start, int num_packets,
+                   const std::function<bool(int packet)>& process_packet,
+                   std::vector<int64_t>* latencies_microsecs) {
+  const absl::Duration packet_duration = PacketDuration();
+  for (int p = 0; p < num_packets; ++p) {
+    const absl::Time arrival = start + p * packet_duration;
+    const absl::Duration wait = arrival - absl::Now();
+    if (wait > absl::ZeroDuration()) {
+      absl::SleepFor(wait);
+    }
+    if (!process_packet(p)) {
+      return false;
+    }
+    latencies_microsecs->push_back(
+        absl::ToInt64Microseconds(absl::Now() - arrival));
+  }
+  return true;
+}
+
+// Runs |process_packet| of every session on a thread of its own and returns
+// the trial, or a nullopt if any of them failed.
+absl::optional<CapacityTrial> RunSessionThreads(
+    const CapacityBenchmarkOptions& options, int num_sessions,
+    int64_t memory_before,
+    const std::function<bool(int session, int packet)>& process_packet) {
+  std::vector<std::vector<int64_t>> latencies(num_sessions);
+  std::vector<char> succeeded(num_sessions, false);
+  const absl::Time start = absl::Now() + kStartDelay;
+  std::vector<std::unique_ptr<csrblocksparse::Thread>> threads;
+  for (int s = 0; s < num_sessions; ++s) {
+    threads.push_back(absl::make_unique<csrblocksparse::Thread>([&, s]() {
+      latencies[s].reserve(options.num_packets_per_trial);
+      succeeded[s] = RunInRealTime(
+          start, options.num_packets_per_trial,
+          [&](int packet) { return process_packet(s, packet); },
+          &latencies[s]);
+    }));
+  }
+  for (auto& thread : threads) {
+    thread->join();
+  }
+  if (std::count(succeeded.begin(), succeeded.end(), false) > 0) {
+    LOG(ERROR) << "A session failed to process a packet.";
+    return absl::nullopt;
+  }
+
+  CapacityTrial trial;
+  trial.num_sessions = num_sessions;
+  const int64_t memory_after = ResidentMemoryBytes();
+  if (memory_before > 0 && memory_after > 0) {
+    trial.memory_bytes_per_session =
+        static_cast<double>(memory_after - memory_before) / num_sessions;
+  }
+  std::vector<int64_t> all_latencies;
+  const int64_t deadline_microsecs =
+      absl::ToInt64Microseconds(PacketDuration());
+  for (const auto& session_latencies : latencies) {
+    for (const int64_t latency : session_latencies) {
+      trial.num_deadline_misses += latency > deadline_microsecs ? 1 : 0;
+    }
+    all_latencies.insert(all_latencies.end(), session_latencies.begin(),
+                         session_latencies.end());
+  }
+  trial.num_packets = all_latencies.size();
+  trial.latency = GetTimingStats(all_latencies, deadline_microsecs);
+  return trial;
+}
+
+// The input of every session: which packets arrive, starting where.
+struct SessionInput {
+  std::unique_ptr<GilbertModel> loss;
+  int first_packet;
+};
+
+absl::optional<std::vector<SessionInput>> CreateSessionInputs(
+    const CapacityBenchmarkOptions& options, int num_sessions) {
+  std::vector<SessionInput> inputs(num_sessions);
+  for (int s = 0; s < num_sessions; ++s) {
+    inputs[s].loss = GilbertModel::Create(options.packet_loss_rate,
+                                          options.average_burst_length);
+    if (inputs[s].loss == nullptr) {
+      LOG(ERROR) << "Could not create the packet loss model.";
+      return absl::nullopt;
+    }
+    inputs[s].first_packet = (s * 37) % kNumInputPackets;
+  }
+  return inputs;
+}
+
+absl::optional<CapacityTrial> RunThreadPerSessionTrial(
+    const CapacityBenchmarkOptions& options,
+    const std::vector<std::vector<uint8_t>>& packets,
+    const std::vector<int16_t>& encoder_input, int num_sessions) {
+  const int64_t memory_before = ResidentMemoryBytes();
+  const ghc::filesystem::path model_path =
+      GetCompleteArchitecturePath(options.model_base_path);
+  auto inputs = CreateSessionInputs(options, num_sessions);
+  if (!inputs.has_value()) {
+    return absl::nullopt;
+  }
+  std::vector<std::unique_ptr<LyraDecoder>> decoders;
+  std::vector<std::unique_ptr<LyraEncoder>> encoders;
+  for (int s = 0; s < num_sessions; ++s) {
+    decoders.push_back(LyraDecoder::Create(options.sample_rate_hz,
+                                           kNumChannels, kBitrate, model_path,
+                                           /*num_threads=*/1,
+                                           options.precision));
+    if (decoders.back() == nullptr) {
+      LOG(ERROR) << "Could not create decoder " << s << ".";
+      return absl::nullopt;
+    }
+    if (options.encode) {
+      encoders.push_back(LyraEncoder::Create(options.sample_rate_hz,
+                                             kNumChannels, kBitrate,
+                                             /*enable_dtx=*/true, model_path));
+      if (encoders.back() == nullptr) {
+        LOG(ERROR) << "Could not create encoder " << s << ".";
+        return absl::nullopt;
+      }
+    }
+  }
+
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(options.sample_rate_hz);
+  return RunSessionThreads(
+      options, num_sessions, memory_before, [&](int s, int p) {
+        const int packet = (inputs->at(s).first_packet + p) % packets.size();
+        LyraDecoder* decoder = decoders[s].get();
+        const bool decoded =
+            inputs->at(s).loss->IsPacketReceived()
+                ? decoder->SetEncodedPacket(packets[packet]) &&
+                      decoder->DecodeSamples(num_samples_per_packet)
+                          .has_value()
+                : decoder->DecodePacketLoss(num_samples_per_packet)
+                      .has_value();
+        if (!decoded || !options.encode) {
+          return decoded;
+        }
+        return encoders[s]
+            ->Encode(absl::MakeConstSpan(encoder_input)
+                         .subspan(packet * num_samples_per_packet,
+                                  num_samples_per_packet))
+            .has_value();
+      });
+}
+
+absl::optional<CapacityTrial> RunSharedModelTrial(
+    const CapacityBenchmarkOptions& options,
+    const std::shared_ptr<LyraModel>& model, int num_cores,
+    const std::vector<std::vector<uint8_t>>& packets,
+    const std::vector<int16_t>& encoder_input, int num_sessions) {
+  const int64_t memory_before = ResidentMemoryBytes();
+  auto inputs = CreateSessionInputs(options, num_sessions);
+  if (!inputs.has_value()) {
+    return absl::nullopt;
+  }
+  auto executor = CodecExecutor::Create(num_cores, /*pin_threads=*/true);
+  if (executor == nullptr) {
+    return absl::nullopt;
+  }
+  std::vector<CodecExecutor::SessionId> decoder_sessions;
+  std::vector<CodecExecutor::SessionId> encoder_sessions;
+  for (int s = 0; s < num_sessions; ++s) {
+    auto decoder_session = executor->AddDecoderSession(
+        LyraDecoder::Create(options.sample_rate_hz, kNumChannels, kBitrate,
+                            model, /*num_threads=*/1, options.precision),
+        kNumFramesPerPacket);
+    if (!decoder_session.has_value()) {
+      LOG(ERROR) << "Could not create decoder " << s << ".";
+      return absl::nullopt;
+    }
+    decoder_sessions.push_back(decoder_session.value());
+    if (options.encode) {
+      auto encoder_session = executor->AddEncoderSession(
+          LyraEncoder::Create(options.sample_rate_hz, kNumChannels, kBitrate,
+                              /*enable_dtx=*/true, model));
+      if (!encoder_session.has_value()) {
+        LOG(ERROR) << "Could not create encoder " << s << ".";
+        return absl::nullopt;
+      }
+      encoder_sessions.push_back(encoder_session.value());
+    }
+  }
+
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(options.sample_rate_hz);
+  return RunSessionThreads(
+      options, num_sessions, memory_before, [&](int s, int p) {
+        const int packet = (inputs->at(s).first_packet + p) % packets.size();
+        auto decoded =
+            inputs->at(s).loss->IsPacketReceived()
+                ? executor->SubmitPacket(decoder_sessions[s], packets[packet])
+                : executor->SubmitPacketLoss(decoder_sessions[s]);
+        if (!options.encode) {
+          return decoded.get().has_value();
+        }
+        auto encoded = executor->SubmitAudio(
+            encoder_sessions[s],
+            std::vector<int16_t>(
+                encoder_input.begin() + packet * num_samples_per_packet,
+                encoder_input.begin() + (packet + 1) * num_samples_per_packet));
+        return decoded.get().has_value() && encoded.get().has_value();
+      });
+}
+
+template <typename ComputeType>
+absl::optional<CapacityTrial> RunBatchedTrial(
+    const CapacityBenchmarkOptions& options,
+    const std::shared_ptr<LyraModel>& model, int num_cores, int num_sessions) {
+  using BatchedWavegruType = BatchedLyraWavegru<ComputeType>;
+  using BatchedConditioningType =
+      typename BatchedWavegruType::BatchedConditioningType;
+  const int64_t memory_before = ResidentMemoryBytes();
+  const ghc::filesystem::path model_path =
+      GetCompleteArchitecturePath(options.model_base_path);
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  const int num_batches = std::min(num_cores, num_sessions);
+
+  // Sessions are dealt to the batches in turn.
+  struct Batch {
+    std::unique_ptr<BatchedWavegruType> wavegru;
+    std::unique_ptr<BatchedConditioningType> conditioning;
+  };
+  std::vector<Batch> batches(num_batches);
+  for (int b = 0; b < num_batches; ++b) {
+    const int batch_size =
+        num_sessions / num_batches + (b < num_sessions % num_batches ? 1 : 0);
+    batches[b].wavegru =
+        BatchedWavegruType::Create(batch_size, model_path, kModelPrefix);
+    if (batches[b].wavegru == nullptr) {
+      LOG(ERROR) << "Could not create batch " << b << ".";
+      return absl::nullopt;
+    }
+    batches[b].conditioning = BatchedConditioningType::Create(
+        batch_size, kNumFeatures, kNumCondHiddens,
+        batches[b].wavegru->num_gru_hiddens(), num_samples_per_hop,
+        kNumFramesPerPacket, model_path.string(), kModelPrefix, model.get());
+    if (batches[b].conditioning == nullptr) {
+      LOG(ERROR) << "Could not create the conditioning of batch " << b << ".";
+      return absl::nullopt;
+    }
+  }
+
+  // Every batch runs on a thread of its own and reports the latency of the
+  // whole batch for each of its sessions.
+  const int num_samples = kNumFramesPerPacket * num_samples_per_hop;
+  std::vector<std::vector<int64_t>> batch_latencies(num_batches);
+  const absl::Time start = absl::Now() + kStartDelay;
+  std::vector<std::unique_ptr<csrblocksparse::Thread>> threads;
+  for (int b = 0; b < num_batches; ++b) {
+    threads.push_back(absl::make_unique<csrblocksparse::Thread>([&, b]() {
+      Batch& batch = batches[b];
+      const int batch_size = batch.conditioning->num_streams();
+      const std::vector<int> conditioning_starts(batch_size, 0);
+      std::vector<std::vector<std::vector<int16_t>>> split_band_samples(
+          batch_size, std::vector<std::vector<int16_t>>(
+                          batch.wavegru->num_split_bands()));
+      csrblocksparse::FatCacheAlignedVector<float> features(
+          kNumFeatures, kNumFramesPerPacket);
+      features.FillRandom(/*min=*/-1.f, /*max=*/1.f);
+      // All sessions of the batch are due in every tick, and their frames go
+      // through each conditioning layer together.
+      std::vector<int> streams(batch_size);
+      std::iota(streams.begin(), streams.end(), 0);
+      const std::vector<csrblocksparse::VectorView<float>> inputs(
+          batch_size, csrblocksparse::VectorView<float>(features));
+      RunInRealTime(
+          start, options.num_packets_per_trial,
+          [&](int /*packet*/) {
+            batch.conditioning->Precompute(absl::MakeConstSpan(streams),
+                                           absl::MakeConstSpan(inputs));
+            return batch.wavegru->SampleBatch(
+                       *batch.conditioning,
+                       absl::MakeConstSpan(conditioning_starts), num_samples,
+                       &split_band_samples) == num_samples;
+          },
+          &batch_latencies[b]);
+    }));
+  }
+  for (auto& thread : threads) {
+    thread->join();
+  }
+
+  CapacityTrial trial;
+  trial.num_sessions = num_sessions;
+  const int64_t memory_after = ResidentMemoryBytes();
+  if (memory_before > 0 && memory_after > 0) {
+    trial.memory_bytes_per_session =
+        static_cast<double>(memory_after - memory_before) / num_sessions;
+  }
+  const int64_t deadline_microsecs =
+      absl::ToInt64Microseconds(PacketDuration());
+  std::vector<int64_t> all_latencies;
+  for (int b = 0; b < num_batches; ++b) {
+    if (static_cast<int>(batch_latencies[b].size()) !=
+        options.num_packets_per_trial) {
+      LOG(ERROR) << "Batch " << b << " failed to sample.";
+      return absl::nullopt;
+    }
+    for (const int64_t latency : batch_latencies[b]) {
+      for (int s = 0; s < batches[b].conditioning->num_streams(); ++s) {
+        all_latencies.push_back(latency);
+        trial.num_deadline_misses += latency > deadline_microsecs ? 1 : 0;
+      }
+    }
+  }
+  trial.num_packets = all_latencies.size();
+  trial.latency = GetTimingStats(all_latencies, deadline_microsecs);
+  return trial;
+}
+
+}  // namespace
+
+const char* SessionModeName(SessionMode mode) {
+  switch (mode) {
+    case SessionMode::kThreadPerSession:
+      return "thread_per_session";
+    case SessionMode::kSharedModel:
+      return "shared_model";
+    case SessionMode::kBatched:
+      return "batched";
+  }
+  return "unknown";
+}
+
+absl::optional<SessionMode> SessionModeFromName(const std::string& name) {
+  for (const SessionMode mode :
+       {SessionMode::kThreadPerSession, SessionMode::kSharedModel,
+        SessionMode::kBatched}) {
+    if (name == SessionModeName(mode)) {
+      return mode;
+    }
+  }
+  return absl::nullopt;
+}
+
+absl::optional<CapacityResult> RampSessions(
+    const CapacityBenchmarkOptions& options, int num_cores,
+    const CapacityTrialRunner& run_trial) {
+  CapacityResult result;
+  // Runs a trial with |num_sessions| and returns whether it passed, or a
+  // nullopt if it could not run.
+  const auto passes = [&](int num_sessions) -> absl::optional<bool> {
+    auto trial = run_trial(num_sessions);
+    if (!trial.has_value()) {
+      return absl::nullopt;
+    }
+    const bool passed =
+        trial->deadline_miss_rate() <= options.max_deadline_miss_rate;
+    LOG(INFO) << absl::StrFormat(
+        "%d sessions: %s, %.2f%% deadline misses, p50=%dus p99=%dus, "
+        "%.1f MiB per session.",
+        num_sessions, passed ? "pass" : "fail",
+        100.0 * trial->deadline_miss_rate(), trial->latency.p50_microsecs,
+        trial->latency.p99_microsecs,
+        trial->memory_bytes_per_session / (1 << 20));
+    result.trials.push_back(*trial);
+    return passed;
+  };
+
+  int passing = 0;
+  int failing = options.max_sessions + 1;
+  for (int num_sessions = std::max(options.min_sessions, 1);
+       num_sessions <= options.max_sessions;) {
+    const auto passed = passes(num_sessions);
+    if (!passed.has_value()) {
+      return absl::nullopt;
+    }
+    if (!passed.value()) {
+      failing = num_sessions;
+      break;
+    }
+    passing = num_sessions;
+    if (num_sessions == options.max_sessions) {
+      break;
+    }
+    num_sessions = std::min(2 * num_sessions, options.max_sessions);
+  }
+  // Only bisect between a passing and a failing number of sessions.
+  while (passing > 0 && failing - passing > 1 &&
+         failing <= options.max_sessions) {
+    const int num_sessions = passing + (failing - passing) / 2;
+    const auto passed = passes(num_sessions);
+    if (!passed.has_value()) {
+      return absl::nullopt;
+    }
+    (passed.value() ? passing : failing) = num_sessions;
+  }
+  result.max_sessions = passing;
+  result.sessions_per_core = static_cast<double>(passing) / num_cores;
+  return result;
+}
+
+std::string FormatCapacityJson(const CapacityBenchmarkOptions& options,
+                               const HostInfo& host,
+                               const CapacityResult& result) {
+  std::string json = absl::StrFormat(
+      "{\n"
+      "  \"host\": %s,\n"
+      "  \"config\": {\"mode\": \"%s\", \"compute_type\": \"%s\", "
+      "\"num_cores\": %d, \"sample_rate_hz\": %d, \"encode\": %s, "
+      "\"packet_loss_rate\": %.3f, \"average_burst_length\": %.3f, "
+      "\"num_packets_per_trial\": %d, \"max_deadline_miss_rate\": %.4f},\n"
+      "  \"max_sessions\": %d,\n"
+      "  \"sessions_per_core\": %.3f,\n"
+      "  \"trials\": [",
+      FormatHostInfoJson(host), SessionModeName(options.mode),
+      ComputePrecisionName(options.precision), options.num_cores,
+      options.sample_rate_hz, options.encode ? "true" : "false",
+      options.packet_loss_rate, options.average_burst_length,
+      options.num_packets_per_trial, options.max_deadline_miss_rate,
+      result.max_sessions, result.sessions_per_core);
+  for (int i = 0; i < static_cast<int>(result.trials.size()); ++i) {
+    const CapacityTrial& trial = result.trials[i];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"num_sessions\": %d, \"deadline_miss_rate\": %.6f, "
+        "\"memory_bytes_per_session\": %.0f, \"latency\": %s}",
+        i == 0 ? "" : ",", trial.num_sessions, trial.deadline_miss_rate(),
+        trial.memory_bytes_per_session, FormatTimingStatsJson(trial.latency));
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+int benchmark_capacity(const CapacityBenchmarkOptions& options,
+                       const std::string& json_path) {
+  if (options.num_packets_per_trial <= 0 || options.min_sessions <= 0 ||
+      options.max_sessions < options.min_sessions) {
+    LOG(ERROR) << "The number of packets and sessions have to be positive, "
+               << "and the maximum number of sessions at least the minimum.";
+    return -1;
+  }
+  if (options.encode && options.mode == SessionMode::kBatched) {
+    LOG(ERROR) << "The batched mode only decodes.";
+    return -1;
+  }
+  CapacityBenchmarkOptions resolved = options;
+  if (resolved.num_cores <= 0) {
+    resolved.num_cores =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  // Threads per session are scheduled on every core of the host.
+  const int num_cores =
+      resolved.mode == SessionMode::kThreadPerSession
+          ? std::max(1, static_cast<int>(std::thread::hardware_concurrency()))
+          : resolved.num_cores;
+
+  const std::shared_ptr<LyraModel> model =
+      LyraModel::Create(GetCompleteArchitecturePath(options.model_base_path));
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not load the model.";
+    return -1;
+  }
+  const auto packets = EncodeInputPackets(model);
+  if (!packets.has_value()) {
+    return -1;
+  }
+  const int num_input_samples = kNumInputPackets * kNumFramesPerPacket *
+                                GetNumSamplesPerHop(resolved.sample_rate_hz);
+  const std::vector<int16_t> encoder_input =
+      GenerateSyntheticSpeech(resolved.sample_rate_hz, num_input_samples);
+
+  CapacityTrialRunner run_trial;
+  switch (resolved.mode) {
+    case SessionMode::kThreadPerSession:
+      run_trial = [&](int num_sessions) {
+        return RunThreadPerSessionTrial(resolved, *packets, encoder_input,
+                                        num_sessions);
+      };
+      break;
+    case SessionMode::kSharedModel:
+      run_trial = [&](int num_sessions) {
+        return RunSharedModelTrial(resolved, model, num_cores, *packets,
+                                   encoder_input, num_sessions);
+      };
+      break;
+    case SessionMode::kBatched:
+      run_trial = [&](int num_sessions) -> absl::optional<CapacityTrial> {
+        switch (resolved.precision) {
+          case ComputePrecision::kFloat:
+            return RunBatchedTrial<float>(resolved, model, num_cores,
+                                          num_sessions);
+          case ComputePrecision::kFixed16:
+            return RunBatchedTrial<csrblocksparse::fixed16_type>(
+                resolved, model, num_cores, num_sessions);
+          case ComputePrecision::kBfloat16:
+            return RunBatchedTrial<csrblocksparse::bfloat16>(
+                resolved, model, num_cores, num_sessions);
+        }
+        return absl::nullopt;
+      };
+      break;
+  }
+
+  LOG(INFO) << "Ramping " << SessionModeName(resolved.mode) << " sessions on "
+            << num_cores << " core(s).";
+  const auto result = RampSessions(resolved, num_cores, run_trial);
+  if (!result.has_value()) {
+    return -1;
+  }
+  LOG(INFO) << absl::StrFormat(
+      "%d sessions run in real time, %.2f per core.", result->max_sessions,
+      result->sessions_per_core);
+
+  if (json_path.empty()) {
+    return 0;
+  }
+  std::ofstream json(json_path);
+  json << FormatCapacityJson(resolved, GetHostInfo(), *result);
+  if (!json) {
+    LOG(ERROR) << "Could not write " << json_path << ".";
+    return -1;
+  }
+  return 0;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_CAPACITY_BENCHMARK_LIB_H_
+#define LYRA_CODEC_CAPACITY_BENCHMARK_LIB_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+
+namespace chromemedia {
+namespace codec {
+
+// How the sessions of a capacity benchmark share the host.
+enum class SessionMode {
+  // Every session loads its own weights and runs on a thread of its own.
+  kThreadPerSession,
+  // All sessions share one copy of the weights and run on a |CodecExecutor|
+  // with one worker per core.
+  kSharedModel,
+  // The sessions are split over one |BatchedLyraWavegru| and one
+  // |BatchedCausalConvolutionalConditioning| per core, which sample and
+  // condition all sessions of a core in one pass over the weights. This only
+  // runs the conditioning and the sampling loop, without packet parsing,
+  // concealment or comfort noise, which the batched model does not have.
+  kBatched,
+};
+
+const char* SessionModeName(SessionMode mode);
+
+// Inverse of |SessionModeName|. Returns a nullopt for unknown names.
+absl::optional<SessionMode> SessionModeFromName(const std::string& name);
+
+struct CapacityBenchmarkOptions {
+  std::string model_base_path;
+  SessionMode mode = SessionMode::kSharedModel;
+  // Cores the sessions run on in the shared and batched modes. Threads per
+  // session run on every core of the host. Defaults to all cores if not
+  // positive.
+  int num_cores = 0;
+  ComputePrecision precision = kDefaultComputePrecision;
+  int sample_rate_hz = 16000;
+  // Whether every session also encodes a packet per packet it decodes, as a
+  // two-way call does. Not supported in the batched mode.
+  bool encode = false;
+  // Packet loss of every session, simulated with a |GilbertModel|.
+  float packet_loss_rate = 0.05f;
+  float average_burst_length = 2.0f;
+  // Number of packets every session decodes in real time in one trial.
+  int num_packets_per_trial = 250;
+  // A trial passes if at most this fraction of the packets of all sessions
+  // finish after their deadline, the arrival of the next packet.
+  double max_deadline_miss_rate = 0.01;
+  // The number of sessions of the first trial and the limit of the ramp.
+  int min_sessions = 1;
+  int max_sessions = 1024;
+};
+
+// Outcome of running a number of sessions in real time.
+struct CapacityTrial {
+  int num_sessions = 0;
+  int64_t num_packets = 0;
+  int64_t num_deadline_misses = 0;
+  // Latency of every packet from its arrival until it was decoded.
+  TimingStats latency = {};
+  // Increase of the resident memory per session, or 0 where it cannot be
+  // measured.
+  double memory_bytes_per_session = 0.0;
+
+  double deadline_miss_rate() const {
+    return num_packets > 0
+               ? static_cast<double>(num_deadline_misses) / num_packets
+               : 1.0;
+  }
+};
+
+struct CapacityResult {
+  // The most sessions that passed, or 0 if even |min_sessions| failed.
+  int max_sessions = 0;
+  double sessions_per_core = 0.0;
+  // The stats of the ramp, in the order the trials ran.
+  std::vector<CapacityTrial> trials;
+};
+
+// Runs a trial with the given number of sessions. Returns a nullopt if the
+// sessions could not be set up.
+using CapacityTrialRunner =
+    std::function<absl::optional<CapacityTrial>(int num_sessions)>;
+
+// Doubles the number of sessions from |options.min_sessions| until a trial
+// misses too many deadlines or |options.max_sessions| is reached, then
+// bisects between the last passing and the first failing number. Returns a
+// nullopt if a trial could not run.
+absl::optional<CapacityResult> RampSessions(
+    const CapacityBenchmarkOptions& options, int num_cores,
+    const CapacityTrialRunner& run_trial);
+
+// Returns |result| of a benchmark with |options| on |host| as a JSON object.
+std::string FormatCapacityJson(const CapacityBenchmarkOptions& options,
+                               const HostInfo& host,
+                               const CapacityResult& result);
+
+// Finds how many sessions of decoders fed with a mix of received, lost and
+// DTX packets run in real time in |options.mode| and logs every trial and the
+// sessions per core. Writes the result as JSON to |json_path| unless it is
+// empty. Returns 0 on success.
+int benchmark_capacity(const CapacityBenchmarkOptions& options,
+                       const std::string& json_path);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_CAPACITY_BENCHMARK_LIB_H_
@@ -0,0 +1,154 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "capacity_benchmark_lib.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "benchmark_decode_lib.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::ElementsAre;
+using testing::HasSubstr;
+
+// Returns a runner whose trials miss no deadlines up to |capacity| sessions
+// and every deadline beyond, and records the number of sessions of each.
+CapacityTrialRunner RunnerWithCapacity(int capacity,
+                                       std::vector<int>* num_sessions_run) {
+  return [=](int num_sessions) -> absl::optional<CapacityTrial> {
+    num_sessions_run->push_back(num_sessions);
+    CapacityTrial trial;
+    trial.num_sessions = num_sessions;
+    trial.num_packets = 100 * num_sessions;
+    trial.num_deadline_misses = num_sessions <= capacity ? 0 : 100;
+    return trial;
+  };
+}
+
+TEST(RampSessionsTest, DoublesThenBisects) {
+  CapacityBenchmarkOptions options;
+  std::vector<int> num_sessions_run;
+
+  const auto result =
+      RampSessions(options, /*num_cores=*/2,
+                   RunnerWithCapacity(13, &num_sessions_run));
+
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->max_sessions, 13);
+  EXPECT_DOUBLE_EQ(result->sessions_per_core, 6.5);
+  EXPECT_THAT(num_sessions_run, ElementsAre(1, 2, 4, 8, 16, 12, 14, 13));
+  EXPECT_EQ(result->trials.size(), num_sessions_run.size());
+}
+
+TEST(RampSessionsTest, StopsAtMaxSessions) {
+  CapacityBenchmarkOptions options;
+  options.max_sessions = 6;
+  std::vector<int> num_sessions_run;
+
+  const auto result =
+      RampSessions(options, /*num_cores=*/1,
+                   RunnerWithCapacity(100, &num_sessions_run));
+
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->max_sessions, 6);
+  EXPECT_THAT(num_sessions_run, ElementsAre(1, 2, 4, 6));
+}
+
+TEST(RampSessionsTest, NoSessionsIfTheFirstTrialFails) {
+  CapacityBenchmarkOptions options;
+  options.min_sessions = 4;
+  std::vector<int> num_sessions_run;
+
+  const auto result =
+      RampSessions(options, /*num_cores=*/1,
+                   RunnerWithCapacity(2, &num_sessions_run));
+
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->max_sessions, 0);
+  EXPECT_THAT(num_sessions_run, ElementsAre(4));
+}
+
+TEST(RampSessionsTest, AllowsMissesUpToTheThreshold) {
+  CapacityBenchmarkOptions options;
+  options.max_sessions = 1;
+  options.max_deadline_miss_rate = 0.01;
+
+  const auto result =
+      RampSessions(options, /*num_cores=*/1, [](int num_sessions) {
+        CapacityTrial trial;
+        trial.num_sessions = num_sessions;
+        trial.num_packets = 1000;
+        trial.num_deadline_misses = 10;
+        return absl::optional<CapacityTrial>(trial);
+      });
+
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->max_sessions, 1);
+}
+
+TEST(RampSessionsTest, FailsIfATrialCannotRun) {
+  CapacityBenchmarkOptions options;
+
+  EXPECT_FALSE(RampSessions(options, /*num_cores=*/1, [](int) {
+                 return absl::optional<CapacityTrial>();
+               }).has_value());
+}
+
+TEST(SessionModeTest, NamesRoundTrip) {
+  for (const SessionMode mode :
+       {SessionMode::kThreadPerSession, SessionMode::kSharedModel,
+        SessionMode::kBatched}) {
+    EXPECT_EQ(SessionModeFromName(SessionModeName(mode)), mode);
+  }
+  EXPECT_FALSE(SessionModeFromName("unknown").has_value());
+}
+
+TEST(FormatCapacityJsonTest, ContainsResultAndTrials) {
+  CapacityBenchmarkOptions options;
+  options.mode = SessionMode::kBatched;
+  options.num_cores = 4;
+  HostInfo host;
+  host.cpu_model = "cpu";
+  host.cpu_isa = "generic";
+  host.num_cpus = 4;
+  CapacityResult result;
+  result.max_sessions = 40;
+  result.sessions_per_core = 10.0;
+  CapacityTrial trial;
+  trial.num_sessions = 40;
+  trial.num_packets = 1000;
+  trial.num_deadline_misses = 5;
+  trial.latency = GetTimingStats({1000, 2000});
+  result.trials = {trial};
+
+  const std::string json = FormatCapacityJson(options, host, result);
+
+  EXPECT_THAT(json, HasSubstr("\"mode\": \"batched\""));
+  EXPECT_THAT(json, HasSubstr("\"num_cores\": 4"));
+  EXPECT_THAT(json, HasSubstr("\"max_sessions\": 40"));
+  EXPECT_THAT(json, HasSubstr("\"sessions_per_core\": 10.000"));
+  EXPECT_THAT(json, HasSubstr("{\"num_sessions\": 40, "
+                              "\"deadline_miss_rate\": 0.005000"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -17,21 +17,37 @@
 #ifndef LYRA_CODEC_CAUSAL_CONVOLUTIONAL_CONDITIONING_H_
 #define LYRA_CODEC_CAUSAL_CONVOLUTIONAL_CONDITIONING_H_
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
+#include <variant>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/str_format.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "dsp_util.h"
 #include "glog/logging.h"
 #include "layer_wrappers_lib.h"
+#include "lyra_model.h"
 #include "lyra_types.h"
+#include "model_unpacker.h"
+#include "parallel_load.h"
+#include "projection_folder.h"
 #include "sparse_inference_matrixvector.h"
+#include "state_buffer.h"
+#include "thread_pool.h"
 
 namespace chromemedia {
 namespace codec {
 
+template <typename Types>
+class BatchedCausalConvolutionalConditioning;
+
 // Computes conditioning using a convolutional network.
 template <typename Types>
 class CausalConvolutionalConditioning {
@@ -58,31 +74,45 @@ class CausalConvolutionalConditioning {
   using ConvToGatesRhsType = typename Types::ConvToGatesRhsType;
   using ConvToGatesOutType = typename Types::ConvToGatesOutType;
 
-  using Conv1DLayerType = LayerWrapper<Conv1DWeightType, Conv1DRhsType,
-                                       CondStack0RhsType, DiskWeightType>;
+  // The layers are held by their final types, so that the calls made for
+  // every frame are resolved statically and can be inlined.
+  using Conv1DLayerType = Conv1DLayerWrapper<Conv1DWeightType, Conv1DRhsType,
+                                             CondStack0RhsType, DiskWeightType>;
   using CondStack0LayerType =
-      LayerWrapper<CondStack0WeightType, CondStack0RhsType, CondStack1RhsType,
-                   DiskWeightType>;
+      DilatedConvolutionalLayerWrapper<CondStack0WeightType, CondStack0RhsType,
+                                       CondStack1RhsType, DiskWeightType>;
   using CondStack1LayerType =
-      LayerWrapper<CondStack1WeightType, CondStack1RhsType, CondStack2RhsType,
-                   DiskWeightType>;
+      DilatedConvolutionalLayerWrapper<CondStack1WeightType, CondStack1RhsType,
+                                       CondStack2RhsType, DiskWeightType>;
   using CondStack2LayerType =
-      LayerWrapper<CondStack2WeightType, CondStack2RhsType, Transpose0RhsType,
-                   DiskWeightType>;
+      DilatedConvolutionalLayerWrapper<CondStack2WeightType, CondStack2RhsType,
+                                       Transpose0RhsType, DiskWeightType>;
   using Transpose0LayerType =
-      LayerWrapper<Transpose0WeightType, Transpose0RhsType, Transpose1RhsType,
-                   DiskWeightType>;
+      TransposeConvolutionalLayerWrapper<Transpose0WeightType,
+                                         Transpose0RhsType, Transpose1RhsType,
+                                         DiskWeightType>;
   using Transpose1LayerType =
-      LayerWrapper<Transpose1WeightType, Transpose1RhsType, Transpose2RhsType,
-                   DiskWeightType>;
+      TransposeConvolutionalLayerWrapper<Transpose1WeightType,
+                                         Transpose1RhsType, Transpose2RhsType,
+                                         DiskWeightType>;
   using Transpose2LayerType =
-      LayerWrapper<Transpose2WeightType, Transpose2RhsType, ConvCondRhsType,
-                   DiskWeightType>;
-  using ConvCondLayerType = LayerWrapper<ConvCondWeightType, ConvCondRhsType,
-                                         ConvCondOutputType, DiskWeightType>;
+      TransposeConvolutionalLayerWrapper<Transpose2WeightType,
+                                         Transpose2RhsType, ConvCondRhsType,
+                                         DiskWeightType>;
+  using ConvCondLayerType =
+      Conv1DLayerWrapper<ConvCondWeightType, ConvCondRhsType,
+                         ConvCondOutputType, DiskWeightType>;
   using ConvToGatesLayerType =
-      LayerWrapper<ConvToGatesWeightType, ConvToGatesRhsType,
-                   ConvToGatesOutType, DiskWeightType>;
+      Conv1DLayerWrapper<ConvToGatesWeightType, ConvToGatesRhsType,
+                         ConvToGatesOutType, DiskWeightType>;
+  // Replaces |ConvCondLayerType| and |ConvToGatesLayerType| if the model was
+  // folded with FoldProjectionLayers().
+  using FoldedProjectionOutType =
+      typename csrblocksparse::TypeOfProduct<ConvToGatesWeightType,
+                                             ConvCondRhsType>::type;
+  using FoldedProjectionLayerType =
+      Conv1DLayerWrapper<ConvToGatesWeightType, ConvCondRhsType,
+                         FoldedProjectionOutType, DiskWeightType>;
 
   using InputType = typename Types::Conv1DRhsType;
   using OutputType = typename Types::OutputType;
@@ -93,12 +123,256 @@ class CausalConvolutionalConditioning {
   // needed because the last layers are actually mapping the output of the
   // conditioning stack into the RNN space.
   // |num_samples_per_hop| must be greater than 0.
+  // If |model| is not null, the layer weights are shared with every other
+  // conditioning stack created through it.
+  // If |path| holds a folded projection layer for |prefix| it is run in place
+  // of the conv_cond and conv_to_gates layers.
+  // If |thread_pool| is not null the stack runs on its threads, otherwise
+  // |num_threads| - 1 threads are started for every frame. It must have at
+  // least |num_threads| threads and outlive this object.
   CausalConvolutionalConditioning(int feature_depth, int num_cond_hiddens,
                                   int num_hiddens, int num_samples_per_hop,
                                   int num_frames_per_packet, int num_threads,
                                   const std::string& path,
-                                  const std::string& prefix)
+                                  const std::string& prefix,
+                                  LyraModel* model = nullptr,
+                                  ThreadPool* thread_pool = nullptr)
+      : CausalConvolutionalConditioning(
+            feature_depth, num_cond_hiddens, num_hiddens, num_samples_per_hop,
+            num_frames_per_packet, num_threads, path, prefix, absl::nullopt,
+            model, thread_pool) {}
+
+  // Same as above, but all layers are filled with |weights| instead of being
+  // loaded, e.g. to measure the cost of a stack of a size and sparsity that
+  // was not trained.
+  CausalConvolutionalConditioning(int feature_depth, int num_cond_hiddens,
+                                  int num_hiddens, int num_samples_per_hop,
+                                  int num_frames_per_packet, int num_threads,
+                                  const LayerParams::FromConstant& weights,
+                                  ThreadPool* thread_pool = nullptr)
+      : CausalConvolutionalConditioning(
+            feature_depth, num_cond_hiddens, num_hiddens, num_samples_per_hop,
+            num_frames_per_packet, num_threads, /*path=*/"", /*prefix=*/"",
+            weights, /*model=*/nullptr, thread_pool) {}
+
+  ~CausalConvolutionalConditioning() {}
+
+  // Return the conditioning vector corresponding to |step| in sample domain.
+  absl::Span<OutputType> AtStep(int step) {
+    const int samples_per_cond_output =
+        num_samples_per_hop_ / kCondUpsamplingRatio;
+    const int conditioning_column =
+        num_stretch_columns_[current_output_] == 0
+            ? (step % (num_frames_per_packet_ * num_samples_per_hop_)) /
+                  samples_per_cond_output
+            : SourceColumn(step / samples_per_cond_output);
+    const int num_output_elements = 3 * num_hiddens_;
+    return absl::Span<OutputType>(
+        conditioning_[current_output_].data() +
+            conditioning_column * num_output_elements,
+        num_output_elements);
+  }
+
+  // Runs the stack on every column of |input|, one frame each, and appends
+  // the results to the conditioning. All frames go through the stack in one
+  // dispatch to the threads.
+  void Precompute(csrblocksparse::VectorView<float> input, int num_threads) {
+    CHECK(!has_next_output_)
+        << "Precompute() cannot follow PrecomputeNext() before SwapOutputs().";
+    num_stretch_columns_[current_output_] = 0;
+    Compute(input, current_output_);
+  }
+
+  void Precompute(const csrblocksparse::FatCacheAlignedVector<float>& input,
+                  int num_threads) {
+    Precompute(csrblocksparse::VectorView<float>(input), num_threads);
+  }
+
+  // Like |Precompute|, but writes into a second output buffer that |AtStep|
+  // and |num_samples| only read after |SwapOutputs|. It may thus run on
+  // another thread while samples are generated from the current output.
+  // Several frames may be precomputed before swapping, they shift in as with
+  // |Precompute|.
+  void PrecomputeNext(csrblocksparse::VectorView<float> input,
+                      int num_threads) {
+    const int next_output = 1 - current_output_;
+    if (!has_next_output_) {
+      std::copy(conditioning_[current_output_].data(),
+                conditioning_[current_output_].data() +
+                    conditioning_[current_output_].size(),
+                conditioning_[next_output].data());
+      num_precomputed_frames_[next_output] =
+          num_precomputed_frames_[current_output_];
+      num_stretch_columns_[next_output] = 0;
+      has_next_output_ = true;
+    }
+    Compute(input, next_output);
+  }
+
+  void PrecomputeNext(const csrblocksparse::FatCacheAlignedVector<float>& input,
+                      int num_threads) {
+    PrecomputeNext(csrblocksparse::VectorView<float>(input), num_threads);
+  }
+
+  // Renders the current output into |num_columns| more columns of
+  // |num_samples_per_hop| / |kCondUpsamplingRatio| steps each, or fewer if it
+  // is negative, by repeating or skipping columns evenly spread over it, so
+  // that its frames play out slower or faster. This holds until the next
+  // |Precompute| or |SwapOutputs|. Returns false, leaving the output as it
+  // was, if |PrecomputeNext| wrote into the other buffer since the last swap,
+  // nothing was precomputed or no column would be left. Must not run
+  // concurrently with any other method.
+  bool StretchCurrentOutput(int num_columns) {
+    const int num_source_columns =
+        num_precomputed_frames_[current_output_] * kCondUpsamplingRatio;
+    if (has_next_output_ || num_source_columns == 0 ||
+        num_source_columns + num_columns < 1) {
+      return false;
+    }
+    num_stretch_columns_[current_output_] = num_columns;
+    return true;
+  }
+
+  // Makes the output of the preceding |PrecomputeNext| calls current. Must not
+  // run concurrently with any other method.
+  void SwapOutputs() {
+    CHECK(has_next_output_) << "Nothing was precomputed with PrecomputeNext().";
+    current_output_ = 1 - current_output_;
+    has_next_output_ = false;
+  }
+
+  // Forgets all frames run through the stack, as if it was just created. Must
+  // not run concurrently with any other method.
+  void ClearState() {
+    conv1d_layer_->ClearState();
+    dilated_conv_layer_0_->ClearState();
+    dilated_conv_layer_1_->ClearState();
+    dilated_conv_layer_2_->ClearState();
+    transpose_conv_layer_0_->ClearState();
+    transpose_conv_layer_1_->ClearState();
+    transpose_conv_layer_2_->ClearState();
+    if (folded_projection_) {
+      folded_projection_layer_->ClearState();
+    } else {
+      conv_cond_layer_->ClearState();
+      conv_to_gates_layer_->ClearState();
+    }
+    for (auto& conditioning : conditioning_) {
+      conditioning.FillZero();
+    }
+    num_precomputed_frames_ = {0, 0};
+    num_stretch_columns_ = {0, 0};
+    current_output_ = 0;
+    has_next_output_ = false;
+    num_repeated_inputs_ = 0;
+  }
+
+  // Appends the inputs of all layers and the current conditioning from the
+  // step |first_step| on, which is the first one still to be read by |AtStep|,
+  // to |writer|. Returns false if an output precomputed with |PrecomputeNext|
+  // was not swapped in yet, which is left out of snapshots. Must not run
+  // concurrently with any other method.
+  bool SaveState(int first_step, StateWriter* writer) const {
+    if (has_next_output_) {
+      return false;
+    }
+    conv1d_layer_->SaveState(writer);
+    dilated_conv_layer_0_->SaveState(writer);
+    dilated_conv_layer_1_->SaveState(writer);
+    dilated_conv_layer_2_->SaveState(writer);
+    transpose_conv_layer_0_->SaveState(writer);
+    transpose_conv_layer_1_->SaveState(writer);
+    transpose_conv_layer_2_->SaveState(writer);
+    if (folded_projection_) {
+      folded_projection_layer_->SaveState(writer);
+    } else {
+      conv_cond_layer_->SaveState(writer);
+      conv_to_gates_layer_->SaveState(writer);
+    }
+    // Most of the conditioning of a packet is read by the time a snapshot is
+    // taken, and none of it once the packet is fully decoded.
+    const int num_frames = num_precomputed_frames_[current_output_];
+    const int num_stretch_columns = num_stretch_columns_[current_output_];
+    const int first_rendered_column =
+        first_step / (num_samples_per_hop_ / kCondUpsamplingRatio);
+    const int first_column =
+        std::min(num_stretch_columns == 0 ? first_rendered_column
+                                          : SourceColumn(first_rendered_column),
+                 num_frames * kCondUpsamplingRatio);
+    writer->Write(num_frames);
+    writer->Write(num_stretch_columns);
+    writer->Write(first_column);
+    writer->WriteSpan(absl::MakeConstSpan(
+        conditioning_[current_output_].data() +
+            first_column * num_outputs_per_column(),
+        NumUnreadOutputs(num_frames, first_column)));
+    return true;
+  }
+
+  // Restores what |SaveState| of a stack of the same shape wrote. Returns false
+  // if |reader| does not hold it, in which case the state must be cleared
+  // before the stack is used again.
+  bool RestoreState(StateReader* reader) {
+    if (!conv1d_layer_->RestoreState(reader) ||
+        !dilated_conv_layer_0_->RestoreState(reader) ||
+        !dilated_conv_layer_1_->RestoreState(reader) ||
+        !dilated_conv_layer_2_->RestoreState(reader) ||
+        !transpose_conv_layer_0_->RestoreState(reader) ||
+        !transpose_conv_layer_1_->RestoreState(reader) ||
+        !transpose_conv_layer_2_->RestoreState(reader)) {
+      return false;
+    }
+    const bool projection_restored =
+        folded_projection_ ? folded_projection_layer_->RestoreState(reader)
+                           : conv_cond_layer_->RestoreState(reader) &&
+                                 conv_to_gates_layer_->RestoreState(reader);
+    int num_frames, num_stretch_columns, first_column;
+    if (!projection_restored || !reader->Read(&num_frames) ||
+        num_frames < 0 || num_frames > num_frames_per_packet_ ||
+        !reader->Read(&num_stretch_columns) ||
+        (num_stretch_columns != 0 &&
+         (num_frames == 0 ||
+          num_frames * kCondUpsamplingRatio + num_stretch_columns < 1)) ||
+        !reader->Read(&first_column) || first_column < 0 ||
+        first_column > num_frames * kCondUpsamplingRatio ||
+        !reader->ReadSpan(absl::MakeSpan(
+            conditioning_[0].data() + first_column * num_outputs_per_column(),
+            NumUnreadOutputs(num_frames, first_column)))) {
+      return false;
+    }
+    num_precomputed_frames_ = {num_frames, 0};
+    num_stretch_columns_ = {num_stretch_columns, 0};
+    current_output_ = 0;
+    has_next_output_ = false;
+    // The inputs that led to the saved state are not known.
+    num_repeated_inputs_ = 0;
+    return true;
+  }
+
+  int num_samples() const {
+    return num_precomputed_frames_[current_output_] * num_samples_per_hop_ +
+           num_stretch_columns_[current_output_] * num_samples_per_column();
+  }
+
+  // The number of steps of |AtStep| that read the same column.
+  int num_samples_per_column() const {
+    return num_samples_per_hop_ / kCondUpsamplingRatio;
+  }
+
+  // The number of frames whose conditioning was reused instead of computed,
+  // since they repeated an input the whole stack was saturated with.
+  int64_t num_reused_frames() const { return num_reused_frames_; }
+
+ private:
+  // Loads the layers from |path| unless |constant_weights| is set.
+  CausalConvolutionalConditioning(
+      int feature_depth, int num_cond_hiddens, int num_hiddens,
+      int num_samples_per_hop, int num_frames_per_packet, int num_threads,
+      const std::string& path, const std::string& prefix,
+      const absl::optional<LayerParams::FromConstant>& constant_weights,
+      LyraModel* model, ThreadPool* thread_pool)
       : feature_depth_(feature_depth),
+
         num_hiddens_(num_hiddens),
         num_cond_hiddens_(num_cond_hiddens),
         num_samples_per_hop_(num_samples_per_hop),
@@ -106,7 +380,19 @@ class CausalConvolutionalConditioning {
         num_threads_(num_threads),
         path_(path),
         prefix_(prefix),
-        num_precomputed_frames_(0),
+        model_(model),
+        thread_pool_(thread_pool),
+        constant_weights_(constant_weights),
+        zipped_(!constant_weights.has_value() && IsZippedModel(path, prefix)),
+        folded_projection_(!constant_weights.has_value() &&
+                           HasFoldedProjection(path, prefix)),
+        num_precomputed_frames_{0, 0},
+        num_stretch_columns_{0, 0},
+        current_output_(0),
+        has_next_output_(false),
+        last_input_(feature_depth),
+        num_repeated_inputs_(0),
+        num_reused_frames_(0),
         spin_barrier_(num_threads_) {
     // Crash ok.
     CHECK_LE(num_threads_, num_cond_hiddens)
@@ -114,6 +400,9 @@ class CausalConvolutionalConditioning {
            "but were "
         << num_threads_ << " and " << num_cond_hiddens_;
     CHECK_GT(num_threads_, 0) << "Number of threads must be > 0.";
+    CHECK(thread_pool_ == nullptr ||
+          thread_pool_->num_threads() >= num_threads_)
+        << "The thread pool has fewer than " << num_threads_ << " threads.";
     CHECK_GT(num_samples_per_hop_, 0)
         << "Number of samples per hop must be > 0.";
     CHECK_GT(num_frames_per_packet_, 0)
@@ -121,40 +410,9 @@ class CausalConvolutionalConditioning {
 
     CreateLayers();
     PrepareOutput();
+    FuseRowEpilogues();
   }
 
-  ~CausalConvolutionalConditioning() {}
-
-  // Return the conditioning vector corresponding to |step| in sample domain.
-  absl::Span<OutputType> AtStep(int step) {
-    const int samples_per_cond_output =
-        num_samples_per_hop_ / kCondUpsamplingRatio;
-    const int conditioning_column =
-        (step % (num_frames_per_packet_ * num_samples_per_hop_)) /
-        samples_per_cond_output;
-    const int num_output_elements = 3 * num_hiddens_;
-    return absl::Span<OutputType>(
-        conditioning_.data() + conditioning_column * num_output_elements,
-        num_output_elements);
-  }
-
-  void Precompute(const csrblocksparse::FatCacheAlignedVector<float>& input,
-                  int num_threads) {
-    CHECK_EQ(input.cols(), kCondInputNumTimesteps);
-    CHECK_EQ(feature_depth_, input.rows());
-    InsertNewInput(input);
-
-    auto f = [this](csrblocksparse::SpinBarrier* barrier, int tid) {
-      ComputeFunction(barrier, tid);
-    };
-    LaunchOnThreadsWithBarrier(num_threads_, f);
-  }
-
-  int num_samples() const {
-    return num_precomputed_frames_ * num_samples_per_hop_;
-  }
-
- private:
   // TODO(b/161825447): Allow more general layer connections.
   static constexpr int kConv1DKernel = 3;
   static constexpr int kDilatedKernel = 2;
@@ -163,9 +421,15 @@ class CausalConvolutionalConditioning {
 
   // This is the upsampling ratio per transpose layer.
   static constexpr int kTransposeStride = 2;
-  static constexpr int kCondInputNumTimesteps = 1;
   static constexpr int kCondUpsamplingRatio = 8;
 
+  // The number of input frames the output of a frame depends on: itself and
+  // the ones before it in the windows of the conv1d and dilated layers. The
+  // transpose and projection layers have no history.
+  static constexpr int kReceptiveFieldFrames =
+      kConv1DKernel +
+      (kDilatedKernel - 1) * (kDilation[0] + kDilation[1] + kDilation[2]);
+
   static LayerParams Conv1DParams(int feature_depth, int num_cond_hiddens,
                                   int num_threads,
                                   const std::string& model_path,
@@ -288,78 +552,229 @@ class CausalConvolutionalConditioning {
                        .prefix = prefix + "_conv_to_gates_"};
   }
 
+  // The conv_cond and conv_to_gates layers folded into one.
+  static LayerParams FoldedProjectionParams(int num_cond_hiddens,
+                                            int num_hiddens, int num_threads,
+                                            const std::string& model_path,
+                                            const std::string& prefix) {
+    LayerParams params = ConvToGatesParams(num_hiddens, num_threads,
+                                           model_path, prefix);
+    params.num_input_channels = num_cond_hiddens;
+    params.prefix = prefix + "_conv_cond_to_gates_";
+    return params;
+  }
+
+  // Points |params| at |model_|, so that the layer weights are shared if a
+  // model was given, and at the storage format of the files under |path_|,
+  // or at |constant_weights_| if they are set.
+  LayerParams WithModelSettings(LayerParams params) const {
+    if (constant_weights_.has_value()) {
+      params.from = constant_weights_.value();
+      return params;
+    }
+    params.model = model_;
+    std::get<LayerParams::FromDisk>(params.from).zipped = zipped_;
+    return params;
+  }
+
+  // Returns a function that creates |*layer| from |params| and returns
+  // whether that succeeded.
+  template <typename LayerType>
+  static std::function<bool()> LayerLoader(const LayerParams& params,
+                                           std::unique_ptr<LayerType>* layer) {
+    return [params, layer]() {
+      *layer = LayerType::Create(params);
+      return *layer != nullptr;
+    };
+  }
+
   void CreateLayers() {
     // TODO(b/161822329): Put these layers in a container.
-    const LayerParams conv1d_params = Conv1DParams(
-        feature_depth_, num_cond_hiddens_, num_threads_, path_, prefix_);
-    conv1d_layer_ = Conv1DLayerType::Create(conv1d_params);
-    CHECK_NE(conv1d_layer_, nullptr);
-
-    const LayerParams dilated_params_0 =
-        DilatedParams(num_cond_hiddens_, 0, num_threads_, path_, prefix_);
-    dilated_conv_layer_0_ = CondStack0LayerType::Create(dilated_params_0);
-    CHECK_NE(dilated_conv_layer_0_, nullptr);
-
-    const LayerParams dilated_params_1 =
-        DilatedParams(num_cond_hiddens_, 1, num_threads_, path_, prefix_);
-    dilated_conv_layer_1_ = CondStack1LayerType::Create(dilated_params_1);
-    CHECK_NE(dilated_conv_layer_1_, nullptr);
-
-    const LayerParams dilated_params_2 =
-        DilatedParams(num_cond_hiddens_, 2, num_threads_, path_, prefix_);
-    dilated_conv_layer_2_ = CondStack2LayerType::Create(dilated_params_2);
-    CHECK_NE(dilated_conv_layer_2_, nullptr);
-
-    const LayerParams transpose_params_0 =
-        TransposeParams(num_cond_hiddens_, 0, num_threads_, path_, prefix_);
-    transpose_conv_layer_0_ = Transpose0LayerType::Create(transpose_params_0);
-    CHECK_NE(transpose_conv_layer_0_, nullptr);
-
-    const LayerParams transpose_params_1 =
-        TransposeParams(num_cond_hiddens_, 1, num_threads_, path_, prefix_);
-    transpose_conv_layer_1_ = Transpose1LayerType::Create(transpose_params_1);
-    CHECK_NE(transpose_conv_layer_1_, nullptr);
-
-    const LayerParams transpose_params_2 =
-        TransposeParams(num_cond_hiddens_, 2, num_threads_, path_, prefix_);
-    transpose_conv_layer_2_ = Transpose2LayerType::Create(transpose_params_2);
-    CHECK_NE(transpose_conv_layer_2_, nullptr);
-
-    const LayerParams conv_cond_params = ConvCondParams(
-        num_cond_hiddens_, num_hiddens_, num_threads_, path_, prefix_);
-    conv_cond_layer_ = ConvCondLayerType::Create(conv_cond_params);
-    CHECK_NE(conv_cond_layer_, nullptr);
-
-    const LayerParams conv_to_gates_params =
-        ConvToGatesParams(num_hiddens_, num_threads_, path_, prefix_);
-    conv_to_gates_layer_ = ConvToGatesLayerType::Create(conv_to_gates_params);
-    CHECK_NE(conv_to_gates_layer_, nullptr);
+    std::vector<std::function<bool()>> loaders = {
+        LayerLoader(WithModelSettings(Conv1DParams(feature_depth_,
+                                                   num_cond_hiddens_,
+                                                   num_threads_, path_,
+                                                   prefix_)),
+                    &conv1d_layer_),
+        LayerLoader(WithModelSettings(DilatedParams(
+                        num_cond_hiddens_, 0, num_threads_, path_, prefix_)),
+                    &dilated_conv_layer_0_),
+        LayerLoader(WithModelSettings(DilatedParams(
+                        num_cond_hiddens_, 1, num_threads_, path_, prefix_)),
+                    &dilated_conv_layer_1_),
+        LayerLoader(WithModelSettings(DilatedParams(
+                        num_cond_hiddens_, 2, num_threads_, path_, prefix_)),
+                    &dilated_conv_layer_2_),
+        LayerLoader(WithModelSettings(TransposeParams(
+                        num_cond_hiddens_, 0, num_threads_, path_, prefix_)),
+                    &transpose_conv_layer_0_),
+        LayerLoader(WithModelSettings(TransposeParams(
+                        num_cond_hiddens_, 1, num_threads_, path_, prefix_)),
+                    &transpose_conv_layer_1_),
+        LayerLoader(WithModelSettings(TransposeParams(
+                        num_cond_hiddens_, 2, num_threads_, path_, prefix_)),
+                    &transpose_conv_layer_2_),
+    };
+    if (folded_projection_) {
+      loaders.push_back(LayerLoader(
+          WithModelSettings(FoldedProjectionParams(
+              num_cond_hiddens_, num_hiddens_, num_threads_, path_, prefix_)),
+          &folded_projection_layer_));
+    } else {
+      loaders.push_back(LayerLoader(
+          WithModelSettings(ConvCondParams(num_cond_hiddens_, num_hiddens_,
+                                           num_threads_, path_, prefix_)),
+          &conv_cond_layer_));
+      loaders.push_back(LayerLoader(
+          WithModelSettings(
+              ConvToGatesParams(num_hiddens_, num_threads_, path_, prefix_)),
+          &conv_to_gates_layer_));
+    }
+    // The layers are read and decompressed concurrently. Crash ok.
+    CHECK(LoadInParallel(loaders))
+        << "Could not create the conditioning layers of " << prefix_ << " in "
+        << path_ << ".";
+  }
+
+  // Moves the row-wise work between layers into the end of the layer before,
+  // where each thread does it on the rows it just computed, so that it needs
+  // no barrier of its own: the skip connection input and Relu of the dilated
+  // layers and the cast between the projection layers. Where the rows of the
+  // threads are not known the work stays behind a barrier.
+  void FuseRowEpilogues() {
+    FuseInputPreparation(conv1d_layer_.get(), dilated_conv_layer_0_.get());
+    FuseInputPreparation(dilated_conv_layer_0_.get(),
+                         dilated_conv_layer_1_.get());
+    FuseInputPreparation(dilated_conv_layer_1_.get(),
+                         dilated_conv_layer_2_.get());
+    if (!folded_projection_) {
+      // The fixed point casts work on blocks of 8 rows.
+      projection_cast_fused_ = conv_cond_layer_->SetRowEpilogue(
+          num_threads_, /*row_alignment=*/8,
+          [this](int row_start, int row_end) {
+            auto input = conv_to_gates_layer_->InputViewToUpdate();
+            for (int column = 0; column < kCondUpsamplingRatio; ++column) {
+              CastVector(
+                  row_start, row_end,
+                  conv_cond_out_.data() + column * conv_cond_out_.col_stride(),
+                  input.data() + column * input.col_stride());
+            }
+          });
+    }
+  }
+
+  // Lets |layer| prepare the input of |next_layer| in its row epilogue.
+  template <typename LayerType, typename NextLayerType>
+  void FuseInputPreparation(LayerType* layer, NextLayerType* next_layer) {
+    if (!next_layer->PreparesInput()) {
+      return;
+    }
+    next_layer->set_input_prepared_externally(layer->SetRowEpilogue(
+        num_threads_, /*row_alignment=*/1,
+        [next_layer](int row_start, int row_end) {
+          next_layer->PrepareInputRows(row_start, row_end);
+        }));
   }
 
   void PrepareOutput() {
-    conv_cond_out_ = csrblocksparse::FatCacheAlignedVector<ConvCondOutputType>(
-        num_hiddens_, kCondUpsamplingRatio);
-    conv_to_gates_out_ =
-        csrblocksparse::FatCacheAlignedVector<ConvToGatesOutType>(
-            3 * num_hiddens_, kCondUpsamplingRatio);
-    conv_to_gates_out_.FillZero();
-    conditioning_ = csrblocksparse::FatCacheAlignedVector<OutputType>(
-        conv_to_gates_out_.rows(),
-        num_frames_per_packet_ * conv_to_gates_out_.cols());
-    conditioning_.FillZero();
-  }
-
-  void InsertNewInput(
-      const csrblocksparse::FatCacheAlignedVector<float>& input) {
-    // This conversion might not always be necessary, will
-    // optimize to copy if RhsType == InputType.
-    const csrblocksparse::FatCacheAlignedVector<InputType> input_rhs_type(
-        input);
-
-    // Copy the values of |input| to the input buffer of the first layer.
-    std::copy(input_rhs_type.data(),
-              input_rhs_type.data() + input_rhs_type.size(),
-              conv1d_layer_->InputViewToUpdate().data());
+    if (folded_projection_) {
+      folded_projection_out_ =
+          csrblocksparse::FatCacheAlignedVector<FoldedProjectionOutType>(
+              3 * num_hiddens_, kCondUpsamplingRatio);
+      folded_projection_out_.FillZero();
+    } else {
+      conv_cond_out_ =
+          csrblocksparse::FatCacheAlignedVector<ConvCondOutputType>(
+              num_hiddens_, kCondUpsamplingRatio);
+      conv_to_gates_out_ =
+          csrblocksparse::FatCacheAlignedVector<ConvToGatesOutType>(
+              3 * num_hiddens_, kCondUpsamplingRatio);
+      conv_to_gates_out_.FillZero();
+    }
+    for (auto& conditioning : conditioning_) {
+      conditioning = csrblocksparse::FatCacheAlignedVector<OutputType>(
+          3 * num_hiddens_, num_frames_per_packet_ * kCondUpsamplingRatio);
+      conditioning.FillZero();
+    }
+  }
+
+  // Runs the stack on each column of |input| and appends the results to the
+  // output buffer |output|. Columns that repeat the input the stack is
+  // saturated with, as during long concealment, append the previous result
+  // again without running the layers.
+  void Compute(csrblocksparse::VectorView<float> input, int output) {
+    CHECK_GT(input.cols(), 0);
+    CHECK_EQ(feature_depth_, input.rows());
+
+    int frame = 0;
+    while (frame < input.cols()) {
+      // The columns up to the next reused one go to the threads in one
+      // dispatch.
+      const int first_frame = frame;
+      bool reuse_frame = false;
+      for (; frame < input.cols(); ++frame) {
+        reuse_frame =
+            RepeatsSaturatedInput(input.data() + frame * input.col_stride());
+        if (reuse_frame) break;
+      }
+      if (frame > first_frame) {
+        RunFrames(input, first_frame, frame, output);
+      }
+      if (reuse_frame) {
+        // The layers would reproduce their inputs and outputs exactly, so
+        // they are left as they are.
+        if (folded_projection_) {
+          AppendFrame(folded_projection_out_, output);
+        } else {
+          AppendFrame(conv_to_gates_out_, output);
+        }
+        ++num_reused_frames_;
+        ++frame;
+      }
+    }
+  }
+
+  // Runs the stack on the columns |first_frame| to |end_frame| - 1 of |input|
+  // and appends the results to the output buffer |output|.
+  void RunFrames(csrblocksparse::VectorView<float> input, int first_frame,
+                 int end_frame, int output) {
+    auto f = [this, &input, first_frame, end_frame, output](
+                 csrblocksparse::SpinBarrier* barrier, int tid) {
+      for (int frame = first_frame; frame < end_frame; ++frame) {
+        if (tid == 0) {
+          InsertNewInput(input.data() + frame * input.col_stride());
+        }
+        barrier->barrier();
+        ComputeFunction(barrier, tid, output);
+      }
+    };
+    if (thread_pool_ != nullptr) {
+      thread_pool_->Run(num_threads_, f);
+    } else {
+      LaunchOnThreadsWithBarrier(num_threads_, f);
+    }
+  }
+
+  // Counts |frame| into the run of equal inputs and returns whether the run
+  // is longer than |kReceptiveFieldFrames|, in which case the output of
+  // |frame| equals the one of the previous frame.
+  bool RepeatsSaturatedInput(const float* frame) {
+    if (num_repeated_inputs_ > 0 &&
+        std::equal(frame, frame + feature_depth_, last_input_.begin())) {
+      num_repeated_inputs_ =
+          std::min(num_repeated_inputs_ + 1, kReceptiveFieldFrames + 1);
+    } else {
+      std::copy(frame, frame + feature_depth_, last_input_.begin());
+      num_repeated_inputs_ = 1;
+    }
+    return num_repeated_inputs_ > kReceptiveFieldFrames;
+  }
+
+  // Copies the |feature_depth_| values of |frame| to the input buffer of the
+  // first layer.
+  void InsertNewInput(const float* frame) {
+    CastVector(0, feature_depth_, frame,
+               conv1d_layer_->InputViewToUpdate().data());
   }
 
   void RunLayers(csrblocksparse::SpinBarrier* spin_barrier, int tid) {
@@ -379,6 +794,15 @@ class CausalConvolutionalConditioning {
                                  transpose_conv_layer_1_->InputViewToUpdate());
     transpose_conv_layer_1_->Run(tid, spin_barrier,
                                  transpose_conv_layer_2_->InputViewToUpdate());
+    if (folded_projection_) {
+      transpose_conv_layer_2_->Run(
+          tid, spin_barrier, folded_projection_layer_->InputViewToUpdate());
+      folded_projection_layer_->Run(
+          tid, spin_barrier,
+          csrblocksparse::MutableVectorView<FoldedProjectionOutType>(
+              &folded_projection_out_));
+      return;
+    }
     transpose_conv_layer_2_->Run(tid, spin_barrier,
                                  conv_cond_layer_->InputViewToUpdate());
 
@@ -387,11 +811,13 @@ class CausalConvolutionalConditioning {
         tid, spin_barrier,
         csrblocksparse::MutableVectorView<ConvCondOutputType>(&conv_cond_out_));
 
-    if (tid == 0) {
-      CastVector(0, conv_cond_out_.size(), conv_cond_out_.data(),
-                 conv_to_gates_layer_->InputViewToUpdate().data());
+    if (!projection_cast_fused_) {
+      if (tid == 0) {
+        CastVector(0, conv_cond_out_.size(), conv_cond_out_.data(),
+                   conv_to_gates_layer_->InputViewToUpdate().data());
+      }
+      spin_barrier->barrier();
     }
-    spin_barrier->barrier();
 
     conv_to_gates_layer_->Run(
         tid, spin_barrier,
@@ -399,30 +825,68 @@ class CausalConvolutionalConditioning {
             &conv_to_gates_out_));
   }
 
-  void CopyToOutput(csrblocksparse::SpinBarrier* spin_barrier, int tid) {
-    // Convert the output to the input type  of the GRU gate in lyra_wavegru.h.
+  // Needs no barrier: the other threads only write the output of the last
+  // layer again after the barriers of the next frame, which thread 0 only
+  // reaches after copying, and the dispatch returns once all threads did.
+  void CopyToOutput(csrblocksparse::SpinBarrier* spin_barrier, int tid,
+                    int output) {
     if (tid == 0) {
-      // Shift the content of |conditioning_| if necessary.
-      if (num_precomputed_frames_ == num_frames_per_packet_) {
-        std::copy(conditioning_.data() + conv_to_gates_out_.size(),
-                  conditioning_.data() + conditioning_.size(),
-                  conditioning_.data());
+      if (folded_projection_) {
+        AppendFrame(folded_projection_out_, output);
+      } else {
+        AppendFrame(conv_to_gates_out_, output);
       }
+    }
+  }
 
-      num_precomputed_frames_ =
-          std::min(num_precomputed_frames_ + 1, num_frames_per_packet_);
-      auto destination_start =
-          conditioning_.data() +
-          (num_precomputed_frames_ - 1) * conv_to_gates_out_.size();
-      CastVector(0, conv_to_gates_out_.size(), conv_to_gates_out_.data(),
-                 destination_start);
+  // The column of the current output that its |rendered_column|-th column is
+  // read from while it is stretched by |StretchCurrentOutput|. Columns past
+  // the end, which are only prefetched, read the last one.
+  int SourceColumn(int rendered_column) const {
+    const int num_source_columns =
+        num_precomputed_frames_[current_output_] * kCondUpsamplingRatio;
+    const int num_rendered_columns =
+        num_source_columns + num_stretch_columns_[current_output_];
+    return std::min(rendered_column * num_source_columns / num_rendered_columns,
+                    num_source_columns - 1);
+  }
+
+  // The number of elements of the conditioning of one step of |AtStep|.
+  int num_outputs_per_column() const { return 3 * num_hiddens_; }
+
+  // The number of elements of the conditioning of |num_frames| frames from
+  // |first_column| on.
+  int NumUnreadOutputs(int num_frames, int first_column) const {
+    return (num_frames * kCondUpsamplingRatio - first_column) *
+           num_outputs_per_column();
+  }
+
+  // Converts |frame| to the input type of the GRU gate in lyra_wavegru.h and
+  // appends it to the output buffer |output|.
+  template <typename FrameType>
+  void AppendFrame(
+      const csrblocksparse::FatCacheAlignedVector<FrameType>& frame,
+      int output) {
+    auto& conditioning = conditioning_[output];
+    int& num_precomputed_frames = num_precomputed_frames_[output];
+    // Shift the content of |conditioning| if necessary.
+    if (num_precomputed_frames == num_frames_per_packet_) {
+      std::copy(conditioning.data() + frame.size(),
+                conditioning.data() + conditioning.size(),
+                conditioning.data());
     }
-    spin_barrier->barrier();
+
+    num_precomputed_frames =
+        std::min(num_precomputed_frames + 1, num_frames_per_packet_);
+    auto destination_start =
+        conditioning.data() + (num_precomputed_frames - 1) * frame.size();
+    CastVector(0, frame.size(), frame.data(), destination_start);
   }
 
-  void ComputeFunction(csrblocksparse::SpinBarrier* spin_barrier, int tid) {
+  void ComputeFunction(csrblocksparse::SpinBarrier* spin_barrier, int tid,
+                       int output) {
     RunLayers(spin_barrier, tid);
-    CopyToOutput(spin_barrier, tid);
+    CopyToOutput(spin_barrier, tid, output);
   }
 
   const int feature_depth_;  // E.g. the number of mel bins.
@@ -433,8 +897,33 @@ class CausalConvolutionalConditioning {
   const int num_threads_;
   const std::string path_;
   const std::string prefix_;
-
-  int num_precomputed_frames_;
+  // Not owned. May be null, in which case the layers are not shared.
+  LyraModel* const model_;
+  // Not owned. May be null.
+  ThreadPool* const thread_pool_;
+  // If set, fills all layers instead of |path_|.
+  const absl::optional<LayerParams::FromConstant> constant_weights_;
+  // Whether the layer files under |path_| are gzipped.
+  const bool zipped_;
+  // Whether |path_| holds a folded projection layer.
+  const bool folded_projection_;
+
+  // Per output buffer in |conditioning_|, the number of frames in it and how
+  // many more columns it is rendered into, see |StretchCurrentOutput|.
+  std::array<int, 2> num_precomputed_frames_;
+  std::array<int, 2> num_stretch_columns_;
+  // Index of the output buffer read by |AtStep|.
+  int current_output_;
+  // Whether |PrecomputeNext| wrote into the other buffer since the last swap.
+  bool has_next_output_;
+  // The last input run through the stack and how many inputs in a row were
+  // equal to it, counting at most one more than |kReceptiveFieldFrames|.
+  std::vector<float> last_input_;
+  int num_repeated_inputs_;
+  int64_t num_reused_frames_;
+  // Whether conv_cond casts its output into the input of conv_to_gates in its
+  // row epilogue.
+  bool projection_cast_fused_ = false;
   csrblocksparse::SpinBarrier spin_barrier_;
 
   std::unique_ptr<Conv1DLayerType> conv1d_layer_;
@@ -445,19 +934,29 @@ class CausalConvolutionalConditioning {
   std::unique_ptr<Transpose1LayerType> transpose_conv_layer_1_;
   std::unique_ptr<Transpose2LayerType> transpose_conv_layer_2_;
 
-  // Wavegru Projection Layers.
+  // Wavegru Projection Layers. Either |folded_projection_layer_| or the other
+  // two are set.
   std::unique_ptr<ConvCondLayerType> conv_cond_layer_;
   std::unique_ptr<ConvToGatesLayerType> conv_to_gates_layer_;
+  std::unique_ptr<FoldedProjectionLayerType> folded_projection_layer_;
 
   // Buffers before and after |conv_to_gates_layer_|.
   csrblocksparse::FatCacheAlignedVector<ConvCondOutputType> conv_cond_out_;
   csrblocksparse::FatCacheAlignedVector<ConvToGatesOutType> conv_to_gates_out_;
+  // Buffer after |folded_projection_layer_|.
+  csrblocksparse::FatCacheAlignedVector<FoldedProjectionOutType>
+      folded_projection_out_;
 
-  // Stores |num_frames_per_packet_| frames worth of conditioning output.
-  csrblocksparse::FatCacheAlignedVector<OutputType> conditioning_;
+  // Each stores |num_frames_per_packet_| frames worth of conditioning output.
+  // Two buffers, so that the next packet can be precomputed while the current
+  // one is read.
+  std::array<csrblocksparse::FatCacheAlignedVector<OutputType>, 2>
+      conditioning_;
 
   template <typename WeightTypeKindPeer>
   friend class CausalConvolutionalConditioningPeer;
+  // Loads the same layers and runs them for many streams.
+  friend class BatchedCausalConvolutionalConditioning<Types>;
 };
 
 }  // namespace codec
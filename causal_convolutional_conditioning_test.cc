@@ -15,8 +15,10 @@
 #include "causal_convolutional_conditioning.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iterator>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 // placeholder for get runfiles header.
@@ -28,6 +30,7 @@
 #include "lyra_config.h"
 #include "lyra_types.h"
 #include "sparse_inference_matrixvector.h"
+#include "thread_pool.h"
 
 namespace chromemedia {
 namespace codec {
@@ -264,6 +267,140 @@ TYPED_TEST(CausalConvolutionalConditioningTest,
   }
 }
 
+// |Types| with the conditioning stored as with USE_BFLOAT16_CONDITIONING,
+// whatever the compute type.
+template <typename Types>
+struct Bfloat16StorageTypes : Types {
+  using OutputType = csrblocksparse::bfloat16;
+};
+
+TYPED_TEST(CausalConvolutionalConditioningTest,
+           Bfloat16StorageIsCloseToGateInputs) {
+  using Types = ConditioningTypes<TypeParam, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+                                  6, 6, 6, 6, 6, 6, 6>;
+  static_assert(
+      std::is_same<typename CausalConvolutionalConditioning<
+                       Bfloat16StorageTypes<Types>>::OutputType,
+                   csrblocksparse::bfloat16>::value,
+      "The conditioning has to be stored in bfloat16.");
+
+  const int kNumCondHiddens = 8;
+  const int kNumHiddens = 4;
+  const std::vector<std::vector<float>> kFeatures = {{0.0f, 0.0f, 0.0f},
+                                                     {1.0f, 1.0f, 1.0f},
+                                                     {0.5f, -0.5f, 0.25f}};
+  CausalConvolutionalConditioning<Types> gate_inputs(
+      kFeatures.at(0).size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      kNumFramesPerPacket, 1, this->testdata_dir_.string(), "lyra");
+  CausalConvolutionalConditioning<Bfloat16StorageTypes<Types>> bfloat16s(
+      kFeatures.at(0).size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      kNumFramesPerPacket, 1, this->testdata_dir_.string(), "lyra");
+  csrblocksparse::FatCacheAlignedVector<float> input(kFeatures.at(0).size(), 1);
+  for (int i = 0; i < kFeatures.size(); ++i) {
+    std::copy(kFeatures.at(i).begin(), kFeatures.at(i).end(), input.data());
+    gate_inputs.Precompute(input, 1);
+    bfloat16s.Precompute(input, 1);
+
+    for (int j = 0; j < kCondUpsamplingRatio; ++j) {
+      auto expected = gate_inputs.AtStep(j * kNumSamplesPerCondOutput);
+      auto stored = bfloat16s.AtStep(j * kNumSamplesPerCondOutput);
+      ASSERT_EQ(stored.size(), expected.size());
+      for (int k = 0; k < expected.size(); ++k) {
+        const float value = static_cast<float>(expected[k]);
+        // bfloat16 keeps 8 bits of mantissa.
+        EXPECT_NEAR(static_cast<float>(stored[k]), value,
+                    std::abs(value) / 128.0f + 1e-6f);
+      }
+    }
+  }
+}
+
+TYPED_TEST(CausalConvolutionalConditioningTest, ThreadPoolYieldsSameResult) {
+  using ConditioningType = CausalConvolutionalConditioning<ConditioningTypes<
+      TypeParam, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6>>;
+
+  const int kNumCondHiddens = 8;
+  const int kNumHiddens = 4;
+  const int kNumThreads = 2;
+  const std::vector<std::vector<float>> kFeatures = {{0.0f, 0.0f, 0.0f},
+                                                     {1.0f, 1.0f, 1.0f},
+                                                     {0.0f, 0.0f, 0.0f}};
+  // The pool may have more threads than the stack uses.
+  auto thread_pool = ThreadPool::Create(kNumThreads + 1);
+  ASSERT_NE(thread_pool, nullptr);
+  ConditioningType launched_threads(
+      kFeatures.at(0).size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      kNumFramesPerPacket, kNumThreads, this->testdata_dir_.string(), "lyra");
+  ConditioningType pooled_threads(
+      kFeatures.at(0).size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      kNumFramesPerPacket, kNumThreads, this->testdata_dir_.string(), "lyra",
+      /*model=*/nullptr, thread_pool.get());
+  csrblocksparse::FatCacheAlignedVector<float> input(kFeatures.at(0).size(), 1);
+  for (int i = 0; i < kFeatures.size(); ++i) {
+    std::copy(kFeatures.at(i).begin(), kFeatures.at(i).end(), input.data());
+    launched_threads.Precompute(input, kNumThreads);
+    pooled_threads.Precompute(input, kNumThreads);
+
+    for (int j = 0; j < kCondUpsamplingRatio; ++j) {
+      auto launched_output =
+          launched_threads.AtStep(j * kNumSamplesPerCondOutput);
+      auto pooled_output = pooled_threads.AtStep(j * kNumSamplesPerCondOutput);
+      for (int k = 0; k < launched_output.size(); ++k) {
+        EXPECT_FLOAT_EQ(static_cast<float>(launched_output[k]),
+                        static_cast<float>(pooled_output[k]));
+      }
+    }
+  }
+}
+
+TYPED_TEST(CausalConvolutionalConditioningTest,
+           RepeatedInputReusesConditioning) {
+  using ConditioningType = CausalConvolutionalConditioning<ConditioningTypes<
+      TypeParam, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6>>;
+
+  const int kNumCondHiddens = 8;
+  const int kNumHiddens = 4;
+  const int kNumThreads = 1;
+  // Longer than the 10 frames the output of a frame depends on.
+  const int kNumRepeatedFrames = 15;
+  const std::vector<float> kRepeatedFeatures = {0.5f, 0.0f, 1.0f};
+  const std::vector<float> kLastFeatures = {1.0f, 1.0f, 1.0f};
+
+  // One stack only sees as many repeated inputs as the output depends on, so
+  // it computes every frame.
+  ConditioningType computed(
+      kRepeatedFeatures.size(), kNumCondHiddens, kNumHiddens,
+      kNumSamplesPerHop, kNumFramesPerPacket, kNumThreads,
+      this->testdata_dir_.string(), "lyra");
+  ConditioningType reused(kRepeatedFeatures.size(), kNumCondHiddens,
+                          kNumHiddens, kNumSamplesPerHop, kNumFramesPerPacket,
+                          kNumThreads, this->testdata_dir_.string(), "lyra");
+  csrblocksparse::FatCacheAlignedVector<float> input(kRepeatedFeatures.size(),
+                                                     1);
+  std::copy(kRepeatedFeatures.begin(), kRepeatedFeatures.end(), input.data());
+  for (int i = 0; i < kNumRepeatedFrames; ++i) {
+    if (i < 10) {
+      computed.Precompute(input, kNumThreads);
+    }
+    reused.Precompute(input, kNumThreads);
+  }
+  EXPECT_EQ(computed.num_reused_frames(), 0);
+  EXPECT_EQ(reused.num_reused_frames(), kNumRepeatedFrames - 10);
+
+  // Both continue from the same layer state.
+  std::copy(kLastFeatures.begin(), kLastFeatures.end(), input.data());
+  computed.Precompute(input, kNumThreads);
+  reused.Precompute(input, kNumThreads);
+  for (int j = 0; j < kCondUpsamplingRatio; ++j) {
+    auto computed_output = computed.AtStep(j * kNumSamplesPerCondOutput);
+    auto reused_output = reused.AtStep(j * kNumSamplesPerCondOutput);
+    for (int k = 0; k < computed_output.size(); ++k) {
+      EXPECT_FLOAT_EQ(static_cast<float>(computed_output[k]),
+                      static_cast<float>(reused_output[k]));
+    }
+  }
+}
+
 TYPED_TEST(CausalConvolutionalConditioningTest,
            MultipleFramesPerPacketYieldsSameResult) {
   using ConditioningType = CausalConvolutionalConditioning<ConditioningTypes<
@@ -325,6 +462,147 @@ TYPED_TEST(CausalConvolutionalConditioningTest,
       testing::Pointwise(testing::FloatEq(), two_frames_output_to_compare));
 }
 
+TYPED_TEST(CausalConvolutionalConditioningTest,
+           PrecomputingFramesAtOnceYieldsSameResult) {
+  using ConditioningType = CausalConvolutionalConditioning<ConditioningTypes<
+      TypeParam, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6>>;
+
+  const int kNumCondHiddens = 8;
+  const int kNumHiddens = 4;
+  const int kNumThreads = 2;
+  const int kNumFrames = 3;
+  const std::vector<std::vector<float>> kFeatures = {{0.0f, 0.0f, 0.0f},
+                                                     {1.0f, 1.0f, 1.0f},
+                                                     {0.5f, -1.0f, 0.0f}};
+  ConditioningType frame_by_frame(
+      kFeatures.at(0).size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      kNumFrames, kNumThreads, this->testdata_dir_.string(), "lyra");
+  ConditioningType all_frames(
+      kFeatures.at(0).size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      kNumFrames, kNumThreads, this->testdata_dir_.string(), "lyra");
+  csrblocksparse::FatCacheAlignedVector<float> frame(kFeatures.at(0).size(), 1);
+  csrblocksparse::FatCacheAlignedVector<float> frames(kFeatures.at(0).size(),
+                                                      kNumFrames);
+  for (int i = 0; i < kNumFrames; ++i) {
+    std::copy(kFeatures.at(i).begin(), kFeatures.at(i).end(), frame.data());
+    frame_by_frame.Precompute(frame, kNumThreads);
+    std::copy(kFeatures.at(i).begin(), kFeatures.at(i).end(),
+              frames.slice(i).data());
+  }
+  all_frames.Precompute(frames, kNumThreads);
+
+  ASSERT_EQ(all_frames.num_samples(), frame_by_frame.num_samples());
+  for (int step = 0; step < frame_by_frame.num_samples();
+       step += kNumSamplesPerCondOutput) {
+    auto expected_output = frame_by_frame.AtStep(step);
+    auto output = all_frames.AtStep(step);
+    for (int k = 0; k < expected_output.size(); ++k) {
+      EXPECT_FLOAT_EQ(static_cast<float>(expected_output[k]),
+                      static_cast<float>(output[k]));
+    }
+  }
+}
+
+TYPED_TEST(CausalConvolutionalConditioningTest,
+           PrecomputeNextYieldsSameResultAfterSwap) {
+  using ConditioningType = CausalConvolutionalConditioning<ConditioningTypes<
+      TypeParam, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6>>;
+
+  const int kNumCondHiddens = 8;
+  const int kNumHiddens = 4;
+  const int kNumThreads = 1;
+  const std::vector<std::vector<float>> kFeatures = {{0.0f, 0.0f, 0.0f},
+                                                     {1.0f, 1.0f, 1.0f},
+                                                     {0.0f, 0.0f, 0.0f}};
+  ConditioningType conditioning(
+      kFeatures.at(0).size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      kNumFramesPerPacket, kNumThreads, this->testdata_dir_.string(), "lyra");
+  ConditioningType double_buffered_conditioning(
+      kFeatures.at(0).size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      kNumFramesPerPacket, kNumThreads, this->testdata_dir_.string(), "lyra");
+  csrblocksparse::FatCacheAlignedVector<float> input(kFeatures.at(0).size(), 1);
+  auto outputs_of = [](ConditioningType* conditioning) {
+    std::vector<float> outputs;
+    for (int step = 0; step < conditioning->num_samples();
+         step += kNumSamplesPerCondOutput) {
+      const auto output = conditioning->AtStep(step);
+      std::transform(output.begin(), output.end(), std::back_inserter(outputs),
+                     [](auto x) { return static_cast<float>(x); });
+    }
+    return outputs;
+  };
+
+  for (int i = 0; i < kFeatures.size(); ++i) {
+    std::copy(kFeatures.at(i).begin(), kFeatures.at(i).end(), input.data());
+    const std::vector<float> previous_outputs =
+        outputs_of(&double_buffered_conditioning);
+    conditioning.Precompute(input, kNumThreads);
+    double_buffered_conditioning.PrecomputeNext(input, kNumThreads);
+
+    // The current output is only replaced by the swap.
+    EXPECT_EQ(outputs_of(&double_buffered_conditioning), previous_outputs);
+    double_buffered_conditioning.SwapOutputs();
+    EXPECT_THAT(outputs_of(&double_buffered_conditioning),
+                testing::Pointwise(testing::FloatEq(),
+                                   outputs_of(&conditioning)));
+  }
+}
+
+TYPED_TEST(CausalConvolutionalConditioningTest,
+           StretchedOutputRepeatsOrSkipsColumns) {
+  using ConditioningType = CausalConvolutionalConditioning<ConditioningTypes<
+      TypeParam, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6>>;
+
+  const int kNumCondHiddens = 8;
+  const int kNumHiddens = 4;
+  const int kNumThreads = 1;
+  const std::vector<float> kFeatures = {1.0f, 2.0f, 3.0f};
+  ConditioningType conditioning(
+      kFeatures.size(), kNumCondHiddens, kNumHiddens, kNumSamplesPerHop,
+      /*num_frames_per_packet=*/1, kNumThreads, this->testdata_dir_.string(),
+      "lyra");
+  EXPECT_EQ(conditioning.num_samples_per_column(), kNumSamplesPerCondOutput);
+  // Nothing was precomputed yet.
+  EXPECT_FALSE(conditioning.StretchCurrentOutput(1));
+
+  csrblocksparse::FatCacheAlignedVector<float> input(kFeatures.size(), 1);
+  std::copy(kFeatures.begin(), kFeatures.end(), input.data());
+  conditioning.Precompute(input, kNumThreads);
+  auto columns_of = [](ConditioningType* conditioning) {
+    std::vector<std::vector<float>> columns;
+    for (int step = 0; step < conditioning->num_samples();
+         step += kNumSamplesPerCondOutput) {
+      const auto output = conditioning->AtStep(step);
+      columns.emplace_back(output.size());
+      std::transform(output.begin(), output.end(), columns.back().begin(),
+                     [](auto x) { return static_cast<float>(x); });
+    }
+    return columns;
+  };
+  const std::vector<std::vector<float>> columns = columns_of(&conditioning);
+  ASSERT_EQ(columns.size(), kCondUpsamplingRatio);
+
+  for (const int num_stretch_columns : {2, -2, 1 - kCondUpsamplingRatio}) {
+    ASSERT_TRUE(conditioning.StretchCurrentOutput(num_stretch_columns));
+    const int num_rendered_columns = kCondUpsamplingRatio + num_stretch_columns;
+    EXPECT_EQ(conditioning.num_samples(),
+              num_rendered_columns * kNumSamplesPerCondOutput);
+    const std::vector<std::vector<float>> stretched =
+        columns_of(&conditioning);
+    ASSERT_EQ(stretched.size(), num_rendered_columns);
+    for (int column = 0; column < num_rendered_columns; ++column) {
+      EXPECT_EQ(stretched[column],
+                columns[column * kCondUpsamplingRatio / num_rendered_columns])
+          << num_stretch_columns << " " << column;
+    }
+  }
+  EXPECT_FALSE(conditioning.StretchCurrentOutput(-kCondUpsamplingRatio));
+
+  // The next frame plays out at its own length.
+  conditioning.Precompute(input, kNumThreads);
+  EXPECT_EQ(conditioning.num_samples(), kNumSamplesPerHop);
+}
+
 // Test that exported layers with fixed-point and float weights produce
 // matching results.
 using csrblocksparse::fixed16_type;
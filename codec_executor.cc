@@ -0,0 +1,324 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codec_executor.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif  // defined(__linux__)
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "lyra_decoder_interface.h"
+#include "lyra_encoder_interface.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Returns a future that is ready with a nullopt.
+template <typename T>
+std::future<absl::optional<T>> MakeFailedFuture() {
+  std::promise<absl::optional<T>> promise;
+  promise.set_value(absl::nullopt);
+  return promise.get_future();
+}
+
+// Returns a future that is ready with false.
+std::future<bool> MakeFailedBoolFuture() {
+  std::promise<bool> promise;
+  promise.set_value(false);
+  return promise.get_future();
+}
+
+// Restricts the calling thread to |cpu| where the platform supports it.
+void PinCurrentThread(int cpu) {
+#if defined(__linux__)
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+    LOG(WARNING) << "Could not pin a worker thread to core " << cpu << ".";
+  }
+#else
+  LOG(WARNING) << "Pinning threads is not supported on this platform.";
+#endif  // defined(__linux__)
+}
+
+}  // namespace
+
+std::unique_ptr<CodecExecutor> CodecExecutor::Create(int num_threads,
+                                                     bool pin_threads) {
+  if (num_threads <= 0) {
+    LOG(ERROR) << "The number of threads has to be positive, but is "
+               << num_threads << ".";
+    return nullptr;
+  }
+  const int num_cpus =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  std::vector<int> worker_cpus(num_threads, -1);
+  if (pin_threads) {
+    for (int i = 0; i < num_threads; ++i) {
+      worker_cpus[i] = i % num_cpus;
+    }
+  }
+  return absl::WrapUnique(new CodecExecutor(worker_cpus));
+}
+
+std::unique_ptr<CodecExecutor> CodecExecutor::CreateOnCpus(
+    const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    LOG(ERROR) << "An executor needs at least one core to run on.";
+    return nullptr;
+  }
+  for (const int cpu : cpus) {
+    if (cpu < 0) {
+      LOG(ERROR) << "Cores are numbered from 0, but one is " << cpu << ".";
+      return nullptr;
+    }
+  }
+  return absl::WrapUnique(new CodecExecutor(cpus));
+}
+
+CodecExecutor::CodecExecutor(const std::vector<int>& worker_cpus)
+    : next_session_id_(0), terminate_(false) {
+  threads_.reserve(worker_cpus.size());
+  for (const int cpu : worker_cpus) {
+    threads_.push_back(absl::make_unique<csrblocksparse::Thread>(
+        [this, cpu]() { RunWorker(cpu); }));
+  }
+}
+
+CodecExecutor::~CodecExecutor() {
+  {
+    absl::MutexLock lock(&queue_mutex_);
+    terminate_ = true;
+  }
+  for (const auto& thread : threads_) {
+    thread->join();
+  }
+}
+
+absl::optional<CodecExecutor::SessionId> CodecExecutor::AddDecoderSession(
+    std::unique_ptr<LyraDecoderInterface> decoder, int num_frames_per_packet) {
+  if (decoder == nullptr) {
+    LOG(ERROR) << "A decoder session needs a decoder.";
+    return absl::nullopt;
+  }
+  if (num_frames_per_packet <= 0) {
+    LOG(ERROR) << "The number of frames per packet has to be positive, but is "
+               << num_frames_per_packet << ".";
+    return absl::nullopt;
+  }
+  auto session = std::make_shared<Session>();
+  session->num_samples_per_packet = decoder->sample_rate_hz() /
+                                    decoder->frame_rate() *
+                                    num_frames_per_packet;
+  session->decoder = std::move(decoder);
+  return AddSession(std::move(session));
+}
+
+absl::optional<CodecExecutor::SessionId> CodecExecutor::AddEncoderSession(
+    std::unique_ptr<LyraEncoderInterface> encoder) {
+  if (encoder == nullptr) {
+    LOG(ERROR) << "An encoder session needs an encoder.";
+    return absl::nullopt;
+  }
+  auto session = std::make_shared<Session>();
+  session->encoder = std::move(encoder);
+  return AddSession(std::move(session));
+}
+
+CodecExecutor::SessionId CodecExecutor::AddSession(
+    std::shared_ptr<Session> session) {
+  absl::MutexLock lock(&sessions_mutex_);
+  const SessionId id = next_session_id_++;
+  sessions_.emplace(id, std::move(session));
+  return id;
+}
+
+bool CodecExecutor::RemoveSession(SessionId session) {
+  absl::MutexLock lock(&sessions_mutex_);
+  return sessions_.erase(session) > 0;
+}
+
+std::shared_ptr<CodecExecutor::Session> CodecExecutor::FindSession(
+    SessionId id) {
+  absl::MutexLock lock(&sessions_mutex_);
+  const auto it = sessions_.find(id);
+  return it == sessions_.end() ? nullptr : it->second;
+}
+
+std::future<absl::optional<std::vector<int16_t>>> CodecExecutor::SubmitPacket(
+    SessionId session, std::vector<uint8_t> packet) {
+  std::shared_ptr<Session> found = FindSession(session);
+  if (found == nullptr || found->decoder == nullptr) {
+    LOG(ERROR) << "There is no decoder session " << session << ".";
+    return MakeFailedFuture<std::vector<int16_t>>();
+  }
+  auto promise =
+      std::make_shared<std::promise<absl::optional<std::vector<int16_t>>>>();
+  auto future = promise->get_future();
+  Session* decoder_session = found.get();
+  Schedule(std::move(found), [decoder_session, promise,
+                              packet = std::move(packet)]() {
+    if (!decoder_session->decoder->SetEncodedPacket(packet)) {
+      promise->set_value(absl::nullopt);
+      return;
+    }
+    promise->set_value(decoder_session->decoder->DecodeSamples(
+        decoder_session->num_samples_per_packet));
+  });
+  return future;
+}
+
+std::future<absl::optional<std::vector<int16_t>>>
+CodecExecutor::SubmitPacketLoss(SessionId session) {
+  std::shared_ptr<Session> found = FindSession(session);
+  if (found == nullptr || found->decoder == nullptr) {
+    LOG(ERROR) << "There is no decoder session " << session << ".";
+    return MakeFailedFuture<std::vector<int16_t>>();
+  }
+  auto promise =
+      std::make_shared<std::promise<absl::optional<std::vector<int16_t>>>>();
+  auto future = promise->get_future();
+  Session* decoder_session = found.get();
+  Schedule(std::move(found), [decoder_session, promise]() {
+    promise->set_value(decoder_session->decoder->DecodePacketLoss(
+        decoder_session->num_samples_per_packet));
+  });
+  return future;
+}
+
+std::future<bool> CodecExecutor::SubmitPacketInto(
+    SessionId session, absl::optional<std::vector<uint8_t>> packet,
+    absl::Span<float> samples) {
+  std::shared_ptr<Session> found = FindSession(session);
+  if (found == nullptr || found->decoder == nullptr) {
+    LOG(ERROR) << "There is no decoder session " << session << ".";
+    return MakeFailedBoolFuture();
+  }
+  if (samples.size() != found->num_samples_per_packet) {
+    LOG(ERROR) << "Session " << session << " decodes "
+               << found->num_samples_per_packet << " samples per packet, not "
+               << samples.size() << ".";
+    return MakeFailedBoolFuture();
+  }
+  auto promise = std::make_shared<std::promise<bool>>();
+  auto future = promise->get_future();
+  Session* decoder_session = found.get();
+  Schedule(std::move(found), [decoder_session, promise,
+                              packet = std::move(packet), samples]() {
+    LyraDecoderInterface* const decoder = decoder_session->decoder.get();
+    if (!packet.has_value()) {
+      promise->set_value(decoder->DecodePacketLoss(samples));
+      return;
+    }
+    promise->set_value(decoder->SetEncodedPacket(*packet) &&
+                       decoder->DecodeSamples(samples));
+  });
+  return future;
+}
+
+std::future<absl::optional<std::vector<uint8_t>>> CodecExecutor::SubmitAudio(
+    SessionId session, std::vector<int16_t> audio) {
+  std::shared_ptr<Session> found = FindSession(session);
+  if (found == nullptr || found->encoder == nullptr) {
+    LOG(ERROR) << "There is no encoder session " << session << ".";
+    return MakeFailedFuture<std::vector<uint8_t>>();
+  }
+  auto promise =
+      std::make_shared<std::promise<absl::optional<std::vector<uint8_t>>>>();
+  auto future = promise->get_future();
+  Session* encoder_session = found.get();
+  Schedule(std::move(found),
+           [encoder_session, promise, audio = std::move(audio)]() {
+             promise->set_value(encoder_session->encoder->Encode(audio));
+           });
+  return future;
+}
+
+void CodecExecutor::Schedule(std::shared_ptr<Session> session,
+                             std::function<void()> task) {
+  {
+    absl::MutexLock lock(&session->mutex);
+    session->tasks.push_back(std::move(task));
+    if (session->scheduled) {
+      return;
+    }
+    session->scheduled = true;
+  }
+  absl::MutexLock lock(&queue_mutex_);
+  run_queue_.push_back(std::move(session));
+}
+
+bool CodecExecutor::HasWorkOrTerminated() const {
+  return !run_queue_.empty() || terminate_;
+}
+
+void CodecExecutor::RunWorker(int cpu) {
+  if (cpu >= 0) {
+    PinCurrentThread(cpu);
+  }
+  while (true) {
+    std::shared_ptr<Session> session;
+    {
+      absl::MutexLock lock(&queue_mutex_);
+      queue_mutex_.Await(
+          absl::Condition(this, &CodecExecutor::HasWorkOrTerminated));
+      // Sessions that are still running put themselves back on the queue
+      // before their worker checks it again, so the queue is only empty on
+      // termination once all submitted work is done.
+      if (run_queue_.empty()) {
+        return;
+      }
+      session = std::move(run_queue_.front());
+      run_queue_.pop_front();
+    }
+
+    std::function<void()> task;
+    {
+      absl::MutexLock lock(&session->mutex);
+      task = std::move(session->tasks.front());
+      session->tasks.pop_front();
+    }
+    task();
+
+    {
+      absl::MutexLock lock(&session->mutex);
+      if (session->tasks.empty()) {
+        session->scheduled = false;
+        continue;
+      }
+    }
+    absl::MutexLock lock(&queue_mutex_);
+    run_queue_.push_back(std::move(session));
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_CODEC_EXECUTOR_H_
+#define LYRA_CODEC_CODEC_EXECUTOR_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "lyra_decoder_interface.h"
+#include "lyra_encoder_interface.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Runs the encoders and decoders of many sessions, e.g. the calls of a server,
+// on one fixed set of worker threads. Callers submit packets and audio and get
+// futures back instead of blocking in the codec themselves, so the number of
+// threads doing codec work stays the number of cores however many callers
+// there are.
+//
+// The work of one session runs in submission order and never on two threads
+// at once. Sessions with pending work take turns on a shared run queue: a
+// worker runs one packet of a session and then moves it to the back of the
+// queue, so the packets of concurrent sessions interleave and an idle worker
+// always picks up the next ready session. The codecs should be created with a
+// single thread each, so that they do not spin on threads of their own.
+//
+// All methods are thread-safe.
+class CodecExecutor {
+ public:
+  using SessionId = int64_t;
+
+  // Starts |num_threads| workers. With |pin_threads| on Linux and Android
+  // worker |i| only runs on core |i| modulo the number of cores, which keeps
+  // the state of the sessions it runs in that core's caches. Returns a
+  // nullptr if |num_threads| is not positive.
+  static std::unique_ptr<CodecExecutor> Create(int num_threads,
+                                               bool pin_threads = false);
+
+  // Starts one worker pinned to each core of |cpus|, e.g. the cores of one
+  // NUMA node, so that the memory the sessions touch stays local to the
+  // workers running them. Returns a nullptr if |cpus| is empty or holds a
+  // negative core.
+  static std::unique_ptr<CodecExecutor> CreateOnCpus(
+      const std::vector<int>& cpus);
+
+  // Finishes all submitted work, then stops the workers.
+  ~CodecExecutor();
+
+  // Adds a session decoding packets of |num_frames_per_packet| frames with
+  // |decoder|. Returns a nullopt if |decoder| is null or
+  // |num_frames_per_packet| is not positive.
+  absl::optional<SessionId> AddDecoderSession(
+      std::unique_ptr<LyraDecoderInterface> decoder, int num_frames_per_packet);
+
+  // Adds a session encoding with |encoder|. Returns a nullopt if |encoder| is
+  // null.
+  absl::optional<SessionId> AddEncoderSession(
+      std::unique_ptr<LyraEncoderInterface> encoder);
+
+  // Removes |session|. Work submitted before still runs, after which the codec
+  // is destroyed. Returns false if there is no such session.
+  bool RemoveSession(SessionId session);
+
+  // Decodes |packet| in decoder |session| into the samples of one packet. An
+  // empty |packet| is decoded as comfort noise. The future holds a nullopt if
+  // |session| is not a decoder session or decoding failed.
+  std::future<absl::optional<std::vector<int16_t>>> SubmitPacket(
+      SessionId session, std::vector<uint8_t> packet);
+
+  // Conceals one lost packet in decoder |session|, with the same results as
+  // |SubmitPacket|.
+  std::future<absl::optional<std::vector<int16_t>>> SubmitPacketLoss(
+      SessionId session);
+
+  // Like |SubmitPacket|, or like |SubmitPacketLoss| if |packet| is a nullopt,
+  // but decodes float samples in the int16 range into |samples|, which has to
+  // hold the samples of one packet and stay valid until the future is ready.
+  // The future holds false if |session| is not a decoder session, |samples|
+  // has the wrong size or decoding failed.
+  std::future<bool> SubmitPacketInto(
+      SessionId session, absl::optional<std::vector<uint8_t>> packet,
+      absl::Span<float> samples);
+
+  // Encodes |audio| in encoder |session|. The future holds a nullopt if
+  // |session| is not an encoder session or encoding failed.
+  std::future<absl::optional<std::vector<uint8_t>>> SubmitAudio(
+      SessionId session, std::vector<int16_t> audio);
+
+  int num_threads() const { return static_cast<int>(threads_.size()); }
+
+ private:
+  struct Session {
+    std::unique_ptr<LyraDecoderInterface> decoder;
+    std::unique_ptr<LyraEncoderInterface> encoder;
+    int num_samples_per_packet = 0;
+
+    absl::Mutex mutex;
+    std::deque<std::function<void()>> tasks ABSL_GUARDED_BY(mutex);
+    // Whether the session is on the run queue or running.
+    bool scheduled ABSL_GUARDED_BY(mutex) = false;
+  };
+
+  // Starts one worker per entry of |worker_cpus|, pinned to that core unless
+  // it is negative.
+  explicit CodecExecutor(const std::vector<int>& worker_cpus);
+
+  // Returns the session with |id|, or a nullptr if there is none.
+  std::shared_ptr<Session> FindSession(SessionId id);
+
+  SessionId AddSession(std::shared_ptr<Session> session);
+
+  // Appends |task| to the tasks of |session|, putting it on the run queue if
+  // it was idle.
+  void Schedule(std::shared_ptr<Session> session, std::function<void()> task);
+
+  bool HasWorkOrTerminated() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(queue_mutex_);
+
+  // Pins the worker to |cpu| unless it is negative.
+  void RunWorker(int cpu);
+
+  absl::Mutex sessions_mutex_;
+  std::map<SessionId, std::shared_ptr<Session>> sessions_
+      ABSL_GUARDED_BY(sessions_mutex_);
+  SessionId next_session_id_ ABSL_GUARDED_BY(sessions_mutex_);
+
+  absl::Mutex queue_mutex_;
+  std::deque<std::shared_ptr<Session>> run_queue_ ABSL_GUARDED_BY(queue_mutex_);
+  bool terminate_ ABSL_GUARDED_BY(queue_mutex_);
+
+  std::vector<std::unique_ptr<csrblocksparse::Thread>> threads_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_CODEC_EXECUTOR_H_
@@ -0,0 +1,302 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codec_executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_metrics.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "lyra_decoder_interface.h"
+#include "testing/mock_lyra_decoder.h"
+#include "testing/mock_lyra_encoder.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::_;
+using testing::ElementsAre;
+using testing::Optional;
+using testing::Return;
+
+constexpr int kSampleRateHz = 16000;
+constexpr int kFrameRate = 25;
+constexpr int kNumFramesPerPacket = 2;
+constexpr int kNumSamplesPerPacket =
+    kSampleRateHz / kFrameRate * kNumFramesPerPacket;
+
+std::unique_ptr<MockLyraDecoder> CreateMockDecoder() {
+  auto decoder = absl::make_unique<MockLyraDecoder>();
+  ON_CALL(*decoder, sample_rate_hz()).WillByDefault(Return(kSampleRateHz));
+  ON_CALL(*decoder, frame_rate()).WillByDefault(Return(kFrameRate));
+  return decoder;
+}
+
+// Decodes every packet into its first byte, and notes whether it was ever
+// called on two threads at once.
+class FakeDecoder : public LyraDecoderInterface {
+ public:
+  explicit FakeDecoder(std::atomic<bool>* overlapped)
+      : overlapped_(overlapped), busy_(false), sample_(0) {}
+
+  bool SetEncodedPacket(absl::Span<const uint8_t> encoded) override {
+    Enter();
+    sample_ = encoded[0];
+    Exit();
+    return true;
+  }
+  absl::optional<std::vector<int16_t>> DecodeSamples(
+      int num_samples) override {
+    Enter();
+    std::vector<int16_t> samples(num_samples, sample_);
+    Exit();
+    return samples;
+  }
+  bool DecodeSamples(absl::Span<int16_t> samples) override { return false; }
+  absl::optional<std::vector<int16_t>> DecodePacketLoss(
+      int num_samples) override {
+    return absl::nullopt;
+  }
+  bool DecodePacketLoss(absl::Span<int16_t> samples) override { return false; }
+  int sample_rate_hz() const override { return kSampleRateHz; }
+  int num_channels() const override { return 1; }
+  int bitrate() const override { return 0; }
+  int frame_rate() const override { return kFrameRate; }
+  bool is_comfort_noise() const override { return false; }
+  DecoderMetrics metrics() const override { return DecoderMetrics(); }
+  void Reset() override {}
+
+ private:
+  void Enter() {
+    if (busy_.exchange(true)) {
+      overlapped_->store(true);
+    }
+  }
+  void Exit() { busy_.store(false); }
+
+  std::atomic<bool>* const overlapped_;
+  std::atomic<bool> busy_;
+  int16_t sample_;
+};
+
+TEST(CodecExecutorTest, CreateFailsWithoutThreads) {
+  EXPECT_EQ(CodecExecutor::Create(0), nullptr);
+  auto executor = CodecExecutor::Create(2);
+  ASSERT_NE(executor, nullptr);
+  EXPECT_EQ(executor->num_threads(), 2);
+}
+
+TEST(CodecExecutorTest, PinnedWorkersRunSubmittedWork) {
+  auto executor = CodecExecutor::Create(2, /*pin_threads=*/true);
+  ASSERT_NE(executor, nullptr);
+  std::atomic<bool> overlapped(false);
+  const auto session = executor->AddDecoderSession(
+      absl::make_unique<FakeDecoder>(&overlapped), kNumFramesPerPacket);
+  ASSERT_TRUE(session.has_value());
+
+  EXPECT_THAT(executor->SubmitPacket(*session, {3}).get(),
+              Optional(std::vector<int16_t>(kNumSamplesPerPacket, 3)));
+}
+
+TEST(CodecExecutorTest, WorkersOnListedCpusRunSubmittedWork) {
+  EXPECT_EQ(CodecExecutor::CreateOnCpus({}), nullptr);
+  EXPECT_EQ(CodecExecutor::CreateOnCpus({0, -1}), nullptr);
+  auto executor = CodecExecutor::CreateOnCpus({0, 0});
+  ASSERT_NE(executor, nullptr);
+  EXPECT_EQ(executor->num_threads(), 2);
+  std::atomic<bool> overlapped(false);
+  const auto session = executor->AddDecoderSession(
+      absl::make_unique<FakeDecoder>(&overlapped), kNumFramesPerPacket);
+  ASSERT_TRUE(session.has_value());
+
+  EXPECT_THAT(executor->SubmitPacket(*session, {3}).get(),
+              Optional(std::vector<int16_t>(kNumSamplesPerPacket, 3)));
+}
+
+TEST(CodecExecutorTest, AddSessionFailsWithInvalidArguments) {
+  auto executor = CodecExecutor::Create(1);
+  ASSERT_NE(executor, nullptr);
+  EXPECT_FALSE(
+      executor->AddDecoderSession(nullptr, kNumFramesPerPacket).has_value());
+  EXPECT_FALSE(executor->AddDecoderSession(CreateMockDecoder(), 0).has_value());
+  EXPECT_FALSE(executor->AddEncoderSession(nullptr).has_value());
+}
+
+TEST(CodecExecutorTest, SubmitPacketDecodesOnePacket) {
+  auto executor = CodecExecutor::Create(1);
+  ASSERT_NE(executor, nullptr);
+  auto decoder = CreateMockDecoder();
+  EXPECT_CALL(*decoder, SetEncodedPacket(ElementsAre(1, 2)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*decoder, DecodeSamples(kNumSamplesPerPacket))
+      .WillOnce(Return(std::vector<int16_t>(kNumSamplesPerPacket, 3)));
+  EXPECT_CALL(*decoder, DecodePacketLoss(kNumSamplesPerPacket))
+      .WillOnce(Return(std::vector<int16_t>(kNumSamplesPerPacket, 4)));
+  const auto session =
+      executor->AddDecoderSession(std::move(decoder), kNumFramesPerPacket);
+  ASSERT_TRUE(session.has_value());
+
+  EXPECT_THAT(executor->SubmitPacket(*session, {1, 2}).get(),
+              Optional(std::vector<int16_t>(kNumSamplesPerPacket, 3)));
+  EXPECT_THAT(executor->SubmitPacketLoss(*session).get(),
+              Optional(std::vector<int16_t>(kNumSamplesPerPacket, 4)));
+}
+
+TEST(CodecExecutorTest, SubmitPacketFailsWithInvalidPacket) {
+  auto executor = CodecExecutor::Create(1);
+  ASSERT_NE(executor, nullptr);
+  auto decoder = CreateMockDecoder();
+  EXPECT_CALL(*decoder, SetEncodedPacket(_)).WillOnce(Return(false));
+  EXPECT_CALL(*decoder, DecodeSamples(testing::An<int>())).Times(0);
+  const auto session =
+      executor->AddDecoderSession(std::move(decoder), kNumFramesPerPacket);
+  ASSERT_TRUE(session.has_value());
+
+  EXPECT_EQ(executor->SubmitPacket(*session, {1}).get(), absl::nullopt);
+}
+
+TEST(CodecExecutorTest, SubmitPacketIntoDecodesFloats) {
+  auto executor = CodecExecutor::Create(1);
+  ASSERT_NE(executor, nullptr);
+  auto decoder = CreateMockDecoder();
+  EXPECT_CALL(*decoder, SetEncodedPacket(ElementsAre(1, 2)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*decoder, DecodeSamples(testing::An<absl::Span<int16_t>>()))
+      .WillOnce([](absl::Span<int16_t> samples) {
+        std::fill(samples.begin(), samples.end(), -3);
+        return true;
+      });
+  EXPECT_CALL(*decoder, DecodePacketLoss(testing::An<absl::Span<int16_t>>()))
+      .WillOnce([](absl::Span<int16_t> samples) {
+        std::fill(samples.begin(), samples.end(), 4);
+        return true;
+      });
+  const auto session =
+      executor->AddDecoderSession(std::move(decoder), kNumFramesPerPacket);
+  ASSERT_TRUE(session.has_value());
+
+  std::vector<float> samples(kNumSamplesPerPacket);
+  EXPECT_TRUE(executor
+                  ->SubmitPacketInto(*session, std::vector<uint8_t>{1, 2},
+                                     absl::MakeSpan(samples))
+                  .get());
+  EXPECT_EQ(samples, std::vector<float>(kNumSamplesPerPacket, -3.0f));
+  EXPECT_TRUE(executor
+                  ->SubmitPacketInto(*session, absl::nullopt,
+                                     absl::MakeSpan(samples))
+                  .get());
+  EXPECT_EQ(samples, std::vector<float>(kNumSamplesPerPacket, 4.0f));
+
+  // Only whole packets are decoded.
+  std::vector<float> short_samples(kNumSamplesPerPacket - 1);
+  EXPECT_FALSE(executor
+                   ->SubmitPacketInto(*session, absl::nullopt,
+                                      absl::MakeSpan(short_samples))
+                   .get());
+}
+
+TEST(CodecExecutorTest, SubmitAudioEncodes) {
+  auto executor = CodecExecutor::Create(1);
+  ASSERT_NE(executor, nullptr);
+  auto encoder = absl::make_unique<MockLyraEncoder>();
+  EXPECT_CALL(*encoder, Encode(ElementsAre(5, 6)))
+      .WillOnce(Return(std::vector<uint8_t>{7}));
+  const auto session = executor->AddEncoderSession(std::move(encoder));
+  ASSERT_TRUE(session.has_value());
+
+  EXPECT_THAT(executor->SubmitAudio(*session, {5, 6}).get(),
+              Optional(ElementsAre(7)));
+}
+
+TEST(CodecExecutorTest, SubmitFailsForWrongSession) {
+  auto executor = CodecExecutor::Create(1);
+  ASSERT_NE(executor, nullptr);
+  const auto decoder_session =
+      executor->AddDecoderSession(CreateMockDecoder(), kNumFramesPerPacket);
+  const auto encoder_session =
+      executor->AddEncoderSession(absl::make_unique<MockLyraEncoder>());
+  ASSERT_TRUE(decoder_session.has_value());
+  ASSERT_TRUE(encoder_session.has_value());
+
+  EXPECT_EQ(executor->SubmitPacket(*encoder_session, {1}).get(),
+            absl::nullopt);
+  EXPECT_EQ(executor->SubmitPacketLoss(*encoder_session).get(),
+            absl::nullopt);
+  EXPECT_EQ(executor->SubmitAudio(*decoder_session, {1}).get(),
+            absl::nullopt);
+  EXPECT_EQ(executor->SubmitAudio(*encoder_session + 1, {1}).get(),
+            absl::nullopt);
+}
+
+TEST(CodecExecutorTest, RemovedSessionFinishesSubmittedWork) {
+  auto executor = CodecExecutor::Create(1);
+  ASSERT_NE(executor, nullptr);
+  std::atomic<bool> overlapped(false);
+  const auto session = executor->AddDecoderSession(
+      absl::make_unique<FakeDecoder>(&overlapped), kNumFramesPerPacket);
+  ASSERT_TRUE(session.has_value());
+
+  auto future = executor->SubmitPacket(*session, {9});
+  EXPECT_TRUE(executor->RemoveSession(*session));
+  EXPECT_FALSE(executor->RemoveSession(*session));
+  EXPECT_THAT(future.get(),
+              Optional(std::vector<int16_t>(kNumSamplesPerPacket, 9)));
+  EXPECT_EQ(executor->SubmitPacket(*session, {9}).get(), absl::nullopt);
+}
+
+TEST(CodecExecutorTest, SessionsDecodeInOrderOnOneThreadAtATime) {
+  constexpr int kNumSessions = 4;
+  constexpr int kNumPackets = 50;
+  auto executor = CodecExecutor::Create(3);
+  ASSERT_NE(executor, nullptr);
+  std::atomic<bool> overlapped(false);
+  std::vector<CodecExecutor::SessionId> sessions;
+  for (int i = 0; i < kNumSessions; ++i) {
+    const auto session = executor->AddDecoderSession(
+        absl::make_unique<FakeDecoder>(&overlapped), kNumFramesPerPacket);
+    ASSERT_TRUE(session.has_value());
+    sessions.push_back(*session);
+  }
+
+  std::vector<std::vector<std::future<absl::optional<std::vector<int16_t>>>>>
+      futures(kNumSessions);
+  for (int p = 0; p < kNumPackets; ++p) {
+    for (int s = 0; s < kNumSessions; ++s) {
+      futures[s].push_back(executor->SubmitPacket(
+          sessions[s], {static_cast<uint8_t>(s * kNumPackets + p)}));
+    }
+  }
+  for (int s = 0; s < kNumSessions; ++s) {
+    for (int p = 0; p < kNumPackets; ++p) {
+      const absl::optional<std::vector<int16_t>> samples = futures[s][p].get();
+      ASSERT_TRUE(samples.has_value());
+      EXPECT_EQ(samples->at(0), s * kNumPackets + p);
+    }
+  }
+  EXPECT_FALSE(overlapped.load());
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,38 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codec_metrics.h"
+
+#include <algorithm>
+
+namespace chromemedia {
+namespace codec {
+
+void RollingRealTimeFactor::Update(double processing_seconds,
+                                   double audio_seconds) {
+  if (audio_seconds <= 0.0) {
+    return;
+  }
+  const double real_time_factor = processing_seconds / audio_seconds;
+  if (!has_value_) {
+    value_ = real_time_factor;
+    has_value_ = true;
+    return;
+  }
+  const double weight = std::min(1.0, audio_seconds / kSmoothingSeconds);
+  value_ += weight * (real_time_factor - value_);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
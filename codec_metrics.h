@@ -0,0 +1,110 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_CODEC_METRICS_H_
+#define LYRA_CODEC_CODEC_METRICS_H_
+
+#include <cstdint>
+
+namespace chromemedia {
+namespace codec {
+
+// Counters of a decoder since its creation. Times are wall times in
+// nanoseconds, sample counts are at the output sample rate.
+struct DecoderMetrics {
+  int64_t num_samples_decoded = 0;
+  // Samples of received packets generated by the generative model.
+  int64_t num_model_samples = 0;
+  // Samples of the comfort noise generator, for silence or lost packets.
+  int64_t num_comfort_noise_samples = 0;
+  // Samples of lost packets concealed with the generative model.
+  int64_t num_concealed_samples = 0;
+  // Late packets whose concealment was replaced by |RecoverLatePacket|.
+  int64_t num_recovered_packets = 0;
+  // Packets played out longer or shorter by |SetStretchedEncodedPacket|.
+  int64_t num_stretched_packets = 0;
+  // Frames whose conditioning |PrepareConcealment| precomputed, and that
+  // concealment then used or that were dropped since a packet came first.
+  int64_t num_prepared_frames_used = 0;
+  int64_t num_prepared_frames_discarded = 0;
+  // How often the generative model was parked after a while of only comfort
+  // noise, and the longest it took to unpark it for the next packet.
+  int64_t num_parks = 0;
+  int64_t max_unpark_nanos = 0;
+  // Time the generative model and the comfort noise generator spent running
+  // their conditioning, including conditioning precomputed in the background.
+  int64_t conditioning_nanos = 0;
+  // Time spent generating samples from the conditioning.
+  int64_t sampling_nanos = 0;
+  // Time spent resampling to and from the internal sample rate.
+  int64_t resampling_nanos = 0;
+  // The longest call that decoded samples.
+  int64_t max_call_nanos = 0;
+  // Decoding time per second of decoded audio, averaged over about the last
+  // |RollingRealTimeFactor::kSmoothingSeconds| of audio.
+  double real_time_factor = 0.0;
+  // Calls that went through a path that allocates its output or scratch
+  // buffers, such as the vector returning methods, comfort noise and packet
+  // loss concealment.
+  int64_t num_allocating_calls = 0;
+};
+
+// Counters of an encoder since its creation, like |DecoderMetrics|.
+struct EncoderMetrics {
+  int64_t num_packets_encoded = 0;
+  int64_t num_frames_extracted = 0;
+  int64_t num_packets_quantized = 0;
+  // Packets sent empty because discontinuous transmission found them to be
+  // background noise.
+  int64_t num_dtx_packets = 0;
+  // Time spent resampling to the internal sample rate.
+  int64_t resampling_nanos = 0;
+  // Time spent denoising and high-pass filtering before feature extraction.
+  int64_t filtering_nanos = 0;
+  int64_t extraction_nanos = 0;
+  // Time discontinuous transmission spent comparing frames to the noise
+  // estimate and updating it.
+  int64_t noise_estimation_nanos = 0;
+  int64_t quantization_nanos = 0;
+  int64_t packing_nanos = 0;
+  int64_t max_call_nanos = 0;
+  double real_time_factor = 0.0;
+};
+
+// Exponential average of the processing time per second of audio. Every
+// update is weighted by its share of |kSmoothingSeconds| of audio, so the
+// average follows load changes within about that time regardless of how much
+// audio each call processes.
+class RollingRealTimeFactor {
+ public:
+  static constexpr double kSmoothingSeconds = 1.0;
+
+  // Records that processing |audio_seconds| of audio took
+  // |processing_seconds|. Calls with non-positive |audio_seconds| are
+  // ignored. The first call sets the average.
+  void Update(double processing_seconds, double audio_seconds);
+
+  double value() const { return value_; }
+
+ private:
+  double value_ = 0.0;
+  bool has_value_ = false;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_CODEC_METRICS_H_
@@ -0,0 +1,56 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codec_metrics.h"
+
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(RollingRealTimeFactorTest, FirstUpdateSetsValue) {
+  RollingRealTimeFactor real_time_factor;
+  EXPECT_EQ(real_time_factor.value(), 0.0);
+  real_time_factor.Update(0.02, 0.04);
+  EXPECT_DOUBLE_EQ(real_time_factor.value(), 0.5);
+}
+
+TEST(RollingRealTimeFactorTest, IgnoresEmptyAudio) {
+  RollingRealTimeFactor real_time_factor;
+  real_time_factor.Update(1.0, 0.0);
+  EXPECT_EQ(real_time_factor.value(), 0.0);
+  real_time_factor.Update(0.01, 0.04);
+  EXPECT_DOUBLE_EQ(real_time_factor.value(), 0.25);
+}
+
+TEST(RollingRealTimeFactorTest, FollowsLoadWithinSmoothingTime) {
+  RollingRealTimeFactor real_time_factor;
+  real_time_factor.Update(0.0, 0.04);
+  // One update of 40 ms moves the average by 4% of the difference.
+  real_time_factor.Update(0.04, 0.04);
+  EXPECT_NEAR(real_time_factor.value(), 0.04, 1e-9);
+  for (int i = 0; i < 2 * RollingRealTimeFactor::kSmoothingSeconds / 0.04;
+       ++i) {
+    real_time_factor.Update(0.04, 0.04);
+  }
+  EXPECT_GT(real_time_factor.value(), 0.85);
+  // An update of more than the smoothing time replaces the average.
+  real_time_factor.Update(0.2, 2.0);
+  EXPECT_DOUBLE_EQ(real_time_factor.value(), 0.1);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,96 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/strings/str_split.h"
+#include "cold_start_benchmark_lib.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+
+ABSL_FLAG(int, num_instances, 8,
+          "The number of decoders and encoders created, and kept alive, with "
+          "every loader.");
+
+ABSL_FLAG(std::string, loaders, "zipped,unpacked,shared_model",
+          "Comma-separated loaders the instances get their weights from, of "
+          "'zipped' (the shipped gzipped files), 'unpacked' (a copy written "
+          "by UnpackModel) and 'shared_model' (one LyraModel for all).");
+
+ABSL_FLAG(int, sample_rate_hz, 16000, "Sample rate of every instance.");
+
+ABSL_FLAG(int, num_threads, 1, "The number of threads of every decoder.");
+
+ABSL_FLAG(std::string, precision, "",
+          "Arithmetic of the decoders, one of 'float', 'fixed16' or "
+          "'bfloat16'. Defaults to the precision the binary was built for.");
+
+ABSL_FLAG(std::string, unpacked_model_dir, "",
+          "Where the model is unpacked to for the 'unpacked' loader. Defaults "
+          "to a directory in the system's temporary directory.");
+
+ABSL_FLAG(bool, use_huge_pages, false,
+          "Whether the shared model backs its weights with transparent huge "
+          "pages.");
+
+ABSL_FLAG(std::string, json_path, "",
+          "If set, the results are written to this path as JSON.");
+
+ABSL_FLAG(
+    std::string, model_path, "wavegru",
+    "Path to directory containing model weights and quant files. For mobile "
+    "this is the absolute path, like '/sdcard/wavegru/'. For desktop this is "
+    "the path relative to the binary.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  chromemedia::codec::ColdStartBenchmarkOptions options;
+  options.loaders.clear();
+  for (const absl::string_view name :
+       absl::StrSplit(absl::GetFlag(FLAGS_loaders), ',')) {
+    const auto loader_or =
+        chromemedia::codec::ModelLoaderFromName(std::string(name));
+    if (!loader_or.has_value()) {
+      LOG(ERROR) << "Unknown loader '" << name << "'.";
+      return -1;
+    }
+    options.loaders.push_back(loader_or.value());
+  }
+
+  const std::string precision_name = absl::GetFlag(FLAGS_precision);
+  if (!precision_name.empty()) {
+    const auto precision_or =
+        chromemedia::codec::ComputePrecisionFromName(precision_name);
+    if (!precision_or.has_value()) {
+      LOG(ERROR) << "Unknown precision '" << precision_name << "'.";
+      return -1;
+    }
+    options.precision = precision_or.value();
+  }
+
+  options.model_base_path = absl::GetFlag(FLAGS_model_path);
+  options.num_instances = absl::GetFlag(FLAGS_num_instances);
+  options.sample_rate_hz = absl::GetFlag(FLAGS_sample_rate_hz);
+  options.num_threads = absl::GetFlag(FLAGS_num_threads);
+  options.unpacked_model_dir = absl::GetFlag(FLAGS_unpacked_model_dir);
+  options.use_huge_pages = absl::GetFlag(FLAGS_use_huge_pages);
+
+  return chromemedia::codec::benchmark_cold_start(
+      options, absl::GetFlag(FLAGS_json_path));
+}
@@ -0,0 +1,362 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cold_start_benchmark_lib.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "architecture_utils.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "huge_pages.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_encoder.h"
+#include "lyra_model.h"
+#include "model_unpacker.h"
+#include "thread_pool.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr char kDecoder[] = "decoder";
+constexpr char kEncoder[] = "encoder";
+
+// Creates instances through |create| until |num_instances| are alive at the
+// same time, and returns the time of every call and the memory they take.
+// Returns a nullopt if an instance could not be created.
+template <typename Instance>
+absl::optional<ColdStartResult> CreateInstances(
+    int num_instances, ModelLoader loader, const std::string& component,
+    const std::function<std::unique_ptr<Instance>()>& create) {
+  ColdStartResult result;
+  result.loader = loader;
+  result.component = component;
+  const bool can_reset_peak = ResetPeakResidentMemory();
+  const int64_t memory_before = ResidentMemoryBytes();
+  const int64_t huge_pages_before = AnonymousHugePageBytes();
+  std::vector<std::unique_ptr<Instance>> instances;
+  std::vector<int64_t> create_timings;
+  for (int i = 0; i < num_instances; ++i) {
+    const int64_t resident_before = ResidentMemoryBytes();
+    if (can_reset_peak) {
+      ResetPeakResidentMemory();
+    }
+    const absl::Time start = absl::Now();
+    std::unique_ptr<Instance> instance = create();
+    create_timings.push_back(absl::ToInt64Microseconds(absl::Now() - start));
+    if (instance == nullptr) {
+      LOG(ERROR) << "Could not create " << component << " " << i << " with "
+                 << ModelLoaderName(loader) << " loader.";
+      return absl::nullopt;
+    }
+    if (can_reset_peak) {
+      result.peak_bytes_per_instance =
+          std::max(result.peak_bytes_per_instance,
+                   PeakResidentMemoryBytes() - resident_before);
+    }
+    instances.push_back(std::move(instance));
+  }
+  const int64_t memory_after = ResidentMemoryBytes();
+  if (memory_before > 0 && memory_after > 0) {
+    result.steady_bytes_per_instance =
+        static_cast<double>(memory_after - memory_before) / num_instances;
+  }
+  result.huge_page_bytes = AnonymousHugePageBytes() - huge_pages_before;
+  result.create = GetTimingStats(create_timings);
+  return result;
+}
+
+// Times |num_calls| runs of the checks |Create| of |role| starts with.
+TimingStats TimeAssetProbing(const ColdStartBenchmarkOptions& options,
+                             const ghc::filesystem::path& model_path,
+                             ModelRole role, int num_calls) {
+  std::vector<int64_t> timings;
+  for (int i = 0; i < num_calls; ++i) {
+    const absl::Time start = absl::Now();
+    const absl::Status status = AreParamsSupported(
+        options.sample_rate_hz, kNumChannels, kBitrate, model_path, role);
+    timings.push_back(absl::ToInt64Microseconds(absl::Now() - start));
+    LOG_IF(WARNING, !status.ok()) << status;
+  }
+  return GetTimingStats(timings);
+}
+
+// Times |num_calls| thread pools of a decoder, from starting to joining the
+// threads.
+TimingStats TimeThreadStartup(int num_threads, int num_calls) {
+  std::vector<int64_t> timings;
+  for (int i = 0; i < num_calls; ++i) {
+    const absl::Time start = absl::Now();
+    ThreadPool::Create(num_threads).reset();
+    timings.push_back(absl::ToInt64Microseconds(absl::Now() - start));
+  }
+  return GetTimingStats(timings);
+}
+
+// Creates the decoders or encoders of one loader from |model_path| and
+// appends their result to |results|.
+bool BenchmarkLoader(const ColdStartBenchmarkOptions& options,
+                     ModelLoader loader, const std::string& component,
+                     const ghc::filesystem::path& model_path,
+                     std::vector<ColdStartResult>* results) {
+  std::shared_ptr<LyraModel> model;
+  int64_t shared_model_microsecs = 0;
+  if (loader == ModelLoader::kSharedModel) {
+    const absl::Time start = absl::Now();
+    model = LyraModel::Create(model_path, options.use_huge_pages);
+    shared_model_microsecs = absl::ToInt64Microseconds(absl::Now() - start);
+    if (model == nullptr) {
+      LOG(ERROR) << "Could not create the shared model.";
+      return false;
+    }
+  }
+
+  absl::optional<ColdStartResult> result;
+  if (component == kDecoder) {
+    result = CreateInstances<LyraDecoder>(
+        options.num_instances, loader, component,
+        [&]() -> std::unique_ptr<LyraDecoder> {
+          if (model != nullptr) {
+            return LyraDecoder::Create(options.sample_rate_hz, kNumChannels,
+                                       kBitrate, model, options.num_threads,
+                                       options.precision);
+          }
+          return LyraDecoder::Create(options.sample_rate_hz, kNumChannels,
+                                     kBitrate, model_path, options.num_threads,
+                                     options.precision);
+        });
+  } else {
+    result = CreateInstances<LyraEncoder>(
+        options.num_instances, loader, component,
+        [&]() -> std::unique_ptr<LyraEncoder> {
+          if (model != nullptr) {
+            return LyraEncoder::Create(options.sample_rate_hz, kNumChannels,
+                                       kBitrate, /*enable_dtx=*/false, model);
+          }
+          return LyraEncoder::Create(options.sample_rate_hz, kNumChannels,
+                                     kBitrate, /*enable_dtx=*/false,
+                                     model_path);
+        });
+  }
+  if (!result.has_value()) {
+    return false;
+  }
+  result->asset_probing = TimeAssetProbing(
+      options, model_path,
+      component == kDecoder ? ModelRole::kDecoder : ModelRole::kEncoder,
+      options.num_instances);
+  result->thread_startup =
+      component == kDecoder
+          ? TimeThreadStartup(options.num_threads, options.num_instances)
+          : TimingStats{};
+  result->shared_model_microsecs = shared_model_microsecs;
+  LOG(INFO) << component << " with " << ModelLoaderName(loader)
+            << " loader: create mean " << result->create.mean_microsecs
+            << " us, max " << result->create.max_microsecs << " us, "
+            << static_cast<int64_t>(result->steady_bytes_per_instance)
+            << " steady and " << result->peak_bytes_per_instance
+            << " peak bytes per instance, " << result->huge_page_bytes
+            << " bytes in huge pages.";
+  results->push_back(std::move(result.value()));
+  return true;
+}
+
+// Returns the result of |component| with |loader| in |results|, or null.
+const ColdStartResult* FindResult(const std::vector<ColdStartResult>& results,
+                                  ModelLoader loader,
+                                  const std::string& component) {
+  for (const ColdStartResult& result : results) {
+    if (result.loader == loader && result.component == component) {
+      return &result;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+const char* ModelLoaderName(ModelLoader loader) {
+  switch (loader) {
+    case ModelLoader::kZipped:
+      return "zipped";
+    case ModelLoader::kUnpacked:
+      return "unpacked";
+    case ModelLoader::kSharedModel:
+      return "shared_model";
+  }
+  return "unknown";
+}
+
+absl::optional<ModelLoader> ModelLoaderFromName(const std::string& name) {
+  for (const ModelLoader loader : {ModelLoader::kZipped, ModelLoader::kUnpacked,
+                                   ModelLoader::kSharedModel}) {
+    if (name == ModelLoaderName(loader)) {
+      return loader;
+    }
+  }
+  return absl::nullopt;
+}
+
+CreateBreakdown BreakDownCreate(const ColdStartResult& zipped,
+                                const ColdStartResult& unpacked) {
+  CreateBreakdown breakdown;
+  breakdown.asset_probing_microsecs = unpacked.asset_probing.mean_microsecs;
+  breakdown.thread_startup_microsecs = unpacked.thread_startup.mean_microsecs;
+  breakdown.gzip_decode_microsecs =
+      std::max<int64_t>(0, zipped.create.mean_microsecs -
+                               unpacked.create.mean_microsecs);
+  breakdown.layer_construction_microsecs = std::max<int64_t>(
+      0, unpacked.create.mean_microsecs - breakdown.asset_probing_microsecs -
+             breakdown.thread_startup_microsecs);
+  return breakdown;
+}
+
+std::string FormatColdStartJson(const ColdStartBenchmarkOptions& options,
+                                const HostInfo& host,
+                                const std::vector<ColdStartResult>& results) {
+  std::string json = absl::StrFormat(
+      "{\n"
+      "  \"host\": %s,\n"
+      "  \"config\": {\"num_instances\": %d, \"sample_rate_hz\": %d, "
+      "\"num_threads\": %d, \"compute_type\": \"%s\", "
+      "\"use_huge_pages\": %s},\n"
+      "  \"results\": [",
+      FormatHostInfoJson(host), options.num_instances, options.sample_rate_hz,
+      options.num_threads, ComputePrecisionName(options.precision),
+      options.use_huge_pages ? "true" : "false");
+  for (int i = 0; i < static_cast<int>(results.size()); ++i) {
+    const ColdStartResult& result = results[i];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"loader\": \"%s\", \"component\": \"%s\", "
+        "\"shared_model_us\": %d, \"steady_bytes_per_instance\": %.0f, "
+        "\"peak_bytes_per_instance\": %d, \"huge_page_bytes\": %d,\n"
+        "     \"create\": %s,\n"
+        "     \"asset_probing\": %s,\n"
+        "     \"thread_startup\": %s}",
+        i == 0 ? "" : ",", ModelLoaderName(result.loader),
+        EscapeJson(result.component), result.shared_model_microsecs,
+        result.steady_bytes_per_instance, result.peak_bytes_per_instance,
+        result.huge_page_bytes, FormatTimingStatsJson(result.create),
+        FormatTimingStatsJson(result.asset_probing),
+        FormatTimingStatsJson(result.thread_startup));
+  }
+  json += "\n  ],\n  \"breakdowns\": [";
+  bool first = true;
+  for (const std::string component : {kDecoder, kEncoder}) {
+    const ColdStartResult* zipped =
+        FindResult(results, ModelLoader::kZipped, component);
+    const ColdStartResult* unpacked =
+        FindResult(results, ModelLoader::kUnpacked, component);
+    if (zipped == nullptr || unpacked == nullptr) {
+      continue;
+    }
+    const CreateBreakdown breakdown = BreakDownCreate(*zipped, *unpacked);
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"component\": \"%s\", \"asset_probing_us\": %d, "
+        "\"gzip_decode_us\": %d, \"layer_construction_us\": %d, "
+        "\"thread_startup_us\": %d}",
+        first ? "" : ",", component, breakdown.asset_probing_microsecs,
+        breakdown.gzip_decode_microsecs,
+        breakdown.layer_construction_microsecs,
+        breakdown.thread_startup_microsecs);
+    first = false;
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+int benchmark_cold_start(const ColdStartBenchmarkOptions& options,
+                         const std::string& json_path) {
+  if (options.num_instances <= 0) {
+    LOG(ERROR) << "The number of instances has to be positive.";
+    return -1;
+  }
+  const ghc::filesystem::path model_path =
+      GetCompleteArchitecturePath(options.model_base_path);
+  ghc::filesystem::path unpacked_model_path = options.unpacked_model_dir;
+  if (std::find(options.loaders.begin(), options.loaders.end(),
+                ModelLoader::kUnpacked) != options.loaders.end()) {
+    if (unpacked_model_path.empty()) {
+      std::error_code error;
+      unpacked_model_path =
+          ghc::filesystem::temp_directory_path(error) / "lyra_cold_start";
+    }
+    if (!UnpackModel(model_path, unpacked_model_path)) {
+      LOG(ERROR) << "Could not unpack the model to " << unpacked_model_path
+                 << ".";
+      return -1;
+    }
+  }
+
+  std::vector<ColdStartResult> results;
+  for (const std::string component : {kDecoder, kEncoder}) {
+    for (const ModelLoader loader : options.loaders) {
+      if (!BenchmarkLoader(options, loader, component,
+                           loader == ModelLoader::kUnpacked
+                               ? unpacked_model_path
+                               : model_path,
+                           &results)) {
+        return -1;
+      }
+    }
+    const ColdStartResult* zipped =
+        FindResult(results, ModelLoader::kZipped, component);
+    const ColdStartResult* unpacked =
+        FindResult(results, ModelLoader::kUnpacked, component);
+    if (zipped != nullptr && unpacked != nullptr) {
+      const CreateBreakdown breakdown = BreakDownCreate(*zipped, *unpacked);
+      LOG(INFO) << component << " create breakdown: asset probing "
+                << breakdown.asset_probing_microsecs << " us, gzip decode "
+                << breakdown.gzip_decode_microsecs
+                << " us, layer construction "
+                << breakdown.layer_construction_microsecs
+                << " us, thread startup "
+                << breakdown.thread_startup_microsecs << " us.";
+    }
+  }
+
+  if (json_path.empty()) {
+    return 0;
+  }
+  std::ofstream json(json_path);
+  json << FormatColdStartJson(options, GetHostInfo(), results);
+  if (!json) {
+    LOG(ERROR) << "Could not write " << json_path << ".";
+    return -1;
+  }
+  LOG(INFO) << "Wrote results to " << json_path << ".";
+  return 0;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_COLD_START_BENCHMARK_LIB_H_
+#define LYRA_CODEC_COLD_START_BENCHMARK_LIB_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Where the instances of a cold start benchmark get their weights from.
+enum class ModelLoader {
+  // Every instance reads and decompresses the gzipped model files.
+  kZipped,
+  // Every instance reads the model written by |UnpackModel|, which skips
+  // decompressing.
+  kUnpacked,
+  // One |LyraModel| is created up front and every instance shares its
+  // weights.
+  kSharedModel,
+};
+
+const char* ModelLoaderName(ModelLoader loader);
+
+// Inverse of |ModelLoaderName|. Returns a nullopt for unknown names.
+absl::optional<ModelLoader> ModelLoaderFromName(const std::string& name);
+
+struct ColdStartBenchmarkOptions {
+  std::string model_base_path;
+  // Instances of each component created, and kept alive, per loader.
+  int num_instances = 8;
+  int sample_rate_hz = 16000;
+  // Threads of every decoder.
+  int num_threads = 1;
+  ComputePrecision precision = kDefaultComputePrecision;
+  std::vector<ModelLoader> loaders = {
+      ModelLoader::kZipped, ModelLoader::kUnpacked, ModelLoader::kSharedModel};
+  // Where the model is unpacked to for |ModelLoader::kUnpacked|. Defaults to
+  // a directory in the temporary directory of the system if empty.
+  std::string unpacked_model_dir;
+  // Whether the shared |LyraModel| backs its weights with transparent huge
+  // pages.
+  bool use_huge_pages = false;
+};
+
+// Creation of |num_instances| instances of one component with one loader.
+struct ColdStartResult {
+  ModelLoader loader;
+  // "decoder" or "encoder".
+  std::string component;
+  // Wall time of each |Create| call.
+  TimingStats create;
+  // Wall time of checking the parameters and probing the model files, as
+  // |Create| does first.
+  TimingStats asset_probing;
+  // Wall time of starting and stopping the thread pool of a decoder. Zero for
+  // encoders, which have none.
+  TimingStats thread_startup;
+  // Wall time of creating the shared |LyraModel|, once for all instances.
+  // Zero for the other loaders.
+  int64_t shared_model_microsecs = 0;
+  // Growth of the resident memory over all instances, divided by their
+  // number.
+  double steady_bytes_per_instance = 0.0;
+  // The largest growth of the peak resident memory during a |Create| call
+  // over the resident memory before it, or 0 where the peak cannot be reset.
+  int64_t peak_bytes_per_instance = 0;
+  // Growth of the memory backed by transparent huge pages over all
+  // instances, or 0 where the kernel does not report it.
+  int64_t huge_page_bytes = 0;
+};
+
+// Mean time of the stages of |Create|, in microseconds. Decompression is
+// the difference between the gzipped and the unpacked loader, and layer
+// construction what remains of creating from the unpacked model.
+struct CreateBreakdown {
+  int64_t asset_probing_microsecs;
+  int64_t gzip_decode_microsecs;
+  int64_t layer_construction_microsecs;
+  int64_t thread_startup_microsecs;
+};
+
+CreateBreakdown BreakDownCreate(const ColdStartResult& zipped,
+                                const ColdStartResult& unpacked);
+
+// Returns |results| of a benchmark with |options| on |host| as a JSON
+// object, with the breakdown of |Create| of every component for which both
+// the gzipped and the unpacked loader ran.
+std::string FormatColdStartJson(const ColdStartBenchmarkOptions& options,
+                                const HostInfo& host,
+                                const std::vector<ColdStartResult>& results);
+
+// Creates |options.num_instances| decoders and then as many encoders with
+// every loader in |options.loaders|, keeping each batch alive until all of
+// it is created, and logs the time and memory of every batch and the
+// breakdown of |Create|. Unless |json_path| is empty, writes the results
+// there as JSON. Returns 0 on success.
+int benchmark_cold_start(const ColdStartBenchmarkOptions& options,
+                         const std::string& json_path);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_COLD_START_BENCHMARK_LIB_H_
@@ -0,0 +1,144 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cold_start_benchmark_lib.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "absl/types/optional.h"
+#include "benchmark_decode_lib.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+using testing::Not;
+
+ColdStartResult ResultWithMeans(ModelLoader loader,
+                                const std::string& component,
+                                int64_t create_microsecs,
+                                int64_t asset_probing_microsecs,
+                                int64_t thread_startup_microsecs) {
+  ColdStartResult result;
+  result.loader = loader;
+  result.component = component;
+  result.create = GetTimingStats({create_microsecs});
+  result.asset_probing = GetTimingStats({asset_probing_microsecs});
+  result.thread_startup = GetTimingStats({thread_startup_microsecs});
+  return result;
+}
+
+TEST(ModelLoaderTest, NamesRoundTrip) {
+  for (const ModelLoader loader : {ModelLoader::kZipped, ModelLoader::kUnpacked,
+                                   ModelLoader::kSharedModel}) {
+    EXPECT_EQ(ModelLoaderFromName(ModelLoaderName(loader)), loader);
+  }
+  EXPECT_FALSE(ModelLoaderFromName("mmap").has_value());
+}
+
+TEST(BreakDownCreateTest, AttributesDifferenceToGzipDecode) {
+  const CreateBreakdown breakdown = BreakDownCreate(
+      ResultWithMeans(ModelLoader::kZipped, "decoder", 9000, 120, 300),
+      ResultWithMeans(ModelLoader::kUnpacked, "decoder", 2000, 100, 250));
+
+  EXPECT_EQ(breakdown.asset_probing_microsecs, 100);
+  EXPECT_EQ(breakdown.thread_startup_microsecs, 250);
+  EXPECT_EQ(breakdown.gzip_decode_microsecs, 7000);
+  EXPECT_EQ(breakdown.layer_construction_microsecs, 1650);
+}
+
+TEST(BreakDownCreateTest, ClampsNoiseToZero) {
+  const CreateBreakdown breakdown = BreakDownCreate(
+      ResultWithMeans(ModelLoader::kZipped, "encoder", 100, 50, 0),
+      ResultWithMeans(ModelLoader::kUnpacked, "encoder", 120, 200, 0));
+
+  EXPECT_EQ(breakdown.gzip_decode_microsecs, 0);
+  EXPECT_EQ(breakdown.layer_construction_microsecs, 0);
+}
+
+TEST(FormatColdStartJsonTest, ContainsResultsAndBreakdowns) {
+  ColdStartBenchmarkOptions options;
+  options.num_instances = 4;
+  HostInfo host;
+  host.cpu_model = "test cpu";
+  host.cpu_isa = "generic";
+  host.num_cpus = 2;
+  ColdStartResult shared =
+      ResultWithMeans(ModelLoader::kSharedModel, "decoder", 500, 100, 250);
+  shared.shared_model_microsecs = 8000;
+  shared.steady_bytes_per_instance = 1024.0;
+  shared.peak_bytes_per_instance = 4096;
+  const std::vector<ColdStartResult> results = {
+      ResultWithMeans(ModelLoader::kZipped, "decoder", 9000, 120, 300),
+      ResultWithMeans(ModelLoader::kUnpacked, "decoder", 2000, 100, 250),
+      shared,
+      ResultWithMeans(ModelLoader::kZipped, "encoder", 900, 100, 0)};
+
+  const std::string json = FormatColdStartJson(options, host, results);
+
+  EXPECT_THAT(json, HasSubstr("\"num_instances\": 4"));
+  EXPECT_THAT(json, HasSubstr("\"loader\": \"shared_model\", "
+                              "\"component\": \"decoder\", "
+                              "\"shared_model_us\": 8000, "
+                              "\"steady_bytes_per_instance\": 1024, "
+                              "\"peak_bytes_per_instance\": 4096"));
+  EXPECT_THAT(json, HasSubstr("{\"component\": \"decoder\", "
+                              "\"asset_probing_us\": 100, "
+                              "\"gzip_decode_us\": 7000, "
+                              "\"layer_construction_us\": 1650, "
+                              "\"thread_startup_us\": 250}"));
+  // The encoder only ran with one loader, so it has no breakdown.
+  EXPECT_THAT(json, Not(HasSubstr("{\"component\": \"encoder\"")));
+}
+
+TEST(BenchmarkColdStartTest, UnpackedLoaderCreatesEveryComponent) {
+  const ghc::filesystem::path output_dir =
+      ghc::filesystem::path(testing::TempDir()) / "cold_start_benchmark";
+  ASSERT_TRUE(ghc::filesystem::create_directories(output_dir) ||
+              ghc::filesystem::is_directory(output_dir));
+  ColdStartBenchmarkOptions options;
+  options.model_base_path = "wavegru";
+  options.num_instances = 1;
+  options.loaders = {ModelLoader::kZipped, ModelLoader::kUnpacked};
+  options.unpacked_model_dir = (output_dir / "unpacked").string();
+  const std::string json_path = (output_dir / "cold_start.json").string();
+
+  ASSERT_EQ(benchmark_cold_start(options, json_path), 0);
+
+  std::ifstream json_file(json_path);
+  std::stringstream json;
+  json << json_file.rdbuf();
+  for (const char* component : {"decoder", "encoder"}) {
+    EXPECT_THAT(json.str(),
+                HasSubstr(absl::StrFormat(
+                    "\"loader\": \"unpacked\", \"component\": \"%s\"",
+                    component)));
+    EXPECT_THAT(json.str(), HasSubstr(absl::StrFormat(
+                                "{\"component\": \"%s\", "
+                                "\"asset_probing_us\"",
+                                component)));
+  }
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
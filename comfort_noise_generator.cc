@@ -14,27 +14,28 @@
 
 #include "comfort_noise_generator.h"
 
+#include <algorithm>
 #include <cmath>
-#include <complex>
 #include <cstdint>
-#include <iterator>
 #include <memory>
 #include <utility>
 #include <vector>
 
+#include "Eigen/Core"
 #include "absl/memory/memory.h"
 #include "absl/random/random.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
-#include "audio/dsp/mfcc/mel_filterbank.h"
+#include "absl/types/span.h"
 #include "audio/dsp/number_util.h"
-#include "audio/dsp/spectrogram/inverse_spectrogram.h"
 #include "dsp_util.h"
 #include "glog/logging.h"
 #include "log_mel_spectrogram_extractor_impl.h"
+#include "state_buffer.h"
 
-#ifdef BENCHMARK
-#include "absl/time/clock.h"
-#endif  // BENCHMARK
+// The real FFT of fft2d, see fft2d/fftsg.c.
+extern "C" void rdft(int n, int isgn, double* a, int* ip, double* w);
 
 namespace chromemedia {
 namespace codec {
@@ -45,150 +46,229 @@ std::unique_ptr<ComfortNoiseGenerator> ComfortNoiseGenerator::Create(
   const int kFftSize = static_cast<int>(
       audio_dsp::NextPowerOfTwo(static_cast<unsigned>(window_length_samples)));
   const int kNumFftBins = kFftSize / 2 + 1;
-
-  auto mel_filterbank = absl::make_unique<audio_dsp::MelFilterbank>();
-  if (!mel_filterbank->Initialize(
-          kNumFftBins, static_cast<double>(sample_rate_hz), num_mel_bins,
-          LogMelSpectrogramExtractorImpl::GetLowerFreqLimit(),
-          LogMelSpectrogramExtractorImpl::GetUpperFreqLimit(sample_rate_hz))) {
-    LOG(ERROR) << "Could not initialize mel filterbank.";
+  if (sample_rate_hz <= 0 || num_mel_bins <= 0 || kNumFftBins < 2) {
+    LOG(ERROR) << "Could not create mel filters for " << num_mel_bins
+               << " bins at " << sample_rate_hz << " Hz and a window of "
+               << window_length_samples << " samples.";
     return nullptr;
   }
-
-  auto inverse_spectrogram = absl::make_unique<audio_dsp::InverseSpectrogram>();
-  if (!inverse_spectrogram->Initialize(kFftSize, hop_length_samples)) {
-    LOG(ERROR) << "Could not initialize inverse spectrogram.";
+  if (hop_length_samples <= 0 || hop_length_samples > kFftSize) {
+    LOG(ERROR) << "Hop length samples was " << hop_length_samples
+               << " but must be positive and at most " << kFftSize << ".";
     return nullptr;
   }
 
-  return absl::WrapUnique(new ComfortNoiseGenerator(
-      kNumFftBins, sample_rate_hz, num_mel_bins, hop_length_samples,
-      std::move(mel_filterbank), std::move(inverse_spectrogram)));
+  // Each mel feature is the weighted sum of the bins of its filter, so a flat
+  // spectrum gives features of that value times the sum of the weights of the
+  // filter. The inverse therefore averages each feature over its filter and
+  // interpolates the averages of the filters each bin falls in. Filters
+  // without any bins carry no information and are skipped.
+  const std::vector<std::vector<double>> mel_weights =
+      LogMelSpectrogramExtractorImpl::GetMelWeights(sample_rate_hz,
+                                                    num_mel_bins, kNumFftBins);
+  std::vector<double> filter_weight_sums(num_mel_bins);
+  for (int c = 0; c < num_mel_bins; ++c) {
+    for (double weight : mel_weights[c]) {
+      filter_weight_sums[c] += weight;
+    }
+  }
+  std::vector<InverseMelBin> inverse_mel_bins(kNumFftBins);
+  for (int k = 0; k < kNumFftBins; ++k) {
+    int first_channel = num_mel_bins;
+    int last_channel = -1;
+    for (int c = 0; c < num_mel_bins; ++c) {
+      if (mel_weights[c][k] != 0.0 && filter_weight_sums[c] > 0.0) {
+        first_channel = std::min(first_channel, c);
+        last_channel = c;
+      }
+    }
+    InverseMelBin& bin = inverse_mel_bins[k];
+    bin.first_channel = std::min(first_channel, num_mel_bins - 1);
+    for (int c = first_channel; c <= last_channel; ++c) {
+      bin.weights.push_back(
+          filter_weight_sums[c] > 0.0
+              ? static_cast<float>(mel_weights[c][k] / filter_weight_sums[c])
+              : 0.f);
+    }
+  }
+
+  return absl::WrapUnique(
+      new ComfortNoiseGenerator(std::move(inverse_mel_bins), kFftSize,
+                                num_mel_bins, hop_length_samples));
 }
 
 ComfortNoiseGenerator::ComfortNoiseGenerator(
-    int num_fft_bins, int sample_rate_hz, int num_mel_bins,
-    int hop_length_samples,
-    std::unique_ptr<audio_dsp::MelFilterbank> mel_filterbank,
-    std::unique_ptr<audio_dsp::InverseSpectrogram> inverse_spectrogram)
-    : mel_filterbank_(std::move(mel_filterbank)),
-      inverse_spectrogram_(std::move(inverse_spectrogram)),
-      num_fft_bins_(num_fft_bins),
+    std::vector<InverseMelBin> inverse_mel_bins, int fft_size,
+    int num_mel_bins, int hop_length_samples)
+    : inverse_mel_bins_(std::move(inverse_mel_bins)),
+      fft_size_(fft_size),
       num_mel_bins_(num_mel_bins),
-      hop_length_samples_(hop_length_samples) {}
+      hop_length_samples_(hop_length_samples),
+      mel_features_(num_mel_bins),
+      magnitudes_(inverse_mel_bins_.size()),
+      phases_(inverse_mel_bins_.size()),
+      fft_buffer_(fft_size),
+      // Sizes required by rdft. A zero first entry makes it compute the
+      // tables on the first call.
+      fft_ip_(2 + static_cast<int>(std::ceil(std::sqrt(fft_size / 2.0))), 0),
+      fft_w_(fft_size / 2, 0.0),
+      overlap_(fft_size, 0.f),
+      // A request of up to one hop is only synthesized when fewer samples are
+      // buffered, so at most two hops minus one are ever buffered.
+      samples_(2 * hop_length_samples),
+      samples_start_(0),
+      num_samples_buffered_(0) {
+  log_mel_features_.reserve(num_mel_bins);
+}
 
-void ComfortNoiseGenerator::AddFeatures(const std::vector<float>& features) {
-  log_mel_features_ = features;
-#ifdef BENCHMARK
+void ComfortNoiseGenerator::AddFeatures(absl::Span<const float> features) {
   // No conditioning happens in the comfort noise generator.
-  conditioning_timings_microsecs_.push_back(0);
-#endif  // BENCHMARK
+  log_mel_features_.assign(features.begin(), features.end());
 }
 
 absl::optional<std::vector<int16_t>> ComfortNoiseGenerator::GenerateSamples(
     int num_samples) {
-  if (num_samples > hop_length_samples_) {
-    LOG(ERROR) << "Number of samples requested cannot be larger than the "
-                  "hop length.";
-    return absl::nullopt;
-  }
   if (num_samples < 0) {
     LOG(ERROR)
         << "Number of samples requested must be greater than or equal to 0.";
     return absl::nullopt;
   }
+  std::vector<int16_t> samples(num_samples);
+  if (!GenerateSamplesInto(absl::MakeSpan(samples))) {
+    return absl::nullopt;
+  }
+  return samples;
+}
+
+bool ComfortNoiseGenerator::GenerateSamplesInto(absl::Span<int16_t> samples) {
+  const int num_samples = samples.size();
+  if (num_samples > hop_length_samples_) {
+    LOG(ERROR) << "Number of samples requested cannot be larger than the "
+                  "hop length.";
+    return false;
+  }
   if (log_mel_features_.size() != num_mel_bins_) {
     LOG(ERROR) << "Size of features is " << log_mel_features_.size()
                << ", but should be " << num_mel_bins_ << ".";
-    return absl::nullopt;
+    return false;
   }
 
-#ifdef BENCHMARK
-  const int64_t comfort_noise_generator_start_microsecs =
-      absl::ToUnixMicros(absl::Now());
-#endif  // BENCHMARK
+  const absl::Time sampling_start = absl::Now();
 
   // Ensure there are enough samples in the buffer to return the requested
   // amount.
-  if (num_samples > reconstructed_samples_.size()) {
-    if (!FftFromFeatures()) return absl::nullopt;
-    if (!InvertFft()) return absl::nullopt;
+  if (num_samples > num_samples_buffered_) {
+    MagnitudesFromFeatures();
+    SynthesizeHop();
   }
 
   // Only return the number of samples requested and remove the returned samples
-  // from the buffer.
-  std::vector<int16_t> samples_to_return(
-      reconstructed_samples_.begin(),
-      reconstructed_samples_.begin() + num_samples);
-  reconstructed_samples_.erase(reconstructed_samples_.begin(),
-                               reconstructed_samples_.begin() + num_samples);
-
-#ifdef BENCHMARK
-  model_timings_microsecs_.push_back(absl::ToUnixMicros(absl::Now()) -
-                                     comfort_noise_generator_start_microsecs);
-#endif  // BENCHMARK
-
-  return samples_to_return;
+  // from the buffer, which wraps around its end at most once.
+  const int capacity = samples_.size();
+  const int num_before_end = std::min(num_samples, capacity - samples_start_);
+  const auto start = samples_.begin() + samples_start_;
+  std::copy(start, start + num_before_end, samples.begin());
+  std::copy(samples_.begin(), samples_.begin() + (num_samples - num_before_end),
+            samples.begin() + num_before_end);
+  samples_start_ = (samples_start_ + num_samples) % capacity;
+  num_samples_buffered_ -= num_samples;
+
+  AddSamplingNanos(absl::ToInt64Nanoseconds(absl::Now() - sampling_start));
+
+  return true;
 }
 
 void ComfortNoiseGenerator::Reset() {
   log_mel_features_.clear();
-  squared_magnitude_fft_.clear();
-  reconstructed_samples_.clear();
+  std::fill(overlap_.begin(), overlap_.end(), 0.f);
+  samples_start_ = 0;
+  num_samples_buffered_ = 0;
 }
 
-bool ComfortNoiseGenerator::FftFromFeatures() {
-  std::vector<double> mel_features(log_mel_features_.size());
-  for (int i = 0; i < log_mel_features_.size(); ++i) {
-    mel_features[i] = static_cast<double>(
-        std::exp(log_mel_features_[i] *
-                 LogMelSpectrogramExtractorImpl::GetNormalizationFactor()));
-  }
-
-  mel_filterbank_->EstimateInverse(mel_features, &squared_magnitude_fft_);
+bool ComfortNoiseGenerator::SaveState(StateWriter* writer) const {
+  writer->WriteSpan(absl::MakeConstSpan(log_mel_features_));
+  writer->WriteSpan(absl::MakeConstSpan(overlap_));
+  writer->WriteSpan(absl::MakeConstSpan(samples_));
+  writer->Write(samples_start_);
+  writer->Write(num_samples_buffered_);
+  return true;
+}
 
-  if (squared_magnitude_fft_.size() != num_fft_bins_) {
-    LOG(ERROR) << "Size of squared-magnitude FFT is "
-               << squared_magnitude_fft_.size() << ", but should be "
-               << num_fft_bins_ << ".";
+bool ComfortNoiseGenerator::RestoreState(StateReader* reader) {
+  const int capacity = samples_.size();
+  if (!reader->ReadVector(&log_mel_features_) ||
+      (!log_mel_features_.empty() &&
+       log_mel_features_.size() != num_mel_bins_) ||
+      !reader->ReadSpan(absl::MakeSpan(overlap_)) ||
+      !reader->ReadSpan(absl::MakeSpan(samples_)) ||
+      !reader->Read(&samples_start_) || !reader->Read(&num_samples_buffered_) ||
+      samples_start_ < 0 || samples_start_ >= capacity ||
+      num_samples_buffered_ < 0 || num_samples_buffered_ > capacity) {
     return false;
   }
-
   return true;
 }
 
-bool ComfortNoiseGenerator::InvertFft() {
-  // Add random phase to squared-magnitude FFT to make it a complex FFT.
-  // InverseSpectrogram class expects a 2D spectrogram, so one containing just
-  // one slice is constructed.
-  std::vector<std::vector<std::complex<double>>> random_phase_spectrogram(1);
-  absl::BitGen gen;
-  for (int i = 0; i < num_fft_bins_; ++i) {
-    double magnitude = sqrt(squared_magnitude_fft_[i]);
-    double random_angle = absl::Uniform<double>(gen, 0, 2 * M_PI);
-    random_phase_spectrogram[0].push_back(
-        magnitude * std::exp(std::complex<double>(0.0, 1.0) * random_angle));
+void ComfortNoiseGenerator::MagnitudesFromFeatures() {
+  const float normalization_factor =
+      LogMelSpectrogramExtractorImpl::GetNormalizationFactor();
+  for (int c = 0; c < num_mel_bins_; ++c) {
+    mel_features_[c] = std::exp(log_mel_features_[c] * normalization_factor);
   }
 
-  std::vector<double> temp_samples;
-  if (!inverse_spectrogram_->Process(random_phase_spectrogram, &temp_samples)) {
-    return false;
+  // The inverse mel filters estimate the squared magnitude of each bin, each
+  // as a dot product over its range of channels.
+  const Eigen::Map<const Eigen::VectorXf> mel_features(mel_features_.data(),
+                                                       num_mel_bins_);
+  for (int k = 0; k < magnitudes_.size(); ++k) {
+    const InverseMelBin& bin = inverse_mel_bins_[k];
+    const int num_weights = bin.weights.size();
+    const float squared_magnitude =
+        Eigen::Map<const Eigen::VectorXf>(bin.weights.data(), num_weights)
+            .dot(mel_features.segment(bin.first_channel, num_weights));
+    magnitudes_[k] = std::sqrt(std::max(squared_magnitude, 0.f));
   }
+}
 
-  if (temp_samples.size() != hop_length_samples_) {
-    LOG(ERROR) << "Size of samples gotten from inverse FFT operation is "
-               << temp_samples.size() << ", but should be "
-               << hop_length_samples_ << ".";
-    return false;
+void ComfortNoiseGenerator::SynthesizeHop() {
+  // Draw all the phases first so that the rotation below is a plain loop.
+  const int num_fft_bins = magnitudes_.size();
+  for (int k = 0; k < num_fft_bins; ++k) {
+    phases_[k] = absl::Uniform<float>(bit_gen_, 0.f, 2.f * M_PI);
   }
 
-  // Store samples in buffer to ensure continuity between samples.
-  for (int i = 0; i < temp_samples.size(); ++i) {
-    reconstructed_samples_.push_back(
-        ClipToInt16(static_cast<float>(temp_samples[i])));
+  // rdft expects the real parts of the DC and Nyquist bins in the first two
+  // entries, followed by the real and imaginary parts of the other bins.
+  fft_buffer_[0] = magnitudes_[0] * std::cos(phases_[0]);
+  fft_buffer_[1] = magnitudes_[num_fft_bins - 1] *
+                   std::cos(phases_[num_fft_bins - 1]);
+  for (int k = 1; k < num_fft_bins - 1; ++k) {
+    fft_buffer_[2 * k] = magnitudes_[k] * std::cos(phases_[k]);
+    fft_buffer_[2 * k + 1] = magnitudes_[k] * std::sin(phases_[k]);
   }
+  rdft(fft_size_, -1, fft_buffer_.data(), fft_ip_.data(), fft_w_.data());
 
-  return true;
+  // Scale to the exact inverse and overlap-add, then the first hop is
+  // complete.
+  const float scale = 2.f / fft_size_;
+  for (int i = 0; i < fft_size_; ++i) {
+    overlap_[i] += static_cast<float>(fft_buffer_[i]) * scale;
+  }
+  // The hop may wrap around the end of the ring buffer of samples.
+  const int capacity = samples_.size();
+  const int end = (samples_start_ + num_samples_buffered_) % capacity;
+  const int num_before_wrap = std::min(hop_length_samples_, capacity - end);
+  const absl::Span<const float> hop =
+      absl::MakeConstSpan(overlap_).first(hop_length_samples_);
+  ClipToInt16(hop.first(num_before_wrap),
+              absl::MakeSpan(samples_).subspan(end, num_before_wrap));
+  ClipToInt16(hop.subspan(num_before_wrap),
+              absl::MakeSpan(samples_).first(hop_length_samples_ -
+                                             num_before_wrap));
+  num_samples_buffered_ += hop_length_samples_;
+  std::copy(overlap_.begin() + hop_length_samples_, overlap_.end(),
+            overlap_.begin());
+  std::fill(overlap_.end() - hop_length_samples_, overlap_.end(), 0.f);
 }
 
 }  // namespace codec
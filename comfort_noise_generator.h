@@ -21,16 +21,20 @@
 #include <memory>
 #include <vector>
 
+#include "absl/random/random.h"
 #include "absl/types/optional.h"
-#include "audio/dsp/mfcc/mel_filterbank.h"
-#include "audio/dsp/spectrogram/inverse_spectrogram.h"
+#include "absl/types/span.h"
 #include "generative_model_interface.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
 
 // This class generates comfort noise by estimating audio samples that
-// correspond to the given features.
+// correspond to the given features. The spectrum is estimated with a
+// precomputed inverse of the mel filters and given a random phase, and the
+// hops are synthesized by an inverse real FFT and overlap-add into buffers
+// allocated at creation.
 class ComfortNoiseGenerator : public GenerativeModelInterface {
  public:
   // Returns a nullptr on failure.
@@ -40,38 +44,63 @@ class ComfortNoiseGenerator : public GenerativeModelInterface {
 
   ~ComfortNoiseGenerator() override {}
 
-  void AddFeatures(const std::vector<float>& features) override;
+  void AddFeatures(absl::Span<const float> features) override;
 
   absl::optional<std::vector<int16_t>> GenerateSamples(
       int num_samples) override;
 
+  // Writes the samples without allocating.
+  bool GenerateSamplesInto(absl::Span<int16_t> samples) override;
+
   void Reset() override;
 
+  // Saves the features, the overlap-add and the buffered samples. The random
+  // phases are not saved, so a restored generator continues with other noise
+  // of the same spectrum.
+  bool SaveState(StateWriter* writer) const override;
+
+  bool RestoreState(StateReader* reader) override;
+
  private:
-  ComfortNoiseGenerator(
-      int num_fft_bins, int sample_rate_hz, int num_mel_bins,
-      int hop_length_samples,
-      std::unique_ptr<audio_dsp::MelFilterbank> mel_filterbank,
-      std::unique_ptr<audio_dsp::InverseSpectrogram> inverse_spectrogram);
-
-  // Estimates the Squared-Magnitude FFT that corresponds to the Log Mel
-  // features. Returns true if the estimation completed successfully and false
-  // otherwise.
-  bool FftFromFeatures();
-
-  // Produces time-domain inverse of a Squared-Magnitude FFT by adding a random
-  // phase to each element. Returns true if the inversion completed successfully
-  // and false otherwise.
-  bool InvertFft();
-
-  const std::unique_ptr<const audio_dsp::MelFilterbank> mel_filterbank_;
-  const std::unique_ptr<audio_dsp::InverseSpectrogram> inverse_spectrogram_;
-  const int num_fft_bins_;
+  // The row of the inverse mel filters for an FFT bin, which weights a
+  // contiguous range of mel channels.
+  struct InverseMelBin {
+    int first_channel;
+    std::vector<float> weights;
+  };
+
+  ComfortNoiseGenerator(std::vector<InverseMelBin> inverse_mel_bins,
+                        int fft_size, int num_mel_bins,
+                        int hop_length_samples);
+
+  // Estimates the FFT magnitudes that correspond to the Log Mel features.
+  void MagnitudesFromFeatures();
+
+  // Produces the next hop of the time-domain inverse of |magnitudes_| with a
+  // random phase added to each bin and appends it to |samples_|.
+  void SynthesizeHop();
+
+  const std::vector<InverseMelBin> inverse_mel_bins_;
+  const int fft_size_;
   const int num_mel_bins_;
   const int hop_length_samples_;
   std::vector<float> log_mel_features_;
-  std::vector<double> squared_magnitude_fft_;
-  std::vector<int16_t> reconstructed_samples_;
+  std::vector<float> mel_features_;
+  std::vector<float> magnitudes_;
+  std::vector<float> phases_;
+  // The random spectrum, transformed in place.
+  std::vector<double> fft_buffer_;
+  // The bit reversal and twiddle factor tables of the FFT.
+  std::vector<int> fft_ip_;
+  std::vector<double> fft_w_;
+  // Overlap-add of the inverse transforms, starting at the next hop.
+  std::vector<float> overlap_;
+  // Ring buffer of the synthesized samples that were not returned yet, which
+  // holds at most two hops. The oldest is at |samples_start_|.
+  std::vector<int16_t> samples_;
+  int samples_start_;
+  int num_samples_buffered_;
+  absl::BitGen bit_gen_;
 };
 
 }  // namespace codec
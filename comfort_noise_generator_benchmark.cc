@@ -0,0 +1,64 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "comfort_noise_generator.h"
+#include "lyra_config.h"
+
+// Generates |state.range(0)| samples of comfort noise per call, from random
+// features that are replaced every hop as in the decoder.
+void BM_GenerateSamples(benchmark::State& state) {
+  const int num_samples = state.range(0);
+  const int sample_rate_hz = chromemedia::codec::kInternalSampleRateHz;
+  const int num_mel_bins = chromemedia::codec::kNumExpectedOutputFeatures;
+  const int hop_length =
+      chromemedia::codec::GetNumSamplesPerHop(sample_rate_hz);
+  auto generator = chromemedia::codec::ComfortNoiseGenerator::Create(
+      sample_rate_hz, num_mel_bins,
+      chromemedia::codec::GetNumSamplesPerFrame(sample_rate_hz), hop_length);
+  if (generator == nullptr) {
+    state.SkipWithError("Could not create the comfort noise generator.");
+    return;
+  }
+  const int kNumRandFeatures = 100;
+  absl::BitGen gen;
+  std::vector<std::vector<float>> features(kNumRandFeatures,
+                                           std::vector<float>(num_mel_bins));
+  for (auto& feature_vector : features) {
+    for (auto& feature : feature_vector) {
+      feature = absl::Uniform<float>(gen, -10.0f, 5.0f);
+    }
+  }
+  std::vector<int16_t> samples(num_samples);
+  int num_samples_in_hop = hop_length;
+
+  for (auto _ : state) {
+    if (num_samples_in_hop + num_samples > hop_length) {
+      generator->AddFeatures(features[absl::Uniform(gen, 0, kNumRandFeatures)]);
+      num_samples_in_hop = 0;
+    }
+    benchmark::DoNotOptimize(
+        generator->GenerateSamplesInto(absl::MakeSpan(samples)));
+    num_samples_in_hop += num_samples;
+  }
+}
+
+BENCHMARK(BM_GenerateSamples)->Arg(40)->Arg(160)->Arg(640);
+BENCHMARK_MAIN();
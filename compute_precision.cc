@@ -0,0 +1,48 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "compute_precision.h"
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace chromemedia {
+namespace codec {
+
+const char* ComputePrecisionName(ComputePrecision precision) {
+  switch (precision) {
+    case ComputePrecision::kFloat:
+      return "float";
+    case ComputePrecision::kFixed16:
+      return "fixed16";
+    case ComputePrecision::kBfloat16:
+      return "bfloat16";
+  }
+  return "unknown";
+}
+
+absl::optional<ComputePrecision> ComputePrecisionFromName(
+    absl::string_view name) {
+  for (const ComputePrecision precision :
+       {ComputePrecision::kFloat, ComputePrecision::kFixed16,
+        ComputePrecision::kBfloat16}) {
+    if (name == ComputePrecisionName(precision)) {
+      return precision;
+    }
+  }
+  return absl::nullopt;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
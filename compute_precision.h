@@ -0,0 +1,57 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_COMPUTE_PRECISION_H_
+#define LYRA_CODEC_COMPUTE_PRECISION_H_
+
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Arithmetic used by the generative model. Fixed point is the fastest, at some
+// loss of quality, and bfloat16 only halves the memory of the weights.
+enum class ComputePrecision {
+  kFloat,
+  kFixed16,
+  kBfloat16,
+};
+
+// Precision used when the caller does not choose one. It follows the
+// USE_FIXED16 and USE_BFLOAT16 build flags, so that binaries built with them
+// keep their behavior.
+#ifdef USE_FIXED16
+constexpr ComputePrecision kDefaultComputePrecision =
+    ComputePrecision::kFixed16;
+#elif USE_BFLOAT16
+constexpr ComputePrecision kDefaultComputePrecision =
+    ComputePrecision::kBfloat16;
+#else
+constexpr ComputePrecision kDefaultComputePrecision = ComputePrecision::kFloat;
+#endif  // USE_FIXED16
+
+// Returns "float", "fixed16" or "bfloat16".
+const char* ComputePrecisionName(ComputePrecision precision);
+
+// Inverse of |ComputePrecisionName|. Returns a nullopt for unknown names.
+absl::optional<ComputePrecision> ComputePrecisionFromName(
+    absl::string_view name);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_COMPUTE_PRECISION_H_
@@ -0,0 +1,39 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "compute_precision.h"
+
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(ComputePrecisionTest, NamesRoundTrip) {
+  for (const ComputePrecision precision :
+       {ComputePrecision::kFloat, ComputePrecision::kFixed16,
+        ComputePrecision::kBfloat16}) {
+    EXPECT_EQ(ComputePrecisionFromName(ComputePrecisionName(precision)),
+              precision);
+  }
+}
+
+TEST(ComputePrecisionTest, UnknownNameReturnsNullopt) {
+  EXPECT_FALSE(ComputePrecisionFromName("double").has_value());
+  EXPECT_FALSE(ComputePrecisionFromName("").has_value());
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
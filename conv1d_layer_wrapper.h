@@ -33,7 +33,7 @@ namespace codec {
 // Class that wraps the data and logic of conv1d layers.
 template <typename WeightType, typename RhsType, typename OutputType,
           typename DiskWeightType>
-class Conv1DLayerWrapper
+class Conv1DLayerWrapper final
     : public LayerWrapper<WeightType, RhsType, OutputType, DiskWeightType> {
  public:
   using Super = LayerWrapper<WeightType, RhsType, OutputType, DiskWeightType>;
@@ -64,7 +64,8 @@ class Conv1DLayerWrapper
 
     auto layer = Super::LoadAndCheckLayer(
         params.from, params.prefix, layer_prompt, params.num_filters,
-        params.kernel_size * params.num_input_channels, params.num_threads);
+        params.kernel_size * params.num_input_channels, params.num_threads,
+        params.model);
     if (layer == nullptr) {
       return nullptr;
     }
@@ -82,33 +83,62 @@ class Conv1DLayerWrapper
   void Run(int tid, csrblocksparse::SpinBarrier* spin_barrier,
            csrblocksparse::MutableVectorView<OutputType> output_view) override {
     this->layer_->SpMM_bias(
-        csrblocksparse::VectorView<RhsType>(this->input_buffer_), &output_view,
-        this->relu_, tid, this->per_column_barrier_ ? spin_barrier : nullptr);
+        csrblocksparse::VectorView<RhsType>(
+            this->input_buffer_.data() + window_start_,
+            this->input_buffer_rows_, this->length_,
+            this->input_buffer_.col_stride()),
+        &output_view, this->relu_, tid,
+        this->per_column_barrier_ ? spin_barrier : nullptr);
+    this->RunRowEpilogue(tid);
     spin_barrier->barrier();
     Reset(tid, spin_barrier);
   }
 
   // The part of |input_buffer_| updated by the previous layer corresponding to
   // time = t (out of all past values). It is the bottom
-  // |num_inputs_to_update_| rows of the current column.
+  // |num_inputs_to_update_| rows of the current window.
   csrblocksparse::MutableVectorView<RhsType> InputViewToUpdate() override {
     return csrblocksparse::MutableVectorView<RhsType>(
-        this->input_buffer_.data() + this->input_buffer_rows_ -
+        this->input_buffer_.data() + window_start_ + this->input_buffer_rows_ -
             this->num_inputs_to_update_,
         this->num_inputs_to_update_, this->length_, this->input_buffer_rows_);
   }
 
+  void ClearState() override {
+    LayerWrapper<WeightType, RhsType, OutputType, DiskWeightType>::ClearState();
+    window_start_ = 0;
+  }
+
  private:
   Conv1DLayerWrapper() = delete;
   explicit Conv1DLayerWrapper(
       int num_input_channels, int output_rows, int length,
       int input_buffer_rows, int stride, bool relu, bool per_column_barrier,
-      std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+      std::shared_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
           layer)
       : Super(num_input_channels, output_rows, length, input_buffer_rows,
-              length, relu, per_column_barrier, std::move(layer)),
+              length, relu, per_column_barrier, std::move(layer),
+              NumExtraRows(length, input_buffer_rows,
+                           std::min(stride * num_input_channels,
+                                    input_buffer_rows))),
         num_inputs_to_update_(
-            std::min(stride * num_input_channels, input_buffer_rows)) {}
+            std::min(stride * num_input_channels, input_buffer_rows)),
+        max_window_start_(this->input_buffer_.rows() - input_buffer_rows),
+        window_start_(0) {}
+
+  // The number of times the window advances before it is moved back to the
+  // top of |input_buffer_|.
+  static constexpr int kNumStepsPerRewind = 16;
+
+  // The columns of a longer input are not contiguous, so only a single column
+  // can advance in place.
+  static int NumExtraRows(int length, int input_buffer_rows,
+                          int num_inputs_to_update) {
+    return length == 1 ? Super::NumRowsToAdvanceInPlace(input_buffer_rows,
+                                                        num_inputs_to_update,
+                                                        kNumStepsPerRewind)
+                       : 0;
+  }
 
   // For Conv1D layers, |stride| > 1 is supported. Every time
   // |stride| * |num_input_channels| elements are pushed in from the bottom.
@@ -150,25 +180,44 @@ class Conv1DLayerWrapper
   //  |----|                             //
   //  | v3 |                             //
   //
+  // Instead of moving the whole window up on every call, the window that the
+  // matrix multiplication reads starts |window_start_| rows into a longer
+  // buffer and moves down by |num_inputs_to_update_| rows, which has the same
+  // effect. Only once it reaches the end of the buffer, every
+  // |kNumStepsPerRewind| calls, is its content moved back to the top.
   void Reset(int tid, csrblocksparse::SpinBarrier* spin_barrier) override {
     // If |num_inputs_to_update_| == |input_buffer_rows_| it means that
     // the whole buffer is overwritten evey time, so there is no need to move
     // elements.
-    if (this->num_inputs_to_update_ < this->input_buffer_rows_) {
-      if (tid == 0) {
-        // Shift the current column up by |num_inputs_to_update_| elements.
-        std::move(this->input_buffer_.data() + this->num_inputs_to_update_,
-                  this->input_buffer_.data() + this->input_buffer_rows_,
-                  this->input_buffer_.data());
-      }
-      spin_barrier->barrier();
+    if (this->num_inputs_to_update_ == this->input_buffer_rows_ || tid != 0) {
+      return;
     }
+    if (window_start_ + this->num_inputs_to_update_ <= max_window_start_) {
+      window_start_ += this->num_inputs_to_update_;
+      return;
+    }
+    // Shift the current window to the top, leaving out the oldest
+    // |num_inputs_to_update_| elements.
+    RhsType* window = this->input_buffer_.data() + window_start_;
+    std::move(window + this->num_inputs_to_update_,
+              window + this->input_buffer_rows_, this->input_buffer_.data());
+    window_start_ = 0;
   }
 
+  // Every column of the window starts at the same row.
+  int WindowStart(int column) const override { return window_start_; }
+
   // Number of input elements to update after each matrix multiplication. Equal
   // to the minimum between |input_buffer_rows_| and
   // |num_input_channels_| * stride (not stored).
   const int num_inputs_to_update_;
+
+  // The largest row of |input_buffer_| the window can start at, which is 0 if
+  // the window is moved back to the top on every call.
+  const int max_window_start_;
+
+  // The row of |input_buffer_| at which the current window starts.
+  int window_start_;
 };
 
 }  // namespace codec
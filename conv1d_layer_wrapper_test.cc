@@ -15,6 +15,7 @@
 #include "conv1d_layer_wrapper.h"
 
 #include <algorithm>
+#include <utility>
 #include <vector>
 
 // placeholder for get runfiles header.
@@ -23,6 +24,8 @@
 #include "include/ghc/filesystem.hpp"
 #include "layer_wrapper.h"
 #include "layer_wrapper_test_common.h"
+#include "lyra_model.h"
+#include "performance_profile.h"
 #include "sparse_inference_matrixvector.h"
 
 namespace chromemedia {
@@ -164,6 +167,46 @@ TYPED_TEST(Conv1DLayerWrapperTest, ResetShiftsInputBufferUp) {
   }
 }
 
+TYPED_TEST(Conv1DLayerWrapperTest, LongRunsKeepTheInputHistory) {
+  // With 32 channels the shifts of the input buffer are cache aligned for all
+  // types, so they are done by advancing a window that is moved back to the
+  // top of the buffer every few steps.
+  auto params = this->conv1d_params_;
+  params.num_input_channels = 32;
+  params.num_filters = 8;
+  params.from = LayerParams::FromConstant{
+      .value = 0.5f,
+      .sparsity = -1.0f,
+  };
+  auto layer = LayerWrapperPeer<TypeParam>::Create(params);
+  ASSERT_NE(layer, nullptr);
+
+  // Repeat the inputs every |kPeriod| steps, so that the outputs repeat too
+  // once the first |kernel_size| inputs are in the buffer.
+  constexpr int kPeriod = 5;
+  constexpr int kNumSteps = 64;
+  using RhsType = typename LayerWrapperPeer<TypeParam>::RhsType;
+  using OutputType = typename LayerWrapperPeer<TypeParam>::OutputType;
+  csrblocksparse::FatCacheAlignedVector<OutputType> output_buffer(
+      params.num_filters, 1);
+  std::vector<std::vector<float>> outputs;
+  for (int step = 0; step < kNumSteps; ++step) {
+    auto input_view = layer->InputViewToUpdate();
+    for (int i = 0; i < input_view.rows(); ++i) {
+      input_view[i] = static_cast<RhsType>(0.01f * (step % kPeriod + 1) +
+                                           0.001f * (i % 4));
+    }
+    layer->Run(0, &this->spin_barrier_,
+               csrblocksparse::MutableVectorView<OutputType>(&output_buffer));
+    outputs.emplace_back(output_buffer.data(),
+                         output_buffer.data() + output_buffer.size());
+  }
+  for (int step = params.kernel_size; step + kPeriod < kNumSteps; ++step) {
+    EXPECT_THAT(outputs[step + kPeriod],
+                testing::Pointwise(testing::FloatEq(), outputs[step]));
+  }
+}
+
 TYPED_TEST(Conv1DLayerWrapperTest, LayerLoadSucceeds) {
   const LayerParams params = this->conv1d_params_;
   auto layer = LayerWrapperPeer<TypeParam>::Create(params);
@@ -245,6 +288,41 @@ TYPED_TEST(Conv1DLayerWrapperTest, LayerRuns) {
               testing::Contains(testing::Ne(0.0f)));
 }
 
+TYPED_TEST(Conv1DLayerWrapperTest, AutotunedBlockHeightYieldsSameResults) {
+  PerformanceProfile profile;
+  profile.autotune_block_height = true;
+  auto model = LyraModel::Create(this->testdata_dir_, profile);
+  ASSERT_NE(model, nullptr);
+  LayerParams autotuned_params = this->conv1d_params_;
+  autotuned_params.model = model.get();
+  auto layer = LayerWrapperPeer<TypeParam>::Create(this->conv1d_params_);
+  auto autotuned_layer = LayerWrapperPeer<TypeParam>::Create(autotuned_params);
+  ASSERT_NE(layer, nullptr);
+  ASSERT_NE(autotuned_layer, nullptr);
+
+  auto output_view = PrepareInputOutput(
+      /*expected_input_rows=*/this->conv1d_params_.num_input_channels,
+      /*expected_input_cols=*/1,
+      /*expected_output_rows=*/this->conv1d_params_.num_filters,
+      /*expected_output_cols=*/1, 1.0f, layer->InputViewToUpdate(),
+      &this->output_buffer_);
+  layer->Run(0, &this->spin_barrier_, output_view);
+  csrblocksparse::FatCacheAlignedVector<typename TestFixture::OutputType>
+      autotuned_output_buffer;
+  auto autotuned_output_view = PrepareInputOutput(
+      /*expected_input_rows=*/this->conv1d_params_.num_input_channels,
+      /*expected_input_cols=*/1,
+      /*expected_output_rows=*/this->conv1d_params_.num_filters,
+      /*expected_output_cols=*/1, 1.0f, autotuned_layer->InputViewToUpdate(),
+      &autotuned_output_buffer);
+  autotuned_layer->Run(0, &this->spin_barrier_, autotuned_output_view);
+
+  for (int row = 0; row < this->conv1d_params_.num_filters; ++row) {
+    EXPECT_FLOAT_EQ(static_cast<float>(autotuned_output_view[row]),
+                    static_cast<float>(output_view[row]));
+  }
+}
+
 TYPED_TEST(Conv1DLayerWrapperTest, MultipleThreadsYieldSameResults) {
   auto params = this->conv1d_params_;
   VerifyMultipleThreadsYeldSameResults<LayerWrapperPeer<TypeParam>>(
@@ -264,6 +342,52 @@ TYPED_TEST(Conv1DLayerWrapperTest, MultipleThreadsYieldSameResults) {
       /*expected_output_cols=*/1);
 }
 
+TYPED_TEST(Conv1DLayerWrapperTest, ThreadRowStartsCoverAllRows) {
+  auto params = this->conv1d_params_;
+  params.num_filters = 16;
+  params.from = LayerParams::FromConstant{
+      .value = 0.5f,
+      .sparsity = -1.0f,
+  };
+  for (const int num_threads : {1, 2, 4}) {
+    params.num_threads = num_threads;
+    auto layer = LayerWrapperPeer<TypeParam>::Create(params);
+    ASSERT_NE(layer, nullptr);
+    const std::vector<int> starts = layer->ThreadRowStarts(num_threads);
+    ASSERT_EQ(starts.size(), num_threads + 1);
+    EXPECT_EQ(starts.front(), 0);
+    EXPECT_EQ(starts.back(), params.num_filters);
+    EXPECT_TRUE(std::is_sorted(starts.begin(), starts.end()));
+  }
+}
+
+TYPED_TEST(Conv1DLayerWrapperTest, RowEpilogueRunsOnTheRowsOfTheThread) {
+  auto params = this->conv1d_params_;
+  params.num_filters = 16;
+  params.from = LayerParams::FromConstant{
+      .value = 0.5f,
+      .sparsity = -1.0f,
+  };
+  auto layer = LayerWrapperPeer<TypeParam>::Create(params);
+  ASSERT_NE(layer, nullptr);
+  std::vector<std::pair<int, int>> epilogue_rows;
+  ASSERT_TRUE(layer->SetRowEpilogue(
+      this->kNumThreads, /*row_alignment=*/8,
+      [&epilogue_rows](int row_start, int row_end) {
+        epilogue_rows.emplace_back(row_start, row_end);
+      }));
+
+  auto output_view = PrepareInputOutput(
+      /*expected_input_rows=*/params.num_input_channels,
+      /*expected_input_cols=*/1,
+      /*expected_output_rows=*/params.num_filters,
+      /*expected_output_cols=*/1, /*input_value=*/1.0f,
+      layer->InputViewToUpdate(), &this->output_buffer_);
+  layer->Run(0, &this->spin_barrier_, output_view);
+  EXPECT_THAT(epilogue_rows,
+              testing::ElementsAre(std::make_pair(0, params.num_filters)));
+}
+
 TYPED_TEST(Conv1DLayerWrapperTest, NumericalResults) {
   const LayerParams params{.num_input_channels = 3,
                            .num_filters = 2,
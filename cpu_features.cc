@@ -0,0 +1,116 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_features.h"
+
+#if defined __aarch64__ && defined __linux__
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif  // defined __aarch64__ && defined __linux__
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+CpuIsa DetectCpuIsaUncached() {
+#if defined __aarch64__
+  // Advanced SIMD is mandatory on aarch64, SVE is not.
+#if defined __ARM_FEATURE_SVE
+  return CpuIsa::kSve;
+#elif defined __linux__ && defined HWCAP_SVE
+  return (getauxval(AT_HWCAP) & HWCAP_SVE) != 0 ? CpuIsa::kSve
+                                                : CpuIsa::kNeon;
+#else
+  return CpuIsa::kNeon;
+#endif  // defined __ARM_FEATURE_SVE
+#elif (defined __x86_64__ || defined __i386__) && \
+    (defined __GNUC__ || defined __clang__)
+  __builtin_cpu_init();
+  const bool has_avx2 =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if (has_avx2 && __builtin_cpu_supports("avx512f")) {
+    return CpuIsa::kAvx512;
+  }
+  return has_avx2 ? CpuIsa::kAvx2 : CpuIsa::kGeneric;
+#else
+  return CpuIsa::kGeneric;
+#endif  // defined __aarch64__
+}
+
+bool HasInt8DotProductUncached() {
+#if defined __aarch64__
+#if defined __ARM_FEATURE_DOTPROD
+  return true;
+#elif defined __linux__ && defined HWCAP_ASIMDDP
+  return (getauxval(AT_HWCAP) & HWCAP_ASIMDDP) != 0;
+#else
+  return false;
+#endif  // defined __ARM_FEATURE_DOTPROD
+#elif (defined __x86_64__ || defined __i386__) && defined __GNUC__ && \
+    !defined __clang__ && __GNUC__ >= 11
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avxvnni") ||
+         (__builtin_cpu_supports("avx512vnni") &&
+          __builtin_cpu_supports("avx512vl"));
+#else
+  return false;
+#endif  // defined __aarch64__
+}
+
+bool IsArmIsa(CpuIsa isa) {
+  return isa == CpuIsa::kNeon || isa == CpuIsa::kSve;
+}
+
+}  // namespace
+
+CpuIsa DetectCpuIsa() {
+  static const CpuIsa kCpuIsa = DetectCpuIsaUncached();
+  return kCpuIsa;
+}
+
+bool IsCpuIsaSupported(CpuIsa isa) {
+  if (isa == CpuIsa::kGeneric) {
+    return true;
+  }
+  const CpuIsa detected = DetectCpuIsa();
+  // The ARM and the x86 instruction sets are exclusive of each other.
+  if (IsArmIsa(isa) != IsArmIsa(detected)) {
+    return false;
+  }
+  return static_cast<int>(isa) <= static_cast<int>(detected);
+}
+
+bool HasInt8DotProduct() {
+  static const bool kHasInt8DotProduct = HasInt8DotProductUncached();
+  return kHasInt8DotProduct;
+}
+
+const char* CpuIsaName(CpuIsa isa) {
+  switch (isa) {
+    case CpuIsa::kGeneric:
+      return "generic";
+    case CpuIsa::kNeon:
+      return "neon";
+    case CpuIsa::kSve:
+      return "sve";
+    case CpuIsa::kAvx2:
+      return "avx2";
+    case CpuIsa::kAvx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+}  // namespace codec
+}  // namespace chromemedia
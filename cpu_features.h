@@ -0,0 +1,54 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_CPU_FEATURES_H_
+#define LYRA_CODEC_CPU_FEATURES_H_
+
+namespace chromemedia {
+namespace codec {
+
+// Instruction sets the codec's own kernels can be dispatched to at runtime.
+// The ARM and the x86 ones are each ordered, so that a kernel for an
+// instruction set also runs on every later one of the same architecture.
+enum class CpuIsa {
+  kGeneric = 0,
+  kNeon,
+  // Scalable vectors, whose length is only known at runtime, on top of NEON.
+  // There are no SVE kernels, so the NEON ones run.
+  kSve,
+  kAvx2,
+  kAvx512,
+};
+
+// Returns the best instruction set supported by the running CPU. The result
+// is computed on the first call and cached.
+CpuIsa DetectCpuIsa();
+
+// Returns whether |isa| can run on the running CPU.
+bool IsCpuIsaSupported(CpuIsa isa);
+
+// Returns a short human readable name of |isa|, e.g. "avx2".
+const char* CpuIsaName(CpuIsa isa);
+
+// Returns whether the running CPU has instructions for dot products of 8 bit
+// integers: AVX-VNNI or AVX512-VNNI on x86, and the dot product extension of
+// ARMv8.2 on aarch64. They are independent of the ordering of |CpuIsa|.
+bool HasInt8DotProduct();
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_CPU_FEATURES_H_
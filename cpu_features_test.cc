@@ -0,0 +1,71 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_features.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(CpuFeaturesTest, DetectedIsaIsSupported) {
+  EXPECT_TRUE(IsCpuIsaSupported(DetectCpuIsa()));
+  EXPECT_EQ(DetectCpuIsa(), DetectCpuIsa());
+}
+
+TEST(CpuFeaturesTest, GenericIsAlwaysSupported) {
+  EXPECT_TRUE(IsCpuIsaSupported(CpuIsa::kGeneric));
+}
+
+TEST(CpuFeaturesTest, NeonAndX86AreExclusive) {
+  EXPECT_FALSE(IsCpuIsaSupported(CpuIsa::kNeon) &&
+               IsCpuIsaSupported(CpuIsa::kAvx2));
+  EXPECT_FALSE(IsCpuIsaSupported(CpuIsa::kSve) &&
+               IsCpuIsaSupported(CpuIsa::kAvx2));
+}
+
+TEST(CpuFeaturesTest, SveImpliesNeon) {
+  if (IsCpuIsaSupported(CpuIsa::kSve)) {
+    EXPECT_TRUE(IsCpuIsaSupported(CpuIsa::kNeon));
+  }
+}
+
+TEST(CpuFeaturesTest, Avx512ImpliesAvx2) {
+  if (IsCpuIsaSupported(CpuIsa::kAvx512)) {
+    EXPECT_TRUE(IsCpuIsaSupported(CpuIsa::kAvx2));
+  }
+}
+
+TEST(CpuFeaturesTest, Int8DotProductIsStable) {
+  EXPECT_EQ(HasInt8DotProduct(), HasInt8DotProduct());
+  // Every CPU with the instructions has AVX2 or NEON.
+  if (!IsCpuIsaSupported(CpuIsa::kAvx2) && !IsCpuIsaSupported(CpuIsa::kNeon)) {
+    EXPECT_FALSE(HasInt8DotProduct());
+  }
+}
+
+TEST(CpuFeaturesTest, Names) {
+  EXPECT_EQ(std::string(CpuIsaName(CpuIsa::kGeneric)), "generic");
+  EXPECT_EQ(std::string(CpuIsaName(CpuIsa::kNeon)), "neon");
+  EXPECT_EQ(std::string(CpuIsaName(CpuIsa::kSve)), "sve");
+  EXPECT_EQ(std::string(CpuIsaName(CpuIsa::kAvx2)), "avx2");
+  EXPECT_EQ(std::string(CpuIsaName(CpuIsa::kAvx512)), "avx512");
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
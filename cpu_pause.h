@@ -0,0 +1,41 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_CPU_PAUSE_H_
+#define LYRA_CODEC_CPU_PAUSE_H_
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif  // defined(__x86_64__) || defined(__i386__)
+
+namespace chromemedia {
+namespace codec {
+
+// Tells the core that this is a spin-wait loop, which saves power and lets a
+// hyperthreaded sibling core run.
+inline void CpuPause() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_CPU_PAUSE_H_
@@ -0,0 +1,75 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "crossfader.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+
+Crossfader::Crossfader(CrossfadeShape shape) : shape_(shape) {}
+
+bool Crossfader::Crossfade(absl::Span<const int16_t> preceding_frame,
+                           absl::Span<const int16_t> following_frame,
+                           absl::Span<int16_t> output) {
+  if (preceding_frame.size() != following_frame.size() ||
+      output.size() != preceding_frame.size()) {
+    LOG(ERROR) << "Frames could not be crossfaded because their sizes "
+                  "differed. Preceding frame size was "
+               << preceding_frame.size() << ", following frame size was "
+               << following_frame.size() << " and output size was "
+               << output.size() << ".";
+    return false;
+  }
+  const int num_samples = output.size();
+  UpdateWeights(num_samples);
+
+  // Each output sample only depends on the input samples at the same index,
+  // so writing into one of the inputs is fine.
+  const int16_t* preceding = preceding_frame.data();
+  const int16_t* following = following_frame.data();
+  const float* weights = fade_out_weights_.data();
+  int16_t* mixed = output.data();
+  for (int i = 0; i < num_samples; ++i) {
+    mixed[i] = static_cast<int16_t>(preceding[i] * weights[i] +
+                                    following[i] * (1.f - weights[i]));
+  }
+  return true;
+}
+
+void Crossfader::UpdateWeights(int num_samples) {
+  if (static_cast<int>(fade_out_weights_.size()) == num_samples) {
+    return;
+  }
+  fade_out_weights_.resize(num_samples);
+  for (int i = 0; i < num_samples; ++i) {
+    switch (shape_) {
+      case CrossfadeShape::kCosineSquared:
+        fade_out_weights_[i] = (1.f + std::cos(i * M_PI / num_samples)) / 2.f;
+        break;
+      case CrossfadeShape::kLinear:
+        fade_out_weights_[i] = 1.f - static_cast<float>(i) / num_samples;
+        break;
+    }
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_CROSSFADER_H_
+#define LYRA_CODEC_CROSSFADER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// The shape of the weight with which the preceding frame fades out. The
+// following frame fades in with one minus that weight.
+enum class CrossfadeShape {
+  // (1 + cos(pi * i / n)) / 2, which is cos^2(pi * i / (2 * n)).
+  kCosineSquared,
+  // 1 - i / n.
+  kLinear,
+};
+
+// Crossfades between two frames of the same size. The weights only depend on
+// the frame size, so they are computed once and reused until a frame of
+// another size comes.
+class Crossfader {
+ public:
+  explicit Crossfader(CrossfadeShape shape = CrossfadeShape::kCosineSquared);
+
+  // Writes the crossfade from |preceding_frame| into |following_frame| to
+  // |output|, which may be either of them. Returns false if the sizes differ.
+  bool Crossfade(absl::Span<const int16_t> preceding_frame,
+                 absl::Span<const int16_t> following_frame,
+                 absl::Span<int16_t> output);
+
+ private:
+  // Makes |fade_out_weights_| hold the weights for frames of |num_samples|.
+  void UpdateWeights(int num_samples);
+
+  const CrossfadeShape shape_;
+  std::vector<float> fade_out_weights_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_CROSSFADER_H_
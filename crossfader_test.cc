@@ -0,0 +1,98 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "crossfader.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(CrossfaderTest, SizesDifferFails) {
+  Crossfader crossfader;
+  const std::vector<int16_t> preceding_frame(10, 100);
+  const std::vector<int16_t> following_frame(11, 100);
+  std::vector<int16_t> output(10);
+  EXPECT_FALSE(
+      crossfader.Crossfade(preceding_frame, following_frame,
+                           absl::MakeSpan(output)));
+  std::vector<int16_t> short_output(9);
+  EXPECT_FALSE(crossfader.Crossfade(preceding_frame, preceding_frame,
+                                    absl::MakeSpan(short_output)));
+}
+
+TEST(CrossfaderTest, CosineSquaredMatchesWindow) {
+  Crossfader crossfader;
+  for (const int num_samples : {1, 5, 80, 320}) {
+    std::vector<int16_t> preceding_frame(num_samples);
+    std::vector<int16_t> following_frame(num_samples);
+    for (int i = 0; i < num_samples; ++i) {
+      preceding_frame[i] = 1000 + i;
+      following_frame[i] = -3000 + 2 * i;
+    }
+    std::vector<int16_t> output(num_samples);
+    ASSERT_TRUE(crossfader.Crossfade(preceding_frame, following_frame,
+                                     absl::MakeSpan(output)));
+    for (int i = 0; i < num_samples; ++i) {
+      const float weight = (1.f + std::cos(i * M_PI / num_samples)) / 2.f;
+      EXPECT_EQ(output[i],
+                static_cast<int16_t>(preceding_frame[i] * weight +
+                                     following_frame[i] * (1.f - weight)));
+    }
+    EXPECT_EQ(output[0], preceding_frame[0]);
+  }
+}
+
+TEST(CrossfaderTest, LinearShape) {
+  Crossfader crossfader(CrossfadeShape::kLinear);
+  const std::vector<int16_t> preceding_frame(4, 400);
+  const std::vector<int16_t> following_frame(4, 0);
+  std::vector<int16_t> output(4);
+  ASSERT_TRUE(crossfader.Crossfade(preceding_frame, following_frame,
+                                   absl::MakeSpan(output)));
+  EXPECT_EQ(output, std::vector<int16_t>({400, 300, 200, 100}));
+}
+
+TEST(CrossfaderTest, OutputCanBeAnInput) {
+  Crossfader crossfader;
+  std::vector<int16_t> preceding_frame(64);
+  std::vector<int16_t> following_frame(64);
+  for (int i = 0; i < 64; ++i) {
+    preceding_frame[i] = 50 * i;
+    following_frame[i] = -20 * i;
+  }
+  std::vector<int16_t> expected(64);
+  ASSERT_TRUE(crossfader.Crossfade(preceding_frame, following_frame,
+                                   absl::MakeSpan(expected)));
+
+  std::vector<int16_t> in_preceding = preceding_frame;
+  ASSERT_TRUE(crossfader.Crossfade(in_preceding, following_frame,
+                                   absl::MakeSpan(in_preceding)));
+  EXPECT_EQ(in_preceding, expected);
+
+  std::vector<int16_t> in_following = following_frame;
+  ASSERT_TRUE(crossfader.Crossfade(preceding_frame, in_following,
+                                   absl::MakeSpan(in_following)));
+  EXPECT_EQ(in_following, expected);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
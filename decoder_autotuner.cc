@@ -0,0 +1,260 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder_autotuner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "lyra_config.h"
+#include "synthetic_model_benchmark_lib.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kDefaultMaxThreads = 4;
+
+// Configurations tuned by this process, keyed by |CpuSignature|.
+class ProcessCache {
+ public:
+  absl::optional<TunedDecoderConfig> Get(const std::string& signature) {
+    absl::MutexLock lock(&mutex_);
+    const auto it = configs_.find(signature);
+    if (it == configs_.end()) {
+      return absl::nullopt;
+    }
+    return it->second;
+  }
+
+  void Put(const std::string& signature, const TunedDecoderConfig& config) {
+    absl::MutexLock lock(&mutex_);
+    configs_[signature] = config;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::map<std::string, TunedDecoderConfig> configs_ ABSL_GUARDED_BY(mutex_);
+};
+
+ProcessCache& GetProcessCache() {
+  static ProcessCache* const cache = new ProcessCache();
+  return *cache;
+}
+
+// Every line of a cache file is the signature followed by the fields of the
+// config, separated by tabs.
+absl::optional<TunedDecoderConfig> ParseCacheLine(absl::string_view line,
+                                                  absl::string_view signature) {
+  const std::vector<absl::string_view> fields = absl::StrSplit(line, '\t');
+  if (fields.size() != 5 || fields[0] != signature) {
+    return absl::nullopt;
+  }
+  TunedDecoderConfig config;
+  const auto precision_or = ComputePrecisionFromName(fields[2]);
+  int meets_real_time;
+  if (!absl::SimpleAtoi(fields[1], &config.num_threads) ||
+      config.num_threads < 1 || !precision_or.has_value() ||
+      !absl::SimpleAtod(fields[3], &config.real_time_factor) ||
+      !absl::SimpleAtoi(fields[4], &meets_real_time)) {
+    return absl::nullopt;
+  }
+  config.precision = precision_or.value();
+  config.meets_real_time = meets_real_time != 0;
+  return config;
+}
+
+// Returns the real time factor of the packets after the first one, which
+// warms the caches up.
+absl::optional<double> TimeConfiguration(const AutotuneOptions& options,
+                                         int num_threads,
+                                         ComputePrecision precision) {
+  const auto result_or = BenchmarkSyntheticModel(
+      options.model, options.num_packets + 1, num_threads, precision);
+  if (!result_or.has_value()) {
+    return absl::nullopt;
+  }
+  const std::vector<int64_t>& timings = result_or->packet_microsecs;
+  const double mean_microsecs =
+      std::accumulate(timings.begin() + 1, timings.end(), 0.0) /
+      (timings.size() - 1);
+  const double audio_microsecs_per_packet =
+      1e6 * kNumFramesPerPacket * GetNumSamplesPerHop(kInternalSampleRateHz) /
+      kInternalSampleRateHz;
+  return mean_microsecs / audio_microsecs_per_packet;
+}
+
+}  // namespace
+
+std::string CpuSignature(const HostInfo& host) {
+  // Tabs separate the fields of the cache file.
+  return absl::StrReplaceAll(
+      absl::StrCat(host.cpu_model, "/", host.cpu_isa, "/", host.num_cpus),
+      {{"\t", " "}});
+}
+
+absl::optional<TunedDecoderConfig> ReadCachedTuning(
+    const std::string& cache_path, absl::string_view signature) {
+  std::ifstream file(cache_path);
+  std::string line;
+  absl::optional<TunedDecoderConfig> config;
+  // A later line for the same signature wins.
+  while (std::getline(file, line)) {
+    const auto parsed = ParseCacheLine(line, signature);
+    if (parsed.has_value()) {
+      config = parsed;
+    }
+  }
+  if (config.has_value()) {
+    config->from_cache = true;
+  }
+  return config;
+}
+
+bool WriteCachedTuning(const std::string& cache_path,
+                       absl::string_view signature,
+                       const TunedDecoderConfig& config) {
+  std::vector<std::string> lines;
+  {
+    std::ifstream file(cache_path);
+    std::string line;
+    while (std::getline(file, line)) {
+      const std::vector<absl::string_view> fields =
+          absl::StrSplit(line, absl::MaxSplits('\t', 1));
+      if (!line.empty() && fields[0] != signature) {
+        lines.push_back(line);
+      }
+    }
+  }
+  lines.push_back(absl::StrCat(signature, "\t", config.num_threads, "\t",
+                               ComputePrecisionName(config.precision), "\t",
+                               config.real_time_factor, "\t",
+                               config.meets_real_time ? 1 : 0));
+  std::ofstream file(cache_path, std::ios::trunc);
+  for (const std::string& line : lines) {
+    file << line << "\n";
+  }
+  file.close();
+  if (!file) {
+    LOG(ERROR) << "Could not write " << cache_path << ".";
+    return false;
+  }
+  return true;
+}
+
+absl::optional<TunedDecoderConfig> AutotuneDecoder(
+    const AutotuneOptions& options) {
+  if (options.precisions.empty() || options.num_packets < 1) {
+    LOG(ERROR) << "Autotuning needs at least one precision and packet.";
+    return absl::nullopt;
+  }
+  const std::string signature = CpuSignature(GetHostInfo());
+  auto cached = GetProcessCache().Get(signature);
+  if (!cached.has_value() && !options.cache_path.empty()) {
+    cached = ReadCachedTuning(options.cache_path, signature);
+    if (cached.has_value()) {
+      GetProcessCache().Put(signature, cached.value());
+    }
+  }
+  if (cached.has_value()) {
+    cached->from_cache = true;
+    return cached;
+  }
+
+  int max_threads = options.max_threads;
+  if (max_threads < 1) {
+    max_threads =
+        std::min<int>(kDefaultMaxThreads,
+                      std::max(1u, std::thread::hardware_concurrency()));
+  }
+  // Thread counts are tried from the smallest up, and the first one meeting
+  // real time ends the search, as more threads only take cores from the rest
+  // of the device then.
+  const absl::Time start = absl::Now();
+  absl::optional<TunedDecoderConfig> fastest;
+  for (int num_threads = 1; num_threads <= max_threads; ++num_threads) {
+    if (fastest.has_value() && fastest->meets_real_time) {
+      break;
+    }
+    for (const ComputePrecision precision : options.precisions) {
+      if (fastest.has_value() && absl::Now() - start > options.time_budget) {
+        break;
+      }
+      const auto real_time_factor_or =
+          TimeConfiguration(options, num_threads, precision);
+      if (!real_time_factor_or.has_value()) {
+        LOG(WARNING) << "Could not time " << num_threads << " thread(s) with "
+                     << ComputePrecisionName(precision) << " arithmetic.";
+        continue;
+      }
+      TunedDecoderConfig config;
+      config.num_threads = num_threads;
+      config.precision = precision;
+      config.real_time_factor = real_time_factor_or.value();
+      config.meets_real_time =
+          config.real_time_factor <= options.max_real_time_factor;
+      VLOG(1) << num_threads << " thread(s) with "
+              << ComputePrecisionName(precision)
+              << " arithmetic: real time factor " << config.real_time_factor
+              << ".";
+      if (!fastest.has_value() ||
+          config.real_time_factor < fastest->real_time_factor) {
+        fastest = config;
+      }
+    }
+  }
+  if (!fastest.has_value()) {
+    LOG(ERROR) << "Could not time any configuration.";
+    return absl::nullopt;
+  }
+  const TunedDecoderConfig tuned = fastest.value();
+  LOG_IF(WARNING, !tuned.meets_real_time)
+      << "No configuration has a real time factor of at most "
+      << options.max_real_time_factor << ".";
+  LOG(INFO) << "Autotuning took "
+            << absl::ToInt64Milliseconds(absl::Now() - start) << " ms and "
+            << "picked " << tuned.num_threads << " thread(s) with "
+            << ComputePrecisionName(tuned.precision)
+            << " arithmetic, real time factor " << tuned.real_time_factor
+            << ".";
+
+  GetProcessCache().Put(signature, tuned);
+  if (!options.cache_path.empty()) {
+    WriteCachedTuning(options.cache_path, signature, tuned);
+  }
+  return tuned;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,99 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LYRA_CODEC_DECODER_AUTOTUNER_H_
+#define LYRA_CODEC_DECODER_AUTOTUNER_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+#include "synthetic_model_benchmark_lib.h"
+
+namespace chromemedia {
+namespace codec {
+
+// How the generative model of a decoder runs, as passed to
+// |LyraDecoder::Create|.
+struct TunedDecoderConfig {
+  int num_threads = 1;
+  ComputePrecision precision = kDefaultComputePrecision;
+  // Time to decode a packet over its duration, as measured on the synthetic
+  // model.
+  double real_time_factor = 0.0;
+  // Whether |real_time_factor| is at most |AutotuneOptions::
+  // max_real_time_factor|. If no configuration is, the fastest one is
+  // returned anyway.
+  bool meets_real_time = false;
+  // Whether this came from the cache instead of a calibration.
+  bool from_cache = false;
+};
+
+struct AutotuneOptions {
+  // Thread counts from 1 up to this are tried. Defaults to the number of
+  // cores, but at most 4, if not positive.
+  int max_threads = 0;
+  std::vector<ComputePrecision> precisions = {ComputePrecision::kFloat,
+                                              ComputePrecision::kFixed16,
+                                              ComputePrecision::kBfloat16};
+  // A configuration meets real time if its real time factor is at most this,
+  // so that the rest of a packet's time is left to the other work of the
+  // device. The default leaves half of it.
+  double max_real_time_factor = 0.5;
+  // Packets timed per configuration, after one untimed packet.
+  int num_packets = 3;
+  // Configurations are no longer tried once the calibration took this long,
+  // so that it fits into the startup of an app. At least one always is.
+  absl::Duration time_budget = absl::Milliseconds(500);
+  // The shape of the model that is timed, the shipped one by default.
+  SyntheticModelConfig model;
+  // File the results are cached in across processes, keyed by
+  // |CpuSignature|. Only the cache of this process is used if empty.
+  std::string cache_path;
+};
+
+// Returns a key that tells CPUs apart whose best configuration may differ:
+// the CPU model, the instruction set and the number of cores of |host|.
+std::string CpuSignature(const HostInfo& host);
+
+// Returns the configuration cached for |signature| in the file at
+// |cache_path|, or a nullopt if there is none or the file cannot be read.
+absl::optional<TunedDecoderConfig> ReadCachedTuning(
+    const std::string& cache_path, absl::string_view signature);
+
+// Adds |config| for |signature| to the file at |cache_path|, replacing an
+// older entry for it. Returns false if the file could not be written.
+bool WriteCachedTuning(const std::string& cache_path,
+                       absl::string_view signature,
+                       const TunedDecoderConfig& config);
+
+// Returns the configuration of the generative model on the running CPU with
+// the fewest threads that meets real time with the headroom of |options|, and
+// of those the one with the fastest precision. Thread counts are tried from 1
+// up, timing a synthetic model with every precision, until one meets it. If
+// none does, returns the fastest configuration that was timed. A result is
+// cached for the rest of the process and in |options.cache_path|, so that
+// only the first call on a device pays for the calibration. Returns a nullopt
+// if no configuration could be timed.
+absl::optional<TunedDecoderConfig> AutotuneDecoder(
+    const AutotuneOptions& options);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_DECODER_AUTOTUNER_H_
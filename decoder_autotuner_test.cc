@@ -0,0 +1,131 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder_autotuner.h"
+
+#include <fstream>
+#include <string>
+
+#include "absl/time/time.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+class DecoderAutotunerTest : public testing::Test {
+ protected:
+  DecoderAutotunerTest()
+      : cache_path_((ghc::filesystem::path(testing::TempDir()) /
+                     "decoder_autotuner_test_cache.tsv")
+                        .string()) {
+    ghc::filesystem::remove(cache_path_);
+  }
+
+  const std::string cache_path_;
+};
+
+TEST_F(DecoderAutotunerTest, SignatureHasNoTabs) {
+  HostInfo host;
+  host.cpu_model = "Vendor\tModel";
+  host.cpu_isa = "neon";
+  host.num_cpus = 8;
+  EXPECT_EQ(CpuSignature(host), "Vendor Model/neon/8");
+}
+
+TEST_F(DecoderAutotunerTest, CacheRoundTripsAndReplacesEntries) {
+  EXPECT_FALSE(ReadCachedTuning(cache_path_, "a").has_value());
+
+  TunedDecoderConfig config;
+  config.num_threads = 2;
+  config.precision = ComputePrecision::kFixed16;
+  config.real_time_factor = 0.25;
+  config.meets_real_time = true;
+  ASSERT_TRUE(WriteCachedTuning(cache_path_, "a", config));
+  config.num_threads = 3;
+  ASSERT_TRUE(WriteCachedTuning(cache_path_, "b", config));
+  config.num_threads = 4;
+  config.precision = ComputePrecision::kBfloat16;
+  config.meets_real_time = false;
+  ASSERT_TRUE(WriteCachedTuning(cache_path_, "a", config));
+
+  const auto a = ReadCachedTuning(cache_path_, "a");
+  ASSERT_TRUE(a.has_value());
+  EXPECT_EQ(a->num_threads, 4);
+  EXPECT_EQ(a->precision, ComputePrecision::kBfloat16);
+  EXPECT_DOUBLE_EQ(a->real_time_factor, 0.25);
+  EXPECT_FALSE(a->meets_real_time);
+  EXPECT_TRUE(a->from_cache);
+  const auto b = ReadCachedTuning(cache_path_, "b");
+  ASSERT_TRUE(b.has_value());
+  EXPECT_EQ(b->num_threads, 3);
+
+  std::ifstream file(cache_path_);
+  int num_lines = 0;
+  for (std::string line; std::getline(file, line);) ++num_lines;
+  EXPECT_EQ(num_lines, 2);
+}
+
+TEST_F(DecoderAutotunerTest, IgnoresMalformedCacheLines) {
+  std::ofstream(cache_path_) << "a\tzero\tfloat\t0.1\t1\n"
+                             << "a\t2\tdouble\t0.1\t1\n"
+                             << "a\t2\n";
+  EXPECT_FALSE(ReadCachedTuning(cache_path_, "a").has_value());
+}
+
+TEST_F(DecoderAutotunerTest, CalibratesOnceAndCachesTheResult) {
+  AutotuneOptions options;
+  options.max_threads = 2;
+  options.precisions = {ComputePrecision::kFloat, ComputePrecision::kFixed16};
+  options.num_packets = 1;
+  options.model.num_gru_hiddens = 64;
+  options.model.proj_size = 32;
+  options.model.num_cond_hiddens = 32;
+  options.model.sparsity = 0.5f;
+  options.cache_path = cache_path_;
+
+  const auto tuned = AutotuneDecoder(options);
+  ASSERT_TRUE(tuned.has_value());
+  EXPECT_FALSE(tuned->from_cache);
+  EXPECT_GE(tuned->num_threads, 1);
+  EXPECT_LE(tuned->num_threads, 2);
+  EXPECT_GT(tuned->real_time_factor, 0.0);
+  EXPECT_EQ(tuned->meets_real_time,
+            tuned->real_time_factor <= options.max_real_time_factor);
+
+  const auto in_file =
+      ReadCachedTuning(cache_path_, CpuSignature(GetHostInfo()));
+  ASSERT_TRUE(in_file.has_value());
+  EXPECT_EQ(in_file->num_threads, tuned->num_threads);
+  EXPECT_EQ(in_file->precision, tuned->precision);
+
+  const auto again = AutotuneDecoder(options);
+  ASSERT_TRUE(again.has_value());
+  EXPECT_TRUE(again->from_cache);
+  EXPECT_EQ(again->num_threads, tuned->num_threads);
+  EXPECT_EQ(again->precision, tuned->precision);
+}
+
+TEST_F(DecoderAutotunerTest, RejectsEmptyOptions) {
+  AutotuneOptions options;
+  options.precisions.clear();
+  EXPECT_FALSE(AutotuneDecoder(options).has_value());
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <iostream>
 #include <string>
 #include <system_error>  // NOLINT(build/c++11)
 
@@ -21,11 +22,18 @@
 #include "absl/strings/string_view.h"
 #include "architecture_utils.h"
 #include "decoder_main_lib.h"
+#include "file_batch.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_stream_file.h"
 
 ABSL_FLAG(std::string, encoded_path, "",
-          "Complete path to the file containing the encoded features.");
+          "Complete path to the file containing the encoded features. If this "
+          "is a directory, or a .txt file listing one encoded file per line, "
+          "all those files are decoded in one batch that loads the model "
+          "once. If '-', packets are read from stdin and the audio of every "
+          "packet is written to stdout as a WAV stream as soon as it is "
+          "decoded.");
 ABSL_FLAG(std::string, output_dir, "",
           "The complete output dir for the wav to be written out. "
           "Recursively creates dir if it does not exist. Will "
@@ -37,6 +45,22 @@ ABSL_FLAG(double, packet_loss_rate, 0.0,
           "Percentage of packets that are lost.");
 ABSL_FLAG(double, average_burst_length, 1.0,
           "Average length of periods where packets are lost.");
+ABSL_FLAG(int, num_parallel_segments, 1,
+          "If not 1, the stream is split into this many segments that are "
+          "decoded concurrently and crossfaded, or one per core if 0. The "
+          "whole stream and output are then held in memory.");
+ABSL_FLAG(bool, raw_output, false,
+          "If decoding stdin, writes raw 16 bit little endian samples instead "
+          "of a WAV stream.");
+ABSL_FLAG(double, start_seconds, 0.0,
+          "If the encoded file is a seekable Lyra stream, decodes from this "
+          "position on.");
+ABSL_FLAG(double, duration_seconds, 0.0,
+          "If positive and the encoded file is a seekable Lyra stream, "
+          "decodes only this much audio.");
+ABSL_FLAG(int, num_workers, 0,
+          "The number of files decoded concurrently in batch mode, or one per "
+          "core if 0.");
 ABSL_FLAG(
     std::string, model_path, "wavegru",
     "Path to directory containing model weights and quant files. For mobile "
@@ -60,6 +84,16 @@ int main(int argc, char** argv) {
     LOG(ERROR) << "Flag --encoded_path not set.";
     return -1;
   }
+  if (encoded_path == "-") {
+    if (!chromemedia::codec::DecodeStream(
+            &std::cin, &std::cout, absl::GetFlag(FLAGS_raw_output),
+            sample_rate_hz, packet_loss_rate, average_burst_length,
+            model_path)) {
+      LOG(ERROR) << "Failed to decode stdin.";
+      return -1;
+    }
+    return 0;
+  }
   if (output_dir.empty()) {
     LOG(ERROR) << "Flag --output_dir not set.";
     return -1;
@@ -74,13 +108,46 @@ int main(int argc, char** argv) {
       return -1;
     }
   }
+  if (ghc::filesystem::is_directory(encoded_path, error_code) ||
+      encoded_path.extension() == ".txt") {
+    const auto encoded_paths =
+        chromemedia::codec::ListBatchFiles(encoded_path, ".lyra");
+    if (!encoded_paths.has_value()) {
+      return -1;
+    }
+    if (!chromemedia::codec::DecodeFiles(
+            encoded_paths.value(), output_dir, output_suffix, sample_rate_hz,
+            packet_loss_rate, average_burst_length, model_path,
+            absl::GetFlag(FLAGS_num_workers))) {
+      LOG(ERROR) << "Failed to decode some of the files of " << encoded_path;
+      return -1;
+    }
+    return 0;
+  }
+
   auto base_name = encoded_path.stem();
   const auto output_path = ghc::filesystem::path(output_dir) /
                            encoded_path.stem().concat(output_suffix + ".wav");
 
-  if (!chromemedia::codec::DecodeFile(encoded_path, output_path, sample_rate_hz,
-                                      packet_loss_rate, average_burst_length,
-                                      model_path)) {
+  const int num_parallel_segments = absl::GetFlag(FLAGS_num_parallel_segments);
+  bool decoded;
+  if (chromemedia::codec::IsLyraStreamFile(encoded_path.string())) {
+    decoded = chromemedia::codec::DecodeLyraStreamFile(
+        encoded_path, output_path, sample_rate_hz,
+        absl::GetFlag(FLAGS_start_seconds),
+        absl::GetFlag(FLAGS_duration_seconds), model_path);
+  } else if (num_parallel_segments == 1) {
+    decoded = chromemedia::codec::DecodeFile(
+        encoded_path, output_path, sample_rate_hz, packet_loss_rate,
+        average_burst_length, model_path);
+  } else {
+    chromemedia::codec::ParallelDecodeOptions options;
+    options.num_segments = num_parallel_segments;
+    decoded = chromemedia::codec::DecodeFileInParallel(
+        encoded_path, output_path, sample_rate_hz, packet_loss_rate,
+        average_burst_length, model_path, options);
+  }
+  if (!decoded) {
     LOG(ERROR) << "Could not decode " << encoded_path;
     return -1;
   }
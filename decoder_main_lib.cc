@@ -15,38 +15,181 @@
 #include "decoder_main_lib.h"
 
 #include <algorithm>
+#include <atomic>
 #include <climits>
 #include <cmath>
 #include <cstdint>
 #include <fstream>
-#include <iterator>
+#include <istream>
 #include <memory>
 #include <optional>
+#include <ostream>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
 #include <vector>
 
-#include "absl/strings/string_view.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "crossfader.h"
+#include "file_batch.h"
 #include "gilbert_model.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_config.h"
 #include "lyra_decoder.h"
+#include "lyra_model.h"
+#include "lyra_stream_decoder.h"
+#include "lyra_stream_file.h"
 #include "wav_util.h"
 
 namespace chromemedia {
 namespace codec {
 namespace {
 
-int PacketSize(LyraDecoder* decoder) {
-  const float bits_per_packet = static_cast<float>(decoder->bitrate()) /
-                                decoder->frame_rate() * kNumFramesPerPacket;
+int PacketSize(const LyraDecoder& decoder) {
+  const float bits_per_packet = static_cast<float>(decoder.bitrate()) /
+                                decoder.frame_rate() * kNumFramesPerPacket;
   const float bytes_per_packet = bits_per_packet / CHAR_BIT;
   return static_cast<int>(std::ceil(bytes_per_packet));
 }
 
+int NumSamplesPerPacket(const LyraDecoder& decoder) {
+  return kNumFramesPerPacket * GetNumSamplesPerHop(decoder.sample_rate_hz());
+}
+
+// Decodes |encoded_packet|, which starts at |encoded_index| of the stream, or
+// conceals it if it was not |received|, and appends the samples to
+// |decoded_audio|.
+bool DecodePacket(absl::Span<const uint8_t> encoded_packet,
+                  int64_t encoded_index, bool received, LyraDecoder* decoder,
+                  std::vector<int16_t>* decoded_audio) {
+  const int num_samples_per_packet = NumSamplesPerPacket(*decoder);
+  absl::optional<std::vector<int16_t>> decoded_or;
+  if (received) {
+    if (!decoder->SetEncodedPacket(encoded_packet)) {
+      LOG(ERROR) << "Unable to set encoded packet starting at byte "
+                 << encoded_index;
+      return false;
+    }
+    decoded_or = decoder->DecodeSamples(num_samples_per_packet);
+  } else {
+    LOG(INFO) << "Decoding a packet in PLC mode.";
+    decoded_or = decoder->DecodePacketLoss(num_samples_per_packet);
+  }
+
+  if (!decoded_or.has_value()) {
+    LOG(ERROR) << "Unable to decode features starting at byte "
+               << encoded_index;
+    return false;
+  }
+  decoded_audio->insert(decoded_audio->end(), decoded_or.value().begin(),
+                        decoded_or.value().end());
+  return true;
+}
+
+// Opens |encoded_path| and returns the number of whole packets of
+// |packet_size| in it, or 0 on failure.
+int64_t OpenPacketStream(const ghc::filesystem::path& encoded_path,
+                         int packet_size, std::ifstream* encoded_stream) {
+  encoded_stream->open(encoded_path.string(),
+                       std::ios_base::binary | std::ios_base::ate);
+  if (!encoded_stream->is_open()) {
+    LOG(ERROR) << "Open on file " << encoded_path << " failed.";
+    return 0;
+  }
+  const int64_t stream_size = encoded_stream->tellg();
+  encoded_stream->seekg(0);
+
+  const int stream_size_remainder = stream_size % packet_size;
+  if (stream_size_remainder != 0) {
+    LOG(WARNING)
+        << "Read " << stream_size
+        << " bytes from file, which has a remainder when divided by packet "
+           "size. Removing the excess bytes from the end and attempting to "
+           "decode.";
+  }
+  const int64_t num_packets = stream_size / packet_size;
+  if (num_packets == 0) {
+    LOG(ERROR) << "File was empty or incomplete and truncated to empty size.";
+  }
+  return num_packets;
+}
+
+// Reads, decodes and writes the packets of |encoded_path| one at a time to a
+// wav file at |output_path|, so the memory used does not grow with the file.
+// Returns the number of samples written, or 0 on failure.
+int64_t DecodePacketStream(const ghc::filesystem::path& encoded_path,
+                           const ghc::filesystem::path& output_path,
+                           float packet_loss_rate, float average_burst_length,
+                           LyraDecoder* decoder) {
+  const int packet_size = PacketSize(*decoder);
+  std::ifstream encoded_stream;
+  const int64_t num_packets =
+      OpenPacketStream(encoded_path, packet_size, &encoded_stream);
+  if (num_packets == 0) {
+    return 0;
+  }
+
+  auto gilbert_model =
+      GilbertModel::Create(packet_loss_rate, average_burst_length);
+  if (gilbert_model == nullptr) {
+    LOG(ERROR) << "Could not create Gilbert model.";
+    return 0;
+  }
+  absl::StatusOr<std::unique_ptr<WavWriter>> writer_or = WavWriter::Create(
+      output_path.string(), decoder->num_channels(), decoder->sample_rate_hz());
+  if (!writer_or.ok()) {
+    LOG(ERROR) << writer_or.status();
+    return 0;
+  }
+  WavWriter& writer = *writer_or.value();
+
+  std::vector<uint8_t> packet(packet_size);
+  std::vector<int16_t> decoded_audio;
+  for (int64_t i = 0; i < num_packets; ++i) {
+    if (!encoded_stream.read(reinterpret_cast<char*>(packet.data()),
+                             packet_size)) {
+      LOG(ERROR) << "Unable to read the packet starting at byte "
+                 << i * packet_size << " of " << encoded_path;
+      return 0;
+    }
+    decoded_audio.clear();
+    if (!DecodePacket(packet, i * packet_size,
+                      gilbert_model->IsPacketReceived(), decoder,
+                      &decoded_audio)) {
+      LOG(ERROR) << "Unable to decode features for file " << encoded_path;
+      return 0;
+    }
+    const absl::Status write_status = writer.Write(decoded_audio);
+    if (!write_status.ok()) {
+      LOG(ERROR) << write_status;
+      return 0;
+    }
+  }
+  const absl::Status close_status = writer.Close();
+  if (!close_status.ok()) {
+    LOG(ERROR) << close_status;
+    return 0;
+  }
+  return writer.num_samples();
+}
+
+// A run of packets decoded by its own decoder.
+struct Segment {
+  // The first packet decoded, to warm up the decoder.
+  int64_t first_packet;
+  // The first packet kept, the ones before it up to |begin_packet| overlap
+  // with the previous segment.
+  int64_t first_kept_packet;
+  int64_t begin_packet;
+  int64_t end_packet;
+  std::vector<int16_t> decoded_audio;
+};
+
 }  // namespace
 
 bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
@@ -59,43 +202,153 @@ bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
     return false;
   }
 
-  const int packet_size = PacketSize(decoder);
-  const int num_samples_per_packet =
-      kNumFramesPerPacket * GetNumSamplesPerHop(decoder->sample_rate_hz());
+  const int packet_size = PacketSize(*decoder);
 
   const auto benchmark_start = absl::Now();
   for (int encoded_index = 0; encoded_index < packet_stream.size();
        encoded_index += packet_size) {
-    const absl::Span<const uint8_t> encoded_packet =
-        absl::MakeConstSpan(packet_stream.data() + encoded_index, packet_size);
-
-    absl::optional<std::vector<int16_t>> decoded_or;
-    if (gilbert_model->IsPacketReceived()) {
-      if (!decoder->SetEncodedPacket(encoded_packet)) {
-        LOG(ERROR) << "Unable to set encoded packet starting at byte "
-                   << encoded_index;
-        return false;
+    if (!DecodePacket(
+            absl::MakeConstSpan(packet_stream.data() + encoded_index,
+                                packet_size),
+            encoded_index, gilbert_model->IsPacketReceived(), decoder,
+            decoded_audio)) {
+      return false;
+    }
+  }
+
+  const auto elapsed = absl::Now() - benchmark_start;
+  LOG(INFO) << "Elapsed seconds : " << absl::ToInt64Seconds(elapsed);
+  LOG(INFO) << "Samples per second : "
+            << decoded_audio->size() / absl::ToDoubleSeconds(elapsed);
+  return true;
+}
+
+bool DecodeFeaturesInParallel(const std::vector<uint8_t>& packet_stream,
+                              int sample_rate_hz, float packet_loss_rate,
+                              float average_burst_length,
+                              const std::shared_ptr<LyraModel>& model,
+                              const ParallelDecodeOptions& options,
+                              std::vector<int16_t>* decoded_audio) {
+  // Only used for the packet sizes, and to check the parameters.
+  auto decoder = LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                                     model);
+  if (decoder == nullptr) {
+    LOG(ERROR) << "Could not create lyra decoder.";
+    return false;
+  }
+  auto gilbert_model =
+      GilbertModel::Create(packet_loss_rate, average_burst_length);
+  if (gilbert_model == nullptr) {
+    LOG(ERROR) << "Could not create Gilbert model.";
+    return false;
+  }
+  if (options.num_warmup_packets < 0 || options.num_crossfade_packets < 0) {
+    LOG(ERROR) << "The numbers of warm-up and crossfade packets cannot be "
+                  "negative.";
+    return false;
+  }
+  const int packet_size = PacketSize(*decoder);
+  const int num_samples_per_packet = NumSamplesPerPacket(*decoder);
+  const int64_t num_packets = packet_stream.size() / packet_size;
+
+  // The losses are drawn up front, so that both decoders of an overlap see
+  // the same ones.
+  std::vector<bool> received(num_packets);
+  for (int64_t i = 0; i < num_packets; ++i) {
+    received[i] = gilbert_model->IsPacketReceived();
+  }
+
+  const int num_cores =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int num_segments = static_cast<int>(std::max<int64_t>(
+      1, std::min<int64_t>(
+             options.num_segments > 0 ? options.num_segments : num_cores,
+             num_packets / std::max(1, options.min_packets_per_segment))));
+  std::vector<Segment> segments(num_segments);
+  for (int i = 0; i < num_segments; ++i) {
+    Segment& segment = segments[i];
+    segment.begin_packet = num_packets * i / num_segments;
+    segment.end_packet = num_packets * (i + 1) / num_segments;
+    segment.first_kept_packet =
+        i == 0 ? 0
+               : std::max(segments[i - 1].begin_packet,
+                          segment.begin_packet - options.num_crossfade_packets);
+    segment.first_packet = std::max<int64_t>(
+        0, segment.first_kept_packet - options.num_warmup_packets);
+  }
+
+  const auto benchmark_start = absl::Now();
+  std::atomic<int> next_segment(0);
+  std::atomic<bool> all_succeeded(true);
+  const auto decode_segments = [&]() {
+    for (int i = next_segment++; i < num_segments; i = next_segment++) {
+      Segment& segment = segments[i];
+      auto segment_decoder = LyraDecoder::Create(sample_rate_hz, kNumChannels,
+                                                 kBitrate, model);
+      if (segment_decoder == nullptr) {
+        LOG(ERROR) << "Could not create lyra decoder.";
+        all_succeeded = false;
+        continue;
+      }
+      std::vector<int16_t> warmup_audio;
+      segment.decoded_audio.reserve(
+          (segment.end_packet - segment.first_kept_packet) *
+          num_samples_per_packet);
+      for (int64_t packet = segment.first_packet; packet < segment.end_packet;
+           ++packet) {
+        warmup_audio.clear();
+        if (!DecodePacket(
+                absl::MakeConstSpan(
+                    packet_stream.data() + packet * packet_size, packet_size),
+                packet * packet_size, received[packet], segment_decoder.get(),
+                packet < segment.first_kept_packet ? &warmup_audio
+                                                   : &segment.decoded_audio)) {
+          all_succeeded = false;
+          break;
+        }
       }
-      decoded_or = decoder->DecodeSamples(num_samples_per_packet);
-    } else {
-      LOG(INFO) << "Decoding a packet in PLC mode.";
-      decoded_or = decoder->DecodePacketLoss(num_samples_per_packet);
     }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < std::min(num_segments, num_cores); ++i) {
+    threads.emplace_back(decode_segments);
+  }
+  decode_segments();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (!all_succeeded) {
+    return false;
+  }
 
-    if (!decoded_or.has_value()) {
-      LOG(ERROR) << "Unable to decode features starting at byte "
-                 << encoded_index;
-      return false;
-    } else {
-      decoded_audio->insert(decoded_audio->end(), decoded_or.value().begin(),
-                            decoded_or.value().end());
+  // Each segment fades in over the packets it shares with the previous one.
+  Crossfader crossfader;
+  decoded_audio->reserve(decoded_audio->size() +
+                         num_packets * num_samples_per_packet);
+  for (const Segment& segment : segments) {
+    const int num_overlap_samples =
+        (segment.begin_packet - segment.first_kept_packet) *
+        num_samples_per_packet;
+    if (num_overlap_samples > 0) {
+      const absl::Span<int16_t> overlap = absl::MakeSpan(
+          &*(decoded_audio->end() - num_overlap_samples), num_overlap_samples);
+      crossfader.Crossfade(
+          overlap,
+          absl::MakeConstSpan(segment.decoded_audio.data(),
+                              num_overlap_samples),
+          overlap);
     }
+    decoded_audio->insert(decoded_audio->end(),
+                          segment.decoded_audio.begin() + num_overlap_samples,
+                          segment.decoded_audio.end());
   }
 
   const auto elapsed = absl::Now() - benchmark_start;
+  LOG(INFO) << "Decoded " << num_segments << " segments in parallel.";
   LOG(INFO) << "Elapsed seconds : " << absl::ToInt64Seconds(elapsed);
   LOG(INFO) << "Samples per second : "
-            << decoded_audio->size() / absl::ToDoubleSeconds(elapsed);
+            << num_packets * num_samples_per_packet /
+                   absl::ToDoubleSeconds(elapsed);
   return true;
 }
 
@@ -109,40 +362,248 @@ bool DecodeFile(const ghc::filesystem::path& encoded_path,
     LOG(ERROR) << "Could not create lyra decoder.";
     return false;
   }
-  std::ifstream encoded_stream(encoded_path.string(), std::ios_base::binary);
-  if (!encoded_stream.is_open()) {
-    LOG(ERROR) << "Open on file " << encoded_path << " failed.";
+
+  const auto benchmark_start = absl::Now();
+  const int64_t num_samples =
+      DecodePacketStream(encoded_path, output_path, packet_loss_rate,
+                         average_burst_length, decoder.get());
+  if (num_samples == 0) {
     return false;
   }
+  const auto elapsed = absl::Now() - benchmark_start;
+  LOG(INFO) << "Elapsed seconds : " << absl::ToInt64Seconds(elapsed);
+  LOG(INFO) << "Samples per second : "
+            << num_samples / absl::ToDoubleSeconds(elapsed);
+  return true;
+}
 
-  std::string packet_stream_string{
-      std::istreambuf_iterator<char>(encoded_stream),
-      std::istreambuf_iterator<char>()};
+bool DecodeLyraStreamFile(const ghc::filesystem::path& encoded_path,
+                          const ghc::filesystem::path& output_path,
+                          int sample_rate_hz, double start_seconds,
+                          double duration_seconds,
+                          const ghc::filesystem::path& model_path) {
+  absl::StatusOr<std::unique_ptr<LyraStreamReader>> reader =
+      LyraStreamReader::Open(encoded_path.string());
+  if (!reader.ok()) {
+    LOG(ERROR) << reader.status();
+    return false;
+  }
+  auto decoder = LyraDecoder::Create(
+      sample_rate_hz, (*reader)->header().num_channels, kBitrate, model_path);
+  if (decoder == nullptr) {
+    LOG(ERROR) << "Could not create lyra decoder.";
+    return false;
+  }
+  absl::StatusOr<std::unique_ptr<LyraStreamDecoder>> stream_decoder =
+      LyraStreamDecoder::Create(*std::move(reader), decoder.get());
+  if (!stream_decoder.ok()) {
+    LOG(ERROR) << stream_decoder.status();
+    return false;
+  }
 
-  const int packet_size = PacketSize(decoder.get());
+  const auto benchmark_start = absl::Now();
+  const int64_t start_sample = std::min<int64_t>(
+      std::llround(start_seconds * sample_rate_hz),
+      (*stream_decoder)->num_samples());
+  const absl::Status seek_status = (*stream_decoder)->Seek(start_sample);
+  if (!seek_status.ok()) {
+    LOG(ERROR) << seek_status;
+    return false;
+  }
+  LOG(INFO) << "Seeking took "
+            << absl::ToDoubleMilliseconds(absl::Now() - benchmark_start)
+            << " ms.";
+  int64_t num_samples = (*stream_decoder)->num_samples() - start_sample;
+  if (duration_seconds > 0) {
+    num_samples = std::min<int64_t>(
+        num_samples, std::llround(duration_seconds * sample_rate_hz));
+  }
 
-  const int stream_size_remainder = packet_stream_string.size() % packet_size;
-  if (stream_size_remainder != 0) {
-    LOG(WARNING)
-        << "Read " << packet_stream_string.size()
-        << " bytes from file, which has a remainder when divided by packet "
-           "size. Removing the excess bytes from the end and attempting to "
-           "decode.";
-    packet_stream_string = packet_stream_string.substr(
-        0, packet_stream_string.size() - stream_size_remainder);
+  absl::StatusOr<std::unique_ptr<WavWriter>> writer_or = WavWriter::Create(
+      output_path.string(), decoder->num_channels(), decoder->sample_rate_hz());
+  if (!writer_or.ok()) {
+    LOG(ERROR) << writer_or.status();
+    return false;
   }
-  if (packet_stream_string.empty()) {
-    LOG(ERROR) << "File was empty or incomplete and truncated to empty size.";
+  WavWriter& writer = *writer_or.value();
+  std::vector<int16_t> decoded_audio(
+      (*stream_decoder)->num_samples_per_packet() * decoder->num_channels());
+  for (int64_t num_left = num_samples; num_left > 0;) {
+    const int num_to_read = std::min<int64_t>(
+        num_left * decoder->num_channels(), decoded_audio.size());
+    const absl::StatusOr<int> num_read = (*stream_decoder)->Read(
+        absl::MakeSpan(decoded_audio.data(), num_to_read));
+    if (!num_read.ok()) {
+      LOG(ERROR) << num_read.status();
+      return false;
+    }
+    const absl::Status write_status = writer.Write(
+        absl::MakeConstSpan(decoded_audio.data(), *num_read));
+    if (!write_status.ok()) {
+      LOG(ERROR) << write_status;
+      return false;
+    }
+    if (*num_read < num_to_read) {
+      break;
+    }
+    num_left -= *num_read / decoder->num_channels();
+  }
+  const absl::Status close_status = writer.Close();
+  if (!close_status.ok()) {
+    LOG(ERROR) << close_status;
+    return false;
+  }
+  const auto elapsed = absl::Now() - benchmark_start;
+  LOG(INFO) << "Elapsed seconds : " << absl::ToInt64Seconds(elapsed);
+  LOG(INFO) << "Samples per second : "
+            << num_samples / absl::ToDoubleSeconds(elapsed);
+  return true;
+}
+
+bool DecodeStream(std::istream* input, std::ostream* output,
+                  bool raw_output, int sample_rate_hz, float packet_loss_rate,
+                  float average_burst_length,
+                  const ghc::filesystem::path& model_path) {
+  auto decoder =
+      LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate, model_path);
+  if (decoder == nullptr) {
+    LOG(ERROR) << "Could not create lyra decoder.";
+    return false;
+  }
+  auto gilbert_model =
+      GilbertModel::Create(packet_loss_rate, average_burst_length);
+  if (gilbert_model == nullptr) {
+    LOG(ERROR) << "Could not create Gilbert model.";
+    return false;
+  }
+  if (!raw_output) {
+    const absl::Status header_status = WriteWavStreamHeader(
+        {decoder->num_channels(), decoder->sample_rate_hz()}, output);
+    if (!header_status.ok()) {
+      LOG(ERROR) << header_status;
+      return false;
+    }
+  }
+
+  // Decodes and flushes every packet as soon as it arrives.
+  const int packet_size = PacketSize(*decoder);
+  std::vector<uint8_t> packet(packet_size);
+  std::vector<int16_t> decoded_audio;
+  int64_t num_packets = 0;
+  absl::Duration total_processing;
+  absl::Duration max_processing;
+  while (input->read(reinterpret_cast<char*>(packet.data()), packet_size)) {
+    const absl::Time packet_start = absl::Now();
+    decoded_audio.clear();
+    if (!DecodePacket(packet, num_packets * packet_size,
+                      gilbert_model->IsPacketReceived(), decoder.get(),
+                      &decoded_audio)) {
+      return false;
+    }
+    const absl::Status write_status = WritePcmSamples(decoded_audio, output);
+    if (!write_status.ok()) {
+      LOG(ERROR) << write_status;
+      return false;
+    }
+    const absl::Duration processing = absl::Now() - packet_start;
+    total_processing += processing;
+    max_processing = std::max(max_processing, processing);
+    ++num_packets;
+  }
+  if (input->bad()) {
+    LOG(ERROR) << "Unable to read the packet starting at byte "
+               << num_packets * packet_size << ".";
+    return false;
+  }
+  if (input->gcount() != 0) {
+    LOG(WARNING) << "Dropping the " << input->gcount()
+                 << " bytes of the incomplete last packet.";
+  }
+  LOG(INFO) << "Decoded " << num_packets << " packets.";
+  if (num_packets > 0) {
+    LOG(INFO) << "Mean milliseconds per packet : "
+              << absl::ToDoubleMilliseconds(total_processing / num_packets);
+    LOG(INFO) << "Max milliseconds per packet : "
+              << absl::ToDoubleMilliseconds(max_processing);
+  }
+  return true;
+}
+
+bool DecodeFiles(const std::vector<ghc::filesystem::path>& encoded_paths,
+                 const ghc::filesystem::path& output_dir,
+                 const std::string& output_suffix, int sample_rate_hz,
+                 float packet_loss_rate, float average_burst_length,
+                 const ghc::filesystem::path& model_path, int num_workers) {
+  // The decoders of all files share one copy of the weights, so only the
+  // first file pays for loading them.
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(model_path);
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not load the model at " << model_path;
+    return false;
+  }
+
+  const FileBatchResult result = ProcessFileBatch(
+      encoded_paths.size(), num_workers,
+      [&](int i) -> std::optional<double> {
+        const ghc::filesystem::path& encoded_path = encoded_paths[i];
+        // The decoder keeps the state of one stream, so every file gets a new
+        // one, which is cheap given the shared model.
+        auto decoder =
+            LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate, model);
+        if (decoder == nullptr) {
+          LOG(ERROR) << "Could not create lyra decoder for " << encoded_path;
+          return std::nullopt;
+        }
+        const ghc::filesystem::path output_path =
+            output_dir / encoded_path.stem().concat(output_suffix + ".wav");
+        const int64_t num_samples =
+            DecodePacketStream(encoded_path, output_path, packet_loss_rate,
+                               average_burst_length, decoder.get());
+        if (num_samples == 0) {
+          return std::nullopt;
+        }
+        return static_cast<double>(num_samples) / sample_rate_hz;
+      });
+  LogFileBatchResult(result);
+  return result.num_failed == 0;
+}
+
+bool DecodeFileInParallel(const ghc::filesystem::path& encoded_path,
+                          const ghc::filesystem::path& output_path,
+                          int sample_rate_hz, float packet_loss_rate,
+                          float average_burst_length,
+                          const ghc::filesystem::path& model_path,
+                          const ParallelDecodeOptions& options) {
+  // The decoders of all segments share one copy of the weights.
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(model_path);
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not load the model at " << model_path;
+    return false;
+  }
+  auto decoder =
+      LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate, model);
+  if (decoder == nullptr) {
+    LOG(ERROR) << "Could not create lyra decoder.";
+    return false;
+  }
+  const int packet_size = PacketSize(*decoder);
+  std::ifstream encoded_stream;
+  const int64_t num_packets =
+      OpenPacketStream(encoded_path, packet_size, &encoded_stream);
+  if (num_packets == 0) {
+    return false;
+  }
+  std::vector<uint8_t> packet_stream(num_packets * packet_size);
+  if (!encoded_stream.read(reinterpret_cast<char*>(packet_stream.data()),
+                           packet_stream.size())) {
+    LOG(ERROR) << "Unable to read " << encoded_path;
     return false;
   }
-  std::vector<uint8_t> packet_stream(packet_stream_string.size());
-  std::transform(packet_stream_string.begin(), packet_stream_string.end(),
-                 packet_stream.begin(),
-                 [](char packet) { return static_cast<uint8_t>(packet); });
 
   std::vector<int16_t> decoded_audio;
-  if (!DecodeFeatures(packet_stream, packet_loss_rate, average_burst_length,
-                      decoder.get(), &decoded_audio)) {
+  if (!DecodeFeaturesInParallel(packet_stream, sample_rate_hz,
+                                packet_loss_rate, average_burst_length, model,
+                                options, &decoded_audio)) {
     LOG(ERROR) << "Unable to decode features for file " << encoded_path;
     return false;
   }
@@ -18,12 +18,16 @@
 #define LYRA_CODEC_DECODER_MAIN_LIB_H_
 
 #include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
 #include "absl/strings/string_view.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_decoder.h"
+#include "lyra_model.h"
 
 namespace chromemedia {
 namespace codec {
@@ -33,6 +37,32 @@ bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
                     float packet_loss_rate, float average_burst_length,
                     LyraDecoder* decoder, std::vector<int16_t>* decoded_audio);
 
+// How |DecodeFeaturesInParallel| splits a packet stream.
+struct ParallelDecodeOptions {
+  // The number of segments, each decoded by its own decoder on its own
+  // thread. Defaults to the number of cores if not positive.
+  int num_segments = 0;
+  // Fewer segments are used if they would be shorter than this, so that the
+  // warm-up stays a small part of the work.
+  int min_packets_per_segment = 250;
+  // Packets decoded and discarded before a segment to settle the state of its
+  // decoder.
+  int num_warmup_packets = 8;
+  // Packets at the start of a segment that are also decoded by the previous
+  // segment and crossfaded with it.
+  int num_crossfade_packets = 2;
+};
+
+// Decodes |packet_stream| like |DecodeFeatures|, but in segments that run
+// concurrently on decoders sharing |model|. The lost packets follow one
+// Gilbert model over the whole stream, as in |DecodeFeatures|.
+bool DecodeFeaturesInParallel(const std::vector<uint8_t>& packet_stream,
+                              int sample_rate_hz, float packet_loss_rate,
+                              float average_burst_length,
+                              const std::shared_ptr<LyraModel>& model,
+                              const ParallelDecodeOptions& options,
+                              std::vector<int16_t>* decoded_audio);
+
 // Decodes an encoded features file into a wav file.
 // Uses the model and quant files located under |model_path|.
 // Given the file /tmp/lyra/file1.lyra exists and is a valid encoded file. For:
@@ -40,11 +70,54 @@ bool DecodeFeatures(const std::vector<uint8_t>& packet_stream,
 // |output_path| = "/tmp/lyra/file1_decoded.lyra"
 // Then successful decoding will write out the file
 // /tmp/lyra/encoded/file1_decoded.wav
+// Packets are read, decoded and written one at a time, so the length of the
+// file does not affect the memory used.
 bool DecodeFile(const ghc::filesystem::path& encoded_path,
                 const ghc::filesystem::path& output_path, int sample_rate_hz,
                 float packet_loss_rate, float average_burst_length,
                 const ghc::filesystem::path& model_path);
 
+// Decodes a file written by |EncodeFileToLyraStream| into a wav file, from
+// |start_seconds| for |duration_seconds|, or to the end if that is not
+// positive. The stream decoder seeks to the start through the index of the
+// file, so the packets before it are not decoded.
+bool DecodeLyraStreamFile(const ghc::filesystem::path& encoded_path,
+                          const ghc::filesystem::path& output_path,
+                          int sample_rate_hz, double start_seconds,
+                          double duration_seconds,
+                          const ghc::filesystem::path& model_path);
+
+// Decodes the packets read from |input| and writes the samples of each packet
+// to |output| as soon as it has arrived, for use in pipes. |output| is a .wav
+// stream of unknown length, or raw 16 bit little endian samples if
+// |raw_output|. Nothing is buffered beyond one packet, and the time spent per
+// packet is logged at the end.
+bool DecodeStream(std::istream* input, std::ostream* output, bool raw_output,
+                  int sample_rate_hz, float packet_loss_rate,
+                  float average_burst_length,
+                  const ghc::filesystem::path& model_path);
+
+// Decodes each file of |encoded_paths| like |DecodeFile| into |output_dir|,
+// under its own name with the extension replaced by |output_suffix| and .wav.
+// The files are spread over |num_workers| threads, or one per core if not
+// positive, whose decoders share one model loaded from |model_path|. Every
+// file is attempted, and the aggregate throughput is logged at the end.
+// Returns false if any file failed.
+bool DecodeFiles(const std::vector<ghc::filesystem::path>& encoded_paths,
+                 const ghc::filesystem::path& output_dir,
+                 const std::string& output_suffix, int sample_rate_hz,
+                 float packet_loss_rate, float average_burst_length,
+                 const ghc::filesystem::path& model_path, int num_workers);
+
+// Same as |DecodeFile|, but decodes with |DecodeFeaturesInParallel|, which
+// holds the whole stream and output in memory.
+bool DecodeFileInParallel(const ghc::filesystem::path& encoded_path,
+                          const ghc::filesystem::path& output_path,
+                          int sample_rate_hz, float packet_loss_rate,
+                          float average_burst_length,
+                          const ghc::filesystem::path& model_path,
+                          const ParallelDecodeOptions& options);
+
 }  // namespace codec
 }  // namespace chromemedia
 
@@ -14,11 +14,15 @@
 
 #include "decoder_main_lib.h"
 
+#include <cstdint>
 #include <cstdio>
+#include <fstream>
 #include <memory>
+#include <sstream>
 #include <string>
 #include <system_error>  // NOLINT(build/c++11)
 #include <tuple>
+#include <vector>
 
 // placeholder for get runfiles header.
 #include "gmock/gmock.h"
@@ -27,6 +31,7 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_config.h"
@@ -135,6 +140,81 @@ TEST_P(DecoderMainLibTest, TwoEncodedFramesWithPacketLoss) {
   EXPECT_EQ(NumSamplesInWavFile(output_filepath), expected_num_samples);
 }
 
+TEST_P(DecoderMainLibTest, BatchDecodesEveryFileAndReportsFailures) {
+  const std::string kInputBaseName = "two_encoded_frames_16khz";
+  const auto batch_dir = output_dir_ / absl::StrCat("batch_", GetParam());
+  const auto input_filepath = testdata_dir_ / (kInputBaseName + ".lyra");
+  std::error_code error_code;
+  ghc::filesystem::create_directories(batch_dir, error_code);
+  ASSERT_FALSE(error_code);
+
+  EXPECT_TRUE(DecodeFiles({input_filepath}, batch_dir, "_decoded",
+                          sample_rate_hz_, /*packet_loss_rate=*/0.f,
+                          /*average_burst_length=*/1.f, model_path_,
+                          /*num_workers=*/2));
+  EXPECT_EQ(NumSamplesInWavFile(batch_dir /
+                                (kInputBaseName + "_decoded.wav")),
+            2 * num_samples_in_packet_);
+
+  // The missing file fails the batch, but the other one is still decoded.
+  ghc::filesystem::remove_all(batch_dir, error_code);
+  ghc::filesystem::create_directories(batch_dir, error_code);
+  EXPECT_FALSE(DecodeFiles(
+      {testdata_dir_ / "non_existent.lyra", input_filepath}, batch_dir,
+      "_decoded", sample_rate_hz_, /*packet_loss_rate=*/0.f,
+      /*average_burst_length=*/1.f, model_path_, /*num_workers=*/2));
+  EXPECT_EQ(NumSamplesInWavFile(batch_dir /
+                                (kInputBaseName + "_decoded.wav")),
+            2 * num_samples_in_packet_);
+}
+
+TEST_P(DecoderMainLibTest, StreamsTwoEncodedFrames) {
+  const auto input_filepath = testdata_dir_ / "two_encoded_frames_16khz.lyra";
+  std::ifstream encoded_stream(input_filepath.string(), std::ios::binary);
+  ASSERT_TRUE(encoded_stream.is_open());
+  std::stringstream input;
+  input << encoded_stream.rdbuf();
+
+  std::stringstream output;
+  EXPECT_TRUE(DecodeStream(&input, &output, /*raw_output=*/false,
+                           sample_rate_hz_, /*packet_loss_rate=*/0.f,
+                           /*average_burst_length=*/1.f, model_path_));
+  absl::StatusOr<WavFormat> format = ReadWavStreamHeader(&output);
+  ASSERT_TRUE(format.ok());
+  EXPECT_EQ(format->sample_rate_hz, sample_rate_hz_);
+  std::vector<int16_t> samples(3 * num_samples_in_packet_);
+  absl::StatusOr<int> num_read =
+      ReadPcmSamples(&output, absl::MakeSpan(samples));
+  ASSERT_TRUE(num_read.ok());
+  EXPECT_EQ(*num_read, 2 * num_samples_in_packet_);
+}
+
+TEST_P(DecoderMainLibTest, TwoEncodedFramesInParallel) {
+  const std::string kInputBaseName = "two_encoded_frames_16khz";
+  const auto input_filepath = testdata_dir_ / (kInputBaseName + ".lyra");
+  const auto output_filepath =
+      output_dir_ /
+      absl::StrCat(kInputBaseName, "_parallel_", GetParam(), ".wav");
+  ParallelDecodeOptions options;
+  options.num_segments = 2;
+  options.min_packets_per_segment = 1;
+  options.num_warmup_packets = 1;
+  options.num_crossfade_packets = 1;
+
+  EXPECT_TRUE(DecodeFileInParallel(input_filepath, output_filepath,
+                                   sample_rate_hz_, /*packet_loss_rate=*/0.5f,
+                                   /*average_burst_length=*/2.f, model_path_,
+                                   options));
+  EXPECT_EQ(NumSamplesInWavFile(output_filepath), 2 * num_samples_in_packet_);
+}
+
+TEST_P(DecoderMainLibTest, ParallelDecodingFileDoesNotExist) {
+  EXPECT_FALSE(DecodeFileInParallel(
+      testdata_dir_ / "non_existent", output_dir_ / "non_existent.wav",
+      sample_rate_hz_, /*packet_loss_rate=*/0.f, /*average_burst_length=*/1.f,
+      model_path_, ParallelDecodeOptions()));
+}
+
 INSTANTIATE_TEST_SUITE_P(SampleRates, DecoderMainLibTest,
                          testing::ValuesIn(kSupportedSampleRates));
 
@@ -17,10 +17,9 @@
 #ifndef LYRA_CODEC_DENOISER_INTERFACE_H_
 #define LYRA_CODEC_DENOISER_INTERFACE_H_
 
-#include <string>
-#include <vector>
+#include <cstdint>
 
-#include "absl/status/statusor.h"
+#include "absl/status/status.h"
 #include "absl/types/span.h"
 
 namespace chromemedia {
@@ -34,9 +33,11 @@ class DenoiserInterface {
   // Report the number of samples per hop, or 0 if it doesn't matter.
   virtual int SamplesPerHop() const = 0;
 
-  // Apply denoising to a frame of audio.
-  virtual absl::StatusOr<std::vector<int16_t>> Denoise(
-      absl::Span<const int16_t> input) = 0;
+  // Apply denoising in place to a frame of |SamplesPerHop| samples of audio.
+  virtual absl::Status Denoise(absl::Span<int16_t> frame) = 0;
+
+  // Forgets the audio of previous frames.
+  virtual void Reset() = 0;
 };
 
 }  // namespace codec
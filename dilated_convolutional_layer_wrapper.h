@@ -21,11 +21,13 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "glog/logging.h"
 #include "layer_wrapper.h"
 #include "sparse_inference_matrixvector.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -33,7 +35,7 @@ namespace codec {
 // Class that wraps the data and logic of dilated convolutional layers.
 template <typename WeightType, typename RhsType, typename OutputType,
           typename DiskWeightType>
-class DilatedConvolutionalLayerWrapper
+class DilatedConvolutionalLayerWrapper final
     : public LayerWrapper<WeightType, RhsType, OutputType, DiskWeightType> {
  public:
   using Super = LayerWrapper<WeightType, RhsType, OutputType, DiskWeightType>;
@@ -60,7 +62,8 @@ class DilatedConvolutionalLayerWrapper
 
     auto layer = Super::LoadAndCheckLayer(
         params.from, params.prefix, layer_prompt, params.num_filters,
-        params.kernel_size * params.num_input_channels, params.num_threads);
+        params.kernel_size * params.num_input_channels, params.num_threads,
+        params.model);
     if (layer == nullptr) {
       return nullptr;
     }
@@ -90,7 +93,10 @@ class DilatedConvolutionalLayerWrapper
            csrblocksparse::MutableVectorView<OutputType> output_view) override {
     // If |skip_connection| is true, the input to is first saved first and
     // Relu'd, then SpMM_bias is applied with no Relu. Then the saved input
-    // is added.
+    // is added. Each thread saves, Relu's and adds the rows that it computes
+    // in SpMM_bias, so only the Relu'd input has to be complete before the
+    // matrix multiplication. If the input was prepared externally, the first
+    // two steps were already done by |PrepareInputRows|.
     //
     //            |
     //          Input ---------
@@ -102,10 +108,9 @@ class DilatedConvolutionalLayerWrapper
     //           Add ----------
     //            |
     //          Output
-    if (skip_connection_) {
-      auto prev_layer_output_view = InputViewToUpdate();
-      SaveSkipConnectionInput(tid, spin_barrier, prev_layer_output_view);
-      Relu(tid, spin_barrier, &prev_layer_output_view);
+    if (skip_connection_ && !this->input_prepared_externally_) {
+      PrepareInputRows(thread_row_starts_[tid], thread_row_starts_[tid + 1]);
+      spin_barrier->barrier();
     }
 
     // Select a part of the |input_buffer_| as the input to the matrix
@@ -115,11 +120,14 @@ class DilatedConvolutionalLayerWrapper
 
     this->layer_->SpMM_bias(input_view, &output_view, this->relu_, tid,
                             this->per_column_barrier_ ? spin_barrier : nullptr);
-    spin_barrier->barrier();
-
     if (skip_connection_) {
-      AddSkipConnection(tid, spin_barrier, &output_view);
+      if (!thread_rows_match_layer_) {
+        spin_barrier->barrier();
+      }
+      AddSkipConnection(tid, &output_view);
     }
+    this->RunRowEpilogue(tid);
+    spin_barrier->barrier();
 
     Reset(tid, spin_barrier);
   }
@@ -134,9 +142,51 @@ class DilatedConvolutionalLayerWrapper
         this->num_input_channels_, 1);
   }
 
+  bool PreparesInput() const override { return skip_connection_; }
+
+  // TODO(b/163000746): Make skip connection a decorator.
+  // TODO(b/123254413): SIMD-optimize the Relu layer.
+  // Copies the rows of the input to the current step to
+  // |skip_connection_buffer_| and Relu's them in place in one pass.
+  void PrepareInputRows(int row_start, int row_end) override {
+    if (!skip_connection_) {
+      return;
+    }
+    RhsType* input = InputViewToUpdate().data();
+    for (int i = row_start; i < row_end; ++i) {
+      skip_connection_buffer_[i] = input[i];
+      input[i] = static_cast<RhsType>(
+          std::max(static_cast<float>(input[i]), 0.0f));
+    }
+  }
+
   int PrepareForThreads(int num_threads) override {
-    num_elements_per_thread_ = this->output_rows_ / num_threads;
-    return this->layer_->PrepareForThreads(num_threads);
+    const int num_prepared_threads =
+        this->layer_->PrepareForThreads(num_threads);
+    FindThreadRows(num_prepared_threads);
+    return num_prepared_threads;
+  }
+
+  void ClearState() override {
+    LayerWrapper<WeightType, RhsType, OutputType, DiskWeightType>::ClearState();
+    std::fill(window_starts_.begin(), window_starts_.end(), 0);
+    num_resets_ = 0;
+  }
+
+  // Also saves the column the next run reads.
+  void SaveState(StateWriter* writer) const override {
+    Super::SaveState(writer);
+    writer->Write(num_resets_);
+  }
+
+  bool RestoreState(StateReader* reader) override {
+    int num_resets;
+    if (!Super::RestoreState(reader) || !reader->Read(&num_resets) ||
+        num_resets < 0 || num_resets >= this->input_buffer_cols_) {
+      return false;
+    }
+    num_resets_ = num_resets;
+    return true;
   }
 
  private:
@@ -145,14 +195,20 @@ class DilatedConvolutionalLayerWrapper
       int num_input_channels, int output_rows, int input_buffer_rows,
       int input_buffer_cols, bool relu, bool per_column_barrier,
       bool skip_connection, int num_threads,
-      std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+      std::shared_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
           layer)
       : Super(num_input_channels, output_rows, /*length=*/1, input_buffer_rows,
-              input_buffer_cols, relu, per_column_barrier, std::move(layer)),
+              input_buffer_cols, relu, per_column_barrier, std::move(layer),
+              Super::NumRowsToAdvanceInPlace(input_buffer_rows,
+                                             num_input_channels,
+                                             kNumStepsPerRewind)),
         skip_connection_(skip_connection),
+        max_window_start_(this->input_buffer_.rows() - input_buffer_rows),
+        window_starts_(input_buffer_cols, 0),
         num_resets_(0),
-        num_elements_per_thread_(output_rows / num_threads),
-        skip_connection_buffer_(output_rows, 1) {}
+        skip_connection_buffer_(output_rows, 1) {
+    FindThreadRows(num_threads);
+  }
 
   // For dilated convolutional layers, the matrix multiplication needs inputs
   // from t, t - |dilation|, ..., t - |kernel_size| * |dilation|.
@@ -185,79 +241,107 @@ class DilatedConvolutionalLayerWrapper
   //  |----|----|----|----|                             //
   //  |    | v5 |    |    |                             //
   //
-  // This "shifting and advancing" is done by the Reset() function.
+  // This "shifting and advancing" is done by the Reset() function. Like in
+  // Conv1DLayerWrapper, the shift is mostly done by starting the window of
+  // each column |num_input_channels_| rows further down a longer column, and
+  // only every |kNumStepsPerRewind| shifts of a column is its content moved
+  // back to the top.
   void Reset(int tid, csrblocksparse::SpinBarrier* spin_barrier) override {
-    if (tid == 0) {
-      // Shift the current column up by |num_input_channels_| elements.
-      auto shift_to = InputColumnStart();
-      std::move(shift_to + this->num_input_channels_,
-                shift_to + this->input_buffer_rows_, shift_to);
-
-      // Perform the modulo operation on |num_resets_| to prevent
-      // overflow.
-      num_resets_ = (num_resets_ + 1) % this->input_buffer_cols_;
+    if (tid != 0) {
+      return;
     }
-    spin_barrier->barrier();
+    int& window_start = window_starts_[num_resets_];
+    if (window_start + this->num_input_channels_ <= max_window_start_) {
+      window_start += this->num_input_channels_;
+    } else {
+      // Shift the current window to the top of its column, leaving out the
+      // oldest |num_input_channels_| elements.
+      RhsType* column = this->input_buffer_.slice(num_resets_).data();
+      std::move(column + window_start + this->num_input_channels_,
+                column + window_start + this->input_buffer_rows_, column);
+      window_start = 0;
+    }
+
+    // Perform the modulo operation on |num_resets_| to prevent
+    // overflow.
+    num_resets_ = (num_resets_ + 1) % this->input_buffer_cols_;
   }
 
-  // Points to the current column of |input_buffer_| depending on the current
+  int WindowStart(int column) const override { return window_starts_[column]; }
+
+  // Points to the current window of |input_buffer_| depending on the current
   // |num_resets_|.
   RhsType* InputColumnStart() {
-    return this->input_buffer_.slice(num_resets_ % this->input_buffer_cols_)
-        .data();
+    return this->input_buffer_.slice(num_resets_).data() +
+           window_starts_[num_resets_];
   }
 
-  // TODO(b/163000746): Make skip connection a decorator.
-  void SaveSkipConnectionInput(int tid,
-                               csrblocksparse::SpinBarrier* spin_barrier,
-                               const csrblocksparse::MutableVectorView<RhsType>&
-                                   prev_layer_output_view) {
-    if (tid == 0) {
-      std::copy(prev_layer_output_view.data(),
-                prev_layer_output_view.data() + this->output_rows_,
-                skip_connection_buffer_.data());
+  // Finds the rows of the output that each thread computes in SpMM_bias(). If
+  // they are not known, the rows are divided evenly instead, and the skip
+  // connection can only be added once all threads finished the matrix
+  // multiplication.
+  void FindThreadRows(int num_threads) {
+    thread_row_starts_ = this->ThreadRowStarts(num_threads);
+    thread_rows_match_layer_ = !thread_row_starts_.empty();
+    if (!thread_rows_match_layer_) {
+      thread_row_starts_.resize(num_threads + 1);
+      for (int tid = 0; tid <= num_threads; ++tid) {
+        thread_row_starts_[tid] = tid * this->output_rows_ / num_threads;
+      }
     }
-    spin_barrier->barrier();
+  }
+
+  // The rows with a skip connection are final once the thread that adds it
+  // is done with them.
+  std::vector<int> OutputRowStarts(int num_threads) const override {
+    if (skip_connection_ && thread_row_starts_.size() == num_threads + 1) {
+      return thread_row_starts_;
+    }
+    return Super::OutputRowStarts(num_threads);
   }
 
   // TODO(b/163000746): Make skip connection a decorator.
   // TODO(b/123254413): SIMD-optimize the Skip connection.
-  // Element wise addition of the contents of |skip_connection_buffer_| to
-  // |dilated_conv_output|.
+  // Element wise addition of the rows of this thread of
+  // |skip_connection_buffer_| to |output_view|.
   void AddSkipConnection(
-      int tid, csrblocksparse::SpinBarrier* spin_barrier,
-      csrblocksparse::MutableVectorView<OutputType>* output_view) {
-    const int tid_offset = tid * num_elements_per_thread_;
-    for (int i = tid_offset; i < tid_offset + num_elements_per_thread_; ++i) {
+      int tid, csrblocksparse::MutableVectorView<OutputType>* output_view) {
+    for (int i = thread_row_starts_[tid]; i < thread_row_starts_[tid + 1];
+         ++i) {
       const float sum = static_cast<float>((*output_view)[i]) +
                         static_cast<float>(skip_connection_buffer_[i]);
       (*output_view)[i] = static_cast<OutputType>(sum);
     }
-    spin_barrier->barrier();
-  }
-
-  // TODO(b/123254413): SIMD-optimize the Relu layer.
-  void Relu(
-      int tid, csrblocksparse::SpinBarrier* spin_barrier,
-      csrblocksparse::MutableVectorView<RhsType>* prev_layer_output_buffer) {
-    const int tid_offset = tid * num_elements_per_thread_;
-    for (int i = tid_offset; i < tid_offset + num_elements_per_thread_; ++i) {
-      (*prev_layer_output_buffer)[i] = static_cast<RhsType>(
-          std::max(static_cast<float>((*prev_layer_output_buffer)[i]), 0.0f));
-    }
-    spin_barrier->barrier();
   }
 
   // Whether to add a skip connection from the input to the output. The
   // input will also go through Relu before the matrix multiplication.
   const bool skip_connection_;
 
+  // The number of times the window of a column advances before it is moved
+  // back to the top of the column.
+  static constexpr int kNumStepsPerRewind = 16;
+
+  // The largest row of a column of |input_buffer_| its window can start at,
+  // which is 0 if the window is moved back to the top on every call.
+  const int max_window_start_;
+
+  // The row at which the current window of each column of |input_buffer_|
+  // starts.
+  std::vector<int> window_starts_;
+
   // Keep track of which part of the buffer to use next.
   int num_resets_;
 
-  // Used in splitting work of AddSkipConnection() and Relu() among threads.
-  // May change between runs.
-  int num_elements_per_thread_;
+  // Thread |tid| saves, Relu's and adds the skip connection of the rows in
+  // [|thread_row_starts_[tid]|, |thread_row_starts_[tid + 1]|). May change
+  // between runs.
+  std::vector<int> thread_row_starts_;
+
+  // Whether those are the rows that each thread computes in SpMM_bias(), so
+  // that a thread can add the skip connection to its rows without waiting
+  // for the others.
+  bool thread_rows_match_layer_;
 
   csrblocksparse::FatCacheAlignedVector<RhsType> skip_connection_buffer_;
 };
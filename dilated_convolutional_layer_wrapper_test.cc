@@ -149,6 +149,48 @@ TYPED_TEST(DilatedConvolutionalLayerWrapperTest,
 // weight matrix shape: [|num_filters|, |kernel_size| * |num_input_channels|].
 //
 // Currently we only support dilated convolutional layers with |stride| == 1.
+TYPED_TEST(DilatedConvolutionalLayerWrapperTest,
+           LongRunsKeepTheInputHistory) {
+  // With 32 channels the shifts of the input buffer are cache aligned for all
+  // types, so they are done by advancing a window of each column that is
+  // moved back to the top of the column every few steps.
+  auto params = this->dilated_params_;
+  params.num_input_channels = 32;
+  params.num_filters = 32;
+  params.from = LayerParams::FromConstant{
+      .value = 0.5f,
+      .sparsity = -1.0f,
+  };
+  auto layer = LayerWrapperPeer<TypeParam>::Create(params);
+  ASSERT_NE(layer, nullptr);
+
+  // Repeat the inputs every |kPeriod| steps, so that the outputs repeat too
+  // once the first |kernel_size| * |dilation| inputs are in the buffer.
+  constexpr int kPeriod = 5;
+  constexpr int kNumSteps = 160;
+  using RhsType = typename LayerWrapperPeer<TypeParam>::RhsType;
+  using OutputType = typename LayerWrapperPeer<TypeParam>::OutputType;
+  csrblocksparse::FatCacheAlignedVector<OutputType> output_buffer(
+      params.num_filters, 1);
+  std::vector<std::vector<float>> outputs;
+  for (int step = 0; step < kNumSteps; ++step) {
+    auto input_view = layer->InputViewToUpdate();
+    for (int i = 0; i < input_view.rows(); ++i) {
+      input_view[i] = static_cast<RhsType>(0.01f * (step % kPeriod + 1) +
+                                           0.001f * (i % 4));
+    }
+    layer->Run(0, &this->spin_barrier_,
+               csrblocksparse::MutableVectorView<OutputType>(&output_buffer));
+    outputs.emplace_back(output_buffer.data(),
+                         output_buffer.data() + output_buffer.size());
+  }
+  for (int step = params.kernel_size * params.dilation;
+       step + kPeriod < kNumSteps; ++step) {
+    EXPECT_THAT(outputs[step + kPeriod],
+                testing::Pointwise(testing::FloatEq(), outputs[step]));
+  }
+}
+
 TYPED_TEST(DilatedConvolutionalLayerWrapperTest, LayerLoadSucceeds) {
   const LayerParams params = this->dilated_params_;
   auto layer = LayerWrapperPeer<TypeParam>::Create(params);
@@ -283,6 +325,44 @@ TYPED_TEST(DilatedConvolutionalLayerWrapperTest, SkipConnectionAddInput) {
   EXPECT_THAT(difference, testing::Each(testing::FloatEq(kInputValue)));
 }
 
+TYPED_TEST(DilatedConvolutionalLayerWrapperTest,
+           InputPreparedExternallyYieldsSameResult) {
+  const float kInputValue = -2.0f;
+  const auto params = this->dilated_params_;
+  auto layer = LayerWrapperPeer<TypeParam>::Create(params);
+  auto prepared_layer = LayerWrapperPeer<TypeParam>::Create(params);
+  ASSERT_NE(layer, nullptr);
+  ASSERT_NE(prepared_layer, nullptr);
+  EXPECT_TRUE(prepared_layer->PreparesInput());
+  prepared_layer->set_input_prepared_externally(true);
+
+  csrblocksparse::FatCacheAlignedVector<typename TestFixture::OutputType>
+      prepared_output_buffer;
+  for (int i = 0; i < 2 * this->kDilation; ++i) {
+    auto output_view = PrepareInputOutput(
+        /*expected_input_rows=*/params.num_input_channels,
+        /*expected_input_cols=*/1,
+        /*expected_output_rows=*/params.num_filters,
+        /*expected_output_cols=*/1, kInputValue + i, layer->InputViewToUpdate(),
+        &this->output_buffer_);
+    layer->Run(0, &this->spin_barrier_, output_view);
+
+    auto prepared_output_view = PrepareInputOutput(
+        /*expected_input_rows=*/params.num_input_channels,
+        /*expected_input_cols=*/1,
+        /*expected_output_rows=*/params.num_filters,
+        /*expected_output_cols=*/1, kInputValue + i,
+        prepared_layer->InputViewToUpdate(), &prepared_output_buffer);
+    prepared_layer->PrepareInputRows(0, params.num_input_channels);
+    prepared_layer->Run(0, &this->spin_barrier_, prepared_output_view);
+
+    for (int row = 0; row < params.num_filters; ++row) {
+      EXPECT_EQ(static_cast<float>(prepared_output_view[row]),
+                static_cast<float>(output_view[row]));
+    }
+  }
+}
+
 TYPED_TEST(DilatedConvolutionalLayerWrapperTest,
            MultipleThreadsYieldSameResults) {
   auto params = this->dilated_params_;
@@ -303,6 +383,26 @@ TYPED_TEST(DilatedConvolutionalLayerWrapperTest,
       /*expected_output_cols=*/1);
 }
 
+// The threads save, Relu and add the skip connection of the rows they compute,
+// which has to cover all rows also when the threads get unequal numbers of
+// rows.
+TYPED_TEST(DilatedConvolutionalLayerWrapperTest,
+           SkipConnectionWithUnevenThreadsYieldSameResults) {
+  auto params = this->dilated_params_;
+  params.num_input_channels = 20;
+  params.num_filters = 20;
+  params.from = LayerParams::FromConstant{
+      .value = 0.5f,
+      .sparsity = -1.0f,
+  };
+  VerifyMultipleThreadsYeldSameResults<LayerWrapperPeer<TypeParam>>(
+      /*iterations=*/8, /*threads_to_test=*/{1, 3}, params,
+      /*expected_input_rows=*/params.num_input_channels,
+      /*expected_input_cols=*/1,
+      /*expected_output_rows=*/params.num_filters,
+      /*expected_output_cols=*/1);
+}
+
 TYPED_TEST(DilatedConvolutionalLayerWrapperTest, NumericalResults) {
   const LayerParams params{.num_input_channels = 3,
                            .num_filters = 2,
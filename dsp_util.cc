@@ -20,6 +20,12 @@
 #include <limits>
 #include <optional>
 
+#if defined __AVX2__
+#include <immintrin.h>
+#elif defined __aarch64__
+#include <arm_neon.h>
+#endif  // defined __AVX2__
+
 #include "absl/types/span.h"
 #include "audio/dsp/signal_vector_util.h"
 #include "glog/logging.h"
@@ -50,5 +56,94 @@ int16_t ClipToInt16(float value) {
                   static_cast<float>(std::numeric_limits<int16_t>::max()));
 }
 
+void ClipToInt16(absl::Span<const float> input, absl::Span<int16_t> output) {
+  ScaleAndClipToInt16(1.f, input, output);
+}
+
+void ScaleAndClipToInt16(float scale, absl::Span<const float> input,
+                         absl::Span<int16_t> output) {
+  CHECK_EQ(input.size(), output.size());
+  const int num_samples = input.size();
+  const float* in = input.data();
+  int16_t* out = output.data();
+  int i = 0;
+#if defined __AVX2__
+  // Clipping before the conversion keeps cvttps from returning INT_MIN for
+  // values out of the int32 range; packs then only narrows.
+  const __m256 scale_ps = _mm256_set1_ps(scale);
+  const __m256 min_ps =
+      _mm256_set1_ps(static_cast<float>(std::numeric_limits<int16_t>::min()));
+  const __m256 max_ps =
+      _mm256_set1_ps(static_cast<float>(std::numeric_limits<int16_t>::max()));
+  for (; i + 16 <= num_samples; i += 16) {
+    const __m256 low = _mm256_min_ps(
+        _mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale_ps),
+                      min_ps),
+        max_ps);
+    const __m256 high = _mm256_min_ps(
+        _mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale_ps),
+                      min_ps),
+        max_ps);
+    // packs interleaves the 128-bit lanes of its inputs, so restore their
+    // order.
+    const __m256i packed = _mm256_permute4x64_epi64(
+        _mm256_packs_epi32(_mm256_cvttps_epi32(low), _mm256_cvttps_epi32(high)),
+        _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+  }
+#elif defined __aarch64__
+  // vcvtq truncates and saturates to int32, and vqmovn saturates to int16.
+  const float32x4_t scale_ps = vdupq_n_f32(scale);
+  for (; i + 8 <= num_samples; i += 8) {
+    const int32x4_t low = vcvtq_s32_f32(vmulq_f32(vld1q_f32(in + i), scale_ps));
+    const int32x4_t high =
+        vcvtq_s32_f32(vmulq_f32(vld1q_f32(in + i + 4), scale_ps));
+    vst1q_s16(out + i, vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+  }
+#endif  // defined __AVX2__
+  for (; i < num_samples; ++i) {
+    out[i] = ClipToInt16(in[i] * scale);
+  }
+}
+
+void Int16ToFloat(absl::Span<const int16_t> input, absl::Span<float> output) {
+  CHECK_EQ(input.size(), output.size());
+  const int num_samples = input.size();
+  const int16_t* in = input.data();
+  float* out = output.data();
+  int i = 0;
+#if defined __AVX2__
+  for (; i + 8 <= num_samples; i += 8) {
+    const __m256i widened = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+    _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(widened));
+  }
+#elif defined __aarch64__
+  for (; i + 8 <= num_samples; i += 8) {
+    const int16x8_t samples = vld1q_s16(in + i);
+    vst1q_f32(out + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))));
+    vst1q_f32(out + i + 4, vcvtq_f32_s32(vmovl_high_s16(samples)));
+  }
+#endif  // defined __AVX2__
+  for (; i < num_samples; ++i) {
+    out[i] = static_cast<float>(in[i]);
+  }
+}
+
+void SoftClipToInt16Range(absl::Span<float> samples) {
+  constexpr float kFullScale = std::numeric_limits<int16_t>::max();
+  constexpr float kKnee = kSoftClipKnee * kFullScale;
+  constexpr float kHeadroom = kFullScale - kKnee;
+  for (float& sample : samples) {
+    const float magnitude = std::abs(sample);
+    if (magnitude > kKnee) {
+      // Has the slope of 1 at the knee and approaches full scale.
+      sample = std::copysign(
+          kKnee + kHeadroom * std::tanh((magnitude - kKnee) / kHeadroom),
+          sample);
+    }
+  }
+}
+
 }  // namespace codec
 }  // namespace chromemedia
@@ -17,7 +17,14 @@
 #ifndef LYRA_CODEC_DSP_UTIL_H_
 #define LYRA_CODEC_DSP_UTIL_H_
 
+#include <algorithm>
 #include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#if defined __AVX2__
+#include <immintrin.h>
+#endif  // defined __AVX2__
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
@@ -35,7 +42,25 @@ absl::optional<float> LogSpectralDistance(
 // Clip values above max value or below min value for int16_t.
 int16_t ClipToInt16(float value);
 
-#if defined __aarch64__
+// Clips all of |input| like above into |output|, which needs to be of the
+// same size. Vectorized where AVX2 or NEON are available.
+void ClipToInt16(absl::Span<const float> input, absl::Span<int16_t> output);
+
+// Same as above, but multiplies |input| by |scale| before clipping.
+void ScaleAndClipToInt16(float scale, absl::Span<const float> input,
+                         absl::Span<int16_t> output);
+
+// Converts all of |input| to floats in |output|, which needs to be of the
+// same size. Vectorized where AVX2 or NEON are available.
+void Int16ToFloat(absl::Span<const int16_t> input, absl::Span<float> output);
+
+// Limits |samples| in place to the int16 range without the corners of
+// clipping: magnitudes up to |kSoftClipKnee| of full scale are kept, and
+// larger ones are compressed smoothly towards full scale.
+inline constexpr float kSoftClipKnee = 0.75f;
+void SoftClipToInt16Range(absl::Span<float> samples);
+
+#if defined __aarch64__ || defined __AVX2__
 
 // We do not provide fixed16 to fixed32 casting as there is no use case so far.
 template <typename InputType, typename OutputType>
@@ -46,6 +71,10 @@ struct ShouldEnableGenericCast
                  (csrblocksparse::IsFixed16Type<InputType>::value &&
                   csrblocksparse::IsFixed32Type<OutputType>::value))> {};
 
+#endif  // defined __aarch64__ || defined __AVX2__
+
+#if defined __aarch64__
+
 template <typename InputType, typename OutputType>
 typename std::enable_if<csrblocksparse::IsFixed16Type<InputType>::value &&
                         csrblocksparse::IsFixed16Type<OutputType>::value>::type
@@ -115,7 +144,181 @@ CastVector(int start, int end, const InputType* input, OutputType* output) {
   }
 }
 
-#else  // defined __aarch64__
+#elif defined __AVX2__
+
+// The x86 casts shift the raw values and saturate them like the NEON ones,
+// 16 values at a time with AVX2 and 32 or 16 with AVX-512. Unlike the NEON
+// ones they do not write past |end|: the values left over are cast one by one
+// by |ShiftAndSaturate|.
+
+// Returns |raw_value| shifted right by |kShiftAmount|, or left if it is
+// negative, and saturated to the range of |RawOutputType|.
+template <int kShiftAmount, typename RawOutputType>
+RawOutputType ShiftAndSaturate(int64_t raw_value) {
+  const int64_t shifted = kShiftAmount >= 0
+                              ? raw_value >> std::max(kShiftAmount, 0)
+                              : raw_value * (int64_t{1} << -std::min(
+                                                 kShiftAmount, 0));
+  return static_cast<RawOutputType>(std::min<int64_t>(
+      std::max<int64_t>(shifted, std::numeric_limits<RawOutputType>::min()),
+      std::numeric_limits<RawOutputType>::max()));
+}
+
+// Shifts the int16 values of |values| left by |kShiftAmount| bits, saturating
+// them to the int16 range. The values are clamped to the range that does not
+// overflow first, and those that were too large get the low bits set, so that
+// they saturate to the maximum.
+template <int kShiftAmount>
+__m256i SaturatingShiftLeftInt16(__m256i values) {
+  constexpr int16_t kMax = std::numeric_limits<int16_t>::max() >> kShiftAmount;
+  constexpr int16_t kMin = std::numeric_limits<int16_t>::min() >> kShiftAmount;
+  const __m256i too_large = _mm256_cmpgt_epi16(values, _mm256_set1_epi16(kMax));
+  values = _mm256_min_epi16(_mm256_max_epi16(values, _mm256_set1_epi16(kMin)),
+                            _mm256_set1_epi16(kMax));
+  return _mm256_or_si256(
+      _mm256_slli_epi16(values, kShiftAmount),
+      _mm256_and_si256(too_large, _mm256_set1_epi16((1 << kShiftAmount) - 1)));
+}
+
+// Same as above for int32 values.
+template <int kShiftAmount>
+__m256i SaturatingShiftLeftInt32(__m256i values) {
+  constexpr int32_t kMax = std::numeric_limits<int32_t>::max() >> kShiftAmount;
+  constexpr int32_t kMin = std::numeric_limits<int32_t>::min() >> kShiftAmount;
+  const __m256i too_large = _mm256_cmpgt_epi32(values, _mm256_set1_epi32(kMax));
+  values = _mm256_min_epi32(_mm256_max_epi32(values, _mm256_set1_epi32(kMin)),
+                            _mm256_set1_epi32(kMax));
+  return _mm256_or_si256(
+      _mm256_slli_epi32(values, kShiftAmount),
+      _mm256_and_si256(too_large, _mm256_set1_epi32((1 << kShiftAmount) - 1)));
+}
+
+#if defined __AVX512BW__
+// Same as above for 32 int16 values.
+template <int kShiftAmount>
+__m512i SaturatingShiftLeftInt16(__m512i values) {
+  constexpr int16_t kMax = std::numeric_limits<int16_t>::max() >> kShiftAmount;
+  constexpr int16_t kMin = std::numeric_limits<int16_t>::min() >> kShiftAmount;
+  const __mmask32 too_large =
+      _mm512_cmpgt_epi16_mask(values, _mm512_set1_epi16(kMax));
+  values = _mm512_min_epi16(_mm512_max_epi16(values, _mm512_set1_epi16(kMin)),
+                            _mm512_set1_epi16(kMax));
+  return _mm512_or_si512(
+      _mm512_slli_epi16(values, kShiftAmount),
+      _mm512_maskz_set1_epi16(too_large, (1 << kShiftAmount) - 1));
+}
+#endif  // defined __AVX512BW__
+
+template <typename InputType, typename OutputType>
+typename std::enable_if<csrblocksparse::IsFixed16Type<InputType>::value &&
+                        csrblocksparse::IsFixed16Type<OutputType>::value>::type
+CastVector(int start, int end, const InputType* input, OutputType* output) {
+  constexpr int kShiftAmount =
+      OutputType::kExponentBits - InputType::kExponentBits;
+  const int16_t* input_int16 = reinterpret_cast<const int16_t*>(input);
+  int16_t* output_int16 = reinterpret_cast<int16_t*>(output);
+  int i = start;
+#if defined __AVX512BW__
+  for (; i + 32 <= end; i += 32) {
+    __m512i values = _mm512_loadu_si512(input_int16 + i);
+    if constexpr (kShiftAmount > 0) {
+      values = _mm512_srai_epi16(values, kShiftAmount);
+    } else if constexpr (kShiftAmount < 0) {
+      values = SaturatingShiftLeftInt16<-kShiftAmount>(values);
+    }
+    _mm512_storeu_si512(output_int16 + i, values);
+  }
+#endif  // defined __AVX512BW__
+  for (; i + 16 <= end; i += 16) {
+    __m256i values = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(input_int16 + i));
+    if constexpr (kShiftAmount > 0) {
+      values = _mm256_srai_epi16(values, kShiftAmount);
+    } else if constexpr (kShiftAmount < 0) {
+      values = SaturatingShiftLeftInt16<-kShiftAmount>(values);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output_int16 + i), values);
+  }
+  for (; i < end; ++i) {
+    output_int16[i] = ShiftAndSaturate<kShiftAmount, int16_t>(input_int16[i]);
+  }
+}
+
+template <typename InputType, typename OutputType>
+typename std::enable_if<csrblocksparse::IsFixed32Type<InputType>::value &&
+                        csrblocksparse::IsFixed16Type<OutputType>::value>::type
+CastVector(int start, int end, const InputType* input, OutputType* output) {
+  constexpr int kShiftAmount =
+      16 + OutputType::kExponentBits - InputType::kExponentBits;
+  // Shifting right by 31 bits already leaves only the sign.
+  constexpr int kRightShiftAmount = std::min(std::max(kShiftAmount, 0), 31);
+  const int32_t* input_int32 = reinterpret_cast<const int32_t*>(input);
+  int16_t* output_int16 = reinterpret_cast<int16_t*>(output);
+  int i = start;
+#if defined __AVX512F__
+  for (; i + 16 <= end; i += 16) {
+    __m512i values = _mm512_loadu_si512(input_int32 + i);
+    if constexpr (kShiftAmount > 0) {
+      values = _mm512_srai_epi32(values, kRightShiftAmount);
+    }
+    // Narrows with saturation.
+    __m256i narrowed = _mm512_cvtsepi32_epi16(values);
+    if constexpr (kShiftAmount < 0) {
+      narrowed = SaturatingShiftLeftInt16<-kShiftAmount>(narrowed);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output_int16 + i),
+                        narrowed);
+  }
+#endif  // defined __AVX512F__
+  for (; i + 16 <= end; i += 16) {
+    __m256i low = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(input_int32 + i));
+    __m256i high = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(input_int32 + i + 8));
+    if constexpr (kShiftAmount > 0) {
+      low = _mm256_srai_epi32(low, kRightShiftAmount);
+      high = _mm256_srai_epi32(high, kRightShiftAmount);
+    }
+    // Narrows with saturation, which interleaves the 128 bit lanes of |low|
+    // and |high|, then puts them back in order.
+    __m256i narrowed = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high),
+                                                _MM_SHUFFLE(3, 1, 2, 0));
+    if constexpr (kShiftAmount < 0) {
+      narrowed = SaturatingShiftLeftInt16<-kShiftAmount>(narrowed);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output_int16 + i),
+                        narrowed);
+  }
+  for (; i < end; ++i) {
+    output_int16[i] = ShiftAndSaturate<kShiftAmount, int16_t>(input_int32[i]);
+  }
+}
+
+template <typename InputType, typename OutputType>
+typename std::enable_if<csrblocksparse::IsFixed32Type<InputType>::value &&
+                        csrblocksparse::IsFixed32Type<OutputType>::value>::type
+CastVector(int start, int end, const InputType* input, OutputType* output) {
+  constexpr int kShiftAmount =
+      OutputType::kExponentBits - InputType::kExponentBits;
+  const int32_t* input_int32 = reinterpret_cast<const int32_t*>(input);
+  int32_t* output_int32 = reinterpret_cast<int32_t*>(output);
+  int i = start;
+  for (; i + 8 <= end; i += 8) {
+    __m256i values = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(input_int32 + i));
+    if constexpr (kShiftAmount > 0) {
+      values = _mm256_srai_epi32(values, kShiftAmount);
+    } else if constexpr (kShiftAmount < 0) {
+      values = SaturatingShiftLeftInt32<-kShiftAmount>(values);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output_int32 + i), values);
+  }
+  for (; i < end; ++i) {
+    output_int32[i] = ShiftAndSaturate<kShiftAmount, int32_t>(input_int32[i]);
+  }
+}
+
+#else  // defined __AVX2__
 
 template <typename InputType, typename OutputType>
 struct ShouldEnableGenericCast : std::true_type {};
@@ -14,6 +14,7 @@
 
 #include "dsp_util.h"
 
+#include <cmath>
 #include <cstdint>
 #include <limits>
 #include <numeric>
@@ -49,6 +50,72 @@ TEST(DspUtilTest, ClipTest) {
   EXPECT_EQ(kMin, std::numeric_limits<int16_t>::min());
 }
 
+// Values in and out of the int16 range, numerous enough to fill whole SIMD
+// registers and leave a tail.
+std::vector<float> ValuesAroundInt16Range() {
+  std::vector<float> values;
+  for (int i = 0; i < 37; ++i) {
+    values.push_back((i - 18) * 2731.7f);
+  }
+  values.push_back(1e10f);
+  values.push_back(-1e10f);
+  values.push_back(-0.75f);
+  return values;
+}
+
+TEST(DspUtilTest, ClipSpanEqualsClippingEachValue) {
+  const std::vector<float> values = ValuesAroundInt16Range();
+  std::vector<int16_t> clipped(values.size());
+  ClipToInt16(values, absl::MakeSpan(clipped));
+  for (int i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(clipped[i], ClipToInt16(values[i])) << "at index " << i;
+  }
+}
+
+TEST(DspUtilTest, ScaleAndClipEqualsClippingEachScaledValue) {
+  const std::vector<float> values = ValuesAroundInt16Range();
+  std::vector<int16_t> clipped(values.size());
+  ScaleAndClipToInt16(0.5f, values, absl::MakeSpan(clipped));
+  for (int i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(clipped[i], ClipToInt16(values[i] * 0.5f)) << "at index " << i;
+  }
+}
+
+TEST(DspUtilTest, Int16ToFloatIsExact) {
+  std::vector<int16_t> samples(43);
+  for (int i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<int16_t>((i - 21) * 1560);
+  }
+  samples.front() = std::numeric_limits<int16_t>::min();
+  samples.back() = std::numeric_limits<int16_t>::max();
+  std::vector<float> floats(samples.size());
+  Int16ToFloat(samples, absl::MakeSpan(floats));
+  EXPECT_THAT(floats, testing::Pointwise(testing::Eq(),
+                                         std::vector<float>(samples.begin(),
+                                                            samples.end())));
+}
+
+TEST(DspUtilTest, SoftClipKeepsQuietSamplesAndLimitsLoudOnes) {
+  constexpr float kFullScale = std::numeric_limits<int16_t>::max();
+  std::vector<float> samples = {0.f,        1000.f,      -20000.f, 28000.f,
+                                kFullScale, -kFullScale, 1e6f,     -1e6f};
+  const std::vector<float> original = samples;
+  SoftClipToInt16Range(absl::MakeSpan(samples));
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(samples[i], original[i]);
+  }
+  for (int i = 3; i < samples.size(); ++i) {
+    EXPECT_LT(std::abs(samples[i]), std::abs(original[i]));
+    EXPECT_GT(std::abs(samples[i]), kSoftClipKnee * kFullScale);
+    EXPECT_LE(std::abs(samples[i]), kFullScale);
+    EXPECT_EQ(std::signbit(samples[i]), std::signbit(original[i]));
+  }
+  // Louder samples stay louder.
+  EXPECT_LT(samples[3], samples[4]);
+  EXPECT_LT(samples[4], samples[6]);
+}
+
 // Pair of input and output types to be tested for casting and their
 // relevant data.
 template <typename I, typename O>
@@ -95,7 +162,8 @@ class CastVectorTest : public ::testing::Test {
   }
 
  protected:
-  static constexpr int kNumElements = 11;
+  // Covers whole SIMD registers of every width plus a scalar tail.
+  static constexpr int kNumElements = 75;
 
   csrblocksparse::CacheAlignedVector<typename InputOutputTypes::InputType>
       input_;
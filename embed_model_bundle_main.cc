@@ -0,0 +1,82 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes a C++ source file holding a model bundle as a constant array, which
+// registers it under |chromemedia::codec::EmbeddedModelPath(--name)| when
+// linked in. The weights then live in read-only pages of the binary and are
+// neither copied out of an APK nor decompressed at startup.
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+#include "model_bundle.h"
+
+ABSL_FLAG(std::string, bundle_path, "",
+          "Path to the bundle written by bundle_model.");
+ABSL_FLAG(std::string, name, "wavegru",
+          "The name the bundle is registered under.");
+ABSL_FLAG(std::string, output_path, "",
+          "The path of the C++ source file to be written.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string bundle_path = absl::GetFlag(FLAGS_bundle_path);
+  const std::string output_path = absl::GetFlag(FLAGS_output_path);
+  if (bundle_path.empty() || output_path.empty()) {
+    LOG(ERROR) << "Flags --bundle_path and --output_path have to be set.";
+    return -1;
+  }
+  // Rejects anything that the codec would not open.
+  if (chromemedia::codec::ModelBundle::Open(bundle_path) == nullptr) {
+    LOG(ERROR) << "Failed to open " << bundle_path;
+    return -1;
+  }
+  std::ifstream bundle_file(bundle_path, std::ios::binary);
+  const std::string bundle{std::istreambuf_iterator<char>(bundle_file),
+                           std::istreambuf_iterator<char>()};
+
+  std::ofstream output(output_path, std::ios::trunc);
+  output << "// Generated by embed_model_bundle. Do not edit.\n\n"
+         << "#include \"absl/strings/string_view.h\"\n"
+         << "#include \"model_bundle.h\"\n\n"
+         << "namespace chromemedia {\nnamespace codec {\nnamespace {\n\n"
+         << absl::StrFormat("alignas(%d) constexpr unsigned char kBundle[] = {",
+                            chromemedia::codec::kModelBundleAlignment);
+  for (size_t i = 0; i < bundle.size(); ++i) {
+    output << (i % 12 == 0 ? "\n   " : "")
+           << absl::StrFormat(" 0x%02x,", static_cast<uint8_t>(bundle[i]));
+  }
+  output << "\n};\n\n"
+         << "const bool kRegistered = RegisterEmbeddedModelBundle(\n"
+         << absl::StrFormat("    \"%s\",\n", absl::GetFlag(FLAGS_name))
+         << "    absl::string_view(reinterpret_cast<const char*>(kBundle),\n"
+         << "                      sizeof(kBundle)));\n\n"
+         << "}  // namespace\n}  // namespace codec\n}  // namespace "
+            "chromemedia\n";
+  if (!output.good()) {
+    LOG(ERROR) << "Failed to write " << output_path;
+    return -1;
+  }
+  return 0;
+}
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <iostream>
 #include <string>
 #include <system_error>  // NOLINT(build/c++11)
 
@@ -21,11 +22,16 @@
 #include "absl/strings/string_view.h"
 #include "architecture_utils.h"
 #include "encoder_main_lib.h"
+#include "file_batch.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
 
 ABSL_FLAG(std::string, input_path, "",
-          "Complete path to the WAV file to be encoded.");
+          "Complete path to the WAV file to be encoded. If this is a "
+          "directory, or a .txt file listing one WAV file per line, all those "
+          "files are encoded in one batch that loads the model once. If '-', "
+          "audio is read from stdin and every packet is written to stdout as "
+          "soon as it is encoded.");
 ABSL_FLAG(std::string, output_dir, "",
           "The dir for the encoded file to be written out. Recursively "
           "creates dir if it does not exist. Output files use the same "
@@ -37,6 +43,20 @@ ABSL_FLAG(bool, enable_preprocessing, false,
 ABSL_FLAG(bool, enable_dtx, false,
           "Enables discontinuous transmission (DTX). DTX does not send packets "
           "when noise is detected.");
+ABSL_FLAG(int, num_parallel_segments, 1,
+          "If not 1, the input is split into this many segments that are "
+          "encoded concurrently, or one per core if 0. The whole input is then "
+          "held in memory.");
+ABSL_FLAG(int, raw_sample_rate_hz, 0,
+          "If positive, the audio read from stdin is raw 16 bit little endian "
+          "mono samples at this rate instead of a WAV stream.");
+ABSL_FLAG(bool, seekable, false,
+          "Writes a seekable Lyra stream file with a '.lyras' postfix instead, "
+          "which holds a timestamp per packet and an index for decoding from "
+          "any position.");
+ABSL_FLAG(int, num_workers, 0,
+          "The number of files encoded concurrently in batch mode, or one per "
+          "core if 0.");
 ABSL_FLAG(
     std::string, model_path, "wavegru",
     "Path to directory containing quantization files. For mobile "
@@ -59,6 +79,15 @@ int main(int argc, char** argv) {
     LOG(ERROR) << "Flag --input_path not set.";
     return -1;
   }
+  if (input_path == "-") {
+    if (!chromemedia::codec::EncodeStream(
+            &std::cin, &std::cout, absl::GetFlag(FLAGS_raw_sample_rate_hz),
+            enable_preprocessing, enable_dtx, model_path)) {
+      LOG(ERROR) << "Failed to encode stdin.";
+      return -1;
+    }
+    return 0;
+  }
   if (output_dir.empty()) {
     LOG(ERROR) << "Flag --output_dir not set.";
     return -1;
@@ -73,12 +102,45 @@ int main(int argc, char** argv) {
       return -1;
     }
   }
-  const auto output_path =
-      ghc::filesystem::path(output_dir) / input_path.stem().concat(".lyra");
+  if (ghc::filesystem::is_directory(input_path, error_code) ||
+      input_path.extension() == ".txt") {
+    const auto wav_paths =
+        chromemedia::codec::ListBatchFiles(input_path, ".wav");
+    if (!wav_paths.has_value()) {
+      return -1;
+    }
+    if (!chromemedia::codec::EncodeFiles(
+            wav_paths.value(), output_dir, enable_preprocessing, enable_dtx,
+            model_path, absl::GetFlag(FLAGS_num_workers))) {
+      LOG(ERROR) << "Failed to encode some of the files of " << input_path;
+      return -1;
+    }
+    return 0;
+  }
 
-  if (!chromemedia::codec::EncodeFile(input_path, output_path,
-                                      enable_preprocessing, enable_dtx,
-                                      model_path)) {
+  const bool seekable = absl::GetFlag(FLAGS_seekable);
+  const auto output_path = ghc::filesystem::path(output_dir) /
+                           input_path.stem().concat(seekable ? ".lyras"
+                                                             : ".lyra");
+
+  const int num_parallel_segments = absl::GetFlag(FLAGS_num_parallel_segments);
+  bool encoded;
+  if (seekable) {
+    encoded = chromemedia::codec::EncodeFileToLyraStream(
+        input_path, output_path, enable_preprocessing, enable_dtx,
+        model_path);
+  } else if (num_parallel_segments == 1) {
+    encoded = chromemedia::codec::EncodeFile(input_path, output_path,
+                                             enable_preprocessing, enable_dtx,
+                                             model_path);
+  } else {
+    chromemedia::codec::ParallelEncodeOptions options;
+    options.num_segments = num_parallel_segments;
+    encoded = chromemedia::codec::EncodeFileInParallel(
+        input_path, output_path, enable_preprocessing, enable_dtx, model_path,
+        options);
+  }
+  if (!encoded) {
     LOG(ERROR) << "Failed to encode " << input_path;
     return -1;
   }
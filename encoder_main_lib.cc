@@ -15,29 +15,137 @@
 #include "encoder_main_lib.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <fstream>
-#include <iterator>
+#include <istream>
 #include <memory>
+#include <optional>
+#include <ostream>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/match.h"
-#include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "file_batch.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_config.h"
 #include "lyra_encoder.h"
+#include "lyra_model.h"
+#include "lyra_stream_file.h"
 #include "no_op_preprocessor.h"
 #include "wav_util.h"
 
 namespace chromemedia {
 namespace codec {
+namespace {
+
+// The number of packets encoded per call, which bounds the memory the batch
+// takes while amortizing the per-call overhead.
+constexpr int kNumPacketsPerBatch = 50;
+
+// Returns |samples| if there is no |preprocessor|, and otherwise a copy of
+// them in |buffer| that it processed in place, since |samples| belong to the
+// caller. |buffer| is reused from batch to batch.
+absl::Span<const int16_t> Preprocess(absl::Span<const int16_t> samples,
+                                     int sample_rate_hz,
+                                     PreprocessorInterface* preprocessor,
+                                     std::vector<int16_t>* buffer) {
+  if (preprocessor == nullptr) {
+    return samples;
+  }
+  buffer->assign(samples.begin(), samples.end());
+  preprocessor->Process(absl::MakeSpan(*buffer), sample_rate_hz);
+  return absl::MakeConstSpan(*buffer);
+}
+
+// Encodes |samples|, which hold whole packets, and appends the packets to
+// |encoded_features|.
+bool EncodeBatch(absl::Span<const int16_t> samples, LyraEncoder* encoder,
+                 std::vector<uint8_t>* encoded_features) {
+  auto encoded_or = encoder->EncodeBatch(samples);
+  if (!encoded_or.has_value()) {
+    return false;
+  }
+  // Append the encoded audio frames to the encoded_features accumulator
+  // vector.
+  for (const std::vector<uint8_t>& encoded : encoded_or.value()) {
+    encoded_features->insert(encoded_features->end(), encoded.begin(),
+                             encoded.end());
+  }
+  return true;
+}
+
+int NumSamplesPerPacket(int sample_rate_hz, const LyraEncoder& encoder) {
+  return kNumFramesPerPacket * sample_rate_hz / encoder.frame_rate();
+}
+
+// Reads |reader| from |wav_path| one batch at a time and writes the packets of
+// each batch to |output_path| right away, so the memory used does not grow
+// with the file.
+bool EncodeWavStream(const ghc::filesystem::path& wav_path,
+                     const ghc::filesystem::path& output_path,
+                     bool enable_preprocessing, WavReader* reader,
+                     LyraEncoder* encoder) {
+  std::unique_ptr<PreprocessorInterface> preprocessor;
+  if (enable_preprocessing) {
+    preprocessor = absl::make_unique<NoOpPreprocessor>();
+  }
+
+  std::ofstream output_stream(output_path.string(),
+                              std::ios_base::binary | std::ios_base::trunc);
+  if (!output_stream.is_open()) {
+    LOG(ERROR) << "Could not open output file " << output_path;
+    return false;
+  }
+
+  const int num_samples_per_packet =
+      NumSamplesPerPacket(reader->sample_rate_hz(), *encoder);
+  std::vector<int16_t> batch(kNumPacketsPerBatch * num_samples_per_packet);
+  std::vector<uint8_t> encoded_features;
+  int64_t num_samples_read = 0;
+  while (true) {
+    const absl::StatusOr<int> num_read = reader->Read(absl::MakeSpan(batch));
+    if (!num_read.ok()) {
+      LOG(ERROR) << num_read.status();
+      return false;
+    }
+    // The samples after the last whole packet are dropped.
+    const int num_samples =
+        *num_read / num_samples_per_packet * num_samples_per_packet;
+    if (num_samples == 0) {
+      break;
+    }
+    encoded_features.clear();
+    if (preprocessor != nullptr) {
+      preprocessor->Process(absl::MakeSpan(batch.data(), num_samples),
+                            reader->sample_rate_hz());
+    }
+    if (!EncodeBatch(absl::MakeConstSpan(batch.data(), num_samples), encoder,
+                     &encoded_features)) {
+      LOG(ERROR) << "Unable to encode features starting at samples at byte "
+                 << num_samples_read << ".";
+      LOG(ERROR) << "Unable to encode features for file " << wav_path;
+      return false;
+    }
+    num_samples_read += *num_read;
+    output_stream.write(reinterpret_cast<const char*>(encoded_features.data()),
+                        encoded_features.size());
+    if (!output_stream.good()) {
+      LOG(ERROR) << "Could not write to output file " << output_path;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
 
 // Packets are appended to encoded_features. The oldest packet is encoded
 // starting at index 0.
@@ -62,33 +170,30 @@ bool EncodeWav(const std::vector<int16_t>& wav_data, int num_channels,
 
   const auto benchmark_start = absl::Now();
 
-  std::vector<int16_t> processed_data(wav_data);
-  if (enable_preprocessing) {
-    processed_data = preprocessor->Process(
-        absl::MakeConstSpan(wav_data.data(), wav_data.size()), sample_rate_hz);
-  }
-
   const int num_samples_per_packet =
-      kNumFramesPerPacket * sample_rate_hz / encoder->frame_rate();
+      NumSamplesPerPacket(sample_rate_hz, *encoder);
+  const int num_samples_per_batch =
+      kNumPacketsPerBatch * num_samples_per_packet;
+  std::vector<int16_t> batch;
   // Iterate over the wav data until the end of the vector.
   for (int wav_iterator = 0;
-       wav_iterator + num_samples_per_packet <= processed_data.size();
-       wav_iterator += num_samples_per_packet) {
-    // Move audio samples from the large in memory wav file frame by frame to
-    // the encoder.
-    auto encoded_or = encoder->Encode(absl::MakeConstSpan(
-        &processed_data.at(wav_iterator), num_samples_per_packet));
-    if (!encoded_or.has_value()) {
+       wav_iterator + num_samples_per_packet <= wav_data.size();
+       wav_iterator += num_samples_per_batch) {
+    // Move audio samples from the large in memory wav file batch by batch to
+    // the encoder. The last batch holds the remaining whole packets.
+    const int num_samples =
+        std::min<int>(num_samples_per_batch,
+                      (wav_data.size() - wav_iterator) /
+                          num_samples_per_packet * num_samples_per_packet);
+    if (!EncodeBatch(
+            Preprocess(absl::MakeConstSpan(&wav_data.at(wav_iterator),
+                                           num_samples),
+                       sample_rate_hz, preprocessor.get(), &batch),
+            encoder.get(), encoded_features)) {
       LOG(ERROR) << "Unable to encode features starting at samples at byte "
                  << wav_iterator << ".";
       return false;
     }
-
-    // Append the encoded audio frames to the encoded_features accumulator
-    // vector.
-    encoded_features->insert(encoded_features->end(),
-                             encoded_or.value().begin(),
-                             encoded_or.value().end());
   }
   const auto elapsed = absl::Now() - benchmark_start;
   LOG(INFO) << "Elapsed seconds : " << absl::ToInt64Seconds(elapsed);
@@ -98,40 +203,391 @@ bool EncodeWav(const std::vector<int16_t>& wav_data, int num_channels,
   return true;
 }
 
+bool EncodeWavInParallel(const std::vector<int16_t>& wav_data,
+                         int num_channels, int sample_rate_hz,
+                         bool enable_preprocessing, bool enable_dtx,
+                         const ghc::filesystem::path& model_path,
+                         const ParallelEncodeOptions& options,
+                         std::vector<uint8_t>* encoded_features) {
+  if (options.num_preroll_packets < 0) {
+    LOG(ERROR) << "The number of pre-roll packets cannot be negative.";
+    return false;
+  }
+  // The encoders of all segments share one copy of the quantizer.
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(model_path);
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not load the model at " << model_path;
+    return false;
+  }
+  // Only used for the packet size, and to check the parameters.
+  auto encoder = LyraEncoder::Create(sample_rate_hz, num_channels, kBitrate,
+                                     enable_dtx, model);
+  if (encoder == nullptr) {
+    LOG(ERROR) << "Could not create lyra encoder.";
+    return false;
+  }
+  const int num_samples_per_packet =
+      NumSamplesPerPacket(sample_rate_hz, *encoder);
+  const int64_t num_packets = wav_data.size() / num_samples_per_packet;
+
+  const int num_cores =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int num_segments = static_cast<int>(std::max<int64_t>(
+      1, std::min<int64_t>(
+             options.num_segments > 0 ? options.num_segments : num_cores,
+             num_packets / std::max(1, options.min_packets_per_segment))));
+  // The packets of every segment, which are concatenated in order.
+  std::vector<std::vector<uint8_t>> segment_features(num_segments);
+
+  const auto benchmark_start = absl::Now();
+  std::atomic<int> next_segment(0);
+  std::atomic<bool> all_succeeded(true);
+  const auto encode_segments = [&]() {
+    for (int i = next_segment++; i < num_segments; i = next_segment++) {
+      const int64_t begin_packet = num_packets * i / num_segments;
+      const int64_t end_packet = num_packets * (i + 1) / num_segments;
+      auto segment_encoder = LyraEncoder::Create(
+          sample_rate_hz, num_channels, kBitrate, enable_dtx, model);
+      std::unique_ptr<PreprocessorInterface> preprocessor;
+      if (enable_preprocessing) {
+        preprocessor = absl::make_unique<NoOpPreprocessor>();
+      }
+      if (segment_encoder == nullptr) {
+        LOG(ERROR) << "Could not create lyra encoder.";
+        all_succeeded = false;
+        continue;
+      }
+      // The pre-roll settles the state of the encoder on the audio before the
+      // segment, and its packets are dropped.
+      const int64_t first_packet =
+          std::max<int64_t>(0, begin_packet - options.num_preroll_packets);
+      std::vector<int16_t> batch;
+      if (first_packet < begin_packet) {
+        std::vector<uint8_t> preroll_features;
+        if (!EncodeBatch(
+                Preprocess(
+                    absl::MakeConstSpan(
+                        &wav_data[first_packet * num_samples_per_packet],
+                        (begin_packet - first_packet) * num_samples_per_packet),
+                    sample_rate_hz, preprocessor.get(), &batch),
+                segment_encoder.get(), &preroll_features)) {
+          LOG(ERROR) << "Unable to encode the pre-roll of segment " << i << ".";
+          all_succeeded = false;
+          continue;
+        }
+      }
+      for (int64_t packet = begin_packet; packet < end_packet;
+           packet += kNumPacketsPerBatch) {
+        const int64_t num_batch_packets =
+            std::min<int64_t>(kNumPacketsPerBatch, end_packet - packet);
+        if (!EncodeBatch(
+                Preprocess(absl::MakeConstSpan(
+                               &wav_data[packet * num_samples_per_packet],
+                               num_batch_packets * num_samples_per_packet),
+                           sample_rate_hz, preprocessor.get(), &batch),
+                segment_encoder.get(), &segment_features[i])) {
+          LOG(ERROR) << "Unable to encode features starting at samples at byte "
+                     << packet * num_samples_per_packet << ".";
+          all_succeeded = false;
+          break;
+        }
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < std::min(num_segments, num_cores); ++i) {
+    threads.emplace_back(encode_segments);
+  }
+  encode_segments();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (!all_succeeded) {
+    return false;
+  }
+  for (const std::vector<uint8_t>& features : segment_features) {
+    encoded_features->insert(encoded_features->end(), features.begin(),
+                             features.end());
+  }
+
+  const auto elapsed = absl::Now() - benchmark_start;
+  LOG(INFO) << "Encoded " << num_segments << " segments in parallel.";
+  LOG(INFO) << "Elapsed seconds : " << absl::ToInt64Seconds(elapsed);
+  LOG(INFO) << "Samples per second : "
+            << wav_data.size() / absl::ToDoubleSeconds(elapsed);
+  return true;
+}
+
 bool EncodeFile(const ghc::filesystem::path& wav_path,
                 const ghc::filesystem::path& output_path,
                 bool enable_preprocessing, bool enable_dtx,
                 const ghc::filesystem::path& model_path) {
+  absl::StatusOr<std::unique_ptr<WavReader>> reader_or =
+      WavReader::Open(wav_path.string());
+  if (!reader_or.ok()) {
+    LOG(ERROR) << reader_or.status();
+    return false;
+  }
+  WavReader& reader = *reader_or.value();
+
+  auto encoder = LyraEncoder::Create(
+      /*sample_rate_hz=*/reader.sample_rate_hz(),
+      /*num_channels=*/reader.num_channels(),
+      /*bitrate=*/kBitrate,
+      /*enable_dtx=*/enable_dtx,
+      /*model_path=*/model_path);
+  if (encoder == nullptr) {
+    LOG(ERROR) << "Could not create lyra encoder.";
+    return false;
+  }
+
+  const auto benchmark_start = absl::Now();
+  if (!EncodeWavStream(wav_path, output_path, enable_preprocessing, &reader,
+                       encoder.get())) {
+    return false;
+  }
+  const auto elapsed = absl::Now() - benchmark_start;
+  LOG(INFO) << "Elapsed seconds : " << absl::ToInt64Seconds(elapsed);
+  LOG(INFO) << "Samples per second : "
+            << reader.num_samples() / absl::ToDoubleSeconds(elapsed);
+
+  return true;
+}
+
+bool EncodeFileToLyraStream(const ghc::filesystem::path& wav_path,
+                            const ghc::filesystem::path& output_path,
+                            bool enable_preprocessing, bool enable_dtx,
+                            const ghc::filesystem::path& model_path) {
+  absl::StatusOr<std::unique_ptr<WavReader>> reader_or =
+      WavReader::Open(wav_path.string());
+  if (!reader_or.ok()) {
+    LOG(ERROR) << reader_or.status();
+    return false;
+  }
+  WavReader& reader = *reader_or.value();
+
+  auto encoder = LyraEncoder::Create(
+      /*sample_rate_hz=*/reader.sample_rate_hz(),
+      /*num_channels=*/reader.num_channels(),
+      /*bitrate=*/kBitrate,
+      /*enable_dtx=*/enable_dtx,
+      /*model_path=*/model_path);
+  if (encoder == nullptr) {
+    LOG(ERROR) << "Could not create lyra encoder.";
+    return false;
+  }
+  std::unique_ptr<PreprocessorInterface> preprocessor;
+  if (enable_preprocessing) {
+    preprocessor = absl::make_unique<NoOpPreprocessor>();
+  }
+
+  LyraStreamHeader header;
+  header.sample_rate_hz = reader.sample_rate_hz();
+  header.num_channels = reader.num_channels();
+  header.packet_duration_ms =
+      kNumFramesPerPacket * 1000 / encoder->frame_rate();
+  header.dtx_enabled = enable_dtx;
+  absl::StatusOr<std::unique_ptr<LyraStreamWriter>> writer =
+      LyraStreamWriter::Create(output_path.string(), header);
+  if (!writer.ok()) {
+    LOG(ERROR) << writer.status();
+    return false;
+  }
+
+  const int num_samples_per_packet =
+      NumSamplesPerPacket(reader.sample_rate_hz(), *encoder);
+  std::vector<int16_t> batch(kNumPacketsPerBatch * num_samples_per_packet);
+  while (true) {
+    const absl::StatusOr<int> num_read = reader.Read(absl::MakeSpan(batch));
+    if (!num_read.ok()) {
+      LOG(ERROR) << num_read.status();
+      return false;
+    }
+    // The samples after the last whole packet are dropped.
+    const absl::Span<int16_t> samples = absl::MakeSpan(
+        batch.data(),
+        *num_read / num_samples_per_packet * num_samples_per_packet);
+    if (samples.empty()) {
+      break;
+    }
+    if (preprocessor != nullptr) {
+      preprocessor->Process(samples, reader.sample_rate_hz());
+    }
+    const auto encoded_or = encoder->EncodeBatch(samples);
+    if (!encoded_or.has_value()) {
+      LOG(ERROR) << "Unable to encode features for file " << wav_path;
+      return false;
+    }
+    // Packets DTX found silent are empty, and kept as such so that the
+    // timestamps of the stream stay in step with the audio.
+    for (const std::vector<uint8_t>& encoded : encoded_or.value()) {
+      const absl::Status status =
+          (*writer)->Write((*writer)->end_timestamp(), encoded);
+      if (!status.ok()) {
+        LOG(ERROR) << status;
+        return false;
+      }
+    }
+  }
+  const absl::Status close_status = (*writer)->Close();
+  if (!close_status.ok()) {
+    LOG(ERROR) << close_status;
+    return false;
+  }
+  return true;
+}
+
+bool EncodeStream(std::istream* input, std::ostream* output,
+                  int raw_sample_rate_hz, bool enable_preprocessing,
+                  bool enable_dtx, const ghc::filesystem::path& model_path) {
+  WavFormat format = {kNumChannels, raw_sample_rate_hz};
+  if (raw_sample_rate_hz <= 0) {
+    absl::StatusOr<WavFormat> format_or = ReadWavStreamHeader(input);
+    if (!format_or.ok()) {
+      LOG(ERROR) << format_or.status();
+      return false;
+    }
+    format = format_or.value();
+  }
+
+  auto encoder =
+      LyraEncoder::Create(format.sample_rate_hz, format.num_channels, kBitrate,
+                          enable_dtx, model_path);
+  if (encoder == nullptr) {
+    LOG(ERROR) << "Could not create lyra encoder.";
+    return false;
+  }
+  std::unique_ptr<PreprocessorInterface> preprocessor;
+  if (enable_preprocessing) {
+    preprocessor = absl::make_unique<NoOpPreprocessor>();
+  }
+
+  // Encodes and flushes every packet as soon as its samples arrive, so the
+  // only delay added is that of collecting one packet.
+  std::vector<int16_t> samples(
+      NumSamplesPerPacket(format.sample_rate_hz, *encoder));
+  std::vector<uint8_t> encoded_features;
+  int64_t num_packets = 0;
+  absl::Duration total_processing;
+  absl::Duration max_processing;
+  while (true) {
+    const absl::StatusOr<int> num_read =
+        ReadPcmSamples(input, absl::MakeSpan(samples));
+    if (!num_read.ok()) {
+      LOG(ERROR) << num_read.status();
+      return false;
+    }
+    // The samples after the last whole packet are dropped.
+    if (*num_read < static_cast<int>(samples.size())) {
+      break;
+    }
+    const absl::Time packet_start = absl::Now();
+    encoded_features.clear();
+    if (preprocessor != nullptr) {
+      preprocessor->Process(absl::MakeSpan(samples), format.sample_rate_hz);
+    }
+    if (!EncodeBatch(samples, encoder.get(), &encoded_features)) {
+      LOG(ERROR) << "Unable to encode packet " << num_packets << ".";
+      return false;
+    }
+    output->write(reinterpret_cast<const char*>(encoded_features.data()),
+                  encoded_features.size());
+    output->flush();
+    if (!output->good()) {
+      LOG(ERROR) << "Could not write packet " << num_packets << ".";
+      return false;
+    }
+    const absl::Duration processing = absl::Now() - packet_start;
+    total_processing += processing;
+    max_processing = std::max(max_processing, processing);
+    ++num_packets;
+  }
+  LOG(INFO) << "Encoded " << num_packets << " packets.";
+  if (num_packets > 0) {
+    LOG(INFO) << "Mean milliseconds per packet : "
+              << absl::ToDoubleMilliseconds(total_processing / num_packets);
+    LOG(INFO) << "Max milliseconds per packet : "
+              << absl::ToDoubleMilliseconds(max_processing);
+  }
+  return true;
+}
+
+bool EncodeFiles(const std::vector<ghc::filesystem::path>& wav_paths,
+                 const ghc::filesystem::path& output_dir,
+                 bool enable_preprocessing, bool enable_dtx,
+                 const ghc::filesystem::path& model_path, int num_workers) {
+  // The encoders of all files share one copy of the quantizer, so only the
+  // first file pays for loading it.
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(model_path);
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not load the model at " << model_path;
+    return false;
+  }
+
+  const FileBatchResult result = ProcessFileBatch(
+      wav_paths.size(), num_workers,
+      [&](int i) -> std::optional<double> {
+        const ghc::filesystem::path& wav_path = wav_paths[i];
+        absl::StatusOr<std::unique_ptr<WavReader>> reader_or =
+            WavReader::Open(wav_path.string());
+        if (!reader_or.ok()) {
+          LOG(ERROR) << reader_or.status();
+          return std::nullopt;
+        }
+        WavReader& reader = *reader_or.value();
+        // The encoder keeps the state of one stream, so every file gets a new
+        // one, which is cheap given the shared model.
+        auto encoder =
+            LyraEncoder::Create(reader.sample_rate_hz(), reader.num_channels(),
+                                kBitrate, enable_dtx, model);
+        if (encoder == nullptr) {
+          LOG(ERROR) << "Could not create lyra encoder for " << wav_path;
+          return std::nullopt;
+        }
+        const ghc::filesystem::path output_path =
+            output_dir / wav_path.stem().concat(".lyra");
+        if (!EncodeWavStream(wav_path, output_path, enable_preprocessing,
+                             &reader, encoder.get())) {
+          return std::nullopt;
+        }
+        return static_cast<double>(reader.num_samples()) /
+               reader.sample_rate_hz();
+      });
+  LogFileBatchResult(result);
+  return result.num_failed == 0;
+}
+
+bool EncodeFileInParallel(const ghc::filesystem::path& wav_path,
+                          const ghc::filesystem::path& output_path,
+                          bool enable_preprocessing, bool enable_dtx,
+                          const ghc::filesystem::path& model_path,
+                          const ParallelEncodeOptions& options) {
   // Reads the entire wav file into memory.
   absl::StatusOr<ReadWavResult> read_wav_result =
       Read16BitWavFileToVector(wav_path.string());
-
   if (!read_wav_result.ok()) {
     LOG(ERROR) << read_wav_result.status();
     return false;
   }
 
-  // Keep an accumulator vector of all the encoded features to write to file.
   std::vector<uint8_t> encoded_features;
-  if (!EncodeWav(read_wav_result->samples, read_wav_result->num_channels,
-                 read_wav_result->sample_rate_hz, enable_preprocessing,
-                 enable_dtx, model_path, &encoded_features)) {
+  if (!EncodeWavInParallel(read_wav_result->samples,
+                           read_wav_result->num_channels,
+                           read_wav_result->sample_rate_hz,
+                           enable_preprocessing, enable_dtx, model_path,
+                           options, &encoded_features)) {
     LOG(ERROR) << "Unable to encode features for file " << wav_path;
     return false;
   }
 
   std::ofstream output_stream(output_path.string(),
                               std::ios_base::binary | std::ios_base::trunc);
-  if (!output_stream.is_open()) {
-    LOG(ERROR) << "Could not open output file " << output_path;
+  output_stream.write(reinterpret_cast<const char*>(encoded_features.data()),
+                      encoded_features.size());
+  if (!output_stream.good()) {
+    LOG(ERROR) << "Could not write output file " << output_path;
     return false;
   }
-  absl::string_view encoded_data(
-      reinterpret_cast<const char*>(encoded_features.data()),
-      encoded_features.size());
-  std::ostreambuf_iterator<char> output_iterator(output_stream);
-  std::copy(encoded_data.begin(), encoded_data.end(), output_iterator);
-
   return true;
 }
 
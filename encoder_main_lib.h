@@ -18,6 +18,8 @@
 #define LYRA_CODEC_ENCODER_MAIN_LIB_H_
 
 #include <cstdint>
+#include <istream>
+#include <ostream>
 #include <string>
 #include <vector>
 
@@ -34,14 +36,76 @@ bool EncodeWav(const std::vector<int16_t>& wav_data, int num_channels,
                const ghc::filesystem::path& model_path,
                std::vector<uint8_t>* encoded_features);
 
+// How |EncodeWavInParallel| splits the audio.
+struct ParallelEncodeOptions {
+  // The number of segments, each encoded by its own encoder on its own
+  // thread. Defaults to the number of cores if not positive.
+  int num_segments = 0;
+  // Fewer segments are used if they would be shorter than this.
+  int min_packets_per_segment = 250;
+  // Packets encoded and discarded before a segment to prime its encoder.
+  int num_preroll_packets = 2;
+};
+
+// Same as |EncodeWav|, but encodes segments of |wav_data| concurrently on
+// encoders sharing one model. Without DTX the state of an encoder reaches back
+// less than a packet, so the output differs from that of |EncodeWav| at most
+// in the first |num_preroll_packets| packets after each seam. With DTX the
+// noise estimator remembers longer, so silent packets further from a seam may
+// be sent or dropped differently.
+bool EncodeWavInParallel(const std::vector<int16_t>& wav_data,
+                         int num_channels, int sample_rate_hz,
+                         bool enable_preprocessing, bool enable_dtx,
+                         const ghc::filesystem::path& model_path,
+                         const ParallelEncodeOptions& options,
+                         std::vector<uint8_t>* encoded_features);
+
 // Encodes a wav file into an encoded feature file. Encodes num_samples from the
 // file at |wav_path| and writes the encoded features out to |output_path|.
-// Uses the quant files located under |model_path|.
+// Uses the quant files located under |model_path|. The file is read and
+// written batch by batch, so its length does not affect the memory used.
 bool EncodeFile(const ghc::filesystem::path& wav_path,
                 const ghc::filesystem::path& output_path,
                 bool enable_preprocessing, bool enable_dtx,
                 const ghc::filesystem::path& model_path);
 
+// Same as |EncodeFile|, but writes the packets to a seekable Lyra stream file,
+// with a timestamp per packet and an index that lets |DecodeLyraStreamFile|
+// start anywhere in the file. Packets DTX found silent are kept as empty
+// records.
+bool EncodeFileToLyraStream(const ghc::filesystem::path& wav_path,
+                            const ghc::filesystem::path& output_path,
+                            bool enable_preprocessing, bool enable_dtx,
+                            const ghc::filesystem::path& model_path);
+
+// Encodes the audio read from |input| and writes each packet to |output| as
+// soon as its samples have been read, for use in pipes. |input| is a .wav
+// stream, or raw 16 bit little endian mono samples at |raw_sample_rate_hz| if
+// that is positive. Nothing is buffered beyond one packet, and the time spent
+// per packet is logged at the end.
+bool EncodeStream(std::istream* input, std::ostream* output,
+                  int raw_sample_rate_hz, bool enable_preprocessing,
+                  bool enable_dtx, const ghc::filesystem::path& model_path);
+
+// Encodes each file of |wav_paths| like |EncodeFile| into |output_dir|, under
+// its own name with the extension replaced by .lyra. The files are spread
+// over |num_workers| threads, or one per core if not positive, whose encoders
+// share one model loaded from |model_path|. Every file is attempted, and the
+// aggregate throughput is logged at the end. Returns false if any file
+// failed.
+bool EncodeFiles(const std::vector<ghc::filesystem::path>& wav_paths,
+                 const ghc::filesystem::path& output_dir,
+                 bool enable_preprocessing, bool enable_dtx,
+                 const ghc::filesystem::path& model_path, int num_workers);
+
+// Same as |EncodeFile|, but encodes with |EncodeWavInParallel|, which holds
+// the whole file and output in memory.
+bool EncodeFileInParallel(const ghc::filesystem::path& wav_path,
+                          const ghc::filesystem::path& output_path,
+                          bool enable_preprocessing, bool enable_dtx,
+                          const ghc::filesystem::path& model_path,
+                          const ParallelEncodeOptions& options);
+
 }  // namespace codec
 }  // namespace chromemedia
 
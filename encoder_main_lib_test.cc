@@ -14,18 +14,25 @@
 
 #include "encoder_main_lib.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
 #include <string>
 #include <system_error>  // NOLINT(build/c++11)
+#include <vector>
 
 // placeholder for get runfiles header.
 #include "gmock/gmock.h"
 // placeholder for testing header.
 #include "absl/flags/flag.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "wav_util.h"
 
 namespace chromemedia {
 namespace codec {
@@ -83,6 +90,120 @@ TEST_F(EncoderMainLibTest, EncodeSingleWavFiles) {
   }
 }
 
+TEST_F(EncoderMainLibTest, BatchEncodesEveryFile) {
+  std::vector<ghc::filesystem::path> wav_paths;
+  for (const auto wav_file : kWavFiles) {
+    wav_paths.push_back((testdata_dir_ / wav_file).concat(".wav"));
+  }
+  EXPECT_TRUE(EncodeFiles(wav_paths, output_dir_,
+                          /*enable_preprocessing=*/false,
+                          /*enable_dtx=*/false, model_path_,
+                          /*num_workers=*/2));
+  for (const auto wav_file : kWavFiles) {
+    std::error_code error_code;
+    EXPECT_GT(ghc::filesystem::file_size(
+                  (output_dir_ / wav_file).concat(".lyra"), error_code),
+              0)
+        << wav_file;
+  }
+}
+
+TEST_F(EncoderMainLibTest, BatchFailsIfAnyFileFails) {
+  const std::vector<ghc::filesystem::path> wav_paths = {
+      "should/not/exist.wav",
+      (testdata_dir_ / kWavFiles[0]).concat(".wav")};
+  EXPECT_FALSE(EncodeFiles(wav_paths, output_dir_,
+                           /*enable_preprocessing=*/false,
+                           /*enable_dtx=*/false, model_path_,
+                           /*num_workers=*/1));
+  // The failure does not stop the other files.
+  std::error_code error_code;
+  EXPECT_GT(ghc::filesystem::file_size(
+                (output_dir_ / kWavFiles[0]).concat(".lyra"), error_code),
+            0);
+}
+
+TEST_F(EncoderMainLibTest, RawStreamMatchesEncodeWav) {
+  const auto wav_path = (testdata_dir_ / "16khz_sample_000001.wav");
+  absl::StatusOr<ReadWavResult> wav = Read16BitWavFileToVector(wav_path);
+  ASSERT_TRUE(wav.ok());
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE(EncodeWav(wav->samples, wav->num_channels, wav->sample_rate_hz,
+                        /*enable_preprocessing=*/false, /*enable_dtx=*/false,
+                        model_path_, &expected));
+
+  std::stringstream input;
+  ASSERT_TRUE(WritePcmSamples(wav->samples, &input).ok());
+  std::stringstream output;
+  EXPECT_TRUE(EncodeStream(&input, &output, wav->sample_rate_hz,
+                           /*enable_preprocessing=*/false,
+                           /*enable_dtx=*/false, model_path_));
+  const std::string encoded = output.str();
+  EXPECT_EQ(std::vector<uint8_t>(encoded.begin(), encoded.end()), expected);
+}
+
+TEST_F(EncoderMainLibTest, WavStreamNeedsHeader) {
+  std::stringstream input(std::string(1000, '\0'));
+  std::stringstream output;
+  EXPECT_FALSE(EncodeStream(&input, &output, /*raw_sample_rate_hz=*/0,
+                            /*enable_preprocessing=*/false,
+                            /*enable_dtx=*/false, model_path_));
+}
+
+TEST_F(EncoderMainLibTest, ParallelEncodingDiffersOnlyNearSeams) {
+  for (const auto wav_file : kWavFiles) {
+    const auto wav_path = (testdata_dir_ / wav_file).concat(".wav");
+    absl::StatusOr<ReadWavResult> wav = Read16BitWavFileToVector(wav_path);
+    ASSERT_TRUE(wav.ok());
+
+    std::vector<uint8_t> serial;
+    ASSERT_TRUE(EncodeWav(wav->samples, wav->num_channels,
+                          wav->sample_rate_hz, /*enable_preprocessing=*/false,
+                          /*enable_dtx=*/false, model_path_, &serial));
+    ParallelEncodeOptions options;
+    options.num_segments = 4;
+    options.min_packets_per_segment = 1;
+    options.num_preroll_packets = 2;
+    std::vector<uint8_t> parallel;
+    ASSERT_TRUE(EncodeWavInParallel(wav->samples, wav->num_channels,
+                                    wav->sample_rate_hz,
+                                    /*enable_preprocessing=*/false,
+                                    /*enable_dtx=*/false, model_path_,
+                                    options, &parallel));
+
+    // Without DTX every packet has the same size, so they line up.
+    ASSERT_EQ(parallel.size(), serial.size()) << wav_file;
+    const int num_packets = serial.size() / kPacketSize;
+    ASSERT_GE(num_packets, options.num_segments);
+    for (int packet = 0; packet < num_packets; ++packet) {
+      const bool same = std::equal(
+          serial.begin() + packet * kPacketSize,
+          serial.begin() + (packet + 1) * kPacketSize,
+          parallel.begin() + packet * kPacketSize);
+      if (same) continue;
+      // The packet has to be among the first ones after a seam.
+      bool near_seam = false;
+      for (int segment = 1; segment < options.num_segments; ++segment) {
+        const int seam = num_packets * segment / options.num_segments;
+        near_seam |= packet >= seam &&
+                     packet < seam + options.num_preroll_packets;
+      }
+      EXPECT_TRUE(near_seam) << wav_file << " differs at packet " << packet;
+    }
+  }
+}
+
+TEST_F(EncoderMainLibTest, ParallelEncodingWritesFile) {
+  const auto wav_path = (testdata_dir_ / kWavFiles[0]).concat(".wav");
+  const auto encoded_path = (output_dir_ / kWavFiles[0]).concat(".lyra");
+  EXPECT_TRUE(EncodeFileInParallel(wav_path, encoded_path,
+                                   /*enable_preprocessing=*/false,
+                                   /*enable_dtx=*/false, model_path_,
+                                   ParallelEncodeOptions()));
+  std::error_code error_code;
+  EXPECT_GT(ghc::filesystem::file_size(encoded_path, error_code), 0);
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
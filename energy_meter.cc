@@ -0,0 +1,232 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "energy_meter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+bool ReadFile(const std::string& path, std::string* contents) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  contents->assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool ReadNumber(const std::string& path, double* value) {
+  std::string contents;
+  return ReadFile(path, &contents) &&
+         absl::SimpleAtod(absl::StripAsciiWhitespace(contents), value);
+}
+
+// Returns the energy in microwatt seconds summed over the rails listed in
+// |contents|, one "CH0(T=<ms>)[<rail>], <energy>" line each after a line with
+// the time, or a negative value if there is none.
+double SumRailMicrowattSeconds(absl::string_view contents) {
+  double total = -1.0;
+  for (const absl::string_view line : absl::StrSplit(contents, '\n')) {
+    const size_t comma = line.rfind(',');
+    double energy;
+    if (comma == absl::string_view::npos ||
+        !absl::SimpleAtod(absl::StripAsciiWhitespace(line.substr(comma + 1)),
+                          &energy)) {
+      continue;
+    }
+    total = std::max(total, 0.0) + energy;
+  }
+  return total;
+}
+
+// Returns the energy_value file of every power monitor under |sysfs_root|.
+std::vector<std::string> FindRailMonitors(const std::string& sysfs_root) {
+  std::vector<std::string> paths;
+  std::error_code error_code;
+  const ghc::filesystem::path devices =
+      ghc::filesystem::path(sysfs_root) / "bus" / "iio" / "devices";
+  for (const auto& device :
+       ghc::filesystem::directory_iterator(devices, error_code)) {
+    const std::string path = (device.path() / "energy_value").string();
+    std::string contents;
+    if (ReadFile(path, &contents) && SumRailMicrowattSeconds(contents) >= 0) {
+      paths.push_back(path);
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+}  // namespace
+
+const char* EnergySourceName(EnergyMeter::Source source) {
+  switch (source) {
+    case EnergyMeter::Source::kPowerRails:
+      return "power_rails";
+    case EnergyMeter::Source::kBattery:
+      return "battery";
+  }
+  return "unknown";
+}
+
+std::unique_ptr<EnergyMeter> EnergyMeter::Create(
+    const std::string& sysfs_root, absl::Duration battery_sample_period) {
+  const ghc::filesystem::path battery =
+      ghc::filesystem::path(sysfs_root) / "class" / "power_supply" /
+      "battery";
+  const std::string status_path = (battery / "status").string();
+  std::vector<std::string> rails = FindRailMonitors(sysfs_root);
+  if (!rails.empty()) {
+    return std::unique_ptr<EnergyMeter>(
+        new EnergyMeter(Source::kPowerRails, std::move(rails), status_path,
+                        battery_sample_period));
+  }
+  if (battery_sample_period <= absl::ZeroDuration()) {
+    LOG(ERROR) << "The battery sample period has to be positive.";
+    return nullptr;
+  }
+  std::vector<std::string> battery_paths = {
+      (battery / "current_now").string(), (battery / "voltage_now").string()};
+  double value;
+  if (!ReadNumber(battery_paths[0], &value) ||
+      !ReadNumber(battery_paths[1], &value)) {
+    LOG(ERROR) << "Neither the power rails nor the battery under "
+               << sysfs_root << " can be read.";
+    return nullptr;
+  }
+  return std::unique_ptr<EnergyMeter>(
+      new EnergyMeter(Source::kBattery, std::move(battery_paths), status_path,
+                      battery_sample_period));
+}
+
+EnergyMeter::EnergyMeter(Source source, std::vector<std::string> paths,
+                         std::string status_path,
+                         absl::Duration battery_sample_period)
+    : source_(source),
+      paths_(std::move(paths)),
+      status_path_(std::move(status_path)),
+      battery_sample_period_(battery_sample_period) {}
+
+EnergyMeter::~EnergyMeter() { Stop(); }
+
+void EnergyMeter::Start() {
+  Stop();
+  std::string status;
+  charging_ = ReadFile(status_path_, &status) &&
+              absl::StripAsciiWhitespace(status) == "Charging";
+  if (charging_ && source_ == Source::kBattery) {
+    LOG(WARNING) << "The battery is charging, so its readings do not show "
+                 << "what the device draws.";
+  }
+  started_ = true;
+  start_time_ = absl::Now();
+  if (source_ == Source::kPowerRails) {
+    start_joules_ = ReadRailJoules();
+    return;
+  }
+  {
+    absl::MutexLock lock(&mutex_);
+    sampling_ = true;
+    battery_joules_ = 0.0;
+  }
+  sampling_thread_ =
+      absl::make_unique<std::thread>(&EnergyMeter::SampleBattery, this);
+}
+
+EnergyReading EnergyMeter::Stop() {
+  EnergyReading reading;
+  if (!started_) {
+    return reading;
+  }
+  started_ = false;
+  if (source_ == Source::kPowerRails) {
+    reading.joules = std::max(ReadRailJoules() - start_joules_, 0.0);
+  } else {
+    {
+      absl::MutexLock lock(&mutex_);
+      sampling_ = false;
+    }
+    sampling_thread_->join();
+    sampling_thread_.reset();
+    absl::MutexLock lock(&mutex_);
+    reading.joules = battery_joules_;
+  }
+  reading.seconds = absl::ToDoubleSeconds(absl::Now() - start_time_);
+  return reading;
+}
+
+double EnergyMeter::ReadRailJoules() const {
+  double total = 0.0;
+  for (const std::string& path : paths_) {
+    std::string contents;
+    if (ReadFile(path, &contents)) {
+      total += std::max(SumRailMicrowattSeconds(contents), 0.0) * 1e-6;
+    }
+  }
+  return total;
+}
+
+double EnergyMeter::ReadBatteryWatts() const {
+  // In microamperes and microvolts. Drivers disagree on the sign of the
+  // current while discharging.
+  double current;
+  double voltage;
+  if (!ReadNumber(paths_[0], &current) || !ReadNumber(paths_[1], &voltage)) {
+    return 0.0;
+  }
+  return std::abs(current) * 1e-6 * std::abs(voltage) * 1e-6;
+}
+
+void EnergyMeter::SampleBattery() {
+  absl::MutexLock lock(&mutex_);
+  absl::Time sample_time = absl::Now();
+  double watts = ReadBatteryWatts();
+  while (sampling_) {
+    mutex_.AwaitWithTimeout(
+        absl::Condition(this, &EnergyMeter::StoppedSampling),
+        battery_sample_period_);
+    const absl::Time now = absl::Now();
+    battery_joules_ += watts * absl::ToDoubleSeconds(now - sample_time);
+    sample_time = now;
+    watts = ReadBatteryWatts();
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_ENERGY_METER_H_
+#define LYRA_CODEC_ENERGY_METER_H_
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Energy the device drew over a measured interval.
+struct EnergyReading {
+  double joules = 0.0;
+  double seconds = 0.0;
+
+  double watts() const { return seconds > 0.0 ? joules / seconds : 0.0; }
+};
+
+// Measures the energy the whole device draws, so other activity adds to the
+// readings. Where the on-device power monitors (ODPM) of the IIO subsystem can
+// be read, as on Pixel phones, their energy counters of every rail are used.
+// Otherwise the current and voltage of the battery are sampled, which is what
+// Android's BatteryManager reports as well; they are coarser, and meaningless
+// while the device is charging.
+class EnergyMeter {
+ public:
+  enum class Source {
+    kPowerRails,
+    kBattery,
+  };
+
+  // Returns nullptr if neither source can be read under |sysfs_root|. The
+  // battery is sampled every |battery_sample_period|.
+  static std::unique_ptr<EnergyMeter> Create(
+      const std::string& sysfs_root = "/sys",
+      absl::Duration battery_sample_period = absl::Milliseconds(20));
+
+  // Stops measuring if |Stop| was not called.
+  ~EnergyMeter();
+
+  // Starts measuring, restarting if it already was.
+  void Start();
+
+  // Stops measuring and returns the energy drawn since |Start|.
+  EnergyReading Stop();
+
+  Source source() const { return source_; }
+
+  // Whether the battery was charging at the last |Start|, in which case
+  // battery readings do not reflect the draw of the device.
+  bool charging() const { return charging_; }
+
+ private:
+  EnergyMeter(Source source, std::vector<std::string> paths,
+              std::string status_path, absl::Duration battery_sample_period);
+
+  // The sum of the energy counters of all rails in joules.
+  double ReadRailJoules() const;
+
+  // The draw of the device from the battery in watts, or 0 if it cannot be
+  // read.
+  double ReadBatteryWatts() const;
+
+  // Integrates |ReadBatteryWatts| until |Stop|.
+  void SampleBattery();
+
+  bool StoppedSampling() const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    return !sampling_;
+  }
+
+  const Source source_;
+  // The energy_value file of every rail monitor, or the current_now and
+  // voltage_now files of the battery.
+  const std::vector<std::string> paths_;
+  const std::string status_path_;
+  const absl::Duration battery_sample_period_;
+
+  bool started_ = false;
+  bool charging_ = false;
+  absl::Time start_time_;
+  double start_joules_ = 0.0;
+
+  absl::Mutex mutex_;
+  bool sampling_ ABSL_GUARDED_BY(mutex_) = false;
+  double battery_joules_ ABSL_GUARDED_BY(mutex_) = 0.0;
+  std::unique_ptr<std::thread> sampling_thread_;
+};
+
+// Returns "power_rails" or "battery".
+const char* EnergySourceName(EnergyMeter::Source source);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_ENERGY_METER_H_
@@ -0,0 +1,131 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "energy_meter.h"
+
+#include <fstream>
+#include <string>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+class EnergyMeterTest : public testing::Test {
+ protected:
+  EnergyMeterTest()
+      : sysfs_root_(ghc::filesystem::temp_directory_path() /
+                    "energy_meter_test") {
+    ghc::filesystem::remove_all(sysfs_root_);
+  }
+
+  ~EnergyMeterTest() override { ghc::filesystem::remove_all(sysfs_root_); }
+
+  void WriteFile(const ghc::filesystem::path& relative_path,
+                 const std::string& contents) {
+    const ghc::filesystem::path path = sysfs_root_ / relative_path;
+    ghc::filesystem::create_directories(path.parent_path());
+    std::ofstream(path.string()) << contents;
+  }
+
+  void WriteRails(int first_energy, int second_energy) {
+    WriteFile("bus/iio/devices/iio:device0/energy_value",
+              "t=1000\nCH0(T=1000)[S2M_VDD_CPUCL2], " +
+                  std::to_string(first_energy) +
+                  "\nCH1(T=1000)[S3M_VDD_GPU], " +
+                  std::to_string(second_energy) + "\n");
+  }
+
+  void WriteBattery(int current_microamperes, int voltage_microvolts,
+                    const std::string& status) {
+    WriteFile("class/power_supply/battery/current_now",
+              std::to_string(current_microamperes) + "\n");
+    WriteFile("class/power_supply/battery/voltage_now",
+              std::to_string(voltage_microvolts) + "\n");
+    WriteFile("class/power_supply/battery/status", status + "\n");
+  }
+
+  const ghc::filesystem::path sysfs_root_;
+};
+
+TEST_F(EnergyMeterTest, NoSourceReturnsNullptr) {
+  ghc::filesystem::create_directories(sysfs_root_);
+
+  EXPECT_EQ(EnergyMeter::Create(sysfs_root_.string()), nullptr);
+}
+
+TEST_F(EnergyMeterTest, PowerRailsAreSummedAcrossRails) {
+  WriteRails(1000000, 2000000);
+  WriteBattery(-500000, 4000000, "Discharging");
+  auto meter = EnergyMeter::Create(sysfs_root_.string());
+  ASSERT_NE(meter, nullptr);
+  EXPECT_EQ(meter->source(), EnergyMeter::Source::kPowerRails);
+
+  meter->Start();
+  // 1.5 J more on the first rail and 0.5 J more on the second.
+  WriteRails(2500000, 2500000);
+  const EnergyReading reading = meter->Stop();
+
+  EXPECT_DOUBLE_EQ(reading.joules, 2.0);
+  EXPECT_GT(reading.seconds, 0.0);
+  EXPECT_FALSE(meter->charging());
+}
+
+TEST_F(EnergyMeterTest, BatteryPowerIsIntegratedOverTime) {
+  // 0.5 A at 4 V is 2 W, whichever sign the driver gives the current.
+  WriteBattery(-500000, 4000000, "Discharging");
+  auto meter =
+      EnergyMeter::Create(sysfs_root_.string(), absl::Milliseconds(5));
+  ASSERT_NE(meter, nullptr);
+  EXPECT_EQ(meter->source(), EnergyMeter::Source::kBattery);
+
+  meter->Start();
+  absl::SleepFor(absl::Milliseconds(200));
+  const EnergyReading reading = meter->Stop();
+
+  EXPECT_GE(reading.seconds, 0.2);
+  EXPECT_NEAR(reading.watts(), 2.0, 0.2);
+}
+
+TEST_F(EnergyMeterTest, ChargingIsReported) {
+  WriteBattery(1000000, 4200000, "Charging");
+  auto meter = EnergyMeter::Create(sysfs_root_.string());
+  ASSERT_NE(meter, nullptr);
+
+  meter->Start();
+  meter->Stop();
+
+  EXPECT_TRUE(meter->charging());
+}
+
+TEST_F(EnergyMeterTest, StopWithoutStartReadsNothing) {
+  WriteBattery(-500000, 4000000, "Discharging");
+  auto meter = EnergyMeter::Create(sysfs_root_.string());
+  ASSERT_NE(meter, nullptr);
+
+  const EnergyReading reading = meter->Stop();
+
+  EXPECT_EQ(reading.joules, 0.0);
+  EXPECT_EQ(reading.seconds, 0.0);
+  EXPECT_EQ(reading.watts(), 0.0);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
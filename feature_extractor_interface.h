@@ -22,6 +22,8 @@
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
+#include "dsp_util.h"
+#include "feature_frame.h"
 
 namespace chromemedia {
 namespace codec {
@@ -34,8 +36,63 @@ class FeatureExtractorInterface {
   virtual ~FeatureExtractorInterface() {}
 
   // Extracts features from the audio. On failure returns a nullopt.
-  virtual absl::optional<std::vector<float>> Extract(
+  virtual absl::optional<FeatureFrame> Extract(
       const absl::Span<const int16_t> audio) = 0;
+
+  // Like |Extract|, but from samples on the int16 scale that were not
+  // rounded to int16 yet, such as the output of a filter. Extractors that
+  // work on floats internally should override this; the default clips and
+  // truncates the samples to int16 and goes through |Extract|.
+  virtual absl::optional<FeatureFrame> ExtractFromFloats(
+      const absl::Span<const float> audio) {
+    std::vector<int16_t> samples(audio.size());
+    ClipToInt16(audio, absl::MakeSpan(samples));
+    return Extract(samples);
+  }
+
+  // Extracts the features of the |num_frames| consecutive hops of |audio|,
+  // which splits into hops of equal length, and returns them concatenated in
+  // order. Extractors that can transform several hops at once should override
+  // this; the default goes through |Extract| once per hop.
+  virtual absl::optional<std::vector<float>> ExtractPacket(
+      const absl::Span<const int16_t> audio, int num_frames) {
+    return ExtractPerHop(
+        audio, num_frames,
+        [this](absl::Span<const int16_t> hop) { return Extract(hop); });
+  }
+
+  // Like |ExtractPacket|, from samples that were not rounded to int16 yet.
+  virtual absl::optional<std::vector<float>> ExtractPacketFromFloats(
+      const absl::Span<const float> audio, int num_frames) {
+    return ExtractPerHop(
+        audio, num_frames,
+        [this](absl::Span<const float> hop) { return ExtractFromFloats(hop); });
+  }
+
+  // Forgets the audio of previous calls, so that the next hop is extracted
+  // as the first one of a stream.
+  virtual void Reset() = 0;
+
+ private:
+  template <typename SampleType, typename ExtractFunction>
+  static absl::optional<std::vector<float>> ExtractPerHop(
+      const absl::Span<const SampleType> audio, int num_frames,
+      const ExtractFunction& extract) {
+    if (num_frames <= 0 || audio.size() % num_frames != 0) {
+      return absl::nullopt;
+    }
+    const int hop_length = audio.size() / num_frames;
+    std::vector<float> features;
+    for (int f = 0; f < num_frames; ++f) {
+      auto hop_features = extract(audio.subspan(f * hop_length, hop_length));
+      if (!hop_features.has_value()) {
+        return absl::nullopt;
+      }
+      features.insert(features.end(), hop_features->begin(),
+                      hop_features->end());
+    }
+    return features;
+  }
 };
 
 }  // namespace codec
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_FEATURE_FRAME_H_
+#define LYRA_CODEC_FEATURE_FRAME_H_
+
+#include <algorithm>
+#include <initializer_list>
+
+#include "absl/types/span.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+
+// The features of one frame, held inline in cache-aligned storage of a fixed
+// capacity instead of on the heap, so that frames are passed between the
+// extractor, the packet loss handler, the predictors and the model without
+// allocating. Converts implicitly to an |absl::Span<const float>| like a
+// vector does.
+class alignas(64) FeatureFrame {
+ public:
+  // The most features a frame can have, which leaves room above the features
+  // of any configuration in lyra_config.h.
+  static constexpr int kCapacity = 256;
+
+  using value_type = float;
+  using iterator = float*;
+  using const_iterator = const float*;
+
+  // An empty frame. The storage is left uninitialized, since only the
+  // features in use are ever read.
+  FeatureFrame() {}
+
+  // A frame of |size| features of |value|. Crash ok, |size| has to fit.
+  explicit FeatureFrame(int size, float value = 0.f) {
+    resize(size);
+    std::fill(begin(), end(), value);
+  }
+
+  // A copy of |features|, which have to fit.
+  FeatureFrame(absl::Span<const float> features) {  // NOLINT
+    assign(features);
+  }
+  FeatureFrame(std::initializer_list<float> features)
+      : FeatureFrame(absl::MakeConstSpan(features.begin(), features.size())) {}
+
+  // Copies only the features in use.
+  FeatureFrame(const FeatureFrame& other) { assign(other); }
+  FeatureFrame& operator=(const FeatureFrame& other) {
+    assign(other);
+    return *this;
+  }
+
+  void assign(absl::Span<const float> features) {
+    resize(features.size());
+    std::copy(features.begin(), features.end(), begin());
+  }
+
+  // Values of features added by growing the frame are unspecified.
+  void resize(int size) {
+    CHECK_GE(size, 0);
+    CHECK_LE(size, kCapacity) << "A feature frame holds at most " << kCapacity
+                              << " features.";
+    size_ = size;
+  }
+
+  float* data() { return data_; }
+  const float* data() const { return data_; }
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  float* begin() { return data_; }
+  float* end() { return data_ + size_; }
+  const float* begin() const { return data_; }
+  const float* end() const { return data_ + size_; }
+
+  float& operator[](int i) { return data_[i]; }
+  float operator[](int i) const { return data_[i]; }
+
+  friend bool operator==(const FeatureFrame& a, const FeatureFrame& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end());
+  }
+  friend bool operator!=(const FeatureFrame& a, const FeatureFrame& b) {
+    return !(a == b);
+  }
+
+ private:
+  float data_[kCapacity];
+  int size_ = 0;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_FEATURE_FRAME_H_
@@ -0,0 +1,82 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "feature_frame.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::Each;
+using testing::ElementsAre;
+using testing::ElementsAreArray;
+
+TEST(FeatureFrameTest, StartsEmpty) {
+  const FeatureFrame frame;
+  EXPECT_TRUE(frame.empty());
+  EXPECT_EQ(frame.size(), 0);
+}
+
+TEST(FeatureFrameTest, HoldsItsFeaturesOnCacheLines) {
+  const FeatureFrame frame(FeatureFrame::kCapacity, 1.0f);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(frame.data()) % 64, 0);
+  EXPECT_EQ(frame.size(), FeatureFrame::kCapacity);
+  EXPECT_THAT(frame, Each(1.0f));
+  // Frames in an optional or a container stay aligned too.
+  const absl::optional<FeatureFrame> optional_frame(frame);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(optional_frame->data()) % 64, 0);
+  const std::vector<FeatureFrame> frames(3, frame);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(frames[1].data()) % 64, 0);
+}
+
+TEST(FeatureFrameTest, CopiesSpansAndPassesAsOne) {
+  const std::vector<float> features = {1.0f, 2.0f, 3.0f};
+  const FeatureFrame frame(features);
+  EXPECT_THAT(frame, ElementsAreArray(features));
+  const absl::Span<const float> view = frame;
+  EXPECT_EQ(view.data(), frame.data());
+  EXPECT_EQ(view, absl::MakeConstSpan(features));
+}
+
+TEST(FeatureFrameTest, CopiesAndComparesOnlyTheFeaturesInUse) {
+  FeatureFrame frame = {1.0f, 2.0f};
+  FeatureFrame copy(4, 7.0f);
+  copy = frame;
+  EXPECT_THAT(copy, ElementsAre(1.0f, 2.0f));
+  EXPECT_EQ(copy, frame);
+  copy[1] = 5.0f;
+  EXPECT_NE(copy, frame);
+  copy.resize(1);
+  EXPECT_NE(copy, frame);
+  frame.assign({1.0f});
+  EXPECT_EQ(copy, frame);
+}
+
+TEST(FeatureFrameDeathTest, TooManyFeaturesCrash) {
+  FeatureFrame frame;
+  EXPECT_DEATH(frame.resize(FeatureFrame::kCapacity + 1), "");
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
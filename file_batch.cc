@@ -0,0 +1,132 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "file_batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <mutex>  // NOLINT(build/c++11)
+#include <optional>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <thread>        // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+
+std::optional<std::vector<ghc::filesystem::path>> ListBatchFiles(
+    const ghc::filesystem::path& input_path, absl::string_view extension) {
+  std::vector<ghc::filesystem::path> files;
+  std::error_code error_code;
+  if (ghc::filesystem::is_directory(input_path, error_code)) {
+    for (ghc::filesystem::directory_iterator it(input_path, error_code), end;
+         !error_code && it != end; it.increment(error_code)) {
+      if (it->is_regular_file(error_code) &&
+          absl::EndsWith(it->path().string(), extension)) {
+        files.push_back(it->path());
+      }
+    }
+    if (error_code) {
+      LOG(ERROR) << "Could not list " << input_path << ": "
+                 << error_code.message();
+      return std::nullopt;
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+  }
+
+  std::ifstream list_stream(input_path.string());
+  if (!list_stream.is_open()) {
+    LOG(ERROR) << "Could not open file list " << input_path;
+    return std::nullopt;
+  }
+  const ghc::filesystem::path list_dir = input_path.parent_path();
+  std::string line;
+  while (std::getline(list_stream, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty()) {
+      continue;
+    }
+    const ghc::filesystem::path file(line);
+    files.push_back(file.is_absolute() ? file : list_dir / file);
+  }
+  return files;
+}
+
+FileBatchResult ProcessFileBatch(
+    int num_files, int num_workers,
+    const std::function<std::optional<double>(int)>& process_file) {
+  if (num_workers <= 0) {
+    num_workers =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  num_workers = std::max(1, std::min(num_workers, num_files));
+
+  FileBatchResult result;
+  result.num_files = num_files;
+  std::mutex result_mutex;
+  std::atomic<int> next_file(0);
+  const auto process_files = [&]() {
+    for (int i = next_file++; i < num_files; i = next_file++) {
+      const std::optional<double> audio_seconds = process_file(i);
+      std::lock_guard<std::mutex> lock(result_mutex);
+      if (audio_seconds.has_value()) {
+        result.audio_seconds += audio_seconds.value();
+      } else {
+        ++result.num_failed;
+      }
+    }
+  };
+
+  const absl::Time start = absl::Now();
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers - 1);
+  for (int i = 1; i < num_workers; ++i) {
+    threads.emplace_back(process_files);
+  }
+  process_files();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  result.elapsed = absl::Now() - start;
+  return result;
+}
+
+void LogFileBatchResult(const FileBatchResult& result) {
+  const double elapsed_seconds = absl::ToDoubleSeconds(result.elapsed);
+  LOG(INFO) << "Processed " << result.num_files - result.num_failed << " of "
+            << result.num_files << " files.";
+  LOG(INFO) << "Elapsed seconds : " << elapsed_seconds;
+  if (elapsed_seconds > 0.0) {
+    LOG(INFO) << "Files per second : "
+              << (result.num_files - result.num_failed) / elapsed_seconds;
+    LOG(INFO) << "Audio seconds per second : "
+              << result.audio_seconds / elapsed_seconds;
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
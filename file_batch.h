@@ -0,0 +1,62 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_FILE_BATCH_H_
+#define LYRA_CODEC_FILE_BATCH_H_
+
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+
+// Returns the files to process in one batch. If |input_path| is a directory
+// these are its regular files ending in |extension|, sorted by name. Otherwise
+// |input_path| is a text file listing one path per line, where empty lines
+// are skipped and relative paths are relative to the directory of the list.
+// Returns a nullopt if |input_path| cannot be read.
+std::optional<std::vector<ghc::filesystem::path>> ListBatchFiles(
+    const ghc::filesystem::path& input_path, absl::string_view extension);
+
+struct FileBatchResult {
+  int num_files = 0;
+  int num_failed = 0;
+  // Duration of the audio of all files processed successfully.
+  double audio_seconds = 0.0;
+  absl::Duration elapsed;
+};
+
+// Calls |process_file| on every index in [0, |num_files|) from |num_workers|
+// threads, or one per core if not positive, one of which is the calling
+// thread. Each call returns the seconds of audio it processed, or a nullopt
+// if it failed. Only |num_workers| files are in flight at any time, so a
+// |process_file| that streams its file keeps the memory used bounded.
+FileBatchResult ProcessFileBatch(
+    int num_files, int num_workers,
+    const std::function<std::optional<double>(int)>& process_file);
+
+// Logs the aggregate throughput of |result|.
+void LogFileBatchResult(const FileBatchResult& result);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_FILE_BATCH_H_
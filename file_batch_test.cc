@@ -0,0 +1,133 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "file_batch.h"
+
+#include <atomic>
+#include <fstream>
+#include <optional>
+#include <system_error>  // NOLINT(build/c++11)
+#include <thread>        // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+class FileBatchTest : public testing::Test {
+ protected:
+  FileBatchTest()
+      : test_dir_(ghc::filesystem::path(testing::TempDir()) / "file_batch") {}
+
+  void SetUp() override {
+    std::error_code error_code;
+    ghc::filesystem::remove_all(test_dir_, error_code);
+    ASSERT_TRUE(ghc::filesystem::create_directories(test_dir_, error_code));
+  }
+
+  void TearDown() override {
+    std::error_code error_code;
+    ghc::filesystem::remove_all(test_dir_, error_code);
+  }
+
+  void Touch(const ghc::filesystem::path& path) {
+    std::ofstream stream(path.string());
+    ASSERT_TRUE(stream.good());
+  }
+
+  const ghc::filesystem::path test_dir_;
+};
+
+TEST_F(FileBatchTest, ListsDirectoryByExtensionInOrder) {
+  Touch(test_dir_ / "b.wav");
+  Touch(test_dir_ / "a.wav");
+  Touch(test_dir_ / "c.lyra");
+  std::error_code error_code;
+  ghc::filesystem::create_directories(test_dir_ / "d.wav", error_code);
+
+  const auto files = ListBatchFiles(test_dir_, ".wav");
+  ASSERT_TRUE(files.has_value());
+  ASSERT_EQ(files->size(), 2);
+  EXPECT_EQ((*files)[0], test_dir_ / "a.wav");
+  EXPECT_EQ((*files)[1], test_dir_ / "b.wav");
+}
+
+TEST_F(FileBatchTest, ListsFileListRelativeToItsDirectory) {
+  const ghc::filesystem::path list_path = test_dir_ / "files.txt";
+  {
+    std::ofstream list_stream(list_path.string());
+    list_stream << "first.lyra\n\n/absolute/second.lyra\r\n";
+  }
+  const auto files = ListBatchFiles(list_path, ".lyra");
+  ASSERT_TRUE(files.has_value());
+  ASSERT_EQ(files->size(), 2);
+  EXPECT_EQ((*files)[0], test_dir_ / "first.lyra");
+  EXPECT_EQ((*files)[1], ghc::filesystem::path("/absolute/second.lyra"));
+}
+
+TEST_F(FileBatchTest, MissingInputFails) {
+  EXPECT_FALSE(ListBatchFiles(test_dir_ / "missing.txt", ".wav").has_value());
+}
+
+TEST(ProcessFileBatchTest, ProcessesEveryFileOnceAndSumsAudio) {
+  constexpr int kNumFiles = 20;
+  std::vector<std::atomic<int>> num_calls(kNumFiles);
+  const FileBatchResult result =
+      ProcessFileBatch(kNumFiles, /*num_workers=*/4,
+                       [&num_calls](int i) -> std::optional<double> {
+                         ++num_calls[i];
+                         if (i == 3) {
+                           return std::nullopt;
+                         }
+                         return 0.5;
+                       });
+  for (const auto& calls : num_calls) {
+    EXPECT_EQ(calls, 1);
+  }
+  EXPECT_EQ(result.num_files, kNumFiles);
+  EXPECT_EQ(result.num_failed, 1);
+  EXPECT_DOUBLE_EQ(result.audio_seconds, 0.5 * (kNumFiles - 1));
+}
+
+TEST(ProcessFileBatchTest, BoundsFilesInFlight) {
+  std::atomic<int> num_in_flight(0);
+  std::atomic<int> max_in_flight(0);
+  ProcessFileBatch(/*num_files=*/16, /*num_workers=*/3,
+                   [&](int) -> std::optional<double> {
+                     const int in_flight = ++num_in_flight;
+                     int max = max_in_flight;
+                     while (in_flight > max &&
+                            !max_in_flight.compare_exchange_weak(max,
+                                                                 in_flight)) {
+                     }
+                     std::this_thread::yield();
+                     --num_in_flight;
+                     return 1.0;
+                   });
+  EXPECT_LE(max_in_flight, 3);
+}
+
+TEST(ProcessFileBatchTest, EmptyBatch) {
+  const FileBatchResult result = ProcessFileBatch(
+      0, 0, [](int) -> std::optional<double> { return 1.0; });
+  EXPECT_EQ(result.num_files, 0);
+  EXPECT_EQ(result.num_failed, 0);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
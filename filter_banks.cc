@@ -14,6 +14,7 @@
 
 #include "filter_banks.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <utility>
@@ -21,9 +22,12 @@
 
 #include "absl/memory/memory.h"
 #include "absl/types/span.h"
+#include "dsp_util.h"
 #include "filter_banks_interface.h"
 #include "glog/logging.h"
+#include "polyphase_resampler.h"
 #include "quadrature_mirror_filter.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -39,6 +43,118 @@ int IntLogTwo(int x) {
   return log_two;
 }
 
+// Returns the levels of 2-band merge filters that merge |num_bands| bands.
+template <typename T>
+std::vector<std::vector<MergeQuadratureMirrorFilter<T>>> MergeFilterTree(
+    int num_bands) {
+  const int num_levels = IntLogTwo(num_bands);
+  std::vector<std::vector<MergeQuadratureMirrorFilter<T>>> filters_per_level;
+  filters_per_level.reserve(num_levels);
+  for (int level = 0; level < num_levels; ++level) {
+    // Number of filters per level goes down as power of 2, ending at 1.
+    filters_per_level.push_back(
+        std::vector<MergeQuadratureMirrorFilter<T>>(num_bands >> (level + 1)));
+  }
+  return filters_per_level;
+}
+
+// Appends the state of every filter of |filters_per_level| to |writer|.
+template <typename T>
+void SaveFilterStates(
+    const std::vector<std::vector<MergeQuadratureMirrorFilter<T>>>&
+        filters_per_level,
+    StateWriter* writer) {
+  for (const auto& filters : filters_per_level) {
+    for (const auto& filter : filters) {
+      filter.SaveState(writer);
+    }
+  }
+}
+
+template <typename T>
+bool RestoreFilterStates(
+    StateReader* reader,
+    std::vector<std::vector<MergeQuadratureMirrorFilter<T>>>*
+        filters_per_level) {
+  for (auto& filters : *filters_per_level) {
+    for (auto& filter : filters) {
+      if (!filter.RestoreState(reader)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Returns a view into each of |bands|.
+template <typename T>
+std::vector<absl::Span<const T>> BandSpans(
+    const std::vector<std::vector<T>>& bands) {
+  return std::vector<absl::Span<const T>>(bands.begin(), bands.end());
+}
+
+// Checks that there are |num_bands| bands of the same size and returns it.
+template <typename T>
+int CheckBandSizes(absl::Span<const absl::Span<T>> bands, int num_bands) {
+  CHECK_EQ(bands.size(), num_bands)
+      << "The number of bands has to be " << num_bands << ", but was "
+      << bands.size() << ".";
+  const int band_size = bands.at(0).size();
+  for (int band = 0; band < bands.size(); ++band) {
+    CHECK_EQ(bands.at(band).size(), band_size)
+        << "The number of samples of all bands has to be the same, but was "
+        << band_size << " for the first band and " << bands.at(band).size()
+        << " for the band number " << band + 1 << ".";
+  }
+  return band_size;
+}
+
+// Because of the mirroring characteristic of aliasing, odd bands are
+// reversed: the low band of filter |filter| in a level is band
+// LowBandIndex(filter) of the level with twice as many bands.
+int LowBandIndex(int filter) { return 2 * filter + filter % 2; }
+int HighBandIndex(int filter) { return 2 * filter + 1 - filter % 2; }
+
+// Merges |bands| level by level through |filters_per_level| into |merged|.
+// The intermediate levels alternate between the two halves of
+// |level_buffer|, each of which holds all the samples of one level.
+template <typename T>
+void MergeBands(absl::Span<const absl::Span<const T>> bands,
+                std::vector<std::vector<MergeQuadratureMirrorFilter<T>>>*
+                    filters_per_level,
+                std::vector<T>* level_buffer, absl::Span<T> merged) {
+  const int num_levels = filters_per_level->size();
+  if (num_levels == 0) {
+    std::copy(bands.at(0).begin(), bands.at(0).end(), merged.begin());
+    return;
+  }
+  const int num_samples = merged.size();
+  level_buffer->resize(2 * num_samples);
+  const T* input = nullptr;
+  for (int level = 0; level < num_levels; ++level) {
+    const int num_input_samples_per_band = bands.at(0).size() << level;
+    const int num_output_samples_per_band = 2 * num_input_samples_per_band;
+    T* output = level + 1 == num_levels
+                    ? merged.data()
+                    : level_buffer->data() + (level % 2) * num_samples;
+    auto input_band = [&](int band) {
+      return level == 0 ? bands[band]
+                        : absl::Span<const T>(
+                              input + band * num_input_samples_per_band,
+                              num_input_samples_per_band);
+    };
+    std::vector<MergeQuadratureMirrorFilter<T>>& filters =
+        (*filters_per_level)[level];
+    for (int filter = 0; filter < filters.size(); ++filter) {
+      filters[filter].Merge(
+          input_band(LowBandIndex(filter)), input_band(HighBandIndex(filter)),
+          absl::Span<T>(output + filter * num_output_samples_per_band,
+                        num_output_samples_per_band));
+    }
+    input = output;
+  }
+}
+
 }  // namespace
 
 std::unique_ptr<SplitFilter> SplitFilter::Create(int num_bands) {
@@ -65,26 +181,50 @@ std::vector<std::vector<int16_t>> SplitFilter::Split(
   CHECK_EQ(signal.size() % num_bands_, 0)
       << "The number of samples has to be divisible by " << num_bands_
       << ", but was " << signal.size() << ".";
-  std::vector<std::vector<int16_t>> old_bands;
-  old_bands.push_back(std::vector<int16_t>(signal.begin(), signal.end()));
-  for (std::vector<SplitQuadratureMirrorFilter<int16_t>>& filters :
-       filters_per_level_) {
-    std::vector<std::vector<int16_t>> new_bands;
+  std::vector<std::vector<int16_t>> bands(
+      num_bands_, std::vector<int16_t>(signal.size() / num_bands_));
+  std::vector<absl::Span<int16_t>> band_spans(bands.begin(), bands.end());
+  SplitInto(signal, band_spans);
+  return bands;
+}
+
+void SplitFilter::SplitInto(absl::Span<const int16_t> signal,
+                            absl::Span<const absl::Span<int16_t>> bands) {
+  CHECK_EQ(signal.size() % num_bands_, 0)
+      << "The number of samples has to be divisible by " << num_bands_
+      << ", but was " << signal.size() << ".";
+  const int num_samples_per_band = CheckBandSizes(bands, num_bands_);
+  CHECK_EQ(num_samples_per_band * num_bands_, signal.size());
+  const int num_levels = filters_per_level_.size();
+  if (num_levels == 0) {
+    std::copy(signal.begin(), signal.end(), bands[0].begin());
+    return;
+  }
+  const int num_samples = signal.size();
+  level_buffer_.resize(2 * num_samples);
+  const int16_t* input = signal.data();
+  for (int level = 0; level < num_levels; ++level) {
+    const int num_output_samples_per_band = num_samples >> (level + 1);
+    const int num_input_samples_per_band = 2 * num_output_samples_per_band;
+    int16_t* output = level_buffer_.data() + (level % 2) * num_samples;
+    auto output_band = [&](int band) {
+      return level + 1 == num_levels
+                 ? bands[band]
+                 : absl::Span<int16_t>(
+                       output + band * num_output_samples_per_band,
+                       num_output_samples_per_band);
+    };
+    std::vector<SplitQuadratureMirrorFilter<int16_t>>& filters =
+        filters_per_level_[level];
     for (int filter = 0; filter < filters.size(); ++filter) {
-      Bands<int16_t> bands = filters.at(filter).Split(old_bands.at(filter));
-      // Because of the mirroring characteristic of aliasing, odd bands are
-      // reversed.
-      if (filter % 2 == 0) {
-        new_bands.push_back(std::move(bands.low_band));
-        new_bands.push_back(std::move(bands.high_band));
-      } else {
-        new_bands.push_back(std::move(bands.high_band));
-        new_bands.push_back(std::move(bands.low_band));
-      }
+      filters[filter].Split(
+          absl::Span<const int16_t>(input + filter * num_input_samples_per_band,
+                                    num_input_samples_per_band),
+          output_band(LowBandIndex(filter)),
+          output_band(HighBandIndex(filter)));
     }
-    old_bands = new_bands;
+    input = output;
   }
-  return old_bands;
 }
 
 std::unique_ptr<MergeFilter> MergeFilter::Create(int num_bands) {
@@ -96,43 +236,127 @@ std::unique_ptr<MergeFilter> MergeFilter::Create(int num_bands) {
   return absl::WrapUnique(new MergeFilter(num_bands));
 }
 
-MergeFilter::MergeFilter(int num_bands) : MergeFilterInterface(num_bands) {
-  const int num_levels = IntLogTwo(num_bands);
-  filters_per_level_.reserve(num_levels);
-  for (int level = 0; level < num_levels; ++level) {
-    // Number of filters per level goes down as power of 2, ending at 1.
-    filters_per_level_.push_back(
-        std::vector<MergeQuadratureMirrorFilter<int16_t>>(num_bands >>
-                                                          (level + 1)));
+MergeFilter::MergeFilter(int num_bands)
+    : MergeFilterInterface(num_bands),
+      filters_per_level_(MergeFilterTree<int16_t>(num_bands)) {}
+
+std::vector<int16_t> MergeFilter::Merge(
+    const std::vector<std::vector<int16_t>>& bands) {
+  const std::vector<absl::Span<const int16_t>> band_spans = BandSpans(bands);
+  const int num_samples_per_band =
+      CheckBandSizes(absl::MakeConstSpan(band_spans), num_bands_);
+  std::vector<int16_t> merged_signal(num_samples_per_band * num_bands_);
+  MergeInto(band_spans, absl::MakeSpan(merged_signal));
+  return merged_signal;
+}
+
+void MergeFilter::MergeInto(absl::Span<const absl::Span<const int16_t>> bands,
+                            absl::Span<int16_t> merged) {
+  const int num_samples_per_band = CheckBandSizes(bands, num_bands_);
+  CHECK_EQ(merged.size(), num_samples_per_band * num_bands_);
+  MergeBands(bands, &filters_per_level_, &level_buffer_, merged);
+}
+
+void MergeFilter::Reset() {
+  for (auto& filters : filters_per_level_) {
+    std::fill(filters.begin(), filters.end(),
+              MergeQuadratureMirrorFilter<int16_t>());
   }
 }
 
-std::vector<int16_t> MergeFilter::Merge(
+bool MergeFilter::SaveState(StateWriter* writer) const {
+  SaveFilterStates(filters_per_level_, writer);
+  return true;
+}
+
+bool MergeFilter::RestoreState(StateReader* reader) {
+  return RestoreFilterStates(reader, &filters_per_level_);
+}
+
+std::unique_ptr<UpsamplingMergeFilter> UpsamplingMergeFilter::Create(
+    int num_bands, int upsampling_factor) {
+  if (!IsPowerOfTwo(num_bands)) {
+    LOG(ERROR) << "Number of bands has to be a power of 2, but was "
+               << num_bands << ".";
+    return nullptr;
+  }
+  if (upsampling_factor < 2) {
+    LOG(ERROR) << "Upsampling factor has to be at least 2, but was "
+               << upsampling_factor << ".";
+    return nullptr;
+  }
+  // Only the ratio of the rates matters to the resampler.
+  auto upsampler = PolyphaseResampler::Create(1, upsampling_factor);
+  if (upsampler == nullptr) {
+    LOG(ERROR) << "Could not create the upsampler.";
+    return nullptr;
+  }
+  return absl::WrapUnique(new UpsamplingMergeFilter(
+      num_bands, upsampling_factor, std::move(upsampler)));
+}
+
+UpsamplingMergeFilter::UpsamplingMergeFilter(
+    int num_bands, int upsampling_factor,
+    std::unique_ptr<PolyphaseResampler> upsampler)
+    : MergeFilterInterface(num_bands),
+      upsampling_factor_(upsampling_factor),
+      filters_per_level_(MergeFilterTree<float>(num_bands)),
+      upsampler_(std::move(upsampler)) {
+  float_band_spans_.reserve(num_bands);
+}
+
+std::vector<int16_t> UpsamplingMergeFilter::Merge(
     const std::vector<std::vector<int16_t>>& bands) {
-  CHECK_EQ(bands.size(), num_bands_)
-      << "The number of bands has to be " << num_bands_ << ", but was "
-      << bands.size() << ".";
-  const int band_size = bands.at(0).size();
-  for (int band = 0; band < bands.size(); ++band) {
-    CHECK_EQ(bands.at(band).size(), band_size)
-        << "The number of samples of all bands has to be the same, but was "
-        << band_size << " for the first band and " << bands.at(band).size()
-        << " for the band number " << band + 1 << ".";
+  const std::vector<absl::Span<const int16_t>> band_spans = BandSpans(bands);
+  const int num_samples_per_band =
+      CheckBandSizes(absl::MakeConstSpan(band_spans), num_bands_);
+  std::vector<int16_t> merged_signal(num_samples_per_band *
+                                     num_samples_per_band_sample());
+  MergeInto(band_spans, absl::MakeSpan(merged_signal));
+  return merged_signal;
+}
+
+void UpsamplingMergeFilter::MergeInto(
+    absl::Span<const absl::Span<const int16_t>> bands,
+    absl::Span<int16_t> merged) {
+  const int num_samples_per_band = CheckBandSizes(bands, num_bands_);
+  CHECK_EQ(merged.size(),
+           num_samples_per_band * num_samples_per_band_sample());
+  const int num_merged_samples = num_samples_per_band * num_bands_;
+  float_bands_.resize(num_merged_samples);
+  float_band_spans_.clear();
+  for (int band = 0; band < num_bands_; ++band) {
+    float* float_band = float_bands_.data() + band * num_samples_per_band;
+    Int16ToFloat(bands[band], absl::MakeSpan(float_band, num_samples_per_band));
+    float_band_spans_.emplace_back(float_band, num_samples_per_band);
   }
-  std::vector<std::vector<int16_t>> old_bands(bands);
-  for (std::vector<MergeQuadratureMirrorFilter<int16_t>>& filters :
-       filters_per_level_) {
-    std::vector<std::vector<int16_t>> new_bands;
-    for (int filter = 0; filter < filters.size(); ++filter) {
-      // Because of the mirroring characteristic of aliasing, odd bands are
-      // reversed.
-      const Bands<int16_t> bands(old_bands.at(2 * filter + filter % 2),
-                                 old_bands.at(2 * filter + 1 - filter % 2));
-      new_bands.push_back(filters.at(filter).Merge(bands));
-    }
-    old_bands = new_bands;
+  merged_.resize(num_merged_samples);
+  MergeBands(absl::MakeConstSpan(float_band_spans_), &filters_per_level_,
+             &level_buffer_, absl::MakeSpan(merged_));
+  upsampled_.resize(merged.size());
+  const int num_upsampled_samples = upsampler_->Process(
+      absl::MakeConstSpan(merged_), absl::MakeSpan(upsampled_));
+  CHECK_EQ(num_upsampled_samples, merged.size());
+  ClipToInt16(upsampled_, merged);
+}
+
+void UpsamplingMergeFilter::Reset() {
+  for (auto& filters : filters_per_level_) {
+    std::fill(filters.begin(), filters.end(),
+              MergeQuadratureMirrorFilter<float>());
   }
-  return old_bands.at(0);
+  upsampler_->Reset();
+}
+
+bool UpsamplingMergeFilter::SaveState(StateWriter* writer) const {
+  SaveFilterStates(filters_per_level_, writer);
+  upsampler_->SaveState(writer);
+  return true;
+}
+
+bool UpsamplingMergeFilter::RestoreState(StateReader* reader) {
+  return RestoreFilterStates(reader, &filters_per_level_) &&
+         upsampler_->RestoreState(reader);
 }
 
 }  // namespace codec
@@ -23,7 +23,9 @@
 
 #include "absl/types/span.h"
 #include "filter_banks_interface.h"
+#include "polyphase_resampler.h"
 #include "quadrature_mirror_filter.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -38,6 +40,13 @@ class SplitFilter {
   // The size of the signal has to be divisible by num_bands.
   std::vector<std::vector<int16_t>> Split(absl::Span<const int16_t> signal);
 
+  // Same as above, but writes the bands into |bands|, which has to hold
+  // num_bands spans of signal.size() / num_bands samples each. The
+  // intermediate levels reuse an internal buffer, so this does not allocate
+  // once the buffer has grown to the signal size.
+  void SplitInto(absl::Span<const int16_t> signal,
+                 absl::Span<const absl::Span<int16_t>> bands);
+
   int num_bands() const { return num_bands_; }
 
  private:
@@ -46,6 +55,8 @@ class SplitFilter {
   const int num_bands_;
   std::vector<std::vector<SplitQuadratureMirrorFilter<int16_t>>>
       filters_per_level_;
+  // Two halves holding the bands of alternating intermediate levels.
+  std::vector<int16_t> level_buffer_;
 };
 
 // Filter bank to merge multiple bands sampled at sub-Nyquist into signal.
@@ -59,11 +70,71 @@ class MergeFilter : public MergeFilterInterface {
   std::vector<int16_t> Merge(
       const std::vector<std::vector<int16_t>>& bands) override;
 
+  // Merges level by level in an internal buffer that is reused between calls,
+  // writing the last level directly into |merged|.
+  void MergeInto(absl::Span<const absl::Span<const int16_t>> bands,
+                 absl::Span<int16_t> merged) override;
+
+  void Reset() override;
+
+  bool SaveState(StateWriter* writer) const override;
+
+  bool RestoreState(StateReader* reader) override;
+
  private:
   explicit MergeFilter(int num_bands);
 
   std::vector<std::vector<MergeQuadratureMirrorFilter<int16_t>>>
       filters_per_level_;
+  // Two halves holding the bands of alternating intermediate levels.
+  std::vector<int16_t> level_buffer_;
+};
+
+// Filter bank that merges the bands like MergeFilter and then upsamples the
+// merged signal by an integer factor, producing the output rate in a single
+// stage. Everything runs in float and is only clipped to int16 at the end, so
+// the merged signal is not quantized in between.
+class UpsamplingMergeFilter : public MergeFilterInterface {
+ public:
+  // Return nullptr if num_bands isn't a power of 2 or upsampling_factor is
+  // smaller than 2.
+  static std::unique_ptr<UpsamplingMergeFilter> Create(int num_bands,
+                                                       int upsampling_factor);
+
+  // Merge multiple bands sampled at sub-Nyquist into signal at
+  // upsampling_factor times the merged sample rate.
+  // The size of the bands have to coincide.
+  std::vector<int16_t> Merge(
+      const std::vector<std::vector<int16_t>>& bands) override;
+
+  void MergeInto(absl::Span<const absl::Span<const int16_t>> bands,
+                 absl::Span<int16_t> merged) override;
+
+  void Reset() override;
+
+  bool SaveState(StateWriter* writer) const override;
+
+  bool RestoreState(StateReader* reader) override;
+
+  int num_samples_per_band_sample() const override {
+    return num_bands_ * upsampling_factor_;
+  }
+
+ private:
+  UpsamplingMergeFilter(int num_bands, int upsampling_factor,
+                        std::unique_ptr<PolyphaseResampler> upsampler);
+
+  const int upsampling_factor_;
+  std::vector<std::vector<MergeQuadratureMirrorFilter<float>>>
+      filters_per_level_;
+  std::unique_ptr<PolyphaseResampler> upsampler_;
+  // Reused float copy of the bands, with a view into each band, the buffer of
+  // the intermediate levels and the merged and upsampled signals.
+  std::vector<float> float_bands_;
+  std::vector<absl::Span<const float>> float_band_spans_;
+  std::vector<float> level_buffer_;
+  std::vector<float> merged_;
+  std::vector<float> upsampled_;
 };
 
 }  // namespace codec
@@ -0,0 +1,103 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "filter_banks.h"
+
+// A packet of audio at 16 kHz.
+static constexpr int kNumSamples = 640;
+
+static std::vector<int16_t> RandomSamples(int num_samples) {
+  absl::BitGen gen;
+  std::vector<int16_t> samples(num_samples);
+  for (auto& sample : samples) {
+    sample = absl::Uniform<uint16_t>(gen);
+  }
+  return samples;
+}
+
+// Splits a packet into |state.range(0)| bands.
+void BM_Split(benchmark::State& state) {
+  const int num_bands = state.range(0);
+  auto split_filter = chromemedia::codec::SplitFilter::Create(num_bands);
+  const std::vector<int16_t> signal = RandomSamples(kNumSamples);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(split_filter->Split(signal));
+  }
+}
+
+// Same as above, but writes the bands into preallocated buffers.
+void BM_SplitInto(benchmark::State& state) {
+  const int num_bands = state.range(0);
+  auto split_filter = chromemedia::codec::SplitFilter::Create(num_bands);
+  const std::vector<int16_t> signal = RandomSamples(kNumSamples);
+  std::vector<int16_t> bands_buffer(kNumSamples);
+  std::vector<absl::Span<int16_t>> bands;
+  for (int band = 0; band < num_bands; ++band) {
+    bands.push_back(absl::MakeSpan(bands_buffer)
+                        .subspan(band * kNumSamples / num_bands,
+                                 kNumSamples / num_bands));
+  }
+
+  for (auto _ : state) {
+    split_filter->SplitInto(signal, bands);
+    benchmark::DoNotOptimize(bands_buffer.data());
+  }
+}
+
+// Merges |state.range(0)| bands into a packet.
+void BM_Merge(benchmark::State& state) {
+  const int num_bands = state.range(0);
+  auto merge_filter = chromemedia::codec::MergeFilter::Create(num_bands);
+  std::vector<std::vector<int16_t>> bands;
+  for (int band = 0; band < num_bands; ++band) {
+    bands.push_back(RandomSamples(kNumSamples / num_bands));
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(merge_filter->Merge(bands));
+  }
+}
+
+// Same as above, but writes the merged signal into a preallocated buffer.
+void BM_MergeInto(benchmark::State& state) {
+  const int num_bands = state.range(0);
+  auto merge_filter = chromemedia::codec::MergeFilter::Create(num_bands);
+  std::vector<std::vector<int16_t>> bands;
+  bands.reserve(num_bands);
+  std::vector<absl::Span<const int16_t>> band_spans;
+  for (int band = 0; band < num_bands; ++band) {
+    bands.push_back(RandomSamples(kNumSamples / num_bands));
+    band_spans.push_back(bands.back());
+  }
+  std::vector<int16_t> merged(kNumSamples);
+
+  for (auto _ : state) {
+    merge_filter->MergeInto(band_spans, absl::MakeSpan(merged));
+    benchmark::DoNotOptimize(merged.data());
+  }
+}
+
+BENCHMARK(BM_Split)->Arg(2)->Arg(4);
+BENCHMARK(BM_SplitInto)->Arg(2)->Arg(4);
+BENCHMARK(BM_Merge)->Arg(2)->Arg(4);
+BENCHMARK(BM_MergeInto)->Arg(2)->Arg(4);
+BENCHMARK_MAIN();
@@ -17,9 +17,14 @@
 #ifndef LYRA_CODEC_FILTER_BANKS_INTERFACE_H_
 #define LYRA_CODEC_FILTER_BANKS_INTERFACE_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "state_buffer.h"
+
 namespace chromemedia {
 namespace codec {
 
@@ -33,6 +38,39 @@ class MergeFilterInterface {
   virtual std::vector<int16_t> Merge(
       const std::vector<std::vector<int16_t>>& bands) = 0;
 
+  // Same as above, but merges |bands| into |merged|, which has to hold
+  // num_samples_per_band_sample() samples for each sample of a band.
+  // Implementations override this to merge in place without allocating; the
+  // default copies the bands and goes through |Merge|.
+  virtual void MergeInto(absl::Span<const absl::Span<const int16_t>> bands,
+                         absl::Span<int16_t> merged) {
+    std::vector<std::vector<int16_t>> band_vectors;
+    band_vectors.reserve(bands.size());
+    for (absl::Span<const int16_t> band : bands) {
+      band_vectors.emplace_back(band.begin(), band.end());
+    }
+    const std::vector<int16_t> merged_vector = Merge(band_vectors);
+    CHECK_EQ(merged_vector.size(), merged.size());
+    std::copy(merged_vector.begin(), merged_vector.end(), merged.begin());
+  }
+
+  // Forgets the samples merged so far, as if the filter was just created.
+  virtual void Reset() {}
+
+  // Appends the history of the filter, everything |Reset| forgets, to
+  // |writer|. Returns false if the filter does not support this, which the
+  // default does not.
+  virtual bool SaveState(StateWriter* writer) const { return false; }
+
+  // Restores what |SaveState| of a filter of the same kind wrote. Returns false
+  // if |reader| does not hold it, in which case the filter must be reset before
+  // it is used again.
+  virtual bool RestoreState(StateReader* reader) { return false; }
+
+  // Number of merged samples for each sample of a band. This is |num_bands|
+  // unless the filter also changes the sample rate of the merged signal.
+  virtual int num_samples_per_band_sample() const { return num_bands_; }
+
   int num_bands() const { return num_bands_; }
 
  protected:
@@ -22,7 +22,9 @@
 #include <random>
 #include <vector>
 
+#include "absl/types/span.h"
 #include "gtest/gtest.h"
+#include "polyphase_resampler.h"
 
 namespace chromemedia {
 namespace codec {
@@ -144,6 +146,74 @@ TEST(FilterBanksTest, Noise) {
   EXPECT_LT(kMinCorrelation, MaxCorrelation(merged_signal, merged_signal));
 }
 
+TEST(FilterBanksTest, ResetMergeFilterForgetsHistory) {
+  std::vector<int16_t> signal(kNumSignalSamples);
+  std::mt19937 generator;
+  std::uniform_int_distribution<> distribution(
+      std::numeric_limits<int16_t>().min(),
+      std::numeric_limits<int16_t>().max());
+  for (int i = 0; i < signal.size(); ++i) {
+    signal[i] = distribution(generator);
+  }
+  std::unique_ptr<SplitFilter> split_filter = SplitFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, split_filter);
+  const std::vector<std::vector<int16_t>> bands = split_filter->Split(signal);
+  std::unique_ptr<MergeFilter> merge_filter = MergeFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, merge_filter);
+
+  const std::vector<int16_t> first_merged_signal = merge_filter->Merge(bands);
+  EXPECT_NE(first_merged_signal, merge_filter->Merge(bands));
+  merge_filter->Reset();
+  EXPECT_EQ(first_merged_signal, merge_filter->Merge(bands));
+}
+
+TEST(FilterBanksTest, SpanApisMatchVectorApis) {
+  std::vector<int16_t> signal(kNumSignalSamples);
+  std::mt19937 generator;
+  std::uniform_int_distribution<> distribution(
+      std::numeric_limits<int16_t>().min(),
+      std::numeric_limits<int16_t>().max());
+  for (int i = 0; i < signal.size(); ++i) {
+    signal[i] = distribution(generator);
+  }
+  std::unique_ptr<SplitFilter> vector_split_filter =
+      SplitFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, vector_split_filter);
+  std::unique_ptr<SplitFilter> span_split_filter =
+      SplitFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, span_split_filter);
+  std::unique_ptr<MergeFilter> vector_merge_filter =
+      MergeFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, vector_merge_filter);
+  std::unique_ptr<MergeFilter> span_merge_filter =
+      MergeFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, span_merge_filter);
+
+  // All the bands live in one buffer, as they would when preallocated.
+  std::vector<int16_t> band_samples(kNumSignalSamples);
+  std::vector<absl::Span<int16_t>> bands;
+  std::vector<absl::Span<const int16_t>> const_bands;
+  for (int band = 0; band < kNumBands; ++band) {
+    bands.emplace_back(band_samples.data() + band * kNumBandSamples,
+                       kNumBandSamples);
+    const_bands.emplace_back(bands.back());
+  }
+  std::vector<int16_t> merged_signal(kNumSignalSamples);
+  // Run twice to check that the state carries over the same way.
+  for (int run = 0; run < 2; ++run) {
+    const std::vector<std::vector<int16_t>> expected_bands =
+        vector_split_filter->Split(signal);
+    span_split_filter->SplitInto(signal, bands);
+    for (int band = 0; band < kNumBands; ++band) {
+      EXPECT_EQ(expected_bands[band],
+                std::vector<int16_t>(bands[band].begin(), bands[band].end()));
+    }
+
+    span_merge_filter->MergeInto(const_bands, absl::MakeSpan(merged_signal));
+    EXPECT_EQ(vector_merge_filter->Merge(expected_bands), merged_signal);
+  }
+}
+
 class FilterBanksSineTest : public testing::TestWithParam<int> {};
 
 TEST_P(FilterBanksSineTest, Sine) {
@@ -180,6 +250,73 @@ TEST_P(FilterBanksSineTest, Sine) {
 INSTANTIATE_TEST_SUITE_P(DifferentFrequencies, FilterBanksSineTest,
                          testing::Range(0, kNumBands));
 
+TEST(UpsamplingMergeFilterTest, InvalidParameters) {
+  EXPECT_EQ(nullptr, UpsamplingMergeFilter::Create(kNumBands + 1, 3));
+  EXPECT_EQ(nullptr, UpsamplingMergeFilter::Create(kNumBands, 1));
+  EXPECT_EQ(nullptr, UpsamplingMergeFilter::Create(kNumBands, 0));
+}
+
+class UpsamplingMergeFilterTest : public testing::TestWithParam<int> {};
+
+TEST_P(UpsamplingMergeFilterTest, MatchesMergeThenUpsample) {
+  const int upsampling_factor = GetParam();
+  std::vector<int16_t> signal(kNumSignalSamples);
+  for (int i = 0; i < signal.size(); ++i) {
+    signal[i] = 10000 * std::sin(M_PI * i / (2.f * kNumBands));
+  }
+  std::unique_ptr<SplitFilter> split_filter = SplitFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, split_filter);
+  const std::vector<std::vector<int16_t>> bands = split_filter->Split(signal);
+
+  std::unique_ptr<MergeFilter> merge_filter = MergeFilter::Create(kNumBands);
+  ASSERT_NE(nullptr, merge_filter);
+  std::unique_ptr<PolyphaseResampler> upsampler =
+      PolyphaseResampler::Create(1, upsampling_factor);
+  ASSERT_NE(nullptr, upsampler);
+  const std::vector<int16_t> merged_signal = merge_filter->Merge(bands);
+  std::vector<int16_t> expected(upsampling_factor * kNumSignalSamples);
+  upsampler->Process(absl::MakeConstSpan(merged_signal),
+                     absl::MakeSpan(expected));
+
+  std::unique_ptr<UpsamplingMergeFilter> upsampling_merge_filter =
+      UpsamplingMergeFilter::Create(kNumBands, upsampling_factor);
+  ASSERT_NE(nullptr, upsampling_merge_filter);
+  EXPECT_EQ(kNumBands, upsampling_merge_filter->num_bands());
+  EXPECT_EQ(kNumBands * upsampling_factor,
+            upsampling_merge_filter->num_samples_per_band_sample());
+  const std::vector<int16_t> upsampled_signal =
+      upsampling_merge_filter->Merge(bands);
+  ASSERT_EQ(expected.size(), upsampled_signal.size());
+  // They only differ by the int16 truncation after each merge level, which
+  // the upsampling merge filter skips.
+  constexpr int kTolerance = 8;
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected[i], upsampled_signal[i], kTolerance);
+  }
+}
+
+TEST_P(UpsamplingMergeFilterTest, ResetForgetsHistory) {
+  std::vector<std::vector<int16_t>> bands(kNumBands);
+  std::mt19937 generator;
+  std::uniform_int_distribution<> distribution(-1000, 1000);
+  for (auto& band : bands) {
+    for (int i = 0; i < kNumBandSamples; ++i) {
+      band.push_back(distribution(generator));
+    }
+  }
+  std::unique_ptr<UpsamplingMergeFilter> merge_filter =
+      UpsamplingMergeFilter::Create(kNumBands, GetParam());
+  ASSERT_NE(nullptr, merge_filter);
+
+  const std::vector<int16_t> first_merged_signal = merge_filter->Merge(bands);
+  EXPECT_NE(first_merged_signal, merge_filter->Merge(bands));
+  merge_filter->Reset();
+  EXPECT_EQ(first_merged_signal, merge_filter->Merge(bands));
+}
+
+INSTANTIATE_TEST_SUITE_P(UpsamplingFactors, UpsamplingMergeFilterTest,
+                         testing::Values(2, 3));
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
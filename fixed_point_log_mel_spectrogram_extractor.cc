@@ -0,0 +1,363 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fixed_point_log_mel_spectrogram_extractor.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "audio/dsp/number_util.h"
+#include "glog/logging.h"
+#include "log_mel_spectrogram_extractor_impl.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Fractional bits of the window, of the mel weights and of the twiddle
+// factors.
+constexpr int kWindowBits = 30;
+constexpr int kWeightBits = 15;
+constexpr int kTwiddleBits = 30;
+// Before every stage of the FFT the values are shifted right until they are
+// below this bound, so that no butterfly overflows 32 bits.
+constexpr int32_t kMaxFftValue = int32_t{1} << 29;
+// Fractional bits of the log2 values of the lookup table.
+constexpr int kLogBits = 16;
+// The lookup table has an entry per 1 / 2^kLogTableBits between 1 and 2, and
+// the next bits of the argument interpolate linearly between entries.
+constexpr int kLogTableBits = 8;
+constexpr int kLogInterpolationBits = 16;
+
+// Returns log2(1 + i / 2^kLogTableBits) with |kLogBits| fractional bits for
+// every i up to and including 2^kLogTableBits.
+const std::array<int32_t, (1 << kLogTableBits) + 1>& Log2Table() {
+  static const auto* const table = []() {
+    auto* table = new std::array<int32_t, (1 << kLogTableBits) + 1>();
+    for (int i = 0; i < table->size(); ++i) {
+      (*table)[i] = static_cast<int32_t>(std::lround(std::ldexp(
+          std::log2(1.0 + std::ldexp(i, -kLogTableBits)), kLogBits)));
+    }
+    return table;
+  }();
+  return *table;
+}
+
+// Returns log2(|value|) with |kLogBits| fractional bits. |value| has to be
+// positive.
+int32_t FixedPointLog2(uint64_t value) {
+  const int integer_part = absl::bit_width(value) - 1;
+  // The bits below the leading one, aligned to the top.
+  const uint64_t fraction =
+      integer_part == 0 ? 0 : value << (64 - integer_part);
+  const int index = fraction >> (64 - kLogTableBits);
+  const int64_t remainder =
+      (fraction >> (64 - kLogTableBits - kLogInterpolationBits)) &
+      ((1 << kLogInterpolationBits) - 1);
+  const auto& table = Log2Table();
+  return (integer_part << kLogBits) + table[index] +
+         static_cast<int32_t>(((table[index + 1] - table[index]) * remainder) >>
+                              kLogInterpolationBits);
+}
+
+// Returns the integer square root of |value|, rounded down.
+uint32_t IntegerSqrt(uint64_t value) {
+  uint64_t root = 0;
+  // The highest power of four not above |value|.
+  const int num_bits = absl::bit_width(value);
+  uint64_t bit = num_bits == 0 ? 0 : uint64_t{1} << ((num_bits - 1) & ~1);
+  while (bit != 0) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return static_cast<uint32_t>(root);
+}
+
+// Returns |value| * |twiddle| / 2^kTwiddleBits, rounded.
+int64_t MultiplyByTwiddle(int64_t value, int32_t twiddle) {
+  return (value * twiddle + (int64_t{1} << (kTwiddleBits - 1))) >>
+         kTwiddleBits;
+}
+
+// Shifts |values| right until their magnitudes are below |kMaxFftValue| and
+// returns by how many bits.
+int Normalize(absl::Span<int32_t> values) {
+  int32_t max_magnitude = 0;
+  for (const int32_t value : values) {
+    max_magnitude = std::max(max_magnitude, std::abs(value));
+  }
+  int shift = 0;
+  while ((max_magnitude >> shift) >= kMaxFftValue) {
+    ++shift;
+  }
+  if (shift > 0) {
+    const int32_t rounding = int32_t{1} << (shift - 1);
+    for (int32_t& value : values) {
+      value = (value + rounding) >> shift;
+    }
+  }
+  return shift;
+}
+
+}  // namespace
+
+FixedPointLogMelSpectrogramExtractor::FixedPointLogMelSpectrogramExtractor(
+    std::vector<int32_t> window, std::vector<MelFilter> mel_filters,
+    int hop_length_samples, int fft_size)
+    : window_(std::move(window)),
+      mel_filters_(std::move(mel_filters)),
+      hop_length_samples_(hop_length_samples),
+      fft_size_(fft_size),
+      // The window starts out as silence, so that the first hop of audio
+      // already yields features.
+      samples_(window_.size(), 0),
+      windowed_(window_.size(), 0),
+      fft_buffer_(fft_size, 0),
+      bit_reversal_(fft_size / 2),
+      cosines_(fft_size / 2 + 1),
+      sines_(fft_size / 2 + 1),
+      magnitudes_(fft_size / 2 + 1, 0) {
+  const int num_complex_values = fft_size / 2;
+  const int num_index_bits = absl::bit_width(
+      static_cast<unsigned>(num_complex_values)) - 1;
+  for (int i = 0; i < num_complex_values; ++i) {
+    int reversed = 0;
+    for (int b = 0; b < num_index_bits; ++b) {
+      reversed |= ((i >> b) & 1) << (num_index_bits - 1 - b);
+    }
+    bit_reversal_[i] = reversed;
+  }
+  for (int k = 0; k < cosines_.size(); ++k) {
+    const double angle = 2.0 * M_PI * k / fft_size;
+    cosines_[k] = static_cast<int32_t>(
+        std::lround(std::ldexp(std::cos(angle), kTwiddleBits)));
+    sines_[k] = static_cast<int32_t>(
+        std::lround(std::ldexp(std::sin(angle), kTwiddleBits)));
+  }
+}
+
+std::unique_ptr<FixedPointLogMelSpectrogramExtractor>
+FixedPointLogMelSpectrogramExtractor::Create(int sample_rate_hz,
+                                             int num_mel_bins,
+                                             int hop_length_samples,
+                                             int window_length_samples) {
+  if (window_length_samples < hop_length_samples) {
+    LOG(ERROR) << "Window length samples was " << window_length_samples
+               << " but must be >= hop length samples which was "
+               << hop_length_samples;
+    return nullptr;
+  }
+  if (hop_length_samples <= 0) {
+    LOG(ERROR) << "Hop length samples was " << hop_length_samples
+               << " but must be positive.";
+    return nullptr;
+  }
+  if (sample_rate_hz <= 0 || num_mel_bins <= 0) {
+    LOG(ERROR) << "Could not create mel filters for " << num_mel_bins
+               << " bins at " << sample_rate_hz << " Hz.";
+    return nullptr;
+  }
+  if (num_mel_bins > FeatureFrame::kCapacity) {
+    LOG(ERROR) << "A frame holds at most " << FeatureFrame::kCapacity
+               << " features, not " << num_mel_bins << ".";
+    return nullptr;
+  }
+
+  // Periodic Hann window.
+  std::vector<int32_t> window(window_length_samples);
+  for (int i = 0; i < window_length_samples; ++i) {
+    window[i] = static_cast<int32_t>(std::lround(std::ldexp(
+        0.5 - 0.5 * std::cos(2.0 * M_PI * i / window_length_samples),
+        kWindowBits)));
+  }
+
+  const int fft_size = static_cast<int>(
+      audio_dsp::NextPowerOfTwo(static_cast<unsigned>(window_length_samples)));
+  // The real FFT is computed as a complex one of half the size, which needs
+  // at least two values.
+  if (fft_size < 4) {
+    LOG(ERROR) << "The window of " << window_length_samples
+               << " samples is too short for a spectrogram.";
+    return nullptr;
+  }
+  const int num_fft_bins = fft_size / 2 + 1;
+
+  // Keep only the range of bins each filter weights.
+  const std::vector<std::vector<double>> mel_weights =
+      LogMelSpectrogramExtractorImpl::GetMelWeights(sample_rate_hz,
+                                                    num_mel_bins, num_fft_bins);
+  std::vector<MelFilter> mel_filters(num_mel_bins);
+  for (int c = 0; c < num_mel_bins; ++c) {
+    const std::vector<double>& weights = mel_weights[c];
+    const auto is_non_zero = [](double weight) { return weight != 0.0; };
+    const auto first =
+        std::find_if(weights.begin(), weights.end(), is_non_zero);
+    const auto last =
+        std::find_if(weights.rbegin(), weights.rend(), is_non_zero).base();
+    mel_filters[c].first_bin = first - weights.begin();
+    for (auto weight = first; weight < last; ++weight) {
+      mel_filters[c].weights.push_back(
+          static_cast<int32_t>(std::lround(std::ldexp(*weight, kWeightBits))));
+    }
+  }
+
+  return absl::WrapUnique(new FixedPointLogMelSpectrogramExtractor(
+      std::move(window), std::move(mel_filters), hop_length_samples,
+      fft_size));
+}
+
+absl::optional<FeatureFrame> FixedPointLogMelSpectrogramExtractor::Extract(
+    const absl::Span<const int16_t> audio) {
+  if (audio.size() != hop_length_samples_) {
+    LOG(ERROR) << "Audio frame should have " << hop_length_samples_
+               << " samples but instead had " << audio.size() << ".";
+    return absl::nullopt;
+  }
+  std::copy(samples_.begin() + hop_length_samples_, samples_.end(),
+            samples_.begin());
+  std::copy(audio.begin(), audio.end(), samples_.end() - hop_length_samples_);
+  return ComputeFeatures();
+}
+
+void FixedPointLogMelSpectrogramExtractor::Reset() {
+  std::fill(samples_.begin(), samples_.end(), 0);
+}
+
+void FixedPointLogMelSpectrogramExtractor::ComplexFft(int* exponent) {
+  const int num_values = fft_size_ / 2;
+  int32_t* data = fft_buffer_.data();
+  for (int i = 0; i < num_values; ++i) {
+    const int j = bit_reversal_[i];
+    if (i < j) {
+      std::swap(data[2 * i], data[2 * j]);
+      std::swap(data[2 * i + 1], data[2 * j + 1]);
+    }
+  }
+  for (int length = 2; length <= num_values; length *= 2) {
+    *exponent += Normalize(absl::MakeSpan(fft_buffer_));
+    const int half_length = length / 2;
+    // The twiddle factors of this stage are every |stride|th of the tables.
+    const int stride = 2 * num_values / length;
+    for (int start = 0; start < num_values; start += length) {
+      for (int j = 0; j < half_length; ++j) {
+        const int32_t cosine = cosines_[j * stride];
+        const int32_t sine = sines_[j * stride];
+        int32_t* a = data + 2 * (start + j);
+        int32_t* b = a + 2 * half_length;
+        // b * exp(-i angle).
+        const int64_t t_real =
+            MultiplyByTwiddle(b[0], cosine) + MultiplyByTwiddle(b[1], sine);
+        const int64_t t_imag =
+            MultiplyByTwiddle(b[1], cosine) - MultiplyByTwiddle(b[0], sine);
+        b[0] = static_cast<int32_t>(a[0] - t_real);
+        b[1] = static_cast<int32_t>(a[1] - t_imag);
+        a[0] = static_cast<int32_t>(a[0] + t_real);
+        a[1] = static_cast<int32_t>(a[1] + t_imag);
+      }
+    }
+  }
+  *exponent += Normalize(absl::MakeSpan(fft_buffer_));
+}
+
+FeatureFrame FixedPointLogMelSpectrogramExtractor::ComputeFeatures() {
+  // Window and zero pad. The products have |kWindowBits| fractional bits and
+  // are scaled to the range the FFT allows, so that quiet windows keep their
+  // precision.
+  const int window_length = window_.size();
+  int64_t max_magnitude = 0;
+  for (int i = 0; i < window_length; ++i) {
+    windowed_[i] = int64_t{samples_[i]} * window_[i];
+    max_magnitude = std::max(max_magnitude, std::abs(windowed_[i]));
+  }
+  std::fill(fft_buffer_.begin() + window_length, fft_buffer_.end(), 0);
+  const int shift = absl::bit_width(static_cast<uint64_t>(max_magnitude)) -
+              (absl::bit_width(static_cast<uint32_t>(kMaxFftValue)) - 1);
+  for (int i = 0; i < window_length; ++i) {
+    fft_buffer_[i] = static_cast<int32_t>(
+        shift > 0 ? (windowed_[i] + (int64_t{1} << (shift - 1))) >> shift
+                  : windowed_[i] * (int64_t{1} << -shift));
+  }
+  int exponent = shift - kWindowBits;
+  ComplexFft(&exponent);
+
+  // Split the transform of the even and odd samples into the bins of the real
+  // FFT: X[k] = E[k] + exp(-2 pi i k / N) O[k], where 2 E[k] = Z[k] +
+  // conj(Z[M - k]) and 2 i O[k] = Z[k] - conj(Z[M - k]). The doubled values
+  // are used, so the exponent drops by one.
+  const int num_values = fft_size_ / 2;
+  const int32_t* data = fft_buffer_.data();
+  for (int k = 0; k <= num_values; ++k) {
+    const int32_t* z_k = data + 2 * (k % num_values);
+    const int32_t* z_m = data + 2 * ((num_values - k) % num_values);
+    const int64_t even_real = int64_t{z_k[0]} + z_m[0];
+    const int64_t even_imag = int64_t{z_k[1]} - z_m[1];
+    const int64_t odd_real = int64_t{z_k[1]} + z_m[1];
+    const int64_t odd_imag = int64_t{z_m[0]} - z_k[0];
+    const int64_t real = even_real + MultiplyByTwiddle(odd_real, cosines_[k]) +
+                         MultiplyByTwiddle(odd_imag, sines_[k]);
+    const int64_t imag = even_imag + MultiplyByTwiddle(odd_imag, cosines_[k]) -
+                         MultiplyByTwiddle(odd_real, sines_[k]);
+    // The squares are taken unsigned, since they may not fit in int64.
+    const uint64_t abs_real = std::abs(real);
+    const uint64_t abs_imag = std::abs(imag);
+    magnitudes_[k] = IntegerSqrt(abs_real * abs_real + abs_imag * abs_imag);
+  }
+  exponent -= 1;
+
+  // Each filter is a dot product over its range of bins, which adds the
+  // fractional bits of the weights. The log of the floor is that of
+  // LogMelSpectrogramExtractorImpl.
+  exponent -= kWeightBits;
+  static const int32_t kLogFloor = static_cast<int32_t>(std::lround(
+      std::ldexp(LogMelSpectrogramExtractorImpl::GetSilenceValue() *
+                     LogMelSpectrogramExtractorImpl::GetNormalizationFactor() /
+                     M_LN2,
+                 kLogBits)));
+  const float log2_to_feature =
+      static_cast<float>(std::ldexp(M_LN2, -kLogBits)) /
+      LogMelSpectrogramExtractorImpl::GetNormalizationFactor();
+  const int num_mel_bins = mel_filters_.size();
+  FeatureFrame mel_features(num_mel_bins);
+  for (int c = 0; c < num_mel_bins; ++c) {
+    const MelFilter& filter = mel_filters_[c];
+    uint64_t energy = 0;
+    for (int i = 0; i < filter.weights.size(); ++i) {
+      energy += uint64_t{magnitudes_[filter.first_bin + i]} * filter.weights[i];
+    }
+    const int32_t log2_energy =
+        energy == 0 ? kLogFloor
+                    : std::max(kLogFloor, FixedPointLog2(energy) +
+                                              exponent * (1 << kLogBits));
+    mel_features[c] = log2_energy * log2_to_feature;
+  }
+  return mel_features;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
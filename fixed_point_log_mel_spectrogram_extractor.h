@@ -0,0 +1,101 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_FIXED_POINT_LOG_MEL_SPECTROGRAM_EXTRACTOR_H_
+#define LYRA_CODEC_FIXED_POINT_LOG_MEL_SPECTROGRAM_EXTRACTOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "feature_extractor_interface.h"
+#include "feature_frame.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Extracts the features of LogMelSpectrogramExtractorImpl in integer
+// arithmetic, for encoders on devices without fast floating point. The window
+// and the twiddle factors are fixed point, the FFT is a block floating point
+// radix-2 transform of 32-bit integers, the mel filters have Q15 weights and
+// the log is taken from a lookup table. Only the final features are converted
+// to floats, for the quantizer.
+class FixedPointLogMelSpectrogramExtractor : public FeatureExtractorInterface {
+ public:
+  // Returns a nullptr if creation fails.
+  static std::unique_ptr<FixedPointLogMelSpectrogramExtractor> Create(
+      int sample_rate_hz, int num_mel_bins, int hop_length_samples,
+      int window_length_samples);
+
+  ~FixedPointLogMelSpectrogramExtractor() override {}
+
+  // Extracts the mel features from the audio. On failure returns a nullopt.
+  // The size of audio must match the value of hop_length_samples_.
+  // This assumes that audio frames are passed in order.
+  absl::optional<FeatureFrame> Extract(
+      const absl::Span<const int16_t> audio) override;
+
+  // Zeroes the samples the next window keeps from the previous hops.
+  void Reset() override;
+
+ private:
+  // The triangular filter of a mel channel, which weights a contiguous range
+  // of FFT bins.
+  struct MelFilter {
+    int first_bin;
+    std::vector<int32_t> weights;
+  };
+
+  FixedPointLogMelSpectrogramExtractor() = delete;
+  FixedPointLogMelSpectrogramExtractor(std::vector<int32_t> window,
+                                       std::vector<MelFilter> mel_filters,
+                                       int hop_length_samples, int fft_size);
+
+  // Returns the features of the current window.
+  FeatureFrame ComputeFeatures();
+
+  // Transforms the |fft_size_| / 2 complex values of |fft_buffer_| in place,
+  // adding the number of bits they were shifted right by to |*exponent|.
+  void ComplexFft(int* exponent);
+
+  const std::vector<int32_t> window_;
+  const std::vector<MelFilter> mel_filters_;
+  const int hop_length_samples_;
+  const int fft_size_;
+  // The last window of samples.
+  std::vector<int16_t> samples_;
+  // The samples times the window.
+  std::vector<int64_t> windowed_;
+  // The windowed samples as interleaved complex values, the even samples in
+  // the real and the odd ones in the imaginary parts, transformed in place.
+  std::vector<int32_t> fft_buffer_;
+  // The bit reversed index of each of the complex values.
+  std::vector<int> bit_reversal_;
+  // The cosine and sine of each multiple of 2 pi / |fft_size_|, with 30
+  // fractional bits.
+  std::vector<int32_t> cosines_;
+  std::vector<int32_t> sines_;
+  // The magnitude of each FFT bin.
+  std::vector<uint32_t> magnitudes_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_FIXED_POINT_LOG_MEL_SPECTROGRAM_EXTRACTOR_H_
@@ -0,0 +1,183 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "fixed_point_log_mel_spectrogram_extractor.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "log_mel_spectrogram_extractor_impl.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static constexpr int kTestSampleRateHz = 16000;
+static constexpr int kNumMelBins = 160;
+static constexpr int kHopLengthSamples = 320;
+static constexpr int kWindowLengthSamples = 640;
+// Largest difference to the features of the float path. The features are the
+// natural log of the mel energies divided by 10, so this is a relative error
+// of about 0.1% in the energies.
+static constexpr float kTolerance = 1e-4f;
+
+// Returns |num_hops| hops of white noise of |amplitude| with a tone of
+// |tone_amplitude| at 1 kHz.
+std::vector<int16_t> TestSignal(int num_hops, double amplitude,
+                                double tone_amplitude) {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> distribution(-amplitude, amplitude);
+  std::vector<int16_t> samples(num_hops * kHopLengthSamples);
+  for (int i = 0; i < samples.size(); ++i) {
+    const double tone =
+        std::sin(2.0 * M_PI * 1000.0 * i / kTestSampleRateHz);
+    samples[i] = static_cast<int16_t>(
+        std::round(distribution(gen) + tone_amplitude * tone));
+  }
+  return samples;
+}
+
+class FixedPointLogMelSpectrogramExtractorTest
+    : public testing::TestWithParam<std::vector<double>> {};
+
+TEST_P(FixedPointLogMelSpectrogramExtractorTest, MatchesFloatPath) {
+  const double amplitude = GetParam()[0];
+  const double tone_amplitude = GetParam()[1];
+  auto fixed_point_extractor = FixedPointLogMelSpectrogramExtractor::Create(
+      kTestSampleRateHz, kNumMelBins, kHopLengthSamples, kWindowLengthSamples);
+  auto float_extractor = LogMelSpectrogramExtractorImpl::Create(
+      kTestSampleRateHz, kNumMelBins, kHopLengthSamples, kWindowLengthSamples);
+  ASSERT_NE(fixed_point_extractor, nullptr);
+  ASSERT_NE(float_extractor, nullptr);
+
+  constexpr int kNumHops = 10;
+  const std::vector<int16_t> samples =
+      TestSignal(kNumHops, amplitude, tone_amplitude);
+  for (int hop = 0; hop < kNumHops; ++hop) {
+    const auto audio = absl::MakeConstSpan(samples).subspan(
+        hop * kHopLengthSamples, kHopLengthSamples);
+
+    auto features_or = fixed_point_extractor->Extract(audio);
+    auto expected_or = float_extractor->Extract(audio);
+
+    ASSERT_TRUE(features_or.has_value());
+    ASSERT_TRUE(expected_or.has_value());
+    EXPECT_THAT(features_or.value(),
+                testing::Pointwise(testing::FloatNear(kTolerance),
+                                   expected_or.value()))
+        << "at hop " << hop;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    NoiseAndTones, FixedPointLogMelSpectrogramExtractorTest,
+    testing::Values(std::vector<double>{32767.0, 0.0},
+                    std::vector<double>{1000.0, 0.0},
+                    std::vector<double>{30.0, 0.0},
+                    std::vector<double>{100.0, 20000.0},
+                    std::vector<double>{0.0, 12000.0}));
+
+TEST(FixedPointLogMelSpectrogramExtractorProdTest, SilenceIsAtTheFloor) {
+  auto feature_extractor = FixedPointLogMelSpectrogramExtractor::Create(
+      kTestSampleRateHz, kNumMelBins, kHopLengthSamples, kWindowLengthSamples);
+  ASSERT_NE(feature_extractor, nullptr);
+  const std::vector<int16_t> silence(kHopLengthSamples, 0);
+
+  auto features_or = feature_extractor->Extract(silence);
+
+  ASSERT_TRUE(features_or.has_value());
+  EXPECT_THAT(features_or.value(),
+              testing::Each(testing::FloatNear(
+                  LogMelSpectrogramExtractorImpl::GetSilenceValue(),
+                  kTolerance)));
+}
+
+TEST(FixedPointLogMelSpectrogramExtractorProdTest, ResetStartsTheStreamOver) {
+  auto feature_extractor = FixedPointLogMelSpectrogramExtractor::Create(
+      kTestSampleRateHz, kNumMelBins, kHopLengthSamples, kWindowLengthSamples);
+  ASSERT_NE(feature_extractor, nullptr);
+  const std::vector<int16_t> hop = TestSignal(1, 1000.0, 8000.0);
+  const auto first_or = feature_extractor->Extract(hop);
+  ASSERT_TRUE(first_or.has_value());
+  ASSERT_TRUE(feature_extractor->Extract(hop).has_value());
+  feature_extractor->Reset();
+
+  // The window of the first hop holds zeros before it again.
+  const auto features_or = feature_extractor->Extract(hop);
+
+  ASSERT_TRUE(features_or.has_value());
+  EXPECT_EQ(features_or.value(), first_or.value());
+}
+
+TEST(FixedPointLogMelSpectrogramExtractorProdTest, FullScaleDoesNotOverflow) {
+  auto fixed_point_extractor = FixedPointLogMelSpectrogramExtractor::Create(
+      kTestSampleRateHz, kNumMelBins, kHopLengthSamples, kWindowLengthSamples);
+  auto float_extractor = LogMelSpectrogramExtractorImpl::Create(
+      kTestSampleRateHz, kNumMelBins, kHopLengthSamples, kWindowLengthSamples);
+  ASSERT_NE(fixed_point_extractor, nullptr);
+  ASSERT_NE(float_extractor, nullptr);
+  // A square wave at full scale, alternating every sample, which puts all
+  // the energy into the Nyquist bin.
+  std::vector<int16_t> samples(kHopLengthSamples);
+  for (int i = 0; i < samples.size(); ++i) {
+    samples[i] = i % 2 == 0 ? 32767 : -32768;
+  }
+
+  for (int hop = 0; hop < 2; ++hop) {
+    auto features_or = fixed_point_extractor->Extract(samples);
+    auto expected_or = float_extractor->Extract(samples);
+
+    ASSERT_TRUE(features_or.has_value());
+    ASSERT_TRUE(expected_or.has_value());
+    EXPECT_THAT(features_or.value(),
+                testing::Pointwise(testing::FloatNear(kTolerance),
+                                   expected_or.value()));
+  }
+}
+
+TEST(FixedPointLogMelSpectrogramExtractorProdTest, WrongFrameSizeFails) {
+  auto feature_extractor = FixedPointLogMelSpectrogramExtractor::Create(
+      kTestSampleRateHz, kNumMelBins, kHopLengthSamples, kWindowLengthSamples);
+  ASSERT_NE(feature_extractor, nullptr);
+
+  EXPECT_FALSE(feature_extractor
+                   ->Extract(std::vector<int16_t>(kHopLengthSamples + 1))
+                   .has_value());
+  EXPECT_FALSE(feature_extractor
+                   ->Extract(std::vector<int16_t>(kHopLengthSamples - 1))
+                   .has_value());
+}
+
+TEST(FixedPointLogMelSpectrogramExtractorProdTest, InvalidParamsFail) {
+  EXPECT_EQ(FixedPointLogMelSpectrogramExtractor::Create(
+                kTestSampleRateHz, kNumMelBins, kWindowLengthSamples,
+                kHopLengthSamples),
+            nullptr);
+  EXPECT_EQ(FixedPointLogMelSpectrogramExtractor::Create(
+                kTestSampleRateHz, kNumMelBins, 0, kWindowLengthSamples),
+            nullptr);
+  EXPECT_EQ(FixedPointLogMelSpectrogramExtractor::Create(
+                kTestSampleRateHz, 0, kHopLengthSamples, kWindowLengthSamples),
+            nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
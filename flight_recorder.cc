@@ -0,0 +1,238 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "flight_recorder.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif  // defined(__linux__)
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "thread_affinity.h"
+#include "tracing.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Cached, since asking the kernel costs more than recording.
+int32_t CachedThreadId() {
+  static thread_local const int32_t thread_id = CurrentThreadId();
+  return thread_id;
+}
+
+int CurrentCpu() {
+#if defined(__linux__)
+  return sched_getcpu();
+#else
+  return -1;
+#endif  // defined(__linux__)
+}
+
+}  // namespace
+
+FlightRecorder::Call::Call(FlightRecorder* recorder, const char* name)
+    : recorder_(recorder == nullptr || Tracing::thread_sink() == recorder
+                    ? nullptr
+                    : recorder),
+      name_(name),
+      begin_nanos_(recorder_ != nullptr ? Tracing::NowNanos() : 0) {
+  if (recorder_ != nullptr) {
+    sink_.emplace(recorder_);
+  }
+}
+
+FlightRecorder::Call::~Call() {
+  if (recorder_ == nullptr) {
+    return;
+  }
+  const int64_t end_nanos = Tracing::NowNanos();
+  sink_.reset();
+  recorder_->Record(name_, begin_nanos_, end_nanos);
+  recorder_->EndCall(name_, begin_nanos_, end_nanos);
+}
+
+std::unique_ptr<FlightRecorder> FlightRecorder::Create(
+    const FlightRecorderOptions& options) {
+  if (options.deadline <= absl::ZeroDuration()) {
+    LOG(ERROR) << "The deadline of the flight recorder has to be positive, "
+               << "but is " << options.deadline << ".";
+    return nullptr;
+  }
+  if (options.capacity <= 0) {
+    LOG(ERROR) << "The flight recorder has to hold events, but holds "
+               << options.capacity << ".";
+    return nullptr;
+  }
+  return absl::WrapUnique(new FlightRecorder(options));
+}
+
+FlightRecorder::FlightRecorder(const FlightRecorderOptions& options)
+    : options_(options),
+      deadline_nanos_(absl::ToInt64Nanoseconds(options.deadline)),
+      slots_(new Slot[options.capacity]),
+      last_dump_nanos_(-1) {}
+
+void FlightRecorder::Record(const char* name, int64_t begin_nanos,
+                            int64_t end_nanos) {
+  const int64_t index = num_recorded_.fetch_add(1, std::memory_order_relaxed);
+  Slot& slot = slots_[index % options_.capacity];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.begin_nanos.store(begin_nanos, std::memory_order_relaxed);
+  slot.duration_nanos.store(end_nanos - begin_nanos,
+                            std::memory_order_relaxed);
+  slot.thread_id.store(CachedThreadId(), std::memory_order_relaxed);
+  slot.cpu.store(CurrentCpu(), std::memory_order_relaxed);
+  slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+std::vector<FlightEvent> FlightRecorder::CollectSince(int64_t begin_nanos,
+                                                      bool* truncated) const {
+  const int64_t num_recorded = num_recorded_.load(std::memory_order_acquire);
+  const int64_t oldest =
+      std::max<int64_t>(0, num_recorded - options_.capacity);
+  std::vector<FlightEvent> events;
+  int64_t oldest_end_nanos = -1;
+  for (int64_t i = oldest; i < num_recorded; ++i) {
+    const Slot& slot = slots_[i % options_.capacity];
+    if (slot.sequence.load(std::memory_order_acquire) != i + 1) {
+      // Still being written, or already overwritten by a later event.
+      continue;
+    }
+    FlightEvent event;
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.begin_nanos = slot.begin_nanos.load(std::memory_order_relaxed);
+    event.duration_nanos = slot.duration_nanos.load(std::memory_order_relaxed);
+    event.thread_id = slot.thread_id.load(std::memory_order_relaxed);
+    event.cpu = slot.cpu.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != i + 1) {
+      continue;
+    }
+    if (i == oldest) {
+      oldest_end_nanos = event.begin_nanos + event.duration_nanos;
+    }
+    if (event.begin_nanos < begin_nanos) {
+      continue;
+    }
+    events.push_back(event);
+  }
+  // The events before the oldest kept one ended before it, so unless that
+  // ended before the call began some of the call were overwritten.
+  *truncated = oldest > 0 && oldest_end_nanos >= begin_nanos;
+  return events;
+}
+
+void FlightRecorder::EndCall(const char* name, int64_t begin_nanos,
+                             int64_t end_nanos) {
+  num_calls_.fetch_add(1, std::memory_order_relaxed);
+  if (end_nanos - begin_nanos <= deadline_nanos_) {
+    return;
+  }
+  num_deadline_misses_.fetch_add(1, std::memory_order_relaxed);
+  FlightRecord record;
+  {
+    absl::MutexLock lock(&dump_mutex_);
+    if (last_dump_nanos_ >= 0 &&
+        end_nanos - last_dump_nanos_ <
+            absl::ToInt64Nanoseconds(options_.min_dump_interval)) {
+      ++num_suppressed_;
+      return;
+    }
+    last_dump_nanos_ = end_nanos;
+    record.num_suppressed = num_suppressed_;
+    num_suppressed_ = 0;
+  }
+  record.call = name;
+  record.begin_nanos = begin_nanos;
+  record.duration_nanos = end_nanos - begin_nanos;
+  record.deadline_nanos = deadline_nanos_;
+  record.events = CollectSince(begin_nanos, &record.truncated);
+  num_dumps_.fetch_add(1, std::memory_order_relaxed);
+  if (options_.on_deadline_miss) {
+    options_.on_deadline_miss(record);
+  } else {
+    LOG(WARNING) << FormatFlightRecord(record);
+  }
+}
+
+std::string FormatFlightRecord(const FlightRecord& record) {
+  std::string text = absl::StrFormat(
+      "%s took %.3f ms, over its deadline of %.3f ms, with %d events%s.",
+      record.call == nullptr ? "A call" : record.call,
+      record.duration_nanos / 1e6, record.deadline_nanos / 1e6,
+      record.events.size(), record.truncated ? ", the earliest dropped" : "");
+  if (record.num_suppressed > 0) {
+    absl::StrAppendFormat(&text, " %d slow calls were not dumped before.",
+                          record.num_suppressed);
+  }
+  struct Totals {
+    int count = 0;
+    int64_t total_nanos = 0;
+    int64_t max_nanos = 0;
+  };
+  // Ordered by thread, so that the lines of a thread are together.
+  std::map<std::tuple<int32_t, int, std::string>, Totals> totals;
+  for (const FlightEvent& event : record.events) {
+    Totals& entry = totals[std::make_tuple(
+        event.thread_id, event.cpu,
+        std::string(event.name == nullptr ? "" : event.name))];
+    ++entry.count;
+    entry.total_nanos += event.duration_nanos;
+    entry.max_nanos = std::max(entry.max_nanos, event.duration_nanos);
+  }
+  for (const auto& [key, entry] : totals) {
+    absl::StrAppendFormat(
+        &text, "\n  thread %d cpu %d %s: %d x, %.3f ms total, %.3f ms max",
+        std::get<0>(key), std::get<1>(key), std::get<2>(key), entry.count,
+        entry.total_nanos / 1e6, entry.max_nanos / 1e6);
+  }
+  return text;
+}
+
+std::string FlightRecordChromeTrace(const FlightRecord& record) {
+  std::string trace = "{\"traceEvents\":[";
+  bool first = true;
+  for (const FlightEvent& event : record.events) {
+    absl::StrAppendFormat(
+        &trace,
+        "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+        "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cpu\":%d}}",
+        first ? "" : ",", event.name == nullptr ? "" : event.name,
+        event.thread_id, event.begin_nanos / 1e3, event.duration_nanos / 1e3,
+        event.cpu);
+    first = false;
+  }
+  trace += "\n],\"displayTimeUnit\":\"ns\"}\n";
+  return trace;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_FLIGHT_RECORDER_H_
+#define LYRA_CODEC_FLIGHT_RECORDER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "tracing.h"
+
+namespace chromemedia {
+namespace codec {
+
+// One scope of a call, as recorded by |FlightRecorder|.
+struct FlightEvent {
+  const char* name = nullptr;
+  int64_t begin_nanos = 0;
+  int64_t duration_nanos = 0;
+  // The kernel id of the thread and the core it was on at the end of the
+  // scope, or -1 where the platform does not tell.
+  int32_t thread_id = 0;
+  int cpu = -1;
+};
+
+// What |FlightRecorder| dumps of a call that missed its deadline.
+struct FlightRecord {
+  // The name of the call, e.g. "DecodeSamples".
+  const char* call = nullptr;
+  int64_t begin_nanos = 0;
+  int64_t duration_nanos = 0;
+  int64_t deadline_nanos = 0;
+  // The scopes of the call on all threads, in the order they ended.
+  std::vector<FlightEvent> events;
+  // Whether the call recorded more events than the recorder holds, in which
+  // case only the latest are in |events|.
+  bool truncated = false;
+  // Missed deadlines that were not dumped since the previous dump because of
+  // the rate limit.
+  int64_t num_suppressed = 0;
+};
+
+struct FlightRecorderOptions {
+  // Calls that take longer than this are dumped, e.g. the duration of the
+  // audio of a call.
+  absl::Duration deadline = absl::Milliseconds(40);
+  // At most one call is dumped per this interval, so that an overloaded host
+  // does not also drown in logs.
+  absl::Duration min_dump_interval = absl::Seconds(10);
+  // Events kept, of all threads together.
+  int capacity = 4096;
+  // Receives every dump, e.g. to ship it with the telemetry of the session.
+  // If empty, dumps are logged with |FormatFlightRecord|.
+  std::function<void(const FlightRecord&)> on_deadline_miss;
+};
+
+// An always-on recorder of the recent trace events of one codec session, e.g.
+// the stage timings and barrier waits of a decoder, which dumps the events of
+// every call that misses its deadline. Calls are marked with |Call|, which
+// makes the recorder the |TraceSink| of the calling thread. The threads of a
+// |ThreadPool| take the sink of the thread calling |ThreadPool::Run|, so the
+// events of the workers of a call are recorded too.
+//
+// Recording an event costs two clock reads and a few relaxed atomic stores
+// into a fixed ring, whether tracing is enabled or not.
+class FlightRecorder : public TraceSink {
+ public:
+  // Records the lifetime of the scope as a call of |recorder| named |name|,
+  // a string literal, and dumps it if it misses the deadline. Does nothing if
+  // |recorder| is null or already records a call on this thread, so that
+  // calls nested in calls are part of the outer one.
+  class Call {
+   public:
+    Call(FlightRecorder* recorder, const char* name);
+    ~Call();
+
+    Call(const Call&) = delete;
+    Call& operator=(const Call&) = delete;
+
+   private:
+    FlightRecorder* const recorder_;
+    const char* const name_;
+    const int64_t begin_nanos_;
+    absl::optional<ScopedTraceSink> sink_;
+  };
+
+  // Returns a nullptr if the deadline or the capacity of |options| is not
+  // positive.
+  static std::unique_ptr<FlightRecorder> Create(
+      const FlightRecorderOptions& options);
+
+  // Thread-safe.
+  void Record(const char* name, int64_t begin_nanos,
+              int64_t end_nanos) override;
+
+  int64_t num_calls() const { return num_calls_.load(); }
+  int64_t num_deadline_misses() const { return num_deadline_misses_.load(); }
+  int64_t num_dumps() const { return num_dumps_.load(); }
+
+  const FlightRecorderOptions& options() const { return options_; }
+
+ private:
+  // The fields are atomics so that collecting a call while other threads
+  // record, e.g. those of a later call, reads a torn event at worst.
+  struct Slot {
+    // The index of the event in the slot plus one, or 0 while it is written.
+    std::atomic<int64_t> sequence{0};
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> begin_nanos{0};
+    std::atomic<int64_t> duration_nanos{0};
+    std::atomic<int32_t> thread_id{0};
+    std::atomic<int> cpu{-1};
+  };
+
+  explicit FlightRecorder(const FlightRecorderOptions& options);
+
+  // Checks the call against the deadline and dumps it if it missed it.
+  void EndCall(const char* name, int64_t begin_nanos, int64_t end_nanos);
+
+  // Returns the events that began at or after |begin_nanos|.
+  std::vector<FlightEvent> CollectSince(int64_t begin_nanos,
+                                        bool* truncated) const;
+
+  const FlightRecorderOptions options_;
+  const int64_t deadline_nanos_;
+  const std::unique_ptr<Slot[]> slots_;
+  std::atomic<int64_t> num_recorded_{0};
+
+  std::atomic<int64_t> num_calls_{0};
+  std::atomic<int64_t> num_deadline_misses_{0};
+  std::atomic<int64_t> num_dumps_{0};
+
+  absl::Mutex dump_mutex_;
+  int64_t last_dump_nanos_ ABSL_GUARDED_BY(dump_mutex_);
+  int64_t num_suppressed_ ABSL_GUARDED_BY(dump_mutex_) = 0;
+};
+
+// Describes |record| in a few lines: the call, and the count, total and
+// longest duration of the scopes of every name per thread and core.
+std::string FormatFlightRecord(const FlightRecord& record);
+
+// Returns the events of |record| as Chrome trace JSON, like
+// |Tracing::ExportChromeTrace|, with the kernel thread ids as tids.
+std::string FlightRecordChromeTrace(const FlightRecord& record);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_FLIGHT_RECORDER_H_
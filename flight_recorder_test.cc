@@ -0,0 +1,195 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "flight_recorder.h"
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "thread_affinity.h"
+#include "tracing.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+// Returns the names of the events of |record|.
+std::vector<std::string> EventNames(const FlightRecord& record) {
+  std::vector<std::string> names;
+  for (const FlightEvent& event : record.events) {
+    names.push_back(event.name);
+  }
+  return names;
+}
+
+class FlightRecorderTest : public testing::Test {
+ protected:
+  // Creates |recorder_| with a deadline of 1 ms, keeping its dumps.
+  void CreateRecorder(absl::Duration min_dump_interval, int capacity = 64) {
+    FlightRecorderOptions options;
+    options.deadline = absl::Milliseconds(1);
+    options.min_dump_interval = min_dump_interval;
+    options.capacity = capacity;
+    options.on_deadline_miss = [this](const FlightRecord& record) {
+      records_.push_back(record);
+    };
+    recorder_ = FlightRecorder::Create(options);
+    ASSERT_NE(recorder_, nullptr);
+  }
+
+  std::unique_ptr<FlightRecorder> recorder_;
+  std::vector<FlightRecord> records_;
+};
+
+TEST_F(FlightRecorderTest, CreateFailsWithInvalidOptions) {
+  FlightRecorderOptions options;
+  options.deadline = absl::ZeroDuration();
+  EXPECT_EQ(FlightRecorder::Create(options), nullptr);
+  options.deadline = absl::Milliseconds(10);
+  options.capacity = 0;
+  EXPECT_EQ(FlightRecorder::Create(options), nullptr);
+}
+
+TEST_F(FlightRecorderTest, CallsWithinTheDeadlineAreNotDumped) {
+  CreateRecorder(absl::ZeroDuration());
+  {
+    FlightRecorder::Call call(recorder_.get(), "Fast");
+    LYRA_TRACE_SCOPE("stage");
+  }
+  EXPECT_EQ(recorder_->num_calls(), 1);
+  EXPECT_EQ(recorder_->num_deadline_misses(), 0);
+  EXPECT_TRUE(records_.empty());
+}
+
+TEST_F(FlightRecorderTest, SlowCallIsDumpedWithItsEvents) {
+  CreateRecorder(absl::ZeroDuration());
+  { LYRA_TRACE_SCOPE("before_the_sink"); }
+  {
+    FlightRecorder::Call call(recorder_.get(), "Slow");
+    EXPECT_EQ(Tracing::thread_sink(), recorder_.get());
+    LYRA_TRACE_SCOPE("stage");
+    absl::SleepFor(absl::Milliseconds(5));
+  }
+  EXPECT_EQ(Tracing::thread_sink(), nullptr);
+
+  ASSERT_EQ(records_.size(), 1);
+  const FlightRecord& record = records_[0];
+  EXPECT_STREQ(record.call, "Slow");
+  EXPECT_GE(record.duration_nanos, record.deadline_nanos);
+  EXPECT_FALSE(record.truncated);
+  EXPECT_THAT(EventNames(record), testing::ElementsAre("stage", "Slow"));
+  for (const FlightEvent& event : record.events) {
+    EXPECT_EQ(event.thread_id, CurrentThreadId());
+    EXPECT_GE(event.begin_nanos, record.begin_nanos);
+  }
+  EXPECT_EQ(recorder_->num_dumps(), 1);
+}
+
+TEST_F(FlightRecorderTest, EventsOfOtherThreadsOfTheCallAreDumped) {
+  CreateRecorder(absl::ZeroDuration());
+  {
+    FlightRecorder::Call call(recorder_.get(), "Slow");
+    TraceSink* const sink = Tracing::thread_sink();
+    std::thread([sink]() {
+      ScopedTraceSink scoped_sink(sink);
+      LYRA_TRACE_SCOPE("worker");
+    }).join();
+    absl::SleepFor(absl::Milliseconds(5));
+  }
+  ASSERT_EQ(records_.size(), 1);
+  const FlightRecord& record = records_[0];
+  ASSERT_THAT(EventNames(record), testing::ElementsAre("worker", "Slow"));
+  EXPECT_NE(record.events[0].thread_id, record.events[1].thread_id);
+}
+
+TEST_F(FlightRecorderTest, NestedCallsArePartOfTheOuterOne) {
+  CreateRecorder(absl::ZeroDuration());
+  {
+    FlightRecorder::Call outer(recorder_.get(), "Outer");
+    FlightRecorder::Call inner(recorder_.get(), "Inner");
+    absl::SleepFor(absl::Milliseconds(5));
+  }
+  EXPECT_EQ(recorder_->num_calls(), 1);
+  ASSERT_EQ(records_.size(), 1);
+  EXPECT_STREQ(records_[0].call, "Outer");
+}
+
+TEST_F(FlightRecorderTest, DumpsAreRateLimited) {
+  CreateRecorder(absl::Hours(1));
+  for (int i = 0; i < 3; ++i) {
+    FlightRecorder::Call call(recorder_.get(), "Slow");
+    absl::SleepFor(absl::Milliseconds(2));
+  }
+  EXPECT_EQ(recorder_->num_deadline_misses(), 3);
+  EXPECT_EQ(recorder_->num_dumps(), 1);
+  EXPECT_EQ(records_.size(), 1);
+}
+
+TEST_F(FlightRecorderTest, CallsOverflowingTheRingAreTruncated) {
+  CreateRecorder(absl::ZeroDuration(), /*capacity=*/4);
+  {
+    FlightRecorder::Call call(recorder_.get(), "Slow");
+    for (int i = 0; i < 10; ++i) {
+      LYRA_TRACE_SCOPE("stage");
+    }
+    absl::SleepFor(absl::Milliseconds(5));
+  }
+  ASSERT_EQ(records_.size(), 1);
+  EXPECT_TRUE(records_[0].truncated);
+  EXPECT_THAT(EventNames(records_[0]),
+              testing::ElementsAre("stage", "stage", "stage", "Slow"));
+}
+
+TEST_F(FlightRecorderTest, NullRecorderRecordsNothing) {
+  FlightRecorder::Call call(nullptr, "Untracked");
+  EXPECT_EQ(Tracing::thread_sink(), nullptr);
+}
+
+TEST(FlightRecordFormat, SummarizesScopesPerThread) {
+  FlightRecord record;
+  record.call = "DecodeSamples";
+  record.duration_nanos = 25000000;
+  record.deadline_nanos = 10000000;
+  record.num_suppressed = 2;
+  record.events = {{"BarrierWait", 0, 1000000, 7, 3},
+                   {"BarrierWait", 2000000, 3000000, 7, 3},
+                   {"SamplingBody", 0, 20000000, 8, 4}};
+
+  const std::string text = FormatFlightRecord(record);
+  EXPECT_THAT(text, HasSubstr("DecodeSamples took 25.000 ms"));
+  EXPECT_THAT(text, HasSubstr("deadline of 10.000 ms"));
+  EXPECT_THAT(text, HasSubstr("2 slow calls were not dumped"));
+  EXPECT_THAT(text, HasSubstr("thread 7 cpu 3 BarrierWait: 2 x, 4.000 ms "
+                              "total, 3.000 ms max"));
+  EXPECT_THAT(text, HasSubstr("thread 8 cpu 4 SamplingBody: 1 x"));
+
+  const std::string trace = FlightRecordChromeTrace(record);
+  EXPECT_THAT(trace, HasSubstr("{\"traceEvents\":["));
+  EXPECT_THAT(trace, HasSubstr("\"name\":\"SamplingBody\",\"ph\":\"X\","
+                               "\"pid\":1,\"tid\":8"));
+  EXPECT_THAT(trace, HasSubstr("\"args\":{\"cpu\":4}"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,64 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes an uncompressed copy of a model directory in which the conv_cond and
+// conv_to_gates layers of the conditioning stack are folded into one, which
+// saves a matrix multiplication per frame. Point --model_path of the codec at
+// the output directory.
+
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "architecture_utils.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "projection_folder.h"
+
+ABSL_FLAG(std::string, model_path, "wavegru",
+          "Path to directory containing the model files. For desktop this is "
+          "the path relative to the binary.");
+ABSL_FLAG(std::string, output_dir, "",
+          "The dir for the folded model files to be written out. "
+          "Recursively creates dir if it does not exist. Will overwrite "
+          "existing files.");
+ABSL_FLAG(std::string, prefix, "lyra_16khz",
+          "The prefix of the model files to fold.");
+ABSL_FLAG(float, density, 0.0f,
+          "Fraction of the 4x4 weight blocks of the folded layer to keep, in "
+          "(0, 1]. By default as many weights are kept as the two folded "
+          "layers have non-zero ones.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  const ghc::filesystem::path model_path =
+      chromemedia::codec::GetCompleteArchitecturePath(
+          absl::GetFlag(FLAGS_model_path));
+  const ghc::filesystem::path output_dir(absl::GetFlag(FLAGS_output_dir));
+  if (output_dir.empty()) {
+    LOG(ERROR) << "Flag --output_dir not set.";
+    return -1;
+  }
+
+  if (!chromemedia::codec::FoldProjectionLayers(
+          model_path, absl::GetFlag(FLAGS_prefix),
+          absl::GetFlag(FLAGS_density), output_dir)) {
+    LOG(ERROR) << "Failed to fold " << model_path;
+    return -1;
+  }
+  return 0;
+}
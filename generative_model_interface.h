@@ -17,14 +17,20 @@
 #ifndef LYRA_CODEC_GENERATIVE_MODEL_INTERFACE_H_
 #define LYRA_CODEC_GENERATIVE_MODEL_INTERFACE_H_
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <vector>
 
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
 
+class StageProfiler;
+
 // An interface to abstract the audio generation from the model
 // implementation.
 class GenerativeModelInterface {
@@ -33,32 +39,142 @@ class GenerativeModelInterface {
 
   // Converts the features obtained from a packet into the format the model
   // expects.
-  virtual void AddFeatures(const std::vector<float>& features) = 0;
+  virtual void AddFeatures(absl::Span<const float> features) = 0;
+
+  // Adds the features of |num_frames| consecutive frames, concatenated in
+  // |features|, as if |AddFeatures| was called on each of them in order.
+  // Models that can process several frames at once should override this; the
+  // default goes through |AddFeatures|.
+  virtual void AddFrames(absl::Span<const float> features, int num_frames) {
+    const int num_features = features.size() / num_frames;
+    for (int i = 0; i < num_frames; ++i) {
+      AddFeatures(features.subspan(num_features * i, num_features));
+    }
+  }
+
+  // Like |AddFeatures|, but the features only take effect once all samples
+  // of the features added before were generated, so that the model can
+  // prepare them in the background meanwhile. Returns false if the model does
+  // not support queuing features, in which case they are dropped.
+  virtual bool QueueFeatures(absl::Span<const float> features) {
+    return false;
+  }
+
+  // Like |QueueFeatures|, but for features that may turn out not to be needed,
+  // such as the estimate for a packet that may still arrive. Nothing else may
+  // be queued at the same time. Returns false if the model does not support
+  // this, in which case the features are dropped.
+  virtual bool QueueSpeculativeFeatures(absl::Span<const float> features) {
+    return false;
+  }
+
+  // Drops the features of |QueueSpeculativeFeatures| as if they had never
+  // been queued. Does nothing if there are none.
+  virtual void DiscardSpeculativeFeatures() {}
+
+  // Plays the features of the last |AddFeatures| or |AddFrames| call out into
+  // about |num_samples| more samples, or fewer if it is negative, e.g. so that
+  // a jitter buffer can drain or grow its delay without a separate time
+  // stretching pass. Has to be called before any of their samples are
+  // generated. Returns by how many samples they were actually stretched, which
+  // the model may round, or nullopt if it cannot stretch them, which the
+  // default never can.
+  virtual absl::optional<int> StretchFeatures(int num_samples) {
+    return absl::nullopt;
+  }
 
   // Runs the model and generates |num_samples| audio samples.
   // Returns a vector of audio samples on success. Returns a nullopt on failure.
   virtual absl::optional<std::vector<int16_t>> GenerateSamples(
       int num_samples) = 0;
 
+  // Runs the model and writes |samples.size()| audio samples into |samples|.
+  // Returns false on failure. Implementations that can generate samples
+  // without allocating should override this; the default goes through
+  // |GenerateSamples|.
+  virtual bool GenerateSamplesInto(absl::Span<int16_t> samples) {
+    const auto samples_or = GenerateSamples(samples.size());
+    if (!samples_or.has_value() || samples_or->size() != samples.size()) {
+      return false;
+    }
+    std::copy(samples_or->begin(), samples_or->end(), samples.begin());
+    return true;
+  }
+
   // Clears any information about previous frames stored by the model.
   virtual void Reset() {}
 
-#ifdef BENCHMARK
-  // Returns amount of time elapsed between start and end of each conditioning
-  // stack run.
-  std::vector<int64_t> conditioning_timings_microsecs() {
-    return conditioning_timings_microsecs_;
-  }
+  // Appends everything |Reset| forgets to |writer|, so that |RestoreState| can
+  // later continue generating from this point, in this model or in another one
+  // created with the same parameters. Returns false if the model cannot save
+  // its current state, which the default never can.
+  virtual bool SaveState(StateWriter* writer) const { return false; }
 
-  // Returns amount of time elapsed between start and end of each model run.
-  std::vector<int64_t> model_timings_microsecs() {
-    return model_timings_microsecs_;
+  // Restores what |SaveState| wrote. Returns false if |reader| does not hold a
+  // state of this kind of model, in which case the model must be reset before
+  // it is used again. The default always fails.
+  virtual bool RestoreState(StateReader* reader) { return false; }
+
+  // Runs the model once on dummy input and then calls |Reset|, so that the
+  // first real call does not pay for page faults on the weights, cold caches
+  // or starting threads. The default does nothing.
+  virtual void WarmUp() {}
+
+  // Releases what the model only needs while it generates samples, e.g.
+  // stops its background threads and gives the memory of its activations
+  // back to the system, while it is idle for a long time. The state is kept,
+  // and the next call that generates samples brings back what it needs.
+  // Returns false if nothing was released, which the default never does.
+  virtual bool Park() { return false; }
+
+  // Brings back what |Park| released ahead of the next call that needs it,
+  // so that this call takes the cost. Does nothing if the model is not
+  // parked, which is the default.
+  virtual void Unpark() {}
+
+  // Starts recording latency histograms of the stages of sample generation.
+  // Returns the profiler, owned by the model, or nullptr if the model does not
+  // support profiling.
+  virtual StageProfiler* EnableStageProfiling() { return nullptr; }
+
+  // Makes the threads of the model wait for each other on an
+  // |AdaptiveBarrier|, which yields and then blocks, instead of spinning.
+  // Returns false if the model does not support it, which is the default.
+  virtual bool SetAdaptiveBarrierEnabled(bool enabled) { return false; }
+
+  // Makes the threads of the model prefetch, while they wait for each other,
+  // what they read first |distance| steps of the sampling loop later, or stops
+  // prefetching if |distance| is 0. Returns false if the model does not
+  // support it, which is the default.
+  virtual bool SetPrefetchDistance(int distance) { return false; }
+
+  // Makes each thread of the model wait after the GRU matrix multiplication
+  // only for the threads that computed the rows it reads next, instead of for
+  // all of them. Returns false if the model does not support it, which is the
+  // default.
+  virtual bool SetGruRowPipeliningEnabled(bool enabled) { return false; }
+
+  // Total time spent running the conditioning stack on added features,
+  // including conditioning precomputed in the background, and generating
+  // samples, since creation. Thread-safe.
+  int64_t conditioning_nanos() const {
+    return conditioning_nanos_.load(std::memory_order_relaxed);
+  }
+  int64_t sampling_nanos() const {
+    return sampling_nanos_.load(std::memory_order_relaxed);
   }
 
  protected:
-  std::vector<int64_t> conditioning_timings_microsecs_;
-  std::vector<int64_t> model_timings_microsecs_;
-#endif  // BENCHMARK
+  void AddConditioningNanos(int64_t nanos) {
+    conditioning_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+  }
+  void AddSamplingNanos(int64_t nanos) {
+    sampling_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<int64_t> conditioning_nanos_{0};
+  std::atomic<int64_t> sampling_nanos_{0};
 };
 
 }  // namespace codec
@@ -26,6 +26,16 @@ namespace codec {
 std::unique_ptr<GilbertModel> GilbertModel::Create(float packet_loss_rate,
                                                    float average_burst_length,
                                                    bool random_seed) {
+  unsigned int seed = 5489u;
+  if (random_seed) {
+    std::random_device rd;
+    seed = rd();
+  }
+  return CreateWithSeed(packet_loss_rate, average_burst_length, seed);
+}
+
+std::unique_ptr<GilbertModel> GilbertModel::CreateWithSeed(
+    float packet_loss_rate, float average_burst_length, unsigned int seed) {
   if (average_burst_length < 1.f) {
     LOG(ERROR) << "Average Burst Length has to be at least 1, but was "
                << average_burst_length << ".";
@@ -44,12 +54,6 @@ std::unique_ptr<GilbertModel> GilbertModel::Create(float packet_loss_rate,
     return nullptr;
   }
 
-  unsigned int seed = 5489u;
-  if (random_seed) {
-    std::random_device rd;
-    seed = rd();
-  }
-
   return absl::WrapUnique(new GilbertModel(
       packet_loss_rate / (average_burst_length * (1.f - packet_loss_rate)),
       1.f / average_burst_length, seed));
@@ -30,6 +30,11 @@ class GilbertModel {
                                               float average_burst_length,
                                               bool random_seed = true);
 
+  // Same as |Create|, but draws the losses from |seed|, so that runs with the
+  // same seed lose the same packets.
+  static std::unique_ptr<GilbertModel> CreateWithSeed(
+      float packet_loss_rate, float average_burst_length, unsigned int seed);
+
   // Update the internal state according to the corresponding probabilities.
   // Returns true if the packet was received.
   // Returns false if the packet was lost.
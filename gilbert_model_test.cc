@@ -36,6 +36,16 @@ TEST(GilbertModelTest, TooLargePacketLossRate) {
   ASSERT_EQ(nullptr, GilbertModel::Create(0.7, 2));
 }
 
+TEST(GilbertModelTest, SameSeedLosesSamePackets) {
+  auto first = GilbertModel::CreateWithSeed(0.2f, 2.f, 7u);
+  auto second = GilbertModel::CreateWithSeed(0.2f, 2.f, 7u);
+  ASSERT_NE(nullptr, first);
+  ASSERT_NE(nullptr, second);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_EQ(first->IsPacketReceived(), second->IsPacketReceived()) << i;
+  }
+}
+
 TEST(GilbertModelTest, DistributionFollowsParams) {
   // The tolerances have been determined empirically, since the model doesn't
   // make it easy to draw theoretical tolerances.
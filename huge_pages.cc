@@ -0,0 +1,148 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "huge_pages.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif  // defined(__linux__)
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+#if defined(__linux__)
+constexpr uintptr_t kHugePageBytes = uintptr_t{2} << 20;
+#endif  // defined(__linux__)
+
+#if defined(__linux__) && !defined(MADV_COLLAPSE)
+// Linux 6.1 and later, but not in the headers of every toolchain yet.
+constexpr int MADV_COLLAPSE = 25;
+#endif  // defined(__linux__) && !defined(MADV_COLLAPSE)
+
+}  // namespace
+
+std::vector<MemoryRange> AnonymousMemoryRanges() {
+  std::vector<MemoryRange> ranges;
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  while (std::getline(maps, line)) {
+    // "start-end perms offset dev inode [path]", where anonymous mappings
+    // have no path but the heap is named "[heap]".
+    const std::vector<absl::string_view> fields =
+        absl::StrSplit(line, ' ', absl::SkipEmpty());
+    if (fields.size() < 5 || (fields.size() > 5 && fields[5] != "[heap]") ||
+        fields[4] != "0") {
+      continue;
+    }
+    const std::vector<absl::string_view> bounds =
+        absl::StrSplit(fields[0], '-');
+    uint64_t start;
+    uint64_t end;
+    if (bounds.size() != 2 || !absl::SimpleHexAtoi(bounds[0], &start) ||
+        !absl::SimpleHexAtoi(bounds[1], &end)) {
+      continue;
+    }
+    ranges.push_back({static_cast<uintptr_t>(start),
+                      static_cast<uintptr_t>(end)});
+  }
+  return ranges;
+}
+
+std::vector<MemoryRange> SubtractMemoryRanges(
+    const std::vector<MemoryRange>& after,
+    const std::vector<MemoryRange>& before) {
+  std::vector<MemoryRange> difference;
+  auto removed = before.begin();
+  for (MemoryRange range : after) {
+    while (removed != before.end() && removed->end <= range.start) {
+      ++removed;
+    }
+    for (auto it = removed; it != before.end() && it->start < range.end;
+         ++it) {
+      if (it->start > range.start) {
+        difference.push_back({range.start, it->start});
+      }
+      range.start = std::max(range.start, it->end);
+    }
+    if (range.start < range.end) {
+      difference.push_back(range);
+    }
+  }
+  return difference;
+}
+
+int64_t AdviseHugePages(const std::vector<MemoryRange>& ranges) {
+  int64_t num_bytes = 0;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  for (const MemoryRange& range : ranges) {
+    const uintptr_t start =
+        (range.start + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+    const uintptr_t end = range.end / kHugePageBytes * kHugePageBytes;
+    if (start >= end) {
+      continue;
+    }
+    void* const address = reinterpret_cast<void*>(start);
+    if (madvise(address, end - start, MADV_HUGEPAGE) != 0) {
+      continue;
+    }
+    // Fails on kernels before 6.1, where khugepaged collapses the pages
+    // in the background instead.
+    madvise(address, end - start, MADV_COLLAPSE);
+    num_bytes += end - start;
+  }
+#endif  // defined(__linux__) && defined(MADV_HUGEPAGE)
+  return num_bytes;
+}
+
+int64_t AdviseHugePagesForAllocations(const std::function<void()>& allocate) {
+  const std::vector<MemoryRange> before = AnonymousMemoryRanges();
+  allocate();
+  return AdviseHugePages(
+      SubtractMemoryRanges(AnonymousMemoryRanges(), before));
+}
+
+int64_t AnonymousHugePageBytes() {
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string line;
+  while (std::getline(smaps, line)) {
+    absl::string_view rest = line;
+    int64_t kilobytes;
+    if (absl::ConsumePrefix(&rest, "AnonHugePages:") &&
+        absl::SimpleAtoi(
+            absl::StripSuffix(absl::StripAsciiWhitespace(rest), "kB"),
+            &kilobytes)) {
+      return kilobytes * 1024;
+    }
+  }
+  return 0;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_HUGE_PAGES_H_
+#define LYRA_CODEC_HUGE_PAGES_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace chromemedia {
+namespace codec {
+
+// A range [|start|, |end|) of addresses.
+struct MemoryRange {
+  uintptr_t start;
+  uintptr_t end;
+};
+
+// Returns the anonymous mappings of this process, including the heap, from
+// the lowest address up. Returns an empty vector where /proc/self/maps cannot
+// be read.
+std::vector<MemoryRange> AnonymousMemoryRanges();
+
+// Returns the ranges of |after| that are not in |before|, e.g. to find the
+// memory mapped between two calls of |AnonymousMemoryRanges|. Both have to be
+// sorted and free of overlaps.
+std::vector<MemoryRange> SubtractMemoryRanges(
+    const std::vector<MemoryRange>& after,
+    const std::vector<MemoryRange>& before);
+
+// Asks the kernel to back the 2MB aligned parts of |ranges| with transparent
+// huge pages, and to collapse the pages that are already resident into huge
+// pages right away where it supports that. Returns the number of bytes
+// advised, which is 0 where huge pages are not supported or disabled.
+int64_t AdviseHugePages(const std::vector<MemoryRange>& ranges);
+
+// Runs |allocate| and advises the anonymous memory that was mapped while it
+// ran with |AdviseHugePages|. That is where large allocations, like weight
+// matrices, end up, even if they are made by code that cannot be told to use
+// huge pages. Allocations made concurrently by other threads are advised
+// too. Returns the number of bytes advised.
+int64_t AdviseHugePagesForAllocations(const std::function<void()>& allocate);
+
+// Returns the bytes of anonymous memory of this process backed by huge pages,
+// or 0 where that cannot be read.
+int64_t AnonymousHugePageBytes();
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_HUGE_PAGES_H_
@@ -0,0 +1,82 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "huge_pages.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::ElementsAre;
+using testing::FieldsAre;
+using testing::IsEmpty;
+
+TEST(HugePagesTest, SubtractsOverlappingRanges) {
+  const std::vector<MemoryRange> after = {{0, 100}, {200, 300}, {400, 500}};
+  const std::vector<MemoryRange> before = {{10, 20}, {50, 250}, {400, 500}};
+  EXPECT_THAT(SubtractMemoryRanges(after, before),
+              ElementsAre(FieldsAre(0, 10), FieldsAre(20, 50),
+                          FieldsAre(250, 300)));
+}
+
+TEST(HugePagesTest, SubtractingNothingKeepsEverything) {
+  const std::vector<MemoryRange> after = {{0, 100}, {200, 300}};
+  EXPECT_THAT(SubtractMemoryRanges(after, {}),
+              ElementsAre(FieldsAre(0, 100), FieldsAre(200, 300)));
+  EXPECT_THAT(SubtractMemoryRanges({}, after), IsEmpty());
+}
+
+#if defined(__linux__)
+TEST(HugePagesTest, FindsLargeAllocations) {
+  constexpr int64_t kNumBytes = int64_t{16} << 20;
+  std::unique_ptr<char[]> buffer;
+  const std::vector<MemoryRange> before = AnonymousMemoryRanges();
+  ASSERT_FALSE(before.empty());
+  buffer.reset(new char[kNumBytes]);
+  buffer[0] = 1;
+  const std::vector<MemoryRange> added =
+      SubtractMemoryRanges(AnonymousMemoryRanges(), before);
+  const uintptr_t address = reinterpret_cast<uintptr_t>(buffer.get());
+  bool covered = false;
+  for (const MemoryRange& range : added) {
+    covered |= range.start <= address && address + kNumBytes <= range.end;
+  }
+  EXPECT_TRUE(covered);
+}
+
+TEST(HugePagesTest, AdvisesAllocationsWithoutChangingThem) {
+  constexpr int64_t kNumBytes = int64_t{16} << 20;
+  std::unique_ptr<char[]> buffer;
+  const int64_t num_advised = AdviseHugePagesForAllocations([&]() {
+    buffer.reset(new char[kNumBytes]);
+    for (int64_t i = 0; i < kNumBytes; i += 4096) buffer[i] = 1;
+  });
+  // Nothing is advised where transparent huge pages are disabled.
+  EXPECT_GE(num_advised, 0);
+  EXPECT_LE(num_advised, kNumBytes);
+  for (int64_t i = 0; i < kNumBytes; i += 4096) ASSERT_EQ(buffer[i], 1);
+  EXPECT_GE(AnonymousHugePageBytes(), 0);
+}
+#endif  // defined(__linux__)
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,288 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "int8_block_sparse_matrix.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined __aarch64__ && defined __ARM_FEATURE_DOTPROD
+#include <arm_neon.h>
+#elif defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#endif  // defined __aarch64__ && defined __ARM_FEATURE_DOTPROD
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "cpu_features.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kBlockSize = Int8BlockSparseMatrix::kBlockSize;
+constexpr int kBlockWeights = kBlockSize * kBlockSize;
+
+// Signature of a kernel that accumulates the products of |num_blocks| blocks
+// of a block row, whose weights start at |weights| and whose columns are
+// |block_cols|, with |input| into the |kBlockSize| |sums| of the block row.
+// The sums may be offset by the row sums of the weights times a constant,
+// which the caller corrects.
+using BlockRowKernel = void (*)(const int* block_cols, int num_blocks,
+                                const int8_t* weights, const int8_t* input,
+                                int32_t* sums);
+
+struct Kernel {
+  BlockRowKernel block_row;
+  // |sums| are off by this times the row sums of the weights.
+  int input_offset;
+};
+
+void BlockRowGeneric(const int* block_cols, int num_blocks,
+                     const int8_t* weights, const int8_t* input,
+                     int32_t* sums) {
+  std::fill(sums, sums + kBlockSize, 0);
+  for (int b = 0; b < num_blocks; ++b) {
+    const int8_t* block = weights + b * kBlockWeights;
+    const int8_t* x = input + block_cols[b];
+    for (int i = 0; i < kBlockSize; ++i) {
+      for (int j = 0; j < kBlockSize; ++j) {
+        sums[i] += static_cast<int32_t>(block[i * kBlockSize + j]) * x[j];
+      }
+    }
+  }
+}
+
+#if defined __aarch64__ && defined __ARM_FEATURE_DOTPROD
+
+// Each lane of sdot is the dot product of the 4 weights of a row of the block
+// with the 4 inputs of its columns.
+void BlockRowNeonDot(const int* block_cols, int num_blocks,
+                     const int8_t* weights, const int8_t* input,
+                     int32_t* sums) {
+  int32x4_t sum = vdupq_n_s32(0);
+  for (int b = 0; b < num_blocks; ++b) {
+    int32_t x;
+    std::memcpy(&x, input + block_cols[b], sizeof(x));
+    sum = vdotq_s32(sum, vld1q_s8(weights + b * kBlockWeights),
+                    vreinterpretq_s8_s32(vdupq_n_s32(x)));
+  }
+  vst1q_s32(sums, sum);
+}
+
+Kernel DotProductKernel() { return {&BlockRowNeonDot, 0}; }
+
+#elif (defined __x86_64__ || defined __i386__) && defined __GNUC__ && \
+    !defined __clang__ && __GNUC__ >= 11
+
+// vpdpbusd multiplies unsigned by signed bytes, so the inputs are offset by
+// 128 by flipping their sign bits. Each 32 bit lane is the dot product of the
+// 4 weights of a row of a block with the 4 inputs of its columns, and two
+// blocks are processed per 256 bit register.
+#define LYRA_DEFINE_VNNI_BLOCK_ROW_KERNEL(name, isa, dpbusd256, dpbusd128)    \
+  __attribute__((target(isa))) void name(                                    \
+      const int* block_cols, int num_blocks, const int8_t* weights,          \
+      const int8_t* input, int32_t* sums) {                                  \
+    const __m256i sign_bits = _mm256_set1_epi8(-128);                        \
+    __m256i sum = _mm256_setzero_si256();                                    \
+    int b = 0;                                                               \
+    for (; b + 2 <= num_blocks; b += 2) {                                    \
+      int32_t x0, x1;                                                        \
+      std::memcpy(&x0, input + block_cols[b], sizeof(x0));                   \
+      std::memcpy(&x1, input + block_cols[b + 1], sizeof(x1));               \
+      const __m256i x = _mm256_xor_si256(                                    \
+          _mm256_set_epi32(x1, x1, x1, x1, x0, x0, x0, x0), sign_bits);      \
+      sum = dpbusd256(sum, x,                                                \
+                      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(   \
+                          weights + b * kBlockWeights)));                    \
+    }                                                                        \
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum),              \
+                                   _mm256_extracti128_si256(sum, 1));        \
+    if (b < num_blocks) {                                                    \
+      int32_t x0;                                                            \
+      std::memcpy(&x0, input + block_cols[b], sizeof(x0));                   \
+      const __m128i x = _mm_xor_si128(_mm_set1_epi32(x0),                    \
+                                      _mm256_castsi256_si128(sign_bits));    \
+      sum128 = dpbusd128(sum128, x,                                          \
+                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(   \
+                             weights + b * kBlockWeights)));                 \
+    }                                                                        \
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum128);              \
+  }
+
+LYRA_DEFINE_VNNI_BLOCK_ROW_KERNEL(BlockRowAvxVnni, "avx2,avxvnni",
+                                  _mm256_dpbusd_avx_epi32,
+                                  _mm_dpbusd_avx_epi32)
+LYRA_DEFINE_VNNI_BLOCK_ROW_KERNEL(BlockRowAvx512Vnni,
+                                  "avx2,avx512vnni,avx512vl",
+                                  _mm256_dpbusd_epi32, _mm_dpbusd_epi32)
+
+#undef LYRA_DEFINE_VNNI_BLOCK_ROW_KERNEL
+
+Kernel DotProductKernel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avxvnni")) {
+    return {&BlockRowAvxVnni, 128};
+  }
+  return {&BlockRowAvx512Vnni, 128};
+}
+
+#else
+
+// Without a kernel |HasInt8DotProduct| is false when the compiler cannot
+// target the instructions, except for ARM compiled without them.
+Kernel DotProductKernel() { return {nullptr, 0}; }
+
+#endif  // defined __aarch64__ && defined __ARM_FEATURE_DOTPROD
+
+bool HasDotProductKernel() {
+  return HasInt8DotProduct() && DotProductKernel().block_row != nullptr;
+}
+
+}  // namespace
+
+void QuantizeToInt8(absl::Span<const float> input, Int8Vector* output) {
+  float max_magnitude = 0.0f;
+  for (const float value : input) {
+    max_magnitude = std::max(max_magnitude, std::abs(value));
+  }
+  output->scale = max_magnitude / 127.0f;
+  const float inverse_scale =
+      max_magnitude > 0.0f ? 127.0f / max_magnitude : 0.0f;
+  output->values.resize(input.size());
+  for (int i = 0; i < input.size(); ++i) {
+    output->values[i] = static_cast<int8_t>(std::lround(
+        std::min(127.0f, std::max(-127.0f, input[i] * inverse_scale))));
+  }
+}
+
+std::unique_ptr<Int8BlockSparseMatrix> Int8BlockSparseMatrix::Create(
+    absl::Span<const float> weights, absl::Span<const float> bias, int rows,
+    int cols) {
+  if (rows <= 0 || cols <= 0 || rows % kBlockSize != 0 ||
+      cols % kBlockSize != 0) {
+    LOG(ERROR) << "The dimensions [" << rows << ", " << cols
+               << "] are not positive multiples of " << kBlockSize << ".";
+    return nullptr;
+  }
+  if (weights.size() != static_cast<size_t>(rows) * cols ||
+      bias.size() != rows) {
+    LOG(ERROR) << "Expected " << rows * cols << " weights and " << rows
+               << " biases but got " << weights.size() << " and "
+               << bias.size() << ".";
+    return nullptr;
+  }
+  // WrapUnique is used because of private c'tor.
+  auto matrix = absl::WrapUnique(new Int8BlockSparseMatrix(rows, cols));
+  matrix->bias_.assign(bias.begin(), bias.end());
+  for (int row = 0; row < rows; ++row) {
+    float max_magnitude = 0.0f;
+    for (int col = 0; col < cols; ++col) {
+      max_magnitude =
+          std::max(max_magnitude, std::abs(weights[row * cols + col]));
+    }
+    matrix->scales_[row] = max_magnitude / 127.0f;
+  }
+
+  for (int block_row = 0; block_row < rows / kBlockSize; ++block_row) {
+    for (int block_col = 0; block_col < cols / kBlockSize; ++block_col) {
+      const float* block = weights.data() + block_row * kBlockSize * cols +
+                           block_col * kBlockSize;
+      bool is_zero = true;
+      for (int i = 0; i < kBlockSize && is_zero; ++i) {
+        for (int j = 0; j < kBlockSize; ++j) {
+          is_zero = is_zero && block[i * cols + j] == 0.0f;
+        }
+      }
+      if (is_zero) {
+        continue;
+      }
+      matrix->block_cols_.push_back(block_col * kBlockSize);
+      for (int i = 0; i < kBlockSize; ++i) {
+        const int row = block_row * kBlockSize + i;
+        const float scale = matrix->scales_[row];
+        for (int j = 0; j < kBlockSize; ++j) {
+          const int8_t weight =
+              scale > 0.0f ? static_cast<int8_t>(
+                                 std::lround(block[i * cols + j] / scale))
+                           : 0;
+          matrix->weights_.push_back(weight);
+          matrix->row_sums_[row] += weight;
+        }
+      }
+    }
+    matrix->block_row_starts_[block_row + 1] = matrix->block_cols_.size();
+  }
+  return matrix;
+}
+
+Int8BlockSparseMatrix::Int8BlockSparseMatrix(int rows, int cols)
+    : rows_(rows),
+      cols_(cols),
+      block_row_starts_(rows / kBlockSize + 1, 0),
+      scales_(rows, 0.0f),
+      row_sums_(rows, 0),
+      use_dot_product_(HasDotProductKernel()) {}
+
+void Int8BlockSparseMatrix::MatVec(const Int8Vector& input, int start_row,
+                                   int end_row, float* output) const {
+  CHECK_EQ(input.values.size(), cols_);
+  CHECK_EQ(start_row % kBlockSize, 0);
+  CHECK_EQ(end_row % kBlockSize, 0);
+  CHECK_LE(0, start_row);
+  CHECK_LE(end_row, rows_);
+  const Kernel kernel =
+      use_dot_product_ ? DotProductKernel() : Kernel{&BlockRowGeneric, 0};
+  int32_t sums[kBlockSize];
+  for (int block_row = start_row / kBlockSize;
+       block_row < end_row / kBlockSize; ++block_row) {
+    const int start_block = block_row_starts_[block_row];
+    kernel.block_row(block_cols_.data() + start_block,
+                     block_row_starts_[block_row + 1] - start_block,
+                     weights_.data() + start_block * kBlockWeights,
+                     input.values.data(), sums);
+    for (int i = 0; i < kBlockSize; ++i) {
+      const int row = block_row * kBlockSize + i;
+      const int32_t sum = sums[i] - kernel.input_offset * row_sums_[row];
+      output[row] = bias_[row] + scales_[row] * input.scale * sum;
+    }
+  }
+}
+
+void Int8BlockSparseMatrix::set_use_dot_product(bool use_dot_product) {
+  CHECK(!use_dot_product || HasDotProductKernel())
+      << "The CPU has no 8 bit dot product instructions.";
+  use_dot_product_ = use_dot_product;
+}
+
+float Int8BlockSparseMatrix::density() const {
+  return static_cast<float>(block_cols_.size()) /
+         ((rows_ / kBlockSize) * (cols_ / kBlockSize));
+}
+
+std::size_t Int8BlockSparseMatrix::bytes() const {
+  return weights_.size() * sizeof(int8_t) + scales_.size() * sizeof(float) +
+         row_sums_.size() * sizeof(int32_t) + bias_.size() * sizeof(float) +
+         block_cols_.size() * sizeof(int) +
+         block_row_starts_.size() * sizeof(int);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_INT8_BLOCK_SPARSE_MATRIX_H_
+#define LYRA_CODEC_INT8_BLOCK_SPARSE_MATRIX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A vector quantized to int8 with a single scale: value i is approximately
+// |scale| * |values[i]|.
+struct Int8Vector {
+  std::vector<int8_t> values;
+  float scale = 0.0f;
+};
+
+// Quantizes |input| into |output|, scaling the largest magnitude to 127.
+// Reuses the memory of |output|.
+void QuantizeToInt8(absl::Span<const float> input, Int8Vector* output);
+
+// A block sparse matrix with a bias, whose weights are stored as int8 with one
+// scale per row, which takes half the memory of fixed16 weights. Only the
+// |kBlockSize| x |kBlockSize| blocks with a non-zero weight are stored. The
+// products are accumulated exactly in int32 against an |Int8Vector|, with the
+// 8 bit dot product instructions of the running CPU if it has them, see
+// |HasInt8DotProduct|, and in plain C++ otherwise, which gives the same
+// result.
+class Int8BlockSparseMatrix {
+ public:
+  static constexpr int kBlockSize = 4;
+
+  // Quantizes the row major |rows| x |cols| |weights|, with |bias| of |rows|
+  // values. Returns a nullptr if the sizes do not match or the dimensions are
+  // not multiples of |kBlockSize|.
+  static std::unique_ptr<Int8BlockSparseMatrix> Create(
+      absl::Span<const float> weights, absl::Span<const float> bias, int rows,
+      int cols);
+
+  // Computes rows [|start_row|, |end_row|) of the product with |input| plus
+  // the bias into |output|, which holds all rows. Both rows have to be
+  // multiples of |kBlockSize|, so that threads can split the rows between
+  // them. |input| must have |cols| values.
+  void MatVec(const Int8Vector& input, int start_row, int end_row,
+              float* output) const;
+
+  // Whether |MatVec| uses the dot product instructions. They can only be
+  // enabled if the running CPU has them.
+  bool use_dot_product() const { return use_dot_product_; }
+  void set_use_dot_product(bool use_dot_product);
+
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+
+  // The number of stored blocks over the number of blocks of a dense matrix.
+  float density() const;
+
+  // The memory taken by the weights, scales, bias and indices.
+  std::size_t bytes() const;
+
+ private:
+  Int8BlockSparseMatrix(int rows, int cols);
+
+  const int rows_;
+  const int cols_;
+  // The blocks of block row |r| are [|block_row_starts_[r]|,
+  // |block_row_starts_[r + 1]|). Block |b| starts at column
+  // |block_cols_[b]| and holds the |kBlockSize|^2 weights from
+  // |weights_[b * kBlockSize^2]| on, row major.
+  std::vector<int> block_row_starts_;
+  std::vector<int> block_cols_;
+  std::vector<int8_t> weights_;
+  std::vector<float> scales_;
+  // The sum of the int8 weights of each row, with which the dot product
+  // kernels correct for the unsigned inputs they take.
+  std::vector<int32_t> row_sums_;
+  std::vector<float> bias_;
+  bool use_dot_product_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_INT8_BLOCK_SPARSE_MATRIX_H_
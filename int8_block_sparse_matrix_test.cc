@@ -0,0 +1,177 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "int8_block_sparse_matrix.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "cpu_features.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kRows = 64;
+constexpr int kCols = 48;
+
+// Returns row major |rows| x |cols| weights in which about |density| of the
+// 4x4 blocks are non-zero.
+std::vector<float> RandomBlockSparseWeights(int rows, int cols, float density,
+                                            std::mt19937* gen) {
+  std::uniform_real_distribution<float> weight(-1.0f, 1.0f);
+  std::bernoulli_distribution keep(density);
+  std::vector<float> weights(rows * cols, 0.0f);
+  for (int r = 0; r < rows; r += 4) {
+    for (int c = 0; c < cols; c += 4) {
+      if (!keep(*gen)) {
+        continue;
+      }
+      for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+          weights[(r + i) * cols + c + j] = weight(*gen);
+        }
+      }
+    }
+  }
+  return weights;
+}
+
+std::vector<float> RandomVector(int size, std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+  std::vector<float> vector(size);
+  for (float& v : vector) {
+    v = value(*gen);
+  }
+  return vector;
+}
+
+class Int8BlockSparseMatrixTest : public testing::Test {
+ protected:
+  Int8BlockSparseMatrixTest()
+      : gen_(17),
+        weights_(RandomBlockSparseWeights(kRows, kCols, 0.3f, &gen_)),
+        bias_(RandomVector(kRows, &gen_)),
+        input_(RandomVector(kCols, &gen_)) {
+    QuantizeToInt8(input_, &quantized_input_);
+  }
+
+  std::mt19937 gen_;
+  std::vector<float> weights_;
+  std::vector<float> bias_;
+  std::vector<float> input_;
+  Int8Vector quantized_input_;
+};
+
+TEST_F(Int8BlockSparseMatrixTest, CreateFailsOnBadSizes) {
+  EXPECT_EQ(Int8BlockSparseMatrix::Create(weights_, bias_, kRows + 1, kCols),
+            nullptr);
+  EXPECT_EQ(Int8BlockSparseMatrix::Create(weights_, bias_, kRows / 2,
+                                          kCols * 2),
+            nullptr);
+  EXPECT_EQ(Int8BlockSparseMatrix::Create(
+                absl::MakeConstSpan(weights_).subspan(kCols), bias_, kRows,
+                kCols),
+            nullptr);
+  EXPECT_EQ(Int8BlockSparseMatrix::Create({}, {}, 0, 0), nullptr);
+}
+
+TEST_F(Int8BlockSparseMatrixTest, QuantizeToInt8) {
+  const std::vector<float> input = {0.5f, -1.0f, 0.25f, 0.0f};
+  Int8Vector quantized;
+  QuantizeToInt8(input, &quantized);
+  EXPECT_FLOAT_EQ(quantized.scale, 1.0f / 127.0f);
+  EXPECT_EQ(quantized.values, (std::vector<int8_t>{64, -127, 32, 0}));
+
+  QuantizeToInt8(std::vector<float>(3, 0.0f), &quantized);
+  EXPECT_EQ(quantized.scale, 0.0f);
+  EXPECT_EQ(quantized.values, std::vector<int8_t>(3, 0));
+}
+
+TEST_F(Int8BlockSparseMatrixTest, CloseToFloatProduct) {
+  auto matrix = Int8BlockSparseMatrix::Create(weights_, bias_, kRows, kCols);
+  ASSERT_NE(matrix, nullptr);
+  EXPECT_NEAR(matrix->density(), 0.3f, 0.1f);
+
+  std::vector<float> output(kRows);
+  matrix->MatVec(quantized_input_, 0, kRows, output.data());
+  for (int r = 0; r < kRows; ++r) {
+    float expected = bias_[r];
+    for (int c = 0; c < kCols; ++c) {
+      expected += weights_[r * kCols + c] * input_[c];
+    }
+    // Each of the products is off by about 1% of the largest magnitudes.
+    EXPECT_NEAR(output[r], expected, 0.1f) << "row " << r;
+  }
+}
+
+TEST_F(Int8BlockSparseMatrixTest, DotProductMatchesGeneric) {
+  auto matrix = Int8BlockSparseMatrix::Create(weights_, bias_, kRows, kCols);
+  ASSERT_NE(matrix, nullptr);
+  if (!matrix->use_dot_product()) {
+    GTEST_SKIP() << "The CPU has no 8 bit dot product instructions.";
+  }
+  std::vector<float> dot_product_output(kRows);
+  matrix->MatVec(quantized_input_, 0, kRows, dot_product_output.data());
+  matrix->set_use_dot_product(false);
+  std::vector<float> generic_output(kRows);
+  matrix->MatVec(quantized_input_, 0, kRows, generic_output.data());
+  // The products are accumulated exactly in both cases.
+  EXPECT_EQ(dot_product_output, generic_output);
+}
+
+TEST_F(Int8BlockSparseMatrixTest, RowRangesMatchFullProduct) {
+  auto matrix = Int8BlockSparseMatrix::Create(weights_, bias_, kRows, kCols);
+  ASSERT_NE(matrix, nullptr);
+  std::vector<float> full_output(kRows);
+  matrix->MatVec(quantized_input_, 0, kRows, full_output.data());
+
+  std::vector<float> split_output(kRows, 0.0f);
+  const std::vector<int> starts = {0, 12, 40, kRows};
+  for (int i = 0; i + 1 < starts.size(); ++i) {
+    matrix->MatVec(quantized_input_, starts[i], starts[i + 1],
+                   split_output.data());
+  }
+  EXPECT_EQ(split_output, full_output);
+}
+
+TEST_F(Int8BlockSparseMatrixTest, TakesAboutHalfTheMemoryOfFixed16) {
+  constexpr int kSize = 256;
+  const std::vector<float> dense_weights =
+      RandomBlockSparseWeights(kSize, kSize, 1.0f, &gen_);
+  auto matrix = Int8BlockSparseMatrix::Create(
+      dense_weights, RandomVector(kSize, &gen_), kSize, kSize);
+  ASSERT_NE(matrix, nullptr);
+  EXPECT_EQ(matrix->density(), 1.0f);
+  // The fixed16 weights and one column index per block.
+  const size_t fixed16_bytes =
+      kSize * kSize * sizeof(int16_t) + (kSize / 4) * (kSize / 4) * sizeof(int);
+  EXPECT_LT(matrix->bytes(), 0.6 * fixed16_bytes);
+}
+
+TEST_F(Int8BlockSparseMatrixTest, DotProductFollowsCpuFeatures) {
+  auto matrix = Int8BlockSparseMatrix::Create(weights_, bias_, kRows, kCols);
+  ASSERT_NE(matrix, nullptr);
+  if (!HasInt8DotProduct()) {
+    EXPECT_FALSE(matrix->use_dot_product());
+  }
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,86 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "latency_benchmark_lib.h"
+
+ABSL_FLAG(int, sample_rate_hz, 16000,
+          "Sample rate of the encoder and the decoder.");
+
+ABSL_FLAG(int, num_packets, 250,
+          "The number of packets encoded and decoded to time them.");
+
+ABSL_FLAG(std::string, packets_per_payload, "1,2,3,5",
+          "Comma-separated numbers of packets per payload to compare.");
+
+ABSL_FLAG(int, network_ms, 0, "One way delay of the network.");
+
+ABSL_FLAG(std::string, precision, "",
+          "Arithmetic of the decoder, one of 'float', 'fixed16' or "
+          "'bfloat16'. Defaults to the precision the binary was built for.");
+
+ABSL_FLAG(std::string, json_path, "",
+          "If set, the results are written to this path as JSON.");
+
+ABSL_FLAG(
+    std::string, model_path, "wavegru",
+    "Path to directory containing model weights and quant files. For mobile "
+    "this is the absolute path, like '/sdcard/wavegru/'. For desktop this is "
+    "the path relative to the binary.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  chromemedia::codec::LatencyBenchmarkOptions options;
+  options.packets_per_payload.clear();
+  for (const absl::string_view number :
+       absl::StrSplit(absl::GetFlag(FLAGS_packets_per_payload), ',')) {
+    int num_packets_per_payload;
+    if (!absl::SimpleAtoi(number, &num_packets_per_payload)) {
+      LOG(ERROR) << "Invalid number of packets per payload '" << number
+                 << "'.";
+      return -1;
+    }
+    options.packets_per_payload.push_back(num_packets_per_payload);
+  }
+
+  const std::string precision_name = absl::GetFlag(FLAGS_precision);
+  if (!precision_name.empty()) {
+    const auto precision_or =
+        chromemedia::codec::ComputePrecisionFromName(precision_name);
+    if (!precision_or.has_value()) {
+      LOG(ERROR) << "Unknown precision '" << precision_name << "'.";
+      return -1;
+    }
+    options.precision = precision_or.value();
+  }
+
+  options.model_base_path = absl::GetFlag(FLAGS_model_path);
+  options.sample_rate_hz = absl::GetFlag(FLAGS_sample_rate_hz);
+  options.num_packets = absl::GetFlag(FLAGS_num_packets);
+  options.network_microsecs = int64_t{1000} * absl::GetFlag(FLAGS_network_ms);
+
+  return chromemedia::codec::benchmark_latency(options,
+                                               absl::GetFlag(FLAGS_json_path));
+}
@@ -0,0 +1,181 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "latency_benchmark_lib.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "architecture_utils.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_encoder.h"
+#include "lyra_model.h"
+
+namespace chromemedia {
+namespace codec {
+
+MouthToEarLatency EstimateMouthToEarLatency(int num_packets_per_payload,
+                                            int64_t encode_microsecs,
+                                            int64_t decode_microsecs,
+                                            int64_t network_microsecs) {
+  MouthToEarLatency latency;
+  latency.num_packets_per_payload = num_packets_per_payload;
+  latency.packetization_microsecs = int64_t{1000000} *
+                                    num_packets_per_payload *
+                                    kNumFramesPerPacket / kFrameRate;
+  latency.encode_microsecs = encode_microsecs;
+  latency.network_microsecs = network_microsecs;
+  latency.decode_microsecs = decode_microsecs;
+  return latency;
+}
+
+std::string FormatLatencyJson(
+    const LatencyBenchmarkOptions& options, const HostInfo& host,
+    const TimingStats& encode, const TimingStats& decode,
+    const std::vector<MouthToEarLatency>& latencies) {
+  std::string json = absl::StrFormat(
+      "{\n"
+      "  \"host\": %s,\n"
+      "  \"config\": {\"sample_rate_hz\": %d, \"num_packets\": %d, "
+      "\"compute_type\": \"%s\", \"network_us\": %d},\n"
+      "  \"encode\": %s,\n"
+      "  \"decode\": %s,\n"
+      "  \"latencies\": [",
+      FormatHostInfoJson(host), options.sample_rate_hz, options.num_packets,
+      ComputePrecisionName(options.precision), options.network_microsecs,
+      FormatTimingStatsJson(encode), FormatTimingStatsJson(decode));
+  for (int i = 0; i < static_cast<int>(latencies.size()); ++i) {
+    const MouthToEarLatency& latency = latencies[i];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"packets_per_payload\": %d, \"packetization_us\": %d, "
+        "\"encode_us\": %d, \"network_us\": %d, \"decode_us\": %d, "
+        "\"total_us\": %d}",
+        i == 0 ? "" : ",", latency.num_packets_per_payload,
+        latency.packetization_microsecs, latency.encode_microsecs,
+        latency.network_microsecs, latency.decode_microsecs,
+        latency.total_microsecs());
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+int benchmark_latency(const LatencyBenchmarkOptions& options,
+                      const std::string& json_path) {
+  const ghc::filesystem::path model_path =
+      GetCompleteArchitecturePath(options.model_base_path);
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(model_path);
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not create the model.";
+    return -1;
+  }
+  std::unique_ptr<LyraEncoder> encoder =
+      LyraEncoder::Create(options.sample_rate_hz, kNumChannels, kBitrate,
+                          /*enable_dtx=*/false, model);
+  std::unique_ptr<LyraDecoder> decoder =
+      LyraDecoder::Create(options.sample_rate_hz, kNumChannels, kBitrate,
+                          model, /*num_threads=*/1, options.precision);
+  if (encoder == nullptr || decoder == nullptr) {
+    LOG(ERROR) << "Could not create the encoder and the decoder.";
+    return -1;
+  }
+
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(options.sample_rate_hz);
+  std::mt19937 generator(0);
+  std::normal_distribution<float> noise(0.0f, 1000.0f);
+  std::vector<int16_t> audio(num_samples_per_packet);
+  std::vector<int16_t> decoded(num_samples_per_packet);
+  std::vector<int64_t> encode_timings;
+  std::vector<int64_t> decode_timings;
+  for (int i = 0; i < options.num_packets; ++i) {
+    for (int16_t& sample : audio) {
+      sample = static_cast<int16_t>(noise(generator));
+    }
+    absl::Time start = absl::Now();
+    const auto encoded = encoder->Encode(audio);
+    encode_timings.push_back(absl::ToInt64Microseconds(absl::Now() - start));
+    if (!encoded.has_value()) {
+      LOG(ERROR) << "Could not encode packet " << i << ".";
+      return -1;
+    }
+    start = absl::Now();
+    if (!decoder->SetEncodedPacket(encoded.value()) ||
+        !decoder->DecodeSamples(absl::MakeSpan(decoded))) {
+      LOG(ERROR) << "Could not decode packet " << i << ".";
+      return -1;
+    }
+    decode_timings.push_back(absl::ToInt64Microseconds(absl::Now() - start));
+  }
+  const int64_t audio_microsecs_per_packet =
+      int64_t{1000000} * kNumFramesPerPacket / kFrameRate;
+  const TimingStats encode =
+      GetTimingStats(encode_timings, audio_microsecs_per_packet);
+  const TimingStats decode =
+      GetTimingStats(decode_timings, audio_microsecs_per_packet);
+
+  std::vector<MouthToEarLatency> latencies;
+  for (const int num_packets_per_payload : options.packets_per_payload) {
+    if (num_packets_per_payload <= 0) {
+      LOG(ERROR) << "Payloads need a positive number of packets, but "
+                 << num_packets_per_payload << " were asked for.";
+      return -1;
+    }
+    latencies.push_back(EstimateMouthToEarLatency(
+        num_packets_per_payload, encode.p50_microsecs, decode.p50_microsecs,
+        options.network_microsecs));
+    const MouthToEarLatency& latency = latencies.back();
+    LOG(INFO) << num_packets_per_payload << " packets per payload: "
+              << latency.total_microsecs() / 1000.0 << "ms mouth-to-ear ("
+              << latency.packetization_microsecs / 1000.0
+              << "ms packetization, " << latency.encode_microsecs / 1000.0
+              << "ms encoding, " << latency.network_microsecs / 1000.0
+              << "ms network, " << latency.decode_microsecs / 1000.0
+              << "ms decoding), "
+              << (latency.total_microsecs() -
+                  latencies.front().total_microsecs()) /
+                     1000.0
+              << "ms more than " << latencies.front().num_packets_per_payload
+              << " packets per payload.";
+  }
+
+  if (json_path.empty()) {
+    return 0;
+  }
+  std::ofstream json(json_path);
+  json << FormatLatencyJson(options, GetHostInfo(), encode, decode,
+                            latencies);
+  if (!json) {
+    LOG(ERROR) << "Could not write " << json_path << ".";
+    return -1;
+  }
+  LOG(INFO) << "Wrote results to " << json_path << ".";
+  return 0;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
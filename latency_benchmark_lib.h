@@ -0,0 +1,90 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_LATENCY_BENCHMARK_LIB_H_
+#define LYRA_CODEC_LATENCY_BENCHMARK_LIB_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+
+namespace chromemedia {
+namespace codec {
+
+struct LatencyBenchmarkOptions {
+  std::string model_base_path;
+  int sample_rate_hz = 16000;
+  // Packets encoded and decoded to time one packet of each.
+  int num_packets = 250;
+  ComputePrecision precision = kDefaultComputePrecision;
+  // The payload sizes compared, in packets. A payload of 1 sends every packet
+  // as soon as it is encoded.
+  std::vector<int> packets_per_payload = {1, 2, 3, 5};
+  // One way delay of the network, which is the same for every payload size.
+  int64_t network_microsecs = 0;
+};
+
+// The stages from capturing the first sample of a payload to playing it.
+struct MouthToEarLatency {
+  int num_packets_per_payload;
+  // Capturing the samples of all packets of the payload. The packets but the
+  // last are encoded while the next one is captured.
+  int64_t packetization_microsecs;
+  // Encoding the last packet of the payload.
+  int64_t encode_microsecs;
+  int64_t network_microsecs;
+  // Decoding the first packet of the payload, whose first sample is played
+  // next.
+  int64_t decode_microsecs;
+
+  int64_t total_microsecs() const {
+    return packetization_microsecs + encode_microsecs + network_microsecs +
+           decode_microsecs;
+  }
+};
+
+// Returns the latency of payloads of |num_packets_per_payload| packets, each
+// of which takes |encode_microsecs| to encode and |decode_microsecs| to
+// decode.
+MouthToEarLatency EstimateMouthToEarLatency(int num_packets_per_payload,
+                                            int64_t encode_microsecs,
+                                            int64_t decode_microsecs,
+                                            int64_t network_microsecs);
+
+// Returns the results of a benchmark with |options| on |host| as a JSON
+// object, with the time to encode and decode one packet and the latency of
+// every payload size.
+std::string FormatLatencyJson(const LatencyBenchmarkOptions& options,
+                              const HostInfo& host, const TimingStats& encode,
+                              const TimingStats& decode,
+                              const std::vector<MouthToEarLatency>& latencies);
+
+// Times encoding and decoding |options.num_packets| packets of noise, and
+// logs the mouth-to-ear latency of every payload size in
+// |options.packets_per_payload| based on the median times. Unless
+// |json_path| is empty, writes the results there as JSON. Returns 0 on
+// success.
+int benchmark_latency(const LatencyBenchmarkOptions& options,
+                      const std::string& json_path);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LATENCY_BENCHMARK_LIB_H_
@@ -0,0 +1,74 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "latency_benchmark_lib.h"
+
+#include <string>
+#include <vector>
+
+#include "benchmark_decode_lib.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+TEST(EstimateMouthToEarLatencyTest, AddsUpStages) {
+  const MouthToEarLatency latency = EstimateMouthToEarLatency(
+      /*num_packets_per_payload=*/1, /*encode_microsecs=*/1500,
+      /*decode_microsecs=*/4000, /*network_microsecs=*/20000);
+
+  EXPECT_EQ(latency.packetization_microsecs, 40000);
+  EXPECT_EQ(latency.total_microsecs(), 40000 + 1500 + 20000 + 4000);
+}
+
+TEST(EstimateMouthToEarLatencyTest, EveryPacketPerPayloadAddsAPacket) {
+  const MouthToEarLatency single = EstimateMouthToEarLatency(1, 1500, 4000, 0);
+  const MouthToEarLatency triple = EstimateMouthToEarLatency(3, 1500, 4000, 0);
+
+  EXPECT_EQ(triple.packetization_microsecs, 120000);
+  EXPECT_EQ(triple.total_microsecs() - single.total_microsecs(), 80000);
+}
+
+TEST(FormatLatencyJsonTest, ContainsTimingsAndLatencies) {
+  LatencyBenchmarkOptions options;
+  options.num_packets = 10;
+  options.network_microsecs = 20000;
+  HostInfo host;
+  host.cpu_model = "test cpu";
+  host.cpu_isa = "generic";
+  host.num_cpus = 2;
+  const std::vector<MouthToEarLatency> latencies = {
+      EstimateMouthToEarLatency(1, 1500, 4000, 20000),
+      EstimateMouthToEarLatency(2, 1500, 4000, 20000)};
+
+  const std::string json =
+      FormatLatencyJson(options, host, GetTimingStats({1500}),
+                        GetTimingStats({4000}), latencies);
+
+  EXPECT_THAT(json, HasSubstr("\"num_packets\": 10"));
+  EXPECT_THAT(json, HasSubstr("{\"packets_per_payload\": 1, "
+                              "\"packetization_us\": 40000, "
+                              "\"encode_us\": 1500, \"network_us\": 20000, "
+                              "\"decode_us\": 4000, \"total_us\": 65500}"));
+  EXPECT_THAT(json, HasSubstr("\"packets_per_payload\": 2, "
+                              "\"packetization_us\": 80000"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -17,6 +17,8 @@
 #ifndef LYRA_CODEC_LAYER_WRAPPER_H_
 #define LYRA_CODEC_LAYER_WRAPPER_H_
 
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <string>
 #include <utility>
@@ -25,8 +27,13 @@
 
 #include "dsp_util.h"
 #include "glog/logging.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "layer_wrapper_interface.h"
+#include "lyra_model.h"
 #include "sparse_inference_matrixvector.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -70,32 +77,44 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
     }
   }
 
-  // Convenient method used in all subclass creation methods.
-  static std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  // Convenient method used in all subclass creation methods. If |model| is
+  // not null, layers loaded from disk are looked up in and added to it, so
+  // that all wrappers created through the same model share their weights.
+  static std::shared_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
   LoadAndCheckLayer(
       const std::variant<LayerParams::FromDisk, LayerParams::FromConstant> from,
       const std::string& prefix, const std::string& layer_prompt,
-      int expected_rows, int expected_cols, int num_threads) {
-    auto layer = absl::make_unique<
-        csrblocksparse::SparseLinearLayer<WeightType, RhsType>>();
-    if (std::holds_alternative<LayerParams::FromDisk>(from)) {
-      const auto from_disk = std::get<LayerParams::FromDisk>(from);
-      auto LoadLayer =
-          csrblocksparse::LoadSparseLayer<WeightType, RhsType, DiskWeightType>;
-      if (!LoadLayer(prefix, from_disk.zipped, layer.get(), from_disk.path)
-               .ok()) {
-        LOG(ERROR) << layer_prompt << " loading failed.";
-        return nullptr;
-      }
+      int expected_rows, int expected_cols, int num_threads,
+      LyraModel* model = nullptr) {
+    std::shared_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+        layer;
+    if (model != nullptr &&
+        std::holds_alternative<LayerParams::FromDisk>(from)) {
+      // The layout is chosen before the layer is shared, so it is timed once
+      // per model.
+      const bool autotune_block_height =
+          model->performance_profile().autotune_block_height;
+      const std::function<std::unique_ptr<
+          csrblocksparse::SparseLinearLayer<WeightType, RhsType>>()>
+          loader = [&]() {
+            auto loaded = LoadLayer(from, prefix, layer_prompt, expected_rows,
+                                    expected_cols, num_threads);
+            if (loaded != nullptr && autotune_block_height) {
+              AutotuneBlockHeight(layer_prompt, num_threads, &loaded);
+            }
+            return loaded;
+          };
+      layer = model->GetOrLoad(
+          absl::StrCat(std::get<LayerParams::FromDisk>(from).path, "/", prefix,
+                       ":", num_threads),
+          loader);
     } else {
-      const auto from_constant = std::get<LayerParams::FromConstant>(from);
-      *layer = csrblocksparse::CreateConstantLayer<WeightType, RhsType>(
-          expected_rows, expected_cols, from_constant.sparsity,
-          from_constant.value);
+      layer = LoadLayer(from, prefix, layer_prompt, expected_rows,
+                        expected_cols, num_threads);
+    }
+    if (layer == nullptr) {
+      return nullptr;
     }
-    LOG(INFO) << layer_prompt << " Shape: [" << layer->rows() << ", "
-              << layer->cols() << "]."
-              << " Sparsity: " << layer->sparsity();
 
     // Dimension checks for the loaded layer.
     if ((expected_rows > 0 && layer->rows() != expected_rows) ||
@@ -106,12 +125,6 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
                  << "].";
       return nullptr;
     }
-
-    if (layer->PrepareForThreads(num_threads) != num_threads) {
-      LOG(ERROR) << layer_prompt << "Could not prepare for " << num_threads
-                 << " threads.";
-      return nullptr;
-    }
     return layer;
   }
 
@@ -129,20 +142,141 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
     return layer_->PrepareForThreads(num_threads);
   }
 
+  // Returns the rows of the output that each of |num_threads| threads computes,
+  // as |num_threads| + 1 boundaries: thread |tid| computes the rows in
+  // [|starts[tid]|, |starts[tid + 1]|). They only depend on the sparsity
+  // pattern of the layer, so they are found by running the part of each
+  // thread alone on two outputs filled with different values: only the rows
+  // the thread writes end up equal. Returns an empty vector if the rows of a
+  // thread are not contiguous or the layer is split. The layer must have been
+  // prepared for |num_threads| threads.
+  std::vector<int> ThreadRowStarts(int num_threads) const {
+    if (layer_->IsSplit()) {
+      return {};
+    }
+    csrblocksparse::FatCacheAlignedVector<RhsType> input(input_buffer_rows_, 1);
+    input.FillZero();
+    csrblocksparse::FatCacheAlignedVector<OutputType> first(output_rows_, 1);
+    csrblocksparse::FatCacheAlignedVector<OutputType> second(output_rows_, 1);
+    std::vector<int> starts(num_threads + 1, 0);
+    for (int tid = 0; tid < num_threads; ++tid) {
+      first.FillZero();
+      std::fill_n(second.data(), second.size(), static_cast<OutputType>(0.5f));
+      for (auto* output : {&first, &second}) {
+        csrblocksparse::MutableVectorView<OutputType> output_view(output);
+        layer_->SpMM_bias(csrblocksparse::VectorView<RhsType>(input),
+                          &output_view, /*relu=*/false, tid);
+      }
+      int end = starts[tid];
+      while (end < output_rows_ && static_cast<float>(first[end]) ==
+                                       static_cast<float>(second[end])) {
+        ++end;
+      }
+      for (int row = 0; row < output_rows_; ++row) {
+        const bool written =
+            static_cast<float>(first[row]) == static_cast<float>(second[row]);
+        if (written != (row >= starts[tid] && row < end)) {
+          return {};
+        }
+      }
+      starts[tid + 1] = end;
+    }
+    if (starts[num_threads] != output_rows_) {
+      return {};
+    }
+    return starts;
+  }
+
+  // Sets |epilogue| to be called by every thread of Run() with the rows of the
+  // output it computed, [|row_start|, |row_end|), as soon as they are final
+  // and before the barrier that ends Run(). Row-wise work on the output, like
+  // what the next layer does to its input, then needs no barrier of its own.
+  // Returns false and leaves the layer without an epilogue if the rows of each
+  // of |num_threads| threads are not known or some thread's rows do not start
+  // at a multiple of |row_alignment|. Has to be set again after the layer is
+  // prepared for another number of threads.
+  bool SetRowEpilogue(
+      int num_threads, int row_alignment,
+      std::function<void(int row_start, int row_end)> epilogue) {
+    epilogue_row_starts_ = OutputRowStarts(num_threads);
+    if (epilogue_row_starts_.empty() ||
+        !std::all_of(epilogue_row_starts_.begin(),
+                     epilogue_row_starts_.end() - 1,
+                     [row_alignment](int start) {
+                       return start % row_alignment == 0;
+                     })) {
+      epilogue_row_starts_.clear();
+      row_epilogue_ = nullptr;
+      return false;
+    }
+    row_epilogue_ = std::move(epilogue);
+    return true;
+  }
+
+  // Whether Run() does row-wise work on its input before the matrix
+  // multiplication, which |PrepareInputRows| can do in its place.
+  virtual bool PreparesInput() const { return false; }
+
+  // Does the work of Run() before the matrix multiplication on the rows in
+  // [|row_start|, |row_end|) of |InputViewToUpdate|, typically from the row
+  // epilogue of the previous layer.
+  virtual void PrepareInputRows(int row_start, int row_end) {}
+
+  // Whether all rows of the input are prepared by |PrepareInputRows| before
+  // Run() is called, so that Run() skips that work and its barrier.
+  void set_input_prepared_externally(bool input_prepared_externally) {
+    input_prepared_externally_ = input_prepared_externally;
+  }
+
+  void ClearState() override { input_buffer_.FillZero(); }
+
+  // Only the window of each column that the next runs read is saved, not the
+  // rows the window advances into, so the state is restored into whatever
+  // windows this layer is at.
+  void SaveState(StateWriter* writer) const override {
+    writer->Write(input_buffer_rows_);
+    writer->Write(input_buffer_cols_);
+    for (int column = 0; column < input_buffer_cols_; ++column) {
+      writer->WriteBytes(input_buffer_.data() + WindowOffset(column),
+                         input_buffer_rows_ * sizeof(RhsType));
+    }
+  }
+
+  bool RestoreState(StateReader* reader) override {
+    int rows, cols;
+    if (!reader->Read(&rows) || !reader->Read(&cols) ||
+        rows != input_buffer_rows_ || cols != input_buffer_cols_) {
+      return false;
+    }
+    for (int column = 0; column < input_buffer_cols_; ++column) {
+      if (!reader->ReadBytes(input_buffer_.data() + WindowOffset(column),
+                             input_buffer_rows_ * sizeof(RhsType))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   virtual int bytes() { return layer_->bytes(); }
 
   virtual int rows() { return layer_->rows(); }
 
   virtual int cols() { return layer_->cols(); }
 
+  // The bias of the matrix multiplication, one value per output row.
+  const auto& bias() const { return layer_->bias(); }
+
  protected:
   LayerWrapper() = delete;
+  // |input_buffer_| gets |num_extra_input_rows| rows more than the matrix
+  // multiplication reads, which subclasses use to keep a history of inputs.
   explicit LayerWrapper(
       int num_input_channels, int output_rows, int length,
       int input_buffer_rows, int input_buffer_cols, bool relu,
       bool per_column_barrier,
-      std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
-          layer)
+      std::shared_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+          layer,
+      int num_extra_input_rows = 0)
       : num_input_channels_(num_input_channels),
         output_rows_(output_rows),
         length_(length),
@@ -151,11 +285,142 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
         relu_(relu),
         per_column_barrier_(per_column_barrier),
         layer_(std::move(layer)),
-        input_buffer_(input_buffer_rows_, input_buffer_cols_) {
+        input_buffer_(input_buffer_rows_ + num_extra_input_rows,
+                      input_buffer_cols_) {
     input_buffer_.FillZero();
   }
 
-  // Perform necessary memory shifting after each Run().
+  // The row of |column| of |input_buffer_| at which the |input_buffer_rows_|
+  // rows that the next run reads start. Subclasses that advance a window
+  // through a longer buffer override this.
+  virtual int WindowStart(int column) const { return 0; }
+
+  int WindowOffset(int column) const {
+    return column * input_buffer_.col_stride() + WindowStart(column);
+  }
+
+  // The rows of the output whose final values each of |num_threads| threads
+  // writes in Run(), as in |ThreadRowStarts|. Subclasses that divide the rows
+  // differently after the matrix multiplication override this.
+  virtual std::vector<int> OutputRowStarts(int num_threads) const {
+    return ThreadRowStarts(num_threads);
+  }
+
+  // Calls the row epilogue, if any, with the rows of thread |tid|.
+  void RunRowEpilogue(int tid) {
+    if (row_epilogue_ != nullptr) {
+      row_epilogue_(epilogue_row_starts_[tid], epilogue_row_starts_[tid + 1]);
+    }
+  }
+
+  // Loads the layer described by |from| and prepares it for |num_threads|.
+  static std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  LoadLayer(
+      const std::variant<LayerParams::FromDisk, LayerParams::FromConstant> from,
+      const std::string& prefix, const std::string& layer_prompt,
+      int expected_rows, int expected_cols, int num_threads) {
+    auto layer = absl::make_unique<
+        csrblocksparse::SparseLinearLayer<WeightType, RhsType>>();
+    if (std::holds_alternative<LayerParams::FromDisk>(from)) {
+      const auto from_disk = std::get<LayerParams::FromDisk>(from);
+      auto LoadSparseLayer =
+          csrblocksparse::LoadSparseLayer<WeightType, RhsType, DiskWeightType>;
+      if (!LoadSparseLayer(prefix, from_disk.zipped, layer.get(),
+                           from_disk.path)
+               .ok()) {
+        LOG(ERROR) << layer_prompt << " loading failed.";
+        return nullptr;
+      }
+    } else {
+      const auto from_constant = std::get<LayerParams::FromConstant>(from);
+      *layer = csrblocksparse::CreateConstantLayer<WeightType, RhsType>(
+          expected_rows, expected_cols, from_constant.sparsity,
+          from_constant.value);
+      if (from_constant.double_block_height) {
+        layer->DoubleBlockHeight();
+      }
+    }
+    LOG(INFO) << layer_prompt << " Shape: [" << layer->rows() << ", "
+              << layer->cols() << "]."
+              << " Sparsity: " << layer->sparsity();
+
+    if (layer->PrepareForThreads(num_threads) != num_threads) {
+      LOG(ERROR) << layer_prompt << "Could not prepare for " << num_threads
+                 << " threads.";
+      return nullptr;
+    }
+    return layer;
+  }
+
+  // Replaces |*layer| with a copy whose blocks are twice as high, padded with
+  // zeros where needed, if that copy multiplies faster on this host. Layers on
+  // disk have blocks of 4 rows, and whether 8 rows are faster depends on the
+  // instruction set and on the sparsity pattern of the layer.
+  static void AutotuneBlockHeight(
+      const std::string& layer_prompt, int num_threads,
+      std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>*
+          layer) {
+    constexpr int kDoubledBlockRows = 8;
+    if ((*layer)->rows() % kDoubledBlockRows != 0) {
+      return;
+    }
+    auto doubled = absl::make_unique<
+        csrblocksparse::SparseLinearLayer<WeightType, RhsType>>(**layer);
+    doubled->DoubleBlockHeight();
+    if (doubled->PrepareForThreads(num_threads) != num_threads) {
+      return;
+    }
+    const absl::Duration time = TimeMultiplication(num_threads, layer->get());
+    const absl::Duration doubled_time =
+        TimeMultiplication(num_threads, doubled.get());
+    LOG(INFO) << layer_prompt << " Multiplies in " << time
+              << " with blocks of 4 rows and in " << doubled_time
+              << " with blocks of 8 rows.";
+    if (doubled_time < time) {
+      *layer = std::move(doubled);
+    }
+  }
+
+  // Returns the fastest of a few multiplications of a zero input by |layer|,
+  // in which this thread runs the parts of all |num_threads| threads in turn.
+  // The time of a sparse multiplication does not depend on the values.
+  static absl::Duration TimeMultiplication(
+      int num_threads,
+      csrblocksparse::SparseLinearLayer<WeightType, RhsType>* layer) {
+    constexpr int kNumRuns = 16;
+    csrblocksparse::FatCacheAlignedVector<RhsType> input(layer->cols(), 1);
+    input.FillZero();
+    csrblocksparse::FatCacheAlignedVector<OutputType> output(layer->rows(), 1);
+    csrblocksparse::MutableVectorView<OutputType> output_view(&output);
+    absl::Duration fastest = absl::InfiniteDuration();
+    for (int run = 0; run < kNumRuns; ++run) {
+      const absl::Time start = absl::Now();
+      for (int tid = 0; tid < num_threads; ++tid) {
+        layer->SpMM_bias(csrblocksparse::VectorView<RhsType>(input),
+                         &output_view, /*relu=*/false, tid);
+      }
+      fastest = std::min(fastest, absl::Now() - start);
+    }
+    return fastest;
+  }
+
+  // Returns the number of extra input buffer rows that let a window of
+  // |window_rows| rows advance by |step_rows| rows |num_steps| times before
+  // its content has to be moved back to the top of the buffer, or 0 if the
+  // window would then start at an offset that is not cache aligned.
+  static int NumRowsToAdvanceInPlace(int window_rows, int step_rows,
+                                     int num_steps) {
+    constexpr int kCacheLineBytes = 64;
+    if (step_rows >= window_rows ||
+        (step_rows * sizeof(RhsType)) % kCacheLineBytes != 0) {
+      return 0;
+    }
+    return num_steps * step_rows;
+  }
+
+  // Perform necessary memory shifting after each Run(). Only thread 0 changes
+  // the buffers, and without a barrier, because the other threads only read
+  // them again after the barriers of the layers that follow.
   virtual void Reset(int tid, csrblocksparse::SpinBarrier* spin_barrier) = 0;
 
   // Dimensions of matrices participating in y = Wx + b,
@@ -194,10 +459,19 @@ class LayerWrapper : public LayerWrapperInterface<WeightType, RhsType,
   // multiplication is done.
   const bool per_column_barrier_;
 
-  std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+  // Possibly shared with other wrappers through a |LyraModel|, in which case
+  // it must not be modified after construction.
+  std::shared_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
       layer_;
   csrblocksparse::FatCacheAlignedVector<RhsType> input_buffer_;
 
+  // See |SetRowEpilogue|.
+  std::vector<int> epilogue_row_starts_;
+  std::function<void(int row_start, int row_end)> row_epilogue_;
+
+  // See |set_input_prepared_externally|.
+  bool input_prepared_externally_ = false;
+
   template <typename WeightTypeKindPeer,
             template <typename, typename, typename, typename>
             class LayerWrapperTypeTemplate>
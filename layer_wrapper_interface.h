@@ -21,10 +21,13 @@
 #include <variant>
 
 #include "sparse_inference_matrixvector.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
 
+class LyraModel;
+
 enum class LayerType { kConv1D, kDilated, kTranspose };
 
 // Parameters to construct a LayerWrapper object.
@@ -78,10 +81,19 @@ struct LayerParams {
     // Desired sparsity, achieved by probabilistically masking out elements.
     // Sparsity < 0.0 means to create a fully dense layer.
     float sparsity = -1.0f;
+
+    // Whether to double the height of the blocks of the weight matrix, so that
+    // it is multiplied in blocks of 8 instead of 4 rows.
+    bool double_block_height = false;
   };
   std::variant<FromDisk, FromConstant> from = FromDisk();
 
   std::string prefix = "";
+
+  // If set, layers loaded from disk are shared with any other layer that was
+  // loaded through the same model with the same |prefix| and |num_threads|.
+  // Not owned.
+  LyraModel* model = nullptr;
 };
 
 // Abstract class for layer wrappers.
@@ -101,6 +113,17 @@ class LayerWrapperInterface {
 
   virtual int PrepareForThreads(int num_threads) = 0;
 
+  // Forgets the inputs of previous runs, as if the layer was just created.
+  virtual void ClearState() = 0;
+
+  // Appends the inputs of previous runs, everything |ClearState| forgets, to
+  // |writer|.
+  virtual void SaveState(StateWriter* writer) const = 0;
+
+  // Restores the inputs saved by |SaveState| of a layer of the same shape.
+  // Returns false if |reader| does not hold them.
+  virtual bool RestoreState(StateReader* reader) = 0;
+
   virtual int bytes() = 0;
 
   virtual int rows() = 0;
@@ -17,6 +17,7 @@
 #ifndef LYRA_CODEC_LAYER_WRAPPER_TEST_COMMON_H_
 #define LYRA_CODEC_LAYER_WRAPPER_TEST_COMMON_H_
 
+#include <functional>
 #include <memory>
 #include <type_traits>
 #include <utility>
@@ -81,6 +82,21 @@ class LayerWrapperPeer {
   int bytes() { return layer_wrapper_->bytes(); }
   int rows() { return layer_wrapper_->rows(); }
   int cols() { return layer_wrapper_->cols(); }
+  std::vector<int> ThreadRowStarts(int num_threads) {
+    return layer_wrapper_->ThreadRowStarts(num_threads);
+  }
+  bool SetRowEpilogue(int num_threads, int row_alignment,
+                      std::function<void(int, int)> epilogue) {
+    return layer_wrapper_->SetRowEpilogue(num_threads, row_alignment,
+                                          std::move(epilogue));
+  }
+  bool PreparesInput() { return layer_wrapper_->PreparesInput(); }
+  void PrepareInputRows(int row_start, int row_end) {
+    layer_wrapper_->PrepareInputRows(row_start, row_end);
+  }
+  void set_input_prepared_externally(bool input_prepared_externally) {
+    layer_wrapper_->set_input_prepared_externally(input_prepared_externally);
+  }
 
   // Protected in LayerWrapper.
   void Reset(int tid, csrblocksparse::SpinBarrier* spin_barrier) {
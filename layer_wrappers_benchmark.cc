@@ -0,0 +1,200 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "causal_convolutional_conditioning.h"
+#include "include/ghc/filesystem.hpp"
+#include "layer_wrappers_lib.h"
+#include "lyra_types.h"
+#include "lyra_wavegru.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using csrblocksparse::fixed16_type;
+template <typename WeightTypeKind>
+using ConditioningType =
+    CausalConvolutionalConditioning<ConditioningTypes<WeightTypeKind>>;
+static constexpr int kNumFeatures = 160;
+static constexpr int kNumCondHiddens = 512;
+static constexpr int kNumGruHiddens = 1024;
+
+// Like the fixtures of exported_layers_test.h, every struct below names the
+// type and the parameters of one layer of the shipped model, one per kind of
+// layer wrapper and the largest projections.
+template <typename WeightTypeKind>
+struct Conv1DLayerTypes {
+  using LayerWrapperType =
+      typename ConditioningType<WeightTypeKind>::Conv1DLayerType;
+  static LayerParams Params(const std::string& model_path) {
+    return LayerParams{
+        .num_input_channels = kNumFeatures,
+        .num_filters = kNumCondHiddens,
+        .length = 1,
+        .kernel_size = 3,
+        .dilation = 1,
+        .stride = 1,
+        .relu = false,
+        .skip_connection = false,
+        .type = LayerType::kConv1D,
+        .num_threads = 1,
+        .per_column_barrier = false,
+        .from = LayerParams::FromDisk{.path = model_path, .zipped = true},
+        .prefix = "lyra_16khz_conv1d_"};
+  }
+};
+
+template <typename WeightTypeKind>
+struct DilatedLayerTypes {
+  using LayerWrapperType =
+      typename ConditioningType<WeightTypeKind>::CondStack0LayerType;
+  static LayerParams Params(const std::string& model_path) {
+    return LayerParams{
+        .num_input_channels = kNumCondHiddens,
+        .num_filters = kNumCondHiddens,
+        .length = 1,
+        .kernel_size = 2,
+        .dilation = 1,
+        .stride = 1,
+        .relu = false,
+        .skip_connection = true,
+        .type = LayerType::kDilated,
+        .num_threads = 1,
+        .per_column_barrier = false,
+        .from = LayerParams::FromDisk{.path = model_path, .zipped = true},
+        .prefix = "lyra_16khz_conditioning_stack_0_"};
+  }
+};
+
+template <typename WeightTypeKind>
+struct TransposeLayerTypes {
+  using LayerWrapperType =
+      typename ConditioningType<WeightTypeKind>::Transpose0LayerType;
+  static LayerParams Params(const std::string& model_path) {
+    return LayerParams{
+        .num_input_channels = kNumCondHiddens,
+        .num_filters = kNumCondHiddens,
+        .length = 1,
+        .kernel_size = 2,
+        .dilation = 1,
+        .stride = 2,
+        .relu = true,
+        .skip_connection = false,
+        .type = LayerType::kTranspose,
+        .num_threads = 1,
+        .per_column_barrier = false,
+        .from = LayerParams::FromDisk{.path = model_path, .zipped = true},
+        .prefix = "lyra_16khz_transpose_0_"};
+  }
+};
+
+template <typename WeightTypeKind>
+struct ConvCondLayerTypes {
+  using LayerWrapperType =
+      typename ConditioningType<WeightTypeKind>::ConvCondLayerType;
+  static LayerParams Params(const std::string& model_path) {
+    return LayerParams{
+        .num_input_channels = kNumCondHiddens,
+        .num_filters = kNumGruHiddens,
+        .length = 8,
+        .kernel_size = 1,
+        .dilation = 1,
+        .stride = 1,
+        .relu = false,
+        .skip_connection = false,
+        .type = LayerType::kConv1D,
+        .num_threads = 1,
+        .per_column_barrier = false,
+        .from = LayerParams::FromDisk{.path = model_path, .zipped = true},
+        .prefix = "lyra_16khz_conv_cond_"};
+  }
+};
+
+template <typename WeightTypeKind>
+struct GruLayerTypes {
+  using LayerWrapperType = typename LyraWavegru<WeightTypeKind>::GruLayerType;
+  static LayerParams Params(const std::string& model_path) {
+    return LayerParams{
+        .num_input_channels = kNumGruHiddens,
+        .num_filters = 3 * kNumGruHiddens,
+        .length = 1,
+        .kernel_size = 1,
+        .dilation = 1,
+        .stride = 1,
+        .relu = false,
+        .skip_connection = false,
+        .type = LayerType::kConv1D,
+        .num_threads = 1,
+        .per_column_barrier = false,
+        .from = LayerParams::FromDisk{.path = model_path, .zipped = true},
+        .prefix = "lyra_16khz_gru_layer_"};
+  }
+};
+
+// Runs the layer of |LayerTypes| on one thread with a small random input.
+template <typename LayerTypes>
+void BM_RunLayer(benchmark::State& state) {
+  using LayerWrapperType = typename LayerTypes::LayerWrapperType;
+  using InputType = typename LayerWrapperType::Input;
+  using OutputType = typename LayerWrapperType::Output;
+  const LayerParams params = LayerTypes::Params(
+      (ghc::filesystem::current_path() / "wavegru").string());
+  auto layer = LayerWrapperType::Create(params);
+  if (layer == nullptr) {
+    state.SkipWithError("Could not create the layer.");
+    return;
+  }
+  absl::BitGen gen;
+  auto input = layer->InputViewToUpdate();
+  std::generate(input.data(), input.data() + input.rows() * input.cols(),
+                [&gen]() {
+                  return InputType(absl::Uniform<float>(gen, -0.01f, 0.01f));
+                });
+  const int output_rows = layer->rows();
+  const int output_cols = params.length;
+  std::vector<OutputType> output(output_rows * output_cols);
+  csrblocksparse::SpinBarrier spin_barrier(1);
+
+  for (auto _ : state) {
+    layer->Run(0, &spin_barrier,
+               csrblocksparse::MutableVectorView<OutputType>(
+                   output.data(), output_rows, output_cols));
+    benchmark::DoNotOptimize(output.data());
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_RunLayer, Conv1DLayerTypes<float>);
+BENCHMARK_TEMPLATE(BM_RunLayer, Conv1DLayerTypes<fixed16_type>);
+BENCHMARK_TEMPLATE(BM_RunLayer, DilatedLayerTypes<float>);
+BENCHMARK_TEMPLATE(BM_RunLayer, DilatedLayerTypes<fixed16_type>);
+BENCHMARK_TEMPLATE(BM_RunLayer, TransposeLayerTypes<float>);
+BENCHMARK_TEMPLATE(BM_RunLayer, TransposeLayerTypes<fixed16_type>);
+BENCHMARK_TEMPLATE(BM_RunLayer, ConvCondLayerTypes<float>);
+BENCHMARK_TEMPLATE(BM_RunLayer, ConvCondLayerTypes<fixed16_type>);
+BENCHMARK_TEMPLATE(BM_RunLayer, GruLayerTypes<float>);
+BENCHMARK_TEMPLATE(BM_RunLayer, GruLayerTypes<fixed16_type>);
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
+
+BENCHMARK_MAIN();
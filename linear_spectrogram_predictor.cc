@@ -0,0 +1,138 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "linear_spectrogram_predictor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "log_mel_spectrogram_extractor_impl.h"
+#include "state_buffer.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<LinearSpectrogramPredictor> LinearSpectrogramPredictor::Create(
+    int num_features) {
+  if (num_features <= 0 || num_features > FeatureFrame::kCapacity) {
+    LOG(ERROR) << "Number of features must be positive and at most "
+               << FeatureFrame::kCapacity << ", was " << num_features << ".";
+    return nullptr;
+  }
+  return absl::WrapUnique(new LinearSpectrogramPredictor(num_features));
+}
+
+LinearSpectrogramPredictor::LinearSpectrogramPredictor(int num_features)
+    : num_features_(num_features),
+      history_(kNumHistoryFrames * num_features),
+      newest_frame_(kNumHistoryFrames - 1),
+      num_frames_(0),
+      slopes_(num_features, 0.0f),
+      prediction_(num_features,
+                  LogMelSpectrogramExtractorImpl::GetSilenceValue()),
+      num_predicted_frames_(0) {}
+
+void LinearSpectrogramPredictor::FeedFrame(absl::Span<const float> features) {
+  if (features.size() != static_cast<size_t>(num_features_)) {
+    LOG(ERROR) << "Expected " << num_features_ << " features but got "
+               << features.size() << ".";
+    return;
+  }
+  newest_frame_ = (newest_frame_ + 1) % kNumHistoryFrames;
+  std::copy(features.begin(), features.end(),
+            history_.begin() + newest_frame_ * num_features_);
+  num_frames_ = std::min(num_frames_ + 1, kNumHistoryFrames);
+  std::copy(features.begin(), features.end(), prediction_.begin());
+  num_predicted_frames_ = 0;
+
+  // Least squares fit of every bin over the frames at times 0 to
+  // |num_frames_| - 1, oldest first.
+  std::fill(slopes_.begin(), slopes_.end(), 0.0f);
+  if (num_frames_ < 2) {
+    return;
+  }
+  const float mean_time = 0.5f * (num_frames_ - 1);
+  float time_variance = 0.0f;
+  const int oldest_frame = newest_frame_ - num_frames_ + 1 + kNumHistoryFrames;
+  for (int t = 0; t < num_frames_; ++t) {
+    const float time = t - mean_time;
+    time_variance += time * time;
+    const float* frame =
+        &history_[((oldest_frame + t) % kNumHistoryFrames) * num_features_];
+    for (int i = 0; i < num_features_; ++i) {
+      slopes_[i] += time * frame[i];
+    }
+  }
+  for (float& slope : slopes_) {
+    slope /= time_variance;
+  }
+}
+
+FeatureFrame LinearSpectrogramPredictor::PredictFrame() {
+  ExtrapolateInto(absl::MakeSpan(prediction_));
+  ++num_predicted_frames_;
+  return FeatureFrame(prediction_);
+}
+
+FeatureFrame LinearSpectrogramPredictor::PeekFrame() {
+  FeatureFrame next(num_features_);
+  ExtrapolateInto(absl::MakeSpan(next));
+  return next;
+}
+
+void LinearSpectrogramPredictor::ExtrapolateInto(absl::Span<float> next) const {
+  const float scale = std::pow(kSlopeDecay, num_predicted_frames_);
+  const float silence = LogMelSpectrogramExtractorImpl::GetSilenceValue();
+  for (int i = 0; i < num_features_; ++i) {
+    next[i] = std::max(silence, prediction_[i] + scale * slopes_[i]);
+  }
+}
+
+void LinearSpectrogramPredictor::Reset() {
+  std::fill(history_.begin(), history_.end(), 0.0f);
+  newest_frame_ = kNumHistoryFrames - 1;
+  num_frames_ = 0;
+  std::fill(slopes_.begin(), slopes_.end(), 0.0f);
+  std::fill(prediction_.begin(), prediction_.end(),
+            LogMelSpectrogramExtractorImpl::GetSilenceValue());
+  num_predicted_frames_ = 0;
+}
+
+bool LinearSpectrogramPredictor::SaveState(StateWriter* writer) const {
+  writer->Write(newest_frame_);
+  writer->Write(num_frames_);
+  writer->Write(num_predicted_frames_);
+  writer->WriteSpan(absl::MakeConstSpan(history_));
+  writer->WriteSpan(absl::MakeConstSpan(slopes_));
+  writer->WriteSpan(absl::MakeConstSpan(prediction_));
+  return true;
+}
+
+bool LinearSpectrogramPredictor::RestoreState(StateReader* reader) {
+  return reader->Read(&newest_frame_) && newest_frame_ >= 0 &&
+         newest_frame_ < kNumHistoryFrames && reader->Read(&num_frames_) &&
+         num_frames_ >= 0 && num_frames_ <= kNumHistoryFrames &&
+         reader->Read(&num_predicted_frames_) && num_predicted_frames_ >= 0 &&
+         reader->ReadSpan(absl::MakeSpan(history_)) &&
+         reader->ReadSpan(absl::MakeSpan(slopes_)) &&
+         reader->ReadSpan(absl::MakeSpan(prediction_));
+}
+
+}  // namespace codec
+}  // namespace chromemedia
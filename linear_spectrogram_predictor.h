@@ -0,0 +1,89 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_LINEAR_SPECTROGRAM_PREDICTOR_H_
+#define LYRA_CODEC_LINEAR_SPECTROGRAM_PREDICTOR_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "feature_frame.h"
+#include "spectrogram_predictor_interface.h"
+#include "state_buffer.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Predicts every bin of the next spectrogram frame by fitting a line through
+// it in the last |kNumHistoryFrames| received frames. The slope of each
+// predicted frame is |kSlopeDecay| times that of the one before, so that a
+// burst of lost frames levels off instead of drifting away. All buffers are
+// allocated when the predictor is created.
+class LinearSpectrogramPredictor : public SpectrogramPredictorInterface {
+ public:
+  static constexpr int kNumHistoryFrames = 4;
+  static constexpr float kSlopeDecay = 0.5f;
+  static constexpr float kMaxPredictionSeconds = 0.2f;
+
+  // Returns nullptr if |num_features| is not positive or does not fit into a
+  // |FeatureFrame|. Can be passed as a |SpectrogramPredictorFactory|.
+  static std::unique_ptr<LinearSpectrogramPredictor> Create(int num_features);
+
+  // Adds |features| to the history and refits the lines through it. Frames
+  // of the wrong size are ignored.
+  void FeedFrame(absl::Span<const float> features) override;
+
+  // Returns the frame after the previously predicted one, or after the most
+  // recently fed one if there is none.
+  FeatureFrame PredictFrame() override;
+
+  FeatureFrame PeekFrame() override;
+
+  float max_prediction_seconds() const override {
+    return kMaxPredictionSeconds;
+  }
+
+  // Empties the history, so that the prediction goes back to silence.
+  void Reset() override;
+
+  bool SaveState(StateWriter* writer) const override;
+
+  bool RestoreState(StateReader* reader) override;
+
+ private:
+  explicit LinearSpectrogramPredictor(int num_features);
+
+  // Writes the frame following |prediction_| into |next|.
+  void ExtrapolateInto(absl::Span<float> next) const;
+
+  const int num_features_;
+  // Ring of the last |kNumHistoryFrames| frames, |newest_frame_| being the
+  // index of the most recent one.
+  std::vector<float> history_;
+  int newest_frame_;
+  int num_frames_;
+  std::vector<float> slopes_;
+  // The most recently predicted frame, or the most recently fed one.
+  std::vector<float> prediction_;
+  int num_predicted_frames_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LINEAR_SPECTROGRAM_PREDICTOR_H_
@@ -0,0 +1,151 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "linear_spectrogram_predictor.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "feature_frame.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "log_mel_spectrogram_extractor_impl.h"
+#include "lyra_config.h"
+#include "state_buffer.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::Each;
+using testing::FloatEq;
+using testing::Pointwise;
+
+TEST(LinearSpectrogramPredictorTest, CreateFailsWithoutFeatures) {
+  EXPECT_EQ(LinearSpectrogramPredictor::Create(0), nullptr);
+}
+
+TEST(LinearSpectrogramPredictorTest, PredictsSilenceBeforeTheFirstFrame) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  EXPECT_THAT(predictor->PredictFrame(),
+              Each(FloatEq(LogMelSpectrogramExtractorImpl::GetSilenceValue())));
+}
+
+TEST(LinearSpectrogramPredictorTest, SingleFrameIsRepeated) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  const std::vector<float> features(kNumFeatures, 1.0f);
+  predictor->FeedFrame(features);
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(1.0f)));
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(1.0f)));
+}
+
+// Frames rising by 1 per frame extrapolate to 1 more, then to half of that
+// more for every further predicted frame.
+TEST(LinearSpectrogramPredictorTest, RampIsExtrapolatedWithDecayingSlope) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  for (int frame = 0; frame < 2 * LinearSpectrogramPredictor::kNumHistoryFrames;
+       ++frame) {
+    predictor->FeedFrame(std::vector<float>(kNumFeatures, frame));
+  }
+  const float newest = 2 * LinearSpectrogramPredictor::kNumHistoryFrames - 1;
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(newest + 1.0f)));
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(newest + 1.5f)));
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(newest + 1.75f)));
+}
+
+TEST(LinearSpectrogramPredictorTest, PredictionNeverFallsBelowSilence) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  const float silence = LogMelSpectrogramExtractorImpl::GetSilenceValue();
+  predictor->FeedFrame(std::vector<float>(kNumFeatures, silence + 10.0f));
+  predictor->FeedFrame(std::vector<float>(kNumFeatures, silence));
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(silence)));
+}
+
+TEST(LinearSpectrogramPredictorTest, PeekFrameDoesNotAdvance) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  predictor->FeedFrame(std::vector<float>(kNumFeatures, 0.0f));
+  predictor->FeedFrame(std::vector<float>(kNumFeatures, 2.0f));
+  const FeatureFrame peeked = predictor->PeekFrame();
+  EXPECT_THAT(predictor->PeekFrame(), Pointwise(FloatEq(), peeked));
+  EXPECT_THAT(predictor->PredictFrame(), Pointwise(FloatEq(), peeked));
+}
+
+TEST(LinearSpectrogramPredictorTest, FrameOfWrongSizeIsIgnored) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  predictor->FeedFrame(std::vector<float>(kNumFeatures, 1.0f));
+  predictor->FeedFrame(std::vector<float>(kNumFeatures + 1, 5.0f));
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(1.0f)));
+}
+
+TEST(LinearSpectrogramPredictorTest, RestoredStateContinuesThePrediction) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  for (int frame = 0; frame < 3; ++frame) {
+    predictor->FeedFrame(std::vector<float>(kNumFeatures, 2.0f * frame));
+  }
+  predictor->PredictFrame();
+  std::vector<uint8_t> state;
+  StateWriter writer(&state);
+  ASSERT_TRUE(predictor->SaveState(&writer));
+  const FeatureFrame expected = predictor->PredictFrame();
+
+  auto restored = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(restored, nullptr);
+  StateReader reader(absl::MakeConstSpan(state));
+  ASSERT_TRUE(restored->RestoreState(&reader));
+  EXPECT_THAT(restored->PredictFrame(), Pointwise(FloatEq(), expected));
+}
+
+TEST(LinearSpectrogramPredictorTest, ResetPredictsLikeANewPredictor) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  for (int frame = 0; frame < 3; ++frame) {
+    predictor->FeedFrame(std::vector<float>(kNumFeatures, 2.0f * frame));
+  }
+  predictor->PredictFrame();
+  predictor->Reset();
+  EXPECT_THAT(predictor->PeekFrame(),
+              Each(FloatEq(LogMelSpectrogramExtractorImpl::GetSilenceValue())));
+
+  // A single frame after the reset is repeated without the slope of the
+  // frames before it.
+  predictor->FeedFrame(std::vector<float>(kNumFeatures, 1.0f));
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(1.0f)));
+  EXPECT_THAT(predictor->PredictFrame(), Each(FloatEq(1.0f)));
+}
+
+TEST(LinearSpectrogramPredictorTest, RestoreStateOfOtherSizeFails) {
+  auto predictor = LinearSpectrogramPredictor::Create(kNumFeatures);
+  ASSERT_NE(predictor, nullptr);
+  std::vector<uint8_t> state;
+  StateWriter writer(&state);
+  ASSERT_TRUE(predictor->SaveState(&writer));
+
+  auto other = LinearSpectrogramPredictor::Create(kNumFeatures + 1);
+  ASSERT_NE(other, nullptr);
+  StateReader reader(absl::MakeConstSpan(state));
+  EXPECT_FALSE(other->RestoreState(&reader));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
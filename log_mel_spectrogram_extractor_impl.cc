@@ -19,16 +19,20 @@
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "Eigen/Core"
 #include "absl/memory/memory.h"
 #include "absl/types/span.h"
-#include "audio/dsp/mfcc/mel_filterbank.h"
 #include "audio/dsp/number_util.h"
-#include "audio/dsp/spectrogram/spectrogram.h"
+#include "dsp_util.h"
 #include "glog/logging.h"
 
+// The real FFT of fft2d, see fft2d/fftsg.c.
+extern "C" void rdft(int n, int isgn, double* a, int* ip, double* w);
+
 namespace chromemedia {
 namespace codec {
 
@@ -39,16 +43,71 @@ static constexpr float kLogFloor = 500.f;
 static constexpr double kLowerFreqLimit = 0.0;
 static constexpr double kUpperFreqLimitFactor = 0.495;
 
+double FreqToMel(double freq) { return 1127.0 * std::log1p(freq / 700.0); }
+
+// Returns the weight of each of the |num_fft_bins| FFT bins in each of the
+// |num_mel_bins| triangular mel filters, computed like
+// audio_dsp::MelFilterbank: the filters are evenly spaced on the mel scale
+// between the limits and the DC bin is always excluded.
+std::vector<std::vector<double>> MelWeights(int num_fft_bins,
+                                            int sample_rate_hz,
+                                            int num_mel_bins,
+                                            double lower_freq_limit,
+                                            double upper_freq_limit) {
+  // An extra center frequency on top bounds the last filter.
+  const double mel_low = FreqToMel(lower_freq_limit);
+  const double mel_spacing =
+      (FreqToMel(upper_freq_limit) - mel_low) / (num_mel_bins + 1);
+  std::vector<double> center_mels(num_mel_bins + 1);
+  for (int i = 0; i <= num_mel_bins; ++i) {
+    center_mels[i] = mel_low + mel_spacing * (i + 1);
+  }
+
+  const double hz_per_bin = 0.5 * sample_rate_hz / (num_fft_bins - 1);
+  const int start_bin = static_cast<int>(1.5 + lower_freq_limit / hz_per_bin);
+  const int end_bin = static_cast<int>(upper_freq_limit / hz_per_bin);
+  std::vector<std::vector<double>> weights(
+      num_mel_bins, std::vector<double>(num_fft_bins, 0.0));
+  int channel = 0;
+  for (int i = start_bin; i <= end_bin && i < num_fft_bins; ++i) {
+    const double mel = FreqToMel(i * hz_per_bin);
+    while (channel < num_mel_bins && center_mels[channel] < mel) {
+      ++channel;
+    }
+    // The bin is on the falling edge of the filter below |channel| and on the
+    // rising edge of |channel|.
+    const double lower_center =
+        channel > 0 ? center_mels[channel - 1] : mel_low;
+    const double falling_weight =
+        (center_mels[channel] - mel) / (center_mels[channel] - lower_center);
+    if (channel > 0) {
+      weights[channel - 1][i] = falling_weight;
+    }
+    if (channel < num_mel_bins) {
+      weights[channel][i] = 1.0 - falling_weight;
+    }
+  }
+  return weights;
+}
+
 }  // namespace
 
 LogMelSpectrogramExtractorImpl::LogMelSpectrogramExtractorImpl(
-    std::unique_ptr<audio_dsp::Spectrogram> spectrogram,
-    std::unique_ptr<audio_dsp::MelFilterbank> mel_filterbank,
-    int hop_length_samples)
-    : spectrogram_(std::move(spectrogram)),
-      mel_filterbank_(std::move(mel_filterbank)),
+    std::vector<float> window, std::vector<MelFilter> mel_filters,
+    int hop_length_samples, int fft_size)
+    : window_(std::move(window)),
+      mel_filters_(std::move(mel_filters)),
       hop_length_samples_(hop_length_samples),
-      samples_(hop_length_samples, 0.0) {}
+      fft_size_(fft_size),
+      // The window starts out as silence, so that the first hop of audio
+      // already yields features.
+      samples_(window_.size() - hop_length_samples, 0.0f),
+      fft_buffer_(fft_size, 0.0),
+      // Sizes required by rdft. A zero first entry makes it compute the
+      // tables on the first call.
+      fft_ip_(2 + static_cast<int>(std::ceil(std::sqrt(fft_size / 2.0))), 0),
+      fft_w_(fft_size / 2, 0.0),
+      magnitudes_(fft_size / 2 + 1, 0.0f) {}
 
 std::unique_ptr<LogMelSpectrogramExtractorImpl>
 LogMelSpectrogramExtractorImpl::Create(int sample_rate_hz, int num_mel_bins,
@@ -60,78 +119,195 @@ LogMelSpectrogramExtractorImpl::Create(int sample_rate_hz, int num_mel_bins,
                << hop_length_samples;
     return nullptr;
   }
-  auto spectrogram = absl::make_unique<audio_dsp::Spectrogram>();
-  if (!spectrogram->Initialize(window_length_samples, hop_length_samples)) {
-    LOG(ERROR) << "Could not initialize spectrogram for feature extraction.";
+  if (hop_length_samples <= 0) {
+    LOG(ERROR) << "Hop length samples was " << hop_length_samples
+               << " but must be positive.";
+    return nullptr;
+  }
+  if (sample_rate_hz <= 0 || num_mel_bins <= 0) {
+    LOG(ERROR) << "Could not create mel filters for " << num_mel_bins
+               << " bins at " << sample_rate_hz << " Hz.";
     return nullptr;
   }
-  // To get a spectrogram for the first audio of hop length samples we first
-  // calculate the spectrogram of an empty window to fill the internal queue.
-  std::vector<std::vector<double>> unused_spectrogram_slices;
-  if (!spectrogram->ComputeSpectrogram(
-          std::vector<double>(window_length_samples, 0.0),
-          &unused_spectrogram_slices)) {
-    LOG(ERROR) << "Error calculating spectrogram of empty window.";
+  if (num_mel_bins > FeatureFrame::kCapacity) {
+    LOG(ERROR) << "A frame holds at most " << FeatureFrame::kCapacity
+               << " features, not " << num_mel_bins << ".";
     return nullptr;
   }
 
+  // Periodic Hann window.
+  std::vector<float> window(window_length_samples);
+  for (int i = 0; i < window_length_samples; ++i) {
+    window[i] = static_cast<float>(
+        0.5 - 0.5 * std::cos(2.0 * M_PI * i / window_length_samples));
+  }
+
   // Compute the next power of two for FFT size.
   const int kFftSize = static_cast<int>(
       audio_dsp::NextPowerOfTwo(static_cast<unsigned>(window_length_samples)));
   // Number of unique FFT bins.
   const int kFftBins = kFftSize / 2 + 1;
-  auto mel_filterbank = absl::make_unique<audio_dsp::MelFilterbank>();
-  if (!mel_filterbank->Initialize(kFftBins, sample_rate_hz, num_mel_bins,
-                                  kLowerFreqLimit,
-                                  GetUpperFreqLimit(sample_rate_hz))) {
-    LOG(ERROR) << "Could not initialize mel filterbank for feature extraction.";
+  if (kFftBins < 2) {
+    LOG(ERROR) << "The window of " << window_length_samples
+               << " samples is too short for a spectrogram.";
     return nullptr;
   }
 
+  // Keep only the range of bins each filter weights.
+  const std::vector<std::vector<double>> mel_weights =
+      GetMelWeights(sample_rate_hz, num_mel_bins, kFftBins);
+  std::vector<MelFilter> mel_filters(num_mel_bins);
+  for (int c = 0; c < num_mel_bins; ++c) {
+    const std::vector<double>& weights = mel_weights[c];
+    const auto is_non_zero = [](double weight) { return weight != 0.0; };
+    const auto first =
+        std::find_if(weights.begin(), weights.end(), is_non_zero);
+    const auto last =
+        std::find_if(weights.rbegin(), weights.rend(), is_non_zero).base();
+    mel_filters[c].first_bin = first - weights.begin();
+    if (first < last) {
+      mel_filters[c].weights.assign(first, last);
+    }
+  }
+
   return absl::WrapUnique(new LogMelSpectrogramExtractorImpl(
-      std::move(spectrogram), std::move(mel_filterbank), hop_length_samples));
+      std::move(window), std::move(mel_filters), hop_length_samples,
+      kFftSize));
 }
 
-absl::optional<std::vector<float>> LogMelSpectrogramExtractorImpl::Extract(
+absl::optional<FeatureFrame> LogMelSpectrogramExtractorImpl::Extract(
     const absl::Span<const int16_t> audio) {
-  if (audio.size() != hop_length_samples_) {
-    LOG(ERROR) << "Audio frame should have " << hop_length_samples_
-               << " samples but instead had " << audio.size() << ".";
+  return ExtractFrame(audio);
+}
+
+absl::optional<FeatureFrame> LogMelSpectrogramExtractorImpl::ExtractFromFloats(
+    const absl::Span<const float> audio) {
+  return ExtractFrame(audio);
+}
+
+absl::optional<std::vector<float>>
+LogMelSpectrogramExtractorImpl::ExtractPacket(
+    const absl::Span<const int16_t> audio, int num_frames) {
+  return ExtractFrames(audio, num_frames);
+}
+
+absl::optional<std::vector<float>>
+LogMelSpectrogramExtractorImpl::ExtractPacketFromFloats(
+    const absl::Span<const float> audio, int num_frames) {
+  return ExtractFrames(audio, num_frames);
+}
+
+void LogMelSpectrogramExtractorImpl::Reset() {
+  std::fill(samples_.begin(), samples_.end(), 0.0f);
+}
+
+template <typename SampleType>
+absl::optional<FeatureFrame> LogMelSpectrogramExtractorImpl::ExtractFrame(
+    absl::Span<const SampleType> audio) {
+  FeatureFrame mel_features(mel_filters_.size());
+  if (!ExtractHops(audio, /*num_frames=*/1, absl::MakeSpan(mel_features))) {
     return absl::nullopt;
   }
+  return mel_features;
+}
 
-  std::copy(audio.begin(), audio.end(), samples_.begin());
-
-  std::vector<std::vector<double>> spectrogram_slices;
-  if (!spectrogram_->ComputeSpectrogram(samples_, &spectrogram_slices)) {
-    LOG(ERROR) << "Could not compute spectrogram from audio.";
+template <typename SampleType>
+absl::optional<std::vector<float>>
+LogMelSpectrogramExtractorImpl::ExtractFrames(
+    absl::Span<const SampleType> audio, int num_frames) {
+  if (num_frames <= 0) {
+    LOG(ERROR) << "There has to be at least one frame, not " << num_frames
+               << ".";
     return absl::nullopt;
   }
-  if (spectrogram_slices.size() != 1) {
-    LOG(ERROR) << "Spectrogram had unexpected number of output frames.";
+  std::vector<float> mel_features(num_frames * mel_filters_.size());
+  if (!ExtractHops(audio, num_frames, absl::MakeSpan(mel_features))) {
     return absl::nullopt;
   }
+  return mel_features;
+}
+
+template <typename SampleType>
+bool LogMelSpectrogramExtractorImpl::ExtractHops(
+    absl::Span<const SampleType> audio, int num_frames,
+    absl::Span<float> mel_features) {
+  if (audio.size() != num_frames * hop_length_samples_) {
+    LOG(ERROR) << "Audio of " << num_frames << " frames should have "
+               << num_frames * hop_length_samples_
+               << " samples but instead had " << audio.size() << ".";
+    return false;
+  }
+  // Append the hops to the kept samples, so that the window of hop f starts
+  // at sample f * hop_length_samples_.
+  const int num_kept_samples = samples_.size();
+  samples_.resize(num_kept_samples + audio.size());
+  const absl::Span<float> appended =
+      absl::MakeSpan(samples_).subspan(num_kept_samples);
+  if constexpr (std::is_same<SampleType, int16_t>::value) {
+    Int16ToFloat(audio, appended);
+  } else {
+    std::copy(audio.begin(), audio.end(), appended.begin());
+  }
 
-  std::vector<double> temp_features;
-  mel_filterbank_->Compute(spectrogram_slices.at(0), &temp_features);
-  std::vector<float> mel_features(temp_features.begin(), temp_features.end());
+  // Window and zero pad each hop, then transform it in place. rdft leaves the
+  // real parts of the DC and Nyquist bins in the first two entries, followed
+  // by the real and imaginary parts of the other bins.
+  const int window_length = window_.size();
+  const int num_fft_bins = fft_size_ / 2 + 1;
+  fft_buffer_.resize(fft_size_);
+  magnitudes_.resize(num_frames * num_fft_bins);
+  for (int f = 0; f < num_frames; ++f) {
+    const float* samples = samples_.data() + f * hop_length_samples_;
+    for (int i = 0; i < window_length; ++i) {
+      fft_buffer_[i] = samples[i] * window_[i];
+    }
+    std::fill(fft_buffer_.begin() + window_length, fft_buffer_.end(), 0.0);
+    rdft(fft_size_, 1, fft_buffer_.data(), fft_ip_.data(), fft_w_.data());
+    float* magnitudes = magnitudes_.data() + f * num_fft_bins;
+    magnitudes[0] = static_cast<float>(std::abs(fft_buffer_[0]));
+    magnitudes[num_fft_bins - 1] = static_cast<float>(std::abs(fft_buffer_[1]));
+    for (int k = 1; k < num_fft_bins - 1; ++k) {
+      magnitudes[k] = static_cast<float>(
+          std::hypot(fft_buffer_[2 * k], fft_buffer_[2 * k + 1]));
+    }
+  }
+  samples_.erase(samples_.begin(), samples_.end() - num_kept_samples);
+
+  // Each filter is a product of its weights with its range of bins of all
+  // hops, which writes its feature of every hop.
+  const Eigen::Map<const Eigen::MatrixXf> magnitudes(magnitudes_.data(),
+                                                     num_fft_bins, num_frames);
+  const int num_mel_bins = mel_filters_.size();
+  Eigen::Map<Eigen::MatrixXf> features(mel_features.data(), num_mel_bins,
+                                       num_frames);
+  for (int c = 0; c < num_mel_bins; ++c) {
+    const MelFilter& filter = mel_filters_[c];
+    const int num_weights = filter.weights.size();
+    features.row(c).noalias() =
+        Eigen::Map<const Eigen::RowVectorXf>(filter.weights.data(),
+                                             num_weights) *
+        magnitudes.middleRows(filter.first_bin, num_weights);
+  }
   // Compute the log, but disallow values below the floor, then
   // normalize the amplitude to avoid clipping in Wavenet.
-  for (auto& val : mel_features) {
-    val = std::log(std::max(val, kLogFloor)) / kNorm;
-  }
+  features.array() = features.array().max(kLogFloor).log() / kNorm;
 
-  return mel_features;
+  return true;
 }
 
 double LogMelSpectrogramExtractorImpl::GetLowerFreqLimit() {
   return kLowerFreqLimit;
 }
-
 double LogMelSpectrogramExtractorImpl::GetUpperFreqLimit(int sample_rate_hz) {
   return kUpperFreqLimitFactor * sample_rate_hz;
 }
 
+std::vector<std::vector<double>> LogMelSpectrogramExtractorImpl::GetMelWeights(
+    int sample_rate_hz, int num_mel_bins, int num_fft_bins) {
+  return MelWeights(num_fft_bins, sample_rate_hz, num_mel_bins,
+                    kLowerFreqLimit, GetUpperFreqLimit(sample_rate_hz));
+}
+
 float LogMelSpectrogramExtractorImpl::GetNormalizationFactor() { return kNorm; }
 
 float LogMelSpectrogramExtractorImpl::GetSilenceValue() {
@@ -23,14 +23,20 @@
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
-#include "audio/dsp/mfcc/mel_filterbank.h"
-#include "audio/dsp/spectrogram/spectrogram.h"
 #include "feature_extractor_interface.h"
+#include "feature_frame.h"
 
 namespace chromemedia {
 namespace codec {
 
 // This class extracts mel spectrogram features from a frame of audio.
+// The features match those of audio_dsp::Spectrogram followed by
+// audio_dsp::MelFilterbank, a periodic Hann window, the magnitude of the
+// zero padded FFT and HTK style triangular mel filters, but are computed in
+// single precision into buffers kept between calls. Only the FFT itself
+// runs in double precision. All the hops of a packet can be extracted at once,
+// which windows them straight from the packet and applies each mel filter to
+// all of them in one product.
 class LogMelSpectrogramExtractorImpl : public FeatureExtractorInterface {
  public:
   // Returns a nullptr if creation fails.
@@ -43,17 +49,37 @@ class LogMelSpectrogramExtractorImpl : public FeatureExtractorInterface {
   // Extracts the mel features from the audio. On failure returns a nullopt.
   // The size of audio must match the value of hop_length_samples_.
   // This assumes that audio frames are passed in order.
-  absl::optional<std::vector<float>> Extract(
+  absl::optional<FeatureFrame> Extract(
       const absl::Span<const int16_t> audio) override;
 
-  // Returns the lower frequency limit used to initialize the MelFilterbank
-  // class.
+  // Like |Extract|, without rounding the samples to int16 first.
+  absl::optional<FeatureFrame> ExtractFromFloats(
+      const absl::Span<const float> audio) override;
+
+  // Extracts the features of |num_frames| hops at once. The size of audio must
+  // be |num_frames| times hop_length_samples_.
+  absl::optional<std::vector<float>> ExtractPacket(
+      const absl::Span<const int16_t> audio, int num_frames) override;
+
+  // Like |ExtractPacket|, without rounding the samples to int16 first.
+  absl::optional<std::vector<float>> ExtractPacketFromFloats(
+      const absl::Span<const float> audio, int num_frames) override;
+
+  // Zeroes the samples the next window keeps from the previous hops.
+  void Reset() override;
+
+  // Returns the lower frequency limit of the mel filters.
   static double GetLowerFreqLimit();
 
-  // Returns the upper frequency limit used to initialize the MelFilterbank
-  // class.
+  // Returns the upper frequency limit of the mel filters.
   static double GetUpperFreqLimit(int sample_rate_hz);
 
+  // Returns the weight of each of the |num_fft_bins| FFT bins in each of the
+  // |num_mel_bins| mel filters of the features at |sample_rate_hz|.
+  static std::vector<std::vector<double>> GetMelWeights(int sample_rate_hz,
+                                                        int num_mel_bins,
+                                                        int num_fft_bins);
+
   // Returns the normalization factor used to normalize the log of the mel
   // features.
   static float GetNormalizationFactor();
@@ -62,16 +88,47 @@ class LogMelSpectrogramExtractorImpl : public FeatureExtractorInterface {
   static float GetSilenceValue();
 
  private:
+  // The triangular filter of a mel channel, which weights a contiguous range
+  // of FFT bins.
+  struct MelFilter {
+    int first_bin;
+    std::vector<float> weights;
+  };
+
   LogMelSpectrogramExtractorImpl() = delete;
-  LogMelSpectrogramExtractorImpl(
-      std::unique_ptr<audio_dsp::Spectrogram> spectrogram,
-      std::unique_ptr<audio_dsp::MelFilterbank> mel_filterbank,
-      int hop_length_samples);
+  LogMelSpectrogramExtractorImpl(std::vector<float> window,
+                                 std::vector<MelFilter> mel_filters,
+                                 int hop_length_samples, int fft_size);
+
+  // Writes the features of the |num_frames| hops of |audio|, concatenated,
+  // into |mel_features| and slides the window past them. Returns false if
+  // |audio| does not have |num_frames| hops.
+  template <typename SampleType>
+  bool ExtractHops(absl::Span<const SampleType> audio, int num_frames,
+                   absl::Span<float> mel_features);
+
+  // Returns the |ExtractHops| of a single hop, or of |num_frames| hops.
+  template <typename SampleType>
+  absl::optional<FeatureFrame> ExtractFrame(
+      absl::Span<const SampleType> audio);
+  template <typename SampleType>
+  absl::optional<std::vector<float>> ExtractFrames(
+      absl::Span<const SampleType> audio, int num_frames);
 
-  const std::unique_ptr<audio_dsp::Spectrogram> spectrogram_;
-  const std::unique_ptr<const audio_dsp::MelFilterbank> mel_filterbank_;
+  const std::vector<float> window_;
+  const std::vector<MelFilter> mel_filters_;
   const int hop_length_samples_;
-  std::vector<double> samples_;
+  const int fft_size_;
+  // The samples of the last window that the next hop keeps, followed by the
+  // hops being extracted while they are.
+  std::vector<float> samples_;
+  // The windowed samples of each hop, transformed in place.
+  std::vector<double> fft_buffer_;
+  // The bit reversal and twiddle factor tables of the FFT.
+  std::vector<int> fft_ip_;
+  std::vector<double> fft_w_;
+  // The magnitude of each FFT bin of each hop, a hop after the other.
+  std::vector<float> magnitudes_;
 };
 
 }  // namespace codec
@@ -20,17 +20,19 @@
 #include "absl/random/random.h"
 #include "absl/types/span.h"
 #include "benchmark/benchmark.h"
+#include "fixed_point_log_mel_spectrogram_extractor.h"
 #include "log_mel_spectrogram_extractor_impl.h"
 
 static constexpr int kTestSampleRateHz = 16000;
 static constexpr int kNumMelBins = 10;
 
+template <typename FeatureExtractor =
+              chromemedia::codec::LogMelSpectrogramExtractorImpl>
 void BenchmarkExtractFrames(benchmark::State& state, const int hop_length,
                             const int window_length) {
-  std::unique_ptr<chromemedia::codec::LogMelSpectrogramExtractorImpl>
-      feature_extractor_ =
-          chromemedia::codec::LogMelSpectrogramExtractorImpl::Create(
-              kTestSampleRateHz, kNumMelBins, hop_length, window_length);
+  std::unique_ptr<FeatureExtractor> feature_extractor_ =
+      FeatureExtractor::Create(kTestSampleRateHz, kNumMelBins, hop_length,
+                               window_length);
   // We create random audio vectors to avoid any caching in the benchmark.
   const int16_t num_rand_vectors = 10000;
   absl::BitGen gen;
@@ -65,8 +67,44 @@ void BM_ExtractMediumFramesLongWindows(benchmark::State& state) {
   BenchmarkExtractFrames(state, 480, 4800);
 }
 
+// Extracts the medium frames of |state.range(0)| hops at once.
+void BM_ExtractPacketsOfMediumFrames(benchmark::State& state) {
+  constexpr int kHopLength = 480;
+  const int num_frames = state.range(0);
+  std::unique_ptr<chromemedia::codec::LogMelSpectrogramExtractorImpl>
+      feature_extractor =
+          chromemedia::codec::LogMelSpectrogramExtractorImpl::Create(
+              kTestSampleRateHz, kNumMelBins, kHopLength, 2 * kHopLength);
+  absl::BitGen gen;
+  std::vector<int16_t> audio(num_frames * kHopLength);
+  for (auto& sample : audio) {
+    sample = absl::Uniform<uint16_t>(gen);
+  }
+
+  for (auto _ : state) {
+    auto features_or = feature_extractor->ExtractPacket(audio, num_frames);
+    benchmark::DoNotOptimize(features_or);
+  }
+  state.SetItemsProcessed(state.iterations() * num_frames);
+}
+
+void BM_ExtractMediumFramesFixedPoint(benchmark::State& state) {
+  BenchmarkExtractFrames<
+      chromemedia::codec::FixedPointLogMelSpectrogramExtractor>(state, 480,
+                                                                 960);
+}
+
+void BM_ExtractLargeFramesFixedPoint(benchmark::State& state) {
+  BenchmarkExtractFrames<
+      chromemedia::codec::FixedPointLogMelSpectrogramExtractor>(state, 2400,
+                                                                 4800);
+}
+
 BENCHMARK(BM_ExtractSmallFrames);
 BENCHMARK(BM_ExtractMediumFrames);
 BENCHMARK(BM_ExtractLargeFrames);
 BENCHMARK(BM_ExtractMediumFramesLongWindows);
+BENCHMARK(BM_ExtractPacketsOfMediumFrames)->Arg(1)->Arg(3)->Arg(10);
+BENCHMARK(BM_ExtractMediumFramesFixedPoint);
+BENCHMARK(BM_ExtractLargeFramesFixedPoint);
 BENCHMARK_MAIN();
@@ -14,12 +14,16 @@
 
 #include "log_mel_spectrogram_extractor_impl.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <vector>
 
 #include "absl/types/span.h"
+#include "feature_frame.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -32,6 +36,8 @@ static constexpr int kNumMelBins = 10;
 static constexpr int kHopLengthSamples = 5;
 static constexpr int kWindowLengthSamples = 10;
 static constexpr int kNumOutputMelBins = 3;
+// The features are computed in single precision.
+static constexpr float kTolerance = 1e-5f;
 
 static constexpr int16_t kWavData[] = {7954,   10085, 8733,   10844,  29949,
                                        -549,   20833, 30345,  18086,  11375,
@@ -77,11 +83,151 @@ TEST_F(LogMelSpectrogramExtractorImplTest, ThreeFramesEqualExpected) {
     auto features_or = feature_extractor_->Extract(audio_frame);
 
     EXPECT_TRUE(features_or.has_value());
-    EXPECT_THAT(features_or.value(),
-                testing::Pointwise(testing::FloatEq(), kMelBins[i]));
+    EXPECT_THAT(
+        features_or.value(),
+        testing::Pointwise(testing::FloatNear(kTolerance), kMelBins[i]));
   }
 }
 
+TEST_F(LogMelSpectrogramExtractorImplTest, FloatFramesEqualExpected) {
+  for (int i = 0; i < kNumOutputMelBins; ++i) {
+    const std::vector<float> audio_frame(
+        &kWavData[i * kHopLengthSamples],
+        &kWavData[i * kHopLengthSamples] + kHopLengthSamples);
+
+    auto features_or = feature_extractor_->ExtractFromFloats(audio_frame);
+
+    EXPECT_TRUE(features_or.has_value());
+    EXPECT_THAT(
+        features_or.value(),
+        testing::Pointwise(testing::FloatNear(kTolerance), kMelBins[i]));
+  }
+}
+
+TEST_F(LogMelSpectrogramExtractorImplTest, ResetStartsTheStreamOver) {
+  for (int i = 0; i < kNumOutputMelBins; ++i) {
+    ASSERT_TRUE(feature_extractor_
+                    ->Extract(absl::MakeConstSpan(
+                        &kWavData[i * kHopLengthSamples], kHopLengthSamples))
+                    .has_value());
+  }
+  feature_extractor_->Reset();
+
+  auto features_or = feature_extractor_->Extract(
+      absl::MakeConstSpan(&kWavData[0], kHopLengthSamples));
+
+  ASSERT_TRUE(features_or.has_value());
+  EXPECT_THAT(features_or.value(),
+              testing::Pointwise(testing::FloatNear(kTolerance), kMelBins[0]));
+}
+
+TEST(LogMelSpectrogramExtractorImplProdTest, SilenceIsAtTheFloor) {
+  auto feature_extractor = LogMelSpectrogramExtractorImpl::Create(
+      kTestSampleRateHz, 160, 320, 640);
+  ASSERT_NE(feature_extractor, nullptr);
+  const std::vector<int16_t> silence(320, 0);
+
+  auto features_or = feature_extractor->Extract(silence);
+
+  ASSERT_TRUE(features_or.has_value());
+  EXPECT_THAT(features_or.value(),
+              testing::Each(testing::FloatNear(
+                  LogMelSpectrogramExtractorImpl::GetSilenceValue(),
+                  kTolerance)));
+}
+
+TEST(LogMelSpectrogramExtractorImplProdTest, ToneIsInItsMelBin) {
+  constexpr int kNumProdMelBins = 160;
+  constexpr int kHopLength = 320;
+  constexpr float kToneHz = 1000.0f;
+  auto feature_extractor = LogMelSpectrogramExtractorImpl::Create(
+      kTestSampleRateHz, kNumProdMelBins, kHopLength, 2 * kHopLength);
+  ASSERT_NE(feature_extractor, nullptr);
+
+  FeatureFrame features;
+  for (int hop = 0; hop < 2; ++hop) {
+    std::vector<int16_t> tone(kHopLength);
+    for (int i = 0; i < kHopLength; ++i) {
+      tone[i] = static_cast<int16_t>(
+          10000.0f * std::sin(2.0f * M_PI * kToneHz * (hop * kHopLength + i) /
+                              kTestSampleRateHz));
+    }
+    auto features_or = feature_extractor->Extract(tone);
+    ASSERT_TRUE(features_or.has_value());
+    features = features_or.value();
+  }
+
+  // The mel filters are evenly spaced between 0 and the upper limit, with
+  // the center of filter i at (i + 1) times the spacing.
+  const auto to_mel = [](double hz) { return 1127.0 * std::log1p(hz / 700.0); };
+  const double mel_spacing =
+      to_mel(LogMelSpectrogramExtractorImpl::GetUpperFreqLimit(
+          kTestSampleRateHz)) /
+      (kNumProdMelBins + 1);
+  const int expected_bin =
+      static_cast<int>(std::round(to_mel(kToneHz) / mel_spacing)) - 1;
+  const int loudest_bin = std::distance(
+      features.begin(), std::max_element(features.begin(), features.end()));
+  EXPECT_NEAR(loudest_bin, expected_bin, 1);
+}
+
+TEST_F(LogMelSpectrogramExtractorImplTest, PacketEqualsExpected) {
+  auto features_or = feature_extractor_->ExtractPacket(
+      absl::MakeConstSpan(kWavData, kNumOutputMelBins * kHopLengthSamples),
+      kNumOutputMelBins);
+
+  ASSERT_TRUE(features_or.has_value());
+  ASSERT_EQ(features_or->size(), kNumOutputMelBins * kNumMelBins);
+  for (int i = 0; i < kNumOutputMelBins; ++i) {
+    EXPECT_THAT(absl::MakeConstSpan(*features_or)
+                    .subspan(i * kNumMelBins, kNumMelBins),
+                testing::Pointwise(testing::FloatNear(kTolerance),
+                                   kMelBins[i]));
+  }
+}
+
+TEST(LogMelSpectrogramExtractorImplProdTest, PacketEqualsHopByHop) {
+  constexpr int kNumProdMelBins = 160;
+  constexpr int kHopLength = 320;
+  constexpr int kNumHops = 3;
+  auto packet_extractor = LogMelSpectrogramExtractorImpl::Create(
+      kTestSampleRateHz, kNumProdMelBins, kHopLength, 2 * kHopLength);
+  auto hop_extractor = LogMelSpectrogramExtractorImpl::Create(
+      kTestSampleRateHz, kNumProdMelBins, kHopLength, 2 * kHopLength);
+  ASSERT_NE(packet_extractor, nullptr);
+  ASSERT_NE(hop_extractor, nullptr);
+  std::vector<float> samples(2 * kNumHops * kHopLength);
+  for (int i = 0; i < samples.size(); ++i) {
+    samples[i] = 8000.5f * std::sin(0.05f * i) * std::cos(0.0013f * i);
+  }
+
+  // Two packets, so that the second one starts from the window the first one
+  // left.
+  for (int packet = 0; packet < 2; ++packet) {
+    const auto packet_samples = absl::MakeConstSpan(samples).subspan(
+        packet * kNumHops * kHopLength, kNumHops * kHopLength);
+    auto features_or =
+        packet_extractor->ExtractPacketFromFloats(packet_samples, kNumHops);
+    ASSERT_TRUE(features_or.has_value());
+    ASSERT_EQ(features_or->size(), kNumHops * kNumProdMelBins);
+    for (int hop = 0; hop < kNumHops; ++hop) {
+      auto hop_features_or = hop_extractor->ExtractFromFloats(
+          packet_samples.subspan(hop * kHopLength, kHopLength));
+      ASSERT_TRUE(hop_features_or.has_value());
+      EXPECT_THAT(absl::MakeConstSpan(*features_or)
+                      .subspan(hop * kNumProdMelBins, kNumProdMelBins),
+                  testing::Pointwise(testing::FloatEq(), *hop_features_or));
+    }
+  }
+}
+
+TEST_F(LogMelSpectrogramExtractorImplTest, PacketOfWrongSizeFails) {
+  std::vector<int16_t> audio(2 * kHopLengthSamples + 1);
+
+  EXPECT_FALSE(feature_extractor_->ExtractPacket(audio, 2).has_value());
+  EXPECT_FALSE(feature_extractor_->ExtractPacket(audio, 0).has_value());
+}
+
 TEST_F(LogMelSpectrogramExtractorImplTest, FrameLongerThanExpected) {
   std::vector<int16_t> audio_frame(kHopLengthSamples + 1);
 
@@ -91,6 +237,15 @@ TEST_F(LogMelSpectrogramExtractorImplTest, FrameLongerThanExpected) {
   EXPECT_FALSE(features_or.has_value());
 }
 
+TEST_F(LogMelSpectrogramExtractorImplTest, FloatFrameLongerThanExpected) {
+  std::vector<float> audio_frame(kHopLengthSamples + 1);
+
+  auto features_or =
+      feature_extractor_->ExtractFromFloats(absl::MakeConstSpan(audio_frame));
+
+  EXPECT_FALSE(features_or.has_value());
+}
+
 TEST_F(LogMelSpectrogramExtractorImplTest, FrameShorterThanExpected) {
   std::vector<int16_t> audio_frame(kWavData, kWavData + kHopLengthSamples - 1);
 
@@ -0,0 +1,167 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "logistic_sampling.h"
+
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#endif  // defined __x86_64__ || defined __i386__
+
+#include "cpu_features.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+void SampleScalar(const float* means, const float* scales,
+                  const float* uniforms, float probability_offset,
+                  int num_samples, int* samples) {
+  for (int i = 0; i < num_samples; ++i) {
+    samples[i] = SampleTruncatedLogistic(means[i], scales[i], uniforms[i],
+                                         probability_offset);
+  }
+}
+
+#if defined __x86_64__ || defined __i386__
+
+// The x86 kernels are compiled for AVX2 regardless of the flags of the rest of
+// the binary, and are only called after checking the running CPU.
+#define LYRA_TARGET_AVX2 __attribute__((target("avx2,fma")))
+
+// Single precision exp and log of four lanes, using the range reductions and
+// polynomials of the Cephes library. Both are accurate to 2 ulp over the
+// ranges used here.
+using Float4 = __m128;
+
+LYRA_TARGET_AVX2 inline Float4 Exp4(Float4 x) {
+  x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-88.3762626647949f)),
+                 _mm_set1_ps(88.3762626647949f));
+  const Float4 fx = _mm_floor_ps(_mm_add_ps(
+      _mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+  Float4 y = _mm_set1_ps(1.9875691500e-4f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)),
+                 _mm_add_ps(x, _mm_set1_ps(1.0f)));
+  const __m128i exponent = _mm_slli_epi32(
+      _mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(y, _mm_castsi128_ps(exponent));
+}
+
+LYRA_TARGET_AVX2 inline Float4 Log4(Float4 x) {
+  x = _mm_max_ps(x, _mm_set1_ps(std::numeric_limits<float>::min()));
+  const __m128i bits = _mm_castps_si128(x);
+  Float4 e = _mm_cvtepi32_ps(
+      _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+  // The mantissa in [0.5, 1).
+  x = _mm_castsi128_ps(
+      _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(~0x7f800000)),
+                   _mm_set1_epi32(0x3f000000)));
+  const Float4 small = _mm_cmplt_ps(x, _mm_set1_ps(0.707106781186547524f));
+  e = _mm_sub_ps(e, _mm_and_ps(small, _mm_set1_ps(1.0f)));
+  x = _mm_add_ps(_mm_sub_ps(x, _mm_set1_ps(1.0f)), _mm_and_ps(small, x));
+  const Float4 z = _mm_mul_ps(x, x);
+  Float4 y = _mm_set1_ps(7.0376836292e-2f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.1514610310e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.1676998740e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.2420140846e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.4249322787e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.6668057665e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(2.0000714765e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-2.4999993993e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(3.3333331174e-1f));
+  y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+  y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+  y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+  return _mm_add_ps(_mm_add_ps(x, y),
+                    _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+}
+
+LYRA_TARGET_AVX2 inline void SampleFour(const float* means, const float* scales,
+                       const float* uniforms, float probability_offset,
+                       int* samples) {
+  const Float4 scale = _mm_loadu_ps(scales);
+  const Float4 abs_scale = _mm_andnot_ps(_mm_set1_ps(-0.0f), scale);
+  // Softplus as max(x, 0) + log(1 + exp(-|x|)), which cannot overflow.
+  const Float4 softplus = _mm_add_ps(
+      _mm_max_ps(scale, _mm_setzero_ps()),
+      Log4(_mm_add_ps(_mm_set1_ps(1.0f),
+                      Exp4(_mm_sub_ps(_mm_setzero_ps(), abs_scale)))));
+  const Float4 prob =
+      _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(uniforms),
+                            _mm_set1_ps(1.0f - 2.0f * probability_offset)),
+                 _mm_set1_ps(probability_offset));
+  const Float4 inverse_cdf =
+      Log4(_mm_div_ps(_mm_sub_ps(_mm_set1_ps(1.0f), prob), prob));
+  Float4 result = _mm_mul_ps(
+      _mm_add_ps(_mm_loadu_ps(means), _mm_mul_ps(softplus, inverse_cdf)),
+      _mm_set1_ps(256.0f));
+  result = _mm_min_ps(_mm_max_ps(result, _mm_set1_ps(-32768.0f)),
+                      _mm_set1_ps(32767.0f));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(samples),
+                   _mm_cvttps_epi32(result));
+}
+
+LYRA_TARGET_AVX2 void SampleAvx2(const float* means, const float* scales,
+                                 const float* uniforms,
+                                 float probability_offset, int num_samples,
+                                 int* samples) {
+  int i = 0;
+  for (; i + 4 <= num_samples; i += 4) {
+    SampleFour(means + i, scales + i, uniforms + i, probability_offset,
+               samples + i);
+  }
+  SampleScalar(means + i, scales + i, uniforms + i, probability_offset,
+               num_samples - i, samples + i);
+}
+
+#undef LYRA_TARGET_AVX2
+
+#endif  // defined __x86_64__ || defined __i386__
+
+}  // namespace
+
+LogisticSamplingKernel GetLogisticSamplingKernel(CpuIsa isa) {
+  CHECK(IsCpuIsaSupported(isa))
+      << "CPU does not support " << CpuIsaName(isa) << ".";
+  switch (isa) {
+#if defined __x86_64__ || defined __i386__
+    // The mixture of logistics is sampled a handful of values at a time, too
+    // few to fill the 16 lanes of AVX-512.
+    case CpuIsa::kAvx512:
+    case CpuIsa::kAvx2:
+      return SampleAvx2;
+#endif  // defined __x86_64__ || defined __i386__
+    // Including NEON and SVE, which have no kernel of their own.
+    default:
+      return SampleScalar;
+  }
+}
+
+void SampleTruncatedLogistics(const float* means, const float* scales,
+                              const float* uniforms, float probability_offset,
+                              int num_samples, int* samples) {
+  static const LogisticSamplingKernel kKernel =
+      GetLogisticSamplingKernel(DetectCpuIsa());
+  kKernel(means, scales, uniforms, probability_offset, num_samples, samples);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LOGISTIC_SAMPLING_H_
+#define LYRA_CODEC_LOGISTIC_SAMPLING_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "cpu_features.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Draws one sample of a logistic distribution with location |mean| and scale
+// softplus(|scale|), truncated to the probability range
+// [|probability_offset|, 1 - |probability_offset|], by inverting its CDF at
+// |uniform|, which must be in [0, 1). Returns the sample in 8.8 fixed point,
+// clamped to the range of int16_t.
+inline int SampleTruncatedLogistic(float mean, float scale, float uniform,
+                                   float probability_offset) {
+  // Softplus the scale.
+  scale = logf(expf(scale) + 1.0f);
+  const float kProbabilityScale = 1.0f - 2.0f * probability_offset;
+  const float prob = uniform * kProbabilityScale + probability_offset;
+  const float f_result = mean + scale * log((1.0f - prob) / prob);
+  return std::min(
+      static_cast<int>(std::numeric_limits<int16_t>::max()),
+      std::max(static_cast<int>(std::numeric_limits<int16_t>::min()),
+               static_cast<int>(f_result * 256)));
+}
+
+// Signature of a kernel that draws |num_samples| samples with
+// |SampleTruncatedLogistic|, reading the i-th sample's parameters from
+// |means|[i], |scales|[i] and |uniforms|[i] and writing it to |samples|[i].
+using LogisticSamplingKernel = void (*)(const float* means, const float* scales,
+                                        const float* uniforms,
+                                        float probability_offset,
+                                        int num_samples, int* samples);
+
+// Returns the fastest kernel that runs on |isa|. The vectorized kernels
+// process four samples at a time and may differ from the scalar version by one
+// unit in the last place of the 8.8 fixed point output. |isa| must be
+// supported by the running CPU.
+LogisticSamplingKernel GetLogisticSamplingKernel(CpuIsa isa);
+
+// Draws the samples with the kernel for the instruction set detected at
+// runtime, see |GetLogisticSamplingKernel|.
+void SampleTruncatedLogistics(const float* means, const float* scales,
+                              const float* uniforms, float probability_offset,
+                              int num_samples, int* samples);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LOGISTIC_SAMPLING_H_
@@ -0,0 +1,106 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "logistic_sampling.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "cpu_features.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static constexpr float kProbabilityOffset = 1e-5f;
+
+TEST(SampleTruncatedLogisticTest, MedianIsTheMean) {
+  EXPECT_EQ(SampleTruncatedLogistic(0.25f, 1.0f, 0.5f, kProbabilityOffset), 64);
+}
+
+TEST(SampleTruncatedLogisticTest, ClampsToInt16) {
+  EXPECT_EQ(SampleTruncatedLogistic(1000.f, 1.0f, 0.5f, kProbabilityOffset),
+            32767);
+  EXPECT_EQ(SampleTruncatedLogistic(-1000.f, 1.0f, 0.5f, kProbabilityOffset),
+            -32768);
+}
+
+TEST(SampleTruncatedLogisticTest, LowUniformsGiveLargeSamples) {
+  // The inverse CDF is decreasing in this parameterization.
+  EXPECT_GT(SampleTruncatedLogistic(0.f, 0.f, 0.01f, kProbabilityOffset),
+            SampleTruncatedLogistic(0.f, 0.f, 0.99f, kProbabilityOffset));
+}
+
+class SampleTruncatedLogisticsTest : public testing::TestWithParam<CpuIsa> {};
+
+TEST_P(SampleTruncatedLogisticsTest, MatchesScalarVersion) {
+  if (!IsCpuIsaSupported(GetParam())) {
+    GTEST_SKIP() << CpuIsaName(GetParam()) << " is not supported.";
+  }
+  std::minstd_rand gen(42);
+  std::uniform_real_distribution<float> location(-4.f, 4.f);
+  std::uniform_real_distribution<float> scale(-12.f, 6.f);
+  std::uniform_real_distribution<float> uniform;
+  // Not a multiple of four, to also cover the scalar tail.
+  const int kNumSamples = 4003;
+  std::vector<float> means(kNumSamples);
+  std::vector<float> scales(kNumSamples);
+  std::vector<float> uniforms(kNumSamples);
+  for (int i = 0; i < kNumSamples; ++i) {
+    means[i] = location(gen);
+    scales[i] = scale(gen);
+    uniforms[i] = uniform(gen);
+  }
+  // Include the extremes of the truncated range.
+  uniforms[0] = 0.f;
+  uniforms[1] = std::nextafter(1.f, 0.f);
+
+  std::vector<int> samples(kNumSamples);
+  GetLogisticSamplingKernel(GetParam())(means.data(), scales.data(),
+                                        uniforms.data(), kProbabilityOffset,
+                                        kNumSamples, samples.data());
+
+  for (int i = 0; i < kNumSamples; ++i) {
+    EXPECT_LE(std::abs(samples[i] -
+                       SampleTruncatedLogistic(means[i], scales[i], uniforms[i],
+                                               kProbabilityOffset)),
+              1)
+        << "mean=" << means[i] << " scale=" << scales[i]
+        << " uniform=" << uniforms[i];
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(CpuIsas, SampleTruncatedLogisticsTest,
+                         testing::Values(CpuIsa::kGeneric, CpuIsa::kNeon,
+                                         CpuIsa::kSve, CpuIsa::kAvx2,
+                                         CpuIsa::kAvx512));
+
+TEST(SampleTruncatedLogisticsDispatchTest, UsesDetectedKernel) {
+  const float means[] = {0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+  const float scales[] = {1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+  const float uniforms[] = {0.5f, 0.5f, 0.5f, 0.5f, 0.5f};
+  int samples[5];
+  SampleTruncatedLogistics(means, scales, uniforms, kProbabilityOffset, 5,
+                           samples);
+  for (const int sample : samples) {
+    EXPECT_EQ(sample, 64);
+  }
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
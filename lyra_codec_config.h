@@ -0,0 +1,75 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_CODEC_CONFIG_H_
+#define LYRA_CODEC_LYRA_CODEC_CONFIG_H_
+
+#include <climits>
+#include <type_traits>
+
+namespace chromemedia {
+namespace codec {
+
+// The dimensions of a codec known at compile time, so that the loops over
+// them can be specialized, unrolled and vectorized for their sizes. The
+// runtime constants of lyra_config.h are defined from |LyraDefaultCodecConfig|
+// and stay the interface of code that does not need the sizes statically.
+template <int NumFeatures, int NumExpectedOutputFeatures,
+          int NumFramesPerPacket, int PacketSize>
+struct LyraCodecConfig {
+  static_assert(NumFeatures > 0, "There has to be at least one feature.");
+  static_assert(NumExpectedOutputFeatures > 0,
+                "There has to be at least one output feature.");
+  static_assert(NumFramesPerPacket > 0,
+                "There has to be at least one frame per packet.");
+  static_assert(PacketSize > 0, "Packets cannot be empty.");
+
+  static constexpr int kNumFeatures = NumFeatures;
+  static constexpr int kNumExpectedOutputFeatures = NumExpectedOutputFeatures;
+  static constexpr int kNumFramesPerPacket = NumFramesPerPacket;
+  static constexpr int kPacketSize = PacketSize;
+  // The features quantized into each packet.
+  static constexpr int kNumQuantizedFeatures =
+      NumFramesPerPacket * NumExpectedOutputFeatures;
+  static constexpr int kNumPacketBits = PacketSize * CHAR_BIT;
+};
+
+// The configuration the code and weights are built for.
+using LyraDefaultCodecConfig =
+    LyraCodecConfig</*NumFeatures=*/160, /*NumExpectedOutputFeatures=*/160,
+                    /*NumFramesPerPacket=*/1, /*PacketSize=*/15>;
+
+// Calls |function| with the size of a loop as a template argument: |Size| if
+// |size| equals it, so that the loop is compiled for that size, and 0
+// otherwise, in which case the loop has to fall back to |size|. See |Extent|.
+template <int Size, typename Function>
+inline auto DispatchOnSize(int size, Function&& function) {
+  if (size == Size) {
+    return function(std::integral_constant<int, Size>());
+  }
+  return function(std::integral_constant<int, 0>());
+}
+
+// The size of a loop specialized by |DispatchOnSize|.
+template <int StaticSize>
+constexpr int Extent(int size) {
+  return StaticSize > 0 ? StaticSize : size;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_CODEC_CONFIG_H_
@@ -15,16 +15,27 @@
 #include "lyra_components.h"
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "Eigen/Core"
 #include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "compute_precision.h"
 #include "feature_extractor_interface.h"
+#include "fixed_point_log_mel_spectrogram_extractor.h"
 #include "generative_model_interface.h"
 #include "log_mel_spectrogram_extractor_impl.h"
+#include "lyra_codec_config.h"
+#include "lyra_model.h"
 #include "packet.h"
 #include "packet_interface.h"
+#include "quantized_bits.h"
 #include "vector_quantizer_impl.h"
 #include "vector_quantizer_interface.h"
 #include "wavegru_model_impl.h"
@@ -39,13 +50,59 @@ constexpr int kNumHeaderBits = 0;
 // LINT.ThenChange(
 // lyra_config.cc,
 // )
+static_assert(Packet<kNumQuantizedBits, kNumHeaderBits>::kPacketSize ==
+                  LyraDefaultCodecConfig::kPacketSize,
+              "The packets have to be as long as the codec configuration.");
+
+// Forwards to a quantizer that is shared through a |LyraModel|. Quantization
+// is const, so a single instance can serve any number of encoders and
+// decoders.
+class SharedVectorQuantizer : public VectorQuantizerInterface {
+ public:
+  explicit SharedVectorQuantizer(
+      std::shared_ptr<const VectorQuantizerImpl> quantizer)
+      : quantizer_(std::move(quantizer)) {}
+
+  absl::optional<QuantizedBits> Quantize(
+      const std::vector<float>& features) const override {
+    return quantizer_->Quantize(features);
+  }
+
+  absl::optional<std::vector<QuantizedBits>> QuantizeBatch(
+      absl::Span<const float> features, int num_vectors) const override {
+    return quantizer_->QuantizeBatch(features, num_vectors);
+  }
+
+  std::vector<float> DecodeToLossyFeatures(
+      const QuantizedBits& quantized_features) const override {
+    return quantizer_->DecodeToLossyFeatures(quantized_features);
+  }
+
+ private:
+  const std::shared_ptr<const VectorQuantizerImpl> quantizer_;
+};
 
 }  // namespace
 
 std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
     int num_output_features, int num_bits,
-    const ghc::filesystem::path& model_path) {
-  return VectorQuantizerImpl::Create(num_output_features, num_bits, model_path);
+    const ghc::filesystem::path& model_path, LyraModel* model) {
+  if (model == nullptr) {
+    return VectorQuantizerImpl::Create(num_output_features, num_bits,
+                                       model_path);
+  }
+  const std::function<std::unique_ptr<VectorQuantizerImpl>()> loader = [&]() {
+    return VectorQuantizerImpl::Create(num_output_features, num_bits,
+                                       model_path);
+  };
+  auto quantizer = model->GetOrLoad(
+      absl::StrCat(model_path.string(), "/quantizer:", num_output_features,
+                   ":", num_bits),
+      loader);
+  if (quantizer == nullptr) {
+    return nullptr;
+  }
+  return absl::make_unique<SharedVectorQuantizer>(std::move(quantizer));
 }
 
 std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
@@ -60,14 +117,23 @@ std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
 
 std::unique_ptr<GenerativeModelInterface> CreateGenerativeModel(
     int num_samples_per_hop, int num_output_features, int num_frames_per_packet,
-    const ghc::filesystem::path& model_path) {
-  return WavegruModelImpl::Create(num_samples_per_hop, num_output_features,
-                                  num_frames_per_packet, model_path);
+    const ghc::filesystem::path& model_path, int num_threads, LyraModel* model,
+    ComputePrecision precision, int output_sample_rate_hz,
+    std::shared_ptr<ThreadPool> thread_pool) {
+  return WavegruModelImpl::Create(
+      num_samples_per_hop, num_output_features, num_frames_per_packet,
+      model_path, num_threads, model, precision, output_sample_rate_hz,
+      std::move(thread_pool));
 }
 
 std::unique_ptr<FeatureExtractorInterface> CreateFeatureExtractor(
     int sample_rate_hz, int num_features, int num_samples_per_hop,
-    int num_samples_per_frame) {
+    int num_samples_per_frame, bool fixed_point) {
+  if (fixed_point) {
+    return FixedPointLogMelSpectrogramExtractor::Create(
+        sample_rate_hz, num_features, num_samples_per_hop,
+        num_samples_per_frame);
+  }
   return LogMelSpectrogramExtractorImpl::Create(
       sample_rate_hz, num_features, num_samples_per_hop, num_samples_per_frame);
 }
@@ -23,19 +23,25 @@
 
 #include "Eigen/Core"
 #include "absl/status/statusor.h"
+#include "compute_precision.h"
 #include "denoiser_interface.h"
 #include "feature_extractor_interface.h"
 #include "generative_model_interface.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_model.h"
 #include "packet_interface.h"
+#include "thread_pool.h"
 #include "vector_quantizer_interface.h"
 
 namespace chromemedia {
 namespace codec {
 
+// If |model| is not null the quantizer tables are shared with every other
+// quantizer created through it.
 std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
     int num_output_features, int num_bits,
-    const ghc::filesystem::path& model_path);
+    const ghc::filesystem::path& model_path, LyraModel* model = nullptr);
 
 std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
     int num_features, int num_bits, const Eigen::RowVectorXf& mean_vector,
@@ -43,13 +49,29 @@ std::unique_ptr<VectorQuantizerInterface> CreateQuantizer(
     const std::vector<float>& code_vectors,
     const std::vector<int16_t>& codebook_dimensions);
 
+// |num_threads| is the number of threads used to run a single instance of the
+// generative model, including the calling thread.
+// If |model| is not null the weights are shared with every other generative
+// model created through it.
+// |precision| selects the arithmetic of the generative model.
+// |num_samples_per_hop| is at |kInternalSampleRateHz|. The samples are
+// generated at |output_sample_rate_hz|, which may only be lower if the model
+// can produce it without resampling.
+// If |thread_pool| is not null the model runs on its threads instead of on a
+// pool of its own.
 std::unique_ptr<GenerativeModelInterface> CreateGenerativeModel(
     int num_samples_per_hop, int num_output_features, int num_frames_per_packet,
-    const ghc::filesystem::path& model_path);
+    const ghc::filesystem::path& model_path, int num_threads = 1,
+    LyraModel* model = nullptr,
+    ComputePrecision precision = kDefaultComputePrecision,
+    int output_sample_rate_hz = kInternalSampleRateHz,
+    std::shared_ptr<ThreadPool> thread_pool = nullptr);
 
+// If |fixed_point| the features are extracted in integer arithmetic, with
+// |FixedPointLogMelSpectrogramExtractor|.
 std::unique_ptr<FeatureExtractorInterface> CreateFeatureExtractor(
     int sample_rate_hz, int num_features, int num_samples_per_hop,
-    int num_samples_per_frame);
+    int num_samples_per_frame, bool fixed_point = false);
 
 absl::StatusOr<std::unique_ptr<DenoiserInterface>> CreateDenoiser(
     const ghc::filesystem::path& model_path);
@@ -17,6 +17,9 @@
 #include <climits>
 
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "lyra_codec_config.h"
 
 namespace chromemedia {
 namespace codec {
@@ -33,17 +36,18 @@ const int kVersionMinor = 0;
 // The micro version is for other things like a release of bugfixes.
 const int kVersionMicro = 1;
 
-const int kNumFeatures = 160;
-const int kNumExpectedOutputFeatures = 160;
+const int kNumFeatures = LyraDefaultCodecConfig::kNumFeatures;
+const int kNumExpectedOutputFeatures =
+    LyraDefaultCodecConfig::kNumExpectedOutputFeatures;
 const int kNumChannels = 1;
 const int kFrameRate = 25;
 const int kFrameOverlapFactor = 2;
-const int kNumFramesPerPacket = 1;
+const int kNumFramesPerPacket = LyraDefaultCodecConfig::kNumFramesPerPacket;
 
 // TODO(b/133794927): Calculation of kPacketSize will be determined by future
 // considerations.
 // LINT.IfChange
-const int kPacketSize = 15;
+const int kPacketSize = LyraDefaultCodecConfig::kPacketSize;
 // LINT.ThenChange(
 // lyra_components.cc,
 // )
@@ -57,5 +61,24 @@ const std::string& GetVersionString() {
   return kVersionString;
 }
 
+const char* ModelRoleName(ModelRole role) {
+  switch (role) {
+    case ModelRole::kEncoder:
+      return "encoder";
+    case ModelRole::kDecoder:
+      return "decoder";
+  }
+  return "unknown";
+}
+
+absl::optional<ModelRole> ModelRoleFromName(absl::string_view name) {
+  for (const ModelRole role : {ModelRole::kEncoder, ModelRole::kDecoder}) {
+    if (name == ModelRoleName(role)) {
+      return role;
+    }
+  }
+  return absl::nullopt;
+}
+
 }  // namespace codec
 }  // namespace chromemedia
@@ -19,17 +19,26 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
 
 #include "absl/base/attributes.h"
 #include "absl/status/status.h"
+#include "absl/strings/match.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/types/optional.h"
 #include "glog/logging.h"
 #include "google/protobuf/text_format.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_config.pb.h"
+#include "model_bundle.h"
 
 namespace chromemedia {
 namespace codec {
@@ -39,6 +48,9 @@ namespace codec {
 // is chosen to be compiled.  As a result, a struct holding the configuration
 // data is defined to ensure each new target added and each new configuration
 // element is explicitly defined.
+//
+// The sizes are also known at compile time as |LyraDefaultCodecConfig| of
+// lyra_codec_config.h, for loops specialized for them.
 
 ABSL_CONST_INIT extern const int kVersionMajor;
 ABSL_CONST_INIT extern const int kVersionMinor;
@@ -108,15 +120,35 @@ inline constexpr absl::string_view kAssets[] = {
     "lyra_16khz_transpose_2_weights.raw.gz"};
 inline constexpr absl::string_view kLyraConfigProto = "lyra_config.textproto";
 
+// The users of a model. Each needs only some of |kAssets|: the encoder reads
+// just the quantizer tables, while the decoder also runs the generative model,
+// including when it conceals lost packets.
+enum class ModelRole { kEncoder, kDecoder };
+
+// Returns "encoder" or "decoder".
+const char* ModelRoleName(ModelRole role);
+
+// Inverse of |ModelRoleName|. Returns a nullopt for unknown names.
+absl::optional<ModelRole> ModelRoleFromName(absl::string_view name);
+
+// Returns whether |asset|, with or without its ".gz", is loaded by |role|.
+inline bool IsAssetOfRole(absl::string_view asset, ModelRole role) {
+  return role == ModelRole::kDecoder ||
+         absl::StartsWith(asset, "lyra_16khz_quant_");
+}
+
 inline bool IsSampleRateSupported(int sample_rate_hz) {
   return std::find(std::begin(kSupportedSampleRates),
                    std::end(kSupportedSampleRates),
                    sample_rate_hz) != std::end(kSupportedSampleRates);
 }
 
+// Checks the codec parameters, and that |model_path| holds the assets of
+// |role| and matches the identifier of the code.
 inline absl::Status AreParamsSupported(
     int sample_rate_hz, int num_channels, int bitrate,
-    const ghc::filesystem::path& model_path) {
+    const ghc::filesystem::path& model_path,
+    ModelRole role = ModelRole::kDecoder) {
   if (!IsSampleRateSupported(sample_rate_hz)) {
     return absl::InvalidArgumentError(absl::StrFormat(
         "Sample rate %d Hz is not supported by codec.", sample_rate_hz));
@@ -131,29 +163,54 @@ inline absl::Status AreParamsSupported(
         "Bitrate %d bps is not supported by codec. It needs to be %d bps.",
         bitrate, kBitrate));
   }
-  for (auto asset : kAssets) {
-    std::error_code error;
-    const bool exists =
-        ghc::filesystem::exists(model_path / std::string(asset), error);
-    if (error) {
-      return absl::UnknownError(
-          absl::StrFormat("Error when probing for asset %s in %s: %s", asset,
-                          model_path, error.message()));
+  // A bundle holds the assets decompressed and without their ".gz", under
+  // its own index.
+  if (IsModelBundle(model_path)) {
+    const std::shared_ptr<const ModelBundle> bundle =
+        ModelBundle::OpenShared(model_path);
+    if (bundle == nullptr) {
+      return absl::UnavailableError(
+          absl::StrFormat("Could not open bundle %s.", model_path));
+    }
+    for (auto asset : kAssets) {
+      if (IsAssetOfRole(asset, role) &&
+          !bundle->Contains(absl::StripSuffix(asset, ".gz"))) {
+        return absl::InvalidArgumentError(absl::StrFormat(
+            "Asset %s does not exist in %s.", asset, model_path));
+      }
     }
-    if (!exists) {
+    if (bundle->identifier() != static_cast<uint32_t>(kVersionMinor)) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Weights identifier (%d) is not compatible with code identifier "
+          "(%d).",
+          bundle->identifier(), kVersionMinor));
+    }
+    return absl::OkStatus();
+  }
+  // Lists |model_path| once instead of probing for every asset.
+  std::error_code error;
+  std::set<std::string> files;
+  for (ghc::filesystem::directory_iterator it(model_path, error), end;
+       !error && it != end; it.increment(error)) {
+    files.insert(it->path().filename().string());
+  }
+  if (error) {
+    return absl::UnknownError(absl::StrFormat(
+        "Error when listing the assets in %s: %s", model_path,
+        error.message()));
+  }
+  // A directory written by |UnpackModel| holds the assets without their
+  // ".gz".
+  for (auto asset : kAssets) {
+    if (IsAssetOfRole(asset, role) && files.count(std::string(asset)) == 0 &&
+        files.count(std::string(absl::StripSuffix(asset, ".gz"))) == 0) {
       return absl::InvalidArgumentError(
           absl::StrFormat("Asset %s does not exist in %s.", asset, model_path));
     }
   }
   const ghc::filesystem::path lyra_config_proto =
       model_path / std::string(kLyraConfigProto);
-  std::error_code error;
-  const bool exists = ghc::filesystem::exists(lyra_config_proto, error);
-  if (error) {
-    return absl::UnknownError(
-        absl::StrFormat("Error when probing for asset %s: %s",
-                        lyra_config_proto, error.message()));
-  }
+  const bool exists = files.count(std::string(kLyraConfigProto)) > 0;
   third_party::lyra_codec::LyraConfig lyra_config;
   if (exists) {
     std::ifstream lyra_config_stream(lyra_config_proto.string());
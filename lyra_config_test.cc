@@ -14,7 +14,12 @@
 
 #include "lyra_config.h"
 
+#include <climits>
+#include <utility>
+
+#include "absl/strings/match.h"
 #include "gtest/gtest.h"
+#include "lyra_codec_config.h"
 
 namespace chromemedia {
 namespace codec {
@@ -36,6 +41,48 @@ TEST(LyraConfigTest, TestGetVersionString) {
   EXPECT_EQ(std::stoi(microStr), kVersionMicro);
 }
 
+TEST(LyraConfigTest, EncoderOnlyLoadsQuantizer) {
+  int num_encoder_assets = 0;
+  for (auto asset : kAssets) {
+    EXPECT_TRUE(IsAssetOfRole(asset, ModelRole::kDecoder)) << asset;
+    if (IsAssetOfRole(asset, ModelRole::kEncoder)) {
+      EXPECT_TRUE(absl::StrContains(asset, "_quant_")) << asset;
+      ++num_encoder_assets;
+    }
+  }
+  EXPECT_EQ(num_encoder_assets, 4);
+  EXPECT_TRUE(IsAssetOfRole("lyra_16khz_quant_transmat", ModelRole::kEncoder));
+}
+
+TEST(LyraConfigTest, ModelRoleNamesRoundTrip) {
+  for (const ModelRole role : {ModelRole::kEncoder, ModelRole::kDecoder}) {
+    const auto parsed = ModelRoleFromName(ModelRoleName(role));
+    ASSERT_TRUE(parsed.has_value());
+    EXPECT_EQ(parsed.value(), role);
+  }
+  EXPECT_FALSE(ModelRoleFromName("plc").has_value());
+}
+
+TEST(LyraConfigTest, RuntimeSizesMatchTheCodecConfig) {
+  EXPECT_EQ(kNumFeatures, LyraDefaultCodecConfig::kNumFeatures);
+  EXPECT_EQ(kNumExpectedOutputFeatures,
+            LyraDefaultCodecConfig::kNumExpectedOutputFeatures);
+  EXPECT_EQ(kNumFramesPerPacket, LyraDefaultCodecConfig::kNumFramesPerPacket);
+  EXPECT_EQ(kPacketSize, LyraDefaultCodecConfig::kPacketSize);
+  EXPECT_EQ(LyraDefaultCodecConfig::kNumPacketBits, kPacketSize * CHAR_BIT);
+}
+
+TEST(LyraConfigTest, DispatchOnSizeFallsBackToTheRuntimeSize) {
+  const auto extent = [](int size) {
+    return DispatchOnSize<160>(size, [size](auto static_size) {
+      return std::make_pair(decltype(static_size)::value,
+                            Extent<decltype(static_size)::value>(size));
+    });
+  };
+  EXPECT_EQ(extent(160), std::make_pair(160, 160));
+  EXPECT_EQ(extent(4), std::make_pair(0, 4));
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
@@ -15,7 +15,11 @@
 #include "lyra_decoder.h"
 
 #include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cmath>
 #include <cstdint>
+#include <deque>
+#include <future>  // NOLINT(build/c++11)
 #include <iterator>
 #include <memory>
 #include <optional>
@@ -26,26 +30,141 @@
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "aggregated_packet.h"
+#include "codec_metrics.h"
 #include "comfort_noise_generator.h"
+#include "compute_precision.h"
+#include "dsp_util.h"
+#include "flight_recorder.h"
 #include "generative_model_interface.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_components.h"
 #include "lyra_config.h"
+#include "lyra_model.h"
 #include "packet_interface.h"
 #include "packet_loss_handler.h"
 #include "packet_loss_handler_interface.h"
+#include "parallel_load.h"
+#include "performance_profile.h"
+#include "quality_governor.h"
+#include "quality_level.h"
 #include "resampler.h"
 #include "resampler_interface.h"
+#include "state_buffer.h"
+#include "tracing.h"
 #include "vector_quantizer_interface.h"
 
 namespace chromemedia {
 namespace codec {
+namespace {
+
+// Changes whenever the layout of the saved state changes.
+constexpr uint32_t kStateVersion = 4;
+
+// A packet can be stretched or compressed by up to this fraction of its
+// samples with |SetStretchedEncodedPacket|.
+constexpr int kMaxStretchDivisor = 2;
+
+// How long a recovered late packet fades in over its concealment.
+constexpr int kRecoveryCrossfadeMillis = 10;
+
+}  // namespace
+
+std::unique_ptr<LyraDecoder> LyraDecoder::Create(
+    int sample_rate_hz, int num_channels, int bitrate,
+    const ghc::filesystem::path& model_path, int num_threads,
+    ComputePrecision precision,
+    SpectrogramPredictorFactory spectrogram_predictor_factory) {
+  return Create(sample_rate_hz, num_channels, bitrate, model_path, num_threads,
+                /*model=*/nullptr, precision, /*thread_pool=*/nullptr,
+                spectrogram_predictor_factory);
+}
 
 std::unique_ptr<LyraDecoder> LyraDecoder::Create(
     int sample_rate_hz, int num_channels, int bitrate,
-    const ghc::filesystem::path& model_path) {
+    const std::shared_ptr<LyraModel>& model, int num_threads,
+    ComputePrecision precision, std::shared_ptr<ThreadPool> thread_pool,
+    SpectrogramPredictorFactory spectrogram_predictor_factory) {
+  if (model == nullptr) {
+    LOG(ERROR) << "A LyraModel is required to share weights.";
+    return nullptr;
+  }
+  return Create(sample_rate_hz, num_channels, bitrate, model->model_path(),
+                num_threads, model.get(), precision, std::move(thread_pool),
+                spectrogram_predictor_factory);
+}
+
+std::unique_ptr<LyraDecoder> LyraDecoder::CreateWithProfile(
+    int sample_rate_hz, int num_channels, int bitrate,
+    const std::shared_ptr<LyraModel>& model) {
+  if (model == nullptr) {
+    LOG(ERROR) << "A LyraModel is required to share weights.";
+    return nullptr;
+  }
+  const PerformanceProfile& profile = model->performance_profile();
+  std::unique_ptr<LyraDecoder> decoder =
+      Create(sample_rate_hz, num_channels, bitrate, model, profile.num_threads,
+             profile.precision);
+  if (decoder == nullptr) {
+    return nullptr;
+  }
+  decoder->ApplyGenerativeModelProfile(profile);
+  if (!decoder->ApplyProfile(profile)) {
+    return nullptr;
+  }
+  decoder->performance_profile_.use_huge_pages = model->use_huge_pages();
+  return decoder;
+}
+
+std::unique_ptr<LyraDecoder> LyraDecoder::CreateProgressively(
+    int sample_rate_hz, int num_channels, int bitrate,
+    const std::shared_ptr<LyraModel>& model) {
+  if (model == nullptr) {
+    LOG(ERROR) << "A LyraModel is required to share weights.";
+    return nullptr;
+  }
+  const PerformanceProfile& profile = model->performance_profile();
+  std::unique_ptr<LyraDecoder> decoder =
+      Create(sample_rate_hz, num_channels, bitrate, model->model_path(),
+             profile.num_threads, model.get(), profile.precision,
+             /*thread_pool=*/nullptr, /*spectrogram_predictor_factory=*/nullptr,
+             /*defer_generative_model=*/true);
+  if (decoder == nullptr || !decoder->ApplyProfile(profile)) {
+    return nullptr;
+  }
+  decoder->performance_profile_.use_huge_pages = model->use_huge_pages();
+  decoder->generative_model_profile_ = profile;
+  // The task holds on to |model|, so the weights outlive the decoder if it is
+  // destroyed first.
+  decoder->pending_generative_model_ = std::async(
+      std::launch::async,
+      [model, sample_rate_hz, profile]() {
+        LYRA_TRACE_SCOPE("LoadGenerativeModel");
+        std::unique_ptr<GenerativeModelInterface> generative_model =
+            CreateGenerativeModel(
+                GetNumSamplesPerHop(kInternalSampleRateHz),
+                kNumExpectedOutputFeatures, kNumFramesPerPacket,
+                model->model_path(), profile.num_threads, model.get(),
+                profile.precision, sample_rate_hz);
+        if (generative_model != nullptr) {
+          generative_model->WarmUp();
+        }
+        return generative_model;
+      });
+  return decoder;
+}
+
+std::unique_ptr<LyraDecoder> LyraDecoder::Create(
+    int sample_rate_hz, int num_channels, int bitrate,
+    const ghc::filesystem::path& model_path, int num_threads,
+    LyraModel* model, ComputePrecision precision,
+    std::shared_ptr<ThreadPool> thread_pool,
+    const SpectrogramPredictorFactory& spectrogram_predictor_factory,
+    bool defer_generative_model) {
   absl::Status are_params_supported =
       AreParamsSupported(sample_rate_hz, num_channels, bitrate, model_path);
   if (!are_params_supported.ok()) {
@@ -53,14 +172,39 @@ std::unique_ptr<LyraDecoder> LyraDecoder::Create(
     return nullptr;
   }
 
-  // The model is always set up for |kInternalSampleRateHz|.
-  auto model = CreateGenerativeModel(GetNumSamplesPerHop(kInternalSampleRateHz),
-                                     kNumExpectedOutputFeatures,
-                                     kNumFramesPerPacket, model_path);
-  if (model == nullptr) {
+  // The model is always set up for |kInternalSampleRateHz|, but produces its
+  // samples at |sample_rate_hz| directly: lower rates by merging only the
+  // lowest split bands and higher ones by upsampling in the merge filter. It
+  // loads concurrently with the quantizer, which is always set up for
+  // |kInternalSampleRateHz| too, unless it is loaded later on.
+  const int model_sample_rate_hz = sample_rate_hz;
+  std::unique_ptr<GenerativeModelInterface> generative_model;
+  std::unique_ptr<VectorQuantizerInterface> vector_quantizer;
+  LoadInParallel({
+      [&]() {
+        if (defer_generative_model) return true;
+        generative_model = CreateGenerativeModel(
+            GetNumSamplesPerHop(kInternalSampleRateHz),
+            kNumExpectedOutputFeatures, kNumFramesPerPacket, model_path,
+            num_threads, model, precision, model_sample_rate_hz,
+            std::move(thread_pool));
+        return generative_model != nullptr;
+      },
+      [&]() {
+        vector_quantizer =
+            CreateQuantizer(kNumFramesPerPacket * kNumExpectedOutputFeatures,
+                            kNumQuantizationBits, model_path, model);
+        return vector_quantizer != nullptr;
+      },
+  });
+  if (generative_model == nullptr && !defer_generative_model) {
     LOG(ERROR) << "New model could not be instantiated.";
     return nullptr;
   }
+  if (vector_quantizer == nullptr) {
+    LOG(ERROR) << "Could not create Vector Quantizer.";
+    return nullptr;
+  }
 
   // The comfort noise generator is always set up for |kInternalSampleRateHz|.
   auto comfort_noise_generator = ComfortNoiseGenerator::Create(
@@ -72,29 +216,22 @@ std::unique_ptr<LyraDecoder> LyraDecoder::Create(
     return nullptr;
   }
 
-  // Vector Quantizer is always set up for |kInternalSampleRateHz|.
-  auto vector_quantizer =
-      CreateQuantizer(kNumFramesPerPacket * kNumExpectedOutputFeatures,
-                      kNumQuantizationBits, model_path);
-  if (vector_quantizer == nullptr) {
-    LOG(ERROR) << "Could not create Vector Quantizer.";
-    return nullptr;
-  }
-
   auto packet = CreatePacket();
 
   // The packet loss handler is always set up for |kInternalSampleRateHz|.
   auto packet_loss_handler = PacketLossHandler::Create(
       kInternalSampleRateHz, kNumExpectedOutputFeatures,
       static_cast<float>(GetNumSamplesPerHop(kInternalSampleRateHz)) /
-          kInternalSampleRateHz);
+          kInternalSampleRateHz,
+      spectrogram_predictor_factory);
   if (packet_loss_handler == nullptr) {
     LOG(ERROR) << "Could not create Packet Loss Handler.";
     return nullptr;
   }
 
   // The resampler always resamples from |kInternalSampleRateHz| to the
-  // requested |sample_rate_hz|.
+  // requested |sample_rate_hz|. Since the model produces |sample_rate_hz|
+  // directly it is only used for the comfort noise.
   auto resampler = Resampler::Create(kInternalSampleRateHz, sample_rate_hz);
   if (resampler == nullptr) {
     LOG(ERROR) << "Could not create Resampler.";
@@ -102,11 +239,14 @@ std::unique_ptr<LyraDecoder> LyraDecoder::Create(
   }
 
   // WrapUnique is used because of private c'tor.
-  return absl::WrapUnique(new LyraDecoder(
-      std::move(model), std::move(comfort_noise_generator),
+  auto decoder = absl::WrapUnique(new LyraDecoder(
+      std::move(generative_model), std::move(comfort_noise_generator),
       std::move(vector_quantizer), std::move(packet),
       std::move(packet_loss_handler), std::move(resampler), sample_rate_hz,
-      num_channels, bitrate, kNumFramesPerPacket));
+      num_channels, bitrate, kNumFramesPerPacket, model_sample_rate_hz));
+  decoder->performance_profile_.num_threads = num_threads;
+  decoder->performance_profile_.precision = precision;
+  return decoder;
 }
 
 LyraDecoder::LyraDecoder(
@@ -116,7 +256,8 @@ LyraDecoder::LyraDecoder(
     std::unique_ptr<PacketInterface> packet,
     std::unique_ptr<PacketLossHandlerInterface> packet_loss_handler,
     std::unique_ptr<ResamplerInterface> resampler, int sample_rate_hz,
-    int num_channels, int bitrate, int num_frames_per_packet)
+    int num_channels, int bitrate, int num_frames_per_packet,
+    int model_sample_rate_hz)
     : generative_model_(std::move(generative_model)),
       comfort_noise_generator_(std::move(comfort_noise_generator)),
       vector_quantizer_(std::move(vector_quantizer)),
@@ -127,47 +268,425 @@ LyraDecoder::LyraDecoder(
       num_channels_(num_channels),
       bitrate_(bitrate),
       num_frames_per_packet_(num_frames_per_packet),
+      model_sample_rate_hz_(model_sample_rate_hz),
       internal_num_samples_available_(0),
       encoded_packet_set_(false),
-      prev_frame_was_comfort_noise_(false) {}
+      packet_queued_(false),
+      comfort_noise_packet_set_(false),
+      internal_num_comfort_noise_samples_available_(0),
+      silence_detection_enabled_(false),
+      num_consecutive_noise_frames_(0),
+      quality_level_(QualityLevel::kFull),
+      prev_frame_was_comfort_noise_(false),
+      parking_delay_samples_(0),
+      num_idle_samples_(0),
+      generative_model_parked_(false),
+      late_packet_recovery_enabled_(false),
+      concealing_(false) {}
 
-bool LyraDecoder::SetEncodedPacket(absl::Span<const uint8_t> encoded) {
+void LyraDecoder::ApplyGenerativeModelProfile(
+    const PerformanceProfile& profile) {
+  if (profile.use_adaptive_barrier) {
+    performance_profile_.use_adaptive_barrier =
+        generative_model_->SetAdaptiveBarrierEnabled(true);
+    LOG_IF(WARNING, !performance_profile_.use_adaptive_barrier)
+        << "The generative model does not support the adaptive barrier.";
+  }
+  if (profile.prefetch_distance > 0) {
+    if (generative_model_->SetPrefetchDistance(
+            profile.prefetch_distance)) {
+      performance_profile_.prefetch_distance =
+          profile.prefetch_distance;
+    } else {
+      LOG(WARNING) << "The generative model does not support prefetching.";
+    }
+  }
+  if (profile.gru_row_pipelining) {
+    performance_profile_.gru_row_pipelining =
+        generative_model_->SetGruRowPipeliningEnabled(true);
+    LOG_IF(WARNING, !performance_profile_.gru_row_pipelining)
+        << "The generative model does not support GRU row pipelining.";
+  }
+}
+
+bool LyraDecoder::ApplyProfile(const PerformanceProfile& profile) {
+  SetPipeliningEnabled(profile.pipelining);
+  SetSilenceDetectionEnabled(profile.silence_detection);
+  SetParkingDelay(absl::Milliseconds(profile.park_after_idle_ms));
+  if (profile.reduced_quality_real_time_factor > 0.0f) {
+    quality_governor_ =
+        QualityGovernor::Create(profile.full_quality_real_time_factor,
+                                profile.reduced_quality_real_time_factor);
+    if (quality_governor_ == nullptr) {
+      LOG(ERROR) << "Could not create Quality Governor.";
+      return false;
+    }
+    performance_profile_.reduced_quality_real_time_factor =
+        profile.reduced_quality_real_time_factor;
+    performance_profile_.full_quality_real_time_factor =
+        profile.full_quality_real_time_factor;
+  }
+  performance_profile_.pool_num_workers = profile.pool_num_workers;
+  return true;
+}
+
+void LyraDecoder::MaybeSwitchToLoadedGenerativeModel() {
+  if (!pending_generative_model_.valid() ||
+      pending_generative_model_.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready) {
+    return;
+  }
+  AdoptGenerativeModel();
+}
+
+void LyraDecoder::AdoptGenerativeModel() {
+  generative_model_ = pending_generative_model_.get();
+  if (generative_model_ == nullptr) {
+    LOG(ERROR) << "The generative model could not be loaded, the decoder "
+                  "stays in comfort noise.";
+    return;
+  }
+  ApplyGenerativeModelProfile(generative_model_profile_);
+}
+
+bool LyraDecoder::WaitForGenerativeModel() {
+  if (pending_generative_model_.valid()) {
+    LYRA_TRACE_SCOPE("WaitForGenerativeModel");
+    pending_generative_model_.wait();
+    AdoptGenerativeModel();
+  }
+  return generative_model_ != nullptr;
+}
+
+bool LyraDecoder::has_generative_model() const {
+  return generative_model_ != nullptr;
+}
+
+absl::optional<std::vector<float>> LyraDecoder::UnpackFeatures(
+    absl::Span<const uint8_t> encoded) const {
   if (encoded.size() != kPacketSize) {
     LOG(ERROR) << "The number of bytes has to equal to " << kPacketSize
                << ", but is " << encoded.size() << ".";
-    return false;
+    return absl::nullopt;
   }
 
   const auto unpacked_or = packet_->UnpackPacket(encoded);
   if (!unpacked_or.has_value()) {
     LOG(ERROR) << "Couldn't read Lyra packet for decoding.";
+    return absl::nullopt;
+  }
+
+  return vector_quantizer_->DecodeToLossyFeatures(unpacked_or.value());
+}
+
+bool LyraDecoder::SetEncodedPacket(absl::Span<const uint8_t> encoded) {
+  FlightRecorder::Call call(flight_recorder_.get(), "SetEncodedPacket");
+  LYRA_TRACE_SCOPE("SetEncodedPacket");
+  DiscardRecoveryState();
+  DiscardPreparedConcealment();
+  aggregated_packets_.clear();
+  next_sequence_number_ = absl::nullopt;
+  if (encoded.empty()) {
+    StartComfortNoisePacket(std::vector<float>());
+    return true;
+  }
+  return StartEncodedPacket(encoded);
+}
+
+absl::optional<int> LyraDecoder::SetStretchedEncodedPacket(
+    absl::Span<const uint8_t> encoded, int num_samples) {
+  const int max_num_stretched_samples =
+      num_frames_per_packet_ * GetNumSamplesPerHop(sample_rate_hz_) /
+      kMaxStretchDivisor;
+  if (std::abs(num_samples) > max_num_stretched_samples) {
+    LOG(ERROR) << "A packet can be stretched by at most "
+               << max_num_stretched_samples << " samples, but "
+               << num_samples << " were requested.";
+    return absl::nullopt;
+  }
+  if (!SetEncodedPacket(encoded)) {
+    return absl::nullopt;
+  }
+  const int internal_num_samples =
+      (num_samples < 0 ? -1 : 1) *
+      ConvertNumSamplesBetweenSampleRate(std::abs(num_samples),
+                                         sample_rate_hz_,
+                                         kInternalSampleRateHz);
+  if (comfort_noise_packet_set_) {
+    // Comfort noise is rendered into any number of samples.
+    internal_num_comfort_noise_samples_available_ += internal_num_samples;
+    if (internal_num_samples != 0) {
+      ++metrics_.num_stretched_packets;
+    }
+    return ConvertNumSamplesBetweenSampleRate(
+        internal_num_comfort_noise_samples_available_, kInternalSampleRateHz,
+        sample_rate_hz_);
+  }
+  const absl::optional<int> num_stretched_samples_or =
+      generative_model_->StretchFeatures(internal_num_samples);
+  if (num_stretched_samples_or.has_value()) {
+    internal_num_samples_available_ += num_stretched_samples_or.value();
+    if (num_stretched_samples_or.value() != 0) {
+      ++metrics_.num_stretched_packets;
+    }
+  } else {
+    LOG(WARNING) << "The generative model cannot stretch the packet, it "
+                    "plays out at its own length.";
+  }
+  return ConvertNumSamplesBetweenSampleRate(internal_num_samples_available_,
+                                            kInternalSampleRateHz,
+                                            sample_rate_hz_);
+}
+
+bool LyraDecoder::SetFuturePacket(absl::Span<const uint8_t> encoded,
+                                  int num_lost_samples) {
+  if (num_lost_samples <= 0) {
+    LOG(ERROR) << "Number of lost samples must be positive.";
+    return false;
+  }
+  const auto concatenated_features_or = UnpackFeatures(encoded);
+  if (!concatenated_features_or.has_value()) {
+    return false;
+  }
+  // Only the first frame of the packet borders on the lost samples.
+  const int num_features =
+      concatenated_features_or->size() / num_frames_per_packet_;
+  if (!packet_loss_handler_->SetFutureFeatures(
+          absl::MakeConstSpan(concatenated_features_or.value())
+              .subspan(0, num_features),
+          ConvertNumSamplesBetweenSampleRate(num_lost_samples, sample_rate_hz_,
+                                             kInternalSampleRateHz))) {
+    return false;
+  }
+  // The prepared concealment was extrapolated.
+  DiscardPreparedConcealment();
+  return true;
+}
+
+bool LyraDecoder::SetAggregatedPayload(absl::Span<const uint8_t> payload) {
+  const auto payload_or = ParseAggregatedPayload(payload, kPacketSize);
+  if (!payload_or.has_value()) {
     return false;
   }
+  const AggregatedPayload& parsed = payload_or.value();
+  // Sequence numbers wrap around, so a payload that starts up to 127 packets
+  // before the next expected one was delivered late or twice. Its packets that
+  // were already received are skipped, and it is dropped if nothing is left.
+  const uint8_t num_received_packets =
+      next_sequence_number_.has_value()
+          ? next_sequence_number_.value() - parsed.sequence_number
+          : 0;
+  const int num_skipped_packets =
+      num_received_packets < 128 ? num_received_packets : 0;
+  if (num_skipped_packets >= static_cast<int>(parsed.packets.size())) {
+    LOG(WARNING) << "Dropped a payload whose packets were all received.";
+    return false;
+  }
+  DiscardRecoveryState();
+  DiscardPreparedConcealment();
+  std::vector<absl::Span<const uint8_t>> packets;
+  packets.reserve(parsed.packets.size() + 1);
+  // Packets between the last received one and the first of this payload were
+  // lost. The last of those may be recovered from the redundant copy.
+  if (parsed.redundant_packet.has_value() &&
+      next_sequence_number_.has_value()) {
+    const uint8_t num_lost_packets =
+        parsed.sequence_number - next_sequence_number_.value();
+    if (num_lost_packets > 0 && num_lost_packets < 128) {
+      packets.push_back(parsed.redundant_packet.value());
+    }
+  }
+  packets.insert(packets.end(), parsed.packets.begin() + num_skipped_packets,
+                 parsed.packets.end());
 
-  std::vector<float> concatenated_features =
-      vector_quantizer_->DecodeToLossyFeatures(unpacked_or.value());
+  aggregated_packets_.clear();
+  if (!StartEncodedPacket(packets.front())) {
+    return false;
+  }
+  for (int i = 1; i < packets.size(); ++i) {
+    aggregated_packets_.emplace_back(packets[i].begin(), packets[i].end());
+  }
+  next_sequence_number_ = parsed.sequence_number + parsed.packets.size();
+  return true;
+}
+
+bool LyraDecoder::StartEncodedPacket(absl::Span<const uint8_t> encoded) {
+  MaybeSwitchToLoadedGenerativeModel();
+  const auto concatenated_features_or = UnpackFeatures(encoded);
+  if (!concatenated_features_or.has_value()) {
+    return false;
+  }
+  const std::vector<float>& concatenated_features =
+      concatenated_features_or.value();
+  // The generative model applies any queued features first.
+  packet_queued_ = false;
   const int num_features =
       concatenated_features.size() / num_frames_per_packet_;
+  const bool detect_noise =
+      silence_detection_enabled_ || quality_level_ == QualityLevel::kReduced;
+  bool is_noise = detect_noise;
   for (int i = 0; i < num_frames_per_packet_; ++i) {
-    const std::vector<float> features(
-        concatenated_features.begin() + num_features * i,
-        concatenated_features.begin() + num_features * (i + 1));
+    const absl::Span<const float> features =
+        absl::MakeConstSpan(concatenated_features)
+            .subspan(num_features * i, num_features);
+    // The noise check has to come before the features update the estimate.
+    if (detect_noise) {
+      const auto is_similar_noise_or =
+          packet_loss_handler_->IsSimilarNoise(features);
+      if (!is_similar_noise_or.has_value()) {
+        LOG(ERROR) << "Unable to check noise estimation.";
+        return false;
+      }
+      is_noise = is_noise && is_similar_noise_or.value();
+    }
     if (!packet_loss_handler_->SetReceivedFeatures(features)) {
       LOG(ERROR) << "Unable to update packet loss handler.";
       return false;
     }
+  }
 
-    generative_model_->AddFeatures(features);
+  // Switching to comfort noise takes a while of noise, so that short pauses
+  // do not flip between the models, but switching back is immediate so that
+  // speech onsets are not lost.
+  num_consecutive_noise_frames_ =
+      is_noise ? num_consecutive_noise_frames_ + num_frames_per_packet_ : 0;
+  // Until the generative model is loaded every packet is comfort noise.
+  if (generative_model_ == nullptr ||
+      num_consecutive_noise_frames_ >=
+          std::ceil(kMinNoiseSeconds * kFrameRate)) {
+    StartComfortNoisePacket(concatenated_features);
+    return true;
   }
+  UnparkGenerativeModel();
+  generative_model_->AddFrames(absl::MakeConstSpan(concatenated_features),
+                               num_frames_per_packet_);
 
   internal_num_samples_available_ =
       num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
   encoded_packet_set_ = true;
+  comfort_noise_packet_set_ = false;
+  return true;
+}
+
+void LyraDecoder::StartComfortNoisePacket(std::vector<float> features) {
+  DiscardPreparedConcealment();
+  packet_queued_ = false;
+  // The samples the generative model has left of the previous packet are kept,
+  // so the transition into comfort noise starts from them.
+  internal_num_comfort_noise_samples_available_ =
+      num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
+  comfort_noise_packet_features_ = std::move(features);
+  comfort_noise_packet_set_ = true;
+}
+
+bool LyraDecoder::QueueEncodedPacket(absl::Span<const uint8_t> encoded) {
+  if (packet_queued_) {
+    LOG(ERROR) << "Only one packet can be queued at a time.";
+    return false;
+  }
+  if (encoded.empty()) {
+    LOG(ERROR) << "Empty packets have to be set with SetEncodedPacket.";
+    return false;
+  }
+  if (!aggregated_packets_.empty()) {
+    LOG(ERROR) << "Packets of an aggregated payload remain to be decoded.";
+    return false;
+  }
+  DiscardRecoveryState();
+  DiscardPreparedConcealment();
+  MaybeSwitchToLoadedGenerativeModel();
+  if (comfort_noise_packet_set_ || !performance_profile_.pipelining ||
+      generative_model_ == nullptr) {
+    // Comfort noise does not use the generative model, so there is nothing to
+    // prepare in the background, and without pipelining nothing is. The
+    // packet is started once the current one is decoded, like the packets of
+    // an aggregated payload.
+    if (encoded.size() != kPacketSize) {
+      LOG(ERROR) << "The number of bytes has to equal to " << kPacketSize
+                 << ", but is " << encoded.size() << ".";
+      return false;
+    }
+    aggregated_packets_.emplace_back(encoded.begin(), encoded.end());
+    MaybeAdvanceToQueuedPacket();
+    return true;
+  }
+  const auto concatenated_features_or = UnpackFeatures(encoded);
+  if (!concatenated_features_or.has_value()) {
+    return false;
+  }
+  const std::vector<float>& concatenated_features =
+      concatenated_features_or.value();
+  const int num_features =
+      concatenated_features.size() / num_frames_per_packet_;
+  UnparkGenerativeModel();
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    const absl::Span<const float> features =
+        absl::MakeConstSpan(concatenated_features)
+            .subspan(num_features * i, num_features);
+    if (!packet_loss_handler_->SetReceivedFeatures(features)) {
+      LOG(ERROR) << "Unable to update packet loss handler.";
+      return false;
+    }
+
+    if (!generative_model_->QueueFeatures(features)) {
+      LOG(ERROR) << "The generative model cannot queue features.";
+      return false;
+    }
+  }
+
+  // Queued features go to the generative model, so they are not checked for
+  // noise and restart the count.
+  num_consecutive_noise_frames_ = 0;
+  packet_queued_ = true;
+  MaybeAdvanceToQueuedPacket();
   return true;
 }
 
+void LyraDecoder::MaybeAdvanceToQueuedPacket() {
+  if (comfort_noise_packet_set_
+          ? internal_num_comfort_noise_samples_available_ > 0
+          : internal_num_samples_available_ > 0) {
+    return;
+  }
+  if (!packet_queued_) {
+    if (!aggregated_packets_.empty()) {
+      if (!StartEncodedPacket(aggregated_packets_.front())) {
+        LOG(ERROR) << "Dropping a packet of an aggregated payload.";
+      }
+      aggregated_packets_.pop_front();
+    }
+    return;
+  }
+  // The generative model switches to the queued features on its own once it
+  // generated all samples of the current ones.
+  internal_num_samples_available_ =
+      num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
+  encoded_packet_set_ = true;
+  packet_queued_ = false;
+}
+
 absl::optional<std::vector<int16_t>> LyraDecoder::DecodeSamples(
     int num_samples) {
+  FlightRecorder::Call call(flight_recorder_.get(), "DecodeSamples");
+  const absl::Time start = absl::Now();
+  MaybeAdvanceToQueuedPacket();
+  int64_t* const num_samples_of_kind = comfort_noise_packet_set_
+                                           ? &metrics_.num_comfort_noise_samples
+                                           : &metrics_.num_model_samples;
+  auto audio_or = GenerateSamples(num_samples);
+  if (audio_or.has_value()) {
+    RecordDecodeCall(start, num_samples, num_samples_of_kind,
+                     /*allocated=*/true);
+  }
+  return audio_or;
+}
+
+absl::optional<std::vector<int16_t>> LyraDecoder::GenerateSamples(
+    int num_samples) {
+  MaybeAdvanceToQueuedPacket();
+  if (comfort_noise_packet_set_) {
+    return DecodeComfortNoise(num_samples);
+  }
   const int external_num_samples_available = ConvertNumSamplesBetweenSampleRate(
       internal_num_samples_available_, kInternalSampleRateHz, sample_rate_hz_);
   if (num_samples > external_num_samples_available) {
@@ -184,12 +703,15 @@ absl::optional<std::vector<int16_t>> LyraDecoder::DecodeSamples(
   }
   const int internal_num_samples = ConvertNumSamplesBetweenSampleRate(
       num_samples, sample_rate_hz_, kInternalSampleRateHz);
-  auto audio_or = generative_model_->GenerateSamples(internal_num_samples);
+  auto audio_or = generative_model_->GenerateSamples(
+      ConvertNumSamplesBetweenSampleRate(num_samples, sample_rate_hz_,
+                                         model_sample_rate_hz_));
   if (!audio_or.has_value()) {
     LOG(ERROR) << "Couldn't generate audio samples.";
     return absl::nullopt;
   }
-  internal_num_samples_available_ -= audio_or->size();
+  internal_num_samples_available_ -= ConvertNumSamplesBetweenSampleRate(
+      audio_or->size(), model_sample_rate_hz_, kInternalSampleRateHz);
 
   // Comfort noise generator should only be run during a model transition, so
   // perform this check beforehand.
@@ -210,16 +732,202 @@ absl::optional<std::vector<int16_t>> LyraDecoder::DecodeSamples(
   }
   prev_frame_was_comfort_noise_ = false;
 
-  if (sample_rate_hz_ != kInternalSampleRateHz) {
-    audio_or = resampler_->Resample(audio_or.value());
+  if (sample_rate_hz_ != model_sample_rate_hz_) {
+    audio_or = Resample(audio_or.value());
   }
   CHECK_EQ(audio_or->size(), num_samples);
 
   return audio_or;
 }
 
+bool LyraDecoder::DecodeSamples(absl::Span<int16_t> samples) {
+  FlightRecorder::Call call(flight_recorder_.get(), "DecodeSamples");
+  const absl::Time start = absl::Now();
+  MaybeAdvanceToQueuedPacket();
+  const int num_samples = samples.size();
+  // Comfort noise and the transitions out of it need the buffers of the vector
+  // path. Comfort noise is cheap next to the generative model anyway.
+  if (prev_frame_was_comfort_noise_ || comfort_noise_packet_set_) {
+    const auto audio_or = DecodeSamples(num_samples);
+    if (!audio_or.has_value()) return false;
+    std::copy(audio_or->begin(), audio_or->end(), samples.begin());
+    return true;
+  }
+
+  // Without resampling the model writes straight into |samples|.
+  bool allocated = false;
+  const auto internal_samples_or =
+      GenerateModelSamples(num_samples, samples, &allocated);
+  if (!internal_samples_or.has_value()) return false;
+
+  if (sample_rate_hz_ != model_sample_rate_hz_) {
+    LYRA_TRACE_SCOPE("Resample");
+    const absl::Time resampling_start = absl::Now();
+    const int num_resampled =
+        resampler_->ResampleInto(internal_samples_or.value(), samples);
+    metrics_.resampling_nanos +=
+        absl::ToInt64Nanoseconds(absl::Now() - resampling_start);
+    CHECK_EQ(num_resampled, num_samples);
+  }
+  RecordDecodeCall(start, num_samples, &metrics_.num_model_samples, allocated);
+  return true;
+}
+
+bool LyraDecoder::DecodeSamples(absl::Span<float> samples) {
+  FlightRecorder::Call call(flight_recorder_.get(), "DecodeSamples");
+  const absl::Time start = absl::Now();
+  MaybeAdvanceToQueuedPacket();
+  const int num_samples = samples.size();
+  if (prev_frame_was_comfort_noise_ || comfort_noise_packet_set_) {
+    const auto audio_or = DecodeSamples(num_samples);
+    if (!audio_or.has_value()) return false;
+    Int16ToFloat(audio_or.value(), samples);
+    return true;
+  }
+
+  bool allocated = false;
+  const auto internal_samples_or =
+      GenerateModelSamples(num_samples, absl::Span<int16_t>(), &allocated);
+  if (!internal_samples_or.has_value()) return false;
+
+  if (sample_rate_hz_ != model_sample_rate_hz_) {
+    LYRA_TRACE_SCOPE("Resample");
+    const absl::Time resampling_start = absl::Now();
+    const int num_resampled =
+        resampler_->ResampleIntoFloats(internal_samples_or.value(), samples);
+    metrics_.resampling_nanos +=
+        absl::ToInt64Nanoseconds(absl::Now() - resampling_start);
+    CHECK_EQ(num_resampled, num_samples);
+  } else {
+    Int16ToFloat(internal_samples_or.value(), samples);
+  }
+  RecordDecodeCall(start, num_samples, &metrics_.num_model_samples, allocated);
+  return true;
+}
+
+absl::optional<absl::Span<const int16_t>> LyraDecoder::GenerateModelSamples(
+    int num_samples, absl::Span<int16_t> output, bool* allocated) {
+  const int external_num_samples_available = ConvertNumSamplesBetweenSampleRate(
+      internal_num_samples_available_, kInternalSampleRateHz, sample_rate_hz_);
+  if (num_samples > external_num_samples_available) {
+    LOG(ERROR) << "Requested " << num_samples
+               << " samples for decoding but only "
+               << external_num_samples_available
+               << " remain in the current frame.";
+    return absl::nullopt;
+  }
+  if (!encoded_packet_set_) {
+    LOG(ERROR) << "Requesting normal decoding without adding "
+                  "an encoded packet.";
+    return absl::nullopt;
+  }
+  const int internal_num_samples = ConvertNumSamplesBetweenSampleRate(
+      num_samples, sample_rate_hz_, kInternalSampleRateHz);
+  const int model_num_samples = ConvertNumSamplesBetweenSampleRate(
+      num_samples, sample_rate_hz_, model_sample_rate_hz_);
+
+  absl::Span<int16_t> model_samples = output;
+  if (output.size() != model_num_samples) {
+    if (internal_samples_.size() < model_num_samples) {
+      internal_samples_.resize(model_num_samples);
+      *allocated = true;
+    }
+    model_samples = absl::MakeSpan(internal_samples_.data(), model_num_samples);
+  }
+  if (!generative_model_->GenerateSamplesInto(model_samples)) {
+    LOG(ERROR) << "Couldn't generate audio samples.";
+    return absl::nullopt;
+  }
+  internal_num_samples_available_ -= internal_num_samples;
+  return absl::MakeConstSpan(model_samples);
+}
+
+absl::optional<std::vector<int16_t>> LyraDecoder::DecodeComfortNoise(
+    int num_samples) {
+  const int external_num_samples_available = ConvertNumSamplesBetweenSampleRate(
+      internal_num_comfort_noise_samples_available_, kInternalSampleRateHz,
+      sample_rate_hz_);
+  if (num_samples > external_num_samples_available) {
+    LOG(ERROR) << "Requested " << num_samples
+               << " samples for decoding but only "
+               << external_num_samples_available
+               << " remain in the current frame.";
+    return absl::nullopt;
+  }
+  if (num_samples == 0) {
+    return std::vector<int16_t>();
+  }
+  const int internal_num_samples = ConvertNumSamplesBetweenSampleRate(
+      num_samples, sample_rate_hz_, kInternalSampleRateHz);
+  absl::optional<FeatureFrame> features_or;
+  if (comfort_noise_packet_features_.empty()) {
+    features_or =
+        packet_loss_handler_->EstimateSilenceFeatures(internal_num_samples);
+    if (!features_or.has_value()) {
+      LOG(ERROR) << "Unable to estimate silence features.";
+      return absl::nullopt;
+    }
+  } else {
+    // Received noise is rendered from the frame the samples start in.
+    const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+    const int num_samples_decoded =
+        num_frames_per_packet_ * num_samples_per_hop -
+        internal_num_comfort_noise_samples_available_;
+    // A stretched packet may start before the first frame or end after the
+    // last one.
+    const int frame = std::clamp(num_samples_decoded / num_samples_per_hop, 0,
+                                 num_frames_per_packet_ - 1);
+    const int num_features =
+        comfort_noise_packet_features_.size() / num_frames_per_packet_;
+    features_or = FeatureFrame(
+        absl::MakeConstSpan(comfort_noise_packet_features_)
+            .subspan(num_features * frame, num_features));
+  }
+  auto audio_or = RunModelsForEstimatedFeatures(
+      internal_num_samples, features_or.value(), /*is_comfort_noise=*/true);
+  if (!audio_or.has_value()) {
+    LOG(ERROR) << "Couldn't generate comfort noise samples.";
+    return absl::nullopt;
+  }
+  internal_num_comfort_noise_samples_available_ -= internal_num_samples;
+
+  if (sample_rate_hz_ != model_sample_rate_hz_) {
+    audio_or = Resample(audio_or.value());
+  }
+  audio_or->resize(num_samples);
+  return audio_or;
+}
+
 absl::optional<std::vector<int16_t>> LyraDecoder::DecodePacketLoss(
     int num_samples) {
+  FlightRecorder::Call call(flight_recorder_.get(), "DecodePacketLoss");
+  const absl::Time start = absl::Now();
+  auto audio_or = GeneratePacketLoss(num_samples);
+  if (audio_or.has_value()) {
+    RecordDecodeCall(start, num_samples,
+                     prev_frame_was_comfort_noise_
+                         ? &metrics_.num_comfort_noise_samples
+                         : &metrics_.num_concealed_samples,
+                     /*allocated=*/true);
+  }
+  return audio_or;
+}
+
+absl::optional<std::vector<int16_t>> LyraDecoder::GeneratePacketLoss(
+    int num_samples) {
+  if (packet_queued_ || !aggregated_packets_.empty()) {
+    LOG(ERROR) << "A packet is queued, it has to be decoded with "
+                  "DecodeSamples.";
+    return absl::nullopt;
+  }
+  MaybeSwitchToLoadedGenerativeModel();
+  if (late_packet_recovery_enabled_ && !concealing_) {
+    // Queued features cannot be saved, so prepared ones are dropped.
+    DiscardPreparedConcealment();
+    concealing_ = true;
+    concealed_samples_.clear();
+    SaveState(&recovery_state_);
+  }
   const int internal_num_samples = ConvertNumSamplesBetweenSampleRate(
       num_samples, sample_rate_hz_, kInternalSampleRateHz);
   auto audio_or = RunGenerativeModelForPacketLoss(internal_num_samples);
@@ -228,71 +936,144 @@ absl::optional<std::vector<int16_t>> LyraDecoder::DecodePacketLoss(
     LOG(ERROR) << "Couldn't generate audio samples.";
     return absl::nullopt;
   }
-  if (sample_rate_hz_ != kInternalSampleRateHz) {
-    audio_or = resampler_->Resample(audio_or.value());
+  if (sample_rate_hz_ != model_sample_rate_hz_) {
+    audio_or = Resample(audio_or.value());
   }
 
   // Possibly truncate some extra samples in the end.
   audio_or->resize(num_samples);
+
+  if (!recovery_state_.empty()) {
+    // A late packet can only replace the concealment of one packet.
+    const int num_samples_per_packet =
+        num_frames_per_packet_ * GetNumSamplesPerHop(sample_rate_hz_);
+    if (concealed_samples_.size() + num_samples > num_samples_per_packet) {
+      recovery_state_.clear();
+      concealed_samples_.clear();
+    } else {
+      concealed_samples_.insert(concealed_samples_.end(), audio_or->begin(),
+                                audio_or->end());
+    }
+  }
   return audio_or;
 }
 
+bool LyraDecoder::DecodePacketLoss(absl::Span<int16_t> samples) {
+  // Packet loss concealment estimates features and may overlap with comfort
+  // noise, both of which allocate, so this goes through the vector path.
+  const auto audio_or = DecodePacketLoss(static_cast<int>(samples.size()));
+  if (!audio_or.has_value()) return false;
+  std::copy(audio_or->begin(), audio_or->end(), samples.begin());
+  return true;
+}
+
+bool LyraDecoder::DecodePacketLoss(absl::Span<float> samples) {
+  const auto audio_or = DecodePacketLoss(static_cast<int>(samples.size()));
+  if (!audio_or.has_value()) return false;
+  Int16ToFloat(audio_or.value(), samples);
+  return true;
+}
+
 absl::optional<std::vector<int16_t>>
 LyraDecoder::RunGenerativeModelForPacketLoss(int num_samples) {
+  if (quality_level_ == QualityLevel::kReduced ||
+      generative_model_ == nullptr) {
+    const auto silence_features_or =
+        packet_loss_handler_->EstimateSilenceFeatures(num_samples);
+    if (!silence_features_or.has_value()) {
+      LOG(ERROR) << "Unable to estimate silence features.";
+      return absl::nullopt;
+    }
+    return RunModelsForEstimatedFeatures(
+        num_samples, silence_features_or.value(), /*is_comfort_noise=*/true);
+  }
   const auto estimated_features_or =
       packet_loss_handler_->EstimateLostFeatures(num_samples);
   if (!estimated_features_or.has_value()) {
     LOG(ERROR) << "Unable to estimate lost features.";
     return absl::nullopt;
   }
+  return RunModelsForEstimatedFeatures(
+      num_samples, estimated_features_or.value(),
+      packet_loss_handler_->is_comfort_noise());
+}
 
+absl::optional<std::vector<int16_t>>
+LyraDecoder::RunModelsForEstimatedFeatures(
+    int num_samples, absl::Span<const float> estimated_features,
+    bool is_comfort_noise) {
   // Do not perform overlap if both previous and current frames were produced
-  // by the comfort noise generator.
-  const bool current_frame_is_comfort_noise =
-      packet_loss_handler_->is_comfort_noise();
-  if (prev_frame_was_comfort_noise_ && current_frame_is_comfort_noise) {
+  // by the comfort noise generator, or if there is no generative model to
+  // overlap with yet.
+  const bool current_frame_is_comfort_noise = is_comfort_noise;
+  if ((prev_frame_was_comfort_noise_ || generative_model_ == nullptr) &&
+      current_frame_is_comfort_noise) {
     prev_frame_was_comfort_noise_ = true;
+    CountIdleSamples(num_samples);
     return RunComfortNoiseGeneratorWithNecessaryOverlap(
-        num_samples, false, estimated_features_or.value());
+        num_samples, false, estimated_features);
   }
+  UnparkGenerativeModel();
 
   std::vector<int16_t> result;
-  result.reserve(num_samples);
+  result.reserve(ConvertNumSamplesBetweenSampleRate(
+      num_samples, kInternalSampleRateHz, model_sample_rate_hz_));
 
   // Generate samples to fill |result| with desired number of samples. Add
   // estimated features when the previous packet has been fully decoded.
+  // |num_samples| and the counts below are at |kInternalSampleRateHz|, while
+  // |result| is at |model_sample_rate_hz_|.
+  int num_samples_decoded = 0;
   int num_samples_to_decode;
-  while (result.size() < num_samples) {
-    const int remaining_num_samples =
-        num_samples - static_cast<int>(result.size());
+  while (num_samples_decoded < num_samples) {
+    const int remaining_num_samples = num_samples - num_samples_decoded;
     if (internal_num_samples_available_ == 0) {
       // The previous sample generation used up the features added, add a new
-      // one.
-      generative_model_->AddFeatures(estimated_features_or.value());
+      // one, unless its conditioning was prepared already, which the model
+      // switches to on its own.
+      if (prepared_features_.has_value() &&
+          absl::MakeConstSpan(*prepared_features_) == estimated_features) {
+        prepared_features_.reset();
+        ++metrics_.num_prepared_frames_used;
+      } else {
+        DiscardPreparedConcealment();
+        generative_model_->AddFeatures(estimated_features);
+      }
       internal_num_samples_available_ =
           GetNumSamplesPerHop(kInternalSampleRateHz);
       encoded_packet_set_ = false;
     }
     num_samples_to_decode =
         std::min(remaining_num_samples, internal_num_samples_available_);
-    const auto audio_or =
-        generative_model_->GenerateSamples(num_samples_to_decode);
+    const auto audio_or = generative_model_->GenerateSamples(
+        ConvertNumSamplesBetweenSampleRate(
+            num_samples_to_decode, kInternalSampleRateHz,
+            model_sample_rate_hz_));
     if (!audio_or.has_value()) {
       LOG(ERROR) << "Model could not be run on features.";
       return absl::nullopt;
     }
     result.insert(result.end(), audio_or->begin(), audio_or->end());
 
-    CHECK_LE(audio_or->size(), internal_num_samples_available_);
-    internal_num_samples_available_ -= audio_or->size();
+    const int internal_num_samples_decoded =
+        ConvertNumSamplesBetweenSampleRate(
+            audio_or->size(), model_sample_rate_hz_, kInternalSampleRateHz);
+    CHECK_LE(internal_num_samples_decoded, internal_num_samples_available_);
+    internal_num_samples_available_ -= internal_num_samples_decoded;
+    num_samples_decoded += internal_num_samples_decoded;
   }
-  CHECK_EQ(result.size(), num_samples);
+  CHECK_EQ(num_samples_decoded, num_samples);
 
-  // Implies a transition between models, which requires overlap.
-  if (current_frame_is_comfort_noise) {
+  // Implies a transition between models, which requires overlap. Concealment
+  // goes back to the generative model after received noise was decoded as
+  // comfort noise.
+  if (current_frame_is_comfort_noise || prev_frame_was_comfort_noise_) {
     result = RunComfortNoiseGeneratorWithNecessaryOverlap(
-                 num_samples, true, estimated_features_or.value(), result)
+                 num_samples, true, estimated_features, result)
                  .value();
+    if (!current_frame_is_comfort_noise) {
+      comfort_noise_generator_->Reset();
+    }
   }
   prev_frame_was_comfort_noise_ = current_frame_is_comfort_noise;
 
@@ -301,56 +1082,53 @@ LyraDecoder::RunGenerativeModelForPacketLoss(int num_samples) {
 
 absl::optional<std::vector<int16_t>>
 LyraDecoder::RunComfortNoiseGeneratorWithNecessaryOverlap(
-    int num_samples, bool overlap_required, const std::vector<float>& features,
-    const std::vector<int16_t>& generative_model_frame) const {
+    int num_samples, bool overlap_required, absl::Span<const float> features,
+    const std::vector<int16_t>& generative_model_frame) {
   comfort_noise_generator_->AddFeatures(features);
-  const auto comfort_noise_or =
+  auto comfort_noise_or =
       comfort_noise_generator_->GenerateSamples(num_samples);
   if (!comfort_noise_or.has_value()) {
     LOG(ERROR) << "Comfort noise generator could not be run on features.";
     return absl::nullopt;
   }
   CHECK_EQ(comfort_noise_or->size(), num_samples);
+  // The comfort noise is always generated at |kInternalSampleRateHz|, so it
+  // has to be brought to the rate of the generative model it is mixed with.
+  if (model_sample_rate_hz_ != kInternalSampleRateHz) {
+    comfort_noise_or = Resample(comfort_noise_or.value());
+  }
 
   if (overlap_required) {
     // If overlap is required, a model transition is guaranteed. The direction
     // of such transition can be deduced by looking at which model produced the
-    // previous frame.
-    absl::optional<std::vector<int16_t>> overlapped_frame_or;
+    // previous frame. The overlap is written over the comfort noise, which is
+    // not needed anymore.
+    std::vector<int16_t>& comfort_noise = comfort_noise_or.value();
+    bool overlapped;
     if (prev_frame_was_comfort_noise_) {
       // Transition from CNG to generative model.
-      overlapped_frame_or =
-          OverlapFrames(comfort_noise_or.value(), generative_model_frame);
+      overlapped = crossfader_.Crossfade(comfort_noise, generative_model_frame,
+                                         absl::MakeSpan(comfort_noise));
     } else {
       // Transition from generative model to CNG.
-      overlapped_frame_or =
-          OverlapFrames(generative_model_frame, comfort_noise_or.value());
+      overlapped = crossfader_.Crossfade(generative_model_frame, comfort_noise,
+                                         absl::MakeSpan(comfort_noise));
+    }
+    if (!overlapped) {
+      return absl::nullopt;
     }
-    return overlapped_frame_or;
-  } else {
-    return comfort_noise_or;
   }
+  return comfort_noise_or;
 }
 
 absl::optional<std::vector<int16_t>> LyraDecoder::OverlapFrames(
     const std::vector<int16_t>& preceding_frame,
-    const std::vector<int16_t>& following_frame) const {
-  if (preceding_frame.size() != following_frame.size()) {
-    LOG(ERROR) << "Overlapped frame could not be computed because frame sizes "
-                  "differed. Preceding frame size was "
-               << preceding_frame.size() << " and following frame size was "
-               << following_frame.size() << ".";
+    const std::vector<int16_t>& following_frame) {
+  std::vector<int16_t> overlapped_frame(preceding_frame.size());
+  if (!crossfader_.Crossfade(preceding_frame, following_frame,
+                             absl::MakeSpan(overlapped_frame))) {
     return absl::nullopt;
   }
-
-  const int kFrameSize = preceding_frame.size();
-  std::vector<int16_t> overlapped_frame(kFrameSize);
-  for (int i = 0; i < kFrameSize; ++i) {
-    const float overlap_weight = (1.f + std::cos(i * M_PI / kFrameSize)) / 2.f;
-    overlapped_frame[i] = preceding_frame[i] * overlap_weight +
-                          following_frame[i] * (1.f - overlap_weight);
-  }
-
   return overlapped_frame;
 }
 
@@ -366,5 +1144,366 @@ bool LyraDecoder::is_comfort_noise() const {
   return packet_loss_handler_->is_comfort_noise();
 }
 
+DecoderMetrics LyraDecoder::metrics() const {
+  DecoderMetrics metrics = metrics_;
+  metrics.conditioning_nanos = comfort_noise_generator_->conditioning_nanos();
+  metrics.sampling_nanos = comfort_noise_generator_->sampling_nanos();
+  if (generative_model_ != nullptr) {
+    metrics.conditioning_nanos += generative_model_->conditioning_nanos();
+    metrics.sampling_nanos += generative_model_->sampling_nanos();
+  }
+  metrics.real_time_factor = real_time_factor_.value();
+  return metrics;
+}
+
+void LyraDecoder::RecordDecodeCall(absl::Time start, int num_samples,
+                                   int64_t* num_samples_of_kind,
+                                   bool allocated) {
+  const absl::Duration call_time = absl::Now() - start;
+  metrics_.num_samples_decoded += num_samples;
+  *num_samples_of_kind += num_samples;
+  metrics_.max_call_nanos =
+      std::max(metrics_.max_call_nanos, absl::ToInt64Nanoseconds(call_time));
+  if (allocated) {
+    ++metrics_.num_allocating_calls;
+  }
+  real_time_factor_.Update(absl::ToDoubleSeconds(call_time),
+                           static_cast<double>(num_samples) / sample_rate_hz_);
+  if (quality_governor_ != nullptr) {
+    quality_level_ = quality_governor_->Update(
+        absl::ToDoubleSeconds(call_time),
+        static_cast<double>(num_samples) / sample_rate_hz_);
+  }
+}
+
+std::vector<int16_t> LyraDecoder::Resample(absl::Span<const int16_t> audio) {
+  LYRA_TRACE_SCOPE("Resample");
+  const absl::Time start = absl::Now();
+  std::vector<int16_t> resampled = resampler_->Resample(audio);
+  metrics_.resampling_nanos += absl::ToInt64Nanoseconds(absl::Now() - start);
+  return resampled;
+}
+
+void LyraDecoder::SetSilenceDetectionEnabled(bool enabled) {
+  silence_detection_enabled_ = enabled;
+  performance_profile_.silence_detection = enabled;
+  num_consecutive_noise_frames_ = 0;
+}
+
+void LyraDecoder::SetParkingDelay(absl::Duration delay) {
+  parking_delay_samples_ = std::max<int64_t>(
+      absl::ToInt64Microseconds(delay) * kInternalSampleRateHz / 1000000, 0);
+  performance_profile_.park_after_idle_ms =
+      std::max<int64_t>(absl::ToInt64Milliseconds(delay), 0);
+  num_idle_samples_ = 0;
+}
+
+void LyraDecoder::SetPipeliningEnabled(bool enabled) {
+  performance_profile_.pipelining = enabled;
+}
+
+void LyraDecoder::SetQualityLevel(QualityLevel quality_level) {
+  quality_level_ = quality_level;
+}
+
+QualityLevel LyraDecoder::quality_level() const { return quality_level_; }
+
+const PerformanceProfile& LyraDecoder::performance_profile() const {
+  return performance_profile_;
+}
+
+StageProfiler* LyraDecoder::EnableStageProfiling() {
+  if (generative_model_ == nullptr) {
+    return nullptr;
+  }
+  return generative_model_->EnableStageProfiling();
+}
+
+FlightRecorder* LyraDecoder::EnableFlightRecorder(
+    const FlightRecorderOptions& options) {
+  flight_recorder_ = FlightRecorder::Create(options);
+  return flight_recorder_.get();
+}
+
+void LyraDecoder::WarmUp() {
+  DiscardPreparedConcealment();
+  // A model that is still loading is warmed up once it is loaded.
+  if (generative_model_ != nullptr) {
+    generative_model_->WarmUp();
+  }
+  comfort_noise_generator_->WarmUp();
+  DiscardRecoveryState();
+}
+
+bool LyraDecoder::SaveState(std::vector<uint8_t>* state) const {
+  state->clear();
+  StateWriter writer(state);
+  writer.Write(kStateVersion);
+  writer.Write(sample_rate_hz_);
+  writer.Write(internal_num_samples_available_);
+  writer.Write(encoded_packet_set_);
+  writer.Write(comfort_noise_packet_set_);
+  writer.Write(internal_num_comfort_noise_samples_available_);
+  writer.WriteSpan(absl::MakeConstSpan(comfort_noise_packet_features_));
+  writer.Write(num_consecutive_noise_frames_);
+  writer.Write(prev_frame_was_comfort_noise_);
+  writer.Write<int32_t>(aggregated_packets_.size());
+  for (const std::vector<uint8_t>& packet : aggregated_packets_) {
+    writer.WriteSpan(absl::MakeConstSpan(packet));
+  }
+  writer.Write(next_sequence_number_.has_value());
+  writer.Write(next_sequence_number_.value_or(0));
+  // The resampler only runs if the output is not at |kInternalSampleRateHz|.
+  const bool saved =
+      !packet_queued_ && generative_model_ != nullptr &&
+      generative_model_->SaveState(&writer) &&
+      comfort_noise_generator_->SaveState(&writer) &&
+      packet_loss_handler_->SaveState(&writer) &&
+      (sample_rate_hz_ == kInternalSampleRateHz ||
+       resampler_->SaveState(&writer));
+  if (!saved) {
+    LOG(ERROR) << "Could not save the decoder state.";
+    state->clear();
+  }
+  return saved;
+}
+
+bool LyraDecoder::RestoreState(absl::Span<const uint8_t> state) {
+  DiscardRecoveryState();
+  DiscardPreparedConcealment();
+  if (RestoreAllState(state)) {
+    return true;
+  }
+  LOG(ERROR) << "Could not restore the decoder state.";
+  Reset();
+  return false;
+}
+
+void LyraDecoder::Reset() {
+  DiscardRecoveryState();
+  DiscardPreparedConcealment();
+  // The model waits for a packet queued by |QueueEncodedPacket| to be
+  // prepared before it clears the conditioning the packet is written to.
+  if (generative_model_ != nullptr) {
+    generative_model_->Reset();
+  }
+  comfort_noise_generator_->Reset();
+  resampler_->Reset();
+  packet_loss_handler_->Reset();
+  internal_num_samples_available_ = 0;
+  encoded_packet_set_ = false;
+  packet_queued_ = false;
+  comfort_noise_packet_set_ = false;
+  internal_num_comfort_noise_samples_available_ = 0;
+  comfort_noise_packet_features_.clear();
+  num_consecutive_noise_frames_ = 0;
+  aggregated_packets_.clear();
+  next_sequence_number_ = absl::nullopt;
+  prev_frame_was_comfort_noise_ = false;
+  num_idle_samples_ = 0;
+}
+
+bool LyraDecoder::RestoreAllState(absl::Span<const uint8_t> state) {
+  StateReader reader(state);
+  return RestoreStateOrFail(&reader) && reader.num_bytes_left() == 0;
+}
+
+bool LyraDecoder::RestoreStateOrFail(StateReader* reader) {
+  uint32_t version;
+  int sample_rate_hz;
+  if (!reader->Read(&version) || version != kStateVersion ||
+      !reader->Read(&sample_rate_hz) || sample_rate_hz != sample_rate_hz_) {
+    return false;
+  }
+  const int num_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
+  const int max_num_samples =
+      num_samples_per_packet + num_samples_per_packet / kMaxStretchDivisor;
+  int32_t num_aggregated_packets;
+  if (!reader->Read(&internal_num_samples_available_) ||
+      internal_num_samples_available_ < 0 ||
+      internal_num_samples_available_ > max_num_samples ||
+      !reader->Read(&encoded_packet_set_) ||
+      !reader->Read(&comfort_noise_packet_set_) ||
+      !reader->Read(&internal_num_comfort_noise_samples_available_) ||
+      internal_num_comfort_noise_samples_available_ < 0 ||
+      internal_num_comfort_noise_samples_available_ > max_num_samples ||
+      !reader->ReadVector(&comfort_noise_packet_features_) ||
+      !reader->Read(&num_consecutive_noise_frames_) ||
+      !reader->Read(&prev_frame_was_comfort_noise_) ||
+      !reader->Read(&num_aggregated_packets) || num_aggregated_packets < 0) {
+    return false;
+  }
+  aggregated_packets_.resize(num_aggregated_packets);
+  for (std::vector<uint8_t>& packet : aggregated_packets_) {
+    if (!reader->ReadVector(&packet)) {
+      return false;
+    }
+  }
+  bool has_next_sequence_number;
+  uint8_t next_sequence_number;
+  if (!reader->Read(&has_next_sequence_number) ||
+      !reader->Read(&next_sequence_number)) {
+    return false;
+  }
+  next_sequence_number_ =
+      has_next_sequence_number ? absl::make_optional(next_sequence_number)
+                               : absl::nullopt;
+  packet_queued_ = false;
+  return generative_model_ != nullptr &&
+         generative_model_->RestoreState(reader) &&
+         comfort_noise_generator_->RestoreState(reader) &&
+         packet_loss_handler_->RestoreState(reader) &&
+         (sample_rate_hz_ == kInternalSampleRateHz ||
+          resampler_->RestoreState(reader));
+}
+
+bool LyraDecoder::PrepareConcealment() {
+  if (prepared_features_.has_value()) {
+    return true;
+  }
+  // Comfort noise does not use the conditioning of the generative model.
+  if (generative_model_ == nullptr || packet_queued_ ||
+      !aggregated_packets_.empty() || comfort_noise_packet_set_ ||
+      prev_frame_was_comfort_noise_ ||
+      quality_level_ == QualityLevel::kReduced) {
+    return false;
+  }
+  auto features_or = packet_loss_handler_->PeekLostFeatures(
+      GetNumSamplesPerHop(kInternalSampleRateHz));
+  if (!features_or.has_value() ||
+      !generative_model_->QueueSpeculativeFeatures(features_or.value())) {
+    return false;
+  }
+  prepared_features_ = std::move(features_or);
+  return true;
+}
+
+void LyraDecoder::DiscardPreparedConcealment() {
+  if (!prepared_features_.has_value()) {
+    return;
+  }
+  generative_model_->DiscardSpeculativeFeatures();
+  prepared_features_.reset();
+  ++metrics_.num_prepared_frames_discarded;
+}
+
+void LyraDecoder::CountIdleSamples(int num_samples) {
+  if (parking_delay_samples_ == 0 || generative_model_parked_ ||
+      generative_model_ == nullptr) {
+    return;
+  }
+  num_idle_samples_ += num_samples;
+  if (num_idle_samples_ < parking_delay_samples_) {
+    return;
+  }
+  // The model cannot park while it prepares queued features, so this is
+  // retried with the next comfort noise.
+  LYRA_TRACE_SCOPE("ParkGenerativeModel");
+  if (generative_model_->Park()) {
+    generative_model_parked_ = true;
+    ++metrics_.num_parks;
+  }
+}
+
+void LyraDecoder::UnparkGenerativeModel() {
+  num_idle_samples_ = 0;
+  if (!generative_model_parked_) {
+    return;
+  }
+  LYRA_TRACE_SCOPE("UnparkGenerativeModel");
+  const absl::Time start = absl::Now();
+  generative_model_->Unpark();
+  metrics_.max_unpark_nanos =
+      std::max(metrics_.max_unpark_nanos,
+               absl::ToInt64Nanoseconds(absl::Now() - start));
+  generative_model_parked_ = false;
+}
+
+void LyraDecoder::SetLatePacketRecoveryEnabled(bool enabled) {
+  late_packet_recovery_enabled_ = enabled;
+  DiscardRecoveryState();
+}
+
+absl::optional<std::vector<int16_t>> LyraDecoder::RecoverLatePacket(
+    absl::Span<const uint8_t> encoded, int num_samples_played) {
+  LYRA_TRACE_SCOPE("RecoverLatePacket");
+  if (recovery_state_.empty()) {
+    LOG(ERROR) << "There is no concealment to recover a late packet into.";
+    return absl::nullopt;
+  }
+  if (num_samples_played < 0 ||
+      num_samples_played > concealed_samples_.size()) {
+    LOG(ERROR) << "Only " << concealed_samples_.size()
+               << " samples were concealed, but " << num_samples_played
+               << " were played.";
+    return absl::nullopt;
+  }
+  DiscardPreparedConcealment();
+  if (!SaveState(&live_state_)) {
+    return absl::nullopt;
+  }
+  const int num_concealed_samples = concealed_samples_.size();
+  auto recovered_or = RecoverLatePacketOrFail(encoded, num_samples_played);
+  if (!recovered_or.has_value()) {
+    LOG(ERROR) << "Could not recover the late packet.";
+    concealed_samples_.resize(num_concealed_samples);
+    CHECK(RestoreAllState(live_state_));
+    return absl::nullopt;
+  }
+  DiscardRecoveryState();
+  ++metrics_.num_recovered_packets;
+  return recovered_or;
+}
+
+absl::optional<std::vector<int16_t>> LyraDecoder::RecoverLatePacketOrFail(
+    absl::Span<const uint8_t> encoded, int num_samples_played) {
+  // The concealment fades out right after the played samples.
+  const int num_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(sample_rate_hz_);
+  const int num_fade_samples =
+      std::min(sample_rate_hz_ * kRecoveryCrossfadeMillis / 1000,
+               num_samples_per_packet - num_samples_played);
+  const int num_missing_fade_samples =
+      num_samples_played + num_fade_samples - concealed_samples_.size();
+  if (num_missing_fade_samples > 0) {
+    // This adds to |concealed_samples_|, which still fits in a packet.
+    if (!GeneratePacketLoss(num_missing_fade_samples).has_value()) {
+      return absl::nullopt;
+    }
+  }
+  const int num_replaced_samples =
+      concealed_samples_.size() - num_samples_played;
+
+  if (!RestoreAllState(recovery_state_)) {
+    return absl::nullopt;
+  }
+  if (encoded.empty()) {
+    StartComfortNoisePacket(std::vector<float>());
+  } else if (!StartEncodedPacket(encoded)) {
+    return absl::nullopt;
+  }
+  if (num_samples_played > 0 &&
+      !GenerateSamples(num_samples_played).has_value()) {
+    return absl::nullopt;
+  }
+  auto recovered_or = GenerateSamples(num_replaced_samples);
+  if (!recovered_or.has_value()) {
+    return absl::nullopt;
+  }
+  const auto fade_out = absl::MakeConstSpan(concealed_samples_)
+                            .subspan(num_samples_played, num_fade_samples);
+  const auto fade_in = absl::MakeSpan(recovered_or.value())
+                           .subspan(0, num_fade_samples);
+  crossfader_.Crossfade(fade_out, fade_in, fade_in);
+  return recovered_or;
+}
+
+void LyraDecoder::DiscardRecoveryState() {
+  concealing_ = false;
+  recovery_state_.clear();
+  concealed_samples_.clear();
+}
+
 }  // namespace codec
 }  // namespace chromemedia
@@ -18,19 +18,35 @@
 #define LYRA_CODEC_LYRA_DECODER_H_
 
 #include <cstdint>
+#include <deque>
+#include <future>  // NOLINT(build/c++11)
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "codec_metrics.h"
+#include "compute_precision.h"
+#include "crossfader.h"
+#include "feature_frame.h"
+#include "flight_recorder.h"
 #include "generative_model_interface.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_decoder_interface.h"
+#include "lyra_model.h"
 #include "packet_interface.h"
 #include "packet_loss_handler_interface.h"
+#include "performance_profile.h"
+#include "quality_governor.h"
+#include "quality_level.h"
 #include "resampler_interface.h"
+#include "spectrogram_predictor_interface.h"
+#include "stage_profiler.h"
+#include "state_buffer.h"
+#include "thread_pool.h"
 #include "vector_quantizer_interface.h"
 
 namespace chromemedia {
@@ -45,18 +61,124 @@ class LyraDecoder : public LyraDecoderInterface {
   /// Static method to create a LyraDecoder.
   ///
   /// @param sample_rate_hz Desired sample rate in Hertz. The supported sample
-  ///                       rates are 8000, 16000, 32000 and 48000.
+  ///                       rates are 8000, 16000, 32000 and 48000. 8000 is
+  ///                       generated directly from the lowest bands of the
+  ///                       model, without resampling.
   /// @param num_channels Desired number of channels. Currently only 1 is
   ///                     supported.
   /// @param bit_rate Desired bit rate. Currently only 3000 is supported.
   /// @param model_path Path to the model weights. The identifier in the
   ///                   lyra_config.textproto has to coincide with the
   ///                   |kVersionMinor| constant in lyra_config.cc.
+  /// @param num_threads Number of threads used to decode a single stream,
+  ///                    including the calling thread. Values greater than 1
+  ///                    start background threads that live as long as the
+  ///                    decoder. Has to be positive.
+  /// @param precision Arithmetic of the generative model. Fixed point is
+  ///                  faster than float at some loss of quality.
+  /// @param spectrogram_predictor_factory Creates the predictor of the
+  ///                                      features of lost packets, such as
+  ///                                      |LinearSpectrogramPredictor::Create|.
+  ///                                      If null the last received features
+  ///                                      are repeated.
+  /// @return A unique_ptr to a |LyraDecoder| if all desired params are
+  ///         supported. Else it returns a nullptr.
+  static std::unique_ptr<LyraDecoder> Create(
+      int sample_rate_hz, int num_channels, int bitrate,
+      const ghc::filesystem::path& model_path, int num_threads = 1,
+      ComputePrecision precision = kDefaultComputePrecision,
+      SpectrogramPredictorFactory spectrogram_predictor_factory = nullptr);
+
+  /// Static method to create a LyraDecoder that shares its read-only weights
+  /// with every other decoder and encoder created from |model|. Only the
+  /// per-stream state, such as activations and recurrent state, is allocated
+  /// for each decoder.
+  ///
+  /// @param sample_rate_hz Desired sample rate in Hertz. The supported sample
+  ///                       rates are 8000, 16000, 32000 and 48000.
+  /// @param num_channels Desired number of channels. Currently only 1 is
+  ///                     supported.
+  /// @param bit_rate Desired bit rate. Currently only 3000 is supported.
+  /// @param model Weights created by |LyraModel::Create|. Has to be non-null.
+  /// @param num_threads Number of threads used to decode a single stream,
+  ///                    including the calling thread. Decoders using the same
+  ///                    number of threads share the same weights.
+  /// @param precision Arithmetic of the generative model. The weights of the
+  ///                  generative model are only guaranteed to be shared
+  ///                  between decoders of the same precision.
+  /// @param thread_pool Threads to run the generative model on. If null the
+  ///                    decoder starts |num_threads| - 1 threads of its own.
+  ///                    A pool shared between decoders needs at least
+  ///                    |num_threads| threads, and the decoders take turns
+  ///                    running on it.
+  /// @param spectrogram_predictor_factory Creates the predictor of the
+  ///                                      features of lost packets. If null
+  ///                                      the last received features are
+  ///                                      repeated.
   /// @return A unique_ptr to a |LyraDecoder| if all desired params are
   ///         supported. Else it returns a nullptr.
   static std::unique_ptr<LyraDecoder> Create(
       int sample_rate_hz, int num_channels, int bitrate,
-      const ghc::filesystem::path& model_path);
+      const std::shared_ptr<LyraModel>& model, int num_threads = 1,
+      ComputePrecision precision = kDefaultComputePrecision,
+      std::shared_ptr<ThreadPool> thread_pool = nullptr,
+      SpectrogramPredictorFactory spectrogram_predictor_factory = nullptr);
+
+  /// Static method to create a LyraDecoder from |model| that runs as its
+  /// |PerformanceProfile| says: with its number of threads, precision and
+  /// barrier, with or without pipelining and silence detection, and with a
+  /// |QualityGovernor| of its real time factors if they are set.
+  ///
+  /// @param sample_rate_hz Desired sample rate in Hertz. The supported sample
+  ///                       rates are 8000, 16000, 32000 and 48000.
+  /// @param num_channels Desired number of channels. Currently only 1 is
+  ///                     supported.
+  /// @param bit_rate Desired bit rate. Currently only 3000 is supported.
+  /// @param model Weights created by |LyraModel::Create|, which also read the
+  ///              profile. Has to be non-null.
+  /// @return A unique_ptr to a |LyraDecoder| if all desired params are
+  ///         supported. Else it returns a nullptr.
+  static std::unique_ptr<LyraDecoder> CreateWithProfile(
+      int sample_rate_hz, int num_channels, int bitrate,
+      const std::shared_ptr<LyraModel>& model);
+
+  /// Static method to create a LyraDecoder like |CreateWithProfile| that is
+  /// usable before the weights of its generative model are loaded.
+  ///
+  /// Only the quantizer and the comfort noise generator, which needs no
+  /// weights, are created before this returns. The generative model loads
+  /// and warms up on a background thread. Until it is ready every packet is
+  /// decoded as comfort noise from its received features, and packet loss is
+  /// concealed with comfort noise. The decoder switches to the generative
+  /// model at the first packet after it is ready, crossfading out of the
+  /// comfort noise. If the model fails to load the decoder stays in comfort
+  /// noise. |SaveState| and |RestoreState| fail until the model is in use.
+  ///
+  /// Destroying the decoder waits for the model to finish loading.
+  ///
+  /// @param sample_rate_hz Desired sample rate in Hertz. The supported sample
+  ///                       rates are 8000, 16000, 32000 and 48000.
+  /// @param num_channels Desired number of channels. Currently only 1 is
+  ///                     supported.
+  /// @param bit_rate Desired bit rate. Currently only 3000 is supported.
+  /// @param model Weights created by |LyraModel::Create|, which also read the
+  ///              profile. Has to be non-null.
+  /// @return A unique_ptr to a |LyraDecoder| if all desired params are
+  ///         supported. Else it returns a nullptr.
+  static std::unique_ptr<LyraDecoder> CreateProgressively(
+      int sample_rate_hz, int num_channels, int bitrate,
+      const std::shared_ptr<LyraModel>& model);
+
+  /// Blocks until the generative model of a decoder from |CreateProgressively|
+  /// is loaded and switches to it at the next packet.
+  ///
+  /// @return True if the decoder has a generative model, which decoders from
+  ///         any other factory always have.
+  bool WaitForGenerativeModel();
+
+  /// @return True if the generative model is loaded and in use, rather than
+  ///         every packet being decoded as comfort noise.
+  bool has_generative_model() const;
 
   /// Parses a packet and prepares the decoder to decode samples from the
   /// payload.
@@ -64,10 +186,102 @@ class LyraDecoder : public LyraDecoderInterface {
   /// If estimated features were added by |DecodePacketLoss| but not fully
   /// decoded overwrites that estimated feature.
   ///
+  /// An empty packet, as sent by an encoder with DTX enabled for a packet of
+  /// background noise, is decoded as comfort noise from the last noise
+  /// estimate. Unlike a lost packet this does not run the generative model,
+  /// except to fade out of it on the transition.
+  ///
   /// @param encoded Encoded packet as a span of bytes.
-  /// @return True if the provided packet is a valid Lyra packet.
+  /// @return True if the provided packet is a valid Lyra packet or empty.
   bool SetEncodedPacket(absl::Span<const uint8_t> encoded) override;
 
+  /// Like |SetEncodedPacket|, but plays the packet out into about
+  /// |num_samples| more samples, or fewer if it is negative, so that a jitter
+  /// buffer can drain or grow its delay without a separate time stretching
+  /// pass.
+  ///
+  /// The generative model repeats or skips columns of the upsampled
+  /// conditioning, evenly spread over the packet, so the stretch is rounded
+  /// to multiples of an eighth of a frame, e.g. 2.5ms. Comfort noise is
+  /// rendered into the requested number of samples. If the generative model
+  /// cannot stretch the packet it plays out at its own length.
+  ///
+  /// @param encoded Encoded packet as a span of bytes, which may be empty as
+  ///                for |SetEncodedPacket|.
+  /// @param num_samples The number of samples at |sample_rate_hz()| to add to
+  ///                    the packet, at most half a packet either way.
+  /// @return The number of samples at |sample_rate_hz()| the packet decodes
+  ///         into, or nullopt if |num_samples| is out of range or the packet
+  ///         is not valid.
+  absl::optional<int> SetStretchedEncodedPacket(
+      absl::Span<const uint8_t> encoded, int num_samples);
+
+  /// Parses the packet that follows the most recently added one, so that it
+  /// is prepared in the background while the remaining samples of the current
+  /// packet are decoded.
+  ///
+  /// |DecodeSamples| moves on to the queued packet once the current one is
+  /// fully decoded, without the latency of preparing it on the calling
+  /// thread. Only one packet can be queued at a time and |DecodePacketLoss|
+  /// fails while one is. |SetEncodedPacket| drops the queued packet. Empty
+  /// packets cannot be queued and have to go through |SetEncodedPacket|.
+  ///
+  /// Without pipelining, see |SetPipeliningEnabled|, the queued packet is
+  /// prepared on the calling thread once the current one is decoded instead.
+  ///
+  /// @param encoded Encoded packet as a span of bytes.
+  /// @return True if the provided packet is a valid Lyra packet and could be
+  ///         queued.
+  bool QueueEncodedPacket(absl::Span<const uint8_t> encoded);
+
+  /// Enables or disables preparing packets given to |QueueEncodedPacket| in
+  /// the background. Disabling it saves the background thread on hosts whose
+  /// cores are all busy. On by default.
+  ///
+  /// @param enabled Whether queued packets are prepared in the background.
+  void SetPipeliningEnabled(bool enabled);
+
+  /// Parses a payload of consecutive packets made by |PacketAggregator| and
+  /// prepares the decoder to decode samples from all of them in order.
+  ///
+  /// The first packet replaces the current one as with |SetEncodedPacket|,
+  /// and |DecodeSamples| moves on to the next one whenever one is fully
+  /// decoded. If packets were lost since the previous payload and this one
+  /// carries a redundant copy of the last of them, that copy is decoded first
+  /// instead of being concealed. |DecodePacketLoss| and |QueueEncodedPacket|
+  /// fail while packets of the payload remain, and |SetEncodedPacket| drops
+  /// them. Packets of the payload that were already received with an earlier
+  /// one, e.g. when payloads are delivered twice or out of order, are
+  /// skipped.
+  ///
+  /// @param payload Aggregated payload as a span of bytes.
+  /// @return True if the provided payload is a valid payload of Lyra packets.
+  ///         False if it is not, or if all of its packets were already
+  ///         received, in which case the decoder is left as it was.
+  bool SetAggregatedPayload(absl::Span<const uint8_t> payload);
+
+  /// Tells the decoder the packet that follows the lost ones, when a jitter
+  /// buffer already holds it, so that |DecodePacketLoss| interpolates the
+  /// features of the lost samples between the last received packet and
+  /// |encoded| instead of extrapolating them. The interpolated features need
+  /// no predictor and do not switch to comfort noise however long the loss,
+  /// so concealment keeps the quality of the generative model at the same
+  /// cost.
+  ///
+  /// |encoded| is only looked ahead at and still has to be added with
+  /// |SetEncodedPacket| once the lost samples are decoded. If more samples
+  /// than announced are lost, concealment carries on as without it.
+  ///
+  /// @param encoded Encoded packet as a span of bytes.
+  /// @param num_lost_samples The number of samples at |sample_rate_hz()|
+  ///                         still lost before |encoded| starts.
+  /// @return True if |encoded| is a valid Lyra packet which the lost samples
+  ///         are interpolated towards. False as well if there is no received
+  ///         packet to interpolate from, or concealment already switched to
+  ///         comfort noise.
+  bool SetFuturePacket(absl::Span<const uint8_t> encoded,
+                       int num_lost_samples) override;
+
   /// Decodes audio from the most recently added packet.
   ///
   /// @param num_samples Number of samples to decode. It has to be less than the
@@ -78,6 +292,33 @@ class LyraDecoder : public LyraDecoderInterface {
   ///          remaining samples available. Else it returns nullopt.
   absl::optional<std::vector<int16_t>> DecodeSamples(int num_samples) override;
 
+  /// Decodes audio from the most recently added packet into a caller-provided
+  /// buffer.
+  ///
+  /// Unlike the vector-returning overload this does not allocate once the
+  /// internal buffers have grown to the largest requested size, except while
+  /// transitioning out of comfort noise.
+  ///
+  /// @param samples Buffer to write |samples.size()| samples into. The same
+  ///                size constraints as for |num_samples| above apply.
+  /// @return True on success. On failure the contents of |samples| are
+  ///         unspecified.
+  bool DecodeSamples(absl::Span<int16_t> samples) override;
+
+  /// Decodes audio from the most recently added packet into float samples in
+  /// the int16 range.
+  ///
+  /// The samples of the generative model are resampled straight into
+  /// |samples| without being clipped to int16, so that a mixer working in
+  /// float neither pays for the conversions to and from int16 nor hears the
+  /// requantization of the resampler. It clips once, after mixing.
+  ///
+  /// @param samples Buffer to write |samples.size()| samples into. The same
+  ///                size constraints as for |num_samples| above apply.
+  /// @return True on success. On failure the contents of |samples| are
+  ///         unspecified.
+  bool DecodeSamples(absl::Span<float> samples) override;
+
   /// Decodes audio in packet loss mode.
   ///
   /// Greedily decodes samples remaining from the last provided packet, then
@@ -93,6 +334,41 @@ class LyraDecoder : public LyraDecoderInterface {
   absl::optional<std::vector<int16_t>> DecodePacketLoss(
       int num_samples) override;
 
+  /// Decodes audio in packet loss mode into a caller-provided buffer.
+  ///
+  /// @param samples Buffer to write |samples.size()| samples into.
+  /// @return True on success. On failure the contents of |samples| are
+  ///         unspecified.
+  bool DecodePacketLoss(absl::Span<int16_t> samples) override;
+
+  /// Decodes audio in packet loss mode into float samples in the int16 range.
+  ///
+  /// Concealment goes through int16 samples like the vector-returning
+  /// overload, so this only saves the caller the conversion.
+  ///
+  /// @param samples Buffer to write |samples.size()| samples into.
+  /// @return True on success. On failure the contents of |samples| are
+  ///         unspecified.
+  bool DecodePacketLoss(absl::Span<float> samples) override;
+
+  /// Precomputes the conditioning of the frame |DecodePacketLoss| would
+  /// conceal next, on the conditioning thread of the generative model while
+  /// the current samples are decoded, so that concealment does not pay for it
+  /// at the start of a loss.
+  ///
+  /// Meant to be called once the next packet is late or likely to be, e.g.
+  /// when the jitter buffer runs low. If a packet is added before the
+  /// concealment starts, the precomputed conditioning is dropped again. It is
+  /// also dropped when |SetLatePacketRecoveryEnabled| has to save the state
+  /// before the concealment, and |SaveState| fails until it was used or
+  /// dropped.
+  ///
+  /// @return True if the conditioning is being prepared. False if there is
+  ///         nothing to prepare, e.g. while a packet is queued, comfort noise
+  ///         is decoded, at |QualityLevel::kReduced| or if the generative
+  ///         model does not support it.
+  bool PrepareConcealment();
+
   /// Getter for the sample rate in Hertz.
   ///
   /// @return Sample rate in Hertz.
@@ -118,37 +394,323 @@ class LyraDecoder : public LyraDecoderInterface {
   /// @return True if the decoder is in comfort noise generation mode.
   bool is_comfort_noise() const override;
 
+  /// @return The counters of everything decoded since creation. The time of
+  ///         the generative model includes conditioning that was precomputed
+  ///         in the background.
+  DecoderMetrics metrics() const override;
+
+  /// Starts recording per-thread latency histograms of the stages of the
+  /// sampling loop, e.g. the GRU matrix multiplication, the sampling and the
+  /// time spent waiting at barriers.
+  ///
+  /// Profiling adds two clock reads per stage and is off unless this is
+  /// called. It must not be called concurrently with decoding.
+  ///
+  /// @return The profiler, owned by the decoder, whose |Summarize| and
+  ///         |Report| may be called at any time. Nullptr if the generative
+  ///         model does not support profiling.
+  StageProfiler* EnableStageProfiling();
+
+  /// Starts keeping the recent trace events of the calls of this decoder, i.e.
+  /// its stage timings and barrier waits with the threads and cores they ran
+  /// on, and dumps those of every |SetEncodedPacket|, |DecodeSamples| or
+  /// |DecodePacketLoss| call that takes longer than |options.deadline|, see
+  /// |FlightRecorder|. Replaces the recorder of a previous call. It must not
+  /// be called concurrently with decoding.
+  ///
+  /// @param options The deadline, how often calls are dumped at most and
+  ///                where to, and how many events are kept.
+  /// @return The recorder, owned by the decoder, or nullptr if |options| are
+  ///         invalid.
+  FlightRecorder* EnableFlightRecorder(const FlightRecorderOptions& options);
+
+  /// Enables or disables decoding received packets of background noise with
+  /// the comfort noise generator instead of the generative model.
+  ///
+  /// This saves most of the decoding time during pauses, at the cost of
+  /// rendering the noise only from its spectrum. Decoding switches to comfort
+  /// noise once all frames received over |kMinNoiseSeconds| were similar to
+  /// the background noise, and back to the generative model on the first
+  /// frame that is not. Packets queued by |QueueEncodedPacket| while the
+  /// generative model runs are decoded with it. Off by default.
+  ///
+  /// @param enabled Whether received noise is decoded as comfort noise.
+  void SetSilenceDetectionEnabled(bool enabled);
+
+  /// How long received frames have to be similar to the background noise
+  /// before they are decoded as comfort noise.
+  static constexpr float kMinNoiseSeconds = 0.1f;
+
+  /// Parks the generative model once the decoder decoded nothing but comfort
+  /// noise for |delay|, e.g. for a muted participant of a conference.
+  ///
+  /// A parked model stops its threads and gives the memory of its
+  /// activations back to the system, keeping only its state and weights.
+  /// The next packet decoded with the generative model, or concealment with
+  /// it, unparks the model first, which restarts its threads. That cost is
+  /// paid at most once per |delay| of comfort noise and is reported in
+  /// |DecoderMetrics::max_unpark_nanos|. Never parks by default.
+  ///
+  /// @param delay Comfort noise after which the model is parked, or zero to
+  ///              never park it.
+  void SetParkingDelay(absl::Duration delay);
+
+  /// Sets how much work decoding may take, e.g. as chosen by a
+  /// |QualityGovernor| from the observed real time factor.
+  ///
+  /// At |QualityLevel::kReduced| lost packets are concealed with comfort
+  /// noise right away instead of with the generative model, and received
+  /// background noise is decoded as comfort noise as with
+  /// |SetSilenceDetectionEnabled|. Takes effect from the next added or lost
+  /// packet. |QualityLevel::kFull| by default.
+  ///
+  /// @param quality_level The level to decode at.
+  void SetQualityLevel(QualityLevel quality_level);
+
+  /// @return The level set by |SetQualityLevel|, or the one chosen by the
+  ///         |QualityGovernor| of a decoder created with |CreateWithProfile|.
+  QualityLevel quality_level() const;
+
+  /// @return The profile the decoder runs with. Knobs changed after creation,
+  ///         such as by |SetSilenceDetectionEnabled|, are reflected in it.
+  const PerformanceProfile& performance_profile() const;
+
+  /// Runs the generative model once on dummy features and resets it, which
+  /// starts its threads, faults in the pages of its weights and buffers and
+  /// warms the caches, so that the first decoded packet is not much slower
+  /// than the following ones.
+  ///
+  /// The state of the decoder is left as it was. It must not be called
+  /// concurrently with decoding and is meant to be called right after
+  /// |Create|, since it also forgets the history of any decoded packets.
+  void WarmUp();
+
+  /// Returns the decoder to the state it was created in, so that it can
+  /// decode another stream without loading the weights or starting the
+  /// threads again, e.g. when a pool hands it to the next call.
+  ///
+  /// Clears everything |SaveState| would save, i.e. the generative model, the
+  /// comfort noise generator, the packet loss handler and the resampler, as
+  /// well as queued, aggregated and prepared packets and the state kept for
+  /// |RecoverLatePacket|. Settings such as |SetQualityLevel| and the metrics
+  /// are kept. It must not be called concurrently with decoding.
+  void Reset() override;
+
+  /// Saves the state of the stream, so that |RestoreState| can continue
+  /// decoding from this point: in this decoder, e.g. to roll back concealment
+  /// when a late packet arrives, or in another decoder created with the same
+  /// sample rate and precision, e.g. after moving the stream to another
+  /// process. The number of threads may differ.
+  ///
+  /// The state holds the GRU state, AR input and random generators of the
+  /// generative model, the input histories of its layers, the conditioning
+  /// that is left of the current packet, the merge filter and the resampler,
+  /// the comfort noise generator, the packet loss handler and the position in
+  /// the current packet. Settings such as |SetQualityLevel| and the metrics
+  /// are not part of it. It is smallest when taken right after a packet was
+  /// fully decoded, since no conditioning is left then, and only valid for
+  /// the same build of the codec.
+  ///
+  /// @param state Cleared and filled with the state. Its capacity is kept, so
+  ///              saving every packet into the same vector does not allocate
+  ///              once it has grown.
+  /// @return False if the state cannot be saved, which is the case while a
+  ///         packet added by |QueueEncodedPacket| is prepared in the
+  ///         background, while the conditioning of |PrepareConcealment| is
+  ///         neither used nor dropped, and while the generative model of a
+  ///         decoder created by |CreateProgressively| is still loading. A
+  ///         model parked by |SetParkingDelay| keeps its state and is saved
+  ///         without being unparked.
+  bool SaveState(std::vector<uint8_t>* state) const;
+
+  /// Restores a state saved by |SaveState|.
+  ///
+  /// @param state The state, which is not referenced after the call.
+  /// @return False if |state| was not saved by a decoder with the same
+  ///         sample rate and precision, in which case the decoder is
+  ///         |Reset|.
+  bool RestoreState(absl::Span<const uint8_t> state);
+
+  /// Enables or disables |RecoverLatePacket|.
+  ///
+  /// While enabled, the first call to |DecodePacketLoss| after a packet saves
+  /// the state of the stream as |SaveState| does, and the concealed samples
+  /// are kept until the next packet is added, for at most a packet's worth of
+  /// samples. Off by default.
+  ///
+  /// @param enabled Whether late packets can be recovered.
+  void SetLatePacketRecoveryEnabled(bool enabled);
+
+  /// Decodes a packet that arrived after |DecodePacketLoss| already concealed
+  /// it, in place of the concealment.
+  ///
+  /// The decoder rolls back to the state saved when the concealment started,
+  /// adds |encoded| as |SetEncodedPacket| would have and generates, without
+  /// returning them, the samples of the concealment that were already played.
+  /// It returns the samples that replace the rest of the concealment, of which
+  /// up to the first 10ms are crossfaded from the concealment. If less than
+  /// that was concealed past |num_samples_played|, the concealment is extended
+  /// to crossfade from. |DecodeSamples| then continues after the returned
+  /// samples.
+  ///
+  /// The concealment should start after the previous packet was fully
+  /// decoded, since the late packet replaces what was left of it.
+  ///
+  /// @param encoded The late packet.
+  /// @param num_samples_played The number of samples returned by
+  ///                           |DecodePacketLoss| since the previous packet
+  ///                           that were already played out and cannot be
+  ///                           replaced.
+  /// @return The samples that replace the concealment from
+  ///         |num_samples_played| on. Returns nullopt, leaving the decoder
+  ///         as it was, if recovery is disabled, no concealment can be
+  ///         recovered or |encoded| is not a valid packet.
+  absl::optional<std::vector<int16_t>> RecoverLatePacket(
+      absl::Span<const uint8_t> encoded, int num_samples_played);
+
  private:
   LyraDecoder() = delete;
+
+  static std::unique_ptr<LyraDecoder> Create(
+      int sample_rate_hz, int num_channels, int bitrate,
+      const ghc::filesystem::path& model_path, int num_threads,
+      LyraModel* model, ComputePrecision precision,
+      std::shared_ptr<ThreadPool> thread_pool,
+      const SpectrogramPredictorFactory& spectrogram_predictor_factory,
+      bool defer_generative_model = false);
   LyraDecoder(std::unique_ptr<GenerativeModelInterface> generative_model,
               std::unique_ptr<GenerativeModelInterface> comfort_noise_generator,
               std::unique_ptr<VectorQuantizerInterface> vector_quantizer,
               std::unique_ptr<PacketInterface> packet,
               std::unique_ptr<PacketLossHandlerInterface> packet_loss_handler,
               std::unique_ptr<ResamplerInterface> resampler, int sample_rate_hz,
-              int num_channels, int bitrate, int num_frames_per_packet);
+              int num_channels, int bitrate, int num_frames_per_packet,
+              int model_sample_rate_hz);
+
+  // Applies the knobs of |profile| that belong to the generative model.
+  void ApplyGenerativeModelProfile(const PerformanceProfile& profile);
+
+  // Applies the knobs of |profile| that belong to the decoder itself. Returns
+  // false if the |QualityGovernor| could not be created.
+  bool ApplyProfile(const PerformanceProfile& profile);
+
+  // Switches to the generative model loading in the background if it is
+  // ready, without blocking.
+  void MaybeSwitchToLoadedGenerativeModel();
+
+  // Takes the generative model from |pending_generative_model_|, which has to
+  // be valid, blocking until it is loaded.
+  void AdoptGenerativeModel();
+
+  // Adds the features of |encoded| to the generative model and the packet loss
+  // handler and makes it the current packet.
+  bool StartEncodedPacket(absl::Span<const uint8_t> encoded);
+
+  // Unpacks |encoded| into the concatenated features of all its frames.
+  // Returns a nullopt if it is not a valid Lyra packet.
+  absl::optional<std::vector<float>> UnpackFeatures(
+      absl::Span<const uint8_t> encoded) const;
 
+  // Makes a packet decoded as comfort noise the current one. Its frames are
+  // rendered from |features|, or from the noise estimate for the empty packet
+  // of an encoder with DTX enabled if |features| is empty.
+  void StartComfortNoisePacket(std::vector<float> features);
+
+  // Makes the queued packet the current one if the current one is fully
+  // decoded.
+  void MaybeAdvanceToQueuedPacket();
+
+  // The bodies of |DecodeSamples| and |DecodePacketLoss| without the
+  // accounting of |metrics_|.
+  absl::optional<std::vector<int16_t>> GenerateSamples(int num_samples);
+  absl::optional<std::vector<int16_t>> GeneratePacketLoss(int num_samples);
+
+  // Generates the samples of the model for |num_samples| samples at
+  // |sample_rate_hz_| of the current packet, which is not comfort noise.
+  // They are written into |output| if it holds exactly that many samples at
+  // |model_sample_rate_hz_|, or else into |internal_samples_|, which
+  // |allocated| tells whether grew. Returns the generated samples, or nullopt
+  // on failure.
+  absl::optional<absl::Span<const int16_t>> GenerateModelSamples(
+      int num_samples, absl::Span<int16_t> output, bool* allocated);
+
+  // Accounts a decoding call that started at |start| and produced
+  // |num_samples| samples, which are also added to |num_samples_of_kind|.
+  void RecordDecodeCall(absl::Time start, int num_samples,
+                        int64_t* num_samples_of_kind, bool allocated);
+
+  // Resamples with |resampler_|, accounting the time spent.
+  std::vector<int16_t> Resample(absl::Span<const int16_t> audio);
+
+  // Decodes |num_samples| samples at |sample_rate_hz_| of the current packet
+  // as comfort noise.
+  absl::optional<std::vector<int16_t>> DecodeComfortNoise(int num_samples);
+
+  // Generates |num_samples| samples at |kInternalSampleRateHz| worth of audio,
+  // returned at |model_sample_rate_hz_|. At |QualityLevel::kReduced| this goes
+  // to comfort noise without running the generative model past the overlap.
   absl::optional<std::vector<int16_t>> RunGenerativeModelForPacketLoss(
       int num_samples);
 
+  // Generates |num_samples| samples at |kInternalSampleRateHz| worth of audio
+  // from |estimated_features|, returned at |model_sample_rate_hz_|. Only the
+  // comfort noise generator runs if |is_comfort_noise| and the previous frame
+  // was comfort noise too, otherwise both run and are overlapped.
+  absl::optional<std::vector<int16_t>> RunModelsForEstimatedFeatures(
+      int num_samples, absl::Span<const float> estimated_features,
+      bool is_comfort_noise);
+
   // Runs the Comfort Noise Generator and performs any necessary overlap between
-  // models.
+  // models. |num_samples| is at |kInternalSampleRateHz| and the result is at
+  // |model_sample_rate_hz_|, like |generative_model_frame|.
   absl::optional<std::vector<int16_t>>
   RunComfortNoiseGeneratorWithNecessaryOverlap(
       int num_samples, bool overlap_required,
-      const std::vector<float>& features,
+      absl::Span<const float> features,
       const std::vector<int16_t>& generative_model_frame =
-          std::vector<int16_t>()) const;
+          std::vector<int16_t>());
 
   // Overlaps frames using a cos^2 window. |preceding_frame| will die down to
   // zero and |following_frame| will rise up from 0 in the resultant overlapped
   // frame. Returns a nullopt if input frames are not the same size.
   absl::optional<std::vector<int16_t>> OverlapFrames(
       const std::vector<int16_t>& preceding_frame,
-      const std::vector<int16_t>& following_frame) const;
+      const std::vector<int16_t>& following_frame);
+
+  // The body of |RestoreState|, which leaves the decoder in an unspecified
+  // state on failure.
+  bool RestoreStateOrFail(StateReader* reader);
+
+  // Restores |state|, returning false if it was not fully read.
+  bool RestoreAllState(absl::Span<const uint8_t> state);
+
+  // The body of |RecoverLatePacket| after the checks of its arguments. The
+  // decoder is left in an unspecified state on failure.
+  absl::optional<std::vector<int16_t>> RecoverLatePacketOrFail(
+      absl::Span<const uint8_t> encoded, int num_samples_played);
+
+  // Forgets the concealment |RecoverLatePacket| could replace, which ends
+  // with the next added packet.
+  void DiscardRecoveryState();
+
+  // Drops the conditioning prepared by |PrepareConcealment| if there is any.
+  void DiscardPreparedConcealment();
+
+  // Counts |num_samples| at |kInternalSampleRateHz| decoded without the
+  // generative model, and parks it once there were enough in a row.
+  void CountIdleSamples(int num_samples);
+
+  // Unparks the generative model if it is parked, and restarts the count of
+  // |CountIdleSamples|. Called before every use of the model.
+  void UnparkGenerativeModel();
 
-  // Used to generate the time domain samples.
+  // Used to generate the time domain samples. Null while it loads in the
+  // background, in which case |pending_generative_model_| is valid and
+  // |generative_model_profile_| is applied to it once it is loaded.
   std::unique_ptr<GenerativeModelInterface> generative_model_;
+  std::future<std::unique_ptr<GenerativeModelInterface>>
+      pending_generative_model_;
+  PerformanceProfile generative_model_profile_;
   // Used to generate comfort noise.
   std::unique_ptr<GenerativeModelInterface> comfort_noise_generator_;
   // Used to get the conditioning features from the bit-stream.
@@ -165,6 +727,10 @@ class LyraDecoder : public LyraDecoderInterface {
   const int num_channels_;
   const int bitrate_;
   const int num_frames_per_packet_;
+  // Sample rate of the samples produced by |generative_model_|. It is either
+  // |kInternalSampleRateHz| or, if the model can produce it directly,
+  // |sample_rate_hz_|, in which case no resampling is needed.
+  const int model_sample_rate_hz_;
 
   // The number of remaining samples to decode per packet expressed at the
   // frequency of |kInternalSampleRateHz|.
@@ -172,8 +738,65 @@ class LyraDecoder : public LyraDecoderInterface {
   // Prevent users from calling |DecodeSamples| without having added a real
   // encoded packet.
   bool encoded_packet_set_;
+  // Whether a packet was added by |QueueEncodedPacket| and not decoded from
+  // yet.
+  bool packet_queued_;
+  // Whether the current packet is decoded as comfort noise, and how many
+  // samples at |kInternalSampleRateHz| of it remain.
+  bool comfort_noise_packet_set_;
+  int internal_num_comfort_noise_samples_available_;
+  // The concatenated features of the current packet if it was received and
+  // decoded as comfort noise. Empty for the empty packets of DTX.
+  std::vector<float> comfort_noise_packet_features_;
+  // Whether received packets similar to the background noise are decoded as
+  // comfort noise, and how many consecutive received frames were.
+  bool silence_detection_enabled_;
+  int num_consecutive_noise_frames_;
+  QualityLevel quality_level_;
+  // Sets |quality_level_| after every decoding call if not null.
+  std::unique_ptr<QualityGovernor> quality_governor_;
+  PerformanceProfile performance_profile_;
+  // Null unless enabled with |EnableFlightRecorder|.
+  std::unique_ptr<FlightRecorder> flight_recorder_;
+  // The packets to start once the current one is decoded: those of the last
+  // aggregated payload, or one queued while decoding comfort noise.
+  std::deque<std::vector<uint8_t>> aggregated_packets_;
+  // The sequence number of the packet after the last aggregated payload,
+  // unset unless the current packet came from one.
+  absl::optional<uint8_t> next_sequence_number_;
   // Used to trigger overlap when switching to or from comfort noise.
   bool prev_frame_was_comfort_noise_;
+  // Samples at |kInternalSampleRateHz| of comfort noise after which the
+  // generative model is parked, or 0 if it never is, and how many were
+  // decoded since the model was last used.
+  int64_t parking_delay_samples_;
+  int64_t num_idle_samples_;
+  bool generative_model_parked_;
+  // Mixes the frames at a model transition, keeping the cos^2 window of the
+  // last frame size so it is not recomputed for every transition.
+  Crossfader crossfader_;
+  // Whether |RecoverLatePacket| is enabled and whether a concealment started
+  // since the last added packet. |recovery_state_| holds the state saved when
+  // it started and |concealed_samples_| the samples at |sample_rate_hz_|
+  // concealed since then. Both are empty once the concealment grew longer
+  // than a packet, or if the state could not be saved.
+  bool late_packet_recovery_enabled_;
+  bool concealing_;
+  std::vector<uint8_t> recovery_state_;
+  std::vector<int16_t> concealed_samples_;
+  // The state of the stream while |RecoverLatePacket| rolls back, restored
+  // if recovery fails.
+  std::vector<uint8_t> live_state_;
+  // The features queued in the generative model by |PrepareConcealment|,
+  // unset once they were used or dropped.
+  absl::optional<FeatureFrame> prepared_features_;
+  // Scratch space for samples at |model_sample_rate_hz_| before resampling,
+  // reused across calls to the span overloads.
+  std::vector<int16_t> internal_samples_;
+  // The counters that the decoder keeps itself. The times of the models are
+  // kept by the models.
+  DecoderMetrics metrics_;
+  RollingRealTimeFactor real_time_factor_;
   friend class LyraDecoderPeer;
 };
 
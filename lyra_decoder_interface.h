@@ -17,11 +17,13 @@
 #ifndef LYRA_CODEC_LYRA_DECODER_INTERFACE_H_
 #define LYRA_CODEC_LYRA_DECODER_INTERFACE_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
+#include "codec_metrics.h"
 
 namespace chromemedia {
 namespace codec {
@@ -43,11 +45,49 @@ class LyraDecoderInterface {
   virtual absl::optional<std::vector<int16_t>> DecodeSamples(
       int num_samples) = 0;
 
+  // Same as above, but decodes |samples.size()| samples into |samples|.
+  // Returns false on failure.
+  virtual bool DecodeSamples(absl::Span<int16_t> samples) = 0;
+
+  // Same as above, but decodes float samples in the int16 range, for callers
+  // that keep processing in float such as mixers. Decoders that have float
+  // samples before clipping them should override this; the default converts
+  // the int16 samples.
+  virtual bool DecodeSamples(absl::Span<float> samples) {
+    std::vector<int16_t> int16_samples(samples.size());
+    if (!DecodeSamples(absl::MakeSpan(int16_samples))) return false;
+    std::copy(int16_samples.begin(), int16_samples.end(), samples.begin());
+    return true;
+  }
+
   // Estimates an encoded packet, and decodes it.
   // On success returns samples from the model, on failure returns nullptr.
   virtual absl::optional<std::vector<int16_t>> DecodePacketLoss(
       int num_samples) = 0;
 
+  // Same as above, but decodes |samples.size()| samples into |samples|.
+  // Returns false on failure.
+  virtual bool DecodePacketLoss(absl::Span<int16_t> samples) = 0;
+
+  // Same as above, but decodes float samples in the int16 range.
+  virtual bool DecodePacketLoss(absl::Span<float> samples) {
+    std::vector<int16_t> int16_samples(samples.size());
+    if (!DecodePacketLoss(absl::MakeSpan(int16_samples))) return false;
+    std::copy(int16_samples.begin(), int16_samples.end(), samples.begin());
+    return true;
+  }
+
+  // Supplies |encoded|, which was already received but starts only after
+  // another |num_lost_samples| lost samples, so that the concealment of those
+  // can interpolate towards it. |encoded| still has to be added with
+  // |SetEncodedPacket| once its turn comes.
+  // Returns false if the decoder cannot make use of it, which the default
+  // cannot.
+  virtual bool SetFuturePacket(absl::Span<const uint8_t> encoded,
+                               int num_lost_samples) {
+    return false;
+  }
+
   virtual int sample_rate_hz() const = 0;
 
   virtual int num_channels() const = 0;
@@ -57,6 +97,14 @@ class LyraDecoderInterface {
   virtual int frame_rate() const = 0;
 
   virtual bool is_comfort_noise() const = 0;
+
+  // Returns the counters of everything decoded since creation.
+  virtual DecoderMetrics metrics() const = 0;
+
+  // Returns the decoder to the state it was created in, as if no packet had
+  // been added yet, so that it can decode another stream. Keeps the weights,
+  // threads and buffers, as well as settings and metrics.
+  virtual void Reset() = 0;
 };
 
 }  // namespace codec
@@ -0,0 +1,489 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_decoder_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_executor.h"
+#include "codec_metrics.h"
+#include "compute_precision.h"
+#include "dsp_util.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_decoder_interface.h"
+#include "lyra_model.h"
+#include "thread_affinity.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Forwards to a decoder and measures how long it takes per second of audio.
+class TimedDecoder : public LyraDecoderInterface {
+ public:
+  // Writes the average real time factor to |real_time_factor|.
+  TimedDecoder(std::unique_ptr<LyraDecoderInterface> decoder,
+               std::shared_ptr<std::atomic<double>> real_time_factor)
+      : decoder_(std::move(decoder)),
+        real_time_factor_(std::move(real_time_factor)),
+        pending_seconds_(0.0) {}
+
+  bool SetEncodedPacket(absl::Span<const uint8_t> encoded) override {
+    const absl::Time start = absl::Now();
+    const bool success = decoder_->SetEncodedPacket(encoded);
+    pending_seconds_ += absl::ToDoubleSeconds(absl::Now() - start);
+    return success;
+  }
+
+  absl::optional<std::vector<int16_t>> DecodeSamples(
+      int num_samples) override {
+    const absl::Time start = absl::Now();
+    auto samples = decoder_->DecodeSamples(num_samples);
+    Update(start, num_samples);
+    return samples;
+  }
+
+  bool DecodeSamples(absl::Span<int16_t> samples) override {
+    const absl::Time start = absl::Now();
+    const bool success = decoder_->DecodeSamples(samples);
+    Update(start, samples.size());
+    return success;
+  }
+
+  absl::optional<std::vector<int16_t>> DecodePacketLoss(
+      int num_samples) override {
+    const absl::Time start = absl::Now();
+    auto samples = decoder_->DecodePacketLoss(num_samples);
+    Update(start, num_samples);
+    return samples;
+  }
+
+  bool DecodePacketLoss(absl::Span<int16_t> samples) override {
+    const absl::Time start = absl::Now();
+    const bool success = decoder_->DecodePacketLoss(samples);
+    Update(start, samples.size());
+    return success;
+  }
+
+  bool DecodeSamples(absl::Span<float> samples) override {
+    const absl::Time start = absl::Now();
+    const bool success = decoder_->DecodeSamples(samples);
+    Update(start, samples.size());
+    return success;
+  }
+
+  bool DecodePacketLoss(absl::Span<float> samples) override {
+    const absl::Time start = absl::Now();
+    const bool success = decoder_->DecodePacketLoss(samples);
+    Update(start, samples.size());
+    return success;
+  }
+
+  int sample_rate_hz() const override { return decoder_->sample_rate_hz(); }
+
+  int num_channels() const override { return decoder_->num_channels(); }
+
+  int bitrate() const override { return decoder_->bitrate(); }
+
+  int frame_rate() const override { return decoder_->frame_rate(); }
+
+  bool is_comfort_noise() const override {
+    return decoder_->is_comfort_noise();
+  }
+
+  DecoderMetrics metrics() const override { return decoder_->metrics(); }
+
+  void Reset() override {
+    decoder_->Reset();
+    pending_seconds_ = 0.0;
+  }
+
+ private:
+  // Adds the time since |start| and the time spent setting packets since the
+  // last call to the average, as the cost of |num_samples|.
+  void Update(absl::Time start, int num_samples) {
+    const double processing_seconds =
+        pending_seconds_ + absl::ToDoubleSeconds(absl::Now() - start);
+    pending_seconds_ = 0.0;
+    if (num_samples <= 0) {
+      return;
+    }
+    const double audio_seconds =
+        static_cast<double>(num_samples) / decoder_->sample_rate_hz();
+    const double sample_real_time_factor = processing_seconds / audio_seconds;
+    const double previous = real_time_factor_->load();
+    if (previous < 0.0) {
+      real_time_factor_->store(sample_real_time_factor);
+      return;
+    }
+    const double weight =
+        std::min(1.0, audio_seconds / LyraDecoderPool::kSmoothingSeconds);
+    real_time_factor_->store(previous +
+                             weight * (sample_real_time_factor - previous));
+  }
+
+  const std::unique_ptr<LyraDecoderInterface> decoder_;
+  // Shared with the pool, but outlives its entry there while the last packets
+  // of a removed session are decoded.
+  const std::shared_ptr<std::atomic<double>> real_time_factor_;
+  // Time spent in |SetEncodedPacket| since the last decode.
+  double pending_seconds_;
+};
+
+}  // namespace
+
+std::unique_ptr<LyraDecoderPool> LyraDecoderPool::Create(
+    int sample_rate_hz, const std::shared_ptr<LyraModel>& model,
+    int num_threads, ComputePrecision precision) {
+  if (model == nullptr) {
+    LOG(ERROR) << "The decoder pool needs a model.";
+    return nullptr;
+  }
+  return Create(
+      [sample_rate_hz, model,
+       precision]() -> std::unique_ptr<LyraDecoderInterface> {
+        return LyraDecoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                                   model, /*num_threads=*/1, precision);
+      },
+      num_threads);
+}
+
+std::unique_ptr<LyraDecoderPool> LyraDecoderPool::CreateWithProfile(
+    int sample_rate_hz, const std::shared_ptr<LyraModel>& model) {
+  if (model == nullptr) {
+    LOG(ERROR) << "The decoder pool needs a model.";
+    return nullptr;
+  }
+  int num_workers = model->performance_profile().pool_num_workers;
+  if (num_workers == 0) {
+    num_workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return Create(
+      [sample_rate_hz, model]() -> std::unique_ptr<LyraDecoderInterface> {
+        return LyraDecoder::CreateWithProfile(sample_rate_hz, kNumChannels,
+                                              kBitrate, model);
+      },
+      num_workers);
+}
+
+std::unique_ptr<LyraDecoderPool> LyraDecoderPool::Create(
+    DecoderFactory decoder_factory, int num_threads) {
+  if (!decoder_factory) {
+    LOG(ERROR) << "The decoder pool needs a decoder factory.";
+    return nullptr;
+  }
+  auto executor = CodecExecutor::Create(num_threads, /*pin_threads=*/true);
+  if (executor == nullptr) {
+    return nullptr;
+  }
+  std::vector<Node> nodes(1);
+  nodes[0].decoder_factory = std::move(decoder_factory);
+  nodes[0].executor = std::move(executor);
+  return absl::WrapUnique(new LyraDecoderPool(std::move(nodes)));
+}
+
+std::unique_ptr<LyraDecoderPool> LyraDecoderPool::CreateNumaAware(
+    int sample_rate_hz, const ghc::filesystem::path& model_path,
+    const std::vector<NumaNode>& nodes) {
+  const std::vector<std::shared_ptr<LyraModel>> replicas =
+      LyraModel::CreateNumaReplicas(model_path, nodes);
+  if (replicas.empty()) {
+    LOG(ERROR) << "Could not create the weights of " << nodes.size()
+               << " NUMA nodes from " << model_path << ".";
+    return nullptr;
+  }
+  std::vector<DecoderFactory> decoder_factories;
+  decoder_factories.reserve(replicas.size());
+  for (const std::shared_ptr<LyraModel>& replica : replicas) {
+    decoder_factories.push_back(
+        [sample_rate_hz, replica]() -> std::unique_ptr<LyraDecoderInterface> {
+          return LyraDecoder::CreateWithProfile(sample_rate_hz, kNumChannels,
+                                                kBitrate, replica);
+        });
+  }
+  return CreateNumaAware(std::move(decoder_factories), nodes);
+}
+
+std::unique_ptr<LyraDecoderPool> LyraDecoderPool::CreateNumaAware(
+    std::vector<DecoderFactory> decoder_factories,
+    const std::vector<NumaNode>& nodes) {
+  if (nodes.empty() || decoder_factories.size() != nodes.size()) {
+    LOG(ERROR) << "The decoder pool needs one decoder factory per NUMA node, "
+               << "but has " << decoder_factories.size() << " for "
+               << nodes.size() << " nodes.";
+    return nullptr;
+  }
+  std::vector<Node> pool_nodes(nodes.size());
+  for (int i = 0; i < nodes.size(); ++i) {
+    if (!decoder_factories[i]) {
+      LOG(ERROR) << "The decoder pool needs a decoder factory.";
+      return nullptr;
+    }
+    pool_nodes[i].executor = CodecExecutor::CreateOnCpus(nodes[i].cpus);
+    if (pool_nodes[i].executor == nullptr) {
+      LOG(ERROR) << "Could not start the workers of NUMA node " << nodes[i].id
+                 << ".";
+      return nullptr;
+    }
+    pool_nodes[i].decoder_factory = std::move(decoder_factories[i]);
+    pool_nodes[i].numa_node = nodes[i];
+  }
+  return absl::WrapUnique(new LyraDecoderPool(std::move(pool_nodes)));
+}
+
+LyraDecoderPool::LyraDecoderPool(std::vector<Node> nodes)
+    : nodes_(std::move(nodes)) {}
+
+absl::optional<LyraDecoderPool::SessionId> LyraDecoderPool::AddSession(
+    int num_frames_per_packet) {
+  absl::MutexLock lock(&mutex_);
+  if (!CanAdmitSessionLocked()) {
+    LOG(ERROR) << "The decoder pool is at capacity with " << sessions_.size()
+               << " sessions.";
+    return absl::nullopt;
+  }
+  const int node_index = LeastLoadedNodeLocked();
+  const Node& node = nodes_[node_index];
+  std::unique_ptr<LyraDecoderInterface> decoder;
+  if (node.numa_node.has_value()) {
+    // The decoder allocates its state as it is created, which puts that state
+    // into the memory of the node it is created on.
+    RunOnNumaNode(*node.numa_node,
+                  [&node, &decoder]() { decoder = node.decoder_factory(); });
+  } else {
+    decoder = node.decoder_factory();
+  }
+  if (decoder == nullptr) {
+    LOG(ERROR) << "Could not create a decoder for a new session.";
+    return absl::nullopt;
+  }
+  auto real_time_factor = std::make_shared<std::atomic<double>>(-1.0);
+  const absl::optional<CodecExecutor::SessionId> executor_session =
+      node.executor->AddDecoderSession(
+          absl::make_unique<TimedDecoder>(std::move(decoder), real_time_factor),
+          num_frames_per_packet);
+  if (!executor_session.has_value()) {
+    return absl::nullopt;
+  }
+  const SessionId session = next_session_id_++;
+  Session& state = sessions_[session];
+  state.node = node_index;
+  state.executor_session = *executor_session;
+  state.real_time_factor = std::move(real_time_factor);
+  state.mix_buffer = std::make_shared<std::vector<float>>();
+  return session;
+}
+
+bool LyraDecoderPool::RemoveSession(SessionId session) {
+  absl::MutexLock lock(&mutex_);
+  const auto it = sessions_.find(session);
+  if (it == sessions_.end()) {
+    return false;
+  }
+  const Session state = std::move(it->second);
+  sessions_.erase(it);
+  return nodes_[state.node].executor->RemoveSession(state.executor_session);
+}
+
+bool LyraDecoderPool::FindSession(
+    SessionId session, CodecExecutor** executor,
+    CodecExecutor::SessionId* executor_session) const {
+  absl::ReaderMutexLock lock(&mutex_);
+  const auto it = sessions_.find(session);
+  if (it == sessions_.end()) {
+    return false;
+  }
+  *executor = nodes_[it->second.node].executor.get();
+  *executor_session = it->second.executor_session;
+  return true;
+}
+
+std::future<absl::optional<std::vector<int16_t>>> LyraDecoderPool::SubmitPacket(
+    SessionId session, std::vector<uint8_t> packet) {
+  CodecExecutor* executor;
+  CodecExecutor::SessionId executor_session;
+  if (!FindSession(session, &executor, &executor_session)) {
+    std::promise<absl::optional<std::vector<int16_t>>> failed;
+    failed.set_value(absl::nullopt);
+    return failed.get_future();
+  }
+  return executor->SubmitPacket(executor_session, std::move(packet));
+}
+
+std::future<absl::optional<std::vector<int16_t>>>
+LyraDecoderPool::SubmitPacketLoss(SessionId session) {
+  CodecExecutor* executor;
+  CodecExecutor::SessionId executor_session;
+  if (!FindSession(session, &executor, &executor_session)) {
+    std::promise<absl::optional<std::vector<int16_t>>> failed;
+    failed.set_value(absl::nullopt);
+    return failed.get_future();
+  }
+  return executor->SubmitPacketLoss(executor_session);
+}
+
+bool LyraDecoderPool::DecodeAndMix(absl::Span<const MixInput> inputs,
+                                   absl::Span<float> mix, bool soft_clip) {
+  std::vector<std::shared_ptr<std::vector<float>>> buffers(inputs.size());
+  std::vector<CodecExecutor*> executors(inputs.size(), nullptr);
+  std::vector<CodecExecutor::SessionId> executor_sessions(inputs.size(), 0);
+  {
+    absl::ReaderMutexLock lock(&mutex_);
+    for (int i = 0; i < inputs.size(); ++i) {
+      const auto it = sessions_.find(inputs[i].session);
+      if (it != sessions_.end()) {
+        buffers[i] = it->second.mix_buffer;
+        executors[i] = nodes_[it->second.node].executor.get();
+        executor_sessions[i] = it->second.executor_session;
+      }
+    }
+  }
+  bool success = true;
+  std::vector<std::future<bool>> decoded(inputs.size());
+  for (int i = 0; i < inputs.size(); ++i) {
+    if (buffers[i] == nullptr) {
+      LOG(ERROR) << "There is no decoder session " << inputs[i].session
+                 << ".";
+      success = false;
+      continue;
+    }
+    buffers[i]->resize(mix.size());
+    decoded[i] = executors[i]->SubmitPacketInto(
+        executor_sessions[i], inputs[i].packet, absl::MakeSpan(*buffers[i]));
+  }
+  for (int i = 0; i < inputs.size(); ++i) {
+    if (buffers[i] == nullptr) {
+      continue;
+    }
+    if (!decoded[i].get()) {
+      success = false;
+      continue;
+    }
+    const float gain = inputs[i].gain;
+    const std::vector<float>& samples = *buffers[i];
+    for (int j = 0; j < mix.size(); ++j) {
+      mix[j] += gain * samples[j];
+    }
+  }
+  if (soft_clip) {
+    SoftClipToInt16Range(mix);
+  }
+  return success;
+}
+
+bool LyraDecoderPool::CanAdmitSession() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return CanAdmitSessionLocked();
+}
+
+absl::optional<double> LyraDecoderPool::AverageRealTimeFactorLocked() const {
+  double measured_load = 0.0;
+  int num_measured = 0;
+  for (const auto& [session, state] : sessions_) {
+    const double real_time_factor = state.real_time_factor->load();
+    if (real_time_factor >= 0.0) {
+      measured_load += real_time_factor;
+      ++num_measured;
+    }
+  }
+  if (num_measured == 0) {
+    return absl::nullopt;
+  }
+  return measured_load / num_measured;
+}
+
+bool LyraDecoderPool::CanAdmitSessionLocked() const {
+  const absl::optional<double> average = AverageRealTimeFactorLocked();
+  if (!average.has_value()) {
+    return true;
+  }
+  double expected_load = *average;
+  for (const auto& [session, state] : sessions_) {
+    const double real_time_factor = state.real_time_factor->load();
+    expected_load += real_time_factor >= 0.0 ? real_time_factor : *average;
+  }
+  return expected_load <= kMaxUtilization * num_threads();
+}
+
+int LyraDecoderPool::LeastLoadedNodeLocked() const {
+  // Before any session was measured every session counts as the same load.
+  const double average = AverageRealTimeFactorLocked().value_or(1.0);
+  std::vector<double> node_loads(nodes_.size(), 0.0);
+  for (const auto& [session, state] : sessions_) {
+    const double real_time_factor = state.real_time_factor->load();
+    node_loads[state.node] +=
+        real_time_factor >= 0.0 ? real_time_factor : average;
+  }
+  int least_loaded = 0;
+  double least_utilization = 0.0;
+  for (int i = 0; i < nodes_.size(); ++i) {
+    const double utilization =
+        (node_loads[i] + average) / nodes_[i].executor->num_threads();
+    if (i == 0 || utilization < least_utilization) {
+      least_loaded = i;
+      least_utilization = utilization;
+    }
+  }
+  return least_loaded;
+}
+
+double LyraDecoderPool::load() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  double total = 0.0;
+  for (const auto& [session, state] : sessions_) {
+    total += std::max(0.0, state.real_time_factor->load());
+  }
+  return total;
+}
+
+int LyraDecoderPool::num_sessions() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return static_cast<int>(sessions_.size());
+}
+
+int LyraDecoderPool::num_threads() const {
+  int num_threads = 0;
+  for (const Node& node : nodes_) {
+    num_threads += node.executor->num_threads();
+  }
+  return num_threads;
+}
+
+int LyraDecoderPool::num_sessions_on_node(int node) const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return static_cast<int>(
+      std::count_if(sessions_.begin(), sessions_.end(),
+                    [node](const auto& entry) {
+                      return entry.second.node == node;
+                    }));
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_DECODER_POOL_H_
+#define LYRA_CODEC_LYRA_DECODER_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_executor.h"
+#include "compute_precision.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_decoder_interface.h"
+#include "lyra_model.h"
+#include "thread_affinity.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Decodes many sessions, e.g. the calls of a server, on a fixed set of pinned
+// worker threads. Every session gets a single-threaded decoder, so the number
+// of threads does not grow with the number of sessions, and all decoders share
+// one copy of the weights through a |LyraModel|.
+//
+// The pool measures the real time factor of every session, that is the core
+// time its decoding takes per second of audio, and only admits a new session
+// while the summed load of all sessions, plus what the new one is expected to
+// take, fits into |kMaxUtilization| of the worker threads.
+//
+// On servers with several NUMA nodes the pool created by |CreateNumaAware|
+// keeps a replica of the weights and a set of workers per node, and places
+// every session, i.e. its decoder state and the threads decoding it, on the
+// least loaded node, so that decoding never reads across the interconnect.
+//
+// All methods are thread-safe.
+class LyraDecoderPool {
+ public:
+  using SessionId = int64_t;
+  using DecoderFactory =
+      std::function<std::unique_ptr<LyraDecoderInterface>()>;
+
+  // What |DecodeAndMix| decodes of one session.
+  struct MixInput {
+    SessionId session;
+    // The next packet of the session, or a nullopt to conceal a lost one. An
+    // empty packet is decoded as comfort noise.
+    absl::optional<std::vector<uint8_t>> packet;
+    // The factor the samples are mixed with.
+    float gain = 1.0f;
+  };
+
+  // Fraction of the worker threads that admitted sessions may load. The rest
+  // absorbs the variation between packets, so that packets are not late.
+  static constexpr double kMaxUtilization = 0.8;
+  // Audio time over which the real time factor of a session is averaged.
+  static constexpr double kSmoothingSeconds = 1.0;
+
+  // Creates decoders at |sample_rate_hz| from |model| with |precision| on
+  // |num_threads| workers. Returns a nullptr if |model| is null or
+  // |num_threads| is not positive.
+  static std::unique_ptr<LyraDecoderPool> Create(
+      int sample_rate_hz, const std::shared_ptr<LyraModel>& model,
+      int num_threads, ComputePrecision precision = kDefaultComputePrecision);
+
+  // Creates decoders with |LyraDecoder::CreateWithProfile| on the
+  // |pool_num_workers| of the profile of |model|, or on one worker per core
+  // if it is 0. Returns a nullptr if |model| is null.
+  static std::unique_ptr<LyraDecoderPool> CreateWithProfile(
+      int sample_rate_hz, const std::shared_ptr<LyraModel>& model);
+
+  // Same as above, but creates the decoder of every session with
+  // |decoder_factory|. Returns a nullptr if |decoder_factory| is empty or
+  // |num_threads| is not positive.
+  static std::unique_ptr<LyraDecoderPool> Create(DecoderFactory decoder_factory,
+                                                 int num_threads);
+
+  // Creates decoders with |LyraDecoder::CreateWithProfile| from a replica of
+  // the weights in |model_path| per node of |nodes|, see
+  // |LyraModel::CreateNumaReplicas|, on one worker per core of every node.
+  // Returns a nullptr if |nodes| is empty or the model cannot be created.
+  static std::unique_ptr<LyraDecoderPool> CreateNumaAware(
+      int sample_rate_hz, const ghc::filesystem::path& model_path,
+      const std::vector<NumaNode>& nodes = DetectNumaNodes());
+
+  // Same as above, but creates the decoders of the sessions placed on node
+  // |i| with |decoder_factories[i]|, in the memory of that node. Returns a
+  // nullptr if there is not one factory per node, a factory is empty or a
+  // node has no cores.
+  static std::unique_ptr<LyraDecoderPool> CreateNumaAware(
+      std::vector<DecoderFactory> decoder_factories,
+      const std::vector<NumaNode>& nodes);
+
+  // Adds a session decoding packets of |num_frames_per_packet| frames. Returns
+  // a nullopt if the pool has no capacity left, the decoder could not be
+  // created or |num_frames_per_packet| is not positive.
+  absl::optional<SessionId> AddSession(int num_frames_per_packet);
+
+  // Removes |session| once its submitted packets are decoded. Returns false
+  // if there is no such session.
+  bool RemoveSession(SessionId session);
+
+  // See |CodecExecutor::SubmitPacket| and |CodecExecutor::SubmitPacketLoss|.
+  std::future<absl::optional<std::vector<int16_t>>> SubmitPacket(
+      SessionId session, std::vector<uint8_t> packet);
+  std::future<absl::optional<std::vector<int16_t>>> SubmitPacketLoss(
+      SessionId session);
+
+  // Decodes one packet of every session of |inputs| on the workers and adds
+  // its samples, times its gain, to |mix|, which holds one packet of float
+  // samples in the int16 range. The sessions decode into float buffers of
+  // their own that are kept between calls, so mixing neither allocates per
+  // session nor converts from int16. With |soft_clip| |mix| is then passed
+  // through |SoftClipToInt16Range|. Blocks until all sessions are decoded.
+  // Returns false if a session does not exist, failed or does not decode
+  // |mix.size()| samples per packet, in which case the others are still
+  // mixed. Calls for the same session must not overlap.
+  bool DecodeAndMix(absl::Span<const MixInput> inputs, absl::Span<float> mix,
+                    bool soft_clip = false);
+
+  // Whether |AddSession| would admit another session. Sessions that did not
+  // decode yet are expected to load a thread as much as the average measured
+  // session. Until any session was measured every session is admitted.
+  bool CanAdmitSession() const;
+
+  // The summed real time factor of the measured sessions, in threads.
+  double load() const;
+
+  int num_sessions() const;
+
+  // The number of sessions placed on node |node|, in the order of the nodes
+  // the pool was created with. A pool not created by |CreateNumaAware| has a
+  // single node.
+  int num_sessions_on_node(int node) const;
+
+  int num_nodes() const { return static_cast<int>(nodes_.size()); }
+
+  int num_threads() const;
+
+ private:
+  // The workers of one NUMA node and the decoders they run.
+  struct Node {
+    DecoderFactory decoder_factory;
+    std::unique_ptr<CodecExecutor> executor;
+    // Where the decoders are created, or a nullopt to leave that to the OS.
+    absl::optional<NumaNode> numa_node;
+  };
+
+  struct Session {
+    int node = 0;
+    CodecExecutor::SessionId executor_session = 0;
+    // Written by the worker decoding the session. Negative until the session
+    // decoded.
+    std::shared_ptr<std::atomic<double>> real_time_factor;
+    // The samples the session decodes for |DecodeAndMix|, kept alive by a
+    // running call after the session is removed.
+    std::shared_ptr<std::vector<float>> mix_buffer;
+  };
+
+  explicit LyraDecoderPool(std::vector<Node> nodes);
+
+  bool CanAdmitSessionLocked() const ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // The node whose workers are expected to be the least loaded with one more
+  // session.
+  int LeastLoadedNodeLocked() const ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // The average real time factor of the measured sessions, or a nullopt if
+  // none was measured yet.
+  absl::optional<double> AverageRealTimeFactorLocked() const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // Looks up the executor and executor session of |session|. Returns false if
+  // there is no such session.
+  bool FindSession(SessionId session, CodecExecutor** executor,
+                   CodecExecutor::SessionId* executor_session) const;
+
+  const std::vector<Node> nodes_;
+
+  mutable absl::Mutex mutex_;
+  std::map<SessionId, Session> sessions_ ABSL_GUARDED_BY(mutex_);
+  SessionId next_session_id_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_DECODER_POOL_H_
@@ -0,0 +1,225 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_decoder_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "dsp_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_decoder_interface.h"
+#include "testing/mock_lyra_decoder.h"
+#include "thread_affinity.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::_;
+using testing::An;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Optional;
+using testing::Return;
+
+constexpr int kSampleRateHz = 16000;
+constexpr int kFrameRate = 25;
+constexpr int kNumSamplesPerPacket = kSampleRateHz / kFrameRate;
+constexpr absl::Duration kPacketDuration =
+    absl::Milliseconds(1000 / kFrameRate);
+
+// Returns a factory of decoders that take |decode_time| per packet.
+LyraDecoderPool::DecoderFactory SlowDecoderFactory(absl::Duration decode_time) {
+  return [decode_time]() -> std::unique_ptr<LyraDecoderInterface> {
+    auto decoder = absl::make_unique<NiceMock<MockLyraDecoder>>();
+    ON_CALL(*decoder, sample_rate_hz()).WillByDefault(Return(kSampleRateHz));
+    ON_CALL(*decoder, frame_rate()).WillByDefault(Return(kFrameRate));
+    ON_CALL(*decoder, SetEncodedPacket(_)).WillByDefault(Return(true));
+    ON_CALL(*decoder, DecodeSamples(An<int>()))
+        .WillByDefault(Invoke([decode_time](int num_samples) {
+          absl::SleepFor(decode_time);
+          return absl::optional<std::vector<int16_t>>(
+              std::vector<int16_t>(num_samples, 1));
+        }));
+    ON_CALL(*decoder, DecodeSamples(An<absl::Span<int16_t>>()))
+        .WillByDefault(Invoke([decode_time](absl::Span<int16_t> samples) {
+          absl::SleepFor(decode_time);
+          std::fill(samples.begin(), samples.end(), 1);
+          return true;
+        }));
+    return decoder;
+  };
+}
+
+TEST(LyraDecoderPoolTest, CreateFailsWithInvalidArguments) {
+  EXPECT_EQ(LyraDecoderPool::Create(kSampleRateHz, nullptr, 1), nullptr);
+  EXPECT_EQ(LyraDecoderPool::Create(nullptr, 1), nullptr);
+  EXPECT_EQ(LyraDecoderPool::Create(SlowDecoderFactory(absl::ZeroDuration()),
+                                    0),
+            nullptr);
+}
+
+TEST(LyraDecoderPoolTest, AddSessionFailsWithoutDecoder) {
+  auto pool = LyraDecoderPool::Create(
+      []() -> std::unique_ptr<LyraDecoderInterface> { return nullptr; }, 1);
+  ASSERT_NE(pool, nullptr);
+  EXPECT_FALSE(pool->AddSession(1).has_value());
+  EXPECT_EQ(pool->num_sessions(), 0);
+}
+
+TEST(LyraDecoderPoolTest, DecodesSubmittedPackets) {
+  auto pool =
+      LyraDecoderPool::Create(SlowDecoderFactory(absl::ZeroDuration()), 2);
+  ASSERT_NE(pool, nullptr);
+  EXPECT_EQ(pool->num_threads(), 2);
+  const auto session = pool->AddSession(/*num_frames_per_packet=*/2);
+  ASSERT_TRUE(session.has_value());
+  EXPECT_EQ(pool->num_sessions(), 1);
+
+  EXPECT_THAT(pool->SubmitPacket(*session, {1}).get(),
+              Optional(std::vector<int16_t>(2 * kNumSamplesPerPacket, 1)));
+  EXPECT_TRUE(pool->RemoveSession(*session));
+  EXPECT_EQ(pool->num_sessions(), 0);
+  EXPECT_EQ(pool->SubmitPacket(*session, {1}).get(), absl::nullopt);
+}
+
+TEST(LyraDecoderPoolTest, DecodeAndMixAddsWeightedSessions) {
+  auto pool =
+      LyraDecoderPool::Create(SlowDecoderFactory(absl::ZeroDuration()), 2);
+  ASSERT_NE(pool, nullptr);
+  const auto first = pool->AddSession(1);
+  const auto second = pool->AddSession(1);
+  ASSERT_TRUE(first.has_value());
+  ASSERT_TRUE(second.has_value());
+
+  std::vector<float> mix(kNumSamplesPerPacket, 1.0f);
+  const std::vector<LyraDecoderPool::MixInput> inputs = {
+      {*first, std::vector<uint8_t>{1}, 0.5f},
+      {*second, std::vector<uint8_t>{1}, 2.0f}};
+  ASSERT_TRUE(pool->DecodeAndMix(inputs, absl::MakeSpan(mix)));
+  EXPECT_EQ(mix, std::vector<float>(kNumSamplesPerPacket, 3.5f));
+
+  // The remaining session is still mixed.
+  EXPECT_TRUE(pool->RemoveSession(*first));
+  std::fill(mix.begin(), mix.end(), 0.0f);
+  EXPECT_FALSE(pool->DecodeAndMix(inputs, absl::MakeSpan(mix)));
+  EXPECT_EQ(mix, std::vector<float>(kNumSamplesPerPacket, 2.0f));
+}
+
+TEST(LyraDecoderPoolTest, DecodeAndMixSoftClips) {
+  auto pool =
+      LyraDecoderPool::Create(SlowDecoderFactory(absl::ZeroDuration()), 1);
+  ASSERT_NE(pool, nullptr);
+  const auto session = pool->AddSession(1);
+  ASSERT_TRUE(session.has_value());
+
+  std::vector<float> mix(kNumSamplesPerPacket, 0.0f);
+  const std::vector<LyraDecoderPool::MixInput> inputs = {
+      {*session, std::vector<uint8_t>{1}, 1e5f}};
+  ASSERT_TRUE(pool->DecodeAndMix(inputs, absl::MakeSpan(mix),
+                                 /*soft_clip=*/true));
+  for (const float sample : mix) {
+    EXPECT_LE(sample, std::numeric_limits<int16_t>::max());
+    EXPECT_GT(sample, kSoftClipKnee * std::numeric_limits<int16_t>::max());
+  }
+}
+
+TEST(LyraDecoderPoolTest, AdmitsSessionsUntilMeasuredLoadExceedsCapacity) {
+  // Every session takes at least half a thread.
+  auto pool = LyraDecoderPool::Create(SlowDecoderFactory(kPacketDuration / 2),
+                                      /*num_threads=*/1);
+  ASSERT_NE(pool, nullptr);
+  const auto session = pool->AddSession(1);
+  ASSERT_TRUE(session.has_value());
+  // Nothing was measured yet.
+  EXPECT_TRUE(pool->CanAdmitSession());
+  EXPECT_EQ(pool->load(), 0.0);
+
+  ASSERT_TRUE(pool->SubmitPacket(*session, {1}).get().has_value());
+  EXPECT_GE(pool->load(), 0.5);
+  // A second session would take the thread beyond |kMaxUtilization|.
+  EXPECT_FALSE(pool->CanAdmitSession());
+  EXPECT_FALSE(pool->AddSession(1).has_value());
+
+  EXPECT_TRUE(pool->RemoveSession(*session));
+  EXPECT_TRUE(pool->CanAdmitSession());
+  EXPECT_TRUE(pool->AddSession(1).has_value());
+}
+
+TEST(LyraDecoderPoolTest, CreateNumaAwareFailsWithInvalidArguments) {
+  const std::vector<NumaNode> nodes = DetectNumaNodes();
+  EXPECT_EQ(LyraDecoderPool::CreateNumaAware({}, {}), nullptr);
+  EXPECT_EQ(LyraDecoderPool::CreateNumaAware({}, nodes), nullptr);
+  EXPECT_EQ(LyraDecoderPool::CreateNumaAware(
+                {SlowDecoderFactory(absl::ZeroDuration())}, {NumaNode()}),
+            nullptr);
+  EXPECT_EQ(LyraDecoderPool::CreateNumaAware(
+                kSampleRateHz, ghc::filesystem::current_path() / "missing",
+                nodes),
+            nullptr);
+}
+
+TEST(LyraDecoderPoolTest, SessionsAreSpreadOverNumaNodes) {
+  // Two nodes on the cores of the first real one, with one worker each.
+  NumaNode node = DetectNumaNodes().front();
+  node.cpus.resize(1);
+  auto pool = LyraDecoderPool::CreateNumaAware(
+      {SlowDecoderFactory(absl::ZeroDuration()),
+       SlowDecoderFactory(absl::ZeroDuration())},
+      {node, node});
+  ASSERT_NE(pool, nullptr);
+  EXPECT_EQ(pool->num_nodes(), 2);
+  EXPECT_EQ(pool->num_threads(), 2);
+
+  std::vector<LyraDecoderPool::SessionId> sessions;
+  for (int i = 0; i < 4; ++i) {
+    const auto session = pool->AddSession(1);
+    ASSERT_TRUE(session.has_value());
+    sessions.push_back(*session);
+  }
+  EXPECT_EQ(pool->num_sessions_on_node(0), 2);
+  EXPECT_EQ(pool->num_sessions_on_node(1), 2);
+
+  std::vector<float> mix(kNumSamplesPerPacket, 0.0f);
+  std::vector<LyraDecoderPool::MixInput> inputs;
+  for (const auto session : sessions) {
+    inputs.push_back({session, std::vector<uint8_t>{1}, 1.0f});
+    EXPECT_THAT(pool->SubmitPacket(session, {1}).get(),
+                Optional(std::vector<int16_t>(kNumSamplesPerPacket, 1)));
+  }
+  ASSERT_TRUE(pool->DecodeAndMix(inputs, absl::MakeSpan(mix)));
+  EXPECT_EQ(mix, std::vector<float>(kNumSamplesPerPacket, 4.0f));
+
+  // A new session goes to the node that lost one.
+  EXPECT_TRUE(pool->RemoveSession(sessions[1]));
+  EXPECT_TRUE(pool->RemoveSession(sessions[3]));
+  EXPECT_EQ(pool->num_sessions_on_node(1), 0);
+  ASSERT_TRUE(pool->AddSession(1).has_value());
+  EXPECT_EQ(pool->num_sessions_on_node(1), 1);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
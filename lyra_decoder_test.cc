@@ -15,9 +15,10 @@
 #include "lyra_decoder.h"
 
 #include <algorithm>
-#include <bitset>
 #include <climits>
+#include <cmath>
 #include <cstdint>
+#include <future>  // NOLINT(build/c++11)
 #include <iterator>
 #include <memory>
 #include <numeric>
@@ -31,22 +32,37 @@
 #include "absl/random/random.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"  // IWYU pragma: keep
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "aggregated_packet.h"
+#include "compute_precision.h"
+#include "feature_frame.h"
+#include "flight_recorder.h"
 #include "generative_model_interface.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
+#include "linear_spectrogram_predictor.h"
 #include "log_mel_spectrogram_extractor_impl.h"
 #include "lyra_config.h"
+#include "lyra_model.h"
 #include "packet.h"
 #include "packet_interface.h"
 #include "packet_loss_handler_interface.h"
+#include "performance_profile.h"
+#include "quality_level.h"
+#include "quantized_bits.h"
 #include "resampler.h"
 #include "resampler_interface.h"
+#include "spectrogram_predictor_interface.h"
+#include "state_buffer.h"
 #include "testing/mock_generative_model.h"
 #include "testing/mock_packet_loss_handler.h"
 #include "testing/mock_resampler.h"
 #include "testing/mock_vector_quantizer.h"
+#include "testing/quantized_bits_string.h"
+#include "tracing.h"
 #include "vector_quantizer_interface.h"
 
 namespace chromemedia {
@@ -68,19 +84,99 @@ class LyraDecoderPeer {
       std::unique_ptr<MockVectorQuantizer> mock_vector_quantizer,
       std::unique_ptr<MockPacketLossHandler> mock_packet_loss_handler,
       std::unique_ptr<ResamplerInterface> resampler, int sample_rate_hz,
-      int num_frames_per_packet)
+      int num_frames_per_packet,
+      int model_sample_rate_hz = kInternalSampleRateHz)
       : decoder_(std::move(mock_generative_model),
                  std::move(mock_comfort_noise_generator),
                  std::move(mock_vector_quantizer),
                  absl::make_unique<Packet<kNumQuantizedBits, kNumHeaderBits>>(),
                  std::move(mock_packet_loss_handler), std::move(resampler),
-                 sample_rate_hz, kNumChannels, kBitrate,
-                 num_frames_per_packet) {}
+                 sample_rate_hz, kNumChannels, kBitrate, num_frames_per_packet,
+                 model_sample_rate_hz) {}
 
   bool SetEncodedPacket(const absl::Span<const uint8_t> encoded) {
     return decoder_.SetEncodedPacket(encoded);
   }
 
+  absl::optional<int> SetStretchedEncodedPacket(
+      const absl::Span<const uint8_t> encoded, int num_samples) {
+    return decoder_.SetStretchedEncodedPacket(encoded, num_samples);
+  }
+
+  bool SetFuturePacket(const absl::Span<const uint8_t> encoded,
+                       int num_lost_samples) {
+    return decoder_.SetFuturePacket(encoded, num_lost_samples);
+  }
+
+  bool QueueEncodedPacket(const absl::Span<const uint8_t> encoded) {
+    return decoder_.QueueEncodedPacket(encoded);
+  }
+
+  bool SetAggregatedPayload(const absl::Span<const uint8_t> payload) {
+    return decoder_.SetAggregatedPayload(payload);
+  }
+
+  void WarmUp() { decoder_.WarmUp(); }
+
+  void Reset() { decoder_.Reset(); }
+
+  bool SaveState(std::vector<uint8_t>* state) const {
+    return decoder_.SaveState(state);
+  }
+
+  bool RestoreState(absl::Span<const uint8_t> state) {
+    return decoder_.RestoreState(state);
+  }
+
+  bool PrepareConcealment() { return decoder_.PrepareConcealment(); }
+
+  void SetLatePacketRecoveryEnabled(bool enabled) {
+    decoder_.SetLatePacketRecoveryEnabled(enabled);
+  }
+
+  absl::optional<std::vector<int16_t>> RecoverLatePacket(
+      absl::Span<const uint8_t> encoded, int num_samples_played) {
+    return decoder_.RecoverLatePacket(encoded, num_samples_played);
+  }
+
+  DecoderMetrics metrics() const { return decoder_.metrics(); }
+
+  FlightRecorder* EnableFlightRecorder(const FlightRecorderOptions& options) {
+    return decoder_.EnableFlightRecorder(options);
+  }
+
+  void SetSilenceDetectionEnabled(bool enabled) {
+    decoder_.SetSilenceDetectionEnabled(enabled);
+  }
+
+  void SetQualityLevel(QualityLevel quality_level) {
+    decoder_.SetQualityLevel(quality_level);
+  }
+
+  void SetPipeliningEnabled(bool enabled) {
+    decoder_.SetPipeliningEnabled(enabled);
+  }
+
+  void SetParkingDelay(absl::Duration delay) {
+    decoder_.SetParkingDelay(delay);
+  }
+
+  const PerformanceProfile& performance_profile() const {
+    return decoder_.performance_profile();
+  }
+
+  // Makes the decoder load its generative model like |CreateProgressively|,
+  // from |generative_model| instead of a background thread.
+  void SetPendingGenerativeModel(
+      std::future<std::unique_ptr<GenerativeModelInterface>>
+          generative_model) {
+    decoder_.pending_generative_model_ = std::move(generative_model);
+  }
+
+  bool WaitForGenerativeModel() { return decoder_.WaitForGenerativeModel(); }
+
+  bool has_generative_model() const { return decoder_.has_generative_model(); }
+
   absl::optional<std::vector<int16_t>> DecodeSamples(int num_samples) {
     return decoder_.DecodeSamples(num_samples);
   }
@@ -89,6 +185,14 @@ class LyraDecoderPeer {
     return decoder_.DecodePacketLoss(num_samples);
   }
 
+  bool DecodeSamples(absl::Span<int16_t> samples) {
+    return decoder_.DecodeSamples(samples);
+  }
+
+  bool DecodeSamples(absl::Span<float> samples) {
+    return decoder_.DecodeSamples(samples);
+  }
+
   absl::optional<std::vector<int16_t>> OverlapFrames(
       const std::vector<int16_t>& preceding_frame,
       const std::vector<int16_t>& following_frame) {
@@ -101,6 +205,7 @@ class LyraDecoderPeer {
 
 namespace {
 
+using testing::ElementsAreArray;
 using testing::Return;
 
 static constexpr absl::string_view kExportedModelPath = "wavegru";
@@ -164,19 +269,20 @@ class LyraDecoderTest
 
 TEST_P(LyraDecoderTest, PacketAllZerosSucceeds) {
   // Fill a packet with the bit pattern 00000000 at each byte.
-  std::bitset<kNumQuantizedBits> quantized(0);
+  const QuantizedBits quantized(kNumQuantizedBits);
   PacketType packet;
-  std::vector<uint8_t> encoded = packet.PackQuantized(quantized.to_string());
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
-  EXPECT_CALL(*mock_vector_quantizer,
-              DecodeToLossyFeatures(quantized.to_string()))
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
       .WillOnce(Return(mock_concatenated_features_));
   auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
   auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
   for (const auto& mock_features : mock_feature_frames_) {
-    EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(mock_features))
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
         .WillOnce(Return(true));
-    EXPECT_CALL(*mock_generative_model, AddFeatures(mock_features));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
   }
   const int num_requested_samples = output_mock_samples_.size();
   const int num_samples_to_generate = mock_samples_->size();
@@ -198,405 +304,1824 @@ TEST_P(LyraDecoderTest, PacketAllZerosSucceeds) {
   EXPECT_EQ(decoded_or.value(), output_mock_samples_);
 }
 
-TEST_P(LyraDecoderTest, DecodePacketLossWithoutPriorPacketSucceeds) {
-  const std::vector<float> estimated_features(kNumFeatures, 23.0f);
+TEST_P(LyraDecoderTest, DecodeSamplesIntoSpanSucceeds) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
   auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
-
-  const int internal_num_samples = mock_samples_->size();
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
+  }
+  const int num_samples_to_generate = mock_samples_->size();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_to_generate))
       .WillOnce(Return(mock_samples_));
-  EXPECT_CALL(*mock_generative_model, AddFeatures(estimated_features));
   auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
-  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_)).Times(0);
   EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
       .Times(0);
-  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
-  EXPECT_CALL(*mock_packet_loss_handler,
-              EstimateLostFeatures(internal_num_samples))
-      .WillOnce(Return(estimated_features));
   auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
       std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
       std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
       GetResampler(1), sample_rate_hz_, num_frames_per_packet_);
 
-  // Without first calling SetEncodedPacket() with any prior packet,
-  // DecodePacketLoss() can still return audio samples.
-  const int num_samples = output_mock_samples_.size();
-  auto decoded_or = lyra_decoder_peer->DecodePacketLoss(num_samples);
-  ASSERT_TRUE(decoded_or.has_value());
-  EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  std::vector<int16_t> decoded(output_mock_samples_.size());
+  ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(absl::MakeSpan(decoded)));
+  EXPECT_EQ(decoded, output_mock_samples_);
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_model_samples,
+            static_cast<int64_t>(decoded.size()));
 }
 
-TEST_P(LyraDecoderTest, DecodeSamplesWithoutPriorPacketFails) {
+TEST_P(LyraDecoderTest, FlightRecorderDumpsSlowCalls) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
   auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
+  }
+  const int num_samples_to_generate = mock_samples_->size();
+  // The model takes longer than the deadline.
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_to_generate))
+      .WillOnce(testing::Invoke([this](int) {
+        LYRA_TRACE_SCOPE("SlowModel");
+        absl::SleepFor(absl::Milliseconds(5));
+        return mock_samples_;
+      }));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(1), sample_rate_hz_, num_frames_per_packet_);
+  std::vector<FlightRecord> records;
+  FlightRecorderOptions options;
+  options.deadline = absl::Milliseconds(1);
+  options.on_deadline_miss = [&records](const FlightRecord& record) {
+    records.push_back(record);
+  };
+  FlightRecorder* recorder = lyra_decoder_peer->EnableFlightRecorder(options);
+  ASSERT_NE(recorder, nullptr);
 
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_)).Times(0);
-  EXPECT_CALL(*mock_generative_model, AddFeatures(testing::_)).Times(0);
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  std::vector<float> decoded(output_mock_samples_.size());
+  ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(absl::MakeSpan(decoded)));
+
+  EXPECT_EQ(recorder->num_calls(), 2);
+  ASSERT_EQ(records.size(), 1);
+  EXPECT_STREQ(records[0].call, "DecodeSamples");
+  std::vector<std::string> names;
+  for (const FlightEvent& event : records[0].events) {
+    names.push_back(event.name);
+  }
+  EXPECT_THAT(names, testing::Contains("SlowModel"));
+  EXPECT_THAT(names, testing::Not(testing::Contains("SetEncodedPacket")));
+}
+
+TEST_P(LyraDecoderTest, DecodeSamplesIntoFloatsSucceeds) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
+  }
+  const int num_samples_to_generate = mock_samples_->size();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_to_generate))
+      .WillOnce(Return(mock_samples_));
   auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
-  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_)).Times(0);
   EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
       .Times(0);
-  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
   auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
       std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
       std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
-      GetResampler(0), sample_rate_hz_, num_frames_per_packet_);
+      GetResampler(1), sample_rate_hz_, num_frames_per_packet_);
 
-  // Without first calling SetEncodedPacket() with any prior packet,
-  // DecodeSamples() does not return audio samples.
-  auto decoded_or =
-      lyra_decoder_peer->DecodeSamples(GetNumSamplesPerHop(sample_rate_hz_));
-  EXPECT_FALSE(decoded_or.has_value());
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  std::vector<float> decoded(output_mock_samples_.size());
+  ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(absl::MakeSpan(decoded)));
+  EXPECT_THAT(decoded, testing::ElementsAreArray(output_mock_samples_));
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_model_samples,
+            static_cast<int64_t>(decoded.size()));
 }
 
-TEST_P(LyraDecoderTest, PlcSamplesStraddlePacketBoundary) {
-  // Step 1: Add one encoded packet containing N frames.
-  // Step 2: Completely decode N - 1 frames worth of (M) samples.
-  // Step 3: Partially decode the last frame (M - 20 out of M samples).
-  // Step 4: Try and fail to decode more samples than are left (62 vs 20).
-  // Step 5: Make one PLC call requesting 62 samples, which use up all the
-  //         remaining 20 samples from a normal packet and then add new PLC
-  //         features to generate 42 samples.
-  // Step 6: Make one PLC call requesting M - 40 samples, which use up the
-  //         remaining M - 42 samples and then add new PLC features to generate
-  //         2 samples.
-  const int kNumTotalPackets = 3;
-  std::bitset<kNumQuantizedBits> quantized_zeros(0);
+TEST_P(LyraDecoderTest, QueuedPacketIsDecodedAfterTheCurrentOne) {
+  const QuantizedBits quantized(kNumQuantizedBits);
   PacketType packet;
-  std::vector<uint8_t> encoded_zeros =
-      packet.PackQuantized(quantized_zeros.to_string());
-
-  // The vector quantizer will be called only once.
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
-  EXPECT_CALL(*mock_vector_quantizer,
-              DecodeToLossyFeatures(quantized_zeros.to_string()))
-      .WillOnce(Return(mock_concatenated_features_));
-
-  // Add N frames of features from encoded packet in Step 1.
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .Times(2)
+      .WillRepeatedly(Return(mock_concatenated_features_));
   auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .Times(0);
   auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
   for (const auto& mock_features : mock_feature_frames_) {
-    EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(mock_features))
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
+    EXPECT_CALL(*mock_generative_model,
+                QueueFeatures(ElementsAreArray(mock_features)))
         .WillOnce(Return(true));
-    EXPECT_CALL(*mock_generative_model, AddFeatures(mock_features)).Times(1);
   }
+  // Both packets are decoded one hop at a time.
+  const int num_hops = 2 * num_frames_per_packet_;
+  const int num_samples_to_generate = mock_samples_->size();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_to_generate))
+      .Times(num_hops)
+      .WillRepeatedly(Return(mock_samples_));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(num_hops), sample_rate_hz_, num_frames_per_packet_);
 
-  // All mocks have their sample vector sizes expressed at
-  // |kInternalSampleRateHz|.
-  // Generate N - 1 frames worth of (M) samples in Step 2.
-  const int internal_frame_size = mock_samples_->size();
-  absl::optional<std::vector<int16_t>> complete_decode_samples_call(
-      {mock_samples_->begin(), mock_samples_->begin() + internal_frame_size});
-  if (num_frames_per_packet_ > 1) {
-    EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_frame_size))
-        .Times(num_frames_per_packet_ - 1)
-        .WillRepeatedly(Return(complete_decode_samples_call));
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  ASSERT_TRUE(lyra_decoder_peer->QueueEncodedPacket(encoded));
+  EXPECT_FALSE(lyra_decoder_peer->QueueEncodedPacket(encoded));
+  EXPECT_FALSE(
+      lyra_decoder_peer->DecodePacketLoss(output_mock_samples_.size())
+          .has_value());
+  for (int i = 0; i < num_hops; ++i) {
+    const auto decoded_or =
+        lyra_decoder_peer->DecodeSamples(output_mock_samples_.size());
+    ASSERT_TRUE(decoded_or.has_value());
+    EXPECT_EQ(decoded_or.value(), output_mock_samples_);
   }
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                   .has_value());
+}
 
-  // Generate M - 20 samples from the last frame in Step 3.
-  absl::optional<std::vector<int16_t>> decode_samples_call_0(
-      {mock_samples_->begin(),
-       mock_samples_->begin() + internal_frame_size - 20});
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_frame_size - 20))
-      .WillOnce(Return(decode_samples_call_0));
-
-  // Add features estimated by PLC in Step 5 & 6.
-  const std::vector<float> estimated_features(kNumFeatures, 11.0f);
-  EXPECT_CALL(*mock_generative_model, AddFeatures(estimated_features))
-      .Times(kNumTotalPackets - 1);
+TEST_P(LyraDecoderTest, QueuedPacketIsNotPreparedWithoutPipelining) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .Times(2)
+      .WillRepeatedly(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features))).Times(2);
+  }
+  EXPECT_CALL(*mock_generative_model, QueueFeatures(testing::_)).Times(0);
+  const int num_hops = 2 * num_frames_per_packet_;
+  const int num_samples_to_generate = mock_samples_->size();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_to_generate))
+      .Times(num_hops)
+      .WillRepeatedly(Return(mock_samples_));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(num_hops), sample_rate_hz_, num_frames_per_packet_);
+  lyra_decoder_peer->SetPipeliningEnabled(false);
+  EXPECT_FALSE(lyra_decoder_peer->performance_profile().pipelining);
 
-  // Request 62 samples in PLC mode in Step 5, internally break this up into
-  // two calls: the remaining 20 samples from the normal packet and 42
-  // samples from a PLC packet.
-  absl::optional<std::vector<int16_t>> plc_samples_call_0(
-      {mock_samples_->begin() + internal_frame_size - 20,
-       mock_samples_->begin() + internal_frame_size});
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(20))
-      .WillOnce(Return(plc_samples_call_0));
-  absl::optional<std::vector<int16_t>> plc_samples_call_1(
-      {mock_samples_->begin(), mock_samples_->begin() + 42});
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(42))
-      .WillOnce(Return(plc_samples_call_1));
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  ASSERT_TRUE(lyra_decoder_peer->QueueEncodedPacket(encoded));
+  for (int i = 0; i < num_hops; ++i) {
+    const auto decoded_or =
+        lyra_decoder_peer->DecodeSamples(output_mock_samples_.size());
+    ASSERT_TRUE(decoded_or.has_value());
+    EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+  }
+}
 
-  // Request M - 40 samples in PLC mode in Step 6, internally break this up into
-  // two calls: the remaining M - 42 samples from the first PLC packet and 2
-  // samples from a second PLC packet.
-  absl::optional<std::vector<int16_t>> plc_samples_call_2(
-      {mock_samples_->begin() + 42,
-       mock_samples_->begin() + internal_frame_size});
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_frame_size - 42))
-      .WillOnce(Return(plc_samples_call_2));
-  absl::optional<std::vector<int16_t>> plc_samples_call_3(
-      {mock_samples_->begin(), mock_samples_->begin() + 2});
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(2))
-      .WillOnce(Return(plc_samples_call_3));
+TEST_P(LyraDecoderTest, AggregatedPacketsAreDecodedInOrder) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto aggregator = PacketAggregator::Create(encoded.size(), 2, false);
+  ASSERT_NE(aggregator, nullptr);
+  ASSERT_FALSE(aggregator->AddPacket(encoded).has_value());
+  const auto payload_or = aggregator->AddPacket(encoded);
+  ASSERT_TRUE(payload_or.has_value());
 
-  // Comfort noise generator not involved.
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .Times(2)
+      .WillRepeatedly(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .Times(0);
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features))).Times(2);
+  }
+  const int num_hops = 2 * num_frames_per_packet_;
+  const int num_samples_to_generate = mock_samples_->size();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_to_generate))
+      .Times(num_hops)
+      .WillRepeatedly(Return(mock_samples_));
   auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
-  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_)).Times(0);
   EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
       .Times(0);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(num_hops), sample_rate_hz_, num_frames_per_packet_);
 
-  // Two estimated features will be used for decoding in Step 5 & 6.
-  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
-      .Times(kNumTotalPackets - 1)
-      .WillRepeatedly(Return(estimated_features));
+  ASSERT_TRUE(lyra_decoder_peer->SetAggregatedPayload(payload_or.value()));
+  EXPECT_FALSE(lyra_decoder_peer->QueueEncodedPacket(encoded));
+  EXPECT_FALSE(
+      lyra_decoder_peer->DecodePacketLoss(output_mock_samples_.size())
+          .has_value());
+  for (int i = 0; i < num_hops; ++i) {
+    const auto decoded_or =
+        lyra_decoder_peer->DecodeSamples(output_mock_samples_.size());
+    ASSERT_TRUE(decoded_or.has_value());
+    EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+  }
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                   .has_value());
+}
+
+TEST_P(LyraDecoderTest, RedundantPacketIsDecodedAfterLostPayload) {
+  const QuantizedBits quantized_zeros(kNumQuantizedBits);
+  const QuantizedBits quantized_ones =
+      QuantizedBitsFromString(std::string(kNumQuantizedBits, '1'));
+  PacketType packet;
+  const std::vector<uint8_t> encoded_zeros =
+      packet.PackQuantized(quantized_zeros);
+  const std::vector<uint8_t> encoded_ones =
+      packet.PackQuantized(quantized_ones);
+  auto aggregator = PacketAggregator::Create(encoded_zeros.size(), 1, true);
+  ASSERT_NE(aggregator, nullptr);
+  const auto first_payload_or = aggregator->AddPacket(encoded_zeros);
+  ASSERT_TRUE(first_payload_or.has_value());
+  // Only its redundant copy in the third payload arrives.
+  ASSERT_TRUE(aggregator->AddPacket(encoded_ones).has_value());
+  const auto third_payload_or = aggregator->AddPacket(encoded_zeros);
+  ASSERT_TRUE(third_payload_or.has_value());
+
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized_zeros))
+      .Times(2)
+      .WillRepeatedly(Return(mock_concatenated_features_));
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized_ones))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .Times(0);
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .Times(3)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features))).Times(3);
+  }
+  const int num_hops = 3 * num_frames_per_packet_;
+  const int num_samples_to_generate = mock_samples_->size();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_to_generate))
+      .Times(num_hops)
+      .WillRepeatedly(Return(mock_samples_));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(num_hops), sample_rate_hz_, num_frames_per_packet_);
+
+  ASSERT_TRUE(
+      lyra_decoder_peer->SetAggregatedPayload(first_payload_or.value()));
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                    .has_value());
+  }
+  ASSERT_TRUE(
+      lyra_decoder_peer->SetAggregatedPayload(third_payload_or.value()));
+  for (int i = 0; i < 2 * num_frames_per_packet_; ++i) {
+    ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                    .has_value());
+  }
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                   .has_value());
+}
+
+TEST_P(LyraDecoderTest, DuplicateAndLatePayloadsAreDropped) {
+  const QuantizedBits quantized_zeros(kNumQuantizedBits);
+  const QuantizedBits quantized_ones =
+      QuantizedBitsFromString(std::string(kNumQuantizedBits, '1'));
+  PacketType packet;
+  const std::vector<uint8_t> encoded_zeros =
+      packet.PackQuantized(quantized_zeros);
+  const std::vector<uint8_t> encoded_ones =
+      packet.PackQuantized(quantized_ones);
+  auto aggregator = PacketAggregator::Create(encoded_zeros.size(), 1, false);
+  ASSERT_NE(aggregator, nullptr);
+  const auto first_payload_or = aggregator->AddPacket(encoded_zeros);
+  ASSERT_TRUE(first_payload_or.has_value());
+  const auto second_payload_or = aggregator->AddPacket(encoded_ones);
+  ASSERT_TRUE(second_payload_or.has_value());
+
+  // Only the first delivery of each payload is decoded.
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized_zeros))
+      .WillOnce(Return(mock_concatenated_features_));
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized_ones))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features))).Times(2);
+  }
+  const int num_hops = 2 * num_frames_per_packet_;
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(mock_samples_->size()))
+      .Times(num_hops)
+      .WillRepeatedly(Return(mock_samples_));
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model),
+      absl::make_unique<MockGenerativeModel>(),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(num_hops), sample_rate_hz_, num_frames_per_packet_);
+
+  ASSERT_TRUE(
+      lyra_decoder_peer->SetAggregatedPayload(first_payload_or.value()));
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                    .has_value());
+  }
+  EXPECT_FALSE(
+      lyra_decoder_peer->SetAggregatedPayload(first_payload_or.value()));
+  ASSERT_TRUE(
+      lyra_decoder_peer->SetAggregatedPayload(second_payload_or.value()));
+  // A duplicate and a late payload leave the current packet as it is.
+  EXPECT_FALSE(
+      lyra_decoder_peer->SetAggregatedPayload(second_payload_or.value()));
+  EXPECT_FALSE(
+      lyra_decoder_peer->SetAggregatedPayload(first_payload_or.value()));
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                    .has_value());
+  }
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                   .has_value());
+}
+
+TEST_P(LyraDecoderTest, QueueEncodedPacketFailsIfModelCannotQueue) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillOnce(Return(true));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, QueueFeatures(testing::_))
+      .WillOnce(Return(false));
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_)).Times(0);
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(0), sample_rate_hz_, num_frames_per_packet_);
+
+  EXPECT_FALSE(lyra_decoder_peer->QueueEncodedPacket(encoded));
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                   .has_value());
+}
+
+TEST_P(LyraDecoderTest, ModelAtOutputSampleRateIsNotResampled) {
+  if (sample_rate_hz_ >= kInternalSampleRateHz) {
+    GTEST_SKIP() << "Only lower sample rates are generated directly.";
+  }
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
+  }
+  // The model is asked for samples at the output rate.
+  const int num_samples = output_mock_samples_.size();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples))
+      .WillOnce(Return(output_mock_samples_));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+  auto resampler = absl::make_unique<MockResampler>();
+  EXPECT_CALL(*resampler, Resample(testing::_)).Times(0);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(resampler), sample_rate_hz_, num_frames_per_packet_,
+      /*model_sample_rate_hz=*/sample_rate_hz_);
+
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  const auto decoded_or = lyra_decoder_peer->DecodeSamples(num_samples);
+  ASSERT_TRUE(decoded_or.has_value());
+  EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+}
+
+TEST_P(LyraDecoderTest, WarmUpWarmsUpBothModels) {
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, WarmUp());
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_)).Times(0);
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, WarmUp());
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      absl::make_unique<MockVectorQuantizer>(),
+      absl::make_unique<MockPacketLossHandler>(), GetResampler(0),
+      sample_rate_hz_, num_frames_per_packet_);
+
+  lyra_decoder_peer->WarmUp();
+}
+
+TEST_P(LyraDecoderTest, RestoredStateContinuesThePacket) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_packet_loss_handler, SaveState(testing::_))
+      .WillOnce(Return(true));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_)).Times(0);
+  EXPECT_CALL(*mock_generative_model, SaveState(testing::_))
+      .WillOnce(Return(true));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, SaveState(testing::_))
+      .WillOnce(Return(true));
+  auto resampler = GetResampler(0);
+  if (sample_rate_hz_ != kInternalSampleRateHz) {
+    EXPECT_CALL(*resampler, SaveState(testing::_)).WillOnce(Return(true));
+  }
+  auto saving_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
+  ASSERT_TRUE(saving_peer->SetEncodedPacket(encoded));
+  std::vector<uint8_t> state;
+  ASSERT_TRUE(saving_peer->SaveState(&state));
+
+  // A decoder the state is restored into picks up the samples of the packet
+  // without receiving it.
+  mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, RestoreState(testing::_))
+      .WillOnce(Return(true));
+  mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, RestoreState(testing::_))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(mock_samples_->size()))
+      .WillOnce(Return(mock_samples_));
+  mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, RestoreState(testing::_))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+  resampler = GetResampler(1);
+  if (sample_rate_hz_ != kInternalSampleRateHz) {
+    EXPECT_CALL(*resampler, RestoreState(testing::_)).WillOnce(Return(true));
+  }
+  auto restoring_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      absl::make_unique<MockVectorQuantizer>(),
+      std::move(mock_packet_loss_handler), std::move(resampler),
+      sample_rate_hz_, num_frames_per_packet_);
+  ASSERT_TRUE(restoring_peer->RestoreState(state));
+
+  const auto decoded_or =
+      restoring_peer->DecodeSamples(output_mock_samples_.size());
+  ASSERT_TRUE(decoded_or.has_value());
+  EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+}
+
+TEST_P(LyraDecoderTest, LatePacketReplacesUnplayedConcealment) {
+  if (sample_rate_hz_ != kInternalSampleRateHz) {
+    GTEST_SKIP() << "The mock resampler only resamples the packet samples.";
+  }
+  const int num_samples_per_hop = mock_samples_->size();
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillRepeatedly(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillRepeatedly(Return(true));
+  const FeatureFrame estimated_features(kNumFeatures, 11.0f);
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .WillRepeatedly(Return(estimated_features));
+  EXPECT_CALL(*mock_packet_loss_handler, SaveState(testing::_))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_packet_loss_handler, RestoreState(testing::_))
+      .WillRepeatedly(Return(true));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, SaveState(testing::_))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_generative_model, RestoreState(testing::_))
+      .WillRepeatedly(Return(true));
+  const std::vector<int16_t> concealed(num_samples_per_hop, 1000);
+  {
+    testing::InSequence sequence;
+    EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_per_hop))
+        .Times(num_frames_per_packet_)
+        .WillRepeatedly(Return(mock_samples_));
+    EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_per_hop))
+        .WillOnce(Return(concealed));
+  }
+  // The late packet is generated for the played half of the concealment,
+  // which is dropped, and for the half that is replaced.
+  const int num_samples_played = num_samples_per_hop / 2;
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(num_samples_played))
+      .Times(2)
+      .WillRepeatedly(Return(std::vector<int16_t>(num_samples_played, 0)));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, SaveState(testing::_))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_comfort_noise_generator, RestoreState(testing::_))
+      .WillRepeatedly(Return(true));
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(0), sample_rate_hz_, num_frames_per_packet_);
+  lyra_decoder_peer->SetLatePacketRecoveryEnabled(true);
+
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    ASSERT_TRUE(
+        lyra_decoder_peer->DecodeSamples(num_samples_per_hop).has_value());
+  }
+  EXPECT_FALSE(lyra_decoder_peer->RecoverLatePacket(encoded, 0).has_value());
+  ASSERT_TRUE(
+      lyra_decoder_peer->DecodePacketLoss(num_samples_per_hop).has_value());
+
+  const auto recovered_or =
+      lyra_decoder_peer->RecoverLatePacket(encoded, num_samples_played);
+  ASSERT_TRUE(recovered_or.has_value());
+  ASSERT_EQ(recovered_or->size(), num_samples_played);
+  // The recovered samples fade in from the concealment.
+  EXPECT_EQ(recovered_or->front(), concealed.front());
+  EXPECT_EQ(recovered_or->back(), 0);
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_recovered_packets, 1);
+  // The concealment can only be replaced once.
+  EXPECT_FALSE(lyra_decoder_peer->RecoverLatePacket(encoded, 0).has_value());
+}
+
+TEST_P(LyraDecoderTest, PreparedConcealmentIsUsedForTheLostPacket) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillRepeatedly(Return(true));
+  const FeatureFrame estimated_features(kNumFeatures, 11.0f);
+  EXPECT_CALL(*mock_packet_loss_handler, PeekLostFeatures(testing::_))
+      .WillOnce(Return(estimated_features));
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .WillOnce(Return(estimated_features));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, AddFeatures(testing::_))
+      .Times(num_frames_per_packet_);
+  EXPECT_CALL(*mock_generative_model,
+              QueueSpeculativeFeatures(ElementsAreArray(estimated_features)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_generative_model, DiscardSpeculativeFeatures()).Times(0);
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_))
+      .WillRepeatedly(Return(mock_samples_));
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model),
+      absl::make_unique<MockGenerativeModel>(),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(num_frames_per_packet_ + 1), sample_rate_hz_,
+      num_frames_per_packet_);
+
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                    .has_value());
+  }
+  ASSERT_TRUE(lyra_decoder_peer->PrepareConcealment());
+  // The concealment does not add the features again.
+  ASSERT_TRUE(lyra_decoder_peer->DecodePacketLoss(output_mock_samples_.size())
+                  .has_value());
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_prepared_frames_used, 1);
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_prepared_frames_discarded, 0);
+}
+
+TEST_P(LyraDecoderTest, PreparedConcealmentIsDroppedWhenThePacketArrives) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillRepeatedly(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillRepeatedly(Return(true));
+  const FeatureFrame estimated_features(kNumFeatures, 11.0f);
+  EXPECT_CALL(*mock_packet_loss_handler, PeekLostFeatures(testing::_))
+      .WillOnce(Return(estimated_features));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, AddFeatures(testing::_))
+      .Times(2 * num_frames_per_packet_);
+  EXPECT_CALL(*mock_generative_model,
+              QueueSpeculativeFeatures(ElementsAreArray(estimated_features)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_generative_model, DiscardSpeculativeFeatures());
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model),
+      absl::make_unique<MockGenerativeModel>(),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(0), sample_rate_hz_, num_frames_per_packet_);
+
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  ASSERT_TRUE(lyra_decoder_peer->PrepareConcealment());
+  // Preparing twice keeps the conditioning prepared the first time.
+  ASSERT_TRUE(lyra_decoder_peer->PrepareConcealment());
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_prepared_frames_used, 0);
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_prepared_frames_discarded, 1);
+}
+
+TEST_P(LyraDecoderTest, FuturePacketIsInterpolatedTowards) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillRepeatedly(Return(mock_concatenated_features_));
+  const int num_lost_samples = 2 * output_mock_samples_.size();
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_packet_loss_handler, PeekLostFeatures(testing::_))
+      .WillOnce(Return(FeatureFrame(kNumFeatures, 11.0f)));
+  // Only the first frame of the future packet borders on the lost samples.
+  EXPECT_CALL(*mock_packet_loss_handler,
+              SetFutureFeatures(ElementsAreArray(mock_feature_frames_[0]),
+                                ConvertNumSamplesBetweenSampleRate(
+                                    num_lost_samples, sample_rate_hz_,
+                                    kInternalSampleRateHz)))
+      .WillOnce(Return(true))
+      .WillOnce(Return(false));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, AddFeatures(testing::_))
+      .Times(num_frames_per_packet_);
+  EXPECT_CALL(*mock_generative_model, QueueSpeculativeFeatures(testing::_))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_generative_model, DiscardSpeculativeFeatures());
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model),
+      absl::make_unique<MockGenerativeModel>(),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(0), sample_rate_hz_, num_frames_per_packet_);
+
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  ASSERT_TRUE(lyra_decoder_peer->PrepareConcealment());
+  EXPECT_FALSE(lyra_decoder_peer->SetFuturePacket(encoded, 0));
+  EXPECT_FALSE(lyra_decoder_peer->SetFuturePacket(
+      absl::MakeConstSpan(encoded).subspan(1), num_lost_samples));
+  // The concealment prepared by extrapolation is dropped.
+  EXPECT_TRUE(lyra_decoder_peer->SetFuturePacket(encoded, num_lost_samples));
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_prepared_frames_discarded, 1);
+  EXPECT_FALSE(lyra_decoder_peer->SetFuturePacket(encoded, num_lost_samples));
+}
+
+TEST_P(LyraDecoderTest, SaveStateFailsIfModelCannotSave) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillRepeatedly(Return(true));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, SaveState(testing::_))
+      .WillOnce(Return(false));
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model),
+      absl::make_unique<MockGenerativeModel>(),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(0), sample_rate_hz_, num_frames_per_packet_);
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+
+  std::vector<uint8_t> state = {1, 2, 3};
+  EXPECT_FALSE(lyra_decoder_peer->SaveState(&state));
+  EXPECT_TRUE(state.empty());
+}
+
+TEST_P(LyraDecoderTest, RestoreStateWithInvalidFlagFails) {
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SaveState(testing::_))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_packet_loss_handler, RestoreState(testing::_)).Times(0);
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, SaveState(testing::_))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_generative_model, RestoreState(testing::_)).Times(0);
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, SaveState(testing::_))
+      .WillOnce(Return(true));
+  auto resampler = GetResampler(0);
+  if (sample_rate_hz_ != kInternalSampleRateHz) {
+    EXPECT_CALL(*resampler, SaveState(testing::_)).WillOnce(Return(true));
+  }
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      absl::make_unique<MockVectorQuantizer>(),
+      std::move(mock_packet_loss_handler), std::move(resampler),
+      sample_rate_hz_, num_frames_per_packet_);
+  std::vector<uint8_t> state;
+  ASSERT_TRUE(lyra_decoder_peer->SaveState(&state));
+
+  // Whether a packet was set follows the version, the sample rate and the
+  // number of samples available.
+  const int flag_offset = sizeof(uint32_t) + 2 * sizeof(int);
+  ASSERT_EQ(state[flag_offset], 0);
+  state[flag_offset] = 2;
+  EXPECT_FALSE(lyra_decoder_peer->RestoreState(state));
+}
+
+TEST_P(LyraDecoderTest, RestoreStateOfOtherSampleRateFails) {
+  const int other_sample_rate_hz =
+      sample_rate_hz_ == kInternalSampleRateHz ? 48000 : kInternalSampleRateHz;
+  std::vector<uint8_t> state;
+  StateWriter writer(&state);
+  writer.Write<uint32_t>(1);
+  writer.Write(other_sample_rate_hz);
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, RestoreState(testing::_)).Times(0);
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_)).Times(0);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model),
+      absl::make_unique<MockGenerativeModel>(),
+      absl::make_unique<MockVectorQuantizer>(),
+      absl::make_unique<MockPacketLossHandler>(), GetResampler(0),
+      sample_rate_hz_, num_frames_per_packet_);
+
+  EXPECT_FALSE(lyra_decoder_peer->RestoreState(state));
+  // The decoder is left as if no packet had been received.
+  std::vector<int16_t> decoded(GetNumSamplesPerHop(sample_rate_hz_));
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(absl::MakeSpan(decoded)));
+}
+
+TEST_P(LyraDecoderTest, ResetForgetsTheStream) {
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .Times(2)
+      .WillRepeatedly(Return(mock_concatenated_features_));
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_packet_loss_handler, Reset()).Times(1);
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, Reset()).Times(1);
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(mock_samples_->size()))
+      .Times(2)
+      .WillRepeatedly(Return(mock_samples_));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, Reset()).Times(1);
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+  auto resampler = GetResampler(2);
+  EXPECT_CALL(*resampler, Reset()).Times(1);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                  .has_value());
+
+  lyra_decoder_peer->Reset();
+  // The rest of the packet is not decoded after the reset.
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(output_mock_samples_.size())
+                   .has_value());
+
+  // The next stream starts with its first packet.
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  const auto decoded_or =
+      lyra_decoder_peer->DecodeSamples(output_mock_samples_.size());
+  ASSERT_TRUE(decoded_or.has_value());
+  EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+}
+
+TEST_P(LyraDecoderTest, DecodeSamplesIntoSpanWithoutPriorPacketFails) {
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_)).Times(0);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model),
+      absl::make_unique<MockGenerativeModel>(),
+      absl::make_unique<MockVectorQuantizer>(),
+      absl::make_unique<MockPacketLossHandler>(), GetResampler(0),
+      sample_rate_hz_, num_frames_per_packet_);
+
+  std::vector<int16_t> decoded(GetNumSamplesPerHop(sample_rate_hz_));
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(absl::MakeSpan(decoded)));
+}
+
+TEST_P(LyraDecoderTest, DecodePacketLossWithoutPriorPacketSucceeds) {
+  const FeatureFrame estimated_features(kNumFeatures, 23.0f);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+
+  const int internal_num_samples = mock_samples_->size();
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .WillOnce(Return(mock_samples_));
+  EXPECT_CALL(*mock_generative_model,
+              AddFeatures(ElementsAreArray(estimated_features)));
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_)).Times(0);
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateLostFeatures(internal_num_samples))
+      .WillOnce(Return(estimated_features));
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(1), sample_rate_hz_, num_frames_per_packet_);
+
+  // Without first calling SetEncodedPacket() with any prior packet,
+  // DecodePacketLoss() can still return audio samples.
+  const int num_samples = output_mock_samples_.size();
+  auto decoded_or = lyra_decoder_peer->DecodePacketLoss(num_samples);
+  ASSERT_TRUE(decoded_or.has_value());
+  EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+}
+
+TEST_P(LyraDecoderTest, DecodeSamplesWithoutPriorPacketFails) {
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_)).Times(0);
+  EXPECT_CALL(*mock_generative_model, AddFeatures(testing::_)).Times(0);
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_)).Times(0);
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(0), sample_rate_hz_, num_frames_per_packet_);
+
+  // Without first calling SetEncodedPacket() with any prior packet,
+  // DecodeSamples() does not return audio samples.
+  auto decoded_or =
+      lyra_decoder_peer->DecodeSamples(GetNumSamplesPerHop(sample_rate_hz_));
+  EXPECT_FALSE(decoded_or.has_value());
+}
+
+TEST_P(LyraDecoderTest, PlcSamplesStraddlePacketBoundary) {
+  // Step 1: Add one encoded packet containing N frames.
+  // Step 2: Completely decode N - 1 frames worth of (M) samples.
+  // Step 3: Partially decode the last frame (M - 20 out of M samples).
+  // Step 4: Try and fail to decode more samples than are left (62 vs 20).
+  // Step 5: Make one PLC call requesting 62 samples, which use up all the
+  //         remaining 20 samples from a normal packet and then add new PLC
+  //         features to generate 42 samples.
+  // Step 6: Make one PLC call requesting M - 40 samples, which use up the
+  //         remaining M - 42 samples and then add new PLC features to generate
+  //         2 samples.
+  const int kNumTotalPackets = 3;
+  const QuantizedBits quantized_zeros(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded_zeros = packet.PackQuantized(quantized_zeros);
+
+  // The vector quantizer will be called only once.
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized_zeros))
+      .WillOnce(Return(mock_concatenated_features_));
+
+  // Add N frames of features from encoded packet in Step 1.
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features))).Times(1);
+  }
+
+  // All mocks have their sample vector sizes expressed at
+  // |kInternalSampleRateHz|.
+  // Generate N - 1 frames worth of (M) samples in Step 2.
+  const int internal_frame_size = mock_samples_->size();
+  absl::optional<std::vector<int16_t>> complete_decode_samples_call(
+      {mock_samples_->begin(), mock_samples_->begin() + internal_frame_size});
+  if (num_frames_per_packet_ > 1) {
+    EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_frame_size))
+        .Times(num_frames_per_packet_ - 1)
+        .WillRepeatedly(Return(complete_decode_samples_call));
+  }
+
+  // Generate M - 20 samples from the last frame in Step 3.
+  absl::optional<std::vector<int16_t>> decode_samples_call_0(
+      {mock_samples_->begin(),
+       mock_samples_->begin() + internal_frame_size - 20});
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_frame_size - 20))
+      .WillOnce(Return(decode_samples_call_0));
+
+  // Add features estimated by PLC in Step 5 & 6.
+  const FeatureFrame estimated_features(kNumFeatures, 11.0f);
+  EXPECT_CALL(*mock_generative_model,
+              AddFeatures(ElementsAreArray(estimated_features)))
+      .Times(kNumTotalPackets - 1);
+
+  // Request 62 samples in PLC mode in Step 5, internally break this up into
+  // two calls: the remaining 20 samples from the normal packet and 42
+  // samples from a PLC packet.
+  absl::optional<std::vector<int16_t>> plc_samples_call_0(
+      {mock_samples_->begin() + internal_frame_size - 20,
+       mock_samples_->begin() + internal_frame_size});
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(20))
+      .WillOnce(Return(plc_samples_call_0));
+  absl::optional<std::vector<int16_t>> plc_samples_call_1(
+      {mock_samples_->begin(), mock_samples_->begin() + 42});
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(42))
+      .WillOnce(Return(plc_samples_call_1));
+
+  // Request M - 40 samples in PLC mode in Step 6, internally break this up into
+  // two calls: the remaining M - 42 samples from the first PLC packet and 2
+  // samples from a second PLC packet.
+  absl::optional<std::vector<int16_t>> plc_samples_call_2(
+      {mock_samples_->begin() + 42,
+       mock_samples_->begin() + internal_frame_size});
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_frame_size - 42))
+      .WillOnce(Return(plc_samples_call_2));
+  absl::optional<std::vector<int16_t>> plc_samples_call_3(
+      {mock_samples_->begin(), mock_samples_->begin() + 2});
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(2))
+      .WillOnce(Return(plc_samples_call_3));
+
+  // Comfort noise generator not involved.
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_)).Times(0);
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+
+  // Two estimated features will be used for decoding in Step 5 & 6.
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .Times(kNumTotalPackets - 1)
+      .WillRepeatedly(Return(estimated_features));
+
+  // Use a real resampler as this test is only concerned with behaviour before
+  // any resampling. We need the real resampler to avoid failing resampling
+  // CHECKs in lyra_decoder.
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
+
+  // Step 1: Add a packet with N frames.
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded_zeros));
+
+  // Step 2: Decode N - 1 complete frames.
+  // The literals in |num_samples_request_*| expressions are at
+  // |kInternalSampleRateHz| and then converted to |sample_rate_hz_| to match
+  // the interface expectation.
+  const int complete_num_samples_request = ConvertNumSamplesBetweenSampleRate(
+      internal_frame_size, GetInternalSampleRate(sample_rate_hz_),
+      sample_rate_hz_);
+  for (int i = 0; i < num_frames_per_packet_ - 1; ++i) {
+    EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(complete_num_samples_request)
+                    .has_value());
+  }
+
+  // Step 3: Decode M - 20 samples from the last frame.
+  const int num_samples_request_0 = ConvertNumSamplesBetweenSampleRate(
+      internal_frame_size - 20, GetInternalSampleRate(sample_rate_hz_),
+      sample_rate_hz_);
+  EXPECT_TRUE(
+      lyra_decoder_peer->DecodeSamples(num_samples_request_0).has_value());
+
+  // Step 4: A |DecodeSamples| request for more than 20 samples should return
+  // nullopt.
+  const int num_samples_request_1 = ConvertNumSamplesBetweenSampleRate(
+      62, GetInternalSampleRate(sample_rate_hz_), sample_rate_hz_);
+  EXPECT_FALSE(
+      lyra_decoder_peer->DecodeSamples(num_samples_request_1).has_value());
+
+  // Step 5: Requesting 62 samples in PLC mode is valid.
+  EXPECT_TRUE(
+      lyra_decoder_peer->DecodePacketLoss(num_samples_request_1).has_value());
+
+  // Step 6: Requesting M - 40 samples in PLC mode is valid too.
+  const int num_samples_request_2 = ConvertNumSamplesBetweenSampleRate(
+      internal_frame_size - 40, GetInternalSampleRate(sample_rate_hz_),
+      sample_rate_hz_);
+  EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples_request_2));
+}
+
+TEST_P(LyraDecoderTest, MultipleLostPackets) {
+  // Requests 3 PLC packets without adding real features.
+  static constexpr int kNumLostPackets = 3;
+  const FeatureFrame estimated_features(kNumFeatures, 17.0f);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  const int internal_num_samples = mock_samples_->size();
+  // PLC calls are made before any real packets are added.
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .Times(kNumLostPackets)
+      .WillRepeatedly(Return(mock_samples_));
+  EXPECT_CALL(*mock_generative_model,
+              AddFeatures(ElementsAreArray(estimated_features)))
+      .Times(kNumLostPackets);
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_)).Times(0);
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .Times(0);
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateLostFeatures(internal_num_samples))
+      .Times(kNumLostPackets)
+      .WillRepeatedly(Return(estimated_features));
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      GetResampler(kNumLostPackets), sample_rate_hz_, num_frames_per_packet_);
+
+  const int num_samples = output_mock_samples_.size();
+  for (int i = 0; i < kNumLostPackets; ++i) {
+    auto decoded_or = lyra_decoder_peer->DecodePacketLoss(num_samples);
+    ASSERT_TRUE(decoded_or.has_value());
+    EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+  }
+
+  const DecoderMetrics metrics = lyra_decoder_peer->metrics();
+  EXPECT_EQ(metrics.num_samples_decoded, kNumLostPackets * num_samples);
+  EXPECT_EQ(metrics.num_concealed_samples, kNumLostPackets * num_samples);
+  EXPECT_EQ(metrics.num_model_samples, 0);
+  EXPECT_EQ(metrics.num_comfort_noise_samples, 0);
+  EXPECT_EQ(metrics.num_allocating_calls, kNumLostPackets);
+}
+
+TEST_P(LyraDecoderTest, OneLostPacketMultipleRequests) {
+  // A packet is lost, but there are several calls to DecodePacketLoss(), each
+  // requesting a different number of samples. The total number of samples
+  // requested does not exceed the frame size.
+  FeatureFrame estimated_features(kNumFeatures, 13.0f);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto resampler = absl::make_unique<MockResampler>();
+
+  // Prepare 4 requested numbers of samples whose sum < frame size M:
+  // 7 + (M / 4 - 15) + (M / 4 + 2) + (M / 2 - 5) <= M - 11.
+  const int frame_size = output_mock_samples_.size();
+  const std::vector<int> num_samples_requested = {
+      7, frame_size / 4 - 15, frame_size / 4 + 2, frame_size / 2 - 5};
+
+  std::vector<std::vector<int16_t>> partial_mock_samples;
+  std::vector<std::vector<int16_t>> partial_output_mock_samples;
+  for (int i = 0; i < num_samples_requested.size(); ++i) {
+    const int internal_num_samples = ConvertNumSamplesBetweenSampleRate(
+        num_samples_requested[i], sample_rate_hz_,
+        GetInternalSampleRate(sample_rate_hz_));
+    partial_mock_samples.push_back(
+        {mock_samples_->begin(),
+         mock_samples_->begin() + internal_num_samples});
+    if (i == 0) {
+      const std::vector<int16_t> kEmptySamples;
+      EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+          .WillOnce(Return(kEmptySamples))
+          .WillOnce(Return(partial_mock_samples.back()));
+      EXPECT_CALL(*mock_generative_model,
+                  AddFeatures(ElementsAreArray(estimated_features)));
+    } else {
+      EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+          .WillOnce(Return(partial_mock_samples.back()));
+    }
+
+    EXPECT_CALL(*mock_packet_loss_handler,
+                EstimateLostFeatures(internal_num_samples))
+        .WillOnce(Return(estimated_features));
+
+    EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_))
+        .Times(0);
+    EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+        .Times(0);
+
+    // Set expectation for |resampler|.
+    partial_output_mock_samples.push_back(
+        {output_mock_samples_.begin(),
+         output_mock_samples_.begin() + num_samples_requested[i]});
+    if (GetInternalSampleRate(sample_rate_hz_) == sample_rate_hz_) {
+      EXPECT_CALL(*resampler,
+                  Resample(absl::MakeConstSpan(partial_mock_samples.back())))
+          .Times(0);
+    } else {
+      EXPECT_CALL(*resampler,
+                  Resample(absl::MakeConstSpan(partial_mock_samples.back())))
+          .WillOnce(Return(partial_output_mock_samples.back()));
+    }
+  }
+
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
+  for (int i = 0; i < num_samples_requested.size(); ++i) {
+    auto decoded_or =
+        lyra_decoder_peer->DecodePacketLoss(num_samples_requested[i]);
+    ASSERT_TRUE(decoded_or.has_value());
+    EXPECT_EQ(decoded_or.value(), partial_output_mock_samples[i]);
+  }
+}
+
+TEST_P(LyraDecoderTest, ModelsTransitionsAndTriggerOverlap) {
+  // Test that models transition and are overlapped when necessary. This test is
+  // solely concerned with verifying that overlap happens and does not check for
+  // correctness. The generative model is called once on a packet, then two
+  // packets are lost, then the generative model is called one more time on a
+  // packet.
+  static constexpr int kNumPacketDecodes = 2;
+  static constexpr int kNumLostPackets = 2;
+  const int internal_num_samples = mock_samples_->size();
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .Times(kNumPacketDecodes)
+      .WillRepeatedly(Return(mock_concatenated_features_));
+
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+
+  // Called in SetEncodedPacket() in Step 1 and 3 below.
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .Times(kNumPacketDecodes)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)))
+        .Times(kNumPacketDecodes);
+  }
+
+  // Called in DecodeSamples() in Step 1 and 3 below, as well as one extra time
+  // in Step 2 below to account for the overlap when transitioning from CNG
+  // to the generative model.
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .Times(kNumPacketDecodes + 1)
+      .WillRepeatedly(Return(mock_samples_));
+
+  // In Step 2, in order to account for the overlap, the generative model's
+  // AddFeatures() may be called one extra time using the estimated features.
+  // This happens only if |num_frames_per_packet_| is 1. Otherwise there would
+  // be enough leftover features from the previous packet to generate samples.
+  const FeatureFrame mock_estimated_features(kNumFeatures, 10.0f);
+  if (num_frames_per_packet_ == 1) {
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_estimated_features)))
+        .Times(1);
+  }
+
+  // CNG's AddFeatures() and GenerateSamples() are called |kNumLostPackets|
+  // |kNumLostPackets| times in Step 2, as well as one extra time to account
+  // for the overlap when transitioning from CNG to the generative model.
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              AddFeatures(ElementsAreArray(mock_estimated_features)))
+      .Times(kNumLostPackets + 1);
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              GenerateSamples(internal_num_samples))
+      .Times(kNumLostPackets + 1)
+      .WillRepeatedly(Return(mock_samples_));
+
+  // This test is not concerned with the behavior of the resampler, so use real
+  // one.
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
+
+  // EstimateLostFeatures() is |kNumLostPackets| times in Step 2 and one extra
+  // time in Step 3 because of the overlap. This extra call does not mess with
+  // the class's internal comfort noise identification logic, as it happens
+  // when the transition is from CNG to the generative model.
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateLostFeatures(internal_num_samples))
+      .Times(kNumLostPackets + 1)
+      .WillRepeatedly(Return(mock_estimated_features));
+  EXPECT_CALL(*mock_packet_loss_handler, is_comfort_noise())
+      .Times(kNumLostPackets)
+      .WillRepeatedly(Return(true));
+
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
+
+  // Step 1: Decode a packet with the generative model.
+  const int num_samples = output_mock_samples_.size();
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+
+  // Step 2: Call DecodePacketLoss() |kNumLostPackets| = 2 times to ensure
+  // |prev_frame_was_comfort_noise_| = true. Overlap is expected here.
+  EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples).has_value());
+  EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples).has_value());
+
+  // Step 3: Decode one more packet with the generative model. Overlap is
+  // expected here.
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+}
+
+TEST_P(LyraDecoderTest, EmptyPacketsAreDecodedAsComfortNoise) {
+  // Empty packets of an encoder with DTX enabled go straight to comfort noise.
+  // The generative model only runs once, for the overlap into the first
+  // comfort noise frame, and not at all for the following ones.
+  static constexpr int kNumEmptyPackets = 2;
+  const int internal_num_samples = mock_samples_->size();
+  const FeatureFrame mock_noise_features(kNumFeatures, 10.0f);
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .Times(0);
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateSilenceFeatures(internal_num_samples))
+      .Times(kNumEmptyPackets)
+      .WillRepeatedly(Return(mock_noise_features));
+  EXPECT_CALL(*mock_packet_loss_handler, is_comfort_noise()).Times(0);
+
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model,
+              AddFeatures(ElementsAreArray(mock_noise_features)))
+      .Times(1);
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .WillOnce(Return(mock_samples_));
+
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              AddFeatures(ElementsAreArray(mock_noise_features)))
+      .Times(kNumEmptyPackets);
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              GenerateSamples(internal_num_samples))
+      .Times(kNumEmptyPackets)
+      .WillRepeatedly(Return(mock_samples_));
+
+  // This test is not concerned with the behavior of the resampler, so use real
+  // one.
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      absl::make_unique<MockVectorQuantizer>(),
+      std::move(mock_packet_loss_handler), std::move(resampler),
+      sample_rate_hz_, num_frames_per_packet_);
+
+  const int num_samples = output_mock_samples_.size();
+  const std::vector<uint8_t> empty_packet;
+  for (int i = 0; i < kNumEmptyPackets; ++i) {
+    ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(empty_packet));
+    EXPECT_FALSE(lyra_decoder_peer->QueueEncodedPacket(empty_packet));
+    std::vector<int16_t> decoded(num_samples);
+    EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(absl::MakeSpan(decoded)));
+  }
+  // No more samples than in an empty packet can be decoded from it.
+  const int num_remaining_samples = (num_frames_per_packet_ - 1) * num_samples;
+  EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(num_remaining_samples + 1)
+                   .has_value());
+}
+
+TEST_P(LyraDecoderTest, IdleModelIsParkedUntilItIsNeeded) {
+  // The first comfort noise frame overlaps with the generative model, after
+  // which the model is parked once two more frames of comfort noise were
+  // decoded. Concealing the next lost packet with it unparks it.
+  static constexpr int kNumEmptyPackets = 3;
+  const int internal_num_samples = mock_samples_->size();
+  const FeatureFrame mock_noise_features(kNumFeatures, 10.0f);
+  const FeatureFrame estimated_features(kNumFeatures, 11.0f);
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateSilenceFeatures(internal_num_samples))
+      .WillRepeatedly(Return(mock_noise_features));
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateLostFeatures(internal_num_samples))
+      .WillOnce(Return(estimated_features));
+  EXPECT_CALL(*mock_packet_loss_handler, is_comfort_noise())
+      .WillOnce(Return(false));
+  EXPECT_CALL(*mock_packet_loss_handler, SaveState(testing::_))
+      .WillOnce(Return(true));
+
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, AddFeatures(testing::_))
+      .Times(testing::AnyNumber());
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .Times(2)
+      .WillRepeatedly(Return(mock_samples_));
+  EXPECT_CALL(*mock_generative_model, SaveState(testing::_))
+      .WillOnce(Return(true));
+  testing::Sequence park_and_unpark;
+  EXPECT_CALL(*mock_generative_model, Park())
+      .InSequence(park_and_unpark)
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_generative_model, Unpark()).InSequence(park_and_unpark);
+
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_))
+      .Times(testing::AnyNumber());
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              GenerateSamples(internal_num_samples))
+      .WillRepeatedly(Return(mock_samples_));
+  EXPECT_CALL(*mock_comfort_noise_generator, SaveState(testing::_))
+      .WillOnce(Return(true));
+
+  // This test is not concerned with the behavior of the resampler, so use real
+  // one.
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      absl::make_unique<MockVectorQuantizer>(),
+      std::move(mock_packet_loss_handler), std::move(resampler),
+      sample_rate_hz_, num_frames_per_packet_);
+  lyra_decoder_peer->SetParkingDelay(absl::Microseconds(
+      int64_t{2} * internal_num_samples * 1000000 / kInternalSampleRateHz));
+  EXPECT_EQ(lyra_decoder_peer->performance_profile().park_after_idle_ms,
+            2 * internal_num_samples * 1000 / kInternalSampleRateHz);
+
+  const int num_samples = output_mock_samples_.size();
+  const std::vector<uint8_t> empty_packet;
+  for (int i = 0; i < kNumEmptyPackets; ++i) {
+    ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(empty_packet));
+    for (int frame = 0; frame < num_frames_per_packet_; ++frame) {
+      ASSERT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+    }
+  }
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_parks, 1);
+  // The parked model keeps its state, which is saved without unparking it.
+  std::vector<uint8_t> state;
+  EXPECT_TRUE(lyra_decoder_peer->SaveState(&state));
+  EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples).has_value());
+
+  const DecoderMetrics metrics = lyra_decoder_peer->metrics();
+  EXPECT_EQ(metrics.num_parks, 1);
+  EXPECT_GE(metrics.max_unpark_nanos, 0);
+}
+
+TEST_P(LyraDecoderTest, DecodesComfortNoiseUntilTheGenerativeModelIsLoaded) {
+  // A packet received while the generative model loads is decoded as comfort
+  // noise from its own features. The first packet after the model is loaded
+  // is decoded with it, overlapped from comfort noise of estimated features.
+  const int internal_num_samples = mock_samples_->size();
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .Times(2)
+      .WillRepeatedly(Return(mock_concatenated_features_));
+
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
+  }
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .WillOnce(Return(mock_samples_));
+  const FeatureFrame mock_estimated_features(kNumFeatures, 10.0f);
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateLostFeatures(internal_num_samples))
+      .WillOnce(Return(mock_estimated_features));
+
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              AddFeatures(ElementsAreArray(mock_feature_frames_[0])));
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              AddFeatures(ElementsAreArray(mock_estimated_features)));
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              GenerateSamples(internal_num_samples))
+      .Times(2)
+      .WillRepeatedly(Return(mock_samples_));
+
+  // This test is not concerned with the behavior of the resampler, so use real
+  // one.
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      /*mock_generative_model=*/nullptr,
+      std::move(mock_comfort_noise_generator),
+      std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
+      std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
+  std::promise<std::unique_ptr<GenerativeModelInterface>> loaded;
+  lyra_decoder_peer->SetPendingGenerativeModel(loaded.get_future());
+  EXPECT_FALSE(lyra_decoder_peer->has_generative_model());
+
+  const int num_samples = output_mock_samples_.size();
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  EXPECT_FALSE(lyra_decoder_peer->has_generative_model());
+
+  loaded.set_value(std::move(mock_generative_model));
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  EXPECT_TRUE(lyra_decoder_peer->has_generative_model());
+  EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_comfort_noise_samples,
+            num_samples);
+}
+
+TEST_P(LyraDecoderTest, FailedGenerativeModelLoadStaysInComfortNoise) {
+  const int internal_num_samples = mock_samples_->size();
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
+
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  for (const auto& mock_features : mock_feature_frames_) {
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .WillOnce(Return(true));
+  }
+  // Lost packets are concealed with comfort noise too.
+  const FeatureFrame mock_noise_features(kNumFeatures, 10.0f);
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateSilenceFeatures(internal_num_samples))
+      .WillOnce(Return(mock_noise_features));
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .Times(0);
+
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_))
+      .Times(2);
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              GenerateSamples(internal_num_samples))
+      .Times(2)
+      .WillRepeatedly(Return(mock_samples_));
 
-  // Use a real resampler as this test is only concerned with behaviour before
-  // any resampling. We need the real resampler to avoid failing resampling
-  // CHECKs in lyra_decoder.
   auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
                                      sample_rate_hz_);
   auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
-      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      /*mock_generative_model=*/nullptr,
+      std::move(mock_comfort_noise_generator),
       std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
       std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
+  std::promise<std::unique_ptr<GenerativeModelInterface>> loaded;
+  lyra_decoder_peer->SetPendingGenerativeModel(loaded.get_future());
+  loaded.set_value(nullptr);
+  EXPECT_FALSE(lyra_decoder_peer->WaitForGenerativeModel());
 
-  // Step 1: Add a packet with N frames.
-  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded_zeros));
-
-  // Step 2: Decode N - 1 complete frames.
-  // The literals in |num_samples_request_*| expressions are at
-  // |kInternalSampleRateHz| and then converted to |sample_rate_hz_| to match
-  // the interface expectation.
-  const int complete_num_samples_request = ConvertNumSamplesBetweenSampleRate(
-      internal_frame_size, GetInternalSampleRate(sample_rate_hz_),
-      sample_rate_hz_);
-  for (int i = 0; i < num_frames_per_packet_ - 1; ++i) {
-    EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(complete_num_samples_request)
-                    .has_value());
-  }
-
-  // Step 3: Decode M - 20 samples from the last frame.
-  const int num_samples_request_0 = ConvertNumSamplesBetweenSampleRate(
-      internal_frame_size - 20, GetInternalSampleRate(sample_rate_hz_),
-      sample_rate_hz_);
-  EXPECT_TRUE(
-      lyra_decoder_peer->DecodeSamples(num_samples_request_0).has_value());
-
-  // Step 4: A |DecodeSamples| request for more than 20 samples should return
-  // nullopt.
-  const int num_samples_request_1 = ConvertNumSamplesBetweenSampleRate(
-      62, GetInternalSampleRate(sample_rate_hz_), sample_rate_hz_);
-  EXPECT_FALSE(
-      lyra_decoder_peer->DecodeSamples(num_samples_request_1).has_value());
-
-  // Step 5: Requesting 62 samples in PLC mode is valid.
-  EXPECT_TRUE(
-      lyra_decoder_peer->DecodePacketLoss(num_samples_request_1).has_value());
-
-  // Step 6: Requesting M - 40 samples in PLC mode is valid too.
-  const int num_samples_request_2 = ConvertNumSamplesBetweenSampleRate(
-      internal_frame_size - 40, GetInternalSampleRate(sample_rate_hz_),
-      sample_rate_hz_);
-  EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples_request_2));
+  const int num_samples = output_mock_samples_.size();
+  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+  EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples).has_value());
+  std::vector<uint8_t> state;
+  EXPECT_FALSE(lyra_decoder_peer->SaveState(&state));
+  EXPECT_FALSE(lyra_decoder_peer->has_generative_model());
 }
 
-TEST_P(LyraDecoderTest, MultipleLostPackets) {
-  // Requests 3 PLC packets without adding real features.
-  static constexpr int kNumLostPackets = 3;
-  const std::vector<float> estimated_features(kNumFeatures, 17.0f);
+TEST_P(LyraDecoderTest, StretchedPacketPlaysOutLongerOrShorter) {
+  // The generative model rounds the stretch to its own granularity, which the
+  // decoder returns the length of the packet for.
+  const int internal_num_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(kInternalSampleRateHz);
+  const int num_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(sample_rate_hz_);
+  const int num_samples_per_column = GetNumSamplesPerHop(sample_rate_hz_) / 8;
+  const int internal_num_samples_per_column =
+      GetNumSamplesPerHop(kInternalSampleRateHz) / 8;
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
-  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
-  const int internal_num_samples = mock_samples_->size();
-  // PLC calls are made before any real packets are added.
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
-      .Times(kNumLostPackets)
-      .WillRepeatedly(Return(mock_samples_));
-  EXPECT_CALL(*mock_generative_model, AddFeatures(estimated_features))
-      .Times(kNumLostPackets);
-  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
-  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_)).Times(0);
-  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
-      .Times(0);
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .Times(2)
+      .WillRepeatedly(Return(mock_concatenated_features_));
+
   auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
-  EXPECT_CALL(*mock_packet_loss_handler,
-              EstimateLostFeatures(internal_num_samples))
-      .Times(kNumLostPackets)
-      .WillRepeatedly(Return(estimated_features));
+  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(testing::_))
+      .WillRepeatedly(Return(true));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, AddFeatures(testing::_))
+      .Times(2 * num_frames_per_packet_);
+  EXPECT_CALL(*mock_generative_model,
+              StretchFeatures(internal_num_samples_per_column))
+      .WillOnce(Return(internal_num_samples_per_column));
+  EXPECT_CALL(*mock_generative_model,
+              StretchFeatures(-internal_num_samples_per_column))
+      .WillOnce(Return(-internal_num_samples_per_column));
+  EXPECT_CALL(*mock_generative_model,
+              GenerateSamples(internal_num_samples_per_packet +
+                              internal_num_samples_per_column))
+      .WillOnce(Return(std::vector<int16_t>(internal_num_samples_per_packet +
+                                            internal_num_samples_per_column)));
+  EXPECT_CALL(*mock_generative_model,
+              GenerateSamples(internal_num_samples_per_packet -
+                              internal_num_samples_per_column))
+      .WillOnce(Return(std::vector<int16_t>(internal_num_samples_per_packet -
+                                            internal_num_samples_per_column)));
+
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
   auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
-      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      std::move(mock_generative_model),
+      absl::make_unique<MockGenerativeModel>(),
       std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
-      GetResampler(kNumLostPackets), sample_rate_hz_, num_frames_per_packet_);
+      std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
 
-  const int num_samples = output_mock_samples_.size();
-  for (int i = 0; i < kNumLostPackets; ++i) {
-    auto decoded_or = lyra_decoder_peer->DecodePacketLoss(num_samples);
+  // More than half a packet is refused before the packet is parsed.
+  EXPECT_FALSE(lyra_decoder_peer
+                   ->SetStretchedEncodedPacket(encoded,
+                                               num_samples_per_packet / 2 + 1)
+                   .has_value());
+
+  for (const int num_stretched_samples :
+       {num_samples_per_column, -num_samples_per_column}) {
+    const auto num_samples_or = lyra_decoder_peer->SetStretchedEncodedPacket(
+        encoded, num_stretched_samples);
+    ASSERT_TRUE(num_samples_or.has_value());
+    EXPECT_EQ(num_samples_or.value(),
+              num_samples_per_packet + num_stretched_samples);
+    const auto decoded_or =
+        lyra_decoder_peer->DecodeSamples(num_samples_or.value());
     ASSERT_TRUE(decoded_or.has_value());
-    EXPECT_EQ(decoded_or.value(), output_mock_samples_);
+    EXPECT_EQ(decoded_or->size(), num_samples_or.value());
+    // The packet is fully decoded.
+    EXPECT_FALSE(lyra_decoder_peer->DecodeSamples(1).has_value());
   }
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_stretched_packets, 2);
 }
 
-TEST_P(LyraDecoderTest, OneLostPacketMultipleRequests) {
-  // A packet is lost, but there are several calls to DecodePacketLoss(), each
-  // requesting a different number of samples. The total number of samples
-  // requested does not exceed the frame size.
-  std::vector<float> estimated_features(kNumFeatures, 13.0f);
-  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+TEST_P(LyraDecoderTest, StretchedComfortNoisePlaysOutLongerOrShorter) {
+  const int num_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(sample_rate_hz_);
+  // Comfort noise is not rounded, but goes through the internal sample rate.
+  const int num_stretched_samples =
+      -ConvertNumSamplesBetweenSampleRate(5, kInternalSampleRateHz,
+                                          sample_rate_hz_);
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateSilenceFeatures(testing::_))
+      .WillRepeatedly(Return(FeatureFrame(kNumFeatures, 10.0f)));
+  // The generative model only runs for the overlap into comfort noise.
   auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_generative_model, AddFeatures(testing::_))
+      .Times(testing::AnyNumber());
+  EXPECT_CALL(*mock_generative_model, StretchFeatures(testing::_)).Times(0);
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(testing::_))
+      .WillRepeatedly(testing::Invoke(
+          [](int num_samples) { return std::vector<int16_t>(num_samples); }));
   auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
-  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
-  auto resampler = absl::make_unique<MockResampler>();
+  EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_))
+      .Times(testing::AnyNumber());
+  EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
+      .WillRepeatedly(testing::Invoke(
+          [](int num_samples) { return std::vector<int16_t>(num_samples); }));
 
-  // Prepare 4 requested numbers of samples whose sum < frame size M:
-  // 7 + (M / 4 - 15) + (M / 4 + 2) + (M / 2 - 5) <= M - 11.
-  const int frame_size = output_mock_samples_.size();
-  const std::vector<int> num_samples_requested = {
-      7, frame_size / 4 - 15, frame_size / 4 + 2, frame_size / 2 - 5};
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
+  auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
+      std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
+      absl::make_unique<MockVectorQuantizer>(),
+      std::move(mock_packet_loss_handler), std::move(resampler),
+      sample_rate_hz_, num_frames_per_packet_);
+
+  const auto num_samples_or = lyra_decoder_peer->SetStretchedEncodedPacket(
+      std::vector<uint8_t>(), num_stretched_samples);
+  ASSERT_TRUE(num_samples_or.has_value());
+  EXPECT_EQ(num_samples_or.value(),
+            num_samples_per_packet + num_stretched_samples);
+  const auto decoded_or =
+      lyra_decoder_peer->DecodeSamples(num_samples_or.value());
+  ASSERT_TRUE(decoded_or.has_value());
+  EXPECT_EQ(decoded_or->size(), num_samples_or.value());
+  EXPECT_EQ(lyra_decoder_peer->metrics().num_stretched_packets, 1);
+}
 
-  std::vector<std::vector<int16_t>> partial_mock_samples;
-  std::vector<std::vector<int16_t>> partial_output_mock_samples;
-  for (int i = 0; i < num_samples_requested.size(); ++i) {
-    const int internal_num_samples = ConvertNumSamplesBetweenSampleRate(
-        num_samples_requested[i], sample_rate_hz_,
-        GetInternalSampleRate(sample_rate_hz_));
-    partial_mock_samples.push_back(
-        {mock_samples_->begin(),
-         mock_samples_->begin() + internal_num_samples});
-    if (i == 0) {
-      const std::vector<int16_t> kEmptySamples;
-      EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
-          .WillOnce(Return(kEmptySamples))
-          .WillOnce(Return(partial_mock_samples.back()));
-      EXPECT_CALL(*mock_generative_model, AddFeatures(estimated_features));
-    } else {
-      EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
-          .WillOnce(Return(partial_mock_samples.back()));
-    }
+TEST_P(LyraDecoderTest, SilenceDetectionDecodesReceivedNoiseAsComfortNoise) {
+  // Received packets similar to the background noise are decoded with the
+  // generative model until they lasted long enough, then as comfort noise
+  // from their own features. The first packet that is not noise goes back to
+  // the generative model right away.
+  const int num_noise_frames_to_switch =
+      std::ceil(LyraDecoder::kMinNoiseSeconds * kFrameRate);
+  const int num_model_packets =
+      (num_noise_frames_to_switch + num_frames_per_packet_ - 1) /
+          num_frames_per_packet_ -
+      1;
+  static constexpr int kNumComfortNoisePackets = 2;
+  const int num_noise_packets = num_model_packets + kNumComfortNoisePackets;
+  const int internal_num_samples = mock_samples_->size();
+  const QuantizedBits quantized(kNumQuantizedBits);
+  PacketType packet;
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .Times(num_noise_packets + 1)
+      .WillRepeatedly(Return(mock_concatenated_features_));
 
+  auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
+  auto& is_similar_noise =
+      EXPECT_CALL(*mock_packet_loss_handler, IsSimilarNoise(testing::_))
+          .Times((num_noise_packets + 1) * num_frames_per_packet_);
+  for (int i = 0; i < num_noise_packets * num_frames_per_packet_; ++i) {
+    is_similar_noise.WillOnce(Return(true));
+  }
+  is_similar_noise.WillRepeatedly(Return(false));
+  auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
     EXPECT_CALL(*mock_packet_loss_handler,
-                EstimateLostFeatures(internal_num_samples))
-        .WillOnce(Return(estimated_features));
-
-    EXPECT_CALL(*mock_comfort_noise_generator, AddFeatures(testing::_))
-        .Times(0);
-    EXPECT_CALL(*mock_comfort_noise_generator, GenerateSamples(testing::_))
-        .Times(0);
-
-    // Set expectation for |resampler|.
-    partial_output_mock_samples.push_back(
-        {output_mock_samples_.begin(),
-         output_mock_samples_.begin() + num_samples_requested[i]});
-    if (GetInternalSampleRate(sample_rate_hz_) == sample_rate_hz_) {
-      EXPECT_CALL(*resampler,
-                  Resample(absl::MakeConstSpan(partial_mock_samples.back())))
-          .Times(0);
-    } else {
-      EXPECT_CALL(*resampler,
-                  Resample(absl::MakeConstSpan(partial_mock_samples.back())))
-          .WillOnce(Return(partial_output_mock_samples.back()));
-    }
+                SetReceivedFeatures(ElementsAreArray(mock_feature_frames_[i])))
+        .Times(num_noise_packets + 1)
+        .WillRepeatedly(Return(true));
+    // The overlap into comfort noise adds the features of the first frame if
+    // no features are left from the previous packet.
+    const bool overlap_adds_features =
+        i == 0 && (num_model_packets == 0 || num_frames_per_packet_ == 1);
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_feature_frames_[i])))
+        .Times(num_model_packets + 1 + (overlap_adds_features ? 1 : 0));
   }
+  // Once per packet decoded with the generative model and once for each
+  // overlap.
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .Times(num_model_packets + 2)
+      .WillRepeatedly(Return(mock_samples_));
+
+  // Going back to the generative model overlaps from comfort noise of
+  // estimated features, like after a lost stretch.
+  const FeatureFrame mock_estimated_features(kNumFeatures, 10.0f);
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateLostFeatures(internal_num_samples))
+      .WillOnce(Return(mock_estimated_features));
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateSilenceFeatures(testing::_))
+      .Times(0);
+  auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              AddFeatures(ElementsAreArray(mock_feature_frames_[0])))
+      .Times(kNumComfortNoisePackets);
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              AddFeatures(ElementsAreArray(mock_estimated_features)))
+      .Times(1);
+  EXPECT_CALL(*mock_comfort_noise_generator,
+              GenerateSamples(internal_num_samples))
+      .Times(kNumComfortNoisePackets + 1)
+      .WillRepeatedly(Return(mock_samples_));
 
+  // This test is not concerned with the behavior of the resampler, so use real
+  // one.
+  auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
+                                     sample_rate_hz_);
   auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
       std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
       std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
       std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
-  for (int i = 0; i < num_samples_requested.size(); ++i) {
-    auto decoded_or =
-        lyra_decoder_peer->DecodePacketLoss(num_samples_requested[i]);
-    ASSERT_TRUE(decoded_or.has_value());
-    EXPECT_EQ(decoded_or.value(), partial_output_mock_samples[i]);
+  lyra_decoder_peer->SetSilenceDetectionEnabled(true);
+
+  const int num_samples = output_mock_samples_.size();
+  for (int i = 0; i < num_noise_packets + 1; ++i) {
+    ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
+    EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
   }
 }
 
-TEST_P(LyraDecoderTest, ModelsTransitionsAndTriggerOverlap) {
-  // Test that models transition and are overlapped when necessary. This test is
-  // solely concerned with verifying that overlap happens and does not check for
-  // correctness. The generative model is called once on a packet, then two
-  // packets are lost, then the generative model is called one more time on a
-  // packet.
-  static constexpr int kNumPacketDecodes = 2;
+TEST_P(LyraDecoderTest, ReducedQualityConcealsWithComfortNoise) {
+  // At the reduced quality level lost packets go to comfort noise right away.
+  // The generative model only runs for the overlap into comfort noise.
   static constexpr int kNumLostPackets = 2;
   const int internal_num_samples = mock_samples_->size();
-  std::bitset<kNumQuantizedBits> quantized(0);
+  const QuantizedBits quantized(kNumQuantizedBits);
   PacketType packet;
-  std::vector<uint8_t> encoded = packet.PackQuantized(quantized.to_string());
+  std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
-  EXPECT_CALL(*mock_vector_quantizer,
-              DecodeToLossyFeatures(quantized.to_string()))
-      .Times(kNumPacketDecodes)
-      .WillRepeatedly(Return(mock_concatenated_features_));
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized))
+      .WillOnce(Return(mock_concatenated_features_));
 
   auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
   auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
-
-  // Called in SetEncodedPacket() in Step 1 and 3 below.
   for (const auto& mock_features : mock_feature_frames_) {
-    EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(mock_features))
-        .Times(kNumPacketDecodes)
-        .WillRepeatedly(Return(true));
-    EXPECT_CALL(*mock_generative_model, AddFeatures(mock_features))
-        .Times(kNumPacketDecodes);
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
   }
-
-  // Called in DecodeSamples() in Step 1 and 3 below, as well as one extra time
-  // in Step 2 below to account for the overlap when transitioning from CNG
-  // to the generative model.
-  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
-      .Times(kNumPacketDecodes + 1)
-      .WillRepeatedly(Return(mock_samples_));
-
-  // In Step 2, in order to account for the overlap, the generative model's
-  // AddFeatures() may be called one extra time using the estimated features.
-  // This happens only if |num_frames_per_packet_| is 1. Otherwise there would
-  // be enough leftover features from the previous packet to generate samples.
-  const std::vector<float> mock_estimated_features(kNumFeatures, 10.0f);
+  const FeatureFrame mock_noise_features(kNumFeatures, 10.0f);
+  EXPECT_CALL(*mock_packet_loss_handler, EstimateLostFeatures(testing::_))
+      .Times(0);
+  EXPECT_CALL(*mock_packet_loss_handler,
+              EstimateSilenceFeatures(internal_num_samples))
+      .Times(kNumLostPackets)
+      .WillRepeatedly(Return(mock_noise_features));
+  // No features are left for the overlap if the packet had only one frame.
   if (num_frames_per_packet_ == 1) {
-    EXPECT_CALL(*mock_generative_model, AddFeatures(mock_estimated_features))
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_noise_features)))
         .Times(1);
   }
+  EXPECT_CALL(*mock_generative_model, GenerateSamples(internal_num_samples))
+      .Times(2)
+      .WillRepeatedly(Return(mock_samples_));
 
-  // CNG's AddFeatures() and GenerateSamples() are called |kNumLostPackets|
-  // |kNumLostPackets| times in Step 2, as well as one extra time to account
-  // for the overlap when transitioning from CNG to the generative model.
   auto mock_comfort_noise_generator = absl::make_unique<MockGenerativeModel>();
   EXPECT_CALL(*mock_comfort_noise_generator,
-              AddFeatures(mock_estimated_features))
-      .Times(kNumLostPackets + 1);
+              AddFeatures(ElementsAreArray(mock_noise_features)))
+      .Times(kNumLostPackets);
   EXPECT_CALL(*mock_comfort_noise_generator,
               GenerateSamples(internal_num_samples))
-      .Times(kNumLostPackets + 1)
+      .Times(kNumLostPackets)
       .WillRepeatedly(Return(mock_samples_));
 
   // This test is not concerned with the behavior of the resampler, so use real
   // one.
   auto resampler = Resampler::Create(GetInternalSampleRate(sample_rate_hz_),
                                      sample_rate_hz_);
-
-  // EstimateLostFeatures() is |kNumLostPackets| times in Step 2 and one extra
-  // time in Step 3 because of the overlap. This extra call does not mess with
-  // the class's internal comfort noise identification logic, as it happens
-  // when the transition is from CNG to the generative model.
-  EXPECT_CALL(*mock_packet_loss_handler,
-              EstimateLostFeatures(internal_num_samples))
-      .Times(kNumLostPackets + 1)
-      .WillRepeatedly(Return(mock_estimated_features));
-  EXPECT_CALL(*mock_packet_loss_handler, is_comfort_noise())
-      .Times(kNumLostPackets)
-      .WillRepeatedly(Return(true));
-
   auto lyra_decoder_peer = absl::make_unique<LyraDecoderPeer>(
       std::move(mock_generative_model), std::move(mock_comfort_noise_generator),
       std::move(mock_vector_quantizer), std::move(mock_packet_loss_handler),
       std::move(resampler), sample_rate_hz_, num_frames_per_packet_);
 
-  // Step 1: Decode a packet with the generative model.
   const int num_samples = output_mock_samples_.size();
   ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
   EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  lyra_decoder_peer->SetQualityLevel(QualityLevel::kReduced);
+  for (int i = 0; i < kNumLostPackets; ++i) {
+    EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples).has_value());
+  }
 
-  // Step 2: Call DecodePacketLoss() |kNumLostPackets| = 2 times to ensure
-  // |prev_frame_was_comfort_noise_| = true. Overlap is expected here.
-  EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples).has_value());
-  EXPECT_TRUE(lyra_decoder_peer->DecodePacketLoss(num_samples).has_value());
-
-  // Step 3: Decode one more packet with the generative model. Overlap is
-  // expected here.
-  ASSERT_TRUE(lyra_decoder_peer->SetEncodedPacket(encoded));
-  EXPECT_TRUE(lyra_decoder_peer->DecodeSamples(num_samples).has_value());
+  const DecoderMetrics metrics = lyra_decoder_peer->metrics();
+  EXPECT_EQ(metrics.num_samples_decoded, (1 + kNumLostPackets) * num_samples);
+  EXPECT_EQ(metrics.num_model_samples, num_samples);
+  EXPECT_EQ(metrics.num_comfort_noise_samples, kNumLostPackets * num_samples);
+  EXPECT_EQ(metrics.num_concealed_samples, 0);
+  EXPECT_GE(metrics.max_call_nanos, 0);
+  EXPECT_GE(metrics.real_time_factor, 0.0);
 }
 
 TEST_P(LyraDecoderTest, FrameSizesDiffer) {
@@ -685,42 +2210,43 @@ TEST_P(LyraDecoderTest, OverlapSucceedsWithConsecutiveFramesOfDifferentSize) {
 
 TEST_P(LyraDecoderTest, DecodeLatestPacketOnly) {
   // Fill a packet with the bit pattern 00000000 at each byte.
-  std::bitset<kNumQuantizedBits> quantized_zeros(0);
+  const QuantizedBits quantized_zeros(kNumQuantizedBits);
   PacketType packet_zeros;
   std::vector<uint8_t> encoded_zeros =
-      packet_zeros.PackQuantized(quantized_zeros.to_string());
+      packet_zeros.PackQuantized(quantized_zeros);
 
   // Fill a packet with the bit pattern 11111111 at each byte.
-  std::bitset<kNumQuantizedBits> quantized_ones(0);
-  quantized_ones.flip();
+  const QuantizedBits quantized_ones =
+      QuantizedBitsFromString(std::string(kNumQuantizedBits, '1'));
   PacketType packet_ones;
-  std::vector<uint8_t> encoded_ones =
-      packet_ones.PackQuantized(quantized_ones.to_string());
+  std::vector<uint8_t> encoded_ones = packet_ones.PackQuantized(quantized_ones);
 
   // First the all 0s packet is passed to the decoder, then the all 1s packet is
   // passed to the decoder.
   const std::vector<float> zeros_concatenated_features(
       num_frames_per_packet_ * kNumFeatures, 0.0f);
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
-  EXPECT_CALL(*mock_vector_quantizer,
-              DecodeToLossyFeatures(quantized_zeros.to_string()))
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized_zeros))
       .WillOnce(Return(zeros_concatenated_features));
-  EXPECT_CALL(*mock_vector_quantizer,
-              DecodeToLossyFeatures(quantized_ones.to_string()))
+  EXPECT_CALL(*mock_vector_quantizer, DecodeToLossyFeatures(quantized_ones))
       .WillOnce(Return(mock_concatenated_features_));
 
   auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
   auto mock_generative_model = absl::make_unique<MockGenerativeModel>();
   const std::vector<float> zeros_features(kNumFeatures, 0.0f);
-  EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(zeros_features))
+  EXPECT_CALL(*mock_packet_loss_handler,
+              SetReceivedFeatures(ElementsAreArray(zeros_features)))
       .Times(num_frames_per_packet_)
       .WillRepeatedly(Return(true));
-  EXPECT_CALL(*mock_generative_model, AddFeatures(zeros_features))
+  EXPECT_CALL(*mock_generative_model,
+              AddFeatures(ElementsAreArray(zeros_features)))
       .Times(num_frames_per_packet_);
   for (const auto& mock_features : mock_feature_frames_) {
-    EXPECT_CALL(*mock_packet_loss_handler, SetReceivedFeatures(mock_features))
+    EXPECT_CALL(*mock_packet_loss_handler,
+                SetReceivedFeatures(ElementsAreArray(mock_features)))
         .WillOnce(Return(true));
-    EXPECT_CALL(*mock_generative_model, AddFeatures(mock_features));
+    EXPECT_CALL(*mock_generative_model,
+                AddFeatures(ElementsAreArray(mock_features)));
   }
 
   // The mock generative model should only be run once.
@@ -746,10 +2272,9 @@ TEST_P(LyraDecoderTest, DecodeLatestPacketOnly) {
 
 TEST_P(LyraDecoderTest, MoreSamplesRequestedThanInAPacket) {
   // Fill a packet with the bit pattern 00000000 at each byte.
-  std::bitset<kNumQuantizedBits> quantized_zeros(0);
+  const QuantizedBits quantized_zeros(kNumQuantizedBits);
   PacketType packet;
-  std::vector<uint8_t> encoded_zeros =
-      packet.PackQuantized(quantized_zeros.to_string());
+  std::vector<uint8_t> encoded_zeros = packet.PackQuantized(quantized_zeros);
 
   auto mock_vector_quantizer = absl::make_unique<MockVectorQuantizer>();
   auto mock_packet_loss_handler = absl::make_unique<MockPacketLossHandler>();
@@ -792,6 +2317,11 @@ TEST_P(LyraDecoderTest, InvalidConfig) {
                                   invalid_bitrates, model_path_),
               nullptr);
   }
+  for (const auto& invalid_num_threads : {-1, 0}) {
+    EXPECT_EQ(LyraDecoder::Create(sample_rate_hz_, kNumChannels, kBitrate,
+                                  model_path_, invalid_num_threads),
+              nullptr);
+  }
 }
 
 INSTANTIATE_TEST_SUITE_P(
@@ -812,6 +2342,116 @@ TEST(LyraDecoderCreate, InvalidCreateReturnsNullptr) {
   }
 }
 
+TEST(LyraDecoderCreate, DecodersShareModelWeights) {
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(
+      ghc::filesystem::current_path() / kExportedModelPath);
+  ASSERT_NE(model, nullptr);
+
+  auto first_decoder =
+      LyraDecoder::Create(kInternalSampleRateHz, kNumChannels, kBitrate, model);
+  ASSERT_NE(first_decoder, nullptr);
+  const int num_assets = model->num_assets();
+  EXPECT_GT(num_assets, 0);
+
+  auto second_decoder =
+      LyraDecoder::Create(kInternalSampleRateHz, kNumChannels, kBitrate, model);
+  ASSERT_NE(second_decoder, nullptr);
+  EXPECT_EQ(model->num_assets(), num_assets);
+}
+
+TEST(LyraDecoderCreate, ProfileOfTheModelIsApplied) {
+  PerformanceProfile profile;
+  profile.num_threads = 2;
+  profile.precision = ComputePrecision::kFixed16;
+  profile.use_adaptive_barrier = true;
+  profile.pipelining = false;
+  profile.silence_detection = true;
+  profile.reduced_quality_real_time_factor = 0.9f;
+  profile.full_quality_real_time_factor = 0.6f;
+  profile.prefetch_distance = 1;
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(
+      ghc::filesystem::current_path() / kExportedModelPath, profile);
+  ASSERT_NE(model, nullptr);
+
+  auto decoder = LyraDecoder::CreateWithProfile(kInternalSampleRateHz,
+                                                kNumChannels, kBitrate, model);
+  ASSERT_NE(decoder, nullptr);
+  const PerformanceProfile& applied = decoder->performance_profile();
+  EXPECT_EQ(applied.num_threads, 2);
+  EXPECT_EQ(applied.precision, ComputePrecision::kFixed16);
+  EXPECT_TRUE(applied.use_adaptive_barrier);
+  EXPECT_FALSE(applied.pipelining);
+  EXPECT_TRUE(applied.silence_detection);
+  EXPECT_EQ(applied.reduced_quality_real_time_factor, 0.9f);
+  EXPECT_EQ(applied.prefetch_distance, 1);
+  EXPECT_EQ(decoder->quality_level(), QualityLevel::kFull);
+}
+
+TEST(LyraDecoderCreate, ProgressiveDecoderAppliesTheProfileOnceLoaded) {
+  PerformanceProfile profile;
+  profile.num_threads = 2;
+  profile.use_adaptive_barrier = true;
+  profile.silence_detection = true;
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(
+      ghc::filesystem::current_path() / kExportedModelPath, profile);
+  ASSERT_NE(model, nullptr);
+
+  auto decoder = LyraDecoder::CreateProgressively(
+      kInternalSampleRateHz, kNumChannels, kBitrate, model);
+  ASSERT_NE(decoder, nullptr);
+  EXPECT_TRUE(decoder->performance_profile().silence_detection);
+  ASSERT_TRUE(decoder->WaitForGenerativeModel());
+  EXPECT_TRUE(decoder->has_generative_model());
+  EXPECT_TRUE(decoder->performance_profile().use_adaptive_barrier);
+}
+
+TEST(LyraDecoderCreate, DecodersOfDifferentPrecisionsShareOneModel) {
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(
+      ghc::filesystem::current_path() / kExportedModelPath);
+  ASSERT_NE(model, nullptr);
+
+  for (const ComputePrecision precision :
+       {ComputePrecision::kFloat, ComputePrecision::kFixed16,
+        ComputePrecision::kBfloat16}) {
+    auto decoder =
+        LyraDecoder::Create(kInternalSampleRateHz, kNumChannels, kBitrate,
+                            model, /*num_threads=*/1, precision);
+    EXPECT_NE(decoder, nullptr) << ComputePrecisionName(precision);
+  }
+}
+
+TEST(LyraDecoderCreate, SpectrogramPredictorIsCreatedByTheFactory) {
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(
+      ghc::filesystem::current_path() / kExportedModelPath);
+  ASSERT_NE(model, nullptr);
+
+  int num_created = 0;
+  auto decoder = LyraDecoder::Create(
+      kInternalSampleRateHz, kNumChannels, kBitrate, model,
+      /*num_threads=*/1, kDefaultComputePrecision, /*thread_pool=*/nullptr,
+      [&num_created](int num_features) {
+        ++num_created;
+        return LinearSpectrogramPredictor::Create(num_features);
+      });
+  EXPECT_NE(decoder, nullptr);
+  EXPECT_EQ(num_created, 1);
+
+  EXPECT_EQ(LyraDecoder::Create(
+                kInternalSampleRateHz, kNumChannels, kBitrate, model,
+                /*num_threads=*/1, kDefaultComputePrecision,
+                /*thread_pool=*/nullptr,
+                [](int num_features) {
+                  return std::unique_ptr<SpectrogramPredictorInterface>();
+                }),
+            nullptr);
+}
+
+TEST(LyraDecoderCreate, NullModelReturnsNullptr) {
+  EXPECT_EQ(LyraDecoder::Create(kInternalSampleRateHz, kNumChannels, kBitrate,
+                                std::shared_ptr<LyraModel>()),
+            nullptr);
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
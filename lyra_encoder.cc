@@ -15,7 +15,6 @@
 #include "lyra_encoder.h"
 
 #include <algorithm>
-#include <bitset>
 #include <cstdint>
 #include <memory>
 #include <utility>
@@ -23,33 +22,86 @@
 
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
-#include "audio/linear_filters/biquad_filter.h"
-#include "audio/linear_filters/biquad_filter_coefficients.h"
+#include "biquad_cascade.h"
+#include "codec_metrics.h"
+#include "compute_precision.h"
 #include "denoiser_interface.h"
-#include "dsp_util.h"
 #include "feature_extractor_interface.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_components.h"
 #include "lyra_config.h"
+#include "lyra_model.h"
 #include "noise_estimator.h"
 #include "noise_estimator_interface.h"
 #include "packet.h"
 #include "packet_interface.h"
+#include "quantized_bits.h"
 #include "resampler.h"
 #include "resampler_interface.h"
+#include "tracing.h"
 #include "vector_quantizer_interface.h"
 
 namespace chromemedia {
 namespace codec {
+namespace {
+
+// This filter has a -60 dB response for frequencies below 60 Hz for 16 kHz
+// sample rate or 30 Hz for 8 kHz sample rate. For sample rates of 32 kHz and
+// 48 kHz, the audio is resampled to 16 kHz before filtering, so the cutoff
+// will be 60 Hz too.
+// TODO(b/143491858): Remove this filtering once we find a vector quantizer
+// that is robust to DC.
+std::vector<BiquadCascade::Section> HighPassSections() {
+  return {
+      {0.99860809, -1.99666786, 0.99860809, -1.99658432, 0.99729972},
+      {0.99597739, -1.99145467, 0.99597739, -1.99137134, 0.99203811},
+      {0.99353280, -1.98665193, 0.99353280, -1.98656881, 0.98714873},
+      {0.99137777, -1.98245157, 0.99137777, -1.98236863, 0.98283848},
+      {0.98960226, -1.97901469, 0.98960226, -1.97893189, 0.97928731},
+      {0.98827957, -1.97646836, 0.98827957, -1.97638567, 0.97664182},
+      {0.98746381, -1.97490392, 0.98746381, -1.9748213, 0.97501025},
+      {0.99357343, -0.99357343, 0.0, -0.98714687, 0.0},
+  };
+}
+
+// The fixed16 build also extracts the features in integer arithmetic, from
+// samples high-pass filtered in integer arithmetic, so that no floating point
+// is used before the quantizer.
+constexpr bool kFixedPointFrontEnd =
+    kDefaultComputePrecision == ComputePrecision::kFixed16;
+
+}  // namespace
 
 std::unique_ptr<LyraEncoder> LyraEncoder::Create(
     int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
     const ghc::filesystem::path& model_path) {
-  absl::Status are_params_supported =
-      AreParamsSupported(sample_rate_hz, num_channels, bitrate, model_path);
+  return Create(sample_rate_hz, num_channels, bitrate, enable_dtx, model_path,
+                /*model=*/nullptr);
+}
+
+std::unique_ptr<LyraEncoder> LyraEncoder::Create(
+    int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
+    const std::shared_ptr<LyraModel>& model) {
+  if (model == nullptr) {
+    LOG(ERROR) << "A LyraModel is required to share weights.";
+    return nullptr;
+  }
+  return Create(sample_rate_hz, num_channels, bitrate, enable_dtx,
+                model->model_path(), model.get());
+}
+
+std::unique_ptr<LyraEncoder> LyraEncoder::Create(
+    int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
+    const ghc::filesystem::path& model_path, LyraModel* model) {
+  // The encoder only loads the quantizer, so the weights of the generative
+  // model need not be shipped with it.
+  absl::Status are_params_supported = AreParamsSupported(
+      sample_rate_hz, num_channels, bitrate, model_path, ModelRole::kEncoder);
   if (!are_params_supported.ok()) {
     LOG(ERROR) << are_params_supported;
     return nullptr;
@@ -68,7 +120,7 @@ std::unique_ptr<LyraEncoder> LyraEncoder::Create(
       GetNumSamplesPerHop(kInternalSampleRateHz);
   auto feature_extractor = CreateFeatureExtractor(
       kInternalSampleRateHz, kNumFeatures, internal_samples_per_hop,
-      GetNumSamplesPerFrame(kInternalSampleRateHz));
+      GetNumSamplesPerFrame(kInternalSampleRateHz), kFixedPointFrontEnd);
   if (feature_extractor == nullptr) {
     LOG(ERROR) << "Could not create Features Extractor.";
     return nullptr;
@@ -76,7 +128,7 @@ std::unique_ptr<LyraEncoder> LyraEncoder::Create(
 
   auto vector_quantizer =
       CreateQuantizer(kNumFramesPerPacket * kNumExpectedOutputFeatures,
-                      kNumQuantizationBits, model_path);
+                      kNumQuantizationBits, model_path, model);
   if (vector_quantizer == nullptr) {
     LOG(ERROR) << "Could not create Vector Quantizer.";
     return nullptr;
@@ -136,104 +188,177 @@ LyraEncoder::LyraEncoder(
       num_channels_(num_channels),
       bitrate_(bitrate),
       num_frames_per_packet_(num_frames_per_packet),
-      enable_dtx_(enable_dtx) {
-  // This filter has a -60 dB response for frequencies below 60 Hz for 16 kHz
-  // sample rate or 30 Hz for 8 kHz sample rate. For sample rates of 32 kHz and
-  // 48 kHz, the audio is resampled to 16 kHz before filtering, so the cutoff
-  // will be 60 Hz too.
-  // TODO(b/143491858): Remove this filtering once we find a vector quantizer
-  // that is robust to DC.
-  second_order_sections_filter_.Init(
-      1, linear_filters::BiquadFilterCascadeCoefficients({
-             {{0.99860809, -1.99666786, 0.99860809},
-              {1.0, -1.99658432, 0.99729972}},
-             {{0.99597739, -1.99145467, 0.99597739},
-              {1.0, -1.99137134, 0.99203811}},
-             {{0.99353280, -1.98665193, 0.99353280},
-              {1.0, -1.98656881, 0.98714873}},
-             {{0.99137777, -1.98245157, 0.99137777},
-              {1.0, -1.98236863, 0.98283848}},
-             {{0.98960226, -1.97901469, 0.98960226},
-              {1.0, -1.97893189, 0.97928731}},
-             {{0.98827957, -1.97646836, 0.98827957},
-              {1.0, -1.97638567, 0.97664182}},
-             {{0.98746381, -1.97490392, 0.98746381},
-              {1.0, -1.9748213, 0.97501025}},
-             {{0.99357343, -0.99357343, 0.0}, {1.0, -0.98714687, 0.0}},
-         }));
-}
+      enable_dtx_(enable_dtx),
+      high_pass_filter_(HighPassSections()),
+      fixed_point_high_pass_filter_(HighPassSections()) {}
 
 absl::optional<std::vector<uint8_t>> LyraEncoder::Encode(
     const absl::Span<const int16_t> audio) {
-  return EncodeInternal(audio, true);
+  auto encoded_or = EncodeInternal(audio, /*num_packets=*/1, true);
+  if (!encoded_or.has_value()) {
+    return absl::nullopt;
+  }
+  return std::move(encoded_or->front());
 }
 
-absl::optional<std::vector<uint8_t>> LyraEncoder::EncodeInternal(
-    const absl::Span<const int16_t> audio, bool filter_audio) {
-  absl::Span<const int16_t> audio_for_encoding = audio;
+absl::optional<std::vector<std::vector<uint8_t>>> LyraEncoder::EncodeBatch(
+    const absl::Span<const int16_t> audio) {
+  const int num_samples_per_packet =
+      num_frames_per_packet_ * GetNumSamplesPerHop(sample_rate_hz_);
+  if (audio.empty() || audio.size() % num_samples_per_packet != 0) {
+    LOG(ERROR) << "The number of audio samples has to be a positive multiple "
+               << "of " << num_samples_per_packet << ", but is "
+               << audio.size() << ".";
+    return absl::nullopt;
+  }
+  return EncodeInternal(audio, audio.size() / num_samples_per_packet, true);
+}
 
-  // Space to store resampled and/or filtered samples.
-  std::vector<int16_t> processed;
-  if (kInternalSampleRateHz != sample_rate_hz_) {
-    processed = resampler_->Resample(audio);
-    audio_for_encoding = absl::MakeConstSpan(processed);
+absl::optional<std::vector<std::vector<uint8_t>>> LyraEncoder::EncodeInternal(
+    const absl::Span<const int16_t> audio, int num_packets,
+    bool filter_audio) {
+  LYRA_TRACE_SCOPE("Encode");
+  const absl::Time start = absl::Now();
+  std::vector<bool> is_empty_packet;
+  const auto concatenated_features =
+      ExtractFeatures(audio, num_packets, filter_audio, &is_empty_packet);
+  if (!concatenated_features.has_value()) {
+    return absl::nullopt;
   }
+  auto encoded = QuantizeAndPack(concatenated_features.value(),
+                                 is_empty_packet, &metrics_);
+  if (!encoded.has_value()) {
+    return absl::nullopt;
+  }
+
+  const absl::Duration call_time = absl::Now() - start;
+  metrics_.num_packets_encoded += num_packets;
+  metrics_.num_frames_extracted += num_packets * num_frames_per_packet_;
+  metrics_.max_call_nanos =
+      std::max(metrics_.max_call_nanos, absl::ToInt64Nanoseconds(call_time));
+  real_time_factor_.Update(absl::ToDoubleSeconds(call_time),
+                           static_cast<double>(audio.size()) / sample_rate_hz_);
+  return encoded;
+}
 
+absl::optional<std::vector<float>> LyraEncoder::ExtractFeatures(
+    const absl::Span<const int16_t> audio, int num_packets, bool filter_audio,
+    std::vector<bool>* is_empty_packet) {
+  absl::Span<const int16_t> audio_for_encoding = audio;
   const int internal_samples_per_hop =
       GetNumSamplesPerHop(kInternalSampleRateHz);
-  if (audio_for_encoding.size() !=
-      num_frames_per_packet_ * internal_samples_per_hop) {
+  const int num_internal_samples =
+      num_packets * num_frames_per_packet_ * internal_samples_per_hop;
+
+  if (kInternalSampleRateHz != sample_rate_hz_) {
+    LYRA_TRACE_SCOPE("EncodeResample");
+    const absl::Time resampling_start = absl::Now();
+    processed_audio_.resize(num_internal_samples);
+    const int num_resampled = resampler_->ResampleInto(
+        audio, absl::MakeSpan(processed_audio_));
+    metrics_.resampling_nanos +=
+        absl::ToInt64Nanoseconds(absl::Now() - resampling_start);
+    if (num_resampled != num_internal_samples) {
+      LOG(ERROR) << "Resampling " << audio.size() << " samples gave "
+                 << num_resampled << " instead of " << num_internal_samples
+                 << ".";
+      return absl::nullopt;
+    }
+    audio_for_encoding = absl::MakeConstSpan(processed_audio_);
+  }
+
+  if (audio_for_encoding.size() != num_internal_samples) {
     LOG(ERROR) << "The number of audio samples has to be exactly "
-               << num_frames_per_packet_ * GetNumSamplesPerHop(sample_rate_hz_)
+               << num_packets * num_frames_per_packet_ *
+                      GetNumSamplesPerHop(sample_rate_hz_)
                << ", but is " << audio.size() << ".";
     return absl::nullopt;
   }
 
-  std::vector<int16_t> denoised_audio;
+  const absl::Time filtering_start = absl::Now();
   if (denoiser_ != nullptr) {
-    denoised_audio.reserve(audio_for_encoding.size());
-    for (int t = 0; t < audio_for_encoding.size();
+    LYRA_TRACE_SCOPE("EncodeDenoise");
+    // The denoiser works in place, on the resampled samples if there are any
+    // and otherwise on a copy of the ones of the caller.
+    if (audio_for_encoding.data() != processed_audio_.data()) {
+      processed_audio_.assign(audio_for_encoding.begin(),
+                              audio_for_encoding.end());
+    }
+    const absl::Span<int16_t> denoised_audio =
+        absl::MakeSpan(processed_audio_);
+    for (int t = 0; t < denoised_audio.size();
          t += denoiser_->SamplesPerHop()) {
-      auto denoised_frame = denoiser_->Denoise(
-          audio_for_encoding.subspan(t, denoiser_->SamplesPerHop()));
-      if (!denoised_frame.ok()) {
+      if (!denoiser_->Denoise(
+                   denoised_audio.subspan(t, denoiser_->SamplesPerHop()))
+               .ok()) {
         LOG(ERROR) << "Denoising failed.";
         return absl::nullopt;
       }
-      denoised_audio.insert(denoised_audio.end(),
-                            denoised_frame.value().begin(),
-                            denoised_frame.value().end());
     }
-    audio_for_encoding = absl::MakeConstSpan(denoised_audio);
+    audio_for_encoding = denoised_audio;
   }
 
+  // High-pass filter before encoding, straight into floats for the feature
+  // extractor unless the front end is fixed point.
   if (filter_audio) {
-    // High-pass filter before encoding.
-    std::vector<float> pre_filtered_floats(audio_for_encoding.begin(),
-                                           audio_for_encoding.end());
-    std::vector<float> filtered_floats;
-    second_order_sections_filter_.ProcessBlock(pre_filtered_floats,
-                                               &filtered_floats);
-    processed.resize(filtered_floats.size());
-    std::transform(filtered_floats.begin(), filtered_floats.end(),
-                   processed.begin(), ClipToInt16);
-    audio_for_encoding = absl::MakeConstSpan(processed);
+    LYRA_TRACE_SCOPE("EncodeHighPass");
+    if (kFixedPointFrontEnd) {
+      fixed_point_filtered_audio_.resize(audio_for_encoding.size());
+      fixed_point_high_pass_filter_.ProcessBlock(
+          audio_for_encoding, absl::MakeSpan(fixed_point_filtered_audio_));
+      audio_for_encoding = absl::MakeConstSpan(fixed_point_filtered_audio_);
+    } else {
+      filtered_audio_.resize(audio_for_encoding.size());
+      high_pass_filter_.ProcessBlock(audio_for_encoding,
+                                     absl::MakeSpan(filtered_audio_));
+    }
   }
+  metrics_.filtering_nanos +=
+      absl::ToInt64Nanoseconds(absl::Now() - filtering_start);
+  const bool extract_from_floats = filter_audio && !kFixedPointFrontEnd;
 
-  // We send an empty packet only if all constituent frames are noise similar
-  // to the previous ones.
-  int num_similar_noise_frames = 0;
-  std::vector<float> concatenated_features;
-  for (int i = 0; i < num_frames_per_packet_; ++i) {
-    auto features_or = feature_extractor_->Extract(audio_for_encoding.subspan(
-        internal_samples_per_hop * i, internal_samples_per_hop));
-    if (!features_or.has_value()) {
-      LOG(ERROR) << "Unable to extract features from audio frame.";
-      return absl::nullopt;
-    }
-    const std::vector<float>& features = features_or.value();
+  // The features of all frames are extracted at once, which lets the
+  // extractor transform them in a batch.
+  const int num_frames = num_packets * num_frames_per_packet_;
+  absl::optional<std::vector<float>> features_or;
+  {
+    LYRA_TRACE_SCOPE("EncodeExtract");
+    const absl::Time extraction_start = absl::Now();
+    features_or = extract_from_floats
+                      ? feature_extractor_->ExtractPacketFromFloats(
+                            filtered_audio_, num_frames)
+                      : feature_extractor_->ExtractPacket(audio_for_encoding,
+                                                          num_frames);
+    metrics_.extraction_nanos +=
+        absl::ToInt64Nanoseconds(absl::Now() - extraction_start);
+  }
+  if (!features_or.has_value()) {
+    LOG(ERROR) << "Unable to extract features from audio frame.";
+    return absl::nullopt;
+  }
 
-    if (enable_dtx_) {
+  // The features of the packets to be quantized, concatenated in order.
+  std::vector<float> concatenated_features = std::move(features_or.value());
+  is_empty_packet->assign(num_packets, false);
+  if (!enable_dtx_) {
+    return concatenated_features;
+  }
+  const int num_features = concatenated_features.size() / num_frames;
+  // The features of the packets that are not empty are moved forward over
+  // those of the empty ones.
+  int num_kept_features = 0;
+  for (int p = 0; p < num_packets; ++p) {
+    // We send an empty packet only if all constituent frames are noise
+    // similar to the previous ones.
+    int num_similar_noise_frames = 0;
+    const auto packet_features = concatenated_features.begin() +
+                                 p * num_frames_per_packet_ * num_features;
+    for (int i = 0; i < num_frames_per_packet_; ++i) {
+      const absl::Time noise_estimation_start = absl::Now();
+      // Packets are only moved over those before them, so the frames of this
+      // one are still in place.
+      const absl::Span<const float> features = absl::MakeConstSpan(
+          &*packet_features + i * num_features, num_features);
       auto is_similar_noise = noise_estimator_->IsSimilarNoise(features);
       if (!is_similar_noise.has_value()) {
         LOG(ERROR) << "Unable to check noise estimation.";
@@ -248,27 +373,61 @@ absl::optional<std::vector<uint8_t>> LyraEncoder::EncodeInternal(
           return absl::nullopt;
         }
       }
+      metrics_.noise_estimation_nanos +=
+          absl::ToInt64Nanoseconds(absl::Now() - noise_estimation_start);
     }
-
-    if (concatenated_features.empty()) {
-      concatenated_features.resize(num_frames_per_packet_ * features.size());
+    if (num_similar_noise_frames == num_frames_per_packet_) {
+      (*is_empty_packet)[p] = true;
+    } else {
+      const int num_packet_features = num_frames_per_packet_ * num_features;
+      std::copy_n(packet_features, num_packet_features,
+                  concatenated_features.begin() + num_kept_features);
+      num_kept_features += num_packet_features;
     }
-    std::copy(features.begin(), features.end(),
-              concatenated_features.begin() + i * features.size());
   }
+  concatenated_features.resize(num_kept_features);
+  return concatenated_features;
+}
 
-  if (num_similar_noise_frames == num_frames_per_packet_) {
-    Packet<0, 0> empty_packet;
-    return empty_packet.PackQuantized(std::bitset<0>{}.to_string());
+absl::optional<std::vector<std::vector<uint8_t>>> LyraEncoder::QuantizeAndPack(
+    const std::vector<float>& concatenated_features,
+    const std::vector<bool>& is_empty_packet, EncoderMetrics* metrics) const {
+  // The features of all packets are quantized together, so that the search
+  // can score several packets at once.
+  const int num_packets = is_empty_packet.size();
+  const int num_packets_to_quantize =
+      std::count(is_empty_packet.begin(), is_empty_packet.end(), false);
+  std::vector<QuantizedBits> quantized;
+  if (num_packets_to_quantize > 0) {
+    LYRA_TRACE_SCOPE("EncodeQuantize");
+    const absl::Time quantization_start = absl::Now();
+    auto quantized_features_or = vector_quantizer_->QuantizeBatch(
+        concatenated_features, num_packets_to_quantize);
+    metrics->quantization_nanos +=
+        absl::ToInt64Nanoseconds(absl::Now() - quantization_start);
+    if (!quantized_features_or.has_value()) {
+      LOG(ERROR) << "Unable to quantize features.";
+      return absl::nullopt;
+    }
+    quantized = std::move(quantized_features_or.value());
   }
 
-  auto quantized_features_or =
-      vector_quantizer_->Quantize(concatenated_features);
-  if (!quantized_features_or.has_value()) {
-    LOG(ERROR) << "Unable to quantize features.";
-    return absl::nullopt;
+  const absl::Time packing_start = absl::Now();
+  std::vector<std::vector<uint8_t>> encoded(num_packets);
+  auto quantized_it = quantized.begin();
+  for (int p = 0; p < num_packets; ++p) {
+    if (is_empty_packet[p]) {
+      Packet<0, 0> empty_packet;
+      encoded[p] = empty_packet.PackQuantized(QuantizedBits());
+    } else {
+      encoded[p] = packet_->PackQuantized(*quantized_it++);
+    }
   }
-  return packet_->PackQuantized(quantized_features_or.value());
+  metrics->packing_nanos +=
+      absl::ToInt64Nanoseconds(absl::Now() - packing_start);
+  metrics->num_packets_quantized += num_packets_to_quantize;
+  metrics->num_dtx_packets += num_packets - num_packets_to_quantize;
+  return encoded;
 }
 
 int LyraEncoder::sample_rate_hz() const { return sample_rate_hz_; }
@@ -278,5 +437,23 @@ int LyraEncoder::num_channels() const { return num_channels_; }
 int LyraEncoder::bitrate() const { return bitrate_; }
 
 int LyraEncoder::frame_rate() const { return kFrameRate; }
+
+EncoderMetrics LyraEncoder::metrics() const {
+  EncoderMetrics metrics = metrics_;
+  metrics.real_time_factor = real_time_factor_.value();
+  return metrics;
+}
+
+void LyraEncoder::Reset() {
+  resampler_->Reset();
+  high_pass_filter_.Reset();
+  fixed_point_high_pass_filter_.Reset();
+  if (denoiser_ != nullptr) {
+    denoiser_->Reset();
+  }
+  feature_extractor_->Reset();
+  noise_estimator_->Reset();
+}
+
 }  // namespace codec
 }  // namespace chromemedia
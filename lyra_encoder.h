@@ -23,11 +23,13 @@
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
-#include "audio/linear_filters/biquad_filter.h"
+#include "biquad_cascade.h"
+#include "codec_metrics.h"
 #include "denoiser_interface.h"
 #include "feature_extractor_interface.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_encoder_interface.h"
+#include "lyra_model.h"
 #include "noise_estimator_interface.h"
 #include "packet_interface.h"
 #include "resampler_interface.h"
@@ -50,20 +52,38 @@ class LyraEncoder : public LyraEncoderInterface {
   ///
   /// @param sample_rate_hz Desired sample rate in Hertz. The supported sample
   ///                       rates are 8000, 16000, 32000 and 48000.
-  /// @param num_channels Desired number of channels. Currently only 1 is
-  ///                     supported.
+  /// @param num_channels Desired number of channels. Only 1 is supported, see
+  ///                     |MultichannelLyraEncoder| for more.
   /// @param bit_rate Desired bit rate. Currently only 3000 is supported.
   /// @param enable_dtx Set to true if discontinuous transmission should be
   ///                   enabled.
   /// @param model_path Path to the model weights. The identifier in the
   ///                   lyra_config.textproto has to coincide with the
-  ///                   kVersionMinor constant in lyra_config.cc.
+  ///                   kVersionMinor constant in lyra_config.cc. Only the
+  ///                   quantizer assets are needed.
   /// @return A unique_ptr to a LyraEncoder if all desired params are supported.
   ///         Else it returns a nullptr.
   static std::unique_ptr<LyraEncoder> Create(
       int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
       const ghc::filesystem::path& model_path);
 
+  /// Static method to create a LyraEncoder that shares its read-only weights
+  /// with every other encoder and decoder created from |model|.
+  ///
+  /// @param sample_rate_hz Desired sample rate in Hertz. The supported sample
+  ///                       rates are 8000, 16000, 32000 and 48000.
+  /// @param num_channels Desired number of channels. Only 1 is supported, see
+  ///                     |MultichannelLyraEncoder| for more.
+  /// @param bit_rate Desired bit rate. Currently only 3000 is supported.
+  /// @param enable_dtx Set to true if discontinuous transmission should be
+  ///                   enabled.
+  /// @param model Weights created by |LyraModel::Create|. Has to be non-null.
+  /// @return A unique_ptr to a LyraEncoder if all desired params are supported.
+  ///         Else it returns a nullptr.
+  static std::unique_ptr<LyraEncoder> Create(
+      int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
+      const std::shared_ptr<LyraModel>& model);
+
   /// Encodes the audio samples into a vector wrapped byte array.
   ///
   /// @param audio Span of int16-formatted samples. It is assumed to contain
@@ -74,6 +94,20 @@ class LyraEncoder : public LyraEncoderInterface {
   absl::optional<std::vector<uint8_t>> Encode(
       const absl::Span<const int16_t> audio) override;
 
+  /// Encodes several consecutive packets of audio at once, which is faster
+  /// than encoding them one by one, for example when transcoding files.
+  /// Features are extracted for all packets back to back and quantized
+  /// together.
+  ///
+  /// @param audio Span of int16-formatted samples. It is assumed to contain a
+  ///              positive multiple of 40ms of data at the sample rate chosen
+  ///              at Create time.
+  /// @return One encoded packet per 40ms of audio, in order, as long as the
+  ///         right amount of data is provided. Else it returns nullopt. If DTX
+  ///         is enabled, packets deemed to contain silence are empty.
+  absl::optional<std::vector<std::vector<uint8_t>>> EncodeBatch(
+      const absl::Span<const int16_t> audio);
+
   /// Getter for the sample rate in Hertz.
   ///
   /// @return Sample rate in Hertz.
@@ -94,8 +128,23 @@ class LyraEncoder : public LyraEncoderInterface {
   /// @return Frame rate.
   int frame_rate() const override;
 
+  /// @return The counters of everything encoded since creation.
+  EncoderMetrics metrics() const override;
+
+  /// Returns the encoder to the state it was created in, so that it can
+  /// encode another stream without loading the quantizer again.
+  ///
+  /// Clears the resampler and high-pass filter histories, the samples the
+  /// feature extractor keeps between hops and the background noise statistics
+  /// of DTX. The metrics are kept.
+  void Reset() override;
+
  private:
   LyraEncoder() = delete;
+
+  static std::unique_ptr<LyraEncoder> Create(
+      int sample_rate_hz, int num_channels, int bitrate, bool enable_dtx,
+      const ghc::filesystem::path& model_path, LyraModel* model);
   LyraEncoder(std::unique_ptr<ResamplerInterface> resampler,
               std::unique_ptr<FeatureExtractorInterface> feature_extractor,
               std::unique_ptr<NoiseEstimatorInterface> noise_estimator,
@@ -105,8 +154,26 @@ class LyraEncoder : public LyraEncoderInterface {
               int num_channels, int bitrate, int num_frames_per_packet,
               bool enable_dtx);
 
-  absl::optional<std::vector<uint8_t>> EncodeInternal(
-      const absl::Span<const int16_t> audio, bool filter_audio);
+  // Encodes |num_packets| consecutive packets of |audio|, which has to hold
+  // exactly that many.
+  absl::optional<std::vector<std::vector<uint8_t>>> EncodeInternal(
+      const absl::Span<const int16_t> audio, int num_packets,
+      bool filter_audio);
+
+  // Extracts the features of the |num_packets| packets of |audio|, which has
+  // to hold exactly that many, and returns them concatenated in order. Packets
+  // DTX found to be background noise are marked in |is_empty_packet| and
+  // have no features.
+  absl::optional<std::vector<float>> ExtractFeatures(
+      const absl::Span<const int16_t> audio, int num_packets,
+      bool filter_audio, std::vector<bool>* is_empty_packet);
+
+  // Quantizes |concatenated_features| in one search and packs them, with an
+  // empty packet wherever |is_empty_packet|. Adds the time spent to
+  // |metrics|.
+  absl::optional<std::vector<std::vector<uint8_t>>> QuantizeAndPack(
+      const std::vector<float>& concatenated_features,
+      const std::vector<bool>& is_empty_packet, EncoderMetrics* metrics) const;
 
   const std::unique_ptr<ResamplerInterface> resampler_;
   const std::unique_ptr<FeatureExtractorInterface> feature_extractor_;
@@ -119,8 +186,22 @@ class LyraEncoder : public LyraEncoderInterface {
   const int bitrate_;
   const int num_frames_per_packet_;
   const bool enable_dtx_;
-  linear_filters::BiquadFilterCascade<float> second_order_sections_filter_;
+  // The resampled samples of the packets being encoded, which the denoiser
+  // works on in place.
+  std::vector<int16_t> processed_audio_;
+  BiquadCascade high_pass_filter_;
+  // The high-pass filtered samples of the packets being encoded.
+  std::vector<float> filtered_audio_;
+  // The same in integer arithmetic, used by the fixed point front end of the
+  // fixed16 build instead.
+  FixedPointBiquadCascade fixed_point_high_pass_filter_;
+  std::vector<int16_t> fixed_point_filtered_audio_;
+  // All counters except the real time factor, which |real_time_factor_|
+  // averages.
+  EncoderMetrics metrics_;
+  RollingRealTimeFactor real_time_factor_;
   friend class LyraEncoderPeer;
+  friend class MultichannelLyraEncoder;
 };
 
 }  // namespace codec
@@ -22,6 +22,7 @@
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
+#include "codec_metrics.h"
 
 namespace chromemedia {
 namespace codec {
@@ -43,6 +44,14 @@ class LyraEncoderInterface {
   virtual int bitrate() const = 0;
 
   virtual int frame_rate() const = 0;
+
+  // Returns the counters of everything encoded since creation.
+  virtual EncoderMetrics metrics() const = 0;
+
+  // Returns the encoder to the state it was created in, as if no audio had
+  // been encoded yet, so that it can encode another stream. Keeps the
+  // weights, buffers and metrics.
+  virtual void Reset() = 0;
 };
 
 }  // namespace codec
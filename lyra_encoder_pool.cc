@@ -0,0 +1,224 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_encoder_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_executor.h"
+#include "codec_metrics.h"
+#include "glog/logging.h"
+#include "lyra_config.h"
+#include "lyra_encoder.h"
+#include "lyra_encoder_interface.h"
+#include "lyra_model.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Forwards to an encoder and measures how long it takes per second of audio.
+class TimedEncoder : public LyraEncoderInterface {
+ public:
+  // Writes the average real time factor to |real_time_factor|.
+  TimedEncoder(std::unique_ptr<LyraEncoderInterface> encoder,
+               std::shared_ptr<std::atomic<double>> real_time_factor)
+      : encoder_(std::move(encoder)),
+        real_time_factor_(std::move(real_time_factor)) {}
+
+  absl::optional<std::vector<uint8_t>> Encode(
+      const absl::Span<const int16_t> audio) override {
+    const absl::Time start = absl::Now();
+    auto encoded = encoder_->Encode(audio);
+    Update(start, audio.size());
+    return encoded;
+  }
+
+  int sample_rate_hz() const override { return encoder_->sample_rate_hz(); }
+
+  int num_channels() const override { return encoder_->num_channels(); }
+
+  int bitrate() const override { return encoder_->bitrate(); }
+
+  int frame_rate() const override { return encoder_->frame_rate(); }
+
+  EncoderMetrics metrics() const override { return encoder_->metrics(); }
+
+  void Reset() override { encoder_->Reset(); }
+
+ private:
+  // Adds the time since |start| to the average, as the cost of
+  // |num_samples|.
+  void Update(absl::Time start, int num_samples) {
+    if (num_samples <= 0) {
+      return;
+    }
+    const double processing_seconds =
+        absl::ToDoubleSeconds(absl::Now() - start);
+    const double audio_seconds =
+        static_cast<double>(num_samples) / encoder_->sample_rate_hz();
+    const double sample_real_time_factor = processing_seconds / audio_seconds;
+    const double previous = real_time_factor_->load();
+    if (previous < 0.0) {
+      real_time_factor_->store(sample_real_time_factor);
+      return;
+    }
+    const double weight =
+        std::min(1.0, audio_seconds / LyraEncoderPool::kSmoothingSeconds);
+    real_time_factor_->store(previous +
+                             weight * (sample_real_time_factor - previous));
+  }
+
+  const std::unique_ptr<LyraEncoderInterface> encoder_;
+  // Shared with the pool, but outlives its entry there while the last audio
+  // of a removed session is encoded.
+  const std::shared_ptr<std::atomic<double>> real_time_factor_;
+};
+
+}  // namespace
+
+std::unique_ptr<LyraEncoderPool> LyraEncoderPool::Create(
+    int sample_rate_hz, bool enable_dtx,
+    const std::shared_ptr<LyraModel>& model, int num_threads) {
+  if (model == nullptr) {
+    LOG(ERROR) << "The encoder pool needs a model.";
+    return nullptr;
+  }
+  return Create(
+      [sample_rate_hz, enable_dtx,
+       model]() -> std::unique_ptr<LyraEncoderInterface> {
+        return LyraEncoder::Create(sample_rate_hz, kNumChannels, kBitrate,
+                                   enable_dtx, model);
+      },
+      num_threads);
+}
+
+std::unique_ptr<LyraEncoderPool> LyraEncoderPool::Create(
+    EncoderFactory encoder_factory, int num_threads) {
+  if (!encoder_factory) {
+    LOG(ERROR) << "The encoder pool needs an encoder factory.";
+    return nullptr;
+  }
+  auto executor = CodecExecutor::Create(num_threads, /*pin_threads=*/true);
+  if (executor == nullptr) {
+    return nullptr;
+  }
+  return absl::WrapUnique(
+      new LyraEncoderPool(std::move(encoder_factory), std::move(executor)));
+}
+
+LyraEncoderPool::LyraEncoderPool(EncoderFactory encoder_factory,
+                                 std::unique_ptr<CodecExecutor> executor)
+    : encoder_factory_(std::move(encoder_factory)),
+      executor_(std::move(executor)) {}
+
+absl::optional<LyraEncoderPool::SessionId> LyraEncoderPool::AddSession() {
+  absl::MutexLock lock(&mutex_);
+  if (!CanAdmitSessionLocked()) {
+    LOG(ERROR) << "The encoder pool is at capacity with "
+               << real_time_factors_.size() << " sessions.";
+    return absl::nullopt;
+  }
+  std::unique_ptr<LyraEncoderInterface> encoder = encoder_factory_();
+  if (encoder == nullptr) {
+    LOG(ERROR) << "Could not create an encoder for a new session.";
+    return absl::nullopt;
+  }
+  auto real_time_factor = std::make_shared<std::atomic<double>>(-1.0);
+  const absl::optional<SessionId> session = executor_->AddEncoderSession(
+      absl::make_unique<TimedEncoder>(std::move(encoder), real_time_factor));
+  if (session.has_value()) {
+    real_time_factors_.emplace(*session, std::move(real_time_factor));
+  }
+  return session;
+}
+
+bool LyraEncoderPool::RemoveSession(SessionId session) {
+  absl::MutexLock lock(&mutex_);
+  real_time_factors_.erase(session);
+  return executor_->RemoveSession(session);
+}
+
+std::future<absl::optional<std::vector<uint8_t>>> LyraEncoderPool::SubmitAudio(
+    SessionId session, std::vector<int16_t> audio) {
+  return executor_->SubmitAudio(session, std::move(audio));
+}
+
+bool LyraEncoderPool::CanAdmitSession() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return CanAdmitSessionLocked();
+}
+
+int LyraEncoderPool::MeasuredLoadLocked(double* measured_load) const {
+  *measured_load = 0.0;
+  int num_measured = 0;
+  for (const auto& [session, session_real_time_factor] : real_time_factors_) {
+    const double real_time_factor = session_real_time_factor->load();
+    if (real_time_factor >= 0.0) {
+      *measured_load += real_time_factor;
+      ++num_measured;
+    }
+  }
+  return num_measured;
+}
+
+bool LyraEncoderPool::CanAdmitSessionLocked() const {
+  double measured_load;
+  const int num_measured = MeasuredLoadLocked(&measured_load);
+  if (num_measured == 0) {
+    return true;
+  }
+  const int num_unmeasured =
+      static_cast<int>(real_time_factors_.size()) - num_measured;
+  const double expected_load =
+      measured_load + measured_load / num_measured * (num_unmeasured + 1);
+  return expected_load <= kMaxUtilization * executor_->num_threads();
+}
+
+double LyraEncoderPool::load() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  double measured_load;
+  MeasuredLoadLocked(&measured_load);
+  return measured_load;
+}
+
+double LyraEncoderPool::sessions_per_thread() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  double measured_load;
+  const int num_measured = MeasuredLoadLocked(&measured_load);
+  if (num_measured == 0 || measured_load <= 0.0) {
+    return 0.0;
+  }
+  return kMaxUtilization * num_measured / measured_load;
+}
+
+int LyraEncoderPool::num_sessions() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return static_cast<int>(real_time_factors_.size());
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_ENCODER_POOL_H_
+#define LYRA_CODEC_LYRA_ENCODER_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "codec_executor.h"
+#include "lyra_encoder_interface.h"
+#include "lyra_model.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Encodes many sessions, e.g. the ingested streams of a server, on a fixed set
+// of pinned worker threads, like |LyraDecoderPool| decodes them. All encoders
+// share one copy of the quantizer, its codebooks and transformation matrices,
+// through a |LyraModel|, so a session only holds its own resampler, filters,
+// feature extractor window and noise estimate.
+//
+// The pool measures the real time factor of every session and only admits a
+// new session while the summed load of all sessions, plus what the new one is
+// expected to take, fits into |kMaxUtilization| of the worker threads.
+//
+// All methods are thread-safe.
+class LyraEncoderPool {
+ public:
+  using SessionId = CodecExecutor::SessionId;
+  using EncoderFactory =
+      std::function<std::unique_ptr<LyraEncoderInterface>()>;
+
+  // Fraction of the worker threads that admitted sessions may load.
+  static constexpr double kMaxUtilization = 0.8;
+  // Audio time over which the real time factor of a session is averaged.
+  static constexpr double kSmoothingSeconds = 1.0;
+
+  // Creates encoders at |sample_rate_hz| from |model| on |num_threads|
+  // workers. Returns a nullptr if |model| is null or |num_threads| is not
+  // positive.
+  static std::unique_ptr<LyraEncoderPool> Create(
+      int sample_rate_hz, bool enable_dtx,
+      const std::shared_ptr<LyraModel>& model, int num_threads);
+
+  // Same as above, but creates the encoder of every session with
+  // |encoder_factory|. Returns a nullptr if |encoder_factory| is empty or
+  // |num_threads| is not positive.
+  static std::unique_ptr<LyraEncoderPool> Create(EncoderFactory encoder_factory,
+                                                 int num_threads);
+
+  // Adds a session. Returns a nullopt if the pool has no capacity left or the
+  // encoder could not be created.
+  absl::optional<SessionId> AddSession();
+
+  // Removes |session| once its submitted audio is encoded. Returns false if
+  // there is no such session.
+  bool RemoveSession(SessionId session);
+
+  // See |CodecExecutor::SubmitAudio|.
+  std::future<absl::optional<std::vector<uint8_t>>> SubmitAudio(
+      SessionId session, std::vector<int16_t> audio);
+
+  // Whether |AddSession| would admit another session. Sessions that did not
+  // encode yet are expected to load a thread as much as the average measured
+  // session. Until any session was measured every session is admitted.
+  bool CanAdmitSession() const;
+
+  // The summed real time factor of the measured sessions, in threads.
+  double load() const;
+
+  // The number of sessions of the average measured load that one worker
+  // thread runs at |kMaxUtilization|, or 0 until any session was measured.
+  double sessions_per_thread() const;
+
+  int num_sessions() const;
+
+  int num_threads() const { return executor_->num_threads(); }
+
+ private:
+  LyraEncoderPool(EncoderFactory encoder_factory,
+                  std::unique_ptr<CodecExecutor> executor);
+
+  bool CanAdmitSessionLocked() const ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // Sums the measured real time factors into |measured_load| and returns how
+  // many sessions were measured.
+  int MeasuredLoadLocked(double* measured_load) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  const EncoderFactory encoder_factory_;
+  const std::unique_ptr<CodecExecutor> executor_;
+
+  mutable absl::Mutex mutex_;
+  // The real time factor of every session, written by the worker encoding
+  // it. Negative until the session encoded.
+  std::map<SessionId, std::shared_ptr<std::atomic<double>>> real_time_factors_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_ENCODER_POOL_H_
@@ -0,0 +1,131 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_encoder_pool.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "lyra_encoder_interface.h"
+#include "testing/mock_lyra_encoder.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Optional;
+using testing::Return;
+
+constexpr int kSampleRateHz = 16000;
+constexpr int kFrameRate = 25;
+constexpr int kNumSamplesPerPacket = kSampleRateHz / kFrameRate;
+constexpr absl::Duration kPacketDuration =
+    absl::Milliseconds(1000 / kFrameRate);
+
+// Returns a factory of encoders that take |encode_time| per packet.
+LyraEncoderPool::EncoderFactory SlowEncoderFactory(absl::Duration encode_time) {
+  return [encode_time]() -> std::unique_ptr<LyraEncoderInterface> {
+    auto encoder = absl::make_unique<NiceMock<MockLyraEncoder>>();
+    ON_CALL(*encoder, sample_rate_hz()).WillByDefault(Return(kSampleRateHz));
+    ON_CALL(*encoder, frame_rate()).WillByDefault(Return(kFrameRate));
+    ON_CALL(*encoder, Encode(_))
+        .WillByDefault(Invoke([encode_time](absl::Span<const int16_t> audio) {
+          absl::SleepFor(encode_time);
+          return absl::optional<std::vector<uint8_t>>(
+              std::vector<uint8_t>(1, audio.size() / kNumSamplesPerPacket));
+        }));
+    return encoder;
+  };
+}
+
+TEST(LyraEncoderPoolTest, CreateFailsWithInvalidArguments) {
+  EXPECT_EQ(LyraEncoderPool::Create(kSampleRateHz, false, nullptr, 1),
+            nullptr);
+  EXPECT_EQ(LyraEncoderPool::Create(nullptr, 1), nullptr);
+  EXPECT_EQ(LyraEncoderPool::Create(SlowEncoderFactory(absl::ZeroDuration()),
+                                    0),
+            nullptr);
+}
+
+TEST(LyraEncoderPoolTest, AddSessionFailsWithoutEncoder) {
+  auto pool = LyraEncoderPool::Create(
+      []() -> std::unique_ptr<LyraEncoderInterface> { return nullptr; }, 1);
+  ASSERT_NE(pool, nullptr);
+  EXPECT_FALSE(pool->AddSession().has_value());
+  EXPECT_EQ(pool->num_sessions(), 0);
+}
+
+TEST(LyraEncoderPoolTest, EncodesSubmittedAudio) {
+  auto pool =
+      LyraEncoderPool::Create(SlowEncoderFactory(absl::ZeroDuration()), 2);
+  ASSERT_NE(pool, nullptr);
+  EXPECT_EQ(pool->num_threads(), 2);
+  const auto session = pool->AddSession();
+  ASSERT_TRUE(session.has_value());
+  EXPECT_EQ(pool->num_sessions(), 1);
+
+  EXPECT_THAT(pool->SubmitAudio(*session, std::vector<int16_t>(
+                                              kNumSamplesPerPacket, 1))
+                  .get(),
+              Optional(std::vector<uint8_t>(1, 1)));
+  EXPECT_TRUE(pool->RemoveSession(*session));
+  EXPECT_EQ(pool->num_sessions(), 0);
+  EXPECT_EQ(
+      pool->SubmitAudio(*session, std::vector<int16_t>(kNumSamplesPerPacket))
+          .get(),
+      absl::nullopt);
+}
+
+TEST(LyraEncoderPoolTest, AdmitsSessionsUntilMeasuredLoadExceedsCapacity) {
+  // Every session takes at least half a thread.
+  auto pool = LyraEncoderPool::Create(SlowEncoderFactory(kPacketDuration / 2),
+                                      /*num_threads=*/1);
+  ASSERT_NE(pool, nullptr);
+  const auto session = pool->AddSession();
+  ASSERT_TRUE(session.has_value());
+  // Nothing was measured yet.
+  EXPECT_TRUE(pool->CanAdmitSession());
+  EXPECT_EQ(pool->load(), 0.0);
+  EXPECT_EQ(pool->sessions_per_thread(), 0.0);
+
+  ASSERT_TRUE(
+      pool->SubmitAudio(*session, std::vector<int16_t>(kNumSamplesPerPacket))
+          .get()
+          .has_value());
+  EXPECT_GE(pool->load(), 0.5);
+  EXPECT_GT(pool->sessions_per_thread(), 0.0);
+  EXPECT_LE(pool->sessions_per_thread(), 1.6);
+  // A second session would take the thread beyond |kMaxUtilization|.
+  EXPECT_FALSE(pool->CanAdmitSession());
+  EXPECT_FALSE(pool->AddSession().has_value());
+
+  EXPECT_TRUE(pool->RemoveSession(*session));
+  EXPECT_TRUE(pool->CanAdmitSession());
+  EXPECT_TRUE(pool->AddSession().has_value());
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
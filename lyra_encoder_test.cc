@@ -28,10 +28,12 @@
 
 // placeholder for get runfiles header.
 #include "absl/memory/memory.h"   // IWYU pragma: keep
+#include "absl/status/status.h"
 #include "absl/types/optional.h"  // IWYU pragma: keep
 #include "absl/types/span.h"
 #include "denoiser_interface.h"
 #include "feature_extractor_interface.h"
+#include "feature_frame.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
@@ -39,12 +41,14 @@
 #include "noise_estimator_interface.h"
 #include "packet.h"
 #include "packet_interface.h"
+#include "quantized_bits.h"
 #include "resampler_interface.h"
 #include "testing/mock_denoiser.h"
 #include "testing/mock_feature_extractor.h"
 #include "testing/mock_noise_estimator.h"
 #include "testing/mock_resampler.h"
 #include "testing/mock_vector_quantizer.h"
+#include "testing/quantized_bits_string.h"
 #include "vector_quantizer_interface.h"
 
 namespace chromemedia {
@@ -76,15 +80,33 @@ class LyraEncoderPeer {
 
   absl::optional<std::vector<uint8_t>> Encode(
       const absl::Span<const int16_t> audio) {
-    return encoder_.EncodeInternal(audio, false);
+    return EncodeOne(audio, false);
   }
 
   absl::optional<std::vector<uint8_t>> EncodeWithFiltering(
       const absl::Span<const int16_t> audio) {
-    return encoder_.EncodeInternal(audio, true);
+    return EncodeOne(audio, true);
   }
 
+  absl::optional<std::vector<std::vector<uint8_t>>> EncodeBatch(
+      const absl::Span<const int16_t> audio, int num_packets) {
+    return encoder_.EncodeInternal(audio, num_packets, false);
+  }
+
+  EncoderMetrics metrics() const { return encoder_.metrics(); }
+
+  void Reset() { encoder_.Reset(); }
+
  private:
+  absl::optional<std::vector<uint8_t>> EncodeOne(
+      const absl::Span<const int16_t> audio, bool filter_audio) {
+    auto encoded_or = encoder_.EncodeInternal(audio, 1, filter_audio);
+    if (!encoded_or.has_value()) {
+      return absl::nullopt;
+    }
+    return encoded_or->front();
+  }
+
   LyraEncoder encoder_;
 };
 
@@ -92,8 +114,11 @@ namespace {
 
 using testing::_;
 using testing::Combine;
+using testing::ElementsAreArray;
+using testing::Invoke;
 using testing::IsSupersetOf;
 using testing::Return;
+using testing::SizeIs;
 using testing::Values;
 using testing::ValuesIn;
 
@@ -134,11 +159,11 @@ class LyraEncoderTest
     // Mock quantized contains all 1s at every bit position.
     std::bitset<kNumQuantizedBits> mock_quantized_bits(0);
     mock_quantized_bits.flip();
-    mock_quantized_ = mock_quantized_bits.to_string();
+    mock_quantized_ = QuantizedBitsFromString(mock_quantized_bits.to_string());
   }
 
   bool DoesPacketContainQuantized(const std::vector<uint8_t>& packet,
-                                  const std::string& quantized_string) {
+                                  const QuantizedBits& quantized) {
     if (packet.size() < kPacketSize) {
       return false;
     }
@@ -151,7 +176,7 @@ class LyraEncoderTest
     // Remove extra bits at the end of packet_data if the number of bits stored
     // in the packet is not evenly divisible by CHAR_BITS.
     packet_data = packet_data.substr(0, kNumQuantizedBits);
-    return packet_data == quantized_string;
+    return packet_data == QuantizedBitsToString(quantized);
   }
 
   void SetResamplerExpectation(int times_if_resampling) {
@@ -177,9 +202,9 @@ class LyraEncoderTest
   std::unique_ptr<MockVectorQuantizer> mock_vector_quantizer_;
   std::unique_ptr<MockResampler> mock_resampler_;
   std::unique_ptr<MockDenoiser> mock_denoiser_;
-  absl::optional<std::vector<float>> mock_features_;
+  absl::optional<FeatureFrame> mock_features_;
   std::vector<float> mock_concatenated_features_;
-  std::string mock_quantized_;
+  QuantizedBits mock_quantized_;
 };
 
 TEST_P(LyraEncoderTest, InvalidSizedAudioFails) {
@@ -227,9 +252,14 @@ TEST_P(LyraEncoderTest, FeatureExtractionFails) {
 
 TEST_P(LyraEncoderTest, SimilarNoiseEvaluationFails) {
   SetResamplerExpectation(1);
-  EXPECT_CALL(*mock_feature_extractor_, Extract(internal_samples_span_.subspan(
-                                            0, internal_num_samples_per_hop_)))
-      .WillOnce(Return(mock_features_));
+  // The features of all frames are extracted before any is checked.
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    EXPECT_CALL(
+        *mock_feature_extractor_,
+        Extract(internal_samples_span_.subspan(
+            i * internal_num_samples_per_hop_, internal_num_samples_per_hop_)))
+        .WillOnce(Return(mock_features_));
+  }
   EXPECT_CALL(*mock_noise_estimator_, IsSimilarNoise(_))
       .WillOnce(Return(absl::nullopt));
   EXPECT_CALL(*mock_noise_estimator_, Update(_)).Times(0);
@@ -247,12 +277,18 @@ TEST_P(LyraEncoderTest, SimilarNoiseEvaluationFails) {
 
 TEST_P(LyraEncoderTest, NoiseEstimationUpdateFails) {
   SetResamplerExpectation(1);
-  EXPECT_CALL(*mock_feature_extractor_, Extract(internal_samples_span_.subspan(
-                                            0, internal_num_samples_per_hop_)))
-      .WillOnce(Return(mock_features_));
+  // The features of all frames are extracted before any is checked.
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    EXPECT_CALL(
+        *mock_feature_extractor_,
+        Extract(internal_samples_span_.subspan(
+            i * internal_num_samples_per_hop_, internal_num_samples_per_hop_)))
+        .WillOnce(Return(mock_features_));
+  }
   EXPECT_CALL(*mock_noise_estimator_, IsSimilarNoise(_))
       .WillOnce(Return(false));
-  EXPECT_CALL(*mock_noise_estimator_, Update(mock_features_.value()))
+  EXPECT_CALL(*mock_noise_estimator_,
+              Update(ElementsAreArray(mock_features_.value())))
       .WillOnce(Return(false));
   EXPECT_CALL(*mock_vector_quantizer_, Quantize(_)).Times(0);
 
@@ -294,7 +330,7 @@ TEST_P(LyraEncoderTest, NoiseEstimationUpdateSucceeds) {
   EXPECT_TRUE(encoded_or.has_value());
 
   Packet<0, 0> empty_packet;
-  const auto packed = empty_packet.PackQuantized(std::bitset<0>{}.to_string());
+  const auto packed = empty_packet.PackQuantized(QuantizedBits());
   EXPECT_NE(packed, encoded_or.value());
 }
 
@@ -323,8 +359,13 @@ TEST_P(LyraEncoderTest, NoiseDetectionReturnsEmptyPacket) {
   EXPECT_TRUE(encoded_or.has_value());
 
   Packet<0, 0> empty_packet;
-  const auto packed = empty_packet.PackQuantized(std::bitset<0>{}.to_string());
+  const auto packed = empty_packet.PackQuantized(QuantizedBits());
   EXPECT_EQ(packed, encoded_or.value());
+
+  const EncoderMetrics metrics = encoder_peer.metrics();
+  EXPECT_EQ(metrics.num_packets_encoded, 1);
+  EXPECT_EQ(metrics.num_dtx_packets, 1);
+  EXPECT_EQ(metrics.num_packets_quantized, 0);
 }
 
 TEST_P(LyraEncoderTest, QuantizationFails) {
@@ -378,6 +419,45 @@ TEST_P(LyraEncoderTest, EncodeWithFilteringModifiesSignal) {
   EXPECT_TRUE(DoesPacketContainQuantized(encoded_or.value(), mock_quantized_));
 }
 
+TEST_P(LyraEncoderTest, ResetRestartsTheStream) {
+  // The high-pass filter turns the step into the DC of 5 into a transient,
+  // which only the first packet of a stream sees.
+  std::fill(samples_.begin(), samples_.end(), 5);
+  std::fill(internal_samples_.begin(), internal_samples_.end(), 5);
+  SetResamplerExpectation(3);
+  EXPECT_CALL(*mock_resampler_, Reset()).Times(1);
+  std::vector<std::vector<int16_t>> extracted_hops;
+  EXPECT_CALL(*mock_feature_extractor_, Extract(_))
+      .Times(3 * num_frames_per_packet_)
+      .WillRepeatedly([this, &extracted_hops](absl::Span<const int16_t> hop) {
+        extracted_hops.emplace_back(hop.begin(), hop.end());
+        return mock_features_;
+      });
+  EXPECT_CALL(*mock_feature_extractor_, Reset()).Times(1);
+  EXPECT_CALL(*mock_noise_estimator_, Reset()).Times(1);
+  EXPECT_CALL(*mock_vector_quantizer_, Quantize(mock_concatenated_features_))
+      .Times(3)
+      .WillRepeatedly(Return(mock_quantized_));
+
+  LyraEncoderPeer encoder_peer(
+      std::move(mock_resampler_), std::move(mock_feature_extractor_),
+      std::move(mock_noise_estimator_), std::move(mock_vector_quantizer_),
+      nullptr, sample_rate_hz_, num_frames_per_packet_,
+      /*enable_dtx=*/false);
+  ASSERT_TRUE(encoder_peer.EncodeWithFiltering(samples_span_).has_value());
+  ASSERT_TRUE(encoder_peer.EncodeWithFiltering(samples_span_).has_value());
+  encoder_peer.Reset();
+  ASSERT_TRUE(encoder_peer.EncodeWithFiltering(samples_span_).has_value());
+
+  ASSERT_EQ(extracted_hops.size(), 3 * num_frames_per_packet_);
+  const auto first_hop = extracted_hops.begin();
+  const auto second_packet = first_hop + num_frames_per_packet_;
+  const auto third_packet = second_packet + num_frames_per_packet_;
+  EXPECT_NE(*second_packet, *first_hop);
+  EXPECT_TRUE(std::equal(first_hop, second_packet, third_packet));
+  EXPECT_EQ(encoder_peer.metrics().num_packets_encoded, 3);
+}
+
 TEST_P(LyraEncoderTest, EncodeWithDenoiser) {
   std::fill(samples_.begin(), samples_.end(), 5);
   std::fill(internal_samples_.begin(), internal_samples_.end(), 5);
@@ -393,13 +473,15 @@ TEST_P(LyraEncoderTest, EncodeWithDenoiser) {
       .WillOnce(Return(mock_quantized_));
 
   const int denoiser_num_samples_per_hop = internal_num_samples_per_hop_ / 4;
-  std::vector<int16_t> denoised_frame(denoiser_num_samples_per_hop, 5);
 
   EXPECT_CALL(*mock_denoiser_, SamplesPerHop())
       .WillRepeatedly(Return(denoiser_num_samples_per_hop));
-  EXPECT_CALL(*mock_denoiser_, Denoise(_))
+  EXPECT_CALL(*mock_denoiser_, Denoise(SizeIs(denoiser_num_samples_per_hop)))
       .Times(4 * num_frames_per_packet_)
-      .WillRepeatedly(Return(denoised_frame));
+      .WillRepeatedly(Invoke([](absl::Span<int16_t> frame) {
+        std::fill(frame.begin(), frame.end(), 5);
+        return absl::OkStatus();
+      }));
 
   LyraEncoderPeer encoder_peer(
       std::move(mock_resampler_), std::move(mock_feature_extractor_),
@@ -443,6 +525,68 @@ TEST_P(LyraEncoderTest, MultipleEncodeCalls) {
     EXPECT_TRUE(
         DoesPacketContainQuantized(encoded_or.value(), mock_quantized_));
   }
+
+  const EncoderMetrics metrics = encoder_peer.metrics();
+  EXPECT_EQ(metrics.num_packets_encoded, kNumEncodeCalls);
+  EXPECT_EQ(metrics.num_packets_quantized, kNumEncodeCalls);
+  EXPECT_EQ(metrics.num_frames_extracted,
+            kNumEncodeCalls * num_frames_per_packet_);
+  EXPECT_EQ(metrics.num_dtx_packets, 0);
+  EXPECT_GE(metrics.real_time_factor, 0.0);
+}
+
+TEST_P(LyraEncoderTest, EncodeBatchEncodesEveryPacket) {
+  constexpr int kNumPackets = 3;
+  std::vector<int16_t> samples;
+  std::vector<int16_t> internal_samples;
+  for (int p = 0; p < kNumPackets; ++p) {
+    samples.insert(samples.end(), samples_.begin(), samples_.end());
+    internal_samples.insert(internal_samples.end(), internal_samples_.begin(),
+                            internal_samples_.end());
+  }
+  if (internal_sample_rate_hz_ == sample_rate_hz_) {
+    EXPECT_CALL(*mock_resampler_, Resample(_)).Times(0);
+  } else {
+    EXPECT_CALL(*mock_resampler_, Resample(absl::MakeConstSpan(samples)))
+        .WillOnce(Return(internal_samples));
+  }
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    EXPECT_CALL(
+        *mock_feature_extractor_,
+        Extract(internal_samples_span_.subspan(
+            i * internal_num_samples_per_hop_, internal_num_samples_per_hop_)))
+        .Times(kNumPackets)
+        .WillRepeatedly(Return(mock_features_));
+  }
+  // Only the frames of the second packet are similar noise.
+  auto& is_similar_noise =
+      EXPECT_CALL(*mock_noise_estimator_, IsSimilarNoise(_));
+  for (int p = 0; p < kNumPackets; ++p) {
+    for (int i = 0; i < num_frames_per_packet_; ++i) {
+      is_similar_noise.WillOnce(Return(p == 1));
+    }
+  }
+  EXPECT_CALL(*mock_noise_estimator_, Update(_))
+      .Times((kNumPackets - 1) * num_frames_per_packet_)
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_vector_quantizer_, Quantize(mock_concatenated_features_))
+      .Times(kNumPackets - 1)
+      .WillRepeatedly(Return(mock_quantized_));
+
+  LyraEncoderPeer encoder_peer(
+      std::move(mock_resampler_), std::move(mock_feature_extractor_),
+      std::move(mock_noise_estimator_), std::move(mock_vector_quantizer_),
+      nullptr, sample_rate_hz_, num_frames_per_packet_,
+      /*enable_dtx=*/true);
+  auto encoded_or =
+      encoder_peer.EncodeBatch(absl::MakeConstSpan(samples), kNumPackets);
+
+  ASSERT_TRUE(encoded_or.has_value());
+  ASSERT_EQ(encoded_or->size(), kNumPackets);
+  EXPECT_TRUE(DoesPacketContainQuantized(encoded_or->at(0), mock_quantized_));
+  Packet<0, 0> empty_packet;
+  EXPECT_EQ(encoded_or->at(1), empty_packet.PackQuantized(QuantizedBits()));
+  EXPECT_TRUE(DoesPacketContainQuantized(encoded_or->at(2), mock_quantized_));
 }
 
 TEST_P(LyraEncoderTest, GoodCreationParametersReturnNotNullptr) {
@@ -0,0 +1,132 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lyra_feature_decoder.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_components.h"
+#include "lyra_config.h"
+#include "lyra_model.h"
+#include "packet_interface.h"
+#include "quantized_bits.h"
+#include "vector_quantizer_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<LyraFeatureDecoder> LyraFeatureDecoder::Create(
+    const ghc::filesystem::path& model_path) {
+  return Create(model_path, /*model=*/nullptr);
+}
+
+std::unique_ptr<LyraFeatureDecoder> LyraFeatureDecoder::Create(
+    const std::shared_ptr<LyraModel>& model) {
+  if (model == nullptr) {
+    LOG(ERROR) << "A LyraModel is required to share weights.";
+    return nullptr;
+  }
+  return Create(model->model_path(), model.get());
+}
+
+std::unique_ptr<LyraFeatureDecoder> LyraFeatureDecoder::Create(
+    const ghc::filesystem::path& model_path, LyraModel* model) {
+  // The features only need the quantizer tables, like the encoder.
+  const absl::Status are_params_supported =
+      AreParamsSupported(kInternalSampleRateHz, kNumChannels, kBitrate,
+                         model_path, ModelRole::kEncoder);
+  if (!are_params_supported.ok()) {
+    LOG(ERROR) << are_params_supported;
+    return nullptr;
+  }
+  auto vector_quantizer =
+      CreateQuantizer(kNumFramesPerPacket * kNumExpectedOutputFeatures,
+                      kNumQuantizationBits, model_path, model);
+  if (vector_quantizer == nullptr) {
+    LOG(ERROR) << "Could not create Vector Quantizer.";
+    return nullptr;
+  }
+  return absl::WrapUnique(new LyraFeatureDecoder(
+      std::move(vector_quantizer), CreatePacket(), kNumExpectedOutputFeatures,
+      kNumFramesPerPacket));
+}
+
+LyraFeatureDecoder::LyraFeatureDecoder(
+    std::unique_ptr<VectorQuantizerInterface> vector_quantizer,
+    std::unique_ptr<PacketInterface> packet, int num_features,
+    int num_frames_per_packet)
+    : vector_quantizer_(std::move(vector_quantizer)),
+      packet_(std::move(packet)),
+      num_features_(num_features),
+      num_frames_per_packet_(num_frames_per_packet) {}
+
+absl::optional<std::vector<std::vector<float>>>
+LyraFeatureDecoder::DecodeFeatures(absl::Span<const uint8_t> encoded) const {
+  if (encoded.size() != packet_->PacketSize()) {
+    LOG(ERROR) << "The number of bytes has to equal to "
+               << packet_->PacketSize() << ", but is " << encoded.size()
+               << ".";
+    return absl::nullopt;
+  }
+  const auto unpacked_or = packet_->UnpackPacket(encoded);
+  if (!unpacked_or.has_value()) {
+    LOG(ERROR) << "Couldn't read Lyra packet for decoding.";
+    return absl::nullopt;
+  }
+  const std::vector<float> concatenated_features =
+      vector_quantizer_->DecodeToLossyFeatures(unpacked_or.value());
+  std::vector<std::vector<float>> frames(num_frames_per_packet_);
+  for (int i = 0; i < num_frames_per_packet_; ++i) {
+    frames[i].assign(concatenated_features.begin() + num_features_ * i,
+                     concatenated_features.begin() + num_features_ * (i + 1));
+  }
+  return frames;
+}
+
+int LyraFeatureDecoder::DecodeFeaturesBatch(
+    absl::Span<const absl::Span<const uint8_t>> packets,
+    absl::Span<PacketInterface::UnpackStatus> statuses,
+    std::vector<float>* features) const {
+  CHECK_EQ(statuses.size(), packets.size());
+  std::vector<QuantizedBits> quantized(packets.size(),
+                                       QuantizedBits(kNumQuantizationBits));
+  const int num_unpacked =
+      packet_->UnpackPackets(packets, absl::MakeSpan(quantized), statuses);
+  features->reserve(features->size() + static_cast<size_t>(num_unpacked) *
+                                           num_frames_per_packet_ *
+                                           num_features_);
+  for (int i = 0; i < packets.size(); ++i) {
+    if (statuses[i] != PacketInterface::UnpackStatus::kUnpacked) {
+      continue;
+    }
+    const std::vector<float> concatenated_features =
+        vector_quantizer_->DecodeToLossyFeatures(quantized[i]);
+    features->insert(features->end(), concatenated_features.begin(),
+                     concatenated_features.end());
+  }
+  return num_unpacked;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
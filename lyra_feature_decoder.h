@@ -0,0 +1,90 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_FEATURE_DECODER_H_
+#define LYRA_CODEC_LYRA_FEATURE_DECODER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_model.h"
+#include "packet_interface.h"
+#include "vector_quantizer_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Decodes Lyra packets into the log mel features they quantize, without
+// synthesizing audio. Analytics such as transcription can run on these
+// directly instead of on features extracted again from the decoded audio,
+// which costs the generative model and a feature extractor per packet.
+//
+// Only the quantizer tables are loaded, the same ones an encoder needs.
+class LyraFeatureDecoder {
+ public:
+  // Returns a nullptr if |model_path| does not hold the quantizer tables or
+  // does not match the identifier of the code.
+  static std::unique_ptr<LyraFeatureDecoder> Create(
+      const ghc::filesystem::path& model_path);
+
+  // Same as above, but shares the quantizer tables with every other encoder
+  // and decoder created from |model|. Returns a nullptr if |model| is null.
+  static std::unique_ptr<LyraFeatureDecoder> Create(
+      const std::shared_ptr<LyraModel>& model);
+
+  // Returns the features of every frame of |encoded|, |num_features| each,
+  // or a nullopt if it is not a valid packet. The empty packets sent by DTX
+  // for noise hold no features, so they fail too.
+  absl::optional<std::vector<std::vector<float>>> DecodeFeatures(
+      absl::Span<const uint8_t> encoded) const;
+
+  // Decodes every packet of |packets|, e.g. of an archive, and sets the same
+  // entry of |statuses|, which has to be as long as |packets|. The features of
+  // the unpacked packets are appended to |features| in order, frame after
+  // frame, and no features are appended for the others. Returns the number of
+  // unpacked packets.
+  int DecodeFeaturesBatch(absl::Span<const absl::Span<const uint8_t>> packets,
+                          absl::Span<PacketInterface::UnpackStatus> statuses,
+                          std::vector<float>* features) const;
+
+  int num_features() const { return num_features_; }
+
+  int num_frames_per_packet() const { return num_frames_per_packet_; }
+
+ private:
+  LyraFeatureDecoder(std::unique_ptr<VectorQuantizerInterface> vector_quantizer,
+                     std::unique_ptr<PacketInterface> packet,
+                     int num_features, int num_frames_per_packet);
+
+  static std::unique_ptr<LyraFeatureDecoder> Create(
+      const ghc::filesystem::path& model_path, LyraModel* model);
+
+  const std::unique_ptr<VectorQuantizerInterface> vector_quantizer_;
+  const std::unique_ptr<PacketInterface> packet_;
+  const int num_features_;
+  const int num_frames_per_packet_;
+
+  friend class LyraFeatureDecoderPeer;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_FEATURE_DECODER_H_
@@ -0,0 +1,148 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lyra_feature_decoder.h"
+
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// placeholder for get runfiles header.
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "packet.h"
+#include "packet_interface.h"
+#include "quantized_bits.h"
+#include "testing/mock_vector_quantizer.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Gives access to the private constructor to inject a MockVectorQuantizer.
+class LyraFeatureDecoderPeer {
+ public:
+  static std::unique_ptr<LyraFeatureDecoder> Create(
+      std::unique_ptr<MockVectorQuantizer> vector_quantizer, int num_features,
+      int num_frames_per_packet) {
+    return absl::WrapUnique(new LyraFeatureDecoder(
+        std::move(vector_quantizer),
+        absl::make_unique<Packet<kNumQuantizationBits, 0>>(), num_features,
+        num_frames_per_packet));
+  }
+};
+
+namespace {
+
+using testing::_;
+using testing::ElementsAre;
+using testing::Return;
+
+constexpr int kTestNumFeatures = 3;
+constexpr int kTestNumFramesPerPacket = 2;
+using PacketStatus = PacketInterface::UnpackStatus;
+
+// Returns features counting up from |first|.
+std::vector<float> CountingFeatures(float first) {
+  std::vector<float> features(kTestNumFeatures * kTestNumFramesPerPacket);
+  std::iota(features.begin(), features.end(), first);
+  return features;
+}
+
+TEST(LyraFeatureDecoderTest, DecodeFeaturesSplitsFrames) {
+  auto vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*vector_quantizer, DecodeToLossyFeatures(_))
+      .WillOnce(Return(CountingFeatures(0.0f)));
+  auto decoder = LyraFeatureDecoderPeer::Create(
+      std::move(vector_quantizer), kTestNumFeatures, kTestNumFramesPerPacket);
+  Packet<kNumQuantizationBits, 0> packet;
+  const std::vector<uint8_t> encoded =
+      packet.PackQuantized(QuantizedBits(kNumQuantizationBits));
+
+  const auto frames_or = decoder->DecodeFeatures(encoded);
+  ASSERT_TRUE(frames_or.has_value());
+  EXPECT_THAT(frames_or.value(),
+              ElementsAre(ElementsAre(0.0f, 1.0f, 2.0f),
+                          ElementsAre(3.0f, 4.0f, 5.0f)));
+}
+
+TEST(LyraFeatureDecoderTest, DecodeFeaturesFailsWithoutFeatures) {
+  auto vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*vector_quantizer, DecodeToLossyFeatures(_)).Times(0);
+  auto decoder = LyraFeatureDecoderPeer::Create(
+      std::move(vector_quantizer), kTestNumFeatures, kTestNumFramesPerPacket);
+
+  EXPECT_FALSE(decoder->DecodeFeatures({}).has_value());
+  EXPECT_FALSE(decoder->DecodeFeatures(std::vector<uint8_t>(3)).has_value());
+}
+
+TEST(LyraFeatureDecoderTest, DecodeFeaturesBatchAppendsUnpackedPackets) {
+  auto vector_quantizer = absl::make_unique<MockVectorQuantizer>();
+  EXPECT_CALL(*vector_quantizer, DecodeToLossyFeatures(_))
+      .WillOnce(Return(CountingFeatures(0.0f)))
+      .WillOnce(Return(CountingFeatures(10.0f)));
+  auto decoder = LyraFeatureDecoderPeer::Create(
+      std::move(vector_quantizer), kTestNumFeatures, kTestNumFramesPerPacket);
+  Packet<kNumQuantizationBits, 0> packet;
+  const std::vector<uint8_t> encoded =
+      packet.PackQuantized(QuantizedBits(kNumQuantizationBits));
+  const std::vector<uint8_t> truncated(encoded.begin(), encoded.end() - 1);
+  const std::vector<absl::Span<const uint8_t>> packets = {
+      encoded, {}, truncated, encoded};
+
+  std::vector<PacketStatus> statuses(packets.size());
+  std::vector<float> features = {-1.0f};
+  EXPECT_EQ(
+      decoder->DecodeFeaturesBatch(packets, absl::MakeSpan(statuses),
+                                   &features),
+      2);
+  EXPECT_THAT(statuses,
+              ElementsAre(PacketStatus::kUnpacked, PacketStatus::kEmpty,
+                          PacketStatus::kInvalid, PacketStatus::kUnpacked));
+  std::vector<float> expected = {-1.0f};
+  for (const float first : {0.0f, 10.0f}) {
+    const std::vector<float> packet_features = CountingFeatures(first);
+    expected.insert(expected.end(), packet_features.begin(),
+                    packet_features.end());
+  }
+  EXPECT_EQ(features, expected);
+}
+
+TEST(LyraFeatureDecoderCreate, CreateFromModelSucceeds) {
+  const auto model =
+      LyraModel::Create(ghc::filesystem::current_path() / "wavegru");
+  ASSERT_NE(model, nullptr);
+  auto decoder = LyraFeatureDecoder::Create(model);
+  ASSERT_NE(decoder, nullptr);
+  EXPECT_EQ(decoder->num_features(), kNumExpectedOutputFeatures);
+  EXPECT_EQ(decoder->num_frames_per_packet(), kNumFramesPerPacket);
+}
+
+TEST(LyraFeatureDecoderCreate, InvalidCreateReturnsNullptr) {
+  EXPECT_EQ(LyraFeatureDecoder::Create(ghc::filesystem::current_path() /
+                                       "missing"),
+            nullptr);
+  EXPECT_EQ(LyraFeatureDecoder::Create(std::shared_ptr<LyraModel>()),
+            nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -26,6 +26,7 @@
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "dsp_util.h"
+#include "feature_frame.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
@@ -124,10 +125,10 @@ TEST_P(LyraIntegrationTest, DecodedAudioHasSimilarFeatures) {
                                              2 * num_samples_per_hop);
   ASSERT_NE(nullptr, decoded_extractor);
 
-  std::vector<std::vector<float>> input_log_mel_spectrogram;
-  std::vector<std::vector<float>> decoded_log_mel_spectrogram;
+  std::vector<FeatureFrame> input_log_mel_spectrogram;
+  std::vector<FeatureFrame> decoded_log_mel_spectrogram;
   for (int frame = 0; frame < num_frames; ++frame) {
-    absl::optional<std::vector<float>> input_features_or =
+    absl::optional<FeatureFrame> input_features_or =
         input_extractor->Extract(
             absl::MakeConstSpan(&middle_samples.at(frame * num_samples_per_hop),
                                 num_samples_per_hop));
@@ -136,7 +137,7 @@ TEST_P(LyraIntegrationTest, DecodedAudioHasSimilarFeatures) {
                 testing::Optional(testing::SizeIs(kNumFeatures)));
     input_log_mel_spectrogram.push_back(input_features_or.value());
 
-    absl::optional<std::vector<float>> decoded_features_or =
+    absl::optional<FeatureFrame> decoded_features_or =
         decoded_extractor->Extract(absl::MakeConstSpan(
             &decoded.at(frame * num_samples_per_hop), num_samples_per_hop));
     ASSERT_TRUE(decoded_features_or.has_value());
@@ -0,0 +1,194 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_jitter_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "lyra_decoder_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<LyraJitterBuffer> LyraJitterBuffer::Create(
+    LyraDecoderInterface* decoder, int num_frames_per_packet) {
+  if (decoder == nullptr) {
+    LOG(ERROR) << "The jitter buffer needs a decoder.";
+    return nullptr;
+  }
+  if (num_frames_per_packet <= 0) {
+    LOG(ERROR) << "The number of frames per packet has to be positive, but is "
+               << num_frames_per_packet << ".";
+    return nullptr;
+  }
+  return absl::WrapUnique(new LyraJitterBuffer(decoder, num_frames_per_packet));
+}
+
+LyraJitterBuffer::LyraJitterBuffer(LyraDecoderInterface* decoder,
+                                   int num_frames_per_packet)
+    : decoder_(decoder),
+      packet_duration_ms_(1000 * num_frames_per_packet / decoder->frame_rate()),
+      num_samples_per_packet_(decoder->sample_rate_hz() *
+                              num_frames_per_packet / decoder->frame_rate()),
+      num_samples_remaining_(0),
+      concealing_(false),
+      target_delay_ms_(packet_duration_ms_) {
+  sorted_delays_ms_.reserve(kNumDelaySamples);
+}
+
+bool LyraJitterBuffer::InsertPacket(uint16_t sequence_number,
+                                    absl::Span<const uint8_t> packet,
+                                    int64_t arrival_time_ms) {
+  const int64_t index = Unwrap(sequence_number);
+  // Late packets still count towards the delay, so that it grows until they
+  // are in time.
+  UpdateDelay(index, arrival_time_ms);
+  if (next_index_.has_value() && index < next_index_.value()) {
+    ++statistics_.num_packets_late;
+    return false;
+  }
+  return packets_.emplace(index, std::vector<uint8_t>(packet.begin(),
+                                                      packet.end()))
+      .second;
+}
+
+bool LyraJitterBuffer::GetAudio(absl::Span<int16_t> samples) {
+  if (!next_index_.has_value()) {
+    // Playout starts once the first packet was buffered for the target delay.
+    if (packets_.empty() ||
+        last_index_.value() - packets_.begin()->first + 1 <
+            TargetNumPackets()) {
+      std::fill(samples.begin(), samples.end(), 0);
+      return true;
+    }
+    next_index_ = packets_.begin()->first;
+  }
+
+  int num_samples_written = 0;
+  while (num_samples_written < samples.size()) {
+    if (num_samples_remaining_ == 0) {
+      StartNextPacket();
+    }
+    const int num_samples =
+        std::min<int>(num_samples_remaining_,
+                      samples.size() - num_samples_written);
+    const absl::Span<int16_t> packet_samples =
+        samples.subspan(num_samples_written, num_samples);
+    const bool decoded = concealing_
+                             ? decoder_->DecodePacketLoss(packet_samples)
+                             : decoder_->DecodeSamples(packet_samples);
+    if (!decoded) {
+      LOG(ERROR) << "Unable to decode samples for playout.";
+      return false;
+    }
+    num_samples_written += num_samples;
+    num_samples_remaining_ -= num_samples;
+  }
+  return true;
+}
+
+int LyraJitterBuffer::target_delay_ms() const { return target_delay_ms_; }
+
+int64_t LyraJitterBuffer::Unwrap(uint16_t sequence_number) {
+  if (!last_index_.has_value()) {
+    last_index_ = sequence_number;
+    return sequence_number;
+  }
+  // The sequence number is taken to be within half its range of the last one.
+  const int16_t difference = static_cast<int16_t>(
+      sequence_number - static_cast<uint16_t>(last_index_.value()));
+  const int64_t index = last_index_.value() + difference;
+  last_index_ = std::max(last_index_.value(), index);
+  return index;
+}
+
+void LyraJitterBuffer::UpdateDelay(int64_t index, int64_t arrival_time_ms) {
+  relative_delays_ms_.push_back(arrival_time_ms - index * packet_duration_ms_);
+  if (relative_delays_ms_.size() > kNumDelaySamples) {
+    relative_delays_ms_.pop_front();
+  }
+  // The fastest recent packet had no jitter, the others were delayed by how
+  // much later than it they arrived.
+  sorted_delays_ms_.assign(relative_delays_ms_.begin(),
+                           relative_delays_ms_.end());
+  const int64_t min_delay_ms =
+      *std::min_element(sorted_delays_ms_.begin(), sorted_delays_ms_.end());
+  const int percentile_index = std::max<int>(
+      0, std::ceil(kDelayPercentile * sorted_delays_ms_.size()) - 1);
+  std::nth_element(sorted_delays_ms_.begin(),
+                   sorted_delays_ms_.begin() + percentile_index,
+                   sorted_delays_ms_.end());
+  const int64_t jitter_ms = sorted_delays_ms_[percentile_index] - min_delay_ms;
+  target_delay_ms_ = std::min<int64_t>(jitter_ms + packet_duration_ms_,
+                                       std::max(kMaxDelayMs,
+                                                packet_duration_ms_));
+}
+
+void LyraJitterBuffer::StartNextPacket() {
+  const int64_t num_packets_buffered =
+      last_index_.value() - next_index_.value() + 1;
+  // One packet above the target is tolerated, so that a delay right at a
+  // packet boundary does not drop a packet at every other step.
+  if (num_packets_buffered > TargetNumPackets() + 1) {
+    if (packets_.erase(next_index_.value()) > 0) {
+      ++statistics_.num_packets_dropped;
+    }
+    ++next_index_.value();
+  }
+
+  num_samples_remaining_ = num_samples_per_packet_;
+  auto it = packets_.find(next_index_.value());
+  if (it == packets_.end()) {
+    concealing_ = true;
+    ++statistics_.num_packets_concealed;
+    // A later packet that is already here can be concealed towards.
+    const auto future_it = packets_.upper_bound(next_index_.value());
+    if (future_it != packets_.end() &&
+        decoder_->SetFuturePacket(
+            future_it->second,
+            (future_it->first - next_index_.value()) *
+                num_samples_per_packet_)) {
+      ++statistics_.num_packets_interpolated;
+    }
+    // If nothing later arrived either the packet is probably late rather than
+    // lost. It is waited for, which grows the delay by one packet.
+    if (last_index_.value() > next_index_.value()) {
+      ++next_index_.value();
+    }
+    return;
+  }
+  concealing_ = !decoder_->SetEncodedPacket(it->second);
+  if (concealing_) {
+    LOG(ERROR) << "Concealing a packet the decoder could not parse.";
+    ++statistics_.num_packets_concealed;
+  } else {
+    ++statistics_.num_packets_decoded;
+  }
+  packets_.erase(it);
+  ++next_index_.value();
+}
+
+int LyraJitterBuffer::TargetNumPackets() const {
+  return (target_delay_ms_ + packet_duration_ms_ - 1) / packet_duration_ms_;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
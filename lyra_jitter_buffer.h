@@ -0,0 +1,129 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_JITTER_BUFFER_H_
+#define LYRA_CODEC_LYRA_JITTER_BUFFER_H_
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "lyra_decoder_interface.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Reorders packets received over a network by sequence number and plays them
+// out through a |LyraDecoderInterface|, concealing the ones that are missing
+// at playout time.
+//
+// The playout delay adapts to the measured jitter: it is the delay that
+// |kDelayPercentile| of the recent packets arrived within, so a good network
+// plays out with about one packet of latency and a bad one buffers enough
+// that fewer packets need concealment. When more packets are buffered than
+// the target delay needs, the oldest one is dropped to catch up. A missing
+// packet is concealed towards the next buffered one, if any, see
+// |LyraDecoderInterface::SetFuturePacket|.
+//
+// This class is not thread-safe.
+class LyraJitterBuffer {
+ public:
+  // Number of recent packets the delay is estimated from.
+  static constexpr int kNumDelaySamples = 100;
+  // Fraction of the recent packets the target delay has to cover.
+  static constexpr float kDelayPercentile = 0.95f;
+  // Upper bound of the target delay.
+  static constexpr int kMaxDelayMs = 1000;
+
+  struct Statistics {
+    int num_packets_decoded = 0;
+    int num_packets_concealed = 0;
+    // Concealed packets whose features were interpolated towards a later
+    // packet that was already buffered.
+    int num_packets_interpolated = 0;
+    // Packets that arrived after their playout time and were discarded.
+    int num_packets_late = 0;
+    // Packets discarded to bring the delay down to the target.
+    int num_packets_dropped = 0;
+  };
+
+  // |decoder| has to outlive the jitter buffer. Each packet holds
+  // |num_frames_per_packet| frames. Returns a nullptr if |decoder| is null or
+  // |num_frames_per_packet| is not positive.
+  static std::unique_ptr<LyraJitterBuffer> Create(
+      LyraDecoderInterface* decoder, int num_frames_per_packet);
+
+  // Adds |packet| with |sequence_number|, which increases by one per packet
+  // and wraps around, received at |arrival_time_ms| on any monotonic clock.
+  // Returns false if the packet is a duplicate or arrived too late to be
+  // played.
+  bool InsertPacket(uint16_t sequence_number, absl::Span<const uint8_t> packet,
+                    int64_t arrival_time_ms);
+
+  // Fills |samples| with the next samples to play at the sample rate of the
+  // decoder. Before the first packet is due this writes silence. Returns false
+  // if the decoder failed.
+  bool GetAudio(absl::Span<int16_t> samples);
+
+  // Delay the buffer currently aims to hold before playing a packet.
+  int target_delay_ms() const;
+
+  const Statistics& statistics() const { return statistics_; }
+
+ private:
+  LyraJitterBuffer(LyraDecoderInterface* decoder, int num_frames_per_packet);
+
+  // Returns |sequence_number| extended to 64 bits around the last one seen.
+  int64_t Unwrap(uint16_t sequence_number);
+
+  // Adds the arrival of packet |index| to the delay estimate.
+  void UpdateDelay(int64_t index, int64_t arrival_time_ms);
+
+  // Picks the packet to be decoded next, setting it on the decoder unless it
+  // has to be concealed.
+  void StartNextPacket();
+
+  // Number of packets the target delay amounts to.
+  int TargetNumPackets() const;
+
+  LyraDecoderInterface* const decoder_;
+  const int packet_duration_ms_;
+  const int num_samples_per_packet_;
+
+  std::map<int64_t, std::vector<uint8_t>> packets_;
+  absl::optional<int64_t> last_index_;
+  // The packet that is decoded next once the current one is played out.
+  // Unset until playout started.
+  absl::optional<int64_t> next_index_;
+  int num_samples_remaining_;
+  bool concealing_;
+
+  // Arrival time minus the nominal send time of recent packets.
+  std::deque<int64_t> relative_delays_ms_;
+  std::vector<int64_t> sorted_delays_ms_;
+  int target_delay_ms_;
+
+  Statistics statistics_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_JITTER_BUFFER_H_
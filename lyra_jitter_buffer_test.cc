@@ -0,0 +1,208 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_jitter_buffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "testing/mock_lyra_decoder.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::_;
+using testing::ElementsAre;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+
+constexpr int kSampleRateHz = 16000;
+constexpr int kFrameRate = 25;
+constexpr int kPacketDurationMs = 1000 / kFrameRate;
+constexpr int kNumSamplesPerPacket = kSampleRateHz / kFrameRate;
+constexpr int16_t kDecodedSample = 1;
+constexpr int16_t kConcealedSample = -1;
+
+class LyraJitterBufferTest : public testing::Test {
+ protected:
+  LyraJitterBufferTest() {
+    ON_CALL(decoder_, sample_rate_hz()).WillByDefault(Return(kSampleRateHz));
+    ON_CALL(decoder_, frame_rate()).WillByDefault(Return(kFrameRate));
+    ON_CALL(decoder_, SetEncodedPacket(_))
+        .WillByDefault(Invoke([this](absl::Span<const uint8_t> encoded) {
+          decoded_packets_.push_back(encoded.empty() ? -1 : encoded[0]);
+          return true;
+        }));
+    ON_CALL(decoder_, DecodeSamples(testing::An<absl::Span<int16_t>>()))
+        .WillByDefault(Invoke([](absl::Span<int16_t> samples) {
+          std::fill(samples.begin(), samples.end(), kDecodedSample);
+          return true;
+        }));
+    ON_CALL(decoder_, DecodePacketLoss(testing::An<absl::Span<int16_t>>()))
+        .WillByDefault(Invoke([](absl::Span<int16_t> samples) {
+          std::fill(samples.begin(), samples.end(), kConcealedSample);
+          return true;
+        }));
+  }
+
+  // Plays one packet duration of audio and returns its first sample.
+  int16_t PlayPacket(LyraJitterBuffer* jitter_buffer) {
+    std::vector<int16_t> samples(kNumSamplesPerPacket);
+    EXPECT_TRUE(jitter_buffer->GetAudio(absl::MakeSpan(samples)));
+    return samples[0];
+  }
+
+  static std::vector<uint8_t> MakePacket(uint16_t sequence_number) {
+    return std::vector<uint8_t>(1, static_cast<uint8_t>(sequence_number));
+  }
+
+  NiceMock<MockLyraDecoder> decoder_;
+  // The first byte of each packet set on the decoder.
+  std::vector<int> decoded_packets_;
+};
+
+TEST_F(LyraJitterBufferTest, InvalidCreateReturnsNullptr) {
+  EXPECT_EQ(LyraJitterBuffer::Create(nullptr, 1), nullptr);
+  EXPECT_EQ(LyraJitterBuffer::Create(&decoder_, 0), nullptr);
+}
+
+TEST_F(LyraJitterBufferTest, SilenceBeforeTheFirstPacket) {
+  auto jitter_buffer = LyraJitterBuffer::Create(&decoder_, 1);
+  ASSERT_NE(jitter_buffer, nullptr);
+  EXPECT_CALL(decoder_, DecodeSamples(testing::An<absl::Span<int16_t>>()))
+      .Times(0);
+  EXPECT_EQ(PlayPacket(jitter_buffer.get()), 0);
+}
+
+TEST_F(LyraJitterBufferTest, PacketsInTimeAreNotConcealed) {
+  static constexpr int kNumPackets = 20;
+  auto jitter_buffer = LyraJitterBuffer::Create(&decoder_, 1);
+  ASSERT_NE(jitter_buffer, nullptr);
+  for (int i = 0; i < kNumPackets; ++i) {
+    ASSERT_TRUE(jitter_buffer->InsertPacket(i, MakePacket(i),
+                                            i * kPacketDurationMs));
+    EXPECT_EQ(PlayPacket(jitter_buffer.get()), kDecodedSample);
+  }
+  EXPECT_EQ(jitter_buffer->target_delay_ms(), kPacketDurationMs);
+  EXPECT_EQ(jitter_buffer->statistics().num_packets_decoded, kNumPackets);
+  EXPECT_EQ(jitter_buffer->statistics().num_packets_concealed, 0);
+  EXPECT_EQ(decoded_packets_.size(), kNumPackets);
+}
+
+TEST_F(LyraJitterBufferTest, ReorderedPacketsAreDecodedInOrder) {
+  auto jitter_buffer = LyraJitterBuffer::Create(&decoder_, 1);
+  ASSERT_NE(jitter_buffer, nullptr);
+  ASSERT_TRUE(jitter_buffer->InsertPacket(1, MakePacket(1), 0));
+  ASSERT_TRUE(jitter_buffer->InsertPacket(0, MakePacket(0), 1));
+  ASSERT_TRUE(jitter_buffer->InsertPacket(2, MakePacket(2), 2));
+  EXPECT_FALSE(jitter_buffer->InsertPacket(2, MakePacket(2), 3));
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(PlayPacket(jitter_buffer.get()), kDecodedSample);
+  }
+  EXPECT_THAT(decoded_packets_, ElementsAre(0, 1, 2));
+}
+
+TEST_F(LyraJitterBufferTest, LostPacketIsConcealed) {
+  auto jitter_buffer = LyraJitterBuffer::Create(&decoder_, 1);
+  ASSERT_NE(jitter_buffer, nullptr);
+  std::vector<int16_t> played;
+  // Packet 2 is lost, which is known once packet 3 arrived. It is concealed
+  // towards packet 3.
+  EXPECT_CALL(decoder_, SetFuturePacket(ElementsAre(3), kNumSamplesPerPacket))
+      .WillOnce(Return(true));
+  for (int i = 0; i < 5; ++i) {
+    if (i == 2) continue;
+    ASSERT_TRUE(jitter_buffer->InsertPacket(i, MakePacket(i),
+                                            i * kPacketDurationMs));
+    played.push_back(PlayPacket(jitter_buffer.get()));
+  }
+  played.push_back(PlayPacket(jitter_buffer.get()));
+  EXPECT_THAT(played, ElementsAre(kDecodedSample, kDecodedSample,
+                                  kConcealedSample, kDecodedSample,
+                                  kDecodedSample));
+  EXPECT_THAT(decoded_packets_, ElementsAre(0, 1, 3, 4));
+  EXPECT_EQ(jitter_buffer->statistics().num_packets_concealed, 1);
+  EXPECT_EQ(jitter_buffer->statistics().num_packets_interpolated, 1);
+}
+
+TEST_F(LyraJitterBufferTest, LatePacketIsWaitedForOnce) {
+  auto jitter_buffer = LyraJitterBuffer::Create(&decoder_, 1);
+  ASSERT_NE(jitter_buffer, nullptr);
+  ASSERT_TRUE(jitter_buffer->InsertPacket(0, MakePacket(0), 0));
+  EXPECT_EQ(PlayPacket(jitter_buffer.get()), kDecodedSample);
+  // Nothing arrived after packet 0, so packet 1 is waited for.
+  EXPECT_EQ(PlayPacket(jitter_buffer.get()), kConcealedSample);
+  ASSERT_TRUE(
+      jitter_buffer->InsertPacket(1, MakePacket(1), 2 * kPacketDurationMs));
+  EXPECT_EQ(PlayPacket(jitter_buffer.get()), kDecodedSample);
+  EXPECT_THAT(decoded_packets_, ElementsAre(0, 1));
+  EXPECT_EQ(jitter_buffer->target_delay_ms(), 2 * kPacketDurationMs);
+}
+
+TEST_F(LyraJitterBufferTest, JitterGrowsTheDelayAndLatePacketsAreDiscarded) {
+  auto jitter_buffer = LyraJitterBuffer::Create(&decoder_, 1);
+  ASSERT_NE(jitter_buffer, nullptr);
+  ASSERT_TRUE(jitter_buffer->InsertPacket(0, MakePacket(0), 0));
+  EXPECT_EQ(PlayPacket(jitter_buffer.get()), kDecodedSample);
+  ASSERT_TRUE(jitter_buffer->InsertPacket(2, MakePacket(2),
+                                          2 * kPacketDurationMs));
+  EXPECT_EQ(PlayPacket(jitter_buffer.get()), kConcealedSample);
+  // Packet 1 arrives 100 ms late, after it was concealed.
+  EXPECT_FALSE(jitter_buffer->InsertPacket(1, MakePacket(1),
+                                           kPacketDurationMs + 100));
+  EXPECT_EQ(jitter_buffer->statistics().num_packets_late, 1);
+  EXPECT_GE(jitter_buffer->target_delay_ms(), 100 + kPacketDurationMs);
+}
+
+TEST_F(LyraJitterBufferTest, ExcessDelayIsDroppedGradually) {
+  static constexpr int kNumPackets = 10;
+  auto jitter_buffer = LyraJitterBuffer::Create(&decoder_, 1);
+  ASSERT_NE(jitter_buffer, nullptr);
+  // All packets arrive at once, far more than the target delay needs.
+  for (int i = 0; i < kNumPackets; ++i) {
+    ASSERT_TRUE(
+        jitter_buffer->InsertPacket(i, MakePacket(i), i * kPacketDurationMs));
+  }
+  // At most one packet is dropped per packet played, until one packet above
+  // the target delay is left.
+  for (int i = 0; i < kNumPackets / 2; ++i) {
+    EXPECT_EQ(PlayPacket(jitter_buffer.get()), kDecodedSample);
+  }
+  EXPECT_THAT(decoded_packets_, ElementsAre(1, 3, 5, 7, 8));
+  EXPECT_EQ(jitter_buffer->statistics().num_packets_dropped, 4);
+}
+
+TEST_F(LyraJitterBufferTest, SequenceNumbersWrapAround) {
+  auto jitter_buffer = LyraJitterBuffer::Create(&decoder_, 1);
+  ASSERT_NE(jitter_buffer, nullptr);
+  const std::vector<uint16_t> sequence_numbers = {65534, 65535, 0, 1};
+  for (int i = 0; i < sequence_numbers.size(); ++i) {
+    ASSERT_TRUE(jitter_buffer->InsertPacket(sequence_numbers[i],
+                                            MakePacket(i),
+                                            i * kPacketDurationMs));
+    EXPECT_EQ(PlayPacket(jitter_buffer.get()), kDecodedSample);
+  }
+  EXPECT_THAT(decoded_packets_, ElementsAre(0, 1, 2, 3));
+  EXPECT_EQ(jitter_buffer->statistics().num_packets_concealed, 0);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,102 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_model.h"
+
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "model_bundle.h"
+#include "performance_profile.h"
+#include "thread_affinity.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::shared_ptr<LyraModel> LyraModel::Create(
+    const ghc::filesystem::path& model_path, bool use_huge_pages) {
+  // A bundle holds only the identifier of its config, so it runs with the
+  // defaults.
+  PerformanceProfile profile;
+  std::error_code error_code;
+  const ghc::filesystem::path config_path =
+      model_path / std::string(kLyraConfigProto);
+  if (ghc::filesystem::is_regular_file(config_path, error_code)) {
+    auto profile_or = ReadPerformanceProfile(config_path);
+    if (!profile_or.ok()) {
+      LOG(ERROR) << profile_or.status();
+      return nullptr;
+    }
+    profile = profile_or.value();
+  }
+  profile.use_huge_pages = profile.use_huge_pages || use_huge_pages;
+  return Create(model_path, profile);
+}
+
+std::shared_ptr<LyraModel> LyraModel::Create(
+    const ghc::filesystem::path& model_path,
+    const PerformanceProfile& profile) {
+  std::error_code error_code;
+  if (!ghc::filesystem::is_directory(model_path, error_code) &&
+      !IsModelBundle(model_path)) {
+    LOG(ERROR) << "Model path " << model_path
+               << " is neither a directory nor a model bundle.";
+    return nullptr;
+  }
+  LOG(INFO) << "Performance profile of " << model_path << ": "
+            << PerformanceProfileString(profile);
+  // WrapUnique is used because of private c'tor.
+  return absl::WrapUnique(new LyraModel(model_path, profile));
+}
+
+std::vector<std::shared_ptr<LyraModel>> LyraModel::CreateNumaReplicas(
+    const ghc::filesystem::path& model_path,
+    const std::vector<NumaNode>& nodes) {
+  const std::shared_ptr<LyraModel> model = Create(model_path);
+  if (model == nullptr) {
+    return {};
+  }
+  std::vector<std::shared_ptr<LyraModel>> replicas;
+  replicas.reserve(nodes.size());
+  for (const NumaNode& node : nodes) {
+    replicas.push_back(absl::WrapUnique(
+        new LyraModel(model_path, model->performance_profile(), node)));
+  }
+  return replicas;
+}
+
+LyraModel::LyraModel(const ghc::filesystem::path& model_path,
+                     const PerformanceProfile& profile,
+                     absl::optional<NumaNode> numa_node)
+    : model_path_(model_path),
+      use_huge_pages_(profile.use_huge_pages),
+      performance_profile_(profile),
+      numa_node_(std::move(numa_node)) {}
+
+int LyraModel::num_assets() const {
+  absl::MutexLock lock(&mutex_);
+  return assets_.size();
+}
+
+}  // namespace codec
+}  // namespace chromemedia
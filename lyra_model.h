@@ -0,0 +1,187 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_MODEL_H_
+#define LYRA_CODEC_LYRA_MODEL_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "huge_pages.h"
+#include "include/ghc/filesystem.hpp"
+#include "performance_profile.h"
+#include "thread_affinity.h"
+
+namespace chromemedia {
+namespace codec {
+
+/// Read-only model weights shared between Lyra instances.
+///
+/// Every decoder or encoder created from the same |LyraModel| reuses a single
+/// copy of each weight matrix and only keeps its own mutable state, such as
+/// activations, recurrent state and filter memories. Assets are loaded lazily
+/// the first time an instance asks for them and live as long as any instance
+/// or the model itself references them.
+///
+/// This class is thread-safe.
+class LyraModel {
+ public:
+  /// Creates a model registry for the weights stored in |model_path|.
+  ///
+  /// @param model_path Directory containing the model weights, or a model
+  ///                   bundle written by bundle_model.
+  /// @param use_huge_pages Whether the memory the weights are loaded into is
+  ///                       backed by transparent huge pages, which lowers the
+  ///                       TLB misses of streaming them when many instances
+  ///                       share a core. Ignored where the kernel does not
+  ///                       support them.
+  /// @return A shared_ptr to a |LyraModel|, or a nullptr if |model_path| is
+  ///         neither a directory nor a model bundle, or if the
+  ///         |PerformanceProfile| in its lyra_config.textproto is invalid.
+  static std::shared_ptr<LyraModel> Create(
+      const ghc::filesystem::path& model_path, bool use_huge_pages = false);
+
+  /// Creates a model registry with the profile of the deployment instead of
+  /// the one of the weights, e.g. as read by |ReadPerformanceProfile|.
+  ///
+  /// @param model_path Directory containing the model weights, or a model
+  ///                   bundle written by bundle_model.
+  /// @param profile How the codecs created from the model run.
+  /// @return A shared_ptr to a |LyraModel|, or a nullptr if |model_path| is
+  ///         neither a directory nor a model bundle.
+  static std::shared_ptr<LyraModel> Create(
+      const ghc::filesystem::path& model_path,
+      const PerformanceProfile& profile);
+
+  /// Creates one registry per NUMA node for the weights stored in
+  /// |model_path|, each of which loads its assets into the memory of its node,
+  /// so that codecs running on a node stream their weights from local memory.
+  /// That trades a copy of the weights per node for the bandwidth of the
+  /// interconnect between the nodes of multi-socket servers.
+  ///
+  /// @param model_path Directory containing the model weights, or a model
+  ///                   bundle written by bundle_model.
+  /// @param nodes The nodes to replicate the weights on, e.g. as returned by
+  ///              |DetectNumaNodes|.
+  /// @return The model of every node in the order of |nodes|, or an empty
+  ///         vector if |Create| fails for |model_path|.
+  static std::vector<std::shared_ptr<LyraModel>> CreateNumaReplicas(
+      const ghc::filesystem::path& model_path,
+      const std::vector<NumaNode>& nodes);
+
+  const ghc::filesystem::path& model_path() const { return model_path_; }
+
+  /// The node whose memory the assets are loaded into, or a nullopt if that
+  /// is left to the OS.
+  const absl::optional<NumaNode>& numa_node() const { return numa_node_; }
+
+  bool use_huge_pages() const { return use_huge_pages_; }
+
+  /// The profile that |LyraDecoder::CreateWithProfile| applies. Without the
+  /// |PerformanceProfile| field in lyra_config.textproto every knob has its
+  /// default.
+  const PerformanceProfile& performance_profile() const {
+    return performance_profile_;
+  }
+
+  // Returns the asset stored under |key|, calling |loader| to build it if this
+  // is the first request. Assets of different types never collide, even if
+  // they use the same |key|. Returns a nullptr if |loader| fails, in which
+  // case nothing is stored and the next request retries. |loader| runs
+  // without holding the lock, so that different assets load concurrently,
+  // while concurrent requests for the same asset wait for the first one.
+  template <typename T>
+  std::shared_ptr<T> GetOrLoad(
+      const std::string& key,
+      const std::function<std::unique_ptr<T>()>& loader) {
+    const AssetKey asset_key(key, TypeTag<T>());
+    {
+      absl::MutexLock lock(&mutex_);
+      while (loading_.count(asset_key) > 0) {
+        loaded_.Wait(&mutex_);
+      }
+      auto it = assets_.find(asset_key);
+      if (it != assets_.end()) {
+        return std::static_pointer_cast<T>(it->second);
+      }
+      loading_.insert(asset_key);
+    }
+    std::shared_ptr<T> asset;
+    const std::function<void()> load = [&]() {
+      if (use_huge_pages_) {
+        // The weights are allocated by the layers, which cannot be told where
+        // to, so the memory mapped while loading them is advised instead.
+        AdviseHugePagesForAllocations([&]() { asset = loader(); });
+      } else {
+        asset = loader();
+      }
+    };
+    if (numa_node_.has_value()) {
+      RunOnNumaNode(*numa_node_, load);
+    } else {
+      load();
+    }
+    absl::MutexLock lock(&mutex_);
+    loading_.erase(asset_key);
+    if (asset != nullptr) {
+      assets_.emplace(asset_key, asset);
+    }
+    loaded_.SignalAll();
+    return asset;
+  }
+
+  // Number of distinct assets loaded so far.
+  int num_assets() const;
+
+ private:
+  using AssetKey = std::pair<std::string, const void*>;
+
+  LyraModel(const ghc::filesystem::path& model_path,
+            const PerformanceProfile& profile,
+            absl::optional<NumaNode> numa_node = absl::nullopt);
+
+  // Returns an address that is unique to |T|, used to tell assets of different
+  // types apart without relying on RTTI.
+  template <typename T>
+  static const void* TypeTag() {
+    static const char kTag = 0;
+    return &kTag;
+  }
+
+  const ghc::filesystem::path model_path_;
+  const bool use_huge_pages_;
+  const PerformanceProfile performance_profile_;
+  const absl::optional<NumaNode> numa_node_;
+  mutable absl::Mutex mutex_;
+  std::map<AssetKey, std::shared_ptr<void>> assets_ ABSL_GUARDED_BY(mutex_);
+  // The assets whose loader is running.
+  std::set<AssetKey> loading_ ABSL_GUARDED_BY(mutex_);
+  // Signaled whenever a loader returns.
+  absl::CondVar loaded_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_MODEL_H_
@@ -0,0 +1,245 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_model.h"
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+// placeholder for get runfiles header.
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "performance_profile.h"
+#include "thread_affinity.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+class LyraModelTest : public testing::Test {
+ protected:
+  LyraModelTest()
+      : model_(LyraModel::Create(ghc::filesystem::current_path() / "wavegru")) {
+  }
+
+  std::shared_ptr<LyraModel> model_;
+};
+
+TEST_F(LyraModelTest, CreateSucceeds) {
+  ASSERT_NE(model_, nullptr);
+  EXPECT_EQ(model_->num_assets(), 0);
+}
+
+TEST_F(LyraModelTest, AssetIsLoadedOnce) {
+  ASSERT_NE(model_, nullptr);
+  int num_loads = 0;
+  const std::function<std::unique_ptr<int>()> loader = [&num_loads]() {
+    ++num_loads;
+    return absl::make_unique<int>(42);
+  };
+
+  const std::shared_ptr<int> first = model_->GetOrLoad("answer", loader);
+  const std::shared_ptr<int> second = model_->GetOrLoad("answer", loader);
+
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(*first, 42);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(num_loads, 1);
+  EXPECT_EQ(model_->num_assets(), 1);
+}
+
+TEST_F(LyraModelTest, DifferentTypesDoNotCollide) {
+  ASSERT_NE(model_, nullptr);
+  const std::function<std::unique_ptr<int>()> int_loader = []() {
+    return absl::make_unique<int>(1);
+  };
+  const std::function<std::unique_ptr<std::string>()> string_loader = []() {
+    return absl::make_unique<std::string>("one");
+  };
+
+  EXPECT_EQ(*model_->GetOrLoad("key", int_loader), 1);
+  EXPECT_EQ(*model_->GetOrLoad("key", string_loader), "one");
+  EXPECT_EQ(model_->num_assets(), 2);
+}
+
+TEST_F(LyraModelTest, FailedLoadIsRetried) {
+  ASSERT_NE(model_, nullptr);
+  int num_loads = 0;
+  const std::function<std::unique_ptr<int>()> failing_loader =
+      [&num_loads]() -> std::unique_ptr<int> {
+    ++num_loads;
+    return nullptr;
+  };
+
+  EXPECT_EQ(model_->GetOrLoad("missing", failing_loader), nullptr);
+  EXPECT_EQ(model_->GetOrLoad("missing", failing_loader), nullptr);
+  EXPECT_EQ(num_loads, 2);
+  EXPECT_EQ(model_->num_assets(), 0);
+}
+
+TEST_F(LyraModelTest, DifferentAssetsLoadConcurrently) {
+  ASSERT_NE(model_, nullptr);
+  // Each loader waits for the other one to start, which only happens in
+  // time if they do not hold the lock of the model.
+  std::atomic<int> num_started(0);
+  std::atomic<bool> both_started(false);
+  const std::function<std::unique_ptr<int>()> loader = [&]() {
+    ++num_started;
+    const absl::Time deadline = absl::Now() + absl::Seconds(10);
+    while (num_started < 2 && absl::Now() < deadline) {
+      std::this_thread::yield();
+    }
+    if (num_started == 2) {
+      both_started = true;
+    }
+    return absl::make_unique<int>(1);
+  };
+
+  std::thread other_thread([this, &loader]() {
+    EXPECT_NE(model_->GetOrLoad("first", loader), nullptr);
+  });
+  EXPECT_NE(model_->GetOrLoad("second", loader), nullptr);
+  other_thread.join();
+  EXPECT_TRUE(both_started);
+  EXPECT_EQ(model_->num_assets(), 2);
+}
+
+TEST_F(LyraModelTest, ConcurrentRequestsLoadOnce) {
+  ASSERT_NE(model_, nullptr);
+  std::atomic<int> num_loads(0);
+  const std::function<std::unique_ptr<int>()> loader = [&num_loads]() {
+    ++num_loads;
+    absl::SleepFor(absl::Milliseconds(10));
+    return absl::make_unique<int>(42);
+  };
+
+  std::vector<std::thread> threads;
+  std::vector<std::shared_ptr<int>> assets(4);
+  for (auto& asset : assets) {
+    threads.emplace_back([this, &loader, &asset]() {
+      asset = model_->GetOrLoad("key", loader);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_loads, 1);
+  for (const auto& asset : assets) {
+    ASSERT_NE(asset, nullptr);
+    EXPECT_EQ(asset, assets[0]);
+  }
+}
+
+TEST(LyraModelCreate, HugePagesLoadAssetsOnce) {
+  auto model = LyraModel::Create(ghc::filesystem::current_path() / "wavegru",
+                                 /*use_huge_pages=*/true);
+  ASSERT_NE(model, nullptr);
+  EXPECT_TRUE(model->use_huge_pages());
+
+  int num_loads = 0;
+  const std::function<std::unique_ptr<std::vector<float>>()> loader =
+      [&num_loads]() {
+        ++num_loads;
+        return absl::make_unique<std::vector<float>>(4 << 20, 1.0f);
+      };
+  const std::shared_ptr<std::vector<float>> first =
+      model->GetOrLoad("weights", loader);
+  const std::shared_ptr<std::vector<float>> second =
+      model->GetOrLoad("weights", loader);
+
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(first->size(), 4 << 20);
+  EXPECT_EQ(first->back(), 1.0f);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(num_loads, 1);
+}
+
+TEST(LyraModelCreate, ProfileIsReadFromTheConfig) {
+  const ghc::filesystem::path model_path =
+      ghc::filesystem::temp_directory_path() / "lyra_model_profile_test";
+  ghc::filesystem::create_directories(model_path);
+  {
+    std::ofstream config((model_path / "lyra_config.textproto").string());
+    config << "performance_profile { num_threads: 2 use_huge_pages: true }\n";
+  }
+  auto model = LyraModel::Create(model_path);
+  ASSERT_NE(model, nullptr);
+  EXPECT_EQ(model->performance_profile().num_threads, 2);
+  EXPECT_TRUE(model->use_huge_pages());
+
+  {
+    std::ofstream config((model_path / "lyra_config.textproto").string());
+    config << "performance_profile { num_threads: 0 }\n";
+  }
+  EXPECT_EQ(LyraModel::Create(model_path), nullptr);
+  ghc::filesystem::remove_all(model_path);
+}
+
+TEST(LyraModelCreate, ProfileOfTheDeploymentOverridesTheConfig) {
+  PerformanceProfile profile;
+  profile.num_threads = 4;
+  profile.pipelining = false;
+  auto model = LyraModel::Create(ghc::filesystem::current_path() / "wavegru",
+                                 profile);
+  ASSERT_NE(model, nullptr);
+  EXPECT_EQ(model->performance_profile().num_threads, 4);
+  EXPECT_FALSE(model->performance_profile().pipelining);
+  EXPECT_FALSE(model->use_huge_pages());
+}
+
+TEST(LyraModelCreate, NumaReplicasLoadTheirOwnAssets) {
+  const std::vector<NumaNode> nodes = DetectNumaNodes();
+  ASSERT_FALSE(nodes.empty());
+  const std::vector<std::shared_ptr<LyraModel>> replicas =
+      LyraModel::CreateNumaReplicas(
+          ghc::filesystem::current_path() / "wavegru", {nodes[0], nodes[0]});
+  ASSERT_EQ(replicas.size(), 2);
+
+  int num_loads = 0;
+  const std::function<std::unique_ptr<int>()> loader = [&num_loads]() {
+    ++num_loads;
+    return absl::make_unique<int>(42);
+  };
+  const std::shared_ptr<int> first = replicas[0]->GetOrLoad("key", loader);
+  const std::shared_ptr<int> second = replicas[1]->GetOrLoad("key", loader);
+
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(num_loads, 2);
+  for (const auto& replica : replicas) {
+    ASSERT_TRUE(replica->numa_node().has_value());
+    EXPECT_EQ(replica->numa_node()->id, nodes[0].id);
+  }
+  EXPECT_TRUE(LyraModel::CreateNumaReplicas(
+                  ghc::filesystem::current_path() / "missing", nodes)
+                  .empty());
+}
+
+TEST(LyraModelCreate, NonexistentPathReturnsNullptr) {
+  EXPECT_EQ(LyraModel::Create(ghc::filesystem::current_path() / "missing"),
+            nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,162 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_stream_decoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "lyra_decoder_interface.h"
+#include "lyra_stream_file.h"
+
+namespace chromemedia {
+namespace codec {
+
+absl::StatusOr<std::unique_ptr<LyraStreamDecoder>> LyraStreamDecoder::Create(
+    std::unique_ptr<LyraStreamReader> reader, LyraDecoderInterface* decoder,
+    int num_priming_packets) {
+  if (reader == nullptr || decoder == nullptr) {
+    return absl::InvalidArgumentError("Reader and decoder have to be set.");
+  }
+  if (decoder->num_channels() != reader->header().num_channels) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Decoder of ", decoder->num_channels(),
+        " channels cannot decode a stream of ",
+        reader->header().num_channels, "."));
+  }
+  if (num_priming_packets < 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Number of priming packets ", num_priming_packets,
+        " is negative."));
+  }
+  const int num_samples_per_packet =
+      decoder->sample_rate_hz() * reader->header().packet_duration_ms / 1000;
+  return absl::WrapUnique(new LyraStreamDecoder(
+      std::move(reader), decoder, num_priming_packets,
+      num_samples_per_packet));
+}
+
+LyraStreamDecoder::LyraStreamDecoder(std::unique_ptr<LyraStreamReader> reader,
+                                     LyraDecoderInterface* decoder,
+                                     int num_priming_packets,
+                                     int num_samples_per_packet)
+    : reader_(std::move(reader)),
+      decoder_(decoder),
+      num_priming_packets_(num_priming_packets),
+      num_samples_per_packet_(num_samples_per_packet),
+      packet_samples_(num_samples_per_packet * decoder->num_channels()),
+      packet_samples_begin_(packet_samples_.size()) {}
+
+int64_t LyraStreamDecoder::num_samples() const {
+  return reader_->end_timestamp() * num_samples_per_packet_;
+}
+
+absl::Status LyraStreamDecoder::Seek(int64_t sample) {
+  if (sample < 0 || sample > num_samples()) {
+    return absl::OutOfRangeError(absl::StrCat(
+        "Sample ", sample, " is outside of the stream of ", num_samples(),
+        " samples."));
+  }
+  const int64_t timestamp = sample / num_samples_per_packet_;
+  next_timestamp_ = std::max<int64_t>(0, timestamp - num_priming_packets_);
+  decoder_->Reset();
+  const absl::Status seek_status = reader_->Seek(next_timestamp_);
+  if (!seek_status.ok()) {
+    return seek_status;
+  }
+  has_packet_ = false;
+  while (next_timestamp_ < timestamp) {
+    const absl::Status status = DecodeNextPacket();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  packet_samples_begin_ = packet_samples_.size();
+  position_ = timestamp * num_samples_per_packet_;
+  if (sample > position_) {
+    const absl::Status status = DecodeNextPacket();
+    if (!status.ok()) {
+      return status;
+    }
+    packet_samples_begin_ = (sample - position_) * decoder_->num_channels();
+    position_ = sample;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<int> LyraStreamDecoder::Read(absl::Span<int16_t> samples) {
+  const int num_channels = decoder_->num_channels();
+  if (samples.size() % num_channels != 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Cannot read ", samples.size(), " samples of ", num_channels,
+        " channels."));
+  }
+  int num_read = 0;
+  while (num_read < samples.size()) {
+    if (packet_samples_begin_ == packet_samples_.size()) {
+      if (next_timestamp_ >= reader_->end_timestamp()) {
+        break;
+      }
+      const absl::Status status = DecodeNextPacket();
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    const int num_copied =
+        std::min<int>(samples.size() - num_read,
+                      packet_samples_.size() - packet_samples_begin_);
+    std::copy_n(packet_samples_.begin() + packet_samples_begin_, num_copied,
+                samples.begin() + num_read);
+    packet_samples_begin_ += num_copied;
+    num_read += num_copied;
+  }
+  position_ += num_read / num_channels;
+  return num_read;
+}
+
+absl::Status LyraStreamDecoder::DecodeNextPacket() {
+  if (!has_packet_) {
+    const absl::StatusOr<bool> read = reader_->Read(&packet_);
+    if (!read.ok()) {
+      return read.status();
+    }
+    has_packet_ = *read;
+  }
+  const absl::Span<int16_t> samples = absl::MakeSpan(packet_samples_);
+  if (has_packet_ && packet_.timestamp == next_timestamp_) {
+    has_packet_ = false;
+    if (!decoder_->SetEncodedPacket(packet_.payload) ||
+        !decoder_->DecodeSamples(samples)) {
+      return absl::DataLossError(
+          absl::StrCat("Unable to decode the packet at ", next_timestamp_,
+                       "."));
+    }
+  } else if (!decoder_->DecodePacketLoss(samples)) {
+    return absl::InternalError(absl::StrCat(
+        "Unable to conceal the packet at ", next_timestamp_, "."));
+  }
+  packet_samples_begin_ = 0;
+  ++next_timestamp_;
+  return absl::OkStatus();
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_STREAM_DECODER_H_
+#define LYRA_CODEC_LYRA_STREAM_DECODER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "lyra_decoder_interface.h"
+#include "lyra_stream_file.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Decodes the packets of a |LyraStreamReader| into samples, from any position
+// of the stream. Lost packets are concealed and empty ones decoded as comfort
+// noise, as they would have been live.
+class LyraStreamDecoder {
+ public:
+  // Packets decoded and discarded before the position of a |Seek|, so that the
+  // decoder sounds as if it had decoded the stream from the start.
+  static constexpr int kDefaultNumPrimingPackets = 4;
+
+  // Returns an error if |decoder| does not decode as many channels as
+  // |reader| holds. |decoder| has to outlive the returned object, which owns
+  // it exclusively: it is reset by every |Seek|.
+  static absl::StatusOr<std::unique_ptr<LyraStreamDecoder>> Create(
+      std::unique_ptr<LyraStreamReader> reader, LyraDecoderInterface* decoder,
+      int num_priming_packets = kDefaultNumPrimingPackets);
+
+  // Moves to |sample| samples per channel from the start of the stream, at a
+  // cost of decoding |num_priming_packets| packets instead of all of the ones
+  // before.
+  absl::Status Seek(int64_t sample);
+
+  // Decodes up to |samples.size()| interleaved samples from the position,
+  // which has to be a multiple of the number of channels. Returns the number
+  // of samples decoded, which is less than asked only at the end of the
+  // stream.
+  absl::StatusOr<int> Read(absl::Span<int16_t> samples);
+
+  // The position in samples per channel from the start of the stream.
+  int64_t position() const { return position_; }
+
+  // The length of the stream in samples per channel.
+  int64_t num_samples() const;
+
+  int num_samples_per_packet() const { return num_samples_per_packet_; }
+
+ private:
+  LyraStreamDecoder(std::unique_ptr<LyraStreamReader> reader,
+                    LyraDecoderInterface* decoder, int num_priming_packets,
+                    int num_samples_per_packet);
+
+  // Decodes the packet at |next_timestamp_| into |packet_samples_|.
+  absl::Status DecodeNextPacket();
+
+  const std::unique_ptr<LyraStreamReader> reader_;
+  LyraDecoderInterface* const decoder_;
+  const int num_priming_packets_;
+  const int num_samples_per_packet_;
+  int64_t position_ = 0;
+  int64_t next_timestamp_ = 0;
+  // The next packet of |reader_| if it was read but is not due yet.
+  LyraStreamPacket packet_;
+  bool has_packet_ = false;
+  // The samples of the last decoded packet, of which the ones from
+  // |packet_samples_begin_| are not read yet.
+  std::vector<int16_t> packet_samples_;
+  int packet_samples_begin_ = 0;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_STREAM_DECODER_H_
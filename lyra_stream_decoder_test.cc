@@ -0,0 +1,198 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_stream_decoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_stream_file.h"
+#include "testing/mock_lyra_decoder.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::_;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+
+constexpr int kSampleRateHz = 8000;
+constexpr int kNumSamplesPerPacket = kSampleRateHz / 25;
+constexpr int kNumPackets = 60;
+constexpr int16_t kConcealedSample = -1;
+constexpr int16_t kComfortNoiseSample = -2;
+
+// Packets 20 to 22 are lost and packet 30 is empty. The mock decodes the
+// others to samples counting up from the start of the stream.
+class LyraStreamDecoderTest : public testing::Test {
+ protected:
+  LyraStreamDecoderTest()
+      : path_((ghc::filesystem::path(testing::TempDir()) / "decoder.lyras")
+                  .string()) {
+    LyraStreamHeader header;
+    header.sample_rate_hz = 16000;
+    header.index_interval_packets = 10;
+    absl::StatusOr<std::unique_ptr<LyraStreamWriter>> writer =
+        LyraStreamWriter::Create(path_, header);
+    EXPECT_TRUE(writer.ok());
+    for (int i = 0; i < kNumPackets; ++i) {
+      if (i >= 20 && i <= 22) {
+        continue;
+      }
+      const std::vector<uint8_t> payload =
+          i == 30 ? std::vector<uint8_t>() : std::vector<uint8_t>(1, i);
+      EXPECT_TRUE((*writer)->Write(i, payload).ok());
+    }
+    EXPECT_TRUE((*writer)->Close().ok());
+
+    ON_CALL(decoder_, sample_rate_hz()).WillByDefault(Return(kSampleRateHz));
+    ON_CALL(decoder_, num_channels()).WillByDefault(Return(1));
+    ON_CALL(decoder_, SetEncodedPacket(_))
+        .WillByDefault(Invoke([this](absl::Span<const uint8_t> encoded) {
+          decoded_packets_.push_back(encoded.empty() ? -1 : encoded[0]);
+          return true;
+        }));
+    ON_CALL(decoder_, DecodeSamples(testing::An<absl::Span<int16_t>>()))
+        .WillByDefault(Invoke([this](absl::Span<int16_t> samples) {
+          const int packet = decoded_packets_.back();
+          for (int i = 0; i < samples.size(); ++i) {
+            samples[i] = packet < 0 ? kComfortNoiseSample
+                                    : packet * kNumSamplesPerPacket + i;
+          }
+          return true;
+        }));
+    ON_CALL(decoder_, DecodePacketLoss(testing::An<absl::Span<int16_t>>()))
+        .WillByDefault(Invoke([this](absl::Span<int16_t> samples) {
+          decoded_packets_.push_back(-2);
+          std::fill(samples.begin(), samples.end(), kConcealedSample);
+          return true;
+        }));
+    ON_CALL(decoder_, Reset()).WillByDefault(Invoke([this]() {
+      decoded_packets_.clear();
+    }));
+  }
+
+  std::unique_ptr<LyraStreamDecoder> CreateStreamDecoder() {
+    absl::StatusOr<std::unique_ptr<LyraStreamReader>> reader =
+        LyraStreamReader::Open(path_);
+    EXPECT_TRUE(reader.ok());
+    absl::StatusOr<std::unique_ptr<LyraStreamDecoder>> stream_decoder =
+        LyraStreamDecoder::Create(*std::move(reader), &decoder_);
+    EXPECT_TRUE(stream_decoder.ok());
+    return *std::move(stream_decoder);
+  }
+
+  const std::string path_;
+  NiceMock<MockLyraDecoder> decoder_;
+  // The first byte of each packet set on the decoder, -1 for empty ones and
+  // -2 for concealed ones, since the last reset.
+  std::vector<int> decoded_packets_;
+};
+
+TEST_F(LyraStreamDecoderTest, ReadsTheWholeStream) {
+  std::unique_ptr<LyraStreamDecoder> stream_decoder = CreateStreamDecoder();
+  ASSERT_NE(stream_decoder, nullptr);
+  EXPECT_EQ(stream_decoder->num_samples_per_packet(), kNumSamplesPerPacket);
+  EXPECT_EQ(stream_decoder->num_samples(), kNumPackets * kNumSamplesPerPacket);
+
+  // Reads in chunks that do not line up with the packets.
+  std::vector<int16_t> samples(stream_decoder->num_samples() + 100);
+  int num_read = 0;
+  while (true) {
+    const absl::StatusOr<int> read = stream_decoder->Read(absl::MakeSpan(
+        samples.data() + num_read,
+        std::min<int>(123, samples.size() - num_read)));
+    ASSERT_TRUE(read.ok());
+    if (*read == 0) {
+      break;
+    }
+    num_read += *read;
+  }
+  EXPECT_EQ(num_read, stream_decoder->num_samples());
+  EXPECT_EQ(stream_decoder->position(), stream_decoder->num_samples());
+  EXPECT_EQ(decoded_packets_.size(), kNumPackets);
+  EXPECT_EQ(samples[19 * kNumSamplesPerPacket + 5],
+            19 * kNumSamplesPerPacket + 5);
+  EXPECT_EQ(samples[21 * kNumSamplesPerPacket], kConcealedSample);
+  EXPECT_EQ(samples[30 * kNumSamplesPerPacket], kComfortNoiseSample);
+  EXPECT_EQ(samples[kNumPackets * kNumSamplesPerPacket - 1],
+            kNumPackets * kNumSamplesPerPacket - 1);
+}
+
+TEST_F(LyraStreamDecoderTest, SeekPrimesAResetDecoder) {
+  std::unique_ptr<LyraStreamDecoder> stream_decoder = CreateStreamDecoder();
+  ASSERT_NE(stream_decoder, nullptr);
+  EXPECT_CALL(decoder_, Reset()).Times(2);
+
+  const int64_t sample = 45 * kNumSamplesPerPacket + 7;
+  ASSERT_TRUE(stream_decoder->Seek(sample).ok());
+  EXPECT_EQ(stream_decoder->position(), sample);
+  // The priming packets and the one the position is in.
+  EXPECT_EQ(decoded_packets_, std::vector<int>({41, 42, 43, 44, 45}));
+
+  std::vector<int16_t> samples(2);
+  ASSERT_TRUE(stream_decoder->Read(absl::MakeSpan(samples)).ok());
+  EXPECT_EQ(samples, std::vector<int16_t>({sample, sample + 1}));
+  EXPECT_EQ(stream_decoder->position(), sample + 2);
+
+  // Priming conceals the lost packets as they would have been live.
+  ASSERT_TRUE(stream_decoder->Seek(24 * kNumSamplesPerPacket).ok());
+  EXPECT_EQ(decoded_packets_, std::vector<int>({-2, -2, -2, 23}));
+  ASSERT_TRUE(stream_decoder->Read(absl::MakeSpan(samples)).ok());
+  EXPECT_EQ(samples[0], 24 * kNumSamplesPerPacket);
+}
+
+TEST_F(LyraStreamDecoderTest, SeekToTheEnds) {
+  std::unique_ptr<LyraStreamDecoder> stream_decoder = CreateStreamDecoder();
+  ASSERT_NE(stream_decoder, nullptr);
+  std::vector<int16_t> samples(kNumSamplesPerPacket);
+
+  ASSERT_TRUE(stream_decoder->Seek(stream_decoder->num_samples()).ok());
+  absl::StatusOr<int> read = stream_decoder->Read(absl::MakeSpan(samples));
+  ASSERT_TRUE(read.ok());
+  EXPECT_EQ(*read, 0);
+
+  ASSERT_TRUE(stream_decoder->Seek(0).ok());
+  EXPECT_TRUE(decoded_packets_.empty());
+  read = stream_decoder->Read(absl::MakeSpan(samples));
+  ASSERT_TRUE(read.ok());
+  EXPECT_EQ(*read, kNumSamplesPerPacket);
+  EXPECT_EQ(samples[0], 0);
+
+  EXPECT_FALSE(stream_decoder->Seek(-1).ok());
+  EXPECT_FALSE(stream_decoder->Seek(stream_decoder->num_samples() + 1).ok());
+}
+
+TEST_F(LyraStreamDecoderTest, ChannelsHaveToMatch) {
+  ON_CALL(decoder_, num_channels()).WillByDefault(Return(2));
+  absl::StatusOr<std::unique_ptr<LyraStreamReader>> reader =
+      LyraStreamReader::Open(path_);
+  ASSERT_TRUE(reader.ok());
+  EXPECT_FALSE(
+      LyraStreamDecoder::Create(*std::move(reader), &decoder_).ok());
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,367 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_stream_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// The header is the magic, the version, the flags, the sample rate, the
+// number of channels, the packet duration and the index interval.
+constexpr absl::string_view kHeaderMagic = "LyrS";
+constexpr int kHeaderSize = 20;
+constexpr uint32_t kDtxFlag = 1;
+// A record is the timestamp and the payload size, followed by the payload.
+constexpr int kRecordHeaderSize = 6;
+// An index entry is the timestamp and the offset of a record.
+constexpr int kIndexEntrySize = 12;
+// The footer after the index entries is their number, the end timestamp,
+// the offset of the index and the magic.
+constexpr absl::string_view kFooterMagic = "LyrI";
+constexpr int kFooterSize = 20;
+
+uint64_t LittleEndian(const char* bytes, int num_bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < num_bytes; ++i) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+void AppendLittleEndian(uint64_t value, int num_bytes, std::string* bytes) {
+  for (int i = 0; i < num_bytes; ++i) {
+    bytes->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+absl::Status ValidateHeader(const LyraStreamHeader& header) {
+  if (header.sample_rate_hz < 1 || header.num_channels < 1 ||
+      header.num_channels > UINT16_MAX || header.packet_duration_ms < 1 ||
+      header.packet_duration_ms > UINT16_MAX ||
+      header.index_interval_packets < 1) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid Lyra stream of ", header.num_channels, " channels at ",
+        header.sample_rate_hz, " Hz with packets of ",
+        header.packet_duration_ms, " ms indexed every ",
+        header.index_interval_packets, " packets."));
+  }
+  return absl::OkStatus();
+}
+
+// Whether the record at |timestamp| gets an entry when the last one was at
+// |index|.
+bool IsIndexed(const std::vector<LyraStreamIndexEntry>& index,
+               int64_t timestamp, int index_interval_packets) {
+  return index.empty() ||
+         timestamp >= index.back().timestamp + index_interval_packets;
+}
+
+}  // namespace
+
+bool IsLyraStreamFile(const std::string& file_name) {
+  std::ifstream file(file_name, std::ios::binary);
+  char magic[4];
+  return file.read(magic, sizeof(magic)) &&
+         absl::string_view(magic, sizeof(magic)) == kHeaderMagic;
+}
+
+absl::StatusOr<std::unique_ptr<LyraStreamWriter>> LyraStreamWriter::Create(
+    const std::string& file_name, const LyraStreamHeader& header) {
+  const absl::Status valid = ValidateHeader(header);
+  if (!valid.ok()) {
+    return valid;
+  }
+  std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+  std::string bytes(kHeaderMagic);
+  AppendLittleEndian(kLyraStreamVersion, 2, &bytes);
+  AppendLittleEndian(header.dtx_enabled ? kDtxFlag : 0, 2, &bytes);
+  AppendLittleEndian(header.sample_rate_hz, 4, &bytes);
+  AppendLittleEndian(header.num_channels, 2, &bytes);
+  AppendLittleEndian(header.packet_duration_ms, 2, &bytes);
+  AppendLittleEndian(header.index_interval_packets, 4, &bytes);
+  file.write(bytes.data(), bytes.size());
+  if (!file.good()) {
+    return absl::AbortedError(
+        absl::StrCat("Failed to write to Lyra stream at: ", file_name));
+  }
+  return absl::WrapUnique(
+      new LyraStreamWriter(std::move(file), file_name, header));
+}
+
+LyraStreamWriter::LyraStreamWriter(std::ofstream file, std::string file_name,
+                                   const LyraStreamHeader& header)
+    : file_(std::move(file)),
+      file_name_(std::move(file_name)),
+      header_(header),
+      offset_(kHeaderSize) {}
+
+LyraStreamWriter::~LyraStreamWriter() {
+  if (file_.is_open()) {
+    Close().IgnoreError();
+  }
+}
+
+absl::Status LyraStreamWriter::Write(int64_t timestamp,
+                                     absl::Span<const uint8_t> payload) {
+  if (!file_.is_open()) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Lyra stream at ", file_name_, " was already closed."));
+  }
+  if (timestamp < end_timestamp_) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Packet at ", timestamp, " is not after the one at ",
+                     end_timestamp_ - 1, "."));
+  }
+  // The end timestamp, one past the last packet, has to fit 32 bits as well.
+  if (timestamp >= std::numeric_limits<uint32_t>::max()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Packet timestamp ", timestamp, " does not fit 32 bits."));
+  }
+  if (payload.size() > kMaxLyraStreamPayloadSize) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Payload of ", payload.size(), " bytes is too large."));
+  }
+  if (IsIndexed(index_, timestamp, header_.index_interval_packets)) {
+    index_.push_back({timestamp, offset_});
+  }
+  buffer_.clear();
+  AppendLittleEndian(timestamp, 4, &buffer_);
+  AppendLittleEndian(payload.size(), 2, &buffer_);
+  buffer_.append(payload.begin(), payload.end());
+  file_.write(buffer_.data(), buffer_.size());
+  if (!file_.good()) {
+    return absl::AbortedError(
+        absl::StrCat("Failed to write to Lyra stream at: ", file_name_));
+  }
+  offset_ += buffer_.size();
+  end_timestamp_ = timestamp + 1;
+  return absl::OkStatus();
+}
+
+absl::Status LyraStreamWriter::Close() {
+  if (!file_.is_open()) {
+    return absl::OkStatus();
+  }
+  buffer_.clear();
+  for (const LyraStreamIndexEntry& entry : index_) {
+    AppendLittleEndian(entry.timestamp, 4, &buffer_);
+    AppendLittleEndian(entry.offset, 8, &buffer_);
+  }
+  AppendLittleEndian(index_.size(), 4, &buffer_);
+  AppendLittleEndian(end_timestamp_, 4, &buffer_);
+  AppendLittleEndian(offset_, 8, &buffer_);
+  buffer_.append(kFooterMagic.begin(), kFooterMagic.end());
+  file_.write(buffer_.data(), buffer_.size());
+  file_.close();
+  if (!file_.good()) {
+    return absl::AbortedError(
+        absl::StrCat("Failed to write to Lyra stream at: ", file_name_));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::unique_ptr<LyraStreamReader>> LyraStreamReader::Open(
+    const std::string& file_name) {
+  const auto invalid = [&file_name](absl::string_view reason) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to read Lyra stream at ", file_name, ", ",
+                     reason));
+  };
+  std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return absl::NotFoundError(
+        absl::StrCat("Failed to open Lyra stream at: ", file_name));
+  }
+  const int64_t file_size = file.tellg();
+  file.seekg(0);
+  char bytes[kHeaderSize];
+  if (!file.read(bytes, sizeof(bytes)) ||
+      absl::string_view(bytes, kHeaderMagic.size()) != kHeaderMagic) {
+    return invalid("not a Lyra stream.");
+  }
+  LyraStreamHeader header;
+  header.version = LittleEndian(bytes + 4, 2);
+  header.dtx_enabled = (LittleEndian(bytes + 6, 2) & kDtxFlag) != 0;
+  header.sample_rate_hz = LittleEndian(bytes + 8, 4);
+  header.num_channels = LittleEndian(bytes + 12, 2);
+  header.packet_duration_ms = LittleEndian(bytes + 14, 2);
+  header.index_interval_packets = LittleEndian(bytes + 16, 4);
+  if (header.version != kLyraStreamVersion) {
+    return invalid(absl::StrCat("version ", header.version,
+                                " is not supported."));
+  }
+  if (!ValidateHeader(header).ok()) {
+    return invalid("the header is invalid.");
+  }
+  auto reader =
+      absl::WrapUnique(new LyraStreamReader(std::move(file), header));
+  const absl::Status index_status = reader->ReadIndex(file_size);
+  if (!index_status.ok()) {
+    return invalid(index_status.message());
+  }
+  return reader;
+}
+
+LyraStreamReader::LyraStreamReader(std::ifstream file,
+                                   const LyraStreamHeader& header)
+    : file_(std::move(file)), header_(header), offset_(kHeaderSize) {}
+
+absl::Status LyraStreamReader::ReadIndex(int64_t file_size) {
+  if (file_size < kHeaderSize + kFooterSize) {
+    return BuildIndex(file_size);
+  }
+  char footer[kFooterSize];
+  file_.seekg(file_size - kFooterSize);
+  if (!file_.read(footer, sizeof(footer)) ||
+      absl::string_view(footer + 16, kFooterMagic.size()) != kFooterMagic) {
+    return BuildIndex(file_size);
+  }
+  const int64_t num_entries = LittleEndian(footer, 4);
+  const int64_t end_timestamp = LittleEndian(footer + 4, 4);
+  const int64_t index_offset = LittleEndian(footer + 8, 8);
+  if (index_offset < kHeaderSize ||
+      index_offset + num_entries * kIndexEntrySize + kFooterSize !=
+          file_size) {
+    return BuildIndex(file_size);
+  }
+  std::vector<char> entries(num_entries * kIndexEntrySize);
+  file_.seekg(index_offset);
+  if (!file_.read(entries.data(), entries.size())) {
+    return absl::DataLossError("the index is cut off.");
+  }
+  index_.reserve(num_entries);
+  for (int64_t i = 0; i < num_entries; ++i) {
+    const char* entry = entries.data() + i * kIndexEntrySize;
+    const LyraStreamIndexEntry parsed = {
+        static_cast<int64_t>(LittleEndian(entry, 4)),
+        static_cast<int64_t>(LittleEndian(entry + 4, 8))};
+    if (parsed.timestamp >= end_timestamp || parsed.offset < kHeaderSize ||
+        parsed.offset >= index_offset ||
+        (!index_.empty() && (parsed.timestamp <= index_.back().timestamp ||
+                             parsed.offset <= index_.back().offset))) {
+      return absl::DataLossError(
+          absl::StrCat("index entry ", i, " is out of order."));
+    }
+    index_.push_back(parsed);
+  }
+  data_end_ = index_offset;
+  end_timestamp_ = end_timestamp;
+  has_stored_index_ = true;
+  return Seek(0);
+}
+
+absl::Status LyraStreamReader::BuildIndex(int64_t file_size) {
+  LOG(WARNING) << "Lyra stream has no index, reading every record.";
+  // Every record is read up to the last whole one, which is where a
+  // recording that was cut off ends.
+  data_end_ = file_size;
+  offset_ = kHeaderSize;
+  file_.clear();
+  file_.seekg(offset_);
+  LyraStreamPacket packet;
+  while (offset_ + kRecordHeaderSize <= file_size) {
+    const int64_t record_offset = offset_;
+    if (!ReadRecord(&packet).ok()) {
+      offset_ = record_offset;
+      break;
+    }
+    if (packet.timestamp < end_timestamp_) {
+      return absl::DataLossError(absl::StrCat(
+          "the record at byte ", record_offset, " is out of order."));
+    }
+    if (IsIndexed(index_, packet.timestamp, header_.index_interval_packets)) {
+      index_.push_back({packet.timestamp, record_offset});
+    }
+    end_timestamp_ = packet.timestamp + 1;
+  }
+  data_end_ = offset_;
+  return Seek(0);
+}
+
+absl::Status LyraStreamReader::ReadRecord(LyraStreamPacket* packet) {
+  char record_header[kRecordHeaderSize];
+  if (!file_.read(record_header, sizeof(record_header))) {
+    return absl::DataLossError(
+        absl::StrCat("the record at byte ", offset_, " is cut off."));
+  }
+  packet->timestamp = LittleEndian(record_header, 4);
+  packet->payload.resize(LittleEndian(record_header + 4, 2));
+  if (!file_.read(reinterpret_cast<char*>(packet->payload.data()),
+                  packet->payload.size())) {
+    return absl::DataLossError(
+        absl::StrCat("the record at byte ", offset_, " is cut off."));
+  }
+  offset_ += kRecordHeaderSize + packet->payload.size();
+  return absl::OkStatus();
+}
+
+absl::StatusOr<bool> LyraStreamReader::Read(LyraStreamPacket* packet) {
+  if (offset_ >= data_end_) {
+    return false;
+  }
+  const absl::Status status = ReadRecord(packet);
+  if (!status.ok()) {
+    return status;
+  }
+  return true;
+}
+
+absl::Status LyraStreamReader::Seek(int64_t timestamp) {
+  // The last entry at or before |timestamp|, from where at most an interval
+  // of records is read.
+  const auto after = std::upper_bound(
+      index_.begin(), index_.end(), timestamp,
+      [](int64_t timestamp, const LyraStreamIndexEntry& entry) {
+        return timestamp < entry.timestamp;
+      });
+  offset_ = after == index_.begin() ? kHeaderSize : std::prev(after)->offset;
+  file_.clear();
+  file_.seekg(offset_);
+  LyraStreamPacket packet;
+  while (offset_ < data_end_) {
+    const int64_t record_offset = offset_;
+    const absl::Status status = ReadRecord(&packet);
+    if (!status.ok()) {
+      return status;
+    }
+    if (packet.timestamp >= timestamp) {
+      offset_ = record_offset;
+      file_.seekg(offset_);
+      break;
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_LYRA_STREAM_FILE_H_
+#define LYRA_CODEC_LYRA_STREAM_FILE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A file of Lyra packets that can be played back from any position, unlike
+// the raw concatenated packets of a .lyra file.
+//
+// The file starts with a header holding the format of the stream, followed by
+// one record per packet: the timestamp of the packet in packets since the
+// start of the stream, the size of the payload and the payload. An empty
+// payload marks a packet DTX found to be silent, and timestamps without a
+// record are packets that were lost. The file ends with an index of the
+// records at about every |index_interval_packets| packets, so that a reader
+// finds the records around any position without reading the ones before.
+// All numbers are little endian.
+
+// The version of the format written by |LyraStreamWriter|.
+inline constexpr int kLyraStreamVersion = 1;
+
+// The largest payload of a record.
+inline constexpr int kMaxLyraStreamPayloadSize = UINT16_MAX;
+
+struct LyraStreamHeader {
+  // The version the file was written with. Ignored by |LyraStreamWriter|.
+  int version = kLyraStreamVersion;
+  // The sample rate of the encoded audio, which the decoder does not have to
+  // match.
+  int sample_rate_hz = 16000;
+  int num_channels = 1;
+  // The duration of the audio of each packet.
+  int packet_duration_ms = 40;
+  // Whether the encoder ran with DTX.
+  bool dtx_enabled = false;
+  // An entry of the index is kept about every this many packets.
+  int index_interval_packets = 25;
+};
+
+struct LyraStreamPacket {
+  // In packets since the start of the stream.
+  int64_t timestamp = 0;
+  // Empty for a packet DTX found to be silent.
+  std::vector<uint8_t> payload;
+};
+
+// The position of the first record at or after |timestamp|.
+struct LyraStreamIndexEntry {
+  int64_t timestamp;
+  int64_t offset;
+};
+
+// Returns true if |file_name| starts like a file of |LyraStreamWriter|, as
+// opposed to one of raw concatenated packets.
+bool IsLyraStreamFile(const std::string& file_name);
+
+// Writes a file of Lyra packets record by record. The index is written by
+// |Close|.
+class LyraStreamWriter {
+ public:
+  // Creates |file_name| and writes |header|. Returns an error if the file
+  // cannot be created or |header| is invalid.
+  static absl::StatusOr<std::unique_ptr<LyraStreamWriter>> Create(
+      const std::string& file_name, const LyraStreamHeader& header);
+
+  // Closes the file if |Close| was not called, ignoring errors.
+  ~LyraStreamWriter();
+
+  // Appends the packet at |timestamp|, which has to be later than that of the
+  // previous packet. Packets skipped in between are lost to the reader.
+  // |payload| is empty for a packet DTX found to be silent.
+  absl::Status Write(int64_t timestamp, absl::Span<const uint8_t> payload);
+
+  // Writes the index and closes the file.
+  absl::Status Close();
+
+  // The timestamp after that of the last written packet.
+  int64_t end_timestamp() const { return end_timestamp_; }
+
+ private:
+  LyraStreamWriter(std::ofstream file, std::string file_name,
+                   const LyraStreamHeader& header);
+
+  std::ofstream file_;
+  const std::string file_name_;
+  const LyraStreamHeader header_;
+  int64_t offset_;
+  int64_t end_timestamp_ = 0;
+  std::vector<LyraStreamIndexEntry> index_;
+  std::string buffer_;
+};
+
+// Reads the packets of a file written by |LyraStreamWriter| in order from any
+// position. A file whose writer did not get to |Close| it, e.g. because the
+// recording was cut off, is read up to its last whole record, after building
+// the index by reading every record once.
+class LyraStreamReader {
+ public:
+  // Opens |file_name| and reads its header and index. Returns an error if the
+  // file cannot be read or was not written by |LyraStreamWriter|.
+  static absl::StatusOr<std::unique_ptr<LyraStreamReader>> Open(
+      const std::string& file_name);
+
+  // Reads the next packet into |packet|. Returns false after the last one.
+  absl::StatusOr<bool> Read(LyraStreamPacket* packet);
+
+  // Moves to the first packet at or after |timestamp|, which is found from
+  // the index by reading at most |index_interval_packets| records.
+  absl::Status Seek(int64_t timestamp);
+
+  const LyraStreamHeader& header() const { return header_; }
+
+  // The timestamp after that of the last packet, i.e. the length of the
+  // stream in packets.
+  int64_t end_timestamp() const { return end_timestamp_; }
+
+  const std::vector<LyraStreamIndexEntry>& index() const { return index_; }
+
+  // Whether the index was read from the file rather than rebuilt.
+  bool has_stored_index() const { return has_stored_index_; }
+
+ private:
+  LyraStreamReader(std::ifstream file, const LyraStreamHeader& header);
+
+  // Reads the index at the end of the file, or builds it and finds the end
+  // of the last whole record if there is none.
+  absl::Status ReadIndex(int64_t file_size);
+  absl::Status BuildIndex(int64_t file_size);
+
+  // Reads the record at |offset_| into |packet| without checking that it
+  // ends before |data_end_|.
+  absl::Status ReadRecord(LyraStreamPacket* packet);
+
+  std::ifstream file_;
+  const LyraStreamHeader header_;
+  // The offset of the next record, and the end of the records.
+  int64_t offset_;
+  int64_t data_end_ = 0;
+  int64_t end_timestamp_ = 0;
+  std::vector<LyraStreamIndexEntry> index_;
+  bool has_stored_index_ = false;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_LYRA_STREAM_FILE_H_
@@ -0,0 +1,207 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lyra_stream_file.h"
+
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+class LyraStreamFileTest : public testing::Test {
+ protected:
+  LyraStreamFileTest()
+      : path_((ghc::filesystem::path(testing::TempDir()) / "stream.lyras")
+                  .string()) {
+    header_.sample_rate_hz = 48000;
+    header_.num_channels = 2;
+    header_.dtx_enabled = true;
+    header_.index_interval_packets = 10;
+  }
+
+  // Writes packets 0 to |num_packets| - 1 except every seventh one, which is
+  // lost, and every fifth one, which is empty. The payload of the others is
+  // their timestamp.
+  void WriteStream(int num_packets) {
+    absl::StatusOr<std::unique_ptr<LyraStreamWriter>> writer =
+        LyraStreamWriter::Create(path_, header_);
+    ASSERT_TRUE(writer.ok()) << writer.status();
+    for (int i = 0; i < num_packets; ++i) {
+      if (i % 7 == 6) {
+        continue;
+      }
+      const std::vector<uint8_t> payload =
+          i % 5 == 4 ? std::vector<uint8_t>()
+                     : std::vector<uint8_t>{static_cast<uint8_t>(i), 0xff};
+      ASSERT_TRUE((*writer)->Write(i, payload).ok());
+    }
+    ASSERT_TRUE((*writer)->Close().ok());
+  }
+
+  // Reads the rest of |reader| and checks it holds what |WriteStream| wrote
+  // from |timestamp|.
+  void ExpectStreamFrom(int64_t timestamp, int num_packets,
+                        LyraStreamReader* reader) {
+    LyraStreamPacket packet;
+    for (; timestamp < num_packets; ++timestamp) {
+      if (timestamp % 7 == 6) {
+        continue;
+      }
+      absl::StatusOr<bool> read = reader->Read(&packet);
+      ASSERT_TRUE(read.ok()) << read.status();
+      ASSERT_TRUE(*read);
+      EXPECT_EQ(packet.timestamp, timestamp);
+      if (timestamp % 5 == 4) {
+        EXPECT_TRUE(packet.payload.empty());
+      } else {
+        EXPECT_EQ(packet.payload,
+                  std::vector<uint8_t>({static_cast<uint8_t>(timestamp),
+                                        0xff}));
+      }
+    }
+    absl::StatusOr<bool> read = reader->Read(&packet);
+    ASSERT_TRUE(read.ok());
+    EXPECT_FALSE(*read);
+  }
+
+  const std::string path_;
+  LyraStreamHeader header_;
+};
+
+TEST_F(LyraStreamFileTest, RoundTrip) {
+  WriteStream(100);
+  EXPECT_TRUE(IsLyraStreamFile(path_));
+
+  absl::StatusOr<std::unique_ptr<LyraStreamReader>> reader =
+      LyraStreamReader::Open(path_);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  EXPECT_TRUE((*reader)->has_stored_index());
+  EXPECT_EQ((*reader)->header().version, kLyraStreamVersion);
+  EXPECT_EQ((*reader)->header().sample_rate_hz, 48000);
+  EXPECT_EQ((*reader)->header().num_channels, 2);
+  EXPECT_EQ((*reader)->header().packet_duration_ms, 40);
+  EXPECT_TRUE((*reader)->header().dtx_enabled);
+  EXPECT_EQ((*reader)->end_timestamp(), 100);
+  EXPECT_EQ((*reader)->index().size(), 10);
+  ExpectStreamFrom(0, 100, reader->get());
+}
+
+TEST_F(LyraStreamFileTest, SeekFindsTheFirstPacketAtOrAfter) {
+  WriteStream(100);
+  absl::StatusOr<std::unique_ptr<LyraStreamReader>> reader =
+      LyraStreamReader::Open(path_);
+  ASSERT_TRUE(reader.ok());
+
+  // Packet 62 was lost, so the first one after it is read.
+  for (const int64_t timestamp : {62, 95, 0, 10, 40}) {
+    ASSERT_TRUE((*reader)->Seek(timestamp).ok());
+    LyraStreamPacket packet;
+    absl::StatusOr<bool> read = (*reader)->Read(&packet);
+    ASSERT_TRUE(read.ok());
+    ASSERT_TRUE(*read);
+    EXPECT_EQ(packet.timestamp, timestamp == 62 ? 63 : timestamp);
+  }
+  ASSERT_TRUE((*reader)->Seek(37).ok());
+  ExpectStreamFrom(37, 100, reader->get());
+  ASSERT_TRUE((*reader)->Seek(100).ok());
+  ExpectStreamFrom(100, 100, reader->get());
+}
+
+TEST_F(LyraStreamFileTest, UnclosedFileIsReadUpToTheLastWholeRecord) {
+  WriteStream(50);
+  // Cuts off the index of 5 entries with its footer, and the last byte of the
+  // empty record of packet 49, as if the recording had stopped there. Packet
+  // 48 was lost, so the stream ends after 47.
+  const uintmax_t size = ghc::filesystem::file_size(path_);
+  ghc::filesystem::resize_file(path_, size - 5 * 12 - 20 - 1);
+
+  absl::StatusOr<std::unique_ptr<LyraStreamReader>> reader =
+      LyraStreamReader::Open(path_);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  EXPECT_FALSE((*reader)->has_stored_index());
+  EXPECT_EQ((*reader)->end_timestamp(), 48);
+  EXPECT_EQ((*reader)->index().size(), 5);
+  ExpectStreamFrom(0, 48, reader->get());
+  ASSERT_TRUE((*reader)->Seek(33).ok());
+  ExpectStreamFrom(33, 48, reader->get());
+}
+
+TEST_F(LyraStreamFileTest, EmptyStream) {
+  WriteStream(0);
+  absl::StatusOr<std::unique_ptr<LyraStreamReader>> reader =
+      LyraStreamReader::Open(path_);
+  ASSERT_TRUE(reader.ok()) << reader.status();
+  EXPECT_EQ((*reader)->end_timestamp(), 0);
+  ExpectStreamFrom(0, 0, reader->get());
+}
+
+TEST_F(LyraStreamFileTest, TimestampsHaveToIncrease) {
+  absl::StatusOr<std::unique_ptr<LyraStreamWriter>> writer =
+      LyraStreamWriter::Create(path_, header_);
+  ASSERT_TRUE(writer.ok());
+  ASSERT_TRUE((*writer)->Write(3, {}).ok());
+  EXPECT_FALSE((*writer)->Write(3, {}).ok());
+  EXPECT_FALSE((*writer)->Write(2, {}).ok());
+  EXPECT_EQ((*writer)->end_timestamp(), 4);
+  ASSERT_TRUE((*writer)->Close().ok());
+  EXPECT_EQ((*writer)->Write(4, {}).code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST_F(LyraStreamFileTest, TimestampsHaveToFit32Bits) {
+  absl::StatusOr<std::unique_ptr<LyraStreamWriter>> writer =
+      LyraStreamWriter::Create(path_, header_);
+  ASSERT_TRUE(writer.ok());
+  const int64_t too_large = std::numeric_limits<uint32_t>::max();
+  const absl::Status status = (*writer)->Write(too_large, {});
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(std::string(status.message()), HasSubstr("32 bits"));
+  EXPECT_EQ((*writer)->end_timestamp(), 0);
+  EXPECT_TRUE((*writer)->Write(too_large - 1, {}).ok());
+  ASSERT_TRUE((*writer)->Close().ok());
+}
+
+TEST_F(LyraStreamFileTest, InvalidHeaderIsRejected) {
+  header_.index_interval_packets = 0;
+  EXPECT_FALSE(LyraStreamWriter::Create(path_, header_).ok());
+}
+
+TEST_F(LyraStreamFileTest, RawPacketsAreNotAStream) {
+  {
+    std::ofstream file(path_, std::ios::binary);
+    file << std::string(30, 'x');
+  }
+  EXPECT_FALSE(IsLyraStreamFile(path_));
+  EXPECT_FALSE(LyraStreamReader::Open(path_).ok());
+  EXPECT_EQ(LyraStreamReader::Open(path_ + ".missing").status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
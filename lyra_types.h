@@ -25,6 +25,25 @@
 namespace chromemedia {
 namespace codec {
 
+// Type the precomputed conditioning is stored in between the conditioning
+// stack and the GRU gates, whose input type is |GateInputType|. It is the
+// gate input type itself unless the build is made with
+// USE_BFLOAT16_CONDITIONING or USE_FIXED16_CONDITIONING, independent of the
+// compute type. Either 16 bit type halves the conditioning every decoder keeps,
+// bfloat16 at a relative precision of 8 bits and fixed16 at the
+// |kFixed16ExponentBits| integer bits of the output of the last layer of the
+// stack.
+#if defined(USE_BFLOAT16_CONDITIONING)
+template <typename GateInputType, int kFixed16ExponentBits>
+using ConditioningStorageType = csrblocksparse::bfloat16;
+#elif defined(USE_FIXED16_CONDITIONING)
+template <typename GateInputType, int kFixed16ExponentBits>
+using ConditioningStorageType = csrblocksparse::fixed16<kFixed16ExponentBits>;
+#else
+template <typename GateInputType, int kFixed16ExponentBits>
+using ConditioningStorageType = GateInputType;
+#endif  // defined(USE_BFLOAT16_CONDITIONING)
+
 // Type inference for the LyraWavegru class, including bit allocations for
 // fixed-point types.
 template <typename WeightTypeKind,
@@ -154,7 +173,9 @@ struct ConditioningTypes<
   using ConvToGatesRhsType = float;
 
   using ConvToGatesOutType = float;
-  using OutputType = typename WavegruTypes<WeightTypeKind>::GruRhsType;
+  using OutputType = ConditioningStorageType<
+      typename WavegruTypes<WeightTypeKind>::GruRhsType,
+      kConvToGatesWeightExponentBits + kConvToGatesRhsExponentBits>;
 };
 
 template <typename WeightTypeKind, int kConv1DWeightExponentBits,
@@ -223,7 +244,9 @@ struct ConditioningTypes<
   using ConvToGatesOutType =
       typename csrblocksparse::TypeOfProduct<ConvToGatesWeightType,
                                              ConvToGatesRhsType>::type;
-  using OutputType = typename WavegruTypes<WeightTypeKind>::GruRhsType;
+  using OutputType = ConditioningStorageType<
+      typename WavegruTypes<WeightTypeKind>::GruRhsType,
+      kConvToGatesWeightExponentBits + kConvToGatesRhsExponentBits>;
 };
 
 template <typename WeightTypeKind,
@@ -18,27 +18,42 @@
 #define LYRA_CODEC_LYRA_WAVEGRU_H_
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <random>
 #include <string>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
-#include "absl/time/clock.h"  // for SleepFor
-#include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "activation_arena.h"
+#include "adaptive_barrier.h"
 #include "causal_convolutional_conditioning.h"
+#include "cpu_features.h"
 #include "dsp_util.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
+#include "layer_wrapper_interface.h"
 #include "layer_wrappers_lib.h"
+#include "lyra_model.h"
 #include "lyra_types.h"
+#include "model_dimensions.h"
+#include "model_unpacker.h"
+#include "parallel_load.h"
 #include "project_and_sample.h"
+#include "row_progress.h"
 #include "sparse_inference_matrixvector.h"
+#include "stage_profiler.h"
+#include "state_buffer.h"
+#include "thread_partition.h"
+#include "tracing.h"
 
 namespace chromemedia {
 namespace codec {
@@ -56,32 +71,55 @@ class LyraWavegru {
   using DiskWeightType = typename Types::DiskWeightType;
   using ScratchType = typename Types::ScratchType;
 
-  using ArLayerType =
-      LayerWrapper<ArWeightType, ArRhsType, ArOutputType, DiskWeightType>;
-  using GruLayerType =
-      LayerWrapper<GruWeightType, GruStateType, GruRhsType, DiskWeightType>;
+  // The layers are held by their final types, so that the calls made for
+  // every sample are resolved statically and can be inlined.
+  using ArLayerType = Conv1DLayerWrapper<ArWeightType, ArRhsType, ArOutputType,
+                                         DiskWeightType>;
+  using GruLayerType = Conv1DLayerWrapper<GruWeightType, GruStateType,
+                                          GruRhsType, DiskWeightType>;
 
   using ConditioningType =
       CausalConvolutionalConditioning<ConditioningTypes<WeightTypeKind>>;
+  // The type the conditioning is stored in, see |ConditioningStorageType|.
+  using ConditioningOutputType = typename ConditioningType::OutputType;
 
   // TODO(b/161747203): Use LayerWrapper for the project and sample layer.
   using ProjectAndSampleType =
       ProjectAndSample<ProjectAndSampleTypes<WeightTypeKind>>;
 
+  // If |model| is not null the weights are looked up in and added to it, so
+  // they are shared with every other instance created through the same model.
+  // The activations of the sampling loop are carved from one arena of this
+  // instance, which is backed by huge pages if |use_huge_pages| is true and
+  // the platform has them. |dimensions| have to match the weights.
   static std::unique_ptr<LyraWavegru<WeightTypeKind>> Create(
       int num_threads, const ghc::filesystem::path& path,
-      const std::string& prefix) {
+      const std::string& prefix, LyraModel* model = nullptr,
+      bool use_huge_pages = false,
+      const ModelDimensions& dimensions = ModelDimensions()) {
+    // The sparse multiplication kernels are selected when the sparse
+    // inference library is compiled, the sampling kernels at runtime.
 #if defined __aarch64__
     LOG(INFO)
         << "lyra_wavegru running fast multiplication kernels for aarch64.";
 #elif defined __AVX__
     LOG(INFO) << "lyra_wavegru running fast multiplication kernels for AVX.";
 #else   // defined __AVX__
-    LOG(WARNING) << "lyra_wavegru running in slow generic mode.";
+    LOG(WARNING) << "lyra_wavegru running generic multiplication kernels.";
 #endif  // defined __aarch64__
-
-    LayerParams ar_to_gates_params{.num_input_channels = kNumSplitBands,
-                                   .num_filters = 3 * kNumGruHiddens,
+    LOG(INFO) << "lyra_wavegru running sampling kernels for "
+              << CpuIsaName(DetectCpuIsa()) << ".";
+
+    const int num_gru_hiddens = dimensions.num_gru_hiddens;
+    const int num_split_bands = dimensions.num_split_bands;
+    if (!IsNumSplitBandsSupported(num_split_bands)) {
+      LOG(ERROR) << "Models with " << num_split_bands
+                 << " split bands are not supported.";
+      return nullptr;
+    }
+    const bool zipped = IsZippedModel(path, prefix);
+    LayerParams ar_to_gates_params{.num_input_channels = num_split_bands,
+                                   .num_filters = 3 * num_gru_hiddens,
                                    .length = 1,
                                    .kernel_size = 1,
                                    .dilation = 1,
@@ -94,16 +132,13 @@ class LyraWavegru {
                                    .from =
                                        LayerParams::FromDisk{
                                            .path = path.string(),
-                                           .zipped = true,
+                                           .zipped = zipped,
                                        },
-                                   .prefix = prefix + "_ar_to_gates_"};
-    auto ar_to_gates_layer = ArLayerType::Create(ar_to_gates_params);
-    if (ar_to_gates_layer == nullptr) {
-      return nullptr;
-    }
+                                   .prefix = prefix + "_ar_to_gates_",
+                                   .model = model};
 
-    LayerParams gru_params{.num_input_channels = kNumGruHiddens,
-                           .num_filters = 3 * kNumGruHiddens,
+    LayerParams gru_params{.num_input_channels = num_gru_hiddens,
+                           .num_filters = 3 * num_gru_hiddens,
                            .length = 1,
                            .kernel_size = 1,
                            .dilation = 1,
@@ -116,204 +151,626 @@ class LyraWavegru {
                            .from =
                                LayerParams::FromDisk{
                                    .path = path.string(),
-                                   .zipped = true,
+                                   .zipped = zipped,
                                },
-                           .prefix = prefix + "_gru_layer_"};
-    auto gru_layer = GruLayerType::Create(gru_params);
-    if (gru_layer == nullptr) {
+                           .prefix = prefix + "_gru_layer_",
+                           .model = model};
+
+    // The three layers are read and decompressed concurrently.
+    std::unique_ptr<ArLayerType> ar_to_gates_layer;
+    std::unique_ptr<GruLayerType> gru_layer;
+    auto project_and_sample_layer = absl::make_unique<ProjectAndSampleType>();
+    const bool loaded = LoadInParallel({
+        [&]() {
+          ar_to_gates_layer = ArLayerType::Create(ar_to_gates_params);
+          return ar_to_gates_layer != nullptr;
+        },
+        [&]() {
+          gru_layer = GruLayerType::Create(gru_params);
+          return gru_layer != nullptr;
+        },
+        [&]() {
+          if (model != nullptr) {
+            project_and_sample_layer->LoadShared(path, prefix + "_", zipped,
+                                                 num_threads, model);
+          } else {
+            project_and_sample_layer->LoadRaw(path, prefix + "_", zipped);
+          }
+          if (project_and_sample_layer->PrepareForThreads(num_threads) !=
+              num_threads) {
+            LOG(ERROR) << "Could not prepare project_and_sample for "
+                       << num_threads << " threads.";
+            return false;
+          }
+          return true;
+        },
+    });
+    if (!loaded) {
       return nullptr;
     }
+    auto arena = CreateArena(ar_to_gates_layer.get(), gru_layer.get(),
+                             *project_and_sample_layer, use_huge_pages);
+    if (arena == nullptr) {
+      return nullptr;
+    }
+    auto wavegru = absl::WrapUnique(new LyraWavegru<WeightTypeKind>(
+        num_threads, num_gru_hiddens, num_split_bands,
+        std::move(ar_to_gates_layer), std::move(gru_layer),
+        std::move(project_and_sample_layer), std::move(arena)));
+    wavegru->LogThreadImbalance(path, prefix, zipped);
+    return wavegru;
+  }
 
+  // Same as above, but all layers are filled with |weights| instead of being
+  // loaded, with |num_gru_hiddens| hidden units, |proj_size| outputs of the
+  // projection and |num_split_bands| bands, e.g. to measure the cost of models
+  // that were not trained. Both sizes have to be positive multiples of
+  // |kSyntheticSizeMultiple|.
+  static std::unique_ptr<LyraWavegru<WeightTypeKind>> CreateSynthetic(
+      int num_threads, int num_gru_hiddens, int proj_size,
+      const LayerParams::FromConstant& weights, bool use_huge_pages = false,
+      int num_split_bands = kDefaultNumSplitBands) {
+    if (!IsNumSplitBandsSupported(num_split_bands)) {
+      LOG(ERROR) << "Models with " << num_split_bands
+                 << " split bands are not supported.";
+      return nullptr;
+    }
+    if (num_gru_hiddens <= 0 || num_gru_hiddens % kSyntheticSizeMultiple != 0 ||
+        proj_size <= 0 || proj_size % kSyntheticSizeMultiple != 0) {
+      LOG(ERROR) << "The number of hidden units and the projection size have "
+                 << "to be positive multiples of " << kSyntheticSizeMultiple
+                 << ", but were " << num_gru_hiddens << " and " << proj_size
+                 << ".";
+      return nullptr;
+    }
+    LayerParams ar_to_gates_params{.num_input_channels = num_split_bands,
+                                   .num_filters = 3 * num_gru_hiddens,
+                                   .length = 1,
+                                   .kernel_size = 1,
+                                   .dilation = 1,
+                                   .stride = 1,
+                                   .relu = false,
+                                   .skip_connection = false,
+                                   .type = LayerType::kConv1D,
+                                   .num_threads = num_threads,
+                                   .per_column_barrier = false,
+                                   .from = weights,
+                                   .prefix = "synthetic_ar_to_gates_"};
+    LayerParams gru_params{.num_input_channels = num_gru_hiddens,
+                           .num_filters = 3 * num_gru_hiddens,
+                           .length = 1,
+                           .kernel_size = 1,
+                           .dilation = 1,
+                           .stride = 1,
+                           .relu = false,
+                           .skip_connection = false,
+                           .type = LayerType::kConv1D,
+                           .num_threads = num_threads,
+                           .per_column_barrier = false,
+                           .from = weights,
+                           .prefix = "synthetic_gru_layer_"};
+    auto ar_to_gates_layer = ArLayerType::Create(ar_to_gates_params);
+    auto gru_layer = GruLayerType::Create(gru_params);
+    if (ar_to_gates_layer == nullptr || gru_layer == nullptr) {
+      return nullptr;
+    }
     auto project_and_sample_layer = absl::make_unique<ProjectAndSampleType>();
-    project_and_sample_layer->LoadRaw(path, prefix + "_", /*zipped=*/true);
+    project_and_sample_layer->LoadConstant(
+        num_gru_hiddens, proj_size, num_split_bands * kNumMixesPerBand,
+        weights);
     if (project_and_sample_layer->PrepareForThreads(num_threads) !=
         num_threads) {
       LOG(ERROR) << "Could not prepare project_and_sample for " << num_threads
                  << " threads.";
       return nullptr;
     }
+    auto arena = CreateArena(ar_to_gates_layer.get(), gru_layer.get(),
+                             *project_and_sample_layer, use_huge_pages);
+    if (arena == nullptr) {
+      return nullptr;
+    }
     return absl::WrapUnique(new LyraWavegru<WeightTypeKind>(
-        num_threads, std::move(ar_to_gates_layer), std::move(gru_layer),
-        std::move(project_and_sample_layer)));
+        num_threads, num_gru_hiddens, num_split_bands,
+        std::move(ar_to_gates_layer), std::move(gru_layer),
+        std::move(project_and_sample_layer), std::move(arena)));
   }
 
-  // The |num_samples_to_generate| is only used by the main thread, which
-  // will store this number in |num_samples_to_generate_|. All background
-  // threads will load from |num_samples_to_generate_| for each iteration of the
-  // while loop.
-  int SampleThreaded(int tid, ConditioningType* conditioning,
-                     std::vector<std::vector<int16_t>>* split_band_samples,
-                     int num_samples_to_generate) {
-    int num_samples_generated = 0;
-    // Thread with |tid| = 0 will break out of this while loop after 1
-    // iteration. All other threads will be in this while loop until
-    // |terminate_threads_| is set to true.
-    while (!terminate_threads_.load()) {
-      // |main_thread_ready_| is used to let background threads do a non-busy
-      // wait while the main thread is returned to the caller to do extra work
-      // outside such as packet handling.
-      if (tid == 0) {
-        num_samples_to_generate_.store(num_samples_to_generate);
-      } else {
-        // Background threads will effectively non-busy wait here until
-        // |num_samples_to_generate_| is set to a value greater than 0.
-        if (num_samples_to_generate_.load() <= 0) {
-          absl::SleepFor(absl::Microseconds(100));
-          continue;
-        }
-      }
-      num_samples_generated = SamplingBody(
-          spin_barrier_.get(), tid, conditioning, split_band_samples, nullptr);
-
-      // Synchronize all threads before the main thread updates
-      // |num_samples_to_generate_|, otherwise the background threads may not
-      // have the chance to run SamplingBody().
-      spin_barrier_->barrier();
-
-      // Synchronize all threads after the main thread updates
-      // |num_samples_to_generate_|, otherwise on the final packet the
-      // background threads may bypass the
-      // (num_samples_to_generate_.load() <= 0) check and
-      // become stuck at the first spin barrier in |SamplingBody| which will
-      // never be matched by the main thread.
-      if (tid == 0) {
-        conditioning_start_.store(conditioning_start_.load() +
-                                  num_samples_generated);
-        num_samples_to_generate_.store(0);
-      }
-      spin_barrier_->barrier();
-      if (tid == 0) {
-        break;
-      }
+  // Generates up to |num_samples_to_generate| samples, summed over all bands,
+  // into |split_band_samples| from |conditioning|, starting after the samples
+  // generated since the last |ResetConditioningStart|. All |num_threads|
+  // threads call this at the same time with the same arguments and a barrier
+  // for all of them, e.g. through |ThreadPool::Run|. Returns the number of
+  // samples generated.
+  int SampleWithBarrier(
+      csrblocksparse::SpinBarrier* spin_barrier, int tid,
+      ConditioningType* conditioning,
+      absl::Span<const absl::Span<int16_t>> split_band_samples,
+      int num_samples_to_generate) {
+    // |SamplingBody| reads the number of samples from
+    // |num_samples_to_generate_|.
+    if (tid == 0) {
+      num_samples_to_generate_.store(num_samples_to_generate);
+    }
+    WaitForAllThreads(spin_barrier, tid);
+    const int num_samples_generated = SamplingBody(
+        spin_barrier, tid, conditioning, split_band_samples, nullptr);
+
+    // All threads have to read |conditioning_start_| before it is advanced.
+    WaitForAllThreads(spin_barrier, tid);
+    if (tid == 0) {
+      conditioning_start_.store(conditioning_start_.load() +
+                                num_samples_generated);
+      num_samples_to_generate_.store(0);
     }
     return num_samples_generated;
   }
 
-  // Causes all threads with |tid| != 0 to break out of their |SamplingBody|
-  // loop.
-  void TerminateThreads() { terminate_threads_.store(true); }
-
   void ResetConditioningStart() { conditioning_start_.store(0); }
 
-  int num_gru_hiddens() const { return kNumGruHiddens; }
+  // Forgets the samples generated so far, as if the model was just created:
+  // the GRU state and AR input are zeroed and the random generators start
+  // over. Must not run concurrently with any other method.
+  void ClearState() {
+    gru_layer_->ClearState();
+    ar_input_.fill(0.f);
+    FillZero(&ar_and_cond_to_gates_buffer_);
+    FillZero(&gru_gates_buffer_);
+    InitializeGenerators();
+    ResetConditioningStart();
+  }
+
+  // Gives the memory of the activations back to the system until the next
+  // sample is generated, e.g. while the model is idle for a long time. They
+  // are recomputed on every step, so the state is kept. Returns the number of
+  // bytes given back. Must not run concurrently with any other method.
+  int64_t ReleaseActivations() { return arena_->Release(); }
+
+  // Appends the GRU state, the AR input of every band, the random generators
+  // and the position in the conditioning to |writer|. Must not run
+  // concurrently with any other method.
+  void SaveState(StateWriter* writer) const {
+    gru_layer_->SaveState(writer);
+    writer->WriteBytes(ar_input_.data(), num_split_bands_ * sizeof(float));
+    // All generators are in the same state, so only one is saved and the
+    // state fits a model with any number of threads.
+    writer->Write(thread_local_gens_[0]);
+    writer->Write(conditioning_start_.load());
+  }
 
-  int num_split_bands() const { return kNumSplitBands; }
+  // Restores what |SaveState| of a model of the same shape wrote, for
+  // conditioning of |num_conditioning_samples| that was restored before.
+  // Returns false if |reader| does not hold it, in which case the state must
+  // be cleared before the model is used again.
+  bool RestoreState(StateReader* reader, int num_conditioning_samples) {
+    std::minstd_rand gen;
+    int conditioning_start;
+    if (!gru_layer_->RestoreState(reader) ||
+        !reader->ReadBytes(ar_input_.data(),
+                           num_split_bands_ * sizeof(float)) ||
+        !reader->Read(&gen) || !reader->Read(&conditioning_start) ||
+        conditioning_start < 0 ||
+        conditioning_start > num_conditioning_samples ||
+        conditioning_start % num_split_bands_ != 0) {
+      return false;
+    }
+    std::fill(thread_local_gens_.begin(), thread_local_gens_.end(), gen);
+    conditioning_start_.store(conditioning_start);
+    return true;
+  }
 
- private:
+  // The position in the conditioning of the next sample to generate.
+  int conditioning_start() const { return conditioning_start_.load(); }
+
+  // Records per-thread latency histograms of every stage of the sampling loop
+  // into |profiler|, or stops recording if it is null. |profiler| must have
+  // |num_threads| threads and outlive this object. Must not be called while
+  // samples are being generated.
+  void set_profiler(StageProfiler* profiler) {
+    CHECK(profiler == nullptr || profiler->num_threads() == num_threads_);
+    profiler_ = profiler;
+    project_and_sample_layer_->set_profiler(profiler);
+  }
+
+  // Makes the threads wait for each other in |SampleWithBarrier| on an
+  // |AdaptiveBarrier| instead of the barrier they are called with, which only
+  // spins. Must not be called while samples are being generated.
+  void set_use_adaptive_barrier(bool use_adaptive_barrier) {
+    if (!use_adaptive_barrier) {
+      adaptive_barrier_.reset();
+    } else if (adaptive_barrier_ == nullptr) {
+      adaptive_barrier_ = absl::make_unique<AdaptiveBarrier>(num_threads_);
+      AddThreadBarriers();
+    }
+  }
+
+  // Makes every thread wait after the GRU matrix multiplication only for the
+  // threads that computed the rows of the gates it updates, instead of for
+  // all threads. Slower threads may then still read the GRU state in their
+  // matrix multiplication, so the new state is written to a second buffer
+  // and copied back once all threads passed the next barrier. Returns false
+  // and leaves the full barrier if the rows of each thread are not known.
+  // Must not be called while samples are being generated.
+  bool set_use_gru_row_pipelining(bool use_gru_row_pipelining) {
+    if (!use_gru_row_pipelining) {
+      gru_row_progress_.reset();
+      next_gru_state_.reset();
+      return true;
+    }
+    if (gru_row_progress_ != nullptr) {
+      return true;
+    }
+    std::vector<int> row_starts = gru_layer_->ThreadRowStarts(num_threads_);
+    if (row_starts.empty()) {
+      return false;
+    }
+    gru_row_progress_ = absl::make_unique<RowProgress>(std::move(row_starts));
+    next_gru_state_ =
+        absl::make_unique<csrblocksparse::CacheAlignedVector<GruStateType>>(
+            num_gru_hiddens_);
+    gate_producers_.clear();
+    for (int tid = 0; tid < num_threads_; ++tid) {
+      int start, end;
+      std::tie(start, end) = ComputeStartAndEnd(tid);
+      std::vector<std::pair<int, int>> gate_rows;
+      for (int gate = 0; gate < 3; ++gate) {
+        gate_rows.emplace_back(gate * num_gru_hiddens_ + start,
+                               gate * num_gru_hiddens_ + end);
+      }
+      gate_producers_.push_back(gru_row_progress_->ProducersOf(gate_rows));
+    }
+    AddThreadBarriers();
+    return true;
+  }
+
+  bool use_gru_row_pipelining() const { return gru_row_progress_ != nullptr; }
+
+  // Makes every thread prefetch, while it waits for thread 0 to sample, the
+  // conditioning it reads |prefetch_distance| steps later and the start of
+  // its rows of the GRU bias. Stops prefetching if |prefetch_distance| is 0.
+  // Must not be called while samples are being generated.
+  void set_prefetch_distance(int prefetch_distance) {
+    CHECK_GE(prefetch_distance, 0);
+    prefetch_distance_ = prefetch_distance;
+    if (prefetch_distance_ > 0 && gru_row_starts_.empty()) {
+      gru_row_starts_ = gru_layer_->ThreadRowStarts(num_threads_);
+    }
+  }
+
+  int prefetch_distance() const { return prefetch_distance_; }
+
+  // The adaptive barrier, whose wait times show how evenly the work is split
+  // between the threads by |ComputeStartAndEnd|, or null unless enabled with
+  // |set_use_adaptive_barrier|.
+  const AdaptiveBarrier* adaptive_barrier() const {
+    return adaptive_barrier_.get();
+  }
+
+  // The arena the activations of the sampling loop are carved from.
+  const ActivationArena& activation_arena() const { return *arena_; }
+
+  int num_gru_hiddens() const { return num_gru_hiddens_; }
+
+  int num_split_bands() const { return num_split_bands_; }
+
+  // The AR-to-gates layer as it is applied while sampling: |ar_to_gates_bias|
+  // has one entry per gate input and |ar_to_gates_weights| holds the
+  // |num_split_bands()| weights of each of them in a row.
+  absl::Span<const float> ar_to_gates_weights() const {
+    return ar_to_gates_weights_;
+  }
+  absl::Span<const float> ar_to_gates_bias() const { return ar_to_gates_bias_; }
+
+  // Whether models with |num_split_bands| bands can be run, for which the AR
+  // input of the gates is unrolled.
+  static bool IsNumSplitBandsSupported(int num_split_bands) {
+    return num_split_bands == 4 || num_split_bands == kMaxNumSplitBands;
+  }
+
+  // The number of hidden units of the default model loaded by |Create|.
   static constexpr int kNumGruHiddens = 1024;
-  static constexpr int kNumSplitBands = 4;
+  // The sizes of synthetic models are multiples of this, so that the gates
+  // split between threads on whole cache lines and SIMD registers.
+  static constexpr int kSyntheticSizeMultiple = 32;
+  // Each step of the sampling loop generates one sample of every band, so
+  // models with more bands take fewer sequential steps per second.
+  static constexpr int kDefaultNumSplitBands = 4;
+  static constexpr int kMaxNumSplitBands = 8;
+
+ private:
+  static constexpr int kCacheLineBytes = 64;
+  // The mixture of logistics of the shipped models has this many components
+  // per band.
+  static constexpr int kNumMixesPerBand = 8;
 
   LyraWavegru() = delete;
 
-  LyraWavegru(int num_threads, std::unique_ptr<ArLayerType> ar_to_gates_layer,
+  // Returns an arena that fits the activations of the sampling loop of an
+  // instance with the given layers, or a nullptr on failure.
+  static std::unique_ptr<ActivationArena> CreateArena(
+      ArLayerType* ar_to_gates_layer, GruLayerType* gru_layer,
+      const ProjectAndSampleType& project_and_sample_layer,
+      bool use_huge_pages) {
+    return ActivationArena::Create(
+        ActivationArena::BytesFor<GruRhsType>(ar_to_gates_layer->rows()) +
+            ActivationArena::BytesFor<GruRhsType>(gru_layer->rows()) +
+            project_and_sample_layer.ActivationBytes(),
+        use_huge_pages);
+  }
+
+  LyraWavegru(int num_threads, int num_gru_hiddens, int num_split_bands,
+              std::unique_ptr<ArLayerType> ar_to_gates_layer,
               std::unique_ptr<GruLayerType> gru_layer,
-              std::unique_ptr<ProjectAndSampleType> project_and_sample_layer)
+              std::unique_ptr<ProjectAndSampleType> project_and_sample_layer,
+              std::unique_ptr<ActivationArena> arena)
       : num_threads_(num_threads),
-        ar_to_gates_layer_(std::move(ar_to_gates_layer)),
+        num_gru_hiddens_(num_gru_hiddens),
+        num_split_bands_(num_split_bands),
+        arena_(std::move(arena)),
         gru_layer_(std::move(gru_layer)),
         project_and_sample_layer_(std::move(project_and_sample_layer)),
-        sample_at_s_(kNumSplitBands),
-        terminate_threads_(false),
+        sample_at_s_(num_split_bands),
         num_samples_to_generate_(0),
         conditioning_start_(0) {
-    InitLoadedLayers();
+    InitLoadedLayers(ar_to_gates_layer.get());
     InitializeGenerators();
-    spin_barrier_ =
-        absl::make_unique<csrblocksparse::SpinBarrier>(num_threads_);
   }
 
-  void InitLoadedLayers() {
+  // |ar_to_gates_layer| is only read here, see |ExtractArToGatesWeights|, and
+  // is released by the constructor afterwards.
+  void InitLoadedLayers(ArLayerType* ar_to_gates_layer) {
+    ExtractArToGatesWeights(ar_to_gates_layer);
     LOG(INFO) << "Model size: " << ModelSize() << " bytes";
-    // Working space for activations.
-    ar_output_buffer_ = csrblocksparse::CacheAlignedVector<ArOutputType>(
-        ar_to_gates_layer_->rows());
-    ar_output_buffer_.FillZero();
-    ar_and_cond_to_gates_buffer_ =
-        csrblocksparse::CacheAlignedVector<GruRhsType>(
-            ar_to_gates_layer_->rows());
-    ar_and_cond_to_gates_buffer_.FillZero();
-    gru_gates_buffer_ =
-        csrblocksparse::CacheAlignedVector<GruRhsType>(gru_layer_->rows());
-    gru_gates_buffer_.FillZero();
+    ar_input_.fill(0.f);
+    // The gates of every hidden unit take the same work. The ranges are
+    // aligned to cache lines of the gate inputs and of the state, so that no
+    // two threads write to the same cache line of either.
+    gate_starts_ = PartitionByWork(
+        std::vector<int64_t>(num_gru_hiddens_, 1), num_threads_,
+        std::max({static_cast<int>(gru_gates_.kSIMDWidth),
+                  kCacheLineBytes / static_cast<int>(sizeof(GruRhsType)),
+                  kCacheLineBytes / static_cast<int>(sizeof(GruStateType))}));
+    // Working space for activations, zeroed by the arena.
+    ar_and_cond_to_gates_buffer_ = ArenaVector(ar_to_gates_bias_.size());
+    gru_gates_buffer_ = ArenaVector(gru_layer_->rows());
+    project_and_sample_layer_->PlaceActivations(arena_.get());
+    // Per-thread scratch space for sampling, whose size should be multiple of
+    // 8. Allocated once here so that sampling does not touch the heap.
+    sample_scratch_.reserve(num_threads_);
+    for (int i = 0; i < num_threads_; ++i) {
+      sample_scratch_.emplace_back(
+          project_and_sample_layer_->expanded_mixes_size());
+    }
+  }
+
+  // The AR input is only |num_split_bands_| wide, so instead of running
+  // |ar_to_gates_layer| as a separate matrix multiplication followed by a
+  // barrier, its weights are applied inline in
+  // |SumConditioningAndAutoregressive|. They are recovered in float by running
+  // the layer once on zeros, which gives the bias, and once per band on a
+  // scaled unit vector. The unit is 0.5 so it is representable by every
+  // |ArRhsType|. The layer itself is not needed afterwards.
+  void ExtractArToGatesWeights(ArLayerType* ar_to_gates_layer) {
+    const int rows = ar_to_gates_layer->rows();
+    constexpr float kUnit = 0.5f;
+    csrblocksparse::CacheAlignedVector<ArOutputType> output(rows);
+    auto run_layer_with_hot_band = [&](int hot_band) {
+      auto input = ar_to_gates_layer->InputViewToUpdate();
+      for (int i = 0; i < num_split_bands_; ++i) {
+        input[i] = static_cast<ArRhsType>(i == hot_band ? kUnit : 0.f);
+      }
+      LaunchOnThreadsWithBarrier(
+          num_threads_, [&](csrblocksparse::SpinBarrier* barrier, int tid) {
+            ar_to_gates_layer->Run(tid, barrier, output.AsMutableView());
+          });
+    };
+
+    run_layer_with_hot_band(-1);
+    ar_to_gates_bias_.resize(rows);
+    for (int row = 0; row < rows; ++row) {
+      ar_to_gates_bias_[row] = static_cast<float>(output[row]);
+    }
+    ar_to_gates_weights_.resize(rows * num_split_bands_);
+    for (int band = 0; band < num_split_bands_; ++band) {
+      run_layer_with_hot_band(band);
+      for (int row = 0; row < rows; ++row) {
+        ar_to_gates_weights_[row * num_split_bands_ + band] =
+            (static_cast<float>(output[row]) - ar_to_gates_bias_[row]) / kUnit;
+      }
+    }
   }
 
   std::size_t ModelSize() const {
     return gru_layer_->bytes() + project_and_sample_layer_->ModelSize() +
-           ar_to_gates_layer_->bytes();
+           (ar_to_gates_weights_.size() + ar_to_gates_bias_.size()) *
+               sizeof(float);
   }
 
   int SamplingBody(
       csrblocksparse::SpinBarrier* spin_barrier, int tid,
       ConditioningType* conditioning,
-      std::vector<std::vector<int16_t>>* split_band_samples,
+      absl::Span<const absl::Span<int16_t>> split_band_samples,
       const std::function<void(int16_t*, int, int, int)>& /*unused*/) {
-    CHECK_EQ(kNumSplitBands, split_band_samples->size());
+    LYRA_TRACE_SCOPE("SamplingBody");
+    CHECK_EQ(num_split_bands_, split_band_samples.size());
     const int conditioning_start = conditioning_start_.load();
     const int num_samples_to_generate =
         std::min(num_samples_to_generate_.load(),
                  conditioning->num_samples() - conditioning_start);
-    // We can only generate samples in multiples of |kNumSplitBands|.
-    CHECK_EQ(num_samples_to_generate % kNumSplitBands, 0);
+    // We can only generate samples in multiples of |num_split_bands_|.
+    CHECK_EQ(num_samples_to_generate % num_split_bands_, 0);
     CHECK_GE(num_samples_to_generate, 0);
 
-    // This is a scratch space, whose size should be multiple of 8.
-    csrblocksparse::CacheAlignedVector<ScratchType> sample_tmp(
-        project_and_sample_layer_->expanded_mixes_size());
-
+    csrblocksparse::CacheAlignedVector<ScratchType>& sample_tmp =
+        sample_scratch_[tid];
     sample_tmp.FillZero();
 
     std::minstd_rand* thread_local_gen = &thread_local_gens_[tid];
 
     int start, end;
-    std::tie(start, end) = ComputeStartAndEnd(tid, kNumGruHiddens);
-
-    for (int s = 0; s < num_samples_to_generate; s += kNumSplitBands) {
-      // Bring the AR sample(s) up to 3 * kNumGruHiddens.
-      ar_to_gates_layer_->Run(tid, spin_barrier,
-                              ar_output_buffer_.AsMutableView());
-
-      // Sum the conditioning and autoregressive output.
-      SumConditioningAndAutoregressive(
-          conditioning->AtStep(conditioning_start + s), 3 * start, 3 * end,
-          spin_barrier);
+    std::tie(start, end) = ComputeStartAndEnd(tid);
+
+    // Copied to a local so that the disabled case costs a test per stage.
+    StageProfiler* const profiler = profiler_;
+    int64_t lap_start = 0;
+
+    for (int s = 0; s < num_samples_to_generate; s += num_split_bands_) {
+      if (profiler != nullptr) lap_start = profiler->Start(tid);
+      // Bring the AR sample(s) up to 3 * num_gru_hiddens_ and add the
+      // conditioning, only for the gates of the hidden units this thread
+      // updates below.
+      if (num_split_bands_ == kMaxNumSplitBands) {
+        SumConditioningAndAutoregressive<kMaxNumSplitBands>(
+            conditioning->AtStep(conditioning_start + s), start, end);
+      } else {
+        SumConditioningAndAutoregressive<kDefaultNumSplitBands>(
+            conditioning->AtStep(conditioning_start + s), start, end);
+      }
+      if (profiler != nullptr) {
+        profiler->Lap(tid, SamplingStage::kConditioningSum, &lap_start);
+      }
 
-      // Pass through the GRU layer.
-      gru_layer_->Run(tid, spin_barrier, gru_gates_buffer_.AsMutableView());
+      // Pass through the GRU layer. The gates update the state in place,
+      // unless other threads may still be reading it.
+      GruStateType* gru_state = gru_layer_->InputViewToUpdate().data();
+      if (gru_row_progress_ != nullptr) {
+        // The layer waits on a barrier of just this thread, and the thread
+        // then only waits for the threads computing the rows of its gates.
+        gru_layer_->Run(tid, thread_barriers_[tid].get(),
+                        gru_gates_buffer_);
+        LYRA_TRACE_SCOPE("RowProgressWait");
+        gru_row_progress_->WaitFor(gate_producers_[tid],
+                                   gru_row_progress_->Publish(tid));
+        // Only this thread reads and writes its hidden units of
+        // |next_gru_state_| until the barrier below.
+        std::copy(gru_state + start, gru_state + end,
+                  next_gru_state_->data() + start);
+        gru_state = next_gru_state_->data();
+      } else if (adaptive_barrier_ != nullptr) {
+        // The layer waits on a barrier of just this thread, which returns
+        // right away, and the threads then wait for each other here.
+        gru_layer_->Run(tid, thread_barriers_[tid].get(),
+                        gru_gates_buffer_);
+        LYRA_TRACE_SCOPE("BarrierWait");
+        adaptive_barrier_->Wait(tid);
+      } else {
+        gru_layer_->Run(tid, spin_barrier, gru_gates_buffer_);
+      }
+      if (profiler != nullptr) {
+        profiler->Lap(tid, SamplingStage::kGruMatVec, &lap_start);
+      }
       gru_gates_
           .template GruWithARInput<csrblocksparse::ARInputsMode::k0ARInputs>(
-              start, end, /*state_size=*/kNumGruHiddens,
+              start, end, /*state_size=*/num_gru_hiddens_,
               /*gru_recurrent_ptr=*/gru_gates_buffer_.data(),
               /*input_ptr=*/ar_and_cond_to_gates_buffer_.data(),
-              /*gru_state_ptr=*/gru_layer_->InputViewToUpdate().data());
-      spin_barrier->barrier();
+              /*gru_state_ptr=*/gru_state);
+      if (profiler != nullptr) {
+        profiler->Lap(tid, SamplingStage::kGateUpdate, &lap_start);
+      }
+      WaitForAllThreads(spin_barrier, tid);
+      if (profiler != nullptr) {
+        profiler->Lap(tid, SamplingStage::kBarrierWait, &lap_start);
+      }
 
       // Project and sample.
-      project_and_sample_layer_->GetSamples(
-          gru_layer_->InputViewToUpdate(), tid, thread_local_gen, &sample_tmp,
-          kNumSplitBands, sample_at_s_.data());
+      if (gru_row_progress_ != nullptr) {
+        project_and_sample_layer_->GetSamples(
+            next_gru_state_->AsMutableView(), tid, thread_local_gen,
+            &sample_tmp, num_split_bands_, sample_at_s_.data());
+        // All matrix multiplications of this step are done, and the next one
+        // only starts after the barrier below.
+        std::copy(next_gru_state_->data() + start,
+                  next_gru_state_->data() + end,
+                  gru_layer_->InputViewToUpdate().data() + start);
+      } else {
+        project_and_sample_layer_->GetSamples(
+            gru_layer_->InputViewToUpdate(), tid, thread_local_gen,
+            &sample_tmp, num_split_bands_, sample_at_s_.data());
+      }
 
       if (tid == 0) {
-        // Loop back the samples as the input of |ar_to_gates_layer_| for the
-        // next step.
-        auto sample_at_sminus1 = ar_to_gates_layer_->InputViewToUpdate();
-        for (int i = 0; i < kNumSplitBands; ++i) {
-          sample_at_sminus1[i] =
-              static_cast<ArRhsType>(SampleToFloat(sample_at_s_.at(i)));
-          split_band_samples->at(i).at(s / kNumSplitBands) = sample_at_s_.at(i);
+        // Loop back the samples as the AR input for the next step.
+        for (int i = 0; i < num_split_bands_; ++i) {
+          ar_input_[i] = SampleToFloat(sample_at_s_.at(i));
+          split_band_samples.at(i).at(s / num_split_bands_) =
+              sample_at_s_.at(i);
         }
       }
-      spin_barrier->barrier();
+      // The other threads would only wait for thread 0 here, so they fetch
+      // what they read first in a later step meanwhile.
+      const int prefetch_step = s + prefetch_distance_ * num_split_bands_;
+      if (prefetch_distance_ > 0 && prefetch_step < num_samples_to_generate) {
+        PrefetchStep(conditioning->AtStep(conditioning_start + prefetch_step),
+                     tid, start, end);
+      }
+      if (profiler != nullptr) lap_start = profiler->Start(tid);
+      WaitForAllThreads(spin_barrier, tid);
+      if (profiler != nullptr) {
+        profiler->Lap(tid, SamplingStage::kBarrierWait, &lap_start);
+      }
     }  // end of for (int s = 0; ...).
     return num_samples_to_generate;
   }
 
-  // Computes the intervals of gru gates to be computed by the given tid.
-  std::tuple<int, int> ComputeStartAndEnd(int tid, int state_size) const {
-    int factor = gru_gates_.kSIMDWidth;
-    factor *= state_size / (factor * num_threads_);
-    return std::make_tuple(factor * tid, tid == num_threads_ - 1
-                                             ? state_size
-                                             : factor * (tid + 1));
+  // Makes sure every thread has a barrier of its own in |thread_barriers_|.
+  void AddThreadBarriers() {
+    for (int tid = thread_barriers_.size(); tid < num_threads_; ++tid) {
+      thread_barriers_.push_back(
+          absl::make_unique<csrblocksparse::SpinBarrier>(1));
+    }
+  }
+
+  // Waits for all threads on |adaptive_barrier_| if it is used, and on
+  // |spin_barrier| otherwise.
+  void WaitForAllThreads(csrblocksparse::SpinBarrier* spin_barrier, int tid) {
+    LYRA_TRACE_SCOPE("BarrierWait");
+    if (adaptive_barrier_ != nullptr) {
+      adaptive_barrier_->Wait(tid);
+    } else {
+      spin_barrier->barrier();
+    }
+  }
+
+  // Returns the interval of gru gates to be computed by the given tid.
+  std::tuple<int, int> ComputeStartAndEnd(int tid) const {
+    return std::make_tuple(gate_starts_[tid], gate_starts_[tid + 1]);
+  }
+
+  // Logs how evenly the work of the sampling loop is split between the
+  // threads, as the most work of a thread over the average: the rows of the
+  // GRU matrix multiplication weighted by their non-zero weights, which the
+  // sparse library splits, and the GRU gates.
+  void LogThreadImbalance(const ghc::filesystem::path& path,
+                          const std::string& prefix, bool zipped) const {
+    LOG(INFO) << "GRU gates split between " << num_threads_
+              << " threads with an imbalance of "
+              << WorkImbalance(std::vector<int64_t>(num_gru_hiddens_, 1),
+                               gate_starts_)
+              << ".";
+    const std::vector<int> row_starts =
+        gru_layer_->ThreadRowStarts(num_threads_);
+    std::vector<float> mask;
+    const int rows = gru_layer_->rows();
+    if (row_starts.empty() ||
+        !csrblocksparse::ReadArrayFromFile(
+             prefix + "_gru_layer_mask.raw" + (zipped ? ".gz" : ""), &mask,
+             path.string())
+             .ok() ||
+        mask.size() % rows != 0) {
+      return;
+    }
+    const int cols = mask.size() / rows;
+    std::vector<int64_t> nnz_per_row(rows, 0);
+    for (int row = 0; row < rows; ++row) {
+      nnz_per_row[row] =
+          std::count_if(mask.begin() + row * cols,
+                        mask.begin() + (row + 1) * cols,
+                        [](float value) { return value != 0.0f; });
+    }
+    LOG(INFO) << "GRU matrix multiplication split between " << num_threads_
+              << " threads with an imbalance of "
+              << WorkImbalance(nnz_per_row, row_starts)
+              << " in non-zero weights.";
   }
 
   // The range [-32768, 32767] is mapped to floating point by x / 32768.0f
@@ -334,49 +791,151 @@ class LyraWavegru {
     }
   }
 
+  // Computes the GRU gate inputs of the hidden units [|start|, |end|) as the
+  // sum of the conditioning and the AR contribution of the previous samples in
+  // a single pass. The reset, update and cell gates of a hidden unit are
+  // |num_gru_hiddens_| rows apart, and GruWithARInput reads exactly these rows
+  // for the same range, so each thread only writes rows it reads itself and no
+  // barrier is needed. The conditioning is widened from the type it is stored
+  // in within the same pass. |kNumBands| is |num_split_bands_|, a constant so
+  // that the sum over the AR input is unrolled.
+  template <int kNumBands>
   void SumConditioningAndAutoregressive(
-      const absl::Span<GruRhsType> conditioning_span, int sum_start,
-      int sum_end, csrblocksparse::SpinBarrier* spin_barrier) {
-    CastVector(sum_start, sum_end, ar_output_buffer_.data(),
-               ar_and_cond_to_gates_buffer_.data());
-    csrblocksparse::detail::SumVectors(sum_start, sum_end,
-                                       conditioning_span.data(),
-                                       ar_and_cond_to_gates_buffer_.data(),
-                                       ar_and_cond_to_gates_buffer_.data());
-    spin_barrier->barrier();
+      const absl::Span<const ConditioningOutputType> conditioning_span,
+      int start, int end) {
+    const ConditioningOutputType* conditioning = conditioning_span.data();
+    const float* weights = ar_to_gates_weights_.data();
+    const float* bias = ar_to_gates_bias_.data();
+    GruRhsType* output = ar_and_cond_to_gates_buffer_.data();
+    std::array<float, kNumBands> x;
+    std::copy_n(ar_input_.begin(), kNumBands, x.begin());
+    for (int gate = 0; gate < 3; ++gate) {
+      const int gate_offset = gate * num_gru_hiddens_;
+      for (int row = gate_offset + start; row < gate_offset + end; ++row) {
+        const float* w = weights + row * kNumBands;
+        float sum = static_cast<float>(conditioning[row]) + bias[row];
+        for (int band = 0; band < kNumBands; ++band) {
+          sum += w[band] * x[band];
+        }
+        output[row] = static_cast<GruRhsType>(sum);
+      }
+    }
+  }
+
+  // Prefetches the rows of |conditioning_span| that thread |tid| sums for the
+  // gates in [|start|, |end|), and the first rows of the GRU bias of its part
+  // of the matrix multiplication.
+  void PrefetchStep(
+      const absl::Span<const ConditioningOutputType> conditioning_span,
+      int tid, int start, int end) const {
+    for (int gate = 0; gate < 3; ++gate) {
+      PrefetchForRead(
+          conditioning_span.data() + gate * num_gru_hiddens_ + start,
+          end - start);
+    }
+    if (!gru_row_starts_.empty()) {
+      constexpr int kNumBiasCacheLines = 4;
+      const auto& bias = gru_layer_->bias();
+      const int row_start = gru_row_starts_[tid];
+      const int rows = std::min(
+          gru_row_starts_[tid + 1] - row_start,
+          kNumBiasCacheLines * kCacheLineBytes /
+              static_cast<int>(sizeof(*bias.data())));
+      PrefetchForRead(bias.data() + row_start, rows);
+    }
+  }
+
+  // Prefetches the cache lines of the |size| elements from |data| for reading.
+  template <typename T>
+  static void PrefetchForRead(const T* data, int size) {
+#if defined(__GNUC__) || defined(__clang__)
+    const char* const bytes = reinterpret_cast<const char*>(data);
+    const int num_bytes = size * static_cast<int>(sizeof(T));
+    for (int offset = 0; offset < num_bytes; offset += kCacheLineBytes) {
+      __builtin_prefetch(bytes + offset, /*rw=*/0, /*locality=*/3);
+    }
+#endif
+  }
+
+  // Returns a vector of |rows| zeros from |arena_|.
+  csrblocksparse::MutableVectorView<GruRhsType> ArenaVector(int rows) {
+    return csrblocksparse::MutableVectorView<GruRhsType>(
+        arena_->Allocate<GruRhsType>(rows), rows, /*cols=*/1,
+        /*col_stride=*/rows);
+  }
+
+  static void FillZero(csrblocksparse::MutableVectorView<GruRhsType>* vector) {
+    std::memset(vector->data(), 0, vector->rows() * sizeof(GruRhsType));
   }
 
   const int num_threads_;
+  const int num_gru_hiddens_;
+  const int num_split_bands_;
+
+  // Holds the activation buffers of the sampling loop, which point into it.
+  // Declared before them, so that it outlives them.
+  const std::unique_ptr<ActivationArena> arena_;
 
   // Random generators for each thread.
   std::vector<std::minstd_rand> thread_local_gens_;
 
+  // Sampling scratch space for each thread.
+  std::vector<csrblocksparse::CacheAlignedVector<ScratchType>> sample_scratch_;
+
   // Layers.
-  // The layer that transforms the AR input to the input of GRU gates is just a
-  // column vector with no bias (the combined bias is handled in the
-  // conditioning stack).
-  std::unique_ptr<ArLayerType> ar_to_gates_layer_;
   std::unique_ptr<GruLayerType> gru_layer_;
 
   // TODO(b/161747203): Use LayerWrapper for the project and sample layer.
   std::unique_ptr<ProjectAndSampleType> project_and_sample_layer_;
   csrblocksparse::GruGates<GruStateType, GruRhsType, ArRhsType> gru_gates_;
 
+  // Weights and bias of the layer that transforms the AR input to the input of
+  // the GRU gates, interleaved so that the |num_split_bands_| weights of a row
+  // are contiguous.
+  std::vector<float> ar_to_gates_weights_;
+  std::vector<float> ar_to_gates_bias_;
+
+  // Thread |tid| updates the GRU gates of the hidden units in
+  // [|gate_starts_[tid]|, |gate_starts_[tid + 1]|).
+  std::vector<int> gate_starts_;
+
+  // See |set_prefetch_distance|. |gru_row_starts_| are the rows of the matrix
+  // multiplication of |gru_layer_| each thread computes, found when
+  // prefetching is first enabled, and empty if they are not contiguous.
+  int prefetch_distance_ = 0;
+  std::vector<int> gru_row_starts_;
+
   // Buffers.
-  csrblocksparse::CacheAlignedVector<ArOutputType> ar_output_buffer_;
-  csrblocksparse::CacheAlignedVector<GruRhsType> ar_and_cond_to_gates_buffer_;
-  csrblocksparse::CacheAlignedVector<GruRhsType> gru_gates_buffer_;
+  // The first |num_split_bands_| are used.
+  std::array<float, kMaxNumSplitBands> ar_input_;
+  csrblocksparse::MutableVectorView<GruRhsType> ar_and_cond_to_gates_buffer_;
+  csrblocksparse::MutableVectorView<GruRhsType> gru_gates_buffer_;
   std::vector<int> sample_at_s_;
 
-  std::atomic<bool> terminate_threads_;
-
-  // To support generating any number of samples, the main thread is responsible
-  // for setting the number (which will be read by children threads), as well
-  // as tracking the position to read next from the conditioning vector.
+  // To support generating any number of samples, the thread with |tid| 0 is
+  // responsible for setting the number (which will be read by the others), as
+  // well as tracking the position to read next from the conditioning vector.
   std::atomic<int> num_samples_to_generate_;
   std::atomic<int> conditioning_start_;
 
-  std::unique_ptr<csrblocksparse::SpinBarrier> spin_barrier_;
+  // Not owned. Null unless profiling was enabled with |set_profiler|.
+  StageProfiler* profiler_ = nullptr;
+
+  // Null unless enabled with |set_use_adaptive_barrier|. The layers only take
+  // a |csrblocksparse::SpinBarrier|, so they are then given one per thread
+  // from |thread_barriers_| that only waits for that thread.
+  std::unique_ptr<AdaptiveBarrier> adaptive_barrier_;
+  std::vector<std::unique_ptr<csrblocksparse::SpinBarrier>> thread_barriers_;
+
+  // Null unless enabled with |set_use_gru_row_pipelining|, in which case thread
+  // |tid| waits after the GRU matrix multiplication for the threads in
+  // |gate_producers_[tid]| only. The layer is then also given one of
+  // |thread_barriers_|, and the gates write the new GRU state to
+  // |next_gru_state_|.
+  std::unique_ptr<RowProgress> gru_row_progress_;
+  std::vector<std::vector<int>> gate_producers_;
+  std::unique_ptr<csrblocksparse::CacheAlignedVector<GruStateType>>
+      next_gru_state_;
 };
 
 }  // namespace codec
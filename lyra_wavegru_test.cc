@@ -14,9 +14,13 @@
 
 #include "lyra_wavegru.h"
 
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <random>
 #include <string>
 #include <tuple>
+#include <vector>
 
 #if !defined(USE_FIXED16) && !defined(USE_BFLOAT16)
 #include "exported_layers_test.h"
@@ -24,10 +28,14 @@
 
 // placeholder for get runfiles header.
 #include "absl/strings/str_format.h"
+#include "activation_arena.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
+#include "layer_wrapper_interface.h"
 #include "lyra_config.h"
+#include "model_unpacker.h"
 #include "sparse_inference_matrixvector.h"  // IWYU pragma: keep
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -62,6 +70,159 @@ TEST_P(LyraWavegruTest, ModelExistsProdFeatures) {
   EXPECT_NE(lyra_wavegru_, nullptr);
 }
 
+TEST_P(LyraWavegruTest, AdaptiveBarrierCanBeToggled) {
+  ASSERT_NE(lyra_wavegru_, nullptr);
+  EXPECT_EQ(lyra_wavegru_->adaptive_barrier(), nullptr);
+  lyra_wavegru_->set_use_adaptive_barrier(true);
+  ASSERT_NE(lyra_wavegru_->adaptive_barrier(), nullptr);
+  EXPECT_EQ(lyra_wavegru_->adaptive_barrier()->num_threads(),
+            std::get<0>(GetParam()));
+  lyra_wavegru_->set_use_adaptive_barrier(false);
+  EXPECT_EQ(lyra_wavegru_->adaptive_barrier(), nullptr);
+}
+
+TEST_P(LyraWavegruTest, PrefetchDistanceCanBeToggled) {
+  ASSERT_NE(lyra_wavegru_, nullptr);
+  EXPECT_EQ(lyra_wavegru_->prefetch_distance(), 0);
+  lyra_wavegru_->set_prefetch_distance(2);
+  EXPECT_EQ(lyra_wavegru_->prefetch_distance(), 2);
+  lyra_wavegru_->set_prefetch_distance(0);
+  EXPECT_EQ(lyra_wavegru_->prefetch_distance(), 0);
+}
+
+TEST_P(LyraWavegruTest, ActivationsFillTheirArena) {
+  ASSERT_NE(lyra_wavegru_, nullptr);
+  const ActivationArena& arena = lyra_wavegru_->activation_arena();
+  EXPECT_GT(arena.bytes_used(), 0);
+  EXPECT_EQ(arena.bytes_used(), arena.capacity());
+}
+
+TEST(LyraWavegruArenaTest, SyntheticModelRunsOnHugePages) {
+  const LayerParams::FromConstant weights{.value = 0.01f, .sparsity = 0.5f};
+  auto wavegru = LyraWavegru<ComputeType>::CreateSynthetic(
+      /*num_threads=*/1, /*num_gru_hiddens=*/64, /*proj_size=*/32, weights,
+      /*use_huge_pages=*/true);
+  ASSERT_NE(wavegru, nullptr);
+  EXPECT_GT(wavegru->activation_arena().bytes_used(), 0);
+  EXPECT_EQ(wavegru->activation_arena().bytes_used(),
+            wavegru->activation_arena().capacity());
+}
+
+TEST(LyraWavegruSplitBandsTest, SyntheticModelHasEightSplitBands) {
+  const LayerParams::FromConstant weights{.value = 0.01f, .sparsity = 0.5f};
+  auto wavegru = LyraWavegru<ComputeType>::CreateSynthetic(
+      /*num_threads=*/2, /*num_gru_hiddens=*/64, /*proj_size=*/32, weights,
+      /*use_huge_pages=*/false, /*num_split_bands=*/8);
+  ASSERT_NE(wavegru, nullptr);
+  EXPECT_EQ(wavegru->num_split_bands(), 8);
+
+  // The state holds the AR input of every band.
+  std::vector<uint8_t> state;
+  StateWriter writer(&state);
+  wavegru->SaveState(&writer);
+  StateReader reader(state);
+  EXPECT_TRUE(wavegru->RestoreState(&reader, /*num_conditioning_samples=*/0));
+  EXPECT_EQ(reader.num_bytes_left(), 0);
+}
+
+TEST(LyraWavegruStateTest, ConditioningStartPastTheConditioningFails) {
+  const LayerParams::FromConstant weights{.value = 0.01f, .sparsity = 0.5f};
+  auto wavegru = LyraWavegru<ComputeType>::CreateSynthetic(
+      /*num_threads=*/1, /*num_gru_hiddens=*/64, /*proj_size=*/32, weights);
+  ASSERT_NE(wavegru, nullptr);
+  std::vector<uint8_t> state;
+  StateWriter writer(&state);
+  wavegru->SaveState(&writer);
+
+  // The position in the conditioning is written last.
+  auto restore_at = [&](int conditioning_start, int num_conditioning_samples) {
+    std::memcpy(state.data() + state.size() - sizeof(conditioning_start),
+                &conditioning_start, sizeof(conditioning_start));
+    StateReader reader(state);
+    return wavegru->RestoreState(&reader, num_conditioning_samples);
+  };
+  const int num_split_bands = wavegru->num_split_bands();
+  EXPECT_TRUE(restore_at(8 * num_split_bands, 8 * num_split_bands));
+  EXPECT_EQ(wavegru->conditioning_start(), 8 * num_split_bands);
+  EXPECT_FALSE(restore_at(9 * num_split_bands, 8 * num_split_bands));
+  EXPECT_FALSE(restore_at(-num_split_bands, 8 * num_split_bands));
+  // Samples are only generated in multiples of the number of bands.
+  EXPECT_FALSE(restore_at(num_split_bands + 1, 8 * num_split_bands));
+}
+
+TEST(LyraWavegruSplitBandsTest, UnsupportedSplitBandsFail) {
+  const LayerParams::FromConstant weights{.value = 0.01f, .sparsity = 0.5f};
+  for (const int num_split_bands : {2, 16}) {
+    EXPECT_EQ(LyraWavegru<ComputeType>::CreateSynthetic(
+                  /*num_threads=*/1, /*num_gru_hiddens=*/64,
+                  /*proj_size=*/32, weights, /*use_huge_pages=*/false,
+                  num_split_bands),
+              nullptr);
+  }
+}
+
+TEST(LyraWavegruFusedArTest, FusedArToGatesMatchesLayer) {
+  using ArLayerType = LyraWavegru<ComputeType>::ArLayerType;
+  using ArRhsType = LyraWavegru<ComputeType>::ArRhsType;
+  using ArOutputType = LyraWavegru<ComputeType>::ArOutputType;
+  const ghc::filesystem::path model_path =
+      ghc::filesystem::current_path() / "wavegru";
+  const std::string prefix = "lyra_16khz";
+  auto wavegru =
+      LyraWavegru<ComputeType>::Create(/*num_threads=*/1, model_path, prefix);
+  ASSERT_NE(wavegru, nullptr);
+  const int num_split_bands = wavegru->num_split_bands();
+  const int num_gate_inputs = 3 * wavegru->num_gru_hiddens();
+  ASSERT_EQ(wavegru->ar_to_gates_bias().size(), num_gate_inputs);
+  ASSERT_EQ(wavegru->ar_to_gates_weights().size(),
+            num_gate_inputs * num_split_bands);
+
+  // The original layer, run as a sparse matrix multiplication.
+  auto ar_to_gates_layer = ArLayerType::Create(LayerParams{
+      .num_input_channels = num_split_bands,
+      .num_filters = num_gate_inputs,
+      .length = 1,
+      .kernel_size = 1,
+      .dilation = 1,
+      .stride = 1,
+      .relu = false,
+      .skip_connection = false,
+      .type = LayerType::kConv1D,
+      .num_threads = 1,
+      .per_column_barrier = false,
+      .from = LayerParams::FromDisk{.path = model_path.string(),
+                                    .zipped = IsZippedModel(model_path,
+                                                            prefix)},
+      .prefix = prefix + "_ar_to_gates_"});
+  ASSERT_NE(ar_to_gates_layer, nullptr);
+
+  std::minstd_rand gen(1);
+  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+  csrblocksparse::CacheAlignedVector<ArOutputType> output(num_gate_inputs);
+  for (int trial = 0; trial < 8; ++trial) {
+    std::vector<float> ar_input(num_split_bands);
+    auto input = ar_to_gates_layer->InputViewToUpdate();
+    for (int band = 0; band < num_split_bands; ++band) {
+      input[band] = static_cast<ArRhsType>(distribution(gen));
+      ar_input[band] = static_cast<float>(input[band]);
+    }
+    LaunchOnThreadsWithBarrier(
+        1, [&](csrblocksparse::SpinBarrier* barrier, int tid) {
+          ar_to_gates_layer->Run(tid, barrier, output.AsMutableView());
+        });
+
+    for (int row = 0; row < num_gate_inputs; ++row) {
+      float fused = wavegru->ar_to_gates_bias()[row];
+      for (int band = 0; band < num_split_bands; ++band) {
+        fused += wavegru->ar_to_gates_weights()[row * num_split_bands + band] *
+                 ar_input[band];
+      }
+      EXPECT_NEAR(fused, static_cast<float>(output[row]), 1e-4f)
+          << "Trial " << trial << ", row " << row << ".";
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     ThreadsAndSampleRates, LyraWavegruTest,
     testing::Combine(testing::ValuesIn(kNumThreads),
@@ -0,0 +1,436 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "model_bundle.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // !defined(_WIN32)
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kMagicSize = sizeof(kModelBundleMagic) - 1;
+// Magic, version, identifier, section count and index checksum.
+constexpr int kHeaderSize = kMagicSize + 4 * sizeof(uint32_t);
+
+void AppendUint32(uint32_t value, std::string* bytes) {
+  for (int i = 0; i < 4; ++i) {
+    bytes->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+void AppendUint64(uint64_t value, std::string* bytes) {
+  for (int i = 0; i < 8; ++i) {
+    bytes->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64_t Align(uint64_t offset) {
+  return (offset + kModelBundleAlignment - 1) / kModelBundleAlignment *
+         kModelBundleAlignment;
+}
+
+// Reads little-endian integers and byte strings from a buffer, failing
+// instead of reading past its end.
+class Reader {
+ public:
+  Reader(const char* data, uint64_t size) : data_(data), size_(size) {}
+
+  bool ReadUint32(uint32_t* value) {
+    uint64_t value64;
+    if (!ReadLittleEndian(4, &value64)) return false;
+    *value = static_cast<uint32_t>(value64);
+    return true;
+  }
+
+  bool ReadUint64(uint64_t* value) { return ReadLittleEndian(8, value); }
+
+  bool ReadBytes(uint64_t num_bytes, absl::string_view* bytes) {
+    if (num_bytes > size_ - position_) return false;
+    *bytes = absl::string_view(data_ + position_, num_bytes);
+    position_ += num_bytes;
+    return true;
+  }
+
+  uint64_t position() const { return position_; }
+
+ private:
+  bool ReadLittleEndian(int num_bytes, uint64_t* value) {
+    if (static_cast<uint64_t>(num_bytes) > size_ - position_) return false;
+    *value = 0;
+    for (int i = 0; i < num_bytes; ++i) {
+      *value |= static_cast<uint64_t>(
+                    static_cast<unsigned char>(data_[position_ + i]))
+                << (8 * i);
+    }
+    position_ += num_bytes;
+    return true;
+  }
+
+  const char* const data_;
+  const uint64_t size_;
+  uint64_t position_ = 0;
+};
+
+constexpr char kEmbeddedModelPrefix[] = "embedded:";
+
+// Guards the unpacking of bundles into layer directories.
+absl::Mutex unpack_mutex(absl::kConstInit);
+
+// Guards |EmbeddedBundles|.
+absl::Mutex embedded_mutex(absl::kConstInit);
+
+// The data of the embedded bundles, by their model path.
+std::map<std::string, absl::string_view>& EmbeddedBundles() {
+  static auto* bundles = new std::map<std::string, absl::string_view>();
+  return *bundles;
+}
+
+absl::optional<absl::string_view> FindEmbeddedBundle(
+    const ghc::filesystem::path& model_path) {
+  absl::MutexLock lock(&embedded_mutex);
+  const auto it = EmbeddedBundles().find(model_path.string());
+  if (it == EmbeddedBundles().end()) {
+    return absl::nullopt;
+  }
+  return it->second;
+}
+
+}  // namespace
+
+uint32_t ModelBundleChecksum(absl::string_view data) {
+  static const std::array<uint32_t, 256> kTable = []() {
+    std::array<uint32_t, 256> table;
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+      }
+      table[i] = crc;
+    }
+    return table;
+  }();
+  uint32_t crc = 0xffffffffu;
+  for (const char c : data) {
+    crc = kTable[(crc ^ static_cast<unsigned char>(c)) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffffu;
+}
+
+std::string SerializeModelBundle(
+    uint32_t identifier,
+    const std::vector<std::pair<std::string, std::string>>& sections) {
+  uint64_t index_size = 0;
+  for (const auto& section : sections) {
+    index_size += 4 + section.first.size() + 8 + 8 + 4;
+  }
+  std::string index;
+  uint64_t offset = Align(kHeaderSize + index_size);
+  for (const auto& section : sections) {
+    AppendUint32(section.first.size(), &index);
+    index += section.first;
+    AppendUint64(offset, &index);
+    AppendUint64(section.second.size(), &index);
+    AppendUint32(ModelBundleChecksum(section.second), &index);
+    offset = Align(offset + section.second.size());
+  }
+
+  std::string bundle(kModelBundleMagic, kMagicSize);
+  AppendUint32(kModelBundleVersion, &bundle);
+  AppendUint32(identifier, &bundle);
+  AppendUint32(sections.size(), &bundle);
+  AppendUint32(ModelBundleChecksum(index), &bundle);
+  bundle += index;
+  for (const auto& section : sections) {
+    bundle.resize(Align(bundle.size()), '\0');
+    bundle += section.second;
+  }
+  return bundle;
+}
+
+std::unique_ptr<ModelBundle> ModelBundle::Open(
+    const ghc::filesystem::path& bundle_path) {
+  std::unique_ptr<ModelBundle> bundle;
+#if !defined(_WIN32)
+  const int fd = open(bundle_path.string().c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Could not open " << bundle_path << ".";
+    return nullptr;
+  }
+  struct stat file_stat;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (data != MAP_FAILED) {
+    bundle = absl::WrapUnique(new ModelBundle(bundle_path,
+                                              static_cast<const char*>(data),
+                                              file_stat.st_size,
+                                              Storage::kMapped));
+  }
+#endif  // !defined(_WIN32)
+  if (bundle == nullptr) {
+    std::ifstream file(bundle_path.string(), std::ios::binary);
+    const std::string contents{std::istreambuf_iterator<char>(file),
+                               std::istreambuf_iterator<char>()};
+    if (!file.is_open() || file.bad()) {
+      LOG(ERROR) << "Could not read " << bundle_path << ".";
+      return nullptr;
+    }
+    char* data = new char[contents.size()];
+    std::memcpy(data, contents.data(), contents.size());
+    bundle = absl::WrapUnique(new ModelBundle(bundle_path, data,
+                                              contents.size(),
+                                              Storage::kAllocated));
+  }
+  if (!bundle->ReadIndex()) {
+    LOG(ERROR) << bundle_path << " is not a valid model bundle.";
+    return nullptr;
+  }
+  return bundle;
+}
+
+std::shared_ptr<const ModelBundle> ModelBundle::OpenShared(
+    const ghc::filesystem::path& bundle_path) {
+  static absl::Mutex mutex(absl::kConstInit);
+  static auto* bundles =
+      new std::map<std::string, std::weak_ptr<const ModelBundle>>();
+  absl::MutexLock lock(&mutex);
+  std::weak_ptr<const ModelBundle>& cached = (*bundles)[bundle_path.string()];
+  std::shared_ptr<const ModelBundle> bundle = cached.lock();
+  if (bundle != nullptr) {
+    return bundle;
+  }
+  const absl::optional<absl::string_view> embedded =
+      FindEmbeddedBundle(bundle_path);
+  if (embedded.has_value()) {
+    auto embedded_bundle = absl::WrapUnique(
+        new ModelBundle(bundle_path, embedded->data(), embedded->size(),
+                        Storage::kEmbedded));
+    if (!embedded_bundle->ReadIndex()) {
+      LOG(ERROR) << bundle_path << " is not a valid model bundle.";
+      return nullptr;
+    }
+    bundle = std::move(embedded_bundle);
+  } else {
+    bundle = Open(bundle_path);
+  }
+  cached = bundle;
+  return bundle;
+}
+
+ModelBundle::ModelBundle(const ghc::filesystem::path& path, const char* data,
+                         uint64_t size, Storage storage)
+    : path_(path), data_(data), size_(size), storage_(storage) {}
+
+ModelBundle::~ModelBundle() {
+  switch (storage_) {
+    case Storage::kMapped:
+#if !defined(_WIN32)
+      munmap(const_cast<char*>(data_), size_);
+#endif  // !defined(_WIN32)
+      break;
+    case Storage::kAllocated:
+      delete[] data_;
+      break;
+    case Storage::kEmbedded:
+      break;
+  }
+}
+
+bool ModelBundle::ReadIndex() {
+  Reader reader(data_, size_);
+  absl::string_view magic;
+  uint32_t version;
+  uint32_t num_sections;
+  if (!reader.ReadBytes(kMagicSize, &magic) ||
+      magic != absl::string_view(kModelBundleMagic, kMagicSize) ||
+      !reader.ReadUint32(&version) || !reader.ReadUint32(&identifier_) ||
+      !reader.ReadUint32(&num_sections) ||
+      !reader.ReadUint32(&index_checksum_)) {
+    return false;
+  }
+  if (version != kModelBundleVersion) {
+    LOG(ERROR) << "Bundle version " << version << " is not supported, only "
+               << kModelBundleVersion << " is.";
+    return false;
+  }
+  const uint64_t index_start = reader.position();
+  for (uint32_t i = 0; i < num_sections; ++i) {
+    uint32_t name_size;
+    absl::string_view name;
+    Entry entry;
+    if (!reader.ReadUint32(&name_size) || !reader.ReadBytes(name_size, &name) ||
+        !reader.ReadUint64(&entry.offset) || !reader.ReadUint64(&entry.size) ||
+        !reader.ReadUint32(&entry.checksum) || entry.offset > size_ ||
+        entry.size > size_ - entry.offset) {
+      return false;
+    }
+    names_.emplace_back(name);
+    entries_.emplace(std::string(name), entry);
+  }
+  const absl::string_view index(data_ + index_start,
+                                reader.position() - index_start);
+  if (ModelBundleChecksum(index) != index_checksum_) {
+    LOG(ERROR) << "The index of the bundle does not match its checksum.";
+    return false;
+  }
+  return true;
+}
+
+std::vector<std::string> ModelBundle::SectionNames() const { return names_; }
+
+bool ModelBundle::Contains(absl::string_view name) const {
+  return entries_.find(name) != entries_.end();
+}
+
+absl::string_view ModelBundle::Section(absl::string_view name) const {
+  const auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    return absl::string_view();
+  }
+  return absl::string_view(data_ + it->second.offset, it->second.size);
+}
+
+bool ModelBundle::VerifyChecksums() const {
+  for (const auto& name_and_entry : entries_) {
+    const Entry& entry = name_and_entry.second;
+    if (ModelBundleChecksum(absl::string_view(data_ + entry.offset,
+                                              entry.size)) != entry.checksum) {
+      LOG(ERROR) << "Section " << name_and_entry.first << " of " << path_
+                 << " does not match its checksum.";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ModelBundle::Unpack(const ghc::filesystem::path& output_dir) const {
+  std::error_code error_code;
+  if (!ghc::filesystem::is_directory(output_dir, error_code) &&
+      !ghc::filesystem::create_directories(output_dir, error_code)) {
+    LOG(ERROR) << "Could not create " << output_dir << ".";
+    return false;
+  }
+  for (const std::string& name : names_) {
+    const absl::string_view section = Section(name);
+    std::ofstream file((output_dir / name).string(),
+                       std::ios::binary | std::ios::trunc);
+    file.write(section.data(), section.size());
+    if (!file.good()) {
+      LOG(ERROR) << "Could not write " << output_dir / name << ".";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RegisterEmbeddedModelBundle(absl::string_view name,
+                                 absl::string_view data) {
+  absl::MutexLock lock(&embedded_mutex);
+  EmbeddedBundles()[EmbeddedModelPath(name).string()] = data;
+  return true;
+}
+
+ghc::filesystem::path EmbeddedModelPath(absl::string_view name) {
+  return ghc::filesystem::path(absl::StrCat(kEmbeddedModelPrefix, name));
+}
+
+bool IsModelBundle(const ghc::filesystem::path& model_path) {
+  if (FindEmbeddedBundle(model_path).has_value()) {
+    return true;
+  }
+  std::error_code error_code;
+  if (!ghc::filesystem::is_regular_file(model_path, error_code)) {
+    return false;
+  }
+  std::ifstream file(model_path.string(), std::ios::binary);
+  char magic[kMagicSize];
+  return file.read(magic, kMagicSize) &&
+         absl::string_view(magic, kMagicSize) ==
+             absl::string_view(kModelBundleMagic, kMagicSize);
+}
+
+ghc::filesystem::path ModelLayerDirectory(
+    const ghc::filesystem::path& model_path) {
+  if (!IsModelBundle(model_path)) {
+    return model_path;
+  }
+  const std::shared_ptr<const ModelBundle> bundle =
+      ModelBundle::OpenShared(model_path);
+  if (bundle == nullptr) {
+    return ghc::filesystem::path();
+  }
+  std::error_code error_code;
+  const ghc::filesystem::path layer_dir =
+      ghc::filesystem::temp_directory_path(error_code) /
+      absl::StrFormat("lyra_bundle_%08x", bundle->index_checksum());
+  absl::MutexLock lock(&unpack_mutex);
+  if (ghc::filesystem::is_directory(layer_dir, error_code)) {
+    return layer_dir;
+  }
+  // The bundle is unpacked next to |layer_dir| and renamed in one step, so
+  // that other processes either see all of it or nothing.
+  const ghc::filesystem::path unpack_dir = absl::StrCat(
+      layer_dir.string(), ".", absl::ToUnixNanos(absl::Now()), ".tmp");
+  if (!bundle->VerifyChecksums() || !bundle->Unpack(unpack_dir)) {
+    ghc::filesystem::remove_all(unpack_dir, error_code);
+    LOG(ERROR) << "Could not unpack " << model_path << ".";
+    return ghc::filesystem::path();
+  }
+  ghc::filesystem::rename(unpack_dir, layer_dir, error_code);
+  if (error_code) {
+    ghc::filesystem::remove_all(unpack_dir, error_code);
+    if (!ghc::filesystem::is_directory(layer_dir, error_code)) {
+      LOG(ERROR) << "Could not move the layers of " << model_path << " to "
+                 << layer_dir << ".";
+      return ghc::filesystem::path();
+    }
+  }
+  LOG(INFO) << "Unpacked the layers of " << model_path << " to " << layer_dir
+            << ".";
+  return layer_dir;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
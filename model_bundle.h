@@ -0,0 +1,157 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_MODEL_BUNDLE_H_
+#define LYRA_CODEC_MODEL_BUNDLE_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+
+// A model in a single file, which loads with one open and one mapping instead
+// of a stat and an open per asset. |WriteModelBundle| writes one from a model
+// directory, holding every file of it with the gzipped arrays decompressed.
+// All integers are little-endian:
+//
+//   magic           8 bytes, |kModelBundleMagic|
+//   format version  uint32, |kModelBundleVersion|
+//   identifier      uint32, the |LyraConfig| identifier of the weights
+//   section count   uint32
+//   index checksum  uint32, CRC-32 of the index
+//   index, for every section:
+//     name size     uint32, followed by the name
+//     offset        uint64, from the start of the file
+//     size          uint64
+//     checksum      uint32, CRC-32 of the section
+//   sections, each at an offset that is a multiple of |kModelBundleAlignment|
+//
+// Sections are named after the file they hold, without ".gz".
+inline constexpr char kModelBundleMagic[] = "LYRABNDL";
+inline constexpr uint32_t kModelBundleVersion = 1;
+inline constexpr int kModelBundleAlignment = 64;
+
+// Returns the CRC-32 of |data|, as used for the checksums of a bundle.
+uint32_t ModelBundleChecksum(absl::string_view data);
+
+// Returns a bundle of |sections|, each a name and its contents, with
+// |identifier|.
+std::string SerializeModelBundle(
+    uint32_t identifier,
+    const std::vector<std::pair<std::string, std::string>>& sections);
+
+class ModelBundle {
+ public:
+  // Maps the bundle at |bundle_path| and reads its index. Returns a nullptr if
+  // it cannot be read, is not a bundle or has a version or an index checksum
+  // that does not match. The checksums of the sections are not verified.
+  static std::unique_ptr<ModelBundle> Open(
+      const ghc::filesystem::path& bundle_path);
+
+  // Same as |Open|, but returns the bundle that is already open at
+  // |bundle_path| if there is one, so that the instances created from a
+  // bundle share its mapping. Also opens the bundles compiled into the binary
+  // at their |EmbeddedModelPath|.
+  static std::shared_ptr<const ModelBundle> OpenShared(
+      const ghc::filesystem::path& bundle_path);
+
+  ~ModelBundle();
+
+  uint32_t identifier() const { return identifier_; }
+
+  // Covers the checksums of all sections, so it tells bundles apart.
+  uint32_t index_checksum() const { return index_checksum_; }
+
+  // Names of all sections, in the order of the index.
+  std::vector<std::string> SectionNames() const;
+
+  bool Contains(absl::string_view name) const;
+
+  // Returns the contents of the section |name|, which stay valid as long as
+  // the bundle, or an empty view if there is no such section.
+  absl::string_view Section(absl::string_view name) const;
+
+  // Returns whether every section matches its checksum.
+  bool VerifyChecksums() const;
+
+  // Writes every section as a file into |output_dir|, which then holds an
+  // unpacked model. Returns false on failure.
+  bool Unpack(const ghc::filesystem::path& output_dir) const;
+
+  const ghc::filesystem::path& path() const { return path_; }
+
+ private:
+  struct Entry {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t checksum;
+  };
+
+  enum class Storage { kMapped, kAllocated, kEmbedded };
+
+  ModelBundle(const ghc::filesystem::path& path, const char* data,
+              uint64_t size, Storage storage);
+
+  bool ReadIndex();
+
+  const ghc::filesystem::path path_;
+  // The whole file, owned unless it is embedded.
+  const char* const data_;
+  const uint64_t size_;
+  const Storage storage_;
+  uint32_t identifier_ = 0;
+  uint32_t index_checksum_ = 0;
+  std::vector<std::string> names_;
+  std::map<std::string, Entry, std::less<>> entries_;
+};
+
+// Makes the bundle |data|, which has to outlive all users and is usually a
+// constant array compiled into the binary, available at
+// |EmbeddedModelPath(name)|. Generated embedded model libraries call this
+// during static initialization. Returns true, so a global can hold the result.
+bool RegisterEmbeddedModelBundle(absl::string_view name,
+                                 absl::string_view data);
+
+// Returns the model path of the embedded bundle |name|, which can be passed
+// wherever the codec takes the path of a model.
+ghc::filesystem::path EmbeddedModelPath(absl::string_view name);
+
+// Returns whether |model_path| is a file starting with |kModelBundleMagic| or
+// an embedded bundle.
+bool IsModelBundle(const ghc::filesystem::path& model_path);
+
+// Returns the directory the sparse layers of the model at |model_path| are
+// loaded from, which is |model_path| itself unless it is a bundle. The sparse
+// inference library only reads layers from files, so the first call for a
+// bundle unpacks it, once per bundle checksum, into a directory in the
+// temporary directory of the system that later calls and processes reuse.
+// Returns an empty path on failure.
+ghc::filesystem::path ModelLayerDirectory(
+    const ghc::filesystem::path& model_path);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_MODEL_BUNDLE_H_
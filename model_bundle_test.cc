@@ -0,0 +1,198 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "model_bundle.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using Sections = std::vector<std::pair<std::string, std::string>>;
+
+class ModelBundleTest : public testing::Test {
+ protected:
+  ModelBundleTest()
+      : test_dir_(ghc::filesystem::path(testing::TempDir()) / "model_bundle"),
+        bundle_path_(test_dir_ / "model.lyra"),
+        sections_({{"lyra_config.textproto", "identifier: 3\n"},
+                   {"lyra_16khz_gru_layer_bias.raw", std::string(100, 'b')},
+                   {"empty", ""}}) {}
+
+  void SetUp() override {
+    std::error_code error_code;
+    ghc::filesystem::create_directories(test_dir_, error_code);
+    ASSERT_FALSE(error_code);
+  }
+
+  void TearDown() override {
+    std::error_code error_code;
+    ghc::filesystem::remove_all(test_dir_, error_code);
+    ASSERT_FALSE(error_code);
+  }
+
+  void WriteBundle(const std::string& bundle) {
+    std::ofstream file(bundle_path_.string(),
+                       std::ios::binary | std::ios::trunc);
+    file.write(bundle.data(), bundle.size());
+    ASSERT_TRUE(file.good());
+  }
+
+  const ghc::filesystem::path test_dir_;
+  const ghc::filesystem::path bundle_path_;
+  const Sections sections_;
+};
+
+TEST(ModelBundleChecksum, MatchesCrc32) {
+  EXPECT_EQ(ModelBundleChecksum("123456789"), 0xcbf43926u);
+  EXPECT_EQ(ModelBundleChecksum(""), 0u);
+}
+
+TEST_F(ModelBundleTest, SerializedBundleOpens) {
+  WriteBundle(SerializeModelBundle(/*identifier=*/3, sections_));
+
+  const auto bundle = ModelBundle::Open(bundle_path_);
+  ASSERT_NE(bundle, nullptr);
+  EXPECT_EQ(bundle->identifier(), 3);
+  ASSERT_EQ(bundle->SectionNames().size(), sections_.size());
+  for (int i = 0; i < sections_.size(); ++i) {
+    EXPECT_EQ(bundle->SectionNames()[i], sections_[i].first);
+    EXPECT_TRUE(bundle->Contains(sections_[i].first));
+    EXPECT_EQ(bundle->Section(sections_[i].first), sections_[i].second);
+  }
+  EXPECT_FALSE(bundle->Contains("missing"));
+  EXPECT_TRUE(bundle->Section("missing").empty());
+  EXPECT_TRUE(bundle->VerifyChecksums());
+}
+
+TEST_F(ModelBundleTest, SectionsAreAligned) {
+  WriteBundle(SerializeModelBundle(/*identifier=*/3, sections_));
+
+  const auto bundle = ModelBundle::Open(bundle_path_);
+  ASSERT_NE(bundle, nullptr);
+  const absl::string_view section =
+      bundle->Section("lyra_16khz_gru_layer_bias.raw");
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(section.data()) %
+                kModelBundleAlignment,
+            0);
+}
+
+TEST_F(ModelBundleTest, SharedBundleIsReused) {
+  WriteBundle(SerializeModelBundle(/*identifier=*/3, sections_));
+
+  const auto bundle = ModelBundle::OpenShared(bundle_path_);
+  ASSERT_NE(bundle, nullptr);
+  EXPECT_EQ(ModelBundle::OpenShared(bundle_path_), bundle);
+}
+
+TEST_F(ModelBundleTest, CorruptIndexFails) {
+  std::string bundle = SerializeModelBundle(/*identifier=*/3, sections_);
+  // The name of the first section starts after the 24 byte header and its
+  // size.
+  bundle[28] ^= 1;
+  WriteBundle(bundle);
+
+  EXPECT_EQ(ModelBundle::Open(bundle_path_), nullptr);
+}
+
+TEST_F(ModelBundleTest, CorruptSectionFailsVerification) {
+  std::string bundle = SerializeModelBundle(/*identifier=*/3, sections_);
+  bundle[bundle.rfind('b')] = 'c';
+  WriteBundle(bundle);
+
+  const auto opened = ModelBundle::Open(bundle_path_);
+  ASSERT_NE(opened, nullptr);
+  EXPECT_FALSE(opened->VerifyChecksums());
+}
+
+TEST_F(ModelBundleTest, TruncatedBundleFails) {
+  const std::string bundle = SerializeModelBundle(/*identifier=*/3, sections_);
+  WriteBundle(bundle.substr(0, bundle.size() - 1));
+
+  EXPECT_EQ(ModelBundle::Open(bundle_path_), nullptr);
+}
+
+TEST_F(ModelBundleTest, UnpackWritesSections) {
+  WriteBundle(SerializeModelBundle(/*identifier=*/3, sections_));
+  const auto bundle = ModelBundle::Open(bundle_path_);
+  ASSERT_NE(bundle, nullptr);
+
+  const ghc::filesystem::path output_dir = test_dir_ / "unpacked";
+  ASSERT_TRUE(bundle->Unpack(output_dir));
+  for (const auto& section : sections_) {
+    std::ifstream file((output_dir / section.first).string(),
+                       std::ios::binary);
+    const std::string contents{std::istreambuf_iterator<char>(file),
+                               std::istreambuf_iterator<char>()};
+    EXPECT_EQ(contents, section.second) << section.first;
+  }
+}
+
+TEST_F(ModelBundleTest, OnlyBundlesAreBundles) {
+  WriteBundle(SerializeModelBundle(/*identifier=*/3, sections_));
+
+  EXPECT_TRUE(IsModelBundle(bundle_path_));
+  EXPECT_FALSE(IsModelBundle(test_dir_));
+  EXPECT_FALSE(IsModelBundle(test_dir_ / "missing"));
+  std::ofstream(test_dir_ / "other").write("LYRA", 4);
+  EXPECT_FALSE(IsModelBundle(test_dir_ / "other"));
+}
+
+TEST_F(ModelBundleTest, EmbeddedBundleOpensInPlace) {
+  static const std::string* const kEmbedded = new std::string(
+      SerializeModelBundle(/*identifier=*/3, {{"section", "contents"}}));
+  ASSERT_TRUE(RegisterEmbeddedModelBundle("test", *kEmbedded));
+
+  const ghc::filesystem::path model_path = EmbeddedModelPath("test");
+  EXPECT_TRUE(IsModelBundle(model_path));
+  EXPECT_FALSE(IsModelBundle(EmbeddedModelPath("missing")));
+  const auto bundle = ModelBundle::OpenShared(model_path);
+  ASSERT_NE(bundle, nullptr);
+  EXPECT_EQ(bundle->identifier(), 3);
+  const absl::string_view section = bundle->Section("section");
+  EXPECT_EQ(section, "contents");
+  // The section is not copied out of the embedded data.
+  EXPECT_GE(section.data(), kEmbedded->data());
+  EXPECT_LT(section.data(), kEmbedded->data() + kEmbedded->size());
+}
+
+TEST_F(ModelBundleTest, DirectoryIsItsOwnLayerDirectory) {
+  EXPECT_EQ(ModelLayerDirectory(test_dir_), test_dir_);
+}
+
+TEST_F(ModelBundleTest, LayerDirectoryHoldsSections) {
+  WriteBundle(SerializeModelBundle(/*identifier=*/3, sections_));
+
+  const ghc::filesystem::path layer_dir = ModelLayerDirectory(bundle_path_);
+  ASSERT_FALSE(layer_dir.empty());
+  for (const auto& section : sections_) {
+    EXPECT_TRUE(ghc::filesystem::exists(layer_dir / section.first));
+  }
+  EXPECT_EQ(ModelLayerDirectory(bundle_path_), layer_dir);
+  std::error_code error_code;
+  ghc::filesystem::remove_all(layer_dir, error_code);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
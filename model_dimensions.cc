@@ -0,0 +1,126 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "model_dimensions.h"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/text_format.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_config.pb.h"
+#include "model_bundle.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+absl::Status CheckDimension(absl::string_view name, int size) {
+  if (size <= 0 || size % kModelDimensionsMultiple != 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s has to be a positive multiple of %d, but is %d.", name,
+        kModelDimensionsMultiple, size));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<ModelDimensions> ModelDimensionsFromConfig(
+    const third_party::lyra_codec::LyraConfig& config) {
+  ModelDimensions dimensions;
+  if (!config.has_model_dimensions()) {
+    return dimensions;
+  }
+  const third_party::lyra_codec::ModelDimensions& proto =
+      config.model_dimensions();
+  if (proto.has_num_gru_hiddens()) {
+    const absl::Status status =
+        CheckDimension("num_gru_hiddens", proto.num_gru_hiddens());
+    if (!status.ok()) {
+      return status;
+    }
+    dimensions.num_gru_hiddens = proto.num_gru_hiddens();
+  }
+  if (proto.has_num_cond_hiddens()) {
+    const absl::Status status =
+        CheckDimension("num_cond_hiddens", proto.num_cond_hiddens());
+    if (!status.ok()) {
+      return status;
+    }
+    dimensions.num_cond_hiddens = proto.num_cond_hiddens();
+  }
+  if (proto.has_num_split_bands()) {
+    if (proto.num_split_bands() != 4 && proto.num_split_bands() != 8) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "num_split_bands has to be 4 or 8, but is %d.",
+          proto.num_split_bands()));
+    }
+    dimensions.num_split_bands = proto.num_split_bands();
+  }
+  return dimensions;
+}
+
+absl::StatusOr<ModelDimensions> ReadModelDimensions(
+    const ghc::filesystem::path& model_path) {
+  // A bundle holds the config as one of its sections.
+  std::string config_string;
+  if (IsModelBundle(model_path)) {
+    const std::shared_ptr<const ModelBundle> bundle =
+        ModelBundle::OpenShared(model_path);
+    if (bundle == nullptr) {
+      return absl::UnavailableError(
+          absl::StrFormat("Could not open bundle %s.", model_path.string()));
+    }
+    if (!bundle->Contains(kLyraConfigProto)) {
+      return ModelDimensions();
+    }
+    config_string = std::string(bundle->Section(kLyraConfigProto));
+  } else {
+    const ghc::filesystem::path config_path =
+        model_path / std::string(kLyraConfigProto);
+    std::error_code error_code;
+    if (!ghc::filesystem::is_regular_file(config_path, error_code)) {
+      return ModelDimensions();
+    }
+    std::ifstream config_stream(config_path.string());
+    if (!config_stream) {
+      return absl::NotFoundError(
+          absl::StrFormat("Could not open %s.", config_path.string()));
+    }
+    config_string.assign(std::istreambuf_iterator<char>(config_stream),
+                         std::istreambuf_iterator<char>());
+  }
+  third_party::lyra_codec::LyraConfig config;
+  // Even though LyraConfig is a subclass of Message, the reinterpreting is
+  // necessary for the mobile proto library.
+  if (!google::protobuf::TextFormat::ParseFromString(
+          config_string,
+          reinterpret_cast<google::protobuf::Message*>(&config))) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Error when parsing the config of %s.", model_path.string()));
+  }
+  return ModelDimensionsFromConfig(config);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_MODEL_DIMENSIONS_H_
+#define LYRA_CODEC_MODEL_DIMENSIONS_H_
+
+#include "absl/status/statusor.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.pb.h"
+
+namespace chromemedia {
+namespace codec {
+
+// The sizes of the |ModelDimensions| message in lyra_config.proto, with the
+// sizes of the default model for the fields that are unset there.
+struct ModelDimensions {
+  int num_gru_hiddens = 1024;
+  int num_cond_hiddens = 512;
+  int num_split_bands = 4;
+};
+
+// Every size is a multiple of this, so that the layers split between threads
+// on whole cache lines and SIMD registers.
+inline constexpr int kModelDimensionsMultiple = 32;
+
+// Returns the dimensions of |config| over the defaults, or an error if a size
+// is not a positive multiple of |kModelDimensionsMultiple| or the number of
+// split bands is neither 4 nor 8.
+absl::StatusOr<ModelDimensions> ModelDimensionsFromConfig(
+    const third_party::lyra_codec::LyraConfig& config);
+
+// Returns the dimensions of the model at |model_path|, as
+// |ModelDimensionsFromConfig| does, from the lyra_config.textproto of the
+// directory or bundle. A model without one has the default dimensions.
+absl::StatusOr<ModelDimensions> ReadModelDimensions(
+    const ghc::filesystem::path& model_path);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_MODEL_DIMENSIONS_H_
@@ -0,0 +1,150 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "model_dimensions.h"
+
+#include <fstream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.pb.h"
+#include "model_bundle.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+third_party::lyra_codec::LyraConfig ParseConfig(const std::string& text) {
+  third_party::lyra_codec::LyraConfig config;
+  EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      text, reinterpret_cast<google::protobuf::Message*>(&config)));
+  return config;
+}
+
+TEST(ModelDimensionsTest, UnsetFieldsKeepDefaults) {
+  const auto dimensions_or =
+      ModelDimensionsFromConfig(ParseConfig("identifier: 2"));
+  ASSERT_TRUE(dimensions_or.ok());
+  EXPECT_EQ(dimensions_or->num_gru_hiddens, 1024);
+  EXPECT_EQ(dimensions_or->num_cond_hiddens, 512);
+  EXPECT_EQ(dimensions_or->num_split_bands, 4);
+}
+
+TEST(ModelDimensionsTest, SetFieldsOverrideDefaults) {
+  const auto dimensions_or = ModelDimensionsFromConfig(ParseConfig(R"(
+      model_dimensions {
+        num_gru_hiddens: 384
+        num_cond_hiddens: 256
+        num_split_bands: 8
+      })"));
+  ASSERT_TRUE(dimensions_or.ok());
+  EXPECT_EQ(dimensions_or->num_gru_hiddens, 384);
+  EXPECT_EQ(dimensions_or->num_cond_hiddens, 256);
+  EXPECT_EQ(dimensions_or->num_split_bands, 8);
+}
+
+TEST(ModelDimensionsTest, OnlyFourOrEightSplitBands) {
+  for (const int num_split_bands : {0, 2, 6, 16}) {
+    const auto dimensions_or = ModelDimensionsFromConfig(ParseConfig(
+        "model_dimensions { num_split_bands: " +
+        std::to_string(num_split_bands) + " }"));
+    EXPECT_EQ(dimensions_or.status().code(),
+              absl::StatusCode::kInvalidArgument)
+        << num_split_bands;
+  }
+}
+
+TEST(ModelDimensionsTest, SizesHaveToBePositiveMultiples) {
+  for (const absl::string_view text :
+       {"model_dimensions { num_gru_hiddens: 0 }",
+        "model_dimensions { num_gru_hiddens: 500 }",
+        "model_dimensions { num_cond_hiddens: -32 }"}) {
+    const auto dimensions_or =
+        ModelDimensionsFromConfig(ParseConfig(std::string(text)));
+    EXPECT_EQ(dimensions_or.status().code(),
+              absl::StatusCode::kInvalidArgument)
+        << text;
+  }
+  EXPECT_THAT(ModelDimensionsFromConfig(
+                  ParseConfig("model_dimensions { num_gru_hiddens: 500 }"))
+                  .status()
+                  .message(),
+              HasSubstr("num_gru_hiddens"));
+}
+
+class ReadModelDimensionsTest : public testing::Test {
+ protected:
+  ReadModelDimensionsTest()
+      : model_path_(ghc::filesystem::temp_directory_path() /
+                    "model_dimensions_test") {
+    ghc::filesystem::create_directories(model_path_);
+  }
+
+  ~ReadModelDimensionsTest() override {
+    ghc::filesystem::remove_all(model_path_);
+  }
+
+  const ghc::filesystem::path model_path_;
+  const std::string config_ =
+      "identifier: 2 model_dimensions { num_gru_hiddens: 512 }";
+};
+
+TEST_F(ReadModelDimensionsTest, DirectoryWithoutConfigHasDefaults) {
+  const auto dimensions_or = ReadModelDimensions(model_path_);
+  ASSERT_TRUE(dimensions_or.ok());
+  EXPECT_EQ(dimensions_or->num_gru_hiddens, 1024);
+}
+
+TEST_F(ReadModelDimensionsTest, ReadsTheConfigOfADirectory) {
+  {
+    std::ofstream config((model_path_ / "lyra_config.textproto").string());
+    config << config_;
+  }
+  const auto dimensions_or = ReadModelDimensions(model_path_);
+  ASSERT_TRUE(dimensions_or.ok());
+  EXPECT_EQ(dimensions_or->num_gru_hiddens, 512);
+  EXPECT_EQ(dimensions_or->num_cond_hiddens, 512);
+}
+
+TEST_F(ReadModelDimensionsTest, ReadsTheConfigOfABundle) {
+  const ghc::filesystem::path bundle_path = model_path_ / "model.lyra";
+  {
+    const std::string bundle =
+        SerializeModelBundle(2, {{"lyra_config.textproto", config_}});
+    std::ofstream bundle_file(bundle_path.string(), std::ios::binary);
+    bundle_file.write(bundle.data(), bundle.size());
+  }
+  const auto dimensions_or = ReadModelDimensions(bundle_path);
+  ASSERT_TRUE(dimensions_or.ok());
+  EXPECT_EQ(dimensions_or->num_gru_hiddens, 512);
+}
+
+TEST_F(ReadModelDimensionsTest, InvalidConfigFails) {
+  {
+    std::ofstream config((model_path_ / "lyra_config.textproto").string());
+    config << "model_dimensions { num_gru_hiddens: 1000 }";
+  }
+  EXPECT_FALSE(ReadModelDimensions(model_path_).ok());
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,238 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "model_unpacker.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/strip.h"
+#include "glog/logging.h"
+#include "google/protobuf/text_format.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_config.pb.h"
+#include "model_bundle.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr char kZippedExtension[] = ".gz";
+
+// Arrays stored as 16 bit integers on disk. Everything else is float.
+bool IsInt16Array(const std::string& file_name) {
+  return absl::StrContains(file_name, "fixed16_weights") ||
+         absl::StrContains(file_name, "codebook_dimensions");
+}
+
+template <typename T>
+bool UnzipArray(const ghc::filesystem::path& model_path,
+                const std::string& file_name, std::string* contents) {
+  std::vector<T> array;
+  const absl::Status status = csrblocksparse::ReadArrayFromFile(
+      file_name, &array, model_path.string());
+  if (!status.ok()) {
+    LOG(ERROR) << "Couldn't read " << model_path / file_name << ": "
+               << status.message();
+    return false;
+  }
+  contents->assign(reinterpret_cast<const char*>(array.data()),
+                   array.size() * sizeof(T));
+  return true;
+}
+
+// Returns whether |file_name| is one of |kAssets| that |role| does not load.
+bool IsSkippedAsset(const std::string& file_name, ModelRole role) {
+  const absl::string_view name =
+      absl::StripSuffix(file_name, kZippedExtension);
+  for (auto asset : kAssets) {
+    if (absl::StripSuffix(asset, kZippedExtension) == name) {
+      return !IsAssetOfRole(asset, role);
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool IsZippedModel(const ghc::filesystem::path& model_path,
+                   const std::string& prefix) {
+  std::error_code error_code;
+  bool found_unzipped = false;
+  for (ghc::filesystem::directory_iterator it(model_path, error_code), end;
+       !error_code && it != end; it.increment(error_code)) {
+    const std::string file_name = it->path().filename().string();
+    if (!absl::StartsWith(file_name, prefix)) {
+      continue;
+    }
+    if (absl::EndsWith(file_name, kZippedExtension)) {
+      return true;
+    }
+    found_unzipped = true;
+  }
+  return !found_unzipped;
+}
+
+bool ReadUnpackedModelFile(const ghc::filesystem::path& model_path,
+                           const std::string& file_name, std::string* contents,
+                           std::string* unpacked_name) {
+  if (!absl::EndsWith(file_name, kZippedExtension)) {
+    std::ifstream file((model_path / file_name).string(), std::ios::binary);
+    if (file.is_open()) {
+      contents->assign(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+    }
+    if (!file.is_open() || file.bad()) {
+      LOG(ERROR) << "Couldn't read " << model_path / file_name << ".";
+      return false;
+    }
+    *unpacked_name = file_name;
+    return true;
+  }
+  *unpacked_name = std::string(
+      absl::StripSuffix(file_name, kZippedExtension));
+  return IsInt16Array(file_name)
+             ? UnzipArray<int16_t>(model_path, file_name, contents)
+             : UnzipArray<float>(model_path, file_name, contents);
+}
+
+bool UnpackModel(const ghc::filesystem::path& model_path,
+                 const ghc::filesystem::path& output_dir, ModelRole role) {
+  std::error_code error_code;
+  if (!ghc::filesystem::is_directory(model_path, error_code)) {
+    LOG(ERROR) << "Model path " << model_path << " is not a directory.";
+    return false;
+  }
+  if (ghc::filesystem::equivalent(model_path, output_dir, error_code)) {
+    LOG(ERROR) << "Cannot unpack " << model_path << " into itself.";
+    return false;
+  }
+  if (!ghc::filesystem::is_directory(output_dir, error_code) &&
+      !ghc::filesystem::create_directories(output_dir, error_code)) {
+    LOG(ERROR) << "Tried creating output dir " << output_dir
+               << " but failed.";
+    return false;
+  }
+
+  for (ghc::filesystem::directory_iterator it(model_path, error_code), end;
+       !error_code && it != end; it.increment(error_code)) {
+    const std::string file_name = it->path().filename().string();
+    if (!it->is_regular_file() || IsSkippedAsset(file_name, role)) {
+      continue;
+    }
+    if (!absl::EndsWith(file_name, kZippedExtension)) {
+      ghc::filesystem::copy_file(
+          it->path(), output_dir / file_name,
+          ghc::filesystem::copy_options::overwrite_existing, error_code);
+      if (error_code) {
+        LOG(ERROR) << "Couldn't copy " << it->path() << ": "
+                   << error_code.message();
+        return false;
+      }
+      continue;
+    }
+    std::string contents;
+    std::string unpacked_name;
+    if (!ReadUnpackedModelFile(model_path, file_name, &contents,
+                               &unpacked_name)) {
+      return false;
+    }
+    const ghc::filesystem::path output_path = output_dir / unpacked_name;
+    std::ofstream output_file(output_path.string(),
+                              std::ios::binary | std::ios::trunc);
+    output_file.write(contents.data(), contents.size());
+    if (!output_file.good()) {
+      LOG(ERROR) << "Couldn't write " << output_path << ".";
+      return false;
+    }
+  }
+  if (error_code) {
+    LOG(ERROR) << "Couldn't list " << model_path << ": "
+               << error_code.message();
+    return false;
+  }
+  return true;
+}
+
+bool WriteModelBundle(const ghc::filesystem::path& model_path,
+                      const ghc::filesystem::path& bundle_path,
+                      ModelRole role) {
+  std::error_code error_code;
+  if (!ghc::filesystem::is_directory(model_path, error_code)) {
+    LOG(ERROR) << "Model path " << model_path << " is not a directory.";
+    return false;
+  }
+  // Sorted so that the same model always gives the same bundle.
+  std::vector<std::string> file_names;
+  for (ghc::filesystem::directory_iterator it(model_path, error_code), end;
+       !error_code && it != end; it.increment(error_code)) {
+    const std::string file_name = it->path().filename().string();
+    if (it->is_regular_file() && !IsSkippedAsset(file_name, role)) {
+      file_names.push_back(file_name);
+    }
+  }
+  if (error_code) {
+    LOG(ERROR) << "Couldn't list " << model_path << ": "
+               << error_code.message();
+    return false;
+  }
+  std::sort(file_names.begin(), file_names.end());
+
+  std::vector<std::pair<std::string, std::string>> sections;
+  uint32_t identifier = 0;
+  for (const std::string& file_name : file_names) {
+    std::string contents;
+    std::string unpacked_name;
+    if (!ReadUnpackedModelFile(model_path, file_name, &contents,
+                               &unpacked_name)) {
+      return false;
+    }
+    if (unpacked_name == kLyraConfigProto) {
+      third_party::lyra_codec::LyraConfig lyra_config;
+      // Even though LyraConfig is a subclass of Message, the reinterpreting is
+      // necessary for the mobile proto library.
+      if (!google::protobuf::TextFormat::ParseFromString(
+              contents,
+              reinterpret_cast<google::protobuf::Message*>(&lyra_config))) {
+        LOG(ERROR) << "Couldn't parse " << model_path / file_name << ".";
+        return false;
+      }
+      identifier = lyra_config.identifier();
+    }
+    sections.emplace_back(std::move(unpacked_name), std::move(contents));
+  }
+
+  const std::string bundle = SerializeModelBundle(identifier, sections);
+  std::ofstream bundle_file(bundle_path.string(),
+                            std::ios::binary | std::ios::trunc);
+  bundle_file.write(bundle.data(), bundle.size());
+  if (!bundle_file.good()) {
+    LOG(ERROR) << "Couldn't write " << bundle_path << ".";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_MODEL_UNPACKER_H_
+#define LYRA_CODEC_MODEL_UNPACKER_H_
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "model_bundle.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Returns whether the model arrays under |model_path| whose file names start
+// with |prefix| are stored gzipped. A directory written by UnpackModel() holds
+// only uncompressed arrays, which the loaders read without decompressing.
+// Defaults to true when no array with |prefix| can be found, so that the
+// error reported is the same as for a missing gzipped model.
+bool IsZippedModel(const ghc::filesystem::path& model_path,
+                   const std::string& prefix);
+
+// Reads the file |file_name| of the model under |model_path| into |contents|
+// as |UnpackModel| writes it, i.e. decompressed if it is a gzipped array, and
+// sets |unpacked_name| to the name it is written under. Returns false on
+// failure.
+bool ReadUnpackedModelFile(const ghc::filesystem::path& model_path,
+                           const std::string& file_name, std::string* contents,
+                           std::string* unpacked_name);
+
+// Decompresses every gzipped array of the model under |model_path| into
+// |output_dir|, and copies all other files as they are. The output directory
+// is created if it does not exist. Loading from the unpacked directory skips
+// gunzipping the layer weights and quantizer tables, which dominates the
+// creation time of encoders and decoders. Assets of |kAssets| not loaded by
+// |role| are left out, so that e.g. encoder deployments ship only the
+// quantizer. Returns false on failure.
+bool UnpackModel(const ghc::filesystem::path& model_path,
+                 const ghc::filesystem::path& output_dir,
+                 ModelRole role = ModelRole::kDecoder);
+
+// Writes the model directory |model_path| into a single file bundle at
+// |bundle_path|, with the identifier of its lyra_config.textproto if it has
+// one. Like |UnpackModel|, it only holds the assets of |role|. Returns false
+// on failure.
+bool WriteModelBundle(const ghc::filesystem::path& model_path,
+                      const ghc::filesystem::path& bundle_path,
+                      ModelRole role = ModelRole::kDecoder);
+
+// Reads the array |file_name| of the model at |model_path| into |array|.
+// |model_path| is either a model directory or a bundle, for which a trailing
+// ".gz" of |file_name| is ignored since bundles hold decompressed arrays.
+template <typename T>
+absl::Status ReadModelArray(const ghc::filesystem::path& model_path,
+                            const std::string& file_name,
+                            std::vector<T>* array) {
+  if (!IsModelBundle(model_path)) {
+    return csrblocksparse::ReadArrayFromFile(file_name, array,
+                                             model_path.string());
+  }
+  const std::shared_ptr<const ModelBundle> bundle =
+      ModelBundle::OpenShared(model_path);
+  if (bundle == nullptr) {
+    return absl::UnavailableError(
+        absl::StrFormat("Could not open bundle %s.", model_path.string()));
+  }
+  const absl::string_view name = absl::StripSuffix(file_name, ".gz");
+  if (!bundle->Contains(name)) {
+    return absl::NotFoundError(absl::StrFormat(
+        "Bundle %s has no array %s.", model_path.string(), name));
+  }
+  const absl::string_view section = bundle->Section(name);
+  if (section.size() % sizeof(T) != 0) {
+    return absl::DataLossError(absl::StrFormat(
+        "Array %s of bundle %s has %d bytes, which is not a multiple of %d.",
+        name, model_path.string(), section.size(), sizeof(T)));
+  }
+  array->resize(section.size() / sizeof(T));
+  std::memcpy(array->data(), section.data(), section.size());
+  return absl::OkStatus();
+}
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_MODEL_UNPACKER_H_
@@ -0,0 +1,150 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "model_unpacker.h"
+
+#include <memory>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+
+// placeholder for get runfiles header.
+#include "absl/strings/match.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_encoder.h"
+#include "lyra_wavegru.h"
+#include "model_bundle.h"
+#include "vector_quantizer_impl.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static const char kPrefix[] = "lyra_16khz";
+
+class ModelUnpackerTest : public testing::Test {
+ protected:
+  ModelUnpackerTest()
+      : model_path_(ghc::filesystem::current_path() / "wavegru"),
+        output_dir_(ghc::filesystem::path(testing::TempDir()) / "unpacked") {}
+
+  void TearDown() override {
+    std::error_code error_code;
+    ghc::filesystem::remove_all(output_dir_, error_code);
+    ASSERT_FALSE(error_code);
+  }
+
+  const ghc::filesystem::path model_path_;
+  const ghc::filesystem::path output_dir_;
+};
+
+TEST_F(ModelUnpackerTest, ShippedModelIsZipped) {
+  EXPECT_TRUE(IsZippedModel(model_path_, kPrefix));
+}
+
+TEST_F(ModelUnpackerTest, UnpackedModelIsNotZipped) {
+  ASSERT_TRUE(UnpackModel(model_path_, output_dir_));
+
+  EXPECT_FALSE(IsZippedModel(output_dir_, kPrefix));
+  for (const auto& entry : ghc::filesystem::directory_iterator(output_dir_)) {
+    EXPECT_FALSE(absl::EndsWith(entry.path().string(), ".gz")) << entry.path();
+  }
+  EXPECT_TRUE(
+      ghc::filesystem::exists(output_dir_ / "lyra_16khz_gru_layer_bias.raw"));
+  EXPECT_TRUE(ghc::filesystem::exists(output_dir_ / "lyra_config.textproto"));
+}
+
+TEST_F(ModelUnpackerTest, UnpackedModelLoads) {
+  ASSERT_TRUE(UnpackModel(model_path_, output_dir_));
+
+  EXPECT_TRUE(AreParamsSupported(kInternalSampleRateHz, kNumChannels,
+                                 kBitrate, output_dir_)
+                  .ok());
+  EXPECT_NE(LyraWavegru<float>::Create(/*num_threads=*/1, output_dir_, kPrefix),
+            nullptr);
+  EXPECT_NE(VectorQuantizerImpl::Create(kNumFramesPerPacket * kNumFeatures,
+                                        /*num_bits=*/120, output_dir_),
+            nullptr);
+  // The codec finds the unpacked assets by itself.
+  EXPECT_NE(LyraDecoder::Create(kInternalSampleRateHz, kNumChannels, kBitrate,
+                                output_dir_),
+            nullptr);
+  EXPECT_NE(LyraEncoder::Create(kInternalSampleRateHz, kNumChannels, kBitrate,
+                                /*enable_dtx=*/false, output_dir_),
+            nullptr);
+}
+
+TEST_F(ModelUnpackerTest, BundledModelLoads) {
+  ASSERT_TRUE(ghc::filesystem::create_directories(output_dir_));
+  const ghc::filesystem::path bundle_path = output_dir_ / "wavegru.lyra";
+  ASSERT_TRUE(WriteModelBundle(model_path_, bundle_path));
+
+  EXPECT_TRUE(IsModelBundle(bundle_path));
+  EXPECT_TRUE(AreParamsSupported(kInternalSampleRateHz, kNumChannels,
+                                 kBitrate, bundle_path)
+                  .ok());
+  EXPECT_NE(VectorQuantizerImpl::Create(kNumFramesPerPacket * kNumFeatures,
+                                        /*num_bits=*/120, bundle_path),
+            nullptr);
+  const ghc::filesystem::path layer_dir = ModelLayerDirectory(bundle_path);
+  ASSERT_FALSE(layer_dir.empty());
+  EXPECT_NE(LyraWavegru<float>::Create(/*num_threads=*/1, layer_dir, kPrefix),
+            nullptr);
+  std::error_code error_code;
+  ghc::filesystem::remove_all(layer_dir, error_code);
+}
+
+TEST_F(ModelUnpackerTest, EncoderModelHoldsOnlyQuantizer) {
+  ASSERT_TRUE(UnpackModel(model_path_, output_dir_, ModelRole::kEncoder));
+
+  EXPECT_TRUE(
+      ghc::filesystem::exists(output_dir_ / "lyra_16khz_quant_transmat"));
+  EXPECT_TRUE(ghc::filesystem::exists(output_dir_ / "lyra_config.textproto"));
+  EXPECT_FALSE(
+      ghc::filesystem::exists(output_dir_ / "lyra_16khz_gru_layer_bias.raw"));
+  EXPECT_TRUE(AreParamsSupported(kInternalSampleRateHz, kNumChannels,
+                                 kBitrate, output_dir_, ModelRole::kEncoder)
+                  .ok());
+  EXPECT_FALSE(AreParamsSupported(kInternalSampleRateHz, kNumChannels,
+                                  kBitrate, output_dir_, ModelRole::kDecoder)
+                   .ok());
+  EXPECT_NE(VectorQuantizerImpl::Create(kNumFramesPerPacket * kNumFeatures,
+                                        /*num_bits=*/120, output_dir_),
+            nullptr);
+  EXPECT_NE(LyraEncoder::Create(kInternalSampleRateHz, kNumChannels, kBitrate,
+                                /*enable_dtx=*/false, output_dir_),
+            nullptr);
+  EXPECT_EQ(LyraDecoder::Create(kInternalSampleRateHz, kNumChannels, kBitrate,
+                                output_dir_),
+            nullptr);
+}
+
+TEST_F(ModelUnpackerTest, UnpackingIntoItselfFails) {
+  EXPECT_FALSE(UnpackModel(model_path_, model_path_));
+}
+
+TEST_F(ModelUnpackerTest, MissingModelFails) {
+  EXPECT_FALSE(UnpackModel(model_path_ / "missing", output_dir_));
+}
+
+TEST(IsZippedModel, MissingModelDefaultsToZipped) {
+  EXPECT_TRUE(IsZippedModel(ghc::filesystem::current_path() / "missing",
+                            kPrefix));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
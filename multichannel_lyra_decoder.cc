@@ -0,0 +1,250 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "multichannel_lyra_decoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_metrics.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_decoder_interface.h"
+#include "lyra_model.h"
+#include "tracing.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<MultichannelLyraDecoder> MultichannelLyraDecoder::Create(
+    int sample_rate_hz, int num_channels, int bitrate,
+    const std::shared_ptr<LyraModel>& model, ComputePrecision precision) {
+  if (num_channels < 1) {
+    LOG(ERROR) << "Number of channels has to be positive, but was "
+               << num_channels << ".";
+    return nullptr;
+  }
+  std::vector<std::unique_ptr<LyraDecoderInterface>> channel_decoders;
+  for (int c = 0; c < num_channels; ++c) {
+    auto channel_decoder =
+        LyraDecoder::Create(sample_rate_hz, kNumChannels, bitrate, model,
+                            /*num_threads=*/1, precision);
+    if (channel_decoder == nullptr) {
+      LOG(ERROR) << "Could not create the decoder of channel " << c << ".";
+      return nullptr;
+    }
+    channel_decoders.push_back(std::move(channel_decoder));
+  }
+  return Create(std::move(channel_decoders));
+}
+
+std::unique_ptr<MultichannelLyraDecoder> MultichannelLyraDecoder::Create(
+    std::vector<std::unique_ptr<LyraDecoderInterface>> channel_decoders) {
+  if (channel_decoders.empty()) {
+    LOG(ERROR) << "At least one channel decoder is required.";
+    return nullptr;
+  }
+  for (const auto& channel_decoder : channel_decoders) {
+    if (channel_decoder == nullptr ||
+        channel_decoder->num_channels() != kNumChannels ||
+        channel_decoder->sample_rate_hz() !=
+            channel_decoders.front()->sample_rate_hz()) {
+      LOG(ERROR) << "The channel decoders have to be mono and of the same "
+                 << "sample rate.";
+      return nullptr;
+    }
+  }
+  return absl::WrapUnique(
+      new MultichannelLyraDecoder(std::move(channel_decoders)));
+}
+
+MultichannelLyraDecoder::MultichannelLyraDecoder(
+    std::vector<std::unique_ptr<LyraDecoderInterface>> channel_decoders)
+    : channel_decoders_(std::move(channel_decoders)), max_call_nanos_(0) {}
+
+bool MultichannelLyraDecoder::SetEncodedPacket(
+    absl::Span<const uint8_t> encoded) {
+  const int num_channels = channel_decoders_.size();
+  if (!encoded.empty() && encoded.size() != num_channels * kPacketSize) {
+    LOG(ERROR) << "A packet of " << num_channels << " channels has "
+               << num_channels * kPacketSize << " bytes, but this one has "
+               << encoded.size() << ".";
+    return false;
+  }
+  for (int c = 0; c < num_channels; ++c) {
+    const absl::Span<const uint8_t> channel_packet =
+        encoded.empty() ? encoded
+                        : encoded.subspan(c * kPacketSize, kPacketSize);
+    if (!channel_decoders_[c]->SetEncodedPacket(channel_packet)) {
+      LOG(ERROR) << "Invalid packet for channel " << c << ".";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MultichannelLyraDecoder::SetFuturePacket(
+    absl::Span<const uint8_t> encoded, int num_lost_samples) {
+  const int num_channels = channel_decoders_.size();
+  if (encoded.size() != num_channels * kPacketSize) {
+    LOG(ERROR) << "A packet of " << num_channels << " channels has "
+               << num_channels * kPacketSize << " bytes, but this one has "
+               << encoded.size() << ".";
+    return false;
+  }
+  // Every channel that can conceals towards its packet, even if others cannot.
+  bool all_channels_interpolate = true;
+  for (int c = 0; c < num_channels; ++c) {
+    all_channels_interpolate =
+        channel_decoders_[c]->SetFuturePacket(
+            encoded.subspan(c * kPacketSize, kPacketSize), num_lost_samples) &&
+        all_channels_interpolate;
+  }
+  return all_channels_interpolate;
+}
+
+absl::optional<std::vector<int16_t>> MultichannelLyraDecoder::DecodeSamples(
+    int num_samples) {
+  if (num_samples < 0) {
+    LOG(ERROR) << "Number of samples cannot be negative.";
+    return absl::nullopt;
+  }
+  std::vector<int16_t> samples(num_samples * channel_decoders_.size());
+  if (!DecodeSamples(absl::MakeSpan(samples))) {
+    return absl::nullopt;
+  }
+  return samples;
+}
+
+bool MultichannelLyraDecoder::DecodeSamples(absl::Span<int16_t> samples) {
+  return DecodeInterleaved(samples, &LyraDecoderInterface::DecodeSamples);
+}
+
+absl::optional<std::vector<int16_t>> MultichannelLyraDecoder::DecodePacketLoss(
+    int num_samples) {
+  if (num_samples < 0) {
+    LOG(ERROR) << "Number of samples cannot be negative.";
+    return absl::nullopt;
+  }
+  std::vector<int16_t> samples(num_samples * channel_decoders_.size());
+  if (!DecodePacketLoss(absl::MakeSpan(samples))) {
+    return absl::nullopt;
+  }
+  return samples;
+}
+
+bool MultichannelLyraDecoder::DecodePacketLoss(absl::Span<int16_t> samples) {
+  return DecodeInterleaved(samples, &LyraDecoderInterface::DecodePacketLoss);
+}
+
+bool MultichannelLyraDecoder::DecodeInterleaved(
+    absl::Span<int16_t> samples,
+    bool (LyraDecoderInterface::*decode)(absl::Span<int16_t>)) {
+  LYRA_TRACE_SCOPE("MultichannelDecode");
+  const int num_channels = channel_decoders_.size();
+  if (samples.size() % num_channels != 0) {
+    LOG(ERROR) << "The number of samples has to be a multiple of the "
+               << num_channels << " channels, but is " << samples.size()
+               << ".";
+    return false;
+  }
+  const absl::Time start = absl::Now();
+  const int num_samples_per_channel = samples.size() / num_channels;
+  channel_samples_.resize(num_samples_per_channel);
+  for (int c = 0; c < num_channels; ++c) {
+    if (!(channel_decoders_[c].get()->*decode)(
+            absl::MakeSpan(channel_samples_))) {
+      LOG(ERROR) << "Unable to decode channel " << c << ".";
+      return false;
+    }
+    for (int i = 0; i < num_samples_per_channel; ++i) {
+      samples[i * num_channels + c] = channel_samples_[i];
+    }
+  }
+  const absl::Duration call_time = absl::Now() - start;
+  max_call_nanos_ =
+      std::max(max_call_nanos_, absl::ToInt64Nanoseconds(call_time));
+  real_time_factor_.Update(
+      absl::ToDoubleSeconds(call_time),
+      static_cast<double>(num_samples_per_channel) / sample_rate_hz());
+  return true;
+}
+
+int MultichannelLyraDecoder::sample_rate_hz() const {
+  return channel_decoders_.front()->sample_rate_hz();
+}
+
+int MultichannelLyraDecoder::num_channels() const {
+  return channel_decoders_.size();
+}
+
+int MultichannelLyraDecoder::bitrate() const {
+  return num_channels() * channel_decoders_.front()->bitrate();
+}
+
+int MultichannelLyraDecoder::frame_rate() const {
+  return channel_decoders_.front()->frame_rate();
+}
+
+bool MultichannelLyraDecoder::is_comfort_noise() const {
+  return std::all_of(channel_decoders_.begin(), channel_decoders_.end(),
+                     [](const std::unique_ptr<LyraDecoderInterface>& decoder) {
+                       return decoder->is_comfort_noise();
+                     });
+}
+
+DecoderMetrics MultichannelLyraDecoder::metrics() const {
+  DecoderMetrics metrics;
+  for (const auto& channel_decoder : channel_decoders_) {
+    const DecoderMetrics channel = channel_decoder->metrics();
+    metrics.num_samples_decoded += channel.num_samples_decoded;
+    metrics.num_model_samples += channel.num_model_samples;
+    metrics.num_comfort_noise_samples += channel.num_comfort_noise_samples;
+    metrics.num_concealed_samples += channel.num_concealed_samples;
+    metrics.num_recovered_packets += channel.num_recovered_packets;
+    metrics.num_stretched_packets += channel.num_stretched_packets;
+    metrics.num_prepared_frames_used += channel.num_prepared_frames_used;
+    metrics.num_prepared_frames_discarded +=
+        channel.num_prepared_frames_discarded;
+    metrics.num_parks += channel.num_parks;
+    metrics.max_unpark_nanos =
+        std::max(metrics.max_unpark_nanos, channel.max_unpark_nanos);
+    metrics.conditioning_nanos += channel.conditioning_nanos;
+    metrics.sampling_nanos += channel.sampling_nanos;
+    metrics.resampling_nanos += channel.resampling_nanos;
+    metrics.num_allocating_calls += channel.num_allocating_calls;
+  }
+  metrics.max_call_nanos = max_call_nanos_;
+  metrics.real_time_factor = real_time_factor_.value();
+  return metrics;
+}
+
+void MultichannelLyraDecoder::Reset() {
+  for (const auto& channel_decoder : channel_decoders_) {
+    channel_decoder->Reset();
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_MULTICHANNEL_LYRA_DECODER_H_
+#define LYRA_CODEC_MULTICHANNEL_LYRA_DECODER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_metrics.h"
+#include "compute_precision.h"
+#include "lyra_decoder_interface.h"
+#include "lyra_model.h"
+
+namespace chromemedia {
+namespace codec {
+
+/// Decodes the packets of a |MultichannelLyraEncoder| into interleaved audio.
+///
+/// Every channel is decoded by its own single-threaded decoder, with its own
+/// concealment and comfort noise, but all of them share the weights of one
+/// |LyraModel|, so a channel only adds the memory of its state. All sample
+/// counts are per channel.
+class MultichannelLyraDecoder : public LyraDecoderInterface {
+ public:
+  /// @param sample_rate_hz Desired sample rate in Hertz, as for |LyraDecoder|.
+  /// @param num_channels Number of interleaved channels. Has to be positive.
+  /// @param bit_rate Bit rate of every channel. Currently only 3000 is
+  ///                 supported.
+  /// @param model Weights created by |LyraModel::Create|. Has to be non-null.
+  /// @param precision Arithmetic of the generative models of all channels.
+  /// @return A unique_ptr to a |MultichannelLyraDecoder| if all desired params
+  ///         are supported. Else it returns a nullptr.
+  static std::unique_ptr<MultichannelLyraDecoder> Create(
+      int sample_rate_hz, int num_channels, int bitrate,
+      const std::shared_ptr<LyraModel>& model,
+      ComputePrecision precision = kDefaultComputePrecision);
+
+  /// Same as above, but decodes channel |c| with |channel_decoders[c]|, which
+  /// all have to be mono and of the same sample rate. Returns a nullptr
+  /// otherwise.
+  static std::unique_ptr<MultichannelLyraDecoder> Create(
+      std::vector<std::unique_ptr<LyraDecoderInterface>> channel_decoders);
+
+  /// Splits |encoded| into the packets of its channels and sets each on the
+  /// decoder of its channel. An empty packet, as sent for background noise, is
+  /// decoded as comfort noise on every channel.
+  ///
+  /// @return True if |encoded| is empty or holds one valid packet per
+  ///         channel.
+  bool SetEncodedPacket(absl::Span<const uint8_t> encoded) override;
+
+  /// Splits |encoded| into the packets of its channels and gives each to the
+  /// decoder of its channel to conceal towards.
+  ///
+  /// @return True if |encoded| holds one packet per channel and the decoders
+  ///         of all channels conceal towards theirs.
+  bool SetFuturePacket(absl::Span<const uint8_t> encoded,
+                       int num_lost_samples) override;
+
+  /// @param num_samples Number of samples to decode per channel.
+  /// @return The interleaved samples of all channels, or nullopt on failure.
+  absl::optional<std::vector<int16_t>> DecodeSamples(int num_samples) override;
+
+  /// @param samples Buffer for |samples.size()| interleaved samples, which has
+  ///                to be a multiple of the number of channels.
+  bool DecodeSamples(absl::Span<int16_t> samples) override;
+
+  absl::optional<std::vector<int16_t>> DecodePacketLoss(
+      int num_samples) override;
+
+  bool DecodePacketLoss(absl::Span<int16_t> samples) override;
+
+  int sample_rate_hz() const override;
+
+  int num_channels() const override;
+
+  /// @return The bitrate of all channels together.
+  int bitrate() const override;
+
+  int frame_rate() const override;
+
+  /// @return True if every channel is decoding comfort noise.
+  bool is_comfort_noise() const override;
+
+  /// @return The counters of all channels, where samples are counted once per
+  ///         channel.
+  DecoderMetrics metrics() const override;
+
+  /// Resets the decoder of every channel.
+  void Reset() override;
+
+ private:
+  explicit MultichannelLyraDecoder(
+      std::vector<std::unique_ptr<LyraDecoderInterface>> channel_decoders);
+
+  // Decodes |samples.size()| interleaved samples with |decode|, which decodes
+  // the given samples of one channel.
+  bool DecodeInterleaved(
+      absl::Span<int16_t> samples,
+      bool (LyraDecoderInterface::*decode)(absl::Span<int16_t>));
+
+  const std::vector<std::unique_ptr<LyraDecoderInterface>> channel_decoders_;
+  // The samples of one channel of the current call.
+  std::vector<int16_t> channel_samples_;
+  int64_t max_call_nanos_;
+  RollingRealTimeFactor real_time_factor_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_MULTICHANNEL_LYRA_DECODER_H_
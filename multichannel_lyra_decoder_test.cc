@@ -0,0 +1,146 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "multichannel_lyra_decoder.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "codec_metrics.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "lyra_config.h"
+#include "lyra_decoder_interface.h"
+#include "testing/mock_lyra_decoder.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::_;
+using testing::ElementsAre;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+
+static constexpr int kSampleRateHz = 16000;
+
+// Returns a mono decoder that fills every buffer with |value| and expects
+// |expected_packet| to be set.
+std::unique_ptr<NiceMock<MockLyraDecoder>> ChannelDecoder(
+    int16_t value, std::vector<uint8_t> expected_packet) {
+  auto decoder = absl::make_unique<NiceMock<MockLyraDecoder>>();
+  ON_CALL(*decoder, sample_rate_hz()).WillByDefault(Return(kSampleRateHz));
+  ON_CALL(*decoder, num_channels()).WillByDefault(Return(kNumChannels));
+  ON_CALL(*decoder, bitrate()).WillByDefault(Return(kBitrate));
+  ON_CALL(*decoder, SetEncodedPacket(_)).WillByDefault(Return(false));
+  ON_CALL(*decoder,
+          SetEncodedPacket(testing::ElementsAreArray(expected_packet)))
+      .WillByDefault(Return(true));
+  ON_CALL(*decoder,
+          SetFuturePacket(testing::ElementsAreArray(expected_packet), _))
+      .WillByDefault(Return(true));
+  ON_CALL(*decoder, DecodeSamples(testing::An<absl::Span<int16_t>>()))
+      .WillByDefault(Invoke([value](absl::Span<int16_t> samples) {
+        std::fill(samples.begin(), samples.end(), value);
+        return true;
+      }));
+  ON_CALL(*decoder, DecodePacketLoss(testing::An<absl::Span<int16_t>>()))
+      .WillByDefault(Invoke([value](absl::Span<int16_t> samples) {
+        std::fill(samples.begin(), samples.end(), -value);
+        return true;
+      }));
+  DecoderMetrics metrics;
+  metrics.num_samples_decoded = 10;
+  ON_CALL(*decoder, metrics()).WillByDefault(Return(metrics));
+  return decoder;
+}
+
+// A stereo decoder whose left channel expects a packet of ones and decodes
+// 1s, and whose right channel expects a packet of twos and decodes 2s.
+std::unique_ptr<MultichannelLyraDecoder> StereoDecoder() {
+  std::vector<std::unique_ptr<LyraDecoderInterface>> channel_decoders;
+  channel_decoders.push_back(
+      ChannelDecoder(1, std::vector<uint8_t>(kPacketSize, 1)));
+  channel_decoders.push_back(
+      ChannelDecoder(2, std::vector<uint8_t>(kPacketSize, 2)));
+  return MultichannelLyraDecoder::Create(std::move(channel_decoders));
+}
+
+TEST(MultichannelLyraDecoderTest, PacketIsSplitIntoChannels) {
+  auto decoder = StereoDecoder();
+  ASSERT_NE(decoder, nullptr);
+  std::vector<uint8_t> packet(kPacketSize, 1);
+  packet.insert(packet.end(), kPacketSize, 2);
+
+  EXPECT_TRUE(decoder->SetEncodedPacket(packet));
+  std::reverse(packet.begin(), packet.end());
+  EXPECT_FALSE(decoder->SetEncodedPacket(packet));
+  EXPECT_FALSE(decoder->SetEncodedPacket(
+      std::vector<uint8_t>(kPacketSize, 1)));
+}
+
+TEST(MultichannelLyraDecoderTest, FuturePacketIsSplitIntoChannels) {
+  auto decoder = StereoDecoder();
+  ASSERT_NE(decoder, nullptr);
+  std::vector<uint8_t> packet(kPacketSize, 1);
+  packet.insert(packet.end(), kPacketSize, 2);
+
+  EXPECT_TRUE(decoder->SetFuturePacket(packet, 1));
+  std::reverse(packet.begin(), packet.end());
+  EXPECT_FALSE(decoder->SetFuturePacket(packet, 1));
+  EXPECT_FALSE(decoder->SetFuturePacket(std::vector<uint8_t>(), 1));
+}
+
+TEST(MultichannelLyraDecoderTest, SamplesAreInterleaved) {
+  auto decoder = StereoDecoder();
+  ASSERT_NE(decoder, nullptr);
+
+  EXPECT_THAT(decoder->DecodeSamples(3),
+              testing::Optional(ElementsAre(1, 2, 1, 2, 1, 2)));
+  EXPECT_THAT(decoder->DecodePacketLoss(2),
+              testing::Optional(ElementsAre(-1, -2, -1, -2)));
+
+  std::vector<int16_t> samples(5);
+  EXPECT_FALSE(decoder->DecodeSamples(absl::MakeSpan(samples)));
+}
+
+TEST(MultichannelLyraDecoderTest, MetricsAddUpChannels) {
+  auto decoder = StereoDecoder();
+  ASSERT_NE(decoder, nullptr);
+  EXPECT_EQ(decoder->num_channels(), 2);
+  EXPECT_EQ(decoder->bitrate(), 2 * kBitrate);
+  EXPECT_EQ(decoder->metrics().num_samples_decoded, 20);
+}
+
+TEST(MultichannelLyraDecoderTest, ChannelsOfOtherSampleRatesFail) {
+  std::vector<std::unique_ptr<LyraDecoderInterface>> channel_decoders;
+  channel_decoders.push_back(ChannelDecoder(1, {}));
+  auto other_rate = ChannelDecoder(2, {});
+  ON_CALL(*other_rate, sample_rate_hz()).WillByDefault(Return(48000));
+  channel_decoders.push_back(std::move(other_rate));
+  EXPECT_EQ(MultichannelLyraDecoder::Create(std::move(channel_decoders)),
+            nullptr);
+  EXPECT_EQ(MultichannelLyraDecoder::Create(
+                std::vector<std::unique_ptr<LyraDecoderInterface>>()),
+            nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
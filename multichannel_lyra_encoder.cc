@@ -0,0 +1,155 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "multichannel_lyra_encoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_metrics.h"
+#include "glog/logging.h"
+#include "lyra_config.h"
+#include "lyra_encoder.h"
+#include "lyra_model.h"
+#include "tracing.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<MultichannelLyraEncoder> MultichannelLyraEncoder::Create(
+    int sample_rate_hz, int num_channels, int bitrate,
+    const std::shared_ptr<LyraModel>& model) {
+  if (num_channels < 1) {
+    LOG(ERROR) << "Number of channels has to be positive, but was "
+               << num_channels << ".";
+    return nullptr;
+  }
+  std::vector<std::unique_ptr<LyraEncoder>> channel_encoders;
+  for (int c = 0; c < num_channels; ++c) {
+    auto channel_encoder = LyraEncoder::Create(
+        sample_rate_hz, kNumChannels, bitrate, /*enable_dtx=*/false, model);
+    if (channel_encoder == nullptr) {
+      LOG(ERROR) << "Could not create the encoder of channel " << c << ".";
+      return nullptr;
+    }
+    channel_encoders.push_back(std::move(channel_encoder));
+  }
+  return absl::WrapUnique(
+      new MultichannelLyraEncoder(std::move(channel_encoders)));
+}
+
+MultichannelLyraEncoder::MultichannelLyraEncoder(
+    std::vector<std::unique_ptr<LyraEncoder>> channel_encoders)
+    : channel_encoders_(std::move(channel_encoders)) {}
+
+absl::optional<std::vector<uint8_t>> MultichannelLyraEncoder::Encode(
+    const absl::Span<const int16_t> audio) {
+  LYRA_TRACE_SCOPE("MultichannelEncode");
+  const int num_channels = channel_encoders_.size();
+  const int num_samples_per_channel =
+      kNumFramesPerPacket * GetNumSamplesPerHop(sample_rate_hz());
+  if (audio.size() != num_channels * num_samples_per_channel) {
+    LOG(ERROR) << "The number of audio samples has to be exactly "
+               << num_channels * num_samples_per_channel << ", but is "
+               << audio.size() << ".";
+    return absl::nullopt;
+  }
+  const absl::Time start = absl::Now();
+
+  // Every channel extracts its own features, which are then quantized in one
+  // search as if they were consecutive packets of one channel.
+  std::vector<float> concatenated_features;
+  channel_audio_.resize(num_samples_per_channel);
+  for (int c = 0; c < num_channels; ++c) {
+    for (int i = 0; i < num_samples_per_channel; ++i) {
+      channel_audio_[i] = audio[i * num_channels + c];
+    }
+    std::vector<bool> is_empty_packet;
+    const auto features = channel_encoders_[c]->ExtractFeatures(
+        channel_audio_, /*num_packets=*/1, /*filter_audio=*/true,
+        &is_empty_packet);
+    if (!features.has_value()) {
+      LOG(ERROR) << "Unable to extract the features of channel " << c << ".";
+      return absl::nullopt;
+    }
+    concatenated_features.insert(concatenated_features.end(),
+                                 features->begin(), features->end());
+  }
+  const auto channel_packets = channel_encoders_.front()->QuantizeAndPack(
+      concatenated_features, std::vector<bool>(num_channels, false),
+      &metrics_);
+  if (!channel_packets.has_value()) {
+    return absl::nullopt;
+  }
+  std::vector<uint8_t> encoded;
+  encoded.reserve(num_channels * kPacketSize);
+  for (const std::vector<uint8_t>& channel_packet : channel_packets.value()) {
+    encoded.insert(encoded.end(), channel_packet.begin(),
+                   channel_packet.end());
+  }
+
+  const absl::Duration call_time = absl::Now() - start;
+  metrics_.num_packets_encoded += num_channels;
+  metrics_.num_frames_extracted += num_channels * kNumFramesPerPacket;
+  metrics_.max_call_nanos =
+      std::max(metrics_.max_call_nanos, absl::ToInt64Nanoseconds(call_time));
+  real_time_factor_.Update(
+      absl::ToDoubleSeconds(call_time),
+      static_cast<double>(num_samples_per_channel) / sample_rate_hz());
+  return encoded;
+}
+
+int MultichannelLyraEncoder::sample_rate_hz() const {
+  return channel_encoders_.front()->sample_rate_hz();
+}
+
+int MultichannelLyraEncoder::num_channels() const {
+  return channel_encoders_.size();
+}
+
+int MultichannelLyraEncoder::bitrate() const {
+  return num_channels() * channel_encoders_.front()->bitrate();
+}
+
+int MultichannelLyraEncoder::frame_rate() const { return kFrameRate; }
+
+EncoderMetrics MultichannelLyraEncoder::metrics() const {
+  EncoderMetrics metrics = metrics_;
+  for (const auto& channel_encoder : channel_encoders_) {
+    const EncoderMetrics channel = channel_encoder->metrics();
+    metrics.resampling_nanos += channel.resampling_nanos;
+    metrics.filtering_nanos += channel.filtering_nanos;
+    metrics.extraction_nanos += channel.extraction_nanos;
+    metrics.noise_estimation_nanos += channel.noise_estimation_nanos;
+  }
+  metrics.real_time_factor = real_time_factor_.value();
+  return metrics;
+}
+
+void MultichannelLyraEncoder::Reset() {
+  for (const auto& channel_encoder : channel_encoders_) {
+    channel_encoder->Reset();
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
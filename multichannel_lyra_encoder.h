@@ -0,0 +1,99 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_MULTICHANNEL_LYRA_ENCODER_H_
+#define LYRA_CODEC_MULTICHANNEL_LYRA_ENCODER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_metrics.h"
+#include "lyra_encoder.h"
+#include "lyra_encoder_interface.h"
+#include "lyra_model.h"
+
+namespace chromemedia {
+namespace codec {
+
+/// Encodes interleaved audio of several channels, such as stereo, into one
+/// packet per 40ms.
+///
+/// Every channel has its own feature extraction state, but all channels share
+/// the quantizer weights of one |LyraModel|, and the features of all channels
+/// are quantized in one search. A packet is the packets of every channel, in
+/// channel order, each of the size of a mono packet, so that a
+/// |MultichannelLyraDecoder| or one mono |LyraDecoder| per channel can decode
+/// it. Discontinuous transmission is not supported, since every channel is
+/// sent in every packet.
+class MultichannelLyraEncoder : public LyraEncoderInterface {
+ public:
+  /// @param sample_rate_hz Desired sample rate in Hertz, as for |LyraEncoder|.
+  /// @param num_channels Number of interleaved channels. Has to be positive.
+  /// @param bit_rate Bit rate of every channel. Currently only 3000 is
+  ///                 supported.
+  /// @param model Weights created by |LyraModel::Create|. Has to be non-null.
+  /// @return A unique_ptr to a |MultichannelLyraEncoder| if all desired params
+  ///         are supported. Else it returns a nullptr.
+  static std::unique_ptr<MultichannelLyraEncoder> Create(
+      int sample_rate_hz, int num_channels, int bitrate,
+      const std::shared_ptr<LyraModel>& model);
+
+  /// Encodes 40ms of interleaved samples of all channels.
+  ///
+  /// @param audio Span of int16-formatted samples, frame by frame, with the
+  ///              samples of all channels of a frame next to each other.
+  /// @return The packet of every channel, concatenated, as long as the right
+  ///         amount of data is provided. Else it returns nullopt.
+  absl::optional<std::vector<uint8_t>> Encode(
+      const absl::Span<const int16_t> audio) override;
+
+  int sample_rate_hz() const override;
+
+  int num_channels() const override;
+
+  /// @return The bitrate of all channels together.
+  int bitrate() const override;
+
+  int frame_rate() const override;
+
+  /// @return The counters of all channels. Packets are counted once per
+  ///         channel.
+  EncoderMetrics metrics() const override;
+
+  /// Resets the encoder of every channel.
+  void Reset() override;
+
+ private:
+  explicit MultichannelLyraEncoder(
+      std::vector<std::unique_ptr<LyraEncoder>> channel_encoders);
+
+  const std::vector<std::unique_ptr<LyraEncoder>> channel_encoders_;
+  // The samples of one channel of the packet being encoded.
+  std::vector<int16_t> channel_audio_;
+  // Quantization and packing of all channels, which are done by the first
+  // channel's quantizer, and the call times.
+  EncoderMetrics metrics_;
+  RollingRealTimeFactor real_time_factor_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_MULTICHANNEL_LYRA_ENCODER_H_
@@ -0,0 +1,131 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "multichannel_lyra_encoder.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_encoder.h"
+#include "lyra_model.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static constexpr int kNumStereoChannels = 2;
+
+class MultichannelLyraEncoderTest : public testing::TestWithParam<int> {
+ protected:
+  MultichannelLyraEncoderTest()
+      : sample_rate_hz_(GetParam()),
+        num_samples_per_packet_(kNumFramesPerPacket *
+                                GetNumSamplesPerHop(sample_rate_hz_)),
+        model_(LyraModel::Create(ghc::filesystem::current_path() /
+                                 "wavegru")) {}
+
+  // Returns a packet of a tone whose frequency depends on |channel|.
+  std::vector<int16_t> Tone(int channel) const {
+    std::vector<int16_t> samples(num_samples_per_packet_);
+    for (int i = 0; i < num_samples_per_packet_; ++i) {
+      samples[i] = static_cast<int16_t>(
+          8000.0 *
+          std::sin(2.0 * M_PI * 300.0 * (channel + 1) * i / sample_rate_hz_));
+    }
+    return samples;
+  }
+
+  const int sample_rate_hz_;
+  const int num_samples_per_packet_;
+  const std::shared_ptr<LyraModel> model_;
+};
+
+TEST_P(MultichannelLyraEncoderTest, ChannelsAreEncodedLikeMonoStreams) {
+  ASSERT_NE(model_, nullptr);
+  auto encoder = MultichannelLyraEncoder::Create(
+      sample_rate_hz_, kNumStereoChannels, kBitrate, model_);
+  ASSERT_NE(encoder, nullptr);
+  EXPECT_EQ(encoder->num_channels(), kNumStereoChannels);
+  EXPECT_EQ(encoder->bitrate(), kNumStereoChannels * kBitrate);
+
+  std::vector<std::unique_ptr<LyraEncoder>> mono_encoders;
+  std::vector<std::vector<int16_t>> channels;
+  for (int c = 0; c < kNumStereoChannels; ++c) {
+    mono_encoders.push_back(LyraEncoder::Create(
+        sample_rate_hz_, kNumChannels, kBitrate, /*enable_dtx=*/false,
+        model_));
+    ASSERT_NE(mono_encoders.back(), nullptr);
+    channels.push_back(Tone(c));
+  }
+  std::vector<int16_t> interleaved(kNumStereoChannels *
+                                   num_samples_per_packet_);
+  for (int i = 0; i < num_samples_per_packet_; ++i) {
+    for (int c = 0; c < kNumStereoChannels; ++c) {
+      interleaved[i * kNumStereoChannels + c] = channels[c][i];
+    }
+  }
+
+  for (int packet = 0; packet < 3; ++packet) {
+    const auto encoded = encoder->Encode(interleaved);
+    ASSERT_TRUE(encoded.has_value());
+    ASSERT_EQ(encoded->size(), kNumStereoChannels * kPacketSize);
+    for (int c = 0; c < kNumStereoChannels; ++c) {
+      const auto mono_encoded = mono_encoders[c]->Encode(channels[c]);
+      ASSERT_TRUE(mono_encoded.has_value());
+      EXPECT_EQ(std::vector<uint8_t>(
+                    encoded->begin() + c * kPacketSize,
+                    encoded->begin() + (c + 1) * kPacketSize),
+                mono_encoded.value())
+          << "packet " << packet << ", channel " << c;
+    }
+  }
+  EXPECT_EQ(encoder->metrics().num_packets_encoded, 3 * kNumStereoChannels);
+  EXPECT_EQ(encoder->metrics().num_packets_quantized, 3 * kNumStereoChannels);
+}
+
+TEST_P(MultichannelLyraEncoderTest, InvalidSizedAudioFails) {
+  ASSERT_NE(model_, nullptr);
+  auto encoder = MultichannelLyraEncoder::Create(
+      sample_rate_hz_, kNumStereoChannels, kBitrate, model_);
+  ASSERT_NE(encoder, nullptr);
+  EXPECT_FALSE(
+      encoder->Encode(std::vector<int16_t>(num_samples_per_packet_))
+          .has_value());
+}
+
+TEST_P(MultichannelLyraEncoderTest, BadCreationParametersReturnNullptr) {
+  ASSERT_NE(model_, nullptr);
+  EXPECT_EQ(MultichannelLyraEncoder::Create(sample_rate_hz_, 0, kBitrate,
+                                            model_),
+            nullptr);
+  EXPECT_EQ(MultichannelLyraEncoder::Create(sample_rate_hz_,
+                                            kNumStereoChannels, -2, model_),
+            nullptr);
+  EXPECT_EQ(MultichannelLyraEncoder::Create(sample_rate_hz_,
+                                            kNumStereoChannels, kBitrate,
+                                            std::shared_ptr<LyraModel>()),
+            nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(SampleRates, MultichannelLyraEncoderTest,
+                         testing::ValuesIn(kSupportedSampleRates));
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -14,19 +14,36 @@
 
 #include "naive_spectrogram_predictor.h"
 
+#include <algorithm>
 #include <vector>
 
+#include "absl/types/span.h"
 #include "log_mel_spectrogram_extractor_impl.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
 
-void NaiveSpectrogramPredictor::FeedFrame(const std::vector<float>& features) {
-  last_packet_ = features;
+void NaiveSpectrogramPredictor::FeedFrame(absl::Span<const float> features) {
+  last_packet_.assign(features.begin(), features.end());
 }
 
-std::vector<float> NaiveSpectrogramPredictor::PredictFrame() {
-  return last_packet_;
+FeatureFrame NaiveSpectrogramPredictor::PredictFrame() {
+  return FeatureFrame(last_packet_);
+}
+
+void NaiveSpectrogramPredictor::Reset() {
+  std::fill(last_packet_.begin(), last_packet_.end(),
+            LogMelSpectrogramExtractorImpl::GetSilenceValue());
+}
+
+bool NaiveSpectrogramPredictor::SaveState(StateWriter* writer) const {
+  writer->WriteSpan(absl::MakeConstSpan(last_packet_));
+  return true;
+}
+
+bool NaiveSpectrogramPredictor::RestoreState(StateReader* reader) {
+  return reader->ReadVector(&last_packet_);
 }
 
 NaiveSpectrogramPredictor::NaiveSpectrogramPredictor(int num_features)
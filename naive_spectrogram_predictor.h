@@ -19,7 +19,10 @@
 
 #include <vector>
 
+#include "absl/types/span.h"
+#include "feature_frame.h"
 #include "spectrogram_predictor_interface.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -31,10 +34,17 @@ namespace codec {
 class NaiveSpectrogramPredictor : public SpectrogramPredictorInterface {
  public:
   // Saves features to last_packet_.
-  void FeedFrame(const std::vector<float>& features) override;
+  void FeedFrame(absl::Span<const float> features) override;
 
   // Returns the most recently seen frame.
-  std::vector<float> PredictFrame() override;
+  FeatureFrame PredictFrame() override;
+
+  // The prediction goes back to silence.
+  void Reset() override;
+
+  bool SaveState(StateWriter* writer) const override;
+
+  bool RestoreState(StateReader* reader) override;
 
   explicit NaiveSpectrogramPredictor(int num_features);
 
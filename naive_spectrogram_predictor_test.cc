@@ -17,6 +17,8 @@
 #include <memory>
 #include <vector>
 
+#include "absl/types/span.h"
+#include "feature_frame.h"
 #include "gtest/gtest.h"
 #include "log_mel_spectrogram_extractor_impl.h"
 #include "lyra_config.h"
@@ -29,14 +31,16 @@ class NaiveSpectrogramPredictorPeer {
   explicit NaiveSpectrogramPredictorPeer(int num_features)
       : naive_spectrogram_predictor_(num_features) {}
 
-  void FeedFrame(const std::vector<float>& features) {
+  void FeedFrame(absl::Span<const float> features) {
     return naive_spectrogram_predictor_.FeedFrame(features);
   }
 
-  std::vector<float> PredictFrame() {
+  FeatureFrame PredictFrame() {
     return naive_spectrogram_predictor_.PredictFrame();
   }
 
+  void Reset() { naive_spectrogram_predictor_.Reset(); }
+
   std::vector<float> FetchLastPacket() {
     return naive_spectrogram_predictor_.last_packet_;
   }
@@ -69,7 +73,7 @@ TEST(NaiveSpectrogramPredictorTest, FeedFrameSetsLastPacket) {
 // other than the default silence value and calls PredictFrame and ensures this
 // nondefault value is returned.
 TEST(NaiveSpectrogramPredictorTest, PredictFrameReturnsLastPacket) {
-  std::vector<float> features(kNumFeatures, 1.0);
+  const FeatureFrame features(kNumFeatures, 1.0);
   auto naive_spectrogram_predictor_peer =
       absl::make_unique<NaiveSpectrogramPredictorPeer>(kNumFeatures);
   naive_spectrogram_predictor_peer->FeedFrame(features);
@@ -77,5 +81,18 @@ TEST(NaiveSpectrogramPredictorTest, PredictFrameReturnsLastPacket) {
   EXPECT_EQ(features, prediction);
 }
 
+// Resets a NaiveSpectrogramPredictor that was fed a frame and ensures that
+// |last_packet_| is silence again.
+TEST(NaiveSpectrogramPredictorTest, ResetReturnsToSilence) {
+  std::vector<float> silence(kNumFeatures,
+                             LogMelSpectrogramExtractorImpl::GetSilenceValue());
+  auto naive_spectrogram_predictor_peer =
+      absl::make_unique<NaiveSpectrogramPredictorPeer>(kNumFeatures);
+  naive_spectrogram_predictor_peer->FeedFrame(
+      std::vector<float>(kNumFeatures, 1.0));
+  naive_spectrogram_predictor_peer->Reset();
+  EXPECT_EQ(silence, naive_spectrogram_predictor_peer->FetchLastPacket());
+}
+
 }  // namespace codec
 }  // namespace chromemedia
@@ -0,0 +1,274 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nm_sparse_matrix.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+#endif  // defined __x86_64__ || defined __i386__
+
+#include "absl/memory/memory.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "cpu_features.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// The supported patterns, sparsest first and, at the same density, with the
+// least metadata first.
+constexpr NmPattern kSupportedPatterns[] = {
+    {1, 8}, {2, 8}, {1, 4}, {4, 8}, {2, 4}};
+
+// The number of bits of the column of a weight within its group.
+int IndexBits(int m) { return m == 4 ? 2 : 3; }
+
+int ColumnInGroup(uint16_t metadata, int k, int index_bits, int m) {
+  return (metadata >> (k * index_bits)) & (m - 1);
+}
+
+// Signature of a kernel that computes |num_rows| rows of the product with
+// |input| plus |bias| into |output|. Each row has |num_groups| groups, whose
+// weights start at |weights| and whose metadata starts at |metadata|.
+using RowsKernel = void (*)(const float* weights, const uint16_t* metadata,
+                            const float* bias, const float* input,
+                            int num_rows, int num_groups, NmPattern pattern,
+                            float* output);
+
+// Adds the products of groups [|start_group|, |num_groups|) of a row to
+// |sum|.
+float GroupsGeneric(const float* weights, const uint16_t* metadata,
+                    const float* input, int start_group, int num_groups,
+                    NmPattern pattern, float sum) {
+  const int index_bits = IndexBits(pattern.m);
+  for (int g = start_group; g < num_groups; ++g) {
+    const float* x = input + g * pattern.m;
+    for (int k = 0; k < pattern.n; ++k) {
+      sum += weights[g * pattern.n + k] *
+             x[ColumnInGroup(metadata[g], k, index_bits, pattern.m)];
+    }
+  }
+  return sum;
+}
+
+void RowsGeneric(const float* weights, const uint16_t* metadata,
+                 const float* bias, const float* input, int num_rows,
+                 int num_groups, NmPattern pattern, float* output) {
+  for (int r = 0; r < num_rows; ++r) {
+    output[r] = GroupsGeneric(weights + r * num_groups * pattern.n,
+                              metadata + r * num_groups, input, 0, num_groups,
+                              pattern, bias[r]);
+  }
+}
+
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+
+// Lane l of a vector holds weight l % n of group l / n of the vector. The
+// metadata of the 16 / n groups is loaded at once, spread to the lanes of
+// their weights, and shifted and masked into the columns to gather.
+__attribute__((target("avx512f"))) void RowsAvx512(
+    const float* weights, const uint16_t* metadata, const float* bias,
+    const float* input, int num_rows, int num_groups, NmPattern pattern,
+    float* output) {
+  const int index_bits = IndexBits(pattern.m);
+  const int groups_per_vector = 16 / pattern.n;
+  alignas(64) int32_t lane_groups[16];
+  alignas(64) int32_t lane_shifts[16];
+  for (int lane = 0; lane < 16; ++lane) {
+    lane_groups[lane] = lane / pattern.n;
+    lane_shifts[lane] = (lane % pattern.n) * index_bits;
+  }
+  const __m512i groups = _mm512_load_si512(lane_groups);
+  const __m512i shifts = _mm512_load_si512(lane_shifts);
+  const __m512i group_columns =
+      _mm512_mullo_epi32(groups, _mm512_set1_epi32(pattern.m));
+  const __m512i index_mask = _mm512_set1_epi32(pattern.m - 1);
+  for (int r = 0; r < num_rows; ++r) {
+    const float* row_weights = weights + r * num_groups * pattern.n;
+    const uint16_t* row_metadata = metadata + r * num_groups;
+    __m512 sum = _mm512_setzero_ps();
+    int g = 0;
+    for (; g + groups_per_vector <= num_groups; g += groups_per_vector) {
+      __m128i low_metadata;
+      __m128i high_metadata = _mm_setzero_si128();
+      if (groups_per_vector == 16) {
+        low_metadata = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(row_metadata + g));
+        high_metadata = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(row_metadata + g + 8));
+      } else if (groups_per_vector == 8) {
+        low_metadata = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(row_metadata + g));
+      } else {
+        low_metadata = _mm_loadl_epi64(
+            reinterpret_cast<const __m128i*>(row_metadata + g));
+      }
+      const __m512i group_metadata = _mm512_permutexvar_epi32(
+          groups, _mm512_cvtepu16_epi32(
+                      _mm256_set_m128i(high_metadata, low_metadata)));
+      const __m512i columns = _mm512_add_epi32(
+          _mm512_add_epi32(_mm512_set1_epi32(g * pattern.m), group_columns),
+          _mm512_and_si512(_mm512_srlv_epi32(group_metadata, shifts),
+                           index_mask));
+      sum = _mm512_fmadd_ps(_mm512_loadu_ps(row_weights + g * pattern.n),
+                            _mm512_i32gather_ps(columns, input, 4), sum);
+    }
+    output[r] = GroupsGeneric(row_weights, row_metadata, input, g, num_groups,
+                              pattern, bias[r] + _mm512_reduce_add_ps(sum));
+  }
+}
+
+RowsKernel SimdKernel() { return &RowsAvx512; }
+
+bool HasSimdKernel() { return IsCpuIsaSupported(CpuIsa::kAvx512); }
+
+#else
+
+// ARM CPUs run |RowsGeneric|.
+RowsKernel SimdKernel() { return nullptr; }
+
+bool HasSimdKernel() { return false; }
+
+#endif  // (defined __x86_64__ || defined __i386__) && defined __GNUC__
+
+}  // namespace
+
+bool FitsNmPattern(absl::Span<const float> weights, int rows, int cols,
+                   NmPattern pattern) {
+  if (rows <= 0 || cols <= 0 || pattern.m <= 0 || cols % pattern.m != 0 ||
+      weights.size() != static_cast<size_t>(rows) * cols) {
+    return false;
+  }
+  for (int start = 0; start < static_cast<int>(weights.size());
+       start += pattern.m) {
+    int num_non_zeros = 0;
+    for (int j = 0; j < pattern.m; ++j) {
+      num_non_zeros += weights[start + j] != 0.0f;
+    }
+    if (num_non_zeros > pattern.n) {
+      return false;
+    }
+  }
+  return true;
+}
+
+absl::optional<NmPattern> FindNmPattern(absl::Span<const float> weights,
+                                        int rows, int cols) {
+  for (const NmPattern& pattern : kSupportedPatterns) {
+    if (FitsNmPattern(weights, rows, cols, pattern)) {
+      return pattern;
+    }
+  }
+  return absl::nullopt;
+}
+
+bool NmSparseMatrix::IsSupported(NmPattern pattern) {
+  for (const NmPattern& supported : kSupportedPatterns) {
+    if (pattern == supported) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::unique_ptr<NmSparseMatrix> NmSparseMatrix::Create(
+    absl::Span<const float> weights, absl::Span<const float> bias, int rows,
+    int cols, NmPattern pattern) {
+  if (!IsSupported(pattern)) {
+    LOG(ERROR) << "The pattern " << pattern.n << ":" << pattern.m
+               << " is not supported.";
+    return nullptr;
+  }
+  if (rows <= 0 || cols <= 0 || cols % pattern.m != 0) {
+    LOG(ERROR) << "The dimensions [" << rows << ", " << cols
+               << "] are not positive with columns a multiple of "
+               << pattern.m << ".";
+    return nullptr;
+  }
+  if (weights.size() != static_cast<size_t>(rows) * cols ||
+      bias.size() != static_cast<size_t>(rows)) {
+    LOG(ERROR) << "Expected " << rows * cols << " weights and " << rows
+               << " biases but got " << weights.size() << " and "
+               << bias.size() << ".";
+    return nullptr;
+  }
+  if (!FitsNmPattern(weights, rows, cols, pattern)) {
+    LOG(ERROR) << "The mask does not fit the pattern " << pattern.n << ":"
+               << pattern.m << ".";
+    return nullptr;
+  }
+  // WrapUnique is used because of private c'tor.
+  auto matrix = absl::WrapUnique(new NmSparseMatrix(rows, cols, pattern));
+  matrix->bias_.assign(bias.begin(), bias.end());
+  const int index_bits = IndexBits(pattern.m);
+  for (int g = 0; g < static_cast<int>(matrix->metadata_.size()); ++g) {
+    const float* group = weights.data() + g * pattern.m;
+    int k = 0;
+    uint16_t metadata = 0;
+    for (int j = 0; j < pattern.m; ++j) {
+      if (group[j] == 0.0f) {
+        continue;
+      }
+      matrix->weights_[g * pattern.n + k] = group[j];
+      metadata |= j << (k * index_bits);
+      ++k;
+    }
+    // The remaining weights stay zero and point at the first column.
+    matrix->metadata_[g] = metadata;
+  }
+  return matrix;
+}
+
+NmSparseMatrix::NmSparseMatrix(int rows, int cols, NmPattern pattern)
+    : rows_(rows),
+      cols_(cols),
+      pattern_(pattern),
+      weights_(rows * (cols / pattern.m) * pattern.n, 0.0f),
+      metadata_(rows * (cols / pattern.m), 0),
+      use_simd_(HasSimdKernel()) {}
+
+void NmSparseMatrix::MatVec(absl::Span<const float> input, int start_row,
+                            int end_row, float* output) const {
+  CHECK_EQ(input.size(), cols_);
+  CHECK_LE(0, start_row);
+  CHECK_LE(start_row, end_row);
+  CHECK_LE(end_row, rows_);
+  const RowsKernel kernel = use_simd_ ? SimdKernel() : &RowsGeneric;
+  const int num_groups = cols_ / pattern_.m;
+  kernel(weights_.data() + start_row * num_groups * pattern_.n,
+         metadata_.data() + start_row * num_groups, bias_.data() + start_row,
+         input.data(), end_row - start_row, num_groups, pattern_,
+         output + start_row);
+}
+
+void NmSparseMatrix::set_use_simd(bool use_simd) {
+  CHECK(!use_simd || HasSimdKernel())
+      << "The CPU has no AVX-512 instructions.";
+  use_simd_ = use_simd;
+}
+
+std::size_t NmSparseMatrix::bytes() const {
+  return weights_.size() * sizeof(float) +
+         metadata_.size() * sizeof(uint16_t) + bias_.size() * sizeof(float);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_NM_SPARSE_MATRIX_H_
+#define LYRA_CODEC_NM_SPARSE_MATRIX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// N:M structured sparsity: each group of |m| consecutive columns of a row
+// holds at most |n| non-zero weights.
+struct NmPattern {
+  int n;
+  int m;
+
+  friend bool operator==(const NmPattern& a, const NmPattern& b) {
+    return a.n == b.n && a.m == b.m;
+  }
+};
+
+// Returns whether the row major |rows| x |cols| |weights| fit |pattern|, that
+// is whether |cols| is a multiple of |pattern.m| and no group of a row holds
+// more than |pattern.n| non-zero weights.
+bool FitsNmPattern(absl::Span<const float> weights, int rows, int cols,
+                   NmPattern pattern);
+
+// Returns the supported pattern of the lowest density that |weights| fit, see
+// |NmSparseMatrix::IsSupported|, or a nullopt if they fit none.
+absl::optional<NmPattern> FindNmPattern(absl::Span<const float> weights,
+                                        int rows, int cols);
+
+// A matrix with a bias whose float weights are stored in N:M structured
+// sparsity. Every group stores exactly |n| weights, padded with zeros, and
+// one 16 bit word of metadata holding the column of each within the group.
+// Unlike a block sparse CSR matrix there are no column indices, so the
+// bandwidth only depends on the shape and every row takes the same work. The
+// products use AVX-512 gathers if the running CPU has them, see |use_simd|,
+// and plain C++ otherwise, to the same result up to rounding.
+class NmSparseMatrix {
+ public:
+  // Whether |pattern| can be stored: 1, 2 or 4 of 4 or 8 columns, except the
+  // dense 4:4.
+  static bool IsSupported(NmPattern pattern);
+
+  // Converts the row major |rows| x |cols| |weights|, in which the masked out
+  // weights are zero, with |bias| of |rows| values. Returns a nullptr if the
+  // sizes do not match, |pattern| is not supported or the weights do not fit
+  // it.
+  static std::unique_ptr<NmSparseMatrix> Create(
+      absl::Span<const float> weights, absl::Span<const float> bias, int rows,
+      int cols, NmPattern pattern);
+
+  // Computes rows [|start_row|, |end_row|) of the product with |input| plus
+  // the bias into |output|, which holds all rows, so that threads can split
+  // the rows between them. |input| must have |cols| values.
+  void MatVec(absl::Span<const float> input, int start_row, int end_row,
+              float* output) const;
+
+  // Whether |MatVec| uses the AVX-512 kernel. It can only be enabled if the
+  // running CPU has the instructions.
+  bool use_simd() const { return use_simd_; }
+  void set_use_simd(bool use_simd);
+
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+  NmPattern pattern() const { return pattern_; }
+
+  // The memory taken by the weights, metadata and bias.
+  std::size_t bytes() const;
+
+ private:
+  NmSparseMatrix(int rows, int cols, NmPattern pattern);
+
+  const int rows_;
+  const int cols_;
+  const NmPattern pattern_;
+  // The |n| weights of group |g| of row |r| start at
+  // |weights_[(r * cols_ / m + g) * n]|, and bits [k * b, (k + 1) * b) of
+  // |metadata_[r * cols_ / m + g]| hold the column of weight |k| within the
+  // group, where b is log2(m).
+  std::vector<float> weights_;
+  std::vector<uint16_t> metadata_;
+  std::vector<float> bias_;
+  bool use_simd_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_NM_SPARSE_MATRIX_H_
@@ -0,0 +1,199 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "nm_sparse_matrix.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kRows = 40;
+constexpr int kCols = 64;
+
+// Returns row major |rows| x |cols| weights in which each group of
+// |pattern.m| columns of a row has |pattern.n| non-zero weights at random
+// columns, or fewer if |fill| is false.
+std::vector<float> RandomNmWeights(int rows, int cols, NmPattern pattern,
+                                   bool fill, std::mt19937* gen) {
+  std::uniform_real_distribution<float> weight(0.1f, 1.0f);
+  std::bernoulli_distribution keep(0.7);
+  std::vector<int> columns(pattern.m);
+  std::vector<float> weights(rows * cols, 0.0f);
+  for (int start = 0; start < rows * cols; start += pattern.m) {
+    for (int j = 0; j < pattern.m; ++j) {
+      columns[j] = j;
+    }
+    std::shuffle(columns.begin(), columns.end(), *gen);
+    for (int k = 0; k < pattern.n; ++k) {
+      if (fill || keep(*gen)) {
+        weights[start + columns[k]] = keep(*gen) ? weight(*gen) : -weight(*gen);
+      }
+    }
+  }
+  return weights;
+}
+
+std::vector<float> RandomVector(int size, std::mt19937* gen) {
+  std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+  std::vector<float> vector(size);
+  for (float& v : vector) {
+    v = value(*gen);
+  }
+  return vector;
+}
+
+std::vector<float> DenseProduct(const std::vector<float>& weights,
+                                const std::vector<float>& bias,
+                                const std::vector<float>& input) {
+  std::vector<float> output(bias);
+  for (int r = 0; r < bias.size(); ++r) {
+    for (int c = 0; c < input.size(); ++c) {
+      output[r] += weights[r * input.size() + c] * input[c];
+    }
+  }
+  return output;
+}
+
+class NmSparseMatrixTest : public testing::TestWithParam<NmPattern> {
+ protected:
+  NmSparseMatrixTest()
+      : gen_(17),
+        weights_(RandomNmWeights(kRows, kCols, GetParam(), false, &gen_)),
+        bias_(RandomVector(kRows, &gen_)),
+        input_(RandomVector(kCols, &gen_)) {}
+
+  std::mt19937 gen_;
+  std::vector<float> weights_;
+  std::vector<float> bias_;
+  std::vector<float> input_;
+};
+
+TEST_P(NmSparseMatrixTest, MatchesDenseProduct) {
+  EXPECT_TRUE(FitsNmPattern(weights_, kRows, kCols, GetParam()));
+  auto matrix =
+      NmSparseMatrix::Create(weights_, bias_, kRows, kCols, GetParam());
+  ASSERT_NE(matrix, nullptr);
+  EXPECT_EQ(matrix->pattern(), GetParam());
+  const std::vector<float> expected = DenseProduct(weights_, bias_, input_);
+
+  // The SIMD kernel is on by default where the CPU has it.
+  const bool has_simd = matrix->use_simd();
+  for (const bool use_simd : {false, true}) {
+    if (use_simd && !has_simd) {
+      continue;
+    }
+    matrix->set_use_simd(use_simd);
+    std::vector<float> output(kRows);
+    matrix->MatVec(input_, 0, kRows, output.data());
+    for (int r = 0; r < kRows; ++r) {
+      EXPECT_NEAR(output[r], expected[r], 1e-4f)
+          << "row " << r << (use_simd ? " with SIMD" : "");
+    }
+  }
+}
+
+TEST_P(NmSparseMatrixTest, RowRangesMatchFullProduct) {
+  auto matrix =
+      NmSparseMatrix::Create(weights_, bias_, kRows, kCols, GetParam());
+  ASSERT_NE(matrix, nullptr);
+  std::vector<float> full_output(kRows);
+  matrix->MatVec(input_, 0, kRows, full_output.data());
+
+  std::vector<float> split_output(kRows, 0.0f);
+  const std::vector<int> starts = {0, 7, 7, 30, kRows};
+  for (int i = 0; i + 1 < starts.size(); ++i) {
+    matrix->MatVec(input_, starts[i], starts[i + 1], split_output.data());
+  }
+  EXPECT_EQ(split_output, full_output);
+}
+
+TEST_P(NmSparseMatrixTest, BytesOnlyDependOnTheShape) {
+  auto matrix =
+      NmSparseMatrix::Create(weights_, bias_, kRows, kCols, GetParam());
+  ASSERT_NE(matrix, nullptr);
+  const int num_groups = kRows * kCols / GetParam().m;
+  EXPECT_EQ(matrix->bytes(), num_groups * GetParam().n * sizeof(float) +
+                                 num_groups * sizeof(uint16_t) +
+                                 kRows * sizeof(float));
+}
+
+INSTANTIATE_TEST_SUITE_P(Patterns, NmSparseMatrixTest,
+                         testing::Values(NmPattern{1, 4}, NmPattern{2, 4},
+                                         NmPattern{1, 8}, NmPattern{2, 8},
+                                         NmPattern{4, 8}));
+
+TEST(NmSparseMatrixCreate, WeightsOutsideThePatternFail) {
+  std::mt19937 gen(5);
+  const std::vector<float> weights =
+      RandomNmWeights(kRows, kCols, {4, 8}, true, &gen);
+  const std::vector<float> bias(kRows, 0.0f);
+  EXPECT_FALSE(FitsNmPattern(weights, kRows, kCols, {2, 4}));
+  EXPECT_EQ(NmSparseMatrix::Create(weights, bias, kRows, kCols, {2, 4}),
+            nullptr);
+  EXPECT_EQ(NmSparseMatrix::Create(weights, bias, kRows, kCols, {2, 8}),
+            nullptr);
+  EXPECT_NE(NmSparseMatrix::Create(weights, bias, kRows, kCols, {4, 8}),
+            nullptr);
+}
+
+TEST(NmSparseMatrixCreate, BadSizesAndPatternsFail) {
+  const std::vector<float> weights(kRows * kCols, 0.0f);
+  const std::vector<float> bias(kRows, 0.0f);
+  EXPECT_EQ(NmSparseMatrix::Create(weights, bias, kRows, kCols, {4, 4}),
+            nullptr);
+  EXPECT_EQ(NmSparseMatrix::Create(weights, bias, kRows, kCols, {3, 8}),
+            nullptr);
+  EXPECT_EQ(NmSparseMatrix::Create(weights, bias, kRows + 1, kCols, {2, 4}),
+            nullptr);
+  EXPECT_EQ(NmSparseMatrix::Create(
+                absl::MakeConstSpan(weights).subspan(2), bias, kRows,
+                kCols - 2, {2, 4}),
+            nullptr);
+  EXPECT_EQ(NmSparseMatrix::Create({}, {}, 0, 0, {2, 4}), nullptr);
+}
+
+TEST(NmSparseMatrixCreate, FindsTheSparsestPatternTheMaskFits) {
+  std::mt19937 gen(3);
+  for (const NmPattern pattern :
+       {NmPattern{1, 8}, NmPattern{2, 8}, NmPattern{4, 8}}) {
+    const std::vector<float> weights =
+        RandomNmWeights(kRows, kCols, pattern, true, &gen);
+    const auto found = FindNmPattern(weights, kRows, kCols);
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found.value(), pattern);
+  }
+  // A 2:4 mask also fits 4:8, which has half the metadata.
+  const auto found = FindNmPattern(
+      RandomNmWeights(kRows, kCols, {2, 4}, true, &gen), kRows, kCols);
+  ASSERT_TRUE(found.has_value());
+  EXPECT_EQ(found.value(), (NmPattern{4, 8}));
+  // A dense matrix fits no pattern.
+  EXPECT_FALSE(FindNmPattern(std::vector<float>(kRows * kCols, 1.0f), kRows,
+                             kCols)
+                   .has_value());
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
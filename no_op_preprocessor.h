@@ -18,7 +18,6 @@
 #define LYRA_CODEC_NO_OP_PREPROCESSOR_H_
 
 #include <cstdint>
-#include <vector>
 
 #include "absl/types/span.h"
 #include "preprocessor_interface.h"
@@ -29,11 +28,8 @@ namespace codec {
 // A pass-through preprocessor that does nothing to the input.
 class NoOpPreprocessor : public PreprocessorInterface {
  public:
-  // Returns a copy of the input.
-  std::vector<int16_t> Process(absl::Span<const int16_t> input,
-                               int sample_rate_hz) override {
-    return std::vector<int16_t>(input.begin(), input.end());
-  }
+  // Leaves |samples| as they are.
+  void Process(absl::Span<int16_t> samples, int sample_rate_hz) override {}
 };
 
 }  // namespace codec
@@ -14,7 +14,9 @@
 
 #include "no_op_preprocessor.h"
 
+#include <cstdint>
 #include <numeric>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -22,16 +24,16 @@ namespace chromemedia {
 namespace codec {
 namespace {
 
-TEST(NoOpPreprocessorTest, IntOutputIsCopy) {
+TEST(NoOpPreprocessorTest, SamplesAreUnchanged) {
   static constexpr int kNumSamples = 640;
   static constexpr int kSampleRateHz = 16000;
   std::vector<int16_t> input(kNumSamples);
   std::iota(input.begin(), input.end(), -100);
+  std::vector<int16_t> samples = input;
 
   NoOpPreprocessor no_op_preprocessor;
-  std::vector<int16_t> output = no_op_preprocessor.Process(
-      absl::MakeConstSpan(input.data(), input.size()), kSampleRateHz);
-  ASSERT_EQ(input, output);
+  no_op_preprocessor.Process(absl::MakeSpan(samples), kSampleRateHz);
+  ASSERT_EQ(samples, input);
 }
 
 }  // namespace
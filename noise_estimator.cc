@@ -23,70 +23,48 @@
 
 #include "absl/memory/memory.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "audio/dsp/signal_vector_util.h"
 #include "glog/logging.h"
 #include "log_mel_spectrogram_extractor_impl.h"
+#include "lyra_codec_config.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
 namespace {
 
-inline float Average(const std::vector<float>& vec) {
-  return std::accumulate(vec.begin(), vec.end(), 0.f) / vec.size();
-}
+// Weighs how much the smoothed power should track the current power, see
+// |NoiseEstimator::Update|.
+constexpr float kPowDiff = 0.3f;
 
-// Places the element wise min between vec1 and vec2 in assignable.
-// Assignable may point to either vec1 or vec2, or may be a different vector.
-void ElementWiseMin(const std::vector<float>& vec1,
-                    const std::vector<float>& vec2,
-                    std::vector<float>* assignable) {
-  for (int i = 0; i < vec1.size(); ++i) {
-    assignable->at(i) = std::min(vec1.at(i), vec2.at(i));
+template <int NumFeatures>
+inline float Average(int num_features, const float* vec) {
+  const int n = Extent<NumFeatures>(num_features);
+  float sum = 0.f;
+  for (int i = 0; i < n; ++i) {
+    sum += vec[i];
   }
+  return sum / n;
 }
 
 // Updates the minimum value per frequency efficiently.
+template <int NumFeatures>
 void UpdateMinAndTemp(uint64_t frame_num, int num_frames_per_update,
-                      const std::vector<float>& smoothed_power,
-                      std::vector<float>* min_power,
-                      std::vector<float>* tmp_min_power) {
+                      int num_features, const float* smoothed_power,
+                      float* min_power, float* tmp_min_power) {
+  const int n = Extent<NumFeatures>(num_features);
   if (frame_num % num_frames_per_update == 0) {
-    ElementWiseMin(*tmp_min_power, smoothed_power, min_power);
-    *tmp_min_power = smoothed_power;
+    for (int i = 0; i < n; ++i) {
+      min_power[i] = std::min(tmp_min_power[i], smoothed_power[i]);
+      tmp_min_power[i] = smoothed_power[i];
+    }
   } else {
-    ElementWiseMin(*min_power, smoothed_power, min_power);
-    ElementWiseMin(*tmp_min_power, smoothed_power, tmp_min_power);
-  }
-}
-
-// The smoothing factor weighs how much the smoothed power calculation should
-// track the current power in a frequency band at a given frame and takes
-// values on the interval (0, max_smoothing].
-// Values closer to 1 indicate smoothed_power should be heavily smoothed
-// (when there is noise in this frequency bin).
-// Values closer to 0 indicate smoothed_power should take on the current
-// power level at this frequency bin (when there is speech in this
-// frequency bin).
-std::vector<float> SmoothingFactor(float max_smoothing,
-                                   const std::vector<float>& curr_power_db,
-                                   const std::vector<float>& smoothed_power,
-                                   const std::vector<float>& noise_estimate) {
-  constexpr float kPowDiff = 0.3f;
-  // The smoothing correction factor approaches 0 as the current power value
-  // moves away from the previously calculated smoothed power, and is 1 when
-  // the two are equal.
-  float smoothing_correction = std::exp(-audio_dsp::Square(
-      (Average(smoothed_power) - Average(curr_power_db)) / kPowDiff));
-
-  std::vector<float> smoothing_factor(noise_estimate.size());
-  for (int i = 0; i < smoothed_power.size(); ++i) {
-    smoothing_factor.at(i) =
-        max_smoothing * smoothing_correction *
-        std::exp(-audio_dsp::Square(
-            (smoothed_power.at(i) - noise_estimate.at(i)) / kPowDiff));
+    for (int i = 0; i < n; ++i) {
+      min_power[i] = std::min(min_power[i], smoothed_power[i]);
+      tmp_min_power[i] = std::min(tmp_min_power[i], smoothed_power[i]);
+    }
   }
-
-  return smoothing_factor;
 }
 
 }  // namespace
@@ -119,76 +97,128 @@ NoiseEstimator::NoiseEstimator(int num_features, int num_frames_per_update,
       tmp_min_smoothed_power_(num_features),
       noise_estimate_(num_features,
                       LogMelSpectrogramExtractorImpl::GetSilenceValue()),
-      noise_bound_(num_features, 0.f) {}
+      noise_bound_(num_features, 0.f),
+      log_num_features_(std::log(static_cast<float>(num_features))) {}
 
 // The variance of non-smoothed noise is estimated and used to calculate the
 // upper bound of the noise bound.
+template <int NumFeatures>
 void NoiseEstimator::ComputeBounds() {
   const float kBoundFactor = 0.9f;
-  for (int i = 0; i < smoothed_power_.size(); ++i) {
-    float noise_variance =
-        std::max<float>(0.f, squared_smoothed_power_.at(i) -
-                                 audio_dsp::Square(smoothed_power_.at(i)));
-    noise_bound_.at(i) =
-        kBoundFactor *
-        std::sqrt(noise_variance * std::log(noise_bound_.size()));
+  const int n = Extent<NumFeatures>(num_features_);
+  const float* smoothed_power = smoothed_power_.data();
+  const float* squared_smoothed_power = squared_smoothed_power_.data();
+  float* noise_bound = noise_bound_.data();
+  for (int i = 0; i < n; ++i) {
+    const float noise_variance = std::max(
+        0.f, squared_smoothed_power[i] - audio_dsp::Square(smoothed_power[i]));
+    noise_bound[i] =
+        kBoundFactor * std::sqrt(noise_variance * log_num_features_);
   }
 }
 
-bool NoiseEstimator::Update(const std::vector<float>& curr_power_db) {
+bool NoiseEstimator::Update(absl::Span<const float> curr_power_db) {
   if (curr_power_db.size() != num_features_) {
     return false;
   }
+  DispatchOnSize<LyraDefaultCodecConfig::kNumFeatures>(
+      num_features_, [this, &curr_power_db](auto num_features) {
+        UpdateImpl<decltype(num_features)::value>(curr_power_db.data());
+      });
+  // Increment by 1 each time the curr_power_db is received.
+  num_frames_received_ += 1;
+  return true;
+}
+
+template <int NumFeatures>
+void NoiseEstimator::UpdateImpl(const float* curr) {
+  // All the buffers have |num_features_| elements, so the loops below index
+  // raw pointers and the compiler can vectorize them.
+  const int n = Extent<NumFeatures>(num_features_);
   if (num_frames_received_ == 0) {
-    smoothed_power_ = curr_power_db;
-    for (int i = 0; i < curr_power_db.size(); ++i) {
-      squared_smoothed_power_.at(i) = audio_dsp::Square(curr_power_db.at(i));
+    std::copy(curr, curr + n, smoothed_power_.begin());
+    std::copy(curr, curr + n, tmp_min_smoothed_power_.begin());
+    for (int i = 0; i < n; ++i) {
+      squared_smoothed_power_[i] = audio_dsp::Square(curr[i]);
     }
-    tmp_min_smoothed_power_ = curr_power_db;
   }
 
-  std::vector<float> smoothing_factor = SmoothingFactor(
-      max_smoothing_, curr_power_db, smoothed_power_, noise_estimate_);
+  // The smoothing factor weighs how much the smoothed power calculation
+  // should track the current power in a frequency band at a given frame and
+  // takes values on the interval (0, max_smoothing_].
+  // Values closer to 1 indicate smoothed_power_ should be heavily smoothed
+  // (when there is noise in this frequency bin).
+  // Values closer to 0 indicate smoothed_power_ should take on the current
+  // power level at this frequency bin (when there is speech in this
+  // frequency bin).
+  // The smoothing correction factor approaches 0 as the current power value
+  // moves away from the previously calculated smoothed power, and is 1 when
+  // the two are equal.
+  const float smoothing_correction = std::exp(-audio_dsp::Square(
+      (Average<NumFeatures>(n, smoothed_power_.data()) -
+       Average<NumFeatures>(n, curr)) /
+      kPowDiff));
+  const float scaled_max_smoothing = max_smoothing_ * smoothing_correction;
 
   // smoothed_power_ per frequency band = smoothing_factor * smoothed_power +
-  // (1 - smoothing_factor) * curr_power_db.
-  for (int i = 0; i < smoothed_power_.size(); ++i) {
-    smoothed_power_.at(i) =
-        smoothing_factor.at(i) * smoothed_power_.at(i) +
-        (1.f - smoothing_factor.at(i)) * curr_power_db.at(i);
-    squared_smoothed_power_.at(i) =
-        smoothing_factor.at(i) * squared_smoothed_power_.at(i) +
-        (1.f - smoothing_factor.at(i)) * audio_dsp::Square(curr_power_db.at(i));
+  // (1 - smoothing_factor) * curr_power_db. Each factor only depends on the
+  // previous values of the same band, so it is computed in the same pass.
+  float* smoothed_power = smoothed_power_.data();
+  float* squared_smoothed_power = squared_smoothed_power_.data();
+  const float* noise_estimate = noise_estimate_.data();
+  for (int i = 0; i < n; ++i) {
+    const float smoothing_factor =
+        scaled_max_smoothing *
+        std::exp(-audio_dsp::Square((smoothed_power[i] - noise_estimate[i]) /
+                                    kPowDiff));
+    smoothed_power[i] = smoothing_factor * smoothed_power[i] +
+                        (1.f - smoothing_factor) * curr[i];
+    squared_smoothed_power[i] =
+        smoothing_factor * squared_smoothed_power[i] +
+        (1.f - smoothing_factor) * audio_dsp::Square(curr[i]);
   }
 
-  UpdateMinAndTemp(num_frames_received_, num_frames_per_update_,
-                   smoothed_power_, &noise_estimate_, &tmp_min_smoothed_power_);
-
-  ComputeBounds();
+  UpdateMinAndTemp<NumFeatures>(num_frames_received_, num_frames_per_update_,
+                                n, smoothed_power_.data(),
+                                noise_estimate_.data(),
+                                tmp_min_smoothed_power_.data());
 
-  // Increment by 1 each time the curr_power_db is received.
-  num_frames_received_ += 1;
-
-  return true;
+  ComputeBounds<NumFeatures>();
 }
 
-std::vector<float> NoiseEstimator::NoiseEstimate() const {
+absl::Span<const float> NoiseEstimator::NoiseEstimate() const {
   return noise_estimate_;
 }
 
+template <int NumFeatures>
+bool NoiseEstimator::IsWithinBounds(const float* curr) const {
+  // A frame is considered to be noise if it falls within noise_estimate_ +-
+  // noise_bound_. All the bands are compared and reduced without branching,
+  // so the loop vectorizes.
+  const int n = Extent<NumFeatures>(num_features_);
+  const float* noise_estimate = noise_estimate_.data();
+  const float* noise_bound = noise_bound_.data();
+  bool is_noise = true;
+  for (int i = 0; i < n; ++i) {
+    is_noise &= (curr[i] <= noise_estimate[i] + noise_bound[i]) &
+                (curr[i] >= noise_estimate[i] - noise_bound[i]);
+  }
+  return is_noise;
+}
+
 absl::optional<bool> NoiseEstimator::IsSimilarNoise(
-    const std::vector<float>& curr_power_db) {
+    absl::Span<const float> curr_power_db) {
   if (curr_power_db.size() != num_features_) {
     return absl::nullopt;
   }
 
-  // Decide whether current frame is noise or not. A frame is considered to be
-  // noise if it falls below noise_estimate_ +- noise_bound_.
-  for (int i = 0; i < curr_power_db.size(); ++i) {
-    if (curr_power_db.at(i) > noise_estimate_.at(i) + noise_bound_.at(i) ||
-        curr_power_db.at(i) < noise_estimate_.at(i) - noise_bound_.at(i)) {
-      return false;
-    }
+  const bool is_noise = DispatchOnSize<LyraDefaultCodecConfig::kNumFeatures>(
+      num_features_, [this, &curr_power_db](auto num_features) {
+        return IsWithinBounds<decltype(num_features)::value>(
+            curr_power_db.data());
+      });
+  if (!is_noise) {
+    return false;
   }
 
   // Exponentially decay noise_bound_ if multiple frames in a row are noise.
@@ -203,5 +233,37 @@ absl::optional<bool> NoiseEstimator::IsSimilarNoise(
   return true;
 }
 
+void NoiseEstimator::Reset() {
+  for (std::vector<float>* statistic :
+       {&smoothed_power_, &squared_smoothed_power_, &tmp_min_smoothed_power_,
+        &noise_bound_}) {
+    std::fill(statistic->begin(), statistic->end(), 0.0f);
+  }
+  std::fill(noise_estimate_.begin(), noise_estimate_.end(),
+            LogMelSpectrogramExtractorImpl::GetSilenceValue());
+  num_frames_received_ = 0;
+}
+
+bool NoiseEstimator::SaveState(StateWriter* writer) const {
+  for (const std::vector<float>* statistic :
+       {&smoothed_power_, &squared_smoothed_power_, &tmp_min_smoothed_power_,
+        &noise_estimate_, &noise_bound_}) {
+    writer->WriteSpan(absl::MakeConstSpan(*statistic));
+  }
+  writer->Write(num_frames_received_);
+  return true;
+}
+
+bool NoiseEstimator::RestoreState(StateReader* reader) {
+  for (std::vector<float>* statistic :
+       {&smoothed_power_, &squared_smoothed_power_, &tmp_min_smoothed_power_,
+        &noise_estimate_, &noise_bound_}) {
+    if (!reader->ReadSpan(absl::MakeSpan(*statistic))) {
+      return false;
+    }
+  }
+  return reader->Read(&num_frames_received_) && num_frames_received_ >= 0;
+}
+
 }  // namespace codec
 }  // namespace chromemedia
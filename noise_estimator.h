@@ -21,7 +21,9 @@
 #include <vector>
 
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "noise_estimator_interface.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -36,21 +38,39 @@ class NoiseEstimator : public NoiseEstimatorInterface {
 
   // Calculates and stores the minimum noise statistics given the current power
   // per frequency band and the previous state.
-  bool Update(const std::vector<float>& curr_power_db) override;
+  bool Update(absl::Span<const float> curr_power_db) override;
 
   // Returns the minimum noise statistic estimate.
-  std::vector<float> NoiseEstimate() const override;
+  absl::Span<const float> NoiseEstimate() const override;
 
   // Identifies if current frame is similar to previously identified noise.
   // Returns a nullopt if the size of curr_power_db does not match
   // num_features_. Otherwise value is true if current frame is noise, false if
   // not.
   absl::optional<bool> IsSimilarNoise(
-      const std::vector<float>& curr_power_db) override;
+      absl::Span<const float> curr_power_db) override;
+
+  // Returns the statistics to those of a new estimator, whose estimate is
+  // silence.
+  void Reset() override;
+
+  bool SaveState(StateWriter* writer) const override;
+
+  bool RestoreState(StateReader* reader) override;
 
  private:
   NoiseEstimator(int num_features, int num_frames_per_update,
                  float max_smoothing, float bound_decay_factor);
+
+  // The bodies of |Update| and |IsSimilarNoise| and the bounds they use, over
+  // |NumFeatures| bands. Those are the features of |LyraDefaultCodecConfig|
+  // when |num_features_| matches them, so that the loops are compiled for
+  // that size, and |num_features_| when |NumFeatures| is 0.
+  template <int NumFeatures>
+  void UpdateImpl(const float* curr);
+  template <int NumFeatures>
+  bool IsWithinBounds(const float* curr) const;
+  template <int NumFeatures>
   void ComputeBounds();
 
   const int num_features_;
@@ -62,6 +82,8 @@ class NoiseEstimator : public NoiseEstimatorInterface {
   std::vector<float> tmp_min_smoothed_power_;
   std::vector<float> noise_estimate_;
   std::vector<float> noise_bound_;
+  // Log of |num_features_|, which scales the variance in |ComputeBounds|.
+  const float log_num_features_;
   int num_frames_received_ = 0;
 };
 
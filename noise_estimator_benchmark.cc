@@ -0,0 +1,50 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "lyra_config.h"
+#include "noise_estimator.h"
+
+// Updates the noise estimate with random frames of log mel power.
+void BM_Update(benchmark::State& state) {
+  const int num_features = chromemedia::codec::kNumFeatures;
+  const int sample_rate_hz = chromemedia::codec::kInternalSampleRateHz;
+  auto noise_estimator = chromemedia::codec::NoiseEstimator::Create(
+      num_features,
+      static_cast<float>(
+          chromemedia::codec::GetNumSamplesPerHop(sample_rate_hz)) /
+          sample_rate_hz);
+  // We create random frames to avoid any caching in the benchmark.
+  const int kNumRandFrames = 1000;
+  absl::BitGen gen;
+  std::vector<std::vector<float>> frames(kNumRandFrames,
+                                         std::vector<float>(num_features));
+  for (auto& frame : frames) {
+    for (auto& power_db : frame) {
+      power_db = absl::Uniform<float>(gen, -20.0f, 20.0f);
+    }
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(noise_estimator->Update(
+        frames[absl::Uniform(gen, 0, kNumRandFrames)]));
+  }
+}
+
+BENCHMARK(BM_Update);
+BENCHMARK_MAIN();
@@ -17,9 +17,9 @@
 #ifndef LYRA_CODEC_NOISE_ESTIMATOR_INTERFACE_H_
 #define LYRA_CODEC_NOISE_ESTIMATOR_INTERFACE_H_
 
-#include <vector>
-
 #include "absl/types/optional.h"  // IWYU pragma: keep
+#include "absl/types/span.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -29,12 +29,22 @@ class NoiseEstimatorInterface {
  public:
   virtual ~NoiseEstimatorInterface() {}
 
-  virtual std::vector<float> NoiseEstimate() const = 0;
+  // Returns a view of the current estimate, which stays valid until the
+  // estimator is next updated, reset or restored.
+  virtual absl::Span<const float> NoiseEstimate() const = 0;
 
-  virtual bool Update(const std::vector<float>& curr_power_db) = 0;
+  virtual bool Update(absl::Span<const float> curr_power_db) = 0;
 
   virtual absl::optional<bool> IsSimilarNoise(
-      const std::vector<float>& curr_power_db) = 0;
+      absl::Span<const float> curr_power_db) = 0;
+
+  // Forgets the statistics of the frames seen so far.
+  virtual void Reset() = 0;
+
+  // Appends the statistics of the frames seen so far to |writer|, or restores
+  // them from |reader|. Both fail unless overridden.
+  virtual bool SaveState(StateWriter* writer) const { return false; }
+  virtual bool RestoreState(StateReader* reader) { return false; }
 };
 
 }  // namespace codec
@@ -23,6 +23,7 @@
 #include "absl/types/optional.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -123,6 +124,25 @@ TEST_F(NoiseEstimatorTest, NoiseIdentification) {
           .value());
 }
 
+TEST_F(NoiseEstimatorTest, ResetEstimatesLikeANewEstimator) {
+  const std::vector<float> kBaseNoise = BaseNoise();
+  for (int i = 1; i < kNumSeconds * kNumFramesPerSecond; ++i) {
+    ASSERT_TRUE(noise_estimator_->Update(RandomNoise(kBaseNoise)));
+  }
+  noise_estimator_->Reset();
+
+  auto new_estimator =
+      NoiseEstimator::Create(kTestNumFeatures, kNumSecondsPerFrame);
+  ASSERT_NE(new_estimator, nullptr);
+  std::vector<uint8_t> reset_state;
+  StateWriter reset_writer(&reset_state);
+  ASSERT_TRUE(noise_estimator_->SaveState(&reset_writer));
+  std::vector<uint8_t> new_state;
+  StateWriter new_writer(&new_state);
+  ASSERT_TRUE(new_estimator->SaveState(&new_writer));
+  EXPECT_EQ(reset_state, new_state);
+}
+
 TEST_F(NoiseEstimatorTest, BoundsDecay) {
   const std::vector<float> kBaseNoise = BaseNoise();
 
@@ -144,6 +164,25 @@ TEST_F(NoiseEstimatorTest, BoundsDecay) {
   EXPECT_FALSE(noise_estimator_->IsSimilarNoise(similar_noise).value());
 }
 
+// Sizes other than that of |LyraDefaultCodecConfig| take the loops compiled
+// for any size.
+TEST(NoiseEstimatorCreate, OtherSizesEstimateNoise) {
+  const int kNumFeatures = 40;
+  auto noise_estimator =
+      NoiseEstimator::Create(kNumFeatures, kNumSecondsPerFrame);
+  ASSERT_NE(noise_estimator, nullptr);
+  const std::vector<float> noise(kNumFeatures, -1.5f);
+  for (int i = 0; i < kNumSeconds * kNumFramesPerSecond; ++i) {
+    ASSERT_TRUE(noise_estimator->Update(noise));
+  }
+
+  EXPECT_THAT(noise_estimator->NoiseEstimate(),
+              testing::Pointwise(testing::FloatNear(kMaxAbsError), noise));
+  EXPECT_TRUE(noise_estimator->IsSimilarNoise(noise).value());
+  const std::vector<float> wrong_size_vector(kTestNumFeatures);
+  EXPECT_FALSE(noise_estimator->IsSimilarNoise(wrong_size_vector).has_value());
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
@@ -17,17 +17,16 @@
 #ifndef LYRA_CODEC_PACKET_H_
 #define LYRA_CODEC_PACKET_H_
 
-#include <bitset>
+#include <algorithm>
 #include <climits>
-#include <cmath>
 #include <cstdint>
-#include <string>
 #include <vector>
 
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "glog/logging.h"
 #include "packet_interface.h"
+#include "quantized_bits.h"
 
 namespace chromemedia {
 namespace codec {
@@ -37,119 +36,140 @@ namespace codec {
 template <int NumQuantizedBits, int NumHeaderBits>
 class Packet : public PacketInterface {
  public:
-  std::vector<uint8_t> PackQuantized(
-      const std::string& quantized_string) override {
-    const std::bitset<NumQuantizedBits> quantized_features(quantized_string);
-    return Pack(quantized_features);
-  }
+  static_assert(NumQuantizedBits <= QuantizedBits::kMaxNumBits,
+                "Too many quantized bits.");
+  static_assert(NumHeaderBits <= QuantizedBits::kMaxNumBits,
+                "Too many header bits.");
 
-  absl::optional<std::string> UnpackPacket(
-      const absl::Span<const uint8_t> packet) override {
-    const int expected_packet_size = static_cast<int>(std::ceil(
-        static_cast<float>(NumQuantizedBits + NumHeaderBits) / CHAR_BIT));
-    if (packet.length() != expected_packet_size) {
-      LOG(ERROR) << "Packet of unexpected length: " << packet.length();
-      return absl::nullopt;
-    }
-    std::bitset<NumQuantizedBits> quantized_features = UnpackFeatures(packet);
-    return quantized_features.to_string();
-  }
+  static constexpr int kPacketSize =
+      (NumQuantizedBits + NumHeaderBits + CHAR_BIT - 1) / CHAR_BIT;
 
-  int PacketSize() const override {
-    return static_cast<int>(std::ceil(
-        static_cast<float>(NumQuantizedBits + NumHeaderBits) / CHAR_BIT));
+  // Packs packets with a header of all zeros.
+  Packet() : header_(NumHeaderBits) {}
+
+  // Packs packets with |header|, which has to have |NumHeaderBits| bits.
+  explicit Packet(const QuantizedBits& header) : header_(header) {
+    CHECK_EQ(header_.num_bits(), NumHeaderBits);
   }
 
- private:
   // Creates a vector of bytes containing a header of variable bits with the
-  // quantized data following directly after. For example:
+  // first |NumQuantizedBits| of |quantized_features| following directly
+  // after. For example:
   //  +--------+--------+---------+
   //  |  ||    |        |  ||     |
   //  +--------+--------+---------+
   //   ^           ^           ^
   //   |           |           |
   // Header   Quantized     Extra Space
-  static std::vector<uint8_t> Pack(
-      const std::bitset<NumQuantizedBits>& quantized_features) {
-    const int kTotalNumPacketBits = NumQuantizedBits + NumHeaderBits;
-    const std::bitset<kTotalNumPacketBits> kByteMask(0b11111111);
-    int right_shift_amount = static_cast<int>(kTotalNumPacketBits) - CHAR_BIT;
-
-    std::bitset<kTotalNumPacketBits> packet_bits =
-        GeneratePacketBits(quantized_features);
-    std::vector<uint8_t> byte_array(
-        static_cast<int>(std::ceil(static_cast<float>(kTotalNumPacketBits) /
-                                   static_cast<float>(CHAR_BIT))));
-
-    // Shift the quantized bits into their proper byte in byte_array. The
-    // leftmost bits of quantized will occupy byte_array.at(NumHeaderBits) after
-    // the header.
-    for (auto& packet_byte : byte_array) {
-      std::bitset<kTotalNumPacketBits> shifted_bits;
-      if (right_shift_amount >= 0) {
-        shifted_bits = packet_bits >> right_shift_amount;
-      } else {
-        // When the quantized bits do not take up the entire last byte, shift
-        // the bits so they take up the upper part of the last byte.
-        shifted_bits = packet_bits << -right_shift_amount;
+  std::vector<uint8_t> PackQuantized(
+      const QuantizedBits& quantized_features) override {
+    QuantizedBits truncated_features = quantized_features;
+    if (truncated_features.num_bits() > NumQuantizedBits) {
+      truncated_features.Resize(NumQuantizedBits);
+    }
+    std::vector<uint8_t> byte_array(kPacketSize);
+    // Write 8 big-endian bytes at a time. The bits past the end of the
+    // header and of the features read as zeros.
+    for (int byte = 0; byte < kPacketSize; byte += kBytesPerWord) {
+      const int bit = byte * CHAR_BIT;
+      const uint64_t word = header_.ReadWord(bit) |
+                            truncated_features.ReadWord(bit - NumHeaderBits);
+      const int num_bytes = std::min(kBytesPerWord, kPacketSize - byte);
+      for (int i = 0; i < num_bytes; ++i) {
+        byte_array[byte + i] =
+            static_cast<uint8_t>(word >> (kWordBits - CHAR_BIT * (i + 1)));
       }
-      // Mask off bits at index 8 or greater to avoid errors when casting.
-      shifted_bits &= kByteMask;
-      packet_byte = static_cast<uint8_t>(shifted_bits.to_ulong());
-      right_shift_amount -= CHAR_BIT;
     }
-
     return byte_array;
   }
 
-  // Unpacks the bytes from a packet into a bitset representing the indices of
-  // the transformed features.
-  static std::bitset<NumQuantizedBits> UnpackFeatures(
-      const absl::Span<const uint8_t> encoded) {
-    std::bitset<NumQuantizedBits> quantized_features(0);
-    int left_shift_amount = static_cast<int>(NumQuantizedBits) +
-                            static_cast<int>(NumHeaderBits) - CHAR_BIT;
-    // Shift each byte from packet into its proper place in quantized_features
-    // where the first bit of quantized data occurs after the header bits.
-    for (uint8_t packet_byte : encoded) {
-      std::bitset<NumQuantizedBits> shifted_packet_data(packet_byte);
-      if (left_shift_amount >= 0) {
-        shifted_packet_data <<= left_shift_amount;
-      } else {
-        // When the quantized bits do not take up the entire last byte, shift
-        // the bits so they take up the upper part of the last byte.
-        shifted_packet_data >>= -left_shift_amount;
-      }
-      quantized_features |= shifted_packet_data;
-      left_shift_amount -= CHAR_BIT;
+  absl::optional<QuantizedBits> UnpackPacket(
+      const absl::Span<const uint8_t> packet) override {
+    if (packet.length() != kPacketSize) {
+      LOG(ERROR) << "Packet of unexpected length: " << packet.length();
+      return absl::nullopt;
     }
+    return ExtractBits(packet, NumHeaderBits, NumQuantizedBits);
+  }
 
-    return quantized_features;
+  // Checks the length of every packet once and extracts the bits straight into
+  // |quantized|, without building an optional per packet.
+  int UnpackPackets(absl::Span<const absl::Span<const uint8_t>> packets,
+                    absl::Span<QuantizedBits> quantized,
+                    absl::Span<UnpackStatus> statuses) override {
+    CHECK_EQ(quantized.size(), packets.size());
+    CHECK_EQ(statuses.size(), packets.size());
+    int num_unpacked = 0;
+    for (int i = 0; i < packets.size(); ++i) {
+      if (packets[i].size() != kPacketSize) {
+        statuses[i] = packets[i].empty() ? UnpackStatus::kEmpty
+                                         : UnpackStatus::kInvalid;
+        continue;
+      }
+      quantized[i] = ExtractBits(packets[i], NumHeaderBits, NumQuantizedBits);
+      statuses[i] = UnpackStatus::kUnpacked;
+      ++num_unpacked;
+    }
+    return num_unpacked;
   }
 
-  // Combine header and quantized features into a bitset.
-  static std::bitset<NumHeaderBits + NumQuantizedBits> GeneratePacketBits(
-      const std::bitset<NumQuantizedBits>& quantized_features) {
-    std::bitset<NumHeaderBits + NumQuantizedBits> packet_bits = SetHeader();
+  // Returns the header of |packet|, which has to be |kPacketSize| bytes long.
+  static QuantizedBits UnpackHeader(const absl::Span<const uint8_t> packet) {
+    CHECK_EQ(packet.length(), kPacketSize);
+    return ExtractBits(packet, 0, NumHeaderBits);
+  }
 
-    std::bitset<NumQuantizedBits + NumHeaderBits> quantized_bitset(
-        quantized_features.to_string());
-    packet_bits |= quantized_bitset;
+  int PacketSize() const override { return kPacketSize; }
 
-    return packet_bits;
+ private:
+  static constexpr int kWordBits = 64;
+  static constexpr int kBytesPerWord = kWordBits / CHAR_BIT;
+
+  // Returns the 64 bits of |packet|, which is |kPacketSize| bytes long,
+  // starting at bit |start|, the first one being the most significant bit.
+  // The bits past the end read as zeros.
+  static uint64_t ReadPacketWord(const absl::Span<const uint8_t> packet,
+                                 int start) {
+    const int first_byte = start / CHAR_BIT;
+    const int offset = start % CHAR_BIT;
+    uint64_t word = 0;
+    if (first_byte + kBytesPerWord <= kPacketSize) {
+      // Without the bounds checks the compiler combines the loop into one load
+      // and a byte swap.
+      for (int i = 0; i < kBytesPerWord; ++i) {
+        word = (word << CHAR_BIT) | packet[first_byte + i];
+      }
+    } else {
+      for (int i = 0; i < kBytesPerWord; ++i) {
+        word <<= CHAR_BIT;
+        if (first_byte + i < kPacketSize) {
+          word |= packet[first_byte + i];
+        }
+      }
+    }
+    if (offset > 0) {
+      word <<= offset;
+      if (first_byte + kBytesPerWord < kPacketSize) {
+        word |= packet[first_byte + kBytesPerWord] >> (CHAR_BIT - offset);
+      }
+    }
+    return word;
   }
 
-  // Includes space for NumQuantBits so can be or'ed at end.
-  static std::bitset<NumHeaderBits + NumQuantizedBits> SetHeader() {
-    std::bitset<NumHeaderBits + NumQuantizedBits> header;
-    // Must update if adding new header sections.
-    int unused_bits = NumHeaderBits;
-    // For each entry in the header, subtract the number of bits from the
-    // unused_bits, get the bits, or it with header and the shift by the number
-    // of bits of the next entry.
-    header <<= (unused_bits + NumQuantizedBits);
-    return header;
+  // Returns the |num_bits| bits of |packet| starting at bit |start|.
+  static QuantizedBits ExtractBits(const absl::Span<const uint8_t> packet,
+                                   int start, int num_bits) {
+    QuantizedBits bits;
+    for (int bit = 0; bit < num_bits; bit += kWordBits) {
+      const int num_word_bits = std::min(kWordBits, num_bits - bit);
+      bits.Append(ReadPacketWord(packet, start + bit) >>
+                      (kWordBits - num_word_bits),
+                  num_word_bits);
+    }
+    return bits;
   }
+
+  QuantizedBits header_;
 };
 
 }  // namespace codec
@@ -0,0 +1,73 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "packet.h"
+#include "quantized_bits.h"
+
+// The packet layout the codec ships with.
+static constexpr int kNumQuantizedBits = 120;
+static constexpr int kNumHeaderBits = 0;
+static constexpr int kNumRandPackets = 1000;
+
+using PacketType =
+    chromemedia::codec::Packet<kNumQuantizedBits, kNumHeaderBits>;
+
+static std::vector<chromemedia::codec::QuantizedBits> RandomQuantizedBits() {
+  absl::BitGen gen;
+  std::vector<chromemedia::codec::QuantizedBits> quantized(kNumRandPackets);
+  for (auto& bits : quantized) {
+    for (int bit = 0; bit < kNumQuantizedBits; bit += 32) {
+      const int num_bits = std::min(32, kNumQuantizedBits - bit);
+      bits.Append(absl::Uniform<uint32_t>(gen) >> (32 - num_bits), num_bits);
+    }
+  }
+  return quantized;
+}
+
+void BM_PackQuantized(benchmark::State& state) {
+  PacketType packet;
+  // We create random bits to avoid any caching in the benchmark.
+  const auto quantized = RandomQuantizedBits();
+  absl::BitGen gen;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(packet.PackQuantized(
+        quantized[absl::Uniform(gen, 0, kNumRandPackets)]));
+  }
+}
+
+void BM_UnpackPacket(benchmark::State& state) {
+  PacketType packet;
+  std::vector<std::vector<uint8_t>> encoded;
+  encoded.reserve(kNumRandPackets);
+  for (const auto& bits : RandomQuantizedBits()) {
+    encoded.push_back(packet.PackQuantized(bits));
+  }
+  absl::BitGen gen;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        packet.UnpackPacket(encoded[absl::Uniform(gen, 0, kNumRandPackets)]));
+  }
+}
+
+BENCHMARK(BM_PackQuantized);
+BENCHMARK(BM_UnpackPacket);
+BENCHMARK_MAIN();
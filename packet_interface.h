@@ -18,11 +18,11 @@
 #define LYRA_CODEC_PACKET_INTERFACE_H_
 
 #include <cstdint>
-#include <string>
 #include <vector>
 
 #include "absl/types/optional.h"  // IWYU pragma: keep
 #include "absl/types/span.h"
+#include "quantized_bits.h"
 
 namespace chromemedia {
 namespace codec {
@@ -30,17 +30,53 @@ namespace codec {
 // An interface to abstract the quantization implementation.
 class PacketInterface {
  public:
+  // What |UnpackPackets| found in a packet.
+  enum class UnpackStatus {
+    kUnpacked,
+    // Sent by DTX for noise.
+    kEmpty,
+    // Not |PacketSize| bytes long.
+    kInvalid,
+  };
+
   virtual ~PacketInterface() {}
 
-  // Packs quantized bits in a string to packet bytes.
+  // Packs quantized bits to packet bytes.
   virtual std::vector<uint8_t> PackQuantized(
-      const std::string& quantized_string) = 0;
+      const QuantizedBits& quantized_features) = 0;
 
-  // Unpacks an encoded packet received over the wire to quantized bits in the
-  // form of a string.
-  virtual absl::optional<std::string> UnpackPacket(
+  // Unpacks an encoded packet received over the wire to quantized bits.
+  virtual absl::optional<QuantizedBits> UnpackPacket(
       const absl::Span<const uint8_t> packet) = 0;
 
+  // Unpacks each of |packets| into the same entry of |quantized| and sets the
+  // same entry of |statuses|, which both have to be as long as |packets|. The
+  // entries of |quantized| of empty and invalid packets are left as they are.
+  // Returns the number of unpacked packets. Unlike |UnpackPacket| nothing is
+  // logged, so that forwarding servers can check untrusted packets in bulk.
+  virtual int UnpackPackets(absl::Span<const absl::Span<const uint8_t>> packets,
+                            absl::Span<QuantizedBits> quantized,
+                            absl::Span<UnpackStatus> statuses) {
+    int num_unpacked = 0;
+    for (int i = 0; i < packets.size(); ++i) {
+      if (packets[i].empty()) {
+        statuses[i] = UnpackStatus::kEmpty;
+        continue;
+      }
+      absl::optional<QuantizedBits> unpacked =
+          packets[i].size() == PacketSize() ? UnpackPacket(packets[i])
+                                            : absl::nullopt;
+      if (!unpacked.has_value()) {
+        statuses[i] = UnpackStatus::kInvalid;
+        continue;
+      }
+      quantized[i] = *unpacked;
+      statuses[i] = UnpackStatus::kUnpacked;
+      ++num_unpacked;
+    }
+    return num_unpacked;
+  }
+
   virtual int PacketSize() const = 0;
 };
 
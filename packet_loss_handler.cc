@@ -14,30 +14,59 @@
 
 #include "packet_loss_handler.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/types/span.h"
 #include "glog/logging.h"
 #include "naive_spectrogram_predictor.h"
 #include "noise_estimator.h"
 #include "noise_estimator_interface.h"
 #include "spectrogram_predictor_interface.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
+namespace {
+
+void WriteFeatures(const FeatureFrame& features, StateWriter* writer) {
+  writer->WriteSpan(absl::MakeConstSpan(features.data(), features.size()));
+}
+
+bool ReadFeatures(StateReader* reader, FeatureFrame* features) {
+  int32_t size;
+  if (!reader->Read(&size) || size < 0 || size > FeatureFrame::kCapacity) {
+    return false;
+  }
+  features->resize(size);
+  return reader->ReadBytes(features->data(), size * sizeof(float));
+}
+
+}  // namespace
 
 std::unique_ptr<PacketLossHandler> PacketLossHandler::Create(
-    int sample_rate_hz, int num_features, float seconds_per_frame) {
+    int sample_rate_hz, int num_features, float seconds_per_frame,
+    const SpectrogramPredictorFactory& spectrogram_predictor_factory) {
+  if (num_features > FeatureFrame::kCapacity) {
+    LOG(ERROR) << "A frame holds at most " << FeatureFrame::kCapacity
+               << " features, not " << num_features << ".";
+    return nullptr;
+  }
   auto noise_estimator =
       NoiseEstimator::Create(num_features, seconds_per_frame);
   if (noise_estimator == nullptr) {
     return nullptr;
   }
-  auto spectrogram_predictor =
-      absl::make_unique<NaiveSpectrogramPredictor>(num_features);
+  std::unique_ptr<SpectrogramPredictorInterface> spectrogram_predictor =
+      spectrogram_predictor_factory == nullptr
+          ? absl::make_unique<NaiveSpectrogramPredictor>(num_features)
+          : spectrogram_predictor_factory(num_features);
   if (spectrogram_predictor == nullptr) {
+    LOG(ERROR) << "Could not create Spectrogram Predictor.";
     return nullptr;
   }
   return absl::WrapUnique(
@@ -50,14 +79,15 @@ PacketLossHandler::PacketLossHandler(
     std::unique_ptr<NoiseEstimatorInterface> noise_estimator,
     std::unique_ptr<SpectrogramPredictorInterface> spectrogram_predictor)
     : consecutive_lost_samples_(0),
+      future_lost_samples_(0),
       noise_estimator_(std::move(noise_estimator)),
       spectrogram_predictor_(std::move(spectrogram_predictor)) {
-  constexpr float kMaxLostSeconds = 0.1;
-  max_lost_samples_ = kMaxLostSeconds * sample_rate_hz;
+  max_lost_samples_ =
+      spectrogram_predictor_->max_prediction_seconds() * sample_rate_hz;
 }
 
 bool PacketLossHandler::SetReceivedFeatures(
-    const std::vector<float>& features) {
+    absl::Span<const float> features) {
   consecutive_lost_samples_ = 0;
 
   if (!noise_estimator_->Update(features)) {
@@ -66,10 +96,52 @@ bool PacketLossHandler::SetReceivedFeatures(
   }
 
   spectrogram_predictor_->FeedFrame(features);
+  received_features_.assign(features);
+  future_features_.resize(0);
+  return true;
+}
+
+bool PacketLossHandler::SetFutureFeatures(absl::Span<const float> features,
+                                          int num_samples) {
+  if (num_samples <= 0) {
+    LOG(ERROR) << "Number of samples must be positive.";
+    return false;
+  }
+  if (received_features_.empty() || is_comfort_noise()) {
+    // There is nothing to interpolate from.
+    return false;
+  }
+  if (features.size() != received_features_.size()) {
+    LOG(ERROR) << "Future features have to be " << received_features_.size()
+               << " features like the received ones, not " << features.size()
+               << ".";
+    return false;
+  }
+  future_features_.assign(features);
+  future_lost_samples_ = consecutive_lost_samples_ + num_samples;
   return true;
 }
 
-absl::optional<std::vector<float>> PacketLossHandler::EstimateLostFeatures(
+bool PacketLossHandler::IsInterpolating(int consecutive_lost_samples) const {
+  return !future_features_.empty() &&
+         consecutive_lost_samples <= future_lost_samples_;
+}
+
+FeatureFrame PacketLossHandler::InterpolateFeatures(
+    int consecutive_lost_samples, int num_samples) const {
+  // The received features are at weight 0 and the future ones would be at 1
+  // after one more estimate of |num_samples| samples.
+  const float weight = static_cast<float>(consecutive_lost_samples) /
+                       (future_lost_samples_ + num_samples);
+  FeatureFrame interpolated(received_features_.size());
+  for (int i = 0; i < interpolated.size(); ++i) {
+    interpolated[i] = received_features_[i] +
+                      weight * (future_features_[i] - received_features_[i]);
+  }
+  return interpolated;
+}
+
+absl::optional<FeatureFrame> PacketLossHandler::EstimateLostFeatures(
     int num_samples) {
   if (num_samples <= 0) {
     LOG(ERROR) << "Number of samples must be positive.";
@@ -77,16 +149,90 @@ absl::optional<std::vector<float>> PacketLossHandler::EstimateLostFeatures(
   }
 
   consecutive_lost_samples_ += num_samples;
+  if (IsInterpolating(consecutive_lost_samples_)) {
+    const FeatureFrame interpolated =
+        InterpolateFeatures(consecutive_lost_samples_, num_samples);
+    spectrogram_predictor_->FeedFrame(interpolated);
+    return interpolated;
+  }
+  future_features_.resize(0);
   if (consecutive_lost_samples_ > max_lost_samples_) {
-    auto noise_estimate = noise_estimator_->NoiseEstimate();
+    const absl::Span<const float> noise_estimate =
+        noise_estimator_->NoiseEstimate();
     spectrogram_predictor_->FeedFrame(noise_estimate);
-    return noise_estimate;
+    return FeatureFrame(noise_estimate);
   }
   return spectrogram_predictor_->PredictFrame();
 }
 
+absl::optional<FeatureFrame> PacketLossHandler::PeekLostFeatures(
+    int num_samples) {
+  if (num_samples <= 0) {
+    LOG(ERROR) << "Number of samples must be positive.";
+    return absl::nullopt;
+  }
+  if (IsInterpolating(consecutive_lost_samples_ + num_samples)) {
+    return InterpolateFeatures(consecutive_lost_samples_ + num_samples,
+                               num_samples);
+  }
+  if (consecutive_lost_samples_ + num_samples > max_lost_samples_) {
+    return FeatureFrame(noise_estimator_->NoiseEstimate());
+  }
+  return spectrogram_predictor_->PeekFrame();
+}
+
+absl::optional<FeatureFrame> PacketLossHandler::EstimateSilenceFeatures(
+    int num_samples) {
+  if (num_samples <= 0) {
+    LOG(ERROR) << "Number of samples must be positive.";
+    return absl::nullopt;
+  }
+
+  consecutive_lost_samples_ =
+      std::max(consecutive_lost_samples_, max_lost_samples_) + num_samples;
+  future_features_.resize(0);
+  const absl::Span<const float> noise_estimate =
+      noise_estimator_->NoiseEstimate();
+  spectrogram_predictor_->FeedFrame(noise_estimate);
+  return FeatureFrame(noise_estimate);
+}
+
+absl::optional<bool> PacketLossHandler::IsSimilarNoise(
+    absl::Span<const float> features) {
+  return noise_estimator_->IsSimilarNoise(features);
+}
+
 bool PacketLossHandler::is_comfort_noise() const {
-  return consecutive_lost_samples_ > max_lost_samples_;
+  return consecutive_lost_samples_ > max_lost_samples_ &&
+         !IsInterpolating(consecutive_lost_samples_);
+}
+
+void PacketLossHandler::Reset() {
+  consecutive_lost_samples_ = 0;
+  received_features_.resize(0);
+  future_features_.resize(0);
+  future_lost_samples_ = 0;
+  noise_estimator_->Reset();
+  spectrogram_predictor_->Reset();
+}
+
+bool PacketLossHandler::SaveState(StateWriter* writer) const {
+  writer->Write(consecutive_lost_samples_);
+  WriteFeatures(received_features_, writer);
+  WriteFeatures(future_features_, writer);
+  writer->Write(future_lost_samples_);
+  return noise_estimator_->SaveState(writer) &&
+         spectrogram_predictor_->SaveState(writer);
+}
+
+bool PacketLossHandler::RestoreState(StateReader* reader) {
+  return reader->Read(&consecutive_lost_samples_) &&
+         consecutive_lost_samples_ >= 0 &&
+         ReadFeatures(reader, &received_features_) &&
+         ReadFeatures(reader, &future_features_) &&
+         reader->Read(&future_lost_samples_) &&
+         noise_estimator_->RestoreState(reader) &&
+         spectrogram_predictor_->RestoreState(reader);
 }
 
 }  // namespace codec
@@ -18,12 +18,14 @@
 #define LYRA_CODEC_PACKET_LOSS_HANDLER_H_
 
 #include <memory>
-#include <vector>
 
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "feature_frame.h"
 #include "noise_estimator_interface.h"
 #include "packet_loss_handler_interface.h"
 #include "spectrogram_predictor_interface.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -33,14 +35,19 @@ namespace codec {
 // number of consecutive packets missing.
 class PacketLossHandler : public PacketLossHandlerInterface {
  public:
-  static std::unique_ptr<PacketLossHandler> Create(int sample_rate_hz,
-                                                   int num_features,
-                                                   float seconds_per_frame);
+  // Creates the spectrogram predictor with |spectrogram_predictor_factory|,
+  // or a NaiveSpectrogramPredictor if it is null. How long features are
+  // predicted before switching to comfort noise is up to the predictor.
+  // Returns a nullptr if |num_features| do not fit into a |FeatureFrame|.
+  static std::unique_ptr<PacketLossHandler> Create(
+      int sample_rate_hz, int num_features, float seconds_per_frame,
+      const SpectrogramPredictorFactory& spectrogram_predictor_factory =
+          nullptr);
 
   // Called for every new packet received by the decoder. Updates both the
   // Spectrogram Predictor and the Noise Estimator with the received features.
   // Returns true on success and false on failure.
-  bool SetReceivedFeatures(const std::vector<float>& features) override;
+  bool SetReceivedFeatures(absl::Span<const float> features) override;
 
   // Provides estimated features from which a packet can be reconstructed.
   // Requires knowing the number of samples that the decoder is looking to
@@ -48,20 +55,69 @@ class PacketLossHandler : public PacketLossHandlerInterface {
   // Estimated features are returned from the Spectrogram Predictor if
   // |num_samples| is below the maximum allowed and are returned from the Noise
   // Estimator otherwise. Returns a nullopt if |num_samples| is out of bounds.
-  absl::optional<std::vector<float>> EstimateLostFeatures(
+  absl::optional<FeatureFrame> EstimateLostFeatures(int num_samples) override;
+
+  absl::optional<FeatureFrame> PeekLostFeatures(int num_samples) override;
+
+  // Until |num_samples| more samples are lost the lost features are linearly
+  // interpolated between the last received features and |features|, without
+  // switching to comfort noise however long that takes. The future features
+  // are forgotten once more samples are lost, or at the next received
+  // features. Returns false if no features were received yet, if the handler
+  // already switched to comfort noise, if |num_samples| is not positive or if
+  // |features| are not of the size of the received ones.
+  bool SetFutureFeatures(absl::Span<const float> features,
+                         int num_samples) override;
+
+  // Provides the background noise estimate for a stretch of |num_samples|
+  // samples the encoder deemed silent. There is nothing to predict, so the
+  // handler switches to comfort noise right away instead of after the maximum
+  // number of lost samples. Returns a nullopt if |num_samples| is out of
+  // bounds.
+  absl::optional<FeatureFrame> EstimateSilenceFeatures(
       int num_samples) override;
 
+  // Checks |features| against the estimate of the Noise Estimator. Has to be
+  // called before the same features are passed to |SetReceivedFeatures|.
+  // Returns a nullopt if |features| are not of the right size.
+  absl::optional<bool> IsSimilarNoise(
+      absl::Span<const float> features) override;
+
   // Returns true if the last returned features are generated by the background
-  // noise estimator.
+  // noise estimator, which interpolated features never are.
   bool is_comfort_noise() const override;
 
+  // Resets the count of lost samples, the future features, the noise estimator
+  // and the spectrogram predictor.
+  void Reset() override;
+
+  bool SaveState(StateWriter* writer) const override;
+
+  bool RestoreState(StateReader* reader) override;
+
  private:
   explicit PacketLossHandler(
       int sample_rate_hz,
       std::unique_ptr<NoiseEstimatorInterface> noise_estimator,
       std::unique_ptr<SpectrogramPredictorInterface> spectrogram_predictor);
 
+  // Whether the lost features are interpolated towards |future_features_|
+  // once |consecutive_lost_samples_| samples are lost.
+  bool IsInterpolating(int consecutive_lost_samples) const;
+
+  // Interpolates between |received_features_| and |future_features_| for the
+  // features after |consecutive_lost_samples| lost ones, each estimate
+  // covering |num_samples| samples.
+  FeatureFrame InterpolateFeatures(int consecutive_lost_samples,
+                                   int num_samples) const;
+
   int consecutive_lost_samples_;
+  // The most recently received features, to interpolate from.
+  FeatureFrame received_features_;
+  // The features to interpolate to, if any, which start after
+  // |future_lost_samples_| consecutive lost samples.
+  FeatureFrame future_features_;
+  int future_lost_samples_;
   int max_lost_samples_;
   const std::unique_ptr<NoiseEstimatorInterface> noise_estimator_;
   std::unique_ptr<SpectrogramPredictorInterface> spectrogram_predictor_;
@@ -17,9 +17,10 @@
 #ifndef LYRA_CODEC_PACKET_LOSS_HANDLER_INTERFACE_H_
 #define LYRA_CODEC_PACKET_LOSS_HANDLER_INTERFACE_H_
 
-#include <vector>
-
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "feature_frame.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -30,13 +31,53 @@ class PacketLossHandlerInterface {
   virtual ~PacketLossHandlerInterface() {}
 
   // Called for every new packet received by the decoder.
-  virtual bool SetReceivedFeatures(const std::vector<float>& features) = 0;
+  virtual bool SetReceivedFeatures(absl::Span<const float> features) = 0;
 
   // When a packet is not received provides a packet to be used instead.
-  virtual absl::optional<std::vector<float>> EstimateLostFeatures(
+  virtual absl::optional<FeatureFrame> EstimateLostFeatures(
+      int num_samples) = 0;
+
+  // Returns what |EstimateLostFeatures| would if |num_samples| were lost now,
+  // without counting them as lost. Returns a nullopt if the handler cannot
+  // tell ahead, which the default cannot.
+  virtual absl::optional<FeatureFrame> PeekLostFeatures(int num_samples) {
+    return absl::nullopt;
+  }
+
+  // Supplies the |features| of a packet that was already received but starts
+  // only after another |num_samples| lost samples, e.g. the packet after a
+  // loss in a jitter buffer, so that the lost features can be interpolated
+  // towards it instead of extrapolated. Returns false if the handler cannot
+  // make use of them, which the default cannot.
+  virtual bool SetFutureFeatures(absl::Span<const float> features,
+                                 int num_samples) {
+    return false;
+  }
+
+  // When the encoder reported silence instead of sending a packet provides
+  // the features of the background noise, to be rendered as comfort noise.
+  virtual absl::optional<FeatureFrame> EstimateSilenceFeatures(
       int num_samples) = 0;
 
+  // Whether |features| of a received packet are similar to the background
+  // noise received so far.
+  virtual absl::optional<bool> IsSimilarNoise(
+      absl::Span<const float> features) = 0;
+
   virtual bool is_comfort_noise() const = 0;
+
+  // Forgets the received history and the count of lost samples, as if no
+  // packet had been received yet.
+  virtual void Reset() = 0;
+
+  // Appends the received history and the count of lost samples to |writer|.
+  // Returns false if the handler does not support this, which the default
+  // does not.
+  virtual bool SaveState(StateWriter* writer) const { return false; }
+
+  // Restores what |SaveState| of a handler of the same parameters wrote.
+  // Returns false if |reader| does not hold it.
+  virtual bool RestoreState(StateReader* reader) { return false; }
 };
 
 }  // namespace codec
@@ -18,8 +18,11 @@
 #include <utility>
 #include <vector>
 
+#include "absl/types/span.h"
+#include "feature_frame.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "linear_spectrogram_predictor.h"
 #include "lyra_config.h"
 #include "noise_estimator_interface.h"
 #include "spectrogram_predictor_interface.h"
@@ -31,6 +34,7 @@ namespace codec {
 
 namespace {
 
+using testing::ElementsAreArray;
 using testing::Return;
 
 static constexpr int kSampleRateHz = 16000;
@@ -50,16 +54,34 @@ class PacketLossHandlerPeer {
       : packet_loss_handler_(kSampleRateHz, std::move(mock_noise_estimator),
                              std::move(mock_spectrogram_predictor)) {}
 
-  bool SetReceivedFeatures(const std::vector<float>& features) {
+  bool SetReceivedFeatures(absl::Span<const float> features) {
     return packet_loss_handler_.SetReceivedFeatures(features);
   }
 
-  absl::optional<std::vector<float>> EstimateLostFeatures(int num_samples) {
+  absl::optional<FeatureFrame> EstimateLostFeatures(int num_samples) {
     return packet_loss_handler_.EstimateLostFeatures(num_samples);
   }
 
+  absl::optional<FeatureFrame> PeekLostFeatures(int num_samples) {
+    return packet_loss_handler_.PeekLostFeatures(num_samples);
+  }
+
+  bool SetFutureFeatures(absl::Span<const float> features, int num_samples) {
+    return packet_loss_handler_.SetFutureFeatures(features, num_samples);
+  }
+
+  absl::optional<bool> IsSimilarNoise(absl::Span<const float> features) {
+    return packet_loss_handler_.IsSimilarNoise(features);
+  }
+
+  absl::optional<FeatureFrame> EstimateSilenceFeatures(int num_samples) {
+    return packet_loss_handler_.EstimateSilenceFeatures(num_samples);
+  }
+
   bool is_comfort_noise() { return packet_loss_handler_.is_comfort_noise(); }
 
+  void Reset() { packet_loss_handler_.Reset(); }
+
   int FetchConsecutiveLostSamples() {
     return packet_loss_handler_.consecutive_lost_samples_;
   }
@@ -87,17 +109,52 @@ TEST(PacketLossHandlerTest, InvalidNoiseEstimatorCreatesNullHandler) {
                                                seconds_per_frame));
 }
 
+// Ensures a failing Spectrogram Predictor factory fails the creation too.
+TEST(PacketLossHandlerTest, InvalidSpectrogramPredictorCreatesNullHandler) {
+  EXPECT_EQ(nullptr,
+            PacketLossHandler::Create(
+                kSampleRateHz, kNumFeatures,
+                static_cast<float>(kNumSamplesPerFrame) / kSampleRateHz,
+                [](int num_features) {
+                  return std::unique_ptr<SpectrogramPredictorInterface>();
+                }));
+}
+
+// A LinearSpectrogramPredictor predicts features for longer than the default
+// predictor before the handler switches to comfort noise.
+TEST(PacketLossHandlerTest, LinearSpectrogramPredictorPredictsLonger) {
+  auto packet_loss_handler = PacketLossHandler::Create(
+      kSampleRateHz, kNumFeatures,
+      static_cast<float>(kNumSamplesPerFrame) / kSampleRateHz,
+      [](int num_features) {
+        return LinearSpectrogramPredictor::Create(num_features);
+      });
+  ASSERT_NE(packet_loss_handler, nullptr);
+  ASSERT_TRUE(packet_loss_handler->SetReceivedFeatures(
+      FeatureFrame(kNumFeatures, 1.0f)));
+
+  const int max_lost_samples =
+      LinearSpectrogramPredictor::kMaxPredictionSeconds * kSampleRateHz;
+  ASSERT_GT(max_lost_samples, kMaxConsecutiveLostSamples);
+  ASSERT_TRUE(
+      packet_loss_handler->EstimateLostFeatures(max_lost_samples).has_value());
+  EXPECT_FALSE(packet_loss_handler->is_comfort_noise());
+  ASSERT_TRUE(packet_loss_handler->EstimateLostFeatures(1).has_value());
+  EXPECT_TRUE(packet_loss_handler->is_comfort_noise());
+}
+
 // Calls SetReceivedFeatures on a valid PacketLossHandler with a valid feature
 // vector and ensures |consecutive_lost_samples_| remains 0 and that the
 // SpectrogramPredictor's FeedPacket method is invoked.
 TEST(PacketLossHandlerTest, SetReceivedFeaturesWithValidFeatures) {
-  std::vector<float> mock_features(kNumFeatures, 1.0);
+  FeatureFrame mock_features(kNumFeatures, 1.0);
   auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
   auto mock_spectrogram_predictor =
       absl::make_unique<MockSpectrogramPredictor>();
-  EXPECT_CALL(*mock_noise_estimator, Update(mock_features))
+  EXPECT_CALL(*mock_noise_estimator, Update(ElementsAreArray(mock_features)))
       .WillOnce(Return(true));
-  EXPECT_CALL(*mock_spectrogram_predictor, FeedFrame(mock_features)).Times(1);
+  EXPECT_CALL(*mock_spectrogram_predictor,
+              FeedFrame(ElementsAreArray(mock_features))).Times(1);
   auto packet_loss_handler_peer = absl::make_unique<PacketLossHandlerPeer>(
       std::move(mock_noise_estimator), std::move(mock_spectrogram_predictor));
   EXPECT_EQ(0, packet_loss_handler_peer->FetchConsecutiveLostSamples());
@@ -116,9 +173,10 @@ TEST(PacketLossHandlerTest, SetReceivedFeaturesWithInvalidFeatures) {
   auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
   auto mock_spectrogram_predictor =
       absl::make_unique<MockSpectrogramPredictor>();
-  EXPECT_CALL(*mock_noise_estimator, Update(mock_features))
+  EXPECT_CALL(*mock_noise_estimator, Update(ElementsAreArray(mock_features)))
       .WillOnce(Return(false));
-  EXPECT_CALL(*mock_spectrogram_predictor, FeedFrame(mock_features)).Times(0);
+  EXPECT_CALL(*mock_spectrogram_predictor,
+              FeedFrame(ElementsAreArray(mock_features))).Times(0);
   auto packet_loss_handler_peer = absl::make_unique<PacketLossHandlerPeer>(
       std::move(mock_noise_estimator), std::move(mock_spectrogram_predictor));
   EXPECT_FALSE(packet_loss_handler_peer->SetReceivedFeatures(mock_features));
@@ -132,7 +190,7 @@ TEST(PacketLossHandlerTest, SetReceivedFeaturesWithInvalidFeatures) {
 TEST(PacketLossHandlerTest,
      EstimateLostFeaturesWithConsecutiveLostSamplesBelowMax) {
   static constexpr int kNumSamplesToRequest = 100;
-  std::vector<float> mock_prediction(kNumFeatures, 2.0);
+  FeatureFrame mock_prediction(kNumFeatures, 2.0);
   auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
   auto mock_spectrogram_predictor =
       absl::make_unique<MockSpectrogramPredictor>();
@@ -157,12 +215,12 @@ TEST(PacketLossHandlerTest,
 // to 0.
 TEST(PacketLossHandlerTest, SetFeaturesResetsConsecutiveLostSamples) {
   static constexpr int kNumSamplesToRequest = 100;
-  std::vector<float> mock_features(kNumFeatures, 1.0);
+  FeatureFrame mock_features(kNumFeatures, 1.0);
   auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
   auto mock_spectrogram_predictor =
       absl::make_unique<MockSpectrogramPredictor>();
 
-  EXPECT_CALL(*mock_noise_estimator, Update(mock_features))
+  EXPECT_CALL(*mock_noise_estimator, Update(ElementsAreArray(mock_features)))
       .WillOnce(Return(true));
 
   auto packet_loss_handler_peer = absl::make_unique<PacketLossHandlerPeer>(
@@ -174,6 +232,27 @@ TEST(PacketLossHandlerTest, SetFeaturesResetsConsecutiveLostSamples) {
   EXPECT_FALSE(packet_loss_handler_peer->is_comfort_noise());
 }
 
+// Resets a PacketLossHandler that switched to comfort noise and ensures that
+// it forgets the lost samples and resets its noise estimator and predictor.
+TEST(PacketLossHandlerTest, ResetForgetsTheLostSamples) {
+  auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
+  auto mock_spectrogram_predictor =
+      absl::make_unique<MockSpectrogramPredictor>();
+  EXPECT_CALL(*mock_noise_estimator, NoiseEstimate())
+      .WillRepeatedly(Return(FeatureFrame(kNumFeatures)));
+  EXPECT_CALL(*mock_noise_estimator, Reset()).Times(1);
+  EXPECT_CALL(*mock_spectrogram_predictor, Reset()).Times(1);
+
+  auto packet_loss_handler_peer = absl::make_unique<PacketLossHandlerPeer>(
+      std::move(mock_noise_estimator), std::move(mock_spectrogram_predictor));
+  ASSERT_TRUE(
+      packet_loss_handler_peer->EstimateSilenceFeatures(100).has_value());
+  ASSERT_TRUE(packet_loss_handler_peer->is_comfort_noise());
+  packet_loss_handler_peer->Reset();
+  EXPECT_EQ(0, packet_loss_handler_peer->FetchConsecutiveLostSamples());
+  EXPECT_FALSE(packet_loss_handler_peer->is_comfort_noise());
+}
+
 // Calls EstimateLostFeatures with out of bound values for |num_samples| and
 // ensures that a nullopt is returned.
 TEST(PacketLossHandlerTest, EstimateLostFeaturesWithInvalidNumSamples) {
@@ -205,8 +284,8 @@ TEST(PacketLossHandlerTest, EstimateLostFeaturesWithInvalidNumSamples) {
 TEST(PacketLossHandlerTest,
      EstimateLostFeaturesReturnsNoiseAfterTooManyLostSamples) {
   static const int kNumSamplesToRequest = 100;
-  std::vector<float> mock_prediction(kNumFeatures, 2.0);
-  std::vector<float> mock_noise(kNumFeatures, 3.0);
+  FeatureFrame mock_prediction(kNumFeatures, 2.0);
+  FeatureFrame mock_noise(kNumFeatures, 3.0);
   auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
   auto mock_spectrogram_predictor =
       absl::make_unique<MockSpectrogramPredictor>();
@@ -214,7 +293,8 @@ TEST(PacketLossHandlerTest,
       // The floor of the result is wanted, so integer division is fine.
       .Times(kMaxConsecutiveLostSamples / kNumSamplesToRequest)
       .WillRepeatedly(Return(mock_prediction));
-  EXPECT_CALL(*mock_spectrogram_predictor, FeedFrame(mock_noise)).Times(1);
+  EXPECT_CALL(*mock_spectrogram_predictor,
+              FeedFrame(ElementsAreArray(mock_noise))).Times(1);
   EXPECT_CALL(*mock_noise_estimator, NoiseEstimate())
       .WillOnce(Return(mock_noise));
 
@@ -244,9 +324,9 @@ TEST(PacketLossHandlerTest,
 TEST(PacketLossHandlerTest,
      SetReceivedFeaturesReturnsHandlerFromNoisePredictionState) {
   static const int kNumSamplesToRequest = 100;
-  std::vector<float> mock_features(kNumFeatures, 1.0);
-  std::vector<float> mock_prediction(kNumFeatures, 2.0);
-  std::vector<float> mock_noise(kNumFeatures, 3.0);
+  FeatureFrame mock_features(kNumFeatures, 1.0);
+  FeatureFrame mock_prediction(kNumFeatures, 2.0);
+  FeatureFrame mock_noise(kNumFeatures, 3.0);
   auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
   auto mock_spectrogram_predictor =
       absl::make_unique<MockSpectrogramPredictor>();
@@ -254,9 +334,11 @@ TEST(PacketLossHandlerTest,
       // The floor of the result is wanted, so integer division is fine.
       .Times(kMaxConsecutiveLostSamples / kNumSamplesToRequest + 1)
       .WillRepeatedly(Return(mock_prediction));
-  EXPECT_CALL(*mock_spectrogram_predictor, FeedFrame(mock_noise)).Times(1);
-  EXPECT_CALL(*mock_spectrogram_predictor, FeedFrame(mock_features)).Times(1);
-  EXPECT_CALL(*mock_noise_estimator, Update(mock_features))
+  EXPECT_CALL(*mock_spectrogram_predictor,
+              FeedFrame(ElementsAreArray(mock_noise))).Times(1);
+  EXPECT_CALL(*mock_spectrogram_predictor,
+              FeedFrame(ElementsAreArray(mock_features))).Times(1);
+  EXPECT_CALL(*mock_noise_estimator, Update(ElementsAreArray(mock_features)))
       .WillOnce(Return(true));
   EXPECT_CALL(*mock_noise_estimator, NoiseEstimate())
       .WillOnce(Return(mock_noise));
@@ -285,5 +367,166 @@ TEST(PacketLossHandlerTest,
   EXPECT_FALSE(packet_loss_handler_peer->is_comfort_noise());
 }
 
+// Peeks at the features of lost samples before and after the maximum number of
+// lost samples and ensures they match the estimates without counting as lost.
+TEST(PacketLossHandlerTest, PeekLostFeaturesDoesNotCountLostSamples) {
+  FeatureFrame mock_prediction(kNumFeatures, 2.0);
+  FeatureFrame mock_noise(kNumFeatures, 3.0);
+  auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
+  auto mock_spectrogram_predictor =
+      absl::make_unique<MockSpectrogramPredictor>();
+  EXPECT_CALL(*mock_spectrogram_predictor, PredictFrame())
+      .WillRepeatedly(Return(mock_prediction));
+  EXPECT_CALL(*mock_spectrogram_predictor, FeedFrame(testing::_)).Times(0);
+  EXPECT_CALL(*mock_noise_estimator, NoiseEstimate())
+      .WillOnce(Return(mock_noise));
+
+  auto packet_loss_handler_peer = absl::make_unique<PacketLossHandlerPeer>(
+      std::move(mock_noise_estimator), std::move(mock_spectrogram_predictor));
+  EXPECT_FALSE(packet_loss_handler_peer->PeekLostFeatures(0).has_value());
+  const auto prediction = packet_loss_handler_peer->PeekLostFeatures(100);
+  ASSERT_TRUE(prediction.has_value());
+  EXPECT_EQ(prediction.value(), mock_prediction);
+  const auto noise = packet_loss_handler_peer->PeekLostFeatures(
+      kMaxConsecutiveLostSamples + 1);
+  ASSERT_TRUE(noise.has_value());
+  EXPECT_EQ(noise.value(), mock_noise);
+  EXPECT_EQ(packet_loss_handler_peer->FetchConsecutiveLostSamples(), 0);
+  EXPECT_FALSE(packet_loss_handler_peer->is_comfort_noise());
+}
+
+// Calls EstimateSilenceFeatures on a PacketLossHandler and ensures that noise
+// is returned right away and fed back into |spectrogram_predictor_|, and that
+// concealment keeps returning noise afterwards until features are received.
+TEST(PacketLossHandlerTest, EstimateSilenceFeaturesReturnsNoiseRightAway) {
+  static const int kNumSamplesToRequest = 100;
+  FeatureFrame mock_features(kNumFeatures, 1.0);
+  FeatureFrame mock_prediction(kNumFeatures, 2.0);
+  FeatureFrame mock_noise(kNumFeatures, 3.0);
+  auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
+  auto mock_spectrogram_predictor =
+      absl::make_unique<MockSpectrogramPredictor>();
+  EXPECT_CALL(*mock_spectrogram_predictor, PredictFrame())
+      .WillOnce(Return(mock_prediction));
+  EXPECT_CALL(*mock_spectrogram_predictor,
+              FeedFrame(ElementsAreArray(mock_noise))).Times(2);
+  EXPECT_CALL(*mock_spectrogram_predictor,
+              FeedFrame(ElementsAreArray(mock_features))).Times(1);
+  EXPECT_CALL(*mock_noise_estimator, Update(ElementsAreArray(mock_features)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_noise_estimator, NoiseEstimate())
+      .Times(2)
+      .WillRepeatedly(Return(mock_noise));
+
+  auto packet_loss_handler_peer = absl::make_unique<PacketLossHandlerPeer>(
+      std::move(mock_noise_estimator), std::move(mock_spectrogram_predictor));
+  EXPECT_FALSE(packet_loss_handler_peer->EstimateSilenceFeatures(0));
+  auto estimate =
+      packet_loss_handler_peer->EstimateSilenceFeatures(kNumSamplesToRequest);
+  ASSERT_TRUE(estimate.has_value());
+  EXPECT_EQ(mock_noise, estimate.value());
+  EXPECT_TRUE(packet_loss_handler_peer->is_comfort_noise());
+
+  estimate =
+      packet_loss_handler_peer->EstimateLostFeatures(kNumSamplesToRequest);
+  ASSERT_TRUE(estimate.has_value());
+  EXPECT_EQ(mock_noise, estimate.value());
+  EXPECT_TRUE(packet_loss_handler_peer->is_comfort_noise());
+
+  EXPECT_TRUE(packet_loss_handler_peer->SetReceivedFeatures(mock_features));
+  estimate =
+      packet_loss_handler_peer->EstimateLostFeatures(kNumSamplesToRequest);
+  ASSERT_TRUE(estimate.has_value());
+  EXPECT_EQ(mock_prediction, estimate.value());
+  EXPECT_FALSE(packet_loss_handler_peer->is_comfort_noise());
+}
+
+// Supplies the features of a packet after two lost ones and ensures the lost
+// features are interpolated towards them without running the predictor, past
+// the maximum number of lost samples and without switching to comfort noise,
+// and that the predictor takes over once more than those are lost.
+TEST(PacketLossHandlerTest, FutureFeaturesAreInterpolated) {
+  const int kNumSamplesToRequest = kMaxConsecutiveLostSamples;
+  FeatureFrame mock_features(kNumFeatures, 1.0);
+  FeatureFrame mock_future_features(kNumFeatures, 4.0);
+  FeatureFrame first_interpolated(kNumFeatures, 2.0);
+  FeatureFrame second_interpolated(kNumFeatures, 3.0);
+  FeatureFrame mock_noise(kNumFeatures, 5.0);
+  auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
+  auto mock_spectrogram_predictor =
+      absl::make_unique<MockSpectrogramPredictor>();
+  EXPECT_CALL(*mock_noise_estimator, Update(ElementsAreArray(mock_features)))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*mock_spectrogram_predictor,
+              FeedFrame(ElementsAreArray(mock_features)));
+  {
+    testing::InSequence sequence;
+    EXPECT_CALL(*mock_spectrogram_predictor,
+                FeedFrame(ElementsAreArray(first_interpolated)));
+    EXPECT_CALL(*mock_spectrogram_predictor,
+                FeedFrame(ElementsAreArray(second_interpolated)));
+    EXPECT_CALL(*mock_spectrogram_predictor,
+                FeedFrame(ElementsAreArray(mock_noise)));
+  }
+  EXPECT_CALL(*mock_spectrogram_predictor, PredictFrame()).Times(0);
+  EXPECT_CALL(*mock_noise_estimator, NoiseEstimate())
+      .WillOnce(Return(mock_noise));
+
+  auto packet_loss_handler_peer = absl::make_unique<PacketLossHandlerPeer>(
+      std::move(mock_noise_estimator), std::move(mock_spectrogram_predictor));
+  // Nothing was received to interpolate from yet.
+  EXPECT_FALSE(packet_loss_handler_peer->SetFutureFeatures(
+      mock_future_features, 2 * kNumSamplesToRequest));
+  ASSERT_TRUE(packet_loss_handler_peer->SetReceivedFeatures(mock_features));
+  EXPECT_FALSE(packet_loss_handler_peer->SetFutureFeatures(
+      mock_future_features, 0));
+  EXPECT_FALSE(packet_loss_handler_peer->SetFutureFeatures(
+      FeatureFrame(kNumFeatures + 1), 2 * kNumSamplesToRequest));
+  ASSERT_TRUE(packet_loss_handler_peer->SetFutureFeatures(
+      mock_future_features, 2 * kNumSamplesToRequest));
+
+  const auto peeked =
+      packet_loss_handler_peer->PeekLostFeatures(kNumSamplesToRequest);
+  ASSERT_TRUE(peeked.has_value());
+  EXPECT_EQ(peeked.value(), first_interpolated);
+  for (const FeatureFrame& expected :
+       {first_interpolated, second_interpolated}) {
+    const auto estimate =
+        packet_loss_handler_peer->EstimateLostFeatures(kNumSamplesToRequest);
+    ASSERT_TRUE(estimate.has_value());
+    EXPECT_EQ(estimate.value(), expected);
+    EXPECT_FALSE(packet_loss_handler_peer->is_comfort_noise());
+  }
+
+  // The future packet did not come after all.
+  const auto estimate =
+      packet_loss_handler_peer->EstimateLostFeatures(kNumSamplesToRequest);
+  ASSERT_TRUE(estimate.has_value());
+  EXPECT_EQ(estimate.value(), mock_noise);
+  EXPECT_TRUE(packet_loss_handler_peer->is_comfort_noise());
+  // Neither is there anything to interpolate from in comfort noise.
+  EXPECT_FALSE(packet_loss_handler_peer->SetFutureFeatures(
+      mock_future_features, kNumSamplesToRequest));
+}
+
+// Ensures IsSimilarNoise asks |noise_estimator_| without updating it.
+TEST(PacketLossHandlerTest, IsSimilarNoiseChecksNoiseEstimator) {
+  FeatureFrame mock_features(kNumFeatures, 1.0);
+  auto mock_noise_estimator = absl::make_unique<MockNoiseEstimator>();
+  EXPECT_CALL(*mock_noise_estimator,
+              IsSimilarNoise(ElementsAreArray(mock_features)))
+      .WillOnce(Return(true))
+      .WillOnce(Return(absl::nullopt));
+  EXPECT_CALL(*mock_noise_estimator, Update(testing::_)).Times(0);
+
+  auto packet_loss_handler_peer = absl::make_unique<PacketLossHandlerPeer>(
+      std::move(mock_noise_estimator),
+      absl::make_unique<MockSpectrogramPredictor>());
+  EXPECT_EQ(packet_loss_handler_peer->IsSimilarNoise(mock_features), true);
+  EXPECT_FALSE(
+      packet_loss_handler_peer->IsSimilarNoise(mock_features).has_value());
+  EXPECT_FALSE(packet_loss_handler_peer->is_comfort_noise());
+}
+
 }  // namespace codec
 }  // namespace chromemedia
@@ -24,6 +24,7 @@
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "gtest/gtest.h"
+#include "testing/quantized_bits_string.h"
 
 namespace chromemedia {
 namespace codec {
@@ -80,7 +81,8 @@ TEST_F(PacketTest, UnpackVariableHeader) {
 
   Packet<kNumQuantizedBitsTest, kNumHeaderBitsTest> packet;
   const auto unpacked_or = packet.UnpackPacket(absl::MakeConstSpan(encoded));
-  EXPECT_EQ(expected_bits.to_string(), unpacked_or.value());
+  EXPECT_EQ(expected_bits.to_string(),
+            QuantizedBitsToString(unpacked_or.value()));
 }
 
 TEST_F(PacketTest, UnpackNoTrailingZeros) {
@@ -93,7 +95,8 @@ TEST_F(PacketTest, UnpackNoTrailingZeros) {
 
   Packet<kNumQuantizedBitsTest, kNumHeaderBitsTest> packet;
   const auto unpacked_or = packet.UnpackPacket(absl::MakeConstSpan(encoded));
-  EXPECT_EQ(expected_bits.to_string(), unpacked_or.value());
+  EXPECT_EQ(expected_bits.to_string(),
+            QuantizedBitsToString(unpacked_or.value()));
 }
 
 TEST_F(PacketTest, UnpackBigHeader) {
@@ -109,7 +112,8 @@ TEST_F(PacketTest, UnpackBigHeader) {
 
   Packet<kNumQuantizedBitsTest, kNumHeaderBitsTest> packet;
   const auto unpacked_or = packet.UnpackPacket(absl::MakeConstSpan(encoded));
-  EXPECT_EQ(expected_bits.to_string(), unpacked_or.value());
+  EXPECT_EQ(expected_bits.to_string(),
+            QuantizedBitsToString(unpacked_or.value()));
 }
 
 TEST_F(PacketTest, UnpackQuantizedBitsAllOnes) {
@@ -118,8 +122,9 @@ TEST_F(PacketTest, UnpackQuantizedBitsAllOnes) {
 
   Packet<kNumQuantizedBits, kNumHeaderBits> packet;
   const auto unpacked_or = packet.UnpackPacket(absl::MakeConstSpan(encoded));
-  EXPECT_TRUE(DoesPacketContainQuantized(encoded, unpacked_or.value(),
-                                         kNumHeaderBits, kNumQuantizedBits));
+  EXPECT_TRUE(DoesPacketContainQuantized(
+      encoded, QuantizedBitsToString(unpacked_or.value()), kNumHeaderBits,
+      kNumQuantizedBits));
 }
 
 TEST_F(PacketTest, UnpackQuantizedBitsAlternatingBytesOfOnesAndZeros) {
@@ -135,8 +140,9 @@ TEST_F(PacketTest, UnpackQuantizedBitsAlternatingBytesOfOnesAndZeros) {
 
   Packet<kNumQuantizedBits, kNumHeaderBits> packet;
   const auto unpacked_or = packet.UnpackPacket(absl::MakeConstSpan(encoded));
-  EXPECT_TRUE(DoesPacketContainQuantized(encoded, unpacked_or.value(),
-                                         kNumHeaderBits, kNumQuantizedBits));
+  EXPECT_TRUE(DoesPacketContainQuantized(
+      encoded, QuantizedBitsToString(unpacked_or.value()), kNumHeaderBits,
+      kNumQuantizedBits));
 }
 
 TEST_F(PacketTest, UnpackQuantizedBitsAlternatingOnesAndZeros) {
@@ -145,8 +151,43 @@ TEST_F(PacketTest, UnpackQuantizedBitsAlternatingOnesAndZeros) {
 
   Packet<kNumQuantizedBits, kNumHeaderBits> packet;
   const auto unpacked_or = packet.UnpackPacket(absl::MakeConstSpan(encoded));
-  EXPECT_TRUE(DoesPacketContainQuantized(encoded, unpacked_or.value(),
-                                         kNumHeaderBits, kNumQuantizedBits));
+  EXPECT_TRUE(DoesPacketContainQuantized(
+      encoded, QuantizedBitsToString(unpacked_or.value()), kNumHeaderBits,
+      kNumQuantizedBits));
+}
+
+TEST_F(PacketTest, PackAndUnpackRoundTrip) {
+  constexpr int kNumHeaderBitsTest = 5;
+  QuantizedBits quantized;
+  for (int i = 0; i < kNumQuantizedBits / 13; ++i) {
+    quantized.Append(0x1a2b + 97 * i, 13);
+  }
+  quantized.Resize(kNumQuantizedBits);
+
+  Packet<kNumQuantizedBits, kNumHeaderBitsTest> packet;
+  const auto unpacked_or =
+      packet.UnpackPacket(absl::MakeConstSpan(packet.PackQuantized(quantized)));
+  ASSERT_TRUE(unpacked_or.has_value());
+  EXPECT_EQ(unpacked_or.value(), quantized);
+}
+
+TEST_F(PacketTest, PackAndUnpackHeader) {
+  constexpr int kNumHeaderBitsTest = 70;
+  QuantizedBits header;
+  header.Append(0x123456789abcdef0, 64);
+  header.Append(0b101010, 6);
+  QuantizedBits quantized(kNumQuantizedBits);
+
+  Packet<kNumQuantizedBits, kNumHeaderBitsTest> packet(header);
+  const std::vector<uint8_t> encoded = packet.PackQuantized(quantized);
+  EXPECT_EQ(encoded[0], 0x12);
+  EXPECT_EQ(encoded[7], 0xf0);
+  EXPECT_EQ(encoded[8], 0b10101000);
+  EXPECT_EQ(
+      (Packet<kNumQuantizedBits, kNumHeaderBitsTest>::UnpackHeader(encoded)),
+      header);
+  EXPECT_EQ(packet.UnpackPacket(absl::MakeConstSpan(encoded)).value(),
+            quantized);
 }
 
 TEST_F(PacketTest, InvalidPacketSize) {
@@ -157,6 +198,50 @@ TEST_F(PacketTest, InvalidPacketSize) {
   EXPECT_FALSE(unpacked_or.has_value());
 }
 
+TEST_F(PacketTest, UnpackPacketsReportsEveryPacket) {
+  Packet<kNumQuantizedBits, kNumHeaderBits> packet;
+  std::vector<std::vector<uint8_t>> encoded;
+  std::vector<QuantizedBits> expected;
+  for (int i = 0; i < 3; ++i) {
+    QuantizedBits quantized;
+    quantized.Append(0x1234567 * (i + 1), 32);
+    quantized.Resize(kNumQuantizedBits);
+    encoded.push_back(packet.PackQuantized(quantized));
+    expected.push_back(quantized);
+  }
+  const std::vector<uint8_t> truncated(kPacketSize - 1);
+  const std::vector<absl::Span<const uint8_t>> packets = {
+      encoded[0], {}, encoded[1], truncated, encoded[2]};
+
+  std::vector<QuantizedBits> unpacked(packets.size());
+  std::vector<PacketInterface::UnpackStatus> statuses(packets.size());
+  EXPECT_EQ(packet.UnpackPackets(packets, absl::MakeSpan(unpacked),
+                                 absl::MakeSpan(statuses)),
+            3);
+  EXPECT_EQ(statuses, std::vector<PacketInterface::UnpackStatus>(
+                          {PacketInterface::UnpackStatus::kUnpacked,
+                           PacketInterface::UnpackStatus::kEmpty,
+                           PacketInterface::UnpackStatus::kUnpacked,
+                           PacketInterface::UnpackStatus::kInvalid,
+                           PacketInterface::UnpackStatus::kUnpacked}));
+  EXPECT_EQ(unpacked[0], expected[0]);
+  EXPECT_EQ(unpacked[2], expected[1]);
+  EXPECT_EQ(unpacked[4], expected[2]);
+  EXPECT_EQ(unpacked[1], QuantizedBits());
+  EXPECT_EQ(unpacked[3], QuantizedBits());
+
+  // The interface unpacks the same, one packet at a time.
+  std::vector<QuantizedBits> unpacked_one_by_one(packets.size());
+  std::vector<PacketInterface::UnpackStatus> statuses_one_by_one(
+      packets.size());
+  EXPECT_EQ(packet.PacketInterface::UnpackPackets(
+                packets, absl::MakeSpan(unpacked_one_by_one),
+                absl::MakeSpan(statuses_one_by_one)),
+            3);
+  EXPECT_EQ(unpacked_one_by_one, unpacked);
+  EXPECT_EQ(statuses_one_by_one, statuses);
+}
+
 TEST_F(PacketTest, PackVariableHeader) {
   std::bitset<kNumQuantizedBits> quantized(0);
   quantized.flip();
@@ -164,7 +249,7 @@ TEST_F(PacketTest, PackVariableHeader) {
 
   Packet<kNumQuantizedBits, kNumHeaderBitsTest> packet;
   const std::vector<uint8_t> encoded =
-      packet.PackQuantized(quantized.to_string());
+      packet.PackQuantized(QuantizedBitsFromString(quantized.to_string()));
   EXPECT_EQ(encoded.size(),
             ExpectedPacketSize(kNumQuantizedBits, kNumHeaderBitsTest));
   EXPECT_TRUE(DoesPacketContainQuantized(
@@ -177,7 +262,7 @@ TEST_F(PacketTest, PackQuantizedBitsAllOnes) {
 
   Packet<kNumQuantizedBits, kNumHeaderBits> packet;
   const std::vector<uint8_t> encoded =
-      packet.PackQuantized(quantized.to_string());
+      packet.PackQuantized(QuantizedBitsFromString(quantized.to_string()));
   EXPECT_EQ(encoded.size(), kPacketSize);
   EXPECT_TRUE(DoesPacketContainQuantized(encoded, quantized.to_string(),
                                          kNumHeaderBits, kNumQuantizedBits));
@@ -192,7 +277,7 @@ TEST_F(PacketTest, PackQuantizedBitsAlternatingOnesAndZeros) {
 
   Packet<kNumQuantizedBits, kNumHeaderBits> packet;
   const std::vector<uint8_t> encoded =
-      packet.PackQuantized(quantized.to_string());
+      packet.PackQuantized(QuantizedBitsFromString(quantized.to_string()));
   EXPECT_EQ(encoded.size(), kPacketSize);
   EXPECT_TRUE(DoesPacketContainQuantized(encoded, quantized.to_string(),
                                          kNumHeaderBits, kNumQuantizedBits));
@@ -213,7 +298,7 @@ TEST_F(PacketTest, PackQuantizedBitsAlternateBytesOfOnesAndZeros) {
 
   Packet<kNumQuantizedBits, kNumHeaderBits> packet;
   const std::vector<uint8_t> encoded =
-      packet.PackQuantized(quantized.to_string());
+      packet.PackQuantized(QuantizedBitsFromString(quantized.to_string()));
   EXPECT_EQ(encoded.size(), kPacketSize);
   EXPECT_TRUE(DoesPacketContainQuantized(encoded, quantized.to_string(),
                                          kNumHeaderBits, kNumQuantizedBits));
@@ -236,7 +321,7 @@ TEST_F(PacketTest, PackBigHeader) {
 
   Packet<kNumQuantizedBits, kNumHeaderBitsTest> packet;
   const std::vector<uint8_t> encoded =
-      packet.PackQuantized(quantized.to_string());
+      packet.PackQuantized(QuantizedBitsFromString(quantized.to_string()));
   EXPECT_EQ(encoded.size(),
             ExpectedPacketSize(kNumQuantizedBits, kNumHeaderBitsTest));
   EXPECT_TRUE(DoesPacketContainQuantized(
@@ -0,0 +1,53 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel_load.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+namespace chromemedia {
+namespace codec {
+
+bool LoadInParallel(const std::vector<std::function<bool()>>& functions) {
+  const int num_functions = functions.size();
+  const int num_threads =
+      std::min({num_functions, kMaxNumLoadingThreads,
+                std::max(1, static_cast<int>(
+                                std::thread::hardware_concurrency()))});
+  std::atomic<int> next_function(0);
+  std::atomic<bool> all_succeeded(true);
+  const auto run_functions = [&]() {
+    for (int i = next_function++; i < num_functions; i = next_function++) {
+      if (!functions[i]()) {
+        all_succeeded = false;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int tid = 1; tid < num_threads; ++tid) {
+    threads.emplace_back(run_functions);
+  }
+  run_functions();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return all_succeeded;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
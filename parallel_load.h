@@ -0,0 +1,41 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_PARALLEL_LOAD_H_
+#define LYRA_CODEC_PARALLEL_LOAD_H_
+
+#include <functional>
+#include <vector>
+
+namespace chromemedia {
+namespace codec {
+
+inline constexpr int kMaxNumLoadingThreads = 4;
+
+// Calls every function of |functions| and returns whether all of them
+// returned true. The functions run concurrently on up to
+// |kMaxNumLoadingThreads| threads, one of which is the calling thread, and
+// must thus be independent of each other. Meant for reading, decompressing
+// and validating the assets of a model, one layer or array per function.
+// Every function is called even if another one failed, so that all errors
+// are logged.
+bool LoadInParallel(const std::vector<std::function<bool()>>& functions);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_PARALLEL_LOAD_H_
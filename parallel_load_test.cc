@@ -0,0 +1,77 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel_load.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(ParallelLoadTest, EmptyListSucceeds) { EXPECT_TRUE(LoadInParallel({})); }
+
+TEST(ParallelLoadTest, CallsEveryFunctionOnce) {
+  std::vector<std::atomic<int>> num_calls(10);
+  std::vector<std::function<bool()>> functions;
+  for (auto& calls : num_calls) {
+    functions.push_back([&calls]() {
+      ++calls;
+      return true;
+    });
+  }
+  EXPECT_TRUE(LoadInParallel(functions));
+  for (const auto& calls : num_calls) {
+    EXPECT_EQ(calls, 1);
+  }
+}
+
+TEST(ParallelLoadTest, FailureStillCallsTheOthers) {
+  std::atomic<int> num_calls(0);
+  std::vector<std::function<bool()>> functions;
+  for (int i = 0; i < 6; ++i) {
+    functions.push_back([&num_calls, i]() {
+      ++num_calls;
+      return i != 2;
+    });
+  }
+  EXPECT_FALSE(LoadInParallel(functions));
+  EXPECT_EQ(num_calls, 6);
+}
+
+TEST(ParallelLoadTest, RunsConcurrently) {
+  if (std::thread::hardware_concurrency() < 2) {
+    GTEST_SKIP() << "Needs at least two hardware threads.";
+  }
+  // Each of the two functions only returns once the other one started, which
+  // would never happen if they ran one after the other.
+  std::atomic<int> num_started(0);
+  const auto wait_for_other = [&num_started]() {
+    ++num_started;
+    while (num_started < 2) {
+      std::this_thread::yield();
+    }
+    return true;
+  };
+  EXPECT_TRUE(LoadInParallel({wait_for_other, wait_for_other}));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
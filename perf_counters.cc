@@ -0,0 +1,189 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+std::string FormatCount(int64_t count) {
+  return count < 0 ? "null" : absl::StrCat(count);
+}
+
+// Returns |a| plus |sign| times |b|, or -1 if either is unavailable. Scaled
+// counts of multiplexed events can shrink between reads, which is clamped.
+int64_t AddCounts(int64_t a, int64_t b, int sign) {
+  return (a < 0 || b < 0) ? -1 : std::max<int64_t>(a + sign * b, 0);
+}
+
+#if defined(__linux__)
+
+// Opens |config| of |type| for the calling thread in the group of
+// |group_fd|, or as a disabled group leader if it is -1.
+int OpenEvent(uint32_t type, uint64_t config, int group_fd) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = group_fd == -1 ? 1 : 0;
+  // Counting the kernel needs privileges and is not what the codec spends.
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, /*pid=*/0,
+                                  /*cpu=*/-1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+#endif  // defined(__linux__)
+
+}  // namespace
+
+double PerfCounts::ipc() const {
+  if (cycles <= 0 || instructions < 0) {
+    return 0.0;
+  }
+  return static_cast<double>(instructions) / cycles;
+}
+
+PerfCounts& PerfCounts::operator+=(const PerfCounts& other) {
+  cycles = AddCounts(cycles, other.cycles, 1);
+  instructions = AddCounts(instructions, other.instructions, 1);
+  branch_misses = AddCounts(branch_misses, other.branch_misses, 1);
+  llc_misses = AddCounts(llc_misses, other.llc_misses, 1);
+  return *this;
+}
+
+PerfCounts PerfCounts::operator-(const PerfCounts& other) const {
+  return {AddCounts(cycles, other.cycles, -1),
+          AddCounts(instructions, other.instructions, -1),
+          AddCounts(branch_misses, other.branch_misses, -1),
+          AddCounts(llc_misses, other.llc_misses, -1)};
+}
+
+std::string FormatPerfCountsJson(const PerfCounts& counts) {
+  return absl::StrFormat(
+      "{\"cycles\": %s, \"instructions\": %s, \"ipc\": %.3f, "
+      "\"branch_misses\": %s, \"llc_misses\": %s, \"llc_miss_bytes\": %s}",
+      FormatCount(counts.cycles), FormatCount(counts.instructions),
+      counts.ipc(), FormatCount(counts.branch_misses),
+      FormatCount(counts.llc_misses), FormatCount(counts.llc_miss_bytes()));
+}
+
+std::string FormatPerfCounts(const PerfCounts& counts) {
+  return absl::StrFormat(
+      "cycles=%s instructions=%s ipc=%.3f branch_misses=%s llc_misses=%s "
+      "llc_miss_bytes=%s",
+      FormatCount(counts.cycles), FormatCount(counts.instructions),
+      counts.ipc(), FormatCount(counts.branch_misses),
+      FormatCount(counts.llc_misses), FormatCount(counts.llc_miss_bytes()));
+}
+
+std::unique_ptr<PerfCounters> PerfCounters::Create() {
+#if defined(__linux__)
+  constexpr uint64_t kLlcReadMisses =
+      PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  std::array<int, kNumEvents> fds;
+  fds[0] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (fds[0] < 0) {
+    LOG(WARNING) << "Could not count hardware events: "
+                 << std::strerror(errno);
+    return nullptr;
+  }
+  fds[1] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, fds[0]);
+  fds[2] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, fds[0]);
+  fds[3] = OpenEvent(PERF_TYPE_HW_CACHE, kLlcReadMisses, fds[0]);
+  if (fds[3] < 0) {
+    // Not every PMU names the last level cache, but most count its misses.
+    fds[3] = OpenEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, fds[0]);
+  }
+  if (ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0) {
+    LOG(WARNING) << "Could not start counting hardware events: "
+                 << std::strerror(errno);
+    for (const int fd : fds) {
+      if (fd >= 0) close(fd);
+    }
+    return nullptr;
+  }
+  return std::unique_ptr<PerfCounters>(new PerfCounters(fds));
+#else
+  LOG(WARNING) << "Hardware events are only counted on Linux.";
+  return nullptr;
+#endif  // defined(__linux__)
+}
+
+PerfCounters::PerfCounters(const std::array<int, kNumEvents>& fds)
+    : fds_(fds) {}
+
+PerfCounters::~PerfCounters() {
+#if defined(__linux__)
+  for (const int fd : fds_) {
+    if (fd >= 0) close(fd);
+  }
+#endif  // defined(__linux__)
+}
+
+PerfCounts PerfCounters::Read() const {
+  PerfCounts counts{-1, -1, -1, -1};
+#if defined(__linux__)
+  // The number of events and the times the group was enabled and running,
+  // followed by the count of each event in the order they were opened.
+  std::array<uint64_t, 3 + kNumEvents> values;
+  const ssize_t size = read(fds_[0], values.data(), sizeof(values));
+  if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)) || values[2] == 0) {
+    return counts;
+  }
+  const double scale = static_cast<double>(values[1]) / values[2];
+  std::array<int64_t*, kNumEvents> fields = {
+      &counts.cycles, &counts.instructions, &counts.branch_misses,
+      &counts.llc_misses};
+  int slot = 3;
+  for (int i = 0; i < kNumEvents; ++i) {
+    if (fds_[i] < 0) {
+      continue;
+    }
+    if (slot >= 3 + static_cast<int>(values[0])) {
+      break;
+    }
+    *fields[i] = static_cast<int64_t>(values[slot++] * scale);
+  }
+#endif  // defined(__linux__)
+  return counts;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_PERF_COUNTERS_H_
+#define LYRA_CODEC_PERF_COUNTERS_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace chromemedia {
+namespace codec {
+
+// Memory traffic is estimated as one cache line per last level cache miss,
+// since there is no portable event for the bandwidth itself.
+inline constexpr int kPerfCacheLineBytes = 64;
+
+// Hardware events counted by |PerfCounters|. An event the CPU or the kernel
+// does not provide is -1.
+struct PerfCounts {
+  int64_t cycles = 0;
+  int64_t instructions = 0;
+  int64_t branch_misses = 0;
+  int64_t llc_misses = 0;
+
+  // Instructions per cycle, or 0 if either is unavailable.
+  double ipc() const;
+
+  // Bytes read from memory as estimated from |llc_misses|, or -1.
+  int64_t llc_miss_bytes() const {
+    return llc_misses < 0 ? -1 : llc_misses * kPerfCacheLineBytes;
+  }
+
+  // Unavailable events stay unavailable.
+  PerfCounts& operator+=(const PerfCounts& other);
+  PerfCounts operator-(const PerfCounts& other) const;
+};
+
+// Returns |counts| as a JSON object, with null for unavailable events.
+std::string FormatPerfCountsJson(const PerfCounts& counts);
+
+// Returns |counts| on one line, suitable for logging.
+std::string FormatPerfCounts(const PerfCounts& counts);
+
+// Counts hardware events of the thread that created it with
+// perf_event_open(2), in user space only. The counters are read in one system
+// call, so reading is cheap next to a call of the codec but not next to a
+// single step of the sampling loop.
+class PerfCounters {
+ public:
+  // Starts counting. Returns nullptr where no event can be counted: off Linux,
+  // when the kernel forbids it through /proc/sys/kernel/perf_event_paranoid or
+  // a seccomp policy, or on virtual machines without a PMU.
+  static std::unique_ptr<PerfCounters> Create();
+
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  // The events counted since |Create|, scaled up if the kernel multiplexed
+  // the counters with other users of the PMU. Returns all -1 if the counters
+  // could not be read.
+  PerfCounts Read() const;
+
+ private:
+  // In the order of the fields of |PerfCounts|.
+  static constexpr int kNumEvents = 4;
+
+  // |fds| holds the descriptor of each event, or -1 if it is not counted.
+  // The first valid one leads the group.
+  explicit PerfCounters(const std::array<int, kNumEvents>& fds);
+
+  const std::array<int, kNumEvents> fds_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_PERF_COUNTERS_H_
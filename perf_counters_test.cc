@@ -0,0 +1,85 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "perf_counters.h"
+
+#include <cstdint>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+TEST(PerfCountsTest, IpcIsInstructionsPerCycle) {
+  EXPECT_DOUBLE_EQ((PerfCounts{1000, 2500, 0, 0}).ipc(), 2.5);
+  EXPECT_DOUBLE_EQ((PerfCounts{0, 2500, 0, 0}).ipc(), 0.0);
+  EXPECT_DOUBLE_EQ((PerfCounts{-1, 2500, 0, 0}).ipc(), 0.0);
+}
+
+TEST(PerfCountsTest, UnavailableEventsStayUnavailable) {
+  PerfCounts counts{10, 20, 30, -1};
+  counts += PerfCounts{1, 2, -1, 4};
+
+  EXPECT_EQ(counts.cycles, 11);
+  EXPECT_EQ(counts.instructions, 22);
+  EXPECT_EQ(counts.branch_misses, -1);
+  EXPECT_EQ(counts.llc_misses, -1);
+  EXPECT_EQ(counts.llc_miss_bytes(), -1);
+}
+
+TEST(PerfCountsTest, DifferenceIsClampedToZero) {
+  const PerfCounts difference =
+      PerfCounts{100, 200, 5, 10} - PerfCounts{40, 250, 5, 2};
+
+  EXPECT_EQ(difference.cycles, 60);
+  EXPECT_EQ(difference.instructions, 0);
+  EXPECT_EQ(difference.branch_misses, 0);
+  EXPECT_EQ(difference.llc_miss_bytes(), 8 * kPerfCacheLineBytes);
+}
+
+TEST(FormatPerfCountsJsonTest, WritesNullForUnavailableEvents) {
+  const std::string json = FormatPerfCountsJson(PerfCounts{100, 150, 3, -1});
+
+  EXPECT_THAT(json, HasSubstr("\"cycles\": 100"));
+  EXPECT_THAT(json, HasSubstr("\"ipc\": 1.500"));
+  EXPECT_THAT(json, HasSubstr("\"branch_misses\": 3"));
+  EXPECT_THAT(json, HasSubstr("\"llc_misses\": null"));
+  EXPECT_THAT(json, HasSubstr("\"llc_miss_bytes\": null"));
+}
+
+TEST(PerfCountersTest, CountsInstructionsOfThisThread) {
+  const auto counters = PerfCounters::Create();
+  if (counters == nullptr) {
+    GTEST_SKIP() << "Hardware events cannot be counted here.";
+  }
+  const PerfCounts before = counters->Read();
+  volatile int64_t sum = 0;
+  for (int i = 0; i < 100000; ++i) {
+    sum += i;
+  }
+  const PerfCounts counts = counters->Read() - before;
+
+  EXPECT_GT(counts.cycles, 0);
+  EXPECT_GT(counts.instructions, 100000);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
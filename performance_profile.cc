@@ -0,0 +1,164 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "performance_profile.h"
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "compute_precision.h"
+#include "google/protobuf/text_format.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.pb.h"
+
+namespace chromemedia {
+namespace codec {
+
+absl::StatusOr<PerformanceProfile> PerformanceProfileFromConfig(
+    const third_party::lyra_codec::LyraConfig& config) {
+  PerformanceProfile profile;
+  if (!config.has_performance_profile()) {
+    return profile;
+  }
+  const third_party::lyra_codec::PerformanceProfile& proto =
+      config.performance_profile();
+  if (proto.has_num_threads()) {
+    if (proto.num_threads() < 1) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "The number of threads has to be positive, but is %d.",
+          proto.num_threads()));
+    }
+    profile.num_threads = proto.num_threads();
+  }
+  if (proto.has_compute_precision()) {
+    const auto precision_or =
+        ComputePrecisionFromName(proto.compute_precision());
+    if (!precision_or.has_value()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Unknown compute precision '%s'.", proto.compute_precision()));
+    }
+    profile.precision = precision_or.value();
+  }
+  if (proto.has_adaptive_barrier()) {
+    profile.use_adaptive_barrier = proto.adaptive_barrier();
+  }
+  if (proto.has_pipelining()) {
+    profile.pipelining = proto.pipelining();
+  }
+  if (proto.has_pool_num_workers()) {
+    if (proto.pool_num_workers() < 1) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "The number of pool workers has to be positive, but is %d.",
+          proto.pool_num_workers()));
+    }
+    profile.pool_num_workers = proto.pool_num_workers();
+  }
+  if (proto.has_use_huge_pages()) {
+    profile.use_huge_pages = proto.use_huge_pages();
+  }
+  if (proto.has_silence_detection()) {
+    profile.silence_detection = proto.silence_detection();
+  }
+  if (proto.has_reduced_quality_real_time_factor() !=
+      proto.has_full_quality_real_time_factor()) {
+    return absl::InvalidArgumentError(
+        "Both real time factors of the quality level have to be set, or "
+        "neither.");
+  }
+  if (proto.has_reduced_quality_real_time_factor()) {
+    if (!(0.0f < proto.full_quality_real_time_factor() &&
+          proto.full_quality_real_time_factor() <
+              proto.reduced_quality_real_time_factor())) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "The real time factors of the quality level have to satisfy 0 < "
+          "full (%f) < reduced (%f).",
+          proto.full_quality_real_time_factor(),
+          proto.reduced_quality_real_time_factor()));
+    }
+    profile.reduced_quality_real_time_factor =
+        proto.reduced_quality_real_time_factor();
+    profile.full_quality_real_time_factor =
+        proto.full_quality_real_time_factor();
+  }
+  if (proto.has_autotune_block_height()) {
+    profile.autotune_block_height = proto.autotune_block_height();
+  }
+  if (proto.has_prefetch_distance()) {
+    if (proto.prefetch_distance() < 0) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "The prefetch distance has to be non-negative, but is %d.",
+          proto.prefetch_distance()));
+    }
+    profile.prefetch_distance = proto.prefetch_distance();
+  }
+  if (proto.has_gru_row_pipelining()) {
+    profile.gru_row_pipelining = proto.gru_row_pipelining();
+  }
+  if (proto.has_park_after_idle_ms()) {
+    if (proto.park_after_idle_ms() < 0) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "The idle time before parking has to be non-negative, but is %d.",
+          proto.park_after_idle_ms()));
+    }
+    profile.park_after_idle_ms = proto.park_after_idle_ms();
+  }
+  return profile;
+}
+
+absl::StatusOr<PerformanceProfile> ReadPerformanceProfile(
+    const ghc::filesystem::path& config_path) {
+  std::ifstream config_stream(config_path.string());
+  if (!config_stream) {
+    return absl::NotFoundError(
+        absl::StrFormat("Could not open %s.", config_path.string()));
+  }
+  const std::string config_string{
+      std::istreambuf_iterator<char>(config_stream),
+      std::istreambuf_iterator<char>()};
+  third_party::lyra_codec::LyraConfig config;
+  // Even though LyraConfig is a subclass of Message, the reinterpreting is
+  // necessary for the mobile proto library.
+  if (!google::protobuf::TextFormat::ParseFromString(
+          config_string,
+          reinterpret_cast<google::protobuf::Message*>(&config))) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Error when parsing %s.", config_path.string()));
+  }
+  return PerformanceProfileFromConfig(config);
+}
+
+std::string PerformanceProfileString(const PerformanceProfile& profile) {
+  const auto bool_name = [](bool value) { return value ? "true" : "false"; };
+  return absl::StrFormat(
+      "num_threads: %d, compute_precision: %s, adaptive_barrier: %s, "
+      "pipelining: %s, pool_num_workers: %d, use_huge_pages: %s, "
+      "silence_detection: %s, reduced_quality_real_time_factor: %g, "
+      "full_quality_real_time_factor: %g, autotune_block_height: %s, "
+      "prefetch_distance: %d, gru_row_pipelining: %s, park_after_idle_ms: %d",
+      profile.num_threads, ComputePrecisionName(profile.precision),
+      bool_name(profile.use_adaptive_barrier), bool_name(profile.pipelining),
+      profile.pool_num_workers, bool_name(profile.use_huge_pages),
+      bool_name(profile.silence_detection),
+      profile.reduced_quality_real_time_factor,
+      profile.full_quality_real_time_factor,
+      bool_name(profile.autotune_block_height), profile.prefetch_distance,
+      bool_name(profile.gru_row_pipelining), profile.park_after_idle_ms);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_PERFORMANCE_PROFILE_H_
+#define LYRA_CODEC_PERFORMANCE_PROFILE_H_
+
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "compute_precision.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.pb.h"
+
+namespace chromemedia {
+namespace codec {
+
+// The knobs of the |PerformanceProfile| message in lyra_config.proto, with
+// the defaults of the code for the fields that are unset there.
+struct PerformanceProfile {
+  int num_threads = 1;
+  ComputePrecision precision = kDefaultComputePrecision;
+  bool use_adaptive_barrier = false;
+  bool pipelining = true;
+  // Workers of a |LyraDecoderPool|, or 0 for one per core.
+  int pool_num_workers = 0;
+  bool use_huge_pages = false;
+  bool silence_detection = false;
+  // Thresholds of the |QualityGovernor| of every decoder. Both are 0 if the
+  // quality level is fixed.
+  float reduced_quality_real_time_factor = 0.0f;
+  float full_quality_real_time_factor = 0.0f;
+  // Whether layers loaded through a |LyraModel| keep the faster of blocks of 4
+  // and 8 rows on this host.
+  bool autotune_block_height = false;
+  // Steps of the sampling loop ahead of which the conditioning is prefetched,
+  // or 0 if it is not.
+  int prefetch_distance = 0;
+  bool gru_row_pipelining = false;
+  // Comfort noise after which a decoder parks its generative model, or 0 if
+  // it never does.
+  int park_after_idle_ms = 0;
+};
+
+// Returns the profile of |config| over the defaults, or an error if a field
+// is out of range.
+absl::StatusOr<PerformanceProfile> PerformanceProfileFromConfig(
+    const third_party::lyra_codec::LyraConfig& config);
+
+// Parses the |LyraConfig| textproto at |config_path|, e.g. the
+// lyra_config.textproto of the weights or a file of the deployment, and
+// returns its profile as |PerformanceProfileFromConfig| does.
+absl::StatusOr<PerformanceProfile> ReadPerformanceProfile(
+    const ghc::filesystem::path& config_path);
+
+// Returns every knob of |profile| on one line, for logging.
+std::string PerformanceProfileString(const PerformanceProfile& profile);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_PERFORMANCE_PROFILE_H_
@@ -0,0 +1,144 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "performance_profile.h"
+
+#include <fstream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "compute_precision.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.pb.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+third_party::lyra_codec::LyraConfig ParseConfig(const std::string& text) {
+  third_party::lyra_codec::LyraConfig config;
+  EXPECT_TRUE(google::protobuf::TextFormat::ParseFromString(
+      text, reinterpret_cast<google::protobuf::Message*>(&config)));
+  return config;
+}
+
+TEST(PerformanceProfileTest, UnsetFieldsKeepDefaults) {
+  const auto profile_or =
+      PerformanceProfileFromConfig(ParseConfig("identifier: 2"));
+  ASSERT_TRUE(profile_or.ok());
+  const PerformanceProfile defaults;
+  EXPECT_EQ(profile_or->num_threads, defaults.num_threads);
+  EXPECT_EQ(profile_or->precision, kDefaultComputePrecision);
+  EXPECT_TRUE(profile_or->pipelining);
+  EXPECT_FALSE(profile_or->silence_detection);
+  EXPECT_EQ(profile_or->reduced_quality_real_time_factor, 0.0f);
+  EXPECT_FALSE(profile_or->autotune_block_height);
+  EXPECT_EQ(profile_or->prefetch_distance, 0);
+  EXPECT_FALSE(profile_or->gru_row_pipelining);
+  EXPECT_EQ(profile_or->park_after_idle_ms, 0);
+}
+
+TEST(PerformanceProfileTest, SetFieldsOverrideDefaults) {
+  const auto profile_or = PerformanceProfileFromConfig(ParseConfig(R"(
+      identifier: 2
+      performance_profile {
+        num_threads: 4
+        compute_precision: "bfloat16"
+        adaptive_barrier: true
+        pipelining: false
+        pool_num_workers: 8
+        use_huge_pages: true
+        silence_detection: true
+        reduced_quality_real_time_factor: 0.9
+        full_quality_real_time_factor: 0.5
+        autotune_block_height: true
+        prefetch_distance: 2
+        gru_row_pipelining: true
+        park_after_idle_ms: 2000
+      })"));
+  ASSERT_TRUE(profile_or.ok());
+  EXPECT_EQ(profile_or->num_threads, 4);
+  EXPECT_EQ(profile_or->precision, ComputePrecision::kBfloat16);
+  EXPECT_TRUE(profile_or->use_adaptive_barrier);
+  EXPECT_FALSE(profile_or->pipelining);
+  EXPECT_EQ(profile_or->pool_num_workers, 8);
+  EXPECT_TRUE(profile_or->use_huge_pages);
+  EXPECT_TRUE(profile_or->silence_detection);
+  EXPECT_FLOAT_EQ(profile_or->reduced_quality_real_time_factor, 0.9f);
+  EXPECT_FLOAT_EQ(profile_or->full_quality_real_time_factor, 0.5f);
+  EXPECT_TRUE(profile_or->autotune_block_height);
+  EXPECT_EQ(profile_or->prefetch_distance, 2);
+  EXPECT_TRUE(profile_or->gru_row_pipelining);
+  EXPECT_EQ(profile_or->park_after_idle_ms, 2000);
+}
+
+TEST(PerformanceProfileTest, InvalidFieldsFail) {
+  for (const absl::string_view text : {
+           "performance_profile { num_threads: 0 }",
+           "performance_profile { compute_precision: \"int4\" }",
+           "performance_profile { pool_num_workers: -1 }",
+           "performance_profile { prefetch_distance: -1 }",
+           "performance_profile { park_after_idle_ms: -1 }",
+           "performance_profile { reduced_quality_real_time_factor: 0.9 }",
+           "performance_profile { reduced_quality_real_time_factor: 0.5 "
+           "full_quality_real_time_factor: 0.9 }",
+       }) {
+    EXPECT_EQ(PerformanceProfileFromConfig(ParseConfig(std::string(text)))
+                  .status()
+                  .code(),
+              absl::StatusCode::kInvalidArgument)
+        << text;
+  }
+}
+
+TEST(PerformanceProfileTest, ReadsTextproto) {
+  const ghc::filesystem::path config_path =
+      ghc::filesystem::temp_directory_path() / "performance_profile.textproto";
+  {
+    std::ofstream config(config_path.string());
+    config << "identifier: 2\nperformance_profile { num_threads: 3 }\n";
+  }
+  const auto profile_or = ReadPerformanceProfile(config_path);
+  ghc::filesystem::remove(config_path);
+  ASSERT_TRUE(profile_or.ok());
+  EXPECT_EQ(profile_or->num_threads, 3);
+
+  EXPECT_EQ(ReadPerformanceProfile(config_path).status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST(PerformanceProfileTest, StringHasEveryKnob) {
+  PerformanceProfile profile;
+  profile.num_threads = 2;
+  profile.precision = ComputePrecision::kFixed16;
+  const std::string text = PerformanceProfileString(profile);
+  EXPECT_THAT(text, HasSubstr("num_threads: 2"));
+  EXPECT_THAT(text, HasSubstr("compute_precision: fixed16"));
+  EXPECT_THAT(text, HasSubstr("pipelining: true"));
+  EXPECT_THAT(text, HasSubstr("full_quality_real_time_factor: 0"));
+  EXPECT_THAT(text, HasSubstr("autotune_block_height: false"));
+  EXPECT_THAT(text, HasSubstr("prefetch_distance: 0"));
+  EXPECT_THAT(text, HasSubstr("gru_row_pipelining: false"));
+  EXPECT_THAT(text, HasSubstr("park_after_idle_ms: 0"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
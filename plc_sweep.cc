@@ -0,0 +1,102 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "architecture_utils.h"
+#include "file_batch.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "plc_sweep_lib.h"
+
+ABSL_FLAG(std::string, encoded_path, "",
+          "A directory of .lyra files, or a .txt file listing one encoded "
+          "file per line, decoded once per configuration and seed.");
+ABSL_FLAG(std::string, packet_loss_rates, "0.01,0.05,0.1,0.2",
+          "Comma separated packet loss rates of the sweep.");
+ABSL_FLAG(std::string, average_burst_lengths, "1,2,4",
+          "Comma separated average burst lengths of the sweep. Every "
+          "combination with the packet loss rates a Gilbert model can "
+          "simulate is run.");
+ABSL_FLAG(int, num_seeds, 3,
+          "The number of loss patterns every file is decoded with per "
+          "configuration.");
+ABSL_FLAG(int, num_workers, 0,
+          "The number of decodes that run concurrently, or one per core if "
+          "0.");
+ABSL_FLAG(int, sample_rate_hz, 16000, "Desired output sample rate in Hertz.");
+ABSL_FLAG(std::string, json_path, "",
+          "If set, the result of every configuration is written to this path "
+          "as JSON.");
+ABSL_FLAG(
+    std::string, model_path, "wavegru",
+    "Path to directory containing model weights and quant files. For mobile "
+    "this is the absolute path, like '/sdcard/wavegru/'. For desktop this is "
+    "the path relative to the binary.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  const ghc::filesystem::path encoded_path(absl::GetFlag(FLAGS_encoded_path));
+  if (encoded_path.empty()) {
+    LOG(ERROR) << "Flag --encoded_path not set.";
+    return -1;
+  }
+  const auto encoded_paths =
+      chromemedia::codec::ListBatchFiles(encoded_path, ".lyra");
+  if (!encoded_paths.has_value()) {
+    return -1;
+  }
+  const auto packet_loss_rates = chromemedia::codec::ParseFloatList(
+      absl::GetFlag(FLAGS_packet_loss_rates));
+  const auto average_burst_lengths = chromemedia::codec::ParseFloatList(
+      absl::GetFlag(FLAGS_average_burst_lengths));
+  if (!packet_loss_rates.has_value() || !average_burst_lengths.has_value()) {
+    return -1;
+  }
+
+  chromemedia::codec::PlcSweepOptions options;
+  options.model_path = chromemedia::codec::GetCompleteArchitecturePath(
+      absl::GetFlag(FLAGS_model_path));
+  options.sample_rate_hz = absl::GetFlag(FLAGS_sample_rate_hz);
+  options.configs = chromemedia::codec::PlcSweepGrid(
+      packet_loss_rates.value(), average_burst_lengths.value());
+  options.num_seeds = absl::GetFlag(FLAGS_num_seeds);
+  options.num_workers = absl::GetFlag(FLAGS_num_workers);
+
+  const auto results =
+      chromemedia::codec::RunPlcSweep(encoded_paths.value(), options);
+  if (!results.has_value()) {
+    LOG(ERROR) << "The sweep failed.";
+    return -1;
+  }
+
+  const std::string json_path = absl::GetFlag(FLAGS_json_path);
+  if (json_path.empty()) {
+    return 0;
+  }
+  std::ofstream json(json_path);
+  json << chromemedia::codec::FormatPlcSweepJson(options, results.value());
+  if (!json) {
+    LOG(ERROR) << "Could not write " << json_path << ".";
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,320 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "plc_sweep_lib.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>  // NOLINT(build/c++11)
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "codec_metrics.h"
+#include "dsp_util.h"
+#include "file_batch.h"
+#include "gilbert_model.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "log_mel_spectrogram_extractor_impl.h"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_model.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Returns the CPU time the calling thread has used so far.
+double ThreadCpuSeconds() {
+  timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return time.tv_sec + 1e-9 * time.tv_nsec;
+}
+
+// Reads the packets of |encoded_path|. Returns a nullopt if it cannot be read
+// or does not hold a whole number of packets.
+absl::optional<std::vector<uint8_t>> ReadPacketStream(
+    const ghc::filesystem::path& encoded_path) {
+  std::ifstream encoded_stream(encoded_path.string(), std::ios_base::binary);
+  if (!encoded_stream.is_open()) {
+    LOG(ERROR) << "Open on file " << encoded_path << " failed.";
+    return absl::nullopt;
+  }
+  std::vector<uint8_t> packet_stream(
+      (std::istreambuf_iterator<char>(encoded_stream)),
+      std::istreambuf_iterator<char>());
+  if (packet_stream.empty() || packet_stream.size() % kPacketSize != 0) {
+    LOG(ERROR) << "The size of " << encoded_path
+               << " is not a positive multiple of the packet size "
+               << kPacketSize << ".";
+    return absl::nullopt;
+  }
+  return packet_stream;
+}
+
+// Decodes |packet_stream| into |decoded|, concealing the packets
+// |gilbert_model| loses, or none if it is null. Adds the packets to |result|.
+bool DecodePackets(const std::vector<uint8_t>& packet_stream,
+                   GilbertModel* gilbert_model, LyraDecoder* decoder,
+                   std::vector<int16_t>* decoded, PlcSweepResult* result) {
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(decoder->sample_rate_hz());
+  decoded->reserve(packet_stream.size() / kPacketSize *
+                   num_samples_per_packet);
+  for (size_t i = 0; i < packet_stream.size(); i += kPacketSize) {
+    const bool received =
+        gilbert_model == nullptr || gilbert_model->IsPacketReceived();
+    absl::optional<std::vector<int16_t>> samples;
+    if (received) {
+      if (!decoder->SetEncodedPacket(
+              absl::MakeConstSpan(&packet_stream[i], kPacketSize))) {
+        LOG(ERROR) << "Unable to set encoded packet starting at byte " << i;
+        return false;
+      }
+      samples = decoder->DecodeSamples(num_samples_per_packet);
+    } else {
+      samples = decoder->DecodePacketLoss(num_samples_per_packet);
+      ++result->num_lost_packets;
+    }
+    if (!samples.has_value()) {
+      LOG(ERROR) << "Unable to decode the packet starting at byte " << i;
+      return false;
+    }
+    decoded->insert(decoded->end(), samples->begin(), samples->end());
+    ++result->num_packets;
+  }
+  return true;
+}
+
+}  // namespace
+
+absl::optional<std::vector<float>> ParseFloatList(const std::string& list) {
+  std::vector<float> values;
+  for (const absl::string_view item :
+       absl::StrSplit(list, ',', absl::SkipWhitespace())) {
+    float value;
+    if (!absl::SimpleAtof(item, &value)) {
+      LOG(ERROR) << "'" << item << "' is not a number.";
+      return absl::nullopt;
+    }
+    values.push_back(value);
+  }
+  return values;
+}
+
+std::vector<PlcSweepConfig> PlcSweepGrid(
+    const std::vector<float>& packet_loss_rates,
+    const std::vector<float>& average_burst_lengths) {
+  std::vector<PlcSweepConfig> configs;
+  for (const float packet_loss_rate : packet_loss_rates) {
+    for (const float average_burst_length : average_burst_lengths) {
+      if (GilbertModel::CreateWithSeed(packet_loss_rate, average_burst_length,
+                                       /*seed=*/0) == nullptr) {
+        LOG(WARNING) << "Skipping packet loss rate " << packet_loss_rate
+                     << " with average burst length " << average_burst_length
+                     << ".";
+        continue;
+      }
+      configs.push_back({packet_loss_rate, average_burst_length});
+    }
+  }
+  return configs;
+}
+
+bool AddLogSpectralDistance(absl::Span<const int16_t> reference,
+                            absl::Span<const int16_t> degraded,
+                            int sample_rate_hz, PlcSweepResult* result) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(sample_rate_hz);
+  auto reference_extractor = LogMelSpectrogramExtractorImpl::Create(
+      sample_rate_hz, kNumFeatures, num_samples_per_hop,
+      2 * num_samples_per_hop);
+  auto degraded_extractor = LogMelSpectrogramExtractorImpl::Create(
+      sample_rate_hz, kNumFeatures, num_samples_per_hop,
+      2 * num_samples_per_hop);
+  if (reference_extractor == nullptr || degraded_extractor == nullptr) {
+    LOG(ERROR) << "Could not create the log mel spectrogram extractors.";
+    return false;
+  }
+  const size_t num_frames =
+      std::min(reference.size(), degraded.size()) / num_samples_per_hop;
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    const auto reference_features = reference_extractor->Extract(
+        reference.subspan(frame * num_samples_per_hop, num_samples_per_hop));
+    const auto degraded_features = degraded_extractor->Extract(
+        degraded.subspan(frame * num_samples_per_hop, num_samples_per_hop));
+    if (!reference_features.has_value() || !degraded_features.has_value()) {
+      LOG(ERROR) << "Could not extract the features of frame " << frame << ".";
+      return false;
+    }
+    const auto distance = LogSpectralDistance(reference_features.value(),
+                                              degraded_features.value());
+    if (!distance.has_value()) {
+      return false;
+    }
+    result->sum_log_spectral_distance += distance.value();
+    ++result->num_frames;
+  }
+  return true;
+}
+
+absl::optional<std::vector<PlcSweepResult>> RunPlcSweep(
+    const std::vector<ghc::filesystem::path>& encoded_paths,
+    const PlcSweepOptions& options) {
+  if (encoded_paths.empty() || options.configs.empty() ||
+      options.num_seeds <= 0) {
+    LOG(ERROR) << "A sweep needs files, configurations and seeds.";
+    return absl::nullopt;
+  }
+  const std::shared_ptr<LyraModel> model =
+      LyraModel::Create(options.model_path);
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not load the model at " << options.model_path;
+    return absl::nullopt;
+  }
+  const int num_files = encoded_paths.size();
+  std::vector<std::vector<uint8_t>> packet_streams;
+  for (const ghc::filesystem::path& encoded_path : encoded_paths) {
+    auto packet_stream = ReadPacketStream(encoded_path);
+    if (!packet_stream.has_value()) {
+      return absl::nullopt;
+    }
+    packet_streams.push_back(std::move(packet_stream.value()));
+  }
+
+  // The loss free decode of every file, which the quality of the decodes with
+  // losses is measured against.
+  std::vector<std::vector<int16_t>> references(num_files);
+  const FileBatchResult reference_result = ProcessFileBatch(
+      num_files, options.num_workers, [&](int i) -> std::optional<double> {
+        auto decoder = LyraDecoder::Create(options.sample_rate_hz,
+                                           kNumChannels, kBitrate, model);
+        if (decoder == nullptr) {
+          LOG(ERROR) << "Could not create lyra decoder.";
+          return std::nullopt;
+        }
+        PlcSweepResult unused;
+        if (!DecodePackets(packet_streams[i], /*gilbert_model=*/nullptr,
+                           decoder.get(), &references[i], &unused)) {
+          LOG(ERROR) << "Unable to decode " << encoded_paths[i];
+          return std::nullopt;
+        }
+        return static_cast<double>(references[i].size()) /
+               options.sample_rate_hz;
+      });
+  if (reference_result.num_failed > 0) {
+    return absl::nullopt;
+  }
+
+  std::vector<PlcSweepResult> results(options.configs.size());
+  for (size_t c = 0; c < options.configs.size(); ++c) {
+    results[c].config = options.configs[c];
+  }
+  std::mutex results_mutex;
+  const int num_runs_per_config = num_files * options.num_seeds;
+  const FileBatchResult sweep_result = ProcessFileBatch(
+      options.configs.size() * num_runs_per_config, options.num_workers,
+      [&](int run) -> std::optional<double> {
+        const int c = run / num_runs_per_config;
+        const int file = run % num_runs_per_config / options.num_seeds;
+        const unsigned int seed = run % options.num_seeds + 1;
+        const PlcSweepConfig& config = options.configs[c];
+
+        PlcSweepResult run_result;
+        run_result.num_runs = 1;
+        std::vector<int16_t> decoded;
+        const double cpu_start = ThreadCpuSeconds();
+        auto decoder = LyraDecoder::Create(options.sample_rate_hz,
+                                           kNumChannels, kBitrate, model);
+        auto gilbert_model = GilbertModel::CreateWithSeed(
+            config.packet_loss_rate, config.average_burst_length, seed);
+        bool ok = decoder != nullptr && gilbert_model != nullptr &&
+                  DecodePackets(packet_streams[file], gilbert_model.get(),
+                                decoder.get(), &decoded, &run_result);
+        run_result.cpu_seconds = ThreadCpuSeconds() - cpu_start;
+        ok = ok && AddLogSpectralDistance(references[file], decoded,
+                                          options.sample_rate_hz, &run_result);
+
+        std::lock_guard<std::mutex> lock(results_mutex);
+        PlcSweepResult& result = results[c];
+        if (!ok) {
+          LOG(ERROR) << "Run with seed " << seed << " of "
+                     << encoded_paths[file] << " failed.";
+          ++result.num_failed;
+          return std::nullopt;
+        }
+        const DecoderMetrics metrics = decoder->metrics();
+        result.num_runs += run_result.num_runs;
+        result.num_packets += run_result.num_packets;
+        result.num_lost_packets += run_result.num_lost_packets;
+        result.num_samples += metrics.num_samples_decoded;
+        result.num_concealed_samples += metrics.num_concealed_samples;
+        result.num_comfort_noise_samples += metrics.num_comfort_noise_samples;
+        result.cpu_seconds += run_result.cpu_seconds;
+        result.sum_log_spectral_distance +=
+            run_result.sum_log_spectral_distance;
+        result.num_frames += run_result.num_frames;
+        return static_cast<double>(decoded.size()) / options.sample_rate_hz;
+      });
+  LogFileBatchResult(sweep_result);
+
+  for (const PlcSweepResult& result : results) {
+    LOG(INFO) << absl::StrFormat(
+        "Loss rate %.3f, burst length %.2f: %.4f CPU seconds per second, "
+        "%.1f%% comfort noise, %.3f dB log-spectral distance, %d failed.",
+        result.config.packet_loss_rate, result.config.average_burst_length,
+        result.cpu_seconds_per_audio_second(options.sample_rate_hz),
+        100.0 * result.comfort_noise_rate(),
+        result.mean_log_spectral_distance(), result.num_failed);
+  }
+  return results;
+}
+
+std::string FormatPlcSweepJson(const PlcSweepOptions& options,
+                               const std::vector<PlcSweepResult>& results) {
+  std::string json = absl::StrFormat(
+      "{\n"
+      "  \"config\": {\"sample_rate_hz\": %d, \"num_seeds\": %d},\n"
+      "  \"results\": [",
+      options.sample_rate_hz, options.num_seeds);
+  for (int i = 0; i < static_cast<int>(results.size()); ++i) {
+    const PlcSweepResult& result = results[i];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"packet_loss_rate\": %.4f, \"average_burst_length\": %.3f, "
+        "\"num_runs\": %d, \"num_failed\": %d, \"num_packets\": %d, "
+        "\"num_lost_packets\": %d, \"cpu_seconds_per_audio_second\": %.6f, "
+        "\"comfort_noise_rate\": %.6f, \"mean_log_spectral_distance\": %.4f}",
+        i == 0 ? "" : ",", result.config.packet_loss_rate,
+        result.config.average_burst_length, result.num_runs, result.num_failed,
+        result.num_packets, result.num_lost_packets,
+        result.cpu_seconds_per_audio_second(options.sample_rate_hz),
+        result.comfort_noise_rate(), result.mean_log_spectral_distance());
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
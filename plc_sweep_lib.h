@@ -0,0 +1,118 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_PLC_SWEEP_LIB_H_
+#define LYRA_CODEC_PLC_SWEEP_LIB_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+
+// One packet loss configuration simulated with a |GilbertModel|.
+struct PlcSweepConfig {
+  float packet_loss_rate = 0.0f;
+  float average_burst_length = 1.0f;
+};
+
+struct PlcSweepOptions {
+  ghc::filesystem::path model_path;
+  int sample_rate_hz = 16000;
+  std::vector<PlcSweepConfig> configs;
+  // Every file is decoded once per configuration and seed, with the losses
+  // drawn from seeds 1 to |num_seeds|.
+  int num_seeds = 3;
+  // Decodes running concurrently on decoders sharing one model, or one per
+  // core if not positive.
+  int num_workers = 0;
+};
+
+// Aggregate of all files and seeds of one configuration.
+struct PlcSweepResult {
+  PlcSweepConfig config;
+  int num_runs = 0;
+  int num_failed = 0;
+  int64_t num_packets = 0;
+  int64_t num_lost_packets = 0;
+  int64_t num_samples = 0;
+  // Samples of lost packets concealed with the generative model and with
+  // comfort noise.
+  int64_t num_concealed_samples = 0;
+  int64_t num_comfort_noise_samples = 0;
+  // CPU time of the decoding threads, without the reference decodes.
+  double cpu_seconds = 0.0;
+  // Sum over all frames of the log-spectral distance in dB between the
+  // decode with losses and the decode of the same file without any.
+  double sum_log_spectral_distance = 0.0;
+  int64_t num_frames = 0;
+
+  double cpu_seconds_per_audio_second(int sample_rate_hz) const {
+    return num_samples > 0 ? cpu_seconds * sample_rate_hz / num_samples : 0.0;
+  }
+  // Fraction of the concealed samples that were comfort noise.
+  double comfort_noise_rate() const {
+    const int64_t num_lost_samples =
+        num_concealed_samples + num_comfort_noise_samples;
+    return num_lost_samples > 0
+               ? static_cast<double>(num_comfort_noise_samples) /
+                     num_lost_samples
+               : 0.0;
+  }
+  double mean_log_spectral_distance() const {
+    return num_frames > 0 ? sum_log_spectral_distance / num_frames : 0.0;
+  }
+};
+
+// Parses a comma separated list of numbers, such as "0.01,0.05,0.1". Returns a
+// nullopt if any of them is not a number.
+absl::optional<std::vector<float>> ParseFloatList(const std::string& list);
+
+// Returns every combination of |packet_loss_rates| and
+// |average_burst_lengths|, skipping those a Gilbert model cannot simulate.
+std::vector<PlcSweepConfig> PlcSweepGrid(
+    const std::vector<float>& packet_loss_rates,
+    const std::vector<float>& average_burst_lengths);
+
+// Sums the log-spectral distance between the log mel spectra of every hop of
+// |reference| and |degraded| into |result|, over the samples both have.
+// Returns false if the spectra cannot be computed.
+bool AddLogSpectralDistance(absl::Span<const int16_t> reference,
+                            absl::Span<const int16_t> degraded,
+                            int sample_rate_hz, PlcSweepResult* result);
+
+// Decodes every file of |encoded_paths| once without losses as the reference,
+// then once per configuration and seed of |options|. All decodes share one
+// model and run on |options.num_workers| threads. Returns a nullopt if the
+// model or a file could not be loaded.
+absl::optional<std::vector<PlcSweepResult>> RunPlcSweep(
+    const std::vector<ghc::filesystem::path>& encoded_paths,
+    const PlcSweepOptions& options);
+
+// Returns |results| of a sweep with |options| as a JSON object.
+std::string FormatPlcSweepJson(const PlcSweepOptions& options,
+                               const std::vector<PlcSweepResult>& results);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_PLC_SWEEP_LIB_H_
@@ -0,0 +1,136 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "plc_sweep_lib.h"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::ElementsAre;
+using testing::HasSubstr;
+using testing::Optional;
+
+static constexpr int kSampleRateHz = 16000;
+
+// Returns |num_samples| of a tone at |frequency_hz|.
+std::vector<int16_t> Tone(int num_samples, float frequency_hz) {
+  std::vector<int16_t> samples(num_samples);
+  for (int i = 0; i < num_samples; ++i) {
+    samples[i] = static_cast<int16_t>(
+        8000.0f * std::sin(2.0f * M_PI * frequency_hz * i / kSampleRateHz));
+  }
+  return samples;
+}
+
+TEST(ParseFloatListTest, ParsesCommaSeparatedNumbers) {
+  EXPECT_THAT(ParseFloatList("0.05, 0.1,1"),
+              Optional(ElementsAre(0.05f, 0.1f, 1.0f)));
+  EXPECT_THAT(ParseFloatList(""), Optional(ElementsAre()));
+  EXPECT_EQ(ParseFloatList("0.1,high"), absl::nullopt);
+}
+
+TEST(PlcSweepGridTest, SkipsConfigurationsGilbertModelCannotSimulate) {
+  // A loss rate of 0.6 needs bursts of at least 1.5 packets on average.
+  const std::vector<PlcSweepConfig> configs =
+      PlcSweepGrid({0.1f, 0.6f}, {1.0f, 2.0f});
+
+  ASSERT_EQ(configs.size(), 3);
+  EXPECT_FLOAT_EQ(configs[0].packet_loss_rate, 0.1f);
+  EXPECT_FLOAT_EQ(configs[0].average_burst_length, 1.0f);
+  EXPECT_FLOAT_EQ(configs[1].packet_loss_rate, 0.1f);
+  EXPECT_FLOAT_EQ(configs[1].average_burst_length, 2.0f);
+  EXPECT_FLOAT_EQ(configs[2].packet_loss_rate, 0.6f);
+  EXPECT_FLOAT_EQ(configs[2].average_burst_length, 2.0f);
+}
+
+TEST(AddLogSpectralDistanceTest, IdenticalAudioHasNoDistance) {
+  const std::vector<int16_t> reference = Tone(kSampleRateHz / 2, 440.0f);
+  PlcSweepResult result;
+
+  ASSERT_TRUE(AddLogSpectralDistance(reference, reference, kSampleRateHz,
+                                     &result));
+
+  EXPECT_EQ(result.num_frames,
+            reference.size() / GetNumSamplesPerHop(kSampleRateHz));
+  EXPECT_DOUBLE_EQ(result.mean_log_spectral_distance(), 0.0);
+}
+
+TEST(AddLogSpectralDistanceTest, DifferentAudioIsDistant) {
+  const std::vector<int16_t> reference = Tone(kSampleRateHz / 2, 440.0f);
+  const std::vector<int16_t> degraded = Tone(kSampleRateHz / 4, 2000.0f);
+  PlcSweepResult result;
+
+  ASSERT_TRUE(
+      AddLogSpectralDistance(reference, degraded, kSampleRateHz, &result));
+
+  // Only the frames both have are compared.
+  EXPECT_EQ(result.num_frames,
+            degraded.size() / GetNumSamplesPerHop(kSampleRateHz));
+  EXPECT_GT(result.mean_log_spectral_distance(), 1.0);
+}
+
+TEST(PlcSweepResultTest, RatesAreRelativeToTheDecodedAudio) {
+  PlcSweepResult result;
+  EXPECT_DOUBLE_EQ(result.cpu_seconds_per_audio_second(kSampleRateHz), 0.0);
+  EXPECT_DOUBLE_EQ(result.comfort_noise_rate(), 0.0);
+
+  result.num_samples = 2 * kSampleRateHz;
+  result.cpu_seconds = 0.5;
+  result.num_concealed_samples = 300;
+  result.num_comfort_noise_samples = 100;
+  EXPECT_DOUBLE_EQ(result.cpu_seconds_per_audio_second(kSampleRateHz), 0.25);
+  EXPECT_DOUBLE_EQ(result.comfort_noise_rate(), 0.25);
+}
+
+TEST(RunPlcSweepTest, MissingModelFails) {
+  PlcSweepOptions options;
+  options.model_path = ghc::filesystem::current_path() / "missing";
+  options.configs = {{0.1f, 2.0f}};
+  EXPECT_EQ(RunPlcSweep({ghc::filesystem::current_path() / "a.lyra"}, options),
+            absl::nullopt);
+}
+
+TEST(FormatPlcSweepJsonTest, ListsEveryConfiguration) {
+  PlcSweepOptions options;
+  PlcSweepResult first;
+  first.config = {0.05f, 1.0f};
+  first.num_runs = 3;
+  PlcSweepResult second;
+  second.config = {0.2f, 4.0f};
+
+  const std::string json = FormatPlcSweepJson(options, {first, second});
+
+  EXPECT_THAT(json, HasSubstr("\"sample_rate_hz\": 16000"));
+  EXPECT_THAT(json, HasSubstr("\"packet_loss_rate\": 0.0500, "
+                              "\"average_burst_length\": 1.000, "
+                              "\"num_runs\": 3"));
+  EXPECT_THAT(json, HasSubstr("\"packet_loss_rate\": 0.2000"));
+  EXPECT_THAT(json, HasSubstr("\"mean_log_spectral_distance\""));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,244 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "dsp_util.h"
+#include "glog/logging.h"
+#include "state_buffer.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Filter radius in samples at the lower of the two sample rates.
+constexpr int kFilterRadius = 17;
+// The cutoff as a proportion of the lower Nyquist frequency, and the Kaiser
+// window shape, as in the defaults of audio_dsp::QResamplerParams.
+constexpr double kCutoffProportion = 0.9;
+constexpr double kKaiserBeta = 5.658;
+
+// Modified Bessel function of the first kind of order zero.
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; term > 1e-12 * sum; ++k) {
+    const double half_x_over_k = 0.5 * x / k;
+    term *= half_x_over_k * half_x_over_k;
+    sum += term;
+  }
+  return sum;
+}
+
+// Designs the lowpass filter for a rate change by |factor|, sampled at the
+// higher rate with |radius| samples on each side of the center and scaled to
+// a DC gain of |gain|.
+std::vector<double> LowpassFilter(int factor, int radius, double gain) {
+  const double cutoff = kCutoffProportion * 0.5 / factor;
+  std::vector<double> filter(2 * radius + 1);
+  double sum = 0.0;
+  for (int n = -radius; n <= radius; ++n) {
+    const double x = M_PI * 2.0 * cutoff * n;
+    const double sinc = n == 0 ? 1.0 : std::sin(x) / x;
+    const double r = static_cast<double>(n) / radius;
+    const double window =
+        BesselI0(kKaiserBeta * std::sqrt(std::max(0.0, 1.0 - r * r))) /
+        BesselI0(kKaiserBeta);
+    filter[n + radius] = sinc * window;
+    sum += filter[n + radius];
+  }
+  for (double& tap : filter) {
+    tap *= gain / sum;
+  }
+  return filter;
+}
+
+// Adds the correlation of |taps| with |input| to the first |num_outputs|
+// values of |output|: output[j] += sum_t taps[t] * input[j + t]. The loop over
+// the outputs is the inner one, so it vectorizes without reordering the sums.
+void AccumulateCorrelation(const std::vector<float>& taps, const float* input,
+                           int num_outputs, float* output) {
+  for (int t = 0; t < taps.size(); ++t) {
+    const float tap = taps[t];
+    const float* shifted_input = input + t;
+    for (int j = 0; j < num_outputs; ++j) {
+      output[j] += tap * shifted_input[j];
+    }
+  }
+}
+
+}  // namespace
+
+bool PolyphaseResampler::SupportsRates(double input_sample_rate_hz,
+                                       double target_sample_rate_hz) {
+  const double lower = std::min(input_sample_rate_hz, target_sample_rate_hz);
+  const double higher = std::max(input_sample_rate_hz, target_sample_rate_hz);
+  if (lower <= 0.0 || lower != std::floor(lower) ||
+      higher != std::floor(higher) || lower == higher) {
+    return false;
+  }
+  return std::fmod(higher, lower) == 0.0;
+}
+
+std::unique_ptr<PolyphaseResampler> PolyphaseResampler::Create(
+    double input_sample_rate_hz, double target_sample_rate_hz) {
+  if (!SupportsRates(input_sample_rate_hz, target_sample_rate_hz)) {
+    LOG(ERROR) << "Cannot resample from " << input_sample_rate_hz << " Hz to "
+               << target_sample_rate_hz << " Hz by an integer factor.";
+    return nullptr;
+  }
+  std::vector<std::vector<float>> phase_taps;
+  if (target_sample_rate_hz > input_sample_rate_hz) {
+    // Output sample L * m + p is the correlation of the last 2 * radius + 1
+    // input samples with taps p, p + L, p + 2 * L, ... of the filter.
+    const int factor =
+        static_cast<int>(target_sample_rate_hz / input_sample_rate_hz);
+    const std::vector<double> filter =
+        LowpassFilter(factor, kFilterRadius * factor, factor);
+    const int num_taps = 2 * kFilterRadius + 1;
+    for (int p = 0; p < factor; ++p) {
+      std::vector<float> taps(num_taps, 0.0f);
+      for (int k = 0; k < num_taps && factor * k + p < filter.size(); ++k) {
+        taps[num_taps - 1 - k] = filter[factor * k + p];
+      }
+      phase_taps.push_back(std::move(taps));
+    }
+    return absl::WrapUnique(new PolyphaseResampler(
+        factor, 1, 2 * kFilterRadius, std::move(phase_taps)));
+  }
+  // Output sample m is the correlation of input samples M * m - 2 * radius to
+  // M * m with the symmetric filter. Splitting both into M phases turns this
+  // into M correlations over contiguous samples.
+  const int factor =
+      static_cast<int>(input_sample_rate_hz / target_sample_rate_hz);
+  const int radius = factor * std::max(1, kFilterRadius / factor);
+  const std::vector<double> filter = LowpassFilter(factor, radius, 1.0);
+  for (int q = 0; q < factor; ++q) {
+    std::vector<float> taps;
+    for (int t = q; t < filter.size(); t += factor) {
+      taps.push_back(filter[t]);
+    }
+    phase_taps.push_back(std::move(taps));
+  }
+  return absl::WrapUnique(
+      new PolyphaseResampler(1, factor, 2 * radius, std::move(phase_taps)));
+}
+
+PolyphaseResampler::PolyphaseResampler(
+    int interpolation_factor, int decimation_factor, int history_size,
+    std::vector<std::vector<float>> phase_taps)
+    : interpolation_factor_(interpolation_factor),
+      decimation_factor_(decimation_factor),
+      history_size_(history_size),
+      phase_taps_(std::move(phase_taps)) {
+  Reset();
+}
+
+int PolyphaseResampler::NumOutputSamples(int num_input_samples) const {
+  const int num_buffered = history_.size() + num_input_samples;
+  if (num_buffered <= history_size_) {
+    return 0;
+  }
+  return interpolation_factor_ *
+         ((num_buffered - history_size_ - 1) / decimation_factor_ + 1);
+}
+
+int PolyphaseResampler::Process(absl::Span<const int16_t> input,
+                                absl::Span<int16_t> output) {
+  const int num_output_samples = ProcessToAccumulator(input);
+  const int num_to_write =
+      std::min(num_output_samples, static_cast<int>(output.size()));
+  ClipToInt16(absl::MakeConstSpan(accumulator_).first(num_to_write),
+              output.first(num_to_write));
+  return num_output_samples;
+}
+
+int PolyphaseResampler::Process(absl::Span<const float> input,
+                                absl::Span<float> output) {
+  const int num_output_samples = ProcessToAccumulator(input);
+  const int num_to_write =
+      std::min(num_output_samples, static_cast<int>(output.size()));
+  std::copy_n(accumulator_.begin(), num_to_write, output.begin());
+  return num_output_samples;
+}
+
+int PolyphaseResampler::Process(absl::Span<const int16_t> input,
+                                absl::Span<float> output) {
+  const int num_output_samples = ProcessToAccumulator(input);
+  const int num_to_write =
+      std::min(num_output_samples, static_cast<int>(output.size()));
+  std::copy_n(accumulator_.begin(), num_to_write, output.begin());
+  return num_output_samples;
+}
+
+template <typename SampleType>
+int PolyphaseResampler::ProcessToAccumulator(
+    absl::Span<const SampleType> input) {
+  const int num_output_samples = NumOutputSamples(input.size());
+  history_.insert(history_.end(), input.begin(), input.end());
+  accumulator_.assign(num_output_samples, 0.0f);
+  if (interpolation_factor_ > 1) {
+    // Every input sample gives one output sample per phase, which are
+    // interleaved into the output.
+    const int num_input_samples = input.size();
+    for (int p = 0; p < interpolation_factor_; ++p) {
+      phase_output_.assign(num_input_samples, 0.0f);
+      AccumulateCorrelation(phase_taps_[p], history_.data(), num_input_samples,
+                            phase_output_.data());
+      for (int m = 0; m < num_input_samples; ++m) {
+        accumulator_[interpolation_factor_ * m + p] = phase_output_[m];
+      }
+    }
+    history_.erase(history_.begin(), history_.end() - history_size_);
+  } else {
+    // Deinterleave each input phase and correlate it with its taps.
+    for (int q = 0; q < decimation_factor_; ++q) {
+      const std::vector<float>& taps = phase_taps_[q];
+      phase_input_.resize(num_output_samples + taps.size() - 1);
+      for (int i = 0; i < phase_input_.size(); ++i) {
+        phase_input_[i] = history_[q + decimation_factor_ * i];
+      }
+      AccumulateCorrelation(taps, phase_input_.data(), num_output_samples,
+                            accumulator_.data());
+    }
+    history_.erase(history_.begin(),
+                   history_.begin() + decimation_factor_ * num_output_samples);
+  }
+  return num_output_samples;
+}
+
+void PolyphaseResampler::Reset() { history_.assign(history_size_, 0.0f); }
+
+void PolyphaseResampler::SaveState(StateWriter* writer) const {
+  writer->WriteSpan(absl::MakeConstSpan(history_));
+}
+
+bool PolyphaseResampler::RestoreState(StateReader* reader) {
+  // When decimating the history holds up to a block of input samples more
+  // than the filter needs.
+  return reader->ReadVector(&history_) &&
+         static_cast<int>(history_.size()) < history_size_ + decimation_factor_;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
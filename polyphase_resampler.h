@@ -0,0 +1,99 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_POLYPHASE_RESAMPLER_H_
+#define LYRA_CODEC_POLYPHASE_RESAMPLER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "state_buffer.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Resamples a stream by an integer factor, either up or down, with a fixed
+// Kaiser-windowed sinc filter split into its polyphase components. All the
+// sample rates supported by Lyra relate to |kInternalSampleRateHz| this way,
+// so this is the fast path of |Resampler|. The filter has a radius of 17
+// samples at the lower of the two rates, which gives the same delays as the
+// generic resampler. Scratch buffers are kept between calls, so once they have
+// grown to the largest block size no call allocates.
+class PolyphaseResampler {
+ public:
+  // Returns whether one of the rates is an integer multiple, greater than one,
+  // of the other.
+  static bool SupportsRates(double input_sample_rate_hz,
+                            double target_sample_rate_hz);
+
+  static std::unique_ptr<PolyphaseResampler> Create(
+      double input_sample_rate_hz, double target_sample_rate_hz);
+
+  // Returns the number of samples the next call to Process() produces for
+  // |num_input_samples| input samples.
+  int NumOutputSamples(int num_input_samples) const;
+
+  // Resamples |input| into |output|, clipping to the int16 range. Returns the
+  // number of resampled samples, of which at most |output.size()| are written.
+  int Process(absl::Span<const int16_t> input, absl::Span<int16_t> output);
+
+  // Same as above, but in float without clipping.
+  int Process(absl::Span<const float> input, absl::Span<float> output);
+
+  // Same as above, but from int16 samples.
+  int Process(absl::Span<const int16_t> input, absl::Span<float> output);
+
+  // Clears the filter history, as if no samples were processed yet.
+  void Reset();
+
+  // Appends the filter history to |writer|.
+  void SaveState(StateWriter* writer) const;
+
+  // Restores the history saved by |SaveState| of a resampler between the same
+  // rates. Returns false if |reader| does not hold it.
+  bool RestoreState(StateReader* reader);
+
+ private:
+  PolyphaseResampler(int interpolation_factor, int decimation_factor,
+                     int history_size,
+                     std::vector<std::vector<float>> phase_taps);
+
+  // Appends |input| to |history_| and resamples it into |accumulator_|.
+  // Returns the number of resampled samples.
+  template <typename SampleType>
+  int ProcessToAccumulator(absl::Span<const SampleType> input);
+
+  const int interpolation_factor_;
+  const int decimation_factor_;
+  // The number of past input samples the filter needs to produce the next
+  // output sample.
+  const int history_size_;
+  // Reversed polyphase components of the filter, one per output phase when
+  // interpolating and one per input phase when decimating.
+  const std::vector<std::vector<float>> phase_taps_;
+
+  std::vector<float> history_;
+  std::vector<float> phase_input_;
+  std::vector<float> phase_output_;
+  std::vector<float> accumulator_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_POLYPHASE_RESAMPLER_H_
@@ -0,0 +1,221 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "dsp_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "lyra_config.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+std::vector<float> SineWave(double frequency_hz, double sample_rate_hz,
+                            float amplitude, int num_samples) {
+  std::vector<float> samples(num_samples);
+  for (int i = 0; i < num_samples; ++i) {
+    samples[i] = amplitude * std::sin(2.0 * M_PI * frequency_hz * i /
+                                      sample_rate_hz);
+  }
+  return samples;
+}
+
+std::vector<float> RandomSamples(int num_samples) {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> distribution(-1000.0f, 1000.0f);
+  std::vector<float> samples(num_samples);
+  for (float& sample : samples) {
+    sample = distribution(gen);
+  }
+  return samples;
+}
+
+std::vector<float> ProcessAll(PolyphaseResampler* resampler,
+                              const std::vector<float>& input) {
+  std::vector<float> output(resampler->NumOutputSamples(input.size()));
+  EXPECT_EQ(resampler->Process(absl::MakeConstSpan(input),
+                               absl::MakeSpan(output)),
+            output.size());
+  return output;
+}
+
+class PolyphaseResamplerTest
+    : public testing::TestWithParam<std::pair<int, int>> {
+ protected:
+  PolyphaseResamplerTest()
+      : input_sample_rate_hz_(GetParam().first),
+        target_sample_rate_hz_(GetParam().second) {}
+
+  std::unique_ptr<PolyphaseResampler> CreateResampler() const {
+    return PolyphaseResampler::Create(input_sample_rate_hz_,
+                                      target_sample_rate_hz_);
+  }
+
+  const int input_sample_rate_hz_;
+  const int target_sample_rate_hz_;
+};
+
+TEST_P(PolyphaseResamplerTest, HopIsResampledToHop) {
+  auto resampler = CreateResampler();
+  ASSERT_NE(resampler, nullptr);
+  const std::vector<float> input(GetNumSamplesPerHop(input_sample_rate_hz_),
+                                 0.0f);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(ProcessAll(resampler.get(), input),
+              std::vector<float>(GetNumSamplesPerHop(target_sample_rate_hz_),
+                                 0.0f));
+  }
+}
+
+TEST_P(PolyphaseResamplerTest, ConstantIsPreserved) {
+  auto resampler = CreateResampler();
+  ASSERT_NE(resampler, nullptr);
+  const std::vector<float> input(4 * GetNumSamplesPerHop(input_sample_rate_hz_),
+                                 1000.0f);
+  const std::vector<float> output = ProcessAll(resampler.get(), input);
+  // Skip the samples that still depend on the zeros the filter starts from.
+  for (int i = output.size() / 2; i < output.size(); ++i) {
+    EXPECT_NEAR(output[i], 1000.0f, 1.0f);
+  }
+}
+
+TEST_P(PolyphaseResamplerTest, OutputDoesNotDependOnBlockSize) {
+  const std::vector<float> input =
+      RandomSamples(5 * GetNumSamplesPerHop(input_sample_rate_hz_));
+  auto resampler = CreateResampler();
+  ASSERT_NE(resampler, nullptr);
+  const std::vector<float> expected = ProcessAll(resampler.get(), input);
+
+  resampler = CreateResampler();
+  std::vector<float> output;
+  const int kBlockSizes[] = {1, 7, 160, 2, 333};
+  for (int start = 0, b = 0; start < input.size(); ++b) {
+    const int size = std::min(kBlockSizes[b % 5],
+                              static_cast<int>(input.size()) - start);
+    std::vector<float> block(input.begin() + start,
+                             input.begin() + start + size);
+    const std::vector<float> resampled = ProcessAll(resampler.get(), block);
+    output.insert(output.end(), resampled.begin(), resampled.end());
+    start += size;
+  }
+  EXPECT_THAT(output, testing::Pointwise(testing::FloatEq(), expected));
+}
+
+TEST_P(PolyphaseResamplerTest, ResetClearsHistory) {
+  const std::vector<float> input =
+      RandomSamples(GetNumSamplesPerHop(input_sample_rate_hz_));
+  auto resampler = CreateResampler();
+  ASSERT_NE(resampler, nullptr);
+  const std::vector<float> first = ProcessAll(resampler.get(), input);
+  ProcessAll(resampler.get(), input);
+  resampler->Reset();
+  EXPECT_EQ(ProcessAll(resampler.get(), input), first);
+}
+
+TEST_P(PolyphaseResamplerTest, Int16MatchesClippedFloats) {
+  std::vector<float> input =
+      RandomSamples(GetNumSamplesPerHop(input_sample_rate_hz_));
+  std::vector<int16_t> int16_input(input.size());
+  for (int i = 0; i < input.size(); ++i) {
+    // Large enough that some outputs have to be clipped.
+    int16_input[i] = static_cast<int16_t>(30 * input[i]);
+    input[i] = int16_input[i];
+  }
+  auto float_resampler = CreateResampler();
+  auto int16_resampler = CreateResampler();
+  ASSERT_NE(float_resampler, nullptr);
+  ASSERT_NE(int16_resampler, nullptr);
+
+  const std::vector<float> float_output =
+      ProcessAll(float_resampler.get(), input);
+  std::vector<int16_t> int16_output(float_output.size());
+  EXPECT_EQ(int16_resampler->Process(absl::MakeConstSpan(int16_input),
+                                     absl::MakeSpan(int16_output)),
+            float_output.size());
+  for (int i = 0; i < float_output.size(); ++i) {
+    EXPECT_EQ(int16_output[i], ClipToInt16(float_output[i]));
+  }
+}
+
+TEST_P(PolyphaseResamplerTest, ShortOutputIsNotOverrun) {
+  const std::vector<int16_t> input(GetNumSamplesPerHop(input_sample_rate_hz_),
+                                   100);
+  auto resampler = CreateResampler();
+  ASSERT_NE(resampler, nullptr);
+  std::vector<int16_t> output(10, 7);
+  EXPECT_EQ(resampler->Process(absl::MakeConstSpan(input),
+                               absl::MakeSpan(output).subspan(0, 5)),
+            GetNumSamplesPerHop(target_sample_rate_hz_));
+  EXPECT_THAT(absl::MakeConstSpan(output).subspan(5),
+              testing::Each(testing::Eq(7)));
+}
+
+INSTANTIATE_TEST_SUITE_P(IntegerRatios, PolyphaseResamplerTest,
+                         testing::Values(std::make_pair(48000, 16000),
+                                         std::make_pair(32000, 16000),
+                                         std::make_pair(8000, 16000),
+                                         std::make_pair(16000, 48000),
+                                         std::make_pair(16000, 32000),
+                                         std::make_pair(16000, 8000)));
+
+class PolyphaseResamplerRoundTripTest : public testing::TestWithParam<int> {};
+
+TEST_P(PolyphaseResamplerRoundTripTest, UpsampleThenDownsampleSimilar) {
+  const int factor = GetParam();
+  constexpr int kBaseSampleRateHz = 16000;
+  const std::vector<float> samples =
+      SineWave(1000.0, kBaseSampleRateHz, 100.0f, 200);
+  auto upsampler =
+      PolyphaseResampler::Create(kBaseSampleRateHz, factor * kBaseSampleRateHz);
+  auto downsampler =
+      PolyphaseResampler::Create(factor * kBaseSampleRateHz, kBaseSampleRateHz);
+  ASSERT_NE(upsampler, nullptr);
+  ASSERT_NE(downsampler, nullptr);
+  const std::vector<float> downsampled =
+      ProcessAll(downsampler.get(), ProcessAll(upsampler.get(), samples));
+  ASSERT_EQ(downsampled.size(), samples.size());
+
+  // The upsampler delays by its radius of 17 input samples and the downsampler
+  // by its radius rounded down to whole output samples.
+  const int delay = 17 + 17 / factor;
+  for (int i = 2 * delay; i < samples.size(); ++i) {
+    EXPECT_NEAR(samples[i - delay], downsampled[i], 1.0f);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Factors, PolyphaseResamplerRoundTripTest,
+                         testing::Values(2, 3));
+
+TEST(PolyphaseResamplerCreateTest, FailsWithoutIntegerRatio) {
+  EXPECT_FALSE(PolyphaseResampler::SupportsRates(44100, 16000));
+  EXPECT_FALSE(PolyphaseResampler::SupportsRates(16000, 16000));
+  EXPECT_FALSE(PolyphaseResampler::SupportsRates(16000.5, 32001));
+  EXPECT_EQ(PolyphaseResampler::Create(44100, 16000), nullptr);
+  EXPECT_EQ(PolyphaseResampler::Create(16000, 16000), nullptr);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
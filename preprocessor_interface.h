@@ -18,7 +18,6 @@
 #define LYRA_CODEC_PREPROCESSOR_INTERFACE_H_
 
 #include <cstdint>
-#include <vector>
 
 #include "absl/types/span.h"
 
@@ -28,9 +27,8 @@ namespace codec {
 // An interface to preprocess audio.
 class PreprocessorInterface {
  public:
-  // Pre-process the input audio stream.
-  virtual std::vector<int16_t> Process(absl::Span<const int16_t> input,
-                                       int sample_rate_hz) = 0;
+  // Pre-process the input audio stream in place.
+  virtual void Process(absl::Span<int16_t> samples, int sample_rate_hz) = 0;
 
   virtual ~PreprocessorInterface() = default;
 };
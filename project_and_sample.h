@@ -22,17 +22,29 @@
 #include <cstddef>
 #include <cstdint>
 #include <limits>
+#include <functional>
+#include <memory>
 #include <random>
 #include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "activation_arena.h"
+#include "cpu_features.h"
 #include "glog/logging.h"
+#include "layer_wrapper_interface.h"
+#include "logistic_sampling.h"
+#include "lyra_model.h"
 #include "lyra_types.h"
+#include "parallel_load.h"
 #include "sparse_inference_matrixvector.h"
+#include "stage_profiler.h"
 
 namespace chromemedia {
 namespace codec {
@@ -75,40 +87,93 @@ class ProjectAndSample {
 
   explicit ProjectAndSample(float probability_offset = 1e-5f,
                             float temperature = 1.f)
-      : probability_offset_(probability_offset), temperature_(temperature) {}
+      : probability_offset_(probability_offset),
+        temperature_(temperature),
+        layers_(std::make_shared<Layers>()),
+        sample_logistics_(GetLogisticSamplingKernel(DetectCpuIsa())) {}
 
   void set_time_components(bool time_components) {
     time_components_ = time_components;
   }
 
+  // Whether the mix, mean and scale layers only add up the columns of the
+  // outputs of the projection its ReLU left nonzero, see |LogitColumns|. On
+  // by default; only float layers support it, others always run the logit
+  // layers over all columns.
+  void set_activation_sparse_logits(bool activation_sparse_logits) {
+    activation_sparse_logits_ = activation_sparse_logits;
+  }
+
+  // Records the projection, mixture of logistics, sampling and barrier spans
+  // of every thread into |profiler| if it is not null. Not owned.
+  void set_profiler(StageProfiler* profiler) { profiler_ = profiler; }
+
   // Use prefix to load the various weights and biases associated with the model
   void LoadRaw(const std::string& path, const std::string& prefix,
                bool zipped) {
-    // compiler gets confused by putting this inside CHECK, thinks it is
-    // multiple arguments to CHECK itself.
-    auto LoadLayer =
-        csrblocksparse::LoadSparseLayer<ProjWeightType, ProjRhsType,
-                                        DiskWeightType>;
-    CHECK(LoadLayer(prefix + "proj_", zipped, &proj_layer_, path).ok());
-
-    auto LoadMixLayer =
-        csrblocksparse::LoadLogitLayer<MixWeightType, ProjMatMulOutType,
-                                       DiskWeightType>;
-    CHECK(LoadMixLayer(prefix + "mix_", zipped, path, &mix_layer_).ok());
+    LoadLayers(path, prefix, zipped, layers_.get());
+  }
 
-    auto LoadMeanLayer =
-        csrblocksparse::LoadLogitLayer<MeanWeightType, ProjMatMulOutType,
-                                       DiskWeightType>;
-    CHECK(LoadMeanLayer(prefix + "means_", zipped, path, &mean_layer_).ok());
+  // Same as LoadRaw, but the layers are looked up in |model| and shared with
+  // every other instance loaded through it for the same |num_threads|. Shared
+  // layers are prepared here, so PrepareForThreads must be called with the
+  // same |num_threads| afterwards.
+  void LoadShared(const std::string& path, const std::string& prefix,
+                  bool zipped, int num_threads, LyraModel* model) {
+    const std::function<std::unique_ptr<Layers>()> loader = [&]() {
+      auto layers = absl::make_unique<Layers>();
+      LoadLayers(path, prefix, zipped, layers.get());
+      CHECK_EQ(num_threads, layers->proj.PrepareForThreads(num_threads));
+      CHECK_EQ(1, layers->mix.PrepareForThreads(1));
+      CHECK_EQ(1, layers->mean.PrepareForThreads(1));
+      CHECK_EQ(1, layers->scale.PrepareForThreads(1));
+      BuildLogitColumns(layers.get());
+      return layers;
+    };
+    layers_ = model->GetOrLoad(
+        absl::StrCat(path, "/", prefix, "project_and_sample:", num_threads),
+        loader);
+    layers_shared_ = true;
+  }
 
-    auto LoadScaleLayer =
-        csrblocksparse::LoadLogitLayer<ScaleWeightType, ProjMatMulOutType,
-                                       DiskWeightType>;
-    CHECK(LoadScaleLayer(prefix + "scales_", zipped, path, &scale_layer_).ok());
+  // Instead of loading the layers, fills them with |weights|, e.g. to measure
+  // models that were not trained. The projection takes |num_gru_hiddens|
+  // inputs to |proj_size| outputs, from which the mix, mean and scale layers
+  // compute |num_mixes| outputs each.
+  void LoadConstant(int num_gru_hiddens, int proj_size, int num_mixes,
+                    const LayerParams::FromConstant& weights) {
+    auto layers = std::make_shared<Layers>();
+    layers->proj = CreateConstantLayer<ProjWeightType, ProjRhsType>(
+        proj_size, num_gru_hiddens, weights);
+    layers->mix = CreateConstantLayer<MixWeightType, ProjMatMulOutType>(
+        num_mixes, proj_size, weights);
+    layers->mean = CreateConstantLayer<MeanWeightType, ProjMatMulOutType>(
+        num_mixes, proj_size, weights);
+    layers->scale = CreateConstantLayer<ScaleWeightType, ProjMatMulOutType>(
+        num_mixes, proj_size, weights);
+    layers_ = std::move(layers);
+    layers_shared_ = false;
   }
 
   ~ProjectAndSample() {}
 
+  // The bytes |PlaceActivations| takes from an arena. Depends on the number of
+  // threads the layers were prepared for.
+  int64_t ActivationBytes() const {
+    return ActivationArena::BytesFor<ProjMatMulOutType>(
+        int64_t{proj_size()} * num_proj_replicas_);
+  }
+
+  // Moves the output of the projection into |arena|, which has to outlive
+  // this object, instead of the arena of its own it is allocated in until
+  // then. Has to be called again if |PrepareForThreads| changes the number of
+  // threads.
+  void PlaceActivations(ActivationArena* arena) {
+    proj_out_ = arena->Allocate<ProjMatMulOutType>(int64_t{proj_size()} *
+                                                   num_proj_replicas_);
+    own_arena_.reset();
+  }
+
   int PrepareForThreads(int num_threads) {
     if (num_threads == num_threads_) return num_threads_;
     num_threads_ = num_threads;
@@ -118,10 +183,16 @@ class ProjectAndSample {
     } else {
       barrier_ = nullptr;
     }
-    CHECK_EQ(num_threads, proj_layer_.PrepareForThreads(num_threads));
-    CHECK_EQ(1, mix_layer_.PrepareForThreads(1));
-    CHECK_EQ(1, mean_layer_.PrepareForThreads(1));
-    CHECK_EQ(1, scale_layer_.PrepareForThreads(1));
+    if (layers_shared_) {
+      CHECK_EQ(num_threads, layers_->proj.num_threads())
+          << "Shared layers were prepared for a different number of threads.";
+    } else {
+      CHECK_EQ(num_threads, layers_->proj.PrepareForThreads(num_threads));
+      CHECK_EQ(1, layers_->mix.PrepareForThreads(1));
+      CHECK_EQ(1, layers_->mean.PrepareForThreads(1));
+      CHECK_EQ(1, layers_->scale.PrepareForThreads(1));
+      BuildLogitColumns(layers_.get());
+    }
     return this->num_threads_;
   }
 
@@ -134,16 +205,25 @@ class ProjectAndSample {
                   int num_samples, int* output_samples) {
     absl::Time t_start;
     if (time_components_) t_start = absl::Now();
-    auto output = proj_out_.slice(0);
-    proj_layer_.MatVec(proj_h, /*relu=*/true, tid, num_proj_replicas_,
-                       proj_layer_.rows(), &output);
-    if (barrier_ != nullptr) barrier_->barrier();
+    int64_t lap_start = profiler_ != nullptr ? profiler_->Start(tid) : 0;
+    auto output = ProjOutput(0);
+    layers_->proj.MatVec(proj_h, /*relu=*/true, tid, num_proj_replicas_,
+                         layers_->proj.rows(), &output);
+    if (profiler_ != nullptr) {
+      profiler_->Lap(tid, SamplingStage::kProjection, &lap_start);
+    }
+    if (barrier_ != nullptr) {
+      barrier_->barrier();
+      if (profiler_ != nullptr) {
+        profiler_->Lap(tid, SamplingStage::kBarrierWait, &lap_start);
+      }
+    }
     if (time_components_ && tid == 0) {
       absl::Time t_now = absl::Now();
       proj_duration_ += t_now - t_start;
       t_start = t_now;
     }
-    MolSamples(tid, thread_local_gen, num_samples, output_samples);
+    MolSamples(tid, thread_local_gen, num_samples, output_samples, lap_start);
   }
 
   // The next multiple of 8 of the output size of the mix layer. This
@@ -154,8 +234,8 @@ class ProjectAndSample {
   }
 
   std::size_t ModelSize() const {
-    return proj_layer_.bytes() + mix_layer_.bytes() + mean_layer_.bytes() +
-           scale_layer_.bytes();
+    return layers_->proj.bytes() + layers_->mix.bytes() +
+           layers_->mean.bytes() + layers_->scale.bytes();
   }
 
   std::string ReportTiming() const {
@@ -168,6 +248,183 @@ class ProjectAndSample {
   }
 
  private:
+  // Whether the projection and the logit layers all output floats, which is
+  // what |LogitColumns| are computed in.
+  static constexpr bool kLogitColumnsSupported =
+      std::is_same<ProjMatMulOutType, float>::value &&
+      std::is_same<MixMatMulOutType, float>::value &&
+      std::is_same<MeanMatMulOutType, float>::value &&
+      std::is_same<ScaleMatMulOutType, float>::value;
+
+  // A logit layer as dense columns, one per output of the projection. The
+  // ReLU of the projection zeroes many of its outputs, so that adding up the
+  // columns of the others takes a fraction of a matrix-vector product over
+  // all of them, on the serial tail of every step.
+  struct LogitColumns {
+    int rows = 0;
+    // Column j holds the weights of the j-th input in |rows| consecutive
+    // floats.
+    std::vector<float> weights;
+    std::vector<float> bias;
+  };
+
+  struct Layers {
+    csrblocksparse::SparseLinearLayer<ProjWeightType, ProjRhsType> proj;
+    csrblocksparse::SparseLinearLayer<MixWeightType, ProjMatMulOutType> mix;
+    csrblocksparse::SparseLinearLayer<MeanWeightType, ProjMatMulOutType> mean;
+    csrblocksparse::SparseLinearLayer<ScaleWeightType, ProjMatMulOutType>
+        scale;
+    // Empty unless |kLogitColumnsSupported|.
+    LogitColumns mix_columns;
+    LogitColumns mean_columns;
+    LogitColumns scale_columns;
+  };
+
+  // Reads the columns of |layer| back from its outputs: that of a zero input
+  // is the bias, and that of the j-th unit vector adds the j-th column. The
+  // layer is only available as an opaque sparse matrix, and this runs once
+  // per model, so a matrix-vector product per column costs nothing per step.
+  template <typename Layer>
+  static LogitColumns ReadLogitColumns(int num_inputs, Layer* layer) {
+    LogitColumns columns;
+    columns.rows = layer->rows();
+    csrblocksparse::CacheAlignedVector<float> input(num_inputs);
+    input.FillZero();
+    const csrblocksparse::MutableVectorView<float> input_view(
+        input.data(), num_inputs, /*cols=*/1, /*col_stride=*/num_inputs);
+    csrblocksparse::CacheAlignedVector<float> output(
+        (columns.rows + kSIMDWidth - 1) / kSIMDWidth * kSIMDWidth);
+    layer->MatVec(input_view, /*relu=*/false, 0, /*replicas*/ 1,
+                  /*stride*/ 0, &output);
+    columns.bias.assign(output.data(), output.data() + columns.rows);
+    columns.weights.resize(int64_t{num_inputs} * columns.rows);
+    for (int j = 0; j < num_inputs; ++j) {
+      input[j] = 1.0f;
+      layer->MatVec(input_view, /*relu=*/false, 0, /*replicas*/ 1,
+                    /*stride*/ 0, &output);
+      input[j] = 0.0f;
+      float* column = columns.weights.data() + int64_t{j} * columns.rows;
+      for (int r = 0; r < columns.rows; ++r) {
+        column[r] = output[r] - columns.bias[r];
+      }
+    }
+    return columns;
+  }
+
+  // Fills the |LogitColumns| of |layers| if they are supported and empty. The
+  // logit layers have to be prepared for threads.
+  static void BuildLogitColumns(Layers* layers) {
+    if constexpr (kLogitColumnsSupported) {
+      if (!layers->mix_columns.weights.empty()) return;
+      const int num_inputs = layers->proj.rows();
+      layers->mix_columns = ReadLogitColumns(num_inputs, &layers->mix);
+      layers->mean_columns = ReadLogitColumns(num_inputs, &layers->mean);
+      layers->scale_columns = ReadLogitColumns(num_inputs, &layers->scale);
+    }
+  }
+
+  // Gathers the |size| outputs of the projection at |proj| that the ReLU left
+  // nonzero into |indices| and |values|, which hold |size| elements. Returns
+  // their number. Writes unconditionally, so that the loop does not branch.
+  static int CompactNonzeros(const float* proj, int size, int* indices,
+                             float* values) {
+    int num_nonzeros = 0;
+    for (int i = 0; i < size; ++i) {
+      indices[num_nonzeros] = i;
+      values[num_nonzeros] = proj[i];
+      num_nonzeros += proj[i] != 0.0f;
+    }
+    return num_nonzeros;
+  }
+
+  // Sets the first |columns.rows| elements of |output| to the bias plus the
+  // columns at |indices| weighed by |values|.
+  static void AddColumns(const LogitColumns& columns, const int* indices,
+                         const float* values, int num_nonzeros,
+                         float* output) {
+    const int rows = columns.rows;
+    std::copy(columns.bias.begin(), columns.bias.end(), output);
+    for (int k = 0; k < num_nonzeros; ++k) {
+      const float* column = columns.weights.data() + int64_t{indices[k]} * rows;
+      const float value = values[k];
+      for (int r = 0; r < rows; ++r) {
+        output[r] += value * column[r];
+      }
+    }
+  }
+
+  bool UseLogitColumns() const {
+    return kLogitColumnsSupported && activation_sparse_logits_ &&
+           !layers_->mix_columns.weights.empty();
+  }
+
+  // Compacts the nonzero outputs of the projection that |tid| reads into the
+  // scratch space of |slot|. Returns their number.
+  int CompactProjOutput(int tid, int slot) {
+    if constexpr (kLogitColumnsSupported) {
+      const float* proj =
+          proj_out_ +
+          int64_t{std::min(tid, num_proj_replicas_ - 1)} * proj_size();
+      return CompactNonzeros(proj, proj_size(), nonzero_indices_[slot].data(),
+                             nonzero_values_[slot].data());
+    }
+    return 0;
+  }
+
+  template <typename WeightType, typename RhsType>
+  static csrblocksparse::SparseLinearLayer<WeightType, RhsType>
+  CreateConstantLayer(int rows, int cols,
+                      const LayerParams::FromConstant& weights) {
+    auto layer = csrblocksparse::CreateConstantLayer<WeightType, RhsType>(
+        rows, cols, weights.sparsity, weights.value);
+    if (weights.double_block_height) {
+      layer.DoubleBlockHeight();
+    }
+    return layer;
+  }
+
+  static void LoadLayers(const std::string& path, const std::string& prefix,
+                         bool zipped, Layers* layers) {
+    // The columns of the previous weights, if any, are read again.
+    layers->mix_columns = LogitColumns();
+    layers->mean_columns = LogitColumns();
+    layers->scale_columns = LogitColumns();
+    // compiler gets confused by putting this inside CHECK, thinks it is
+    // multiple arguments to CHECK itself.
+    auto LoadLayer =
+        csrblocksparse::LoadSparseLayer<ProjWeightType, ProjRhsType,
+                                        DiskWeightType>;
+    auto LoadMixLayer =
+        csrblocksparse::LoadLogitLayer<MixWeightType, ProjMatMulOutType,
+                                       DiskWeightType>;
+    auto LoadMeanLayer =
+        csrblocksparse::LoadLogitLayer<MeanWeightType, ProjMatMulOutType,
+                                       DiskWeightType>;
+    auto LoadScaleLayer =
+        csrblocksparse::LoadLogitLayer<ScaleWeightType, ProjMatMulOutType,
+                                       DiskWeightType>;
+    // The four layers are decompressed concurrently.
+    CHECK(LoadInParallel({
+        [&]() {
+          return LoadLayer(prefix + "proj_", zipped, &layers->proj, path).ok();
+        },
+        [&]() {
+          return LoadMixLayer(prefix + "mix_", zipped, path, &layers->mix)
+              .ok();
+        },
+        [&]() {
+          return LoadMeanLayer(prefix + "means_", zipped, path, &layers->mean)
+              .ok();
+        },
+        [&]() {
+          return LoadScaleLayer(prefix + "scales_", zipped, path,
+                                &layers->scale)
+              .ok();
+        },
+    })) << "Could not load the project and sample layers of " << prefix
+        << " in " << path << ".";
+  }
+
   void InitLoadedLayers(int num_threads) {
     const int size = proj_size();
     int output_bins = expanded_mixes_size();
@@ -178,9 +435,10 @@ class ProjectAndSample {
 #endif
 
     // working space for activations
-    proj_out_ =
-        std::move(csrblocksparse::FatCacheAlignedVector<ProjMatMulOutType>(
-            size, num_proj_replicas_));
+    own_arena_ = ActivationArena::Create(ActivationBytes());
+    CHECK(own_arena_ != nullptr);
+    proj_out_ = own_arena_->Allocate<ProjMatMulOutType>(int64_t{size} *
+                                                        num_proj_replicas_);
     mixes_ = std::move(
         csrblocksparse::CacheAlignedVector<MixMatMulOutType>(output_bins));
     // If the number of output_bins has been rounded up, the
@@ -188,29 +446,49 @@ class ProjectAndSample {
     // vector with a value that will not disturb the softmax calculation.
     mixes_.FillWith(
         static_cast<MixMatMulOutType>(std::numeric_limits<float>::lowest()));
-    CHECK_EQ(size, mix_layer_.cols());
-    CHECK_EQ(size, mean_layer_.cols());
-    CHECK_EQ(size, scale_layer_.cols());
+    CHECK_EQ(size, layers_->mix.cols());
+    CHECK_EQ(size, layers_->mean.cols());
+    CHECK_EQ(size, layers_->scale.cols());
     means_ = std::move(
         csrblocksparse::CacheAlignedVector<MeanMatMulOutType>(output_bins));
     scales_ = std::move(
         csrblocksparse::CacheAlignedVector<ScaleMatMulOutType>(output_bins));
     mol_sample_tmp_ = csrblocksparse::CacheAlignedVector<float>(output_bins);
+    if (kLogitColumnsSupported) {
+      for (int slot = 0; slot < 2; ++slot) {
+        nonzero_indices_[slot].resize(size);
+        nonzero_values_[slot].resize(size);
+      }
+    }
   }
 
+  // |lap_start| is the timestamp |profiler_| measures the first stage from.
   void MolSamples(int tid, std::minstd_rand* thread_local_gen, int num_samples,
-                  int* output_samples) {
+                  int* output_samples, int64_t lap_start) {
     DCHECK_NE(output_samples, nullptr);
     absl::Time t_start;
     if (time_components_) t_start = absl::Now();
+    const bool use_logit_columns = UseLogitColumns();
+    // The number of nonzero outputs of the projection in the scratch space of
+    // |CompactProjOutput|, where thread 0 uses slot 0 and the last thread slot
+    // 1, unless they are the same thread.
+    int num_nonzeros = 0;
     if (tid == 0) {
       // If there are two threads, we run the mix layer and its sampling in one,
       // and the mean + scale layers in the other. If there are more than two
       // threads, the others are not used, as more than 2 threads isn't really
       // helpful.
-      mix_layer_.MatVec(proj_out_.slice(std::min(tid, num_proj_replicas_ - 1)),
-                        /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0,
-                        &mixes_);
+      if (use_logit_columns) {
+        num_nonzeros = CompactProjOutput(tid, /*slot=*/0);
+        if constexpr (kLogitColumnsSupported) {
+          AddColumns(layers_->mix_columns, nonzero_indices_[0].data(),
+                     nonzero_values_[0].data(), num_nonzeros, mixes_.data());
+        }
+      } else {
+        layers_->mix.MatVec(
+            ProjOutput(std::min(tid, num_proj_replicas_ - 1)),
+            /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0, &mixes_);
+      }
       int mixtures_per_sample = mixes_.size() / num_samples;
       for (int i = 0; i < num_samples; i++) {
         output_samples[i] = mixes_.ScalarSample(
@@ -219,38 +497,63 @@ class ProjectAndSample {
       }
     }
     if (tid == num_threads_ - 1) {
-      mean_layer_.MatVec(proj_out_.slice(std::min(tid, num_proj_replicas_ - 1)),
-                         /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0,
-                         &means_);
-      scale_layer_.MatVec(
-          proj_out_.slice(std::min(tid, num_proj_replicas_ - 1)),
-          /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0, &scales_);
+      if (use_logit_columns) {
+        const int slot = tid == 0 ? 0 : 1;
+        if (tid > 0) {
+          num_nonzeros = CompactProjOutput(tid, slot);
+        }
+        if constexpr (kLogitColumnsSupported) {
+          AddColumns(layers_->mean_columns, nonzero_indices_[slot].data(),
+                     nonzero_values_[slot].data(), num_nonzeros,
+                     means_.data());
+          AddColumns(layers_->scale_columns, nonzero_indices_[slot].data(),
+                     nonzero_values_[slot].data(), num_nonzeros,
+                     scales_.data());
+        }
+      } else {
+        layers_->mean.MatVec(
+            ProjOutput(std::min(tid, num_proj_replicas_ - 1)),
+            /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0, &means_);
+        layers_->scale.MatVec(
+            ProjOutput(std::min(tid, num_proj_replicas_ - 1)),
+            /*relu=*/false, 0, /*replicas*/ 1, /*stride*/ 0, &scales_);
+      }
+    }
+    if (profiler_ != nullptr) {
+      profiler_->Lap(tid, SamplingStage::kMixtureOfLogistics, &lap_start);
+    }
+    if (barrier_ != nullptr) {
+      barrier_->barrier();
+      if (profiler_ != nullptr) {
+        profiler_->Lap(tid, SamplingStage::kBarrierWait, &lap_start);
+      }
     }
-    if (barrier_ != nullptr) barrier_->barrier();
     if (tid > 0) return;
     if (time_components_) {
       absl::Time t_now = absl::Now();
       mixture_of_logistics_duration_ += t_now - t_start;
       t_start = t_now;
     }
+    // Gather the parameters of the chosen mixture components and draw the
+    // uniforms first, in the same order as one sample at a time would, so
+    // that all samples can then be computed together.
+    if (static_cast<int>(logistic_means_.size()) < num_samples) {
+      logistic_means_.resize(num_samples);
+      logistic_scales_.resize(num_samples);
+      logistic_uniforms_.resize(num_samples);
+    }
+    std::uniform_real_distribution<float> dist;
     for (int s = 0; s < num_samples; s++) {
-      int index = output_samples[s];
-      float mean = static_cast<float>(means_[index]);
-      float scale = static_cast<float>(scales_[index]);
-      // Softplus the scale.
-      scale = logf(expf(scale) + 1.0f);
-      std::uniform_real_distribution<float> dist;
-
-      // Truncated logistic distribution.
-      const float kProbabilityScale = 1.0f - 2.0f * probability_offset_;
-      float prob =
-          dist(*thread_local_gen) * kProbabilityScale + probability_offset_;
-      float f_result = mean + scale * log((1.0f - prob) / prob);
-      int result = std::min(
-          static_cast<int>(std::numeric_limits<int16_t>::max()),
-          std::max(static_cast<int>(std::numeric_limits<int16_t>::min()),
-                   static_cast<int>(f_result * 256)));
-      output_samples[s] = result;
+      const int index = output_samples[s];
+      logistic_means_[s] = static_cast<float>(means_[index]);
+      logistic_scales_[s] = static_cast<float>(scales_[index]);
+      logistic_uniforms_[s] = dist(*thread_local_gen);
+    }
+    sample_logistics_(logistic_means_.data(), logistic_scales_.data(),
+                      logistic_uniforms_.data(), probability_offset_,
+                      num_samples, output_samples);
+    if (profiler_ != nullptr) {
+      profiler_->Lap(tid, SamplingStage::kSampling, &lap_start);
     }
 
     if (time_components_) {
@@ -260,9 +563,19 @@ class ProjectAndSample {
     }
   }
 
-  int proj_size() const { return proj_layer_.rows(); }
+  int proj_size() const { return layers_->proj.rows(); }
+
+  // The output of the projection that |replica| writes. The replicas follow
+  // each other, as the projection writes them with a stride of its rows.
+  csrblocksparse::MutableVectorView<ProjMatMulOutType> ProjOutput(
+      int replica) {
+    const int size = proj_size();
+    return csrblocksparse::MutableVectorView<ProjMatMulOutType>(
+        proj_out_ + int64_t{replica} * size, size, /*cols=*/1,
+        /*col_stride=*/size);
+  }
   int mixes_size() const {
-    int output_bins = mix_layer_.rows();
+    int output_bins = layers_->mix.rows();
 #ifdef __AVX2__
     output_bins = ((output_bins + kSIMDWidth - 1) / kSIMDWidth) * kSIMDWidth;
 #endif
@@ -275,25 +588,41 @@ class ProjectAndSample {
   int num_threads_ = 0;
   int num_proj_replicas_ = 0;
   std::unique_ptr<csrblocksparse::SpinBarrier> barrier_;
-  // Parameters of the model.
-  csrblocksparse::SparseLinearLayer<ProjWeightType, ProjRhsType> proj_layer_;
-  csrblocksparse::SparseLinearLayer<MixWeightType, ProjMatMulOutType>
-      mix_layer_;
-  csrblocksparse::SparseLinearLayer<MeanWeightType, ProjMatMulOutType>
-      mean_layer_;
-  csrblocksparse::SparseLinearLayer<ScaleWeightType, ProjMatMulOutType>
-      scale_layer_;
-  // Scratch space for computation
-  csrblocksparse::FatCacheAlignedVector<ProjMatMulOutType> proj_out_;
+  // Parameters of the model, possibly shared with other instances through a
+  // |LyraModel|.
+  std::shared_ptr<Layers> layers_;
+  // Whether |layers_| came from a |LyraModel|, in which case they were already
+  // prepared for threads and must not be modified.
+  bool layers_shared_ = false;
+  // Null once the activations were placed in the arena of the owner.
+  std::unique_ptr<ActivationArena> own_arena_;
+  // Scratch space for computation. |proj_out_| holds |num_proj_replicas_|
+  // outputs of the projection and points into |own_arena_| or the arena of
+  // |PlaceActivations|.
+  ProjMatMulOutType* proj_out_ = nullptr;
   csrblocksparse::CacheAlignedVector<MixMatMulOutType> mixes_;
   csrblocksparse::CacheAlignedVector<MeanMatMulOutType> means_;
   csrblocksparse::CacheAlignedVector<ScaleMatMulOutType> scales_;
   csrblocksparse::CacheAlignedVector<float> mol_sample_tmp_;
+  // The indices and values of the nonzero outputs of the projection, for the
+  // first and the last thread.
+  std::vector<int> nonzero_indices_[2];
+  std::vector<float> nonzero_values_[2];
+  bool activation_sparse_logits_ = true;
+  // Parameters and uniforms of the logistic distributions sampled in each
+  // |MolSamples| call.
+  std::vector<float> logistic_means_;
+  std::vector<float> logistic_scales_;
+  std::vector<float> logistic_uniforms_;
+  // Kernel for the instruction set of the running CPU, chosen once here so
+  // that a single binary runs the fastest code each host supports.
+  const LogisticSamplingKernel sample_logistics_;
 
   bool time_components_ = false;
   absl::Duration proj_duration_;
   absl::Duration mixture_of_logistics_duration_;
   absl::Duration samp_duration_;
+  StageProfiler* profiler_ = nullptr;
   // Maximum possible width of a SIMD register in floats.
   static constexpr int kSIMDWidth = 16;
 };
@@ -150,6 +150,32 @@ TYPED_TEST(ProjectAndSampleTest, GetSamplesReturnGoldenValues) {
   }
 }
 
+TYPED_TEST(ProjectAndSampleTest, ActivationSparseLogitsMatchDenseLogits) {
+  this->project_and_sample_layer_.LoadRaw(this->testdata_dir_.string(), kPrefix,
+                                          /*zipped=*/true);
+  std::vector<std::vector<int>> samples;
+  for (const bool activation_sparse_logits : {false, true}) {
+    this->project_and_sample_layer_.set_activation_sparse_logits(
+        activation_sparse_logits);
+    for (const int num_threads : {1, 2}) {
+      this->project_and_sample_layer_.PrepareForThreads(num_threads);
+      const std::minstd_rand::result_type kSeed = 42;
+      std::vector<std::minstd_rand> gen(num_threads, std::minstd_rand(kSeed));
+      samples.emplace_back(kNumSplitBands);
+      auto f = [&](csrblocksparse::SpinBarrier* barrier, int tid) {
+        this->project_and_sample_layer_.GetSamples(
+            this->gru_hiddens_view_, /*tid=*/tid, &gen[tid],
+            &this->scratch_space_, kNumSplitBands, samples.back().data());
+        barrier->barrier();
+      };
+      LaunchOnThreadsWithBarrier(num_threads, f);
+    }
+  }
+  for (const auto& actual_samples : samples) {
+    EXPECT_EQ(actual_samples, samples.front());
+  }
+}
+
 TYPED_TEST(ProjectAndSampleTest, ReportTiming) {
   this->project_and_sample_layer_.LoadRaw(this->testdata_dir_.string(), kPrefix,
                                           /*zipped=*/true);
@@ -0,0 +1,265 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "projection_folder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/status/status.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_types.h"
+#include "model_unpacker.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// The block size of the sparse layers of the shipped models.
+constexpr int kBlockSize = 4;
+
+using FoldedFixed16WeightType =
+    ConditioningTypes<csrblocksparse::fixed16_type>::ConvToGatesWeightType;
+
+std::string FoldedProjectionPrefix(const std::string& prefix) {
+  return prefix + "_conv_cond_to_gates_";
+}
+
+// A layer y = Wx + b, with the masked out weights set to zero.
+struct DenseLayer {
+  int rows = 0;
+  int cols = 0;
+  // Row major.
+  std::vector<float> weights;
+  std::vector<float> bias;
+};
+
+template <typename T>
+bool ReadArray(const ghc::filesystem::path& model_path,
+               const std::string& file_name, std::vector<T>* array) {
+  const absl::Status status =
+      csrblocksparse::ReadArrayFromFile(file_name, array, model_path.string());
+  if (!status.ok()) {
+    LOG(ERROR) << "Couldn't read " << model_path / file_name << ": "
+               << status.message();
+    return false;
+  }
+  return true;
+}
+
+template <typename T>
+bool WriteArray(const std::vector<T>& array,
+                const ghc::filesystem::path& output_path) {
+  std::ofstream output_file(output_path.string(),
+                            std::ios::binary | std::ios::trunc);
+  output_file.write(reinterpret_cast<const char*>(array.data()),
+                    array.size() * sizeof(T));
+  if (!output_file.good()) {
+    LOG(ERROR) << "Couldn't write " << output_path << ".";
+    return false;
+  }
+  return true;
+}
+
+bool ReadLayer(const ghc::filesystem::path& model_path,
+               const std::string& layer_prefix, const std::string& extension,
+               DenseLayer* layer) {
+  std::vector<float> mask;
+  if (!ReadArray(model_path, layer_prefix + "weights.raw" + extension,
+                 &layer->weights) ||
+      !ReadArray(model_path, layer_prefix + "mask.raw" + extension, &mask) ||
+      !ReadArray(model_path, layer_prefix + "bias.raw" + extension,
+                 &layer->bias)) {
+    return false;
+  }
+  if (layer->bias.empty() || layer->weights.size() != mask.size() ||
+      layer->weights.size() % layer->bias.size() != 0) {
+    LOG(ERROR) << "Inconsistent array sizes for " << layer_prefix << ".";
+    return false;
+  }
+  layer->rows = layer->bias.size();
+  layer->cols = layer->weights.size() / layer->rows;
+  for (int i = 0; i < layer->weights.size(); ++i) {
+    layer->weights[i] *= mask[i];
+  }
+  return true;
+}
+
+int NumNonZeros(const std::vector<float>& weights) {
+  return std::count_if(weights.begin(), weights.end(),
+                       [](float weight) { return weight != 0.0f; });
+}
+
+// Returns the layer equivalent to applying |first| and then |second|.
+DenseLayer Fold(const DenseLayer& first, const DenseLayer& second) {
+  DenseLayer folded;
+  folded.rows = second.rows;
+  folded.cols = first.cols;
+  folded.weights.assign(folded.rows * folded.cols, 0.0f);
+  folded.bias = second.bias;
+  std::vector<double> row(folded.cols);
+  for (int r = 0; r < second.rows; ++r) {
+    std::fill(row.begin(), row.end(), 0.0);
+    double bias = second.bias[r];
+    for (int k = 0; k < second.cols; ++k) {
+      const double weight = second.weights[r * second.cols + k];
+      // |second| is sparse, so most rows of |first| are skipped.
+      if (weight == 0.0) {
+        continue;
+      }
+      const float* first_row = first.weights.data() + k * first.cols;
+      for (int c = 0; c < first.cols; ++c) {
+        row[c] += weight * first_row[c];
+      }
+      bias += weight * first.bias[k];
+    }
+    std::copy(row.begin(), row.end(),
+              folded.weights.begin() + r * folded.cols);
+    folded.bias[r] = static_cast<float>(bias);
+  }
+  return folded;
+}
+
+// Zeroes all but the |num_blocks_to_keep| blocks of |layer| with the largest
+// norms and returns the mask of the kept weights.
+std::vector<float> PruneBlocks(int num_blocks_to_keep, DenseLayer* layer) {
+  const int num_block_cols = layer->cols / kBlockSize;
+  const int num_blocks = (layer->rows / kBlockSize) * num_block_cols;
+  const auto weight_index = [layer, num_block_cols](int block, int i, int j) {
+    return ((block / num_block_cols) * kBlockSize + i) * layer->cols +
+           (block % num_block_cols) * kBlockSize + j;
+  };
+  std::vector<double> squared_norms(num_blocks, 0.0);
+  for (int block = 0; block < num_blocks; ++block) {
+    for (int i = 0; i < kBlockSize; ++i) {
+      for (int j = 0; j < kBlockSize; ++j) {
+        const double weight = layer->weights[weight_index(block, i, j)];
+        squared_norms[block] += weight * weight;
+      }
+    }
+  }
+
+  std::vector<float> mask(layer->weights.size(), 1.0f);
+  if (num_blocks_to_keep >= num_blocks) {
+    return mask;
+  }
+  std::vector<int> blocks(num_blocks);
+  std::iota(blocks.begin(), blocks.end(), 0);
+  std::nth_element(blocks.begin(), blocks.begin() + num_blocks_to_keep,
+                   blocks.end(), [&squared_norms](int a, int b) {
+                     return squared_norms[a] > squared_norms[b];
+                   });
+  for (auto it = blocks.begin() + num_blocks_to_keep; it != blocks.end();
+       ++it) {
+    for (int i = 0; i < kBlockSize; ++i) {
+      for (int j = 0; j < kBlockSize; ++j) {
+        const int index = weight_index(*it, i, j);
+        layer->weights[index] = 0.0f;
+        mask[index] = 0.0f;
+      }
+    }
+  }
+  return mask;
+}
+
+}  // namespace
+
+bool HasFoldedProjection(const ghc::filesystem::path& model_path,
+                         const std::string& prefix) {
+  const ghc::filesystem::path bias_path =
+      model_path / (FoldedProjectionPrefix(prefix) + "bias.raw");
+  std::error_code error_code;
+  return ghc::filesystem::exists(bias_path, error_code) ||
+         ghc::filesystem::exists(bias_path.string() + ".gz", error_code);
+}
+
+bool FoldProjectionLayers(const ghc::filesystem::path& model_path,
+                          const std::string& prefix, float density,
+                          const ghc::filesystem::path& output_dir) {
+  if (density > 1.0f) {
+    LOG(ERROR) << "Density must be at most 1 but was " << density << ".";
+    return false;
+  }
+  const std::string extension = IsZippedModel(model_path, prefix) ? ".gz" : "";
+  DenseLayer conv_cond;
+  DenseLayer conv_to_gates;
+  if (!ReadLayer(model_path, prefix + "_conv_cond_", extension, &conv_cond) ||
+      !ReadLayer(model_path, prefix + "_conv_to_gates_", extension,
+                 &conv_to_gates)) {
+    return false;
+  }
+  if (conv_to_gates.cols != conv_cond.rows) {
+    LOG(ERROR) << "conv_to_gates has " << conv_to_gates.cols
+               << " columns but conv_cond has " << conv_cond.rows << " rows.";
+    return false;
+  }
+  DenseLayer folded = Fold(conv_cond, conv_to_gates);
+  if (folded.rows % kBlockSize != 0 || folded.cols % kBlockSize != 0) {
+    LOG(ERROR) << "The folded layer of shape [" << folded.rows << ", "
+               << folded.cols << "] is not made of " << kBlockSize << "x"
+               << kBlockSize << " blocks.";
+    return false;
+  }
+
+  const int num_blocks =
+      (folded.rows / kBlockSize) * (folded.cols / kBlockSize);
+  const int num_blocks_to_keep =
+      density > 0.0f
+          ? static_cast<int>(std::ceil(density * num_blocks))
+          : (NumNonZeros(conv_cond.weights) +
+             NumNonZeros(conv_to_gates.weights)) /
+                (kBlockSize * kBlockSize);
+  const std::vector<float> mask = PruneBlocks(num_blocks_to_keep, &folded);
+  LOG(INFO) << "Folded " << prefix << " projections into a [" << folded.rows
+            << ", " << folded.cols << "] layer with "
+            << std::min(num_blocks_to_keep, num_blocks) << " of "
+            << num_blocks << " blocks.";
+
+  const float max_fixed16_weight = static_cast<float>(
+      1 << FoldedFixed16WeightType::kExponentBits);
+  std::vector<int16_t> fixed16_weights(folded.weights.size());
+  for (int i = 0; i < folded.weights.size(); ++i) {
+    if (std::abs(folded.weights[i]) >= max_fixed16_weight) {
+      LOG(ERROR) << "Folded weight " << folded.weights[i]
+                 << " does not fit in fixed16 with "
+                 << FoldedFixed16WeightType::kExponentBits
+                 << " exponent bits.";
+      return false;
+    }
+    fixed16_weights[i] = static_cast<int16_t>(
+        FoldedFixed16WeightType(folded.weights[i]).raw_val());
+  }
+
+  if (!UnpackModel(model_path, output_dir)) {
+    return false;
+  }
+  const std::string folded_prefix = FoldedProjectionPrefix(prefix);
+  return WriteArray(folded.weights,
+                    output_dir / (folded_prefix + "weights.raw")) &&
+         WriteArray(fixed16_weights,
+                    output_dir / (folded_prefix + "fixed16_weights.raw")) &&
+         WriteArray(mask, output_dir / (folded_prefix + "mask.raw")) &&
+         WriteArray(folded.bias, output_dir / (folded_prefix + "bias.raw"));
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_PROJECTION_FOLDER_H_
+#define LYRA_CODEC_PROJECTION_FOLDER_H_
+
+#include <string>
+
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+
+// Returns whether the model under |model_path| holds the arrays of a folded
+// projection layer for |prefix|, as written by FoldProjectionLayers().
+bool HasFoldedProjection(const ghc::filesystem::path& model_path,
+                         const std::string& prefix);
+
+// The conv_cond and conv_to_gates layers of the conditioning stack are two
+// consecutive 1x1 convolutions without a nonlinearity in between, so they are
+// equivalent to a single layer with the product of their weights. Unpacks the
+// model under |model_path| into |output_dir| like UnpackModel() and adds that
+// layer for |prefix|, which the conditioning stack then runs instead of the
+// two.
+// The product of two sparse layers is dense. If |density| is in (0, 1] only
+// that fraction of its 4x4 weight blocks with the largest norms are kept.
+// Otherwise as many blocks are kept as the two layers have non-zero weights
+// together, so that the folded layer costs at most as many multiply-adds.
+// The fixed16 weights are written in the format of the conv_to_gates weights
+// of the default ConditioningTypes. Returns false on failure, including when
+// a folded weight does not fit in that format.
+bool FoldProjectionLayers(const ghc::filesystem::path& model_path,
+                          const std::string& prefix, float density,
+                          const ghc::filesystem::path& output_dir);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_PROJECTION_FOLDER_H_
@@ -0,0 +1,119 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "projection_folder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+
+// placeholder for get runfiles header.
+#include "causal_convolutional_conditioning.h"
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_types.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+static const char kPrefix[] = "lyra_16khz";
+static constexpr int kNumCondHiddens = 512;
+static constexpr int kNumHiddens = 1024;
+
+using ConditioningType =
+    CausalConvolutionalConditioning<ConditioningTypes<float>>;
+
+class ProjectionFolderTest : public testing::Test {
+ protected:
+  ProjectionFolderTest()
+      : model_path_(ghc::filesystem::current_path() / "wavegru"),
+        output_dir_(ghc::filesystem::path(testing::TempDir()) / "folded") {}
+
+  void TearDown() override {
+    std::error_code error_code;
+    ghc::filesystem::remove_all(output_dir_, error_code);
+    ASSERT_FALSE(error_code);
+  }
+
+  ConditioningType CreateConditioning(const ghc::filesystem::path& path) {
+    return ConditioningType(kNumFeatures, kNumCondHiddens, kNumHiddens,
+                            GetNumSamplesPerHop(kInternalSampleRateHz),
+                            kNumFramesPerPacket, /*num_threads=*/1,
+                            path.string(), kPrefix);
+  }
+
+  const ghc::filesystem::path model_path_;
+  const ghc::filesystem::path output_dir_;
+};
+
+TEST_F(ProjectionFolderTest, ShippedModelIsNotFolded) {
+  EXPECT_FALSE(HasFoldedProjection(model_path_, kPrefix));
+}
+
+TEST_F(ProjectionFolderTest, FoldedModelHasFoldedProjection) {
+  ASSERT_TRUE(FoldProjectionLayers(model_path_, kPrefix, /*density=*/0.0f,
+                                   output_dir_));
+
+  EXPECT_TRUE(HasFoldedProjection(output_dir_, kPrefix));
+  EXPECT_FALSE(HasFoldedProjection(output_dir_, "lyra_32khz"));
+  EXPECT_TRUE(ghc::filesystem::exists(
+      output_dir_ / "lyra_16khz_conv_cond_to_gates_fixed16_weights.raw"));
+  EXPECT_TRUE(ghc::filesystem::exists(output_dir_ / "lyra_config.textproto"));
+}
+
+TEST_F(ProjectionFolderTest, DenseFoldedConditioningMatchesUnfolded) {
+  ASSERT_TRUE(FoldProjectionLayers(model_path_, kPrefix, /*density=*/1.0f,
+                                   output_dir_));
+  ConditioningType unfolded = CreateConditioning(model_path_);
+  ConditioningType folded = CreateConditioning(output_dir_);
+
+  csrblocksparse::FatCacheAlignedVector<float> features(kNumFeatures, 1);
+  for (int frame = 0; frame < 3; ++frame) {
+    for (int i = 0; i < kNumFeatures; ++i) {
+      features.data()[i] = std::sin(0.1f * (frame * kNumFeatures + i));
+    }
+    unfolded.Precompute(features, /*num_threads=*/1);
+    folded.Precompute(features, /*num_threads=*/1);
+  }
+
+  ASSERT_EQ(folded.num_samples(), unfolded.num_samples());
+  for (int step = 0; step < unfolded.num_samples(); ++step) {
+    const auto unfolded_output = unfolded.AtStep(step);
+    const auto folded_output = folded.AtStep(step);
+    ASSERT_EQ(folded_output.size(), unfolded_output.size());
+    for (int i = 0; i < unfolded_output.size(); ++i) {
+      const float expected = static_cast<float>(unfolded_output[i]);
+      EXPECT_NEAR(static_cast<float>(folded_output[i]), expected,
+                  1e-3f * std::max(1.0f, std::abs(expected)));
+    }
+  }
+}
+
+TEST_F(ProjectionFolderTest, DensityAboveOneFails) {
+  EXPECT_FALSE(FoldProjectionLayers(model_path_, kPrefix, /*density=*/1.5f,
+                                    output_dir_));
+}
+
+TEST_F(ProjectionFolderTest, MissingModelFails) {
+  EXPECT_FALSE(FoldProjectionLayers(model_path_ / "missing", kPrefix,
+                                    /*density=*/0.0f, output_dir_));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -14,12 +14,12 @@
 
 #include "quadrature_mirror_filter.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <type_traits>
 #include <vector>
 
 #include "absl/types/span.h"
-#include "audio/linear_filters/biquad_filter.h"
-#include "audio/linear_filters/biquad_filter_coefficients.h"
 #include "dsp_util.h"
 #include "glog/logging.h"
 
@@ -27,30 +27,53 @@ namespace chromemedia {
 namespace codec {
 namespace {
 
-// Zeros of the 2 all-pass filters that provide the right relative phase
-// difference that allows the splitting and merging of the low and high bands.
-constexpr float zeros_1[] = {0.3255157470703125f, 0.748626708984375f,
-                             0.961456298828125f};
-constexpr float zeros_2[] = {0.097930908203125f, 0.564300537109375f,
-                             0.8737335205078125f};
-
-linear_filters::BiquadFilterCascadeCoefficients AllPassCoefficients(
-    absl::Span<const float> zeros) {
-  std::vector<linear_filters::BiquadFilterCoefficients> coefficients;
-  coefficients.reserve(zeros.size());
-  for (float zero : zeros) {
-    coefficients.push_back(linear_filters::BiquadFilterCoefficients(
-        {zero, 1.f, 0.f}, {1.f, zero, 0.f}));
+// Zeros of the sections of the 2 all-pass filters that provide the right
+// relative phase difference that allows the splitting and merging of the low
+// and high bands, interleaved by filter. Each section has the transfer function
+// (zero + z^-1) / (1 + zero * z^-1).
+constexpr float kZeros[AllPassFilterPair::kNumSections][2] = {
+    {0.3255157470703125f, 0.097930908203125f},
+    {0.748626708984375f, 0.564300537109375f},
+    {0.961456298828125f, 0.8737335205078125f}};
+
+// Converts filtered values times |scale| to the sample type, clipping them to
+// the int16 range if needed.
+template <typename T>
+void FromFloats(float scale, absl::Span<const float> values,
+                absl::Span<T> output) {
+  if constexpr (std::is_same<T, int16_t>::value) {
+    ScaleAndClipToInt16(scale, values, output);
+  } else {
+    std::transform(values.begin(), values.end(), output.begin(),
+                   [scale](float value) { return value * scale; });
   }
-  return linear_filters::BiquadFilterCascadeCoefficients(coefficients);
 }
 
 }  // namespace
 
-template <typename T>
-SplitQuadratureMirrorFilter<T>::SplitQuadratureMirrorFilter() {
-  all_pass_1_.Init(/*num_channels=*/1, AllPassCoefficients(zeros_1));
-  all_pass_2_.Init(/*num_channels=*/1, AllPassCoefficients(zeros_2));
+AllPassFilterPair::AllPassFilterPair() : state_() {}
+
+void AllPassFilterPair::ProcessBlock(absl::Span<float> branch_1,
+                                     absl::Span<float> branch_2) {
+  CHECK_EQ(branch_1.size(), branch_2.size());
+  float state[kNumSections][2];
+  std::copy(&state_[0][0], &state_[0][0] + 2 * kNumSections, &state[0][0]);
+  float* const data_1 = branch_1.data();
+  float* const data_2 = branch_2.data();
+  for (int i = 0; i < branch_1.size(); ++i) {
+    float x[2] = {data_1[i], data_2[i]};
+    for (int section = 0; section < kNumSections; ++section) {
+      // Transposed direct form II, with the same operation on both lanes.
+      for (int lane = 0; lane < 2; ++lane) {
+        const float y = kZeros[section][lane] * x[lane] + state[section][lane];
+        state[section][lane] = x[lane] - kZeros[section][lane] * y;
+        x[lane] = y;
+      }
+    }
+    data_1[i] = x[0];
+    data_2[i] = x[1];
+  }
+  std::copy(&state[0][0], &state[0][0] + 2 * kNumSections, &state_[0][0]);
 }
 
 template <typename T>
@@ -58,29 +81,36 @@ Bands<T> SplitQuadratureMirrorFilter<T>::Split(absl::Span<const T> signal) {
   CHECK_EQ(signal.size() % 2, 0)
       << "The number of samples has to be even, but was " << signal.size()
       << ".";
-  float all_pass_out_1, all_pass_out_2;
   Bands<T> bands(signal.size() / 2);
-  for (int i = 0; i < bands.num_samples_per_band; ++i) {
-    all_pass_1_.ProcessSample(static_cast<float>(signal.at(2 * i)),
-                              &all_pass_out_1);
-    all_pass_2_.ProcessSample(static_cast<float>(signal.at(2 * i + 1)),
-                              &all_pass_out_2);
-    if (std::is_same<T, int16_t>::value) {
-      bands.low_band.at(i) = ClipToInt16((all_pass_out_1 + all_pass_out_2) / 2);
-      bands.high_band.at(i) =
-          ClipToInt16((all_pass_out_1 - all_pass_out_2) / 2);
-    } else {
-      bands.low_band.at(i) = (all_pass_out_1 + all_pass_out_2) / 2;
-      bands.high_band.at(i) = (all_pass_out_1 - all_pass_out_2) / 2;
-    }
-  }
+  Split(signal, absl::MakeSpan(bands.low_band),
+        absl::MakeSpan(bands.high_band));
   return bands;
 }
 
 template <typename T>
-MergeQuadratureMirrorFilter<T>::MergeQuadratureMirrorFilter() {
-  all_pass_1_.Init(/*num_channels=*/1, AllPassCoefficients(zeros_1));
-  all_pass_2_.Init(/*num_channels=*/1, AllPassCoefficients(zeros_2));
+void SplitQuadratureMirrorFilter<T>::Split(absl::Span<const T> signal,
+                                           absl::Span<T> low_band,
+                                           absl::Span<T> high_band) {
+  CHECK_EQ(signal.size() % 2, 0)
+      << "The number of samples has to be even, but was " << signal.size()
+      << ".";
+  const int num_samples_per_band = signal.size() / 2;
+  CHECK_EQ(low_band.size(), num_samples_per_band);
+  CHECK_EQ(high_band.size(), num_samples_per_band);
+  branch_1_.resize(num_samples_per_band);
+  branch_2_.resize(num_samples_per_band);
+  for (int i = 0; i < num_samples_per_band; ++i) {
+    branch_1_[i] = static_cast<float>(signal[2 * i]);
+    branch_2_[i] = static_cast<float>(signal[2 * i + 1]);
+  }
+  all_pass_.ProcessBlock(absl::MakeSpan(branch_1_), absl::MakeSpan(branch_2_));
+  for (int i = 0; i < num_samples_per_band; ++i) {
+    const float sum = branch_1_[i] + branch_2_[i];
+    branch_2_[i] = branch_1_[i] - branch_2_[i];
+    branch_1_[i] = sum;
+  }
+  FromFloats(0.5f, branch_1_, low_band);
+  FromFloats(0.5f, branch_2_, high_band);
 }
 
 template <typename T>
@@ -93,25 +123,43 @@ std::vector<T> MergeQuadratureMirrorFilter<T>::Merge(const Bands<T>& bands) {
       << "The number of samples of all bands has to be "
       << bands.num_samples_per_band << ", but was " << bands.high_band.size()
       << " for the high band.";
-  float all_pass_out_1, all_pass_out_2;
-  std::vector<T> merged_signal;
-  merged_signal.reserve(2 * bands.num_samples_per_band);
-  for (int i = 0; i < bands.num_samples_per_band; ++i) {
-    all_pass_1_.ProcessSample(
-        static_cast<float>(bands.low_band.at(i) - bands.high_band.at(i)),
-        &all_pass_out_1);
-    all_pass_2_.ProcessSample(
-        static_cast<float>(bands.low_band.at(i) + bands.high_band.at(i)),
-        &all_pass_out_2);
-    if (std::is_same<T, int16_t>::value) {
-      merged_signal.push_back(ClipToInt16(all_pass_out_2));
-      merged_signal.push_back(ClipToInt16(all_pass_out_1));
-    } else {
-      merged_signal.push_back(all_pass_out_2);
-      merged_signal.push_back(all_pass_out_1);
+  std::vector<T> merged_signal(2 * bands.num_samples_per_band);
+  Merge(absl::MakeConstSpan(bands.low_band),
+        absl::MakeConstSpan(bands.high_band), absl::MakeSpan(merged_signal));
+  return merged_signal;
+}
+
+template <typename T>
+void MergeQuadratureMirrorFilter<T>::Merge(absl::Span<const T> low_band,
+                                           absl::Span<const T> high_band,
+                                           absl::Span<T> signal) {
+  const int num_samples_per_band = low_band.size();
+  CHECK_EQ(high_band.size(), num_samples_per_band)
+      << "The number of samples of all bands has to be "
+      << num_samples_per_band << ", but was " << high_band.size()
+      << " for the high band.";
+  CHECK_EQ(signal.size(), 2 * num_samples_per_band);
+  branch_1_.resize(num_samples_per_band);
+  branch_2_.resize(num_samples_per_band);
+  for (int i = 0; i < num_samples_per_band; ++i) {
+    branch_1_[i] = static_cast<float>(low_band[i] - high_band[i]);
+    branch_2_[i] = static_cast<float>(low_band[i] + high_band[i]);
+  }
+  all_pass_.ProcessBlock(absl::MakeSpan(branch_1_), absl::MakeSpan(branch_2_));
+  if constexpr (std::is_same<T, int16_t>::value) {
+    // Interleave first, so that all samples get clipped at once.
+    interleaved_.resize(signal.size());
+    for (int i = 0; i < num_samples_per_band; ++i) {
+      interleaved_[2 * i] = branch_2_[i];
+      interleaved_[2 * i + 1] = branch_1_[i];
+    }
+    ClipToInt16(interleaved_, signal);
+  } else {
+    for (int i = 0; i < num_samples_per_band; ++i) {
+      signal[2 * i] = branch_2_[i];
+      signal[2 * i + 1] = branch_1_[i];
     }
   }
-  return merged_signal;
 }
 
 template struct Bands<int16_t>;
@@ -21,7 +21,7 @@
 #include <vector>
 
 #include "absl/types/span.h"
-#include "audio/linear_filters/biquad_filter.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -40,22 +40,50 @@ struct Bands {
   std::vector<T> high_band;
 };
 
+// The two all-pass filters of a quadrature mirror filter bank, each a cascade
+// of first order sections with a relative phase difference that allows the
+// splitting and merging of the low and high bands. Both are run side by side
+// over whole blocks, section by section, so that each step of the pair maps
+// onto two SIMD lanes and the state stays in registers for the block.
+class AllPassFilterPair {
+ public:
+  static constexpr int kNumSections = 3;
+
+  AllPassFilterPair();
+
+  // Filters |branch_1| through the first all-pass filter and |branch_2|
+  // through the second one, in place. Both have to be the same size.
+  void ProcessBlock(absl::Span<float> branch_1, absl::Span<float> branch_2);
+
+  void SaveState(StateWriter* writer) const { writer->Write(state_); }
+  bool RestoreState(StateReader* reader) { return reader->Read(&state_); }
+
+ private:
+  // The delayed value of each section of the first and second filter.
+  float state_[kNumSections][2];
+};
+
 // Quadrature mirror filter bank to split a signal into 2 bands sampled at
 // sub-Nyquist.
 template <typename T>
 class SplitQuadratureMirrorFilter {
  public:
-  SplitQuadratureMirrorFilter();
-
   // Split signal into low and high bands sampled at sub-Nyquist.
   // Signal size has to be even.
   Bands<T> Split(absl::Span<const T> signal);
 
+  // Same as above, but writes the bands into |low_band| and |high_band|, which
+  // have to hold half of the samples of |signal| each.
+  void Split(absl::Span<const T> signal, absl::Span<T> low_band,
+             absl::Span<T> high_band);
+
  private:
-  // Two all-pass filters with a relative phase difference that allows the
-  // splitting of the low and high bands as the sum and difference respectively.
-  linear_filters::BiquadFilterCascade<float> all_pass_1_;
-  linear_filters::BiquadFilterCascade<float> all_pass_2_;
+  // The low and high bands are the sum and difference of the all-pass filtered
+  // even and odd samples respectively.
+  AllPassFilterPair all_pass_;
+  // Reused buffers for the even and odd samples.
+  std::vector<float> branch_1_;
+  std::vector<float> branch_2_;
 };
 
 // Quadrature mirror filter bank to merge 2 bands sampled at sub-Nyquist into a
@@ -63,17 +91,30 @@ class SplitQuadratureMirrorFilter {
 template <typename T>
 class MergeQuadratureMirrorFilter {
  public:
-  MergeQuadratureMirrorFilter();
-
   // Merge the low and high bands sampled at sub-Nyquist into signal.
   // The low and high band have to have the same size as num_samples_per_band.
   std::vector<T> Merge(const Bands<T>& bands);
 
+  // Same as above, but merges |low_band| and |high_band|, which have to have
+  // the same size, into |signal|, which has to be twice as large.
+  void Merge(absl::Span<const T> low_band, absl::Span<const T> high_band,
+             absl::Span<T> signal);
+
+  // Appends the filter state to |writer|, or restores it from |reader|.
+  void SaveState(StateWriter* writer) const { all_pass_.SaveState(writer); }
+  bool RestoreState(StateReader* reader) {
+    return all_pass_.RestoreState(reader);
+  }
+
  private:
-  // Two all-pass filters with a relative phase difference that allows the
-  // merging of the sum and difference of the low and high bands.
-  linear_filters::BiquadFilterCascade<float> all_pass_1_;
-  linear_filters::BiquadFilterCascade<float> all_pass_2_;
+  // The odd and even samples are the all-pass filtered difference and sum of
+  // the low and high bands respectively.
+  AllPassFilterPair all_pass_;
+  // Reused buffers for the difference and sum of the bands.
+  std::vector<float> branch_1_;
+  std::vector<float> branch_2_;
+  // Reused buffer for the merged samples before they are clipped to int16.
+  std::vector<float> interleaved_;
 };
 
 extern template struct Bands<int16_t>;
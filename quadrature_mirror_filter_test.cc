@@ -21,6 +21,7 @@
 #include <random>
 #include <vector>
 
+#include "absl/types/span.h"
 #include "gtest/gtest.h"
 
 namespace chromemedia::codec {
@@ -159,6 +160,38 @@ TYPED_TEST(QuadratureMirrorFiltersTest, Noise) {
             ComputeMaxCorrelation(merged_signal, merged_signal).correlation);
 }
 
+TYPED_TEST(QuadratureMirrorFiltersTest, BlocksContinueTheState) {
+  std::vector<TypeParam> signal(kNumSignalSamples);
+  PopulateWithNoise(&signal);
+  SplitQuadratureMirrorFilter<TypeParam> split_filter;
+  MergeQuadratureMirrorFilter<TypeParam> merge_filter;
+  const Bands<TypeParam> bands = split_filter.Split(signal);
+  const std::vector<TypeParam> merged_signal = merge_filter.Merge(bands);
+
+  // Splitting and merging in two blocks gives the same samples.
+  SplitQuadratureMirrorFilter<TypeParam> block_split_filter;
+  MergeQuadratureMirrorFilter<TypeParam> block_merge_filter;
+  const absl::Span<const TypeParam> signal_span = absl::MakeConstSpan(signal);
+  constexpr int kFirstBlockSize = 2 * 37;
+  const Bands<TypeParam> first_bands =
+      block_split_filter.Split(signal_span.subspan(0, kFirstBlockSize));
+  const Bands<TypeParam> second_bands =
+      block_split_filter.Split(signal_span.subspan(kFirstBlockSize));
+  std::vector<TypeParam> block_merged_signal =
+      block_merge_filter.Merge(first_bands);
+  const std::vector<TypeParam> second_merged_signal =
+      block_merge_filter.Merge(second_bands);
+  block_merged_signal.insert(block_merged_signal.end(),
+                             second_merged_signal.begin(),
+                             second_merged_signal.end());
+
+  std::vector<TypeParam> block_low_band = first_bands.low_band;
+  block_low_band.insert(block_low_band.end(), second_bands.low_band.begin(),
+                        second_bands.low_band.end());
+  EXPECT_EQ(bands.low_band, block_low_band);
+  EXPECT_EQ(merged_signal, block_merged_signal);
+}
+
 class QuadratureMirrorFiltersSineTest : public testing::TestWithParam<int> {};
 
 TEST_P(QuadratureMirrorFiltersSineTest, Sine) {
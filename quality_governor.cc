@@ -0,0 +1,80 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "quality_governor.h"
+
+#include <cmath>
+#include <memory>
+
+#include "absl/memory/memory.h"
+#include "glog/logging.h"
+#include "quality_level.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<QualityGovernor> QualityGovernor::Create(
+    float resume_real_time_factor, float max_real_time_factor) {
+  if (!(resume_real_time_factor > 0.f &&
+        resume_real_time_factor < max_real_time_factor)) {
+    LOG(ERROR) << "The resume real time factor " << resume_real_time_factor
+               << " has to be positive and lower than the maximum "
+               << max_real_time_factor << ".";
+    return nullptr;
+  }
+  return absl::WrapUnique(
+      new QualityGovernor(resume_real_time_factor, max_real_time_factor));
+}
+
+QualityGovernor::QualityGovernor(float resume_real_time_factor,
+                                 float max_real_time_factor)
+    : resume_real_time_factor_(resume_real_time_factor),
+      max_real_time_factor_(max_real_time_factor),
+      real_time_factor_(0.0),
+      // The first level may change right away.
+      seconds_at_level_(kMinHoldSeconds),
+      quality_level_(QualityLevel::kFull) {}
+
+QualityLevel QualityGovernor::Update(double processing_seconds,
+                                     double audio_seconds) {
+  if (!(audio_seconds > 0.0)) {
+    return quality_level_;
+  }
+  // Exponential average over audio time, so that it does not depend on how
+  // much audio each call covers.
+  const double weight = 1.0 - std::exp(-audio_seconds / kSmoothingSeconds);
+  real_time_factor_ +=
+      weight * (processing_seconds / audio_seconds - real_time_factor_);
+  seconds_at_level_ += audio_seconds;
+  if (seconds_at_level_ < kMinHoldSeconds) {
+    return quality_level_;
+  }
+
+  QualityLevel next_level = quality_level_;
+  if (quality_level_ == QualityLevel::kFull &&
+      real_time_factor_ > max_real_time_factor_) {
+    next_level = QualityLevel::kReduced;
+  } else if (quality_level_ == QualityLevel::kReduced &&
+             real_time_factor_ < resume_real_time_factor_) {
+    next_level = QualityLevel::kFull;
+  }
+  if (next_level != quality_level_) {
+    quality_level_ = next_level;
+    seconds_at_level_ = 0.0;
+  }
+  return quality_level_;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
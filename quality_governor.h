@@ -0,0 +1,74 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_QUALITY_GOVERNOR_H_
+#define LYRA_CODEC_QUALITY_GOVERNOR_H_
+
+#include <memory>
+
+#include "quality_level.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Chooses the |QualityLevel| to decode at from the observed real time factor,
+// the time spent decoding over the duration of the audio decoded.
+//
+// A server may feed it the decoding time of all its streams against the audio
+// time its cores had available for them and apply the level to every decoder,
+// or keep one per stream. This class is not thread-safe.
+class QualityGovernor {
+ public:
+  // Audio time over which real time factors are averaged. Averaging keeps
+  // one slow packet from lowering the level.
+  static constexpr double kSmoothingSeconds = 1.0;
+  // Audio time a level is kept for at least after changing. While the level
+  // is reduced the real time factor drops, so without holding it the level
+  // would go back up as soon as the average caught up.
+  static constexpr double kMinHoldSeconds = 5.0;
+
+  // The level is reduced once the average real time factor exceeds
+  // |max_real_time_factor| and restored once it falls below
+  // |resume_real_time_factor|. Returns a nullptr unless
+  // 0 < |resume_real_time_factor| < |max_real_time_factor|.
+  static std::unique_ptr<QualityGovernor> Create(float resume_real_time_factor,
+                                                 float max_real_time_factor);
+
+  // Records that decoding |audio_seconds| of audio took |processing_seconds|
+  // and returns the level to decode the following audio at. Calls with
+  // non-positive |audio_seconds| are ignored.
+  QualityLevel Update(double processing_seconds, double audio_seconds);
+
+  QualityLevel quality_level() const { return quality_level_; }
+
+  // The average real time factor.
+  double real_time_factor() const { return real_time_factor_; }
+
+ private:
+  QualityGovernor(float resume_real_time_factor, float max_real_time_factor);
+
+  const float resume_real_time_factor_;
+  const float max_real_time_factor_;
+  double real_time_factor_;
+  // Audio time since the level last changed.
+  double seconds_at_level_;
+  QualityLevel quality_level_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_QUALITY_GOVERNOR_H_
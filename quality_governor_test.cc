@@ -0,0 +1,101 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "quality_governor.h"
+
+#include "gtest/gtest.h"
+#include "quality_level.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr float kResumeRealTimeFactor = 0.5f;
+constexpr float kMaxRealTimeFactor = 0.8f;
+constexpr double kPacketSeconds = 0.04;
+
+// Feeds packets decoded at |real_time_factor| for |audio_seconds| and returns
+// the last level.
+QualityLevel RunAt(QualityGovernor* governor, double real_time_factor,
+                   double audio_seconds) {
+  QualityLevel level = governor->quality_level();
+  for (double t = 0.0; t < audio_seconds; t += kPacketSeconds) {
+    level = governor->Update(real_time_factor * kPacketSeconds, kPacketSeconds);
+  }
+  return level;
+}
+
+TEST(QualityGovernorTest, InvalidFactorsFail) {
+  EXPECT_EQ(QualityGovernor::Create(0.f, kMaxRealTimeFactor), nullptr);
+  EXPECT_EQ(QualityGovernor::Create(kMaxRealTimeFactor, kMaxRealTimeFactor),
+            nullptr);
+  EXPECT_EQ(QualityGovernor::Create(kMaxRealTimeFactor, kResumeRealTimeFactor),
+            nullptr);
+}
+
+TEST(QualityGovernorTest, StaysFullWhileRealTime) {
+  auto governor =
+      QualityGovernor::Create(kResumeRealTimeFactor, kMaxRealTimeFactor);
+  ASSERT_NE(governor, nullptr);
+  EXPECT_EQ(governor->quality_level(), QualityLevel::kFull);
+  EXPECT_EQ(RunAt(governor.get(), 0.7, 10.0), QualityLevel::kFull);
+  EXPECT_NEAR(governor->real_time_factor(), 0.7, 1e-3);
+}
+
+TEST(QualityGovernorTest, OneSlowPacketDoesNotReduce) {
+  auto governor =
+      QualityGovernor::Create(kResumeRealTimeFactor, kMaxRealTimeFactor);
+  ASSERT_NE(governor, nullptr);
+  RunAt(governor.get(), 0.3, 2.0);
+  EXPECT_EQ(governor->Update(2.0 * kPacketSeconds, kPacketSeconds),
+            QualityLevel::kFull);
+}
+
+TEST(QualityGovernorTest, ReducesUnderOverloadAndRestoresAfterHold) {
+  auto governor =
+      QualityGovernor::Create(kResumeRealTimeFactor, kMaxRealTimeFactor);
+  ASSERT_NE(governor, nullptr);
+  // Overload reduces the level within a few smoothing periods.
+  EXPECT_EQ(RunAt(governor.get(), 1.5, 3 * QualityGovernor::kSmoothingSeconds),
+            QualityLevel::kReduced);
+
+  // The reduced level is held even though decoding became cheap.
+  EXPECT_EQ(RunAt(governor.get(), 0.1, QualityGovernor::kMinHoldSeconds / 2),
+            QualityLevel::kReduced);
+  EXPECT_EQ(RunAt(governor.get(), 0.1, QualityGovernor::kMinHoldSeconds),
+            QualityLevel::kFull);
+}
+
+TEST(QualityGovernorTest, StaysReducedBetweenThresholds) {
+  auto governor =
+      QualityGovernor::Create(kResumeRealTimeFactor, kMaxRealTimeFactor);
+  ASSERT_NE(governor, nullptr);
+  ASSERT_EQ(RunAt(governor.get(), 1.5, 3 * QualityGovernor::kSmoothingSeconds),
+            QualityLevel::kReduced);
+  EXPECT_EQ(RunAt(governor.get(), 0.65, 3 * QualityGovernor::kMinHoldSeconds),
+            QualityLevel::kReduced);
+}
+
+TEST(QualityGovernorTest, NonPositiveAudioIsIgnored) {
+  auto governor =
+      QualityGovernor::Create(kResumeRealTimeFactor, kMaxRealTimeFactor);
+  ASSERT_NE(governor, nullptr);
+  EXPECT_EQ(governor->Update(1.0, 0.0), QualityLevel::kFull);
+  EXPECT_EQ(governor->Update(1.0, -1.0), QualityLevel::kFull);
+  EXPECT_EQ(governor->real_time_factor(), 0.0);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_QUALITY_LEVEL_H_
+#define LYRA_CODEC_QUALITY_LEVEL_H_
+
+namespace chromemedia {
+namespace codec {
+
+// How much work the decoder may spend per packet. Lower levels replace the
+// generative model with comfort noise wherever the result is not speech
+// received in a packet, so an overloaded host can keep many streams real
+// time instead of glitching all of them.
+enum class QualityLevel {
+  // The generative model renders all received packets and conceals lost ones.
+  kFull,
+  // Lost packets are concealed with comfort noise right away, and received
+  // background noise is decoded as comfort noise.
+  kReduced,
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_QUALITY_LEVEL_H_
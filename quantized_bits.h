@@ -0,0 +1,132 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_QUANTIZED_BITS_H_
+#define LYRA_CODEC_QUANTIZED_BITS_H_
+
+#include <array>
+#include <cstdint>
+
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A fixed capacity sequence of bits, as produced by a vector quantizer for one
+// packet. The bits are packed into words, the first bit being the most
+// significant bit of the first word, so that they can be moved in and out of
+// packets without going through one byte per bit.
+class QuantizedBits {
+ public:
+  static constexpr int kMaxNumBits = 256;
+
+  // An empty sequence.
+  QuantizedBits() : num_bits_(0), words_{} {}
+
+  // A sequence of |num_bits| zeros.
+  explicit QuantizedBits(int num_bits) : QuantizedBits() { Resize(num_bits); }
+
+  int num_bits() const { return num_bits_; }
+
+  // Truncates the sequence or pads it with zeros to |num_bits|.
+  void Resize(int num_bits) {
+    CHECK_GE(num_bits, 0);
+    CHECK_LE(num_bits, kMaxNumBits);
+    // Clear everything past the new end, so that equal sequences have equal
+    // words.
+    for (int word = num_bits / kWordBits; word < kNumWords; ++word) {
+      const int word_start = word * kWordBits;
+      if (word_start >= num_bits) {
+        words_[word] = 0;
+      } else {
+        words_[word] &= ~(~uint64_t{0} >> (num_bits - word_start));
+      }
+    }
+    num_bits_ = num_bits;
+  }
+
+  // Appends the |num_bits| least significant bits of |value|, most significant
+  // bit first. |num_bits| has to be at most 64.
+  void Append(uint64_t value, int num_bits) {
+    CHECK_GE(num_bits, 0);
+    CHECK_LE(num_bits, kWordBits);
+    CHECK_LE(num_bits_ + num_bits, kMaxNumBits);
+    if (num_bits == 0) {
+      return;
+    }
+    // Move the bits to the top of a word.
+    const uint64_t bits = value << (kWordBits - num_bits);
+    const int word = num_bits_ / kWordBits;
+    const int offset = num_bits_ % kWordBits;
+    words_[word] |= bits >> offset;
+    // Spill the rest over into the next word.
+    if (offset + num_bits > kWordBits) {
+      words_[word + 1] |= bits << (kWordBits - offset);
+    }
+    num_bits_ += num_bits;
+  }
+
+  // Returns the |num_bits| bits starting at bit |start| as the least
+  // significant bits of the result. |num_bits| has to be at most 32 and the
+  // bits past the end of the sequence read as zeros.
+  uint32_t Read(int start, int num_bits) const {
+    CHECK_GE(start, 0);
+    CHECK_LE(num_bits, 32);
+    CHECK_LE(start + num_bits, kMaxNumBits);
+    if (num_bits == 0) {
+      return 0;
+    }
+    return static_cast<uint32_t>(ReadWord(start) >> (kWordBits - num_bits));
+  }
+
+  // Returns the 64 bits starting at bit |start|, the first one being the most
+  // significant bit. |start| may be negative, and the bits outside of the
+  // sequence read as zeros.
+  uint64_t ReadWord(int start) const {
+    if (start <= -kWordBits || start >= kMaxNumBits) {
+      return 0;
+    }
+    if (start < 0) {
+      return ReadWord(0) >> -start;
+    }
+    const int word = start / kWordBits;
+    const int offset = start % kWordBits;
+    uint64_t bits = words_[word] << offset;
+    if (offset > 0 && word + 1 < kNumWords) {
+      bits |= words_[word + 1] >> (kWordBits - offset);
+    }
+    return bits;
+  }
+
+  bool operator==(const QuantizedBits& other) const {
+    return num_bits_ == other.num_bits_ && words_ == other.words_;
+  }
+  bool operator!=(const QuantizedBits& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  static constexpr int kWordBits = 64;
+  static constexpr int kNumWords = kMaxNumBits / kWordBits;
+
+  int num_bits_;
+  std::array<uint64_t, kNumWords> words_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_QUANTIZED_BITS_H_
@@ -0,0 +1,107 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "quantized_bits.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(QuantizedBitsTest, DefaultIsEmpty) {
+  EXPECT_EQ(QuantizedBits().num_bits(), 0);
+  EXPECT_EQ(QuantizedBits(), QuantizedBits(0));
+}
+
+TEST(QuantizedBitsTest, SizedIsZeros) {
+  const QuantizedBits bits(100);
+  EXPECT_EQ(bits.num_bits(), 100);
+  for (int i = 0; i < 100; i += 20) {
+    EXPECT_EQ(bits.Read(i, 20), 0);
+  }
+}
+
+TEST(QuantizedBitsTest, ReadsAppendedValuesAcrossWords) {
+  QuantizedBits bits;
+  // 17 values of 13 bits straddle every word boundary.
+  for (uint32_t i = 0; i < 17; ++i) {
+    bits.Append(0x1000 + 37 * i, 13);
+  }
+  ASSERT_EQ(bits.num_bits(), 17 * 13);
+  for (uint32_t i = 0; i < 17; ++i) {
+    EXPECT_EQ(bits.Read(13 * i, 13), 0x1000 + 37 * i);
+  }
+}
+
+TEST(QuantizedBitsTest, FirstBitIsMostSignificant) {
+  QuantizedBits bits;
+  bits.Append(0b101, 3);
+  bits.Append(0b0011, 4);
+  EXPECT_EQ(bits.Read(0, 7), 0b1010011);
+  EXPECT_EQ(bits.Read(0, 1), 1);
+  EXPECT_EQ(bits.Read(1, 1), 0);
+}
+
+TEST(QuantizedBitsTest, ReadsWordsAtAnyOffset) {
+  QuantizedBits bits;
+  bits.Append(0xfedcba9876543210, 64);
+  bits.Append(0x0123456789abcdef, 64);
+  EXPECT_EQ(bits.ReadWord(0), 0xfedcba9876543210);
+  EXPECT_EQ(bits.ReadWord(4), 0xedcba98765432100);
+  EXPECT_EQ(bits.ReadWord(-8), 0x00fedcba98765432);
+  EXPECT_EQ(bits.ReadWord(120), 0xef00000000000000);
+  EXPECT_EQ(bits.ReadWord(-64), 0);
+  EXPECT_EQ(bits.ReadWord(QuantizedBits::kMaxNumBits), 0);
+}
+
+TEST(QuantizedBitsTest, AppendIgnoresHigherBits) {
+  QuantizedBits bits;
+  bits.Append(0xff, 4);
+  bits.Append(0, 4);
+  EXPECT_EQ(bits.Read(0, 8), 0xf0);
+}
+
+TEST(QuantizedBitsTest, ResizeTruncatesAndPadsWithZeros) {
+  QuantizedBits bits;
+  bits.Append(0xffffffff, 32);
+  bits.Append(0xffffffff, 32);
+  bits.Append(0xffffffff, 32);
+  bits.Resize(70);
+  EXPECT_EQ(bits.num_bits(), 70);
+  EXPECT_EQ(bits.Read(64, 6), 0b111111);
+  bits.Resize(120);
+  EXPECT_EQ(bits.Read(64, 32), 0xfc000000);
+
+  QuantizedBits expected;
+  expected.Append(0xffffffff, 32);
+  expected.Append(0xffffffff, 32);
+  expected.Append(0b111111, 6);
+  expected.Resize(120);
+  EXPECT_EQ(bits, expected);
+}
+
+TEST(QuantizedBitsTest, EqualityComparesSizes) {
+  QuantizedBits bits;
+  bits.Append(1, 1);
+  QuantizedBits longer = bits;
+  longer.Resize(2);
+  EXPECT_NE(bits, longer);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
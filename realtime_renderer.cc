@@ -0,0 +1,149 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "realtime_renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "glog/logging.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::unique_ptr<RealtimeRenderer> RealtimeRenderer::Create(
+    int sample_rate_hz, int samples_per_buffer, int num_buffers_ahead,
+    SampleSource source) {
+  if (sample_rate_hz <= 0) {
+    LOG(ERROR) << "The sample rate has to be positive, but is "
+               << sample_rate_hz << ".";
+    return nullptr;
+  }
+  if (samples_per_buffer <= 0) {
+    LOG(ERROR) << "The number of samples per buffer has to be positive, but is "
+               << samples_per_buffer << ".";
+    return nullptr;
+  }
+  if (num_buffers_ahead <= 0) {
+    LOG(ERROR) << "The number of buffers ahead has to be positive, but is "
+               << num_buffers_ahead << ".";
+    return nullptr;
+  }
+  if (!source) {
+    LOG(ERROR) << "The renderer needs a sample source.";
+    return nullptr;
+  }
+  return absl::WrapUnique(new RealtimeRenderer(sample_rate_hz,
+                                               samples_per_buffer,
+                                               num_buffers_ahead,
+                                               std::move(source)));
+}
+
+RealtimeRenderer::RealtimeRenderer(int sample_rate_hz, int samples_per_buffer,
+                                   int num_buffers_ahead, SampleSource source)
+    : samples_per_buffer_(samples_per_buffer),
+      capacity_((num_buffers_ahead + 1) * samples_per_buffer),
+      poll_interval_(absl::Seconds(samples_per_buffer) / sample_rate_hz / 4),
+      source_(std::move(source)),
+      ring_(capacity_),
+      write_position_(0),
+      read_position_(0),
+      num_samples_underrun_(0),
+      num_underruns_(0),
+      num_source_failures_(0),
+      terminate_(false) {
+  worker_ =
+      absl::make_unique<csrblocksparse::Thread>([this]() { RunWorker(); });
+}
+
+RealtimeRenderer::~RealtimeRenderer() {
+  terminate_.store(true, std::memory_order_relaxed);
+  worker_->join();
+}
+
+void RealtimeRenderer::RunWorker() {
+  int64_t write_position = write_position_.load(std::memory_order_relaxed);
+  while (!terminate_.load(std::memory_order_relaxed)) {
+    const int64_t read_position =
+        read_position_.load(std::memory_order_acquire);
+    if (write_position - read_position + samples_per_buffer_ > capacity_) {
+      absl::SleepFor(poll_interval_);
+      continue;
+    }
+    // Writes always start at a multiple of |samples_per_buffer_|, which
+    // |capacity_| is a multiple of too, so a buffer never wraps around.
+    const absl::Span<int16_t> buffer = absl::MakeSpan(
+        ring_.data() + write_position % capacity_, samples_per_buffer_);
+    if (!source_(buffer)) {
+      num_source_failures_.fetch_add(1, std::memory_order_relaxed);
+      std::fill(buffer.begin(), buffer.end(), 0);
+    }
+    write_position += samples_per_buffer_;
+    write_position_.store(write_position, std::memory_order_release);
+  }
+}
+
+int RealtimeRenderer::Render(absl::Span<int16_t> output) {
+  const int64_t read_position = read_position_.load(std::memory_order_relaxed);
+  const int num_available = static_cast<int>(
+      write_position_.load(std::memory_order_acquire) - read_position);
+  const int num_samples =
+      std::min(num_available, static_cast<int>(output.size()));
+
+  const int start = static_cast<int>(read_position % capacity_);
+  const int num_before_wrap = std::min(num_samples, capacity_ - start);
+  std::copy_n(ring_.begin() + start, num_before_wrap, output.begin());
+  std::copy_n(ring_.begin(), num_samples - num_before_wrap,
+              output.begin() + num_before_wrap);
+  read_position_.store(read_position + num_samples, std::memory_order_release);
+
+  if (num_samples < static_cast<int>(output.size())) {
+    std::fill(output.begin() + num_samples, output.end(), 0);
+    num_samples_underrun_.fetch_add(output.size() - num_samples,
+                                    std::memory_order_relaxed);
+    num_underruns_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return num_samples;
+}
+
+int RealtimeRenderer::num_samples_buffered() const {
+  // Reading first keeps the difference from going negative, since the read
+  // position never passes the write position.
+  const int64_t read_position = read_position_.load(std::memory_order_acquire);
+  return static_cast<int>(write_position_.load(std::memory_order_acquire) -
+                          read_position);
+}
+
+RealtimeRenderer::Statistics RealtimeRenderer::statistics() const {
+  Statistics statistics;
+  statistics.num_samples_rendered =
+      read_position_.load(std::memory_order_relaxed);
+  statistics.num_samples_underrun =
+      num_samples_underrun_.load(std::memory_order_relaxed);
+  statistics.num_underruns = num_underruns_.load(std::memory_order_relaxed);
+  statistics.num_source_failures =
+      num_source_failures_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_REALTIME_RENDERER_H_
+#define LYRA_CODEC_REALTIME_RENDERER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Serves audio to a device callback that runs on a real-time thread and asks
+// for a fixed number of samples at a time. Running the generative model inside
+// such a callback misses its deadline whenever a packet boundary lands in it,
+// so a worker thread generates the audio ahead of time into a lock-free single
+// producer single consumer ring buffer, and |Render| only copies out of it.
+//
+// The worker keeps between |num_buffers_ahead| and |num_buffers_ahead| + 1
+// device buffers generated, which is the latency the renderer adds.
+class RealtimeRenderer {
+ public:
+  // Writes the next |samples| to be played. Returns false on failure, in which
+  // case silence is played instead. Typically wraps
+  // |LyraJitterBuffer::GetAudio| or |LyraDecoderInterface::DecodeSamples|.
+  using SampleSource = std::function<bool(absl::Span<int16_t>)>;
+
+  struct Statistics {
+    int64_t num_samples_rendered = 0;
+    // Samples |Render| had to fill with silence because the worker was late.
+    int64_t num_samples_underrun = 0;
+    // Calls to |Render| that were short of samples.
+    int64_t num_underruns = 0;
+    int64_t num_source_failures = 0;
+  };
+
+  // |source| is only called on the worker thread, one call per device buffer
+  // of |samples_per_buffer| samples at |sample_rate_hz|; if it shares state
+  // with other threads, e.g. a jitter buffer receiving packets, it has to
+  // synchronize with them itself. Returns a nullptr if an argument is not
+  // positive or |source| is empty.
+  static std::unique_ptr<RealtimeRenderer> Create(int sample_rate_hz,
+                                                  int samples_per_buffer,
+                                                  int num_buffers_ahead,
+                                                  SampleSource source);
+
+  // Stops the worker thread.
+  ~RealtimeRenderer();
+
+  // Fills |output| with the next samples and returns how many of them were
+  // generated audio rather than silence. Does not block, allocate or call
+  // |source|, so it is safe to call on a real-time thread. Has to be called
+  // from one thread at a time.
+  int Render(absl::Span<int16_t> output);
+
+  // Number of generated samples not yet rendered. Thread-safe.
+  int num_samples_buffered() const;
+
+  // Thread-safe.
+  Statistics statistics() const;
+
+ private:
+  RealtimeRenderer(int sample_rate_hz, int samples_per_buffer,
+                   int num_buffers_ahead, SampleSource source);
+
+  void RunWorker();
+
+  const int samples_per_buffer_;
+  const int capacity_;
+  // How long the worker sleeps when the ring buffer is full.
+  const absl::Duration poll_interval_;
+  const SampleSource source_;
+
+  std::vector<int16_t> ring_;
+  // Total number of samples ever written by the worker and read by |Render|.
+  // Each is only advanced by its own side. Kept on separate cache lines so
+  // that the two threads do not contend for them.
+  alignas(64) std::atomic<int64_t> write_position_;
+  alignas(64) std::atomic<int64_t> read_position_;
+
+  std::atomic<int64_t> num_samples_underrun_;
+  std::atomic<int64_t> num_underruns_;
+  std::atomic<int64_t> num_source_failures_;
+
+  std::atomic<bool> terminate_;
+  std::unique_ptr<csrblocksparse::Thread> worker_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_REALTIME_RENDERER_H_
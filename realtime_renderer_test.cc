@@ -0,0 +1,168 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "realtime_renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::Each;
+using testing::Eq;
+
+constexpr int kSampleRateHz = 16000;
+// 10 ms device buffers.
+constexpr int kSamplesPerBuffer = kSampleRateHz / 100;
+constexpr int kNumBuffersAhead = 2;
+
+// Waits until the worker generated at least |num_samples|.
+void WaitForSamples(const RealtimeRenderer& renderer, int num_samples) {
+  while (renderer.num_samples_buffered() < num_samples) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+}
+
+// Writes consecutive sample values, counting the samples written.
+class CountingSource {
+ public:
+  RealtimeRenderer::SampleSource AsSource() {
+    return [this](absl::Span<int16_t> samples) {
+      for (int16_t& sample : samples) {
+        sample = next_sample_++;
+      }
+      num_samples_.fetch_add(samples.size());
+      return true;
+    };
+  }
+
+  int64_t num_samples() const { return num_samples_.load(); }
+
+ private:
+  int16_t next_sample_ = 0;
+  std::atomic<int64_t> num_samples_{0};
+};
+
+TEST(RealtimeRendererTest, CreateFailsWithInvalidArguments) {
+  const auto source = [](absl::Span<int16_t>) { return true; };
+  EXPECT_EQ(RealtimeRenderer::Create(0, kSamplesPerBuffer, kNumBuffersAhead,
+                                     source),
+            nullptr);
+  EXPECT_EQ(RealtimeRenderer::Create(kSampleRateHz, 0, kNumBuffersAhead,
+                                     source),
+            nullptr);
+  EXPECT_EQ(RealtimeRenderer::Create(kSampleRateHz, kSamplesPerBuffer, 0,
+                                     source),
+            nullptr);
+  EXPECT_EQ(RealtimeRenderer::Create(kSampleRateHz, kSamplesPerBuffer,
+                                     kNumBuffersAhead, nullptr),
+            nullptr);
+}
+
+TEST(RealtimeRendererTest, RendersSourceSamplesInOrder) {
+  CountingSource source;
+  auto renderer = RealtimeRenderer::Create(kSampleRateHz, kSamplesPerBuffer,
+                                           kNumBuffersAhead, source.AsSource());
+  ASSERT_NE(renderer, nullptr);
+
+  // Sizes that do not divide the ring buffer, so that reads wrap around.
+  constexpr int kNumSamplesPerRender = kSamplesPerBuffer / 2 + 7;
+  std::vector<int16_t> output(kNumSamplesPerRender);
+  int16_t expected_sample = 0;
+  for (int i = 0; i < 20; ++i) {
+    WaitForSamples(*renderer, kNumSamplesPerRender);
+    ASSERT_EQ(renderer->Render(absl::MakeSpan(output)), kNumSamplesPerRender);
+    for (int16_t sample : output) {
+      ASSERT_EQ(sample, expected_sample++);
+    }
+  }
+  EXPECT_EQ(renderer->statistics().num_samples_rendered,
+            20 * kNumSamplesPerRender);
+  EXPECT_EQ(renderer->statistics().num_underruns, 0);
+}
+
+TEST(RealtimeRendererTest, WorkerStaysAtMostOneBufferBeyondTarget) {
+  CountingSource source;
+  auto renderer = RealtimeRenderer::Create(kSampleRateHz, kSamplesPerBuffer,
+                                           kNumBuffersAhead, source.AsSource());
+  ASSERT_NE(renderer, nullptr);
+
+  constexpr int kCapacity = (kNumBuffersAhead + 1) * kSamplesPerBuffer;
+  WaitForSamples(*renderer, kCapacity);
+  absl::SleepFor(absl::Milliseconds(20));
+  EXPECT_EQ(source.num_samples(), kCapacity);
+  EXPECT_EQ(renderer->num_samples_buffered(), kCapacity);
+
+  // Rendering one buffer makes room for exactly one more.
+  std::vector<int16_t> output(kSamplesPerBuffer);
+  renderer->Render(absl::MakeSpan(output));
+  WaitForSamples(*renderer, kCapacity);
+  absl::SleepFor(absl::Milliseconds(20));
+  EXPECT_EQ(source.num_samples(), kCapacity + kSamplesPerBuffer);
+}
+
+TEST(RealtimeRendererTest, UnderrunRendersSilence) {
+  absl::Notification release_source;
+  auto renderer = RealtimeRenderer::Create(
+      kSampleRateHz, kSamplesPerBuffer, kNumBuffersAhead,
+      [&release_source](absl::Span<int16_t> samples) {
+        release_source.WaitForNotification();
+        std::fill(samples.begin(), samples.end(), 1);
+        return true;
+      });
+  ASSERT_NE(renderer, nullptr);
+
+  std::vector<int16_t> output(kSamplesPerBuffer, 1);
+  EXPECT_EQ(renderer->Render(absl::MakeSpan(output)), 0);
+  EXPECT_THAT(output, Each(Eq(0)));
+  EXPECT_EQ(renderer->statistics().num_underruns, 1);
+  EXPECT_EQ(renderer->statistics().num_samples_underrun, kSamplesPerBuffer);
+
+  release_source.Notify();
+  WaitForSamples(*renderer, kSamplesPerBuffer);
+  EXPECT_EQ(renderer->Render(absl::MakeSpan(output)), kSamplesPerBuffer);
+  EXPECT_THAT(output, Each(Eq(1)));
+  EXPECT_EQ(renderer->statistics().num_underruns, 1);
+}
+
+TEST(RealtimeRendererTest, SourceFailureRendersSilence) {
+  auto renderer = RealtimeRenderer::Create(
+      kSampleRateHz, kSamplesPerBuffer, kNumBuffersAhead,
+      [](absl::Span<int16_t> samples) {
+        std::fill(samples.begin(), samples.end(), 1);
+        return false;
+      });
+  ASSERT_NE(renderer, nullptr);
+
+  WaitForSamples(*renderer, kSamplesPerBuffer);
+  std::vector<int16_t> output(kSamplesPerBuffer, 1);
+  EXPECT_EQ(renderer->Render(absl::MakeSpan(output)), kSamplesPerBuffer);
+  EXPECT_THAT(output, Each(Eq(0)));
+  EXPECT_GE(renderer->statistics().num_source_failures, 1);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
@@ -24,44 +25,114 @@
 #include "audio/dsp/resampler_q.h"
 #include "dsp_util.h"
 #include "glog/logging.h"
+#include "polyphase_resampler.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
 std::unique_ptr<Resampler> Resampler::Create(double input_sample_rate_hz,
                                              double target_sample_rate_hz) {
+  if (PolyphaseResampler::SupportsRates(input_sample_rate_hz,
+                                        target_sample_rate_hz)) {
+    auto polyphase_resampler =
+        PolyphaseResampler::Create(input_sample_rate_hz, target_sample_rate_hz);
+    if (polyphase_resampler == nullptr) {
+      LOG(ERROR) << "Error creating PolyphaseResampler.";
+      return nullptr;
+    }
+    return absl::WrapUnique(new Resampler(std::move(polyphase_resampler)));
+  }
   audio_dsp::QResamplerParams params;
   // Set kernel radius to 17 input samples. Since `ResetFullyPrimed()` is used
   // below, the resampler has a delay of 2 * 17 input samples, or about 2 ms
   // at 16 kHz input sample rate.
   params.filter_radius_factor =
       17.0 * std::min(1.0, target_sample_rate_hz / input_sample_rate_hz);
-  audio_dsp::QResampler<float> dsp_resampler(
+  auto dsp_resampler = absl::make_unique<audio_dsp::QResampler<float>>(
       input_sample_rate_hz, target_sample_rate_hz, /*num_channels=*/1, params);
-  if (!dsp_resampler.Valid()) {
+  if (!dsp_resampler->Valid()) {
     LOG(ERROR) << "Error creating QResampler.";
     return nullptr;
   }
-  return absl::WrapUnique(new Resampler(dsp_resampler));
+  return absl::WrapUnique(new Resampler(std::move(dsp_resampler)));
 }
 
 Resampler::~Resampler() {}
 
-Resampler::Resampler(audio_dsp::QResampler<float> dsp_resampler)
-    : resampler_(std::move(dsp_resampler)) {
-  resampler_.ResetFullyPrimed();
+Resampler::Resampler(std::unique_ptr<PolyphaseResampler> polyphase_resampler)
+    : polyphase_resampler_(std::move(polyphase_resampler)) {}
+
+Resampler::Resampler(
+    std::unique_ptr<audio_dsp::QResampler<float>> dsp_resampler)
+    : dsp_resampler_(std::move(dsp_resampler)) {
+  dsp_resampler_->ResetFullyPrimed();
 }
 
 std::vector<int16_t> Resampler::Resample(absl::Span<const int16_t> audio) {
-  std::vector<float> input_floats(audio.begin(), audio.end());
-  std::vector<float> output_floats;
-  resampler_.ProcessSamples(input_floats, &output_floats);
-  std::vector<int16_t> output(output_floats.size());
-  std::transform(output_floats.begin(), output_floats.end(), output.begin(),
-                 ClipToInt16);
+  if (polyphase_resampler_ != nullptr) {
+    std::vector<int16_t> output(
+        polyphase_resampler_->NumOutputSamples(audio.size()));
+    polyphase_resampler_->Process(audio, absl::MakeSpan(output));
+    return output;
+  }
+  ResampleToFloats(audio);
+  std::vector<int16_t> output(output_floats_.size());
+  ClipToInt16(output_floats_, absl::MakeSpan(output));
   return output;
 }
 
-void Resampler::Reset() { resampler_.ResetFullyPrimed(); }
+int Resampler::ResampleInto(absl::Span<const int16_t> audio,
+                            absl::Span<int16_t> output) {
+  if (polyphase_resampler_ != nullptr) {
+    return polyphase_resampler_->Process(audio, output);
+  }
+  ResampleToFloats(audio);
+  const int num_to_write =
+      std::min(output_floats_.size(), static_cast<size_t>(output.size()));
+  ClipToInt16(absl::MakeConstSpan(output_floats_).first(num_to_write),
+              output.first(num_to_write));
+  return output_floats_.size();
+}
+
+int Resampler::ResampleIntoFloats(absl::Span<const int16_t> audio,
+                                  absl::Span<float> output) {
+  if (polyphase_resampler_ != nullptr) {
+    return polyphase_resampler_->Process(audio, output);
+  }
+  ResampleToFloats(audio);
+  std::copy_n(
+      output_floats_.begin(),
+      std::min(output_floats_.size(), static_cast<size_t>(output.size())),
+      output.begin());
+  return output_floats_.size();
+}
+
+void Resampler::ResampleToFloats(absl::Span<const int16_t> audio) {
+  input_floats_.resize(audio.size());
+  Int16ToFloat(audio, absl::MakeSpan(input_floats_));
+  dsp_resampler_->ProcessSamples(input_floats_, &output_floats_);
+}
+
+void Resampler::Reset() {
+  if (polyphase_resampler_ != nullptr) {
+    polyphase_resampler_->Reset();
+  } else {
+    dsp_resampler_->ResetFullyPrimed();
+  }
+}
+
+bool Resampler::SaveState(StateWriter* writer) const {
+  if (polyphase_resampler_ == nullptr) {
+    return false;
+  }
+  polyphase_resampler_->SaveState(writer);
+  return true;
+}
+
+bool Resampler::RestoreState(StateReader* reader) {
+  return polyphase_resampler_ != nullptr &&
+         polyphase_resampler_->RestoreState(reader);
+}
 
 }  // namespace codec
 }  // namespace chromemedia
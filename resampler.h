@@ -23,12 +23,16 @@
 
 #include "absl/types/span.h"
 #include "audio/dsp/resampler_q.h"
+#include "polyphase_resampler.h"
 #include "resampler_interface.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
 
 // This class wraps a resampler that can either upsample or downsample audio.
+// Rates related by an integer factor, which covers every rate Lyra supports,
+// use a PolyphaseResampler and the rest fall back to a QResampler.
 class Resampler : public ResamplerInterface {
  public:
   ~Resampler() override;
@@ -38,11 +42,36 @@ class Resampler : public ResamplerInterface {
   // Resamples audio at input_sample_rate_hz to target_sample_rate_hz.
   std::vector<int16_t> Resample(absl::Span<const int16_t> audio) override;
 
+  // Same as above, but writes into |output|. The float buffers used for
+  // resampling are kept between calls, so once they have grown to the largest
+  // requested size this does not allocate.
+  int ResampleInto(absl::Span<const int16_t> audio,
+                   absl::Span<int16_t> output) override;
+
+  // Same as above, but skips clipping to int16.
+  int ResampleIntoFloats(absl::Span<const int16_t> audio,
+                         absl::Span<float> output) override;
+
   void Reset() override;
 
+  // Only supported by the polyphase resampler, whose history is a plain
+  // buffer.
+  bool SaveState(StateWriter* writer) const override;
+  bool RestoreState(StateReader* reader) override;
+
  private:
-  explicit Resampler(audio_dsp::QResampler<float> dsp_resampler);
-  audio_dsp::QResampler<float> resampler_;
+  explicit Resampler(std::unique_ptr<PolyphaseResampler> polyphase_resampler);
+  explicit Resampler(
+      std::unique_ptr<audio_dsp::QResampler<float>> dsp_resampler);
+
+  // Resamples |audio| into |output_floats_| with |dsp_resampler_|.
+  void ResampleToFloats(absl::Span<const int16_t> audio);
+
+  std::unique_ptr<PolyphaseResampler> polyphase_resampler_;
+  // Only used if |polyphase_resampler_| is null.
+  std::unique_ptr<audio_dsp::QResampler<float>> dsp_resampler_;
+  std::vector<float> input_floats_;
+  std::vector<float> output_floats_;
 };
 
 }  // namespace codec
@@ -0,0 +1,68 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "lyra_config.h"
+#include "resampler.h"
+
+// Resamples a packet of random audio from |state.range(0)| Hz to
+// |state.range(1)| Hz.
+void BM_ResampleInto(benchmark::State& state) {
+  const int input_sample_rate_hz = state.range(0);
+  const int target_sample_rate_hz = state.range(1);
+  auto resampler = chromemedia::codec::Resampler::Create(
+      input_sample_rate_hz, target_sample_rate_hz);
+  if (resampler == nullptr) {
+    state.SkipWithError("Could not create the resampler.");
+    return;
+  }
+  const int num_input_samples =
+      chromemedia::codec::kNumFramesPerPacket *
+      chromemedia::codec::GetNumSamplesPerHop(input_sample_rate_hz);
+  absl::BitGen gen;
+  std::vector<int16_t> audio(num_input_samples);
+  for (auto& sample : audio) {
+    sample = absl::Uniform<uint16_t>(gen);
+  }
+  // Leave room for the rounding of the number of resampled samples.
+  std::vector<int16_t> output(
+      num_input_samples * target_sample_rate_hz / input_sample_rate_hz + 1);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        resampler->ResampleInto(audio, absl::MakeSpan(output)));
+  }
+}
+
+// Decoding resamples from the internal sample rate to every supported one and
+// encoding the other way around.
+static void SupportedRatios(benchmark::internal::Benchmark* benchmark) {
+  const int internal_rate_hz = chromemedia::codec::kInternalSampleRateHz;
+  for (const int sample_rate_hz : chromemedia::codec::kSupportedSampleRates) {
+    if (sample_rate_hz == internal_rate_hz) {
+      continue;
+    }
+    benchmark->Args({internal_rate_hz, sample_rate_hz});
+    benchmark->Args({sample_rate_hz, internal_rate_hz});
+  }
+}
+
+BENCHMARK(BM_ResampleInto)->Apply(SupportedRatios);
+BENCHMARK_MAIN();
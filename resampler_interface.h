@@ -17,10 +17,12 @@
 #ifndef LYRA_CODEC_RESAMPLER_INTERFACE_H_
 #define LYRA_CODEC_RESAMPLER_INTERFACE_H_
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
 #include "absl/types/span.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -31,7 +33,39 @@ class ResamplerInterface {
 
   virtual std::vector<int16_t> Resample(absl::Span<const int16_t> audio) = 0;
 
+  // Resamples |audio| and writes the result into |output|. Returns the number
+  // of resampled samples, of which at most |output.size()| are written.
+  virtual int ResampleInto(absl::Span<const int16_t> audio,
+                           absl::Span<int16_t> output) {
+    const std::vector<int16_t> resampled = Resample(audio);
+    std::copy_n(resampled.begin(),
+                std::min(resampled.size(), output.size()), output.begin());
+    return resampled.size();
+  }
+
+  // Same as above, but writes float samples in the int16 range without
+  // clipping them, for callers that keep processing in float. Resamplers that
+  // work in float should override this; the default converts the result of
+  // |Resample|.
+  virtual int ResampleIntoFloats(absl::Span<const int16_t> audio,
+                                 absl::Span<float> output) {
+    const std::vector<int16_t> resampled = Resample(audio);
+    std::copy_n(resampled.begin(),
+                std::min(resampled.size(), output.size()), output.begin());
+    return resampled.size();
+  }
+
   virtual void Reset() = 0;
+
+  // Appends the filter history, everything |Reset| forgets, to |writer|.
+  // Returns false if the resampler does not support this, which the default
+  // does not.
+  virtual bool SaveState(StateWriter* writer) const { return false; }
+
+  // Restores what |SaveState| of a resampler between the same rates wrote.
+  // Returns false if |reader| does not hold it, in which case the resampler
+  // must be reset before it is used again.
+  virtual bool RestoreState(StateReader* reader) { return false; }
 };
 
 }  // namespace codec
@@ -14,6 +14,7 @@
 
 #include "resampler.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <limits>
 #include <memory>
@@ -22,6 +23,7 @@
 
 #include "absl/types/span.h"
 #include "audio/dsp/signal_vector_util.h"
+#include "dsp_util.h"
 #include "gtest/gtest.h"
 #include "lyra_config.h"
 
@@ -41,9 +43,66 @@ TEST_P(ResamplerSampleRateTest, ResamplingWorksAllZeros) {
   EXPECT_EQ(resampled, expected);
 }
 
+TEST_P(ResamplerSampleRateTest, ResampleIntoMatchesResample) {
+  const double input_sample_rate = GetParam().first;
+  const double output_sample_rate = GetParam().second;
+  std::vector<double> doubles_samples;
+  audio_dsp::ComputeSineWaveVector(1000, input_sample_rate, 0.0,
+                                   GetNumSamplesPerHop(input_sample_rate),
+                                   &doubles_samples);
+  std::vector<int16_t> samples;
+  for (auto val : doubles_samples) {
+    samples.push_back(val * 100);
+  }
+  auto resampler = Resampler::Create(input_sample_rate, output_sample_rate);
+  auto span_resampler =
+      Resampler::Create(input_sample_rate, output_sample_rate);
+
+  // Run twice so the second call reuses the buffers grown by the first one.
+  for (int i = 0; i < 2; ++i) {
+    const auto resampled = resampler->Resample(absl::MakeConstSpan(samples));
+    std::vector<int16_t> output(GetNumSamplesPerHop(output_sample_rate));
+    EXPECT_EQ(span_resampler->ResampleInto(absl::MakeConstSpan(samples),
+                                           absl::MakeSpan(output)),
+              resampled.size());
+    EXPECT_EQ(output, resampled);
+  }
+}
+
+TEST_P(ResamplerSampleRateTest, ResampleIntoFloatsMatchesResampleWhenClipped) {
+  const double input_sample_rate = GetParam().first;
+  const double output_sample_rate = GetParam().second;
+  std::vector<double> doubles_samples;
+  audio_dsp::ComputeSineWaveVector(1000, input_sample_rate, 0.0,
+                                   GetNumSamplesPerHop(input_sample_rate),
+                                   &doubles_samples);
+  std::vector<int16_t> samples;
+  for (auto val : doubles_samples) {
+    samples.push_back(val * 100);
+  }
+  auto resampler = Resampler::Create(input_sample_rate, output_sample_rate);
+  auto float_resampler =
+      Resampler::Create(input_sample_rate, output_sample_rate);
+
+  for (int i = 0; i < 2; ++i) {
+    const auto resampled = resampler->Resample(absl::MakeConstSpan(samples));
+    std::vector<float> output(GetNumSamplesPerHop(output_sample_rate));
+    EXPECT_EQ(float_resampler->ResampleIntoFloats(absl::MakeConstSpan(samples),
+                                                  absl::MakeSpan(output)),
+              resampled.size());
+    for (int j = 0; j < resampled.size(); ++j) {
+      EXPECT_EQ(ClipToInt16(output[j]), resampled[j]);
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(UpsampleAndDownsample, ResamplerSampleRateTest,
-                         testing::Values(std::make_pair(32000, 16000),
-                                         std::make_pair(16000, 32000)));
+                         testing::Values(std::make_pair(48000, 16000),
+                                         std::make_pair(32000, 16000),
+                                         std::make_pair(8000, 16000),
+                                         std::make_pair(16000, 48000),
+                                         std::make_pair(16000, 32000),
+                                         std::make_pair(16000, 8000)));
 
 TEST(ResamplerTest, UpsampleThenDownsampleSimilar) {
   const double base_sample_rate = 16000;
@@ -91,5 +150,24 @@ TEST(ResamplerExtremeValuesTest, AlternatingExtremeValuesTest) {
   EXPECT_EQ(resampled.size(), GetNumSamplesPerHop(kOutputSampleRate));
 }
 
+TEST(ResamplerExtremeValuesTest, FloatsAreNotClipped) {
+  constexpr double kInputSampleRate = 16000;
+  constexpr double kOutputSampleRate = 32000;
+  std::vector<int16_t> samples(GetNumSamplesPerHop(kInputSampleRate));
+  for (int i = 0; i < samples.size(); ++i) {
+    samples[i] = ((i / 2) % 2 == 0) ? std::numeric_limits<int16_t>::min()
+                                    : std::numeric_limits<int16_t>::max();
+  }
+
+  auto resampler = Resampler::Create(kInputSampleRate, kOutputSampleRate);
+  std::vector<float> resampled(GetNumSamplesPerHop(kOutputSampleRate));
+  resampler->ResampleIntoFloats(absl::MakeConstSpan(samples),
+                                absl::MakeSpan(resampled));
+
+  // The filter overshoots the full scale square wave.
+  EXPECT_GT(*std::max_element(resampled.begin(), resampled.end()),
+            std::numeric_limits<int16_t>::max());
+}
+
 }  // namespace codec
 }  // namespace chromemedia
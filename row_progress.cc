@@ -0,0 +1,79 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "row_progress.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "cpu_pause.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+
+RowProgress::RowProgress(std::vector<int> row_starts)
+    : row_starts_(std::move(row_starts)),
+      counters_(std::max<int>(row_starts_.size(), 1) - 1) {
+  CHECK_GE(num_threads(), 1);
+  CHECK(std::is_sorted(row_starts_.begin(), row_starts_.end()));
+}
+
+int64_t RowProgress::Publish(int tid) {
+  // Only thread |tid| writes its counter, so it needs no read-modify-write.
+  const int64_t num_runs =
+      counters_[tid].num_runs.load(std::memory_order_relaxed) + 1;
+  counters_[tid].num_runs.store(num_runs, std::memory_order_release);
+  return num_runs;
+}
+
+std::vector<int> RowProgress::ProducersOf(
+    const std::vector<std::pair<int, int>>& row_ranges) const {
+  std::vector<int> producers;
+  for (int tid = 0; tid < num_threads(); ++tid) {
+    const int start = row_starts_[tid];
+    const int end = row_starts_[tid + 1];
+    if (std::any_of(row_ranges.begin(), row_ranges.end(),
+                    [start, end](const std::pair<int, int>& range) {
+                      return range.first < end && start < range.second;
+                    })) {
+      producers.push_back(tid);
+    }
+  }
+  return producers;
+}
+
+void RowProgress::WaitFor(const std::vector<int>& producers,
+                          int64_t num_runs) const {
+  for (const int tid : producers) {
+    const std::atomic<int64_t>& counter = counters_[tid].num_runs;
+    int num_pauses = 0;
+    while (counter.load(std::memory_order_acquire) < num_runs) {
+      if (num_pauses < kNumPauses) {
+        CpuPause();
+        ++num_pauses;
+      } else {
+        // The producer was likely descheduled.
+        std::this_thread::yield();
+      }
+    }
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
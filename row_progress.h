@@ -0,0 +1,72 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_ROW_PROGRESS_H_
+#define LYRA_CODEC_ROW_PROGRESS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace chromemedia {
+namespace codec {
+
+// Lets the threads that split the output rows of a layer wait only for the
+// threads whose rows they read next, instead of for all of them at a barrier.
+// Every thread publishes how many runs of its rows it finished, and a reader
+// spins until the producers of its rows have finished as many. Threads that
+// finish early can then move on while a slow thread's rows are still missing
+// for others.
+class RowProgress {
+ public:
+  // |row_starts| are the |num_threads| + 1 boundaries of the rows each thread
+  // computes, as given by |LayerWrapper::ThreadRowStarts|.
+  explicit RowProgress(std::vector<int> row_starts);
+
+  // Marks the rows of thread |tid| final for one more run, after which readers
+  // see everything the thread wrote before. Returns the number of runs it has
+  // finished, which is what readers of the same run wait for.
+  int64_t Publish(int tid);
+
+  // Returns the threads that compute some row of one of |row_ranges|, each a
+  // half-open [start, end) range, in increasing order.
+  std::vector<int> ProducersOf(
+      const std::vector<std::pair<int, int>>& row_ranges) const;
+
+  // Returns once every thread of |producers| published |num_runs| runs.
+  void WaitFor(const std::vector<int>& producers, int64_t num_runs) const;
+
+  int num_threads() const { return static_cast<int>(row_starts_.size()) - 1; }
+
+ private:
+  static constexpr int kNumPauses = 1000;
+
+  const std::vector<int> row_starts_;
+
+  // One per thread, each on its own cache line so that a thread publishing
+  // does not invalidate the counters the others spin on.
+  struct alignas(64) Counter {
+    std::atomic<int64_t> num_runs{0};
+  };
+  std::vector<Counter> counters_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_ROW_PROGRESS_H_
@@ -0,0 +1,98 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "row_progress.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+// Calls |func| with every tid in [0, |num_threads|), each on its own thread.
+void RunOnThreads(int num_threads, const std::function<void(int)>& func) {
+  std::vector<std::thread> threads;
+  for (int tid = 1; tid < num_threads; ++tid) {
+    threads.emplace_back(func, tid);
+  }
+  func(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST(RowProgressTest, ProducersAreTheThreadsOfOverlappingRows) {
+  const RowProgress progress({0, 4, 8, 8, 16});
+  EXPECT_EQ(progress.num_threads(), 4);
+  EXPECT_THAT(progress.ProducersOf({{0, 4}}), ElementsAre(0));
+  EXPECT_THAT(progress.ProducersOf({{3, 5}}), ElementsAre(0, 1));
+  EXPECT_THAT(progress.ProducersOf({{8, 9}, {0, 1}}), ElementsAre(0, 3));
+  EXPECT_THAT(progress.ProducersOf({{4, 4}}), IsEmpty());
+}
+
+TEST(RowProgressTest, PublishCountsRuns) {
+  RowProgress progress({0, 2, 4});
+  EXPECT_EQ(progress.Publish(0), 1);
+  EXPECT_EQ(progress.Publish(0), 2);
+  EXPECT_EQ(progress.Publish(1), 1);
+  // Returns right away for runs already published.
+  progress.WaitFor({0, 1}, 1);
+}
+
+TEST(RowProgressTest, ReadersSeeTheRowsOfTheirProducers) {
+  constexpr int kNumThreads = 4;
+  constexpr int kRowsPerThread = 16;
+  constexpr int kNumRuns = 200;
+  std::vector<int> row_starts;
+  for (int tid = 0; tid <= kNumThreads; ++tid) {
+    row_starts.push_back(tid * kRowsPerThread);
+  }
+  RowProgress progress(row_starts);
+  std::vector<std::atomic<int>> rows(kNumThreads * kRowsPerThread);
+  std::atomic<int> num_mismatches(0);
+  RunOnThreads(kNumThreads, [&](int tid) {
+    // Every thread reads the rows of the next thread.
+    const int next = (tid + 1) % kNumThreads;
+    const std::vector<int> producers = progress.ProducersOf(
+        {{row_starts[next], row_starts[next + 1]}});
+    for (int run = 1; run <= kNumRuns; ++run) {
+      for (int row = row_starts[tid]; row < row_starts[tid + 1]; ++row) {
+        rows[row].store(run, std::memory_order_relaxed);
+      }
+      progress.WaitFor(producers, progress.Publish(tid));
+      for (int row = row_starts[next]; row < row_starts[next + 1]; ++row) {
+        // The next thread may already be at a later run, but never earlier.
+        if (rows[row].load(std::memory_order_relaxed) < run) {
+          ++num_mismatches;
+        }
+      }
+    }
+  });
+  EXPECT_EQ(num_mismatches, 0);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
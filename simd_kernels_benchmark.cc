@@ -0,0 +1,143 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Times the codec's own vector kernels, to compare the instruction sets of a
+// host: the N:M sparse product and the logistic sampling with and without the
+// kernels of each, and the fixed point casts as compiled for the host.
+
+#include <memory>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "cpu_features.h"
+#include "dsp_util.h"
+#include "logistic_sampling.h"
+#include "nm_sparse_matrix.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// The shape of the recurrent weights of the GRU: three gates of 1024 units.
+constexpr int kRows = 3 * 1024;
+constexpr int kCols = 1024;
+// A handful of bands is sampled at a time.
+constexpr int kNumSamples = 16;
+constexpr float kProbabilityOffset = 1e-5f;
+
+constexpr CpuIsa kCpuIsas[] = {CpuIsa::kGeneric, CpuIsa::kNeon, CpuIsa::kSve,
+                               CpuIsa::kAvx2, CpuIsa::kAvx512};
+
+std::vector<float> RandomFloats(int size, float min, float max) {
+  absl::BitGen gen;
+  std::vector<float> values(size);
+  for (float& value : values) {
+    value = absl::Uniform(gen, min, max);
+  }
+  return values;
+}
+
+// Multiplies with |state.range(0)| of every |state.range(1)| weights kept,
+// with the vector kernel of the host if |state.range(2)| is set.
+void BM_NmSparseMatVec(benchmark::State& state) {
+  const NmPattern pattern = {static_cast<int>(state.range(0)),
+                             static_cast<int>(state.range(1))};
+  std::vector<float> weights = RandomFloats(kRows * kCols, -1.0f, 1.0f);
+  for (int i = 0; i < weights.size(); ++i) {
+    if (i % pattern.m >= pattern.n) {
+      weights[i] = 0.0f;
+    }
+  }
+  auto matrix = NmSparseMatrix::Create(
+      weights, RandomFloats(kRows, -1.0f, 1.0f), kRows, kCols, pattern);
+  const bool use_simd = state.range(2) != 0;
+  if (use_simd && !matrix->use_simd()) {
+    state.SkipWithError("The CPU has no vector kernel.");
+    return;
+  }
+  matrix->set_use_simd(use_simd);
+  state.SetLabel(use_simd ? CpuIsaName(DetectCpuIsa()) : "generic");
+  const std::vector<float> input = RandomFloats(kCols, -1.0f, 1.0f);
+  std::vector<float> output(kRows);
+
+  for (auto _ : state) {
+    matrix->MatVec(input, 0, kRows, output.data());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kRows * kCols * pattern.n /
+                          pattern.m);
+}
+BENCHMARK(BM_NmSparseMatVec)
+    ->Args({1, 4, 0})
+    ->Args({1, 4, 1})
+    ->Args({2, 4, 0})
+    ->Args({2, 4, 1});
+
+// Samples with the kernel of |kCpuIsas[state.range(0)]|.
+void BM_SampleTruncatedLogistics(benchmark::State& state) {
+  const CpuIsa isa = kCpuIsas[state.range(0)];
+  if (!IsCpuIsaSupported(isa)) {
+    state.SkipWithError(CpuIsaName(isa));
+    return;
+  }
+  const LogisticSamplingKernel kernel = GetLogisticSamplingKernel(isa);
+  const std::vector<float> means = RandomFloats(kNumSamples, -4.0f, 4.0f);
+  const std::vector<float> scales = RandomFloats(kNumSamples, -12.0f, 6.0f);
+  const std::vector<float> uniforms = RandomFloats(kNumSamples, 0.0f, 1.0f);
+  std::vector<int> samples(kNumSamples);
+
+  for (auto _ : state) {
+    kernel(means.data(), scales.data(), uniforms.data(), kProbabilityOffset,
+           kNumSamples, samples.data());
+    benchmark::DoNotOptimize(samples.data());
+  }
+  state.SetLabel(CpuIsaName(isa));
+  state.SetItemsProcessed(state.iterations() * kNumSamples);
+}
+BENCHMARK(BM_SampleTruncatedLogistics)->Arg(0)->Arg(1)->Arg(2)->Arg(3)->Arg(4);
+
+// Casts the GRU gates from their fixed32 products to the fixed16 state.
+void BM_CastVectorFixed32ToFixed16(benchmark::State& state) {
+  csrblocksparse::CacheAlignedVector<csrblocksparse::fixed32<11>> input(kRows);
+  input.FillRandom(-8.0f, 8.0f);
+  csrblocksparse::CacheAlignedVector<csrblocksparse::fixed16<2>> output(kRows);
+
+  for (auto _ : state) {
+    CastVector(0, kRows, input.data(), output.data());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kRows);
+}
+BENCHMARK(BM_CastVectorFixed32ToFixed16);
+
+// Casts fixed16 values to one exponent bit fewer, which saturates.
+void BM_CastVectorFixed16ToFixed16(benchmark::State& state) {
+  csrblocksparse::CacheAlignedVector<csrblocksparse::fixed16<5>> input(kRows);
+  input.FillRandom(-8.0f, 8.0f);
+  csrblocksparse::CacheAlignedVector<csrblocksparse::fixed16<4>> output(kRows);
+
+  for (auto _ : state) {
+    CastVector(0, kRows, input.data(), output.data());
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kRows);
+}
+BENCHMARK(BM_CastVectorFixed16ToFixed16);
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,152 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/time/time.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "soak_benchmark_lib.h"
+
+namespace {
+
+// Heap allocations through operator new, which this binary replaces to
+// count them. The library only reads the count.
+std::atomic<int64_t> num_allocations{0};
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* pointer = std::malloc(std::max<std::size_t>(size, 1))) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* pointer = nullptr;
+  if (posix_memalign(&pointer,
+                     std::max(sizeof(void*), static_cast<size_t>(alignment)),
+                     std::max<std::size_t>(size, 1)) == 0) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+ABSL_FLAG(int, sample_rate_hz, 16000,
+          "Sample rate of the encoders and the decoders.");
+
+ABSL_FLAG(int, num_sessions, 1,
+          "The number of calls encoded and decoded side by side.");
+
+ABSL_FLAG(absl::Duration, duration, absl::Hours(4), "How long to soak.");
+
+ABSL_FLAG(absl::Duration, session_length, absl::Minutes(5),
+          "Calls are torn down and started again after this long.");
+
+ABSL_FLAG(absl::Duration, window, absl::Minutes(1),
+          "The memory, the allocations and the latencies are sampled once "
+          "every window.");
+
+ABSL_FLAG(bool, real_time, true,
+          "Paces the packets at the rate they are played. Otherwise runs "
+          "them as fast as possible.");
+
+ABSL_FLAG(double, packet_loss_rate, 0.05, "Packet loss of every call.");
+
+ABSL_FLAG(double, average_burst_length, 2.0,
+          "Average number of packets lost in a row.");
+
+ABSL_FLAG(int, num_warm_up_windows, 2,
+          "Windows at the start left out of the drift analysis.");
+
+ABSL_FLAG(double, max_memory_growth_mib_per_hour, 4.0,
+          "Resident memory growth above which the run is flagged.");
+
+ABSL_FLAG(double, max_latency_drift, 0.25,
+          "Relative growth of the p99 latencies above which the run is "
+          "flagged.");
+
+ABSL_FLAG(std::string, precision, "",
+          "Arithmetic of the decoders, one of 'float', 'fixed16' or "
+          "'bfloat16'. Defaults to the precision the binary was built for.");
+
+ABSL_FLAG(std::string, json_path, "",
+          "If set, the results are written to this path as JSON.");
+
+ABSL_FLAG(
+    std::string, model_path, "wavegru",
+    "Path to directory containing model weights and quant files. For mobile "
+    "this is the absolute path, like '/sdcard/wavegru/'. For desktop this is "
+    "the path relative to the binary.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  chromemedia::codec::SoakBenchmarkOptions options;
+  const std::string precision_name = absl::GetFlag(FLAGS_precision);
+  if (!precision_name.empty()) {
+    const auto precision_or =
+        chromemedia::codec::ComputePrecisionFromName(precision_name);
+    if (!precision_or.has_value()) {
+      LOG(ERROR) << "Unknown precision '" << precision_name << "'.";
+      return -1;
+    }
+    options.precision = precision_or.value();
+  }
+
+  options.model_base_path = absl::GetFlag(FLAGS_model_path);
+  options.sample_rate_hz = absl::GetFlag(FLAGS_sample_rate_hz);
+  options.num_sessions = absl::GetFlag(FLAGS_num_sessions);
+  options.duration = absl::GetFlag(FLAGS_duration);
+  options.session_length = absl::GetFlag(FLAGS_session_length);
+  options.window = absl::GetFlag(FLAGS_window);
+  options.real_time = absl::GetFlag(FLAGS_real_time);
+  options.packet_loss_rate = absl::GetFlag(FLAGS_packet_loss_rate);
+  options.average_burst_length = absl::GetFlag(FLAGS_average_burst_length);
+  options.num_warm_up_windows = absl::GetFlag(FLAGS_num_warm_up_windows);
+  options.max_memory_growth_bytes_per_hour =
+      absl::GetFlag(FLAGS_max_memory_growth_mib_per_hour) * (1 << 20);
+  options.max_latency_drift = absl::GetFlag(FLAGS_max_latency_drift);
+  options.count_allocations = []() {
+    return num_allocations.load(std::memory_order_relaxed);
+  };
+  return chromemedia::codec::benchmark_soak(options,
+                                            absl::GetFlag(FLAGS_json_path));
+}
@@ -0,0 +1,382 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "soak_benchmark_lib.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "architecture_utils.h"
+#include "benchmark_decode_lib.h"
+#include "benchmark_encode_lib.h"
+#include "compute_precision.h"
+#include "gilbert_model.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_decoder.h"
+#include "lyra_encoder.h"
+#include "lyra_model.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Sessions start at different packets of the shared input, so that their DTX
+// sections do not line up.
+constexpr int kNumInputPackets = 250;
+// Fewest windows after warm-up to compare the first quarter with the last.
+constexpr int kMinNumAnalyzedWindows = 4;
+
+absl::Duration PacketDuration() {
+  return absl::Seconds(1) * kNumFramesPerPacket / kFrameRate;
+}
+
+double Median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  const int size = values.size();
+  return size % 2 == 1 ? values[size / 2]
+                       : 0.5 * (values[size / 2 - 1] + values[size / 2]);
+}
+
+// Returns the median of |value| over the first and the last quarter of
+// |windows|.
+std::pair<double, double> FirstAndLastQuarter(
+    absl::Span<const SoakWindow> windows,
+    const std::function<double(const SoakWindow&)>& value) {
+  const int quarter = windows.size() / 4;
+  std::vector<double> first;
+  std::vector<double> last;
+  for (int i = 0; i < quarter; ++i) {
+    first.push_back(value(windows[i]));
+    last.push_back(value(windows[windows.size() - quarter + i]));
+  }
+  return {Median(first), Median(last)};
+}
+
+double RelativeDrift(const std::pair<double, double>& first_and_last) {
+  return first_and_last.first > 0.0
+             ? (first_and_last.second - first_and_last.first) /
+                   first_and_last.first
+             : 0.0;
+}
+
+// One call, which is started again every session length.
+struct Session {
+  std::unique_ptr<LyraEncoder> encoder;
+  std::unique_ptr<LyraDecoder> decoder;
+  std::unique_ptr<GilbertModel> loss;
+  int64_t first_packet;
+};
+
+}  // namespace
+
+SoakDrift AnalyzeSoakDrift(const SoakBenchmarkOptions& options,
+                           const std::vector<SoakWindow>& windows) {
+  SoakDrift drift;
+  const int num_warm_up_windows =
+      std::min<int>(std::max(options.num_warm_up_windows, 0), windows.size());
+  const auto analyzed =
+      absl::MakeConstSpan(windows).subspan(num_warm_up_windows);
+  if (analyzed.size() < kMinNumAnalyzedWindows) {
+    return drift;
+  }
+
+  double mean_hours = 0.0;
+  double mean_bytes = 0.0;
+  for (const SoakWindow& window : analyzed) {
+    mean_hours += window.elapsed_seconds / 3600.0;
+    mean_bytes += window.resident_memory_bytes;
+  }
+  mean_hours /= analyzed.size();
+  mean_bytes /= analyzed.size();
+  double covariance = 0.0;
+  double variance = 0.0;
+  for (const SoakWindow& window : analyzed) {
+    const double hours = window.elapsed_seconds / 3600.0 - mean_hours;
+    covariance += hours * (window.resident_memory_bytes - mean_bytes);
+    variance += hours * hours;
+  }
+  if (variance > 0.0) {
+    drift.memory_growth_bytes_per_hour = covariance / variance;
+  }
+
+  drift.encode_p99_drift =
+      RelativeDrift(FirstAndLastQuarter(analyzed, [](const SoakWindow& w) {
+        return static_cast<double>(w.encode.p99_microsecs);
+      }));
+  drift.decode_p99_drift =
+      RelativeDrift(FirstAndLastQuarter(analyzed, [](const SoakWindow& w) {
+        return static_cast<double>(w.decode.p99_microsecs);
+      }));
+  const bool counted_allocations =
+      std::all_of(analyzed.begin(), analyzed.end(), [](const SoakWindow& w) {
+        return w.allocations_per_packet >= 0.0;
+      });
+  if (counted_allocations) {
+    const auto allocations =
+        FirstAndLastQuarter(analyzed, [](const SoakWindow& w) {
+          return w.allocations_per_packet;
+        });
+    drift.allocations_per_packet_growth =
+        allocations.second - allocations.first;
+  }
+
+  drift.memory_grows = drift.memory_growth_bytes_per_hour >
+                       options.max_memory_growth_bytes_per_hour;
+  drift.latency_drifts = drift.encode_p99_drift > options.max_latency_drift ||
+                         drift.decode_p99_drift > options.max_latency_drift;
+  drift.allocations_grow = drift.allocations_per_packet_growth >
+                           options.max_allocations_per_packet_growth;
+  return drift;
+}
+
+std::string FormatSoakJson(const SoakBenchmarkOptions& options,
+                           const HostInfo& host,
+                           const std::vector<SoakWindow>& windows,
+                           const SoakDrift& drift) {
+  std::string json = absl::StrFormat(
+      "{\n"
+      "  \"host\": %s,\n"
+      "  \"config\": {\"sample_rate_hz\": %d, \"compute_type\": \"%s\", "
+      "\"num_sessions\": %d, \"duration_s\": %d, \"session_length_s\": %d, "
+      "\"window_s\": %d, \"real_time\": %s, \"packet_loss_rate\": %g, "
+      "\"average_burst_length\": %g, \"num_warm_up_windows\": %d},\n"
+      "  \"windows\": [",
+      FormatHostInfoJson(host), options.sample_rate_hz,
+      ComputePrecisionName(options.precision), options.num_sessions,
+      absl::ToInt64Seconds(options.duration),
+      absl::ToInt64Seconds(options.session_length),
+      absl::ToInt64Seconds(options.window),
+      options.real_time ? "true" : "false", options.packet_loss_rate,
+      options.average_burst_length, options.num_warm_up_windows);
+  for (int i = 0; i < static_cast<int>(windows.size()); ++i) {
+    const SoakWindow& window = windows[i];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"elapsed_s\": %.1f, \"num_packets\": %d, "
+        "\"resident_bytes\": %d, \"allocations_per_packet\": %.2f, "
+        "\"encode\": %s, \"decode\": %s}",
+        i == 0 ? "" : ",", window.elapsed_seconds, window.num_packets,
+        window.resident_memory_bytes, window.allocations_per_packet,
+        FormatTimingStatsJson(window.encode),
+        FormatTimingStatsJson(window.decode));
+  }
+  absl::StrAppendFormat(
+      &json,
+      "\n  ],\n"
+      "  \"drift\": {\"memory_growth_bytes_per_hour\": %.0f, "
+      "\"encode_p99_drift\": %.3f, \"decode_p99_drift\": %.3f, "
+      "\"allocations_per_packet_growth\": %.2f, \"memory_grows\": %s, "
+      "\"latency_drifts\": %s, \"allocations_grow\": %s}\n"
+      "}\n",
+      drift.memory_growth_bytes_per_hour, drift.encode_p99_drift,
+      drift.decode_p99_drift, drift.allocations_per_packet_growth,
+      drift.memory_grows ? "true" : "false",
+      drift.latency_drifts ? "true" : "false",
+      drift.allocations_grow ? "true" : "false");
+  return json;
+}
+
+int benchmark_soak(const SoakBenchmarkOptions& options,
+                   const std::string& json_path) {
+  if (options.num_sessions <= 0 || options.window <= absl::ZeroDuration() ||
+      options.session_length < PacketDuration() ||
+      options.duration < options.window) {
+    LOG(ERROR) << "A soak run needs sessions, a session of at least a packet "
+               << "and a duration of at least a window.";
+    return -1;
+  }
+  const ghc::filesystem::path model_path =
+      GetCompleteArchitecturePath(options.model_base_path);
+  const std::shared_ptr<LyraModel> model = LyraModel::Create(model_path);
+  if (model == nullptr) {
+    LOG(ERROR) << "Could not create the model.";
+    return -1;
+  }
+
+  const int num_samples_per_packet =
+      kNumFramesPerPacket * GetNumSamplesPerHop(options.sample_rate_hz);
+  const std::vector<int16_t> audio = GenerateSyntheticSpeech(
+      options.sample_rate_hz, kNumInputPackets * num_samples_per_packet);
+  const int64_t num_packets_per_session =
+      options.session_length / PacketDuration();
+  auto start_session = [&](int64_t first_packet, Session* session) {
+    // Tear the previous call down before the next one allocates.
+    *session = Session();
+    session->encoder =
+        LyraEncoder::Create(options.sample_rate_hz, kNumChannels, kBitrate,
+                            /*enable_dtx=*/true, model);
+    session->decoder =
+        LyraDecoder::Create(options.sample_rate_hz, kNumChannels, kBitrate,
+                            model, /*num_threads=*/1, options.precision);
+    session->loss = GilbertModel::Create(options.packet_loss_rate,
+                                         options.average_burst_length);
+    session->first_packet = first_packet;
+    return session->encoder != nullptr && session->decoder != nullptr &&
+           session->loss != nullptr;
+  };
+  std::vector<Session> sessions(options.num_sessions);
+  for (Session& session : sessions) {
+    if (!start_session(/*first_packet=*/0, &session)) {
+      LOG(ERROR) << "Could not start a session.";
+      return -1;
+    }
+  }
+
+  // Reserved for the packets of a window run in real time, which is as many
+  // as they ever hold then.
+  const int64_t num_packets_per_window =
+      options.window / PacketDuration() * options.num_sessions;
+  std::vector<int64_t> encode_timings;
+  std::vector<int64_t> decode_timings;
+  encode_timings.reserve(num_packets_per_window);
+  decode_timings.reserve(num_packets_per_window);
+  std::vector<int16_t> decoded(num_samples_per_packet);
+  const int64_t audio_microsecs_per_packet =
+      absl::ToInt64Microseconds(PacketDuration());
+  std::vector<SoakWindow> windows;
+  windows.reserve(options.duration / options.window + 1);
+
+  const absl::Time start = absl::Now();
+  absl::Time window_end = start + options.window;
+  int64_t allocations_at_window_start =
+      options.count_allocations ? options.count_allocations() : 0;
+  for (int64_t packet = 0;; ++packet) {
+    if (options.real_time) {
+      const absl::Duration wait =
+          start + packet * PacketDuration() - absl::Now();
+      if (wait > absl::ZeroDuration()) {
+        absl::SleepFor(wait);
+      }
+    }
+    const absl::Time now = absl::Now();
+    if (now >= window_end) {
+      const int64_t allocations_at_window_end =
+          options.count_allocations ? options.count_allocations() : 0;
+      SoakWindow window;
+      window.elapsed_seconds = absl::ToDoubleSeconds(now - start);
+      window.num_packets = encode_timings.size();
+      window.resident_memory_bytes = ResidentMemoryBytes();
+      window.allocations_per_packet =
+          options.count_allocations && window.num_packets > 0
+              ? static_cast<double>(allocations_at_window_end -
+                                    allocations_at_window_start) /
+                    window.num_packets
+              : -1.0;
+      window.encode =
+          GetTimingStats(encode_timings, audio_microsecs_per_packet);
+      window.decode =
+          GetTimingStats(decode_timings, audio_microsecs_per_packet);
+      windows.push_back(window);
+      LOG(INFO) << "Window " << windows.size() << " at "
+                << absl::FormatDuration(absl::Seconds(
+                       static_cast<int64_t>(window.elapsed_seconds)))
+                << ": " << window.num_packets << " packets, "
+                << window.resident_memory_bytes / (1 << 20)
+                << " MiB resident, " << window.allocations_per_packet
+                << " allocations per packet, p99 encode "
+                << window.encode.p99_microsecs << "us and decode "
+                << window.decode.p99_microsecs << "us.";
+      encode_timings.clear();
+      decode_timings.clear();
+      if (now - start >= options.duration) {
+        break;
+      }
+      window_end += options.window;
+      allocations_at_window_start =
+          options.count_allocations ? options.count_allocations() : 0;
+    }
+
+    for (int s = 0; s < options.num_sessions; ++s) {
+      Session& session = sessions[s];
+      if (packet - session.first_packet >= num_packets_per_session &&
+          !start_session(packet, &session)) {
+        LOG(ERROR) << "Could not start session " << s << " again.";
+        return -1;
+      }
+      const int input_packet =
+          (packet + s * kNumInputPackets / options.num_sessions) %
+          kNumInputPackets;
+      absl::Time call_start = absl::Now();
+      const auto encoded = session.encoder->Encode(
+          absl::MakeConstSpan(audio).subspan(
+              input_packet * num_samples_per_packet, num_samples_per_packet));
+      encode_timings.push_back(
+          absl::ToInt64Microseconds(absl::Now() - call_start));
+      if (!encoded.has_value()) {
+        LOG(ERROR) << "Session " << s << " could not encode packet "
+                   << packet << ".";
+        return -1;
+      }
+      call_start = absl::Now();
+      const bool decoded_packet =
+          session.loss->IsPacketReceived()
+              ? session.decoder->SetEncodedPacket(encoded.value()) &&
+                    session.decoder->DecodeSamples(absl::MakeSpan(decoded))
+              : session.decoder->DecodePacketLoss(absl::MakeSpan(decoded));
+      decode_timings.push_back(
+          absl::ToInt64Microseconds(absl::Now() - call_start));
+      if (!decoded_packet) {
+        LOG(ERROR) << "Session " << s << " could not decode packet "
+                   << packet << ".";
+        return -1;
+      }
+    }
+  }
+
+  const SoakDrift drift = AnalyzeSoakDrift(options, windows);
+  LOG(INFO) << "Resident memory grew by "
+            << drift.memory_growth_bytes_per_hour / (1 << 20)
+            << " MiB per hour, p99 latency drifted by "
+            << 100.0 * drift.encode_p99_drift << "% when encoding and "
+            << 100.0 * drift.decode_p99_drift << "% when decoding.";
+  if (drift.memory_grows) {
+    LOG(WARNING) << "The resident memory grows faster than "
+                 << options.max_memory_growth_bytes_per_hour / (1 << 20)
+                 << " MiB per hour.";
+  }
+  if (drift.latency_drifts) {
+    LOG(WARNING) << "The p99 latency drifted by more than "
+                 << 100.0 * options.max_latency_drift << "%.";
+  }
+  if (drift.allocations_grow) {
+    LOG(WARNING) << "The allocations per packet grew by "
+                 << drift.allocations_per_packet_growth << ".";
+  }
+
+  if (!json_path.empty()) {
+    std::ofstream json(json_path);
+    json << FormatSoakJson(options, GetHostInfo(), windows, drift);
+    if (!json) {
+      LOG(ERROR) << "Could not write " << json_path << ".";
+      return -1;
+    }
+    LOG(INFO) << "Wrote results to " << json_path << ".";
+  }
+  return drift.flagged() ? 1 : 0;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
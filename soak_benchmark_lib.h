@@ -0,0 +1,120 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_SOAK_BENCHMARK_LIB_H_
+#define LYRA_CODEC_SOAK_BENCHMARK_LIB_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+
+namespace chromemedia {
+namespace codec {
+
+struct SoakBenchmarkOptions {
+  std::string model_base_path;
+  int sample_rate_hz = 16000;
+  ComputePrecision precision = kDefaultComputePrecision;
+  // Calls encoding with DTX and decoding packets after simulated loss, all
+  // run in turn on the calling thread.
+  int num_sessions = 1;
+  absl::Duration duration = absl::Hours(4);
+  // Sessions are torn down and started again after this long, so that what
+  // creating and destroying them leaks shows too.
+  absl::Duration session_length = absl::Minutes(5);
+  // The memory, the allocations and the latencies are sampled once a window.
+  absl::Duration window = absl::Minutes(1);
+  // Paces the packets at the rate they are played. Otherwise they are run as
+  // fast as possible, which packs more hours of calls into the duration.
+  bool real_time = true;
+  // Packet loss of every session, simulated with a |GilbertModel|.
+  float packet_loss_rate = 0.05f;
+  float average_burst_length = 2.0f;
+  // Windows at the start left out of the analysis, while caches, pools and
+  // the allocator warm up.
+  int num_warm_up_windows = 2;
+  // What the analysis tolerates before flagging a run.
+  double max_memory_growth_bytes_per_hour = 4 << 20;
+  double max_latency_drift = 0.25;
+  double max_allocations_per_packet_growth = 0.5;
+  // Returns how many heap allocations the process made so far. If not set,
+  // the allocations are not sampled.
+  std::function<int64_t()> count_allocations;
+};
+
+// What one window of a soak run measured.
+struct SoakWindow {
+  // Since the start of the run, at the end of the window.
+  double elapsed_seconds;
+  int64_t num_packets;
+  int64_t resident_memory_bytes;
+  // Negative if the allocations were not counted.
+  double allocations_per_packet;
+  TimingStats encode;
+  TimingStats decode;
+};
+
+// How a soak run changed from its first windows after warm-up to its last.
+struct SoakDrift {
+  // Least squares slope of the resident memory.
+  double memory_growth_bytes_per_hour = 0.0;
+  // Relative change of the median p99 latency of the first quarter of the
+  // windows to that of the last quarter.
+  double encode_p99_drift = 0.0;
+  double decode_p99_drift = 0.0;
+  // Change of the median allocations per packet between the same quarters.
+  double allocations_per_packet_growth = 0.0;
+  bool memory_grows = false;
+  bool latency_drifts = false;
+  bool allocations_grow = false;
+
+  bool flagged() const {
+    return memory_grows || latency_drifts || allocations_grow;
+  }
+};
+
+// Returns the drift of |windows| against the thresholds of |options|. Runs
+// with fewer than 4 windows after |options.num_warm_up_windows| are too
+// short to tell and are never flagged.
+SoakDrift AnalyzeSoakDrift(const SoakBenchmarkOptions& options,
+                           const std::vector<SoakWindow>& windows);
+
+// Returns the results of a soak run with |options| on |host| as a JSON
+// object, with every window and the drift.
+std::string FormatSoakJson(const SoakBenchmarkOptions& options,
+                           const HostInfo& host,
+                           const std::vector<SoakWindow>& windows,
+                           const SoakDrift& drift);
+
+// Runs |options.num_sessions| calls of synthetic speech for
+// |options.duration|, logs every window as it ends and the drift at the
+// end. The timings are kept for the current window only, so the run itself
+// does not grow. Unless |json_path| is empty, writes the results there as
+// JSON. Returns 0 if nothing drifted, 1 if the memory, the latencies or the
+// allocations did, and -1 on errors.
+int benchmark_soak(const SoakBenchmarkOptions& options,
+                   const std::string& json_path);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_SOAK_BENCHMARK_LIB_H_
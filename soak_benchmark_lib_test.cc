@@ -0,0 +1,148 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "soak_benchmark_lib.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "benchmark_decode_lib.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+
+constexpr int64_t kMiB = 1 << 20;
+
+// Windows of a minute each whose resident memory grows by
+// |bytes_per_window| and whose p99 latencies grow by |microsecs_per_window|.
+std::vector<SoakWindow> MakeWindows(int num_windows, int64_t bytes_per_window,
+                                    int64_t microsecs_per_window,
+                                    double allocations_per_window) {
+  std::vector<SoakWindow> windows;
+  for (int i = 0; i < num_windows; ++i) {
+    SoakWindow window;
+    window.elapsed_seconds = 60.0 * (i + 1);
+    window.num_packets = 1500;
+    window.resident_memory_bytes = 100 * kMiB + i * bytes_per_window;
+    window.allocations_per_packet = 2.0 + i * allocations_per_window;
+    window.encode = GetTimingStats({1000 + i * microsecs_per_window});
+    window.decode = GetTimingStats({4000 + i * microsecs_per_window});
+    windows.push_back(window);
+  }
+  return windows;
+}
+
+TEST(AnalyzeSoakDriftTest, SteadyRunIsNotFlagged) {
+  const SoakDrift drift =
+      AnalyzeSoakDrift(SoakBenchmarkOptions(), MakeWindows(60, 0, 0, 0.0));
+
+  EXPECT_DOUBLE_EQ(drift.memory_growth_bytes_per_hour, 0.0);
+  EXPECT_DOUBLE_EQ(drift.encode_p99_drift, 0.0);
+  EXPECT_DOUBLE_EQ(drift.decode_p99_drift, 0.0);
+  EXPECT_DOUBLE_EQ(drift.allocations_per_packet_growth, 0.0);
+  EXPECT_FALSE(drift.flagged());
+}
+
+TEST(AnalyzeSoakDriftTest, GrowingMemoryIsFlagged) {
+  // 1 MiB a minute is 60 MiB an hour.
+  const SoakDrift drift =
+      AnalyzeSoakDrift(SoakBenchmarkOptions(), MakeWindows(60, kMiB, 0, 0.0));
+
+  EXPECT_NEAR(drift.memory_growth_bytes_per_hour, 60.0 * kMiB, 1.0);
+  EXPECT_TRUE(drift.memory_grows);
+  EXPECT_FALSE(drift.latency_drifts);
+  EXPECT_TRUE(drift.flagged());
+}
+
+TEST(AnalyzeSoakDriftTest, DriftingLatencyIsFlagged) {
+  const SoakDrift drift =
+      AnalyzeSoakDrift(SoakBenchmarkOptions(), MakeWindows(60, 0, 50, 0.0));
+
+  EXPECT_GT(drift.encode_p99_drift, 1.0);
+  EXPECT_GT(drift.decode_p99_drift, 0.25);
+  EXPECT_TRUE(drift.latency_drifts);
+  EXPECT_FALSE(drift.memory_grows);
+}
+
+TEST(AnalyzeSoakDriftTest, GrowingAllocationsAreFlagged) {
+  const SoakDrift drift =
+      AnalyzeSoakDrift(SoakBenchmarkOptions(), MakeWindows(60, 0, 0, 0.1));
+
+  EXPECT_GT(drift.allocations_per_packet_growth, 0.5);
+  EXPECT_TRUE(drift.allocations_grow);
+}
+
+TEST(AnalyzeSoakDriftTest, UncountedAllocationsAreNotFlagged) {
+  std::vector<SoakWindow> windows = MakeWindows(60, 0, 0, 0.1);
+  for (SoakWindow& window : windows) {
+    window.allocations_per_packet = -1.0;
+  }
+
+  EXPECT_FALSE(AnalyzeSoakDrift(SoakBenchmarkOptions(), windows).flagged());
+}
+
+TEST(AnalyzeSoakDriftTest, IgnoresWarmUpWindows) {
+  std::vector<SoakWindow> windows = MakeWindows(20, 0, 0, 0.0);
+  windows[0].resident_memory_bytes -= 50 * kMiB;
+  windows[0].decode = GetTimingStats({40000});
+  windows[1].resident_memory_bytes -= 10 * kMiB;
+  SoakBenchmarkOptions options;
+  options.num_warm_up_windows = 2;
+
+  EXPECT_FALSE(AnalyzeSoakDrift(options, windows).flagged());
+  options.num_warm_up_windows = 0;
+  EXPECT_TRUE(AnalyzeSoakDrift(options, windows).memory_grows);
+}
+
+TEST(AnalyzeSoakDriftTest, ShortRunsAreNotFlagged) {
+  SoakBenchmarkOptions options;
+  options.num_warm_up_windows = 2;
+
+  EXPECT_FALSE(AnalyzeSoakDrift(options, {}).flagged());
+  EXPECT_FALSE(
+      AnalyzeSoakDrift(options, MakeWindows(5, 10 * kMiB, 1000, 1.0))
+          .flagged());
+}
+
+TEST(FormatSoakJsonTest, ContainsWindowsAndDrift) {
+  SoakBenchmarkOptions options;
+  options.num_sessions = 3;
+  HostInfo host;
+  host.cpu_model = "test cpu";
+  host.cpu_isa = "generic";
+  host.num_cpus = 2;
+  const std::vector<SoakWindow> windows = MakeWindows(8, kMiB, 0, 0.0);
+
+  const std::string json = FormatSoakJson(options, host, windows,
+                                          AnalyzeSoakDrift(options, windows));
+
+  EXPECT_THAT(json, HasSubstr("\"num_sessions\": 3"));
+  EXPECT_THAT(json, HasSubstr("\"duration_s\": 14400"));
+  EXPECT_THAT(json, HasSubstr("{\"elapsed_s\": 60.0, \"num_packets\": 1500, "
+                              "\"resident_bytes\": 104857600, "
+                              "\"allocations_per_packet\": 2.00"));
+  EXPECT_THAT(json, HasSubstr("\"memory_growth_bytes_per_hour\": 62914560"));
+  EXPECT_THAT(json, HasSubstr("\"memory_grows\": true"));
+  EXPECT_THAT(json, HasSubstr("\"latency_drifts\": false"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
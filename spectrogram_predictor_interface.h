@@ -17,7 +17,12 @@
 #ifndef LYRA_CODEC_SPECTROGRAM_PREDICTOR_INTERFACE_H_
 #define LYRA_CODEC_SPECTROGRAM_PREDICTOR_INTERFACE_H_
 
-#include <vector>
+#include <functional>
+#include <memory>
+
+#include "absl/types/span.h"
+#include "feature_frame.h"
+#include "state_buffer.h"
 
 namespace chromemedia {
 namespace codec {
@@ -30,13 +35,36 @@ class SpectrogramPredictorInterface {
 
   // Used to 'inform' the predictor of the most recently seen spectrogram
   // frame.
-  virtual void FeedFrame(const std::vector<float>& features) = 0;
+  virtual void FeedFrame(absl::Span<const float> features) = 0;
 
   // Returns the most correct prediction for the next spectrogram frame
   // according to the implementation.
-  virtual std::vector<float> PredictFrame() = 0;
+  virtual FeatureFrame PredictFrame() = 0;
+
+  // Returns what the next call to |PredictFrame| would, without moving the
+  // predictor on to the frame after it.
+  virtual FeatureFrame PeekFrame() { return PredictFrame(); }
+
+  // Returns for how long after the last received frame the predictions stay
+  // plausible. The packet loss handler switches to comfort noise after that.
+  virtual float max_prediction_seconds() const { return 0.1f; }
+
+  // Forgets the frames fed so far, as if the predictor was just created.
+  virtual void Reset() = 0;
+
+  // Appends the frames the prediction depends on to |writer|, or restores
+  // them from |reader|. Both fail unless overridden.
+  virtual bool SaveState(StateWriter* writer) const { return false; }
+  virtual bool RestoreState(StateReader* reader) { return false; }
 };
 
+// Creates a spectrogram predictor for frames of |num_features| features, or
+// returns nullptr on failure. Selects the implementation a packet loss
+// handler is created with.
+using SpectrogramPredictorFactory =
+    std::function<std::unique_ptr<SpectrogramPredictorInterface>(
+        int num_features)>;
+
 }  // namespace codec
 }  // namespace chromemedia
 #endif  // LYRA_CODEC_SPECTROGRAM_PREDICTOR_INTERFACE_H_
@@ -0,0 +1,263 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stage_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+constexpr int kNumStages = static_cast<int>(SamplingStage::kNumStages);
+
+// Returns the smallest bucket bound below which |fraction| of the spans in
+// |counts| fall. Bounds are clamped to |max_nanos|, which is exact.
+int64_t Percentile(const std::vector<int64_t>& counts, int64_t count,
+                   int64_t max_nanos, double fraction) {
+  const int64_t rank = std::max<int64_t>(
+      1, static_cast<int64_t>(std::ceil(fraction * count)));
+  int64_t cumulative = 0;
+  for (int i = 0; i < static_cast<int>(counts.size()); ++i) {
+    cumulative += counts[i];
+    if (cumulative >= rank) {
+      return std::min(LatencyHistogram::BucketUpperBound(i), max_nanos);
+    }
+  }
+  return max_nanos;
+}
+
+StageLatency SummarizeCounts(const std::vector<int64_t>& counts,
+                             int64_t max_nanos, int64_t total_nanos) {
+  StageLatency latency;
+  for (const int64_t count : counts) {
+    latency.count += count;
+  }
+  if (latency.count == 0) {
+    return latency;
+  }
+  latency.p50_nanos = Percentile(counts, latency.count, max_nanos, 0.5);
+  latency.p99_nanos = Percentile(counts, latency.count, max_nanos, 0.99);
+  latency.max_nanos = max_nanos;
+  latency.total_nanos = total_nanos;
+  return latency;
+}
+
+std::string FormatLatency(const std::string& name,
+                          const StageLatency& latency) {
+  return absl::StrFormat(
+      "%-22s count=%-9d p50=%8.2fus p99=%8.2fus max=%9.2fus total=%.3fms\n",
+      name, latency.count, latency.p50_nanos / 1e3, latency.p99_nanos / 1e3,
+      latency.max_nanos / 1e3, latency.total_nanos / 1e6);
+}
+
+}  // namespace
+
+const char* SamplingStageName(SamplingStage stage) {
+  switch (stage) {
+    case SamplingStage::kConditioningSum:
+      return "conditioning_sum";
+    case SamplingStage::kGruMatVec:
+      return "gru_matvec";
+    case SamplingStage::kGateUpdate:
+      return "gate_update";
+    case SamplingStage::kProjection:
+      return "projection";
+    case SamplingStage::kMixtureOfLogistics:
+      return "mixture_of_logistics";
+    case SamplingStage::kSampling:
+      return "sampling";
+    case SamplingStage::kBarrierWait:
+      return "barrier_wait";
+    case SamplingStage::kNumStages:
+      break;
+  }
+  return "unknown";
+}
+
+LatencyHistogram::LatencyHistogram() { Reset(); }
+
+void LatencyHistogram::Record(int64_t nanos) {
+  nanos = std::max<int64_t>(nanos, 0);
+  counts_[BucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+  total_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+  int64_t max_nanos = max_nanos_.load(std::memory_order_relaxed);
+  while (nanos > max_nanos &&
+         !max_nanos_.compare_exchange_weak(max_nanos, nanos,
+                                           std::memory_order_relaxed)) {
+  }
+}
+
+StageLatency LatencyHistogram::Summarize() const {
+  std::vector<int64_t> counts(kNumBuckets, 0);
+  const int64_t max_nanos = AccumulateInto(&counts);
+  return SummarizeCounts(counts, max_nanos, total_nanos());
+}
+
+int64_t LatencyHistogram::AccumulateInto(std::vector<int64_t>* counts) const {
+  for (int i = 0; i < kNumBuckets; ++i) {
+    (*counts)[i] += counts_[i].load(std::memory_order_relaxed);
+  }
+  return max_nanos_.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Reset() {
+  for (auto& count : counts_) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  max_nanos_.store(0, std::memory_order_relaxed);
+  total_nanos_.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::BucketIndex(int64_t nanos) {
+  if (nanos < kSubBuckets) {
+    return std::max<int64_t>(nanos, 0);
+  }
+  int msb = 0;
+  while ((nanos >> (msb + 1)) != 0) {
+    ++msb;
+  }
+  const int sub_bucket = (nanos >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+  return (msb - kSubBucketBits + 1) * kSubBuckets + sub_bucket;
+}
+
+int64_t LatencyHistogram::BucketUpperBound(int index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  const int msb = index / kSubBuckets + kSubBucketBits - 1;
+  const int64_t width = int64_t{1} << (msb - kSubBucketBits);
+  const int64_t lower = (int64_t{1} << msb) + (index % kSubBuckets) * width;
+  return lower + width - 1;
+}
+
+StageProfiler::StageProfiler(int num_threads) {
+  histograms_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    histograms_.push_back(absl::make_unique<StageHistograms>());
+  }
+}
+
+StageLatency StageProfiler::Summarize(SamplingStage stage) const {
+  std::vector<int64_t> counts(LatencyHistogram::kNumBuckets, 0);
+  int64_t max_nanos = 0;
+  int64_t total_nanos = 0;
+  for (const auto& thread_histograms : histograms_) {
+    const LatencyHistogram& histogram =
+        thread_histograms->at(static_cast<int>(stage));
+    max_nanos = std::max(max_nanos, histogram.AccumulateInto(&counts));
+    total_nanos += histogram.total_nanos();
+  }
+  return SummarizeCounts(counts, max_nanos, total_nanos);
+}
+
+StageLatency StageProfiler::Summarize(SamplingStage stage, int tid) const {
+  return histograms_[tid]->at(static_cast<int>(stage)).Summarize();
+}
+
+bool StageProfiler::EnablePerfCounters() {
+  if (count_events_) {
+    return true;
+  }
+  if (PerfCounters::Create() == nullptr) {
+    return false;
+  }
+  events_.clear();
+  for (int i = 0; i < num_threads(); ++i) {
+    events_.push_back(absl::make_unique<ThreadEvents>());
+  }
+  count_events_ = true;
+  return true;
+}
+
+void StageProfiler::StartEvents(int tid) {
+  ThreadEvents& events = *events_[tid];
+  if (events.counters == nullptr) {
+    if (events.unavailable) {
+      return;
+    }
+    events.counters = PerfCounters::Create();
+    if (events.counters == nullptr) {
+      events.unavailable = true;
+      events.stages.fill(PerfCounts{-1, -1, -1, -1});
+      return;
+    }
+  }
+  events.last = events.counters->Read();
+}
+
+void StageProfiler::CountEvents(int tid, SamplingStage stage) {
+  ThreadEvents& events = *events_[tid];
+  if (events.counters == nullptr) {
+    return;
+  }
+  const PerfCounts now = events.counters->Read();
+  events.stages[static_cast<int>(stage)] += now - events.last;
+  events.last = now;
+}
+
+PerfCounts StageProfiler::SummarizeEvents(SamplingStage stage) const {
+  if (!count_events_) {
+    return PerfCounts{-1, -1, -1, -1};
+  }
+  PerfCounts counts;
+  for (const auto& thread_events : events_) {
+    counts += thread_events->stages[static_cast<int>(stage)];
+  }
+  return counts;
+}
+
+std::string StageProfiler::Report() const {
+  std::string report = absl::StrFormat("cpu_isa: %s\n", CpuIsaName(cpu_isa()));
+  for (int i = 0; i < kNumStages; ++i) {
+    const SamplingStage stage = static_cast<SamplingStage>(i);
+    report += FormatLatency(SamplingStageName(stage), Summarize(stage));
+  }
+  for (int tid = 0; tid < num_threads(); ++tid) {
+    report += FormatLatency(absl::StrFormat("barrier_wait[%d]", tid),
+                            Summarize(SamplingStage::kBarrierWait, tid));
+  }
+  if (count_events_) {
+    for (int i = 0; i < kNumStages; ++i) {
+      const SamplingStage stage = static_cast<SamplingStage>(i);
+      absl::StrAppendFormat(&report, "%-22s %s\n", SamplingStageName(stage),
+                            FormatPerfCounts(SummarizeEvents(stage)));
+    }
+  }
+  return report;
+}
+
+void StageProfiler::Reset() {
+  for (auto& thread_histograms : histograms_) {
+    for (auto& histogram : *thread_histograms) {
+      histogram.Reset();
+    }
+  }
+  for (auto& thread_events : events_) {
+    if (!thread_events->unavailable) {
+      thread_events->stages.fill(PerfCounts());
+    }
+  }
+}
+
+}  // namespace codec
+}  // namespace chromemedia
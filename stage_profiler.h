@@ -0,0 +1,189 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_STAGE_PROFILER_H_
+#define LYRA_CODEC_STAGE_PROFILER_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpu_features.h"
+#include "perf_counters.h"
+
+namespace chromemedia {
+namespace codec {
+
+// The stages of one step of the WaveGRU sampling loop. The AR input is fused
+// into the conditioning sum, so it has no stage of its own.
+enum class SamplingStage {
+  kConditioningSum = 0,
+  kGruMatVec,
+  kGateUpdate,
+  kProjection,
+  kMixtureOfLogistics,
+  kSampling,
+  // Time spent waiting at the explicit barriers of the loop, i.e. the time a
+  // thread is stalled by the slowest one.
+  kBarrierWait,
+  kNumStages,
+};
+
+// Returns a short human readable name of |stage|.
+const char* SamplingStageName(SamplingStage stage);
+
+// Summary of the spans recorded for one stage.
+struct StageLatency {
+  int64_t count = 0;
+  int64_t p50_nanos = 0;
+  int64_t p99_nanos = 0;
+  int64_t max_nanos = 0;
+  int64_t total_nanos = 0;
+};
+
+// Histogram of durations in nanoseconds with log-linear buckets: every power
+// of two is split into |kSubBuckets| buckets, so percentiles are accurate to
+// within 25%. Recording is lock free and may run concurrently with reading.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Record(int64_t nanos);
+
+  StageLatency Summarize() const;
+
+  // Adds the counts of this histogram into |counts|, which must have
+  // |kNumBuckets| entries, and returns the maximum recorded span.
+  int64_t AccumulateInto(std::vector<int64_t>* counts) const;
+
+  int64_t total_nanos() const {
+    return total_nanos_.load(std::memory_order_relaxed);
+  }
+
+  void Reset();
+
+  static constexpr int kSubBucketBits = 2;
+  static constexpr int kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kNumBuckets = 64 * kSubBuckets;
+
+  // Exposed for testing.
+  static int BucketIndex(int64_t nanos);
+  static int64_t BucketUpperBound(int index);
+
+ private:
+  std::array<std::atomic<int64_t>, kNumBuckets> counts_;
+  std::atomic<int64_t> max_nanos_;
+  std::atomic<int64_t> total_nanos_;
+};
+
+// Collects per-thread latency histograms of the stages of the sampling loop.
+// Each thread only records into its own histograms, so the hot path never
+// contends on a cache line with another thread.
+class StageProfiler {
+ public:
+  explicit StageProfiler(int num_threads);
+
+  // Returns a timestamp for |Lap|, also from |Start|.
+  static int64_t NowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Returns a timestamp for |Lap| on thread |tid|, from which the hardware
+  // events of the next stage are counted as well if they are enabled.
+  int64_t Start(int tid) {
+    if (count_events_) StartEvents(tid);
+    return NowNanos();
+  }
+
+  // Records the time since |*start_nanos| for |stage| on thread |tid| and
+  // moves |*start_nanos| to now, so that consecutive stages can be chained.
+  void Lap(int tid, SamplingStage stage, int64_t* start_nanos) {
+    const int64_t now = NowNanos();
+    Record(tid, stage, now - *start_nanos);
+    if (count_events_) CountEvents(tid, stage);
+    *start_nanos = now;
+  }
+
+  void Record(int tid, SamplingStage stage, int64_t nanos) {
+    histograms_[tid]->at(static_cast<int>(stage)).Record(nanos);
+  }
+
+  // Summary of |stage| over all threads.
+  StageLatency Summarize(SamplingStage stage) const;
+
+  // Summary of |stage| on thread |tid| only.
+  StageLatency Summarize(SamplingStage stage, int tid) const;
+
+  // Also counts the hardware events of every stage with |PerfCounters|,
+  // which every thread opens at its first |Start|. Returns false, and leaves
+  // counting off, where the calling thread cannot count them. Reading the
+  // counters costs a system call per stage, so enabling them inflates the
+  // latencies of short stages.
+  bool EnablePerfCounters();
+
+  bool perf_counters_enabled() const { return count_events_; }
+
+  // The events counted for |stage| over all threads, or all -1 if counting is
+  // off. Must not be called while threads are profiled.
+  PerfCounts SummarizeEvents(SamplingStage stage) const;
+
+  // Returns the instruction set the codec's own kernels were dispatched to,
+  // followed by one line per stage and one for the barrier wait of each
+  // thread, and the hardware events of each stage if they are counted,
+  // suitable for logging.
+  std::string Report() const;
+
+  void Reset();
+
+  int num_threads() const { return histograms_.size(); }
+
+  // Instruction set the sampling kernels run with on this CPU.
+  CpuIsa cpu_isa() const { return DetectCpuIsa(); }
+
+ private:
+  using StageHistograms =
+      std::array<LatencyHistogram, static_cast<int>(SamplingStage::kNumStages)>;
+
+  // Hardware events of one thread, only touched by that thread while it is
+  // profiled.
+  struct ThreadEvents {
+    std::unique_ptr<PerfCounters> counters;
+    // Whether opening |counters| failed, so that it is not retried.
+    bool unavailable = false;
+    PerfCounts last;
+    std::array<PerfCounts, static_cast<int>(SamplingStage::kNumStages)>
+        stages;
+  };
+
+  void StartEvents(int tid);
+  void CountEvents(int tid, SamplingStage stage);
+
+  // One heap allocation per thread keeps threads apart in memory.
+  std::vector<std::unique_ptr<StageHistograms>> histograms_;
+  std::vector<std::unique_ptr<ThreadEvents>> events_;
+  bool count_events_ = false;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_STAGE_PROFILER_H_
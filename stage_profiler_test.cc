@@ -0,0 +1,138 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stage_profiler.h"
+
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(LatencyHistogramTest, BucketsCoverTheirBounds) {
+  for (const int64_t nanos : {0, 1, 3, 4, 7, 8, 100, 1000, 123456789}) {
+    const int index = LatencyHistogram::BucketIndex(nanos);
+    EXPECT_LT(index, LatencyHistogram::kNumBuckets);
+    EXPECT_LE(nanos, LatencyHistogram::BucketUpperBound(index)) << nanos;
+    if (index > 0) {
+      EXPECT_GT(nanos, LatencyHistogram::BucketUpperBound(index - 1)) << nanos;
+    }
+  }
+}
+
+TEST(LatencyHistogramTest, EmptySummaryIsZero) {
+  const StageLatency latency = LatencyHistogram().Summarize();
+
+  EXPECT_EQ(latency.count, 0);
+  EXPECT_EQ(latency.p50_nanos, 0);
+  EXPECT_EQ(latency.max_nanos, 0);
+}
+
+TEST(LatencyHistogramTest, PercentilesAreWithinBucketError) {
+  LatencyHistogram histogram;
+  for (int i = 1; i <= 1000; ++i) {
+    histogram.Record(i * 1000);
+  }
+
+  const StageLatency latency = histogram.Summarize();
+
+  EXPECT_EQ(latency.count, 1000);
+  EXPECT_EQ(latency.max_nanos, 1000000);
+  EXPECT_EQ(latency.total_nanos, int64_t{500500} * 1000);
+  EXPECT_GE(latency.p50_nanos, 500000);
+  EXPECT_LE(latency.p50_nanos, 500000 * 5 / 4);
+  EXPECT_GE(latency.p99_nanos, 990000);
+  EXPECT_LE(latency.p99_nanos, latency.max_nanos);
+}
+
+TEST(LatencyHistogramTest, ResetClearsSpans) {
+  LatencyHistogram histogram;
+  histogram.Record(42);
+  histogram.Reset();
+
+  EXPECT_EQ(histogram.Summarize().count, 0);
+}
+
+TEST(StageProfilerTest, SummarizesAcrossThreads) {
+  StageProfiler profiler(/*num_threads=*/2);
+  profiler.Record(0, SamplingStage::kBarrierWait, 10);
+  profiler.Record(1, SamplingStage::kBarrierWait, 1000);
+  profiler.Record(1, SamplingStage::kGruMatVec, 500);
+
+  EXPECT_EQ(profiler.Summarize(SamplingStage::kBarrierWait).count, 2);
+  EXPECT_EQ(profiler.Summarize(SamplingStage::kBarrierWait).max_nanos, 1000);
+  EXPECT_EQ(profiler.Summarize(SamplingStage::kBarrierWait, 0).max_nanos, 10);
+  EXPECT_EQ(profiler.Summarize(SamplingStage::kGruMatVec, 0).count, 0);
+  EXPECT_EQ(profiler.Summarize(SamplingStage::kGruMatVec, 1).count, 1);
+}
+
+TEST(StageProfilerTest, LapChainsStages) {
+  StageProfiler profiler(/*num_threads=*/1);
+  int64_t start = StageProfiler::NowNanos();
+  const int64_t first_start = start;
+  profiler.Lap(0, SamplingStage::kProjection, &start);
+  profiler.Lap(0, SamplingStage::kSampling, &start);
+
+  EXPECT_GE(start, first_start);
+  EXPECT_EQ(profiler.Summarize(SamplingStage::kProjection).count, 1);
+  EXPECT_EQ(profiler.Summarize(SamplingStage::kSampling).count, 1);
+}
+
+TEST(StageProfilerTest, EventsAreUnavailableUnlessEnabled) {
+  StageProfiler profiler(/*num_threads=*/1);
+  int64_t start = profiler.Start(0);
+  profiler.Lap(0, SamplingStage::kGruMatVec, &start);
+
+  EXPECT_FALSE(profiler.perf_counters_enabled());
+  EXPECT_EQ(profiler.SummarizeEvents(SamplingStage::kGruMatVec).cycles, -1);
+}
+
+TEST(StageProfilerTest, PerfCountersCountEachStage) {
+  StageProfiler profiler(/*num_threads=*/1);
+  if (!profiler.EnablePerfCounters()) {
+    GTEST_SKIP() << "Hardware events cannot be counted here.";
+  }
+  int64_t start = profiler.Start(0);
+  volatile int64_t sum = 0;
+  for (int i = 0; i < 100000; ++i) {
+    sum += i;
+  }
+  profiler.Lap(0, SamplingStage::kGruMatVec, &start);
+
+  EXPECT_GT(profiler.SummarizeEvents(SamplingStage::kGruMatVec).instructions,
+            100000);
+  EXPECT_EQ(profiler.SummarizeEvents(SamplingStage::kSampling).instructions,
+            0);
+  EXPECT_THAT(profiler.Report(), testing::HasSubstr("ipc="));
+}
+
+TEST(StageProfilerTest, ReportNamesEveryStage) {
+  StageProfiler profiler(/*num_threads=*/2);
+  const std::string report = profiler.Report();
+
+  EXPECT_THAT(report, testing::HasSubstr(absl::StrCat(
+                          "cpu_isa: ", CpuIsaName(profiler.cpu_isa()))));
+  EXPECT_THAT(report, testing::HasSubstr("conditioning_sum"));
+  EXPECT_THAT(report, testing::HasSubstr("mixture_of_logistics"));
+  EXPECT_THAT(report, testing::HasSubstr("barrier_wait[1]"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
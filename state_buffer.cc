@@ -0,0 +1,44 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "state_buffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace chromemedia {
+namespace codec {
+
+void StateWriter::WriteBytes(const void* data, size_t num_bytes) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  buffer_->insert(buffer_->end(), bytes, bytes + num_bytes);
+}
+
+bool StateReader::ReadBytes(void* data, size_t num_bytes) {
+  if (num_bytes > num_bytes_left()) {
+    return false;
+  }
+  if (num_bytes > 0) {
+    std::memcpy(data, buffer_.data() + position_, num_bytes);
+  }
+  position_ += num_bytes;
+  return true;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
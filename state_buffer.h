@@ -0,0 +1,123 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef LYRA_CODEC_STATE_BUFFER_H_
+#define LYRA_CODEC_STATE_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Appends the raw bytes of trivially copyable values to a buffer, for state
+// that is only ever read back by the same build, e.g. to move a stream between
+// processes or to roll it back. Nothing about the layout is portable between
+// architectures or versions of the codec.
+class StateWriter {
+ public:
+  // Appends to |buffer|, which is not cleared, so that a buffer reused across
+  // snapshots stops allocating once it has grown to the largest one.
+  explicit StateWriter(std::vector<uint8_t>* buffer) : buffer_(buffer) {}
+
+  template <typename T>
+  void Write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be written.");
+    WriteBytes(&value, sizeof(T));
+  }
+
+  // Writes the size of |values| followed by their bytes.
+  template <typename T>
+  void WriteSpan(absl::Span<const T> values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be written.");
+    Write<int32_t>(values.size());
+    WriteBytes(values.data(), values.size() * sizeof(T));
+  }
+
+  void WriteBytes(const void* data, size_t num_bytes);
+
+ private:
+  std::vector<uint8_t>* const buffer_;
+};
+
+// Reads back what a |StateWriter| wrote, in the same order. Every method
+// returns false if the buffer ends early or does not match what is read into,
+// in which case the reader is left at an unspecified position.
+class StateReader {
+ public:
+  explicit StateReader(absl::Span<const uint8_t> buffer) : buffer_(buffer) {}
+
+  template <typename T>
+  bool Read(T* value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be read.");
+    return ReadBytes(value, sizeof(T));
+  }
+
+  // Bools are read as a byte, which has to be 0 or 1, since any other value
+  // would not be a valid bool.
+  bool Read(bool* value) {
+    uint8_t byte;
+    if (!Read(&byte) || byte > 1) {
+      return false;
+    }
+    *value = byte == 1;
+    return true;
+  }
+
+  // Reads values written by |StateWriter::WriteSpan| into |values|, which has
+  // to have the size that was written.
+  template <typename T>
+  bool ReadSpan(absl::Span<T> values) {
+    int32_t size;
+    if (!Read(&size) || size != static_cast<int32_t>(values.size())) {
+      return false;
+    }
+    return ReadBytes(values.data(), values.size() * sizeof(T));
+  }
+
+  // Same as above, but resizes |values| to the size that was written.
+  template <typename T>
+  bool ReadVector(std::vector<T>* values) {
+    int32_t size;
+    if (!Read(&size) || size < 0 ||
+        static_cast<size_t>(size) * sizeof(T) > num_bytes_left()) {
+      return false;
+    }
+    values->resize(size);
+    return ReadBytes(values->data(), values->size() * sizeof(T));
+  }
+
+  bool ReadBytes(void* data, size_t num_bytes);
+
+  size_t num_bytes_left() const { return buffer_.size() - position_; }
+
+ private:
+  const absl::Span<const uint8_t> buffer_;
+  size_t position_ = 0;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_STATE_BUFFER_H_
@@ -0,0 +1,97 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "state_buffer.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::ElementsAre;
+
+TEST(StateBufferTest, ReadsBackWhatWasWritten) {
+  std::vector<uint8_t> buffer;
+  StateWriter writer(&buffer);
+  writer.Write<int>(42);
+  writer.Write(true);
+  const std::vector<float> floats = {1.f, -2.5f, 3.f};
+  writer.WriteSpan(absl::MakeConstSpan(floats));
+  const std::vector<int16_t> shorts = {7, -7};
+  writer.WriteSpan(absl::MakeConstSpan(shorts));
+
+  StateReader reader(buffer);
+  int value;
+  bool flag;
+  std::vector<float> read_floats(3);
+  std::vector<int16_t> read_shorts = {1, 2, 3, 4, 5};
+  ASSERT_TRUE(reader.Read(&value));
+  ASSERT_TRUE(reader.Read(&flag));
+  ASSERT_TRUE(reader.ReadSpan(absl::MakeSpan(read_floats)));
+  ASSERT_TRUE(reader.ReadVector(&read_shorts));
+  EXPECT_EQ(value, 42);
+  EXPECT_TRUE(flag);
+  EXPECT_THAT(read_floats, ElementsAre(1.f, -2.5f, 3.f));
+  EXPECT_THAT(read_shorts, ElementsAre(7, -7));
+  EXPECT_EQ(reader.num_bytes_left(), 0);
+}
+
+TEST(StateBufferTest, WriterAppends) {
+  std::vector<uint8_t> buffer = {1, 2};
+  StateWriter writer(&buffer);
+  writer.Write<uint8_t>(3);
+  EXPECT_THAT(buffer, ElementsAre(1, 2, 3));
+}
+
+TEST(StateBufferTest, InvalidBoolFails) {
+  std::vector<uint8_t> buffer;
+  StateWriter(&buffer).Write<uint8_t>(2);
+  bool flag;
+  EXPECT_FALSE(StateReader(buffer).Read(&flag));
+}
+
+TEST(StateBufferTest, ReadingPastTheEndFails) {
+  std::vector<uint8_t> buffer;
+  StateWriter(&buffer).Write<int16_t>(1);
+  StateReader reader(buffer);
+  int32_t value;
+  EXPECT_FALSE(reader.Read(&value));
+}
+
+TEST(StateBufferTest, SpanOfOtherSizeFails) {
+  std::vector<uint8_t> buffer;
+  const std::vector<float> floats(4, 1.f);
+  StateWriter(&buffer).WriteSpan(absl::MakeConstSpan(floats));
+  std::vector<float> read_floats(3);
+  EXPECT_FALSE(StateReader(buffer).ReadSpan(absl::MakeSpan(read_floats)));
+}
+
+TEST(StateBufferTest, TruncatedVectorFails) {
+  std::vector<uint8_t> buffer;
+  const std::vector<float> floats(4, 1.f);
+  StateWriter(&buffer).WriteSpan(absl::MakeConstSpan(floats));
+  buffer.resize(buffer.size() - 1);
+  std::vector<float> read_floats;
+  EXPECT_FALSE(StateReader(buffer).ReadVector(&read_floats));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,111 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "synthetic_model_benchmark_lib.h"
+
+ABSL_FLAG(std::string, num_gru_hiddens, "256,512,768,1024",
+          "Comma-separated numbers of GRU hidden units to sweep. Every size "
+          "has to be a positive multiple of 32.");
+
+ABSL_FLAG(std::string, sparsities, "0.75,0.85,0.9,0.95",
+          "Comma-separated fractions of zero weights to sweep. A negative "
+          "sparsity makes every layer dense.");
+
+ABSL_FLAG(std::string, block_heights, "4,8",
+          "Comma-separated heights of the blocks the weights are multiplied "
+          "in, each either 4 or 8.");
+
+ABSL_FLAG(int, num_cond_hiddens, 512,
+          "Hidden units of the conditioning stack of every model.");
+
+ABSL_FLAG(int, num_split_bands, 4,
+          "Bands every model generates a sample of per step, either 4 or 8.");
+
+ABSL_FLAG(int, num_packets, 100, "The number of packets run per model.");
+
+ABSL_FLAG(int, num_threads, 1, "The number of threads every model runs on.");
+
+ABSL_FLAG(std::string, precision, "",
+          "Arithmetic of the models, one of 'float', 'fixed16' or 'bfloat16'. "
+          "Defaults to the precision the binary was built for.");
+
+ABSL_FLAG(std::string, output_dir,
+          chromemedia::codec::kDefaultBenchmarkOutputDir,
+          "Directory the CSV and JSON results are written to. Nothing is "
+          "written if empty.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  chromemedia::codec::SyntheticModelBenchmarkOptions options;
+  options.num_gru_hiddens.clear();
+  for (const absl::string_view size :
+       absl::StrSplit(absl::GetFlag(FLAGS_num_gru_hiddens), ',')) {
+    int num_gru_hiddens;
+    if (!absl::SimpleAtoi(size, &num_gru_hiddens)) {
+      LOG(ERROR) << "Invalid number of hidden units '" << size << "'.";
+      return -1;
+    }
+    options.num_gru_hiddens.push_back(num_gru_hiddens);
+  }
+  options.sparsities.clear();
+  for (const absl::string_view sparsity_name :
+       absl::StrSplit(absl::GetFlag(FLAGS_sparsities), ',')) {
+    float sparsity;
+    if (!absl::SimpleAtof(sparsity_name, &sparsity) || sparsity >= 1.f) {
+      LOG(ERROR) << "Invalid sparsity '" << sparsity_name << "'.";
+      return -1;
+    }
+    options.sparsities.push_back(sparsity);
+  }
+  options.double_block_heights.clear();
+  for (const absl::string_view height :
+       absl::StrSplit(absl::GetFlag(FLAGS_block_heights), ',')) {
+    if (height != "4" && height != "8") {
+      LOG(ERROR) << "Invalid block height '" << height << "'.";
+      return -1;
+    }
+    options.double_block_heights.push_back(height == "8");
+  }
+
+  const std::string precision_name = absl::GetFlag(FLAGS_precision);
+  if (!precision_name.empty()) {
+    const auto precision_or =
+        chromemedia::codec::ComputePrecisionFromName(precision_name);
+    if (!precision_or.has_value()) {
+      LOG(ERROR) << "Unknown precision '" << precision_name << "'.";
+      return -1;
+    }
+    options.precision = precision_or.value();
+  }
+
+  options.num_cond_hiddens = absl::GetFlag(FLAGS_num_cond_hiddens);
+  options.num_split_bands = absl::GetFlag(FLAGS_num_split_bands);
+  options.num_packets = absl::GetFlag(FLAGS_num_packets);
+  options.num_threads = absl::GetFlag(FLAGS_num_threads);
+  options.output_dir = absl::GetFlag(FLAGS_output_dir);
+
+  return chromemedia::codec::benchmark_synthetic_models(options);
+}
@@ -0,0 +1,288 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "synthetic_model_benchmark_lib.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/substitute.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "layer_wrapper_interface.h"
+#include "lyra_config.h"
+#include "lyra_wavegru.h"
+#include "sparse_inference_matrixvector.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Shape of the layers of the conditioning stack, as in
+// |CausalConvolutionalConditioning|.
+constexpr int kConv1DKernel = 3;
+constexpr int kNumDilatedLayers = 3;
+constexpr int kDilatedKernel = 2;
+constexpr int kNumTransposeLayers = 3;
+constexpr int kTransposeStride = 2;
+// Outputs of the projection that the mixture of logistics of a split band is
+// sampled from.
+constexpr int kNumMixesPerBand = 8;
+// Small enough for the GRU state and the fixed point types not to saturate.
+constexpr float kWeightValue = 0.01f;
+constexpr int kSizeMultiple = LyraWavegru<float>::kSyntheticSizeMultiple;
+
+int64_t CountWeights(int64_t rows, int64_t cols, float sparsity) {
+  const double density = sparsity < 0.f ? 1.0 : 1.0 - sparsity;
+  return static_cast<int64_t>(rows * cols * density);
+}
+
+template <typename ComputeType>
+absl::optional<SyntheticModelResult> BenchmarkTypedSyntheticModel(
+    const SyntheticModelConfig& config, int num_packets, int num_threads) {
+  using WavegruType = LyraWavegru<ComputeType>;
+  using ConditioningType = typename WavegruType::ConditioningType;
+  const LayerParams::FromConstant weights{
+      .value = kWeightValue,
+      .sparsity = config.sparsity,
+      .double_block_height = config.double_block_height};
+  auto wavegru = WavegruType::CreateSynthetic(
+      num_threads, config.num_gru_hiddens, config.proj_size, weights,
+      /*use_huge_pages=*/false, config.num_split_bands);
+  if (wavegru == nullptr) {
+    return absl::nullopt;
+  }
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  auto conditioning = absl::make_unique<ConditioningType>(
+      kNumFeatures, config.num_cond_hiddens, config.num_gru_hiddens,
+      num_samples_per_hop, kNumFramesPerPacket, num_threads, weights);
+
+  const int num_samples = kNumFramesPerPacket * num_samples_per_hop;
+  const int num_split_bands = wavegru->num_split_bands();
+  std::vector<std::vector<int16_t>> split_samples(
+      num_split_bands, std::vector<int16_t>(num_samples / num_split_bands));
+  std::vector<absl::Span<int16_t>> split_spans;
+  for (auto& band : split_samples) {
+    split_spans.push_back(absl::MakeSpan(band));
+  }
+  csrblocksparse::FatCacheAlignedVector<float> features(kNumFeatures,
+                                                        kNumFramesPerPacket);
+  features.FillRandom(/*min=*/-1.f, /*max=*/1.f);
+
+  std::vector<int64_t> conditioning_timings;
+  std::vector<int64_t> sampling_timings;
+  std::vector<int64_t> packet_timings;
+  for (int p = 0; p < num_packets; ++p) {
+    wavegru->ResetConditioningStart();
+    const absl::Time conditioning_start = absl::Now();
+    conditioning->Precompute(features, num_threads);
+    const absl::Time sampling_start = absl::Now();
+    int num_samples_generated = 0;
+    LaunchOnThreadsWithBarrier(
+        num_threads, [&](csrblocksparse::SpinBarrier* barrier, int tid) {
+          const int num_generated = wavegru->SampleWithBarrier(
+              barrier, tid, conditioning.get(),
+              absl::MakeConstSpan(split_spans), num_samples);
+          if (tid == 0) {
+            num_samples_generated = num_generated;
+          }
+        });
+    const absl::Time sampling_end = absl::Now();
+    if (num_samples_generated != num_samples) {
+      LOG(ERROR) << "Generated " << num_samples_generated << " instead of "
+                 << num_samples << " samples.";
+      return absl::nullopt;
+    }
+    conditioning_timings.push_back(
+        absl::ToInt64Microseconds(sampling_start - conditioning_start));
+    sampling_timings.push_back(
+        absl::ToInt64Microseconds(sampling_end - sampling_start));
+    packet_timings.push_back(
+        absl::ToInt64Microseconds(sampling_end - conditioning_start));
+  }
+
+  const int64_t audio_microsecs_per_packet =
+      int64_t{num_samples} * 1000000 / kInternalSampleRateHz;
+  SyntheticModelResult result;
+  result.config = config;
+  result.num_weights = SyntheticModelNumWeights(config);
+  result.conditioning =
+      GetTimingStats(conditioning_timings, audio_microsecs_per_packet);
+  result.sampling =
+      GetTimingStats(sampling_timings, audio_microsecs_per_packet);
+  result.packet = GetTimingStats(packet_timings, audio_microsecs_per_packet);
+  result.packet_microsecs = std::move(packet_timings);
+  return result;
+}
+
+std::string SyntheticModelTitle(const SyntheticModelConfig& config) {
+  return absl::StrFormat(
+      "synthetic_%dh_%dp_%dc_%db_sparsity_%.2f_block_%d",
+      config.num_gru_hiddens, config.proj_size, config.num_cond_hiddens,
+      config.num_split_bands, config.sparsity,
+      config.double_block_height ? 8 : 4);
+}
+
+}  // namespace
+
+int64_t SyntheticModelNumWeights(const SyntheticModelConfig& config) {
+  const int64_t cond = config.num_cond_hiddens;
+  const int64_t hiddens = config.num_gru_hiddens;
+  const int64_t proj = config.proj_size;
+  const float sparsity = config.sparsity;
+  int64_t num_weights = CountWeights(cond, kNumFeatures * kConv1DKernel,
+                                     sparsity);
+  num_weights +=
+      kNumDilatedLayers * CountWeights(cond, cond * kDilatedKernel, sparsity);
+  num_weights +=
+      kNumTransposeLayers * CountWeights(cond * kTransposeStride, cond,
+                                         sparsity);
+  // Conditioning projection and conditioning to gates.
+  num_weights += CountWeights(hiddens, cond, sparsity);
+  num_weights += CountWeights(3 * hiddens, hiddens, sparsity);
+  // Autoregressive input to gates and the GRU itself.
+  num_weights += CountWeights(3 * hiddens, config.num_split_bands, sparsity);
+  num_weights += CountWeights(3 * hiddens, hiddens, sparsity);
+  // Projection and the mix, mean and scale layers.
+  num_weights += CountWeights(proj, hiddens, sparsity);
+  num_weights += 3 * CountWeights(config.num_split_bands * kNumMixesPerBand,
+                                  proj, sparsity);
+  return num_weights;
+}
+
+absl::optional<SyntheticModelResult> BenchmarkSyntheticModel(
+    const SyntheticModelConfig& config, int num_packets, int num_threads,
+    ComputePrecision precision) {
+  if (num_packets <= 0 || num_threads <= 0) {
+    LOG(ERROR) << "The number of packets and threads have to be positive.";
+    return absl::nullopt;
+  }
+  switch (precision) {
+    case ComputePrecision::kFloat:
+      return BenchmarkTypedSyntheticModel<float>(config, num_packets,
+                                                 num_threads);
+    case ComputePrecision::kFixed16:
+      return BenchmarkTypedSyntheticModel<csrblocksparse::fixed16_type>(
+          config, num_packets, num_threads);
+    case ComputePrecision::kBfloat16:
+      return BenchmarkTypedSyntheticModel<csrblocksparse::bfloat16>(
+          config, num_packets, num_threads);
+  }
+  return absl::nullopt;
+}
+
+std::string FormatSyntheticModelBenchmarkJson(
+    const SyntheticModelBenchmarkOptions& options, const HostInfo& host,
+    const std::vector<SyntheticModelResult>& results) {
+  std::string json = absl::StrFormat(
+      "{\n"
+      "  \"host\": %s,\n"
+      "  \"config\": {\"num_packets\": %d, \"num_threads\": %d, "
+      "\"precision\": \"%s\"},\n"
+      "  \"results\": [",
+      FormatHostInfoJson(host), options.num_packets, options.num_threads,
+      ComputePrecisionName(options.precision));
+  for (int r = 0; r < static_cast<int>(results.size()); ++r) {
+    const SyntheticModelResult& result = results[r];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"num_gru_hiddens\": %d, \"proj_size\": %d, "
+        "\"num_cond_hiddens\": %d, \"num_split_bands\": %d, "
+        "\"sparsity\": %.4f, \"block_height\": %d, \"num_weights\": %d,\n"
+        "     \"conditioning\": %s,\n"
+        "     \"sampling\": %s,\n"
+        "     \"packet\": %s}",
+        r == 0 ? "" : ",", result.config.num_gru_hiddens,
+        result.config.proj_size, result.config.num_cond_hiddens,
+        result.config.num_split_bands, result.config.sparsity,
+        result.config.double_block_height ? 8 : 4, result.num_weights,
+        FormatTimingStatsJson(result.conditioning),
+        FormatTimingStatsJson(result.sampling),
+        FormatTimingStatsJson(result.packet));
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+int benchmark_synthetic_models(const SyntheticModelBenchmarkOptions& options) {
+  std::vector<SyntheticModelResult> results;
+  for (const int num_gru_hiddens : options.num_gru_hiddens) {
+    for (const float sparsity : options.sparsities) {
+      for (const bool double_block_height : options.double_block_heights) {
+        SyntheticModelConfig config;
+        config.num_gru_hiddens = num_gru_hiddens;
+        config.proj_size =
+            std::max(kSizeMultiple, num_gru_hiddens / 2 / kSizeMultiple *
+                                        kSizeMultiple);
+        config.num_cond_hiddens = options.num_cond_hiddens;
+        config.num_split_bands = options.num_split_bands;
+        config.sparsity = sparsity;
+        config.double_block_height = double_block_height;
+        const auto result_or =
+            BenchmarkSyntheticModel(config, options.num_packets,
+                                    options.num_threads, options.precision);
+        if (!result_or.has_value()) {
+          LOG(ERROR) << "Could not benchmark "
+                     << SyntheticModelTitle(config) << ".";
+          return -1;
+        }
+        LOG(INFO) << SyntheticModelTitle(config) << ": "
+                  << result_or->num_weights << " weights, "
+                  << result_or->packet.mean_microsecs
+                  << " us per packet, real-time factor "
+                  << result_or->packet.real_time_factor << ".";
+        results.push_back(result_or.value());
+      }
+    }
+  }
+
+  if (options.output_dir.empty()) {
+    return 0;
+  }
+  for (const SyntheticModelResult& result : results) {
+    if (!PrintStatsAndWriteCSV(result.packet_microsecs,
+                               SyntheticModelTitle(result.config),
+                               options.output_dir)) {
+      return -1;
+    }
+  }
+  const std::string json_path =
+      (ghc::filesystem::path(options.output_dir) /
+       "synthetic_model_benchmark.json")
+          .string();
+  std::ofstream json(json_path);
+  json << FormatSyntheticModelBenchmarkJson(options, GetHostInfo(), results);
+  if (!json) {
+    LOG(ERROR) << "Could not write " << json_path << ".";
+    return -1;
+  }
+  LOG(INFO) << "Wrote results to " << json_path << ".";
+  return 0;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_SYNTHETIC_MODEL_BENCHMARK_LIB_H_
+#define LYRA_CODEC_SYNTHETIC_MODEL_BENCHMARK_LIB_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+
+namespace chromemedia {
+namespace codec {
+
+// The shape of a model whose weights are all constant, so that
+// architectures can be timed before they are trained.
+struct SyntheticModelConfig {
+  // Both have to be positive multiples of
+  // |LyraWavegru::kSyntheticSizeMultiple|. The shipped model has 1024 hidden
+  // units and a projection of 512.
+  int num_gru_hiddens = 1024;
+  int proj_size = 512;
+  int num_cond_hiddens = 512;
+  // Either 4, as in the shipped model, or 8, which halves the steps of the
+  // sampling loop.
+  int num_split_bands = 4;
+  // Fraction of the weights of every layer that are zero. Every layer is
+  // dense if it is negative.
+  float sparsity = 0.9f;
+  // Whether the weights are multiplied in blocks of 8 instead of 4 rows.
+  bool double_block_height = false;
+};
+
+// Returns the expected number of non-zero weights of a model with |config|,
+// summed over the conditioning stack, the GRU and the projection and
+// sampling layers.
+int64_t SyntheticModelNumWeights(const SyntheticModelConfig& config);
+
+// Per-packet timings of one synthetic model, in microseconds.
+struct SyntheticModelResult {
+  SyntheticModelConfig config;
+  int64_t num_weights;
+  TimingStats conditioning;
+  TimingStats sampling;
+  // Conditioning and sampling together.
+  TimingStats packet;
+  std::vector<int64_t> packet_microsecs;
+};
+
+// Runs |num_packets| packets of random features through the conditioning
+// stack and the sampling loop of a model with |config| and returns the
+// timings. Returns a nullopt if the model could not be created.
+absl::optional<SyntheticModelResult> BenchmarkSyntheticModel(
+    const SyntheticModelConfig& config, int num_packets, int num_threads,
+    ComputePrecision precision);
+
+struct SyntheticModelBenchmarkOptions {
+  // Every combination of these is run. The projection is half as large as
+  // the GRU, as in the shipped model, rounded down to a multiple of
+  // |LyraWavegru::kSyntheticSizeMultiple|.
+  std::vector<int> num_gru_hiddens = {256, 512, 768, 1024};
+  std::vector<float> sparsities = {0.75f, 0.85f, 0.9f, 0.95f};
+  std::vector<bool> double_block_heights = {false, true};
+  int num_cond_hiddens = 512;
+  int num_split_bands = 4;
+  int num_packets = 100;
+  int num_threads = 1;
+  ComputePrecision precision = kDefaultComputePrecision;
+  // Directory the CSV and JSON results are written to. Nothing is written if
+  // it is empty.
+  std::string output_dir = kDefaultBenchmarkOutputDir;
+};
+
+// Returns the results of a sweep with |options| on |host| as a JSON object.
+std::string FormatSyntheticModelBenchmarkJson(
+    const SyntheticModelBenchmarkOptions& options, const HostInfo& host,
+    const std::vector<SyntheticModelResult>& results);
+
+// Times a synthetic model for every combination in |options| and logs the
+// stats of each. Unless |options.output_dir| is empty, writes the per-packet
+// timings of each model as CSV and all stats with the host metadata as
+// synthetic_model_benchmark.json into it. Returns 0 on success.
+int benchmark_synthetic_models(const SyntheticModelBenchmarkOptions& options);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_SYNTHETIC_MODEL_BENCHMARK_LIB_H_
@@ -0,0 +1,144 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "synthetic_model_benchmark_lib.h"
+
+#include <string>
+#include <vector>
+
+#include "benchmark_decode_lib.h"
+#include "compute_precision.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+using testing::SizeIs;
+
+SyntheticModelConfig SmallConfig() {
+  SyntheticModelConfig config;
+  config.num_gru_hiddens = 64;
+  config.proj_size = 32;
+  config.num_cond_hiddens = 32;
+  config.sparsity = 0.5f;
+  return config;
+}
+
+TEST(SyntheticModelNumWeightsTest, CountsEveryLayerOfDenseModel) {
+  SyntheticModelConfig config = SmallConfig();
+  config.sparsity = -1.f;
+
+  // Conv1D, dilated, transposed, conditioning projection, conditioning to
+  // gates, AR to gates, GRU, projection and mix, mean and scale.
+  const int64_t expected = 32 * 160 * 3 + 3 * 32 * 64 + 3 * 64 * 32 +
+                           64 * 32 + 192 * 64 + 192 * 4 + 192 * 64 + 32 * 64 +
+                           3 * 32 * 32;
+  EXPECT_EQ(SyntheticModelNumWeights(config), expected);
+}
+
+TEST(SyntheticModelNumWeightsTest, ScalesWithSizeAndDensity) {
+  SyntheticModelConfig dense = SmallConfig();
+  dense.sparsity = -1.f;
+  SyntheticModelConfig sparse = dense;
+  sparse.sparsity = 0.75f;
+  SyntheticModelConfig larger = sparse;
+  larger.num_gru_hiddens = 128;
+
+  EXPECT_NEAR(SyntheticModelNumWeights(sparse),
+              SyntheticModelNumWeights(dense) / 4, 16);
+  EXPECT_GT(SyntheticModelNumWeights(larger),
+            SyntheticModelNumWeights(sparse));
+}
+
+TEST(BenchmarkSyntheticModelTest, TimesEveryPacket) {
+  for (const bool double_block_height : {false, true}) {
+    SyntheticModelConfig config = SmallConfig();
+    config.double_block_height = double_block_height;
+
+    const auto result = BenchmarkSyntheticModel(
+        config, /*num_packets=*/3, /*num_threads=*/1,
+        kDefaultComputePrecision);
+
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->num_weights, SyntheticModelNumWeights(config));
+    EXPECT_EQ(result->packet.num_calls, 3);
+    EXPECT_THAT(result->packet_microsecs, SizeIs(3));
+    EXPECT_GE(result->packet.mean_microsecs, result->sampling.mean_microsecs);
+    EXPECT_GT(result->packet.real_time_factor, 0.0);
+  }
+}
+
+TEST(BenchmarkSyntheticModelTest, RunsEightSplitBands) {
+  SyntheticModelConfig config = SmallConfig();
+  config.num_split_bands = 8;
+
+  const auto result = BenchmarkSyntheticModel(
+      config, /*num_packets=*/2, /*num_threads=*/2, kDefaultComputePrecision);
+
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->num_weights, SyntheticModelNumWeights(config));
+  EXPECT_GT(SyntheticModelNumWeights(config),
+            SyntheticModelNumWeights(SmallConfig()));
+  EXPECT_EQ(result->packet.num_calls, 2);
+}
+
+TEST(BenchmarkSyntheticModelTest, RejectsUnsupportedSplitBands) {
+  SyntheticModelConfig config = SmallConfig();
+  config.num_split_bands = 2;
+
+  EXPECT_FALSE(BenchmarkSyntheticModel(config, /*num_packets=*/1,
+                                       /*num_threads=*/1,
+                                       kDefaultComputePrecision)
+                   .has_value());
+}
+
+TEST(BenchmarkSyntheticModelTest, RejectsSizesThatAreNotMultiples) {
+  SyntheticModelConfig config = SmallConfig();
+  config.num_gru_hiddens = 100;
+
+  EXPECT_FALSE(BenchmarkSyntheticModel(config, /*num_packets=*/1,
+                                       /*num_threads=*/1,
+                                       kDefaultComputePrecision)
+                   .has_value());
+}
+
+TEST(FormatSyntheticModelBenchmarkJsonTest, ContainsEveryModel) {
+  SyntheticModelBenchmarkOptions options;
+  options.num_packets = 7;
+  SyntheticModelResult result;
+  result.config = SmallConfig();
+  result.config.double_block_height = true;
+  result.num_weights = 1234;
+  result.conditioning = GetTimingStats({10, 20});
+  result.sampling = GetTimingStats({30, 40});
+  result.packet = GetTimingStats({40, 60});
+
+  const std::string json = FormatSyntheticModelBenchmarkJson(
+      options, GetHostInfo(), {result, result});
+
+  EXPECT_THAT(json, HasSubstr("\"num_packets\": 7"));
+  EXPECT_THAT(json, HasSubstr("\"num_gru_hiddens\": 64"));
+  EXPECT_THAT(json, HasSubstr("\"num_split_bands\": 4"));
+  EXPECT_THAT(json, HasSubstr("\"sparsity\": 0.5000"));
+  EXPECT_THAT(json, HasSubstr("\"block_height\": 8"));
+  EXPECT_THAT(json, HasSubstr("\"num_weights\": 1234"));
+  EXPECT_THAT(json, HasSubstr("\"sampling\": {"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -18,9 +18,8 @@
 #define LYRA_CODEC_TESTING_MOCK_DENOISER_H_
 
 #include <cstdint>
-#include <vector>
 
-#include "absl/status/statusor.h"
+#include "absl/status/status.h"
 #include "absl/types/span.h"
 #include "denoiser_interface.h"
 #include "gmock/gmock.h"
@@ -34,8 +33,10 @@ class MockDenoiser : public DenoiserInterface {
 
   MOCK_METHOD(int, SamplesPerHop, (), (const, override));
 
-  MOCK_METHOD(absl::StatusOr<std::vector<int16_t>>, Denoise,
-              (absl::Span<const int16_t> input), (override));
+  MOCK_METHOD(absl::Status, Denoise, (absl::Span<int16_t> frame),
+              (override));
+
+  MOCK_METHOD(void, Reset, (), (override));
 };
 
 }  // namespace codec
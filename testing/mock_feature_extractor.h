@@ -19,10 +19,10 @@
 
 #include <cstdint>
 #include <optional>
-#include <vector>
 
 #include "absl/types/span.h"
 #include "feature_extractor_interface.h"
+#include "feature_frame.h"
 #include "gmock/gmock.h"
 
 namespace chromemedia {
@@ -32,8 +32,10 @@ class MockFeatureExtractor : public FeatureExtractorInterface {
  public:
   ~MockFeatureExtractor() override {}
 
-  MOCK_METHOD(absl::optional<std::vector<float>>, Extract,
+  MOCK_METHOD(absl::optional<FeatureFrame>, Extract,
               (const absl::Span<const int16_t> audio), (override));
+
+  MOCK_METHOD(void, Reset, (), (override));
 };
 
 }  // namespace codec
@@ -21,6 +21,7 @@
 #include <optional>
 #include <vector>
 
+#include "absl/types/span.h"
 #include "generative_model_interface.h"
 #include "gmock/gmock.h"
 
@@ -31,10 +32,23 @@ class MockGenerativeModel : public GenerativeModelInterface {
  public:
   ~MockGenerativeModel() override {}
 
-  MOCK_METHOD(void, AddFeatures, (const std::vector<float>& features),
+  MOCK_METHOD(void, AddFeatures, (absl::Span<const float> features),
+              (override));
+  MOCK_METHOD(bool, QueueFeatures, (absl::Span<const float> features),
+              (override));
+  MOCK_METHOD(bool, QueueSpeculativeFeatures,
+              (absl::Span<const float> features), (override));
+  MOCK_METHOD(void, DiscardSpeculativeFeatures, (), (override));
+  MOCK_METHOD(absl::optional<int>, StretchFeatures, (int num_samples),
               (override));
   MOCK_METHOD(absl::optional<std::vector<int16_t>>, GenerateSamples,
               (int num_samples), (override));
+  MOCK_METHOD(void, WarmUp, (), (override));
+  MOCK_METHOD(bool, Park, (), (override));
+  MOCK_METHOD(void, Unpark, (), (override));
+  MOCK_METHOD(void, Reset, (), (override));
+  MOCK_METHOD(bool, SaveState, (StateWriter * writer), (const, override));
+  MOCK_METHOD(bool, RestoreState, (StateReader * reader), (override));
 };
 
 }  // namespace codec
@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "absl/types/span.h"
+#include "codec_metrics.h"
 #include "gmock/gmock.h"
 #include "lyra_decoder_interface.h"
 
@@ -37,11 +38,18 @@ class MockLyraDecoder : public LyraDecoderInterface {
   MOCK_METHOD(absl::optional<std::vector<int16_t>>, DecodeSamples, (int),
               (override));
 
+  MOCK_METHOD(bool, DecodeSamples, (absl::Span<int16_t>), (override));
+
   MOCK_METHOD(absl::optional<std::vector<int16_t>>, DecodePacketLoss, ());
 
   MOCK_METHOD(absl::optional<std::vector<int16_t>>, DecodePacketLoss, (int),
               (override));
 
+  MOCK_METHOD(bool, DecodePacketLoss, (absl::Span<int16_t>), (override));
+
+  MOCK_METHOD(bool, SetFuturePacket, (absl::Span<const uint8_t>, int),
+              (override));
+
   MOCK_METHOD(int, sample_rate_hz, (), (const, override));
 
   MOCK_METHOD(int, num_channels, (), (const, override));
@@ -51,6 +59,10 @@ class MockLyraDecoder : public LyraDecoderInterface {
   MOCK_METHOD(int, frame_rate, (), (const, override));
 
   MOCK_METHOD(bool, is_comfort_noise, (), (const, override));
+
+  MOCK_METHOD(DecoderMetrics, metrics, (), (const, override));
+
+  MOCK_METHOD(void, Reset, (), (override));
 };
 
 }  // namespace codec
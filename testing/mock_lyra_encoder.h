@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "absl/types/span.h"
+#include "codec_metrics.h"
 #include "gmock/gmock.h"
 #include "lyra_encoder_interface.h"
 
@@ -42,6 +43,10 @@ class MockLyraEncoder : public LyraEncoderInterface {
   MOCK_METHOD(int, bitrate, (), (const, override));
 
   MOCK_METHOD(int, frame_rate, (), (const, override));
+
+  MOCK_METHOD(EncoderMetrics, metrics, (), (const, override));
+
+  MOCK_METHOD(void, Reset, (), (override));
 };
 
 }  // namespace codec
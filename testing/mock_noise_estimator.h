@@ -17,8 +17,7 @@
 #ifndef LYRA_CODEC_TESTING_MOCK_NOISE_ESTIMATOR_H_
 #define LYRA_CODEC_TESTING_MOCK_NOISE_ESTIMATOR_H_
 
-#include <vector>
-
+#include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "noise_estimator_interface.h"
 
@@ -29,12 +28,14 @@ class MockNoiseEstimator : public NoiseEstimatorInterface {
  public:
   ~MockNoiseEstimator() override {}
 
-  MOCK_METHOD(std::vector<float>, NoiseEstimate, (), (const, override));
+  MOCK_METHOD(absl::Span<const float>, NoiseEstimate, (), (const, override));
 
-  MOCK_METHOD(bool, Update, (const std::vector<float>&), (override));
+  MOCK_METHOD(bool, Update, (absl::Span<const float>), (override));
 
-  MOCK_METHOD(absl::optional<bool>, IsSimilarNoise, (const std::vector<float>&),
+  MOCK_METHOD(absl::optional<bool>, IsSimilarNoise, (absl::Span<const float>),
               (override));
+
+  MOCK_METHOD(void, Reset, (), (override));
 };
 
 }  // namespace codec
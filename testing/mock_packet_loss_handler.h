@@ -17,9 +17,9 @@
 #ifndef LYRA_CODEC_TESTING_MOCK_PACKET_LOSS_HANDLER_H_
 #define LYRA_CODEC_TESTING_MOCK_PACKET_LOSS_HANDLER_H_
 
-#include <vector>
-
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "feature_frame.h"
 #include "gmock/gmock.h"
 #include "packet_loss_handler_interface.h"
 
@@ -30,13 +30,32 @@ class MockPacketLossHandler : public PacketLossHandlerInterface {
  public:
   ~MockPacketLossHandler() override {}
 
-  MOCK_METHOD(absl::optional<std::vector<float>>, EstimateLostFeatures,
+  MOCK_METHOD(absl::optional<FeatureFrame>, EstimateLostFeatures,
+              (int num_samples), (override));
+
+  MOCK_METHOD(absl::optional<FeatureFrame>, PeekLostFeatures,
               (int num_samples), (override));
 
-  MOCK_METHOD(bool, SetReceivedFeatures, (const std::vector<float>&),
+  MOCK_METHOD(bool, SetFutureFeatures,
+              (absl::Span<const float> features, int num_samples),
+              (override));
+
+  MOCK_METHOD(absl::optional<FeatureFrame>, EstimateSilenceFeatures,
+              (int num_samples), (override));
+
+  MOCK_METHOD(absl::optional<bool>, IsSimilarNoise,
+              (absl::Span<const float> features), (override));
+
+  MOCK_METHOD(bool, SetReceivedFeatures, (absl::Span<const float>),
               (override));
 
   MOCK_METHOD(bool, is_comfort_noise, (), (const, override));
+
+  MOCK_METHOD(void, Reset, (), (override));
+
+  MOCK_METHOD(bool, SaveState, (StateWriter * writer), (const, override));
+
+  MOCK_METHOD(bool, RestoreState, (StateReader * reader), (override));
 };
 
 }  // namespace codec
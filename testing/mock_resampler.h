@@ -35,6 +35,10 @@ class MockResampler : public ResamplerInterface {
               (override));
 
   MOCK_METHOD(void, Reset, (), (override));
+
+  MOCK_METHOD(bool, SaveState, (StateWriter * writer), (const, override));
+
+  MOCK_METHOD(bool, RestoreState, (StateReader * reader), (override));
 };
 
 }  // namespace codec
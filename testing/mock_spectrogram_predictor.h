@@ -17,8 +17,8 @@
 #ifndef LYRA_CODEC_TESTING_MOCK_SPECTROGRAM_PREDICTOR_H_
 #define LYRA_CODEC_TESTING_MOCK_SPECTROGRAM_PREDICTOR_H_
 
-#include <vector>
-
+#include "absl/types/span.h"
+#include "feature_frame.h"
 #include "gmock/gmock.h"
 #include "spectrogram_predictor_interface.h"
 
@@ -29,9 +29,11 @@ class MockSpectrogramPredictor : public SpectrogramPredictorInterface {
  public:
   ~MockSpectrogramPredictor() override {}
 
-  MOCK_METHOD(void, FeedFrame, (const std::vector<float>&), (override));
+  MOCK_METHOD(void, FeedFrame, (absl::Span<const float>), (override));
+
+  MOCK_METHOD(FeatureFrame, PredictFrame, (), (override));
 
-  MOCK_METHOD(std::vector<float>, PredictFrame, (), (override));
+  MOCK_METHOD(void, Reset, (), (override));
 };
 
 }  // namespace codec
@@ -18,10 +18,10 @@
 #define LYRA_CODEC_TESTING_MOCK_VECTOR_QUANTIZER_H_
 
 #include <optional>
-#include <string>
 #include <vector>
 
 #include "gmock/gmock.h"
+#include "quantized_bits.h"
 #include "vector_quantizer_interface.h"
 
 namespace chromemedia {
@@ -31,11 +31,11 @@ class MockVectorQuantizer : public VectorQuantizerInterface {
  public:
   ~MockVectorQuantizer() override {}
 
-  MOCK_METHOD(absl::optional<std::string>, Quantize,
+  MOCK_METHOD(absl::optional<QuantizedBits>, Quantize,
               (const std::vector<float>& features), (const, override));
 
   MOCK_METHOD(std::vector<float>, DecodeToLossyFeatures,
-              (const std::string& quantized_features), (const, override));
+              (const QuantizedBits& quantized_features), (const, override));
 };
 
 }  // namespace codec
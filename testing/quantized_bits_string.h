@@ -0,0 +1,51 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_TESTING_QUANTIZED_BITS_STRING_H_
+#define LYRA_CODEC_TESTING_QUANTIZED_BITS_STRING_H_
+
+#include <string>
+
+#include "quantized_bits.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Converts a string of '0' and '1' characters, like std::bitset::to_string()
+// returns, into bits in the same order.
+inline QuantizedBits QuantizedBitsFromString(const std::string& bits) {
+  QuantizedBits quantized_bits;
+  for (char bit : bits) {
+    quantized_bits.Append(bit == '1' ? 1 : 0, 1);
+  }
+  return quantized_bits;
+}
+
+// The inverse of |QuantizedBitsFromString|.
+inline std::string QuantizedBitsToString(const QuantizedBits& quantized_bits) {
+  std::string bits(quantized_bits.num_bits(), '0');
+  for (int i = 0; i < quantized_bits.num_bits(); ++i) {
+    if (quantized_bits.Read(i, 1) == 1) {
+      bits[i] = '1';
+    }
+  }
+  return bits;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_TESTING_QUANTIZED_BITS_STRING_H_
@@ -0,0 +1,326 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_affinity.h"
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // defined(__linux__)
+
+#if defined(__ANDROID__)
+#include <dlfcn.h>
+#endif  // defined(__ANDROID__)
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// Returns the highest clock of |cpu| in kHz, or 0 if it cannot be read.
+int64_t MaxFrequencyKhz(int cpu) {
+  std::ifstream file(absl::StrCat("/sys/devices/system/cpu/cpu", cpu,
+                                  "/cpufreq/cpuinfo_max_freq"));
+  int64_t frequency_khz = 0;
+  if (!(file >> frequency_khz)) {
+    return 0;
+  }
+  return frequency_khz;
+}
+
+// Makes the calling thread prefer the memory of |node|, where the kernel
+// supports memory policies. The pages still go to another node if |node| is
+// full.
+void PreferMemoryOfNode(int node) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+  constexpr int kBitsPerWord = sizeof(unsigned long) * CHAR_BIT;  // NOLINT
+  std::vector<unsigned long> mask(node / kBitsPerWord + 1, 0);  // NOLINT
+  mask[node / kBitsPerWord] = 1ul << (node % kBitsPerWord);
+  // The kernel reads one bit less than it is told to.
+  // Kernels without NUMA support have no policies to set.
+  if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(),
+              mask.size() * kBitsPerWord + 1) != 0 &&
+      errno != ENOSYS) {
+    LOG(WARNING) << "Could not prefer the memory of NUMA node " << node
+                 << ".";
+  }
+#endif  // defined(__linux__) && defined(SYS_set_mempolicy)
+}
+
+}  // namespace
+
+std::vector<int> ParseCpuList(absl::string_view cpu_list) {
+  std::vector<int> cpus;
+  cpu_list = absl::StripAsciiWhitespace(cpu_list);
+  if (cpu_list.empty()) {
+    return cpus;
+  }
+  for (const absl::string_view range : absl::StrSplit(cpu_list, ',')) {
+    const std::vector<absl::string_view> bounds = absl::StrSplit(range, '-');
+    int first;
+    int last;
+    if (bounds.size() > 2 || !absl::SimpleAtoi(bounds.front(), &first) ||
+        !absl::SimpleAtoi(bounds.back(), &last) || first < 0 ||
+        last < first) {
+      return {};
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+std::vector<NumaNode> DetectNumaNodes(const std::string& sysfs_root) {
+  std::map<int, NumaNode> nodes;
+  std::error_code error_code;
+  const ghc::filesystem::path node_directory =
+      ghc::filesystem::path(sysfs_root) / "devices" / "system" / "node";
+  for (const auto& entry :
+       ghc::filesystem::directory_iterator(node_directory, error_code)) {
+    absl::string_view name = entry.path().filename().string();
+    int id;
+    if (!absl::ConsumePrefix(&name, "node") || !absl::SimpleAtoi(name, &id)) {
+      continue;
+    }
+    std::ifstream file((entry.path() / "cpulist").string());
+    std::string cpu_list;
+    std::getline(file, cpu_list);
+    NumaNode node;
+    node.id = id;
+    node.cpus = ParseCpuList(cpu_list);
+    // Nodes of memory only, like CXL expanders, run no threads.
+    if (!node.cpus.empty()) {
+      nodes.emplace(id, std::move(node));
+    }
+  }
+  std::vector<NumaNode> result;
+  for (auto& [id, node] : nodes) {
+    result.push_back(std::move(node));
+  }
+  if (result.empty()) {
+    NumaNode all_cpus;
+    const int num_cpus =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      all_cpus.cpus.push_back(cpu);
+    }
+    result.push_back(std::move(all_cpus));
+  }
+  return result;
+}
+
+bool RunOnNumaNode(const NumaNode& node,
+                   const std::function<void()>& allocate) {
+  bool restricted = false;
+  std::thread thread([&node, &allocate, &restricted]() {
+    restricted = SetCurrentThreadAffinity(node.cpus);
+    PreferMemoryOfNode(node.id);
+    allocate();
+  });
+  thread.join();
+  return restricted;
+}
+
+std::vector<CpuCluster> DetectCpuClusters() {
+  const int num_cpus =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  // Ordered from the fastest to the slowest clock.
+  std::map<int64_t, CpuCluster, std::greater<int64_t>> clusters;
+  for (int cpu = 0; cpu < num_cpus; ++cpu) {
+    const int64_t frequency_khz = MaxFrequencyKhz(cpu);
+    CpuCluster& cluster = clusters[frequency_khz];
+    cluster.cpus.push_back(cpu);
+    cluster.max_frequency_khz = frequency_khz;
+  }
+  if (clusters.count(0) > 0) {
+    // Some clocks are unknown, so the cores cannot be grouped.
+    CpuCluster all_cpus;
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      all_cpus.cpus.push_back(cpu);
+    }
+    return {all_cpus};
+  }
+  std::vector<CpuCluster> result;
+  for (auto& [frequency_khz, cluster] : clusters) {
+    result.push_back(std::move(cluster));
+  }
+  return result;
+}
+
+std::string CpuClusterName(const CpuCluster& cluster) {
+  std::string name = "cpus";
+  // Consecutive CPUs are written as ranges.
+  for (int i = 0; i < cluster.cpus.size();) {
+    int end = i + 1;
+    while (end < cluster.cpus.size() &&
+           cluster.cpus[end] == cluster.cpus[end - 1] + 1) {
+      ++end;
+    }
+    absl::StrAppend(&name, i == 0 ? " " : ",", cluster.cpus[i]);
+    if (end - i > 1) {
+      absl::StrAppend(&name, "-", cluster.cpus[end - 1]);
+    }
+    i = end;
+  }
+  if (cluster.max_frequency_khz > 0) {
+    absl::StrAppend(&name, " at ", cluster.max_frequency_khz / 1000, " MHz");
+  }
+  return name;
+}
+
+bool SetCurrentThreadAffinity(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return true;
+  }
+#if defined(__linux__)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (const int cpu : cpus) {
+    CPU_SET(cpu, &cpu_set);
+  }
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    LOG(WARNING) << "Could not restrict a thread to "
+                 << CpuClusterName({cpus}) << ".";
+    return false;
+  }
+  return true;
+#else
+  LOG(WARNING) << "Thread affinity is not supported on this platform.";
+  return false;
+#endif  // defined(__linux__)
+}
+
+int32_t CurrentThreadId() {
+#if defined(__linux__)
+  return static_cast<int32_t>(syscall(SYS_gettid));
+#else
+  return 0;
+#endif  // defined(__linux__)
+}
+
+ThreadAffinity AffinityForCluster(const CpuCluster& cluster) {
+  ThreadAffinity affinity;
+  affinity.calling_thread_cpus = cluster.cpus;
+  affinity.background_thread_cpus = cluster.cpus;
+  return affinity;
+}
+
+// The performance hint functions of libandroid, which are looked up at run
+// time so that the codec still runs on Android versions without them.
+struct PerformanceHintApi {
+  void* (*get_manager)();
+  void* (*create_session)(void* manager, const int32_t* thread_ids,
+                          size_t size, int64_t target_nanos);
+  int (*report_actual_work_duration)(void* session, int64_t actual_nanos);
+  void (*close_session)(void* session);
+};
+
+namespace {
+
+const PerformanceHintApi* LoadPerformanceHintApi() {
+#if defined(__ANDROID__)
+  static const PerformanceHintApi* const api =
+      []() -> const PerformanceHintApi* {
+    void* library = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    if (library == nullptr) {
+      return nullptr;
+    }
+    auto* api = new PerformanceHintApi;
+    api->get_manager = reinterpret_cast<decltype(api->get_manager)>(
+        dlsym(library, "APerformanceHint_getManager"));
+    api->create_session = reinterpret_cast<decltype(api->create_session)>(
+        dlsym(library, "APerformanceHint_createSession"));
+    api->report_actual_work_duration =
+        reinterpret_cast<decltype(api->report_actual_work_duration)>(
+            dlsym(library, "APerformanceHint_reportActualWorkDuration"));
+    api->close_session = reinterpret_cast<decltype(api->close_session)>(
+        dlsym(library, "APerformanceHint_closeSession"));
+    if (api->get_manager == nullptr || api->create_session == nullptr ||
+        api->report_actual_work_duration == nullptr ||
+        api->close_session == nullptr) {
+      delete api;
+      return nullptr;
+    }
+    return api;
+  }();
+  return api;
+#else
+  return nullptr;
+#endif  // defined(__ANDROID__)
+}
+
+}  // namespace
+
+std::unique_ptr<PerformanceHintSession> PerformanceHintSession::Create(
+    const std::vector<int32_t>& thread_ids, absl::Duration target) {
+  const PerformanceHintApi* api = LoadPerformanceHintApi();
+  if (api == nullptr) {
+    LOG(WARNING) << "Performance hints are not supported on this platform.";
+    return nullptr;
+  }
+  void* manager = api->get_manager();
+  void* session =
+      manager == nullptr
+          ? nullptr
+          : api->create_session(manager, thread_ids.data(), thread_ids.size(),
+                                absl::ToInt64Nanoseconds(target));
+  if (session == nullptr) {
+    LOG(WARNING) << "Could not create a performance hint session.";
+    return nullptr;
+  }
+  // WrapUnique is used because of private c'tor.
+  return absl::WrapUnique(new PerformanceHintSession(api, session));
+}
+
+PerformanceHintSession::PerformanceHintSession(const PerformanceHintApi* api,
+                                               void* session)
+    : api_(api), session_(session) {}
+
+PerformanceHintSession::~PerformanceHintSession() {
+  api_->close_session(session_);
+}
+
+void PerformanceHintSession::ReportActualWorkDuration(
+    absl::Duration duration) {
+  api_->report_actual_work_duration(session_,
+                                    absl::ToInt64Nanoseconds(duration));
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_THREAD_AFFINITY_H_
+#define LYRA_CODEC_THREAD_AFFINITY_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace chromemedia {
+namespace codec {
+
+// The CPUs of a cluster of identical cores, like the big or the LITTLE cores
+// of a heterogeneous ARM SoC.
+struct CpuCluster {
+  std::vector<int> cpus;
+  // The highest clock of the cores, or 0 if unknown.
+  int64_t max_frequency_khz = 0;
+};
+
+// Returns the clusters of the running device from the fastest to the slowest,
+// telling them apart by the highest clock of their cores as reported by
+// sysfs on Linux and Android. Returns a single cluster of all cores where the
+// clocks cannot be read.
+std::vector<CpuCluster> DetectCpuClusters();
+
+// Returns a short description of |cluster| for logs, like "cpus 4-7 at
+// 2841 MHz".
+std::string CpuClusterName(const CpuCluster& cluster);
+
+// The CPUs of a NUMA node, which reach the memory of the node faster than
+// that of the other nodes.
+struct NumaNode {
+  int id = 0;
+  std::vector<int> cpus;
+};
+
+// Returns the NUMA nodes that have CPUs from the lowest id up, as reported by
+// sysfs under |sysfs_root| on Linux. Returns a single node 0 of every core
+// where the topology cannot be read, as on Android.
+std::vector<NumaNode> DetectNumaNodes(const std::string& sysfs_root = "/sys");
+
+// Parses a list of CPUs in the format of sysfs, like "0-3,8,10-11". Returns an
+// empty vector if |cpu_list| is malformed.
+std::vector<int> ParseCpuList(absl::string_view cpu_list);
+
+// Runs |allocate| on a new thread restricted to the CPUs of |node| that
+// prefers the memory of |node|, and waits for it. Linux places a page on the
+// node of the thread that first touches it, so what |allocate| allocates and
+// fills in, like weights, ends up in the memory of |node|, as does that of
+// the threads it starts. Returns false if the thread could not be restricted,
+// in which case |allocate| still ran, on any node.
+bool RunOnNumaNode(const NumaNode& node, const std::function<void()>& allocate);
+
+// Restricts the calling thread to |cpus|. Does nothing and returns true if
+// |cpus| is empty. Returns false and logs a warning if the platform does not
+// support it or the kernel refused.
+bool SetCurrentThreadAffinity(const std::vector<int>& cpus);
+
+// Returns the kernel id of the calling thread, or 0 where there is none.
+int32_t CurrentThreadId();
+
+// Where the threads of a |ThreadPool| run, and whether the OS is told how
+// fast they have to be.
+struct ThreadAffinity {
+  // The CPUs the thread with |tid| 0 is restricted to. As that is the thread
+  // calling |ThreadPool::Run|, its affinity stays changed after it returns.
+  // Left alone if empty.
+  std::vector<int> calling_thread_cpus;
+  // Background thread |tid| is pinned to the CPU at |tid| - 1 modulo the size
+  // of this, so that the scheduler cannot migrate it. Left alone if empty.
+  std::vector<int> background_thread_cpus;
+  // If positive, the OS is asked to clock the cores so that each
+  // |ThreadPool::Run| finishes within this time, through the performance hint
+  // API of Android 13 and later. Ignored where that is not available.
+  absl::Duration performance_hint_target = absl::ZeroDuration();
+};
+
+// Returns an affinity that runs every thread on |cluster|.
+ThreadAffinity AffinityForCluster(const CpuCluster& cluster);
+
+// The functions of the performance hint API, defined where it is available.
+struct PerformanceHintApi;
+
+// Reports how long the work of a fixed set of threads took to the OS, so that
+// it can raise or lower their clocks to meet a target duration.
+class PerformanceHintSession {
+ public:
+  // Returns a nullptr if the platform has no performance hint API, such as
+  // anything but Android 13 or later, or it refused the session.
+  static std::unique_ptr<PerformanceHintSession> Create(
+      const std::vector<int32_t>& thread_ids, absl::Duration target);
+
+  ~PerformanceHintSession();
+
+  void ReportActualWorkDuration(absl::Duration duration);
+
+ private:
+  PerformanceHintSession(const PerformanceHintApi* api, void* session);
+
+  const PerformanceHintApi* const api_;
+  void* const session_;
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_THREAD_AFFINITY_H_
@@ -0,0 +1,128 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_affinity.h"
+
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "include/ghc/filesystem.hpp"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(ThreadAffinityTest, ClustersCoverEveryCpuOnceFastestFirst) {
+  const std::vector<CpuCluster> clusters = DetectCpuClusters();
+  ASSERT_FALSE(clusters.empty());
+  std::set<int> cpus;
+  for (int i = 0; i < clusters.size(); ++i) {
+    EXPECT_FALSE(clusters[i].cpus.empty());
+    for (const int cpu : clusters[i].cpus) {
+      EXPECT_TRUE(cpus.insert(cpu).second) << cpu;
+    }
+    if (i > 0) {
+      EXPECT_GT(clusters[i - 1].max_frequency_khz,
+                clusters[i].max_frequency_khz);
+    }
+  }
+  EXPECT_EQ(cpus.size(),
+            std::max(1u, std::thread::hardware_concurrency()));
+}
+
+TEST(ThreadAffinityTest, ClusterNameWritesRanges) {
+  EXPECT_EQ(CpuClusterName({{0, 1, 2, 3}, 1800000}), "cpus 0-3 at 1800 MHz");
+  EXPECT_EQ(CpuClusterName({{4, 6, 7}, 0}), "cpus 4,6-7");
+}
+
+TEST(ThreadAffinityTest, AffinityForClusterPlacesEveryThread) {
+  const ThreadAffinity affinity = AffinityForCluster({{6, 7}, 2400000});
+  EXPECT_EQ(affinity.calling_thread_cpus, std::vector<int>({6, 7}));
+  EXPECT_EQ(affinity.background_thread_cpus, std::vector<int>({6, 7}));
+  EXPECT_EQ(affinity.performance_hint_target, absl::ZeroDuration());
+}
+
+TEST(ThreadAffinityTest, EmptyAffinityLeavesThreadAlone) {
+  EXPECT_TRUE(SetCurrentThreadAffinity({}));
+}
+
+TEST(ThreadAffinityTest, ParsesCpuLists) {
+  EXPECT_EQ(ParseCpuList("0-3,8,10-11\n"),
+            std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_EQ(ParseCpuList("5"), std::vector<int>({5}));
+  EXPECT_TRUE(ParseCpuList("").empty());
+  EXPECT_TRUE(ParseCpuList("3-1").empty());
+  EXPECT_TRUE(ParseCpuList("0,,1").empty());
+  EXPECT_TRUE(ParseCpuList("0-1-2").empty());
+}
+
+TEST(ThreadAffinityTest, NumaNodesAreReadFromSysfs) {
+  const ghc::filesystem::path sysfs_root =
+      ghc::filesystem::temp_directory_path() / "thread_affinity_numa_test";
+  const ghc::filesystem::path nodes =
+      sysfs_root / "devices" / "system" / "node";
+  for (const auto& [name, cpu_list] :
+       std::vector<std::pair<std::string, std::string>>{
+           {"node1", "8-15\n"}, {"node0", "0-7\n"}, {"node2", "\n"}}) {
+    ghc::filesystem::create_directories(nodes / name);
+    std::ofstream((nodes / name / "cpulist").string()) << cpu_list;
+  }
+  ghc::filesystem::create_directories(nodes / "power");
+
+  const std::vector<NumaNode> numa_nodes = DetectNumaNodes(sysfs_root);
+  ghc::filesystem::remove_all(sysfs_root);
+
+  // The node without CPUs holds memory only and is left out.
+  ASSERT_EQ(numa_nodes.size(), 2);
+  EXPECT_EQ(numa_nodes[0].id, 0);
+  EXPECT_EQ(numa_nodes[0].cpus.size(), 8);
+  EXPECT_EQ(numa_nodes[1].id, 1);
+  EXPECT_EQ(numa_nodes[1].cpus.front(), 8);
+}
+
+TEST(ThreadAffinityTest, MissingTopologyIsOneNodeOfEveryCpu) {
+  const std::vector<NumaNode> nodes = DetectNumaNodes("/nonexistent");
+
+  ASSERT_EQ(nodes.size(), 1);
+  EXPECT_EQ(nodes[0].id, 0);
+  EXPECT_EQ(nodes[0].cpus.size(),
+            std::max(1u, std::thread::hardware_concurrency()));
+}
+
+TEST(ThreadAffinityTest, RunOnNumaNodeRunsOnAnotherThread) {
+  const std::thread::id caller = std::this_thread::get_id();
+  std::thread::id runner = caller;
+
+  RunOnNumaNode(DetectNumaNodes().front(),
+                [&runner]() { runner = std::this_thread::get_id(); });
+
+  EXPECT_NE(runner, caller);
+}
+
+#if !defined(__ANDROID__)
+TEST(ThreadAffinityTest, PerformanceHintsNeedAndroid) {
+  EXPECT_EQ(PerformanceHintSession::Create({CurrentThreadId()},
+                                           absl::Milliseconds(10)),
+            nullptr);
+}
+#endif  // !defined(__ANDROID__)
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
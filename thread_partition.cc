@@ -0,0 +1,85 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_partition.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+
+std::vector<int> PartitionByWork(absl::Span<const int64_t> work, int num_parts,
+                                 int granularity) {
+  CHECK_GT(num_parts, 0);
+  CHECK_GT(granularity, 0);
+  const int num_units = work.size();
+  // |prefix_work[g]| is the work of the first |g| groups of |granularity|
+  // units, the last of which may be shorter.
+  const int num_groups = (num_units + granularity - 1) / granularity;
+  std::vector<int64_t> prefix_work(num_groups + 1, 0);
+  for (int g = 0; g < num_groups; ++g) {
+    const int group_end = std::min((g + 1) * granularity, num_units);
+    prefix_work[g + 1] = prefix_work[g];
+    for (int unit = g * granularity; unit < group_end; ++unit) {
+      prefix_work[g + 1] += work[unit];
+    }
+  }
+
+  // Each boundary is put at the group boundary closest to its share of the
+  // total work, which keeps every part within one group of its share.
+  const int64_t total_work = prefix_work[num_groups];
+  std::vector<int> starts(num_parts + 1, 0);
+  int group = 0;
+  for (int part = 1; part < num_parts; ++part) {
+    const double target = static_cast<double>(total_work) * part / num_parts;
+    while (group < num_groups && prefix_work[group + 1] <= target) {
+      ++group;
+    }
+    if (group < num_groups &&
+        target - prefix_work[group] > prefix_work[group + 1] - target) {
+      ++group;
+    }
+    starts[part] = std::min(group * granularity, num_units);
+  }
+  starts[num_parts] = num_units;
+  return starts;
+}
+
+float WorkImbalance(absl::Span<const int64_t> work,
+                    const std::vector<int>& starts) {
+  const int num_parts = starts.size() - 1;
+  CHECK_GT(num_parts, 0);
+  int64_t total_work = 0;
+  int64_t max_part_work = 0;
+  for (int part = 0; part < num_parts; ++part) {
+    int64_t part_work = 0;
+    for (int unit = starts[part]; unit < starts[part + 1]; ++unit) {
+      part_work += work[unit];
+    }
+    total_work += part_work;
+    max_part_work = std::max(max_part_work, part_work);
+  }
+  if (total_work == 0) {
+    return 1.0f;
+  }
+  return static_cast<float>(max_part_work) * num_parts / total_work;
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_THREAD_PARTITION_H_
+#define LYRA_CODEC_THREAD_PARTITION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace chromemedia {
+namespace codec {
+
+// Splits the units [0, |work.size()|) into |num_parts| contiguous ranges
+// whose summed |work| is as even as possible, where every boundary but the
+// last is a multiple of |granularity|. Returns the |num_parts| + 1 boundaries:
+// part |i| is [|starts[i]|, |starts[i + 1]|). Parts may be empty if there are
+// fewer groups of |granularity| units than parts.
+std::vector<int> PartitionByWork(absl::Span<const int64_t> work, int num_parts,
+                                 int granularity);
+
+// Returns the largest summed |work| of a part of |starts|, as returned by
+// |PartitionByWork|, over the average of all parts. It is 1 for a perfectly
+// balanced partition, and for no work at all.
+float WorkImbalance(absl::Span<const int64_t> work,
+                    const std::vector<int>& starts);
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_THREAD_PARTITION_H_
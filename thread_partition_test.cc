@@ -0,0 +1,69 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_partition.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+TEST(ThreadPartitionTest, UniformWorkIsSplitEvenly) {
+  const std::vector<int64_t> work(1024, 1);
+  // Dividing by row count and giving the remainder to the last thread would
+  // give it 184 of the 1024 rows, instead of 168 or 176.
+  const std::vector<int> starts = PartitionByWork(work, 6, 8);
+  EXPECT_THAT(starts, testing::ElementsAre(0, 168, 344, 512, 680, 856, 1024));
+  for (int part = 0; part + 1 < starts.size(); ++part) {
+    EXPECT_EQ(starts[part] % 8, 0);
+  }
+  EXPECT_LT(WorkImbalance(work, starts), 1.04f);
+}
+
+TEST(ThreadPartitionTest, UnevenWorkIsSplitByWork) {
+  // The first half of the units has three times the work of the second half.
+  std::vector<int64_t> work(64, 1);
+  std::fill(work.begin(), work.begin() + 32, 3);
+  const std::vector<int> starts = PartitionByWork(work, 2, 4);
+  EXPECT_THAT(starts, testing::ElementsAre(0, 20, 64));
+  EXPECT_LT(WorkImbalance(work, starts), 1.1f);
+
+  // An even split by count gives the first part three quarters of the work.
+  EXPECT_FLOAT_EQ(WorkImbalance(work, {0, 32, 64}), 1.5f);
+}
+
+TEST(ThreadPartitionTest, MorePartsThanGroupsGivesEmptyParts) {
+  const std::vector<int64_t> work(8, 1);
+  const std::vector<int> starts = PartitionByWork(work, 4, 4);
+  EXPECT_EQ(starts.front(), 0);
+  EXPECT_EQ(starts.back(), 8);
+  for (int part = 0; part + 1 < starts.size(); ++part) {
+    EXPECT_LE(starts[part], starts[part + 1]);
+  }
+}
+
+TEST(ThreadPartitionTest, NoWorkIsBalanced) {
+  const std::vector<int64_t> work(16, 0);
+  EXPECT_EQ(WorkImbalance(work, PartitionByWork(work, 3, 4)), 1.0f);
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,226 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "sparse_inference_matrixvector.h"
+#include "thread_affinity.h"
+#include "tracing.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+struct JobWaiter {
+  const std::atomic<int64_t>* num_jobs;
+  const std::atomic<bool>* terminate;
+  int64_t num_jobs_seen;
+};
+
+bool HasNewJobOrTerminated(JobWaiter* waiter) {
+  return waiter->terminate->load() ||
+         waiter->num_jobs->load() > waiter->num_jobs_seen;
+}
+
+}  // namespace
+
+std::unique_ptr<ThreadPool> ThreadPool::Create(
+    int num_threads, const ThreadAffinity& affinity) {
+  if (num_threads < 1) {
+    LOG(ERROR) << "Number of threads has to be positive, but was "
+               << num_threads << ".";
+    return nullptr;
+  }
+  // WrapUnique is used because of private c'tor.
+  return absl::WrapUnique(new ThreadPool(num_threads, affinity));
+}
+
+ThreadPool::ThreadPool(int num_threads, const ThreadAffinity& affinity)
+    : num_threads_(num_threads),
+      affinity_(affinity),
+      background_thread_ids_(num_threads - 1, 0),
+      job_(nullptr),
+      job_num_threads_(0),
+      job_trace_sink_(nullptr),
+      num_pending_threads_(0),
+      num_jobs_(0),
+      terminate_(false),
+      parked_(true) {
+  for (int i = 1; i <= num_threads_; ++i) {
+    barriers_.push_back(absl::make_unique<csrblocksparse::SpinBarrier>(i));
+  }
+  absl::MutexLock run_lock(&run_mutex_);
+  StartBackgroundThreads();
+}
+
+ThreadPool::~ThreadPool() {
+  absl::MutexLock run_lock(&run_mutex_);
+  StopBackgroundThreads();
+}
+
+void ThreadPool::StartBackgroundThreads() {
+  // The background threads place themselves and report their ids before
+  // the pool is used, so that a performance hint session can include them.
+  absl::BlockingCounter num_starting_threads(num_threads_ - 1);
+  threads_.reserve(num_threads_ - 1);
+  for (int tid = 1; tid < num_threads_; ++tid) {
+    threads_.push_back(absl::make_unique<csrblocksparse::Thread>(
+        [this, tid, &num_starting_threads]() {
+          const std::vector<int>& cpus = affinity_.background_thread_cpus;
+          if (!cpus.empty()) {
+            SetCurrentThreadAffinity({cpus[(tid - 1) % cpus.size()]});
+          }
+          background_thread_ids_[tid - 1] = CurrentThreadId();
+          num_starting_threads.DecrementCount();
+          RunBackgroundThread(tid);
+        }));
+  }
+  num_starting_threads.Wait();
+  parked_ = false;
+}
+
+void ThreadPool::StopBackgroundThreads() {
+  {
+    absl::MutexLock lock(&wake_mutex_);
+    terminate_.store(true);
+  }
+  for (const auto& thread : threads_) {
+    thread->join();
+  }
+  threads_.clear();
+  // Restarted threads count the jobs from 0 again.
+  num_jobs_.store(0);
+  terminate_.store(false);
+  parked_ = true;
+}
+
+void ThreadPool::Park() {
+  absl::MutexLock run_lock(&run_mutex_);
+  if (parked_) {
+    return;
+  }
+  StopBackgroundThreads();
+  // The hint session holds the ids of the stopped threads.
+  hint_session_.reset();
+  calling_thread_ = std::thread::id();
+}
+
+void ThreadPool::Unpark() {
+  absl::MutexLock run_lock(&run_mutex_);
+  if (parked_) {
+    StartBackgroundThreads();
+  }
+}
+
+bool ThreadPool::is_parked() {
+  absl::MutexLock run_lock(&run_mutex_);
+  return parked_;
+}
+
+void ThreadPool::Run(int num_threads, const Function& func) {
+  CHECK_GE(num_threads, 1);
+  CHECK_LE(num_threads, num_threads_);
+  absl::MutexLock run_lock(&run_mutex_);
+  if (parked_) {
+    LYRA_TRACE_SCOPE("UnparkThreadPool");
+    StartBackgroundThreads();
+  }
+  PlaceCallingThread();
+  const absl::Time start = absl::Now();
+  csrblocksparse::SpinBarrier* barrier = barriers_[num_threads - 1].get();
+  if (num_threads_ == 1) {
+    func(barrier, 0);
+  } else {
+    RunOnAllThreads(num_threads, func, barrier);
+  }
+  if (hint_session_ != nullptr) {
+    hint_session_->ReportActualWorkDuration(absl::Now() - start);
+  }
+}
+
+void ThreadPool::RunOnAllThreads(int num_threads, const Function& func,
+                                 csrblocksparse::SpinBarrier* barrier) {
+  job_ = &func;
+  job_num_threads_ = num_threads;
+  job_trace_sink_ = Tracing::thread_sink();
+  // Every background thread acknowledges the job, also the ones that do not
+  // take part in it, so that none of them still reads |job_| when the next
+  // one is posted.
+  num_pending_threads_.store(num_threads_ - 1);
+  {
+    // Blocked background threads re-evaluate their condition on unlock.
+    absl::MutexLock lock(&wake_mutex_);
+    num_jobs_.fetch_add(1);
+  }
+
+  func(barrier, 0);
+  while (num_pending_threads_.load() > 0) {
+    std::this_thread::yield();
+  }
+  job_ = nullptr;
+}
+
+void ThreadPool::PlaceCallingThread() {
+  if (calling_thread_ == std::this_thread::get_id()) {
+    return;
+  }
+  calling_thread_ = std::this_thread::get_id();
+  SetCurrentThreadAffinity(affinity_.calling_thread_cpus);
+  if (affinity_.performance_hint_target > absl::ZeroDuration()) {
+    std::vector<int32_t> thread_ids = background_thread_ids_;
+    thread_ids.push_back(CurrentThreadId());
+    hint_session_ = PerformanceHintSession::Create(
+        thread_ids, affinity_.performance_hint_target);
+  }
+}
+
+void ThreadPool::RunBackgroundThread(int tid) {
+  int64_t num_jobs_seen = 0;
+  while (WaitForJob(num_jobs_seen)) {
+    ++num_jobs_seen;
+    if (tid < job_num_threads_) {
+      ScopedTraceSink sink(job_trace_sink_);
+      (*job_)(barriers_[job_num_threads_ - 1].get(), tid);
+    }
+    num_pending_threads_.fetch_sub(1);
+  }
+}
+
+bool ThreadPool::WaitForJob(int64_t num_jobs_seen) {
+  JobWaiter waiter{&num_jobs_, &terminate_, num_jobs_seen};
+  const absl::Time spin_end = absl::Now() + kSpinBeforeBlocking;
+  while (!HasNewJobOrTerminated(&waiter)) {
+    if (absl::Now() > spin_end) {
+      absl::MutexLock lock(&wake_mutex_);
+      wake_mutex_.Await(absl::Condition(&HasNewJobOrTerminated, &waiter));
+      break;
+    }
+  }
+  return !terminate_.load();
+}
+
+}  // namespace codec
+}  // namespace chromemedia
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_THREAD_POOL_H_
+#define LYRA_CODEC_THREAD_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "sparse_inference_matrixvector.h"
+#include "thread_affinity.h"
+#include "tracing.h"
+
+namespace chromemedia {
+namespace codec {
+
+// A fixed set of threads that run a function on several threads synchronized
+// by a barrier, like |LaunchOnThreadsWithBarrier|, but without starting
+// threads on every call. The calling thread is always the one with |tid| 0.
+// A pool may be shared by several models, whose calls to |Run| then take
+// turns. The thread calling |Run| is placed according to the affinity of the
+// pool whenever it differs from the previous caller. The background threads
+// run a job with the |TraceSink| of the thread calling |Run|.
+class ThreadPool {
+ public:
+  using Function = std::function<void(csrblocksparse::SpinBarrier*, int)>;
+
+  // Starts |num_threads| - 1 background threads, which block while there is
+  // nothing to run, placed according to |affinity|. Returns a nullptr if
+  // |num_threads| is not positive.
+  static std::unique_ptr<ThreadPool> Create(
+      int num_threads, const ThreadAffinity& affinity = ThreadAffinity());
+
+  ~ThreadPool();
+
+  // Calls |func| with every |tid| in [0, |num_threads|) on as many threads and
+  // a barrier for all of them, and returns once all calls returned.
+  // |num_threads| has to be in [1, |num_threads()|]. Thread-safe, concurrent
+  // calls are serialized. Restarts the background threads if the pool is
+  // parked.
+  void Run(int num_threads, const Function& func);
+
+  // Stops the background threads, e.g. while the models using the pool are
+  // idle for a long time, so that they neither wake up nor hold their stacks.
+  // The next |Run| or |Unpark| starts them again. Thread-safe.
+  void Park();
+
+  // Starts the background threads again if the pool is parked, which takes
+  // about as long as creating the pool. Thread-safe.
+  void Unpark();
+
+  bool is_parked();
+
+  int num_threads() const { return num_threads_; }
+
+ private:
+  static constexpr absl::Duration kSpinBeforeBlocking = absl::Microseconds(50);
+
+  ThreadPool(int num_threads, const ThreadAffinity& affinity);
+
+  // Starts the |num_threads_| - 1 background threads and waits until they
+  // placed themselves.
+  void StartBackgroundThreads() ABSL_EXCLUSIVE_LOCKS_REQUIRED(run_mutex_);
+  void StopBackgroundThreads() ABSL_EXCLUSIVE_LOCKS_REQUIRED(run_mutex_);
+
+  // Posts |func| to the background threads and runs it as |tid| 0, returning
+  // once every background thread acknowledged it.
+  void RunOnAllThreads(int num_threads, const Function& func,
+                       csrblocksparse::SpinBarrier* barrier)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(run_mutex_);
+
+  void RunBackgroundThread(int tid);
+
+  // Applies |affinity_| to the calling thread and starts a performance hint
+  // session including it, unless that was already done for this thread.
+  void PlaceCallingThread() ABSL_EXCLUSIVE_LOCKS_REQUIRED(run_mutex_);
+
+  // Returns true once a job after the first |num_jobs_seen| was posted, or
+  // false if the pool is terminated first. Spins for up to
+  // |kSpinBeforeBlocking| before blocking on |wake_mutex_|.
+  bool WaitForJob(int64_t num_jobs_seen);
+
+  const int num_threads_;
+  // One per number of participating threads, indexed by that number - 1.
+  std::vector<std::unique_ptr<csrblocksparse::SpinBarrier>> barriers_;
+
+  const ThreadAffinity affinity_;
+  // The kernel ids of the background threads, indexed by |tid| - 1.
+  std::vector<int32_t> background_thread_ids_;
+
+  // Serializes |Run|.
+  absl::Mutex run_mutex_;
+  // The last thread that called |Run|, which |affinity_| was applied to.
+  std::thread::id calling_thread_ ABSL_GUARDED_BY(run_mutex_);
+  std::unique_ptr<PerformanceHintSession> hint_session_
+      ABSL_GUARDED_BY(run_mutex_);
+  // The job being run. Only written by |Run| while no background thread
+  // reads them.
+  const Function* job_;
+  int job_num_threads_;
+  TraceSink* job_trace_sink_;
+  // The number of background threads that did not finish the current job.
+  std::atomic<int> num_pending_threads_;
+
+  // Background threads block on this while there is no job.
+  absl::Mutex wake_mutex_;
+  std::atomic<int64_t> num_jobs_;
+  std::atomic<bool> terminate_;
+
+  // Empty while the pool is parked.
+  std::vector<std::unique_ptr<csrblocksparse::Thread>> threads_
+      ABSL_GUARDED_BY(run_mutex_);
+  bool parked_ ABSL_GUARDED_BY(run_mutex_);
+};
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_THREAD_POOL_H_
@@ -0,0 +1,196 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_pool.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif  // defined(__linux__)
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "sparse_inference_matrixvector.h"
+#include "thread_affinity.h"
+#include "tracing.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+class ThreadPoolTest : public testing::TestWithParam<int> {
+ protected:
+  ThreadPoolTest() : pool_(ThreadPool::Create(GetParam())) {}
+
+  std::unique_ptr<ThreadPool> pool_;
+};
+
+TEST_P(ThreadPoolTest, RunsEveryTidOnce) {
+  ASSERT_NE(pool_, nullptr);
+  EXPECT_EQ(pool_->num_threads(), GetParam());
+  for (int num_threads = 1; num_threads <= GetParam(); ++num_threads) {
+    // Run several times to check that the threads are reused.
+    for (int run = 0; run < 3; ++run) {
+      std::vector<std::atomic<int>> num_calls(GetParam());
+      for (auto& count : num_calls) count.store(0);
+      pool_->Run(num_threads,
+                 [&](csrblocksparse::SpinBarrier* barrier, int tid) {
+                   num_calls[tid].fetch_add(1);
+                   barrier->barrier();
+                 });
+      for (int tid = 0; tid < GetParam(); ++tid) {
+        EXPECT_EQ(num_calls[tid].load(), tid < num_threads ? 1 : 0) << tid;
+      }
+    }
+  }
+}
+
+TEST_P(ThreadPoolTest, CallerIsTidZero) {
+  ASSERT_NE(pool_, nullptr);
+  const std::thread::id caller = std::this_thread::get_id();
+  std::vector<std::thread::id> ids(GetParam());
+  pool_->Run(GetParam(), [&](csrblocksparse::SpinBarrier* barrier, int tid) {
+    ids[tid] = std::this_thread::get_id();
+  });
+  EXPECT_EQ(ids[0], caller);
+  for (int tid = 1; tid < GetParam(); ++tid) {
+    EXPECT_NE(ids[tid], caller);
+  }
+}
+
+class CountingSink : public TraceSink {
+ public:
+  void Record(const char* name, int64_t begin_nanos,
+              int64_t end_nanos) override {
+    ++num_events;
+  }
+
+  std::atomic<int> num_events{0};
+};
+
+TEST_P(ThreadPoolTest, ThreadsTakeTheTraceSinkOfTheCaller) {
+  ASSERT_NE(pool_, nullptr);
+  CountingSink sink;
+  const auto job = [](csrblocksparse::SpinBarrier* barrier, int tid) {
+    LYRA_TRACE_SCOPE("job");
+  };
+  {
+    ScopedTraceSink scoped_sink(&sink);
+    pool_->Run(GetParam(), job);
+  }
+  EXPECT_EQ(sink.num_events, GetParam());
+
+  // Without a sink of the caller the threads have none either.
+  pool_->Run(GetParam(), job);
+  EXPECT_EQ(sink.num_events, GetParam());
+}
+
+TEST_P(ThreadPoolTest, ConcurrentRunsAreSerialized) {
+  ASSERT_NE(pool_, nullptr);
+  std::atomic<int> num_running(0);
+  std::atomic<bool> overlapped(false);
+  auto run_many = [&]() {
+    for (int i = 0; i < 50; ++i) {
+      pool_->Run(GetParam(), [&](csrblocksparse::SpinBarrier* barrier,
+                                 int tid) {
+        if (tid == 0 && num_running.fetch_add(1) != 0) overlapped.store(true);
+        barrier->barrier();
+        if (tid == 0) num_running.fetch_sub(1);
+      });
+    }
+  };
+  std::thread other(run_many);
+  run_many();
+  other.join();
+  EXPECT_FALSE(overlapped.load());
+}
+
+TEST_P(ThreadPoolTest, ParkedPoolRestartsOnRun) {
+  ASSERT_NE(pool_, nullptr);
+  EXPECT_FALSE(pool_->is_parked());
+  for (int park = 0; park < 3; ++park) {
+    pool_->Park();
+    EXPECT_TRUE(pool_->is_parked());
+    // Every run after a restart has to be seen by the new threads.
+    for (int run = 0; run < 3; ++run) {
+      std::vector<std::atomic<int>> num_calls(GetParam());
+      for (auto& count : num_calls) count.store(0);
+      pool_->Run(GetParam(),
+                 [&](csrblocksparse::SpinBarrier* barrier, int tid) {
+                   num_calls[tid].fetch_add(1);
+                   barrier->barrier();
+                 });
+      for (int tid = 0; tid < GetParam(); ++tid) {
+        EXPECT_EQ(num_calls[tid].load(), 1) << tid;
+      }
+    }
+    EXPECT_FALSE(pool_->is_parked());
+  }
+  pool_->Park();
+  pool_->Unpark();
+  EXPECT_FALSE(pool_->is_parked());
+}
+
+INSTANTIATE_TEST_SUITE_P(NumThreads, ThreadPoolTest, testing::Values(1, 2, 4));
+
+#if defined(__linux__)
+// Returns the CPUs the calling thread may run on.
+std::vector<int> CurrentThreadCpus() {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  sched_getaffinity(0, sizeof(cpu_set), &cpu_set);
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &cpu_set)) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+TEST(ThreadPoolAffinity, PinsBackgroundThreadsAndCaller) {
+  const std::vector<int> allowed = CurrentThreadCpus();
+  ASSERT_FALSE(allowed.empty());
+  ThreadAffinity affinity;
+  affinity.background_thread_cpus = {allowed.back()};
+  affinity.calling_thread_cpus = {allowed.front()};
+
+  std::vector<std::vector<int>> cpus(3);
+  // The caller runs on its own thread, so that the affinity of the test
+  // thread stays as it was.
+  std::thread caller([&]() {
+    auto pool = ThreadPool::Create(3, affinity);
+    ASSERT_NE(pool, nullptr);
+    pool->Run(3, [&](csrblocksparse::SpinBarrier* barrier, int tid) {
+      cpus[tid] = CurrentThreadCpus();
+    });
+  });
+  caller.join();
+  EXPECT_EQ(cpus[0], std::vector<int>({allowed.front()}));
+  EXPECT_EQ(cpus[1], std::vector<int>({allowed.back()}));
+  EXPECT_EQ(cpus[2], std::vector<int>({allowed.back()}));
+}
+#endif  // defined(__linux__)
+
+TEST(ThreadPoolCreate, InvalidNumThreadsReturnsNullptr) {
+  for (const int invalid_num_threads : {-1, 0}) {
+    EXPECT_EQ(ThreadPool::Create(invalid_num_threads), nullptr);
+  }
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
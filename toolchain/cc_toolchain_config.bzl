@@ -155,7 +155,7 @@ def _impl(ctx):
         toolchain_identifier = "local",
         host_system_name = "local",
         target_system_name = "local",
-        target_cpu = "k8",
+        target_cpu = ctx.attr.target_cpu,
         target_libc = "unknown",
         compiler = "clang",
         abi_version = "unknown",
@@ -165,6 +165,8 @@ def _impl(ctx):
 
 cc_toolchain_config = rule(
     implementation = _impl,
-    attrs = {},
+    attrs = {
+        "target_cpu": attr.string(default = "k8"),
+    },
     provides = [CcToolchainConfigInfo],
 )
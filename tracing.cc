@@ -0,0 +1,191 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tracing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+#include "glog/logging.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+// The fields are atomics so that an export concurrent with recording reads
+// possibly mixed up events rather than racing.
+struct TraceEvent {
+  std::atomic<const char*> name{nullptr};
+  std::atomic<int64_t> begin_nanos{0};
+  std::atomic<int64_t> duration_nanos{0};
+};
+
+struct ThreadBuffer {
+  // Id of the thread currently owning the buffer, in the order in which
+  // threads first recorded.
+  std::atomic<int> tid{0};
+  // Number of events recorded since the last |Clear|; the next one goes to
+  // |num_recorded % kEventsPerThread|.
+  std::atomic<int64_t> num_recorded{0};
+  TraceEvent events[Tracing::kEventsPerThread];
+};
+
+// Owns all buffers for the lifetime of the process. The buffers of exited
+// threads are handed to new threads, so the number of buffers is bounded by
+// the number of threads that ever recorded at the same time.
+class Registry {
+ public:
+  ThreadBuffer* Acquire() {
+    absl::MutexLock lock(&mutex_);
+    ThreadBuffer* buffer;
+    if (free_buffers_.empty()) {
+      buffers_.push_back(absl::make_unique<ThreadBuffer>());
+      buffer = buffers_.back().get();
+    } else {
+      buffer = free_buffers_.back();
+      free_buffers_.pop_back();
+    }
+    buffer->tid.store(next_tid_++, std::memory_order_relaxed);
+    return buffer;
+  }
+
+  // The events of |buffer| are kept until they are overwritten by its next
+  // owner.
+  void Release(ThreadBuffer* buffer) {
+    absl::MutexLock lock(&mutex_);
+    free_buffers_.push_back(buffer);
+  }
+
+  void Clear() {
+    absl::MutexLock lock(&mutex_);
+    for (auto& buffer : buffers_) {
+      buffer->num_recorded.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::string ExportChromeTrace() {
+    std::string trace = "{\"traceEvents\":[";
+    bool first = true;
+    absl::MutexLock lock(&mutex_);
+    for (const auto& buffer : buffers_) {
+      const int tid = buffer->tid.load(std::memory_order_relaxed);
+      const int64_t num_recorded =
+          buffer->num_recorded.load(std::memory_order_acquire);
+      const int64_t oldest = std::max<int64_t>(
+          0, num_recorded - Tracing::kEventsPerThread);
+      for (int64_t i = oldest; i < num_recorded; ++i) {
+        const TraceEvent& event =
+            buffer->events[i % Tracing::kEventsPerThread];
+        const char* name = event.name.load(std::memory_order_relaxed);
+        if (name == nullptr) {
+          continue;
+        }
+        absl::StrAppendFormat(
+            &trace,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            first ? "" : ",", name, tid,
+            event.begin_nanos.load(std::memory_order_relaxed) / 1e3,
+            event.duration_nanos.load(std::memory_order_relaxed) / 1e3);
+        first = false;
+      }
+    }
+    trace += "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return trace;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_ ABSL_GUARDED_BY(mutex_);
+  std::vector<ThreadBuffer*> free_buffers_ ABSL_GUARDED_BY(mutex_);
+  int next_tid_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+Registry* GetRegistry() {
+  // Never destroyed, so that threads exiting after main can still release
+  // their buffers.
+  static Registry* const registry = new Registry;
+  return registry;
+}
+
+// Acquires the buffer of a thread when it first records and releases it when
+// the thread exits.
+class ThreadBufferHandle {
+ public:
+  ~ThreadBufferHandle() {
+    if (buffer_ != nullptr) {
+      GetRegistry()->Release(buffer_);
+    }
+  }
+
+  ThreadBuffer* buffer() {
+    if (buffer_ == nullptr) {
+      buffer_ = GetRegistry()->Acquire();
+    }
+    return buffer_;
+  }
+
+ private:
+  ThreadBuffer* buffer_ = nullptr;
+};
+
+}  // namespace
+
+std::atomic<bool> Tracing::enabled_{false};
+thread_local TraceSink* Tracing::thread_sink_ = nullptr;
+
+void Tracing::Clear() { GetRegistry()->Clear(); }
+
+std::string Tracing::ExportChromeTrace() {
+  return GetRegistry()->ExportChromeTrace();
+}
+
+bool Tracing::WriteChromeTrace(const std::string& path) {
+  std::ofstream file(path);
+  if (!file) {
+    LOG(ERROR) << "Could not open " << path << " for writing.";
+    return false;
+  }
+  file << ExportChromeTrace();
+  file.close();
+  if (!file) {
+    LOG(ERROR) << "Could not write trace to " << path << ".";
+    return false;
+  }
+  return true;
+}
+
+void Tracing::Record(const char* name, int64_t begin_nanos,
+                     int64_t end_nanos) {
+  static thread_local ThreadBufferHandle handle;
+  ThreadBuffer* buffer = handle.buffer();
+  const int64_t index = buffer->num_recorded.load(std::memory_order_relaxed);
+  TraceEvent& event = buffer->events[index % kEventsPerThread];
+  event.name.store(name, std::memory_order_relaxed);
+  event.begin_nanos.store(begin_nanos, std::memory_order_relaxed);
+  event.duration_nanos.store(end_nanos - begin_nanos,
+                             std::memory_order_relaxed);
+  buffer->num_recorded.store(index + 1, std::memory_order_release);
+}
+
+}  // namespace codec
+}  // namespace chromemedia
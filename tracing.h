@@ -0,0 +1,153 @@
+/*
+ * Copyright 2021 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LYRA_CODEC_TRACING_H_
+#define LYRA_CODEC_TRACING_H_
+
+#include <atomic>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdint>
+#include <string>
+
+namespace chromemedia {
+namespace codec {
+
+// Lightweight tracing of the codec internals, off by default. While enabled,
+// every |LYRA_TRACE_SCOPE| records one complete event into a fixed-size ring
+// buffer of the calling thread, so memory stays bounded however long the
+// process runs, and only the most recent |kEventsPerThread| events of each
+// thread are kept. While disabled a scope costs one relaxed atomic load.
+//
+// The recorded events can be exported in the Chrome trace event format, which
+// chrome://tracing and https://ui.perfetto.dev open directly.
+//
+// Independently of that, every thread can have a |TraceSink|, which receives
+// the events of the scopes of that thread whether tracing is enabled or not.
+
+// Receives the events of the scopes of the threads it is installed on with
+// |ScopedTraceSink|, e.g. to keep those of one codec session.
+class TraceSink {
+ public:
+  virtual ~TraceSink() = default;
+
+  // Called on the thread the event was recorded on, with |name| as passed to
+  // |LYRA_TRACE_SCOPE|.
+  virtual void Record(const char* name, int64_t begin_nanos,
+                      int64_t end_nanos) = 0;
+};
+
+class Tracing {
+ public:
+  static constexpr int kEventsPerThread = 1 << 14;
+
+  static void Enable() { enabled_.store(true, std::memory_order_relaxed); }
+  static void Disable() { enabled_.store(false, std::memory_order_relaxed); }
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  // Drops all recorded events.
+  static void Clear();
+
+  // Returns the recorded events of all threads as Chrome trace JSON. Events
+  // are only guaranteed to be consistent if no thread records while this
+  // runs, e.g. after |Disable|.
+  static std::string ExportChromeTrace();
+
+  // Writes |ExportChromeTrace| to |path|. Returns false on failure.
+  static bool WriteChromeTrace(const std::string& path);
+
+  static int64_t NowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Records an event of |name|, which has to outlive the export, e.g. a string
+  // literal, on the calling thread.
+  static void Record(const char* name, int64_t begin_nanos,
+                     int64_t end_nanos);
+
+  // The sink of the calling thread, or a nullptr if it has none.
+  static TraceSink* thread_sink() { return thread_sink_; }
+
+ private:
+  friend class ScopedTraceSink;
+
+  static std::atomic<bool> enabled_;
+  static thread_local TraceSink* thread_sink_;
+};
+
+// Makes |sink| the sink of the calling thread for the lifetime of the scope,
+// and then restores the previous one. A null |sink| removes the sink.
+class ScopedTraceSink {
+ public:
+  explicit ScopedTraceSink(TraceSink* sink) : previous_(Tracing::thread_sink_) {
+    Tracing::thread_sink_ = sink;
+  }
+
+  ~ScopedTraceSink() { Tracing::thread_sink_ = previous_; }
+
+  ScopedTraceSink(const ScopedTraceSink&) = delete;
+  ScopedTraceSink& operator=(const ScopedTraceSink&) = delete;
+
+ private:
+  TraceSink* const previous_;
+};
+
+// Records the lifetime of the scope as an event if tracing is enabled when
+// the scope is entered, and passes it to the sink of the thread if it has one
+// then.
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name)
+      : name_(name),
+        traced_(Tracing::enabled()),
+        sink_(Tracing::thread_sink()),
+        begin_nanos_(traced_ || sink_ != nullptr ? Tracing::NowNanos() : -1) {}
+
+  ~TraceScope() {
+    if (begin_nanos_ >= 0) {
+      const int64_t end_nanos = Tracing::NowNanos();
+      if (traced_) {
+        Tracing::Record(name_, begin_nanos_, end_nanos);
+      }
+      if (sink_ != nullptr) {
+        sink_->Record(name_, begin_nanos_, end_nanos);
+      }
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* const name_;
+  const bool traced_;
+  TraceSink* const sink_;
+  const int64_t begin_nanos_;
+};
+
+#define LYRA_TRACE_CONCAT_INNER(a, b) a##b
+#define LYRA_TRACE_CONCAT(a, b) LYRA_TRACE_CONCAT_INNER(a, b)
+
+// Traces the rest of the enclosing scope under |name|, a string literal.
+#define LYRA_TRACE_SCOPE(name)                                                \
+  ::chromemedia::codec::TraceScope LYRA_TRACE_CONCAT(lyra_trace_scope_,       \
+                                                     __LINE__)(name)
+
+}  // namespace codec
+}  // namespace chromemedia
+
+#endif  // LYRA_CODEC_TRACING_H_
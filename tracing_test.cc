@@ -0,0 +1,165 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tracing.h"
+
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace chromemedia {
+namespace codec {
+namespace {
+
+using testing::HasSubstr;
+using testing::Not;
+
+class TracingTest : public testing::Test {
+ protected:
+  void SetUp() override { Tracing::Clear(); }
+  void TearDown() override {
+    Tracing::Disable();
+    Tracing::Clear();
+  }
+};
+
+int CountOccurrences(const std::string& text, const std::string& pattern) {
+  int count = 0;
+  for (size_t pos = text.find(pattern); pos != std::string::npos;
+       pos = text.find(pattern, pos + pattern.size())) {
+    ++count;
+  }
+  return count;
+}
+
+TEST_F(TracingTest, DisabledRecordsNothing) {
+  { LYRA_TRACE_SCOPE("disabled_scope"); }
+
+  EXPECT_THAT(Tracing::ExportChromeTrace(), Not(HasSubstr("disabled_scope")));
+}
+
+TEST_F(TracingTest, ExportsCompleteEvents) {
+  Tracing::Enable();
+  {
+    LYRA_TRACE_SCOPE("outer");
+    LYRA_TRACE_SCOPE("inner");
+  }
+  Tracing::Disable();
+
+  const std::string trace = Tracing::ExportChromeTrace();
+  EXPECT_TRUE(absl::StartsWith(trace, "{\"traceEvents\":["));
+  EXPECT_THAT(trace, HasSubstr("\"name\":\"outer\",\"ph\":\"X\""));
+  EXPECT_THAT(trace, HasSubstr("\"name\":\"inner\",\"ph\":\"X\""));
+  EXPECT_THAT(trace, HasSubstr("\"dur\":"));
+}
+
+TEST_F(TracingTest, ClearDropsEvents) {
+  Tracing::Enable();
+  { LYRA_TRACE_SCOPE("cleared"); }
+  Tracing::Clear();
+
+  EXPECT_THAT(Tracing::ExportChromeTrace(), Not(HasSubstr("cleared")));
+}
+
+TEST_F(TracingTest, KeepsOnlyTheMostRecentEventsOfAThread) {
+  Tracing::Enable();
+  for (int i = 0; i < Tracing::kEventsPerThread; ++i) {
+    LYRA_TRACE_SCOPE("old");
+  }
+  for (int i = 0; i < Tracing::kEventsPerThread / 2; ++i) {
+    LYRA_TRACE_SCOPE("new");
+  }
+  Tracing::Disable();
+
+  const std::string trace = Tracing::ExportChromeTrace();
+  EXPECT_EQ(CountOccurrences(trace, "\"name\":\"old\""),
+            Tracing::kEventsPerThread / 2);
+  EXPECT_EQ(CountOccurrences(trace, "\"name\":\"new\""),
+            Tracing::kEventsPerThread / 2);
+}
+
+TEST_F(TracingTest, ThreadsRecordIntoTheirOwnBuffers) {
+  Tracing::Enable();
+  { LYRA_TRACE_SCOPE("main_thread"); }
+  std::thread worker([] { LYRA_TRACE_SCOPE("worker_thread"); });
+  worker.join();
+  Tracing::Disable();
+
+  const std::string trace = Tracing::ExportChromeTrace();
+  const size_t main_event = trace.find("\"name\":\"main_thread\"");
+  const size_t worker_event = trace.find("\"name\":\"worker_thread\"");
+  ASSERT_NE(main_event, std::string::npos);
+  ASSERT_NE(worker_event, std::string::npos);
+  const std::string main_tid =
+      trace.substr(trace.find("\"tid\":", main_event), 8);
+  const std::string worker_tid =
+      trace.substr(trace.find("\"tid\":", worker_event), 8);
+  EXPECT_NE(main_tid, worker_tid);
+}
+
+class NameSink : public TraceSink {
+ public:
+  void Record(const char* name, int64_t begin_nanos,
+              int64_t end_nanos) override {
+    EXPECT_LE(begin_nanos, end_nanos);
+    names.push_back(name);
+  }
+
+  std::vector<std::string> names;
+};
+
+TEST_F(TracingTest, SinkReceivesScopesWhileTracingIsDisabled) {
+  NameSink sink;
+  {
+    ScopedTraceSink scoped_sink(&sink);
+    EXPECT_EQ(Tracing::thread_sink(), &sink);
+    LYRA_TRACE_SCOPE("sunk");
+  }
+  EXPECT_EQ(Tracing::thread_sink(), nullptr);
+  { LYRA_TRACE_SCOPE("after"); }
+
+  EXPECT_THAT(sink.names, testing::ElementsAre("sunk"));
+  EXPECT_THAT(Tracing::ExportChromeTrace(), Not(HasSubstr("sunk")));
+}
+
+TEST_F(TracingTest, SinksAreRestoredAndPerThread) {
+  NameSink outer_sink;
+  NameSink inner_sink;
+  ScopedTraceSink scoped_outer(&outer_sink);
+  {
+    ScopedTraceSink scoped_inner(&inner_sink);
+    std::thread([]() {
+      EXPECT_EQ(Tracing::thread_sink(), nullptr);
+      LYRA_TRACE_SCOPE("other_thread");
+    }).join();
+    LYRA_TRACE_SCOPE("inner");
+  }
+  { LYRA_TRACE_SCOPE("outer"); }
+
+  EXPECT_THAT(inner_sink.names, testing::ElementsAre("inner"));
+  EXPECT_THAT(outer_sink.names, testing::ElementsAre("outer"));
+}
+
+TEST_F(TracingTest, WriteChromeTraceFailsForBadPath) {
+  EXPECT_FALSE(Tracing::WriteChromeTrace("/nonexistent/dir/trace.json"));
+}
+
+}  // namespace
+}  // namespace codec
+}  // namespace chromemedia
@@ -30,9 +30,19 @@ namespace chromemedia {
 namespace codec {
 
 // Class that wraps the data and logic of transpose convolutional layers.
+//
+// Since |kernel_size| equals |stride|, the kernel positions of different
+// input columns never overlap, and the layer is computed in polyphase form:
+// the rows of the weight matrix are the |kernel_size| kernel slices stacked,
+// one per output phase, so a single matrix multiplication of all |length|
+// input columns yields every phase of every output column at once. Column t
+// of the product holds the outputs at |stride| * t + p for all phases p one
+// after the other, which is exactly the memory layout of |stride| * |length|
+// columns of |num_filters| rows, so the product is written in place into the
+// input of the next layer, reshaped, with no staging buffer or copy.
 template <typename WeightType, typename RhsType, typename OutputType,
           typename DiskWeightType>
-class TransposeConvolutionalLayerWrapper
+class TransposeConvolutionalLayerWrapper final
     : public LayerWrapper<WeightType, RhsType, OutputType, DiskWeightType> {
  public:
   using Super = LayerWrapper<WeightType, RhsType, OutputType, DiskWeightType>;
@@ -66,7 +76,8 @@ class TransposeConvolutionalLayerWrapper
     auto layer =
         Super::LoadAndCheckLayer(params.from, params.prefix, layer_prompt,
                                  params.kernel_size * params.num_filters,
-                                 params.num_input_channels, params.num_threads);
+                                 params.num_input_channels, params.num_threads,
+                                 params.model);
     if (layer == nullptr) {
       return nullptr;
     }
@@ -90,6 +101,7 @@ class TransposeConvolutionalLayerWrapper
     this->layer_->SpMM_bias(
         csrblocksparse::VectorView<RhsType>(this->input_buffer_), &output_view,
         this->relu_, tid, this->per_column_barrier_ ? spin_barrier : nullptr);
+    this->RunRowEpilogue(tid);
     spin_barrier->barrier();
     Reset(tid, spin_barrier);
   }
@@ -105,7 +117,7 @@ class TransposeConvolutionalLayerWrapper
       int num_input_channels, int output_rows, int length,
       int input_buffer_rows, int input_buffer_cols, bool relu,
       bool per_column_barrier,
-      std::unique_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
+      std::shared_ptr<csrblocksparse::SparseLinearLayer<WeightType, RhsType>>
           layer)
       : Super(num_input_channels, output_rows, length, input_buffer_rows,
               input_buffer_cols, relu, per_column_barrier, std::move(layer)) {}
@@ -0,0 +1,66 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes an uncompressed copy of a model directory, which encoders and
+// decoders load without gunzipping every layer. Run it once when deploying a
+// model and point --model_path of the codec at the output directory.
+
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "architecture_utils.h"
+#include "glog/logging.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "model_unpacker.h"
+
+ABSL_FLAG(std::string, model_path, "wavegru",
+          "Path to directory containing the gzipped model files. For "
+          "desktop this is the path relative to the binary.");
+ABSL_FLAG(std::string, output_dir, "",
+          "The dir for the unpacked model files to be written out. "
+          "Recursively creates dir if it does not exist. Will overwrite "
+          "existing files.");
+ABSL_FLAG(std::string, role, "decoder",
+          "The user of the model, 'encoder' to keep only the quantizer "
+          "assets or 'decoder' to keep all of them.");
+
+int main(int argc, char** argv) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  const ghc::filesystem::path model_path =
+      chromemedia::codec::GetCompleteArchitecturePath(
+          absl::GetFlag(FLAGS_model_path));
+  const ghc::filesystem::path output_dir(absl::GetFlag(FLAGS_output_dir));
+  if (output_dir.empty()) {
+    LOG(ERROR) << "Flag --output_dir not set.";
+    return -1;
+  }
+
+  const std::string role_name = absl::GetFlag(FLAGS_role);
+  const auto role = chromemedia::codec::ModelRoleFromName(role_name);
+  if (!role.has_value()) {
+    LOG(ERROR) << "Unknown role '" << role_name << "'.";
+    return -1;
+  }
+
+  if (!chromemedia::codec::UnpackModel(model_path, output_dir, role.value())) {
+    LOG(ERROR) << "Failed to unpack " << model_path;
+    return -1;
+  }
+  return 0;
+}
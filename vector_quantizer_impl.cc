@@ -14,11 +14,12 @@
 
 #include "vector_quantizer_impl.h"
 
-#include <bitset>
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <vector>
 
@@ -26,14 +27,39 @@
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/types/optional.h"
-#include "audio/dsp/signal_vector_util.h"
+#include "absl/types/span.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_codec_config.h"
+#include "model_unpacker.h"
+#include "parallel_load.h"
 #include "sparse_inference_matrixvector.h"
 
 namespace chromemedia {
 namespace codec {
 namespace {
+
+// The number of columns of a matrix of |NumFeatures| features, which is
+// dynamic if |NumFeatures| is 0. See |DispatchOnSize|.
+template <int NumFeatures>
+constexpr int kFeatureColumns = NumFeatures > 0 ? NumFeatures : Eigen::Dynamic;
+
+// Projects the |num_vectors| vectors of |features| into the klt space. With
+// the number of features known at compile time the mean subtraction is
+// unrolled and the product picks kernels for that size.
+template <int NumFeatures>
+Eigen::MatrixXf ProjectBatch(absl::Span<const float> features,
+                             int num_vectors,
+                             const Eigen::RowVectorXf& mean_vector,
+                             const Eigen::MatrixXf& transformation_matrix) {
+  // Row i holds the i-th feature vector.
+  const Eigen::Map<const Eigen::Matrix<float, Eigen::Dynamic,
+                                       kFeatureColumns<NumFeatures>,
+                                       Eigen::RowMajor>>
+      batch(features.data(), num_vectors, mean_vector.size());
+  return (batch.rowwise() - mean_vector) * transformation_matrix;
+}
+
 std::vector<std::vector<std::vector<float>>> CodeVectorsToCodebooks(
     const std::vector<float>& flattened_code_vectors,
     const std::vector<int16_t>& codebook_dimensions) {
@@ -65,56 +91,59 @@ std::vector<std::vector<std::vector<float>>> CodeVectorsToCodebooks(
 
   return codebooks;
 }
+
+template <typename T>
+bool ReadQuantizerArray(const ghc::filesystem::path& model_path,
+                        const std::string& file_name, std::vector<T>* array) {
+  const absl::Status status = ReadModelArray(model_path, file_name, array);
+  if (!status.ok()) {
+    LOG(ERROR) << "Couldn't read " << model_path / file_name << ": "
+               << status.message();
+    return false;
+  }
+  return true;
+}
 }  // namespace
 
 std::unique_ptr<VectorQuantizerImpl> VectorQuantizerImpl::Create(
     int num_features, int num_bits, const ghc::filesystem::path& model_path) {
   const std::string kPrefix = "lyra_16khz_quant_";
 
-  // Open gzipped vqs as arrays.
-  std::vector<float> mean_vector_array;
-  auto status = csrblocksparse::ReadArrayFromFile(
-      kPrefix + "mean_vectors.gz", &mean_vector_array, model_path.string());
-  if (!status.ok()) {
-    LOG(ERROR) << "Couldn't read " << model_path / (kPrefix + "mean_vectors.gz")
-               << ": " << status.message();
-    return nullptr;
-  }
-
   if (num_bits > kMaxNumQuantizedBits) {
     LOG(ERROR) << "Specified number of bits " << num_bits
                << "exceeds the compile-time maximum " << kMaxNumQuantizedBits;
     return nullptr;
   }
 
+  // Open the vqs as arrays. They are gzipped unless the model was unpacked.
+  // The arrays are read and decompressed concurrently.
+  const std::string extension = IsZippedModel(model_path, kPrefix) ? ".gz" : "";
+  std::vector<float> mean_vector_array;
   std::vector<float> flat_transformation_matrix_array;
-  status = csrblocksparse::ReadArrayFromFile(kPrefix + "transmat.gz",
-                                             &flat_transformation_matrix_array,
-                                             model_path.string());
-  if (!status.ok()) {
-    LOG(ERROR) << "Couldn't read " << model_path / (kPrefix + "transmat.gz")
-               << ": " << status.message();
-    return nullptr;
-  }
-
   std::vector<float> flattened_code_vectors;
-  status = csrblocksparse::ReadArrayFromFile(kPrefix + "code_vectors.gz",
-                                             &flattened_code_vectors,
-                                             model_path.string());
-  if (!status.ok()) {
-    LOG(ERROR) << "Couldn't read " << model_path / (kPrefix + "code_vectors.gz")
-               << ": " << status.message();
-    return nullptr;
-  }
-
   std::vector<int16_t> codebook_dimensions;
-  status = csrblocksparse::ReadArrayFromFile(kPrefix + "codebook_dimensions.gz",
-                                             &codebook_dimensions,
-                                             model_path.string());
-  if (!status.ok()) {
-    LOG(ERROR) << "Couldn't read "
-               << model_path / (kPrefix + "codebook_dimensions.gz") << ": "
-               << status.message();
+  if (!LoadInParallel({
+          [&]() {
+            return ReadQuantizerArray(model_path,
+                                      kPrefix + "mean_vectors" + extension,
+                                      &mean_vector_array);
+          },
+          [&]() {
+            return ReadQuantizerArray(model_path,
+                                      kPrefix + "transmat" + extension,
+                                      &flat_transformation_matrix_array);
+          },
+          [&]() {
+            return ReadQuantizerArray(model_path,
+                                      kPrefix + "code_vectors" + extension,
+                                      &flattened_code_vectors);
+          },
+          [&]() {
+            return ReadQuantizerArray(
+                model_path, kPrefix + "codebook_dimensions" + extension,
+                &codebook_dimensions);
+          },
+      })) {
     return nullptr;
   }
 
@@ -193,129 +222,250 @@ VectorQuantizerImpl::VectorQuantizerImpl(
       mean_vector_(mean_vector),
       transformation_matrix_(transformation_matrix),
       inverse_transformation_matrix_(transformation_matrix.inverse()),
-      codebooks_(codebooks) {}
+      codebooks_(FlattenCodebooks(codebooks)),
+      search_width_(0) {}
+
+std::vector<VectorQuantizerImpl::Codebook>
+VectorQuantizerImpl::FlattenCodebooks(
+    const std::vector<std::vector<std::vector<float>>>& codebooks) {
+  std::vector<Codebook> flattened_codebooks;
+  flattened_codebooks.reserve(codebooks.size());
+  for (const auto& codebook : codebooks) {
+    Codebook& flattened = flattened_codebooks.emplace_back();
+    flattened.num_bits = static_cast<int>(
+        std::ceil(std::log2(static_cast<float>(codebook.size()))));
+    // There will be at least 1 code vector within each codebook.
+    flattened.code_vectors.resize(codebook.size(), codebook.at(0).size());
+    for (int i = 0; i < codebook.size(); ++i) {
+      for (int j = 0; j < codebook.at(i).size(); ++j) {
+        flattened.code_vectors(i, j) = codebook.at(i).at(j);
+      }
+    }
+    flattened.squared_norms = flattened.code_vectors.rowwise().squaredNorm();
+    if (codebook.size() >= kMinNumCodeVectorsToCluster) {
+      ClusterCodeVectors(&flattened);
+    }
+  }
+  return flattened_codebooks;
+}
+
+void VectorQuantizerImpl::ClusterCodeVectors(Codebook* codebook) {
+  constexpr int kNumIterations = 10;
+  const int num_code_vectors = codebook->code_vectors.rows();
+  const int num_clusters =
+      static_cast<int>(std::round(std::sqrt(num_code_vectors)));
+
+  // Start from code vectors spread evenly over the codebook.
+  codebook->centroids.resize(num_clusters, codebook->code_vectors.cols());
+  for (int i = 0; i < num_clusters; ++i) {
+    codebook->centroids.row(i) =
+        codebook->code_vectors.row(i * num_code_vectors / num_clusters);
+  }
+  std::vector<int> assignments(num_code_vectors);
+  for (int iteration = 0; iteration < kNumIterations; ++iteration) {
+    // Assign each code vector to its closest centroid.
+    const Eigen::MatrixXf scores =
+        codebook->centroids.rowwise().squaredNorm().transpose().replicate(
+            num_code_vectors, 1) -
+        2.0f * codebook->code_vectors * codebook->centroids.transpose();
+    for (int i = 0; i < num_code_vectors; ++i) {
+      scores.row(i).minCoeff(&assignments[i]);
+    }
+    // Move each centroid to the mean of its code vectors. Centroids without
+    // any stay where they are.
+    Eigen::MatrixXf sums =
+        Eigen::MatrixXf::Zero(num_clusters, codebook->code_vectors.cols());
+    std::vector<int> counts(num_clusters, 0);
+    for (int i = 0; i < num_code_vectors; ++i) {
+      sums.row(assignments[i]) += codebook->code_vectors.row(i);
+      ++counts[assignments[i]];
+    }
+    for (int i = 0; i < num_clusters; ++i) {
+      if (counts[i] > 0) {
+        codebook->centroids.row(i) = sums.row(i) / counts[i];
+      }
+    }
+  }
+  codebook->centroid_squared_norms =
+      codebook->centroids.rowwise().squaredNorm();
 
-absl::optional<std::string> VectorQuantizerImpl::Quantize(
+  codebook->clusters.assign(num_clusters, Cluster());
+  for (int i = 0; i < num_code_vectors; ++i) {
+    codebook->clusters[assignments[i]].indices.push_back(i);
+  }
+  for (Cluster& cluster : codebook->clusters) {
+    cluster.code_vectors.resize(cluster.indices.size(),
+                                codebook->code_vectors.cols());
+    for (int i = 0; i < cluster.indices.size(); ++i) {
+      cluster.code_vectors.row(i) =
+          codebook->code_vectors.row(cluster.indices[i]);
+    }
+    cluster.squared_norms = cluster.code_vectors.rowwise().squaredNorm();
+  }
+}
+
+absl::optional<QuantizedBits> VectorQuantizerImpl::Quantize(
     const std::vector<float>& features) const {
-  if (features.size() != num_features_) {
-    LOG(ERROR) << "There were " << features.size()
-               << " features to be quantized but expected " << num_features_;
+  auto quantized_or = QuantizeBatch(features, 1);
+  if (!quantized_or.has_value()) {
     return absl::nullopt;
   }
+  return quantized_or->front();
+}
 
-  Eigen::RowVectorXf projected_features(num_features_);
-  for (int i = 0; i < features.size(); ++i) {
-    projected_features(i) = features.at(i);
+absl::optional<std::vector<QuantizedBits>> VectorQuantizerImpl::QuantizeBatch(
+    absl::Span<const float> features, int num_vectors) const {
+  if (num_vectors <= 0 || features.size() != num_vectors * num_features_) {
+    LOG(ERROR) << "There were " << features.size() << " features in "
+               << num_vectors << " vectors to be quantized but expected "
+               << num_features_ << " per vector";
+    return absl::nullopt;
   }
-  // Project into klt space.
-  projected_features =
-      (projected_features - mean_vector_) * transformation_matrix_;
 
-  std::bitset<kMaxNumQuantizedBits> quantized_bits = 0;
-  uint32_t bit_shift_amount = 0;
-  uint32_t start_dimension = 0;
+  // Project into klt space.
+  const Eigen::MatrixXf projected_features =
+      DispatchOnSize<LyraDefaultCodecConfig::kNumQuantizedFeatures>(
+          num_features_, [&](auto num_features) {
+            return ProjectBatch<decltype(num_features)::value>(
+                features, num_vectors, mean_vector_, transformation_matrix_);
+          });
+
+  std::vector<QuantizedBits> quantized(num_vectors);
+  int num_quantized_bits = 0;
+  int start_dimension = 0;
   // Iterate over all the codebooks.
   for (const auto& codebook : codebooks_) {
     // The number of bits needed to represent all code vectors in this code
     // book.
-    int current_num_bits = std::ceil(std::log2(codebook.size()));
-    if (current_num_bits == 0) {
+    const int current_num_bits = codebook.num_bits;
+    if (current_num_bits == 0 ||
+        num_quantized_bits + current_num_bits > num_bits_) {
       break;
     }
-    bit_shift_amount += current_num_bits;
-    // There will be at least 1 code vector within each codebook.
-    uint32_t dimensionality = codebook.at(0).size();
+    num_quantized_bits += current_num_bits;
+    const int dimensionality = codebook.code_vectors.cols();
 
-    // Take the sub dimensions of projected_features from current codebook
+    // Take the sub dimensions of the projected features from current codebook
     // dimensionality.
-    Eigen::RowVectorXf sub_projected_feature =
-        projected_features.segment(start_dimension, dimensionality);
+    const auto sub_projected_features =
+        projected_features.middleCols(start_dimension, dimensionality);
     start_dimension += dimensionality;
-    int chosen_index = FindNearest(sub_projected_feature, codebook);
 
-    // Fill quantized_bits starting from the MSB to the LSB with the bits from
-    // subsequent chosen_indexes.
+    // Append the bits of the subsequent chosen indices from the MSB to the
+    // LSB.
     // Eg for the two bit patterns appended in order and NUM_BITS bits = 16
     //
-    // 0b10001, current_num_bits = 5 ->
-    //   bit_shift_amount = 5
-    //   chosen_index_shift = 16 - 5 = 11
-    // 0b0010, current_num_bits = 4 ->
-    //   bit_shift_amount = 5 + 4 = 9
-    //   chosen_index_shift = 16 - 9 = 7
+    // 0b10001, current_num_bits = 5
+    // 0b0010, current_num_bits = 4
     //
     //  quantized_bits will become:
     //  |1 0 0 0 1 0 0 1 0 _ _ _ _ _ _ _|
     //   |       |       |             |
-    //  bit15  bit11    bit7          bit0
-
-    int chosen_index_shift = quantized_bits.size() - bit_shift_amount;
-    quantized_bits |= std::bitset<quantized_bits.size()>(chosen_index)
-                      << chosen_index_shift;
+    //  bit0    bit4    bit8          bit15
+    if (IsExhaustiveSearch(codebook)) {
+      // See |FindNearest|. Scoring the whole batch at once turns the
+      // matrix-vector products into one matrix-matrix product, with column j
+      // scoring all code vectors against the j-th feature vector.
+      const Eigen::MatrixXf scores =
+          (-2.0f * codebook.code_vectors * sub_projected_features.transpose())
+              .colwise() +
+          codebook.squared_norms;
+      for (int j = 0; j < num_vectors; ++j) {
+        int chosen_index = 0;
+        scores.col(j).minCoeff(&chosen_index);
+        quantized[j].Append(chosen_index, current_num_bits);
+      }
+    } else {
+      for (int j = 0; j < num_vectors; ++j) {
+        quantized[j].Append(
+            FindNearest(sub_projected_features.row(j), codebook),
+            current_num_bits);
+      }
+    }
+  }
+  // Pad with zeros if the codebooks do not use all bits.
+  for (auto& quantized_bits : quantized) {
+    quantized_bits.Resize(num_bits_);
   }
 
-  return quantized_bits.to_string().substr(0, num_bits_);
+  return quantized;
 }
 
 std::vector<float> VectorQuantizerImpl::DecodeToLossyFeatures(
-    const std::string& quantized_features) const {
-  const std::bitset<kMaxNumQuantizedBits> quantized_bits(quantized_features);
-  Eigen::RowVectorXf features(num_features_);
-  int dimension = 0;
-  int bit_shift_amount = num_bits_;
-  for (auto& codebook : codebooks_) {
-    // Shift right by the total bit width minus the accumulated bit width so
-    // far.
-    int current_num_bits = static_cast<int>(
-        std::ceil(std::log2(static_cast<float>(codebook.size()))));
-    CHECK(bit_shift_amount >= current_num_bits);
-    bit_shift_amount -= current_num_bits;
-    // Mask off bits we have already seen.
-    const std::bitset<kMaxNumQuantizedBits> kPreviouslySeenMask(
-        (1 << current_num_bits) - 1);
-    int code_vector_index =
-        ((quantized_bits >> bit_shift_amount) & kPreviouslySeenMask).to_ulong();
-
-    for (auto component : codebook.at(code_vector_index)) {
-      features(dimension) = component;
-      ++dimension;
-    }
-  }
-  // Project back into the log mel spectrogram domain.
-  features = features * inverse_transformation_matrix_ + mean_vector_;
+    const QuantizedBits& quantized_features) const {
+  // Gather the KLT features in a vector of the size of the configured
+  // features if it matches.
+  return DispatchOnSize<LyraDefaultCodecConfig::kNumQuantizedFeatures>(
+      num_features_, [&](auto num_features) {
+        Eigen::Matrix<float, 1,
+                      kFeatureColumns<decltype(num_features)::value>>
+            features(num_features_);
+        int dimension = 0;
+        int bit_offset = 0;
+        for (const auto& codebook : codebooks_) {
+          const int current_num_bits = codebook.num_bits;
+          CHECK_LE(bit_offset + current_num_bits, num_bits_);
+          const int code_vector_index =
+              quantized_features.Read(bit_offset, current_num_bits);
+          bit_offset += current_num_bits;
+
+          const int dimensionality = codebook.code_vectors.cols();
+          features.segment(dimension, dimensionality) =
+              codebook.code_vectors.row(code_vector_index);
+          dimension += dimensionality;
+        }
+        // Project back into the log mel spectrogram domain.
+        features = features * inverse_transformation_matrix_ + mean_vector_;
+        return std::vector<float>(features.data(),
+                                  features.data() + features.size());
+      });
+}
 
-  return std::vector<float>(features.data(), features.data() + features.size());
+bool VectorQuantizerImpl::IsExhaustiveSearch(const Codebook& codebook) const {
+  return search_width_ <= 0 || search_width_ >= codebook.clusters.size();
 }
 
 int VectorQuantizerImpl::FindNearest(
     const Eigen::RowVectorXf& sub_projected_features,
-    const std::vector<std::vector<float>>& codebook) const {
-  float min_dist = std::numeric_limits<float>::max();
+    const Codebook& codebook) const {
+  // Since ||c - x||^2 = ||c||^2 - 2 c.x + ||x||^2 and the last term is the
+  // same for all code vectors, the nearest code vector minimizes
+  // ||c||^2 - 2 c.x, which takes a single matrix-vector product.
+  if (IsExhaustiveSearch(codebook)) {
+    int chosen_index = 0;
+    (codebook.squared_norms -
+     2.0f * codebook.code_vectors * sub_projected_features.transpose())
+        .minCoeff(&chosen_index);
+    return chosen_index;
+  }
+
+  const Eigen::VectorXf centroid_scores =
+      codebook.centroid_squared_norms -
+      2.0f * codebook.centroids * sub_projected_features.transpose();
+  const int num_clusters = codebook.clusters.size();
+  std::vector<int> clusters(num_clusters);
+  std::iota(clusters.begin(), clusters.end(), 0);
+  std::partial_sort(clusters.begin(), clusters.begin() + search_width_,
+                    clusters.end(), [&centroid_scores](int a, int b) {
+                      return centroid_scores(a) < centroid_scores(b);
+                    });
+  float min_score = std::numeric_limits<float>::max();
   int chosen_index = 0;
-  int current_index = 0;
-
-  // Iterate over all the code vectors in this subspace.
-  for (const auto& code_vector : codebook) {
-    float dist = 0;
-    // Iterate over each dimension of the current code vector.
-    for (int dimension = 0; dimension < sub_projected_features.size();
-         ++dimension) {
-      // Find the closest l2 distance of each code vector.
-      dist += audio_dsp::Square(sub_projected_features(dimension) -
-                                code_vector.at(dimension));
-      // No need to keep calculating distance if we are already over the
-      // previous min.
-      if (dist >= min_dist) {
-        break;
-      }
+  for (int i = 0; i < search_width_; ++i) {
+    const Cluster& cluster = codebook.clusters[clusters[i]];
+    if (cluster.indices.empty()) {
+      continue;
     }
-    if (dist < min_dist) {
-      min_dist = dist;
-      chosen_index = current_index;
+    int index = 0;
+    const float score =
+        (cluster.squared_norms -
+         2.0f * cluster.code_vectors * sub_projected_features.transpose())
+            .minCoeff(&index);
+    if (score < min_score) {
+      min_score = score;
+      chosen_index = cluster.indices[index];
     }
-    current_index++;
   }
-
   return chosen_index;
 }
 
@@ -19,12 +19,13 @@
 
 #include <cstdint>
 #include <memory>
-#include <string>
 #include <vector>
 
 #include "Eigen/Core"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "include/ghc/filesystem.hpp"
+#include "quantized_bits.h"
 #include "vector_quantizer_interface.h"
 
 namespace chromemedia {
@@ -49,26 +50,83 @@ class VectorQuantizerImpl : public VectorQuantizerInterface {
 
   // Quantizes the features using vector quantization. Results will have
   // |NumQuantizedBits| bits.
-  absl::optional<std::string> Quantize(
+  absl::optional<QuantizedBits> Quantize(
       const std::vector<float>& features) const override;
 
-  // Unpacks the string of bits and looks up the KLT features. Then multiplies
-  // by the inverse transformation matrix and adds the mean.
+  // Quantizes all feature vectors of the batch with one projection and, for
+  // the exhaustive search, one matrix-matrix product per codebook.
+  absl::optional<std::vector<QuantizedBits>> QuantizeBatch(
+      absl::Span<const float> features, int num_vectors) const override;
+
+  // Unpacks the bits and looks up the KLT features. Then multiplies by the
+  // inverse transformation matrix and adds the mean.
   std::vector<float> DecodeToLossyFeatures(
-      const std::string& quantized_features) const override;
+      const QuantizedBits& quantized_features) const override;
+
+  // Makes |Quantize| search approximately. The code vectors of each codebook
+  // with at least |kMinNumCodeVectorsToCluster| of them are grouped into
+  // about sqrt(size) clusters when the quantizer is created, and only the
+  // code vectors of the |search_width| clusters with the closest centroids
+  // are compared. Wider searches are slower and pick the exact nearest code
+  // vectors more often. 0, the default, searches all code vectors. Must not
+  // be called concurrently with |Quantize|.
+  void set_search_width(int search_width) { search_width_ = search_width; }
+  int search_width() const { return search_width_; }
+
+  static constexpr int kMinNumCodeVectorsToCluster = 16;
 
  private:
   static constexpr int kMaxNumQuantizedBits = 200;
+  static_assert(kMaxNumQuantizedBits <= QuantizedBits::kMaxNumBits,
+                "The quantized bits do not fit in QuantizedBits.");
 
   VectorQuantizerImpl(
       int num_features, int num_bits, const Eigen::RowVectorXf& mean_vector,
       const Eigen::MatrixXf& transformation_matrix,
       const std::vector<std::vector<std::vector<float>>>& codebooks);
 
+  // A group of code vectors of a codebook that are close to each other.
+  struct Cluster {
+    // The indices of the code vectors in the codebook.
+    std::vector<int> indices;
+    // The code vectors with those indices, see |Codebook|.
+    Eigen::MatrixXf code_vectors;
+    Eigen::VectorXf squared_norms;
+  };
+
+  // The code vectors of one subspace of the klt feature space.
+  struct Codebook {
+    // The bits needed to represent the index of a code vector.
+    int num_bits;
+    // Row i is the i-th code vector. Column major, so that scoring all code
+    // vectors against a feature vector vectorizes across code vectors.
+    Eigen::MatrixXf code_vectors;
+    // The squared l2 norm of each code vector.
+    Eigen::VectorXf squared_norms;
+    // The k-means clusters of the code vectors for the approximate search,
+    // with their centroids in the same layout as |code_vectors|. Empty for
+    // small codebooks.
+    Eigen::MatrixXf centroids;
+    Eigen::VectorXf centroid_squared_norms;
+    std::vector<Cluster> clusters;
+  };
+
   VectorQuantizerImpl() = delete;
-  // Find the closest (l2) code vector to sub_projected_features.
+
+  static std::vector<Codebook> FlattenCodebooks(
+      const std::vector<std::vector<std::vector<float>>>& codebooks);
+
+  // Fills the clusters of |codebook| with a few iterations of Lloyd's
+  // algorithm.
+  static void ClusterCodeVectors(Codebook* codebook);
+
+  // Whether |FindNearest| compares all code vectors of |codebook|.
+  bool IsExhaustiveSearch(const Codebook& codebook) const;
+
+  // Find the closest (l2) code vector of |codebook| to
+  // |sub_projected_features|, approximately if |search_width_| is positive.
   int FindNearest(const Eigen::RowVectorXf& sub_projected_features,
-                  const std::vector<std::vector<float>>& codebook) const;
+                  const Codebook& codebook) const;
 
   const int num_bits_;
   const int num_features_;
@@ -79,11 +137,10 @@ class VectorQuantizerImpl : public VectorQuantizerInterface {
   const Eigen::MatrixXf transformation_matrix_;
   // Store the inverse for DecodeToLossyFeatures.
   const Eigen::MatrixXf inverse_transformation_matrix_;
-  // The first dimension contains the subspaces of the klt feature space,
-  // of length |subvector_indexes_ + 1|. The second dimension contains the
-  // code vector points in that subspace. The third dimension contains
-  // the components of the code vector, of length |subvector_indexes[i]|.
-  const std::vector<std::vector<std::vector<float>>> codebooks_;
+  // One codebook per subspace of the klt feature space, in the order of the
+  // subspaces.
+  const std::vector<Codebook> codebooks_;
+  int search_width_;
 
   friend class VectorQuantizerImplPeer;
 };
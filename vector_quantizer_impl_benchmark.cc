@@ -0,0 +1,95 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "quantized_bits.h"
+#include "vector_quantizer_impl.h"
+
+static constexpr int kNumQuantizedBits = 120;
+
+// Quantizes random features with the shipped codebooks and a search width of
+// |state.range(0)|, where 0 is the exact search.
+void BM_Quantize(benchmark::State& state) {
+  const int num_features = chromemedia::codec::kNumFramesPerPacket *
+                           chromemedia::codec::kNumFeatures;
+  std::unique_ptr<chromemedia::codec::VectorQuantizerImpl> quantizer =
+      chromemedia::codec::VectorQuantizerImpl::Create(
+          num_features, kNumQuantizedBits,
+          ghc::filesystem::current_path() / "wavegru");
+  if (quantizer == nullptr) {
+    state.SkipWithError("Could not create the quantizer.");
+    return;
+  }
+  quantizer->set_search_width(state.range(0));
+  // We create random features to avoid any caching in the benchmark.
+  const int kNumRandVectors = 1000;
+  absl::BitGen gen;
+  std::vector<std::vector<float>> features(kNumRandVectors,
+                                           std::vector<float>(num_features));
+  for (auto& feature_vector : features) {
+    for (auto& feature : feature_vector) {
+      feature = absl::Gaussian<float>(gen);
+    }
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(quantizer->Quantize(
+        features[absl::Uniform(gen, 0, kNumRandVectors)]));
+  }
+}
+
+// Decodes the quantized random features back into lossy features.
+void BM_DecodeToLossyFeatures(benchmark::State& state) {
+  const int num_features = chromemedia::codec::kNumFramesPerPacket *
+                           chromemedia::codec::kNumFeatures;
+  std::unique_ptr<chromemedia::codec::VectorQuantizerImpl> quantizer =
+      chromemedia::codec::VectorQuantizerImpl::Create(
+          num_features, kNumQuantizedBits,
+          ghc::filesystem::current_path() / "wavegru");
+  if (quantizer == nullptr) {
+    state.SkipWithError("Could not create the quantizer.");
+    return;
+  }
+  const int kNumRandVectors = 1000;
+  absl::BitGen gen;
+  std::vector<chromemedia::codec::QuantizedBits> quantized_features;
+  quantized_features.reserve(kNumRandVectors);
+  std::vector<float> features(num_features);
+  for (int i = 0; i < kNumRandVectors; ++i) {
+    for (auto& feature : features) {
+      feature = absl::Gaussian<float>(gen);
+    }
+    auto quantized_or = quantizer->Quantize(features);
+    if (!quantized_or.has_value()) {
+      state.SkipWithError("Could not quantize the features.");
+      return;
+    }
+    quantized_features.push_back(quantized_or.value());
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(quantizer->DecodeToLossyFeatures(
+        quantized_features[absl::Uniform(gen, 0, kNumRandVectors)]));
+  }
+}
+
+BENCHMARK(BM_Quantize)->Arg(0)->Arg(1)->Arg(2)->Arg(4);
+BENCHMARK(BM_DecodeToLossyFeatures);
+BENCHMARK_MAIN();
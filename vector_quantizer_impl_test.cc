@@ -17,20 +17,26 @@
 #include <bitset>
 #include <cstdint>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <optional>
+#include <random>
 #include <string>
 #include <utility>
 #include <vector>
 
 // placeholder for get runfiles header.
 #include "Eigen/Core"
+#include "Eigen/LU"
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
+#include "dsp_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_codec_config.h"
 #include "lyra_config.h"
+#include "testing/quantized_bits_string.h"
 
 namespace chromemedia {
 namespace codec {
@@ -40,7 +46,8 @@ static constexpr int kTestNumFeatures = 4;
 static constexpr int kTestNumBits = 120;
 
 // A peer class for testing so that mean_vector / transformation_matrix /
-// codebooks may be injected.
+// codebooks may be injected. Passes the quantized bits as strings of '0' and
+// '1' characters.
 class VectorQuantizerImplPeer {
  public:
   static std::unique_ptr<VectorQuantizerImplPeer> Create(
@@ -74,12 +81,35 @@ class VectorQuantizerImplPeer {
 
   absl::optional<std::string> Quantize(
       const std::vector<float>& features) const {
-    return quantizer_->Quantize(features);
+    const auto quantized_or = quantizer_->Quantize(features);
+    if (!quantized_or.has_value()) {
+      return absl::nullopt;
+    }
+    return QuantizedBitsToString(quantized_or.value());
+  }
+
+  absl::optional<std::vector<std::string>> QuantizeBatch(
+      const std::vector<float>& features, int num_vectors) const {
+    const auto quantized_or =
+        quantizer_->QuantizeBatch(features, num_vectors);
+    if (!quantized_or.has_value()) {
+      return absl::nullopt;
+    }
+    std::vector<std::string> quantized;
+    for (const QuantizedBits& quantized_bits : quantized_or.value()) {
+      quantized.push_back(QuantizedBitsToString(quantized_bits));
+    }
+    return quantized;
   }
 
   std::vector<float> DecodeToLossyFeatures(
       const std::string& quantized_features) const {
-    return quantizer_->DecodeToLossyFeatures(quantized_features);
+    return quantizer_->DecodeToLossyFeatures(
+        QuantizedBitsFromString(quantized_features));
+  }
+
+  void set_search_width(int search_width) {
+    quantizer_->set_search_width(search_width);
   }
 
  private:
@@ -90,6 +120,33 @@ class VectorQuantizerImplPeer {
   std::unique_ptr<VectorQuantizerImpl> quantizer_;
 };
 
+// Returns |size| values drawn uniformly from [-1, 1).
+std::vector<float> RandomVector(int size, std::mt19937* gen) {
+  std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+  std::vector<float> values(size);
+  for (float& value : values) {
+    value = distribution(*gen);
+  }
+  return values;
+}
+
+// Returns a quantizer with a zero mean, an identity transformation and a
+// single codebook of |code_vectors|, which therefore searches directly in the
+// feature space.
+std::unique_ptr<VectorQuantizerImplPeer> CreateSingleCodebookQuantizer(
+    const std::vector<float>& code_vectors) {
+  const std::vector<float> zero_mean(kTestNumFeatures, 0.0f);
+  std::vector<std::vector<float>> identity(
+      kTestNumFeatures, std::vector<float>(kTestNumFeatures, 0.0f));
+  for (int i = 0; i < kTestNumFeatures; ++i) {
+    identity[i][i] = 1.0f;
+  }
+  return VectorQuantizerImplPeer::Create(
+      zero_mean, identity, code_vectors,
+      {static_cast<int16_t>(code_vectors.size() / kTestNumFeatures),
+       kTestNumFeatures});
+}
+
 class VectorQuantizerImplTest : public testing::Test {
  public:
   VectorQuantizerImplTest()
@@ -229,6 +286,158 @@ TEST_F(VectorQuantizerImplTest, DecodeToLossyFeaturesValidNumFeatures) {
               testing::Pointwise(testing::FloatEq(), expected_features));
 }
 
+TEST_F(VectorQuantizerImplTest, DecodeMatchesInverseTransformOfCodeVectors) {
+  Eigen::MatrixXf transformation_matrix(kTestNumFeatures, kTestNumFeatures);
+  for (int i = 0; i < kTestNumFeatures; ++i) {
+    for (int j = 0; j < kTestNumFeatures; ++j) {
+      transformation_matrix(i, j) = transformation_matrix_[i][j];
+    }
+  }
+  const Eigen::MatrixXf inverse = transformation_matrix.inverse();
+  // Every combination of the 2 code vectors of the first codebook and the 4
+  // of the second.
+  for (int first = 0; first < 2; ++first) {
+    for (int second = 0; second < 4; ++second) {
+      std::bitset<kNumQuantizedBits> quantized((first << 2) | second);
+      quantized <<= kNumQuantizedBits - 3;
+      Eigen::RowVectorXf klt_features(kTestNumFeatures);
+      klt_features << flattened_code_vectors_[2 * first],
+          flattened_code_vectors_[2 * first + 1],
+          flattened_code_vectors_[4 + 2 * second],
+          flattened_code_vectors_[4 + 2 * second + 1];
+      const Eigen::RowVectorXf expected = klt_features * inverse;
+
+      const std::vector<float> features =
+          quantizer_->DecodeToLossyFeatures(quantized.to_string());
+
+      ASSERT_EQ(features.size(), kTestNumFeatures);
+      for (int i = 0; i < kTestNumFeatures; ++i) {
+        EXPECT_NEAR(features[i], expected(i) + mean_vector_[i], 1e-5f);
+      }
+    }
+  }
+}
+
+TEST_F(VectorQuantizerImplTest, QuantizeFindsNearestCodeVector) {
+  constexpr int kNumCodeVectors = 16;
+  std::mt19937 gen(42);
+  const std::vector<float> code_vectors =
+      RandomVector(kNumCodeVectors * kTestNumFeatures, &gen);
+  auto quantizer = CreateSingleCodebookQuantizer(code_vectors);
+  ASSERT_NE(quantizer, nullptr);
+
+  for (int trial = 0; trial < 100; ++trial) {
+    const std::vector<float> features = RandomVector(kTestNumFeatures, &gen);
+    int expected_index = 0;
+    float min_distance = std::numeric_limits<float>::max();
+    for (int i = 0; i < kNumCodeVectors; ++i) {
+      float distance = 0.0f;
+      for (int j = 0; j < kTestNumFeatures; ++j) {
+        const float difference =
+            features[j] - code_vectors[i * kTestNumFeatures + j];
+        distance += difference * difference;
+      }
+      if (distance < min_distance) {
+        min_distance = distance;
+        expected_index = i;
+      }
+    }
+    std::bitset<kNumQuantizedBits> expected(expected_index);
+    expected <<= kNumQuantizedBits - 4;
+
+    auto quantized_or = quantizer->Quantize(features);
+
+    ASSERT_TRUE(quantized_or.has_value());
+    EXPECT_EQ(quantized_or.value(), expected.to_string());
+  }
+}
+
+TEST_F(VectorQuantizerImplTest, ApproximateQuantizeIsCloseToExact) {
+  constexpr int kNumCodeVectors = 256;
+  // The 256 code vectors are grouped into 16 clusters.
+  constexpr int kNumClusters = 16;
+  std::mt19937 gen(42);
+  auto quantizer = CreateSingleCodebookQuantizer(
+      RandomVector(kNumCodeVectors * kTestNumFeatures, &gen));
+  ASSERT_NE(quantizer, nullptr);
+
+  constexpr int kNumTrials = 1000;
+  std::vector<std::vector<float>> features(kNumTrials);
+  std::vector<std::string> exact(kNumTrials);
+  float exact_distance = 0.0f;
+  for (int i = 0; i < kNumTrials; ++i) {
+    features[i] = RandomVector(kTestNumFeatures, &gen);
+    exact[i] = quantizer->Quantize(features[i]).value();
+    exact_distance +=
+        LogSpectralDistance(features[i],
+                            quantizer->DecodeToLossyFeatures(exact[i]))
+            .value();
+  }
+
+  // Searching all clusters is exact.
+  quantizer->set_search_width(kNumClusters);
+  for (int i = 0; i < kNumTrials; ++i) {
+    EXPECT_EQ(quantizer->Quantize(features[i]).value(), exact[i]);
+  }
+
+  quantizer->set_search_width(2);
+  int num_exact = 0;
+  float approximate_distance = 0.0f;
+  for (int i = 0; i < kNumTrials; ++i) {
+    const std::string approximate = quantizer->Quantize(features[i]).value();
+    num_exact += approximate == exact[i];
+    approximate_distance +=
+        LogSpectralDistance(features[i],
+                            quantizer->DecodeToLossyFeatures(approximate))
+            .value();
+  }
+  EXPECT_GT(num_exact, 0.8f * kNumTrials);
+  EXPECT_LT(approximate_distance, 1.05f * exact_distance);
+}
+
+TEST_F(VectorQuantizerImplTest, QuantizeBatchMatchesQuantize) {
+  constexpr int kNumVectors = 8;
+  std::mt19937 gen(42);
+  const std::vector<float> features =
+      RandomVector(kNumVectors * kTestNumFeatures, &gen);
+  const auto batch_or = quantizer_->QuantizeBatch(features, kNumVectors);
+  ASSERT_TRUE(batch_or.has_value());
+  ASSERT_EQ(batch_or->size(), kNumVectors);
+  for (int i = 0; i < kNumVectors; ++i) {
+    const std::vector<float> vector(
+        features.begin() + i * kTestNumFeatures,
+        features.begin() + (i + 1) * kTestNumFeatures);
+    EXPECT_EQ(batch_or->at(i), quantizer_->Quantize(vector).value());
+  }
+}
+
+TEST_F(VectorQuantizerImplTest, ApproximateQuantizeBatchMatchesQuantize) {
+  constexpr int kNumCodeVectors = 256;
+  constexpr int kNumVectors = 8;
+  std::mt19937 gen(42);
+  auto quantizer = CreateSingleCodebookQuantizer(
+      RandomVector(kNumCodeVectors * kTestNumFeatures, &gen));
+  ASSERT_NE(quantizer, nullptr);
+  quantizer->set_search_width(2);
+  const std::vector<float> features =
+      RandomVector(kNumVectors * kTestNumFeatures, &gen);
+  const auto batch_or = quantizer->QuantizeBatch(features, kNumVectors);
+  ASSERT_TRUE(batch_or.has_value());
+  ASSERT_EQ(batch_or->size(), kNumVectors);
+  for (int i = 0; i < kNumVectors; ++i) {
+    const std::vector<float> vector(
+        features.begin() + i * kTestNumFeatures,
+        features.begin() + (i + 1) * kTestNumFeatures);
+    EXPECT_EQ(batch_or->at(i), quantizer->Quantize(vector).value());
+  }
+}
+
+TEST_F(VectorQuantizerImplTest, QuantizeBatchWrongNumFeaturesFails) {
+  const std::vector<float> features(2 * kTestNumFeatures + 1, 0.0f);
+  EXPECT_FALSE(quantizer_->QuantizeBatch(features, 2).has_value());
+  EXPECT_FALSE(quantizer_->QuantizeBatch({}, 0).has_value());
+}
+
 TEST_F(VectorQuantizerImplTest, DefaultCreateSucceedsWithProdNumFeatures) {
   auto quantizer = VectorQuantizerImpl::Create(
       kNumFramesPerPacket * kNumFeatures, 120, model_path_);
@@ -243,6 +452,37 @@ TEST_F(VectorQuantizerImplTest, TooManyBits) {
   EXPECT_EQ(quantizer, nullptr);
 }
 
+// The configured number of features takes the loops compiled for that size.
+TEST(VectorQuantizerImplCreate, ConfiguredNumFeaturesRoundTrips) {
+  const int num_features = LyraDefaultCodecConfig::kNumQuantizedFeatures;
+  const int kDimensionality = 4;
+  const int num_codebooks = num_features / kDimensionality;
+  // Each codebook holds a vector of all ones and one of all minus ones, and
+  // the transformation is the identity, so features made of those vectors
+  // are decoded exactly.
+  std::vector<float> code_vectors;
+  std::vector<int16_t> codebook_dimensions;
+  for (int i = 0; i < num_codebooks; ++i) {
+    code_vectors.insert(code_vectors.end(), kDimensionality, 1.0f);
+    code_vectors.insert(code_vectors.end(), kDimensionality, -1.0f);
+    codebook_dimensions.insert(codebook_dimensions.end(), {2, kDimensionality});
+  }
+  auto quantizer = VectorQuantizerImpl::Create(
+      num_features, kTestNumBits, Eigen::VectorXf::Zero(num_features),
+      Eigen::MatrixXf::Identity(num_features, num_features), code_vectors,
+      codebook_dimensions);
+  ASSERT_NE(quantizer, nullptr);
+
+  std::mt19937 gen(1);
+  std::vector<float> features;
+  for (int i = 0; i < num_codebooks; ++i) {
+    features.insert(features.end(), kDimensionality, gen() % 2 ? 1.0f : -1.0f);
+  }
+  const auto quantized_or = quantizer->Quantize(features);
+  ASSERT_TRUE(quantized_or.has_value());
+  EXPECT_EQ(quantizer->DecodeToLossyFeatures(quantized_or.value()), features);
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia
@@ -17,10 +17,11 @@
 #ifndef LYRA_CODEC_VECTOR_QUANTIZER_INTERFACE_H_
 #define LYRA_CODEC_VECTOR_QUANTIZER_INTERFACE_H_
 
-#include <string>
 #include <vector>
 
 #include "absl/types/optional.h"  // IWYU pragma: keep
+#include "absl/types/span.h"
+#include "quantized_bits.h"
 
 namespace chromemedia {
 namespace codec {
@@ -30,15 +31,40 @@ class VectorQuantizerInterface {
  public:
   virtual ~VectorQuantizerInterface() {}
 
-  // Converts the features into a bitset representing the indices of code
-  // vectors closest to the klt transform of features.
-  virtual absl::optional<std::string> Quantize(
+  // Converts the features into bits representing the indices of code vectors
+  // closest to the klt transform of features.
+  virtual absl::optional<QuantizedBits> Quantize(
       const std::vector<float>& features) const = 0;
 
+  // Quantizes |num_vectors| feature vectors of the same size, concatenated in
+  // |features|, as if |Quantize| was called on each of them in order. Returns
+  // a nullopt if any of them fails. Quantizers that can search for several
+  // vectors at once should override this; the default goes through
+  // |Quantize|.
+  virtual absl::optional<std::vector<QuantizedBits>> QuantizeBatch(
+      absl::Span<const float> features, int num_vectors) const {
+    if (num_vectors <= 0 || features.size() % num_vectors != 0) {
+      return absl::nullopt;
+    }
+    const int num_features = features.size() / num_vectors;
+    std::vector<QuantizedBits> quantized;
+    quantized.reserve(num_vectors);
+    for (int i = 0; i < num_vectors; ++i) {
+      auto quantized_or = Quantize(std::vector<float>(
+          features.begin() + num_features * i,
+          features.begin() + num_features * (i + 1)));
+      if (!quantized_or.has_value()) {
+        return absl::nullopt;
+      }
+      quantized.push_back(quantized_or.value());
+    }
+    return quantized;
+  }
+
   // Converts quantized bits back into lossy features in the log mel
   // spectrogram domain.
   virtual std::vector<float> DecodeToLossyFeatures(
-      const std::string& quantized_features) const = 0;
+      const QuantizedBits& quantized_features) const = 0;
 };
 
 }  // namespace codec
@@ -14,12 +14,73 @@
 
 #include "wav_util.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "audio/dsp/portable/read_wav_file.h"
 #include "audio/dsp/portable/write_wav_file.h"
 
 namespace chromemedia::codec {
+namespace {
+
+constexpr int kBytesPerSample = sizeof(int16_t);
+constexpr int kHeaderSize = 44;
+constexpr uint16_t kFormatPcm = 1;
+constexpr uint16_t kFormatExtensible = 0xfffe;
+
+uint32_t LittleEndian(const char* bytes, int num_bytes) {
+  uint32_t value = 0;
+  for (int i = 0; i < num_bytes; ++i) {
+    value |= static_cast<uint32_t>(static_cast<unsigned char>(bytes[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+void AppendLittleEndian(uint32_t value, int num_bytes, std::string* bytes) {
+  for (int i = 0; i < num_bytes; ++i) {
+    bytes->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+// Returns the canonical header of a 16 bit PCM file with |num_data_bytes| of
+// samples.
+std::string WavHeader(int num_channels, int sample_rate_hz,
+                      uint32_t num_data_bytes) {
+  std::string header = "RIFF";
+  // Saturates for streams of unknown length.
+  AppendLittleEndian(
+      std::min<uint64_t>(uint64_t{kHeaderSize} - 8 + num_data_bytes,
+                         std::numeric_limits<uint32_t>::max()),
+      4, &header);
+  header += "WAVEfmt ";
+  AppendLittleEndian(16, 4, &header);
+  AppendLittleEndian(kFormatPcm, 2, &header);
+  AppendLittleEndian(num_channels, 2, &header);
+  AppendLittleEndian(sample_rate_hz, 4, &header);
+  AppendLittleEndian(sample_rate_hz * num_channels * kBytesPerSample, 4,
+                     &header);
+  AppendLittleEndian(num_channels * kBytesPerSample, 2, &header);
+  AppendLittleEndian(8 * kBytesPerSample, 2, &header);
+  header += "data";
+  AppendLittleEndian(num_data_bytes, 4, &header);
+  return header;
+}
+
+}  // namespace
 
 absl::StatusOr<ReadWavResult> Read16BitWavFileToVector(
     const std::string& file_name) {
@@ -53,4 +114,265 @@ absl::Status Write16BitWavFileFromVector(const std::string& file_name,
       absl::StrCat("Failed to write to wav file at: ", file_name));
 }
 
+absl::StatusOr<std::unique_ptr<WavReader>> WavReader::Open(
+    const std::string& file_name) {
+  std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return absl::NotFoundError(
+        absl::StrCat("Failed to open wav at path: ", file_name));
+  }
+  const int64_t file_size = file.tellg();
+  file.seekg(0);
+  const auto invalid = [&file_name](absl::string_view reason) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to read from wav at path: ", file_name, ", ",
+                     reason));
+  };
+
+  char riff[12];
+  if (!file.read(riff, sizeof(riff)) ||
+      absl::string_view(riff, 4) != "RIFF" ||
+      absl::string_view(riff + 8, 4) != "WAVE") {
+    return invalid("not a RIFF WAVE file.");
+  }
+  // Skips chunks until the samples, which have to follow the format.
+  int num_channels = 0;
+  int sample_rate_hz = 0;
+  char chunk_header[8];
+  while (file.read(chunk_header, sizeof(chunk_header))) {
+    const absl::string_view chunk_id(chunk_header, 4);
+    const uint32_t chunk_size = LittleEndian(chunk_header + 4, 4);
+    if (chunk_id == "fmt ") {
+      std::vector<char> format(chunk_size);
+      if (chunk_size < 16 || !file.read(format.data(), chunk_size)) {
+        return invalid("truncated format chunk.");
+      }
+      uint32_t format_tag = LittleEndian(format.data(), 2);
+      // The sub format of an extensible file starts with its format tag.
+      if (format_tag == kFormatExtensible && chunk_size >= 26) {
+        format_tag = LittleEndian(format.data() + 24, 2);
+      }
+      num_channels = LittleEndian(format.data() + 2, 2);
+      sample_rate_hz = LittleEndian(format.data() + 4, 4);
+      const int bits_per_sample = LittleEndian(format.data() + 14, 2);
+      if (format_tag != kFormatPcm || bits_per_sample != 8 * kBytesPerSample ||
+          num_channels < 1 || sample_rate_hz < 1) {
+        return invalid("only 16 bit PCM is supported.");
+      }
+      file.seekg(chunk_size % 2, std::ios::cur);
+    } else if (chunk_id == "data") {
+      if (num_channels == 0) {
+        return invalid("samples before the format.");
+      }
+      // Files whose writer did not finish have a wrong size, so the samples
+      // are bounded by the end of the file.
+      const int64_t num_data_bytes =
+          std::min<int64_t>(chunk_size, file_size - file.tellg());
+      return absl::WrapUnique(
+          new WavReader(std::move(file), num_channels, sample_rate_hz,
+                        num_data_bytes / kBytesPerSample));
+    } else {
+      file.seekg(chunk_size + chunk_size % 2, std::ios::cur);
+    }
+  }
+  return invalid("no samples found.");
+}
+
+WavReader::WavReader(std::ifstream file, int num_channels, int sample_rate_hz,
+                     int64_t num_samples)
+    : file_(std::move(file)),
+      num_channels_(num_channels),
+      sample_rate_hz_(sample_rate_hz),
+      num_samples_(num_samples) {}
+
+absl::StatusOr<int> WavReader::Read(absl::Span<int16_t> samples) {
+  const int num_samples = static_cast<int>(std::min<int64_t>(
+      samples.size(), num_samples_ - num_samples_read_));
+  if (num_samples == 0) {
+    return 0;
+  }
+  buffer_.resize(num_samples * kBytesPerSample);
+  if (!file_.read(buffer_.data(), buffer_.size())) {
+    return absl::DataLossError("Failed to read samples from wav.");
+  }
+  for (int i = 0; i < num_samples; ++i) {
+    samples[i] = static_cast<int16_t>(
+        LittleEndian(buffer_.data() + i * kBytesPerSample, kBytesPerSample));
+  }
+  num_samples_read_ += num_samples;
+  return num_samples;
+}
+
+absl::StatusOr<std::unique_ptr<WavWriter>> WavWriter::Create(
+    const std::string& file_name, int num_channels, int sample_rate_hz) {
+  if (num_channels < 1 || sample_rate_hz < 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid wav format of ", num_channels, " channels at ",
+                     sample_rate_hz, " Hz."));
+  }
+  std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+  const std::string header = WavHeader(num_channels, sample_rate_hz, 0);
+  file.write(header.data(), header.size());
+  if (!file.good()) {
+    return absl::AbortedError(
+        absl::StrCat("Failed to write to wav file at: ", file_name));
+  }
+  return absl::WrapUnique(new WavWriter(std::move(file), file_name,
+                                        num_channels, sample_rate_hz));
+}
+
+WavWriter::WavWriter(std::ofstream file, std::string file_name,
+                     int num_channels, int sample_rate_hz)
+    : file_(std::move(file)),
+      file_name_(std::move(file_name)),
+      num_channels_(num_channels),
+      sample_rate_hz_(sample_rate_hz) {}
+
+WavWriter::~WavWriter() {
+  if (file_.is_open()) {
+    Close().IgnoreError();
+  }
+}
+
+absl::Status WavWriter::Write(absl::Span<const int16_t> samples) {
+  if (!file_.is_open()) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Wav file at ", file_name_, " was already closed."));
+  }
+  // The sizes in the header are 32 bits.
+  if ((num_samples_ + samples.size()) * kBytesPerSample >
+      std::numeric_limits<uint32_t>::max() - (kHeaderSize - 8)) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Wav file at ", file_name_, " would exceed 4 GiB."));
+  }
+  buffer_.resize(samples.size() * kBytesPerSample);
+  for (int i = 0; i < samples.size(); ++i) {
+    const uint16_t sample = static_cast<uint16_t>(samples[i]);
+    buffer_[i * kBytesPerSample] = static_cast<char>(sample & 0xff);
+    buffer_[i * kBytesPerSample + 1] = static_cast<char>(sample >> 8);
+  }
+  file_.write(buffer_.data(), buffer_.size());
+  if (!file_.good()) {
+    return absl::AbortedError(
+        absl::StrCat("Failed to write to wav file at: ", file_name_));
+  }
+  num_samples_ += samples.size();
+  return absl::OkStatus();
+}
+
+absl::Status WavWriter::Close() {
+  if (!file_.is_open()) {
+    return absl::OkStatus();
+  }
+  const std::string header =
+      WavHeader(num_channels_, sample_rate_hz_, num_samples_ * kBytesPerSample);
+  file_.seekp(0);
+  file_.write(header.data(), header.size());
+  file_.close();
+  if (!file_.good()) {
+    return absl::AbortedError(
+        absl::StrCat("Failed to write to wav file at: ", file_name_));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<WavFormat> ReadWavStreamHeader(std::istream* stream) {
+  const auto invalid = [](absl::string_view reason) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to read from wav stream, ", reason));
+  };
+  char riff[12];
+  if (!stream->read(riff, sizeof(riff)) ||
+      absl::string_view(riff, 4) != "RIFF" ||
+      absl::string_view(riff + 8, 4) != "WAVE") {
+    return invalid("not a RIFF WAVE stream.");
+  }
+  // Skips chunks until the samples by reading them, since a pipe cannot
+  // seek.
+  WavFormat format = {0, 0};
+  char chunk_header[8];
+  std::vector<char> chunk;
+  while (stream->read(chunk_header, sizeof(chunk_header))) {
+    const absl::string_view chunk_id(chunk_header, 4);
+    const uint32_t chunk_size = LittleEndian(chunk_header + 4, 4);
+    if (chunk_id == "data") {
+      if (format.num_channels == 0) {
+        return invalid("samples before the format.");
+      }
+      return format;
+    }
+    const int64_t padded_size = int64_t{chunk_size} + chunk_size % 2;
+    if (chunk_id == "fmt ") {
+      chunk.resize(padded_size);
+      if (chunk_size < 16 || !stream->read(chunk.data(), padded_size)) {
+        return invalid("truncated format chunk.");
+      }
+      uint32_t format_tag = LittleEndian(chunk.data(), 2);
+      if (format_tag == kFormatExtensible && chunk_size >= 26) {
+        format_tag = LittleEndian(chunk.data() + 24, 2);
+      }
+      format.num_channels = LittleEndian(chunk.data() + 2, 2);
+      format.sample_rate_hz = LittleEndian(chunk.data() + 4, 4);
+      const int bits_per_sample = LittleEndian(chunk.data() + 14, 2);
+      if (format_tag != kFormatPcm || bits_per_sample != 8 * kBytesPerSample ||
+          format.num_channels < 1 || format.sample_rate_hz < 1) {
+        return invalid("only 16 bit PCM is supported.");
+      }
+    } else if (!stream->ignore(padded_size) ||
+               stream->gcount() != padded_size) {
+      return invalid("truncated chunk.");
+    }
+  }
+  return invalid("no samples found.");
+}
+
+absl::Status WriteWavStreamHeader(const WavFormat& format,
+                                  std::ostream* stream) {
+  if (format.num_channels < 1 || format.sample_rate_hz < 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid wav format of ", format.num_channels,
+                     " channels at ", format.sample_rate_hz, " Hz."));
+  }
+  const std::string header =
+      WavHeader(format.num_channels, format.sample_rate_hz,
+                std::numeric_limits<uint32_t>::max());
+  stream->write(header.data(), header.size());
+  stream->flush();
+  if (!stream->good()) {
+    return absl::AbortedError("Failed to write to wav stream.");
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<int> ReadPcmSamples(std::istream* stream,
+                                   absl::Span<int16_t> samples) {
+  std::vector<char> buffer(samples.size() * kBytesPerSample);
+  stream->read(buffer.data(), buffer.size());
+  if (stream->bad()) {
+    return absl::DataLossError("Failed to read samples from stream.");
+  }
+  const int num_samples = stream->gcount() / kBytesPerSample;
+  for (int i = 0; i < num_samples; ++i) {
+    samples[i] = static_cast<int16_t>(
+        LittleEndian(buffer.data() + i * kBytesPerSample, kBytesPerSample));
+  }
+  return num_samples;
+}
+
+absl::Status WritePcmSamples(absl::Span<const int16_t> samples,
+                             std::ostream* stream) {
+  std::string buffer;
+  buffer.reserve(samples.size() * kBytesPerSample);
+  for (const int16_t sample : samples) {
+    AppendLittleEndian(static_cast<uint16_t>(sample), kBytesPerSample,
+                       &buffer);
+  }
+  stream->write(buffer.data(), buffer.size());
+  stream->flush();
+  if (!stream->good()) {
+    return absl::AbortedError("Failed to write samples to stream.");
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace chromemedia::codec
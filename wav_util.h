@@ -18,11 +18,16 @@
 #define LYRA_CODEC_WAV_UTIL_H_
 
 #include <cstdint>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 
 namespace chromemedia::codec {
 
@@ -46,6 +51,97 @@ absl::Status Write16BitWavFileFromVector(const std::string& file_name,
                                          int num_channels, int sample_rate_hz,
                                          const std::vector<int16_t>& samples);
 
+// Reads the samples of a 16 bit PCM .wav file chunk by chunk, so that files of
+// any length are processed in constant memory.
+class WavReader {
+ public:
+  // Opens `file_name` and parses its header. Returns an error if the file
+  // cannot be read or is not a 16 bit PCM .wav file.
+  static absl::StatusOr<std::unique_ptr<WavReader>> Open(
+      const std::string& file_name);
+
+  // Reads the next samples into `samples`, interleaved for a multichannel
+  // file. Returns the number of samples read, which is less than
+  // `samples.size()` only at the end of the file and 0 after it.
+  absl::StatusOr<int> Read(absl::Span<int16_t> samples);
+
+  int num_channels() const { return num_channels_; }
+  int sample_rate_hz() const { return sample_rate_hz_; }
+  // The number of samples in the file, over all channels.
+  int64_t num_samples() const { return num_samples_; }
+
+ private:
+  WavReader(std::ifstream file, int num_channels, int sample_rate_hz,
+            int64_t num_samples);
+
+  std::ifstream file_;
+  const int num_channels_;
+  const int sample_rate_hz_;
+  const int64_t num_samples_;
+  int64_t num_samples_read_ = 0;
+  std::vector<char> buffer_;
+};
+
+// Writes a 16 bit PCM .wav file chunk by chunk. The sizes in the header are
+// filled in by `Close`.
+class WavWriter {
+ public:
+  // Creates `file_name` and writes a header for `num_channels` channels at
+  // `sample_rate_hz`.
+  static absl::StatusOr<std::unique_ptr<WavWriter>> Create(
+      const std::string& file_name, int num_channels, int sample_rate_hz);
+
+  // Closes the file if `Close` was not called, ignoring errors.
+  ~WavWriter();
+
+  // Appends `samples`, interleaved for a multichannel file.
+  absl::Status Write(absl::Span<const int16_t> samples);
+
+  // Writes the final sizes into the header and closes the file.
+  absl::Status Close();
+
+  int64_t num_samples() const { return num_samples_; }
+
+ private:
+  WavWriter(std::ofstream file, std::string file_name, int num_channels,
+            int sample_rate_hz);
+
+  std::ofstream file_;
+  const std::string file_name_;
+  const int num_channels_;
+  const int sample_rate_hz_;
+  int64_t num_samples_ = 0;
+  std::vector<char> buffer_;
+};
+
+// The format of the samples of a .wav stream.
+struct WavFormat {
+  int num_channels;
+  int sample_rate_hz;
+};
+
+// Parses the header of a 16 bit PCM .wav stream, such as one piped from
+// another process, and leaves `stream` at the first sample. The stream is
+// only read forward, and the size of the samples is ignored since a writer
+// of a pipe cannot know it, so the samples run until the end of the stream.
+absl::StatusOr<WavFormat> ReadWavStreamHeader(std::istream* stream);
+
+// Writes the header of a 16 bit PCM .wav stream of unknown length, whose
+// sizes are set to the largest possible value as is common for pipes.
+absl::Status WriteWavStreamHeader(const WavFormat& format,
+                                  std::ostream* stream);
+
+// Reads up to `samples.size()` little endian 16 bit samples from `stream`.
+// Returns the number of samples read, which is less than `samples.size()`
+// only at the end of the stream. A trailing odd byte is dropped.
+absl::StatusOr<int> ReadPcmSamples(std::istream* stream,
+                                   absl::Span<int16_t> samples);
+
+// Writes `samples` to `stream` as little endian 16 bit samples and flushes
+// it, so that a reader on the other end of a pipe gets them right away.
+absl::Status WritePcmSamples(absl::Span<const int16_t> samples,
+                             std::ostream* stream);
+
 }  // namespace chromemedia::codec
 
 #endif  // LYRA_CODEC_WAV_UTIL_H_
@@ -14,10 +14,18 @@
 
 #include "wav_util.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
 // placeholder for get runfiles header.
 // placeholder for testing header.
 #include "absl/flags/flag.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
 
@@ -90,5 +98,126 @@ TEST_F(WavUtilTest, WriteToBadPath) {
   EXPECT_FALSE(result.ok());
 }
 
+TEST_F(WavUtilTest, ChunkedReadMatchesWholeFileRead) {
+  const ghc::filesystem::path wav_path =
+      ghc::filesystem::current_path() / "testdata" / "16khz_sample_000001.wav";
+  absl::StatusOr<ReadWavResult> read_result = ReadWav(wav_path);
+  ASSERT_TRUE(read_result.ok());
+
+  absl::StatusOr<std::unique_ptr<WavReader>> reader =
+      WavReader::Open(wav_path.string());
+  ASSERT_TRUE(reader.ok());
+  EXPECT_EQ((*reader)->num_channels(), read_result->num_channels);
+  EXPECT_EQ((*reader)->sample_rate_hz(), read_result->sample_rate_hz);
+  EXPECT_EQ((*reader)->num_samples(), read_result->samples.size());
+  std::vector<int16_t> samples;
+  std::vector<int16_t> chunk(333);
+  while (true) {
+    absl::StatusOr<int> num_read = (*reader)->Read(absl::MakeSpan(chunk));
+    ASSERT_TRUE(num_read.ok());
+    if (*num_read == 0) break;
+    samples.insert(samples.end(), chunk.begin(), chunk.begin() + *num_read);
+  }
+  EXPECT_EQ(samples, read_result->samples);
+}
+
+TEST_F(WavUtilTest, ChunkedWriteReadsBack) {
+  const ghc::filesystem::path output_path =
+      ghc::filesystem::path(testing::TempDir()) / "chunked.wav";
+  std::vector<int16_t> samples(1000);
+  for (int i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<int16_t>(i * 67 - 32000);
+  }
+  {
+    absl::StatusOr<std::unique_ptr<WavWriter>> writer =
+        WavWriter::Create(output_path.string(), 2, 48000);
+    ASSERT_TRUE(writer.ok());
+    for (int i = 0; i < samples.size(); i += 300) {
+      const int num_samples = std::min<int>(300, samples.size() - i);
+      ASSERT_TRUE(
+          (*writer)->Write(absl::MakeConstSpan(&samples[i], num_samples)).ok());
+    }
+    EXPECT_EQ((*writer)->num_samples(), samples.size());
+    EXPECT_TRUE((*writer)->Close().ok());
+  }
+
+  absl::StatusOr<std::unique_ptr<WavReader>> reader =
+      WavReader::Open(output_path.string());
+  ASSERT_TRUE(reader.ok());
+  EXPECT_EQ((*reader)->num_channels(), 2);
+  EXPECT_EQ((*reader)->sample_rate_hz(), 48000);
+  ASSERT_EQ((*reader)->num_samples(), samples.size());
+  std::vector<int16_t> read_samples(samples.size() + 1);
+  absl::StatusOr<int> num_read = (*reader)->Read(absl::MakeSpan(read_samples));
+  ASSERT_TRUE(num_read.ok());
+  EXPECT_EQ(*num_read, samples.size());
+  read_samples.resize(*num_read);
+  EXPECT_EQ(read_samples, samples);
+}
+
+TEST_F(WavUtilTest, ChunkedReaderRejectsInvalidFiles) {
+  const ghc::filesystem::path testdata =
+      ghc::filesystem::current_path() / "testdata";
+  EXPECT_FALSE(WavReader::Open((testdata / "invalid.wav").string()).ok());
+  EXPECT_FALSE(
+      WavReader::Open((testdata / "lyra_config.textproto").string()).ok());
+  EXPECT_FALSE(WavReader::Open("/should/not/exist.wav").ok());
+}
+
+TEST_F(WavUtilTest, ChunkedWriterToBadPathFails) {
+  EXPECT_FALSE(WavWriter::Create("/invalid/path/test", 1, 16000).ok());
+}
+
+TEST_F(WavUtilTest, StreamRoundTripsWithoutSeeking) {
+  std::vector<int16_t> samples(1000);
+  for (int i = 0; i < samples.size(); ++i) {
+    samples[i] = static_cast<int16_t>(i * 67 - 32000);
+  }
+  std::stringstream stream;
+  ASSERT_TRUE(WriteWavStreamHeader({1, 16000}, &stream).ok());
+  for (int i = 0; i < samples.size(); i += 320) {
+    const int num_samples = std::min<int>(320, samples.size() - i);
+    ASSERT_TRUE(
+        WritePcmSamples(absl::MakeConstSpan(&samples[i], num_samples), &stream)
+            .ok());
+  }
+
+  absl::StatusOr<WavFormat> format = ReadWavStreamHeader(&stream);
+  ASSERT_TRUE(format.ok());
+  EXPECT_EQ(format->num_channels, 1);
+  EXPECT_EQ(format->sample_rate_hz, 16000);
+  std::vector<int16_t> read_samples;
+  std::vector<int16_t> packet(320);
+  while (true) {
+    absl::StatusOr<int> num_read =
+        ReadPcmSamples(&stream, absl::MakeSpan(packet));
+    ASSERT_TRUE(num_read.ok());
+    read_samples.insert(read_samples.end(), packet.begin(),
+                        packet.begin() + *num_read);
+    if (*num_read < packet.size()) {
+      break;
+    }
+  }
+  EXPECT_EQ(read_samples, samples);
+}
+
+TEST_F(WavUtilTest, StreamHeaderSkipsOtherChunks) {
+  // A header with a LIST chunk before the format, as written by ffmpeg.
+  std::stringstream stream;
+  ASSERT_TRUE(WriteWavStreamHeader({2, 48000}, &stream).ok());
+  std::string header = stream.str();
+  header.insert(12, std::string("LIST\x03\0\0\0abc\0", 12));
+  std::stringstream padded(header);
+  absl::StatusOr<WavFormat> format = ReadWavStreamHeader(&padded);
+  ASSERT_TRUE(format.ok());
+  EXPECT_EQ(format->num_channels, 2);
+  EXPECT_EQ(format->sample_rate_hz, 48000);
+}
+
+TEST_F(WavUtilTest, StreamHeaderRejectsRawSamples) {
+  std::stringstream stream(std::string(100, '\x7f'));
+  EXPECT_FALSE(ReadWavStreamHeader(&stream).ok());
+}
+
 }  // namespace
 }  // namespace chromemedia::codec
@@ -15,7 +15,9 @@
 #include "wavegru_model_impl.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <string>
@@ -24,155 +26,632 @@
 
 #include "buffer_merger.h"
 #include "causal_convolutional_conditioning.h"
+#include "compute_precision.h"
 #include "glog/logging.h"
 #include "include/ghc/filesystem.hpp"
+#include "lyra_config.h"
+#include "lyra_model.h"
+#include "lyra_types.h"
 #include "lyra_wavegru.h"
+#include "model_bundle.h"
+#include "model_dimensions.h"
+#include "parallel_load.h"
 #include "sparse_inference_matrixvector.h"
+#include "stage_profiler.h"
+#include "state_buffer.h"
+#include "thread_pool.h"
+#include "tracing.h"
 // IWYU pragma: no_include "speech/greco3/core/thread.h"
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
-#include "absl/types/optional.h"
-
-#ifdef BENCHMARK
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
-#endif  // BENCHMARK
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
 
 namespace chromemedia {
 namespace codec {
 
+class WavegruModelImpl::Backend {
+ public:
+  virtual ~Backend() {}
+
+  virtual void ResetConditioningStart() = 0;
+  // Each column of |input| is one frame.
+  virtual void Precompute(csrblocksparse::VectorView<float> input,
+                          int num_threads) = 0;
+  // Precomputes into the conditioning that |SwapConditioning| switches to.
+  virtual void PrecomputeNext(csrblocksparse::VectorView<float> input,
+                              int num_threads) = 0;
+  virtual void SwapConditioning() = 0;
+  // Renders the current conditioning into |num_columns| more columns, see
+  // |CausalConvolutionalConditioning::StretchCurrentOutput|. Fails once
+  // samples were generated from it.
+  virtual bool StretchConditioning(int num_columns) = 0;
+  virtual int num_samples_per_column() const = 0;
+  // The number of samples that can still be generated from the current
+  // conditioning.
+  virtual int num_conditioning_samples_left() const = 0;
+  virtual int SampleWithBarrier(
+      csrblocksparse::SpinBarrier* spin_barrier, int tid,
+      absl::Span<const absl::Span<int16_t>> split_samples,
+      int num_samples) = 0;
+  virtual void set_profiler(StageProfiler* profiler) = 0;
+  virtual void set_use_adaptive_barrier(bool use_adaptive_barrier) = 0;
+  virtual void set_prefetch_distance(int prefetch_distance) = 0;
+  virtual bool set_use_gru_row_pipelining(bool use_gru_row_pipelining) = 0;
+  virtual int num_split_bands() const = 0;
+  // Forgets all frames and samples, as if the backend was just created.
+  virtual void ClearState() = 0;
+  virtual int64_t ReleaseActivations() = 0;
+  virtual bool SaveState(StateWriter* writer) const = 0;
+  virtual bool RestoreState(StateReader* reader) = 0;
+  // Like |SaveState| and |RestoreState|, for the conditioning stack only.
+  virtual bool SaveConditioning(StateWriter* writer) const = 0;
+  virtual bool RestoreConditioning(StateReader* reader) = 0;
+};
+
+template <typename ComputeType>
+class WavegruModelImpl::TypedBackend : public WavegruModelImpl::Backend {
+ public:
+  using ConditioningType =
+      CausalConvolutionalConditioning<ConditioningTypes<ComputeType>>;
+
+  static std::unique_ptr<Backend> Create(
+      int num_features, const ModelDimensions& dimensions,
+      int num_samples_per_hop, int num_frames_per_packet, int num_threads,
+      const std::string& model_path, const std::string& model_prefix,
+      LyraModel* model, ThreadPool* thread_pool) {
+    // The wavegru and the conditioning stack load concurrently.
+    std::unique_ptr<LyraWavegru<ComputeType>> wavegru;
+    std::unique_ptr<ConditioningType> conditioning;
+    LoadInParallel({
+        [&]() {
+          wavegru = LyraWavegru<ComputeType>::Create(
+              num_threads, model_path, model_prefix, model,
+              /*use_huge_pages=*/false, dimensions);
+          return wavegru != nullptr;
+        },
+        [&]() {
+          conditioning = absl::make_unique<ConditioningType>(
+              num_features, dimensions.num_cond_hiddens,
+              dimensions.num_gru_hiddens, num_samples_per_hop,
+              num_frames_per_packet, num_threads, model_path, model_prefix,
+              model, thread_pool);
+          return true;
+        },
+    });
+    if (wavegru == nullptr) {
+      LOG(ERROR) << "Could not create wavegru.";
+      return nullptr;
+    }
+    return absl::WrapUnique(
+        new TypedBackend(std::move(wavegru), std::move(conditioning)));
+  }
+
+  void ResetConditioningStart() override { wavegru_->ResetConditioningStart(); }
+
+  void Precompute(csrblocksparse::VectorView<float> input,
+                  int num_threads) override {
+    conditioning_->Precompute(input, num_threads);
+  }
+
+  void PrecomputeNext(csrblocksparse::VectorView<float> input,
+                      int num_threads) override {
+    conditioning_->PrecomputeNext(input, num_threads);
+  }
+
+  void SwapConditioning() override { conditioning_->SwapOutputs(); }
+
+  bool StretchConditioning(int num_columns) override {
+    return wavegru_->conditioning_start() == 0 &&
+           conditioning_->StretchCurrentOutput(num_columns);
+  }
+
+  int num_samples_per_column() const override {
+    return conditioning_->num_samples_per_column();
+  }
+
+  int num_conditioning_samples_left() const override {
+    return conditioning_->num_samples() - wavegru_->conditioning_start();
+  }
+
+  int SampleWithBarrier(csrblocksparse::SpinBarrier* spin_barrier, int tid,
+                        absl::Span<const absl::Span<int16_t>> split_samples,
+                        int num_samples) override {
+    return wavegru_->SampleWithBarrier(spin_barrier, tid, conditioning_.get(),
+                                       split_samples, num_samples);
+  }
+
+  void set_profiler(StageProfiler* profiler) override {
+    wavegru_->set_profiler(profiler);
+  }
+
+  void set_use_adaptive_barrier(bool use_adaptive_barrier) override {
+    wavegru_->set_use_adaptive_barrier(use_adaptive_barrier);
+  }
+
+  void set_prefetch_distance(int prefetch_distance) override {
+    wavegru_->set_prefetch_distance(prefetch_distance);
+  }
+
+  bool set_use_gru_row_pipelining(bool use_gru_row_pipelining) override {
+    return wavegru_->set_use_gru_row_pipelining(use_gru_row_pipelining);
+  }
+
+  int num_split_bands() const override { return wavegru_->num_split_bands(); }
+
+  void ClearState() override {
+    wavegru_->ClearState();
+    conditioning_->ClearState();
+  }
+
+  int64_t ReleaseActivations() override {
+    return wavegru_->ReleaseActivations();
+  }
+
+  bool SaveState(StateWriter* writer) const override {
+    if (!SaveConditioning(writer)) {
+      return false;
+    }
+    wavegru_->SaveState(writer);
+    return true;
+  }
+
+  bool RestoreState(StateReader* reader) override {
+    return RestoreConditioning(reader) &&
+           wavegru_->RestoreState(reader, conditioning_->num_samples());
+  }
+
+  bool SaveConditioning(StateWriter* writer) const override {
+    return conditioning_->SaveState(wavegru_->conditioning_start(), writer);
+  }
+
+  bool RestoreConditioning(StateReader* reader) override {
+    return conditioning_->RestoreState(reader);
+  }
+
+ private:
+  TypedBackend(std::unique_ptr<LyraWavegru<ComputeType>> wavegru,
+               std::unique_ptr<ConditioningType> conditioning)
+      : wavegru_(std::move(wavegru)), conditioning_(std::move(conditioning)) {}
+
+  std::unique_ptr<LyraWavegru<ComputeType>> wavegru_;
+  std::unique_ptr<ConditioningType> conditioning_;
+};
+
 std::unique_ptr<WavegruModelImpl> WavegruModelImpl::Create(
     int num_samples_per_hop, int num_features, int num_frames_per_packet,
-    const ghc::filesystem::path& model_path) {
-  const int kNumThreads = 1;
-  const int kNumCondHiddens = 512;
+    const ghc::filesystem::path& model_path, int num_threads, LyraModel* model,
+    ComputePrecision precision, int output_sample_rate_hz,
+    std::shared_ptr<ThreadPool> thread_pool) {
   const std::string kModelPrefix = "lyra_16khz";
 
-  auto wavegru = LyraWavegru<ComputeType>::Create(
-      kNumThreads, std::string(model_path), kModelPrefix);
-  if (wavegru == nullptr) {
-    LOG(ERROR) << "Could not create wavegru.";
+  if (num_threads < 1) {
+    LOG(ERROR) << "Number of threads has to be positive, but was "
+               << num_threads << ".";
+    return nullptr;
+  }
+  if (num_features > FeatureFrame::kCapacity) {
+    LOG(ERROR) << "A frame holds at most " << FeatureFrame::kCapacity
+               << " features, not " << num_features << ".";
+    return nullptr;
+  }
+  const bool owns_thread_pool = thread_pool == nullptr;
+  if (owns_thread_pool) {
+    thread_pool = ThreadPool::Create(num_threads);
+  } else if (thread_pool->num_threads() < num_threads) {
+    LOG(ERROR) << "The thread pool has " << thread_pool->num_threads()
+               << " threads, but " << num_threads << " are needed.";
+    return nullptr;
+  }
+
+  LOG(INFO) << "Feature size: " << num_features;
+  LOG(INFO) << "Number of samples per hop: " << num_samples_per_hop;
+  LOG(INFO) << "Number of threads: " << num_threads;
+  LOG(INFO) << "Compute precision: " << ComputePrecisionName(precision);
+  LOG(INFO) << "Output sample rate: " << output_sample_rate_hz;
+
+  const auto dimensions_or = ReadModelDimensions(model_path);
+  if (!dimensions_or.ok()) {
+    LOG(ERROR) << dimensions_or.status();
+    return nullptr;
+  }
+  const ModelDimensions& dimensions = dimensions_or.value();
+  LOG(INFO) << "Number of GRU hiddens: " << dimensions.num_gru_hiddens;
+  LOG(INFO) << "Number of conditioning hiddens: "
+            << dimensions.num_cond_hiddens;
+  LOG(INFO) << "Number of split bands: " << dimensions.num_split_bands;
+  // Every step of the sampling loop generates a sample of every band.
+  if (num_samples_per_hop % dimensions.num_split_bands != 0) {
+    LOG(ERROR) << "The " << num_samples_per_hop << " samples of a hop do not "
+               << "split into " << dimensions.num_split_bands << " bands.";
+    return nullptr;
+  }
+
+  // The sparse layers are only read from files, so the layers of a bundle are
+  // loaded from a directory unpacked once per bundle.
+  const ghc::filesystem::path layer_path = ModelLayerDirectory(model_path);
+  if (layer_path.empty()) {
+    LOG(ERROR) << "Could not get the layers of " << model_path << ".";
+    return nullptr;
+  }
+
+  std::unique_ptr<Backend> backend;
+  switch (precision) {
+    case ComputePrecision::kFloat:
+      backend = TypedBackend<float>::Create(
+          num_features, dimensions, num_samples_per_hop,
+          num_frames_per_packet, num_threads, layer_path.string(),
+          kModelPrefix, model, thread_pool.get());
+      break;
+    case ComputePrecision::kFixed16:
+      backend = TypedBackend<csrblocksparse::fixed16_type>::Create(
+          num_features, dimensions, num_samples_per_hop,
+          num_frames_per_packet, num_threads, layer_path.string(),
+          kModelPrefix, model, thread_pool.get());
+      break;
+    case ComputePrecision::kBfloat16:
+      backend = TypedBackend<csrblocksparse::bfloat16>::Create(
+          num_features, dimensions, num_samples_per_hop,
+          num_frames_per_packet, num_threads, layer_path.string(),
+          kModelPrefix, model, thread_pool.get());
+      break;
+  }
+  if (backend == nullptr) {
+    LOG(ERROR) << "Could not create the "
+               << ComputePrecisionName(precision) << " model.";
     return nullptr;
   }
 
-  auto merge_filter = BufferMerger::Create(wavegru->num_split_bands());
+  // The split bands of the model are ordered from low to high, so merging
+  // only the lowest of them gives a lower sample rate. Higher rates that are a
+  // multiple of |kInternalSampleRateHz| are upsampled by the merge filter.
+  const int num_split_bands = backend->num_split_bands();
+  int num_output_bands = num_split_bands;
+  int upsampling_factor = 1;
+  if (output_sample_rate_hz > kInternalSampleRateHz) {
+    upsampling_factor = output_sample_rate_hz / kInternalSampleRateHz;
+  } else if (output_sample_rate_hz > 0) {
+    num_output_bands =
+        num_split_bands * output_sample_rate_hz / kInternalSampleRateHz;
+  }
+  if (num_output_bands * upsampling_factor * kInternalSampleRateHz !=
+      num_split_bands * output_sample_rate_hz) {
+    LOG(ERROR) << "Cannot generate samples at " << output_sample_rate_hz
+               << " Hz.";
+    return nullptr;
+  }
+  auto merge_filter = BufferMerger::Create(num_split_bands, num_output_bands,
+                                           upsampling_factor);
   if (merge_filter == nullptr) {
     LOG(ERROR) << "Could not create merge filter.";
     return nullptr;
   }
   // WrapUnique is used because of private c'tor.
-  return absl::WrapUnique(new WavegruModelImpl(
-      std::string(model_path), kModelPrefix, kNumThreads, num_features,
-      kNumCondHiddens, num_samples_per_hop, num_frames_per_packet,
-      std::move(wavegru), std::move(merge_filter)));
-}
-
-WavegruModelImpl::WavegruModelImpl(
-    const std::string& model_path, const std::string& model_prefix,
-    int num_threads, int num_features, int num_cond_hiddens,
-    int num_samples_per_hop, int num_frames_per_packet,
-    std::unique_ptr<LyraWavegru<ComputeType>> wavegru,
-    std::unique_ptr<BufferMerger> buffer_merger)
+  return absl::WrapUnique(
+      new WavegruModelImpl(num_threads, num_samples_per_hop, num_features,
+                           precision, std::move(thread_pool),
+                           owns_thread_pool, std::move(backend),
+                           std::move(merge_filter)));
+}
+
+WavegruModelImpl::WavegruModelImpl(int num_threads, int num_samples_per_hop,
+                                   int num_features,
+                                   ComputePrecision precision,
+                                   std::shared_ptr<ThreadPool> thread_pool,
+                                   bool owns_thread_pool,
+                                   std::unique_ptr<Backend> backend,
+                                   std::unique_ptr<BufferMerger> buffer_merger)
     : num_threads_(num_threads),
       num_samples_per_hop_(num_samples_per_hop),
-      model_split_samples_(wavegru->num_split_bands()),
-      wavegru_(std::move(wavegru)),
-      buffer_merger_(std::move(buffer_merger)) {
-  // The number of samples generated per band is based on the model, not
-  // requested sampling rate. If the requested sample rate is less than the
-  // model sample rate we just merge less bands.
-  for (auto& band : model_split_samples_) {
-    band.reserve(num_samples_per_hop_ / wavegru_->num_split_bands());
-  }
-  background_threads_.reserve(num_threads - 1);
-  LOG(INFO) << "Feature size: " << num_features;
-  LOG(INFO) << "Number of samples per hop: " << num_samples_per_hop_;
+      num_features_(num_features),
+      precision_(precision),
+      thread_pool_(std::move(thread_pool)),
+      owns_thread_pool_(owns_thread_pool),
+      backend_(std::move(backend)),
+      buffer_merger_(std::move(buffer_merger)),
+      num_samples_to_generate_(0),
+      num_samples_generated_(0),
+      sample_job_([this](csrblocksparse::SpinBarrier* spin_barrier, int tid) {
+        const int num_samples_generated = backend_->SampleWithBarrier(
+            spin_barrier, tid, model_split_samples_, num_samples_to_generate_);
+        if (tid == 0) {
+          num_samples_generated_ = num_samples_generated;
+        }
+      }),
+      has_queued_features_(false),
+      has_speculative_features_(false),
+      num_features_to_precompute_(0),
+      terminate_conditioning_thread_(false) {}
 
-  conditioning_ = absl::make_unique<ConditioningType>(
-      num_features, num_cond_hiddens, wavegru_->num_gru_hiddens(),
-      num_samples_per_hop_, num_frames_per_packet,
-      /*num_threads=*/1, model_path, model_prefix);
-}
+WavegruModelImpl::~WavegruModelImpl() { TerminateConditioningThread(); }
 
-WavegruModelImpl::~WavegruModelImpl() {
-  wavegru_->TerminateThreads();
-  for (const auto& thread : background_threads_) {
-    thread->join();
-  }
+void WavegruModelImpl::AddFeatures(absl::Span<const float> features) {
+  AddFrames(features, /*num_frames=*/1);
 }
 
-void WavegruModelImpl::AddFeatures(const std::vector<float>& features) {
-  const int kNumFrames = 1;
-  csrblocksparse::FatCacheAlignedVector<float> input(features.size(),
-                                                     kNumFrames);
-  std::copy(features.begin(), features.end(), input.data());
-  wavegru_->ResetConditioningStart();
+void WavegruModelImpl::AddFrames(absl::Span<const float> features,
+                                 int num_frames) {
+  // The queued features come first, so they have to be in the causal history
+  // of the conditioning stack before |features| are.
+  ApplyQueuedFeatures();
+  const int num_features = features.size() / num_frames;
+  const csrblocksparse::VectorView<float> input(features.data(), num_features,
+                                                num_frames, num_features);
+  backend_->ResetConditioningStart();
 
-#ifdef BENCHMARK
-  const int64_t conditioning_start_microsecs = absl::ToUnixMicros(absl::Now());
-#endif  // BENCHMARK
+  LYRA_TRACE_SCOPE("Precompute");
+  const absl::Time conditioning_start = absl::Now();
   buffer_merger_->Reset();
-  conditioning_->Precompute(input, /*num_threads=*/1);
-#ifdef BENCHMARK
-  conditioning_timings_microsecs_.push_back(absl::ToUnixMicros(absl::Now()) -
-                                            conditioning_start_microsecs);
-#endif  // BENCHMARK
+  backend_->Precompute(input, num_threads_);
+  AddConditioningNanos(
+      absl::ToInt64Nanoseconds(absl::Now() - conditioning_start));
 }
 
 absl::optional<std::vector<int16_t>> WavegruModelImpl::GenerateSamples(
     int num_samples) {
-  // Launch background threads on the first packet.
-  if (background_threads_.empty() && num_threads_ > 1) {
-    // |tid| = 0 is reserved for the main thread which will be returned to the
-    // caller.
-    LOG(INFO) << "Starting up background threads for wavegru.";
-    for (int tid = 1; tid < num_threads_; ++tid) {
-      auto f = [&, tid]() {
-        wavegru_->SampleThreaded(tid, conditioning_.get(),
-                                 &model_split_samples_, 0);
-      };
-      background_threads_.emplace_back(
-          absl::make_unique<csrblocksparse::Thread>(f));
-    }
+  std::vector<int16_t> samples(num_samples);
+  if (!GenerateSamplesInto(absl::MakeSpan(samples))) {
+    return absl::nullopt;
+  }
+  return samples;
+}
+
+absl::optional<int> WavegruModelImpl::StretchFeatures(int num_samples) {
+  if (has_queued_features_) {
+    LOG(ERROR) << "Features cannot be stretched while others are queued.";
+    return absl::nullopt;
+  }
+  const int num_samples_per_column = backend_->num_samples_per_column();
+  const int num_columns = static_cast<int>(std::round(
+      static_cast<float>(num_samples) / num_samples_per_column));
+  if (!backend_->StretchConditioning(num_columns)) {
+    return absl::nullopt;
+  }
+  return num_columns * num_samples_per_column;
+}
+
+bool WavegruModelImpl::QueueFeatures(absl::Span<const float> features) {
+  StartConditioningThread();
+  absl::MutexLock lock(&conditioning_mutex_);
+  queued_features_.emplace_back(features);
+  ++num_features_to_precompute_;
+  has_queued_features_ = true;
+  return true;
+}
+
+bool WavegruModelImpl::QueueSpeculativeFeatures(
+    absl::Span<const float> features) {
+  if (has_queued_features_) {
+    LOG(ERROR) << "Speculative features cannot be queued after other ones.";
+    return false;
+  }
+  // The conditioning thread is idle, so the stack can be read here.
+  speculation_state_.clear();
+  StateWriter writer(&speculation_state_);
+  if (!backend_->SaveConditioning(&writer)) {
+    return false;
+  }
+  has_speculative_features_ = true;
+  return QueueFeatures(features);
+}
+
+void WavegruModelImpl::DiscardSpeculativeFeatures() {
+  if (!has_speculative_features_) {
+    return;
+  }
+  WaitForQueuedFeatures();
+  StateReader reader(speculation_state_);
+  // Crash ok, the state was saved by this stack.
+  CHECK(backend_->RestoreConditioning(&reader));
+  has_queued_features_ = false;
+  has_speculative_features_ = false;
+}
+
+void WavegruModelImpl::Reset() {
+  ApplyQueuedFeatures();
+  backend_->ClearState();
+  buffer_merger_->ClearState();
+}
+
+bool WavegruModelImpl::SaveState(StateWriter* writer) const {
+  if (has_queued_features_) {
+    return false;
+  }
+  // The layers of other precisions hold as many values of another type.
+  writer->Write(precision_);
+  return backend_->SaveState(writer) && buffer_merger_->SaveState(writer);
+}
+
+bool WavegruModelImpl::RestoreState(StateReader* reader) {
+  // The conditioning thread must be done with any queued features before the
+  // conditioning it writes to is overwritten.
+  ApplyQueuedFeatures();
+  ComputePrecision precision;
+  return reader->Read(&precision) && precision == precision_ &&
+         backend_->RestoreState(reader) && buffer_merger_->RestoreState(reader);
+}
+
+void WavegruModelImpl::WarmUp() {
+  StartConditioningThread();
+  // The frame reads every weight and writes every buffer of the conditioning
+  // stack and the sampling loop, which faults in their pages and brings them
+  // into the caches. Generating the split samples directly leaves the merge
+  // filter alone, whose buffers are small.
+  AddFeatures(FeatureFrame(num_features_, 0.0f));
+  const int num_bands = backend_->num_split_bands();
+  std::vector<int16_t> split_samples(num_samples_per_hop_);
+  std::vector<absl::Span<int16_t>> split_bands;
+  for (int band = 0; band < num_bands; ++band) {
+    split_bands.push_back(absl::MakeSpan(split_samples)
+                              .subspan(band * num_samples_per_hop_ / num_bands,
+                                       num_samples_per_hop_ / num_bands));
+  }
+  GenerateSplitSamples(split_bands);
+  Reset();
+}
+
+bool WavegruModelImpl::Park() {
+  if (has_queued_features_) {
+    return false;
+  }
+  TerminateConditioningThread();
+  backend_->ReleaseActivations();
+  // A shared pool is still used by the other models.
+  if (owns_thread_pool_) {
+    thread_pool_->Park();
   }
+  return true;
+}
 
-  const int kLocalTid = 0;
-#ifdef BENCHMARK
-  const int64_t wavegru_start_microsecs = absl::ToUnixMicros(absl::Now());
-#endif  // BENCHMARK
-
-  // Without specifying the |-> const std::vector<std::vector<int16_t>>&| the
-  // return type of the lambda is inferred and will be a copy of
-  // |model_split_samples_|. The std::function will then incorrectly return a
-  // reference to this local variable which is destroyed as soon as the
-  // std::function call operator is returned.
-  std::function<const std::vector<std::vector<int16_t>>&(int)>
-      sample_generator = [&](int num_samples_to_generate)
-      -> const std::vector<std::vector<int16_t>>& {
-    const int num_samples_to_generate_per_band =
-        num_samples_to_generate / wavegru_->num_split_bands();
-    for (auto& band : model_split_samples_) {
-      band.resize(num_samples_to_generate_per_band);
+void WavegruModelImpl::Unpark() {
+  if (owns_thread_pool_) {
+    thread_pool_->Unpark();
+  }
+}
+
+void WavegruModelImpl::StartConditioningThread() {
+  if (conditioning_thread_ == nullptr) {
+    conditioning_thread_ = absl::make_unique<csrblocksparse::Thread>(
+        [this]() { RunConditioningThread(); });
+  }
+}
+
+void WavegruModelImpl::RunConditioningThread() {
+  while (true) {
+    FeatureFrame features;
+    {
+      absl::MutexLock lock(&conditioning_mutex_);
+      conditioning_mutex_.Await(absl::Condition(
+          this, &WavegruModelImpl::HasQueuedFeaturesOrTerminated));
+      if (terminate_conditioning_thread_) {
+        return;
+      }
+      features = queued_features_.front();
+      queued_features_.pop_front();
+    }
+    {
+      LYRA_TRACE_SCOPE("PrecomputeNext");
+      const absl::Time conditioning_start = absl::Now();
+      backend_->PrecomputeNext(
+          csrblocksparse::VectorView<float>(features.data(), features.size(),
+                                            /*cols=*/1, features.size()),
+          num_threads_);
+      AddConditioningNanos(
+          absl::ToInt64Nanoseconds(absl::Now() - conditioning_start));
     }
 
-    // The background threads will wait at the beginning of their sample
-    // generation loops until the main thread executes this function.
-    int num_samples_generated = wavegru_->SampleThreaded(
-        kLocalTid, conditioning_.get(), &model_split_samples_,
-        num_samples_to_generate);
-    CHECK_EQ(num_samples_generated, num_samples_to_generate)
-        << "Model did not generate the right number of samples.";
-    return model_split_samples_;
-  };
+    absl::MutexLock lock(&conditioning_mutex_);
+    --num_features_to_precompute_;
+  }
+}
+
+void WavegruModelImpl::TerminateConditioningThread() {
+  if (conditioning_thread_ == nullptr) {
+    return;
+  }
+  {
+    absl::MutexLock lock(&conditioning_mutex_);
+    terminate_conditioning_thread_ = true;
+  }
+  conditioning_thread_->join();
+  conditioning_thread_.reset();
+  absl::MutexLock lock(&conditioning_mutex_);
+  terminate_conditioning_thread_ = false;
+}
+
+bool WavegruModelImpl::HasQueuedFeaturesOrTerminated() const {
+  return !queued_features_.empty() || terminate_conditioning_thread_;
+}
+
+bool WavegruModelImpl::QueuedFeaturesArePrecomputed() const {
+  return num_features_to_precompute_ == 0;
+}
+
+void WavegruModelImpl::ApplyQueuedFeatures() {
+  if (!has_queued_features_) {
+    return;
+  }
+  WaitForQueuedFeatures();
+  backend_->SwapConditioning();
+  backend_->ResetConditioningStart();
+  buffer_merger_->Reset();
+  has_queued_features_ = false;
+  has_speculative_features_ = false;
+}
+
+void WavegruModelImpl::WaitForQueuedFeatures() {
+  absl::MutexLock lock(&conditioning_mutex_);
+  conditioning_mutex_.Await(absl::Condition(
+      this, &WavegruModelImpl::QueuedFeaturesArePrecomputed));
+}
+
+StageProfiler* WavegruModelImpl::EnableStageProfiling() {
+  if (profiler_ == nullptr) {
+    profiler_ = absl::make_unique<StageProfiler>(num_threads_);
+    backend_->set_profiler(profiler_.get());
+  }
+  return profiler_.get();
+}
+
+bool WavegruModelImpl::SetAdaptiveBarrierEnabled(bool enabled) {
+  backend_->set_use_adaptive_barrier(enabled);
+  return true;
+}
+
+bool WavegruModelImpl::SetPrefetchDistance(int distance) {
+  if (distance < 0) {
+    LOG(ERROR) << "The prefetch distance has to be non-negative, but is "
+               << distance << ".";
+    return false;
+  }
+  backend_->set_prefetch_distance(distance);
+  return true;
+}
+
+bool WavegruModelImpl::SetGruRowPipeliningEnabled(bool enabled) {
+  return backend_->set_use_gru_row_pipelining(enabled);
+}
+
+bool WavegruModelImpl::GenerateSamplesInto(absl::Span<int16_t> samples) {
+  // Switch to the queued features at the boundary of the current ones. The
+  // background threads are idle here, so they do not read the conditioning
+  // while it is swapped.
+  if (has_queued_features_ && backend_->num_conditioning_samples_left() == 0) {
+    ApplyQueuedFeatures();
+  }
+
+  LYRA_TRACE_SCOPE("BufferAndMerge");
+  const absl::Time sampling_start = absl::Now();
 
   // Only ask the buffer merger for the min of the number of requested samples
   // and the number we actually generated, because the model may have run out of
   // conditioning but the BufferAndMerge retains state until Reset() is called.
-  auto samples = buffer_merger_->BufferAndMerge(sample_generator, num_samples);
-#ifdef BENCHMARK
-  model_timings_microsecs_.push_back(absl::ToUnixMicros(absl::Now()) -
-                                     wavegru_start_microsecs);
-#endif  // BENCHMARK
-  return samples;
+  buffer_merger_->BufferAndMerge(
+      [this](absl::Span<const absl::Span<int16_t>> split_samples) {
+        GenerateSplitSamples(split_samples);
+      },
+      samples);
+  AddSamplingNanos(absl::ToInt64Nanoseconds(absl::Now() - sampling_start));
+  return true;
+}
+
+void WavegruModelImpl::GenerateSplitSamples(
+    absl::Span<const absl::Span<int16_t>> split_samples) {
+  // The number of samples generated per band is based on the model, not the
+  // requested sample rate. If the requested sample rate is less than the model
+  // sample rate the buffer merger just merges less bands.
+  CHECK_EQ(split_samples.size(), backend_->num_split_bands());
+  const int num_samples_to_generate =
+      split_samples.at(0).size() * backend_->num_split_bands();
+
+  model_split_samples_ = split_samples;
+  num_samples_to_generate_ = num_samples_to_generate;
+  thread_pool_->Run(num_threads_, sample_job_);
+  CHECK_EQ(num_samples_generated_, num_samples_to_generate)
+      << "Model did not generate the right number of samples.";
 }
 
 }  // namespace codec
@@ -18,18 +18,27 @@
 #define LYRA_CODEC_WAVEGRU_MODEL_IMPL_H_
 
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "buffer_merger.h"
-#include "causal_convolutional_conditioning.h"
+#include "compute_precision.h"
+#include "feature_frame.h"
 #include "generative_model_interface.h"
 #include "include/ghc/filesystem.hpp"
-#include "lyra_types.h"
-#include "lyra_wavegru.h"
+#include "lyra_config.h"
+#include "lyra_model.h"
 #include "sparse_inference_matrixvector.h"
+#include "stage_profiler.h"
+#include "state_buffer.h"
+#include "thread_pool.h"
 
 namespace chromemedia {
 namespace codec {
@@ -37,47 +46,187 @@ namespace codec {
 // Wraps a custom Wavegru C++ implementation.
 class WavegruModelImpl : public GenerativeModelInterface {
  public:
+  // |num_threads| is the number of threads the sampling loop and the
+  // conditioning stack are split over. The calling thread is always used as
+  // one of them, the others come from |thread_pool|. If it is null a pool of
+  // |num_threads| threads is created for this model, otherwise it must have
+  // at least |num_threads| threads and may be shared with other models.
+  // If |model| is not null the weights are shared with every other instance
+  // created through it. It is only used during creation.
+  // |precision| selects the arithmetic of the model, see |ComputePrecision|.
+  // |num_samples_per_hop| is always at |kInternalSampleRateHz|, but the
+  // samples are generated at |output_sample_rate_hz|. With a lower rate only
+  // the lowest split bands are merged, so that no resampling is needed. It has
+  // to be |kInternalSampleRateHz| divided by a power of 2 no larger than the
+  // number of split bands, e.g. 8000, or multiplied by an integer, e.g. 48000,
+  // in which case the merge filter upsamples in the same pass.
   // Returns a nullptr on failure.
   static std::unique_ptr<WavegruModelImpl> Create(
       int num_samples_per_hop, int num_features, int num_frames_per_packet,
-      const ghc::filesystem::path& model_path);
+      const ghc::filesystem::path& model_path, int num_threads = 1,
+      LyraModel* model = nullptr,
+      ComputePrecision precision = kDefaultComputePrecision,
+      int output_sample_rate_hz = kInternalSampleRateHz,
+      std::shared_ptr<ThreadPool> thread_pool = nullptr);
 
   ~WavegruModelImpl() override;
 
-  void AddFeatures(const std::vector<float>& features) override;
+  // Any queued features are applied before |features|.
+  void AddFeatures(absl::Span<const float> features) override;
+
+  // Runs all |num_frames| frames through the conditioning stack in one
+  // dispatch to the threads, reading them from |features| in place. Any
+  // queued features are applied first.
+  void AddFrames(absl::Span<const float> features, int num_frames) override;
+
+  // Runs the conditioning stack on |features| on a background thread, which is
+  // started on the first call, while the samples of the current features are
+  // generated. The queued features are switched to once all of those were
+  // generated, so a single |GenerateSamples| call must not cross that
+  // boundary. Up to |num_frames_per_packet| features can be queued at a time;
+  // more push the oldest ones out, as with |AddFeatures|.
+  bool QueueFeatures(absl::Span<const float> features) override;
+
+  // Saves the state of the conditioning stack before queuing |features|, and
+  // |DiscardSpeculativeFeatures| restores it once they were precomputed. Fails
+  // if features are queued already.
+  bool QueueSpeculativeFeatures(absl::Span<const float> features) override;
+
+  void DiscardSpeculativeFeatures() override;
+
+  // Repeats or skips columns of the upsampled conditioning, evenly spread
+  // over the features, so |num_samples| is rounded to whole columns of
+  // |num_samples_per_hop| / 8 samples. Fails while features are queued.
+  absl::optional<int> StretchFeatures(int num_samples) override;
 
   absl::optional<std::vector<int16_t>> GenerateSamples(
       int num_samples) override;
 
+  // Writes |samples.size()| samples into |samples|. Apart from the buffers
+  // that grow on the first call, this does not allocate.
+  bool GenerateSamplesInto(absl::Span<int16_t> samples) override;
+
+  // Waits for the queued features, drops them and clears the state of the
+  // conditioning stack, the wavegru and the merge filter, as in a new model.
+  void Reset() override;
+
+  // Saves the conditioning stack, the precomputed conditioning, the wavegru
+  // and the merge filter. Fails while features are queued, since the
+  // conditioning thread may still be running on them.
+  bool SaveState(StateWriter* writer) const override;
+
+  bool RestoreState(StateReader* reader) override;
+
+  // Starts the conditioning thread, runs a frame of zero features through the
+  // conditioning stack and the sampling loop on the threads of the pool, and
+  // then calls |Reset|. See |GenerativeModelInterface::WarmUp|.
+  void WarmUp() override;
+
+  // Stops the conditioning thread, gives the memory of the activations of the
+  // sampling loop back to the system and, unless the thread pool was passed
+  // to |Create| and is shared, stops its threads. The state is kept. Fails
+  // while features are queued.
+  bool Park() override;
+
+  // Starts the threads of the pool again. The conditioning thread is
+  // restarted by the next |QueueFeatures|.
+  void Unpark() override;
+
+  // Records the stages of the sampling loop of all |num_threads_| threads.
+  StageProfiler* EnableStageProfiling() override;
+
+  // Must not be called while samples are generated.
+  bool SetAdaptiveBarrierEnabled(bool enabled) override;
+
+  // Must not be called while samples are generated.
+  bool SetPrefetchDistance(int distance) override;
+
+  // Must not be called while samples are generated.
+  bool SetGruRowPipeliningEnabled(bool enabled) override;
+
+  ComputePrecision precision() const { return precision_; }
+
  private:
-#ifdef USE_FIXED16
-  using ComputeType = csrblocksparse::fixed16_type;
-#elif USE_BFLOAT16
-  using ComputeType = csrblocksparse::bfloat16;
-#else
-  using ComputeType = float;
-#endif  // USE_FIXED16
-  using ConditioningType =
-      CausalConvolutionalConditioning<ConditioningTypes<ComputeType>>;
+  // The wavegru and the conditioning stack, which are the only parts of the
+  // model that depend on the |ComputePrecision|. Both are defined in the .cc
+  // so that every precision is compiled into this one library.
+  class Backend;
+  template <typename ComputeType>
+  class TypedBackend;
 
   WavegruModelImpl() = delete;
-  WavegruModelImpl(const std::string& model_path,
-                   const std::string& model_prefix, int num_threads,
-                   int num_features, int num_cond_hiddens,
-                   int num_samples_per_hop, int num_frames_per_packet,
-                   std::unique_ptr<LyraWavegru<ComputeType>> wavegru,
+  WavegruModelImpl(int num_threads, int num_samples_per_hop,
+                   int num_features, ComputePrecision precision,
+                   std::shared_ptr<ThreadPool> thread_pool,
+                   bool owns_thread_pool,
+                   std::unique_ptr<Backend> backend,
                    std::unique_ptr<BufferMerger> buffer_merger);
 
+  // Runs the model on the threads of |thread_pool_| to fill each band of
+  // |split_samples|, which are provided by |buffer_merger_|.
+  void GenerateSplitSamples(
+      absl::Span<const absl::Span<int16_t>> split_samples);
+
+  // Starts |conditioning_thread_| unless it is running.
+  void StartConditioningThread();
+  // Runs the conditioning stack on the features given to |QueueFeatures|
+  // until |TerminateConditioningThread| is called.
+  void RunConditioningThread();
+  // Stops |conditioning_thread_| so that |StartConditioningThread| can start
+  // it again. Does nothing unless it is running.
+  void TerminateConditioningThread();
+
+  // Blocks until the queued features were precomputed and switches to them.
+  // Does nothing if no features are queued.
+  void ApplyQueuedFeatures();
+
+  // Blocks until the queued features were precomputed.
+  void WaitForQueuedFeatures();
+
+  bool HasQueuedFeaturesOrTerminated() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(conditioning_mutex_);
+  bool QueuedFeaturesArePrecomputed() const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(conditioning_mutex_);
+
   const int num_threads_;
   const int num_samples_per_hop_;
+  const int num_features_;
+  const ComputePrecision precision_;
 
-  // The direct output samples from the model in the split domain.
-  std::vector<std::vector<int16_t>> model_split_samples_;
-  std::vector<std::unique_ptr<csrblocksparse::Thread>> background_threads_;
 
-  std::unique_ptr<LyraWavegru<ComputeType>> wavegru_;
-  std::unique_ptr<ConditioningType> conditioning_;
+  // Declared before |backend_|, which points to them, so they outlive it.
+  std::unique_ptr<StageProfiler> profiler_;
+  std::shared_ptr<ThreadPool> thread_pool_;
+  // Whether |thread_pool_| was created for this model, which may park it.
+  const bool owns_thread_pool_;
+  std::unique_ptr<Backend> backend_;
   std::unique_ptr<BufferMerger> buffer_merger_;
+
+  // Arguments and result of |sample_job_|, which runs the sampling loop on
+  // every thread of |thread_pool_|. Built once so that no std::function is
+  // constructed per call. |model_split_samples_| are the views of the bands
+  // the model writes its direct output samples to in the split domain.
+  absl::Span<const absl::Span<int16_t>> model_split_samples_;
+  int num_samples_to_generate_;
+  int num_samples_generated_;
+  const ThreadPool::Function sample_job_;
+
+  // Whether features were queued since they were last applied. Only accessed
+  // by the thread that calls the public methods.
+  bool has_queued_features_;
+  // Whether the queued features came from |QueueSpeculativeFeatures|, and the
+  // state of the conditioning stack before them.
+  bool has_speculative_features_;
+  std::vector<uint8_t> speculation_state_;
+  // Features handed to |conditioning_thread_|, oldest first.
+  absl::Mutex conditioning_mutex_;
+  std::deque<FeatureFrame> queued_features_
+      ABSL_GUARDED_BY(conditioning_mutex_);
+  // The number of queued features that were not yet precomputed, including
+  // the ones being precomputed.
+  int num_features_to_precompute_ ABSL_GUARDED_BY(conditioning_mutex_);
+  bool terminate_conditioning_thread_ ABSL_GUARDED_BY(conditioning_mutex_);
+  std::unique_ptr<csrblocksparse::Thread> conditioning_thread_;
 };
 
 }  // namespace codec
@@ -20,28 +20,32 @@
 #include <vector>
 
 // placeholder for get runfiles header.
+#include "absl/types/span.h"
+#include "compute_precision.h"
 #include "gtest/gtest.h"
 #include "include/ghc/filesystem.hpp"
 #include "lyra_config.h"
+#include "stage_profiler.h"
+#include "thread_pool.h"
 
 namespace chromemedia {
 namespace codec {
 namespace {
 
-class WavegruModelImplTest : public testing::Test {
+class WavegruModelImplTest : public testing::TestWithParam<int> {
  protected:
   WavegruModelImplTest()
       : num_samples_per_hop_(GetNumSamplesPerHop(kInternalSampleRateHz)),
         model_(WavegruModelImpl::Create(
             num_samples_per_hop_, kNumFeatures, kNumFramesPerPacket,
-            ghc::filesystem::current_path() / "wavegru")) {}
+            ghc::filesystem::current_path() / "wavegru", GetParam())) {}
   const int num_samples_per_hop_;
   std::unique_ptr<WavegruModelImpl> model_;
 };
 
-TEST_F(WavegruModelImplTest, ModelExists) { EXPECT_NE(model_, nullptr); }
+TEST_P(WavegruModelImplTest, ModelExists) { EXPECT_NE(model_, nullptr); }
 
-TEST_F(WavegruModelImplTest, RunModelExpectedOutputSize) {
+TEST_P(WavegruModelImplTest, RunModelExpectedOutputSize) {
   std::vector<float> features(kNumFeatures);
 
   model_->AddFeatures(features);
@@ -52,7 +56,7 @@ TEST_F(WavegruModelImplTest, RunModelExpectedOutputSize) {
             GetNumSamplesPerHop(kInternalSampleRateHz));
 }
 
-TEST_F(WavegruModelImplTest, AddFeaturesAndGenerateSamplesExpectedOutputSize) {
+TEST_P(WavegruModelImplTest, AddFeaturesAndGenerateSamplesExpectedOutputSize) {
   std::vector<float> features(kNumFeatures);
   model_->AddFeatures(features);
 
@@ -63,7 +67,7 @@ TEST_F(WavegruModelImplTest, AddFeaturesAndGenerateSamplesExpectedOutputSize) {
   }
 }
 
-TEST_F(WavegruModelImplTest, GenerateMoreThanNumSamplesPerHopExpectDeath) {
+TEST_P(WavegruModelImplTest, GenerateMoreThanNumSamplesPerHopExpectDeath) {
   std::vector<float> features(kNumFeatures);
   model_->AddFeatures(features);
 
@@ -79,6 +83,363 @@ TEST_F(WavegruModelImplTest, GenerateMoreThanNumSamplesPerHopExpectDeath) {
   }
 }
 
+TEST_P(WavegruModelImplTest, StageProfilingRecordsEveryThread) {
+  StageProfiler* profiler = model_->EnableStageProfiling();
+  ASSERT_NE(profiler, nullptr);
+  EXPECT_EQ(profiler, model_->EnableStageProfiling());
+  ASSERT_EQ(profiler->num_threads(), GetParam());
+
+  std::vector<float> features(kNumFeatures);
+  model_->AddFeatures(features);
+  ASSERT_TRUE(model_->GenerateSamples(num_samples_per_hop_).has_value());
+
+  // The sampling loop runs once per |kNumSplitBands| = 4 samples.
+  const int expected_steps = num_samples_per_hop_ / 4;
+  for (int tid = 0; tid < GetParam(); ++tid) {
+    EXPECT_EQ(profiler->Summarize(SamplingStage::kGruMatVec, tid).count,
+              expected_steps);
+    EXPECT_GT(profiler->Summarize(SamplingStage::kBarrierWait, tid).count, 0);
+  }
+  EXPECT_EQ(profiler->Summarize(SamplingStage::kSampling, 0).count,
+            expected_steps);
+}
+
+TEST_P(WavegruModelImplTest, QueuedFeaturesMatchAddedFeatures) {
+  auto reference_model = WavegruModelImpl::Create(
+      num_samples_per_hop_, kNumFeatures, kNumFramesPerPacket,
+      ghc::filesystem::current_path() / "wavegru", GetParam());
+  ASSERT_NE(reference_model, nullptr);
+  const std::vector<std::vector<float>> feature_frames = {
+      std::vector<float>(kNumFeatures, 0.0f),
+      std::vector<float>(kNumFeatures, 1.0f),
+      std::vector<float>(kNumFeatures, -1.0f)};
+
+  // The first features are added, the others queued while the samples of the
+  // previous ones are generated.
+  const int num_frames = feature_frames.size();
+  model_->AddFeatures(feature_frames[0]);
+  for (int i = 0; i < num_frames; ++i) {
+    reference_model->AddFeatures(feature_frames[i]);
+    const auto expected_or =
+        reference_model->GenerateSamples(num_samples_per_hop_);
+    ASSERT_TRUE(expected_or.has_value());
+
+    const int num_first_samples = num_samples_per_hop_ / 2;
+    auto first_samples_or = model_->GenerateSamples(num_first_samples);
+    ASSERT_TRUE(first_samples_or.has_value());
+    if (i + 1 < num_frames) {
+      ASSERT_TRUE(model_->QueueFeatures(feature_frames[i + 1]));
+    }
+    const auto second_samples_or =
+        model_->GenerateSamples(num_samples_per_hop_ - num_first_samples);
+    ASSERT_TRUE(second_samples_or.has_value());
+    first_samples_or->insert(first_samples_or->end(),
+                             second_samples_or->begin(),
+                             second_samples_or->end());
+    EXPECT_EQ(first_samples_or.value(), expected_or.value());
+  }
+}
+
+TEST_P(WavegruModelImplTest, AddFramesMatchesAddFeatures) {
+  const int kNumFrames = 3;
+  auto frame_by_frame_model = WavegruModelImpl::Create(
+      num_samples_per_hop_, kNumFeatures, kNumFrames,
+      ghc::filesystem::current_path() / "wavegru", GetParam());
+  auto all_frames_model = WavegruModelImpl::Create(
+      num_samples_per_hop_, kNumFeatures, kNumFrames,
+      ghc::filesystem::current_path() / "wavegru", GetParam());
+  ASSERT_NE(frame_by_frame_model, nullptr);
+  ASSERT_NE(all_frames_model, nullptr);
+  std::vector<float> features(kNumFrames * kNumFeatures);
+  for (int i = 0; i < features.size(); ++i) {
+    features[i] = (i % 7) / 7.0f;
+  }
+
+  for (int i = 0; i < kNumFrames; ++i) {
+    frame_by_frame_model->AddFeatures(
+        std::vector<float>(features.begin() + i * kNumFeatures,
+                           features.begin() + (i + 1) * kNumFeatures));
+  }
+  all_frames_model->AddFrames(absl::MakeConstSpan(features), kNumFrames);
+
+  const auto expected_or =
+      frame_by_frame_model->GenerateSamples(kNumFrames * num_samples_per_hop_);
+  const auto samples_or =
+      all_frames_model->GenerateSamples(kNumFrames * num_samples_per_hop_);
+  ASSERT_TRUE(expected_or.has_value());
+  ASSERT_TRUE(samples_or.has_value());
+  EXPECT_EQ(samples_or.value(), expected_or.value());
+}
+
+TEST_P(WavegruModelImplTest, WarmedUpModelMatchesNewModel) {
+  auto warmed_up_model = WavegruModelImpl::Create(
+      num_samples_per_hop_, kNumFeatures, kNumFramesPerPacket,
+      ghc::filesystem::current_path() / "wavegru", GetParam());
+  ASSERT_NE(model_, nullptr);
+  ASSERT_NE(warmed_up_model, nullptr);
+  warmed_up_model->WarmUp();
+  std::vector<float> features(kNumFeatures);
+  for (int i = 0; i < features.size(); ++i) {
+    features[i] = (i % 5) / 5.0f;
+  }
+
+  for (int hop = 0; hop < 2; ++hop) {
+    model_->AddFeatures(features);
+    warmed_up_model->AddFeatures(features);
+    const auto expected_or = model_->GenerateSamples(num_samples_per_hop_);
+    const auto samples_or =
+        warmed_up_model->GenerateSamples(num_samples_per_hop_);
+    ASSERT_TRUE(expected_or.has_value());
+    ASSERT_TRUE(samples_or.has_value());
+    EXPECT_EQ(samples_or.value(), expected_or.value());
+  }
+}
+
+TEST_P(WavegruModelImplTest, ResetMatchesNewModel) {
+  auto reset_model = WavegruModelImpl::Create(
+      num_samples_per_hop_, kNumFeatures, kNumFramesPerPacket,
+      ghc::filesystem::current_path() / "wavegru", GetParam());
+  ASSERT_NE(model_, nullptr);
+  ASSERT_NE(reset_model, nullptr);
+  const std::vector<float> features(kNumFeatures, 0.5f);
+  reset_model->AddFeatures(features);
+  ASSERT_TRUE(reset_model->GenerateSamples(num_samples_per_hop_).has_value());
+  reset_model->QueueFeatures(features);
+  reset_model->Reset();
+
+  model_->AddFeatures(features);
+  reset_model->AddFeatures(features);
+  const auto expected_or = model_->GenerateSamples(num_samples_per_hop_);
+  const auto samples_or = reset_model->GenerateSamples(num_samples_per_hop_);
+  ASSERT_TRUE(expected_or.has_value());
+  ASSERT_TRUE(samples_or.has_value());
+  EXPECT_EQ(samples_or.value(), expected_or.value());
+}
+
+TEST_P(WavegruModelImplTest, DiscardedSpeculativeFeaturesLeaveNoTrace) {
+  auto speculating_model = WavegruModelImpl::Create(
+      num_samples_per_hop_, kNumFeatures, kNumFramesPerPacket,
+      ghc::filesystem::current_path() / "wavegru", GetParam());
+  ASSERT_NE(model_, nullptr);
+  ASSERT_NE(speculating_model, nullptr);
+  const std::vector<float> features(kNumFeatures, 0.5f);
+  const std::vector<float> speculative_features(kNumFeatures, 0.25f);
+  const std::vector<float> next_features(kNumFeatures, 0.75f);
+  model_->AddFeatures(features);
+  speculating_model->AddFeatures(features);
+  // Half of the current hop is generated while the speculative features are
+  // precomputed, and the other half after they were dropped.
+  const int num_first_samples = num_samples_per_hop_ / 2;
+  ASSERT_TRUE(model_->GenerateSamples(num_samples_per_hop_).has_value());
+  ASSERT_TRUE(
+      speculating_model->GenerateSamples(num_first_samples).has_value());
+  ASSERT_TRUE(
+      speculating_model->QueueSpeculativeFeatures(speculative_features));
+  EXPECT_FALSE(speculating_model->QueueSpeculativeFeatures(features));
+  speculating_model->DiscardSpeculativeFeatures();
+  ASSERT_TRUE(speculating_model
+                  ->GenerateSamples(num_samples_per_hop_ - num_first_samples)
+                  .has_value());
+
+  model_->AddFeatures(next_features);
+  speculating_model->AddFeatures(next_features);
+  const auto expected_or = model_->GenerateSamples(num_samples_per_hop_);
+  const auto samples_or =
+      speculating_model->GenerateSamples(num_samples_per_hop_);
+  ASSERT_TRUE(expected_or.has_value());
+  ASSERT_TRUE(samples_or.has_value());
+  EXPECT_EQ(samples_or.value(), expected_or.value());
+}
+
+TEST_P(WavegruModelImplTest, ParkedModelContinuesWhereItStopped) {
+  auto parked_model = WavegruModelImpl::Create(
+      num_samples_per_hop_, kNumFeatures, kNumFramesPerPacket,
+      ghc::filesystem::current_path() / "wavegru", GetParam());
+  ASSERT_NE(model_, nullptr);
+  ASSERT_NE(parked_model, nullptr);
+  const std::vector<std::vector<float>> feature_frames = {
+      std::vector<float>(kNumFeatures, 0.25f),
+      std::vector<float>(kNumFeatures, 0.5f),
+      std::vector<float>(kNumFeatures, 0.75f)};
+
+  // The model is parked between every two hops, once with features queued,
+  // which it cannot be then, and resumes on its own or through |Unpark|.
+  for (int i = 0; i < feature_frames.size(); ++i) {
+    model_->AddFeatures(feature_frames[i]);
+    parked_model->AddFeatures(feature_frames[i]);
+    const auto expected_or = model_->GenerateSamples(num_samples_per_hop_);
+    const auto samples_or = parked_model->GenerateSamples(num_samples_per_hop_);
+    ASSERT_TRUE(expected_or.has_value());
+    ASSERT_TRUE(samples_or.has_value());
+    EXPECT_EQ(samples_or.value(), expected_or.value());
+
+    if (i == 1) {
+      ASSERT_TRUE(parked_model->QueueFeatures(feature_frames[i]));
+      EXPECT_FALSE(parked_model->Park());
+      parked_model->Reset();
+      model_->Reset();
+    }
+    EXPECT_TRUE(parked_model->Park());
+    if (i == 0) {
+      parked_model->Unpark();
+    }
+  }
+}
+
+TEST_P(WavegruModelImplTest, GruRowPipeliningMatchesBarrier) {
+  auto pipelined_model = WavegruModelImpl::Create(
+      num_samples_per_hop_, kNumFeatures, kNumFramesPerPacket,
+      ghc::filesystem::current_path() / "wavegru", GetParam());
+  ASSERT_NE(model_, nullptr);
+  ASSERT_NE(pipelined_model, nullptr);
+  // Only fails if the rows of the threads are not contiguous.
+  if (!pipelined_model->SetGruRowPipeliningEnabled(true)) {
+    GTEST_SKIP() << "The GRU rows of the threads are not known.";
+  }
+
+  // Enough steps for a race on the GRU state to show in the samples, which
+  // feed back as the AR input.
+  constexpr int kNumHops = 10;
+  std::vector<float> features(kNumFeatures);
+  for (int hop = 0; hop < kNumHops; ++hop) {
+    for (int i = 0; i < features.size(); ++i) {
+      features[i] = ((i + hop) % 7) / 7.0f;
+    }
+    model_->AddFeatures(features);
+    pipelined_model->AddFeatures(features);
+    const auto expected_or = model_->GenerateSamples(num_samples_per_hop_);
+    const auto samples_or =
+        pipelined_model->GenerateSamples(num_samples_per_hop_);
+    ASSERT_TRUE(expected_or.has_value());
+    ASSERT_TRUE(samples_or.has_value());
+    ASSERT_EQ(samples_or.value(), expected_or.value()) << "hop " << hop;
+  }
+}
+
+TEST_P(WavegruModelImplTest, StretchedFeaturesPlayOutLongerOrShorter) {
+  ASSERT_NE(model_, nullptr);
+  const std::vector<float> features(kNumFeatures, 0.5f);
+  // A column of the conditioning is an eighth of a hop, to which the stretch
+  // is rounded.
+  const int num_samples_per_column = num_samples_per_hop_ / 8;
+  for (const int num_stretch_columns : {2, -2}) {
+    model_->AddFeatures(features);
+    const auto stretched_or = model_->StretchFeatures(
+        num_stretch_columns * num_samples_per_column + 1);
+    ASSERT_TRUE(stretched_or.has_value());
+    EXPECT_EQ(stretched_or.value(),
+              num_stretch_columns * num_samples_per_column);
+    const auto samples_or =
+        model_->GenerateSamples(num_samples_per_hop_ + stretched_or.value());
+    ASSERT_TRUE(samples_or.has_value());
+    // Once samples were generated the features cannot be stretched anymore.
+    EXPECT_FALSE(model_->StretchFeatures(num_samples_per_column).has_value());
+  }
+  // Nor can they be while others are queued.
+  model_->AddFeatures(features);
+  ASSERT_TRUE(model_->QueueFeatures(features));
+  EXPECT_FALSE(model_->StretchFeatures(num_samples_per_column).has_value());
+}
+
+INSTANTIATE_TEST_SUITE_P(NumThreads, WavegruModelImplTest,
+                         testing::Values(1, 2, 4));
+
+class WavegruModelImplPrecisionTest
+    : public testing::TestWithParam<ComputePrecision> {};
+
+TEST_P(WavegruModelImplPrecisionTest, GeneratesSamplesWithEveryPrecision) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  auto model = WavegruModelImpl::Create(
+      num_samples_per_hop, kNumFeatures, kNumFramesPerPacket,
+      ghc::filesystem::current_path() / "wavegru", /*num_threads=*/1,
+      /*model=*/nullptr, GetParam());
+  ASSERT_NE(model, nullptr);
+  EXPECT_EQ(model->precision(), GetParam());
+
+  model->AddFeatures(std::vector<float>(kNumFeatures));
+  auto samples_or = model->GenerateSamples(num_samples_per_hop);
+  ASSERT_TRUE(samples_or.has_value());
+  EXPECT_EQ(samples_or->size(), num_samples_per_hop);
+}
+
+INSTANTIATE_TEST_SUITE_P(Precisions, WavegruModelImplPrecisionTest,
+                         testing::Values(ComputePrecision::kFloat,
+                                         ComputePrecision::kFixed16,
+                                         ComputePrecision::kBfloat16));
+
+TEST(WavegruModelImplNarrowband, GeneratesOneHopAtTheOutputSampleRate) {
+  constexpr int kOutputSampleRateHz = 8000;
+  auto model = WavegruModelImpl::Create(
+      GetNumSamplesPerHop(kInternalSampleRateHz), kNumFeatures,
+      kNumFramesPerPacket, ghc::filesystem::current_path() / "wavegru",
+      /*num_threads=*/1, /*model=*/nullptr, kDefaultComputePrecision,
+      kOutputSampleRateHz);
+  ASSERT_NE(model, nullptr);
+
+  model->AddFeatures(std::vector<float>(kNumFeatures));
+  const int num_samples_per_hop = GetNumSamplesPerHop(kOutputSampleRateHz);
+  auto samples_or = model->GenerateSamples(num_samples_per_hop);
+  ASSERT_TRUE(samples_or.has_value());
+  EXPECT_EQ(samples_or->size(), num_samples_per_hop);
+}
+
+TEST(WavegruModelImplCreate, InvalidOutputSampleRateReturnsNullptr) {
+  for (const int invalid_sample_rate_hz : {0, 12000, 32000}) {
+    EXPECT_EQ(WavegruModelImpl::Create(
+                  GetNumSamplesPerHop(kInternalSampleRateHz), kNumFeatures,
+                  kNumFramesPerPacket,
+                  ghc::filesystem::current_path() / "wavegru",
+                  /*num_threads=*/1, /*model=*/nullptr,
+                  kDefaultComputePrecision, invalid_sample_rate_hz),
+              nullptr);
+  }
+}
+
+TEST(WavegruModelImplThreadPool, ModelsShareOnePool) {
+  const int num_samples_per_hop = GetNumSamplesPerHop(kInternalSampleRateHz);
+  std::shared_ptr<ThreadPool> thread_pool = ThreadPool::Create(4);
+  ASSERT_NE(thread_pool, nullptr);
+  std::vector<std::unique_ptr<WavegruModelImpl>> models;
+  for (const int num_threads : {2, 4}) {
+    models.push_back(WavegruModelImpl::Create(
+        num_samples_per_hop, kNumFeatures, kNumFramesPerPacket,
+        ghc::filesystem::current_path() / "wavegru", num_threads,
+        /*model=*/nullptr, kDefaultComputePrecision, kInternalSampleRateHz,
+        thread_pool));
+    ASSERT_NE(models.back(), nullptr);
+  }
+
+  for (auto& model : models) {
+    model->AddFeatures(std::vector<float>(kNumFeatures));
+  }
+  for (auto& model : models) {
+    auto samples_or = model->GenerateSamples(num_samples_per_hop);
+    ASSERT_TRUE(samples_or.has_value());
+    EXPECT_EQ(samples_or->size(), num_samples_per_hop);
+  }
+}
+
+TEST(WavegruModelImplCreate, TooSmallThreadPoolReturnsNullptr) {
+  EXPECT_EQ(WavegruModelImpl::Create(
+                GetNumSamplesPerHop(kInternalSampleRateHz), kNumFeatures,
+                kNumFramesPerPacket,
+                ghc::filesystem::current_path() / "wavegru",
+                /*num_threads=*/4, /*model=*/nullptr, kDefaultComputePrecision,
+                kInternalSampleRateHz, ThreadPool::Create(2)),
+            nullptr);
+}
+
+TEST(WavegruModelImplCreate, InvalidNumThreadsReturnsNullptr) {
+  for (const int invalid_num_threads : {-1, 0}) {
+    EXPECT_EQ(WavegruModelImpl::Create(
+                  GetNumSamplesPerHop(kInternalSampleRateHz), kNumFeatures,
+                  kNumFramesPerPacket,
+                  ghc::filesystem::current_path() / "wavegru",
+                  invalid_num_threads),
+              nullptr);
+  }
+}
+
 }  // namespace
 }  // namespace codec
 }  // namespace chromemedia